@@ -249,6 +249,7 @@ Client::Client(Messenger *m, MonClient *mc)
     monclient(mc), messenger(m), whoami(mc->get_global_id()),
     cap_epoch_barrier(0),
     last_tid(0), oldest_tid(0), last_flush_tid(1),
+    num_async_dirops(0),
     initialized(false), authenticated(false),
     mounted(false), unmounting(false),
     local_osd(-1), local_osd_epoch(0),
@@ -1622,6 +1623,14 @@ int Client::make_request(MetaRequest *request,
 {
   int r = 0;
 
+  // the mds doesn't know an async created inode before the create got there
+  if (request->inode())
+    wait_async_create(request->inode());
+  if (request->old_inode())
+    wait_async_create(request->old_inode());
+  if (request->other_inode())
+    wait_async_create(request->other_inode());
+
   // assign a unique tid
   ceph_tid_t tid = ++last_tid;
   request->set_tid(tid);
@@ -1776,6 +1785,156 @@ void Client::unregister_request(MetaRequest *req)
   put_request(req);
 }
 
+/*
+ * Async dirops
+ *
+ * While we hold Fx on a directory whose dentries we all know, nobody else
+ * can change it, so creates and unlinks in it are applied to our cache and
+ * answered right away.  The requests are sent to the mds without waiting
+ * for the replies, and creates name an ino the mds delegated to us.  An
+ * op that fails sets async_err on the directory (and the new inode), which
+ * fsync and close report; fsync of either waits for the ops to be safe.
+ */
+MetaSession *Client::get_async_dirop_session(Inode *dir)
+{
+  if (!cct->_conf->client_async_dirops ||
+      num_async_dirops >= cct->_conf->client_async_dirops_max)
+    return NULL;
+  if (dir->snapid != CEPH_NOSNAP || !(dir->flags & I_COMPLETE) ||
+      !dir->auth_cap || !dir->caps_issued_mask(CEPH_CAP_FILE_EXCL))
+    return NULL;
+  MetaSession *session = dir->auth_cap->session;
+  if (session->state != MetaSession::STATE_OPEN)
+    return NULL;
+  return session;
+}
+
+void Client::send_async_request(MetaRequest *request, MetaSession *session,
+				const UserPerm& perms)
+{
+  ceph_tid_t tid = ++last_tid;
+  request->set_tid(tid);
+  request->op_stamp = ceph_clock_now();
+  request->async = true;
+
+  mds_requests[tid] = request->get();
+  if (oldest_tid == 0)
+    oldest_tid = tid;
+  request->set_caller_perms(perms);
+  request->set_oldest_client_tid(oldest_tid);
+  num_async_dirops++;
+
+  // fsync waits for these like for unsafe ops
+  request->inode()->unsafe_ops.push_back(&request->unsafe_dir_item);
+  if (request->async_inode)
+    request->async_inode->unsafe_ops.push_back(&request->unsafe_target_item);
+
+  ldout(cct, 10) << "send_async_request tid " << tid << " "
+		 << ceph_mds_op_name(request->get_op()) << " "
+		 << request->get_filepath() << dendl;
+  send_request(request, session);
+}
+
+void Client::resend_async_request(MetaRequest *request)
+{
+  mds_rank_t mds = choose_target_mds(request);
+  if (mds != MDS_RANK_NONE && have_open_session(mds)) {
+    send_request(request, mds_sessions[mds]);
+    return;
+  }
+  // nobody is waiting to open a session for it
+  ldout(cct, 10) << "resend_async_request tid " << request->get_tid()
+		 << " no session to mds." << mds << dendl;
+  request->item.remove_myself();
+  abort_async_request(request, -EIO);
+}
+
+void Client::async_dirop_failed(MetaRequest *request, int r)
+{
+  ldout(cct, 1) << "async " << ceph_mds_op_name(request->get_op()) << " "
+		<< request->get_filepath() << " failed: " << cpp_strerror(r)
+		<< dendl;
+
+  // what we told the application no longer holds
+  Inode *dir = request->inode();
+  dir->async_err = r;
+  dir->dir_release_count++;
+  clear_dir_complete_and_ordered(dir, true);
+
+  Inode *in = request->async_inode.get();
+  if (in) {
+    in->async_err = r;
+    while (!in->dn_set.empty())
+      unlink(*in->dn_set.begin(), true, true);  // keep dir, dentry
+    signal_cond_list(in->waitfor_caps);
+  }
+}
+
+void Client::finish_async_request(MetaRequest *request)
+{
+  MClientReply *reply = request->reply;
+  request->reply = NULL;
+  int r = reply->get_result();
+
+  Inode *in = request->async_inode.get();
+  if (r >= 0 && in && request->target != request->async_inode) {
+    // the mds didn't create it with the ino we gave it
+    r = -EIO;
+  }
+  if (r < 0) {
+    async_dirop_failed(request, r);
+  } else {
+    request->success = true;
+    if (in)
+      in->flags &= ~I_ASYNC_CREATE;
+  }
+  num_async_dirops--;
+
+  utime_t lat = ceph_clock_now();
+  lat -= request->sent_stamp;
+  logger->tinc(l_c_lat, lat);
+  logger->tinc(l_c_reply, lat);
+
+  put_request(request);  // ours
+  reply->put();
+}
+
+void Client::abort_async_request(MetaRequest *request, int r)
+{
+  async_dirop_failed(request, r);
+  request->unsafe_dir_item.remove_myself();
+  request->unsafe_target_item.remove_myself();
+  signal_cond_list(request->waitfor_safe);
+  num_async_dirops--;
+  unregister_request(request);
+  put_request(request);  // ours
+}
+
+void Client::wait_async_create(Inode *in)
+{
+  while ((in->flags & I_ASYNC_CREATE) && !in->async_err &&
+	 !in->is_any_caps()) {
+    ldout(cct, 10) << "waiting for async create of " << *in << dendl;
+    wait_on_list(in->waitfor_caps);
+  }
+}
+
+void Client::got_delegated_inos(MetaSession *session, MClientReply *reply)
+{
+  // the created ino, then the inos delegated to us
+  bufferlist::iterator p = reply->get_extra_bl().begin();
+  if (p.get_remaining() <= sizeof(inodeno_t))
+    return;
+  inodeno_t created_ino;
+  interval_set<inodeno_t> inos;
+  ::decode(created_ino, p);
+  ::decode(inos, p);
+  if (inos.empty())
+    return;
+  ldout(cct, 10) << "mds." << session->mds_num << " delegated " << inos << dendl;
+  session->delegated_inos.union_of(inos);
+}
+
 void Client::put_request(MetaRequest *request)
 {
   if (request->_put()) {
@@ -2226,7 +2385,10 @@ void Client::handle_client_request_forward(MClientRequestForward *fwd)
   request->item.remove_myself();
   request->num_fwd = fwd->get_num_fwd();
   request->resend_mds = fwd->get_dest_mds();
-  request->caller_cond->Signal();
+  if (request->async)
+    resend_async_request(request);
+  else
+    request->caller_cond->Signal();
 
   fwd->put();
 }
@@ -2286,7 +2448,10 @@ void Client::handle_client_reply(MClientReply *reply)
 	 request->sent_on_mseq == in->caps[request->resend_mds]->mseq)) {
       // have to return ESTALE
     } else {
-      request->caller_cond->Signal();
+      if (request->async)
+	resend_async_request(request);
+      else
+	request->caller_cond->Signal();
       reply->put();
       return;
     }
@@ -2296,6 +2461,8 @@ void Client::handle_client_reply(MClientReply *reply)
   assert(request->reply == NULL);
   request->reply = reply;
   insert_trace(request, session);
+  if ((request->head.flags & CEPH_MDS_FLAG_DELEG_INOS) && !request->got_unsafe)
+    got_delegated_inos(session, reply);
 
   // Handle unsafe reply
   if (!is_safe) {
@@ -2314,7 +2481,10 @@ void Client::handle_client_reply(MClientReply *reply)
 
   // Only signal the caller once (on the first reply):
   // Either its an unsafe reply, or its a safe reply and no unsafe reply was sent.
-  if (!is_safe || !request->got_unsafe) {
+  if (request->async) {
+    if (!is_safe || !request->got_unsafe)
+      finish_async_request(request);  // the registry still holds a ref
+  } else if (!is_safe || !request->got_unsafe) {
     Cond cond;
     request->dispatch_cond = &cond;
 
@@ -2332,7 +2502,7 @@ void Client::handle_client_reply(MClientReply *reply)
   if (is_safe) {
     // the filesystem change is committed to disk
     // we're done, clean up
-    if (request->got_unsafe) {
+    if (request->got_unsafe || request->async) {
       request->unsafe_item.remove_myself();
       request->unsafe_dir_item.remove_myself();
       request->unsafe_target_item.remove_myself();
@@ -2621,6 +2791,9 @@ void Client::send_reconnect(MetaSession *session)
 
   session->readonly = false;
 
+  // the mds forgot what it delegated; in flight creates still name theirs
+  session->delegated_inos.clear();
+
   if (session->release) {
     session->release->put();
     session->release = NULL;
@@ -2770,6 +2943,8 @@ void Client::kick_requests_closed(MetaSession *session)
 	req->unsafe_target_item.remove_myself();
 	signal_cond_list(req->waitfor_safe);
 	unregister_request(req);
+      } else if (req->async) {
+	abort_async_request(req, -EIO);
       }
     }
   }
@@ -3051,6 +3226,9 @@ int Client::get_caps(Inode *in, int need, int want, int *phave, loff_t endoff)
     return r;
 
   while (1) {
+    if ((in->flags & I_ASYNC_CREATE) && in->async_err)
+      return in->async_err;  // no caps are coming
+
     int file_wanted = in->caps_file_wanted();
     if ((file_wanted & need) != need) {
       ldout(cct, 10) << "get_caps " << *in << " need " << ccap_string(need)
@@ -8367,22 +8545,26 @@ int Client::uninline_data(Inode *in, Context *onfinish)
 
 int Client::read(int fd, char *buf, loff_t size, loff_t offset)
 {
-  Mutex::Locker lock(client_lock);
-  tout(cct) << "read" << std::endl;
-  tout(cct) << fd << std::endl;
-  tout(cct) << size << std::endl;
-  tout(cct) << offset << std::endl;
+  bufferlist bl;
+  int r;
+  {
+    Mutex::Locker lock(client_lock);
+    tout(cct) << "read" << std::endl;
+    tout(cct) << fd << std::endl;
+    tout(cct) << size << std::endl;
+    tout(cct) << offset << std::endl;
 
-  Fh *f = get_filehandle(fd);
-  if (!f)
-    return -EBADF;
+    Fh *f = get_filehandle(fd);
+    if (!f)
+      return -EBADF;
 #if defined(__linux__) && defined(O_PATH)
-  if (f->flags & O_PATH)
-    return -EBADF;
+    if (f->flags & O_PATH)
+      return -EBADF;
 #endif
-  bufferlist bl;
-  int r = _read(f, offset, size, &bl);
-  ldout(cct, 3) << "read(" << fd << ", " << (void*)buf << ", " << size << ", " << offset << ") = " << r << dendl;
+    r = _read(f, offset, size, &bl);
+    ldout(cct, 3) << "read(" << fd << ", " << (void*)buf << ", " << size << ", " << offset << ") = " << r << dendl;
+  }
+  // bl holds its own references; copy out without holding client_lock
   if (r >= 0) {
     bl.copy(0, bl.length(), buf);
     r = bl.length();
@@ -8466,6 +8648,12 @@ retry:
   }
 
   if (!conf->client_debug_force_sync_read &&
+      (have & CEPH_CAP_FILE_CACHE) && !(f->flags & O_RSYNC) &&
+      _stream_read_wanted(f, offset, size)) {
+    r = _read_stream(f, offset, size, bl);
+    if (r < 0)
+      goto done;
+  } else if (!conf->client_debug_force_sync_read &&
       (conf->client_oc && (have & CEPH_CAP_FILE_CACHE))) {
 
     if (f->flags & O_RSYNC) {
@@ -8612,6 +8800,182 @@ int Client::_read_async(Fh *f, uint64_t off, uint64_t len, bufferlist *bl)
   return r;
 }
 
+/*
+ * Streaming reads
+ *
+ * Once a handle has read client_stream_read_min bytes in sequence, its
+ * reads go straight to the osds: we keep object sized reads in flight up
+ * to a window ahead of the reader and hand it the buffers they fill.  The
+ * window doubles each time the reader has to wait, up to
+ * client_stream_read_max_bytes.  Nothing goes into the object cacher, so a
+ * big file read once doesn't push out everything else.  This needs Fc
+ * like the cached path does, and stops while the object cacher holds
+ * dirty data for the file.
+ */
+Client::C_StreamRead::C_StreamRead(Client *c, Fh *f, uint64_t off) :
+    client(c), f(f), off(off), gen(f->stream.gen) {
+  f->get();
+}
+
+Client::C_StreamRead::~C_StreamRead() {
+  client->_put_fh(f);
+}
+
+void Client::C_StreamRead::finish(int r) {
+  Fh::StreamRead& s = f->stream;
+  if (gen == s.gen) {
+    auto p = s.extents.find(off);
+    if (p != s.extents.end()) {
+      p->second.done = true;
+      p->second.r = (r == -ENOENT ? 0 : r);  // a hole
+      p->second.bl.claim(bl);
+    }
+  }
+  client->put_cap_ref(f->inode.get(), CEPH_CAP_FILE_RD);
+  client->signal_cond_list(s.waiters);
+}
+
+bool Client::_stream_read_wanted(Fh *f, uint64_t off, uint64_t len)
+{
+  Fh::StreamRead& s = f->stream;
+  uint64_t min = cct->_conf->client_stream_read_min;
+  if (!min)
+    return false;
+
+  if (off != s.next) {
+    s.run = 0;
+    if (!s.extents.empty())
+      _stream_read_reset(f);
+  }
+  s.next = off + len;
+  s.run += len;
+
+  // our own buffered writes are only in the object cacher
+  if (f->inode->oset.dirty_or_tx) {
+    if (!s.extents.empty())
+      _stream_read_reset(f);
+    return false;
+  }
+  return s.run >= min;
+}
+
+void Client::_stream_read_reset(Fh *f)
+{
+  Fh::StreamRead& s = f->stream;
+  ldout(cct, 10) << __func__ << " " << f << dendl;
+  s.gen++;
+  s.extents.clear();
+  s.window = 0;
+  s.issued_end = 0;
+  signal_cond_list(s.waiters);
+}
+
+void Client::_stream_read_ahead(Fh *f, uint64_t end)
+{
+  Inode *in = f->inode.get();
+  Fh::StreamRead& s = f->stream;
+  uint64_t object_size = in->layout.object_size;
+
+  if (end > in->size)
+    end = in->size;
+  while (s.issued_end < end) {
+    // one object at a time, so that they are read in parallel
+    uint64_t off = s.issued_end;
+    uint64_t len = MIN(object_size - off % object_size, in->size - off);
+    s.extents[off].len = len;
+    s.issued_end += len;
+
+    ldout(cct, 20) << __func__ << " " << off << "~" << len << dendl;
+    C_StreamRead *c = new C_StreamRead(this, f, off);
+    get_cap_ref(in, CEPH_CAP_FILE_RD);
+    filer->read_trunc(in->ino, &in->layout, in->snapid, off, len, &c->bl, 0,
+		      in->truncate_size, in->truncate_seq,
+		      new C_Lock(&client_lock, c));
+  }
+}
+
+int Client::_read_stream(Fh *f, uint64_t off, uint64_t len, bufferlist *bl)
+{
+  Inode *in = f->inode.get();
+  Fh::StreamRead& s = f->stream;
+
+  ldout(cct, 10) << "_read_stream " << *in << " " << off << "~" << len << dendl;
+
+  if (s.cache_gen != in->cache_gen ||
+      s.change_attr != in->change_attr ||
+      s.truncate_seq != in->truncate_seq) {
+    // someone may have written since we read ahead
+    _stream_read_reset(f);
+    s.cache_gen = in->cache_gen;
+    s.change_attr = in->change_attr;
+    s.truncate_seq = in->truncate_seq;
+  }
+
+  if (off >= in->size || len == 0)
+    return 0;
+  if (off + len > in->size)
+    len = in->size - off;
+
+  bufferlist out;
+  uint64_t gen;
+  uint64_t pos;
+  uint64_t end = off + len;
+
+ restart:
+  // what the reader is past
+  while (!s.extents.empty()) {
+    auto p = s.extents.begin();
+    if (p->first + p->second.len > off)
+      break;
+    s.extents.erase(p);
+  }
+  if (s.extents.empty() || s.extents.begin()->first > off) {
+    _stream_read_reset(f);
+    s.issued_end = off;
+  }
+  if (!s.window)
+    s.window = in->layout.get_period();
+  _stream_read_ahead(f, off + len + s.window);
+
+  out.clear();
+  gen = s.gen;
+  pos = off;
+  while (pos < end) {
+    auto p = s.extents.find(pos);
+    if (p == s.extents.end()) {
+      p = s.extents.lower_bound(pos);
+      assert(p != s.extents.begin());
+      --p;
+    }
+    if (!p->second.done) {
+      // the reader caught up; read further ahead
+      s.window = MIN(s.window * 2, cct->_conf->client_stream_read_max_bytes);
+      wait_on_list(s.waiters);
+      if (s.gen != gen)
+	goto restart;  // another reader on this handle reset us
+      continue;
+    }
+    if (p->second.r < 0) {
+      int r = p->second.r;
+      _stream_read_reset(f);
+      return r;
+    }
+
+    Fh::StreamRead::Extent& e = p->second;
+    if (e.bl.length() < e.len)
+      e.bl.append_zero(e.len - e.bl.length());  // sparse
+    uint64_t from = pos - p->first;
+    uint64_t n = MIN(e.len - from, end - pos);
+    bufferlist sub;
+    sub.substr_of(e.bl, from, n);
+    out.claim_append(sub);
+    pos += n;
+  }
+  _stream_read_ahead(f, end + s.window);
+  bl->claim_append(out);
+  return len;
+}
+
 int Client::_read_sync(Fh *f, uint64_t off, uint64_t len, bufferlist *bl,
 		       bool *checkeof)
 {
@@ -8700,6 +9064,12 @@ void Client::_sync_write_commit(Inode *in)
 
 int Client::write(int fd, const char *buf, loff_t size, loff_t offset) 
 {
+  // copy into fresh buffer (since our write may be resub, async) before
+  // taking client_lock, so that writers don't serialize on the memcpy
+  bufferlist bl;
+  if (size > 0)
+    bl.append(buf, size);
+
   Mutex::Locker lock(client_lock);
   tout(cct) << "write" << std::endl;
   tout(cct) << fd << std::endl;
@@ -8713,7 +9083,7 @@ int Client::write(int fd, const char *buf, loff_t size, loff_t offset)
   if (fh->flags & O_PATH)
     return -EBADF;
 #endif
-  int r = _write(fh, offset, size, buf, NULL, 0);
+  int r = _write(fh, offset, bl);
   ldout(cct, 3) << "write(" << fd << ", \"...\", " << size << ", " << offset << ") = " << r << dendl;
   return r;
 }
@@ -8727,54 +9097,70 @@ int Client::pwritev(int fd, const struct iovec *iov, int iovcnt, int64_t offset)
 
 int Client::_preadv_pwritev(int fd, const struct iovec *iov, unsigned iovcnt, int64_t offset, bool write)
 {
-    Mutex::Locker lock(client_lock);
-    tout(cct) << fd << std::endl;
-    tout(cct) << offset << std::endl;
-
-    Fh *fh = get_filehandle(fd);
-    if (!fh)
-        return -EBADF;
-#if defined(__linux__) && defined(O_PATH)
-    if (fh->flags & O_PATH)
-        return -EBADF;
-#endif
     loff_t totallen = 0;
     for (unsigned i = 0; i < iovcnt; i++) {
         totallen += iov[i].iov_len;
     }
+
+    // the user buffers are copied in before and out after client_lock
+    bufferlist bl;
     if (write) {
-        int w = _write(fh, offset, totallen, NULL, iov, iovcnt);
-        ldout(cct, 3) << "pwritev(" << fd << ", \"...\", " << totallen << ", " << offset << ") = " << w << dendl;
-        return w;
-    } else {
-        bufferlist bl;
-        int r = _read(fh, offset, totallen, &bl);
-        ldout(cct, 3) << "preadv(" << fd << ", " <<  offset << ") = " << r << dendl;
-        if (r <= 0)
-          return r;
-
-        int bufoff = 0;
-        for (unsigned j = 0, resid = r; j < iovcnt && resid > 0; j++) {
-               /*
-                * This piece of code aims to handle the case that bufferlist does not have enough data 
-                * to fill in the iov 
-                */
-               if (resid < iov[j].iov_len) {
-                    bl.copy(bufoff, resid, (char *)iov[j].iov_base);
-                    break;
-               } else {
-                    bl.copy(bufoff, iov[j].iov_len, (char *)iov[j].iov_base);
-               }
-               resid -= iov[j].iov_len;
-               bufoff += iov[j].iov_len;
+        for (unsigned i = 0; i < iovcnt; i++) {
+            if (iov[i].iov_len > 0)
+                bl.append((const char *)iov[i].iov_base, iov[i].iov_len);
+        }
+    }
+
+    int r;
+    {
+        Mutex::Locker lock(client_lock);
+        tout(cct) << fd << std::endl;
+        tout(cct) << offset << std::endl;
+
+        Fh *fh = get_filehandle(fd);
+        if (!fh)
+            return -EBADF;
+#if defined(__linux__) && defined(O_PATH)
+        if (fh->flags & O_PATH)
+            return -EBADF;
+#endif
+        if (write) {
+            int w = _write(fh, offset, bl);
+            ldout(cct, 3) << "pwritev(" << fd << ", \"...\", " << totallen << ", " << offset << ") = " << w << dendl;
+            return w;
         }
-        return r;  
+        r = _read(fh, offset, totallen, &bl);
+        ldout(cct, 3) << "preadv(" << fd << ", " <<  offset << ") = " << r << dendl;
+    }
+
+    if (r <= 0)
+      return r;
+
+    int bufoff = 0;
+    for (unsigned j = 0, resid = r; j < iovcnt && resid > 0; j++) {
+           /*
+            * This piece of code aims to handle the case that bufferlist does not have enough data 
+            * to fill in the iov 
+            */
+           if (resid < iov[j].iov_len) {
+                bl.copy(bufoff, resid, (char *)iov[j].iov_base);
+                break;
+           } else {
+                bl.copy(bufoff, iov[j].iov_len, (char *)iov[j].iov_base);
+           }
+           resid -= iov[j].iov_len;
+           bufoff += iov[j].iov_len;
     }
+    return r;  
 }
 
-int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf,
-                  const struct iovec *iov, int iovcnt)
+/*
+ * bl must be a private copy of the data, since our write may be resubmitted
+ * or completed asynchronously; callers build it before taking client_lock.
+ */
+int Client::_write(Fh *f, int64_t offset, bufferlist& bl)
 {
+  uint64_t size = bl.length();
   if ((uint64_t)(offset+size) > mdsmap->get_max_filesize()) //too large!
     return -EFBIG;
 
@@ -8831,19 +9217,6 @@ int Client::_write(Fh *f, int64_t offset, uint64_t size, const char *buf,
     assert(in->inline_version > 0);
   }
 
-  // copy into fresh buffer (since our write may be resub, async)
-  bufferlist bl;
-  if (buf) {
-    if (size > 0)
-      bl.append(buf, size);
-  } else if (iov){
-    for (int i = 0; i < iovcnt; i++) {
-      if (iov[i].iov_len > 0) {
-        bl.append((const char *)iov[i].iov_base, iov[i].iov_len);
-      }
-    }
-  }
-
   utime_t lat;
   uint64_t totalwritten;
   int have;
@@ -11053,6 +11426,44 @@ int Client::ll_mknodx(Inode *parent, const char *name, mode_t mode,
   return r;
 }
 
+void Client::_create_async(MetaRequest *req, MetaSession *session, Inode *dir,
+			   Dentry *de, mode_t mode, const UserPerm& perms,
+			   InodeRef *inp)
+{
+  inodeno_t ino = session->delegated_inos.range_start();
+  session->delegated_inos.erase(ino);
+
+  // we know the name is free; if someone raced us anyway, fail rather than
+  // open their file
+  req->head.ino = ino;
+  req->head.args.open.flags = req->head.args.open.flags | O_EXCL;
+
+  vinodeno_t vino(ino, CEPH_NOSNAP);
+  Inode *in = new Inode(this, vino, &dir->cached_layout);
+  inode_map[vino] = in;
+  if (use_faked_inos())
+    _assign_faked_ino(in);
+
+  in->mode = mode;
+  in->uid = perms.uid();
+  in->gid = (dir->mode & S_ISGID) ? dir->gid : perms.gid();
+  in->nlink = 1;
+  in->btime = in->ctime = in->mtime = in->atime = ceph_clock_now();
+  in->layout = dir->cached_layout;
+  in->inline_version = mdsmap->get_inline_data_enabled() ?
+    1 : CEPH_INLINE_NONE;
+  in->flags |= I_ASYNC_CREATE;
+  ldout(cct, 10) << "_create_async " << *in << dendl;
+
+  dir->dir_ordered_count++;
+  clear_dir_complete_and_ordered(dir, false);
+  link(dir->dir, de->name, in, de);
+
+  req->async_inode = in;
+  send_async_request(req, session, perms);
+  *inp = in;
+}
+
 int Client::_create(Inode *dir, const char *name, int flags, mode_t mode,
 		    InodeRef *inp, Fh **fhp, int stripe_unit, int stripe_count,
 		    int object_size, const char *data_pool, bool *created,
@@ -11074,6 +11485,7 @@ int Client::_create(Inode *dir, const char *name, int flags, mode_t mode,
   if (cmode < 0)
     return -EINVAL;
 
+  MetaSession *async_session = NULL;
   int64_t pool_id = -1;
   if (data_pool && *data_pool) {
     pool_id = objecter->with_osdmap(
@@ -11103,6 +11515,8 @@ int Client::_create(Inode *dir, const char *name, int flags, mode_t mode,
   req->head.args.open.pool = pool_id;
   req->dentry_drop = CEPH_CAP_FILE_SHARED;
   req->dentry_unless = CEPH_CAP_FILE_EXCL;
+  if (cct->_conf->client_async_dirops)
+    req->head.flags = req->head.flags | CEPH_MDS_FLAG_DELEG_INOS;
 
   mode |= S_IFREG;
   bufferlist xattrs_bl;
@@ -11119,9 +11533,26 @@ int Client::_create(Inode *dir, const char *name, int flags, mode_t mode,
     goto fail;
   req->set_dentry(de);
 
-  res = make_request(req, perms, inp, created);
-  if (res < 0) {
-    goto reply_error;
+  // files with the default layout only; that's what we cached
+  if (!de->inode && !stripe_unit && !stripe_count && !object_size &&
+      pool_id < 0 && xattrs_bl.length() == 0 &&
+      dir->cached_layout.pool_id >= 0) {
+    async_session = get_async_dirop_session(dir);
+    if (async_session && async_session->delegated_inos.empty())
+      async_session = NULL;
+  }
+
+  if (async_session) {
+    _create_async(req, async_session, dir, de, mode, perms, inp);
+    if (created)
+      *created = true;
+  } else {
+    res = make_request(req, perms, inp, created);
+    if (res < 0) {
+      goto reply_error;
+    }
+    if (!stripe_unit && !stripe_count && !object_size && pool_id < 0)
+      dir->cached_layout = (*inp)->layout;
   }
 
   /* If the caller passed a value in fhp, do the open */
@@ -11394,6 +11825,7 @@ int Client::_unlink(Inode *dir, const char *name, const UserPerm& perm)
   }
 
   MetaRequest *req = new MetaRequest(CEPH_MDS_OP_UNLINK);
+  MetaSession *async_session;
 
   filepath path;
   dir->make_nosnap_relative_path(path);
@@ -11418,7 +11850,16 @@ int Client::_unlink(Inode *dir, const char *name, const UserPerm& perm)
 
   req->set_inode(dir);
 
-  res = make_request(req, perm);
+  async_session = otherin->is_dir() ? NULL : get_async_dirop_session(dir);
+  if (async_session) {
+    dir->dir_ordered_count++;
+    clear_dir_complete_and_ordered(dir, false);
+    unlink(de, true, true);  // keep dir, dentry
+    send_async_request(req, async_session, perm);
+    res = 0;
+  } else {
+    res = make_request(req, perm);
+  }
 
   trim_cache();
   ldout(cct, 3) << "unlink(" << path << ") = " << res << dendl;
@@ -12176,6 +12617,10 @@ int Client::ll_commit_blocks(Inode *in,
 
 int Client::ll_write(Fh *fh, loff_t off, loff_t len, const char *data)
 {
+  bufferlist bl;
+  if (len > 0)
+    bl.append(data, len);
+
   Mutex::Locker lock(client_lock);
   ldout(cct, 3) << "ll_write " << fh << " " << fh->inode->ino << " " << off <<
     "~" << len << dendl;
@@ -12184,7 +12629,7 @@ int Client::ll_write(Fh *fh, loff_t off, loff_t len, const char *data)
   tout(cct) << off << std::endl;
   tout(cct) << len << std::endl;
 
-  int r = _write(fh, off, len, data, NULL, 0);
+  int r = _write(fh, off, bl);
   ldout(cct, 3) << "ll_write " << fh << " " << off << "~" << len << " = " << r
 		<< dendl;
   return r;
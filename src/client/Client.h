@@ -382,6 +382,18 @@ protected:
   void handle_client_reply(MClientReply *reply);
   bool is_dir_operation(MetaRequest *request);
 
+  // async dirops
+  int num_async_dirops;
+  MetaSession *get_async_dirop_session(Inode *dir);
+  void send_async_request(MetaRequest *request, MetaSession *session,
+			  const UserPerm& perms);
+  void resend_async_request(MetaRequest *request);
+  void finish_async_request(MetaRequest *request);
+  void abort_async_request(MetaRequest *request, int r);
+  void async_dirop_failed(MetaRequest *request, int r);
+  void wait_async_create(Inode *in);
+  void got_delegated_inos(MetaSession *session, MClientReply *reply);
+
   bool   initialized;
   bool   authenticated;
   bool   mounted;
@@ -755,8 +767,23 @@ private:
     void finish(int r);
   };
 
+  struct C_StreamRead : public Context {
+    Client *client;
+    Fh *f;
+    uint64_t off;
+    uint64_t gen;
+    bufferlist bl;
+    C_StreamRead(Client *c, Fh *f, uint64_t off);
+    ~C_StreamRead();
+    void finish(int r);
+  };
+
   int _read_sync(Fh *f, uint64_t off, uint64_t len, bufferlist *bl, bool *checkeof);
   int _read_async(Fh *f, uint64_t off, uint64_t len, bufferlist *bl);
+  bool _stream_read_wanted(Fh *f, uint64_t off, uint64_t len);
+  void _stream_read_reset(Fh *f);
+  void _stream_read_ahead(Fh *f, uint64_t end);
+  int _read_stream(Fh *f, uint64_t off, uint64_t len, bufferlist *bl);
 
   // internal interface
   //   call these with client_lock held!
@@ -809,14 +836,16 @@ private:
   int _open(Inode *in, int flags, mode_t mode, Fh **fhp,
 	    const UserPerm& perms);
   int _renew_caps(Inode *in);
+  void _create_async(MetaRequest *req, MetaSession *session, Inode *dir,
+		     Dentry *de, mode_t mode, const UserPerm& perms,
+		     InodeRef *inp);
   int _create(Inode *in, const char *name, int flags, mode_t mode, InodeRef *inp,
 	      Fh **fhp, int stripe_unit, int stripe_count, int object_size,
 	      const char *data_pool, bool *created, const UserPerm &perms);
 
   loff_t _lseek(Fh *fh, loff_t offset, int whence);
   int _read(Fh *fh, int64_t offset, uint64_t size, bufferlist *bl);
-  int _write(Fh *fh, int64_t offset, uint64_t size, const char *buf,
-          const struct iovec *iov, int iovcnt);
+  int _write(Fh *fh, int64_t offset, bufferlist& bl);
   int _preadv_pwritev(int fd, const struct iovec *iov, unsigned iovcnt, int64_t offset, bool write);
   int _flush(Fh *fh);
   int _fsync(Fh *fh, bool syncdataonly);
@@ -1,6 +1,8 @@
 #ifndef CEPH_CLIENT_FH_H
 #define CEPH_CLIENT_FH_H
 
+#include <map>
+
 #include "common/Readahead.h"
 #include "include/types.h"
 #include "InodeRef.h"
@@ -25,6 +27,28 @@ struct Fh {
 
   Readahead readahead;
 
+  // sequential reads that go around the object cacher, see
+  // Client::_read_stream()
+  struct StreamRead {
+    struct Extent {
+      uint64_t len = 0;
+      bool done = false;
+      int r = 0;
+      bufferlist bl;
+    };
+    uint64_t next = 0;        // where a sequential reader reads next
+    uint64_t run = 0;         // bytes read in sequence up to next
+    uint64_t gen = 0;         // reads issued before a reset are dropped
+    uint64_t window = 0;      // how far ahead of the reader we read
+    uint64_t issued_end = 0;  // end of the extents read so far
+    // the inode as of the reads; they are stale once it changed
+    int cache_gen = 0;
+    uint64_t change_attr = 0;
+    uint32_t truncate_seq = 0;
+    std::map<uint64_t, Extent> extents;
+    list<Cond*> waiters;
+  } stream;
+
   // file lock
   ceph_lock_state_t *fcntl_locks;
   ceph_lock_state_t *flock_locks;
@@ -82,6 +82,7 @@ struct CapSnap {
 #define I_DIR_ORDERED	2
 #define I_CAP_DROPPED	4
 #define I_SNAPDIR_OPEN	8
+#define I_ASYNC_CREATE	16
 
 struct Inode {
   Client *client;
@@ -108,6 +109,7 @@ struct Inode {
   // file (data access)
   ceph_dir_layout dir_layout;
   file_layout_t layout;
+  file_layout_t cached_layout; // of the files created in this dir
   uint64_t   size;        // on directory, # dentries
   uint32_t   truncate_seq;
   uint64_t   truncate_size;
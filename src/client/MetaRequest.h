@@ -60,6 +60,9 @@ public:
   //possible responses
   bool got_unsafe;
 
+  bool async;                  // sent without a caller waiting for the reply
+  InodeRef async_inode;        // made up for an async create
+
   xlist<MetaRequest*>::item item;
   xlist<MetaRequest*>::item unsafe_item;
   xlist<MetaRequest*>::item unsafe_dir_item;
@@ -85,7 +88,7 @@ public:
     num_fwd(0), retry_attempt(0),
     ref(1), reply(0), 
     kick(false), success(false),
-    got_unsafe(false), item(this), unsafe_item(this),
+    got_unsafe(false), async(false), item(this), unsafe_item(this),
     unsafe_dir_item(this), unsafe_target_item(this),
     caller_cond(0), dispatch_cond(0) {
     memset(&head, 0, sizeof(head));
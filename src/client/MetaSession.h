@@ -47,6 +47,8 @@ struct MetaSession {
   std::set<ceph_tid_t> flushing_caps_tids;
   std::set<Inode*> early_flushing_caps;
 
+  interval_set<inodeno_t> delegated_inos; // ours to create with, see CEPH_MDS_FLAG_DELEG_INOS
+
   MClientCapRelease *release;
   
   MetaSession()
@@ -33,6 +33,7 @@
 #include <cstdlib>
 #include <errno.h>
 #include <iostream>
+#include <limits>
 #include <map>
 #include <sstream>
 #include <vector>
@@ -1826,6 +1827,64 @@ int copyup(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
   return cls_cxx_write(hctx, 0, in->length(), in);
 }
 
+/**
+ * Like copyup, but only the given extents of the parent data are sent
+ * and written; the rest of the object is left sparse.  With no extents
+ * an empty object is created.
+ *
+ * Input:
+ * @param extent_map map of offset to length of the extents to write
+ * @param data the data of the extents, concatenated in order
+ *
+ * Output:
+ * @returns 0 on success, or if block already exists in child
+ *  negative error code on other error
+ */
+int sparse_copyup(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  std::map<uint64_t, uint64_t> extent_map;
+  bufferlist data;
+  try {
+    bufferlist::iterator iter = in->begin();
+    ::decode(extent_map, iter);
+    ::decode(data, iter);
+  } catch (const buffer::error &err) {
+    CLS_LOG(20, "sparse_copyup: invalid decode");
+    return -EINVAL;
+  }
+
+  // check for existence; if child object exists, just return success
+  if (cls_cxx_stat(hctx, NULL, NULL) == 0) {
+    return 0;
+  }
+
+  if (extent_map.empty()) {
+    CLS_LOG(20, "sparse_copyup: create empty object");
+    return cls_cxx_create(hctx, true);
+  }
+
+  uint64_t data_offset = 0;
+  for (auto &it : extent_map) {
+    if (data_offset + it.second > data.length()) {
+      CLS_ERR("sparse_copyup: extents exceed data length");
+      return -EINVAL;
+    }
+
+    bufferlist tmpbl;
+    tmpbl.substr_of(data, data_offset, it.second);
+    CLS_LOG(20, "sparse_copyup: writing extent %" PRIu64 "~%" PRIu64 "\n",
+            it.first, it.second);
+    int r = cls_cxx_write(hctx, it.first, it.second, &tmpbl);
+    if (r < 0) {
+      CLS_ERR("sparse_copyup: error writing extent %" PRIu64 "~%" PRIu64
+              ": %s", it.first, it.second, cpp_strerror(r).c_str());
+      return r;
+    }
+    data_offset += it.second;
+  }
+  return 0;
+}
+
 
 /************************ rbd_id object methods **************************/
 
@@ -4872,6 +4931,201 @@ int image_get_group(cls_method_context_t hctx,
   return 0;
 }
 
+static int group_snap_list_helper(cls_method_context_t hctx,
+                                  snapid_t start_after, uint64_t max_return,
+                                  std::vector<cls::rbd::GroupSnapshot> *snaps)
+{
+  cls::rbd::GroupSnapshot start(start_after, "",
+                                cls::rbd::GROUP_SNAPSHOT_STATE_INCOMPLETE);
+  string last_read = start_after == 0 ? "" : start.snap_key();
+  int keys_read = RBD_MAX_KEYS_READ;
+  while (keys_read == RBD_MAX_KEYS_READ && snaps->size() < max_return) {
+    std::map<string, bufferlist> vals;
+    keys_read = cls_cxx_map_get_vals(hctx, last_read,
+                                     cls::rbd::RBD_GROUP_SNAP_KEY_PREFIX,
+                                     RBD_MAX_KEYS_READ, &vals);
+    if (keys_read < 0) {
+      return keys_read;
+    }
+
+    for (auto &it : vals) {
+      if (snaps->size() >= max_return) {
+        break;
+      }
+
+      cls::rbd::GroupSnapshot snap;
+      try {
+        bufferlist::iterator iter = it.second.begin();
+        ::decode(snap, iter);
+      } catch (const buffer::error &err) {
+        CLS_ERR("error decoding group snapshot: %s", it.first.c_str());
+        return -EIO;
+      }
+      snaps->push_back(snap);
+    }
+
+    if (vals.empty()) {
+      break;
+    }
+    last_read = vals.rbegin()->first;
+  }
+  return 0;
+}
+
+/**
+ * Add an incomplete snapshot to the consistency group.
+ *
+ * Input:
+ * @param snap_name (std::string)
+ *
+ * Output:
+ * @param snap_id (snapid_t) id allocated to the snapshot
+ * @return 0 on success, negative error code on failure
+ */
+int group_snap_add(cls_method_context_t hctx,
+                   bufferlist *in, bufferlist *out)
+{
+  CLS_LOG(20, "group_snap_add");
+  string snap_name;
+  try {
+    bufferlist::iterator iter = in->begin();
+    ::decode(snap_name, iter);
+  } catch (const buffer::error &err) {
+    return -EINVAL;
+  }
+
+  if (snap_name.empty()) {
+    return -EINVAL;
+  }
+
+  std::vector<cls::rbd::GroupSnapshot> snaps;
+  int r = group_snap_list_helper(hctx, 0, std::numeric_limits<uint64_t>::max(),
+                                 &snaps);
+  if (r < 0) {
+    return r;
+  }
+  for (auto &snap : snaps) {
+    if (snap.name == snap_name) {
+      return -EEXIST;
+    }
+  }
+
+  uint64_t snap_seq;
+  r = read_key(hctx, GROUP_SNAP_SEQ, &snap_seq);
+  if (r < 0) {
+    return r;
+  }
+
+  cls::rbd::GroupSnapshot snap(++snap_seq, snap_name,
+                               cls::rbd::GROUP_SNAPSHOT_STATE_INCOMPLETE);
+  std::map<string, bufferlist> vals;
+  ::encode(snap_seq, vals[GROUP_SNAP_SEQ]);
+  ::encode(snap, vals[snap.snap_key()]);
+  r = cls_cxx_map_set_vals(hctx, &vals);
+  if (r < 0) {
+    return r;
+  }
+
+  ::encode(snap.id, *out);
+  return 0;
+}
+
+/**
+ * Update a snapshot of the consistency group.
+ *
+ * Input:
+ * @param snap (cls::rbd::GroupSnapshot)
+ *
+ * Output:
+ * @return 0 on success, negative error code on failure
+ */
+int group_snap_set(cls_method_context_t hctx,
+                   bufferlist *in, bufferlist *out)
+{
+  CLS_LOG(20, "group_snap_set");
+  cls::rbd::GroupSnapshot snap;
+  try {
+    bufferlist::iterator iter = in->begin();
+    ::decode(snap, iter);
+  } catch (const buffer::error &err) {
+    return -EINVAL;
+  }
+
+  cls::rbd::GroupSnapshot old_snap;
+  int r = read_key(hctx, snap.snap_key(), &old_snap);
+  if (r < 0) {
+    return r;
+  } else if (old_snap.name != snap.name) {
+    return -EINVAL;
+  }
+
+  bufferlist snap_bl;
+  ::encode(snap, snap_bl);
+  return cls_cxx_map_set_val(hctx, snap.snap_key(), &snap_bl);
+}
+
+/**
+ * Remove a snapshot from the consistency group.
+ *
+ * Input:
+ * @param snap_id (snapid_t)
+ *
+ * Output:
+ * @return 0 on success, negative error code on failure
+ */
+int group_snap_remove(cls_method_context_t hctx,
+                      bufferlist *in, bufferlist *out)
+{
+  CLS_LOG(20, "group_snap_remove");
+  snapid_t snap_id;
+  try {
+    bufferlist::iterator iter = in->begin();
+    ::decode(snap_id, iter);
+  } catch (const buffer::error &err) {
+    return -EINVAL;
+  }
+
+  cls::rbd::GroupSnapshot snap(snap_id, "",
+                               cls::rbd::GROUP_SNAPSHOT_STATE_INCOMPLETE);
+  return cls_cxx_map_remove_key(hctx, snap.snap_key());
+}
+
+/**
+ * List snapshots of the consistency group.
+ *
+ * Input:
+ * @param start_after (snapid_t) id to begin listing after (0 to start at
+ *        the beginning)
+ * @param max_return (uint64_t)
+ *
+ * Output:
+ * @param snaps (std::vector<cls::rbd::GroupSnapshot>)
+ * @return 0 on success, negative error code on failure
+ */
+int group_snap_list(cls_method_context_t hctx,
+                    bufferlist *in, bufferlist *out)
+{
+  CLS_LOG(20, "group_snap_list");
+  snapid_t start_after;
+  uint64_t max_return;
+  try {
+    bufferlist::iterator iter = in->begin();
+    ::decode(start_after, iter);
+    ::decode(max_return, iter);
+  } catch (const buffer::error &err) {
+    return -EINVAL;
+  }
+
+  std::vector<cls::rbd::GroupSnapshot> snaps;
+  int r = group_snap_list_helper(hctx, start_after, max_return, &snaps);
+  if (r < 0) {
+    return r;
+  }
+
+  ::encode(snaps, *out);
+  return 0;
+}
+
 CLS_INIT(rbd)
 {
   CLS_LOG(20, "Loaded rbd class!");
@@ -4905,6 +5159,7 @@ CLS_INIT(rbd)
   cls_method_handle_t h_snapshot_rename;
   cls_method_handle_t h_get_all_features;
   cls_method_handle_t h_copyup;
+  cls_method_handle_t h_sparse_copyup;
   cls_method_handle_t h_get_id;
   cls_method_handle_t h_set_id;
   cls_method_handle_t h_dir_get_id;
@@ -4962,6 +5217,10 @@ CLS_INIT(rbd)
   cls_method_handle_t h_image_add_group;
   cls_method_handle_t h_image_remove_group;
   cls_method_handle_t h_image_get_group;
+  cls_method_handle_t h_group_snap_add;
+  cls_method_handle_t h_group_snap_set;
+  cls_method_handle_t h_group_snap_remove;
+  cls_method_handle_t h_group_snap_list;
 
   cls_register("rbd", &h_class);
   cls_register_cxx_method(h_class, "create",
@@ -5011,6 +5270,9 @@ CLS_INIT(rbd)
   cls_register_cxx_method(h_class, "copyup",
 			  CLS_METHOD_RD | CLS_METHOD_WR,
 			  copyup, &h_copyup);
+  cls_register_cxx_method(h_class, "sparse_copyup",
+			  CLS_METHOD_RD | CLS_METHOD_WR,
+			  sparse_copyup, &h_sparse_copyup);
   cls_register_cxx_method(h_class, "get_parent",
 			  CLS_METHOD_RD,
 			  get_parent, &h_get_parent);
@@ -5227,5 +5489,17 @@ CLS_INIT(rbd)
   cls_register_cxx_method(h_class, "image_get_group",
 			  CLS_METHOD_RD,
 			  image_get_group, &h_image_get_group);
+  cls_register_cxx_method(h_class, "group_snap_add",
+			  CLS_METHOD_RD | CLS_METHOD_WR,
+			  group_snap_add, &h_group_snap_add);
+  cls_register_cxx_method(h_class, "group_snap_set",
+			  CLS_METHOD_RD | CLS_METHOD_WR,
+			  group_snap_set, &h_group_snap_set);
+  cls_register_cxx_method(h_class, "group_snap_remove",
+			  CLS_METHOD_RD | CLS_METHOD_WR,
+			  group_snap_remove, &h_group_snap_remove);
+  cls_register_cxx_method(h_class, "group_snap_list",
+			  CLS_METHOD_RD,
+			  group_snap_list, &h_group_snap_list);
   return;
 }
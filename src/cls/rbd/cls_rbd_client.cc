@@ -788,6 +788,23 @@ namespace librbd {
       return ioctx->exec(oid, "rbd", "copyup", data, out);
     }
 
+    void sparse_copyup(librados::ObjectWriteOperation *op,
+                       const std::map<uint64_t, uint64_t> &extent_map,
+                       bufferlist data) {
+      bufferlist bl;
+      ::encode(extent_map, bl);
+      ::encode(data, bl);
+      op->exec("rbd", "sparse_copyup", bl);
+    }
+
+    int sparse_copyup(librados::IoCtx *ioctx, const std::string &oid,
+                      const std::map<uint64_t, uint64_t> &extent_map,
+                      bufferlist data) {
+      librados::ObjectWriteOperation op;
+      sparse_copyup(&op, extent_map, data);
+      return ioctx->operate(oid, &op);
+    }
+
     int get_protection_status(librados::IoCtx *ioctx, const std::string &oid,
 			      snapid_t snap_id, uint8_t *protection_status)
     {
@@ -1955,5 +1972,65 @@ namespace librbd {
       return image_get_group_finish(&iter, group_spec);
     }
 
+    int group_snap_add(librados::IoCtx *ioctx, const std::string &oid,
+		       const std::string &snap_name, snapid_t *snap_id)
+    {
+      bufferlist bl, bl2;
+      ::encode(snap_name, bl);
+
+      int r = ioctx->exec(oid, "rbd", "group_snap_add", bl, bl2);
+      if (r < 0)
+	return r;
+
+      bufferlist::iterator iter = bl2.begin();
+      try {
+	::decode(*snap_id, iter);
+      } catch (const buffer::error &err) {
+	return -EBADMSG;
+      }
+
+      return 0;
+    }
+
+    int group_snap_set(librados::IoCtx *ioctx, const std::string &oid,
+		       const cls::rbd::GroupSnapshot &snap)
+    {
+      bufferlist bl, bl2;
+      ::encode(snap, bl);
+
+      return ioctx->exec(oid, "rbd", "group_snap_set", bl, bl2);
+    }
+
+    int group_snap_remove(librados::IoCtx *ioctx, const std::string &oid,
+			  snapid_t snap_id)
+    {
+      bufferlist bl, bl2;
+      ::encode(snap_id, bl);
+
+      return ioctx->exec(oid, "rbd", "group_snap_remove", bl, bl2);
+    }
+
+    int group_snap_list(librados::IoCtx *ioctx, const std::string &oid,
+			snapid_t start_after, uint64_t max_return,
+			std::vector<cls::rbd::GroupSnapshot> *snaps)
+    {
+      bufferlist bl, bl2;
+      ::encode(start_after, bl);
+      ::encode(max_return, bl);
+
+      int r = ioctx->exec(oid, "rbd", "group_snap_list", bl, bl2);
+      if (r < 0)
+	return r;
+
+      bufferlist::iterator iter = bl2.begin();
+      try {
+	::decode(*snaps, iter);
+      } catch (const buffer::error &err) {
+	return -EBADMSG;
+      }
+
+      return 0;
+    }
+
   } // namespace cls_client
 } // namespace librbd
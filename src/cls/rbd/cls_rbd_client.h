@@ -154,6 +154,12 @@ namespace librbd {
 
     int copyup(librados::IoCtx *ioctx, const std::string &oid,
 	       bufferlist data);
+    void sparse_copyup(librados::ObjectWriteOperation *op,
+                       const std::map<uint64_t, uint64_t> &extent_map,
+                       bufferlist data);
+    int sparse_copyup(librados::IoCtx *ioctx, const std::string &oid,
+                      const std::map<uint64_t, uint64_t> &extent_map,
+                      bufferlist data);
     int get_protection_status(librados::IoCtx *ioctx, const std::string &oid,
 			      snapid_t snap_id, uint8_t *protection_status);
     int set_protection_status(librados::IoCtx *ioctx, const std::string &oid,
@@ -397,6 +403,15 @@ namespace librbd {
                                cls::rbd::GroupSpec *group_spec);
     int image_get_group(librados::IoCtx *ioctx, const std::string &oid,
 			cls::rbd::GroupSpec *group_spec);
+    int group_snap_add(librados::IoCtx *ioctx, const std::string &oid,
+		       const std::string &snap_name, snapid_t *snap_id);
+    int group_snap_set(librados::IoCtx *ioctx, const std::string &oid,
+		       const cls::rbd::GroupSnapshot &snap);
+    int group_snap_remove(librados::IoCtx *ioctx, const std::string &oid,
+			  snapid_t snap_id);
+    int group_snap_list(librados::IoCtx *ioctx, const std::string &oid,
+			snapid_t start_after, uint64_t max_return,
+			std::vector<cls::rbd::GroupSnapshot> *snaps);
 
   } // namespace cls_client
 } // namespace librbd
@@ -317,6 +317,74 @@ bool GroupSpec::is_valid() const {
   return (!group_id.empty()) && (pool_id != -1);
 }
 
+void ImageSnapshotSpec::encode(bufferlist &bl) const {
+  ENCODE_START(1, 1, bl);
+  ::encode(pool, bl);
+  ::encode(image_id, bl);
+  ::encode(snap_id, bl);
+  ENCODE_FINISH(bl);
+}
+
+void ImageSnapshotSpec::decode(bufferlist::iterator &it) {
+  DECODE_START(1, it);
+  ::decode(pool, it);
+  ::decode(image_id, it);
+  ::decode(snap_id, it);
+  DECODE_FINISH(it);
+}
+
+void ImageSnapshotSpec::dump(Formatter *f) const {
+  f->dump_int("pool", pool);
+  f->dump_string("image_id", image_id);
+  f->dump_unsigned("snap_id", snap_id);
+}
+
+void GroupSnapshot::encode(bufferlist &bl) const {
+  ENCODE_START(1, 1, bl);
+  ::encode(id, bl);
+  ::encode(name, bl);
+  ::encode(state, bl);
+  ::encode(snaps, bl);
+  ENCODE_FINISH(bl);
+}
+
+void GroupSnapshot::decode(bufferlist::iterator &it) {
+  DECODE_START(1, it);
+  ::decode(id, it);
+  ::decode(name, it);
+  ::decode(state, it);
+  ::decode(snaps, it);
+  DECODE_FINISH(it);
+}
+
+void GroupSnapshot::dump(Formatter *f) const {
+  f->dump_unsigned("id", id);
+  f->dump_string("name", name);
+  f->dump_string("state", state == GROUP_SNAPSHOT_STATE_COMPLETE ?
+                            "complete" : "incomplete");
+  f->open_array_section("snaps");
+  for (auto &snap : snaps) {
+    f->open_object_section("snap");
+    snap.dump(f);
+    f->close_section();
+  }
+  f->close_section();
+}
+
+void GroupSnapshot::generate_test_instances(std::list<GroupSnapshot*> &o) {
+  o.push_back(new GroupSnapshot());
+  o.push_back(new GroupSnapshot(1, "snap1", GROUP_SNAPSHOT_STATE_INCOMPLETE));
+  o.push_back(new GroupSnapshot(2, "snap2", GROUP_SNAPSHOT_STATE_COMPLETE));
+  o.back()->snaps.push_back(ImageSnapshotSpec(3, "abc123", 4));
+}
+
+std::string GroupSnapshot::snap_key() const {
+  ostringstream oss;
+  oss << RBD_GROUP_SNAP_KEY_PREFIX << std::setw(16) << std::setfill('0')
+      << std::hex << id;
+  return oss.str();
+}
+
 void GroupSnapshotNamespace::encode(bufferlist& bl) const {
   ::encode(group_pool, bl);
   ::encode(group_id, bl);
@@ -11,7 +11,9 @@
 #include "include/stringify.h"
 #include "include/utime.h"
 #include <iosfwd>
+#include <list>
 #include <string>
+#include <vector>
 
 #define RBD_GROUP_REF "rbd_group_ref"
 
@@ -22,6 +24,7 @@ namespace rbd {
 
 static const uint32_t MAX_OBJECT_MAP_OBJECT_COUNT = 256000000;
 static const string RBD_GROUP_IMAGE_KEY_PREFIX = "image_";
+static const string RBD_GROUP_SNAP_KEY_PREFIX = "snapshot_";
 
 enum MirrorMode {
   MIRROR_MODE_DISABLED = 0,
@@ -218,6 +221,73 @@ struct GroupSpec {
 
 WRITE_CLASS_ENCODER(GroupSpec);
 
+enum GroupSnapshotState {
+  GROUP_SNAPSHOT_STATE_INCOMPLETE = 0,
+  GROUP_SNAPSHOT_STATE_COMPLETE = 1
+};
+
+inline void encode(const GroupSnapshotState &state, bufferlist& bl,
+		   uint64_t features=0)
+{
+  ::encode(static_cast<uint8_t>(state), bl);
+}
+
+inline void decode(GroupSnapshotState &state, bufferlist::iterator& it)
+{
+  uint8_t int_state;
+  ::decode(int_state, it);
+  state = static_cast<GroupSnapshotState>(int_state);
+}
+
+struct ImageSnapshotSpec {
+  ImageSnapshotSpec() {}
+  ImageSnapshotSpec(int64_t pool, const std::string &image_id,
+		    snapid_t snap_id)
+    : pool(pool), image_id(image_id), snap_id(snap_id) {}
+
+  int64_t pool = -1;
+  std::string image_id;
+  snapid_t snap_id;
+
+  void encode(bufferlist &bl) const;
+  void decode(bufferlist::iterator &it);
+  void dump(Formatter *f) const;
+
+  inline bool operator==(const ImageSnapshotSpec &rhs) const {
+    return pool == rhs.pool && image_id == rhs.image_id &&
+	   snap_id == rhs.snap_id;
+  }
+};
+
+WRITE_CLASS_ENCODER(ImageSnapshotSpec);
+
+struct GroupSnapshot {
+  GroupSnapshot() {}
+  GroupSnapshot(snapid_t id, const std::string &name,
+		GroupSnapshotState state)
+    : id(id), name(name), state(state) {}
+
+  snapid_t id;
+  std::string name;
+  GroupSnapshotState state = GROUP_SNAPSHOT_STATE_INCOMPLETE;
+  std::vector<ImageSnapshotSpec> snaps;
+
+  void encode(bufferlist &bl) const;
+  void decode(bufferlist::iterator &it);
+  void dump(Formatter *f) const;
+
+  static void generate_test_instances(std::list<GroupSnapshot*> &o);
+
+  std::string snap_key() const;
+
+  inline bool operator==(const GroupSnapshot &rhs) const {
+    return id == rhs.id && name == rhs.name && state == rhs.state &&
+	   snaps == rhs.snaps;
+  }
+};
+
+WRITE_CLASS_ENCODER(GroupSnapshot);
+
 enum SnapshotNamespaceType {
   SNAPSHOT_NAMESPACE_TYPE_USER = 0,
   SNAPSHOT_NAMESPACE_TYPE_GROUP = 1
@@ -29,13 +29,15 @@ CLS_NAME(rgw)
 #define BI_BUCKET_LOG_INDEX           1
 #define BI_BUCKET_OBJ_INSTANCE_INDEX  2
 #define BI_BUCKET_OLH_DATA_INDEX      3
+#define BI_BUCKET_RESHARD_LOG_INDEX   4
 
-#define BI_BUCKET_LAST_INDEX          4
+#define BI_BUCKET_LAST_INDEX          5
 
 static string bucket_index_prefixes[] = { "", /* special handling for the objs list index */
                                           "0_",     /* bucket log index */
                                           "1000_",  /* obj instance index */
                                           "1001_",  /* olh data index */
+                                          "2000_",  /* reshard log index */
 
                                           /* this must be the last index */
                                           "9999_",};
@@ -373,6 +375,51 @@ static int read_bucket_header(cls_method_context_t hctx, struct rgw_bucket_dir_h
   return 0;
 }
 
+/*
+ * read the header of a shard that is about to be modified; changes are
+ * refused once the shard is blocked for resharding or was resharded
+ */
+static int read_bucket_header_for_write(cls_method_context_t hctx, struct rgw_bucket_dir_header *header)
+{
+  int rc = read_bucket_header(hctx, header);
+  if (rc < 0)
+    return rc;
+
+  if (header->new_instance.writes_refused()) {
+    CLS_LOG(1, "NOTICE: bucket index shard is being resharded (status=%s)\n",
+            to_string(header->new_instance.reshard_status).c_str());
+    return -CLS_RGW_ERR_BUSY_RESHARDING;
+  }
+
+  return 0;
+}
+
+static void reshard_log_key(const string& name, string *key)
+{
+  *key = BI_PREFIX_CHAR;
+  key->append(bucket_index_prefixes[BI_BUCKET_RESHARD_LOG_INDEX]);
+  key->append(name);
+}
+
+/*
+ * while a shard is being resharded, note every object whose entries
+ * change so that they are copied again to the new index
+ */
+static int reshard_log_change(cls_method_context_t hctx, const struct rgw_bucket_dir_header& header,
+                              const string& name)
+{
+  if (header.new_instance.reshard_status != CLS_RGW_RESHARD_IN_PROGRESS) {
+    return 0;
+  }
+
+  string key;
+  reshard_log_key(name, &key);
+
+  bufferlist bl;
+  ::encode(cls_current_version(hctx), bl);
+  return cls_cxx_map_set_val(hctx, key, &bl);
+}
+
 int rgw_bucket_list(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
 {
   bufferlist::iterator iter = in->begin();
@@ -468,6 +515,7 @@ static int check_index(cls_method_context_t hctx, struct rgw_bucket_dir_header *
 
   calc_header->tag_timeout = existing_header->tag_timeout;
   calc_header->ver = existing_header->ver;
+  calc_header->new_instance = existing_header->new_instance;
 
   map<string, bufferlist> keys;
   string start_obj;
@@ -629,18 +677,9 @@ int rgw_bucket_set_tag_timeout(cls_method_context_t hctx, bufferlist *in, buffer
 static int read_key_entry(cls_method_context_t hctx, cls_rgw_obj_key& key, string *idx, struct rgw_bucket_dir_entry *entry,
                           bool special_delete_marker_name = false);
 
-int rgw_bucket_prepare_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+static int prepare_index_op(cls_method_context_t hctx, rgw_cls_obj_prepare_op& op,
+                            struct rgw_bucket_dir_header& header)
 {
-  // decode request
-  rgw_cls_obj_prepare_op op;
-  bufferlist::iterator iter = in->begin();
-  try {
-    ::decode(op, iter);
-  } catch (buffer::error& err) {
-    CLS_LOG(1, "ERROR: rgw_bucket_prepare_op(): failed to decode request\n");
-    return -EINVAL;
-  }
-
   if (op.tag.empty()) {
     CLS_LOG(1, "ERROR: tag is empty\n");
     return -EINVAL;
@@ -675,12 +714,9 @@ int rgw_bucket_prepare_op(cls_method_context_t hctx, bufferlist *in, bufferlist
   info.op = op.op;
   entry.pending_map.insert(pair<string, rgw_bucket_pending_info>(op.tag, info));
 
-  struct rgw_bucket_dir_header header;
-  rc = read_bucket_header(hctx, &header);
-  if (rc < 0) {
-    CLS_LOG(1, "ERROR: rgw_bucket_prepare_op(): failed to read header\n");
+  rc = reshard_log_change(hctx, header, op.key.name);
+  if (rc < 0)
     return rc;
-  }
 
   if (op.log_op) {
     rc = log_index_operation(hctx, op.key, op.op, op.tag, entry.meta.mtime,
@@ -692,13 +728,67 @@ int rgw_bucket_prepare_op(cls_method_context_t hctx, bufferlist *in, bufferlist
   // write out new key to disk
   bufferlist info_bl;
   ::encode(entry, info_bl);
-  rc = cls_cxx_map_set_val(hctx, idx, &info_bl);
+  return cls_cxx_map_set_val(hctx, idx, &info_bl);
+}
+
+int rgw_bucket_prepare_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  // decode request
+  rgw_cls_obj_prepare_op op;
+  bufferlist::iterator iter = in->begin();
+  try {
+    ::decode(op, iter);
+  } catch (buffer::error& err) {
+    CLS_LOG(1, "ERROR: rgw_bucket_prepare_op(): failed to decode request\n");
+    return -EINVAL;
+  }
+
+  struct rgw_bucket_dir_header header;
+  int rc = read_bucket_header_for_write(hctx, &header);
+  if (rc < 0) {
+    CLS_LOG(1, "ERROR: rgw_bucket_prepare_op(): failed to read header\n");
+    return rc;
+  }
+
+  rc = prepare_index_op(hctx, op, header);
   if (rc < 0)
     return rc;
 
   return write_bucket_header(hctx, &header);
 }
 
+/*
+ * prepare several entries of the same index shard, reading and writing the
+ * header once; if one of them fails none is prepared
+ */
+int rgw_bucket_prepare_ops(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  // decode request
+  rgw_cls_obj_prepare_ops op;
+  bufferlist::iterator iter = in->begin();
+  try {
+    ::decode(op, iter);
+  } catch (buffer::error& err) {
+    CLS_LOG(1, "ERROR: rgw_bucket_prepare_ops(): failed to decode request\n");
+    return -EINVAL;
+  }
+
+  struct rgw_bucket_dir_header header;
+  int rc = read_bucket_header_for_write(hctx, &header);
+  if (rc < 0) {
+    CLS_LOG(1, "ERROR: rgw_bucket_prepare_ops(): failed to read header\n");
+    return rc;
+  }
+
+  for (auto& o : op.ops) {
+    rc = prepare_index_op(hctx, o, header);
+    if (rc < 0)
+      return rc;
+  }
+
+  return write_bucket_header(hctx, &header);
+}
+
 static void unaccount_entry(struct rgw_bucket_dir_header& header, struct rgw_bucket_dir_entry& entry)
 {
   struct rgw_bucket_category_stats& stats = header.stats[entry.meta.category];
@@ -792,12 +882,19 @@ int rgw_bucket_complete_op(cls_method_context_t hctx, bufferlist *in, bufferlist
           op.tag.c_str());
 
   struct rgw_bucket_dir_header header;
-  int rc = read_bucket_header(hctx, &header);
+  int rc = read_bucket_header_for_write(hctx, &header);
+  if (rc == -CLS_RGW_ERR_BUSY_RESHARDING) {
+    return rc;
+  }
   if (rc < 0) {
     CLS_LOG(1, "ERROR: rgw_bucket_complete_op(): failed to read header\n");
     return -EINVAL;
   }
 
+  rc = reshard_log_change(hctx, header, op.key.name);
+  if (rc < 0)
+    return rc;
+
   struct rgw_bucket_dir_entry entry;
   bool ondisk = true;
 
@@ -926,6 +1023,10 @@ int rgw_bucket_complete_op(cls_method_context_t hctx, bufferlist *in, bufferlist
             remove_entry.key.name.c_str(), remove_entry.key.instance.c_str(), remove_entry.meta.category);
     unaccount_entry(header, remove_entry);
 
+    ret = reshard_log_change(hctx, header, remove_key.name);
+    if (ret < 0)
+      return ret;
+
     if (op.log_op) {
       rc = log_index_operation(hctx, remove_key, CLS_RGW_OP_DEL, op.tag, remove_entry.meta.mtime,
                                remove_entry.ver, CLS_RGW_STATE_COMPLETE, header.ver, header.max_marker, op.bilog_flags, NULL, NULL);
@@ -1374,11 +1475,23 @@ static int rgw_bucket_link_olh(cls_method_context_t hctx, bufferlist *in, buffer
     return -EINVAL;
   }
 
+  struct rgw_bucket_dir_header header;
+  int ret = read_bucket_header_for_write(hctx, &header);
+  if (ret < 0) {
+    CLS_LOG(1, "ERROR: rgw_bucket_link_olh(): failed to read header\n");
+    return ret;
+  }
+
+  ret = reshard_log_change(hctx, header, op.key.name);
+  if (ret < 0) {
+    return ret;
+  }
+
   BIVerObjEntry obj(hctx, op.key);
   BIOLHEntry olh(hctx, op.key);
 
   /* read instance entry */
-  int ret = obj.init(op.delete_marker);
+  ret = obj.init(op.delete_marker);
   bool existed = (ret == 0);
   if (ret == -ENOENT && op.delete_marker) {
     ret = 0;
@@ -1506,13 +1619,6 @@ static int rgw_bucket_link_olh(cls_method_context_t hctx, bufferlist *in, buffer
     return ret;
   }
 
-  struct rgw_bucket_dir_header header;
-  ret = read_bucket_header(hctx, &header);
-  if (ret < 0) {
-    CLS_LOG(1, "ERROR: rgw_bucket_unlink_instance(): failed to read header\n");
-    return ret;
-  }
-
   if (op.log_op) {
     rgw_bucket_dir_entry& entry = obj.get_dir_entry();
 
@@ -1554,6 +1660,18 @@ static int rgw_bucket_unlink_instance(cls_method_context_t hctx, bufferlist *in,
     return -EINVAL;
   }
 
+  struct rgw_bucket_dir_header header;
+  int ret = read_bucket_header_for_write(hctx, &header);
+  if (ret < 0) {
+    CLS_LOG(1, "ERROR: rgw_bucket_unlink_instance(): failed to read header\n");
+    return ret;
+  }
+
+  ret = reshard_log_change(hctx, header, op.key.name);
+  if (ret < 0) {
+    return ret;
+  }
+
   cls_rgw_obj_key dest_key = op.key;
   if (dest_key.instance == "null") {
     dest_key.instance.clear();
@@ -1562,7 +1680,7 @@ static int rgw_bucket_unlink_instance(cls_method_context_t hctx, bufferlist *in,
   BIVerObjEntry obj(hctx, dest_key);
   BIOLHEntry olh(hctx, dest_key);
 
-  int ret = obj.init();
+  ret = obj.init();
   if (ret == -ENOENT) {
     return 0; /* already removed */
   }
@@ -1662,13 +1780,6 @@ static int rgw_bucket_unlink_instance(cls_method_context_t hctx, bufferlist *in,
     return ret;
   }
 
-  struct rgw_bucket_dir_header header;
-  ret = read_bucket_header(hctx, &header);
-  if (ret < 0) {
-    CLS_LOG(1, "ERROR: rgw_bucket_unlink_instance(): failed to read header\n");
-    return ret;
-  }
-
   if (op.log_op) {
     rgw_bucket_entry_ver ver;
     ver.epoch = (op.olh_epoch ? op.olh_epoch : olh.get_epoch());
@@ -1755,11 +1866,23 @@ static int rgw_bucket_trim_olh_log(cls_method_context_t hctx, bufferlist *in, bu
     return -EINVAL;
   }
 
+  struct rgw_bucket_dir_header header;
+  int ret = read_bucket_header_for_write(hctx, &header);
+  if (ret < 0) {
+    CLS_LOG(1, "ERROR: rgw_bucket_trim_olh_log(): failed to read header\n");
+    return ret;
+  }
+
+  ret = reshard_log_change(hctx, header, op.olh.name);
+  if (ret < 0) {
+    return ret;
+  }
+
   /* read olh entry */
   struct rgw_bucket_olh_entry olh_data_entry;
   string olh_data_key;
   encode_olh_data_key(op.olh, &olh_data_key);
-  int ret = read_index_entry(hctx, olh_data_key, &olh_data_entry);
+  ret = read_index_entry(hctx, olh_data_key, &olh_data_entry);
   if (ret < 0 && ret != -ENOENT) {
     CLS_LOG(0, "ERROR: read_index_entry() olh_key=%s ret=%d", olh_data_key.c_str(), ret);
     return ret;
@@ -1806,11 +1929,23 @@ static int rgw_bucket_clear_olh(cls_method_context_t hctx, bufferlist *in, buffe
     return -EINVAL;
   }
 
+  struct rgw_bucket_dir_header header;
+  int ret = read_bucket_header_for_write(hctx, &header);
+  if (ret < 0) {
+    CLS_LOG(1, "ERROR: rgw_bucket_clear_olh(): failed to read header\n");
+    return ret;
+  }
+
+  ret = reshard_log_change(hctx, header, op.key.name);
+  if (ret < 0) {
+    return ret;
+  }
+
   /* read olh entry */
   struct rgw_bucket_olh_entry olh_data_entry;
   string olh_data_key;
   encode_olh_data_key(op.key, &olh_data_key);
-  int ret = read_index_entry(hctx, olh_data_key, &olh_data_entry);
+  ret = read_index_entry(hctx, olh_data_key, &olh_data_entry);
   if (ret < 0 && ret != -ENOENT) {
     CLS_LOG(0, "ERROR: read_index_entry() olh_key=%s ret=%d", olh_data_key.c_str(), ret);
     return ret;
@@ -1868,6 +2003,11 @@ int rgw_dir_suggest_changes(cls_method_context_t hctx, bufferlist *in, bufferlis
     return rc;
   }
 
+  if (header.new_instance.writes_refused()) {
+    /* only a suggestion, the new index is checked again when listed */
+    return 0;
+  }
+
   timespan tag_timeout(header.tag_timeout ? header.tag_timeout : CEPH_RGW_TAG_TIMEOUT);
 
   bufferlist::iterator in_iter = in->begin();
@@ -1929,6 +2069,9 @@ int rgw_dir_suggest_changes(cls_method_context_t hctx, bufferlist *in, bufferlis
           header.stats[cur_change.meta.category];
       bool log_op = (op & CEPH_RGW_DIR_SUGGEST_LOG_OP) != 0;
       op &= CEPH_RGW_DIR_SUGGEST_OP_MASK;
+      ret = reshard_log_change(hctx, header, cur_change.key.name);
+      if (ret < 0)
+        return ret;
       switch(op) {
       case CEPH_RGW_REMOVE:
         CLS_LOG(10, "CEPH_RGW_REMOVE name=%s instance=%s\n", cur_change.key.name.c_str(), cur_change.key.instance.c_str());
@@ -2242,7 +2385,30 @@ static int rgw_bi_put_op(cls_method_context_t hctx, bufferlist *in, bufferlist *
 
   rgw_cls_bi_entry& entry = op.entry;
 
-  int r = cls_cxx_map_set_val(hctx, entry.idx, &entry.data);
+  struct rgw_bucket_dir_header header;
+  int r = read_bucket_header_for_write(hctx, &header);
+  if (r < 0) {
+    CLS_LOG(1, "ERROR: %s(): failed to read header\n", __func__);
+    return r;
+  }
+
+  if (header.new_instance.resharding()) {
+    cls_rgw_obj_key key;
+    uint8_t category;
+    rgw_bucket_category_stats stats;
+    try {
+      entry.get_info(&key, &category, &stats);
+    } catch (buffer::error& err) {
+      CLS_LOG(0, "ERROR: %s(): failed to decode entry", __func__);
+      return -EINVAL;
+    }
+    r = reshard_log_change(hctx, header, key.name);
+    if (r < 0) {
+      return r;
+    }
+  }
+
+  r = cls_cxx_map_set_val(hctx, entry.idx, &entry.data);
   if (r < 0) {
     CLS_LOG(0, "ERROR: %s(): cls_cxx_map_set_val() returned r=%d", __func__, r);
   }
@@ -2720,6 +2886,125 @@ static int rgw_bi_log_trim(cls_method_context_t hctx, bufferlist *in, bufferlist
   return 0;
 }
 
+static int rgw_set_bucket_resharding(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  // decode request
+  cls_rgw_set_bucket_resharding_op op;
+  bufferlist::iterator iter = in->begin();
+  try {
+    ::decode(op, iter);
+  } catch (buffer::error& err) {
+    CLS_LOG(1, "ERROR: %s(): failed to decode request\n", __func__);
+    return -EINVAL;
+  }
+
+  struct rgw_bucket_dir_header header;
+  int rc = read_bucket_header(hctx, &header);
+  if (rc < 0) {
+    CLS_LOG(1, "ERROR: %s(): failed to read header\n", __func__);
+    return rc;
+  }
+
+  header.new_instance = op.entry;
+
+  return write_bucket_header(hctx, &header);
+}
+
+static int rgw_reshard_log_list(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  // decode request
+  cls_rgw_reshard_log_list_op op;
+  bufferlist::iterator iter = in->begin();
+  try {
+    ::decode(op, iter);
+  } catch (buffer::error& err) {
+    CLS_LOG(1, "ERROR: %s(): failed to decode request\n", __func__);
+    return -EINVAL;
+  }
+
+  string prefix;
+  reshard_log_key(string(), &prefix);
+
+  string start_key;
+  reshard_log_key(op.marker, &start_key);
+
+#define MAX_RESHARD_LOG_ENTRIES 1000
+  uint32_t max = (op.max && op.max < MAX_RESHARD_LOG_ENTRIES ? op.max : MAX_RESHARD_LOG_ENTRIES);
+
+  map<string, bufferlist> keys;
+  int rc = cls_cxx_map_get_vals(hctx, start_key, prefix, max, &keys);
+  if (rc < 0) {
+    return rc;
+  }
+
+  cls_rgw_reshard_log_list_ret op_ret;
+  for (auto& kv : keys) {
+    cls_rgw_reshard_log_entry entry;
+    entry.name = kv.first.substr(prefix.size());
+    bufferlist::iterator biter = kv.second.begin();
+    try {
+      ::decode(entry.ver, biter);
+    } catch (buffer::error& err) {
+      CLS_LOG(0, "ERROR: %s(): failed to decode entry %s", __func__, escape_str(kv.first).c_str());
+      return -EIO;
+    }
+    op_ret.entries.push_back(entry);
+  }
+  op_ret.is_truncated = (keys.size() == max);
+
+  ::encode(op_ret, *out);
+
+  return 0;
+}
+
+static int rgw_reshard_log_trim(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+  // decode request
+  cls_rgw_reshard_log_trim_op op;
+  bufferlist::iterator iter = in->begin();
+  try {
+    ::decode(op, iter);
+  } catch (buffer::error& err) {
+    CLS_LOG(1, "ERROR: %s(): failed to decode request\n", __func__);
+    return -EINVAL;
+  }
+
+  for (auto& entry : op.entries) {
+    string key;
+    reshard_log_key(entry.name, &key);
+
+    bufferlist bl;
+    int rc = cls_cxx_map_get_val(hctx, key, &bl);
+    if (rc == -ENOENT) {
+      continue;
+    }
+    if (rc < 0) {
+      return rc;
+    }
+
+    uint64_t ver;
+    bufferlist::iterator biter = bl.begin();
+    try {
+      ::decode(ver, biter);
+    } catch (buffer::error& err) {
+      CLS_LOG(0, "ERROR: %s(): failed to decode entry %s", __func__, escape_str(key).c_str());
+      return -EIO;
+    }
+
+    /* changed again since it was listed, keep it for the next pass */
+    if (ver != entry.ver) {
+      continue;
+    }
+
+    rc = cls_cxx_map_remove_key(hctx, key);
+    if (rc < 0) {
+      return rc;
+    }
+  }
+
+  return 0;
+}
+
 static void usage_record_prefix_by_time(uint64_t epoch, string& key)
 {
   char buf[32];
@@ -3483,6 +3768,7 @@ CLS_INIT(rgw)
   cls_method_handle_t h_rgw_bucket_rebuild_index;
   cls_method_handle_t h_rgw_bucket_update_stats;
   cls_method_handle_t h_rgw_bucket_prepare_op;
+  cls_method_handle_t h_rgw_bucket_prepare_ops;
   cls_method_handle_t h_rgw_bucket_complete_op;
   cls_method_handle_t h_rgw_bucket_link_olh;
   cls_method_handle_t h_rgw_bucket_unlink_instance_op;
@@ -3498,6 +3784,9 @@ CLS_INIT(rgw)
   cls_method_handle_t h_rgw_bi_list_op;
   cls_method_handle_t h_rgw_bi_log_list_op;
   cls_method_handle_t h_rgw_dir_suggest_changes;
+  cls_method_handle_t h_rgw_set_bucket_resharding;
+  cls_method_handle_t h_rgw_reshard_log_list;
+  cls_method_handle_t h_rgw_reshard_log_trim;
   cls_method_handle_t h_rgw_user_usage_log_add;
   cls_method_handle_t h_rgw_user_usage_log_read;
   cls_method_handle_t h_rgw_user_usage_log_trim;
@@ -3521,6 +3810,7 @@ CLS_INIT(rgw)
   cls_register_cxx_method(h_class, "bucket_rebuild_index", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_rebuild_index, &h_rgw_bucket_rebuild_index);
   cls_register_cxx_method(h_class, "bucket_update_stats", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_update_stats, &h_rgw_bucket_update_stats);
   cls_register_cxx_method(h_class, "bucket_prepare_op", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_prepare_op, &h_rgw_bucket_prepare_op);
+  cls_register_cxx_method(h_class, "bucket_prepare_ops", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_prepare_ops, &h_rgw_bucket_prepare_ops);
   cls_register_cxx_method(h_class, "bucket_complete_op", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_complete_op, &h_rgw_bucket_complete_op);
   cls_register_cxx_method(h_class, "bucket_link_olh", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_link_olh, &h_rgw_bucket_link_olh);
   cls_register_cxx_method(h_class, "bucket_unlink_instance", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bucket_unlink_instance, &h_rgw_bucket_unlink_instance_op);
@@ -3541,6 +3831,11 @@ CLS_INIT(rgw)
   cls_register_cxx_method(h_class, "bi_log_trim", CLS_METHOD_RD | CLS_METHOD_WR, rgw_bi_log_trim, &h_rgw_bi_log_list_op);
   cls_register_cxx_method(h_class, "dir_suggest_changes", CLS_METHOD_RD | CLS_METHOD_WR, rgw_dir_suggest_changes, &h_rgw_dir_suggest_changes);
 
+  /* bucket index resharding */
+  cls_register_cxx_method(h_class, "set_bucket_resharding", CLS_METHOD_RD | CLS_METHOD_WR, rgw_set_bucket_resharding, &h_rgw_set_bucket_resharding);
+  cls_register_cxx_method(h_class, "reshard_log_list", CLS_METHOD_RD, rgw_reshard_log_list, &h_rgw_reshard_log_list);
+  cls_register_cxx_method(h_class, "reshard_log_trim", CLS_METHOD_RD | CLS_METHOD_WR, rgw_reshard_log_trim, &h_rgw_reshard_log_trim);
+
   /* usage logging */
   cls_register_cxx_method(h_class, "user_usage_log_add", CLS_METHOD_RD | CLS_METHOD_WR, rgw_user_usage_log_add, &h_rgw_user_usage_log_add);
   cls_register_cxx_method(h_class, "user_usage_log_read", CLS_METHOD_RD, rgw_user_usage_log_read, &h_rgw_user_usage_log_read);
@@ -165,6 +165,15 @@ void cls_rgw_bucket_prepare_op(ObjectWriteOperation& o, RGWModifyOp op, string&
   o.exec("rgw", "bucket_prepare_op", in);
 }
 
+void cls_rgw_bucket_prepare_ops(ObjectWriteOperation& o, list<rgw_cls_obj_prepare_op>& ops)
+{
+  struct rgw_cls_obj_prepare_ops call;
+  call.ops.swap(ops);
+  bufferlist in;
+  ::encode(call, in);
+  o.exec("rgw", "bucket_prepare_ops", in);
+}
+
 void cls_rgw_bucket_complete_op(ObjectWriteOperation& o, RGWModifyOp op, string& tag,
                                 rgw_bucket_entry_ver& ver,
                                 const cls_rgw_obj_key& key,
@@ -499,6 +508,66 @@ int CLSRGWIssueBucketRebuild::issue_op(int shard_id, const string& oid)
   return issue_bucket_rebuild_index_op(io_ctx, oid, &manager);
 }
 
+void cls_rgw_set_bucket_resharding(librados::ObjectWriteOperation& op,
+                                   const cls_rgw_bucket_instance_entry& entry)
+{
+  bufferlist in;
+  struct cls_rgw_set_bucket_resharding_op call;
+  call.entry = entry;
+  ::encode(call, in);
+  op.exec("rgw", "set_bucket_resharding", in);
+}
+
+static bool issue_set_bucket_resharding(librados::IoCtx& io_ctx, const string& oid,
+                                        const cls_rgw_bucket_instance_entry& entry,
+                                        BucketIndexAioManager *manager) {
+  ObjectWriteOperation op;
+  cls_rgw_set_bucket_resharding(op, entry);
+  return manager->aio_operate(io_ctx, oid, &op);
+}
+
+int CLSRGWIssueSetBucketResharding::issue_op(int shard_id, const string& oid)
+{
+  return issue_set_bucket_resharding(io_ctx, oid, entry, &manager);
+}
+
+int cls_rgw_reshard_log_list(librados::IoCtx& io_ctx, const string& oid,
+                             const string& marker, uint32_t max,
+                             list<cls_rgw_reshard_log_entry> *entries, bool *is_truncated)
+{
+  bufferlist in, out;
+  struct cls_rgw_reshard_log_list_op call;
+  call.marker = marker;
+  call.max = max;
+  ::encode(call, in);
+  int r = io_ctx.exec(oid, "rgw", "reshard_log_list", in, out);
+  if (r < 0)
+    return r;
+
+  struct cls_rgw_reshard_log_list_ret op_ret;
+  bufferlist::iterator iter = out.begin();
+  try {
+    ::decode(op_ret, iter);
+  } catch (buffer::error& err) {
+    return -EIO;
+  }
+
+  entries->swap(op_ret.entries);
+  *is_truncated = op_ret.is_truncated;
+
+  return 0;
+}
+
+void cls_rgw_reshard_log_trim(librados::ObjectWriteOperation& op,
+                              const list<cls_rgw_reshard_log_entry>& entries)
+{
+  bufferlist in;
+  struct cls_rgw_reshard_log_trim_op call;
+  call.entries = entries;
+  ::encode(call, in);
+  op.exec("rgw", "reshard_log_trim", in);
+}
+
 void cls_rgw_encode_suggestion(char op, rgw_bucket_dir_entry& dirent, bufferlist& updates)
 {
   updates.append(op);
@@ -536,6 +605,28 @@ public:
   }
 };
 
+int cls_rgw_get_dir_header(IoCtx& io_ctx, const string& oid, rgw_bucket_dir_header *header)
+{
+  bufferlist in, out;
+  struct rgw_cls_list_op call;
+  call.num_entries = 0;
+  ::encode(call, in);
+  int r = io_ctx.exec(oid, "rgw", "bucket_list", in, out);
+  if (r < 0)
+    return r;
+
+  struct rgw_cls_list_ret ret;
+  bufferlist::iterator iter = out.begin();
+  try {
+    ::decode(ret, iter);
+  } catch (buffer::error& err) {
+    return -EIO;
+  }
+
+  *header = ret.dir.header;
+  return 0;
+}
+
 int cls_rgw_get_dir_header_async(IoCtx& io_ctx, string& oid, RGWGetDirHeader_CB *ctx)
 {
   bufferlist in, out;
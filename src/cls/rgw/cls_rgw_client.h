@@ -311,6 +311,10 @@ void cls_rgw_bucket_prepare_op(librados::ObjectWriteOperation& o, RGWModifyOp op
                                const cls_rgw_obj_key& key, const string& locator, bool log_op,
                                uint16_t bilog_op);
 
+/* prepare a number of entries of the same index shard in one call */
+void cls_rgw_bucket_prepare_ops(librados::ObjectWriteOperation& o,
+                                list<rgw_cls_obj_prepare_op>& ops);
+
 void cls_rgw_bucket_complete_op(librados::ObjectWriteOperation& o, RGWModifyOp op, string& tag,
                                 rgw_bucket_entry_ver& ver,
                                 const cls_rgw_obj_key& key,
@@ -452,8 +456,30 @@ public:
     CLSRGWConcurrentIO(io_ctx, oids, max_aio), result(dir_headers) {}
 };
 
+int cls_rgw_get_dir_header(librados::IoCtx& io_ctx, const string& oid, rgw_bucket_dir_header *header);
 int cls_rgw_get_dir_header_async(librados::IoCtx& io_ctx, string& oid, RGWGetDirHeader_CB *ctx);
 
+/* bucket index resharding */
+void cls_rgw_set_bucket_resharding(librados::ObjectWriteOperation& op,
+                                   const cls_rgw_bucket_instance_entry& entry);
+
+class CLSRGWIssueSetBucketResharding : public CLSRGWConcurrentIO {
+  cls_rgw_bucket_instance_entry entry;
+protected:
+  int issue_op(int shard_id, const string& oid);
+public:
+  CLSRGWIssueSetBucketResharding(librados::IoCtx& io_ctx, map<int, string>& bucket_objs,
+                                 const cls_rgw_bucket_instance_entry& _entry,
+                                 uint32_t max_aio) :
+    CLSRGWConcurrentIO(io_ctx, bucket_objs, max_aio), entry(_entry) {}
+};
+
+int cls_rgw_reshard_log_list(librados::IoCtx& io_ctx, const string& oid,
+                             const string& marker, uint32_t max,
+                             list<cls_rgw_reshard_log_entry> *entries, bool *is_truncated);
+void cls_rgw_reshard_log_trim(librados::ObjectWriteOperation& op,
+                              const list<cls_rgw_reshard_log_entry>& entries);
+
 void cls_rgw_encode_suggestion(char op, rgw_bucket_dir_entry& dirent, bufferlist& updates);
 
 void cls_rgw_suggest_changes(librados::ObjectWriteOperation& o, bufferlist& updates);
@@ -110,6 +110,24 @@ void rgw_cls_obj_prepare_op::dump(Formatter *f) const
   f->dump_int("bilog_flags", bilog_flags);
 }
 
+void rgw_cls_obj_prepare_ops::generate_test_instances(list<rgw_cls_obj_prepare_ops*>& o)
+{
+  rgw_cls_obj_prepare_ops *op = new rgw_cls_obj_prepare_ops;
+  list<rgw_cls_obj_prepare_op*> ls;
+  rgw_cls_obj_prepare_op::generate_test_instances(ls);
+  for (auto p : ls) {
+    op->ops.push_back(*p);
+    delete p;
+  }
+  o.push_back(op);
+  o.push_back(new rgw_cls_obj_prepare_ops);
+}
+
+void rgw_cls_obj_prepare_ops::dump(Formatter *f) const
+{
+  encode_json("ops", ops, f);
+}
+
 void rgw_cls_obj_complete_op::generate_test_instances(list<rgw_cls_obj_complete_op*>& o)
 {
   rgw_cls_obj_complete_op *op = new rgw_cls_obj_complete_op;
@@ -481,6 +481,38 @@ void rgw_bucket_category_stats::dump(Formatter *f) const
   f->dump_unsigned("actual_size", actual_size);
 }
 
+void cls_rgw_bucket_instance_entry::generate_test_instances(list<cls_rgw_bucket_instance_entry*>& o)
+{
+  o.push_back(new cls_rgw_bucket_instance_entry);
+  cls_rgw_bucket_instance_entry *e = new cls_rgw_bucket_instance_entry;
+  e->reshard_status = CLS_RGW_RESHARD_IN_PROGRESS;
+  e->new_bucket_instance_id = "new_instance_id";
+  e->num_shards = 16;
+  o.push_back(e);
+}
+
+void cls_rgw_bucket_instance_entry::dump(Formatter *f) const
+{
+  encode_json("reshard_status", to_string(reshard_status), f);
+  encode_json("new_bucket_instance_id", new_bucket_instance_id, f);
+  encode_json("num_shards", num_shards, f);
+}
+
+void cls_rgw_reshard_log_entry::generate_test_instances(list<cls_rgw_reshard_log_entry*>& o)
+{
+  o.push_back(new cls_rgw_reshard_log_entry);
+  cls_rgw_reshard_log_entry *e = new cls_rgw_reshard_log_entry;
+  e->name = "name";
+  e->ver = 12;
+  o.push_back(e);
+}
+
+void cls_rgw_reshard_log_entry::dump(Formatter *f) const
+{
+  encode_json("name", name, f);
+  encode_json("ver", ver, f);
+}
+
 void rgw_bucket_dir_header::generate_test_instances(list<rgw_bucket_dir_header*>& o)
 {
   list<rgw_bucket_category_stats *> l;
@@ -514,6 +546,7 @@ void rgw_bucket_dir_header::dump(Formatter *f) const
     f->close_section();
   }
   f->close_section();
+  encode_json("new_instance", new_instance, f);
 }
 
 void rgw_bucket_dir::generate_test_instances(list<rgw_bucket_dir*>& o)
@@ -583,26 +583,113 @@ struct rgw_bucket_category_stats {
 };
 WRITE_CLASS_ENCODER(rgw_bucket_category_stats)
 
+/* same as ERR_BUSY_RESHARDING in rgw_common.h */
+#define CLS_RGW_ERR_BUSY_RESHARDING 2300
+
+enum cls_rgw_reshard_status {
+  CLS_RGW_RESHARD_NONE        = 0,
+  CLS_RGW_RESHARD_IN_PROGRESS = 1, /* being copied, changes are logged */
+  CLS_RGW_RESHARD_BLOCKED     = 2, /* catching up, changes are refused */
+  CLS_RGW_RESHARD_DONE        = 3, /* replaced by the new bucket instance */
+};
+
+static inline std::string to_string(const cls_rgw_reshard_status status)
+{
+  switch (status) {
+  case CLS_RGW_RESHARD_NONE:
+    return "none";
+  case CLS_RGW_RESHARD_IN_PROGRESS:
+    return "in-progress";
+  case CLS_RGW_RESHARD_BLOCKED:
+    return "blocked";
+  case CLS_RGW_RESHARD_DONE:
+    return "done";
+  };
+  return "unknown";
+}
+
+struct cls_rgw_bucket_instance_entry {
+  cls_rgw_reshard_status reshard_status{CLS_RGW_RESHARD_NONE};
+  string new_bucket_instance_id;
+  int32_t num_shards{-1};
+
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode((uint8_t)reshard_status, bl);
+    ::encode(new_bucket_instance_id, bl);
+    ::encode(num_shards, bl);
+    ENCODE_FINISH(bl);
+  }
+
+  void decode(bufferlist::iterator& bl) {
+    DECODE_START(1, bl);
+    uint8_t s;
+    ::decode(s, bl);
+    reshard_status = (cls_rgw_reshard_status)s;
+    ::decode(new_bucket_instance_id, bl);
+    ::decode(num_shards, bl);
+    DECODE_FINISH(bl);
+  }
+
+  void dump(Formatter *f) const;
+  static void generate_test_instances(list<cls_rgw_bucket_instance_entry*>& o);
+
+  bool resharding() const {
+    return reshard_status != CLS_RGW_RESHARD_NONE;
+  }
+  bool writes_refused() const {
+    return (reshard_status == CLS_RGW_RESHARD_BLOCKED ||
+            reshard_status == CLS_RGW_RESHARD_DONE);
+  }
+};
+WRITE_CLASS_ENCODER(cls_rgw_bucket_instance_entry)
+
+/* an object whose index entries changed while its shard was resharded */
+struct cls_rgw_reshard_log_entry {
+  string name;
+  uint64_t ver{0};
+
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(name, bl);
+    ::encode(ver, bl);
+    ENCODE_FINISH(bl);
+  }
+
+  void decode(bufferlist::iterator& bl) {
+    DECODE_START(1, bl);
+    ::decode(name, bl);
+    ::decode(ver, bl);
+    DECODE_FINISH(bl);
+  }
+
+  void dump(Formatter *f) const;
+  static void generate_test_instances(list<cls_rgw_reshard_log_entry*>& o);
+};
+WRITE_CLASS_ENCODER(cls_rgw_reshard_log_entry)
+
 struct rgw_bucket_dir_header {
   map<uint8_t, rgw_bucket_category_stats> stats;
   uint64_t tag_timeout;
   uint64_t ver;
   uint64_t master_ver;
   string max_marker;
+  cls_rgw_bucket_instance_entry new_instance;
 
   rgw_bucket_dir_header() : tag_timeout(0), ver(0), master_ver(0) {}
 
   void encode(bufferlist &bl) const {
-    ENCODE_START(5, 2, bl);
+    ENCODE_START(6, 2, bl);
     ::encode(stats, bl);
     ::encode(tag_timeout, bl);
     ::encode(ver, bl);
     ::encode(master_ver, bl);
     ::encode(max_marker, bl);
+    ::encode(new_instance, bl);
     ENCODE_FINISH(bl);
   }
   void decode(bufferlist::iterator &bl) {
-    DECODE_START_LEGACY_COMPAT_LEN(3, 2, 2, bl);
+    DECODE_START_LEGACY_COMPAT_LEN(6, 2, 2, bl);
     ::decode(stats, bl);
     if (struct_v > 2) {
       ::decode(tag_timeout, bl);
@@ -618,6 +705,11 @@ struct rgw_bucket_dir_header {
     if (struct_v >= 5) {
       ::decode(max_marker, bl);
     }
+    if (struct_v >= 6) {
+      ::decode(new_instance, bl);
+    } else {
+      new_instance = cls_rgw_bucket_instance_entry();
+    }
     DECODE_FINISH(bl);
   }
   void dump(Formatter *f) const;
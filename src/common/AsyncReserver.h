@@ -74,6 +74,17 @@ public:
     do_queues();
   }
 
+  unsigned get_max() {
+    Mutex::Locker l(lock);
+    return max_allowed;
+  }
+
+  /// number of reservations waiting for a slot
+  unsigned get_num_waiting() {
+    Mutex::Locker l(lock);
+    return queue_pointers.size();
+  }
+
   void set_min_priority(unsigned min) {
     Mutex::Locker l(lock);
     min_priority = min;
@@ -73,6 +73,13 @@ public:
       ) {
       return p.crc32c(len, -1);
     }
+    static value_t calc(
+      state_t state,
+      size_t len,
+      const char *data
+      ) {
+      return ceph_crc32c(-1, (const unsigned char *)data, len);
+    }
   };
 
   struct crc32c_16 {
@@ -92,6 +99,13 @@ public:
       ) {
       return p.crc32c(len, -1) & 0xffff;
     }
+    static value_t calc(
+      state_t state,
+      size_t len,
+      const char *data
+      ) {
+      return ceph_crc32c(-1, (const unsigned char *)data, len) & 0xffff;
+    }
   };
 
   struct crc32c_8 {
@@ -111,6 +125,13 @@ public:
       ) {
       return p.crc32c(len, -1) & 0xff;
     }
+    static value_t calc(
+      state_t state,
+      size_t len,
+      const char *data
+      ) {
+      return ceph_crc32c(-1, (const unsigned char *)data, len) & 0xff;
+    }
   };
 
   struct xxhash32 {
@@ -138,6 +159,13 @@ public:
       }
       return XXH32_digest(state);
     }
+    static value_t calc(
+      state_t state,
+      size_t len,
+      const char *data
+      ) {
+      return XXH32(data, len, -1);
+    }
   };
 
   struct xxhash64 {
@@ -165,8 +193,31 @@ public:
       }
       return XXH64_digest(state);
     }
+    static value_t calc(
+      state_t state,
+      size_t len,
+      const char *data
+      ) {
+      return XXH64(data, len, -1);
+    }
   };
 
+  /// checksum the next block, in place if it lies within one buffer
+  template<class Alg>
+  static typename Alg::value_t calc_block(
+    typename Alg::state_t state,
+    size_t len,
+    bufferlist::const_iterator& p
+    ) {
+    bufferlist::const_iterator q = p;
+    const char *data;
+    if (q.get_ptr_and_advance(len, &data) == len) {
+      p = q;
+      return Alg::calc(state, len, data);
+    }
+    return Alg::calc(state, len, p);
+  }
+
   template<class Alg>
   static int calculate(
     size_t csum_block_size,
@@ -190,7 +241,7 @@ public:
       reinterpret_cast<typename Alg::value_t*>(csum_data->c_str());
     pv += offset / csum_block_size;
     while (blocks--) {
-      *pv = Alg::calc(state, csum_block_size, p);
+      *pv = calc_block<Alg>(state, csum_block_size, p);
       ++pv;
     }
     Alg::fini(&state);
@@ -218,7 +269,7 @@ public:
     pv += offset / csum_block_size;
     size_t pos = offset;
     while (length > 0) {
-      typename Alg::value_t v = Alg::calc(state, csum_block_size, p);
+      typename Alg::value_t v = calc_block<Alg>(state, csum_block_size, p);
       if (*pv != v) {
 	if (bad_csum) {
 	  *bad_csum = v;
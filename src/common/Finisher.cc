@@ -108,3 +108,229 @@ void *Finisher::finisher_thread_entry()
   return 0;
 }
 
+
+#undef dout_prefix
+#define dout_prefix *_dout << "finisher_pool(" << this << ") "
+
+FinisherPool::FinisherPool(CephContext *cct_, string name, string tn,
+			   unsigned num_threads, unsigned num_lanes)
+  : cct(cct_), thread_name(tn),
+    lanes(num_lanes ? num_lanes : std::max(1u, num_threads) * 16),
+    logger(0)
+{
+  assert(num_threads > 0);
+  for (unsigned i = 0; i < num_threads; ++i)
+    workers.emplace_back(new Worker(this, i));
+
+  PerfCountersBuilder b(cct, string("finisher-") + name,
+			l_finisher_first, l_finisher_last);
+  b.add_u64(l_finisher_queue_len, "queue_len");
+  b.add_time_avg(l_finisher_complete_lat, "complete_latency");
+  logger = b.create_perf_counters();
+  cct->get_perfcounters_collection()->add(logger);
+  logger->set(l_finisher_queue_len, 0);
+  logger->set(l_finisher_complete_lat, 0);
+}
+
+FinisherPool::~FinisherPool()
+{
+  if (logger && cct) {
+    cct->get_perfcounters_collection()->remove(logger);
+    delete logger;
+  }
+}
+
+void FinisherPool::queue(uint64_t key, Context *c, int r)
+{
+  Lane *l = lane_of(key);
+  ++pending;
+  if (logger)
+    logger->inc(l_finisher_queue_len);
+  bool idle_lane;
+  {
+    std::lock_guard<std::mutex> ll(l->lock);
+    l->queue.push_back(make_pair(c, r));
+    idle_lane = !l->scheduled;
+    l->scheduled = true;
+  }
+  if (idle_lane)
+    schedule(l, workers[(l - &lanes[0]) % workers.size()].get());
+}
+
+void FinisherPool::queue(uint64_t key, list<Context*>& ls)
+{
+  if (ls.empty())
+    return;
+  Lane *l = lane_of(key);
+  pending += ls.size();
+  if (logger)
+    logger->inc(l_finisher_queue_len, ls.size());
+  bool idle_lane;
+  {
+    std::lock_guard<std::mutex> ll(l->lock);
+    for (auto c : ls)
+      l->queue.push_back(make_pair(c, 0));
+    idle_lane = !l->scheduled;
+    l->scheduled = true;
+  }
+  ls.clear();
+  if (idle_lane)
+    schedule(l, workers[(l - &lanes[0]) % workers.size()].get());
+}
+
+void FinisherPool::schedule(Lane *l, Worker *w)
+{
+  {
+    std::lock_guard<std::mutex> wl(w->lock);
+    w->ready.push_back(l);
+  }
+  // an idle worker raises idle before it looks at num_ready, and we
+  // raise num_ready before we look at idle, so one of us sees the other
+  ++num_ready;
+  if (idle.load()) {
+    std::lock_guard<std::mutex> sl(sleep_lock);
+    sleep_cond.notify_one();
+  }
+}
+
+FinisherPool::Lane *FinisherPool::dequeue(Worker *w)
+{
+  {
+    std::lock_guard<std::mutex> wl(w->lock);
+    if (!w->ready.empty()) {
+      Lane *l = w->ready.front();
+      w->ready.pop_front();
+      --num_ready;
+      return l;
+    }
+  }
+  for (unsigned i = 1; i < workers.size(); ++i) {
+    Worker *victim = workers[(w->id + i) % workers.size()].get();
+    std::lock_guard<std::mutex> vl(victim->lock);
+    if (!victim->ready.empty()) {
+      Lane *l = victim->ready.back();
+      victim->ready.pop_back();
+      --num_ready;
+      ldout(cct, 20) << "worker " << w->id << " stole lane "
+		     << (l - &lanes[0]) << " from " << victim->id << dendl;
+      return l;
+    }
+  }
+  return NULL;
+}
+
+void FinisherPool::run_lane(Worker *w, Lane *l)
+{
+  vector<pair<Context*,int> > ls;
+  {
+    std::lock_guard<std::mutex> ll(l->lock);
+    ls.swap(l->queue);
+  }
+  ldout(cct, 10) << "worker " << w->id << " doing " << ls.size()
+		 << " on lane " << (l - &lanes[0]) << dendl;
+
+  utime_t start, end;
+  if (logger)
+    start = ceph_clock_now();
+  for (auto& p : ls) {
+    p.first->complete(p.second);
+    if (logger) {
+      logger->dec(l_finisher_queue_len);
+      end = ceph_clock_now();
+      logger->tinc(l_finisher_complete_lat, end - start);
+      start = end;
+    }
+  }
+
+  bool more;
+  {
+    std::lock_guard<std::mutex> ll(l->lock);
+    more = !l->queue.empty();
+    if (!more)
+      l->scheduled = false;
+  }
+  // requeue at the back, so other lanes on this worker get a turn and
+  // an idle worker can take over this one
+  if (more)
+    schedule(l, w);
+  pending -= ls.size();
+  wake_drainers();
+}
+
+void FinisherPool::wake_drainers()
+{
+  if (draining.load()) {
+    std::lock_guard<std::mutex> sl(sleep_lock);
+    empty_cond.notify_all();
+  }
+}
+
+void FinisherPool::worker_entry(Worker *w)
+{
+  ldout(cct, 10) << "worker " << w->id << " start" << dendl;
+  while (true) {
+    Lane *l = dequeue(w);
+    if (l) {
+      run_lane(w, l);
+      continue;
+    }
+    std::unique_lock<std::mutex> sl(sleep_lock);
+    ++idle;
+    while (!stopping && num_ready.load() == 0)
+      sleep_cond.wait(sl);
+    --idle;
+    if (stopping)
+      break;
+  }
+  ldout(cct, 10) << "worker " << w->id << " stop" << dendl;
+}
+
+void FinisherPool::start()
+{
+  ldout(cct, 10) << __func__ << " " << workers.size() << " threads" << dendl;
+  for (auto& w : workers)
+    w->create(thread_name.c_str());
+}
+
+void FinisherPool::stop()
+{
+  ldout(cct, 10) << __func__ << dendl;
+  {
+    std::lock_guard<std::mutex> sl(sleep_lock);
+    stopping = true;
+    sleep_cond.notify_all();
+  }
+  for (auto& w : workers)
+    w->join();
+  std::lock_guard<std::mutex> sl(sleep_lock);
+  stopping = false;
+  ldout(cct, 10) << __func__ << " finish" << dendl;
+}
+
+void FinisherPool::wait_for_empty()
+{
+  std::unique_lock<std::mutex> sl(sleep_lock);
+  ++draining;
+  while (pending.load()) {
+    ldout(cct, 10) << "wait_for_empty waiting" << dendl;
+    empty_cond.wait(sl);
+  }
+  --draining;
+  ldout(cct, 10) << "wait_for_empty empty" << dendl;
+}
+
+void FinisherPool::wait_for_empty(uint64_t key)
+{
+  Lane *l = lane_of(key);
+  std::unique_lock<std::mutex> sl(sleep_lock);
+  ++draining;
+  while (true) {
+    {
+      std::lock_guard<std::mutex> ll(l->lock);
+      if (!l->scheduled)
+	break;
+    }
+    empty_cond.wait(sl);
+  }
+  --draining;
+}
@@ -15,6 +15,12 @@
 #ifndef CEPH_FINISHER_H
 #define CEPH_FINISHER_H
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+
 #include "include/atomic.h"
 #include "common/Mutex.h"
 #include "common/Cond.h"
@@ -164,6 +170,89 @@ class Finisher {
   }
 };
 
+/** @brief A pool of finisher threads with per-key ordering.
+ * Contexts are queued under a key (a sequencer, a PG, an image...).
+ * Contexts with the same key complete in the order they were queued and
+ * never concurrently; contexts with different keys may complete in
+ * parallel.  Keys are hashed onto lanes.  A lane with work sits on
+ * exactly one thread's run queue; a thread with nothing to do steals
+ * lanes from the others, so a slow completion only holds up its own
+ * lane.
+ */
+class FinisherPool {
+  struct Lane {
+    std::mutex lock;
+    vector<pair<Context*,int> > queue;
+    bool scheduled = false;  ///< on a run queue, or being run
+  };
+
+  struct Worker : public Thread {
+    FinisherPool *pool;
+    unsigned id;
+    std::mutex lock;
+    std::deque<Lane*> ready;  ///< lanes to run, front first; steal from back
+    Worker(FinisherPool *p, unsigned i) : pool(p), id(i) {}
+    void *entry() override {
+      pool->worker_entry(this);
+      return 0;
+    }
+  };
+
+  CephContext *cct;
+  string thread_name;
+  vector<Lane> lanes;
+  vector<std::unique_ptr<Worker> > workers;
+
+  std::mutex sleep_lock;  ///< protects stopping; sleeping and draining
+  std::condition_variable sleep_cond;  ///< wakes idle workers
+  std::condition_variable empty_cond;  ///< wakes wait_for_empty()
+  bool stopping = false;
+  std::atomic<unsigned> idle = {0};      ///< workers waiting for work
+  std::atomic<unsigned> draining = {0};  ///< threads in wait_for_empty()
+  std::atomic<uint64_t> num_ready = {0}; ///< lanes on run queues
+  std::atomic<uint64_t> pending = {0};   ///< contexts queued or running
+
+  PerfCounters *logger;
+
+  Lane *lane_of(uint64_t key) {
+    return &lanes[((key * 0x9E3779B97F4A7C15ull) >> 32) % lanes.size()];
+  }
+  void schedule(Lane *l, Worker *w);
+  Lane *dequeue(Worker *w);
+  void run_lane(Worker *w, Lane *l);
+  void wake_drainers();
+  void worker_entry(Worker *w);
+
+ public:
+  /// Add a context to complete in order with others of the same key.
+  void queue(uint64_t key, Context *c, int r = 0);
+  void queue(uint64_t key, list<Context*>& ls);
+
+  /// Start the worker threads.
+  void start();
+
+  /** @brief Stop the worker threads.
+   * As with Finisher::stop(), the sources that queue contexts should be
+   * shut down and wait_for_empty() called first. */
+  void stop();
+
+  /// Block until nothing is queued or running.
+  void wait_for_empty();
+
+  /// Block until nothing queued under key's lane is queued or running.
+  void wait_for_empty(uint64_t key);
+
+  unsigned get_num_threads() const {
+    return workers.size();
+  }
+
+  /// Construct a named pool that logs its queue length.
+  /// @param num_lanes number of ordering lanes, 0 for a default
+  FinisherPool(CephContext *cct_, string name, string tn,
+	       unsigned num_threads, unsigned num_lanes = 0);
+  ~FinisherPool();
+};
+
 /// Context that is completed asynchronously on the supplied finisher.
 class C_OnFinisher : public Context {
   Context *con;
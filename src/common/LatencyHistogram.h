@@ -0,0 +1,93 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_COMMON_LATENCY_HISTOGRAM_H
+#define CEPH_COMMON_LATENCY_HISTOGRAM_H
+
+#include "include/int_types.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+
+/**
+ * Latencies in microseconds, counted in buckets 1/16th of a power of two
+ * wide, so percentiles come out within about 6% of the exact value.
+ */
+class LatencyHistogram {
+public:
+  void add(uint64_t usec) {
+    ++m_buckets[bucket(usec)];
+    m_min = (m_count == 0 ? usec : std::min(m_min, usec));
+    m_max = std::max(m_max, usec);
+    m_sum += usec;
+    ++m_count;
+  }
+
+  void merge(const LatencyHistogram &other) {
+    if (other.m_count == 0) {
+      return;
+    }
+    for (size_t i = 0; i < BUCKETS; ++i) {
+      m_buckets[i] += other.m_buckets[i];
+    }
+    m_min = (m_count == 0 ? other.m_min : std::min(m_min, other.m_min));
+    m_max = std::max(m_max, other.m_max);
+    m_sum += other.m_sum;
+    m_count += other.m_count;
+  }
+
+  uint64_t count() const {
+    return m_count;
+  }
+  uint64_t min() const {
+    return m_min;
+  }
+  uint64_t max() const {
+    return m_max;
+  }
+  double mean() const {
+    return m_count == 0 ? 0 : static_cast<double>(m_sum) / m_count;
+  }
+
+  uint64_t percentile(double p) const {
+    uint64_t target = std::max<uint64_t>(1, std::ceil(p / 100 * m_count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+      seen += m_buckets[i];
+      if (seen >= target) {
+        return std::min(upper_bound(i), m_max);
+      }
+    }
+    return m_max;
+  }
+
+private:
+  static const unsigned SUB_BUCKET_BITS = 4;
+  static const size_t BUCKETS = (64 - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS;
+
+  static size_t bucket(uint64_t v) {
+    if (v < (1 << SUB_BUCKET_BITS)) {
+      return v;
+    }
+    unsigned shift = 63 - __builtin_clzll(v) - SUB_BUCKET_BITS;
+    return ((shift + 1) << SUB_BUCKET_BITS) +
+           ((v >> shift) & ((1 << SUB_BUCKET_BITS) - 1));
+  }
+
+  static uint64_t upper_bound(size_t i) {
+    if (i < (1 << SUB_BUCKET_BITS)) {
+      return i;
+    }
+    unsigned shift = (i >> SUB_BUCKET_BITS) - 1;
+    uint64_t sub = i & ((1 << SUB_BUCKET_BITS) - 1);
+    return ((((1 << SUB_BUCKET_BITS) + sub + 1) << shift) - 1);
+  }
+
+  uint64_t m_buckets[BUCKETS] = {};
+  uint64_t m_count = 0;
+  uint64_t m_sum = 0;
+  uint64_t m_min = 0;
+  uint64_t m_max = 0;
+};
+
+#endif // CEPH_COMMON_LATENCY_HISTOGRAM_H
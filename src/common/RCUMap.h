@@ -0,0 +1,156 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2004-2006 Sage Weil <sage@newdream.net>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMMON_RCUMAP_H
+#define CEPH_COMMON_RCUMAP_H
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+#include "include/unordered_map.h"
+
+/**
+ * Read-mostly map whose lookups take no lock.
+ *
+ * Readers see an immutable snapshot of the map.  Writers copy it,
+ * modify the copy, publish it, and free the old one once every reader
+ * that may still be looking at it is gone (a grace period, as in
+ * sleepable RCU).  Readers announce themselves by bumping a counter in
+ * one of a few cacheline-sized slots picked per thread, so concurrent
+ * readers on different threads don't share a cacheline.
+ *
+ * Writes are O(size) and wait for readers; use it only where the map
+ * changes rarely compared to how often it is read.  A value found by
+ * lookup() is only guaranteed to be the one in the map while the
+ * callback runs; callers that need it afterwards must pin it (e.g. take
+ * a ref) inside the callback and keep it alive until the next grace
+ * period of the write that removes it, i.e. drop the map's own ref only
+ * after set()/erase() returns.
+ */
+template <typename K, typename V, typename M = ceph::unordered_map<K, V> >
+class RCUMap {
+public:
+  typedef M map_t;
+
+private:
+  static const unsigned NUM_SLOTS = 32;
+
+  struct alignas(64) slot_t {
+    std::atomic<unsigned> readers[2];
+    slot_t() {
+      readers[0] = 0;
+      readers[1] = 0;
+    }
+  };
+
+  slot_t slots[NUM_SLOTS];
+  std::atomic<unsigned> phase;
+  std::atomic<const map_t*> current;
+  std::mutex write_lock;  ///< serializes writers
+
+  static slot_t& _my_slot(slot_t *s) {
+    static std::atomic<unsigned> next_slot(0);
+    static thread_local unsigned my_slot = next_slot++ % NUM_SLOTS;
+    return s[my_slot];
+  }
+
+  /// wait until readers of a map that is no longer published are gone
+  void _synchronize() {
+    // two flips: a reader may have read the phase just before the
+    // first flip and bumped its counter just after we looked at it
+    for (int i = 0; i < 2; ++i) {
+      unsigned old = phase.load();
+      phase.store(old ^ 1);
+      for (unsigned s = 0; s < NUM_SLOTS; ++s) {
+	while (slots[s].readers[old].load() != 0)
+	  std::this_thread::yield();
+      }
+    }
+  }
+
+  template <typename F>
+  void _update(F&& f) {
+    std::lock_guard<std::mutex> l(write_lock);
+    const map_t *old = current.load();
+    map_t *m = new map_t(*old);
+    f(*m);
+    current.store(m);
+    _synchronize();
+    delete old;
+  }
+
+public:
+  RCUMap() : phase(0), current(new map_t) {}
+  ~RCUMap() {
+    delete current.load();
+  }
+  RCUMap(const RCUMap&) = delete;
+  RCUMap& operator=(const RCUMap&) = delete;
+
+  /**
+   * call f(value) with k's value if k is in the map
+   *
+   * @return whether k was found
+   */
+  template <typename F>
+  bool lookup(const K& k, F&& f) const {
+    slot_t& s = _my_slot(const_cast<slot_t*>(slots));
+    unsigned p = phase.load();
+    s.readers[p]++;
+    const map_t *m = current.load();
+    auto i = m->find(k);
+    bool found = i != m->end();
+    if (found)
+      f(i->second);
+    s.readers[p]--;
+    return found;
+  }
+
+  bool lookup(const K& k, V *v) const {
+    return lookup(k, [v](const V& i) { *v = i; });
+  }
+
+  /// insert or replace k; returns once no reader can see the old value
+  void set(const K& k, const V& v) {
+    _update([&](map_t& m) { m[k] = v; });
+  }
+
+  /// remove k; returns once no reader can see it
+  void erase(const K& k) {
+    _update([&](map_t& m) { m.erase(k); });
+  }
+
+  void clear() {
+    _update([](map_t& m) { m.clear(); });
+  }
+
+  size_t size() const {
+    size_t r = 0;
+    lookup_all([&r](const map_t& m) { r = m.size(); });
+    return r;
+  }
+
+  /// call f(map) on the current snapshot
+  template <typename F>
+  void lookup_all(F&& f) const {
+    slot_t& s = _my_slot(const_cast<slot_t*>(slots));
+    unsigned p = phase.load();
+    s.readers[p]++;
+    f(*current.load());
+    s.readers[p]--;
+  }
+};
+
+#endif
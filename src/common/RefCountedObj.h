@@ -65,6 +65,9 @@ public:
   void set_cct(CephContext *c) {
     cct = c;
   }
+  CephContext *get_cct() const {
+    return cct;
+  }
 
   uint64_t get_nref() const {
     return nref.read();
@@ -18,6 +18,7 @@
 #include "common/debug.h"
 #include "common/signal.h"
 #include "common/io_priority.h"
+#include "common/numa.h"
 
 #include <dirent.h>
 #include <errno.h>
@@ -29,34 +30,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
-#ifdef HAVE_SCHED
-#include <sched.h>
-#endif
-
-static int _set_affinity(int id)
-{
-#ifdef HAVE_SCHED
-  if (id >= 0 && id < CPU_SETSIZE) {
-    cpu_set_t cpuset;
-    CPU_ZERO(&cpuset);
-
-    CPU_SET(id, &cpuset);
-
-    if (sched_setaffinity(0, sizeof(cpuset), &cpuset) < 0)
-      return -errno;
-    /* guaranteed to take effect immediately */
-    sched_yield();
-  }
-#endif
-  return 0;
-}
 
 Thread::Thread()
   : thread_id(0),
     pid(0),
     ioprio_class(-1),
     ioprio_priority(-1),
-    cpuid(-1),
     thread_name(NULL)
 {
 }
@@ -82,8 +61,8 @@ void *Thread::entry_wrapper()
 		    pid,
 		    IOPRIO_PRIO_VALUE(ioprio_class, ioprio_priority));
   }
-  if (pid && cpuid >= 0)
-    _set_affinity(cpuid);
+  if (pid && !cpus.empty())
+    set_cpu_affinity(cpus);
 
   ceph_pthread_setname(pthread_self(), thread_name);
   return entry();
@@ -201,10 +180,18 @@ int Thread::set_ioprio(int cls, int prio)
 }
 
 int Thread::set_affinity(int id)
+{
+  std::set<int> s;
+  if (id >= 0)
+    s.insert(id);
+  return set_affinity(s);
+}
+
+int Thread::set_affinity(const std::set<int>& s)
 {
   int r = 0;
-  cpuid = id;
+  cpus = s;
   if (pid && ceph_gettid() == pid)
-    r = _set_affinity(id);
+    r = set_cpu_affinity(cpus);
   return r;
 }
@@ -18,13 +18,14 @@
 
 #include <pthread.h>
 #include <sys/types.h>
+#include <set>
 
 class Thread {
  private:
   pthread_t thread_id;
   pid_t pid;
   int ioprio_class, ioprio_priority;
-  int cpuid;
+  std::set<int> cpus;  ///< affinity; empty for any
   const char *thread_name;
 
   void *entry_wrapper();
@@ -54,6 +55,7 @@ class Thread {
   int detach();
   int set_ioprio(int cls, int prio);
   int set_affinity(int cpuid);
+  int set_affinity(const std::set<int>& cpus);
 };
 
 #endif
@@ -8,6 +8,7 @@
 #include "common/dout.h"
 #include "common/ceph_context.h"
 #include "common/perf_counters.h"
+#include "common/Timer.h"
 
 #define dout_subsys ceph_subsys_throttle
 
@@ -33,8 +34,9 @@ enum {
 
 Throttle::Throttle(CephContext *cct, const std::string& n, int64_t m, bool _use_perf)
   : cct(cct), name(n), logger(NULL),
-    max(m),
+    count(0), max(m),
     lock("Throttle::lock"),
+    waiters(0),
     use_perf(_use_perf)
 {
   assert(m >= 0);
@@ -59,7 +61,7 @@ Throttle::Throttle(CephContext *cct, const std::string& n, int64_t m, bool _use_
 
     logger = b.create_perf_counters();
     cct->get_perfcounters_collection()->add(logger);
-    logger->set(l_throttle_max, max.read());
+    logger->set(l_throttle_max, max.load());
   }
 }
 
@@ -83,50 +85,63 @@ Throttle::~Throttle()
 void Throttle::_reset_max(int64_t m)
 {
   assert(lock.is_locked());
-  if ((int64_t)max.read() == m)
+  if (max.load() == m)
     return;
   if (!cond.empty())
     cond.front()->SignalOne();
   if (logger)
     logger->set(l_throttle_max, m);
-  max.set((size_t)m);
+  max.store(m);
 }
 
 bool Throttle::_wait(int64_t c)
 {
+  assert(lock.is_locked());
+  if (cond.empty() && _try_get(c))
+    return false;
+
+  // always wait behind other waiters.  waiters is raised before we look
+  // at count again, and put() lowers count before it looks at waiters,
+  // so either we see the slots come back or put() sees us and wakes us.
   utime_t start;
-  bool waited = false;
-  if (_should_wait(c) || !cond.empty()) { // always wait behind other waiters.
-    Cond *cv = new Cond;
-    cond.push_back(cv);
-    waited = true;
-    ldout(cct, 2) << "_wait waiting..." << dendl;
-    if (logger)
-      start = ceph_clock_now();
+  Cond *cv = new Cond;
+  cond.push_back(cv);
+  ++waiters;
+  ldout(cct, 2) << "_wait waiting..." << dendl;
+  if (logger)
+    start = ceph_clock_now();
 
-    do {
-      cv->Wait(lock);
-    } while (_should_wait(c) || cv != cond.front());
+  while (cv != cond.front() || !_try_get(c))
+    cv->Wait(lock);
 
-    ldout(cct, 2) << "_wait finished waiting" << dendl;
-    if (logger) {
-      utime_t dur = ceph_clock_now() - start;
-      logger->tinc(l_throttle_wait, dur);
-    }
+  ldout(cct, 2) << "_wait finished waiting" << dendl;
+  if (logger) {
+    utime_t dur = ceph_clock_now() - start;
+    logger->tinc(l_throttle_wait, dur);
+  }
 
-    delete cv;
-    cond.pop_front();
+  delete cv;
+  cond.pop_front();
+  --waiters;
 
-    // wake up the next guy
+  // wake up the next guy
+  if (!cond.empty())
+    cond.front()->SignalOne();
+  return true;
+}
+
+void Throttle::_wake_waiters()
+{
+  if (waiters.load()) {
+    Mutex::Locker l(lock);
     if (!cond.empty())
       cond.front()->SignalOne();
   }
-  return waited;
 }
 
 bool Throttle::wait(int64_t m)
 {
-  if (0 == max.read() && 0 == m) {
+  if (0 == max.load() && 0 == m) {
     return false;
   }
 
@@ -141,48 +156,44 @@ bool Throttle::wait(int64_t m)
 
 int64_t Throttle::take(int64_t c)
 {
-  if (0 == max.read()) {
+  if (0 == max.load()) {
     return 0;
   }
   assert(c >= 0);
   ldout(cct, 10) << "take " << c << dendl;
-  {
-    Mutex::Locker l(lock);
-    count.add(c);
-  }
+  int64_t cur = count.fetch_add(c) + c;
   if (logger) {
     logger->inc(l_throttle_take);
     logger->inc(l_throttle_take_sum, c);
-    logger->set(l_throttle_val, count.read());
+    logger->set(l_throttle_val, cur);
   }
-  return count.read();
+  return cur;
 }
 
 bool Throttle::get(int64_t c, int64_t m)
 {
-  if (0 == max.read() && 0 == m) {
+  if (0 == max.load() && 0 == m) {
     return false;
   }
 
   assert(c >= 0);
-  ldout(cct, 10) << "get " << c << " (" << count.read() << " -> " << (count.read() + c) << ")" << dendl;
+  ldout(cct, 10) << "get " << c << " (" << count.load() << " -> " << (count.load() + c) << ")" << dendl;
   if (logger) {
     logger->inc(l_throttle_get_started);
   }
   bool waited = false;
-  {
+  if (m || waiters.load() || !_try_get(c)) {
     Mutex::Locker l(lock);
     if (m) {
       assert(m > 0);
       _reset_max(m);
     }
     waited = _wait(c);
-    count.add(c);
   }
   if (logger) {
     logger->inc(l_throttle_get);
     logger->inc(l_throttle_get_sum, c);
-    logger->set(l_throttle_val, count.read());
+    logger->set(l_throttle_val, count.load());
   }
   return waited;
 }
@@ -192,26 +203,24 @@ bool Throttle::get(int64_t c, int64_t m)
  */
 bool Throttle::get_or_fail(int64_t c)
 {
-  if (0 == max.read()) {
+  if (0 == max.load()) {
     return true;
   }
 
   assert (c >= 0);
-  Mutex::Locker l(lock);
-  if (_should_wait(c) || !cond.empty()) {
+  if (waiters.load() || !_try_get(c)) {
     ldout(cct, 10) << "get_or_fail " << c << " failed" << dendl;
     if (logger) {
       logger->inc(l_throttle_get_or_fail_fail);
     }
     return false;
   } else {
-    ldout(cct, 10) << "get_or_fail " << c << " success (" << count.read() << " -> " << (count.read() + c) << ")" << dendl;
-    count.add(c);
+    ldout(cct, 10) << "get_or_fail " << c << " success (" << (count.load() - c) << " -> " << count.load() << ")" << dendl;
     if (logger) {
       logger->inc(l_throttle_get_or_fail_success);
       logger->inc(l_throttle_get);
       logger->inc(l_throttle_get_sum, c);
-      logger->set(l_throttle_val, count.read());
+      logger->set(l_throttle_val, count.load());
     }
     return true;
   }
@@ -219,25 +228,24 @@ bool Throttle::get_or_fail(int64_t c)
 
 int64_t Throttle::put(int64_t c)
 {
-  if (0 == max.read()) {
+  if (0 == max.load()) {
     return 0;
   }
 
   assert(c >= 0);
-  ldout(cct, 10) << "put " << c << " (" << count.read() << " -> " << (count.read()-c) << ")" << dendl;
-  Mutex::Locker l(lock);
+  ldout(cct, 10) << "put " << c << " (" << count.load() << " -> " << (count.load()-c) << ")" << dendl;
+  int64_t cur = count.load();
   if (c) {
-    if (!cond.empty())
-      cond.front()->SignalOne();
-    assert(((int64_t)count.read()) >= c); //if count goes negative, we failed somewhere!
-    count.sub(c);
+    cur = count.fetch_sub(c) - c;
+    assert(cur >= 0); //if count goes negative, we failed somewhere!
+    _wake_waiters();
     if (logger) {
       logger->inc(l_throttle_put);
       logger->inc(l_throttle_put_sum, c);
-      logger->set(l_throttle_val, count.read());
+      logger->set(l_throttle_val, cur);
     }
   }
-  return count.read();
+  return cur;
 }
 
 void Throttle::reset()
@@ -245,7 +253,7 @@ void Throttle::reset()
   Mutex::Locker l(lock);
   if (!cond.empty())
     cond.front()->SignalOne();
-  count.set(0);
+  count.store(0);
   if (logger) {
     logger->set(l_throttle_val, 0);
   }
@@ -657,3 +665,80 @@ void OrderedThrottle::complete_pending_ops() {
     ++m_complete_tid;
   }
 }
+
+TokenBucketThrottle::TokenBucketThrottle(CephContext *cct, uint64_t tick_ms,
+                                         SafeTimer *timer, Mutex *timer_lock)
+  : m_cct(cct), m_tick_ms(std::max<uint64_t>(tick_ms, 1)), m_timer(timer),
+    m_timer_lock(timer_lock), m_lock("TokenBucketThrottle::m_lock") {
+}
+
+TokenBucketThrottle::~TokenBucketThrottle() {
+  set_limit(0, 0);
+}
+
+void TokenBucketThrottle::set_limit(uint64_t average, uint64_t burst)
+{
+  std::list<Blocker> blockers;
+  Mutex::Locker timer_locker(*m_timer_lock);
+  {
+    Mutex::Locker locker(m_lock);
+    if (average == 0) {
+      blockers.swap(m_blockers);
+    }
+    // a burst below one tick's worth would throw tokens away
+    burst = std::max(burst, std::max<uint64_t>(1, average * m_tick_ms / 1000));
+    if (m_average == 0) {
+      m_tokens = burst;
+    }
+    m_average = average;
+    m_burst = burst;
+    m_tokens = std::min<double>(m_tokens, m_burst);
+  }
+
+  if (average == 0) {
+    if (m_tick_ctx != nullptr) {
+      m_timer->cancel_event(m_tick_ctx);
+      m_tick_ctx = nullptr;
+    }
+  } else if (m_tick_ctx == nullptr) {
+    schedule_tick();
+  }
+
+  for (auto &b : blockers) {
+    b.on_ready->complete(0);
+  }
+}
+
+void TokenBucketThrottle::add_tokens()
+{
+  assert(m_timer_lock->is_locked());
+  m_tick_ctx = nullptr;
+
+  std::list<Blocker> ready;
+  {
+    Mutex::Locker locker(m_lock);
+    if (m_average == 0) {
+      return;
+    }
+    m_tokens = std::min<double>(m_tokens + m_average * m_tick_ms / 1000.0,
+                                m_burst);
+    while (!m_blockers.empty() && _may_take(m_blockers.front().tokens)) {
+      m_tokens -= m_blockers.front().tokens;
+      ready.splice(ready.end(), m_blockers, m_blockers.begin());
+    }
+  }
+  schedule_tick();
+
+  for (auto &b : ready) {
+    b.on_ready->complete(0);
+  }
+}
+
+void TokenBucketThrottle::schedule_tick()
+{
+  assert(m_timer_lock->is_locked());
+  m_tick_ctx = new FunctionContext([this](int r) {
+      add_tokens();
+    });
+  m_timer->add_event_after(m_tick_ms / 1000.0, m_tick_ctx);
+}
@@ -9,6 +9,7 @@
 #include <list>
 #include <map>
 #include <iostream>
+#include <atomic>
 #include <condition_variable>
 #include <chrono>
 #include "include/atomic.h"
@@ -16,6 +17,7 @@
 
 class CephContext;
 class PerfCounters;
+class SafeTimer;
 
 /**
  * @class Throttle
@@ -24,14 +26,19 @@ class PerfCounters;
  * This class defines the maximum number of slots currently taken away. The
  * excessive requests for more of them are delayed, until some slots are put
  * back, so @p get_current() drops below the limit after fulfills the requests.
+ *
+ * Slots are taken and returned with atomic operations on @p count; the
+ * lock is only needed to queue up behind the limit or behind other
+ * waiters, and to wake them.
  */
 class Throttle {
   CephContext *cct;
   const std::string name;
   PerfCounters *logger;
-  ceph::atomic_t count, max;
+  std::atomic<int64_t> count, max;
   Mutex lock;
   list<Cond*> cond;
+  std::atomic<unsigned> waiters;  ///< cond.size(), readable without lock
   const bool use_perf;
 
 public:
@@ -40,16 +47,29 @@ public:
 
 private:
   void _reset_max(int64_t m);
-  bool _should_wait(int64_t c) const {
-    int64_t m = max.read();
-    int64_t cur = count.read();
+  bool _should_wait(int64_t cur, int64_t c) const {
+    int64_t m = max.load();
     return
       m &&
       ((c <= m && cur + c > m) || // normally stay under max
        (c >= m && cur > m));     // except for large c
   }
+  bool _should_wait(int64_t c) const {
+    return _should_wait(count.load(), c);
+  }
 
+  /// take c slots if that does not need to wait; lock not required
+  bool _try_get(int64_t c) {
+    int64_t cur = count.load();
+    while (!_should_wait(cur, c)) {
+      if (count.compare_exchange_weak(cur, cur + c))
+	return true;
+    }
+    return false;
+  }
+  /// under lock: wait in line until c slots can be taken, and take them
   bool _wait(int64_t c);
+  void _wake_waiters();
 
 public:
   /**
@@ -57,14 +77,14 @@ public:
    * @returns the number of taken slots
    */
   int64_t get_current() const {
-    return count.read();
+    return count.load();
   }
 
   /**
    * get the max number of slots
    * @returns the max number of slots
    */
-  int64_t get_max() const { return max.read(); }
+  int64_t get_max() const { return max.load(); }
 
   /**
    * set the new max number, and wait until the number of taken slots drains
@@ -321,4 +341,70 @@ private:
   void complete_pending_ops();
 };
 
+/**
+ * @class TokenBucketThrottle
+ * Limits the rate of requests with a token bucket.
+ *
+ * Tokens accrue at the average rate, every tick, up to the burst size.
+ * A request takes as many tokens as it costs; one that finds too few
+ * waits, behind any request already waiting, for the tick that brings
+ * enough.  A request costing more than the burst size goes once the
+ * bucket is full, leaving it in debt.
+ */
+class TokenBucketThrottle {
+public:
+  TokenBucketThrottle(CephContext *cct, uint64_t tick_ms, SafeTimer *timer,
+                      Mutex *timer_lock);
+  ~TokenBucketThrottle();
+
+  /// a zero average disables the throttle and lets every waiter go
+  void set_limit(uint64_t average, uint64_t burst);
+
+  /**
+   * Take @p c tokens for @p item.  Returns false if it may go now;
+   * otherwise @p handler's @p MF is called with it, from the timer
+   * thread, once it may.
+   */
+  template <typename T, typename I, void(T::*MF)(int, I*, uint64_t)>
+  bool get(uint64_t c, T *handler, I *item, uint64_t flag) {
+    Mutex::Locker locker(m_lock);
+    if (m_average == 0) {
+      return false;
+    }
+    if (m_blockers.empty() && _may_take(c)) {
+      m_tokens -= c;
+      return false;
+    }
+    m_blockers.push_back(Blocker{c, new FunctionContext(
+      [handler, item, flag](int r) {
+        (handler->*MF)(r, item, flag);
+      })});
+    return true;
+  }
+
+private:
+  struct Blocker {
+    uint64_t tokens;
+    Context *on_ready;
+  };
+
+  CephContext *m_cct;
+  const uint64_t m_tick_ms;
+  SafeTimer *m_timer;
+  Mutex *m_timer_lock;
+  Context *m_tick_ctx = nullptr;
+
+  Mutex m_lock;
+  uint64_t m_average = 0;
+  uint64_t m_burst = 0;
+  double m_tokens = 0;
+  std::list<Blocker> m_blockers;
+
+  bool _may_take(uint64_t c) const {
+    return m_tokens >= std::min<double>(c, m_burst);
+  }
+  void add_tokens();
+  void schedule_tick();
+};
+
 #endif
@@ -0,0 +1,202 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <random>
+#include <sstream>
+
+#include "common/Clock.h"
+#include "common/Cond.h"
+#include "common/Formatter.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
+#include "common/ceph_context.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/safe_io.h"
+#include "include/compat.h"
+
+#include "Tracer.h"
+
+#define dout_subsys ceph_subsys_
+#undef dout_prefix
+#define dout_prefix *_dout << "tracer "
+
+static uint64_t random_id()
+{
+  static thread_local std::mt19937_64 rng(std::random_device{}());
+  uint64_t id;
+  do {
+    id = rng();
+  } while (id == 0);
+  return id;
+}
+
+trace_context_t trace_sample(CephContext *cct)
+{
+  double rate = cct->_conf->trace_sample_rate;
+  if (rate <= 0)
+    return trace_context_t();
+  if (rate < 1 &&
+      (double)random_id() / (double)UINT64_MAX >= rate)
+    return trace_context_t();
+  return trace_context_t(random_id(), 0);
+}
+
+/*
+ * Writes finished spans to trace_export_path, in the zipkin v2 json
+ * format with one span per line, so that a shipper can post them to a
+ * collector in batches.  Spans are handed over as text and written by
+ * our own thread, so a slow disk never holds up the request path.
+ */
+class TraceExporter : public Thread {
+  CephContext *cct;
+  Mutex lock;
+  Cond cond;
+  std::vector<std::string> pending;
+  bool stopping = false;
+  int fd = -1;
+
+  void *entry() override {
+    Mutex::Locker l(lock);
+    while (!stopping || !pending.empty()) {
+      if (pending.empty()) {
+	utime_t interval;
+	interval.set_from_double(cct->_conf->trace_export_interval);
+	cond.WaitInterval(lock, interval);
+	continue;
+      }
+      std::vector<std::string> spans;
+      spans.swap(pending);
+      lock.Unlock();
+      write_spans(spans);
+      lock.Lock();
+    }
+    return NULL;
+  }
+
+  void write_spans(const std::vector<std::string>& spans) {
+    if (fd < 0) {
+      const std::string& path = cct->_conf->trace_export_path;
+      if (path.empty())
+	return;
+      fd = ::open(path.c_str(), O_WRONLY|O_APPEND|O_CREAT|O_CLOEXEC, 0644);
+      if (fd < 0) {
+	int r = -errno;
+	lderr(cct) << "failed to open " << path << ": " << cpp_strerror(r)
+		   << ", dropping " << spans.size() << " spans" << dendl;
+	return;
+      }
+    }
+    std::string out;
+    for (auto& s : spans) {
+      out += s;
+      out += '\n';
+    }
+    int r = safe_write(fd, out.data(), out.size());
+    if (r < 0) {
+      lderr(cct) << "failed to write spans: " << cpp_strerror(r) << dendl;
+    }
+  }
+
+public:
+  explicit TraceExporter(CephContext *cct)
+    : cct(cct), lock("TraceExporter::lock") {
+    create("tracer");
+  }
+  ~TraceExporter() override {
+    lock.Lock();
+    stopping = true;
+    cond.Signal();
+    lock.Unlock();
+    join();
+    if (fd >= 0)
+      VOID_TEMP_FAILURE_RETRY(::close(fd));
+  }
+
+  void queue(std::string&& span) {
+    Mutex::Locker l(lock);
+    pending.push_back(std::move(span));
+  }
+};
+
+static uint64_t to_usec(utime_t t)
+{
+  return (uint64_t)t.sec() * 1000000ull + t.usec();
+}
+
+static std::string to_hex(uint64_t id)
+{
+  char buf[17];
+  snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)id);
+  return buf;
+}
+
+void TraceSpan::start(CephContext *_cct, const trace_context_t& parent,
+		      const char *_name, utime_t stamp)
+{
+  assert(!valid());
+  if (!parent.valid())
+    return;
+  cct = _cct;
+  ctx = trace_context_t(parent.trace_id, random_id());
+  parent_id = parent.span_id;
+  name = _name;
+  start_stamp = stamp == utime_t() ? ceph_clock_now() : stamp;
+}
+
+void TraceSpan::event(const char *e, utime_t stamp)
+{
+  if (!valid())
+    return;
+  events.emplace_back(stamp == utime_t() ? ceph_clock_now() : stamp, e);
+}
+
+void TraceSpan::finish(utime_t stamp)
+{
+  if (!valid())
+    return;
+  utime_t end = stamp == utime_t() ? ceph_clock_now() : stamp;
+
+  JSONFormatter f;
+  f.open_object_section("span");
+  f.dump_string("traceId", to_hex(ctx.trace_id));
+  f.dump_string("id", to_hex(ctx.span_id));
+  if (parent_id)
+    f.dump_string("parentId", to_hex(parent_id));
+  f.dump_string("name", name);
+  f.dump_unsigned("timestamp", to_usec(start_stamp));
+  f.dump_unsigned("duration", end > start_stamp ?
+		  to_usec(end) - to_usec(start_stamp) : 0);
+  f.open_object_section("localEndpoint");
+  f.dump_string("serviceName", cct->_conf->name.to_str());
+  f.close_section();
+  f.open_array_section("annotations");
+  for (auto& e : events) {
+    f.open_object_section("annotation");
+    f.dump_unsigned("timestamp", to_usec(e.first));
+    f.dump_string("value", e.second);
+    f.close_section();
+  }
+  f.close_section();
+  f.close_section();
+  std::ostringstream ss;
+  f.flush(ss);
+
+  TraceExporter *exporter;
+  cct->lookup_or_create_singleton_object<TraceExporter>(exporter,
+							"trace_exporter");
+  exporter->queue(ss.str());
+
+  cct = nullptr;
+  events.clear();
+}
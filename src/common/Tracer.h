@@ -0,0 +1,105 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef CEPH_COMMON_TRACER_H
+#define CEPH_COMMON_TRACER_H
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "include/encoding.h"
+#include "include/utime.h"
+
+class CephContext;
+
+/**
+ * What a traced request carries from one component to the next: the
+ * trace it belongs to, and the span of the sender, which is the parent
+ * of the spans recorded by the receiver.
+ */
+struct trace_context_t {
+  uint64_t trace_id = 0;  ///< 0 if the request is not traced
+  uint64_t span_id = 0;
+
+  trace_context_t() {}
+  trace_context_t(uint64_t t, uint64_t s) : trace_id(t), span_id(s) {}
+
+  bool valid() const { return trace_id != 0; }
+
+  void encode(bufferlist& bl) const {
+    ::encode(trace_id, bl);
+    ::encode(span_id, bl);
+  }
+  void decode(bufferlist::iterator& p) {
+    ::decode(trace_id, p);
+    ::decode(span_id, p);
+  }
+};
+WRITE_CLASS_ENCODER(trace_context_t)
+
+inline ostream& operator<<(ostream& out, const trace_context_t& t) {
+  return out << std::hex << t.trace_id << ":" << t.span_id << std::dec;
+}
+
+/**
+ * Decide whether a request that starts here is traced, at
+ * trace_sample_rate.
+ *
+ * @returns the root context of a new trace, or an invalid one
+ */
+trace_context_t trace_sample(CephContext *cct);
+
+/**
+ * The part of a traced request one component is responsible for, from
+ * start() to finish(), with the steps it went through on the way.
+ *
+ * A span is inactive, and everything but start() a no-op, unless it was
+ * started with a valid parent.  Finished spans are written out in the
+ * background, see trace_export_path.  The owner serializes calls.
+ */
+class TraceSpan {
+  CephContext *cct = nullptr;
+  trace_context_t ctx;      ///< our own span id
+  uint64_t parent_id = 0;
+  const char *name = nullptr;
+  utime_t start_stamp;
+  std::vector<std::pair<utime_t, std::string>> events;
+
+public:
+  TraceSpan() {}
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+  ~TraceSpan() {
+    finish();
+  }
+
+  void start(CephContext *cct, const trace_context_t& parent,
+	     const char *name, utime_t stamp = utime_t());
+
+  bool valid() const {
+    return cct != nullptr;
+  }
+  /// what to hand on with the requests this component sends
+  trace_context_t context() const {
+    return ctx;
+  }
+
+  void event(const char *e, utime_t stamp = utime_t());
+  void event(const std::string& e, utime_t stamp = utime_t()) {
+    if (valid())
+      event(e.c_str(), stamp);
+  }
+
+  void finish(utime_t stamp = utime_t());
+};
+
+#endif
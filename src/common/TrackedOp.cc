@@ -152,6 +152,15 @@ bool OpTracker::dump_ops_in_flight(Formatter *f, bool print_only_blocked)
     }
   }
   f->close_section(); // list of TrackedOps
+  if (sample_every > 1) {
+    f->open_object_section("sampling");
+    f->dump_unsigned("sample_every", sample_every);
+    f->dump_float("escalate_after", escalate_after);
+    f->dump_unsigned("ops", seq.read());
+    f->dump_unsigned("ops_sampled", ops_sampled);
+    f->dump_unsigned("ops_escalated", ops_escalated);
+    f->close_section();
+  }
   if (print_only_blocked) {
     f->dump_float("complaint_time", complaint_time);
     f->dump_int("num_blocked_ops", total_ops_in_flight);
@@ -176,6 +185,10 @@ bool OpTracker::register_inflight_op(TrackedOp *i)
     sdata->ops_in_flight_sharded.push_back(*i);
     i->seq = current_seq;
   }
+  if (sample_every <= 1 || current_seq % sample_every == 0) {
+    i->tracked = true;
+    ++ops_sampled;
+  }
   return true;
 }
 
@@ -195,7 +208,7 @@ void OpTracker::unregister_inflight_op(TrackedOp *i)
   i->_unregistered();
 
   RWLock::RLocker l(lock);
-  if (!tracking_enabled)
+  if (!tracking_enabled || !i->tracked)
     delete i;
   else {
     i->state = TrackedOp::STATE_HISTORY;
@@ -319,10 +332,27 @@ void OpTracker::get_age_ms_histogram(pow2_hist_t *h)
 #undef dout_context
 #define dout_context tracker->cct
 
+bool TrackedOp::_maybe_escalate(utime_t stamp)
+{
+  if (!tracker->should_escalate(stamp - initiated_at))
+    return false;
+  Mutex::Locker l(lock);
+  if (!tracked) {
+    // what happened before this is lost; keep at least the arrival
+    events.reserve(OPTRACKER_PREALLOC_EVENTS);
+    events.push_back(Event(initiated_at, "initiated"));
+    tracked = true;
+    ++tracker->ops_escalated;
+  }
+  return true;
+}
+
 void TrackedOp::mark_event_string(const string &event, utime_t stamp)
 {
   if (!state)
     return;
+  if (!tracked && !_maybe_escalate(stamp))
+    return;
 
   {
     Mutex::Locker l(lock);
@@ -341,6 +371,10 @@ void TrackedOp::mark_event(const char *event, utime_t stamp)
 {
   if (!state)
     return;
+  if (!tracked && !_maybe_escalate(stamp)) {
+    current = event;
+    return;
+  }
 
   {
     Mutex::Locker l(lock);
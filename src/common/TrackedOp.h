@@ -58,6 +58,7 @@ public:
 struct ShardedTrackingData;
 class OpTracker {
   friend class OpHistory;
+  friend class TrackedOp;
   atomic64_t seq;
   vector<ShardedTrackingData*> sharded_in_flight_list;
   uint32_t num_optracker_shards;
@@ -66,6 +67,9 @@ class OpTracker {
   int log_threshold;
   bool tracking_enabled;
   RWLock       lock;
+  uint32_t sample_every = 1;   ///< record events for 1 in this many ops
+  double escalate_after = 0;   ///< ...and for any op older than this
+  std::atomic<uint64_t> ops_sampled = {0}, ops_escalated = {0};
 
 public:
   CephContext *cct;
@@ -82,6 +86,20 @@ public:
     RWLock::WLocker l(lock);
     tracking_enabled = enable;
   }
+  /**
+   * Record events for only 1 in every ops, plus for any op that is
+   * still running escalate_after seconds after it arrived.  Every op
+   * is still in flight for dump_ops_in_flight and slow request
+   * warnings, but ops that are neither sampled nor slow keep no events
+   * and go straight away when they are done instead of to the history.
+   */
+  void set_sampling(uint32_t every, double escalate) {
+    sample_every = every;
+    escalate_after = escalate;
+  }
+  bool should_escalate(double age) const {
+    return escalate_after > 0 && age >= escalate_after;
+  }
   bool dump_ops_in_flight(Formatter *f, bool print_only_blocked=false);
   bool dump_historic_ops(Formatter *f);
   bool register_inflight_op(TrackedOp *i);
@@ -185,6 +203,8 @@ protected:
     STATE_HISTORY
   };
   atomic<int> state = {STATE_UNTRACKED};
+  /// whether events are recorded: sampled by the tracker, or slow
+  std::atomic<bool> tracked = {false};
 
   mutable string desc_str;   ///< protected by lock
   mutable const char *desc = nullptr;  ///< readable without lock
@@ -193,7 +213,6 @@ protected:
     tracker(_tracker),
     initiated_at(initiated)
   {
-    events.reserve(OPTRACKER_PREALLOC_EVENTS);
   }
 
   /// output any type-specific data you want to get when dump() is called
@@ -205,6 +224,9 @@ protected:
   /// called when the last non-OpTracker reference is dropped
   virtual void _unregistered() {};
 
+  /// start recording events for an untracked op that turns out slow
+  bool _maybe_escalate(utime_t stamp);
+
 public:
   virtual ~TrackedOp() {}
 
@@ -270,8 +292,15 @@ public:
   void mark_event(const char *event,
 		  utime_t stamp=ceph_clock_now());
 
+  /// the end-to-end trace work done on behalf of this op belongs to
+  virtual trace_context_t get_trace_context() const {
+    return trace_context_t();
+  }
+
   virtual const char *state_string() const {
     Mutex::Locker l(lock);
+    if (events.empty())
+      return current ? current : "initiated";
     return events.rbegin()->c_str();
   }
 
@@ -279,7 +308,10 @@ public:
 
   void tracking_start() {
     if (tracker->register_inflight_op(this)) {
-      events.push_back(Event(initiated_at, "initiated"));
+      if (tracked) {
+	events.reserve(OPTRACKER_PREALLOC_EVENTS);
+	events.push_back(Event(initiated_at, "initiated"));
+      }
       state = STATE_LIVE;
     }
   }
@@ -172,6 +172,7 @@ void ThreadPool::start_threads()
     int r = wt->set_ioprio(ioprio_class, ioprio_priority);
     if (r < 0)
       lderr(cct) << " set_ioprio got " << cpp_strerror(r) << dendl;
+    wt->set_affinity(cpu_affinity);
 
     wt->create(thread_name.c_str());
   }
@@ -372,6 +373,7 @@ void ShardedThreadPool::start_threads()
     WorkThreadSharded *wt = new WorkThreadSharded(this, thread_index);
     ldout(cct, 10) << "start_threads creating and starting " << wt << dendl;
     threads_shardedpool.push_back(wt);
+    wt->set_affinity(cpu_affinity);
     wt->create(thread_name.c_str());
     thread_index++;
   }
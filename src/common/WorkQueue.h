@@ -20,6 +20,7 @@
 #include "Thread.h"
 #include "include/unordered_map.h"
 #include "common/config_obs.h"
+#include "common/Finisher.h"
 #include "common/HeartbeatMap.h"
 
 class CephContext;
@@ -37,6 +38,7 @@ class ThreadPool : public md_config_obs_t {
   int _draining;
   Cond _wait_cond;
   int ioprio_class, ioprio_priority;
+  std::set<int> cpu_affinity;
 
 public:
   class TPHandle {
@@ -528,6 +530,11 @@ public:
 
   /// set io priority
   void set_ioprio(int cls, int priority);
+  /// pin threads started after this to cpus; call before start()
+  void set_affinity(const std::set<int>& cpus) {
+    Mutex::Locker l(_lock);
+    cpu_affinity = cpus;
+  }
 };
 
 class GenContextWQ :
@@ -579,14 +586,32 @@ public:
       m_lock("ContextWQ::m_lock") {
     tp->add_work_queue(this);
   }
+  /// complete contexts on fp, in order under key, instead of on tp
+  ContextWQ(const string &name, time_t ti, ThreadPool *tp,
+            FinisherPool *fp, uint64_t key)
+    : ContextWQ(name, ti, tp) {
+    m_finisher_pool = fp;
+    m_finisher_key = key;
+  }
 
   void queue(Context *ctx, int result = 0) {
+    if (m_finisher_pool) {
+      m_finisher_pool->queue(m_finisher_key, ctx, result);
+      return;
+    }
     if (result != 0) {
       Mutex::Locker locker(m_lock);
       m_context_results[ctx] = result;
     }
     ThreadPool::PointerWQ<Context>::queue(ctx);
   }
+  void drain() {
+    if (m_finisher_pool) {
+      m_finisher_pool->wait_for_empty(m_finisher_key);
+      return;
+    }
+    ThreadPool::PointerWQ<Context>::drain();
+  }
 protected:
   virtual void _clear() {
     ThreadPool::PointerWQ<Context>::_clear();
@@ -611,6 +636,8 @@ protected:
 private:
   Mutex m_lock;
   ceph::unordered_map<Context*, int> m_context_results;
+  FinisherPool *m_finisher_pool = nullptr;
+  uint64_t m_finisher_key = 0;
 };
 
 class ShardedThreadPool {
@@ -688,6 +715,7 @@ private:
   };
 
   vector<WorkThreadSharded*> threads_shardedpool;
+  std::set<int> cpu_affinity;
   void start_threads();
   void shardedthreadpool_worker(uint32_t thread_index);
   void set_wq(BaseShardedWQ* swq) {
@@ -714,6 +742,11 @@ public:
   void unpause();
   /// wait for all work to complete
   void drain();
+  /// pin threads started after this to cpus; call before start()
+  void set_affinity(const std::set<int>& cpus) {
+    Mutex::Locker l(shardedpool_lock);
+    cpu_affinity = cpus;
+  }
 
 };
 
@@ -184,6 +184,38 @@ bool block_device_is_rotational(const char *devname)
   return get_block_device_int_property(devname, "rotational") > 0;
 }
 
+/**
+ * get the NUMA node of the controller behind a block device
+ *
+ * return -ENOENT if it is not attached to any one node
+ */
+int get_block_device_numa_node(const char *devname, int *node)
+{
+  char basename[PATH_MAX], filename[PATH_MAX];
+  int r = get_block_device_base(devname, basename, sizeof(basename));
+  if (r < 0)
+    return r;
+
+  // scsi/sata have numa_node on the device; nvme namespaces one level up
+  const char *paths[] = { "device", "device/device" };
+  for (auto p : paths) {
+    snprintf(filename, sizeof(filename),
+	     "%s/sys/block/%s/%s/numa_node", sandbox_dir, basename, p);
+    FILE *fp = fopen(filename, "r");
+    if (fp == NULL)
+      continue;
+    char buff[32] = {0};
+    r = -EINVAL;
+    if (fgets(buff, sizeof(buff) - 1, fp)) {
+      *node = atoi(buff);
+      r = *node < 0 ? -ENOENT : 0;
+    }
+    fclose(fp);
+    return r;
+  }
+  return -ENOENT;
+}
+
 int get_device_by_uuid(uuid_d dev_uuid, const char* label, char* partition,
 	char* device)
 {
@@ -255,6 +287,11 @@ bool block_device_is_rotational(const char *devname)
   return false;
 }
 
+int get_block_device_numa_node(const char *devname, int *node)
+{
+  return -EOPNOTSUPP;
+}
+
 int get_device_by_uuid(uuid_d dev_uuid, const char* label, char* partition,
 	char* device)
 {
@@ -286,6 +323,11 @@ bool block_device_is_rotational(const char *devname)
   return false;
 }
 
+int get_block_device_numa_node(const char *devname, int *node)
+{
+  return -EOPNOTSUPP;
+}
+
 int get_device_by_uuid(uuid_d dev_uuid, const char* label, char* partition,
 	char* device)
 {
@@ -312,6 +354,11 @@ bool block_device_is_rotational(const char *devname)
   return false;
 }
 
+int get_block_device_numa_node(const char *devname, int *node)
+{
+  return -EOPNOTSUPP;
+}
+
 int get_device_by_uuid(uuid_d dev_uuid, const char* label, char* partition,
 	char* device)
 {
@@ -42,6 +42,8 @@
 
 #define CEPH_BUFFER_ALLOC_UNIT  (MIN(CEPH_PAGE_SIZE, 4096))
 #define CEPH_BUFFER_APPEND_SIZE (CEPH_BUFFER_ALLOC_UNIT - sizeof(raw_combined))
+// lists up to this long are copied rather than shared by append_or_copy()
+#define CEPH_BUFFER_COPY_MAX    256
 
 #ifdef BUFFER_DEBUG
 static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
@@ -1848,6 +1850,18 @@ static simple_spinlock_t buffer_debug_lock = SIMPLE_SPINLOCK_INITIALIZER;
       _buffers.push_back(*p);
   }
 
+  void buffer::list::append_or_copy(const list& bl)
+  {
+    if (bl._len > CEPH_BUFFER_COPY_MAX) {
+      append(bl);
+      return;
+    }
+    for (std::list<ptr>::const_iterator p = bl._buffers.begin();
+	 p != bl._buffers.end();
+	 ++p)
+      append(p->c_str(), p->length());
+  }
+
   void buffer::list::append(std::istream& in)
   {
     while (!in.eof()) {
@@ -185,11 +185,14 @@ OPTION(ms_initial_backoff, OPT_DOUBLE, .2)
 OPTION(ms_max_backoff, OPT_DOUBLE, 15.0)
 OPTION(ms_crc_data, OPT_BOOL, true)
 OPTION(ms_crc_header, OPT_BOOL, true)
+OPTION(ms_crc_data_trusted_peers, OPT_STR, "") // entity types (e.g. "osd") we skip data crc with, when ms_crc_data is on
+OPTION(ms_crc_data_trusted_networks, OPT_STR, "") // if set, those peers must also be in one of these networks (async messenger only)
 OPTION(ms_die_on_bad_msg, OPT_BOOL, false)
 OPTION(ms_die_on_unhandled_msg, OPT_BOOL, false)
 OPTION(ms_die_on_old_message, OPT_BOOL, false)     // assert if we get a dup incoming message and shouldn't have (may be triggered by pre-541cd3c64be0dfa04e8a2df39422e0eb9541a428 code)
 OPTION(ms_die_on_skipped_message, OPT_BOOL, false)  // assert if we skip a seq (kernel client does this intentionally)
 OPTION(ms_dispatch_throttle_bytes, OPT_U64, 100 << 20)
+OPTION(ms_dispatch_threads, OPT_U32, 1) // threads delivering queued messages; more than one needs dispatchers that cope with concurrent ms_dispatch calls
 OPTION(ms_bind_ipv6, OPT_BOOL, false)
 OPTION(ms_bind_port_min, OPT_INT, 6800)
 OPTION(ms_bind_port_max, OPT_INT, 7300)
@@ -223,7 +226,20 @@ OPTION(ms_async_set_affinity, OPT_BOOL, true)
 // If ms_async_affinity_cores is empty, all threads will be bind to current running
 // core
 OPTION(ms_async_affinity_cores, OPT_STR, "")
+// pin op shards and messenger workers (those without ms_async_affinity_cores)
+// to the cpus of this NUMA node; -1 for no pinning
+OPTION(numa_node, OPT_INT, -1)
+// if numa_node is -1, use the NUMA node of this network interface instead
+OPTION(numa_iface, OPT_STR, "")
 OPTION(ms_async_send_inline, OPT_BOOL, false)
+OPTION(ms_async_rebalance_interval, OPT_DOUBLE, 0) // seconds between checks of whether a busy connection should move to a less loaded worker, 0 to never move connections
+OPTION(ms_async_rebalance_min_load, OPT_U32, 500) // permille of cpu a worker must use before its connections are moved away
+OPTION(ms_async_send_batch_bytes, OPT_U64, 65536) // gather queued messages into one send of up to this many bytes, 0 to send each message on its own
+OPTION(ms_async_ack_delay_us, OPT_U32, 0) // hold back an ack with nothing to ride along for up to this long, 0 to ack right away
+OPTION(ms_async_busy_poll_workers, OPT_STR, "") // ids of workers that spin on their event loop instead of sleeping in it, e.g. "0,1"
+OPTION(ms_async_busy_poll_us, OPT_U32, 0) // SO_BUSY_POLL for sockets of those workers (posix stack), 0 to leave it unset
+OPTION(ms_async_zerocopy_min_bytes, OPT_U64, 0) // send batches of at least this many bytes with MSG_ZEROCOPY (posix stack, linux only), 0 to always copy
+OPTION(ms_async_worker_max_bytes, OPT_U64, 0) // bytes of received messages a worker may hold before its connections stop reading, 0 for no limit
 OPTION(ms_async_rdma_device_name, OPT_STR, "")
 OPTION(ms_async_rdma_enable_hugepage, OPT_BOOL, false)
 OPTION(ms_async_rdma_buffer_size, OPT_INT, 8192)
@@ -231,6 +247,8 @@ OPTION(ms_async_rdma_send_buffers, OPT_U32, 1024)
 OPTION(ms_async_rdma_receive_buffers, OPT_U32, 1024)
 OPTION(ms_async_rdma_port_num, OPT_U32, 1)
 OPTION(ms_async_rdma_polling_us, OPT_U32, 1000)
+OPTION(ms_async_rdma_adaptive_polling, OPT_BOOL, false) // shrink the busy polling window while idle and grow it back when completions follow a sleep, up to ms_async_rdma_polling_us
+OPTION(ms_async_rdma_max_inline_data, OPT_U32, 0) // send chunks up to this many bytes inline in the work request, 0 to never send inline
 OPTION(ms_async_rdma_local_gid, OPT_STR, "")       // GID format: "fe80:0000:0000:0000:7efe:90ff:fe72:6efe", no zero folding
 OPTION(ms_async_rdma_roce_ver, OPT_INT, 1)         // 0=RoCEv1, 1=RoCEv2, 2=RoCEv1.5
 OPTION(ms_async_rdma_sl, OPT_INT, 3)               // in RoCE, this means PCP
@@ -259,6 +277,9 @@ OPTION(mon_compact_on_start, OPT_BOOL, false)  // compact leveldb on ceph-mon st
 OPTION(mon_compact_on_bootstrap, OPT_BOOL, false)  // trigger leveldb compaction on bootstrap
 OPTION(mon_compact_on_trim, OPT_BOOL, true)       // compact (a prefix) when we trim old states
 OPTION(mon_osd_cache_size, OPT_INT, 10)  // the size of osdmaps cache, not to rely on underlying store's cache
+OPTION(mon_osd_map_compression, OPT_STR, "snappy") // compress osdmap messages with this for peers that support it ("none" to disable)
+OPTION(mon_osd_map_compression_min_size, OPT_U32, 16384) // don't bother compressing osdmap messages smaller than this
+OPTION(mon_osd_client_full_map_epochs, OPT_U32, 500) // send non-osd subscribers at least this far behind the current full map instead of every incremental (0 = never)
 
 OPTION(mon_cpu_threads, OPT_INT, 4)
 OPTION(mon_osd_mapping_pgs_per_chunk, OPT_INT, 4096)
@@ -300,6 +321,7 @@ OPTION(mon_timecheck_skew_interval, OPT_FLOAT, 30.0) // on leader, timecheck (cl
 OPTION(mon_pg_create_interval, OPT_FLOAT, 30.0) // no more than every 30s
 OPTION(mon_pg_stuck_threshold, OPT_INT, 300) // number of seconds after which pgs can be considered inactive, unclean, or stale (see doc/control.rst under dump_stuck for more info)
 OPTION(mon_pg_min_inactive, OPT_U64, 1) // the number of PGs which have to be inactive longer than 'mon_pg_stuck_threshold' before health goes into ERR. 0 means disabled, never go into ERR.
+OPTION(mon_pg_stats_via_mgr, OPT_BOOL, false) // ceph-mgr aggregates osd pg stats and sends the mon a digest, instead of the mon keeping them in the PGMap
 OPTION(mon_pg_warn_min_per_osd, OPT_INT, 30)  // min # pgs per (in) osd before we warn the admin
 OPTION(mon_pg_warn_max_per_osd, OPT_INT, 300)  // max # pgs per (in) osd before we warn the admin
 OPTION(mon_pg_warn_max_object_skew, OPT_FLOAT, 10.0) // max skew few average in objects per pg
@@ -335,6 +357,7 @@ OPTION(mon_reweight_max_osds, OPT_INT, 4)   // max osds to change per reweight-b
 OPTION(mon_reweight_max_change, OPT_DOUBLE, 0.05)
 OPTION(mon_health_data_update_interval, OPT_FLOAT, 60.0)
 OPTION(mon_health_to_clog, OPT_BOOL, true)
+OPTION(mon_command_reply_cache_ttl, OPT_DOUBLE, 1.0) // reuse status/health/df replies for up to this long while nothing commits (0 = never)
 OPTION(mon_health_to_clog_interval, OPT_INT, 3600)
 OPTION(mon_health_to_clog_tick_interval, OPT_DOUBLE, 60.0)
 OPTION(mon_data_avail_crit, OPT_INT, 5)
@@ -383,6 +406,7 @@ OPTION(paxos_stash_full_interval, OPT_INT, 25)   // how often (in commits) to st
 OPTION(paxos_max_join_drift, OPT_INT, 10) // max paxos iterations before we must first sync the monitor stores
 OPTION(paxos_propose_interval, OPT_DOUBLE, 1.0)  // gather updates for this long before proposing a map update
 OPTION(paxos_min_wait, OPT_DOUBLE, 0.05)  // min time to gather updates for after period of inactivity
+OPTION(paxos_batch_proposals, OPT_BOOL, true) // when one service proposes, take along the updates other services are still gathering
 OPTION(paxos_min, OPT_INT, 500)       // minimum number of paxos states to keep around
 OPTION(paxos_trim_min, OPT_INT, 250)  // number of extra proposals tolerated before trimming
 OPTION(paxos_trim_max, OPT_INT, 500) // max number of extra proposals to trim at a time
@@ -409,6 +433,7 @@ OPTION(mon_client_hunt_interval_backoff, OPT_DOUBLE, 2.0) // each time we reconn
 OPTION(mon_client_hunt_interval_max_multiple, OPT_DOUBLE, 10.0) // up to a max of 10*default (30 seconds)
 OPTION(mon_client_max_log_entries_per_message, OPT_INT, 1000)
 OPTION(mon_max_pool_pg_num, OPT_INT, 65536)
+OPTION(mon_max_pool_compression_dictionaries_bytes, OPT_U64, 256*1024) // per pool, base64 encoded; the osdmap carries them
 OPTION(mon_pool_quota_warn_threshold, OPT_INT, 0) // percent of quota at which to issue warnings
 OPTION(mon_pool_quota_crit_threshold, OPT_INT, 0) // percent of quota at which to issue errors
 OPTION(client_cache_size, OPT_INT, 16384)
@@ -420,6 +445,8 @@ OPTION(client_trace, OPT_STR, "")
 OPTION(client_readahead_min, OPT_LONGLONG, 128*1024)  // readahead at _least_ this much.
 OPTION(client_readahead_max_bytes, OPT_LONGLONG, 0)  // default unlimited
 OPTION(client_readahead_max_periods, OPT_LONGLONG, 4)  // as multiple of file layout period (object size * num stripes)
+OPTION(client_stream_read_min, OPT_U64, 16*1024*1024) // after reading this much in sequence, read around the object cacher (0 = never)
+OPTION(client_stream_read_max_bytes, OPT_U64, 64*1024*1024) // how far ahead of a streaming reader to read at most
 OPTION(client_snapdir, OPT_STR, ".snap")
 OPTION(client_mountpoint, OPT_STR, "/")
 OPTION(client_mount_uid, OPT_INT, -1)
@@ -463,6 +490,8 @@ OPTION(client_try_dentry_invalidate, OPT_BOOL, true) // the client should try to
 OPTION(client_die_on_failed_remount, OPT_BOOL, true)
 OPTION(client_check_pool_perm, OPT_BOOL, true)
 OPTION(client_use_faked_inos, OPT_BOOL, false)
+OPTION(client_async_dirops, OPT_BOOL, false) // create/unlink without waiting for the mds when we hold Fx on the dir
+OPTION(client_async_dirops_max, OPT_INT, 1024) // in flight, beyond which dirops are synchronous again
 OPTION(client_mds_namespace, OPT_STR, "")
 
 OPTION(crush_location, OPT_STR, "")       // whitespace-separated list of key=value pairs describing crush location
@@ -477,6 +506,7 @@ OPTION(objecter_completion_locks_per_session, OPT_U64, 32) // num of completion
 OPTION(objecter_inject_no_watch_ping, OPT_BOOL, false)   // suppress watch pings
 OPTION(objecter_retry_writes_after_first_reply, OPT_BOOL, false)   // ignore the first reply for each write, and resend the osd op instead
 OPTION(objecter_debug_inject_relock_delay, OPT_BOOL, false)
+OPTION(objecter_read_policy, OPT_STR, "primary") // where reads of replicated pools go: primary, random, localize (nearest by crush_location) or latency (fastest to answer lately)
 
 // Max number of deletes at once in a single Filer::purge call
 OPTION(filer_max_purge_ops, OPT_U32, 10)
@@ -489,10 +519,15 @@ OPTION(journaler_batch_interval, OPT_DOUBLE, .001)   // seconds.. max add latenc
 OPTION(journaler_batch_max, OPT_U64, 0)  // max bytes we'll delay flushing; disable, for now....
 OPTION(mds_data, OPT_STR, "/var/lib/ceph/mds/$cluster-$id")
 OPTION(mds_max_file_size, OPT_U64, 1ULL << 40) // Used when creating new CephFS. Change with 'ceph mds set max_file_size <size>' afterwards
-OPTION(mds_cache_size, OPT_INT, 100000)
+OPTION(mds_cache_size, OPT_INT, 0) // max inodes in cache, 0 for no limit
+OPTION(mds_cache_memory_limit, OPT_U64, 1ULL << 30) // bytes of cache objects
+OPTION(mds_cache_reservation, OPT_FLOAT, .05) // trim this far below the limits
 OPTION(mds_cache_mid, OPT_FLOAT, .7)
 OPTION(mds_max_file_recover, OPT_U32, 32)
+OPTION(mds_open_ino_max_fetching, OPT_INT, 1024) // backtraces read at once when opening inodes by number
 OPTION(mds_dir_max_commit_size, OPT_INT, 10) // MB
+OPTION(mds_dir_keys_per_op, OPT_INT, 16384) // omap keys read per op when fetching a dirfrag
+OPTION(mds_readdir_prefetch, OPT_BOOL, true) // fetch the next dirfrag while a client reads one
 OPTION(mds_decay_halflife, OPT_FLOAT, 5)
 OPTION(mds_beacon_interval, OPT_FLOAT, 4)
 OPTION(mds_beacon_grace, OPT_FLOAT, 15)
@@ -505,23 +540,27 @@ OPTION(mds_recall_state_timeout, OPT_FLOAT, 60)    // detect clients which aren'
 OPTION(mds_freeze_tree_timeout, OPT_FLOAT, 30)    // detecting freeze tree deadlock
 OPTION(mds_session_autoclose, OPT_FLOAT, 300) // autoclose idle session
 OPTION(mds_health_summarize_threshold, OPT_INT, 10) // collapse N-client health metrics to a single 'many'
-OPTION(mds_health_cache_threshold, OPT_FLOAT, 1.5) // warn on cache size if it exceeds mds_cache_size by this factor
+OPTION(mds_health_cache_threshold, OPT_FLOAT, 1.5) // warn on cache size if it exceeds its limits by this factor
 OPTION(mds_reconnect_timeout, OPT_FLOAT, 45)  // seconds to wait for clients during mds restart
 	      //  make it (mds_session_timeout - mds_beacon_grace)
 OPTION(mds_tick_interval, OPT_FLOAT, 5)
 OPTION(mds_dirstat_min_interval, OPT_FLOAT, 1)    // try to avoid propagating more often than this
 OPTION(mds_scatter_nudge_interval, OPT_FLOAT, 5)  // how quickly dirstat changes propagate up the hierarchy
 OPTION(mds_client_prealloc_inos, OPT_INT, 1000)
+OPTION(mds_client_delegate_inos, OPT_INT, 100) // of the prealloc inos, how many a client may create with on its own
 OPTION(mds_early_reply, OPT_BOOL, true)
 OPTION(mds_default_dir_hash, OPT_INT, CEPH_STR_HASH_RJENKINS)
 OPTION(mds_log, OPT_BOOL, true)
 OPTION(mds_log_pause, OPT_BOOL, false)
 OPTION(mds_log_skip_corrupt_events, OPT_BOOL, false)
+OPTION(mds_log_replay_decode_threads, OPT_INT, 2) // threads decoding journal events ahead of replay (0 = decode in the replay thread)
+OPTION(mds_log_replay_batch, OPT_U32, 256)        // journal events read and decoded together during replay
 OPTION(mds_log_max_events, OPT_INT, -1)
 OPTION(mds_log_events_per_segment, OPT_INT, 1024)
 OPTION(mds_log_segment_size, OPT_INT, 0)  // segment size for mds log, default to default file_layout_t
 OPTION(mds_log_max_segments, OPT_U32, 30)
 OPTION(mds_log_max_expiring, OPT_INT, 20)
+OPTION(mds_log_group_commit, OPT_BOOL, true)  // flush the journal whenever the previous flush is safe
 OPTION(mds_bal_sample_interval, OPT_DOUBLE, 3.0)  // every 3 seconds
 OPTION(mds_bal_replicate_threshold, OPT_FLOAT, 8000)
 OPTION(mds_bal_unreplicate_threshold, OPT_FLOAT, 0)
@@ -547,6 +586,10 @@ OPTION(mds_bal_midchunk, OPT_FLOAT, .3)       // any sub bigger than this taken
 OPTION(mds_bal_minchunk, OPT_FLOAT, .001)     // never take anything smaller than this
 OPTION(mds_bal_target_removal_min, OPT_INT, 5) // min balance iterations before old target is removed
 OPTION(mds_bal_target_removal_max, OPT_INT, 10) // max balance iterations before old target is removed
+OPTION(mds_bal_overload_epochs, OPT_INT, 2)   // balancer epochs we must be overloaded before exporting
+OPTION(mds_bal_import_cooldown, OPT_INT, 30)  // seconds before an import may be exported again
+OPTION(mds_bal_min_latency, OPT_DOUBLE, 0)    // don't export while our reply latency (seconds) is below this
+OPTION(mds_bal_max_exports_in_flight, OPT_INT, 4)  // concurrent exports of the balancer
 OPTION(mds_replay_interval, OPT_FLOAT, 1.0) // time to wait before starting replay again
 OPTION(mds_shutdown_check, OPT_INT, 0)
 OPTION(mds_thrash_exports, OPT_INT, 0)
@@ -595,8 +638,9 @@ OPTION(mds_max_completed_requests, OPT_U32, 100000)
 OPTION(mds_action_on_write_error, OPT_U32, 1) // 0: ignore; 1: force readonly; 2: crash
 OPTION(mds_mon_shutdown_timeout, OPT_DOUBLE, 5)
 
-// Maximum number of concurrent stray files to purge
-OPTION(mds_max_purge_files, OPT_U32, 64)
+// Maximum number of concurrent stray files to purge; within it, the
+// ops limit below (which scales with the PG count) decides
+OPTION(mds_max_purge_files, OPT_U32, 1024)
 // Maximum number of concurrent RADOS ops to issue in purging
 OPTION(mds_max_purge_ops, OPT_U32, 8192)
 // Maximum number of concurrent RADOS ops to issue in purging, scaled by PG count
@@ -618,6 +662,10 @@ OPTION(osd_compact_leveldb_on_mount, OPT_BOOL, false)
 
 // Maximum number of backfills to or from a single osd
 OPTION(osd_max_backfills, OPT_U64, 1)
+OPTION(osd_backfill_adaptive, OPT_BOOL, false)   // adjust the backfill reservation limit to load, starting from osd_max_backfills
+OPTION(osd_backfill_adaptive_max, OPT_U64, 8)   // and never above this
+OPTION(osd_backfill_adaptive_client_lat, OPT_DOUBLE, .05)   // back off while mean client op latency (s) is higher, 0 to ignore
+OPTION(osd_backfill_adaptive_commit_lat, OPT_DOUBLE, .1)   // or the store's commit latency (s) is, 0 to ignore
 
 // Minimum recovery priority (255 = max, smaller = lower)
 OPTION(osd_min_recovery_priority, OPT_INT, 0)
@@ -733,22 +781,68 @@ OPTION(osd_max_markdown_count, OPT_INT, 5)
 
 OPTION(osd_op_threads, OPT_INT, 2)    // 0 == no threading
 OPTION(osd_peering_wq_batch_size, OPT_U64, 20)
+OPTION(osd_peering_threads, OPT_INT, 5)  // pgs peering in parallel; keep >= 1
 OPTION(osd_op_pq_max_tokens_per_priority, OPT_U64, 4194304)
 OPTION(osd_op_pq_min_cost, OPT_U64, 65536)
 OPTION(osd_disk_threads, OPT_INT, 1)
 OPTION(osd_disk_thread_ioprio_class, OPT_STR, "") // rt realtime be best effort idle
 OPTION(osd_disk_thread_ioprio_priority, OPT_INT, -1) // 0-7
 OPTION(osd_recovery_threads, OPT_INT, 1)
+OPTION(osd_load_pgs_threads, OPT_INT, 4) // pgs whose state is read in parallel on startup
 OPTION(osd_recover_clone_overlap, OPT_BOOL, true)   // preserve clone_overlap during recovery/migration
 OPTION(osd_op_num_threads_per_shard, OPT_INT, 2)
 OPTION(osd_op_num_shards, OPT_INT, 5)
-OPTION(osd_op_queue, OPT_STR, "wpq") // PrioritzedQueue (prio), Weighted Priority Queue (wpq), or debug_random
+// one op thread per shard, which owns the shard's pgs and runs each
+// dequeued pg's pending ops back to back under a single pg lock
+OPTION(osd_op_run_to_completion, OPT_BOOL, false)
+OPTION(osd_op_run_to_completion_batch, OPT_INT, 16) // max ops taken off a shard's queue at once
+OPTION(osd_op_queue, OPT_STR, "wpq") // PrioritzedQueue (prio), Weighted Priority Queue (wpq), mClock by op class (mclock_opclass), or debug_random
 OPTION(osd_op_queue_cut_off, OPT_STR, "low") // Min priority to go to strict queue. (low, high, debug_random)
+// mclock_opclass profiles: reservation and limit in ops/s (0 = none),
+// weight relative to the other classes.  Pools can override the client
+// profile with the mclock_res/mclock_wgt/mclock_lim pool options.
+OPTION(osd_op_queue_mclock_client_op_res, OPT_DOUBLE, 1000.0)
+OPTION(osd_op_queue_mclock_client_op_wgt, OPT_DOUBLE, 500.0)
+OPTION(osd_op_queue_mclock_client_op_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_osd_subop_res, OPT_DOUBLE, 1000.0)
+OPTION(osd_op_queue_mclock_osd_subop_wgt, OPT_DOUBLE, 500.0)
+OPTION(osd_op_queue_mclock_osd_subop_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_snap_res, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_snap_wgt, OPT_DOUBLE, 1.0)
+OPTION(osd_op_queue_mclock_snap_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_recov_res, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_recov_wgt, OPT_DOUBLE, 1.0)
+OPTION(osd_op_queue_mclock_recov_lim, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_scrub_res, OPT_DOUBLE, 0.0)
+OPTION(osd_op_queue_mclock_scrub_wgt, OPT_DOUBLE, 1.0)
+OPTION(osd_op_queue_mclock_scrub_lim, OPT_DOUBLE, 0.0)
 
 // Set to true for testing.  Users should NOT set this.
 // If set to true even after reading enough shards to
 // decode the object, any error will be reported.
+// serve single-extent reads of cached, unlocked head objects in replicated
+// pools without building an OpContext
+OPTION(osd_small_read_fast_path, OPT_BOOL, true)
+OPTION(osd_small_read_max_len, OPT_U64, 65536)
+// coalesce rep ops to the same peer osd into one message; all osds must
+// run luminous
+OPTION(osd_repop_batch, OPT_BOOL, false)
+OPTION(osd_repop_batch_window, OPT_DOUBLE, .0002) // seconds a batch may wait
+OPTION(osd_repop_batch_max_bytes, OPT_U64, 65536) // send once this much op data is queued
+// per-client admission control at dispatch; 0 leaves a rate unlimited
+OPTION(osd_client_throttle_ops, OPT_DOUBLE, 0) // client ops/s
+OPTION(osd_client_throttle_bytes, OPT_DOUBLE, 0) // client op bytes/s
+OPTION(osd_client_throttle_burst, OPT_DOUBLE, 1.0) // seconds of headroom a client may save up
+OPTION(osd_client_throttle_policy, OPT_STR, "session") // what shares a throttle: session|entity
 OPTION(osd_read_ec_check_for_errors, OPT_BOOL, false) // return error if any ec shard has an error
+OPTION(osd_ec_extent_cache_max_bytes, OPT_U64, 1<<20) // per pg, stripes kept from finished ec overwrites
+OPTION(osd_ec_direct_small_reads, OPT_BOOL, true) // read only the data shards holding a small ec read, if they are all there
+OPTION(osd_ec_parity_delta_writes, OPT_BOOL, false) // small ec overwrites update parity from the changed shards only, if the plugin can
+OPTION(osd_ec_recovery_read_ahead, OPT_BOOL, true) // read the next extent of an ec object under recovery while its pushes are in flight
+OPTION(osd_ec_recovery_balance_reads, OPT_BOOL, true) // pick ec recovery sources by their outstanding reads
+OPTION(osd_ec_locality_aware_reads, OPT_BOOL, true) // weigh ec read sources by crush locality and measured read latency
+OPTION(osd_ec_remote_locality_cost, OPT_INT, 10000) // usec of read latency a shard outside our ec profile's ruleset-locality bucket is worth
+OPTION(osd_ec_rely_on_store_csum, OPT_BOOL, false) // when every shard is on bluestore with checksums (and the pool doesn't turn them off), ec writes drop the per-shard crcs of hinfo; reads and deep scrub rely on the store's checksums
 
 // Only use clone_overlap for recovery if there are fewer than
 // osd_recover_clone_overlap_limit entries in the overlap set
@@ -775,9 +869,13 @@ OPTION(osd_heartbeat_interval, OPT_INT, 6)       // (seconds) how often we ping
 OPTION(osd_heartbeat_grace, OPT_INT, 20)
 OPTION(osd_heartbeat_min_peers, OPT_INT, 10)     // minimum number of peers
 OPTION(osd_heartbeat_use_min_delay_socket, OPT_BOOL, false) // prio the heartbeat tcp socket and set dscp as CS6 on it if true
+OPTION(osd_heartbeat_thread_cpu, OPT_INT, -1)    // pin the heartbeat thread to this cpu; -1 for any
+OPTION(osd_heartbeat_thread_rt_priority, OPT_INT, 0) // run the heartbeat thread SCHED_FIFO at this priority; 0 for normal scheduling
+OPTION(osd_heartbeat_rtt_history, OPT_INT, 256)  // halve a peer's ping rtt histogram once it holds this many samples
 
 // max number of parallel snap trims/pg
 OPTION(osd_pg_max_concurrent_snap_trims, OPT_U64, 2)
+OPTION(osd_snap_trim_batch, OPT_U64, 8)   // clones trimmed per snap trim transaction
 // max number of trimming pgs
 OPTION(osd_max_trimming_pgs, OPT_U64, 2)
 
@@ -800,7 +898,9 @@ OPTION(osd_recovery_delay_start, OPT_FLOAT, 0)
 OPTION(osd_recovery_max_active, OPT_U64, 3)
 OPTION(osd_recovery_max_single_start, OPT_U64, 1)
 OPTION(osd_recovery_max_chunk, OPT_U64, 8<<20)  // max size of push chunk
+OPTION(osd_recovery_push_window, OPT_U64, 2)  // push chunks of one object kept in flight to each peer
 OPTION(osd_recovery_max_omap_entries_per_chunk, OPT_U64, 64000) // max number of omap entries per chunk; 0 to disable limit
+OPTION(osd_recovery_dirty_extents, OPT_BOOL, true) // push only the ranges the log says changed when a replica has an older copy
 OPTION(osd_copyfrom_max_chunk, OPT_U64, 8<<20)   // max size of a COPYFROM chunk
 OPTION(osd_push_per_object_cost, OPT_U64, 1000)  // push cost per object
 OPTION(osd_max_push_cost, OPT_U64, 8<<20)  // max size of push message
@@ -818,6 +918,9 @@ OPTION(osd_scrub_backoff_ratio, OPT_DOUBLE, .66)   // the probability to back of
 OPTION(osd_scrub_chunk_min, OPT_INT, 5)
 OPTION(osd_scrub_chunk_max, OPT_INT, 25)
 OPTION(osd_scrub_sleep, OPT_FLOAT, 0)   // sleep between [deep]scrub ops
+OPTION(osd_scrub_bandwidth, OPT_U64, 0)   // bytes/sec all deep scrubs on an osd may read, 0 for no limit
+OPTION(osd_scrub_resume, OPT_BOOL, true)   // an interrupted deep scrub picks up from its last finished chunk
+OPTION(osd_deep_scrub_skip_unchanged, OPT_INT, 0)   // deep scrubs between full sweeps that don't hash objects unchanged since the last one, 0 to always hash
 OPTION(osd_scrub_auto_repair, OPT_BOOL, false)   // whether auto-repair inconsistencies upon deep-scrubbing
 OPTION(osd_scrub_auto_repair_num_errors, OPT_U32, 5)   // only auto-repair when number of errors is below this threshold
 OPTION(osd_deep_scrub_interval, OPT_FLOAT, 60*60*24*7) // once a week
@@ -868,6 +971,8 @@ OPTION(osd_enxio_on_misdirected_op, OPT_BOOL, false)
 OPTION(osd_debug_verify_cached_snaps, OPT_BOOL, false)
 OPTION(osd_enable_op_tracker, OPT_BOOL, true) // enable/disable OSD op tracking
 OPTION(osd_num_op_tracker_shard, OPT_U32, 32) // The number of shards for holding the ops
+OPTION(osd_op_tracker_sample_every, OPT_U32, 1) // record op events for 1 in this many ops
+OPTION(osd_op_tracker_escalate_after, OPT_DOUBLE, .1) // ...and for any op running longer than this (seconds)
 OPTION(osd_op_history_size, OPT_U32, 20)    // Max number of completed ops to track
 OPTION(osd_op_history_duration, OPT_U32, 600) // Oldest completed op to track
 OPTION(osd_target_transaction_size, OPT_INT, 30)     // to adjust various transactions that batch smaller items
@@ -876,6 +981,11 @@ OPTION(osd_failsafe_nearfull_ratio, OPT_FLOAT, .90) // what % full makes an OSD
 OPTION(osd_fast_fail_on_connection_refused, OPT_BOOL, true) // immediately mark OSDs as down once they refuse to accept connections
 
 OPTION(osd_pg_object_context_cache_count, OPT_INT, 64)
+// if set, size each pg's obc cache by approximate bytes instead of count
+OPTION(osd_pg_object_context_cache_bytes, OPT_U64, 0)
+// share of the obc cache for objects seen only once, so scans don't
+// evict hot objects; 0 for plain lru
+OPTION(osd_pg_object_context_cache_probation_ratio, OPT_DOUBLE, .25)
 OPTION(osd_tracing, OPT_BOOL, false) // true if LTTng-UST tracepoints should be enabled
 
 OPTION(osd_fast_info, OPT_BOOL, true) // use fast info attr, if we can
@@ -912,15 +1022,19 @@ OPTION(rocksdb_log_to_ceph_log, OPT_BOOL, true)  // log to ceph log
 OPTION(rocksdb_cache_size, OPT_INT, 128*1024*1024)  // default rocksdb cache size
 OPTION(rocksdb_cache_shard_bits, OPT_INT, 4)  // rocksdb block cache shard bits, 4 bit -> 16 shards
 OPTION(rocksdb_block_size, OPT_INT, 4*1024)  // default rocksdb block size
+OPTION(rocksdb_bloom_bits_per_key, OPT_INT, 20)  // sst bloom filter bits per key (0 = no filter)
 OPTION(rocksdb_perf, OPT_BOOL, false) // Enabling this will have 5-10% impact on performance for the stats collection
 OPTION(rocksdb_collect_compaction_stats, OPT_BOOL, false) //For rocksdb, this behavior will be an overhead of 5%~10%, collected only rocksdb_perf is enabled.
 OPTION(rocksdb_collect_extended_stats, OPT_BOOL, false) //For rocksdb, this behavior will be an overhead of 5%~10%, collected only rocksdb_perf is enabled.
 OPTION(rocksdb_collect_memory_stats, OPT_BOOL, false) //For rocksdb, this behavior will be an overhead of 5%~10%, collected only rocksdb_perf is enabled.
+OPTION(rocksdb_enable_rmrange, OPT_BOOL, false) // remove key ranges with one DeleteRange tombstone instead of one per key; range tombstones slow down reads and iterators as they pile up
 
 // rocksdb options that will be used for omap(if omap_backend is rocksdb)
 OPTION(filestore_rocksdb_options, OPT_STR, "")
 // rocksdb options that will be used in monstore
-OPTION(mon_rocksdb_options, OPT_STR, "write_buffer_size=33554432,compression=kNoCompression")
+// small values, heavy churn: keep more (small) memtables around so a slow
+// flush doesn't stall paxos commits, and reuse wal files
+OPTION(mon_rocksdb_options, OPT_STR, "write_buffer_size=33554432,compression=kNoCompression,max_write_buffer_number=4,min_write_buffer_number_to_merge=1,recycle_log_file_num=4")
 
 /**
  * osd_*_priority adjust the relative priority of client io, recovery io,
@@ -986,7 +1100,11 @@ OPTION(bdev_inject_crash_flush_delay, OPT_INT, 2) // wait N more seconds on flus
 OPTION(bdev_aio, OPT_BOOL, true)
 OPTION(bdev_aio_poll_ms, OPT_INT, 250)  // milliseconds
 OPTION(bdev_aio_max_queue_depth, OPT_INT, 32)
+OPTION(bdev_ioring, OPT_BOOL, false)  // use io_uring instead of libaio, if built with it and the kernel allows
+OPTION(bdev_ioring_hipri, OPT_BOOL, false)  // IORING_SETUP_IOPOLL: busy poll for completions
+OPTION(bdev_ioring_sqthread_poll, OPT_BOOL, false)  // IORING_SETUP_SQPOLL: kernel thread polls the submission ring
 OPTION(bdev_block_size, OPT_INT, 4096)
+OPTION(bdev_numa_affinity, OPT_BOOL, false) // run a device's aio thread, and bluestore's kv threads, on the device's NUMA node
 OPTION(bdev_debug_aio, OPT_BOOL, false)
 OPTION(bdev_debug_aio_suicide_timeout, OPT_FLOAT, 60.0)
 
@@ -995,6 +1113,7 @@ OPTION(bdev_debug_aio_suicide_timeout, OPT_FLOAT, 60.0)
 // NVMe driver is loaded while osd is running.
 OPTION(bdev_nvme_unbind_from_kernel, OPT_BOOL, false)
 OPTION(bdev_nvme_retry_count, OPT_INT, -1) // -1 means by default which is 4
+OPTION(bdev_nvme_per_thread_qpair, OPT_BOOL, false) // submitting threads own a qpair and poll it, instead of handing IO to a driver thread (experimental)
 
 OPTION(objectstore_blackhole, OPT_BOOL, false)
 
@@ -1009,6 +1128,10 @@ OPTION(bluefs_compact_log_sync, OPT_BOOL, false)  // sync or async log compactio
 OPTION(bluefs_buffered_io, OPT_BOOL, false)
 OPTION(bluefs_allocator, OPT_STR, "bitmap")     // stupid | bitmap
 OPTION(bluefs_preextend_wal_files, OPT_BOOL, false)  // this *requires* that rocksdb has recycling enabled
+OPTION(bluefs_spillover_check_interval, OPT_DOUBLE, 60) // seconds; 0 to disable spillover accounting and migration
+OPTION(bluefs_spillover_migrate, OPT_BOOL, false) // move spilled files back to their preferred device
+OPTION(bluefs_spillover_migrate_max_bytes, OPT_U64, 256*1024*1024) // per pass
+OPTION(bluefs_spillover_migrate_min_free_ratio, OPT_FLOAT, .1) // keep this fraction of the target device free
 
 OPTION(bluestore_bluefs, OPT_BOOL, true)
 OPTION(bluestore_bluefs_env_mirror, OPT_BOOL, false) // mirror to normal Env for debug
@@ -1061,6 +1184,13 @@ OPTION(bluestore_gc_enable_blob_threshold, OPT_INT, 0)
  * 
  */
 OPTION(bluestore_gc_enable_total_threshold, OPT_INT, 0)  
+/*
+ * Rewrite the rest of an uncompressed blob touched by a write if it is
+ * spread over at least this many physical extents (0 = never), moving
+ * at most bluestore_gc_fragmented_max_bytes per write.
+ */
+OPTION(bluestore_gc_fragmented_blob_extents, OPT_INT, 0)
+OPTION(bluestore_gc_fragmented_max_bytes, OPT_U64, 1024*1024)
 
 OPTION(bluestore_max_blob_size, OPT_U32, 512*1024)
 /*
@@ -1069,6 +1199,13 @@ OPTION(bluestore_max_blob_size, OPT_U32, 512*1024)
  * And ask for compressing at least 12.5%(1/8) off, by default.
  */
 OPTION(bluestore_compression_required_ratio, OPT_DOUBLE, .875)
+// compress the blobs of a large write in parallel on this many threads
+// (0 = compress inline in the op thread)
+OPTION(bluestore_compression_threads, OPT_INT, 0)
+OPTION(bluestore_compression_thread_timeout, OPT_INT, 60)
+OPTION(bluestore_compression_thread_suicide_timeout, OPT_INT, 180)
+// store blobs uncompressed instead of queueing behind this many pending jobs
+OPTION(bluestore_compression_max_queue, OPT_INT, 64)
 OPTION(bluestore_extent_map_shard_max_size, OPT_U32, 1200)
 OPTION(bluestore_extent_map_shard_target_size, OPT_U32, 500)
 OPTION(bluestore_extent_map_shard_min_size, OPT_U32, 150)
@@ -1081,12 +1218,37 @@ OPTION(bluestore_2q_cache_kin_ratio, OPT_DOUBLE, .5)    // kin page slot size /
 OPTION(bluestore_2q_cache_kout_ratio, OPT_DOUBLE, .5)   // number of kout page slot / total number of page slot
 OPTION(bluestore_cache_size, OPT_U64, 1024*1024*1024)
 OPTION(bluestore_cache_meta_ratio, OPT_DOUBLE, .9)
+/*
+ * If enabled, bluestore_cache_size is shared between the onode (meta),
+ * buffer (data) and kv block caches and rebalanced periodically based on
+ * the hit rates observed in each.  bluestore_cache_meta_ratio and
+ * rocksdb_cache_size only provide the starting split.
+ */
+OPTION(bluestore_cache_autotune, OPT_BOOL, false)
+OPTION(bluestore_cache_autotune_interval, OPT_DOUBLE, 5)  // seconds between rebalances
+OPTION(bluestore_cache_autotune_chunk_size, OPT_U64, 32*1024*1024) // bytes moved per rebalance
+OPTION(bluestore_cache_autotune_min_ratio, OPT_DOUBLE, .05) // min share of the budget for each cache
+OPTION(bluestore_cache_autotune_rss_target, OPT_U64, 0) // shrink caches to keep process rss below this (0 = unbounded)
 OPTION(bluestore_kvbackend, OPT_STR, "rocksdb")
-OPTION(bluestore_allocator, OPT_STR, "bitmap")     // stupid | bitmap
+OPTION(bluestore_allocator, OPT_STR, "bitmap")     // stupid | bitmap | cached_stupid | cached_bitmap
+OPTION(bluestore_allocator_cache_shards, OPT_INT, 0)   // cached_*: per-cpu shards (0 = one per cpu)
+OPTION(bluestore_allocator_cache_refill_bytes, OPT_U64, 4*1024*1024) // cached_*: bytes pulled per refill
+OPTION(bluestore_allocator_cache_release_bytes, OPT_U64, 4*1024*1024) // cached_*: freed bytes batched per shard
+OPTION(bluestore_allocator_prefer_contiguous, OPT_INT, 0) // stupid: when splitting, first try pieces of N alloc units (0 = off)
+OPTION(bluestore_fragmentation_check_period, OPT_DOUBLE, 3600) // seconds between fragmentation score updates
+OPTION(bluestore_alloc_snapshot, OPT_BOOL, false) // save allocator state on umount, load it instead of the freelist on mount
+OPTION(bluestore_alloc_snapshot_compression, OPT_STR, "snappy") // compressor for the snapshot ("" = none)
+OPTION(bluestore_alloc_snapshot_verify, OPT_BOOL, false) // cross-check a loaded snapshot against the freelist
 OPTION(bluestore_freelist_type, OPT_STR, "bitmap") // extent | bitmap
 OPTION(bluestore_freelist_blocks_per_key, OPT_INT, 128)
 OPTION(bluestore_bitmapallocator_blocks_per_zone, OPT_INT, 1024) // must be power of 2 aligned, e.g., 512, 1024, 2048...
 OPTION(bluestore_bitmapallocator_span_size, OPT_INT, 1024) // must be power of 2 aligned, e.g., 512, 1024, 2048...
+// Prefixes to keep in their own rocksdb column family, created at mkfs,
+// as a space separated list of PREFIX[=cf options] items, e.g.
+// "M=write_buffer_size=67108864;compaction_style=kCompactionStyleUniversal".
+// Giving M "prefix_extractor=rocksdb.FixedPrefix.10" (prefix plus nid)
+// lets per-object omap scans use prefix bloom filters.
+OPTION(bluestore_rocksdb_cfs, OPT_STR, "")
 OPTION(bluestore_rocksdb_options, OPT_STR, "compression=kNoCompression,max_write_buffer_number=4,min_write_buffer_number_to_merge=1,recycle_log_file_num=4,write_buffer_size=268435456,writable_file_max_buffer_size=0")
 OPTION(bluestore_fsck_on_mount, OPT_BOOL, false)
 OPTION(bluestore_fsck_on_mount_deep, OPT_BOOL, true)
@@ -1094,9 +1256,14 @@ OPTION(bluestore_fsck_on_umount, OPT_BOOL, false)
 OPTION(bluestore_fsck_on_umount_deep, OPT_BOOL, true)
 OPTION(bluestore_fsck_on_mkfs, OPT_BOOL, true)
 OPTION(bluestore_fsck_on_mkfs_deep, OPT_BOOL, false)
+OPTION(bluestore_fsck_threads, OPT_INT, 4)  // objects are checked in parallel by this many threads (<= 1: inline)
 OPTION(bluestore_sync_submit_transaction, OPT_BOOL, false) // submit kv txn in queueing thread (not kv_sync_thread)
 OPTION(bluestore_sync_wal_apply, OPT_BOOL, true)     // perform initial wal work synchronously (possibly in combination with aio so we only *queue* ios)
 OPTION(bluestore_wal_threads, OPT_INT, 4)
+// apply wal writes from many txcs together, merged and sorted by offset
+OPTION(bluestore_wal_batch, OPT_BOOL, false)
+OPTION(bluestore_wal_batch_max_ops, OPT_U64, 512)      // submit a wal batch at this many ops...
+OPTION(bluestore_wal_batch_max_bytes, OPT_U64, 64*1024*1024) // ...or this many bytes
 OPTION(bluestore_wal_thread_timeout, OPT_INT, 30)
 OPTION(bluestore_wal_thread_suicide_timeout, OPT_INT, 120)
 OPTION(bluestore_max_ops, OPT_U64, 512)
@@ -1107,6 +1274,10 @@ OPTION(bluestore_nid_prealloc, OPT_INT, 1024)
 OPTION(bluestore_blobid_prealloc, OPT_U64, 10240)
 OPTION(bluestore_clone_cow, OPT_BOOL, true)  // do copy-on-write for clones
 OPTION(bluestore_default_buffered_read, OPT_BOOL, true)
+OPTION(bluestore_readahead, OPT_BOOL, false)  // detect sequential reads and read ahead into the buffer cache
+OPTION(bluestore_readahead_trigger_requests, OPT_INT, 4)  // sequential reads needed to start read-ahead
+OPTION(bluestore_readahead_min_bytes, OPT_U64, 128*1024)  // first read-ahead size; doubles while the stream continues...
+OPTION(bluestore_readahead_max_bytes, OPT_U64, 4*1024*1024)  // ...up to this
 OPTION(bluestore_default_buffered_write, OPT_BOOL, false)
 OPTION(bluestore_debug_misc, OPT_BOOL, false)
 OPTION(bluestore_debug_no_reuse_blocks, OPT_BOOL, false)
@@ -1164,6 +1335,7 @@ OPTION(filestore_debug_inject_read_err, OPT_BOOL, false)
 
 OPTION(filestore_debug_omap_check, OPT_BOOL, 0) // Expensive debugging check on sync
 OPTION(filestore_omap_header_cache_size, OPT_INT, 1024)
+OPTION(filestore_omap_header_cache_shards, OPT_INT, 16) // objects are spread over this many header locks and caches
 
 // Use omap for xattrs for attrs over
 // filestore_max_inline_xattr_size or
@@ -1261,6 +1433,7 @@ OPTION(filestore_debug_verify_split, OPT_BOOL, false)
 OPTION(journal_dio, OPT_BOOL, true)
 OPTION(journal_aio, OPT_BOOL, true)
 OPTION(journal_force_aio, OPT_BOOL, false)
+OPTION(journal_aio_min_inflight, OPT_INT, 8) // aios in flight before we wait for larger writes to batch up
 OPTION(journal_block_size, OPT_INT, 4096)
 
 // max bytes to search ahead in journal searching for corruption
@@ -1290,8 +1463,11 @@ OPTION(fio_dir, OPT_STR, "/tmp/fio") // fio data directory for fio-objectstore
 OPTION(rados_mon_op_timeout, OPT_DOUBLE, 0) // how many seconds to wait for a response from the monitor before returning an error from a rados operation. 0 means on limit.
 OPTION(rados_osd_op_timeout, OPT_DOUBLE, 0) // how many seconds to wait for a response from osds before returning an error from a rados operation. 0 means no limit.
 OPTION(rados_tracing, OPT_BOOL, false) // true if LTTng-UST tracepoints should be enabled
+OPTION(rados_striper_readahead_max_bytes, OPT_U64, 0) // readahead for sequential libradosstriper reads; 0 disables it.  Readahead data is only dropped by this client's own writes, so reads may miss other clients' recent writes
+OPTION(rados_striper_readahead_trigger_requests, OPT_INT, 2) // number of sequential reads of a striped object before readahead starts
 
-OPTION(rbd_op_threads, OPT_INT, 1)
+OPTION(rbd_op_threads, OPT_INT, 1) // threads sending image IO; overlapping requests are still sent in order
+OPTION(rbd_op_finisher_threads, OPT_INT, 0) // if > 0, complete op_work_queue contexts on a FinisherPool of this many threads, in order per image
 OPTION(rbd_op_thread_timeout, OPT_INT, 60)
 OPTION(rbd_non_blocking_aio, OPT_BOOL, true) // process AIO ops from a worker thread to prevent blocking
 OPTION(rbd_cache, OPT_BOOL, true) // whether to enable caching (writeback unless rbd_cache_max_dirty is 0)
@@ -1302,7 +1478,21 @@ OPTION(rbd_cache_target_dirty, OPT_LONGLONG, 16<<20) // target dirty limit in by
 OPTION(rbd_cache_max_dirty_age, OPT_FLOAT, 1.0)      // seconds in cache before writeback starts
 OPTION(rbd_cache_max_dirty_object, OPT_INT, 0)       // dirty limit for objects - set to 0 for auto calculate from rbd_cache_size
 OPTION(rbd_cache_block_writes_upfront, OPT_BOOL, false) // whether to block writes to the cache before the aio_write call completes (true), or block before the aio completion is called (false)
+OPTION(rbd_persistent_cache, OPT_BOOL, false) // log writes to a local file and acknowledge them once durable there, writing them back to the image in the background; the log is replayed when the image is next opened
+OPTION(rbd_persistent_cache_path, OPT_STR, "/var/lib/ceph/rbd-cache") // directory for the write logs, ideally on local NVMe or PMEM
+OPTION(rbd_persistent_cache_size, OPT_U64, 1<<30) // bytes of log per image; writes wait for writeback once it is full
+OPTION(rbd_persistent_cache_max_writeback, OPT_U32, 16) // logged writes being written back to the image at once
+OPTION(rbd_memory_cache, OPT_BOOL, false) // cache image extents in memory in place of the object cacher (ignored with rbd_persistent_cache)
+OPTION(rbd_memory_cache_size, OPT_U64, 32<<20) // cache size in bytes
+OPTION(rbd_memory_cache_max_dirty, OPT_U64, 24<<20) // writes wait for writeback above this many dirty bytes
+OPTION(rbd_memory_cache_target_dirty, OPT_U64, 16<<20) // start writing back above this many dirty bytes
+OPTION(rbd_memory_cache_max_dirty_age, OPT_FLOAT, 1.0) // seconds dirty data may stay in the cache
+OPTION(rbd_memory_cache_shards, OPT_U32, 16) // independently locked shards; each object's range belongs to one
+OPTION(rbd_memory_cache_max_writeback, OPT_U32, 8) // writeback batches in flight at once
+OPTION(rbd_memory_cache_writeback_batch, OPT_U64, 4<<20) // bytes of dirty extents coalesced into one writeback request
 OPTION(rbd_concurrent_management_ops, OPT_INT, 10) // how many operations can be in flight for a management operation like deleting or resizing an image
+OPTION(rbd_concurrent_management_ops_max, OPT_INT, 128) // how far that can grow while OSD latency stays low
+OPTION(rbd_concurrent_diff_ops, OPT_INT, 32) // how many objects can have their snapshots listed at once while diffing an image
 OPTION(rbd_balance_snap_reads, OPT_BOOL, false)
 OPTION(rbd_localize_snap_reads, OPT_BOOL, false)
 OPTION(rbd_balance_parent_reads, OPT_BOOL, false)
@@ -1310,11 +1500,20 @@ OPTION(rbd_localize_parent_reads, OPT_BOOL, true)
 OPTION(rbd_readahead_trigger_requests, OPT_INT, 10) // number of sequential requests necessary to trigger readahead
 OPTION(rbd_readahead_max_bytes, OPT_LONGLONG, 512 * 1024) // set to 0 to disable readahead
 OPTION(rbd_readahead_disable_after_bytes, OPT_LONGLONG, 50 * 1024 * 1024) // how many bytes are read in total before readahead is disabled
-OPTION(rbd_clone_copy_on_read, OPT_BOOL, false)
+OPTION(rbd_clone_copy_on_read, OPT_BOOL, false) // copy up parent objects in the background once they have been read
+OPTION(rbd_sparse_copyup, OPT_BOOL, false) // only send the non-zero ranges of parent objects when copying up (requires OSDs with the rbd sparse_copyup class method)
 OPTION(rbd_blacklist_on_break_lock, OPT_BOOL, true) // whether to blacklist clients whose lock was broken
 OPTION(rbd_blacklist_expire_seconds, OPT_INT, 0) // number of seconds to blacklist - set to 0 for OSD default
 OPTION(rbd_request_timed_out_seconds, OPT_INT, 30) // number of seconds before maint request times out
 OPTION(rbd_skip_partial_discard, OPT_BOOL, false) // when trying to discard a range inside an object, set to true to skip zeroing the range.
+OPTION(rbd_qos_iops_limit, OPT_U64, 0) // IOs per second allowed for the image, 0 for no limit
+OPTION(rbd_qos_bps_limit, OPT_U64, 0) // bytes per second read and written, 0 for no limit
+OPTION(rbd_qos_read_iops_limit, OPT_U64, 0) // reads per second, 0 for no limit
+OPTION(rbd_qos_write_iops_limit, OPT_U64, 0) // writes, discards and writesames per second, 0 for no limit
+OPTION(rbd_qos_read_bps_limit, OPT_U64, 0) // bytes read per second, 0 for no limit
+OPTION(rbd_qos_write_bps_limit, OPT_U64, 0) // bytes written per second, 0 for no limit
+OPTION(rbd_qos_burst_seconds, OPT_FLOAT, 1.0) // seconds' worth of each limit an idle image may save up and burst
+OPTION(rbd_qos_schedule_tick_min, OPT_INT, 50) // milliseconds between QoS token refills
 OPTION(rbd_enable_alloc_hint, OPT_BOOL, true) // when writing a object, it will issue a hint to osd backend to indicate the expected size object need
 OPTION(rbd_tracing, OPT_BOOL, false) // true if LTTng-UST tracepoints should be enabled
 OPTION(rbd_validate_pool, OPT_BOOL, true) // true if empty pools should be validated for RBD compatibility
@@ -1374,9 +1573,13 @@ OPTION(rbd_journal_commit_age, OPT_DOUBLE, 5) // commit time interval, seconds
 OPTION(rbd_journal_object_flush_interval, OPT_INT, 0) // maximum number of pending commits per journal object
 OPTION(rbd_journal_object_flush_bytes, OPT_INT, 0) // maximum number of pending bytes per journal object
 OPTION(rbd_journal_object_flush_age, OPT_DOUBLE, 0) // maximum age (in seconds) for pending commits
+OPTION(rbd_journal_object_max_in_flight_appends, OPT_U32, 0) // maximum number of in-flight appends per journal object, lowered while OSD latency is high (0 = no limit)
 OPTION(rbd_journal_pool, OPT_STR, "") // pool for journal objects
 OPTION(rbd_journal_max_payload_bytes, OPT_U32, 16384) // maximum journal payload size before splitting
 OPTION(rbd_journal_max_concurrent_object_sets, OPT_INT, 0) // maximum number of object sets a journal client can be behind before it is automatically unregistered
+OPTION(rbd_journal_parallel_writes, OPT_BOOL, false) // write data while its journal event is appended instead of once it is safe (not for mirrored images)
+OPTION(rbd_journal_max_prefetch_bytes, OPT_U32, 0) // maximum bytes of later journal objects to read ahead during replay (0 = no read-ahead)
+OPTION(rbd_journal_replay_max_parallel_writes, OPT_U32, 0) // maximum number of non-overlapping write events replayed before their predecessors complete (0 = replay in sequence)
 
 /**
  * RBD Mirror options
@@ -1384,6 +1587,7 @@ OPTION(rbd_journal_max_concurrent_object_sets, OPT_INT, 0) // maximum number of
 OPTION(rbd_mirror_journal_commit_age, OPT_DOUBLE, 5) // commit time interval, seconds
 OPTION(rbd_mirror_journal_poll_age, OPT_DOUBLE, 5) // maximum age (in seconds) between successive journal polls
 OPTION(rbd_mirror_journal_max_fetch_bytes, OPT_U32, 32768) // maximum bytes to read from each journal data object per fetch
+OPTION(rbd_mirror_journal_max_prefetch_bytes, OPT_U32, 1048576) // maximum bytes of later journal objects to read ahead while replaying (0 = no read-ahead)
 OPTION(rbd_mirror_sync_point_update_age, OPT_DOUBLE, 30) // number of seconds between each update of the image sync point object number
 OPTION(rbd_mirror_concurrent_image_syncs, OPT_U32, 5) // maximum number of image syncs in parallel
 OPTION(rbd_mirror_pool_replayers_refresh_interval, OPT_INT, 30) // interval to refresh peers in rbd-mirror daemon
@@ -1401,6 +1605,9 @@ OPTION(rgw_max_chunk_size, OPT_INT, 4 * 1024 * 1024)
 OPTION(rgw_put_obj_min_window_size, OPT_INT, 16 * 1024 * 1024)
 OPTION(rgw_put_obj_max_window_size, OPT_INT, 64 * 1024 * 1024)
 OPTION(rgw_max_put_size, OPT_U64, 5ULL*1024*1024*1024)
+OPTION(rgw_put_obj_hash_threads, OPT_INT, 4) // threads that compute the md5 of uploads larger than rgw_max_chunk_size, 0 hashes on the request thread
+OPTION(rgw_compression_threads, OPT_INT, 4) // threads that compress the chunks of uploads to compressed placement targets, 0 compresses on the request thread
+OPTION(rgw_compression_block_size, OPT_INT, 1024 * 1024) // chunks are compressed in parallel in blocks of this size
 
 /**
  * override max bucket index shards in zone configuration (if not zero)
@@ -1418,6 +1625,20 @@ OPTION(rgw_override_bucket_index_max_shards, OPT_U32, 0)
  */
 OPTION(rgw_bucket_index_max_aio, OPT_U32, 8)
 
+/**
+ * Buckets whose index shards hold more than rgw_max_objs_per_shard
+ * entries on average are queued for resharding, and resharded online by
+ * the radosgw instances when rgw_dynamic_resharding is set.
+ */
+OPTION(rgw_dynamic_resharding, OPT_BOOL, true)
+OPTION(rgw_max_objs_per_shard, OPT_U32, 100000)
+OPTION(rgw_reshard_num_logs, OPT_U32, 16) // number of objects the reshard queue is spread over
+OPTION(rgw_reshard_thread_interval, OPT_U32, 600) // seconds between passes over the reshard queue
+OPTION(rgw_reshard_bucket_lock_duration, OPT_U32, 120) // seconds a bucket reshard lock is held before it is renewed
+OPTION(rgw_reshard_block_threshold, OPT_U32, 1000) // block writes for the final catch up once fewer objects changed
+OPTION(rgw_reshard_max_catchup_passes, OPT_U32, 10) // block writes for the final catch up after this many passes
+OPTION(rgw_reshard_wait_time, OPT_U32, 120) // seconds a write waits for a blocked bucket index before failing
+
 /**
  * whether or not the quota/gc threads should be started
  */
@@ -1429,7 +1650,17 @@ OPTION(rgw_enable_lc_threads, OPT_BOOL, true)
 OPTION(rgw_data, OPT_STR, "/var/lib/ceph/radosgw/$cluster-$id")
 OPTION(rgw_enable_apis, OPT_STR, "s3, s3website, swift, swift_auth, admin")
 OPTION(rgw_cache_enabled, OPT_BOOL, true)   // rgw cache enabled
-OPTION(rgw_cache_lru_size, OPT_INT, 10000)   // num of entries in rgw cache
+OPTION(rgw_cache_lru_size, OPT_INT, 100000)   // num of entries in rgw cache
+OPTION(rgw_cache_max_bytes, OPT_U64, 256 << 20) // memory used by the rgw cache, 0 for no limit
+OPTION(rgw_cache_shards, OPT_INT, 16)   // independently locked partitions of the rgw cache
+OPTION(rgw_cache_negative_ttl, OPT_INT, 60) // seconds a cached ENOENT is trusted for, 0 until invalidated
+OPTION(rgw_cache_notify_max_batch, OPT_INT, 32) // cache updates sent together in one notify, 1 to send each on its own
+OPTION(rgw_datacache_enabled, OPT_BOOL, false) // cache hot object data in local files
+OPTION(rgw_datacache_path, OPT_STR, "/var/lib/ceph/radosgw/$cluster-$id/datacache")
+OPTION(rgw_datacache_size, OPT_U64, 10ull << 30) // bytes of object data the data cache holds
+OPTION(rgw_datacache_max_obj_size, OPT_U64, 64 << 20) // larger objects aren't cached
+OPTION(rgw_datacache_admit_hits, OPT_INT, 2) // requests of an object before it is cached
+OPTION(rgw_datacache_admit_candidates, OPT_INT, 100000) // uncached objects whose requests are counted
 OPTION(rgw_socket_path, OPT_STR, "")   // path to unix domain socket, if not specified, rgw will not run as external fcgi
 OPTION(rgw_host, OPT_STR, "")  // host for radosgw, can be an IP, default is 0.0.0.0
 OPTION(rgw_port, OPT_STR, "")  // port to listen, format as "8080" "5000", if not specified, rgw will not run external fcgi
@@ -1437,7 +1668,7 @@ OPTION(rgw_dns_name, OPT_STR, "") // hostname suffix on buckets
 OPTION(rgw_dns_s3website_name, OPT_STR, "") // hostname suffix on buckets for s3-website endpoint
 OPTION(rgw_content_length_compat, OPT_BOOL, false) // Check both HTTP_CONTENT_LENGTH and CONTENT_LENGTH in fcgi env
 OPTION(rgw_lifecycle_enabled, OPT_BOOL, true) //rgw lifecycle enabled
-OPTION(rgw_lifecycle_thread, OPT_INT, 1) //start lifecycle thread number per radosgw
+OPTION(rgw_lifecycle_thread, OPT_INT, 4) // bucket index shards each radosgw expires at a time
 OPTION(rgw_lifecycle_work_time, OPT_STR, "00:00-06:00") //job process lc  at 00:00-06:00s
 OPTION(rgw_lc_lock_max_time, OPT_INT, 60)  // total run time for a single gc processor work
 OPTION(rgw_lc_max_objs, OPT_INT, 32)
@@ -1484,6 +1715,8 @@ OPTION(rgw_ldap_dnattr, OPT_STR, "uid")
 OPTION(rgw_ldap_secret, OPT_STR, "/etc/openldap/secret")
 /* rgw_s3_auth_use_ldap  use LDAP for RGW auth? */
 OPTION(rgw_s3_auth_use_ldap, OPT_BOOL, false)
+OPTION(rgw_auth_cache_size, OPT_INT, 10000) // entries in each auth result cache (s3 v4 signing keys, ldap binds), 0 disables them
+OPTION(rgw_auth_cache_ttl, OPT_INT, 300) // seconds a cached auth result is used for
 /* rgw_ldap_searchfilter  LDAP search filter */
 OPTION(rgw_ldap_searchfilter, OPT_STR, "")
 
@@ -1496,6 +1729,7 @@ OPTION(rgw_remote_addr_param, OPT_STR, "REMOTE_ADDR")  // e.g. X-Forwarded-For,
 OPTION(rgw_op_thread_timeout, OPT_INT, 10*60)
 OPTION(rgw_op_thread_suicide_timeout, OPT_INT, 0)
 OPTION(rgw_thread_pool_size, OPT_INT, 100)
+OPTION(rgw_asio_coroutine_stack_size, OPT_U64, 512 << 10) // stack of each connection's coroutine in the asio frontend
 OPTION(rgw_num_control_oids, OPT_INT, 8)
 OPTION(rgw_num_rados_handles, OPT_U32, 1)
 
@@ -1515,6 +1749,12 @@ OPTION(rgw_nfs_fhcache_size, OPT_INT, 2017) /* 3*2017=6051 */
 OPTION(rgw_nfs_namespace_expire_secs, OPT_INT, 300) /* namespace invalidate
 						     * timer */
 OPTION(rgw_nfs_max_gc, OPT_INT, 300) /* max gc events per cycle */
+OPTION(rgw_nfs_attr_cache_secs, OPT_INT, 10) /* attributes and listings
+						* read from RADOS are
+						* trusted this long, 0
+						* disables */
+OPTION(rgw_nfs_dirent_cache_size, OPT_INT, 65536) /* max listed entries kept
+						     * per directory */
 OPTION(rgw_nfs_write_completion_interval_s, OPT_INT, 10) /* stateless (V3)
 							  * commit
 							  * delay */
@@ -1543,6 +1783,12 @@ OPTION(rgw_enable_usage_log, OPT_BOOL, false) // enable logging bandwidth usage
 OPTION(rgw_ops_log_rados, OPT_BOOL, true) // whether ops log should go to rados
 OPTION(rgw_ops_log_socket_path, OPT_STR, "") // path to unix domain socket where ops log can go
 OPTION(rgw_ops_log_data_backlog, OPT_INT, 5 << 20) // max data backlog for ops log
+OPTION(rgw_ops_log_file_path, OPT_STR, "") // path to a local file where ops log can go
+OPTION(rgw_ops_log_flush_threshold, OPT_INT, 1 << 20) // flush pending ops log data once it reaches this many bytes
+OPTION(rgw_ops_log_tick_interval, OPT_INT, 1) // flush pending ops log data every X seconds
+OPTION(rgw_ops_log_max_backlog, OPT_INT, 64 << 20) // drop ops log entries beyond this many pending bytes
+OPTION(rgw_op_complaint_time, OPT_FLOAT, 30) // requests that take longer log the time of each phase, 0 disables
+OPTION(rgw_op_history_slow_op_size, OPT_U32, 20) // number of slow requests kept for dump_historic_slow_requests
 OPTION(rgw_fcgi_socket_backlog, OPT_INT, 1024) // socket  backlog for fcgi
 OPTION(rgw_usage_log_flush_threshold, OPT_INT, 1024) // threshold to flush pending log data
 OPTION(rgw_usage_log_tick_interval, OPT_INT, 30) // flush pending log data every X seconds
@@ -1554,12 +1800,17 @@ OPTION(rgw_gc_max_objs, OPT_INT, 32)
 OPTION(rgw_gc_obj_min_wait, OPT_INT, 2 * 3600)    // wait time before object may be handled by gc
 OPTION(rgw_gc_processor_max_time, OPT_INT, 3600)  // total run time for a single gc processor work
 OPTION(rgw_gc_processor_period, OPT_INT, 3600)  // gc processor cycle time
+OPTION(rgw_gc_processor_threads, OPT_INT, 2)  // gc shards each gateway works on at a time
+OPTION(rgw_gc_max_concurrent_io, OPT_INT, 10)  // tail object releases in flight per gc shard
+OPTION(rgw_gc_max_trim_chunk, OPT_INT, 16)  // completed gc entries removed from a shard at once
 OPTION(rgw_s3_success_create_obj_status, OPT_INT, 0) // alternative success status response for create-obj (0 - default)
 OPTION(rgw_resolve_cname, OPT_BOOL, false)  // should rgw try to resolve hostname as a dns cname record
 OPTION(rgw_obj_stripe_size, OPT_INT, 4 << 20)
 OPTION(rgw_extended_http_attrs, OPT_STR, "") // list of extended attrs that can be set on objects (beyond the default)
 OPTION(rgw_exit_timeout_secs, OPT_INT, 120) // how many seconds to wait for process to go down before exiting unconditionally
-OPTION(rgw_get_obj_window_size, OPT_INT, 16 << 20) // window size in bytes for single get obj request
+OPTION(rgw_get_obj_window_size, OPT_INT, 16 << 20) // max window size in bytes for single get obj request
+OPTION(rgw_get_obj_min_window_size, OPT_INT, 4 << 20) // window size a get obj request starts with, and never shrinks below
+OPTION(rgw_get_obj_max_memory, OPT_U64, 1 << 30) // bytes all get obj requests may have in flight together, 0 for no limit
 OPTION(rgw_get_obj_max_req_size, OPT_INT, 4 << 20) // max length of a single get obj rados op
 OPTION(rgw_relaxed_s3_bucket_names, OPT_BOOL, false) // enable relaxed bucket name rules for US region buckets
 OPTION(rgw_defer_to_bucket_acls, OPT_STR, "") // if the user has bucket perms, use those before key perms (recurse and full_control)
@@ -1580,6 +1831,7 @@ OPTION(rgw_data_log_obj_prefix, OPT_STR, "data_log") //
 OPTION(rgw_replica_log_obj_prefix, OPT_STR, "replica_log") //
 
 OPTION(rgw_bucket_quota_ttl, OPT_INT, 600) // time for cached bucket stats to be cached within rgw instance
+OPTION(rgw_bucket_quota_stale_ttl, OPT_INT, 300) // time past rgw_bucket_quota_ttl that cached stats still serve requests while they're refreshed
 OPTION(rgw_bucket_quota_soft_threshold, OPT_DOUBLE, 0.95) // threshold from which we don't rely on cached info for quota decisions
 OPTION(rgw_bucket_quota_cache_size, OPT_INT, 10000) // number of entries in bucket quota cache
 OPTION(rgw_bucket_default_quota_max_objects, OPT_INT, -1) // number of objects allowed
@@ -1598,6 +1850,7 @@ OPTION(rgw_user_default_quota_max_size, OPT_LONGLONG, -1) // Max size of object
 
 OPTION(rgw_multipart_min_part_size, OPT_INT, 5 * 1024 * 1024) // min size for each part (except for last one) in multipart upload
 OPTION(rgw_multipart_part_upload_limit, OPT_INT, 10000) // parts limit in multipart upload
+OPTION(rgw_multipart_complete_max_aio, OPT_INT, 16) // part info reads in flight when completing a multipart upload
 
 OPTION(rgw_max_slo_entries, OPT_INT, 1000) // default number of max entries in slo
 
@@ -1619,6 +1872,11 @@ OPTION(rgw_sync_lease_period, OPT_INT, 120) // time in second for lease that rgw
 OPTION(rgw_sync_log_trim_interval, OPT_INT, 1200) // time in seconds between attempts to trim sync logs
 
 OPTION(rgw_sync_data_inject_err_probability, OPT_DOUBLE, 0) // range [0, 1]
+OPTION(rgw_data_sync_spawn_window, OPT_INT, 20) // bucket shards each data log shard syncs at a time
+OPTION(rgw_bucket_sync_spawn_window, OPT_INT, 20) // most objects each bucket shard syncs at a time
+OPTION(rgw_data_sync_poll_interval, OPT_INT, 20) // seconds an idle data log shard waits before polling the remote log again
+OPTION(rgw_data_sync_poll_max_interval, OPT_INT, 60) // longest an idle data log shard backs off to between polls
+OPTION(rgw_data_log_trim_spawn_window, OPT_INT, 8) // data log shards trimmed at a time
 OPTION(rgw_sync_meta_inject_err_probability, OPT_DOUBLE, 0) // range [0, 1]
 
 
@@ -1632,8 +1890,15 @@ OPTION(mgr_modules, OPT_STR, "rest")  // Which modules to load
 OPTION(mgr_data, OPT_STR, "/var/lib/ceph/mgr/$cluster-$id") // where to find keyring etc
 OPTION(mgr_beacon_period, OPT_INT, 5)  // How frequently to send beacon
 OPTION(mgr_stats_period, OPT_INT, 5) // How frequently to send stats
+OPTION(mgr_stats_filter, OPT_STR, "") // have daemons only report perf counters whose path starts with one of these (empty = all)
+OPTION(mgr_stats_histograms, OPT_BOOL, true) // Include histogram counters in stats
+OPTION(mgr_counter_history_raw, OPT_INT, 3600) // seconds of perf counter values to keep as reported (0 = none)
+OPTION(mgr_counter_history_minutes, OPT_INT, 86400) // seconds of perf counter values to keep at one a minute (0 = none)
+OPTION(mgr_counter_history_hours, OPT_INT, 30*86400) // seconds of perf counter values to keep at one an hour (0 = none)
 OPTION(mon_mgr_digest_period, OPT_INT, 5)  // How frequently to send digests
 OPTION(mon_mgr_beacon_grace, OPT_INT, 30)  // How long to wait to failover
+OPTION(mon_mgr_report_grace, OPT_INT, 60)  // How old the mgr's pg stat digest may get before health warns
+OPTION(mgr_mon_report_interval, OPT_INT, 5)  // How frequently to send the mon the pg stat digest
 
 OPTION(rgw_list_bucket_min_readahead, OPT_INT, 1000) // minimum number of entries to read from rados for bucket listing
 
@@ -1653,6 +1918,11 @@ OPTION(rgw_torrent_sha_unit, OPT_INT, 512*1024)    // torrent field piece length
 
 OPTION(event_tracing, OPT_BOOL, false) // true if LTTng-UST tracepoints should be enabled
 
+// end-to-end request traces (common/Tracer.h)
+OPTION(trace_sample_rate, OPT_DOUBLE, 0) // fraction of the requests started here that are traced
+OPTION(trace_export_path, OPT_STR, "/var/log/ceph/$cluster-$name.trace") // finished spans, as zipkin v2 json, one per line
+OPTION(trace_export_interval, OPT_DOUBLE, 1) // seconds between writes of finished spans
+
 // This will be set to true when it is safe to start threads.
 // Once it is true, it will never change.
 OPTION(internal_safe_to_start_threads, OPT_BOOL, false)
@@ -0,0 +1,84 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_CONFIG_SNAPSHOT_H
+#define CEPH_CONFIG_SNAPSHOT_H
+
+#include <atomic>
+#include <list>
+#include <memory>
+
+#include "common/config.h"
+#include "common/config_obs.h"
+
+/**
+ * Immutable copy of a set of config values, for hot paths.
+ *
+ * T is a plain struct of typed values, built from the config by
+ * T(const md_config_t*), and names the options it copies in a static,
+ * NULL-terminated T::tracked_keys.  A new T is built under the config
+ * lock whenever one of them changes and published with a single pointer
+ * store, so readers never see a mix of old and new values and take no
+ * lock:
+ *
+ *   const auto *c = snapshot.get();
+ *   if (len > c->max_write_size) ...
+ *
+ * Old versions are kept until the snapshot itself goes away, so a
+ * pointer obtained from get() stays valid for the snapshot's lifetime.
+ * That costs one T per config change, which is fine for the handful of
+ * values a hot path reads and for injectargs-rate changes.
+ */
+template <typename T>
+class ConfigSnapshot : public md_config_obs_t {
+  md_config_t *conf;
+  std::atomic<const T*> current;
+  std::list<std::unique_ptr<const T>> versions;  ///< under conf->lock
+
+  void publish(const md_config_t *c) {
+    versions.emplace_back(new T(c));
+    current.store(versions.back().get(), std::memory_order_release);
+  }
+
+public:
+  explicit ConfigSnapshot(md_config_t *c)
+    : conf(c), current(nullptr) {
+    {
+      Mutex::Locker l(conf->lock);
+      publish(conf);
+    }
+    conf->add_observer(this);
+  }
+  ~ConfigSnapshot() override {
+    conf->remove_observer(this);
+  }
+
+  ConfigSnapshot(const ConfigSnapshot&) = delete;
+  ConfigSnapshot& operator=(const ConfigSnapshot&) = delete;
+
+  const T *get() const {
+    return current.load(std::memory_order_acquire);
+  }
+  const T *operator->() const {
+    return get();
+  }
+
+  const char** get_tracked_conf_keys() const override {
+    return T::tracked_keys;
+  }
+  void handle_conf_change(const md_config_t *c,
+			  const std::set<std::string> &changed) override {
+    publish(c);
+  }
+};
+
+#endif
@@ -157,3 +157,28 @@ bool parse_network(const char *s, struct sockaddr *network, unsigned int *prefix
 
   return false;
 }
+
+
+bool network_contains(const struct sockaddr *network, unsigned int prefix_len,
+		      const struct sockaddr *addr) {
+  if (network->sa_family != addr->sa_family)
+    return false;
+
+  switch (network->sa_family) {
+    case AF_INET: {
+      struct in_addr want, temp;
+      netmask_ipv4(&((struct sockaddr_in*)network)->sin_addr, prefix_len, &want);
+      netmask_ipv4(&((struct sockaddr_in*)addr)->sin_addr, prefix_len, &temp);
+      return temp.s_addr == want.s_addr;
+    }
+
+    case AF_INET6: {
+      struct in6_addr want, temp;
+      netmask_ipv6(&((struct sockaddr_in6*)network)->sin6_addr, prefix_len, &want);
+      netmask_ipv6(&((struct sockaddr_in6*)addr)->sin6_addr, prefix_len, &temp);
+      return IN6_ARE_ADDR_EQUAL(&temp, &want);
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,314 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2004-2006 Sage Weil <sage@newdream.net>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef MCLOCK_QUEUE_H
+#define MCLOCK_QUEUE_H
+
+#include "common/ceph_time.h"
+#include "common/Formatter.h"
+#include "include/assert.h"
+#include "OpQueue.h"
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+#include <map>
+#include <sstream>
+
+/// mClock service parameters of one class of requests
+struct mClockClientInfo {
+  double reservation;  ///< ops/s guaranteed, 0 for none
+  double weight;       ///< share of what is left over
+  double limit;        ///< ops/s cap, 0 for none
+
+  mClockClientInfo(double r = 0, double w = 1, double l = 0)
+    : reservation(r), weight(w), limit(l) {}
+};
+
+/**
+ * mClock scheduler (Gulati et al., OSDI '10) behind the OpQueue
+ * interface.
+ *
+ * Every request of class C gets a reservation, proportional and limit
+ * tag when it is queued.  dequeue() first serves any request whose
+ * reservation tag is due; otherwise the smallest proportional tag
+ * among the classes under their limit.  If every class is at its
+ * limit the smallest proportional tag is served anyway: a worker
+ * asking for an op always gets one, so limits only hold back a class
+ * while others have work.
+ *
+ * The strict queue is served ahead of everything, by priority, as in
+ * the other OpQueues.  Each request costs one; tags are in seconds of
+ * the given clock.
+ */
+template <typename T, typename K, typename C>
+class mClockQueue : public OpQueue <T, K>
+{
+public:
+  typedef std::function<C (const T&)> class_func_t;
+  typedef std::function<mClockClientInfo (const C&)> info_func_t;
+  typedef std::function<double ()> clock_func_t;
+
+  static double mono_now() {
+    return std::chrono::duration<double>(
+      ceph::mono_clock::now().time_since_epoch()).count();
+  }
+
+private:
+  struct Request {
+    K owner;
+    T item;
+    double r_tag, p_tag, l_tag;
+    Request(const K& o, const T& i, double r, double p, double l)
+      : owner(o), item(i), r_tag(r), p_tag(p), l_tag(l) {}
+  };
+
+  struct Client {
+    mClockClientInfo info;
+    std::deque<Request> requests;
+    double prev_r = 0, prev_p = 0, prev_l = 0;
+    /// proportional credit handed back for ops served by reservation;
+    /// p tags are stored raw and compared as p_tag - p_adjust
+    double p_adjust = 0;
+  };
+
+  typedef std::list<std::pair<K, T> > ListPairs;
+
+  std::map<unsigned, ListPairs> strict;
+  std::map<C, Client> clients;
+  unsigned total = 0;
+
+  class_func_t class_func;
+  info_func_t info_func;
+  clock_func_t clock_func;
+
+  static constexpr double max_tag = std::numeric_limits<double>::max();
+
+  Client& _get_client(const C& cl) {
+    auto p = clients.find(cl);
+    if (p == clients.end()) {
+      p = clients.insert(std::make_pair(cl, Client())).first;
+      p->second.info = info_func(cl);
+    } else if (p->second.requests.empty()) {
+      // pick up profile changes whenever a class goes idle
+      p->second.info = info_func(cl);
+    }
+    return p->second;
+  }
+
+  void _tag(Client& c, double now, double *r, double *p, double *l) {
+    const mClockClientInfo& i = c.info;
+    *r = i.reservation > 0 ?
+      std::max(now, c.prev_r + 1.0 / i.reservation) : max_tag;
+    *p = std::max(now + c.p_adjust,
+		  c.prev_p + 1.0 / std::max(i.weight, 1e-9));
+    *l = i.limit > 0 ? std::max(now, c.prev_l + 1.0 / i.limit) : 0;
+  }
+
+  void _enqueue(K cl, T& item, bool front) {
+    C c = class_func(item);
+    Client& client = _get_client(c);
+    double r, p, l;
+    if (front && !client.requests.empty()) {
+      // a requeued op goes ahead of the rest of its class
+      const Request& head = client.requests.front();
+      client.requests.emplace_front(cl, item, head.r_tag, head.p_tag,
+				    head.l_tag);
+    } else {
+      _tag(client, clock_func(), &r, &p, &l);
+      if (!front) {
+	if (r != max_tag)
+	  client.prev_r = r;
+	client.prev_p = p;
+	client.prev_l = l;
+      }
+      if (front)
+	client.requests.emplace_front(cl, item, r, p, l);
+      else
+	client.requests.emplace_back(cl, item, r, p, l);
+    }
+    ++total;
+  }
+
+  template <typename F>
+  static unsigned _filter_list(ListPairs& l, F&& f) {
+    unsigned n = 0;
+    for (auto i = l.begin(); i != l.end(); ) {
+      if (f(*i)) {
+	i = l.erase(i);
+	++n;
+      } else {
+	++i;
+      }
+    }
+    return n;
+  }
+
+public:
+  mClockQueue(class_func_t class_f, info_func_t info_f,
+	      clock_func_t clock_f = &mono_now)
+    : class_func(class_f), info_func(info_f), clock_func(clock_f) {}
+
+  unsigned length() const override final {
+    return total;
+  }
+
+  void remove_by_filter(std::function<bool (T)> f) override final {
+    for (auto p = strict.begin(); p != strict.end(); ) {
+      total -= _filter_list(p->second, [&](std::pair<K, T>& i) {
+	  return f(i.second);
+	});
+      if (p->second.empty())
+	strict.erase(p++);
+      else
+	++p;
+    }
+    for (auto& c : clients) {
+      auto& q = c.second.requests;
+      for (auto i = q.begin(); i != q.end(); ) {
+	if (f(i->item)) {
+	  i = q.erase(i);
+	  --total;
+	} else {
+	  ++i;
+	}
+      }
+    }
+  }
+
+  void remove_by_class(K k, std::list<T> *out) override final {
+    for (auto p = strict.begin(); p != strict.end(); ) {
+      total -= _filter_list(p->second, [&](std::pair<K, T>& i) {
+	  if (!(i.first == k))
+	    return false;
+	  if (out)
+	    out->push_front(i.second);
+	  return true;
+	});
+      if (p->second.empty())
+	strict.erase(p++);
+      else
+	++p;
+    }
+    for (auto& c : clients) {
+      auto& q = c.second.requests;
+      for (auto i = q.begin(); i != q.end(); ) {
+	if (i->owner == k) {
+	  if (out)
+	    out->push_front(i->item);
+	  i = q.erase(i);
+	  --total;
+	} else {
+	  ++i;
+	}
+      }
+    }
+  }
+
+  void enqueue_strict(K cl, unsigned priority, T item) override final {
+    strict[priority].push_back(std::make_pair(cl, item));
+    ++total;
+  }
+
+  void enqueue_strict_front(K cl, unsigned priority, T item) override final {
+    strict[priority].push_front(std::make_pair(cl, item));
+    ++total;
+  }
+
+  void enqueue(K cl, unsigned priority, unsigned cost, T item) override final {
+    _enqueue(cl, item, false);
+  }
+
+  void enqueue_front(K cl, unsigned priority, unsigned cost, T item)
+    override final {
+    _enqueue(cl, item, true);
+  }
+
+  bool empty() const override final {
+    return total == 0;
+  }
+
+  T dequeue() override final {
+    assert(total > 0);
+    if (!strict.empty()) {
+      auto p = strict.rbegin();
+      T ret = p->second.front().second;
+      p->second.pop_front();
+      if (p->second.empty())
+	strict.erase(p->first);
+      --total;
+      return ret;
+    }
+
+    double now = clock_func();
+    Client *by_r = nullptr, *by_p = nullptr, *any = nullptr;
+    for (auto& i : clients) {
+      Client& c = i.second;
+      if (c.requests.empty())
+	continue;
+      const Request& head = c.requests.front();
+      if (head.r_tag <= now &&
+	  (!by_r || head.r_tag < by_r->requests.front().r_tag))
+	by_r = &c;
+      double p = head.p_tag - c.p_adjust;
+      if (head.l_tag <= now &&
+	  (!by_p || p < by_p->requests.front().p_tag - by_p->p_adjust))
+	by_p = &c;
+      if (!any || p < any->requests.front().p_tag - any->p_adjust)
+	any = &c;
+    }
+    assert(any);
+
+    Client *c;
+    if (by_r) {
+      c = by_r;
+      // served out of its reservation; don't charge its share as well
+      c->p_adjust += 1.0 / std::max(c->info.weight, 1e-9);
+    } else {
+      c = by_p ? by_p : any;
+    }
+    T ret = c->requests.front().item;
+    c->requests.pop_front();
+    --total;
+    return ret;
+  }
+
+  void dump(ceph::Formatter *f) const override final {
+    f->dump_int("total", total);
+    f->open_array_section("strict");
+    for (auto& p : strict) {
+      f->open_object_section("priority");
+      f->dump_int("priority", p.first);
+      f->dump_int("size", p.second.size());
+      f->close_section();
+    }
+    f->close_section();
+    f->open_array_section("classes");
+    for (auto& i : clients) {
+      const Client& c = i.second;
+      std::ostringstream ss;
+      ss << i.first;
+      f->open_object_section("class");
+      f->dump_string("class", ss.str());
+      f->dump_float("reservation", c.info.reservation);
+      f->dump_float("weight", c.info.weight);
+      f->dump_float("limit", c.info.limit);
+      f->dump_int("size", c.requests.size());
+      f->close_section();
+    }
+    f->close_section();
+  }
+};
+
+#endif
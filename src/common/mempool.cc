@@ -12,6 +12,8 @@
  *
  */
 
+#include <unistd.h>
+
 #include "include/mempool.h"
 #include "include/demangle.h"
 
@@ -41,12 +43,14 @@ const char *mempool::get_pool_name(mempool::pool_index_t ix) {
 
 void mempool::dump(ceph::Formatter *f, size_t skip)
 {
-  for (size_t i = skip; i < num_pools; ++i) {
+  stats_t total;
+  for (size_t i = 0; i < num_pools - skip; ++i) {
     const pool_t &pool = mempool::get_pool((pool_index_t)i);
     f->open_object_section(get_pool_name((pool_index_t)i));
-    pool.dump(f);
+    pool.dump(f, &total);
     f->close_section();
   }
+  f->dump_object("total", total);
 }
 
 void mempool::set_debug_mode(bool d)
@@ -57,10 +61,19 @@ void mempool::set_debug_mode(bool d)
 // --------------------------------------------------------------
 // pool_t
 
+mempool::pool_t::pool_t()
+{
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t n = 1;
+  while (n < (size_t)cpus && n < num_shards)
+    n <<= 1;
+  shard_mask = n - 1;
+}
+
 size_t mempool::pool_t::allocated_bytes() const
 {
   ssize_t result = 0;
-  for (size_t i = 0; i < num_shards; ++i) {
+  for (size_t i = 0; i <= shard_mask; ++i) {
     result += shard[i].bytes;
   }
   assert(result >= 0);
@@ -70,7 +83,7 @@ size_t mempool::pool_t::allocated_bytes() const
 size_t mempool::pool_t::allocated_items() const
 {
   ssize_t result = 0;
-  for (size_t i = 0; i < num_shards; ++i) {
+  for (size_t i = 0; i <= shard_mask; ++i) {
     result += shard[i].items;
   }
   assert(result >= 0);
@@ -81,7 +94,7 @@ void mempool::pool_t::get_stats(
   stats_t *total,
   std::map<std::string, stats_t> *by_type) const
 {
-  for (size_t i = 0; i < num_shards; ++i) {
+  for (size_t i = 0; i <= shard_mask; ++i) {
     total->items += shard[i].items;
     total->bytes += shard[i].bytes;
   }
@@ -96,11 +109,15 @@ void mempool::pool_t::get_stats(
   }
 }
 
-void mempool::pool_t::dump(ceph::Formatter *f) const
+void mempool::pool_t::dump(ceph::Formatter *f, stats_t *sum) const
 {
   stats_t total;
   std::map<std::string, stats_t> by_type;
   get_stats(&total, &by_type);
+  if (sum) {
+    sum->items += total.items;
+    sum->bytes += total.bytes;
+  }
   f->dump_object("total", total);
   if (!by_type.empty()) {
     for (auto &i : by_type) {
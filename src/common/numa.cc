@@ -0,0 +1,144 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sstream>
+#ifdef HAVE_SCHED
+#include <sched.h>
+#endif
+
+#include "common/numa.h"
+#include "common/ceph_context.h"
+#include "common/config.h"
+#include "common/debug.h"
+#include "common/errno.h"
+
+#define dout_subsys ceph_subsys_
+#undef dout_prefix
+#define dout_prefix *_dout << "numa "
+
+int parse_cpu_set_list(const char *s, std::set<int> *cpus)
+{
+  cpus->clear();
+  while (*s && *s != '\n') {
+    char *end;
+    long a = strtol(s, &end, 10);
+    if (end == s || a < 0)
+      return -EINVAL;
+    long b = a;
+    s = end;
+    if (*s == '-') {
+      ++s;
+      b = strtol(s, &end, 10);
+      if (end == s || b < a)
+	return -EINVAL;
+      s = end;
+    }
+    for (long i = a; i <= b; ++i)
+      cpus->insert(i);
+    if (*s == ',')
+      ++s;
+    else if (*s && *s != '\n')
+      return -EINVAL;
+  }
+  return 0;
+}
+
+std::string cpu_set_to_str_list(const std::set<int>& cpus)
+{
+  std::ostringstream ss;
+  auto p = cpus.begin();
+  while (p != cpus.end()) {
+    int a = *p, b = a;
+    while (++p != cpus.end() && *p == b + 1)
+      ++b;
+    if (ss.tellp() > 0)
+      ss << ",";
+    ss << a;
+    if (b > a)
+      ss << "-" << b;
+  }
+  return ss.str();
+}
+
+static int read_sysfs_line(const std::string& fn, char *buf, size_t len)
+{
+  FILE *f = fopen(fn.c_str(), "r");
+  if (!f)
+    return -errno;
+  int r = 0;
+  if (!fgets(buf, len, f))
+    r = -EINVAL;
+  fclose(f);
+  return r;
+}
+
+int get_numa_node_cpu_set(int node, std::set<int> *cpus)
+{
+  char buf[1024];
+  int r = read_sysfs_line("/sys/devices/system/node/node" +
+			  std::to_string(node) + "/cpulist",
+			  buf, sizeof(buf));
+  if (r < 0)
+    return r;
+  return parse_cpu_set_list(buf, cpus);
+}
+
+int get_iface_numa_node(const std::string& iface, int *node)
+{
+  char buf[32];
+  int r = read_sysfs_line("/sys/class/net/" + iface + "/device/numa_node",
+			  buf, sizeof(buf));
+  if (r < 0)
+    return r;
+  *node = atoi(buf);
+  // -1 means the device is not attached to any one node
+  return *node < 0 ? -ENOENT : 0;
+}
+
+int set_cpu_affinity(const std::set<int>& cpus)
+{
+#ifdef HAVE_SCHED
+  if (cpus.empty())
+    return 0;
+  cpu_set_t cpuset;
+  CPU_ZERO(&cpuset);
+  for (auto c : cpus)
+    if (c >= 0 && c < CPU_SETSIZE)
+      CPU_SET(c, &cpuset);
+  if (sched_setaffinity(0, sizeof(cpuset), &cpuset) < 0)
+    return -errno;
+  /* guaranteed to take effect immediately */
+  sched_yield();
+  return 0;
+#else
+  return -EOPNOTSUPP;
+#endif
+}
+
+int get_numa_affinity(CephContext *cct, std::set<int> *cpus)
+{
+  cpus->clear();
+  int node = cct->_conf->numa_node;
+  if (node < 0 && !cct->_conf->numa_iface.empty()) {
+    int r = get_iface_numa_node(cct->_conf->numa_iface, &node);
+    if (r < 0) {
+      lderr(cct) << "unable to get numa node of " << cct->_conf->numa_iface
+		 << ": " << cpp_strerror(r) << dendl;
+      return r;
+    }
+  }
+  if (node < 0)
+    return 0;
+  int r = get_numa_node_cpu_set(node, cpus);
+  if (r < 0) {
+    lderr(cct) << "unable to get cpus of numa node " << node << ": "
+	       << cpp_strerror(r) << dendl;
+    return r;
+  }
+  ldout(cct, 1) << "node " << node << " cpus "
+		<< cpu_set_to_str_list(*cpus) << dendl;
+  return 0;
+}
@@ -0,0 +1,41 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_COMMON_NUMA_H
+#define CEPH_COMMON_NUMA_H
+
+#include <set>
+#include <string>
+
+class CephContext;
+
+/// parse a kernel-style cpu list ("0-3,8,10-11")
+int parse_cpu_set_list(const char *s, std::set<int> *cpus);
+std::string cpu_set_to_str_list(const std::set<int>& cpus);
+
+/// cpus of a NUMA node, from sysfs
+int get_numa_node_cpu_set(int node, std::set<int> *cpus);
+
+/// NUMA node of a network interface; -ENOENT if it has none
+int get_iface_numa_node(const std::string& iface, int *node);
+
+/// pin the calling thread to cpus
+int set_cpu_affinity(const std::set<int>& cpus);
+
+/**
+ * cpus the network-facing threads (op shards, messenger workers) should
+ * run on: those of numa_node, or of numa_iface's node if numa_node is
+ * -1.  Leaves cpus empty if neither is set or they cannot be resolved.
+ */
+int get_numa_affinity(CephContext *cct, std::set<int> *cpus);
+
+#endif
@@ -27,6 +27,8 @@
 
 #include <stdlib.h>
 #include <time.h>
+#include <algorithm>
+#include <random>
 #include <sstream>
 #include <vector>
 
@@ -82,6 +84,16 @@ ostream& ObjBencher::out(ostream& os)
   return out(os, cur_time);
 }
 
+/// the value below which a fraction p of the samples fall
+static double vec_percentile(std::vector<double> v, double p)
+{
+  if (v.empty())
+    return 0;
+  size_t k = std::min(v.size() - 1, (size_t)(p * v.size()));
+  std::nth_element(v.begin(), v.begin() + k, v.end());
+  return v[k];
+}
+
 void *ObjBencher::status_printer(void *_bencher) {
   ObjBencher *bencher = static_cast<ObjBencher *>(_bencher);
   bench_data& data = bencher->data;
@@ -90,7 +102,13 @@ void *ObjBencher::status_printer(void *_bencher) {
   Cond cond;
   int i = 0;
   int previous_writes = 0;
+  uint64_t previous_bytes = 0;
   int cycleSinceChange = 0;
+  ostream *csv = bencher->csv;
+  int csv_finished = 0;
+  uint64_t csv_bytes = 0;
+  size_t csv_latency_pos = 0;
+  utime_t csv_time = ceph_clock_now();
   double bandwidth;
   int iops;
   utime_t ONE_SECOND;
@@ -118,8 +136,7 @@ void *ObjBencher::status_printer(void *_bencher) {
           << setw(12) << "avg lat(s)" << std::endl;
     }
     if (cycleSinceChange)
-      bandwidth = (double)(data.finished - previous_writes)
-        * (data.op_size)
+      bandwidth = (double)(data.bytes_done() - previous_bytes)
         / (1024*1024)
         / cycleSinceChange;
     else
@@ -152,10 +169,11 @@ void *ObjBencher::status_printer(void *_bencher) {
     if (formatter)
       formatter->open_object_section("data");
 
-    double avg_bandwidth = (double) (data.op_size) * (data.finished)
+    double avg_bandwidth = (double)data.bytes_done()
       / (double)(cur_time - data.start_time) / (1024*1024);
     if (previous_writes != data.finished) {
       previous_writes = data.finished;
+      previous_bytes = data.bytes_done();
       cycleSinceChange = 0;
       if (!formatter) {
         bencher->out(cout, cur_time)
@@ -206,6 +224,31 @@ void *ObjBencher::status_printer(void *_bencher) {
       formatter->close_section(); // data
       formatter->flush(*outstream);
     }
+    if (csv) {
+      if (i == 0)
+        *csv << "time,sec,cur_ops,started,finished,cur_MB/s,cur_iops,"
+             << "lat_p50,lat_p99,lat_p999" << std::endl;
+      // the latencies of the ops that finished since the last line
+      std::vector<double> lat(data.history.latency.begin() + csv_latency_pos,
+                              data.history.latency.end());
+      csv_latency_pos = data.history.latency.size();
+      double secs = cur_time - csv_time;
+      if (secs <= 0)
+        secs = 1;
+      *csv << std::fixed << setprecision(6) << (double)cur_time
+           << ',' << i
+           << ',' << data.in_flight
+           << ',' << data.started
+           << ',' << data.finished
+           << ',' << (data.bytes_done() - csv_bytes) / secs / (1024*1024)
+           << ',' << (data.finished - csv_finished) / secs
+           << ',' << vec_percentile(lat, 0.5)
+           << ',' << vec_percentile(lat, 0.99)
+           << ',' << vec_percentile(lat, 0.999) << std::endl;
+      csv_time = cur_time;
+      csv_finished = data.finished;
+      csv_bytes = data.bytes_done();
+    }
     ++i;
     ++cycleSinceChange;
     cond.WaitInterval(bencher->lock, ONE_SECOND);
@@ -248,6 +291,8 @@ int ObjBencher::aio_bench(
     object_size = prev_object_size;   
     op_size = prev_op_size;           
   }
+  if (operation == OP_MIXED)
+    op_size = object_size;  // whole objects, of varying size
 
   char* contentsChars = new char[op_size];
   lock.Lock();
@@ -262,11 +307,21 @@ int ObjBencher::aio_bench(
   data.max_latency = 0;
   data.avg_latency = 0;
   data.object_contents = contentsChars;
+  data.variable_size = false;
+  data.finished_bytes = 0;
   lock.Unlock();
 
   //fill in contentsChars deterministically so we can check returns
   sanitize_object_contents(&data, data.op_size);
 
+  if (start_at != utime_t()) {
+    utime_t now = ceph_clock_now();
+    if (start_at > now) {
+      out(cout) << "Waiting until " << start_at << " to start" << std::endl;
+      (start_at - now).sleep();
+    }
+  }
+
   if (formatter)
     formatter->open_object_section("bench");
 
@@ -282,8 +337,12 @@ int ObjBencher::aio_bench(
     r = rand_read_bench(secondsToRun, num_objects, concurrentios, prevPid, no_verify);
     if (r != 0) goto out;
   }
+  else if (OP_MIXED == operation) {
+    r = mixed_bench(secondsToRun, concurrentios, run_name_meta, max_objects);
+    if (r != 0) goto out;
+  }
 
-  if (OP_WRITE == operation && cleanup) {
+  if ((OP_WRITE == operation || OP_MIXED == operation) && cleanup) {
     r = fetch_bench_metadata(run_name_meta, &op_size, &object_size,
 			     &num_objects, &prevPid);
     if (r < 0) {
@@ -605,6 +664,7 @@ int ObjBencher::write_bench(int secondsToRun,
     formatter->dump_format("max_latency:", "%f", data.max_latency);
     formatter->dump_format("min_latency", "%f", data.min_latency);
   }
+  dump_latency_percentiles("", data.history.latency);
   //write object size/number data for read benchmarks
   ::encode(data.object_size, b_write);
   num_objects = (data.finished + writes_per_object - 1) / writes_per_object;
@@ -751,6 +811,7 @@ int ObjBencher::seq_read_bench(int seconds_to_run, int num_objects, int concurre
       lock.Unlock();
       goto ERR;
     }
+    data.history.latency.push_back(data.cur_latency);
     total_latency += data.cur_latency;
     if (data.cur_latency > data.max_latency) data.max_latency = data.cur_latency;
     if (data.cur_latency < data.min_latency) data.min_latency = data.cur_latency;
@@ -787,6 +848,7 @@ int ObjBencher::seq_read_bench(int seconds_to_run, int num_objects, int concurre
       goto ERR;
     }
     data.cur_latency = ceph_clock_now() - start_times[slot];
+    data.history.latency.push_back(data.cur_latency);
     total_latency += data.cur_latency;
     if (data.cur_latency > data.max_latency) data.max_latency = data.cur_latency;
     if (data.cur_latency < data.min_latency) data.min_latency = data.cur_latency;
@@ -846,6 +908,7 @@ int ObjBencher::seq_read_bench(int seconds_to_run, int num_objects, int concurre
     formatter->dump_format("max_latency", "%f", data.max_latency);
     formatter->dump_format("min_latency", "%f", data.min_latency);
   }
+  dump_latency_percentiles("", data.history.latency);
 
   completions_done();
 
@@ -967,6 +1030,7 @@ int ObjBencher::rand_read_bench(int seconds_to_run, int num_objects, int concurr
       goto ERR;
     }
 
+    data.history.latency.push_back(data.cur_latency);
     total_latency += data.cur_latency;
     if (data.cur_latency > data.max_latency) data.max_latency = data.cur_latency;
     if (data.cur_latency < data.min_latency) data.min_latency = data.cur_latency;
@@ -1020,6 +1084,7 @@ int ObjBencher::rand_read_bench(int seconds_to_run, int num_objects, int concurr
       goto ERR;
     }
     data.cur_latency = ceph_clock_now() - start_times[slot];
+    data.history.latency.push_back(data.cur_latency);
     total_latency += data.cur_latency;
     if (data.cur_latency > data.max_latency) data.max_latency = data.cur_latency;
     if (data.cur_latency < data.min_latency) data.min_latency = data.cur_latency;
@@ -1079,6 +1144,7 @@ int ObjBencher::rand_read_bench(int seconds_to_run, int num_objects, int concurr
     formatter->dump_format("max_latency", "%f", data.max_latency);
     formatter->dump_format("min_latency", "%f", data.min_latency);
   }
+  dump_latency_percentiles("", data.history.latency);
   completions_done();
 
   return (errors > 0 ? -EIO : 0);
@@ -1091,6 +1157,327 @@ int ObjBencher::rand_read_bench(int seconds_to_run, int num_objects, int concurr
   return r;
 }
 
+void ObjBencher::dump_latency_percentiles(const std::string& what,
+                                          const vector<double>& latency)
+{
+  double p50 = vec_percentile(latency, 0.5);
+  double p99 = vec_percentile(latency, 0.99);
+  double p999 = vec_percentile(latency, 0.999);
+  if (!formatter) {
+    std::string label = what.empty() ? "Latency" : what + " latency";
+    out(cout) << label << " p50(s):    " << p50 << std::endl
+              << label << " p99(s):    " << p99 << std::endl
+              << label << " p99.9(s):  " << p999 << std::endl;
+  } else {
+    std::string prefix = what.empty() ? "" : what + "_";
+    formatter->dump_format((prefix + "latency_p50").c_str(), "%f", p50);
+    formatter->dump_format((prefix + "latency_p99").c_str(), "%f", p99);
+    formatter->dump_format((prefix + "latency_p999").c_str(), "%f", p999);
+  }
+}
+
+/*
+ * Whole-object reads, writes and removes, picked at random in the
+ * proportions given by set_mix(), on objects whose sizes are uniformly
+ * distributed between min_object_size and object_size.  Writes create
+ * new objects until there are max_objects of them, then overwrite
+ * existing ones.
+ *
+ * With a target rate the ops are started on a fixed schedule, and each
+ * op's latency is counted from when it was due, so that a cluster that
+ * falls behind shows it in the latencies rather than in a lower rate
+ * (concurrentios then only bounds the ops in flight).  Without one,
+ * concurrentios ops are kept in flight as in the other benchmarks.
+ */
+int ObjBencher::mixed_bench(int secondsToRun, int concurrentios,
+                            const string& run_name_meta, unsigned max_objects)
+{
+  enum { MIX_READ, MIX_WRITE, MIX_REMOVE };
+  static const char *op_names[] = { "read", "write", "remove" };
+
+  struct slot_op {
+    int type = -1;       // -1 while the slot is free
+    int obj = 0;
+    bool new_obj = false;
+    uint64_t len = 0;
+    utime_t start;
+    bufferlist bl;
+  };
+
+  if (concurrentios <= 0)
+    return -EINVAL;
+  const unsigned mix_total = mix_read + mix_write + mix_remove;
+  if (!mix_write) {
+    cerr << "the mix must include writes" << std::endl;
+    return -EINVAL;
+  }
+  const uint64_t max_size = data.object_size;
+  const uint64_t min_size = min_object_size ?
+    std::min(min_object_size, max_size) : max_size;
+
+  if (!formatter) {
+    out(cout) << "Mixing " << mix_read << ":" << mix_write << ":" << mix_remove
+              << " reads:writes:removes of objects of " << min_size << " to "
+              << max_size << " bytes, ";
+    if (target_iops > 0)
+      cout << "starting " << target_iops << " ops per second (at most "
+           << concurrentios << " in flight)";
+    else
+      cout << "keeping " << concurrentios << " ops in flight";
+    cout << " for up to " << secondsToRun << " seconds" << std::endl;
+  } else {
+    formatter->dump_format("concurrent_ios", "%d", concurrentios);
+    formatter->dump_format("target_iops", "%f", target_iops);
+    formatter->dump_format("mix_read", "%u", mix_read);
+    formatter->dump_format("mix_write", "%u", mix_write);
+    formatter->dump_format("mix_remove", "%u", mix_remove);
+    formatter->dump_format("min_object_size", "%llu", (unsigned long long)min_size);
+    formatter->dump_format("object_size", "%llu", (unsigned long long)max_size);
+    formatter->dump_format("seconds_to_run", "%d", secondsToRun);
+    formatter->dump_format("max_objects", "%u", max_objects);
+  }
+
+  std::string prefix = generate_object_prefix();
+  if (!formatter)
+    out(cout) << "Object prefix: " << prefix << std::endl;
+  else
+    formatter->dump_string("object_prefix", prefix);
+
+  bufferlist contents;
+  snprintf(data.object_contents, data.op_size, "I'm a mixed op!");
+  contents.append(data.object_contents, max_size);
+
+  std::mt19937_64 rng(getpid() ^ ceph_clock_now().to_nsec());
+  std::vector<slot_op> ops(concurrentios);
+  std::vector<int> free_slots;
+  for (int i = concurrentios - 1; i >= 0; --i)
+    free_slots.push_back(i);
+  std::vector<uint64_t> sizes;    // by object number
+  std::vector<int> live;          // objects written and not removed
+  std::map<int, int> reading;     // object -> reads in flight
+  std::vector<double> latency[3];
+  double total_latency = 0;
+  uint64_t late = 0;
+  uint64_t issued = 0;
+  int next_obj = 0;
+  lock_cond lc(&lock);
+  utime_t stop_time, time_passed;
+  int r = completions_init(concurrentios);
+  if (r < 0)
+    return r;
+
+  // account for the op in slot, which is done; called with the lock held
+  auto finish_op = [&](int slot) -> int {
+    slot_op& op = ops[slot];
+    lock.Unlock();
+    completion_wait(slot);
+    lock.Lock();
+    int ret = completion_ret(slot);
+    release_completion(slot);
+    if (ret < 0) {
+      cerr << op_names[op.type] << " of " << generate_object_name(op.obj)
+           << " got " << ret << std::endl;
+      return ret;
+    }
+    data.cur_latency = ceph_clock_now() - op.start;
+    data.history.latency.push_back(data.cur_latency);
+    latency[op.type].push_back(data.cur_latency);
+    total_latency += data.cur_latency;
+    if (data.cur_latency > data.max_latency) data.max_latency = data.cur_latency;
+    if (data.cur_latency < data.min_latency) data.min_latency = data.cur_latency;
+    ++data.finished;
+    data.avg_latency = total_latency / data.finished;
+    --data.in_flight;
+    if (op.type == MIX_READ) {
+      data.finished_bytes += ret;
+      if (--reading[op.obj] == 0)
+        reading.erase(op.obj);
+    } else if (op.type == MIX_WRITE) {
+      data.finished_bytes += op.len;
+      sizes[op.obj] = std::max(sizes[op.obj], op.len);
+      if (op.new_obj)
+        live.push_back(op.obj);
+    }
+    op.type = -1;
+    op.bl.clear();
+    free_slots.push_back(slot);
+    return 0;
+  };
+
+  pthread_t print_thread;
+  pthread_create(&print_thread, NULL, ObjBencher::status_printer, (void *)this);
+  ceph_pthread_setname(print_thread, "mixed_stat");
+
+  lock.Lock();
+  data.variable_size = true;
+  data.finished = 0;
+  data.start_time = ceph_clock_now();
+  stop_time = data.start_time + utime_t(secondsToRun, 0);
+  while (true) {
+    utime_t now = ceph_clock_now();
+    if (secondsToRun && now >= stop_time)
+      break;
+
+    // reap whatever is done
+    bool reaped = false;
+    for (int slot = 0; slot < concurrentios; ++slot) {
+      if (ops[slot].type >= 0 && completion_is_done(slot)) {
+        r = finish_op(slot);
+        if (r < 0)
+          goto ERR;
+        reaped = true;
+      }
+    }
+    if (reaped)
+      continue;
+
+    utime_t due = now;
+    if (target_iops > 0) {
+      due = data.start_time;
+      due += (double)issued / target_iops;
+    }
+    if (free_slots.empty() || due > now) {
+      // for a completion, the next op's turn, or the end of the run
+      utime_t until;
+      if (!free_slots.empty())
+        until = due;
+      if (secondsToRun && (until == utime_t() || until > stop_time))
+        until = stop_time;
+      if (until != utime_t())
+        lc.cond.WaitUntil(lock, until);
+      else
+        lc.cond.Wait(lock);
+      continue;
+    }
+    if (target_iops > 0 && now - due > 1.0 / target_iops)
+      ++late;
+
+    // pick the op
+    int slot = free_slots.back();
+    free_slots.pop_back();
+    slot_op& op = ops[slot];
+    unsigned x = rng() % mix_total;
+    op.type = x < mix_read ? MIX_READ :
+      x < mix_read + mix_write ? MIX_WRITE : MIX_REMOVE;
+    if (op.type != MIX_WRITE && live.empty())
+      op.type = MIX_WRITE;
+    if (op.type == MIX_REMOVE) {
+      size_t i = rng() % live.size();
+      op.obj = live[i];
+      if (reading.count(op.obj)) {
+        op.type = MIX_READ;   // don't pull it out from under a read
+      } else {
+        live[i] = live.back();
+        live.pop_back();
+      }
+    } else if (op.type == MIX_READ) {
+      op.obj = live[rng() % live.size()];
+    }
+    if (op.type == MIX_READ) {
+      ++reading[op.obj];
+      op.len = sizes[op.obj];
+    } else if (op.type == MIX_WRITE) {
+      op.new_obj = !max_objects || (unsigned)next_obj < max_objects ||
+        live.empty();
+      if (op.new_obj) {
+        op.obj = next_obj++;
+        sizes.push_back(0);
+      } else {
+        op.obj = live[rng() % live.size()];
+      }
+      op.len = min_size + rng() % (max_size - min_size + 1);
+    }
+    op.start = due;
+    ++data.started;
+    ++data.in_flight;
+    ++issued;
+    lock.Unlock();
+
+    std::string name = generate_object_name(op.obj);
+    r = create_completion(slot, _aio_cb, (void *)&lc);
+    if (r < 0) {
+      lock.Lock();
+      goto ERR;
+    }
+    if (op.type == MIX_READ) {
+      r = aio_read(name, slot, &op.bl, op.len, 0);
+    } else if (op.type == MIX_WRITE) {
+      op.bl.substr_of(contents, 0, op.len);
+      r = aio_write(name, slot, op.bl, op.len, 0);
+    } else {
+      r = aio_remove(name, slot);
+    }
+    lock.Lock();
+    if (r < 0)
+      goto ERR;
+  }
+
+  // wait for what is still in flight
+  for (int slot = 0; slot < concurrentios; ++slot) {
+    if (ops[slot].type >= 0) {
+      r = finish_op(slot);
+      if (r < 0)
+        goto ERR;
+    }
+  }
+  time_passed = ceph_clock_now() - data.start_time;
+  data.done = true;
+  lock.Unlock();
+  pthread_join(print_thread, NULL);
+
+  {
+    double bandwidth = (double)data.finished_bytes / (double)time_passed /
+      (1024*1024);
+    if (!formatter) {
+      out(cout) << "Total time run:         " << time_passed << std::endl
+         << "Total reads made:       " << latency[MIX_READ].size() << std::endl
+         << "Total writes made:      " << latency[MIX_WRITE].size() << std::endl
+         << "Total removes made:     " << latency[MIX_REMOVE].size() << std::endl
+         << "Ops started late:       " << late << std::endl
+         << "Bandwidth (MB/sec):     " << setprecision(6) << bandwidth << std::endl
+         << "Average IOPS:           " << (int)(data.finished/time_passed) << std::endl
+         << "Average Latency(s):     " << data.avg_latency << std::endl
+         << "Max latency(s):         " << data.max_latency << std::endl
+         << "Min latency(s):         " << data.min_latency << std::endl;
+    } else {
+      formatter->dump_format("total_time_run", "%f", (double)time_passed);
+      formatter->dump_format("total_reads_made", "%d", (int)latency[MIX_READ].size());
+      formatter->dump_format("total_writes_made", "%d", (int)latency[MIX_WRITE].size());
+      formatter->dump_format("total_removes_made", "%d", (int)latency[MIX_REMOVE].size());
+      formatter->dump_format("late_ops", "%llu", (unsigned long long)late);
+      formatter->dump_format("bandwidth", "%f", bandwidth);
+      formatter->dump_format("average_iops", "%d", (int)(data.finished/time_passed));
+      formatter->dump_format("average_latency", "%f", data.avg_latency);
+      formatter->dump_format("max_latency", "%f", data.max_latency);
+      formatter->dump_format("min_latency", "%f", data.min_latency);
+    }
+    dump_latency_percentiles("", data.history.latency);
+    for (int t = MIX_READ; t <= MIX_REMOVE; ++t) {
+      if (!latency[t].empty())
+        dump_latency_percentiles(op_names[t], latency[t]);
+    }
+  }
+
+  {
+    // for cleanup; objects that were removed are skipped there
+    bufferlist b_write;
+    ::encode(data.object_size, b_write);
+    ::encode(next_obj, b_write);
+    ::encode(getpid(), b_write);
+    ::encode(data.op_size, b_write);
+    sync_write(run_name_meta, b_write, sizeof(int)*3);
+  }
+
+  completions_done();
+  return 0;
+
+ ERR:
+  data.done = true;
+  lock.Unlock();
+  pthread_join(print_thread, NULL);
+  return r;
+}
+
 int ObjBencher::clean_up(const std::string& orig_prefix, int concurrentios, const std::string& run_name) {
   int r = 0;
   uint64_t op_size, object_size;
@@ -51,11 +51,18 @@ struct bench_data {
   utime_t cur_latency; //latency of last completed transaction
   utime_t start_time; //start time for benchmark
   char *object_contents; //pointer to the contents written to each object
+  bool variable_size; // ops vary in size, finished_bytes counts what they moved
+  uint64_t finished_bytes;
+
+  uint64_t bytes_done() const {
+    return variable_size ? finished_bytes : (uint64_t)finished * op_size;
+  }
 };
 
 const int OP_WRITE     = 1;
 const int OP_SEQ_READ  = 2;
 const int OP_RAND_READ = 3;
+const int OP_MIXED     = 4;
 
 // Object is composed of <oid,namespace>
 typedef std::pair<std::string, std::string> Object;
@@ -64,6 +71,11 @@ class ObjBencher {
   bool show_time;
   Formatter *formatter = NULL;
   ostream *outstream = NULL;
+  ostream *csv = NULL;
+  double target_iops = 0;
+  unsigned mix_read = 70, mix_write = 30, mix_remove = 0;
+  uint64_t min_object_size = 0;
+  utime_t start_at;
 public:
   CephContext *cct;
 protected:
@@ -79,6 +91,9 @@ protected:
   int write_bench(int secondsToRun, int concurrentios, const string& run_name_meta, unsigned max_objects);
   int seq_read_bench(int secondsToRun, int num_objects, int concurrentios, int writePid, bool no_verify=false);
   int rand_read_bench(int secondsToRun, int num_objects, int concurrentios, int writePid, bool no_verify=false);
+  int mixed_bench(int secondsToRun, int concurrentios, const string& run_name_meta, unsigned max_objects);
+
+  void dump_latency_percentiles(const std::string& what, const vector<double>& latency);
 
   int clean_up(int num_objects, int prevPid, int concurrentios);
   bool more_objects_matching_prefix(const std::string& prefix, std::list<Object>* name);
@@ -123,6 +138,31 @@ public:
   void set_outstream(ostream& os) {
     outstream = &os;
   }
+  /// write a line of comma separated values to os every second
+  void set_csv(ostream& os) {
+    csv = &os;
+  }
+  /// for OP_MIXED: start ops at this rate however long they take
+  /// (open loop) instead of keeping concurrentios in flight
+  void set_target_iops(double iops) {
+    target_iops = iops;
+  }
+  /// for OP_MIXED: relative shares of reads, writes and removes
+  void set_mix(unsigned read, unsigned write, unsigned remove) {
+    mix_read = read;
+    mix_write = write;
+    mix_remove = remove;
+  }
+  /// for OP_MIXED: objects are written with sizes uniformly distributed
+  /// between this and object_size
+  void set_min_object_size(uint64_t size) {
+    min_object_size = size;
+  }
+  /// wait until this time before starting, so that benchmarks run from
+  /// several processes or hosts start together
+  void set_start_at(utime_t t) {
+    start_at = t;
+  }
   int clean_up_slow(const std::string& prefix, int concurrentios);
 };
 
@@ -30,6 +30,7 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <atomic>
 
 class CephContext;
 class PerfCountersBuilder;
@@ -73,6 +74,22 @@ enum perfcounter_type_d : uint8_t
 class PerfCounters
 {
 public:
+  enum {
+    NUM_SHARDS = 16
+  };
+
+  /**
+   * A thread's slice of a sharded counter.  Padded so that the slices
+   * of different threads never share a cacheline, whatever the
+   * alignment of the array they live in.
+   */
+  struct perf_counter_shard_d {
+    std::atomic<uint64_t> u64 = {0};
+    std::atomic<uint64_t> avgcount = {0};
+    std::atomic<uint64_t> avgcount2 = {0};
+    char __padding[128 - sizeof(std::atomic<uint64_t>) * 3];
+  };
+
   /** Represents a PerfCounters data element. */
   struct perf_counter_data_any_d {
     perf_counter_data_any_d()
@@ -89,7 +106,7 @@ public:
         description(other.description),
         nick(other.nick),
 	type(other.type),
-	u64(other.u64.read()) {
+	u64(other.read_u64()) {
       pair<uint64_t,uint64_t> a = other.read_avg();
       u64.set(a.first);
       avgcount.set(a.second);
@@ -107,6 +124,9 @@ public:
     atomic64_t avgcount;
     atomic64_t avgcount2;
     std::unique_ptr<PerfHistogram<>> histogram;
+    /// if set, updates go to the calling thread's shard instead of the
+    /// fields above and reads sum the shards
+    std::unique_ptr<perf_counter_shard_d[]> shards;
 
     void reset()
     {
@@ -114,12 +134,70 @@ public:
 	u64.set(0);
 	avgcount.set(0);
 	avgcount2.set(0);
+	if (shards) {
+	  for (unsigned i = 0; i < NUM_SHARDS; ++i) {
+	    shards[i].u64 = 0;
+	    shards[i].avgcount = 0;
+	    shards[i].avgcount2 = 0;
+	  }
+	}
       }
       if (histogram) {
         histogram->reset();
       }
     }
 
+    static unsigned my_shard() {
+      static std::atomic<unsigned> next_shard(0);
+      static thread_local unsigned shard = next_shard++ % NUM_SHARDS;
+      return shard;
+    }
+
+    /// add v to the counter (and bump the count of an average)
+    void add(uint64_t v) {
+      if (shards) {
+	perf_counter_shard_d& s = shards[my_shard()];
+	if (type & PERFCOUNTER_LONGRUNAVG) {
+	  s.avgcount++;
+	  s.u64 += v;
+	  s.avgcount2++;
+	} else {
+	  s.u64 += v;
+	}
+      } else if (type & PERFCOUNTER_LONGRUNAVG) {
+	avgcount.inc();
+	u64.add(v);
+	avgcount2.inc();
+      } else {
+	u64.add(v);
+      }
+    }
+
+    void sub(uint64_t v) {
+      if (shards)
+	shards[my_shard()].u64 -= v;
+      else
+	u64.sub(v);
+    }
+
+    /// overwrite the value; with shards it all goes to the plain field
+    void set_u64(uint64_t v) {
+      if (shards) {
+	for (unsigned i = 0; i < NUM_SHARDS; ++i)
+	  shards[i].u64 = 0;
+      }
+      u64.set(v);
+    }
+
+    uint64_t read_u64() const {
+      if (!shards)
+	return u64.read();
+      uint64_t sum = u64.read();
+      for (unsigned i = 0; i < NUM_SHARDS; ++i)
+	sum += shards[i].u64;
+      return sum;
+    }
+
     /// read <sum, count> safely
     pair<uint64_t,uint64_t> read_avg() const {
       uint64_t sum, count;
@@ -127,6 +205,18 @@ public:
 	count = avgcount.read();
 	sum = u64.read();
       } while (avgcount2.read() != count);
+      if (shards) {
+	for (unsigned i = 0; i < NUM_SHARDS; ++i) {
+	  const perf_counter_shard_d& s = shards[i];
+	  uint64_t ssum, scount;
+	  do {
+	    scount = s.avgcount;
+	    ssum = s.u64;
+	  } while (s.avgcount2 != scount);
+	  sum += ssum;
+	  count += scount;
+	}
+      }
       return make_pair(sum, count);
     }
   };
@@ -288,6 +378,9 @@ public:
       PerfHistogramCommon::axis_config_d x_axis_config,
       PerfHistogramCommon::axis_config_d y_axis_config,
       const char *description=NULL, const char* nick = NULL);
+  /// spread updates of counter key over per-thread shards; for hot
+  /// counters that many threads bump at once
+  void set_sharded(int key);
   PerfCounters* create_perf_counters();
 private:
   PerfCountersBuilder(const PerfCountersBuilder &rhs);
@@ -127,6 +127,26 @@ public:
     return m_rawData[index].read();
   }
 
+  /// Read value by its index in the raw data, the first axis being the
+  /// most significant; see get_raw_size()
+  uint64_t read_raw(int64_t index) const {
+    assert(index >= 0 && index < get_raw_size());
+    return m_rawData[index].read();
+  }
+
+  /// Get number of all histogram counters
+  int64_t get_raw_size() const {
+    int64_t ret = 1;
+    for (const auto &ac : m_axes_config) {
+      ret *= ac.m_buckets;
+    }
+    return ret;
+  }
+
+  const std::array<axis_config_d, DIM>& get_axes_config() const {
+    return m_axes_config;
+  }
+
   /// Dump data to a Formatter object
   void dump_formatted(ceph::Formatter *f) const {
     // Dump axes configuration
@@ -155,15 +175,6 @@ protected:
                  [f](int) { f->close_section(); });
   }
 
-  /// Get number of all histogram counters
-  int64_t get_raw_size() {
-    int64_t ret = 1;
-    for (const auto &ac : m_axes_config) {
-      ret *= ac.m_buckets;
-    }
-    return ret;
-  }
-
   /// Calculate m_rawData index from axis values
   template <typename... T>
   int64_t get_raw_index_for_value(T... axes) const {
@@ -0,0 +1,79 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_COMMON_SHARDED_SHARED_MUTEX_H
+#define CEPH_COMMON_SHARDED_SHARED_MUTEX_H
+
+#include <atomic>
+#include <boost/thread/shared_mutex.hpp>
+
+namespace ceph {
+
+// A shared mutex for data that is read on every operation by many
+// threads at once and written rarely, like the Objecter's osdmap.
+//
+// Every shared acquisition of a boost::shared_mutex, however brief,
+// goes through the same internal mutex, so with enough threads taking
+// it shared the mutex's cache line becomes the bottleneck.  Here each
+// thread takes only its own shard shared, and exclusive ownership
+// takes all of them, so readers on different threads touch nothing in
+// common.
+//
+// A thread's shard is fixed for its lifetime, so shared ownership must
+// be released by the thread that acquired it.  It is Lockable and
+// SharedLockable, and works with std::unique_lock, boost::shared_lock
+// and ceph::shunique_lock.
+
+class sharded_shared_mutex {
+  static constexpr unsigned SHARDS = 16;
+
+  struct shard {
+    boost::shared_mutex m;
+    char pad[64];  // keep neighbouring shards off each other's cache lines
+  };
+  shard shards[SHARDS];
+
+  static unsigned my_shard() {
+    static std::atomic<unsigned> next(0);
+    static thread_local unsigned s = next++ % SHARDS;
+    return s;
+  }
+
+public:
+  sharded_shared_mutex() = default;
+  sharded_shared_mutex(const sharded_shared_mutex&) = delete;
+  sharded_shared_mutex& operator=(const sharded_shared_mutex&) = delete;
+
+  void lock() {
+    for (auto& s : shards)
+      s.m.lock();
+  }
+  bool try_lock() {
+    for (unsigned i = 0; i < SHARDS; ++i) {
+      if (!shards[i].m.try_lock()) {
+	while (i-- > 0)
+	  shards[i].m.unlock();
+	return false;
+      }
+    }
+    return true;
+  }
+  void unlock() {
+    for (unsigned i = SHARDS; i-- > 0; )
+      shards[i].m.unlock();
+  }
+
+  void lock_shared() {
+    shards[my_shard()].m.lock_shared();
+  }
+  bool try_lock_shared() {
+    return shards[my_shard()].m.try_lock_shared();
+  }
+  void unlock_shared() {
+    shards[my_shard()].m.unlock_shared();
+  }
+};
+
+} // namespace ceph
+
+#endif // CEPH_COMMON_SHARDED_SHARED_MUTEX_H
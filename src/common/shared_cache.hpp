@@ -15,57 +15,131 @@
 #ifndef CEPH_SHAREDCACHE_H
 #define CEPH_SHAREDCACHE_H
 
+#include <functional>
 #include <map>
 #include <list>
 #include <memory>
 #include <utility>
 #include "common/Mutex.h"
 #include "common/Cond.h"
+#include "common/Formatter.h"
+#include "common/perf_counters.h"
 #include "include/unordered_map.h"
 
+/**
+ * LRU of strong refs in front of a map of weak refs, so a value stays
+ * findable for as long as anybody holds it.
+ *
+ * Entries are counted as 1 each unless a cost function is set, in which
+ * case max_size is in whatever units it returns (e.g. bytes); costs are
+ * refreshed whenever an entry is touched.  With a probation ratio set,
+ * the LRU is segmented: new entries start on a probation list that
+ * gets at most that share of max_size, and only move to the main list
+ * when touched again, so a scan can't push out the hot set.
+ */
 template <class K, class V, class C = std::less<K>, class H = std::hash<K> >
 class SharedLRU {
   CephContext *cct;
   typedef ceph::shared_ptr<V> VPtr;
   typedef ceph::weak_ptr<V> WeakVPtr;
+  typedef list<pair<K, VPtr> > lru_list_t;
   Mutex lock;
   size_t max_size;
   Cond cond;
-  unsigned size;
+  size_t size;
 public:
   int waiting;
+  typedef std::function<size_t (const V&)> cost_func_t;
 private:
-  ceph::unordered_map<K, typename list<pair<K, VPtr> >::iterator, H> contents;
-  list<pair<K, VPtr> > lru;
+  struct lru_pos_t {
+    typename lru_list_t::iterator pos;
+    size_t cost;
+    bool probation;
+  };
+  ceph::unordered_map<K, lru_pos_t, H> contents;
+  lru_list_t lru;        ///< entries touched more than once (or all)
+  lru_list_t probation;  ///< entries touched once, if segmented
+  size_t probation_size;
+  double probation_ratio;
+  cost_func_t cost_func;
+
+  uint64_t hits, misses, evictions;
+  PerfCounters *logger;
+  int l_hit, l_miss, l_evict;
 
   map<K, pair<WeakVPtr, V*>, C> weak_refs;
 
+  void _hit() {
+    ++hits;
+    if (logger)
+      logger->inc(l_hit);
+  }
+  void _miss() {
+    ++misses;
+    if (logger)
+      logger->inc(l_miss);
+  }
+
   void trim_cache(list<VPtr> *to_release) {
     while (size > max_size) {
-      to_release->push_back(lru.back().second);
-      lru_remove(lru.back().first);
+      lru_list_t *l = &lru;
+      if (!probation.empty() &&
+	  (lru.empty() || probation_size > max_size * probation_ratio))
+	l = &probation;
+      to_release->push_back(l->back().second);
+      lru_remove(l->back().first);
+      ++evictions;
+      if (logger)
+	logger->inc(l_evict);
     }
   }
 
   void lru_remove(const K& key) {
-    typename ceph::unordered_map<K, typename list<pair<K, VPtr> >::iterator, H>::iterator i = 
+    typename ceph::unordered_map<K, lru_pos_t, H>::iterator i =
       contents.find(key);
     if (i == contents.end())
       return;
-    lru.erase(i->second);
-    --size;
+    if (i->second.probation) {
+      probation.erase(i->second.pos);
+      probation_size -= i->second.cost;
+    } else {
+      lru.erase(i->second.pos);
+    }
+    size -= i->second.cost;
     contents.erase(i);
   }
 
   void lru_add(const K& key, const VPtr& val, list<VPtr> *to_release) {
-    typename ceph::unordered_map<K, typename list<pair<K, VPtr> >::iterator, H>::iterator i =
+    size_t cost = cost_func ? cost_func(*val) : 1;
+    typename ceph::unordered_map<K, lru_pos_t, H>::iterator i =
       contents.find(key);
     if (i != contents.end()) {
-      lru.splice(lru.begin(), lru, i->second);
+      size += cost - i->second.cost;
+      if (i->second.probation) {
+	// second touch: promote
+	probation_size -= i->second.cost;
+	lru.splice(lru.begin(), probation, i->second.pos);
+	i->second.probation = false;
+      } else {
+	lru.splice(lru.begin(), lru, i->second.pos);
+      }
+      i->second.cost = cost;
+      if (cost_func)
+	trim_cache(to_release);
     } else {
-      ++size;
-      lru.push_front(make_pair(key, val));
-      contents[key] = lru.begin();
+      size += cost;
+      lru_pos_t p;
+      p.cost = cost;
+      p.probation = probation_ratio > 0;
+      if (p.probation) {
+	probation.push_front(make_pair(key, val));
+	probation_size += cost;
+	p.pos = probation.begin();
+      } else {
+	lru.push_front(make_pair(key, val));
+	p.pos = lru.begin();
+      }
+      contents[key] = p;
       trim_cache(to_release);
     }
   }
@@ -93,13 +167,16 @@ private:
 public:
   SharedLRU(CephContext *cct = NULL, size_t max_size = 20)
     : cct(cct), lock("SharedLRU::lock"), max_size(max_size), 
-      size(0), waiting(0) {
+      size(0), waiting(0), probation_size(0), probation_ratio(0),
+      hits(0), misses(0), evictions(0),
+      logger(NULL), l_hit(0), l_miss(0), l_evict(0) {
     contents.rehash(max_size); 
   }
   
   ~SharedLRU() {
     contents.clear();
     lru.clear();
+    probation.clear();
     if (!weak_refs.empty()) {
       lderr(cct) << "leaked refs:\n";
       dump_weak_refs(*_dout);
@@ -130,6 +207,41 @@ public:
     cct = c;
   }
 
+  /// size entries by f instead of counting them; call before first use
+  void set_cost_func(cost_func_t f) {
+    Mutex::Locker l(lock);
+    assert(contents.empty());
+    cost_func = f;
+  }
+
+  /// segment the LRU, giving new entries at most ratio of max_size
+  void set_probation_ratio(double ratio) {
+    Mutex::Locker l(lock);
+    assert(contents.empty());
+    probation_ratio = ratio;
+  }
+
+  /// also count hits, misses and evictions in these perf counters
+  void set_perf_counters(PerfCounters *l, int hit, int miss, int evict) {
+    Mutex::Locker locker(lock);
+    logger = l;
+    l_hit = hit;
+    l_miss = miss;
+    l_evict = evict;
+  }
+
+  void dump_stats(Formatter *f) {
+    Mutex::Locker l(lock);
+    f->dump_unsigned("hits", hits);
+    f->dump_unsigned("misses", misses);
+    f->dump_unsigned("evictions", evictions);
+    f->dump_unsigned("size", size);
+    f->dump_unsigned("max_size", max_size);
+    f->dump_unsigned("cached", contents.size());
+    f->dump_unsigned("probation", probation_size);
+    f->dump_unsigned("alive", weak_refs.size());
+  }
+
   void dump_weak_refs() {
     lderr(cct) << "leaked refs:\n";
     dump_weak_refs(*_dout);
@@ -152,11 +264,12 @@ public:
     while (true) {
       VPtr val; // release any ref we have after we drop the lock
       Mutex::Locker l(lock);
-      if (size == 0)
+      if (contents.empty())
         break;
 
-      val = lru.back().second;
-      lru_remove(lru.back().first);
+      lru_list_t& from = lru.empty() ? probation : lru;
+      val = from.back().second;
+      lru_remove(from.back().first);
     }
   }
 
@@ -282,6 +395,10 @@ public:
 	  cond.Wait(lock);
       } while (retry);
       --waiting;
+      if (val)
+	_hit();
+      else
+	_miss();
     }
     return val;
   }
@@ -298,6 +415,7 @@ public:
 	  val = i->second.first.lock();
 	  if (val) {
 	    lru_add(key, val, &to_release);
+	    _hit();
 	    return val;
 	  } else {
 	    retry = true;
@@ -307,6 +425,7 @@ public:
 	  cond.Wait(lock);
       } while (retry);
 
+      _miss();
       V *new_value = new V();
       VPtr new_val(new_value, Cleanup(this, key));
       weak_refs.insert(make_pair(key, make_pair(new_val, new_value)));
@@ -16,6 +16,7 @@
 #include "Compressor.h"
 #include "CompressionPlugin.h"
 #include "common/dout.h"
+#include "include/encoding.h"
 
 const char * Compressor::get_comp_alg_name(int a) {
   switch (a) {
@@ -23,6 +24,7 @@ const char * Compressor::get_comp_alg_name(int a) {
   case COMP_ALG_SNAPPY: return "snappy";
   case COMP_ALG_ZLIB: return "zlib";
   case COMP_ALG_ZSTD: return "zstd";
+  case COMP_ALG_LZ4: return "lz4";
   default: return "???";
   }
 }
@@ -34,6 +36,8 @@ boost::optional<Compressor::CompressionAlgorithm> Compressor::get_comp_alg_type(
     return COMP_ALG_ZLIB;
   if (s == "zstd")
     return COMP_ALG_ZSTD;
+  if (s == "lz4")
+    return COMP_ALG_LZ4;
   if (s == "")
     return COMP_ALG_NONE;
 
@@ -61,6 +65,30 @@ boost::optional<Compressor::CompressionMode> Compressor::get_comp_mode_type(cons
   return boost::optional<CompressionMode>();
 }
 
+int Compressor::decode_dictionaries(const std::string &s,
+				    std::map<uint32_t, bufferlist> *dicts)
+{
+  bufferlist in, bl;
+  in.append(s);
+  try {
+    bl.decode_base64(in);
+    bufferlist::iterator p = bl.begin();
+    ::decode(*dicts, p);
+  } catch (buffer::error& e) {
+    return -EINVAL;
+  }
+  return 0;
+}
+
+std::string Compressor::encode_dictionaries(
+  const std::map<uint32_t, bufferlist> &dicts)
+{
+  bufferlist bl, out;
+  ::encode(dicts, bl);
+  bl.encode_base64(out);
+  return out.to_str();
+}
+
 CompressorRef Compressor::create(CephContext *cct, const std::string &type)
 {
   // support "random" for teuthology testing
@@ -15,7 +15,9 @@
 #ifndef CEPH_COMPRESSOR_H
 #define CEPH_COMPRESSOR_H
 
+#include <map>
 #include <string>
+#include <vector>
 #include <boost/optional.hpp>
 #include "include/memory.h"
 #include "include/buffer.h"
@@ -30,6 +32,7 @@ public:
     COMP_ALG_SNAPPY = 1,
     COMP_ALG_ZLIB = 2,
     COMP_ALG_ZSTD = 3,
+    COMP_ALG_LZ4 = 4,
     COMP_ALG_LAST	//the last value for range checks
   };
   // compression options
@@ -61,6 +64,45 @@ public:
   // alignment with decode methods
   virtual int decompress(bufferlist::iterator &p, size_t compressed_len, bufferlist &out) = 0;
 
+  /**
+   * A dictionary trained on samples of the data to be compressed.
+   *
+   * Small inputs with a common structure (JSON documents, filesystem
+   * metadata) compress poorly on their own, but well against a dictionary
+   * of what they have in common.  Whoever stores the compressed data keeps
+   * the id with it and must hand back the same dictionary to decompress.
+   */
+  struct Dictionary {
+    uint32_t id;
+    explicit Dictionary(uint32_t i) : id(i) {}
+    virtual ~Dictionary() {}
+  };
+  typedef std::shared_ptr<Dictionary> DictionaryRef;
+
+  /// prepare a dictionary for use; null if the algorithm has no dictionaries
+  virtual DictionaryRef create_dictionary(uint32_t id, const bufferlist &data) {
+    return DictionaryRef();
+  }
+  virtual int compress(const bufferlist &in, bufferlist &out,
+		       const Dictionary &dict) {
+    return -EOPNOTSUPP;
+  }
+  virtual int decompress(bufferlist::iterator &p, size_t compressed_len,
+			 bufferlist &out, const Dictionary &dict) {
+    return -EOPNOTSUPP;
+  }
+  /// build a dictionary of at most max_len bytes from samples of the data
+  virtual int train_dictionary(const std::vector<bufferlist> &samples,
+			       size_t max_len, bufferlist *dict) {
+    return -EOPNOTSUPP;
+  }
+
+  /// the compression_dictionaries pool option: dictionaries by id, base64
+  static int decode_dictionaries(const std::string &s,
+				 std::map<uint32_t, bufferlist> *dicts);
+  static std::string encode_dictionaries(
+    const std::map<uint32_t, bufferlist> &dicts);
+
   static CompressorRef create(CephContext *cct, const std::string &type);
   static CompressorRef create(CephContext *cct, int alg);
 
@@ -0,0 +1,119 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_LZ4COMPRESSOR_H
+#define CEPH_LZ4COMPRESSOR_H
+
+#include <lz4.h>
+
+#include <utility>
+#include <vector>
+
+#include "include/buffer.h"
+#include "include/encoding.h"
+#include "compressor/Compressor.h"
+
+/*
+ * Each buffer of the source is compressed as one block of a single lz4
+ * stream, so the source isn't copied to make it contiguous.  The output
+ * is prefixed with the number of blocks and the original and compressed
+ * length of each.
+ */
+class LZ4Compressor : public Compressor {
+ public:
+  LZ4Compressor() : Compressor(COMP_ALG_LZ4, "lz4") {}
+
+  int compress(const bufferlist &src, bufferlist &dst) override {
+    size_t bound = 0;
+    for (const auto& b : src.buffers()) {
+      bound += LZ4_compressBound(b.length());
+    }
+    bufferptr outptr = buffer::create_page_aligned(bound);
+    LZ4_stream_t lz4_stream;
+    LZ4_resetStream(&lz4_stream);
+
+    bufferlist header;
+    uint32_t count = 0;
+    size_t pos = 0;
+    for (const auto& b : src.buffers()) {
+      if (b.length() == 0) {
+        continue;
+      }
+      int compressed_len = LZ4_compress_fast_continue(
+        &lz4_stream, b.c_str(), outptr.c_str() + pos, b.length(),
+        outptr.length() - pos, 1);
+      if (compressed_len <= 0) {
+        return -1;
+      }
+      ::encode((uint32_t)b.length(), header);
+      ::encode((uint32_t)compressed_len, header);
+      pos += compressed_len;
+      ++count;
+    }
+    ::encode(count, dst);
+    dst.claim_append(header);
+    dst.append(outptr, 0, pos);
+    return 0;
+  }
+
+  int decompress(const bufferlist &src, bufferlist &dst) override {
+    bufferlist::iterator i = const_cast<bufferlist&>(src).begin();
+    return decompress(i, src.length(), dst);
+  }
+
+  int decompress(bufferlist::iterator &p,
+		 size_t compressed_len,
+		 bufferlist &dst) override {
+    uint32_t count;
+    std::vector<std::pair<uint32_t, uint32_t> > blocks;
+    size_t total_origin = 0, total_compressed = 0;
+    try {
+      ::decode(count, p);
+      blocks.resize(count);
+      for (auto& b : blocks) {
+        ::decode(b.first, p);
+        ::decode(b.second, p);
+        total_origin += b.first;
+        total_compressed += b.second;
+      }
+    } catch (buffer::error& e) {
+      return -1;
+    }
+    size_t header_len = sizeof(uint32_t) * (1 + 2 * count);
+    if (header_len + total_compressed > compressed_len) {
+      return -1;
+    }
+
+    /* the blocks reference the ones before them, so they are decompressed
+     * into one contiguous buffer */
+    bufferlist in_bl;
+    p.copy(total_compressed, in_bl);
+    const char *in = in_bl.c_str();
+    bufferptr dstptr(total_origin);
+    char *out = dstptr.c_str();
+    LZ4_streamDecode_t lz4_stream_decode;
+    LZ4_setStreamDecode(&lz4_stream_decode, nullptr, 0);
+    for (const auto& b : blocks) {
+      int r = LZ4_decompress_safe_continue(&lz4_stream_decode, in, out,
+                                           b.second, b.first);
+      if (r < 0 || (uint32_t)r != b.first) {
+        return -1;
+      }
+      in += b.second;
+      out += b.first;
+    }
+    dst.push_back(std::move(dstptr));
+    return 0;
+  }
+};
+
+#endif
@@ -15,7 +15,9 @@
 #ifndef CEPH_ZSTDCOMPRESSOR_H
 #define CEPH_ZSTDCOMPRESSOR_H
 
+#define ZSTD_STATIC_LINKING_ONLY
 #include "zstd/lib/zstd.h"
+#include "zstd/lib/dictBuilder/zdict.h"
 #include "include/buffer.h"
 #include "include/encoding.h"
 #include "compressor/Compressor.h"
@@ -23,10 +25,20 @@
 #define COMPRESSION_LEVEL 5
 
 class ZstdCompressor : public Compressor {
- public:
-  ZstdCompressor() : Compressor(COMP_ALG_ZSTD, "zstd") {}
+  struct ZstdDictionary : public Dictionary {
+    ZSTD_CDict *cdict;
+    ZSTD_DDict *ddict;
+    ZstdDictionary(uint32_t id, bufferlist data) : Dictionary(id) {
+      cdict = ZSTD_createCDict(data.c_str(), data.length(), COMPRESSION_LEVEL);
+      ddict = ZSTD_createDDict(data.c_str(), data.length());
+    }
+    ~ZstdDictionary() override {
+      ZSTD_freeCDict(cdict);
+      ZSTD_freeDDict(ddict);
+    }
+  };
 
-  int compress(const bufferlist &src, bufferlist &dst) override {
+  int _compress(ZSTD_CStream *s, const bufferlist &src, bufferlist &dst) {
     bufferptr outptr = buffer::create_page_aligned(
       ZSTD_compressBound(src.length()));
     ZSTD_outBuffer_s outbuf;
@@ -34,8 +46,6 @@ class ZstdCompressor : public Compressor {
     outbuf.size = outptr.length();
     outbuf.pos = 0;
 
-    ZSTD_CStream *s = ZSTD_createCStream();
-    ZSTD_initCStream(s, COMPRESSION_LEVEL);
     auto p = src.begin();
     size_t left = src.length();
     while (left) {
@@ -57,18 +67,8 @@ class ZstdCompressor : public Compressor {
     return 0;
   }
 
-  int decompress(const bufferlist &src, bufferlist &dst) override {
-    bufferlist::iterator i = const_cast<bufferlist&>(src).begin();
-    return decompress(i, src.length(), dst);
-  }
-
-  int decompress(bufferlist::iterator &p,
-		 size_t compressed_len,
-		 bufferlist &dst) override {
-    if (compressed_len < 4) {
-      return -1;
-    }
-    compressed_len -= 4;
+  int _decompress(ZSTD_DStream *s, bufferlist::iterator &p,
+		  size_t compressed_len, bufferlist &dst) {
     uint32_t dst_len;
     ::decode(dst_len, p);
 
@@ -77,16 +77,19 @@ class ZstdCompressor : public Compressor {
     outbuf.dst = dstptr.c_str();
     outbuf.size = dstptr.length();
     outbuf.pos = 0;
-    ZSTD_DStream *s = ZSTD_createDStream();
-    ZSTD_initDStream(s);
     while (compressed_len > 0) {
       if (p.end()) {
+	ZSTD_freeDStream(s);
 	return -1;
       }
       ZSTD_inBuffer_s inbuf;
       inbuf.pos = 0;
       inbuf.size = p.get_ptr_and_advance(compressed_len, (const char**)&inbuf.src);
-      ZSTD_decompressStream(s, &outbuf, &inbuf);
+      size_t r = ZSTD_decompressStream(s, &outbuf, &inbuf);
+      if (ZSTD_isError(r)) {
+	ZSTD_freeDStream(s);
+	return -1;
+      }
       compressed_len -= inbuf.size;
     }
     ZSTD_freeDStream(s);
@@ -94,6 +97,80 @@ class ZstdCompressor : public Compressor {
     dst.append(dstptr, 0, outbuf.pos);
     return 0;
   }
+
+ public:
+  ZstdCompressor() : Compressor(COMP_ALG_ZSTD, "zstd") {}
+
+  int compress(const bufferlist &src, bufferlist &dst) override {
+    ZSTD_CStream *s = ZSTD_createCStream();
+    ZSTD_initCStream(s, COMPRESSION_LEVEL);
+    return _compress(s, src, dst);
+  }
+
+  int decompress(const bufferlist &src, bufferlist &dst) override {
+    bufferlist::iterator i = const_cast<bufferlist&>(src).begin();
+    return decompress(i, src.length(), dst);
+  }
+
+  int decompress(bufferlist::iterator &p,
+		 size_t compressed_len,
+		 bufferlist &dst) override {
+    if (compressed_len < 4) {
+      return -1;
+    }
+    ZSTD_DStream *s = ZSTD_createDStream();
+    ZSTD_initDStream(s);
+    return _decompress(s, p, compressed_len - 4, dst);
+  }
+
+  DictionaryRef create_dictionary(uint32_t id,
+				  const bufferlist &data) override {
+    auto d = std::make_shared<ZstdDictionary>(id, data);
+    if (!d->cdict || !d->ddict) {
+      return DictionaryRef();
+    }
+    return d;
+  }
+
+  int compress(const bufferlist &src, bufferlist &dst,
+	       const Dictionary &dict) override {
+    auto& d = static_cast<const ZstdDictionary&>(dict);
+    ZSTD_CStream *s = ZSTD_createCStream();
+    ZSTD_initCStream_usingCDict(s, d.cdict);
+    return _compress(s, src, dst);
+  }
+
+  int decompress(bufferlist::iterator &p, size_t compressed_len,
+		 bufferlist &dst, const Dictionary &dict) override {
+    if (compressed_len < 4) {
+      return -1;
+    }
+    auto& d = static_cast<const ZstdDictionary&>(dict);
+    ZSTD_DStream *s = ZSTD_createDStream();
+    ZSTD_initDStream_usingDDict(s, d.ddict);
+    return _decompress(s, p, compressed_len - 4, dst);
+  }
+
+  int train_dictionary(const std::vector<bufferlist> &samples,
+		       size_t max_len, bufferlist *dict) override {
+    bufferlist all;
+    std::vector<size_t> sizes;
+    for (auto& s : samples) {
+      all.append(s);
+      sizes.push_back(s.length());
+    }
+    if (sizes.empty()) {
+      return -EINVAL;
+    }
+    bufferptr bp(max_len);
+    size_t r = ZDICT_trainFromBuffer(bp.c_str(), max_len, all.c_str(),
+				     sizes.data(), sizes.size());
+    if (ZDICT_isError(r)) {
+      return -EINVAL;
+    }
+    dict->append(bp, 0, r);
+    return 0;
+  }
 };
 
 #endif
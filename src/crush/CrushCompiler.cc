@@ -61,6 +61,14 @@ static void print_fixedpoint(ostream& out, int i)
   out << s;
 }
 
+// enough digits for a weight to survive a recompile unchanged
+static void print_exact_fixedpoint(ostream& out, __u32 i)
+{
+  char s[20];
+  snprintf(s, sizeof(s), "%.5f", (double)i / (double)0x10000);
+  out << s;
+}
+
 int CrushCompiler::decompile_bucket_impl(int i, ostream &out)
 {
   int type = crush.get_bucket_type(i);
@@ -181,6 +189,41 @@ int CrushCompiler::decompile_bucket(int cur,
   return 0;
 }
 
+int CrushCompiler::decompile_choose_args(
+  int64_t id, const crush_choose_arg_map& arg_map, ostream &out)
+{
+  out << "choose_args " << id << " {\n";
+  for (__u32 i = 0; i < arg_map.size; i++) {
+    const crush_choose_arg *arg = &arg_map.args[i];
+    if (!arg->weight_set_size && !arg->ids_size)
+      continue;
+    out << "  {\n";
+    out << "    bucket_id " << (-1 - (int)i) << "\n";
+    if (arg->weight_set_size) {
+      out << "    weight_set [\n";
+      for (__u32 j = 0; j < arg->weight_set_size; j++) {
+	const crush_weight_set *ws = &arg->weight_set[j];
+	out << "      [ ";
+	for (__u32 k = 0; k < ws->size; k++) {
+	  print_exact_fixedpoint(out, ws->weights[k]);
+	  out << " ";
+	}
+	out << "]\n";
+      }
+      out << "    ]\n";
+    }
+    if (arg->ids_size) {
+      out << "    ids [ ";
+      for (__u32 j = 0; j < arg->ids_size; j++)
+	out << arg->ids[j] << " ";
+      out << "]\n";
+    }
+    out << "  }\n";
+  }
+  out << "}\n";
+  return 0;
+}
+
 int CrushCompiler::decompile(ostream &out)
 {
   out << "# begin crush map\n";
@@ -324,6 +367,14 @@ int CrushCompiler::decompile(ostream &out)
     }
     out << "}\n";
   }
+  if (crush.has_choose_args()) {
+    out << "\n# choose_args\n";
+    for (auto& c : crush.choose_args) {
+      int ret = decompile_choose_args(c.first, c.second, out);
+      if (ret)
+	return ret;
+    }
+  }
   out << "\n# end crush map" << std::endl;
   return 0;
 }
@@ -727,6 +778,125 @@ int CrushCompiler::parse_rule(iter_t const& i)
   return 0;
 }
 
+int CrushCompiler::parse_weight_set_weights(iter_t const& i, int bucket_id,
+					    crush_weight_set *weight_set)
+{
+  // -2 for the enclosing [ ]
+  __u32 size = i->children.size() - 2;
+  __u32 bucket_size = crush.get_bucket_size(bucket_id);
+  if (size != bucket_size) {
+    err << bucket_id << " needs exactly " << bucket_size
+	<< " weights but got " << size << std::endl;
+    return -1;
+  }
+  weight_set->size = size;
+  weight_set->weights = (__u32 *)calloc(weight_set->size, sizeof(__u32));
+  __u32 pos = 0;
+  for (iter_t p = i->children.begin() + 1; pos < size; p++, pos++)
+    weight_set->weights[pos] =
+      (__u32)(strtod(string_node(*p).c_str(), 0) * (double)0x10000 + 0.5);
+  return 0;
+}
+
+int CrushCompiler::parse_weight_set(iter_t const& i, int bucket_id,
+				    crush_choose_arg *arg)
+{
+  // -3 stands for the leading "weight_set" keyword and the enclosing [ ]
+  arg->weight_set_size = i->children.size() - 3;
+  arg->weight_set = (crush_weight_set *)calloc(arg->weight_set_size,
+					       sizeof(crush_weight_set));
+  __u32 pos = 0;
+  for (iter_t p = i->children.begin(); p != i->children.end(); p++) {
+    int r = 0;
+    switch((int)p->value.id().to_long()) {
+    case crush_grammar::_choose_arg_weight_set_weights:
+      if (pos < arg->weight_set_size) {
+	r = parse_weight_set_weights(p, bucket_id, &arg->weight_set[pos]);
+	pos++;
+      } else {
+	err << "invalid weight_set syntax" << std::endl;
+	r = -1;
+      }
+    }
+    if (r < 0)
+      return r;
+  }
+  return 0;
+}
+
+int CrushCompiler::parse_choose_arg_ids(iter_t const& i, int bucket_id,
+					crush_choose_arg *arg)
+{
+  // -3 for the leading "ids" keyword and the enclosing [ ]
+  __u32 size = i->children.size() - 3;
+  __u32 bucket_size = crush.get_bucket_size(bucket_id);
+  if (size != bucket_size) {
+    err << bucket_id << " needs exactly " << bucket_size
+	<< " ids but got " << size << std::endl;
+    return -1;
+  }
+  arg->ids_size = size;
+  arg->ids = (__s32 *)calloc(arg->ids_size, sizeof(__s32));
+  __u32 pos = 0;
+  for (iter_t p = i->children.begin() + 2; pos < size; p++, pos++)
+    arg->ids[pos] = int_node(*p);
+  return 0;
+}
+
+int CrushCompiler::parse_choose_arg(iter_t const& i,
+				    crush_choose_arg_map *arg_map)
+{
+  int bucket_id = int_node(i->children[1].children[1]);
+  if (-1 - bucket_id < 0 || (__u32)(-1 - bucket_id) >= arg_map->size ||
+      !crush.bucket_exists(bucket_id)) {
+    err << bucket_id << " is out of range" << std::endl;
+    return -1;
+  }
+  crush_choose_arg *arg = &arg_map->args[-1 - bucket_id];
+  if (arg->weight_set_size || arg->ids_size) {
+    err << bucket_id << " is given more than once" << std::endl;
+    return -1;
+  }
+  for (iter_t p = i->children.begin(); p != i->children.end(); p++) {
+    int r = 0;
+    switch((int)p->value.id().to_long()) {
+    case crush_grammar::_choose_arg_weight_set:
+      r = parse_weight_set(p, bucket_id, arg);
+      break;
+    case crush_grammar::_choose_arg_ids:
+      r = parse_choose_arg_ids(p, bucket_id, arg);
+      break;
+    }
+    if (r < 0)
+      return r;
+  }
+  return 0;
+}
+
+int CrushCompiler::parse_choose_args(iter_t const& i)
+{
+  int64_t choose_arg_index = int_node(i->children[1]);
+  if (crush.have_choose_args(choose_arg_index)) {
+    err << choose_arg_index << " duplicated" << std::endl;
+    return -1;
+  }
+  crush_choose_arg_map& arg_map = crush.choose_args[choose_arg_index];
+  arg_map.size = crush.get_max_buckets();
+  arg_map.args = (crush_choose_arg *)calloc(arg_map.size,
+					    sizeof(crush_choose_arg));
+  for (iter_t p = i->children.begin() + 2; p != i->children.end(); p++) {
+    int r = 0;
+    switch((int)p->value.id().to_long()) {
+    case crush_grammar::_choose_arg:
+      r = parse_choose_arg(p, &arg_map);
+      break;
+    }
+    if (r < 0)
+      return r;
+  }
+  return 0;
+}
+
 void CrushCompiler::find_used_bucket_ids(iter_t const& i)
 {
   for (iter_t p = i->children.begin(); p != i->children.end(); p++) {
@@ -764,6 +934,9 @@ int CrushCompiler::parse_crush(iter_t const& i)
     case crush_grammar::_crushrule: 
       r = parse_rule(p);
       break;
+    case crush_grammar::_choose_args:
+      r = parse_choose_args(p);
+      break;
     default:
       ceph_abort();
     }
@@ -24,6 +24,8 @@ class CrushCompiler {
   };
 
   int decompile_bucket_impl(int i, ostream &out);
+  int decompile_choose_args(int64_t id, const crush_choose_arg_map& arg_map,
+			    ostream &out);
   int decompile_bucket(int cur,
 		       std::map<int, dcb_state_t>& dcb_states,
 		       ostream &out);
@@ -49,6 +51,13 @@ class CrushCompiler {
   int parse_bucket_type(iter_t const& i);
   int parse_bucket(iter_t const& i);
   int parse_rule(iter_t const& i);
+  int parse_weight_set_weights(iter_t const& i, int bucket_id,
+			       crush_weight_set *weight_set);
+  int parse_weight_set(iter_t const& i, int bucket_id, crush_choose_arg *arg);
+  int parse_choose_arg_ids(iter_t const& i, int bucket_id,
+			   crush_choose_arg *arg);
+  int parse_choose_arg(iter_t const& i, crush_choose_arg_map *arg_map);
+  int parse_choose_args(iter_t const& i);
   void find_used_bucket_ids(iter_t const& i);
   int parse_crush(iter_t const& i);  
   void dump(iter_t const& i, int ind=1);
@@ -103,6 +103,23 @@ map<int,int> CrushTester::get_collapsed_mapping()
   return collapse_mask;
 }
 
+void CrushTester::get_device_weights(vector<__u32>& weight)
+{
+  /*
+   * note device weight is set by crushtool
+   * (likely due to a given a command line option)
+   */
+  for (int o = 0; o < crush.get_max_devices(); o++) {
+    if (device_weight.count(o)) {
+      weight.push_back(device_weight[o]);
+    } else if (crush.check_item_present(o)) {
+      weight.push_back(0x10000);
+    } else {
+      weight.push_back(0);
+    }
+  }
+}
+
 void CrushTester::adjust_weights(vector<__u32>& weight)
 {
 
@@ -512,20 +529,7 @@ int CrushTester::test()
 
   // initial osd weights
   vector<__u32> weight;
-
-  /*
-   * note device weight is set by crushtool
-   * (likely due to a given a command line option)
-   */
-  for (int o = 0; o < crush.get_max_devices(); o++) {
-    if (device_weight.count(o)) {
-      weight.push_back(device_weight[o]);
-    } else if (crush.check_item_present(o)) {
-      weight.push_back(0x10000);
-    } else {
-      weight.push_back(0);
-    }
-  }
+  get_device_weights(weight);
 
   if (output_utilization_all)
     err << "devices weights (hex): " << hex << weight << dec << std::endl;
@@ -634,6 +638,11 @@ int CrushTester::test()
         // create a vector to hold placement results temporarily 
         vector<int> temporary_per ( per.size() );
 
+        // map the whole batch at once
+        vector<vector<int> > batch_out;
+        if (use_crush)
+          do_rule_range(r, batch_min, batch_max, nr, weight, &batch_out);
+
         for (int x = batch_min; x <= batch_max; x++) {
           // create a vector to hold the results of a CRUSH placement or RNG simulation
           vector<int> out;
@@ -641,11 +650,7 @@ int CrushTester::test()
           if (use_crush) {
             if (output_mappings)
 	      err << "CRUSH"; // prepend CRUSH to placement output
-            uint32_t real_x = x;
-            if (pool_id != -1) {
-              real_x = crush_hash32_2(CRUSH_HASH_RJENKINS1, x, (uint32_t)pool_id);
-            }
-            crush.do_rule(r, real_x, out, nr, weight);
+            out.swap(batch_out[x - batch_min]);
           } else {
             if (output_mappings)
 	      err << "RNG"; // prepend RNG to placement output to denote simulation
@@ -753,3 +758,212 @@ int CrushTester::test()
 
   return 0;
 }
+
+/*
+ * Map x in [first_x, last_x] (hashed with the pool id if one is set)
+ * in a single batch.
+ */
+void CrushTester::do_rule_range(int ruleno, int first_x, int last_x,
+				int numrep, const vector<__u32>& weight,
+				vector<vector<int> > *out)
+{
+  vector<uint32_t> xs(last_x - first_x + 1);
+  for (int x = first_x; x <= last_x; x++)
+    xs[x - first_x] = x;
+  if (pool_id != -1 && !xs.empty())
+    crush_hash32_2_multi(CRUSH_HASH_RJENKINS1, &xs[0], (uint32_t)pool_id,
+			 &xs[0], xs.size());
+  crush.do_rule_batch(ruleno, vector<int>(xs.begin(), xs.end()), out, numrep,
+		      weight, pool_id);
+}
+
+/*
+ * Map every x with the current weight sets, and count how often each
+ * item (device or bucket) is chosen at each position.
+ */
+void CrushTester::count_choices(int ruleno, int numrep,
+				const vector<__u32>& weight,
+				const map<int,int>& parent,
+				vector<map<int,int> > *hits,
+				vector<vector<int> > *mappings)
+{
+  hits->assign(numrep, map<int,int>());
+  do_rule_range(ruleno, min_x, max_x, numrep, weight, mappings);
+  for (int x = min_x; x <= max_x; x++) {
+    const vector<int>& out = (*mappings)[x - min_x];
+    for (unsigned pos = 0; pos < out.size(); pos++) {
+      int item = out[pos];
+      if (item == CRUSH_ITEM_NONE)
+	continue;
+      while (true) {
+	(*hits)[pos][item]++;
+	map<int,int>::const_iterator p = parent.find(item);
+	if (p == parent.end())
+	  break;
+	item = p->second;
+      }
+    }
+  }
+}
+
+int CrushTester::optimize_choose_args(int max_iterations, float max_deviation)
+{
+  if (min_rule < 0 || min_rule != max_rule || !crush.rule_exists(min_rule)) {
+    err << "optimize_choose_args: need a single existing rule" << std::endl;
+    return -EINVAL;
+  }
+  if (min_rep <= 0 || min_rep != max_rep) {
+    err << "optimize_choose_args: need a single num_rep" << std::endl;
+    return -EINVAL;
+  }
+  if (min_x < 0 || max_x < 0) {
+    min_x = 0;
+    max_x = 1023;
+  }
+  int ruleno = min_rule;
+  int numrep = min_rep;
+
+  vector<__u32> weight;
+  get_device_weights(weight);
+
+  // pool_id is -1, i.e. DEFAULT_CHOOSE_ARGS, if none was given
+  if (!crush.have_choose_args(pool_id))
+    crush.create_choose_args(pool_id, numrep);
+  crush_choose_arg_map& arg_map = crush.choose_args[pool_id];
+
+  // the tree the choices are made in, and the devices they end in
+  map<int,int> parent;
+  for (int b = -1; b > -1 - crush.get_max_buckets(); --b) {
+    if (!crush.bucket_exists(b))
+      continue;
+    for (int i = 0; i < crush.get_bucket_size(b); i++) {
+      int item = crush.get_bucket_item(b, i);
+      if (!parent.count(item))
+	parent[item] = b;
+    }
+  }
+
+  // the deviation of the most over- or underfull device
+  auto get_deviation = [&](const vector<map<int,int> >& hits) {
+    map<int,int> per;
+    int total = 0;
+    for (auto& h : hits) {
+      for (auto& p : h) {
+	if (p.first >= 0) {
+	  per[p.first] += p.second;
+	  total += p.second;
+	}
+      }
+    }
+    double weight_sum = 0;
+    for (int o = 0; o < (int)weight.size(); o++)
+      if (weight[o] && parent.count(o))
+	weight_sum += crush.get_item_weightf(o);
+    double worst = 0;
+    for (int o = 0; o < (int)weight.size(); o++) {
+      if (!weight[o] || !parent.count(o) || crush.get_item_weight(o) <= 0)
+	continue;
+      double expected = total * crush.get_item_weightf(o) / weight_sum;
+      double d = fabs(per[o] - expected) / expected;
+      worst = MAX(worst, d);
+    }
+    return worst;
+  };
+
+  vector<map<int,int> > hits;
+  vector<vector<int> > orig_mappings, mappings;
+  count_choices(ruleno, numrep, weight, parent, &hits, &orig_mappings);
+  double orig_deviation = get_deviation(hits);
+  double best_deviation = orig_deviation;
+  map<unsigned, vector<vector<__u32> > > best;  // bucket -> weight sets
+  auto save = [&]() {
+    best.clear();
+    for (__u32 b = 0; b < arg_map.size; b++) {
+      crush_choose_arg *arg = &arg_map.args[b];
+      for (__u32 j = 0; j < arg->weight_set_size; j++)
+	best[b].push_back(vector<__u32>(
+			    arg->weight_set[j].weights,
+			    arg->weight_set[j].weights + arg->weight_set[j].size));
+    }
+  };
+  save();
+
+  int iteration = 0;
+  double deviation = orig_deviation;
+  while (iteration < max_iterations && deviation > max_deviation) {
+    ++iteration;
+    // let each bucket correct its own choices, position by position;
+    // the positions past the last weight set share it
+    for (__u32 b = 0; b < arg_map.size; b++) {
+      crush_choose_arg *arg = &arg_map.args[b];
+      int id = -1 - (int)b;
+      if (!arg->weight_set_size || !crush.bucket_exists(id))
+	continue;
+      for (__u32 j = 0; j < arg->weight_set_size && (int)j < numrep; j++) {
+	crush_weight_set *ws = &arg->weight_set[j];
+	int size = crush.get_bucket_size(id);
+	if ((int)ws->size != size)
+	  continue;
+	int last = j + 1 < arg->weight_set_size ? j : numrep - 1;
+	vector<int> actual(size);
+	double total = 0, weight_sum = 0;
+	for (int i = 0; i < size; i++) {
+	  int item = crush.get_bucket_item(id, i);
+	  for (int pos = j; pos <= last; pos++) {
+	    map<int,int>::iterator p = hits[pos].find(item);
+	    if (p != hits[pos].end())
+	      actual[i] += p->second;
+	  }
+	  total += actual[i];
+	  weight_sum += crush.get_bucket_item_weight(id, i);
+	}
+	if (total == 0 || weight_sum == 0)
+	  continue;
+	for (int i = 0; i < size; i++) {
+	  int w = crush.get_bucket_item_weight(id, i);
+	  if (w <= 0 || ws->weights[i] == 0)
+	    continue;
+	  double expected = total * w / weight_sum;
+	  // move half way, and not too far, to avoid oscillating
+	  double factor = 1.0 + 0.5 * (expected - actual[i]) / expected;
+	  factor = MIN(MAX(factor, 0.5), 2.0);
+	  ws->weights[i] = MAX((__u32)(ws->weights[i] * factor), 1u);
+	}
+      }
+    }
+    count_choices(ruleno, numrep, weight, parent, &hits, &mappings);
+    deviation = get_deviation(hits);
+    if (output_statistics)
+      err << "iteration " << iteration << ": max deviation "
+	  << deviation * 100 << "%" << std::endl;
+    if (deviation < best_deviation) {
+      best_deviation = deviation;
+      save();
+    }
+  }
+
+  // keep the best weight sets we found
+  for (auto& p : best) {
+    crush_choose_arg *arg = &arg_map.args[p.first];
+    for (unsigned j = 0; j < p.second.size(); j++)
+      std::copy(p.second[j].begin(), p.second[j].end(),
+		arg->weight_set[j].weights);
+  }
+  count_choices(ruleno, numrep, weight, parent, &hits, &mappings);
+
+  int moved = 0, total = 0;
+  for (unsigned x = 0; x < mappings.size(); x++) {
+    for (unsigned pos = 0; pos < mappings[x].size(); pos++) {
+      total++;
+      if (pos >= orig_mappings[x].size() ||
+	  orig_mappings[x][pos] != mappings[x][pos])
+	moved++;
+    }
+  }
+  err << "choose_args " << pool_id << " rule " << ruleno
+      << " num_rep " << numrep << ": max deviation "
+      << orig_deviation * 100 << "% -> " << best_deviation * 100
+      << "% after " << iteration << " iterations, "
+      << moved << "/" << total << " mappings changed" << std::endl;
+  return 0;
+}
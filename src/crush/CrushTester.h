@@ -44,6 +44,20 @@ class CrushTester {
  */
   void adjust_weights(vector<__u32>& weight);
 
+  /*
+   * the device weights to test with: 1.0, or the one set for the device
+   * with set_device_weight(), or 0 if the device is not in the map
+   */
+  void get_device_weights(vector<__u32>& weight);
+
+  void do_rule_range(int ruleno, int first_x, int last_x, int numrep,
+		     const vector<__u32>& weight, vector<vector<int> > *out);
+
+  void count_choices(int ruleno, int numrep, const vector<__u32>& weight,
+		     const map<int,int>& parent,
+		     vector<map<int,int> > *hits,
+		     vector<vector<int> > *mappings);
+
   /*
    * Get the maximum number of devices that could be selected to satisfy ruleno.
    */
@@ -359,6 +373,20 @@ public:
    */
   void check_overlapped_rules() const;
   int test();
+  /**
+   * adjust the choose_args weight sets of the pool (or the default ones
+   * if no pool is set) until the inputs in [min_x, max_x] are spread
+   * over the devices in proportion to their crush weight.
+   *
+   * Each iteration lets every straw2 bucket correct the share of each
+   * of its items, at each position, half way towards the target. It
+   * stops as soon as no device deviates by more than @p max_deviation
+   * (a ratio of its expected share), so that no more mappings change
+   * than needed, and keeps the best weight sets it found.
+   *
+   * @return 0, or -EINVAL if the rule or num_rep is not a single value
+   */
+  int optimize_choose_args(int max_iterations, float max_deviation);
   int test_with_crushtool(const char *crushtool_cmd = "crushtool",
 			  int max_id = -1,
 			  int timeout = 0,
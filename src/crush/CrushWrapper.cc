@@ -5,6 +5,7 @@
 #include "common/debug.h"
 #include "common/Formatter.h"
 #include "common/errno.h"
+#include "include/stringify.h"
 
 #include "CrushWrapper.h"
 #include "CrushTreeDumper.h"
@@ -225,6 +226,7 @@ bool CrushWrapper::_maybe_remove_last_instance(CephContext *cct, int item, bool
   if (item < 0 && !unlink_only) {
     crush_bucket *t = get_bucket(item);
     ldout(cct, 5) << "_maybe_remove_last_instance removing bucket " << item << dendl;
+    _choose_args_drop_bucket(item);
     crush_remove_bucket(crush, t);
   }
   if ((item >= 0 || !unlink_only) && name_map.count(item)) {
@@ -268,6 +270,7 @@ int CrushWrapper::remove_item(CephContext *cct, int item, bool unlink_only)
       if (id == item) {
 	ldout(cct, 5) << "remove_item removing item " << item
 		      << " from bucket " << b->id << dendl;
+	_choose_args_drop_bucket(b->id);
 	crush_bucket_remove_item(crush, b, item);
 	adjust_item_weight(cct, b->id, b->weight);
 	ret = 0;
@@ -330,6 +333,7 @@ int CrushWrapper::_remove_item_under(CephContext *cct, int item, int ancestor, b
     int id = b->items[i];
     if (id == item) {
       ldout(cct, 5) << "_remove_item_under removing item " << item << " from bucket " << b->id << dendl;
+      _choose_args_drop_bucket(b->id);
       crush_bucket_remove_item(crush, b, item);
       adjust_item_weight(cct, b->id, b->weight);
       ret = 0;
@@ -664,6 +668,7 @@ int CrushWrapper::insert_item(CephContext *cct, int item, float weight, string n
 
     ldout(cct, 5) << "insert_item adding " << cur << " weight " << weight
 		  << " to bucket " << id << dendl;
+    _choose_args_drop_bucket(b->id);
     int r = crush_bucket_add_item(crush, b, cur, 0);
     assert (!r);
     break;
@@ -827,7 +832,9 @@ int CrushWrapper::adjust_item_weight(CephContext *cct, int id, int weight)
       continue;
     for (unsigned i = 0; i < b->size; i++) {
       if (b->items[i] == id) {
+	int old = crush_get_bucket_item_weight(b, i);
 	int diff = crush_bucket_adjust_item_weight(crush, b, id, weight);
+	_choose_args_adjust_item_weight(b, i, old, weight);
 	ldout(cct, 5) << "adjust_item_weight " << id << " diff " << diff << " in bucket " << bidx << dendl;
 	adjust_item_weight(cct, -1 - bidx, b->weight);
 	changed++;
@@ -851,7 +858,9 @@ int CrushWrapper::adjust_item_weight_in_loc(CephContext *cct, int id, int weight
     crush_bucket *b = get_bucket(bid);
     for (unsigned int i = 0; i < b->size; i++) {
       if (b->items[i] == id) {
+	int old = crush_get_bucket_item_weight(b, i);
 	int diff = crush_bucket_adjust_item_weight(crush, b, id, weight);
+	_choose_args_adjust_item_weight(b, i, old, weight);
 	ldout(cct, 5) << "adjust_item_weight_in_loc " << id << " diff " << diff << " in bucket " << bid << dendl;
 	adjust_item_weight(cct, bid, b->weight);
 	changed++;
@@ -879,7 +888,9 @@ int CrushWrapper::adjust_subtree_weight(CephContext *cct, int id, int weight)
     for (unsigned i=0; i<b->size; ++i) {
       int n = b->items[i];
       if (n >= 0) {
+	int old = crush_get_bucket_item_weight(b, i);
 	crush_bucket_adjust_item_weight(crush, b, n, weight);
+	_choose_args_adjust_item_weight(b, i, old, weight);
 	++changed;
 	++local_changed;
       } else {
@@ -1125,6 +1136,158 @@ int CrushWrapper::remove_rule(int ruleno)
   return 0;
 }
 
+// choose_args
+
+static void destroy_choose_arg(crush_choose_arg *arg)
+{
+  for (__u32 j = 0; j < arg->weight_set_size; j++)
+    free(arg->weight_set[j].weights);
+  free(arg->weight_set);
+  free(arg->ids);
+  memset(arg, 0, sizeof(*arg));
+}
+
+static void destroy_choose_arg_map(crush_choose_arg_map *arg_map)
+{
+  for (__u32 i = 0; i < arg_map->size; i++)
+    destroy_choose_arg(&arg_map->args[i]);
+  free(arg_map->args);
+  arg_map->args = NULL;
+  arg_map->size = 0;
+}
+
+void CrushWrapper::create_choose_args(int64_t id, int positions)
+{
+  assert(positions > 0);
+  rm_choose_args(id);
+
+  crush_choose_arg_map& arg_map = choose_args[id];
+  arg_map.size = crush->max_buckets;
+  arg_map.args = (crush_choose_arg*)calloc(arg_map.size,
+					   sizeof(crush_choose_arg));
+  for (int i = 0; i < crush->max_buckets; i++) {
+    crush_bucket *b = crush->buckets[i];
+    if (!b || b->alg != CRUSH_BUCKET_STRAW2)
+      continue;
+    crush_bucket_straw2 *sb = reinterpret_cast<crush_bucket_straw2*>(b);
+    crush_choose_arg *arg = &arg_map.args[i];
+    arg->weight_set_size = positions;
+    arg->weight_set = (crush_weight_set*)calloc(positions,
+						sizeof(crush_weight_set));
+    for (int j = 0; j < positions; j++) {
+      crush_weight_set *ws = &arg->weight_set[j];
+      ws->size = b->size;
+      ws->weights = (__u32*)calloc(b->size, sizeof(__u32));
+      memcpy(ws->weights, sb->item_weights, b->size * sizeof(__u32));
+    }
+  }
+}
+
+bool CrushWrapper::rm_choose_args(int64_t id)
+{
+  auto p = choose_args.find(id);
+  if (p == choose_args.end())
+    return false;
+  destroy_choose_arg_map(&p->second);
+  choose_args.erase(p);
+  return true;
+}
+
+void CrushWrapper::choose_args_clear()
+{
+  for (auto& p : choose_args)
+    destroy_choose_arg_map(&p.second);
+  choose_args.clear();
+}
+
+static crush_weight_set *get_choose_arg_weight_set(
+  const crush_choose_arg_map& arg_map, int bucket, int position)
+{
+  unsigned bidx = -1 - bucket;
+  if (bidx >= arg_map.size)
+    return NULL;
+  crush_choose_arg *arg = &arg_map.args[bidx];
+  if (position < 0 || (unsigned)position >= arg->weight_set_size)
+    return NULL;
+  return &arg->weight_set[position];
+}
+
+int CrushWrapper::choose_args_set_item_weight(int64_t id, int bucket,
+					      int item, int position,
+					      __u32 weight)
+{
+  auto p = choose_args.find(id);
+  if (p == choose_args.end())
+    return -ENOENT;
+  crush_bucket *b = get_bucket(bucket);
+  if (IS_ERR(b))
+    return -ENOENT;
+  crush_weight_set *ws = get_choose_arg_weight_set(p->second, bucket,
+						   position);
+  if (!ws)
+    return -ENOENT;
+  for (unsigned i = 0; i < b->size && i < ws->size; i++) {
+    if (b->items[i] == item) {
+      ws->weights[i] = weight;
+      return 0;
+    }
+  }
+  return -ENOENT;
+}
+
+int CrushWrapper::choose_args_get_item_weight(int64_t id, int bucket,
+					      int item, int position) const
+{
+  auto p = choose_args.find(id);
+  if (p == choose_args.end())
+    return -ENOENT;
+  const crush_bucket *b = get_bucket(bucket);
+  if (IS_ERR(b))
+    return -ENOENT;
+  crush_weight_set *ws = get_choose_arg_weight_set(p->second, bucket,
+						   position);
+  if (!ws)
+    return -ENOENT;
+  for (unsigned i = 0; i < b->size && i < ws->size; i++) {
+    if (b->items[i] == item)
+      return ws->weights[i];
+  }
+  return -ENOENT;
+}
+
+void CrushWrapper::_choose_args_adjust_item_weight(const crush_bucket *b,
+						   unsigned pos,
+						   __u32 old_weight,
+						   __u32 new_weight)
+{
+  // keep whatever correction the weight sets apply to the item
+  unsigned bidx = -1 - b->id;
+  for (auto& p : choose_args) {
+    if (bidx >= p.second.size)
+      continue;
+    crush_choose_arg *arg = &p.second.args[bidx];
+    for (__u32 j = 0; j < arg->weight_set_size; j++) {
+      crush_weight_set *ws = &arg->weight_set[j];
+      if (pos >= ws->size)
+	continue;
+      if (old_weight == 0)
+	ws->weights[pos] = new_weight;
+      else
+	ws->weights[pos] = (uint64_t)ws->weights[pos] * new_weight /
+	  old_weight;
+    }
+  }
+}
+
+void CrushWrapper::_choose_args_drop_bucket(int id)
+{
+  unsigned bidx = -1 - id;
+  for (auto& p : choose_args) {
+    if (bidx < p.second.size)
+      destroy_choose_arg(&p.second.args[bidx]);
+  }
+}
+
 void CrushWrapper::encode(bufferlist& bl, uint64_t features) const
 {
   assert(crush);
@@ -1218,6 +1381,37 @@ void CrushWrapper::encode(bufferlist& bl, uint64_t features) const
   ::encode(crush->allowed_bucket_algs, bl);
   if (features & CEPH_FEATURE_CRUSH_TUNABLES5) {
     ::encode(crush->chooseleaf_stable, bl);
+    if (HAVE_FEATURE(features, CRUSH_CHOOSE_ARGS)) {
+      __u32 n = choose_args.size();
+      ::encode(n, bl);
+      for (auto& c : choose_args) {
+	const crush_choose_arg_map& arg_map = c.second;
+	::encode(c.first, bl);
+	__u32 size = 0;
+	for (__u32 i = 0; i < arg_map.size; i++) {
+	  const crush_choose_arg *arg = &arg_map.args[i];
+	  if (arg->weight_set_size || arg->ids_size)
+	    size++;
+	}
+	::encode(size, bl);
+	for (__u32 i = 0; i < arg_map.size; i++) {
+	  const crush_choose_arg *arg = &arg_map.args[i];
+	  if (!arg->weight_set_size && !arg->ids_size)
+	    continue;
+	  ::encode(i, bl);
+	  ::encode(arg->weight_set_size, bl);
+	  for (__u32 j = 0; j < arg->weight_set_size; j++) {
+	    const crush_weight_set *ws = &arg->weight_set[j];
+	    ::encode(ws->size, bl);
+	    for (__u32 k = 0; k < ws->size; k++)
+	      ::encode(ws->weights[k], bl);
+	  }
+	  ::encode(arg->ids_size, bl);
+	  for (__u32 j = 0; j < arg->ids_size; j++)
+	    ::encode(arg->ids[j], bl);
+	}
+      }
+    }
   }
 }
 
@@ -1311,9 +1505,45 @@ void CrushWrapper::decode(bufferlist::iterator& blp)
     if (!blp.end()) {
       ::decode(crush->chooseleaf_stable, blp);
     }
+    if (!blp.end()) {
+      __u32 n;
+      ::decode(n, blp);
+      while (n--) {
+	int64_t id;
+	::decode(id, blp);
+	crush_choose_arg_map& arg_map = choose_args[id];
+	arg_map.size = crush->max_buckets;
+	arg_map.args = (crush_choose_arg*)calloc(arg_map.size,
+						 sizeof(crush_choose_arg));
+	__u32 size;
+	::decode(size, blp);
+	while (size--) {
+	  __u32 bidx;
+	  ::decode(bidx, blp);
+	  if (bidx >= arg_map.size)
+	    throw buffer::malformed_input("choose_args bucket out of range");
+	  crush_choose_arg *arg = &arg_map.args[bidx];
+	  ::decode(arg->weight_set_size, blp);
+	  arg->weight_set = (crush_weight_set*)calloc(
+	    arg->weight_set_size, sizeof(crush_weight_set));
+	  for (__u32 j = 0; j < arg->weight_set_size; j++) {
+	    crush_weight_set *ws = &arg->weight_set[j];
+	    ::decode(ws->size, blp);
+	    ws->weights = (__u32*)calloc(ws->size, sizeof(__u32));
+	    for (__u32 k = 0; k < ws->size; k++)
+	      ::decode(ws->weights[k], blp);
+	  }
+	  ::decode(arg->ids_size, blp);
+	  arg->ids = (__s32*)calloc(arg->ids_size, sizeof(__s32));
+	  for (__u32 j = 0; j < arg->ids_size; j++)
+	    ::decode(arg->ids[j], blp);
+	}
+      }
+    }
     finalize();
   }
   catch (...) {
+    choose_args_clear();
     crush_destroy(crush);
     throw;
   }
@@ -1495,6 +1725,10 @@ void CrushWrapper::dump(Formatter *f) const
   f->open_object_section("tunables");
   dump_tunables(f);
   f->close_section();
+
+  f->open_object_section("choose_args");
+  dump_choose_args(f);
+  f->close_section();
 }
 
 namespace {
@@ -1587,6 +1821,40 @@ void CrushWrapper::dump_tunables(Formatter *f) const
   f->dump_int("has_v5_rules", (int)has_v5_rules());
 }
 
+void CrushWrapper::dump_choose_args(Formatter *f) const
+{
+  for (auto& c : choose_args) {
+    const crush_choose_arg_map& arg_map = c.second;
+    f->open_array_section(stringify(c.first).c_str());
+    for (__u32 i = 0; i < arg_map.size; i++) {
+      const crush_choose_arg *arg = &arg_map.args[i];
+      if (!arg->weight_set_size && !arg->ids_size)
+	continue;
+      f->open_object_section("choose_arg");
+      f->dump_int("bucket_id", -1 - (int)i);
+      if (arg->weight_set_size) {
+	f->open_array_section("weight_set");
+	for (__u32 j = 0; j < arg->weight_set_size; j++) {
+	  const crush_weight_set *ws = &arg->weight_set[j];
+	  f->open_array_section("weights");
+	  for (__u32 k = 0; k < ws->size; k++)
+	    f->dump_float("weight", (float)ws->weights[k] / (float)0x10000);
+	  f->close_section();
+	}
+	f->close_section();
+      }
+      if (arg->ids_size) {
+	f->open_array_section("ids");
+	for (__u32 j = 0; j < arg->ids_size; j++)
+	  f->dump_int("id", arg->ids[j]);
+	f->close_section();
+      }
+      f->close_section();
+    }
+    f->close_section();
+  }
+}
+
 void CrushWrapper::dump_rules(Formatter *f) const
 {
   for (int i=0; i<get_max_rules(); i++) {
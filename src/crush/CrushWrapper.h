@@ -55,6 +55,13 @@ public:
   std::map<int32_t, string> name_map; /* bucket/device names */
   std::map<int32_t, string> rule_name_map;
 
+  /// weight-set overrides, by pool id (or DEFAULT_CHOOSE_ARGS)
+  typedef std::map<int64_t, crush_choose_arg_map> choose_args_t;
+  choose_args_t choose_args;
+
+  /// choose_args used by pools that have none of their own
+  static const int64_t DEFAULT_CHOOSE_ARGS = -1;
+
 private:
   struct crush_map *crush;
   /* reverse maps */
@@ -73,6 +80,15 @@ private:
       r[p->second] = p->first;
   }
 
+  /*
+   * keep the choose_args in line with changes to the buckets: a new
+   * item weight scales the item's weight sets, and adding or removing
+   * an item drops the bucket's weight sets altogether.
+   */
+  void _choose_args_adjust_item_weight(const crush_bucket *b, unsigned pos,
+				       __u32 old_weight, __u32 new_weight);
+  void _choose_args_drop_bucket(int id);
+
 public:
   CrushWrapper(const CrushWrapper& other);
   const CrushWrapper& operator=(const CrushWrapper& other);
@@ -83,6 +99,7 @@ public:
   ~CrushWrapper() {
     if (crush)
       crush_destroy(crush);
+    choose_args_clear();
   }
 
   crush_map *get_crush_map() { return crush; }
@@ -92,6 +109,7 @@ public:
     if (crush)
       crush_destroy(crush);
     crush = crush_create();
+    choose_args_clear();
     assert(crush);
     have_rmaps = false;
 
@@ -919,6 +937,8 @@ private:
     crush_bucket *parent_bucket = get_bucket(parent_id);
 
     if (!IS_ERR(parent_bucket)) {
+      _choose_args_drop_bucket(parent_id);
+
       // zero out the bucket weight
       crush_bucket_adjust_item_weight(crush, parent_bucket, item, 0);
       adjust_item_weight(cct, parent_bucket->id, parent_bucket->weight);
@@ -1084,13 +1104,57 @@ public:
     return result;
   }
 
+  // choose_args
+  bool has_choose_args() const {
+    return !choose_args.empty();
+  }
+  bool have_choose_args(int64_t id) const {
+    return choose_args.count(id);
+  }
+
+  /**
+   * Return the choose_args a mapping for pool @p id should use: its
+   * own, else the DEFAULT_CHOOSE_ARGS ones, else NULL.
+   */
+  const crush_choose_arg_map *choose_args_get(int64_t id) const {
+    auto p = choose_args.find(id);
+    if (p == choose_args.end())
+      p = choose_args.find(DEFAULT_CHOOSE_ARGS);
+    if (p == choose_args.end())
+      return NULL;
+    return &p->second;
+  }
+
+  /**
+   * (Re)create the choose_args for @p id with @p positions weight sets
+   * in each straw2 bucket, all initialized to the bucket's own weights,
+   * so that the mappings are unchanged until they are adjusted.
+   */
+  void create_choose_args(int64_t id, int positions);
+  bool rm_choose_args(int64_t id);
+  void choose_args_clear();
+
+  /**
+   * Set the weight of @p item in its @p bucket, for the given result
+   * @p position, in choose_args @p id.
+   *
+   * @return 0, or -ENOENT if there is no such choose_args, bucket, item
+   *         or position
+   */
+  int choose_args_set_item_weight(int64_t id, int bucket, int item,
+				  int position, __u32 weight);
+  int choose_args_get_item_weight(int64_t id, int bucket, int item,
+				  int position) const;
+
   void do_rule(int rule, int x, vector<int>& out, int maxout,
-	       const vector<__u32>& weight) const {
+	       const vector<__u32>& weight,
+	       int64_t choose_args_index = DEFAULT_CHOOSE_ARGS) const {
     int rawout[maxout];
     char work[crush_work_size(crush, maxout)];
     crush_init_workspace(crush, work);
     int numrep = crush_do_rule(crush, rule, x, rawout, maxout, &weight[0],
-			       weight.size(), work);
+			       weight.size(), work,
+			       choose_args_get(choose_args_index));
     if (numrep < 0)
       numrep = 0;
     out.resize(numrep);
@@ -1098,6 +1162,31 @@ public:
       out[i] = rawout[i];
   }
 
+  /**
+   * map every x in @p xs, as do_rule would, with a single workspace
+   *
+   * @param out [out] the mapping of each xs[i]
+   */
+  void do_rule_batch(int rule, const vector<int>& xs,
+		     vector<vector<int> > *out, int maxout,
+		     const vector<__u32>& weight,
+		     int64_t choose_args_index = DEFAULT_CHOOSE_ARGS) const {
+    out->resize(xs.size());
+    if (xs.empty())
+      return;
+    vector<int> rawout(xs.size() * maxout);
+    vector<int> numrep(xs.size());
+    vector<char> work(crush_work_size(crush, maxout));
+    crush_init_workspace(crush, &work[0]);
+    crush_do_rule_batch(crush, rule, &xs[0], xs.size(), &rawout[0], maxout,
+			&numrep[0], &weight[0], weight.size(), &work[0],
+			choose_args_get(choose_args_index));
+    for (unsigned i = 0; i < xs.size(); i++) {
+      const int *p = &rawout[i * maxout];
+      (*out)[i].assign(p, p + max(numrep[i], 0));
+    }
+  }
+
   bool check_crush_rule(int ruleset, int type, int size,  ostream& ss) {
     assert(crush);
 
@@ -1130,6 +1219,7 @@ public:
   void dump_rules(Formatter *f) const;
   void dump_rule(int ruleset, Formatter *f) const;
   void dump_tunables(Formatter *f) const;
+  void dump_choose_args(Formatter *f) const;
   void list_rules(Formatter *f) const;
   void dump_tree(ostream *out, Formatter *f) const;
   void dump_tree(Formatter *f) const;
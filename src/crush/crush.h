@@ -287,6 +287,49 @@ struct crush_bucket_straw2 {
 	__u32 *item_weights;   /*!< 16.16 fixed point weight for each item */
 };
 
+/** @ingroup API
+ *
+ * Replacement weights for the items of a bucket, in the same order as
+ * the bucket's __items__. It is ignored unless __size__ equals the
+ * size of the bucket.
+ */
+struct crush_weight_set {
+	__u32 *weights; /*!< 16.16 fixed point weight for each item */
+	__u32 size;     /*!< size of the __weights__ array */
+};
+
+/** @ingroup API
+ *
+ * Replacement arguments for the choice made in one bucket, used by
+ * crush_do_rule() in place of the bucket's own item weights and ids.
+ * Only ::CRUSH_BUCKET_STRAW2 buckets honour them.
+ *
+ * __weight_set[p]__ is used when choosing the item at position __p__
+ * of the result (the replica rank); positions past the end of the
+ * array use the last entry, so a single entry applies to all of them.
+ *
+ * __ids__, when set, replace the items as input of the hash, but not
+ * as the result of the choice. It is ignored unless __ids_size__
+ * equals the size of the bucket.
+ */
+struct crush_choose_arg {
+	__s32 *ids;            /*!< values to hash instead of the items */
+	__u32 ids_size;        /*!< size of the __ids__ array */
+	struct crush_weight_set *weight_set; /*!< weights for each position */
+	__u32 weight_set_size; /*!< size of the __weight_set__ array */
+};
+
+/** @ingroup API
+ *
+ * A set of crush_choose_arg, one for each bucket of a crush_map: the
+ * bucket with id __id__ uses __args[-1-id]__. Buckets beyond __size__
+ * use their own weights.
+ */
+struct crush_choose_arg_map {
+	struct crush_choose_arg *args; /*!< one per bucket */
+	__u32 size;                    /*!< size of the __args__ array */
+};
+
 
 
 /** @ingroup API
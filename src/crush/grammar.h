@@ -57,6 +57,12 @@ struct crush_grammar : public grammar<crush_grammar>
     _crushrule,
     _crushmap,
     _tunable,
+    _choose_arg_bucket_id,
+    _choose_arg_weight_set_weights,
+    _choose_arg_weight_set,
+    _choose_arg_ids,
+    _choose_arg,
+    _choose_args,
   };
 
   template <typename ScannerT>
@@ -92,6 +98,13 @@ struct crush_grammar : public grammar<crush_grammar>
     rule<ScannerT, parser_context<>, parser_tag<_step> >      step;
     rule<ScannerT, parser_context<>, parser_tag<_crushrule> >      crushrule;
 
+    rule<ScannerT, parser_context<>, parser_tag<_choose_arg_bucket_id> >     choose_arg_bucket_id;
+    rule<ScannerT, parser_context<>, parser_tag<_choose_arg_weight_set_weights> >     choose_arg_weight_set_weights;
+    rule<ScannerT, parser_context<>, parser_tag<_choose_arg_weight_set> >     choose_arg_weight_set;
+    rule<ScannerT, parser_context<>, parser_tag<_choose_arg_ids> >     choose_arg_ids;
+    rule<ScannerT, parser_context<>, parser_tag<_choose_arg> >     choose_arg;
+    rule<ScannerT, parser_context<>, parser_tag<_choose_args> >     choose_args;
+
     rule<ScannerT, parser_context<>, parser_tag<_crushmap> >      crushmap;
 
     definition(crush_grammar const& /*self*/)
@@ -158,8 +171,24 @@ struct crush_grammar : public grammar<crush_grammar>
 			   >> +step
 			   >> '}';
 
+      // choose_args
+      choose_arg_bucket_id = str_p("bucket_id") >> negint;
+      choose_arg_weight_set_weights = str_p("[") >> *real_p >> str_p("]");
+      choose_arg_weight_set = str_p("weight_set") >> str_p("[")
+				 >> *choose_arg_weight_set_weights
+				 >> str_p("]");
+      choose_arg_ids = str_p("ids") >> str_p("[") >> *integer >> str_p("]");
+      choose_arg = str_p("{") >> choose_arg_bucket_id
+			      >> !choose_arg_weight_set
+			      >> !choose_arg_ids
+			      >> str_p("}");
+      choose_args = str_p("choose_args") >> integer >> str_p("{")
+					 >> *choose_arg
+					 >> str_p("}");
+
       // the whole crush map
-      crushmap = *(tunable | device | bucket_type) >> *(bucket | crushrule);
+      crushmap = *(tunable | device | bucket_type) >> *(bucket | crushrule)
+					 >> *choose_args;
     }
 
     rule<ScannerT, parser_context<>, parser_tag<_crushmap> > const&
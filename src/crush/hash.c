@@ -140,6 +140,102 @@ __u32 crush_hash32_5(int type, __u32 a, __u32 b, __u32 c, __u32 d, __u32 e)
 	}
 }
 
+/*
+ * The _multi variants hash CRUSH_HASH_LANES inputs at a time, with each
+ * mixing step written as a fixed-length loop over the lanes so that the
+ * compiler turns it into vector instructions (even at -O2, which will
+ * not vectorize the variable-length loop around a scalar hash).  The
+ * inputs left over are hashed one at a time.
+ */
+#define CRUSH_HASH_LANES 8
+
+#define crush_hashmix_lanes(a, b, c) do {			\
+		int l;						\
+		for (l = 0; l < CRUSH_HASH_LANES; l++)		\
+			crush_hashmix(a[l], b[l], c[l]);	\
+	} while (0)
+
+static void crush_hash32_rjenkins1_2_lanes(const __u32 *av, __u32 bv,
+					   __u32 *out)
+{
+	__u32 a[CRUSH_HASH_LANES], b[CRUSH_HASH_LANES];
+	__u32 hash[CRUSH_HASH_LANES], x[CRUSH_HASH_LANES], y[CRUSH_HASH_LANES];
+	int l;
+
+	for (l = 0; l < CRUSH_HASH_LANES; l++) {
+		a[l] = av[l];
+		b[l] = bv;
+		hash[l] = crush_hash_seed ^ a[l] ^ b[l];
+		x[l] = 231232;
+		y[l] = 1232;
+	}
+	crush_hashmix_lanes(a, b, hash);
+	crush_hashmix_lanes(x, a, hash);
+	crush_hashmix_lanes(b, y, hash);
+	for (l = 0; l < CRUSH_HASH_LANES; l++)
+		out[l] = hash[l];
+}
+
+static void crush_hash32_rjenkins1_3_lanes(__u32 av, const __u32 *bv,
+					   __u32 cv, __u32 *out)
+{
+	__u32 a[CRUSH_HASH_LANES], b[CRUSH_HASH_LANES], c[CRUSH_HASH_LANES];
+	__u32 hash[CRUSH_HASH_LANES], x[CRUSH_HASH_LANES], y[CRUSH_HASH_LANES];
+	int l;
+
+	for (l = 0; l < CRUSH_HASH_LANES; l++) {
+		a[l] = av;
+		b[l] = bv[l];
+		c[l] = cv;
+		hash[l] = crush_hash_seed ^ a[l] ^ b[l] ^ c[l];
+		x[l] = 231232;
+		y[l] = 1232;
+	}
+	crush_hashmix_lanes(a, b, hash);
+	crush_hashmix_lanes(c, x, hash);
+	crush_hashmix_lanes(y, a, hash);
+	crush_hashmix_lanes(b, x, hash);
+	crush_hashmix_lanes(y, c, hash);
+	for (l = 0; l < CRUSH_HASH_LANES; l++)
+		out[l] = hash[l];
+}
+
+void crush_hash32_2_multi(int type, const __u32 *a, __u32 b,
+			  __u32 *out, unsigned n)
+{
+	unsigned i = 0;
+
+	switch (type) {
+	case CRUSH_HASH_RJENKINS1:
+		for (; i + CRUSH_HASH_LANES <= n; i += CRUSH_HASH_LANES)
+			crush_hash32_rjenkins1_2_lanes(a + i, b, out + i);
+		for (; i < n; i++)
+			out[i] = crush_hash32_rjenkins1_2(a[i], b);
+		break;
+	default:
+		for (; i < n; i++)
+			out[i] = 0;
+	}
+}
+
+void crush_hash32_3_multi(int type, __u32 a, const __u32 *b, __u32 c,
+			  __u32 *out, unsigned n)
+{
+	unsigned i = 0;
+
+	switch (type) {
+	case CRUSH_HASH_RJENKINS1:
+		for (; i + CRUSH_HASH_LANES <= n; i += CRUSH_HASH_LANES)
+			crush_hash32_rjenkins1_3_lanes(a, b + i, c, out + i);
+		for (; i < n; i++)
+			out[i] = crush_hash32_rjenkins1_3(a, b[i], c);
+		break;
+	default:
+		for (; i < n; i++)
+			out[i] = 0;
+	}
+}
+
 const char *crush_hash_name(int type)
 {
 	switch (type) {
@@ -20,4 +20,16 @@ extern __u32 crush_hash32_4(int type, __u32 a, __u32 b, __u32 c, __u32 d);
 extern __u32 crush_hash32_5(int type, __u32 a, __u32 b, __u32 c, __u32 d,
 			    __u32 e);
 
+/*
+ * Hash many inputs at once, for callers that would otherwise call the
+ * scalar functions in a loop: out[i] = crush_hash32_2(type, a[i], b) and
+ * out[i] = crush_hash32_3(type, a, b[i], c).  The loops have no branches,
+ * so the compiler can vectorize them; results are identical to the
+ * scalar functions.
+ */
+extern void crush_hash32_2_multi(int type, const __u32 *a, __u32 b,
+				 __u32 *out, unsigned n);
+extern void crush_hash32_3_multi(int type, __u32 a, const __u32 *b, __u32 c,
+				 __u32 *out, unsigned n);
+
 #endif
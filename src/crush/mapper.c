@@ -299,47 +299,91 @@ static __u64 crush_ln(unsigned int xin)
  *
  */
 
+static const __u32 *get_choose_arg_weights(
+	const struct crush_bucket_straw2 *bucket,
+	const struct crush_choose_arg *arg,
+	int position)
+{
+	const struct crush_weight_set *ws;
+
+	if (!arg || !arg->weight_set || arg->weight_set_size == 0)
+		return bucket->item_weights;
+	if ((__u32)position >= arg->weight_set_size)
+		position = arg->weight_set_size - 1;
+	ws = &arg->weight_set[position];
+	if (ws->size != bucket->h.size)
+		return bucket->item_weights;
+	return ws->weights;
+}
+
+static const __s32 *get_choose_arg_ids(
+	const struct crush_bucket_straw2 *bucket,
+	const struct crush_choose_arg *arg)
+{
+	if (!arg || !arg->ids || arg->ids_size != bucket->h.size)
+		return bucket->h.items;
+	return arg->ids;
+}
+
+/*
+ * items are drawn in chunks: the hashes for a whole chunk are computed
+ * by one branch-free (vectorizable) loop, then their logs, and only then
+ * are the draws compared.  the result is the same as drawing one item
+ * at a time.
+ */
+#define CRUSH_STRAW2_CHUNK 32
+
 static int bucket_straw2_choose(const struct crush_bucket_straw2 *bucket,
-				int x, int r)
+				int x, int r,
+				const struct crush_choose_arg *arg,
+				int position)
 {
-	unsigned int i, high = 0;
-	unsigned int u;
+	unsigned int i, j, n, high = 0;
 	unsigned int w;
-	__s64 ln, draw, high_draw = 0;
-
-	for (i = 0; i < bucket->h.size; i++) {
-		w = bucket->item_weights[i];
-		if (w) {
-			u = crush_hash32_3(bucket->h.hash, x,
-					   bucket->h.items[i], r);
-			u &= 0xffff;
-
-			/*
-			 * for some reason slightly less than 0x10000 produces
-			 * a slightly more accurate distribution... probably a
-			 * rounding effect.
-			 *
-			 * the natural log lookup table maps [0,0xffff]
-			 * (corresponding to real numbers [1/0x10000, 1] to
-			 * [0, 0xffffffffffff] (corresponding to real numbers
-			 * [-11.090355,0]).
-			 */
-			ln = crush_ln(u) - 0x1000000000000ll;
-
-			/*
-			 * divide by 16.16 fixed-point weight.  note
-			 * that the ln value is negative, so a larger
-			 * weight means a larger (less negative) value
-			 * for draw.
-			 */
-			draw = div64_s64(ln, w);
-		} else {
-			draw = S64_MIN;
-		}
+	__u32 u[CRUSH_STRAW2_CHUNK];
+	__s64 ln[CRUSH_STRAW2_CHUNK];
+	__s64 draw, high_draw = 0;
+	const __u32 *weights = get_choose_arg_weights(bucket, arg, position);
+	const __s32 *ids = get_choose_arg_ids(bucket, arg);
+
+	for (i = 0; i < bucket->h.size; i += n) {
+		n = bucket->h.size - i;
+		if (n > CRUSH_STRAW2_CHUNK)
+			n = CRUSH_STRAW2_CHUNK;
+		crush_hash32_3_multi(bucket->h.hash, x, (const __u32 *)ids + i,
+				     r, u, n);
+
+		/*
+		 * for some reason slightly less than 0x10000 produces
+		 * a slightly more accurate distribution... probably a
+		 * rounding effect.
+		 *
+		 * the natural log lookup table maps [0,0xffff]
+		 * (corresponding to real numbers [1/0x10000, 1] to
+		 * [0, 0xffffffffffff] (corresponding to real numbers
+		 * [-11.090355,0]).
+		 */
+		for (j = 0; j < n; j++)
+			ln[j] = crush_ln(u[j] & 0xffff) - 0x1000000000000ll;
+
+		for (j = 0; j < n; j++) {
+			w = weights[i + j];
+			if (w) {
+				/*
+				 * divide by 16.16 fixed-point weight.  note
+				 * that the ln value is negative, so a larger
+				 * weight means a larger (less negative) value
+				 * for draw.
+				 */
+				draw = div64_s64(ln[j], w);
+			} else {
+				draw = S64_MIN;
+			}
 
-		if (i == 0 || draw > high_draw) {
-			high = i;
-			high_draw = draw;
+			if (i + j == 0 || draw > high_draw) {
+				high = i + j;
+				high_draw = draw;
+			}
 		}
 	}
 
@@ -349,7 +393,9 @@ static int bucket_straw2_choose(const struct crush_bucket_straw2 *bucket,
 
 static int crush_bucket_choose(const struct crush_bucket *in,
 			       struct crush_work_bucket *work,
-			       int x, int r)
+			       int x, int r,
+			       const struct crush_choose_arg *arg,
+			       int position)
 {
 	dprintk(" crush_bucket_choose %d x=%d r=%d\n", in->id, x, r);
 	BUG_ON(in->size == 0);
@@ -371,13 +417,22 @@ static int crush_bucket_choose(const struct crush_bucket *in,
 	case CRUSH_BUCKET_STRAW2:
 		return bucket_straw2_choose(
 			(const struct crush_bucket_straw2 *)in,
-			x, r);
+			x, r, arg, position);
 	default:
 		dprintk("unknown bucket %d alg %d\n", in->id, in->alg);
 		return in->items[0];
 	}
 }
 
+static const struct crush_choose_arg *get_choose_arg(
+	const struct crush_choose_arg_map *choose_args,
+	const struct crush_bucket *in)
+{
+	if (!choose_args || (__u32)(-1-in->id) >= choose_args->size)
+		return NULL;
+	return &choose_args->args[-1-in->id];
+}
+
 /*
  * true if device is marked "out" (failed, fully offloaded)
  * of the cluster
@@ -433,7 +488,8 @@ static int crush_choose_firstn(const struct crush_map *map,
 			       unsigned int vary_r,
 			       unsigned int stable,
 			       int *out2,
-			       int parent_r)
+			       int parent_r,
+			       const struct crush_choose_arg_map *choose_args)
 {
 	int rep;
 	unsigned int ftotal, flocal;
@@ -485,7 +541,9 @@ parent_r %d stable %d\n",
 				else
 					item = crush_bucket_choose(
 						in, work->work[-1-in->id],
-						x, r);
+						x, r,
+						get_choose_arg(choose_args, in),
+						outpos);
 				if (item >= map->max_devices) {
 					dprintk("   bad item %d\n", item);
 					skip_rep = 1;
@@ -542,7 +600,8 @@ parent_r %d stable %d\n",
 							    vary_r,
 							    stable,
 							    NULL,
-							    sub_r) <= outpos)
+							    sub_r,
+							    choose_args) <= outpos)
 							/* didn't get leaf */
 							reject = 1;
 					} else {
@@ -619,7 +678,8 @@ static void crush_choose_indep(const struct crush_map *map,
 			       unsigned int recurse_tries,
 			       int recurse_to_leaf,
 			       int *out2,
-			       int parent_r)
+			       int parent_r,
+			       const struct crush_choose_arg_map *choose_args)
 {
 	const struct crush_bucket *in = bucket;
 	int endpos = outpos + left;
@@ -691,7 +751,9 @@ static void crush_choose_indep(const struct crush_map *map,
 
 				item = crush_bucket_choose(
 					in, work->work[-1-in->id],
-					x, r);
+					x, r,
+					get_choose_arg(choose_args, in),
+					rep);
 				if (item >= map->max_devices) {
 					dprintk("   bad item %d\n", item);
 					out[rep] = CRUSH_ITEM_NONE;
@@ -745,7 +807,8 @@ static void crush_choose_indep(const struct crush_map *map,
 							x, 1, numrep, 0,
 							out2, rep,
 							recurse_tries, 0,
-							0, NULL, r);
+							0, NULL, r,
+							choose_args);
 						if (out2[rep] == CRUSH_ITEM_NONE) {
 							/* placed nothing; no leaf */
 							break;
@@ -850,11 +913,13 @@ void crush_init_workspace(const struct crush_map *m, void *v) {
  * @weight: weight vector (for map leaves)
  * @weight_max: size of weight vector
  * @cwin: Pointer to at least map->working_size bytes of memory or NULL.
+ * @choose_args: weights and ids to use instead of the buckets', or NULL
  */
 int crush_do_rule(const struct crush_map *map,
 		  int ruleno, int x, int *result, int result_max,
 		  const __u32 *weight, int weight_max,
-		  void *cwin)
+		  void *cwin,
+		  const struct crush_choose_arg_map *choose_args)
 {
 	int result_len;
 	struct crush_work *cw = cwin;
@@ -1009,7 +1074,8 @@ int crush_do_rule(const struct crush_map *map,
 						vary_r,
 						stable,
 						c+osize,
-						0);
+						0,
+						choose_args);
 				} else {
 					out_size = ((numrep < (result_max-osize)) ?
 						    numrep : (result_max-osize));
@@ -1026,7 +1092,8 @@ int crush_do_rule(const struct crush_map *map,
 						   choose_leaf_tries : 1,
 						recurse_to_leaf,
 						c+osize,
-						0);
+						0,
+						choose_args);
 					osize += out_size;
 				}
 			}
@@ -1060,3 +1127,36 @@ int crush_do_rule(const struct crush_map *map,
 
 	return result_len;
 }
+
+/**
+ * crush_do_rule_batch - calculate the mappings of many inputs with a rule
+ * @map: the crush_map
+ * @ruleno: the rule id
+ * @x: array of @n hash inputs
+ * @n: number of inputs
+ * @result: @n * @result_max items; the mapping of x[i] starts at
+ *          result + i * result_max
+ * @result_max: maximum result size of each mapping
+ * @result_len: array of @n result sizes
+ * @weight: weight vector (for map leaves)
+ * @weight_max: size of weight vector
+ * @cwin: workspace as for crush_do_rule, initialized once for the batch
+ * @choose_args: weights and ids to use instead of the buckets', or NULL
+ *
+ * Each mapping is the same as crush_do_rule() would return for x[i].
+ */
+void crush_do_rule_batch(const struct crush_map *map,
+			 int ruleno, const int *x, int n,
+			 int *result, int result_max, int *result_len,
+			 const __u32 *weight, int weight_max,
+			 void *cwin,
+			 const struct crush_choose_arg_map *choose_args)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		result_len[i] = crush_do_rule(map, ruleno, x[i],
+					      result + i * result_max,
+					      result_max, weight, weight_max,
+					      cwin, choose_args);
+}
@@ -67,7 +67,12 @@ extern int crush_find_rule(const struct crush_map *map, int ruleset, int type, i
  * @param result_max the size of the __result__ array
  * @param weights an array of weights of size __weight_max__
  * @param weight_max the size of the __weights__ array
+ * The __choose_args__ argument, if not NULL, replaces the weights
+ * (and optionally the hash inputs) of the straw2 buckets it covers,
+ * see crush_choose_arg.
+ *
  * @param cwin must be the value of crush_work_size(__map__, __result_max__)
+ * @param choose_args weights to use instead of the bucket weights, or NULL
  *
  * @return 0 on error or the size of __result__ on success
  */
@@ -75,7 +80,22 @@ extern int crush_do_rule(const struct crush_map *map,
 			 int ruleno,
 			 int x, int *result, int result_max,
 			 const __u32 *weights, int weight_max,
-			 void *cwin);
+			 void *cwin,
+			 const struct crush_choose_arg_map *choose_args);
+
+/** @ingroup API
+ *
+ * Map each of the __n__ values in __x__ as crush_do_rule() would,
+ * storing the mapping of __x[i]__ at __result + i * result_max__ and
+ * its size in __result_len[i]__.  The workspace __cwin__ is set up
+ * once for the whole batch instead of once per value.
+ */
+extern void crush_do_rule_batch(const struct crush_map *map,
+				int ruleno, const int *x, int n,
+				int *result, int result_max, int *result_len,
+				const __u32 *weights, int weight_max,
+				void *cwin,
+				const struct crush_choose_arg_map *choose_args);
 
 /* Returns the exact amount of workspace that will need to be used
    for a given combination of crush_map and result_max. The caller can
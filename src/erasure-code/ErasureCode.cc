@@ -175,6 +175,137 @@ int ErasureCode::decode_chunks(const set<int> &want_to_read,
   assert("ErasureCode::decode_chunks not implemented" == 0);
 }
 
+/// make bl a single aligned buffer of length bytes, keeping it if it is one
+static void reuse_aligned(bufferlist &bl, unsigned length, unsigned align)
+{
+  if (bl.length() == length && bl.is_contiguous() && bl.is_aligned(align))
+    return;
+  bl.clear();
+  bl.push_back(buffer::create_aligned(length, align));
+}
+
+int ErasureCode::encode_stripes(const set<int> &want_to_encode,
+				const bufferlist &in,
+				unsigned stripe_count,
+				map<int, bufferlist> *encoded)
+{
+  if (stripe_count == 0 || in.length() % stripe_count)
+    return -EINVAL;
+  unsigned int k = get_data_chunk_count();
+  unsigned int m = get_chunk_count() - k;
+  unsigned stripe_width = in.length() / stripe_count;
+  unsigned blocksize = get_chunk_size(stripe_width);
+  if (blocksize * k != stripe_width)
+    return -EINVAL;
+
+  if (!(get_supported_optimizations() & FLAG_EC_PLUGIN_MULTI_STRIPE)) {
+    map<int, bufferlist> out;
+    for (unsigned s = 0; s < stripe_count; s++) {
+      bufferlist stripe;
+      stripe.substr_of(in, s * stripe_width, stripe_width);
+      map<int, bufferlist> chunks;
+      int r = encode(want_to_encode, stripe, &chunks);
+      if (r)
+	return r;
+      for (map<int, bufferlist>::iterator i = chunks.begin();
+	   i != chunks.end();
+	   ++i)
+	out[i->first].claim_append(i->second);
+    }
+    encoded->swap(out);
+    return 0;
+  }
+
+  unsigned length = blocksize * stripe_count;
+  vector<char*> data(k);
+  for (unsigned int i = 0; i < k + m; i++) {
+    bufferlist &chunk = (*encoded)[chunk_index(i)];
+    reuse_aligned(chunk, length, SIMD_ALIGN);
+    if (i < k)
+      data[i] = chunk.c_str();
+  }
+  bufferlist::const_iterator p = in.begin();
+  for (unsigned s = 0; s < stripe_count; s++)
+    for (unsigned int i = 0; i < k; i++)
+      p.copy(blocksize, data[i] + s * blocksize);
+  int r = encode_chunks(want_to_encode, encoded);
+  if (r)
+    return r;
+  for (unsigned int i = 0; i < k + m; i++) {
+    if (want_to_encode.count(i) == 0)
+      encoded->erase(i);
+  }
+  return 0;
+}
+
+int ErasureCode::decode_stripes(const set<int> &want_to_read,
+				const map<int, bufferlist> &chunks,
+				unsigned stripe_count,
+				map<int, bufferlist> *decoded)
+{
+  if (chunks.empty() || stripe_count == 0)
+    return -EINVAL;
+  unsigned length = chunks.begin()->second.length();
+  if (length % stripe_count)
+    return -EINVAL;
+  for (map<int, bufferlist>::const_iterator i = chunks.begin();
+       i != chunks.end();
+       ++i) {
+    if (i->second.length() != length)
+      return -EINVAL;
+  }
+
+  if (!(get_supported_optimizations() & FLAG_EC_PLUGIN_MULTI_STRIPE)) {
+    unsigned blocksize = length / stripe_count;
+    map<int, bufferlist> out;
+    for (unsigned s = 0; s < stripe_count; s++) {
+      map<int, bufferlist> stripe;
+      for (map<int, bufferlist>::const_iterator i = chunks.begin();
+	   i != chunks.end();
+	   ++i)
+	stripe[i->first].substr_of(i->second, s * blocksize, blocksize);
+      map<int, bufferlist> stripe_decoded;
+      int r = decode(want_to_read, stripe, &stripe_decoded);
+      if (r)
+	return r;
+      for (set<int>::const_iterator i = want_to_read.begin();
+	   i != want_to_read.end();
+	   ++i)
+	out[*i].claim_append(stripe_decoded[*i]);
+    }
+    decoded->swap(out);
+    return 0;
+  }
+
+  // as decode(), keeping the buffers of the chunks to rebuild
+  bool have_all = true;
+  for (set<int>::const_iterator i = want_to_read.begin();
+       i != want_to_read.end();
+       ++i) {
+    if (chunks.find(*i) == chunks.end()) {
+      have_all = false;
+      break;
+    }
+  }
+  if (have_all) {
+    for (set<int>::const_iterator i = want_to_read.begin();
+	 i != want_to_read.end();
+	 ++i)
+      (*decoded)[*i] = chunks.find(*i)->second;
+    return 0;
+  }
+  for (unsigned int i = 0; i < get_chunk_count(); i++) {
+    map<int, bufferlist>::const_iterator c = chunks.find(i);
+    if (c == chunks.end()) {
+      reuse_aligned((*decoded)[i], length, SIMD_ALIGN);
+    } else {
+      (*decoded)[i] = c->second;
+      (*decoded)[i].rebuild_aligned(SIMD_ALIGN);
+    }
+  }
+  return decode_chunks(want_to_read, chunks, decoded);
+}
+
 int ErasureCode::parse(const ErasureCodeProfile &profile,
 		       ostream *ss)
 {
@@ -273,3 +404,78 @@ int ErasureCode::decode_concat(const map<int, bufferlist> &chunks,
   }
   return r;
 }
+
+int ErasureCode::encode_delta(const map<int, bufferlist> &old_data,
+			      const map<int, bufferlist> &new_data,
+			      map<int, bufferlist> *coding)
+{
+  if (!(get_supported_optimizations() & FLAG_EC_PLUGIN_PARITY_DELTA))
+    return -EOPNOTSUPP;
+  int k = get_data_chunk_count();
+  int n = get_chunk_count();
+  if (old_data.empty() ||
+      old_data.size() != new_data.size() ||
+      coding->size() != (unsigned)(n - k))
+    return -EINVAL;
+
+  unsigned blocksize = old_data.begin()->second.length();
+  map<int, bufferlist> deltas;
+  for (map<int, bufferlist>::const_iterator i = old_data.begin();
+       i != old_data.end();
+       ++i) {
+    map<int, bufferlist>::const_iterator j = new_data.find(i->first);
+    if (i->first < 0 || i->first >= k ||
+	j == new_data.end() ||
+	i->second.length() != blocksize ||
+	j->second.length() != blocksize)
+      return -EINVAL;
+    bufferptr delta(buffer::create_aligned(blocksize, SIMD_ALIGN));
+    j->second.copy(0, blocksize, delta.c_str());
+    bufferlist old(i->second);
+    const char *o = old.c_str();
+    char *d = delta.c_str();
+    for (unsigned b = 0; b < blocksize; ++b)
+      d[b] ^= o[b];
+    deltas[i->first].push_back(std::move(delta));
+  }
+  for (map<int, bufferlist>::iterator i = coding->begin();
+       i != coding->end();
+       ++i) {
+    if (i->first < k || i->first >= n ||
+	i->second.length() != blocksize)
+      return -EINVAL;
+    i->second.rebuild_aligned_size_and_memory(blocksize, SIMD_ALIGN);
+  }
+  return encode_delta_chunks(deltas, coding);
+}
+
+int ErasureCode::encode_delta_chunks(const map<int, bufferlist> &deltas,
+				     map<int, bufferlist> *coding)
+{
+  return -EOPNOTSUPP;
+}
+
+int ErasureCode::minimum_to_decode_sub_chunks(
+  const set<int> &want_to_read,
+  const set<int> &available,
+  map<int, vector<pair<int, int> > > *minimum)
+{
+  set<int> minimum_chunks;
+  int r = minimum_to_decode(want_to_read, available, &minimum_chunks);
+  if (r != 0)
+    return r;
+  vector<pair<int, int> > all(1, make_pair(0, get_sub_chunk_count()));
+  for (set<int>::iterator i = minimum_chunks.begin();
+       i != minimum_chunks.end();
+       ++i)
+    (*minimum)[*i] = all;
+  return 0;
+}
+
+int ErasureCode::decode_sub_chunks(const set<int> &want_to_read,
+				   const map<int, bufferlist> &chunks,
+				   map<int, bufferlist> *decoded,
+				   unsigned chunk_size)
+{
+  return decode(want_to_read, chunks, decoded);
+}
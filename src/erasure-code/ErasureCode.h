@@ -78,6 +78,16 @@ namespace ceph {
                               const map<int, bufferlist> &chunks,
                               map<int, bufferlist> *decoded);
 
+    virtual int encode_stripes(const set<int> &want_to_encode,
+			       const bufferlist &in,
+			       unsigned stripe_count,
+			       map<int, bufferlist> *encoded);
+
+    virtual int decode_stripes(const set<int> &want_to_read,
+			       const map<int, bufferlist> &chunks,
+			       unsigned stripe_count,
+			       map<int, bufferlist> *decoded);
+
     virtual const vector<int> &get_chunk_mapping() const;
 
     int to_mapping(const ErasureCodeProfile &profile,
@@ -104,6 +114,32 @@ namespace ceph {
     virtual int decode_concat(const map<int, bufferlist> &chunks,
 			      bufferlist *decoded);
 
+    virtual uint64_t get_supported_optimizations() const {
+      return 0;
+    }
+
+    virtual int encode_delta(const map<int, bufferlist> &old_data,
+			     const map<int, bufferlist> &new_data,
+			     map<int, bufferlist> *coding);
+
+    /// add the contribution of data chunk deltas (old ^ new) to coding
+    virtual int encode_delta_chunks(const map<int, bufferlist> &deltas,
+				    map<int, bufferlist> *coding);
+
+    virtual int get_sub_chunk_count() {
+      return 1;
+    }
+
+    virtual int minimum_to_decode_sub_chunks(
+      const set<int> &want_to_read,
+      const set<int> &available,
+      map<int, vector<pair<int, int> > > *minimum);
+
+    virtual int decode_sub_chunks(const set<int> &want_to_read,
+				  const map<int, bufferlist> &chunks,
+				  map<int, bufferlist> *decoded,
+				  unsigned chunk_size);
+
   protected:
     int parse(const ErasureCodeProfile &profile,
 	      ostream *ss);
@@ -400,6 +400,60 @@ namespace ceph {
                               const map<int, bufferlist> &chunks,
                               map<int, bufferlist> *decoded) = 0;
 
+    /**
+     * Encode the **stripe_count** stripes found one after the other
+     * in **in**, each of which must fill its chunks without padding.
+     * On success **encoded** maps at least all the chunk indexes of
+     * **want_to_encode** to the concatenation of that chunk of each
+     * stripe, which is what calling **encode** on every stripe and
+     * appending the results would give.
+     *
+     * If **encoded** already holds a contiguous, SIMD aligned buffer
+     * of the right length for a chunk, from a previous call, it is
+     * overwritten instead of allocating a new one.
+     *
+     * With FLAG_EC_PLUGIN_MULTI_STRIPE the stripes are gathered into
+     * one buffer per chunk and encoded by a single **encode_chunks**
+     * call; otherwise they are encoded one at a time.
+     *
+     * Returns -EINVAL if **in** is not **stripe_count** unpadded
+     * stripes, 0 on success.
+     *
+     * @param [in] want_to_encode chunk indexes to be encoded
+     * @param [in] in the stripes to be encoded
+     * @param [in] stripe_count the number of stripes in **in**
+     * @param [in,out] encoded map chunk indexes to chunk data
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int encode_stripes(const set<int> &want_to_encode,
+			       const bufferlist &in,
+			       unsigned stripe_count,
+			       map<int, bufferlist> *encoded) = 0;
+
+    /**
+     * Decode **want_to_read** from **chunks** that each hold that
+     * chunk of **stripe_count** stripes, one after the other, as
+     * returned by **encode_stripes**. On success **decoded** maps at
+     * least all the chunk indexes of **want_to_read** to the same
+     * concatenation.
+     *
+     * As with **encode_stripes**, contiguous and aligned buffers of
+     * the right length already in **decoded** are reused for the
+     * chunks that must be rebuilt, and codes with
+     * FLAG_EC_PLUGIN_MULTI_STRIPE decode all stripes in one
+     * **decode_chunks** call.
+     *
+     * @param [in] want_to_read chunk indexes to be decoded
+     * @param [in] chunks map chunk indexes to chunk data
+     * @param [in] stripe_count the number of stripes in each chunk
+     * @param [in,out] decoded map chunk indexes to chunk data
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int decode_stripes(const set<int> &want_to_read,
+			       const map<int, bufferlist> &chunks,
+			       unsigned stripe_count,
+			       map<int, bufferlist> *decoded) = 0;
+
     /**
      * Return the ordered list of chunks or an empty vector
      * if no remapping is necessary.
@@ -447,6 +501,109 @@ namespace ceph {
      */
     virtual int decode_concat(const map<int, bufferlist> &chunks,
 			      bufferlist *decoded) = 0;
+
+    /// capabilities returned by **get_supported_optimizations**
+    enum {
+      /// **encode_delta** can update coding chunks in place
+      FLAG_EC_PLUGIN_PARITY_DELTA = 1 << 0,
+      /// **encode_chunks** and **decode_chunks** of buffers holding
+      /// several stripes, one after the other, work on all of them
+      FLAG_EC_PLUGIN_MULTI_STRIPE = 1 << 1,
+    };
+
+    /**
+     * Return the FLAG_EC_PLUGIN_* optimizations the code supports.
+     *
+     * @return a bitmask of FLAG_EC_PLUGIN_* values
+     */
+    virtual uint64_t get_supported_optimizations() const = 0;
+
+    /**
+     * Update the **coding** chunks of a stripe after some of its
+     * data chunks changed from **old_data** to **new_data**, without
+     * the data chunks that did not change.
+     *
+     * This is only possible for linear codes, where each coding chunk
+     * is a weighted sum of the data chunks: coding[i] is updated by
+     * coef(i, j) * (new_data[j] - old_data[j]) for every changed j.
+     * It is available if **get_supported_optimizations** has
+     * FLAG_EC_PLUGIN_PARITY_DELTA.
+     *
+     * **old_data** and **new_data** must have the same data chunk
+     * indexes, **coding** must have all coding chunk indexes, and
+     * all buffers must have the same size. Indexes are the same as
+     * for **encode_chunks**.
+     *
+     * Returns 0 on success.
+     *
+     * @param [in] old_data map data chunk indexes to their old content
+     * @param [in] new_data map data chunk indexes to their new content
+     * @param [in,out] coding map coding chunk indexes to chunk data
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int encode_delta(const map<int, bufferlist> &old_data,
+			     const map<int, bufferlist> &new_data,
+			     map<int, bufferlist> *coding) = 0;
+
+    /**
+     * Return the number of sub-chunks each chunk is divided into.
+     *
+     * Regenerating codes split every chunk into sub-chunks of
+     * **get_chunk_size() / get_sub_chunk_count()** bytes so that a
+     * lost chunk can be rebuilt from a fraction of each helper chunk
+     * rather than from **get_data_chunk_count()** whole chunks. All
+     * other codes have a single sub-chunk.
+     *
+     * @return the number of sub-chunks per chunk
+     */
+    virtual int get_sub_chunk_count() = 0;
+
+    /**
+     * Compute the **available** chunks and, for each of them, the
+     * sub-chunks that need to be retrieved in order to decode
+     * **want_to_read**.
+     *
+     * Each sub-chunk range of **minimum** is a (first sub-chunk
+     * index, count) pair; a chunk that must be read whole maps to
+     * {(0, get_sub_chunk_count())}. The sub-chunks of a chunk are
+     * laid out consecutively, so a range covers bytes
+     * [first * S, (first + count) * S) of every chunk-sized stripe
+     * unit where **S** is **get_chunk_size() / get_sub_chunk_count()**.
+     *
+     * Returns -EIO if there are not enough chunk indexes in
+     * **available** to decode **want_to_read**.
+     *
+     * @param [in] want_to_read chunk indexes to be decoded
+     * @param [in] available chunk indexes containing valid data
+     * @param [out] minimum map chunk indexes to the sub-chunk ranges
+     *              to retrieve
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int minimum_to_decode_sub_chunks(
+      const set<int> &want_to_read,
+      const set<int> &available,
+      map<int, vector<pair<int, int> > > *minimum) = 0;
+
+    /**
+     * Decode **want_to_read** from the sub-chunks returned by
+     * **minimum_to_decode_sub_chunks**.
+     *
+     * Each buffer of **chunks** is the concatenation of the
+     * sub-chunk ranges that were asked for that chunk, in order. The
+     * buffers of **decoded** are **chunk_size** bytes long. When all
+     * of **chunks** hold whole chunks this is the same as
+     * **decode**.
+     *
+     * @param [in] want_to_read chunk indexes to be decoded
+     * @param [in] chunks map chunk indexes to sub-chunk data
+     * @param [out] decoded map chunk indexes to chunk data
+     * @param [in] chunk_size the size of a whole chunk
+     * @return **0** on success or a negative errno on error.
+     */
+    virtual int decode_sub_chunks(const set<int> &want_to_read,
+				  const map<int, bufferlist> &chunks,
+				  map<int, bufferlist> *decoded,
+				  unsigned chunk_size) = 0;
   };
 
   typedef ceph::shared_ptr<ErasureCodeInterface> ErasureCodeInterfaceRef;
@@ -0,0 +1,571 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph distributed storage system
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <errno.h>
+#include <algorithm>
+
+#include "common/debug.h"
+#include "ErasureCodeClay.h"
+#include "crush/CrushWrapper.h"
+#include "erasure-code/ErasureCodePlugin.h"
+#include "include/stringify.h"
+#include "osd/osd_types.h"
+
+#define DEFAULT_RULESET_ROOT "default"
+#define DEFAULT_RULESET_FAILURE_DOMAIN "host"
+
+#define dout_context g_ceph_context
+#define dout_subsys ceph_subsys_osd
+#undef dout_prefix
+#define dout_prefix _prefix(_dout)
+
+static ostream& _prefix(std::ostream* _dout)
+{
+  return *_dout << "ErasureCodeClay: ";
+}
+
+static int pow_int(int a, int x)
+{
+  int power = 1;
+  while (x) {
+    if (x & 1)
+      power *= a;
+    x /= 2;
+    a *= a;
+  }
+  return power;
+}
+
+static bufferlist sub_chunk(const bufferlist &chunk, int z, unsigned sc_size)
+{
+  bufferlist bl;
+  bl.substr_of(chunk, z * sc_size, sc_size);
+  return bl;
+}
+
+static bufferlist aligned_chunk(unsigned size, bool zero)
+{
+  bufferptr ptr(buffer::create_aligned(size, ErasureCode::SIMD_ALIGN));
+  if (zero)
+    ptr.zero();
+  bufferlist bl;
+  bl.push_back(std::move(ptr));
+  return bl;
+}
+
+int ErasureCodeClay::create_ruleset(const string &name,
+				    CrushWrapper &crush,
+				    ostream *ss) const
+{
+  int ruleid = crush.add_simple_ruleset(name, ruleset_root,
+					ruleset_failure_domain, "indep",
+					pg_pool_t::TYPE_ERASURE, ss);
+  if (ruleid < 0)
+    return ruleid;
+  crush.set_rule_mask_max_size(ruleid, get_chunk_count());
+  return crush.get_rule_mask_ruleset(ruleid);
+}
+
+int ErasureCodeClay::init(ErasureCodeProfile &profile, ostream *ss)
+{
+  int r = parse(profile, ss);
+  if (r)
+    return r;
+  r = ErasureCode::init(profile, ss);
+  if (r)
+    return r;
+  ErasureCodePluginRegistry &registry = ErasureCodePluginRegistry::instance();
+  r = registry.factory(mds.profile["plugin"], directory, mds.profile,
+		       &mds.erasure_code, ss);
+  if (r)
+    return r;
+  return registry.factory(pft.profile["plugin"], directory, pft.profile,
+			  &pft.erasure_code, ss);
+}
+
+int ErasureCodeClay::parse(ErasureCodeProfile &profile, ostream *ss)
+{
+  int err = ErasureCode::parse(profile, ss);
+  err |= to_int("k", profile, &k, DEFAULT_K, ss);
+  err |= to_int("m", profile, &m, DEFAULT_M, ss);
+  err |= sanity_check_k(k, ss);
+  if (m < 1) {
+    *ss << "m=" << m << " must be >= 1" << std::endl;
+    return -EINVAL;
+  }
+  err |= to_int("d", profile, &d, stringify(k + m - 1), ss);
+  if (d < k || d > k + m - 1) {
+    *ss << "d=" << d << " must be within [" << k << ", " << k + m - 1
+	<< "], set to " << k + m - 1 << std::endl;
+    profile["d"] = stringify(k + m - 1);
+    d = k + m - 1;
+    err = -EINVAL;
+  }
+
+  std::string scalar_mds, technique;
+  err |= to_string("scalar_mds", profile, &scalar_mds, "jerasure", ss);
+  if (scalar_mds == "jerasure") {
+    err |= to_string("technique", profile, &technique, "reed_sol_van", ss);
+    if (technique != "reed_sol_van") {
+      *ss << "technique=" << technique << " is not supported by clay with"
+	  << " scalar_mds=jerasure, use reed_sol_van" << std::endl;
+      return -EINVAL;
+    }
+  } else if (scalar_mds == "isa") {
+    err |= to_string("technique", profile, &technique, "reed_sol_van", ss);
+    if (technique != "reed_sol_van" && technique != "cauchy") {
+      *ss << "technique=" << technique << " is not supported by clay with"
+	  << " scalar_mds=isa, use reed_sol_van or cauchy" << std::endl;
+      return -EINVAL;
+    }
+  } else {
+    *ss << "scalar_mds=" << scalar_mds << " is not supported, use one of"
+	<< " jerasure, isa" << std::endl;
+    return -ENOENT;
+  }
+  err |= to_string("ruleset-root", profile, &ruleset_root,
+		   DEFAULT_RULESET_ROOT, ss);
+  err |= to_string("ruleset-failure-domain", profile,
+		   &ruleset_failure_domain,
+		   DEFAULT_RULESET_FAILURE_DOMAIN, ss);
+
+  q = d - k + 1;
+  nu = (k + m) % q ? q - (k + m) % q : 0;
+  // the scalar code works over GF(2^8)
+  if (k + m + nu > 254) {
+    *ss << "k + m + nu=" << k + m + nu << " must be <= 254" << std::endl;
+    return -EINVAL;
+  }
+  t = (k + m + nu) / q;
+  sub_chunk_no = pow_int(q, t);
+
+  mds.profile["plugin"] = scalar_mds;
+  mds.profile["technique"] = technique;
+  mds.profile["k"] = stringify(k + nu);
+  mds.profile["m"] = stringify(m);
+  mds.profile["w"] = DEFAULT_W;
+  pft.profile["plugin"] = scalar_mds;
+  pft.profile["technique"] = technique;
+  pft.profile["k"] = "2";
+  pft.profile["m"] = "2";
+  pft.profile["w"] = DEFAULT_W;
+
+  dout(10) << __func__ << " k=" << k << " m=" << m << " d=" << d
+	   << " q=" << q << " t=" << t << " nu=" << nu
+	   << " sub_chunk_no=" << sub_chunk_no << dendl;
+  return err;
+}
+
+unsigned int ErasureCodeClay::get_chunk_size(unsigned int object_size) const
+{
+  // every sub-chunk must suit both scalar codes; their alignments are
+  // powers of two
+  unsigned sc_alignment = std::max(mds.erasure_code->get_chunk_size(1),
+				   pft.erasure_code->get_chunk_size(1));
+  unsigned alignment = sub_chunk_no * k * sc_alignment;
+  return ((object_size + alignment - 1) / alignment) * alignment / k;
+}
+
+bool ErasureCodeClay::is_repair(const set<int> &want_to_read,
+				const set<int> &available) const
+{
+  if (includes(available.begin(), available.end(),
+	       want_to_read.begin(), want_to_read.end()))
+    return false;
+  if (want_to_read.size() != 1)
+    return false;
+  // every other node of the lost node's column must help
+  int lost_node = node_of(*want_to_read.begin());
+  int y = lost_node / q;
+  for (int x = 0; x < q; x++) {
+    int node = y * q + x;
+    if (node == lost_node || is_shortened(node))
+      continue;
+    if (!available.count(chunk_of(node)))
+      return false;
+  }
+  return available.size() >= (unsigned)d;
+}
+
+void ErasureCodeClay::get_repair_subchunks(
+  int lost_node,
+  vector<pair<int, int> > *repair_sub_chunks) const
+{
+  // the planes whose y-th digit is x: runs of q^(t-1-y) consecutive
+  // planes, one every q^(t-y)
+  int x = lost_node % q;
+  int y = lost_node / q;
+  int seq_sc_count = pow_int(q, t - 1 - y);
+  int num_seq = pow_int(q, y);
+  int index = x * seq_sc_count;
+  for (int i = 0; i < num_seq; i++) {
+    repair_sub_chunks->push_back(make_pair(index, seq_sc_count));
+    index += q * seq_sc_count;
+  }
+}
+
+int ErasureCodeClay::get_repair_sub_chunk_count() const
+{
+  return sub_chunk_no / q;
+}
+
+int ErasureCodeClay::minimum_to_decode_sub_chunks(
+  const set<int> &want_to_read,
+  const set<int> &available,
+  map<int, vector<pair<int, int> > > *minimum)
+{
+  if (is_repair(want_to_read, available))
+    return minimum_to_repair(want_to_read, available, minimum);
+  return ErasureCode::minimum_to_decode_sub_chunks(want_to_read, available,
+						   minimum);
+}
+
+int ErasureCodeClay::minimum_to_repair(
+  const set<int> &want_to_read,
+  const set<int> &available,
+  map<int, vector<pair<int, int> > > *minimum) const
+{
+  int lost_node = node_of(*want_to_read.begin());
+  vector<pair<int, int> > sub_chunks;
+  get_repair_subchunks(lost_node, &sub_chunks);
+  int y = lost_node / q;
+  for (int x = 0; x < q; x++) {
+    int node = y * q + x;
+    if (node != lost_node && !is_shortened(node))
+      (*minimum)[chunk_of(node)] = sub_chunks;
+  }
+  for (set<int>::const_iterator i = available.begin();
+       i != available.end() && minimum->size() < (unsigned)d;
+       ++i) {
+    if (!minimum->count(*i))
+      (*minimum)[*i] = sub_chunks;
+  }
+  if (minimum->size() != (unsigned)d)
+    return -EIO;
+  return 0;
+}
+
+int ErasureCodeClay::encode_chunks(const set<int> &want_to_encode,
+				   map<int, bufferlist> *encoded)
+{
+  unsigned size = encoded->begin()->second.length();
+  map<int, bufferlist> coupled;
+  set<int> parity;
+  for (int i = 0; i < k + m; i++) {
+    bufferlist &chunk = (*encoded)[i];
+    if (!chunk.is_contiguous())
+      chunk.rebuild_aligned_size_and_memory(size, SIMD_ALIGN);
+    coupled[node_of(i)] = chunk;
+    if (i >= k)
+      parity.insert(node_of(i));
+  }
+  for (int i = k; i < k + nu; i++)
+    coupled[i] = aligned_chunk(size, true);
+  return decode_layered(parity, &coupled);
+}
+
+int ErasureCodeClay::decode_chunks(const set<int> &want_to_read,
+				   const map<int, bufferlist> &chunks,
+				   map<int, bufferlist> *decoded)
+{
+  unsigned size = decoded->begin()->second.length();
+  map<int, bufferlist> coupled;
+  set<int> erased;
+  for (int i = 0; i < k + m; i++) {
+    bufferlist &chunk = (*decoded)[i];
+    if (!chunk.is_contiguous())
+      chunk.rebuild_aligned_size_and_memory(size, SIMD_ALIGN);
+    coupled[node_of(i)] = chunk;
+    if (!chunks.count(i))
+      erased.insert(node_of(i));
+  }
+  if (erased.size() > (unsigned)m)
+    return -EIO;
+  for (int i = k; i < k + nu; i++)
+    coupled[i] = aligned_chunk(size, true);
+  return decode_layered(erased, &coupled);
+}
+
+int ErasureCodeClay::decode_sub_chunks(const set<int> &want_to_read,
+				       const map<int, bufferlist> &chunks,
+				       map<int, bufferlist> *decoded,
+				       unsigned chunk_size)
+{
+  set<int> available;
+  for (map<int, bufferlist>::const_iterator i = chunks.begin();
+       i != chunks.end();
+       ++i)
+    available.insert(i->first);
+  if (is_repair(want_to_read, available) &&
+      chunks.begin()->second.length() < chunk_size)
+    return repair(want_to_read, chunks, decoded, chunk_size);
+  return decode(want_to_read, chunks, decoded);
+}
+
+void ErasureCodeClay::get_plane_vector(int z, vector<int> *z_vec) const
+{
+  z_vec->resize(t);
+  for (int i = 0; i < t; i++) {
+    (*z_vec)[t - 1 - i] = z % q;
+    z /= q;
+  }
+}
+
+/**
+ * Solve the pairwise transform of node at plane z and its companion
+ * for unknown1 and unknown2 (PAIR_*), given the other two sub-chunks.
+ * The node with the larger x comes first in the [4, 2] code: coupled
+ * sub-chunks are its data, uncoupled ones its coding.
+ */
+void ErasureCodeClay::pair_transform(map<int, bufferlist> &coupled,
+				     vector<bufferlist> &uncoupled,
+				     int node, int z, unsigned sc_size,
+				     int unknown1, int unknown2)
+{
+  vector<int> z_vec;
+  get_plane_vector(z, &z_vec);
+  int x = node % q;
+  int y = node / q;
+  int z_y = z_vec[y];
+  assert(z_y != x);
+  int companion = y * q + z_y;
+  int companion_z = z + (x - z_y) * pow_int(q, t - 1 - y);
+
+  bufferlist sub[4];
+  sub[PAIR_C] = sub_chunk(coupled[node], z, sc_size);
+  sub[PAIR_C_COMPANION] = sub_chunk(coupled[companion], companion_z, sc_size);
+  sub[PAIR_U] = sub_chunk(uncoupled[node], z, sc_size);
+  sub[PAIR_U_COMPANION] = sub_chunk(uncoupled[companion], companion_z,
+				    sc_size);
+  // PAIR_* to the position in the pairwise transform
+  int flip = x < z_y ? 1 : 0;
+  map<int, bufferlist> known, all;
+  set<int> want;
+  for (int i = 0; i < 4; i++) {
+    all[i ^ flip] = sub[i];
+    if (i == unknown1 || i == unknown2)
+      want.insert(i ^ flip);
+    else
+      known[i ^ flip] = sub[i];
+  }
+  int r = pft.erasure_code->decode_chunks(want, known, &all);
+  assert(r == 0);
+}
+
+void ErasureCodeClay::decode_uncoupled(const set<int> &erased, int z,
+				       unsigned sc_size,
+				       vector<bufferlist> &uncoupled)
+{
+  map<int, bufferlist> known, all;
+  for (int i = 0; i < q * t; i++) {
+    all[i] = sub_chunk(uncoupled[i], z, sc_size);
+    if (!erased.count(i))
+      known[i] = all[i];
+  }
+  int r = mds.erasure_code->decode_chunks(erased, known, &all);
+  assert(r == 0);
+}
+
+int ErasureCodeClay::decode_layered(set<int> &erased,
+				    map<int, bufferlist> *coupled)
+{
+  assert(!erased.empty());
+  assert(erased.size() <= (unsigned)m);
+  // each plane is decoded with exactly m erasures: recompute parity
+  // nodes into scratch buffers rather than into the caller's chunks
+  unsigned size = coupled->begin()->second.length();
+  for (int i = k + nu; erased.size() < (unsigned)m && i < q * t; i++) {
+    if (erased.insert(i).second)
+      (*coupled)[i] = aligned_chunk(size, false);
+  }
+  assert(size % sub_chunk_no == 0);
+  unsigned sc_size = size / sub_chunk_no;
+
+  vector<bufferlist> uncoupled(q * t);
+  for (int i = 0; i < q * t; i++)
+    uncoupled[i] = aligned_chunk(size, false);
+
+  // planes by the number of erased nodes unpaired in them: the
+  // companions a plane needs are recovered in planes of lower score
+  vector<int> z_vec;
+  map<int, vector<int> > ordered_planes;
+  for (int z = 0; z < sub_chunk_no; z++) {
+    get_plane_vector(z, &z_vec);
+    int score = 0;
+    for (set<int>::iterator i = erased.begin(); i != erased.end(); ++i) {
+      if (*i % q == z_vec[*i / q])
+	score++;
+    }
+    ordered_planes[score].push_back(z);
+  }
+
+  for (map<int, vector<int> >::iterator p = ordered_planes.begin();
+       p != ordered_planes.end();
+       ++p) {
+    for (vector<int>::iterator z = p->second.begin();
+	 z != p->second.end();
+	 ++z) {
+      get_plane_vector(*z, &z_vec);
+      for (int node = 0; node < q * t; node++) {
+	if (erased.count(node))
+	  continue;
+	if (node % q == z_vec[node / q])
+	  (*coupled)[node].copy(*z * sc_size, sc_size,
+				uncoupled[node].c_str() + *z * sc_size);
+	else
+	  pair_transform(*coupled, uncoupled, node, *z, sc_size,
+			 PAIR_U, PAIR_U_COMPANION);
+      }
+      decode_uncoupled(erased, *z, sc_size, uncoupled);
+    }
+    for (vector<int>::iterator z = p->second.begin();
+	 z != p->second.end();
+	 ++z) {
+      get_plane_vector(*z, &z_vec);
+      for (set<int>::iterator i = erased.begin(); i != erased.end(); ++i) {
+	int x = *i % q;
+	int y = *i / q;
+	int companion = y * q + z_vec[y];
+	if (x == z_vec[y]) {
+	  uncoupled[*i].copy(*z * sc_size, sc_size,
+			     (*coupled)[*i].c_str() + *z * sc_size);
+	} else if (!erased.count(companion)) {
+	  pair_transform(*coupled, uncoupled, *i, *z, sc_size,
+			 PAIR_C, PAIR_U_COMPANION);
+	} else if (z_vec[y] < x) {
+	  // both erased: once per pair, from both uncoupled sub-chunks
+	  pair_transform(*coupled, uncoupled, *i, *z, sc_size,
+			 PAIR_C, PAIR_C_COMPANION);
+	}
+      }
+    }
+  }
+  return 0;
+}
+
+int ErasureCodeClay::repair(const set<int> &want_to_read,
+			    const map<int, bufferlist> &chunks,
+			    map<int, bufferlist> *decoded,
+			    unsigned chunk_size)
+{
+  assert(chunk_size % sub_chunk_no == 0);
+  unsigned sc_size = chunk_size / sub_chunk_no;
+  int lost_node = node_of(*want_to_read.begin());
+  int y = lost_node / q;
+  vector<pair<int, int> > sub_chunks;
+  get_repair_subchunks(lost_node, &sub_chunks);
+
+  // lay the helpers' sub-chunks out at their planes
+  map<int, bufferlist> coupled;
+  for (int node = 0; node < q * t; node++)
+    coupled[node] = aligned_chunk(chunk_size, is_shortened(node));
+  for (map<int, bufferlist>::const_iterator i = chunks.begin();
+       i != chunks.end();
+       ++i) {
+    if (i->second.length() !=
+	(unsigned)get_repair_sub_chunk_count() * sc_size) {
+      derr << __func__ << " chunk " << i->first << " is "
+	   << i->second.length() << " bytes, expected "
+	   << get_repair_sub_chunk_count() * sc_size << dendl;
+      return -EINVAL;
+    }
+    char *dst = coupled[node_of(i->first)].c_str();
+    unsigned off = 0;
+    for (vector<pair<int, int> >::iterator r = sub_chunks.begin();
+	 r != sub_chunks.end();
+	 ++r) {
+      i->second.copy(off, r->second * sc_size, dst + r->first * sc_size);
+      off += r->second * sc_size;
+    }
+  }
+
+  // in the repair planes the lost node and its column are unknown, as
+  // are the nodes that did not help
+  set<int> aloof, erased;
+  for (int node = 0; node < q * t; node++) {
+    if (node == lost_node || is_shortened(node) ||
+	chunks.count(chunk_of(node)))
+      continue;
+    aloof.insert(node);
+    erased.insert(node);
+  }
+  for (int x = 0; x < q; x++)
+    erased.insert(y * q + x);
+  if (erased.size() > (unsigned)m)
+    return -EIO;
+
+  vector<bufferlist> uncoupled(q * t);
+  for (int i = 0; i < q * t; i++)
+    uncoupled[i] = aligned_chunk(chunk_size, false);
+
+  // a helper coupled with an aloof node needs the latter's uncoupled
+  // sub-chunk, decoded in a plane where fewer aloof nodes are unpaired
+  vector<int> z_vec;
+  map<int, vector<int> > ordered_planes;
+  for (vector<pair<int, int> >::iterator r = sub_chunks.begin();
+       r != sub_chunks.end();
+       ++r) {
+    for (int z = r->first; z < r->first + r->second; z++) {
+      get_plane_vector(z, &z_vec);
+      int score = 0;
+      for (set<int>::iterator i = aloof.begin(); i != aloof.end(); ++i) {
+	if (*i % q == z_vec[*i / q])
+	  score++;
+      }
+      ordered_planes[score].push_back(z);
+    }
+  }
+
+  for (map<int, vector<int> >::iterator p = ordered_planes.begin();
+       p != ordered_planes.end();
+       ++p) {
+    for (vector<int>::iterator z = p->second.begin();
+	 z != p->second.end();
+	 ++z) {
+      get_plane_vector(*z, &z_vec);
+      for (int node = 0; node < q * t; node++) {
+	if (erased.count(node))
+	  continue;
+	int companion = (node / q) * q + z_vec[node / q];
+	if (node == companion)
+	  coupled[node].copy(*z * sc_size, sc_size,
+			     uncoupled[node].c_str() + *z * sc_size);
+	else if (aloof.count(companion))
+	  pair_transform(coupled, uncoupled, node, *z, sc_size,
+			 PAIR_C_COMPANION, PAIR_U);
+	else
+	  pair_transform(coupled, uncoupled, node, *z, sc_size,
+			 PAIR_U, PAIR_U_COMPANION);
+      }
+      decode_uncoupled(erased, *z, sc_size, uncoupled);
+    }
+  }
+
+  // the lost node is unpaired in the repair planes; in every other
+  // plane it is coupled with a column member at a repair plane
+  for (vector<pair<int, int> >::iterator r = sub_chunks.begin();
+       r != sub_chunks.end();
+       ++r) {
+    for (int z = r->first; z < r->first + r->second; z++) {
+      uncoupled[lost_node].copy(z * sc_size, sc_size,
+				coupled[lost_node].c_str() + z * sc_size);
+      for (int x = 0; x < q; x++) {
+	int node = y * q + x;
+	if (node != lost_node)
+	  pair_transform(coupled, uncoupled, node, z, sc_size,
+			 PAIR_C_COMPANION, PAIR_U_COMPANION);
+      }
+    }
+  }
+  (*decoded)[*want_to_read.begin()] = coupled[lost_node];
+  return 0;
+}
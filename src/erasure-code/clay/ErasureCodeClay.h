@@ -0,0 +1,154 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph distributed storage system
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ */
+
+#ifndef CEPH_ERASURE_CODE_CLAY_H
+#define CEPH_ERASURE_CODE_CLAY_H
+
+#include "include/assert.h"
+#include "erasure-code/ErasureCode.h"
+
+/**
+ * Coupled-layer (Clay) minimum-storage regenerating code, after
+ * Vajha et al., "Clay Codes: Moulding MDS Codes to Yield an MSR
+ * Code", FAST '18.
+ *
+ * The k + m chunks, plus nu zero-filled "shortened" chunks so that
+ * q = d - k + 1 divides their number, are laid out on a q x t grid:
+ * the node at (x, y) is chunk y * q + x (parity chunks are shifted
+ * up by nu). Every chunk is divided into q^t sub-chunks, one per
+ * plane; plane z is identified by its t base-q digits z_0 .. z_{t-1}.
+ *
+ * In plane z, the node (x, y) is unpaired if x == z_y; otherwise it
+ * is coupled with the node (z_y, y) in the plane whose y-th digit is
+ * x. The stored (coupled) sub-chunks of a pair are turned into
+ * uncoupled ones by a [4, 2] MDS pairwise transform, and the
+ * uncoupled sub-chunks of each plane form a codeword of a scalar
+ * (k + nu, m) MDS code. Both codes are loaded from the **scalar_mds**
+ * plugin.
+ *
+ * A single lost chunk is rebuilt from d helpers, reading from each
+ * only the q^(t-1) sub-chunks of the planes where the lost node is
+ * unpaired, i.e. d / (d - k + 1) chunks worth of data instead of k.
+ */
+class ErasureCodeClay : public ErasureCode {
+public:
+  std::string DEFAULT_K{"4"};
+  std::string DEFAULT_M{"2"};
+  std::string DEFAULT_W{"8"};
+  int k = 0, m = 0, d = 0, w = 8;
+  int q = 0, t = 0, nu = 0;
+  int sub_chunk_no = 0;
+  std::string directory;
+  std::string ruleset_root;
+  std::string ruleset_failure_domain;
+
+  struct ScalarMDS {
+    ErasureCodeInterfaceRef erasure_code;
+    ErasureCodeProfile profile;
+  };
+  ScalarMDS mds;  ///< (k + nu, m) code of the uncoupled planes
+  ScalarMDS pft;  ///< (2, 2) pairwise transform
+
+  explicit ErasureCodeClay(const std::string &dir)
+    : directory(dir)
+  {}
+
+  virtual ~ErasureCodeClay() {}
+
+  virtual int create_ruleset(const string &name,
+			     CrushWrapper &crush,
+			     ostream *ss) const;
+
+  virtual unsigned int get_chunk_count() const {
+    return k + m;
+  }
+
+  virtual unsigned int get_data_chunk_count() const {
+    return k;
+  }
+
+  virtual int get_sub_chunk_count() {
+    return sub_chunk_no;
+  }
+
+  virtual unsigned int get_chunk_size(unsigned int object_size) const;
+
+  virtual int minimum_to_decode_sub_chunks(
+    const set<int> &want_to_read,
+    const set<int> &available,
+    map<int, vector<pair<int, int> > > *minimum);
+
+  virtual int encode_chunks(const set<int> &want_to_encode,
+			    map<int, bufferlist> *encoded);
+
+  virtual int decode_chunks(const set<int> &want_to_read,
+			    const map<int, bufferlist> &chunks,
+			    map<int, bufferlist> *decoded);
+
+  virtual int decode_sub_chunks(const set<int> &want_to_read,
+				const map<int, bufferlist> &chunks,
+				map<int, bufferlist> *decoded,
+				unsigned chunk_size);
+
+  virtual int init(ErasureCodeProfile &profile, ostream *ss);
+
+  /// true if want_to_read is a single chunk that d helpers can repair
+  bool is_repair(const set<int> &want_to_read,
+		 const set<int> &available) const;
+
+  /// (first, count) ranges of the sub-chunks that repair a node
+  void get_repair_subchunks(int lost_node,
+			    vector<pair<int, int> > *repair_sub_chunks) const;
+
+  int get_repair_sub_chunk_count() const;
+
+protected:
+  virtual int parse(ErasureCodeProfile &profile, ostream *ss);
+
+private:
+  /// what a pair_transform() call solves for
+  enum {
+    PAIR_C = 0,            ///< the node's coupled sub-chunk
+    PAIR_C_COMPANION = 1,  ///< its companion's coupled sub-chunk
+    PAIR_U = 2,            ///< the node's uncoupled sub-chunk
+    PAIR_U_COMPANION = 3,  ///< its companion's uncoupled sub-chunk
+  };
+
+  int node_of(int chunk) const {
+    return chunk < k ? chunk : chunk + nu;
+  }
+  int chunk_of(int node) const {
+    return node < k ? node : node - nu;
+  }
+  bool is_shortened(int node) const {
+    return node >= k && node < k + nu;
+  }
+
+  int minimum_to_repair(const set<int> &want_to_read,
+			const set<int> &available,
+			map<int, vector<pair<int, int> > > *minimum) const;
+  int repair(const set<int> &want_to_read,
+	     const map<int, bufferlist> &chunks,
+	     map<int, bufferlist> *decoded,
+	     unsigned chunk_size);
+
+  void get_plane_vector(int z, vector<int> *z_vec) const;
+  int decode_layered(set<int> &erased, map<int, bufferlist> *coupled);
+  void decode_uncoupled(const set<int> &erased, int z, unsigned sc_size,
+			vector<bufferlist> &uncoupled);
+  void pair_transform(map<int, bufferlist> &coupled,
+		      vector<bufferlist> &uncoupled,
+		      int node, int z, unsigned sc_size,
+		      int unknown1, int unknown2);
+};
+
+#endif
@@ -157,6 +157,37 @@ ErasureCodeIsaDefault::isa_encode(char **data,
 
 // -----------------------------------------------------------------------------
 
+int
+ErasureCodeIsaDefault::encode_delta_chunks(const map<int, bufferlist> &deltas,
+                                           map<int, bufferlist> *coding)
+{
+  unsigned char *parity[m];
+  for (int i = 0; i < m; i++)
+    parity[i] = (unsigned char*) (*coding)[k + i].c_str();
+
+  for (map<int, bufferlist>::const_iterator i = deltas.begin();
+       i != deltas.end();
+       ++i) {
+    bufferlist delta(i->second);
+    unsigned char *src = (unsigned char*) delta.c_str();
+    int blocksize = delta.length();
+    if (m == 1) {
+      // single parity stripe
+      unsigned words = blocksize / EC_ISA_VECTOR_OP_WORDSIZE;
+      unsigned aligned = words * EC_ISA_VECTOR_OP_WORDSIZE;
+      vector_xor((vector_op_t*) src, (vector_op_t*) parity[0],
+                 (vector_op_t*) src + words);
+      byte_xor(src + aligned, parity[0] + aligned, src + blocksize);
+    } else {
+      ec_encode_data_update(blocksize, k, m, i->first, encode_tbls,
+                            src, parity);
+    }
+  }
+  return 0;
+}
+
+// -----------------------------------------------------------------------------
+
 bool
 ErasureCodeIsaDefault::erasure_contains(int *erasures, int i)
 {
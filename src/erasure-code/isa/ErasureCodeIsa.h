@@ -148,6 +148,14 @@ public:
                           char **coding,
                           int blocksize);
 
+  virtual uint64_t get_supported_optimizations() const
+  {
+    return FLAG_EC_PLUGIN_PARITY_DELTA | FLAG_EC_PLUGIN_MULTI_STRIPE;
+  }
+
+  virtual int encode_delta_chunks(const map<int, bufferlist> &deltas,
+                                  map<int, bufferlist> *coding);
+
   virtual bool erasure_contains(int *erasures, int i);
 
   virtual int isa_decode(int *erasures,
@@ -150,6 +150,45 @@ int ErasureCodeJerasure::decode_chunks(const set<int> &want_to_read,
   return jerasure_decode(erasures, data, coding, blocksize);
 }
 
+int ErasureCodeJerasure::matrix_encode_delta(const int *matrix,
+					     const map<int, bufferlist> &deltas,
+					     map<int, bufferlist> *coding)
+{
+  for (map<int, bufferlist>::const_iterator i = deltas.begin();
+       i != deltas.end();
+       ++i) {
+    bufferlist delta(i->second);
+    char *src = delta.c_str();
+    int blocksize = delta.length();
+    for (map<int, bufferlist>::iterator j = coding->begin();
+	 j != coding->end();
+	 ++j) {
+      int coef = matrix[(j->first - k) * k + i->first];
+      char *dst = j->second.c_str();
+      if (coef == 0)
+	continue;
+      if (coef == 1) {
+	galois_region_xor(src, dst, blocksize);
+	continue;
+      }
+      switch (w) {
+      case 8:
+	galois_w08_region_multiply(src, coef, blocksize, dst, 1);
+	break;
+      case 16:
+	galois_w16_region_multiply(src, coef, blocksize, dst, 1);
+	break;
+      case 32:
+	galois_w32_region_multiply(src, coef, blocksize, dst, 1);
+	break;
+      default:
+	return -EOPNOTSUPP;
+      }
+    }
+  }
+  return 0;
+}
+
 bool ErasureCodeJerasure::is_prime(int value)
 {
   int prime55[] = {
@@ -165,6 +204,80 @@ bool ErasureCodeJerasure::is_prime(int value)
   return false;
 }
 
+ErasureCodeJerasure::decoding_table_ref
+ErasureCodeJerasure::get_decoding_table(int *matrix, int *erased)
+{
+  // the table only depends on which chunks are gone
+  string signature(erased, erased + k + m);
+  Mutex::Locker l(decoding_tables_lock);
+  lru_map_t::iterator i = decoding_tables.find(signature);
+  if (i != decoding_tables.end()) {
+    decoding_tables_lru.splice(decoding_tables_lru.begin(),
+			       decoding_tables_lru, i->second.first);
+    return i->second.second;
+  }
+
+  decoding_table_ref table(new decoding_table_t);
+  table->matrix.resize(k * k);
+  table->ids.resize(k);
+  if (jerasure_make_decoding_matrix(k, m, w, matrix, erased,
+				    &table->matrix[0], &table->ids[0]) < 0)
+    return decoding_table_ref();
+
+  if (decoding_tables.size() >= decoding_tables_lru_length) {
+    decoding_tables.erase(decoding_tables_lru.back());
+    decoding_tables_lru.pop_back();
+  }
+  decoding_tables_lru.push_front(signature);
+  decoding_tables[signature] = make_pair(decoding_tables_lru.begin(), table);
+  return table;
+}
+
+int ErasureCodeJerasure::matrix_decode(int *matrix,
+				       int *erasures,
+				       char **data,
+				       char **coding,
+				       int blocksize)
+{
+  if (w != 8 && w != 16 && w != 32)
+    return -1;
+
+  int erased[k + m];
+  memset(erased, 0, sizeof(erased));
+  int data_erased = 0;
+  int coding_erased = 0;
+  for (int *e = erasures; *e != -1; ++e) {
+    if (erased[*e])
+      continue;
+    erased[*e] = 1;
+    if (*e < k)
+      data_erased++;
+    else
+      coding_erased++;
+  }
+  if (data_erased + coding_erased > m)
+    return -1;
+
+  if (data_erased) {
+    decoding_table_ref table = get_decoding_table(matrix, erased);
+    if (!table)
+      return -1;
+    for (int i = 0; i < k; i++) {
+      if (erased[i])
+	jerasure_matrix_dotprod(k, w, &table->matrix[i * k], &table->ids[0],
+				i, data, coding, blocksize);
+    }
+  }
+
+  // every data chunk is there now, re-encode the coding chunks
+  for (int i = 0; i < m; i++) {
+    if (erased[k + i])
+      jerasure_matrix_dotprod(k, w, matrix + (i * k), NULL, i + k,
+			      data, coding, blocksize);
+  }
+  return 0;
+}
+
 // 
 // ErasureCodeJerasureReedSolomonVandermonde
 //
@@ -180,8 +293,7 @@ int ErasureCodeJerasureReedSolomonVandermonde::jerasure_decode(int *erasures,
                                                                 char **coding,
                                                                 int blocksize)
 {
-  return jerasure_matrix_decode(k, m, w, matrix, 1,
-				erasures, data, coding, blocksize);
+  return matrix_decode(matrix, erasures, data, coding, blocksize);
 }
 
 unsigned ErasureCodeJerasureReedSolomonVandermonde::get_alignment() const
@@ -233,7 +345,7 @@ int ErasureCodeJerasureReedSolomonRAID6::jerasure_decode(int *erasures,
 							 char **coding,
 							 int blocksize)
 {
-  return jerasure_matrix_decode(k, m, w, matrix, 1, erasures, data, coding, blocksize);
+  return matrix_decode(matrix, erasures, data, coding, blocksize);
 }
 
 unsigned ErasureCodeJerasureReedSolomonRAID6::get_alignment() const
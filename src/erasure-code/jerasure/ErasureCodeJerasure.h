@@ -18,6 +18,7 @@
 #ifndef CEPH_ERASURE_CODE_JERASURE_H
 #define CEPH_ERASURE_CODE_JERASURE_H
 
+#include "common/Mutex.h"
 #include "erasure-code/ErasureCode.h"
 
 #define DEFAULT_RULESET_ROOT "default"
@@ -46,7 +47,8 @@ public:
     technique(_technique),
     ruleset_root(DEFAULT_RULESET_ROOT),
     ruleset_failure_domain(DEFAULT_RULESET_FAILURE_DOMAIN),
-    per_chunk_alignment(false)
+    per_chunk_alignment(false),
+    decoding_tables_lock("ErasureCodeJerasure::decoding_tables_lock")
   {}
 
   virtual ~ErasureCodeJerasure() {}
@@ -74,6 +76,11 @@ public:
 
   virtual int init(ErasureCodeProfile &profile, ostream *ss);
 
+  /// every technique works on w * packetsize blocks, which chunks align to
+  virtual uint64_t get_supported_optimizations() const {
+    return FLAG_EC_PLUGIN_MULTI_STRIPE;
+  }
+
   virtual void jerasure_encode(char **data,
                                char **coding,
                                int blocksize) = 0;
@@ -86,6 +93,38 @@ public:
   static bool is_prime(int value);
 protected:
   virtual int parse(ErasureCodeProfile &profile, ostream *ss);
+  int matrix_encode_delta(const int *matrix,
+			  const map<int, bufferlist> &deltas,
+			  map<int, bufferlist> *coding);
+
+  /**
+   * jerasure_matrix_decode() with the decoding matrix of each erasure
+   * pattern kept in an LRU, instead of inverted again on every call
+   */
+  int matrix_decode(int *matrix,
+		    int *erasures,
+		    char **data,
+		    char **coding,
+		    int blocksize);
+
+private:
+  struct decoding_table_t {
+    vector<int> matrix; ///< k rows of k, one per data chunk
+    vector<int> ids;    ///< the k chunks it decodes from
+  };
+  typedef ceph::shared_ptr<decoding_table_t> decoding_table_ref;
+  typedef list<string> lru_list_t;
+  typedef map<string, pair<lru_list_t::iterator, decoding_table_ref> >
+    lru_map_t;
+
+  // enough for every pattern of up to 4 erasures of (12,4)
+  static const unsigned decoding_tables_lru_length = 2516;
+
+  Mutex decoding_tables_lock;
+  lru_list_t decoding_tables_lru; ///< most recently used first
+  lru_map_t decoding_tables;
+
+  decoding_table_ref get_decoding_table(int *matrix, int *erased);
 };
 
 class ErasureCodeJerasureReedSolomonVandermonde : public ErasureCodeJerasure {
@@ -112,6 +151,13 @@ public:
                                char **data,
                                char **coding,
                                int blocksize);
+  virtual uint64_t get_supported_optimizations() const {
+    return FLAG_EC_PLUGIN_PARITY_DELTA | FLAG_EC_PLUGIN_MULTI_STRIPE;
+  }
+  virtual int encode_delta_chunks(const map<int, bufferlist> &deltas,
+				  map<int, bufferlist> *coding) {
+    return matrix_encode_delta(matrix, deltas, coding);
+  }
   virtual unsigned get_alignment() const;
   virtual void prepare();
 private:
@@ -141,6 +187,13 @@ public:
                                char **data,
                                char **coding,
                                int blocksize);
+  virtual uint64_t get_supported_optimizations() const {
+    return FLAG_EC_PLUGIN_PARITY_DELTA | FLAG_EC_PLUGIN_MULTI_STRIPE;
+  }
+  virtual int encode_delta_chunks(const map<int, bufferlist> &deltas,
+				  map<int, bufferlist> *coding) {
+    return matrix_encode_delta(matrix, deltas, coding);
+  }
   virtual unsigned get_alignment() const;
   virtual void prepare();
 private:
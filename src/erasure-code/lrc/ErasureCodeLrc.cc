@@ -555,6 +555,66 @@ void p(const set<int> &s) { cerr << s; } // for gdb
 int ErasureCodeLrc::minimum_to_decode(const set<int> &want_to_read,
 				      const set<int> &available_chunks,
 				      set<int> *minimum)
+{
+  int r = _minimum_to_decode(want_to_read, available_chunks, minimum);
+  if (r < 0)
+    derr << __func__ << " not enough chunks in " << available_chunks
+	 << " to read " << want_to_read << dendl;
+  return r;
+}
+
+int ErasureCodeLrc::minimum_to_decode_with_cost(const set<int> &want_to_read,
+						const map<int, int> &available,
+						set<int> *minimum)
+{
+  set<int> available_chunks;
+  vector<pair<int, int> > by_cost;
+  for (map<int, int>::const_iterator i = available.begin();
+       i != available.end();
+       ++i) {
+    available_chunks.insert(i->first);
+    by_cost.push_back(make_pair(i->second, i->first));
+  }
+  int r = minimum_to_decode(want_to_read, available_chunks, minimum);
+  if (r < 0)
+    return r;
+  //
+  // The layers are walked from the most local one, which reads the
+  // fewest chunks but ignores where they are. Also try the smallest
+  // prefix of the chunks sorted by cost that can be decoded from:
+  // when the cheap chunks are those of a local layer (the same rack,
+  // for instance), the repair stays there.
+  //
+  sort(by_cost.begin(), by_cost.end());
+  set<int> cheapest;
+  for (vector<pair<int, int> >::const_iterator i = by_cost.begin();
+       i != by_cost.end();
+       ++i) {
+    cheapest.insert(i->second);
+    set<int> candidate;
+    if (_minimum_to_decode(want_to_read, cheapest, &candidate) < 0)
+      continue;
+    long minimum_cost = 0, candidate_cost = 0;
+    for (set<int>::const_iterator j = minimum->begin();
+	 j != minimum->end();
+	 ++j)
+      minimum_cost += available.find(*j)->second;
+    for (set<int>::const_iterator j = candidate.begin();
+	 j != candidate.end();
+	 ++j)
+      candidate_cost += available.find(*j)->second;
+    if (make_pair(candidate_cost, candidate.size()) <
+	make_pair(minimum_cost, minimum->size()))
+      minimum->swap(candidate);
+    break;
+  }
+  dout(20) << __func__ << " minimum = " << *minimum << dendl;
+  return 0;
+}
+
+int ErasureCodeLrc::_minimum_to_decode(const set<int> &want_to_read,
+				       const set<int> &available_chunks,
+				       set<int> *minimum)
 {
   dout(20) << __func__ << " want_to_read " << want_to_read
 	   << " available_chunks " << available_chunks << dendl;
@@ -719,8 +779,6 @@ int ErasureCodeLrc::minimum_to_decode(const set<int> &want_to_read,
     }
   }
 
-  derr << __func__ << " not enough chunks in " << available_chunks
-       << " to read " << want_to_read << dendl;
   return -EIO;
 }
 
@@ -90,6 +90,14 @@ public:
 				const set<int> &available,
 				set<int> *minimum);
 
+  virtual int minimum_to_decode_with_cost(const set<int> &want_to_read,
+					  const map<int, int> &available,
+					  set<int> *minimum);
+
+  int _minimum_to_decode(const set<int> &want_to_read,
+			 const set<int> &available,
+			 set<int> *minimum);
+
   virtual int create_ruleset(const string &name,
 			     CrushWrapper &crush,
 			     ostream *ss) const;
@@ -833,6 +833,10 @@ namespace buffer CEPH_BUFFER_API {
     void append(ptr&& bp);
     void append(const ptr& bp, unsigned off, unsigned len);
     void append(const list& bl);
+    /// like append(bl), but copy bl into our append_buffer when it is
+    /// short, so encoding small nested lists does not add a list node and
+    /// a raw reference per buffer
+    void append_or_copy(const list& bl);
     void append(std::istream& in);
     void append_zero(unsigned len);
     void prepend_zero(unsigned len);
@@ -100,6 +100,10 @@ DEFINE_CEPH_FEATURE_RETIRED(21, 1, MON_GV, HAMMER, JEWEL)
 DEFINE_CEPH_FEATURE(21, 2, SERVER_LUMINOUS)
 DEFINE_CEPH_FEATURE(21, 2, RESEND_ON_SPLIT) // overlap
 DEFINE_CEPH_FEATURE(21, 2, RADOS_BACKOFF)   // overlap
+DEFINE_CEPH_FEATURE(21, 2, CRUSH_CHOOSE_ARGS) // overlap
+DEFINE_CEPH_FEATURE(21, 2, OSDMAP_PG_UPMAP) // overlap
+DEFINE_CEPH_FEATURE(21, 2, MOSDMAP_COMPACT) // overlap
+DEFINE_CEPH_FEATURE(21, 2, REPLICA_READ_EAGAIN) // overlap
 DEFINE_CEPH_FEATURE_RETIRED(22, 1, BACKFILL_RESERVATION, JEWEL, LUMINOUS)
 
 DEFINE_CEPH_FEATURE(23, 1, MSG_AUTH)
@@ -226,6 +230,10 @@ DEFINE_CEPH_FEATURE_DEPRECATED(63, 1, RESERVED_BROKEN, LUMINOUS) // client-facin
 	 CEPH_FEATURE_SERVER_LUMINOUS |		\
 	 CEPH_FEATURE_RESEND_ON_SPLIT |		\
 	 CEPH_FEATURE_RADOS_BACKOFF |		\
+	 CEPH_FEATURE_CRUSH_CHOOSE_ARGS |	\
+	 CEPH_FEATURE_OSDMAP_PG_UPMAP |		\
+	 CEPH_FEATURE_MOSDMAP_COMPACT |		\
+	 CEPH_FEATURE_REPLICA_READ_EAGAIN |	\
 	 0ULL)
 
 #define CEPH_FEATURES_SUPPORTED_DEFAULT  CEPH_FEATURES_ALL
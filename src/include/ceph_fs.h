@@ -458,6 +458,7 @@ union ceph_mds_request_args_legacy {
 
 #define CEPH_MDS_FLAG_REPLAY        1  /* this is a replayed op */
 #define CEPH_MDS_FLAG_WANT_DENTRY   2  /* want dentry in reply */
+#define CEPH_MDS_FLAG_DELEG_INOS    4  /* want delegated inos in create reply */
 
 struct ceph_mds_request_head_legacy {
 	__le64 oldest_client_tid;
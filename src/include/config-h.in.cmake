@@ -90,6 +90,9 @@
 /* Defined if you have libaio */
 #cmakedefine HAVE_LIBAIO
 
+/* Defined if you have liburing */
+#cmakedefine HAVE_LIBURING
+
 /* Defined if OpenLDAP enabled */
 #cmakedefine HAVE_OPENLDAP
 
@@ -108,6 +111,9 @@
 /* Defined if LevelDB supports bloom filters */
 #cmakedefine HAVE_LEVELDB_FILTER_POLICY
 
+/* Define if you have lz4 */
+#cmakedefine HAVE_LZ4
+
 /* Define if you have tcmalloc */
 #cmakedefine HAVE_LIBTCMALLOC
 
@@ -1290,6 +1290,39 @@ struct denc_traits<boost::none_t> {
 // ----------------------------------------------------------------------
 // encode/decode wrappers
 
+namespace _denc {
+  // Run dec on a contiguous view of what is left in p, then advance p
+  // past what it consumed.  We don't know how much the object needs, so
+  // the safe choice is everything up to the end of the bufferlist, but
+  // on a fragmented list that means copying the rest of it for every
+  // object.  Objects usually fit in the segment p is in, so try that
+  // first and only copy when the object straddles a segment boundary.
+  template<typename F>
+  inline void decode_contiguous(bufferlist::iterator& p, F&& dec)
+  {
+    if (p.end())
+      throw buffer::end_of_buffer();
+    unsigned remaining = p.get_remaining();
+    bufferptr tmp = p.get_current_ptr();
+    if (tmp.length() < remaining) {
+      auto cp = tmp.begin();
+      try {
+	dec(cp);
+	p.advance((ssize_t)cp.get_offset());
+	return;
+      } catch (buffer::end_of_buffer&) {
+	// ran into the next segment; fall back to a copy
+      }
+      bufferlist::iterator t = p;
+      t.copy_shallow(remaining, tmp);
+    }
+    auto cp = tmp.begin();
+    dec(cp);
+    p.advance((ssize_t)cp.get_offset());
+  }
+}
+
+
 // These glue the new-style denc world into old-style calls to encode
 // and decode by calling into denc_traits<> methods (when present).
 
@@ -1324,18 +1357,9 @@ inline typename std::enable_if<traits::supported &&
   T& o,
   bufferlist::iterator& p)
 {
-  if (p.end())
-    throw buffer::end_of_buffer();
-  // ensure we get a contigous buffer... until the end of the
-  // bufferlist.  we don't really know how much we'll need here,
-  // unfortunately.  hopefully it is already contiguous and we're just
-  // bumping the raw ref and initializing the ptr tmp fields.
-  bufferptr tmp;
-  bufferlist::iterator t = p;
-  t.copy_shallow(p.get_bl().length() - p.get_off(), tmp);
-  auto cp = tmp.begin();
-  traits::decode(o, cp);
-  p.advance((ssize_t)cp.get_offset());
+  _denc::decode_contiguous(p, [&o](buffer::ptr::iterator& cp) {
+      traits::decode(o, cp);
+    });
 }
 
 template<typename T, typename traits=denc_traits<T>>
@@ -1344,14 +1368,9 @@ inline typename std::enable_if<traits::supported &&
   T& o,
   bufferlist::iterator& p)
 {
-  if (p.end())
-    throw buffer::end_of_buffer();
-  bufferptr tmp;
-  bufferlist::iterator t = p;
-  t.copy_shallow(p.get_bl().length() - p.get_off(), tmp);
-  auto cp = tmp.begin();
-  traits::decode(o, cp);
-  p.advance((ssize_t)cp.get_offset());
+  _denc::decode_contiguous(p, [&o](buffer::ptr::iterator& cp) {
+      traits::decode(o, cp);
+    });
 }
 
 // nohead variants
@@ -1376,14 +1395,9 @@ inline typename std::enable_if<traits::supported &&
 {
   if (!num)
     return;
-  if (p.end())
-    throw buffer::end_of_buffer();
-  bufferptr tmp;
-  bufferlist::iterator t = p;
-  t.copy_shallow(p.get_bl().length() - p.get_off(), tmp);
-  auto cp = tmp.begin();
-  traits::decode_nohead(num, o, cp);
-  p.advance((ssize_t)cp.get_offset());
+  _denc::decode_contiguous(p, [num, &o](buffer::ptr::iterator& cp) {
+      traits::decode_nohead(num, o, cp);
+    });
 }
 
 
@@ -254,7 +254,7 @@ inline void encode(const bufferlist& s, bufferlist& bl)
 {
   __u32 len = s.length();
   encode(len, bl);
-  bl.append(s);
+  bl.append_or_copy(s);
 }
 inline void encode_destructively(bufferlist& s, bufferlist& bl) 
 {
@@ -272,7 +272,7 @@ inline void decode(bufferlist& s, bufferlist::iterator& p)
 
 inline void encode_nohead(const bufferlist& s, bufferlist& bl) 
 {
-  bl.append(s);
+  bl.append_or_copy(s);
 }
 inline void decode_nohead(int len, bufferlist& s, bufferlist::iterator& p)
 {
@@ -643,7 +643,7 @@ inline void encode(const std::vector<ceph::shared_ptr<T>,Alloc>& v,
 {
   __u32 n = (__u32)(v.size());
   encode(n, bl);
-  for (typename std::vector<ceph::shared_ptr<T> >::const_iterator p = v.begin(); p != v.end(); ++p)
+  for (typename std::vector<ceph::shared_ptr<T>,Alloc>::const_iterator p = v.begin(); p != v.end(); ++p)
     if (*p)
       encode(**p, bl, features);
     else
@@ -655,7 +655,7 @@ inline void encode(const std::vector<ceph::shared_ptr<T>,Alloc>& v,
 {
   __u32 n = (__u32)(v.size());
   encode(n, bl);
-  for (typename std::vector<ceph::shared_ptr<T> >::const_iterator p = v.begin(); p != v.end(); ++p)
+  for (typename std::vector<ceph::shared_ptr<T>,Alloc>::const_iterator p = v.begin(); p != v.end(); ++p)
     if (*p)
       encode(**p, bl);
     else
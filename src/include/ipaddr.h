@@ -18,4 +18,10 @@ const struct sockaddr *find_ip_in_subnet(const struct ifaddrs *addrs,
 
 bool parse_network(const char *s, struct sockaddr *network, unsigned int *prefix_len);
 
+/*
+  Check whether addr is in the given network.
+ */
+bool network_contains(const struct sockaddr *network, unsigned int prefix_len,
+		      const struct sockaddr *addr);
+
 #endif
@@ -147,7 +147,9 @@ namespace mempool {
   f(bluefs)			      \
   f(buffer_meta)		      \
   f(buffer_data)		      \
+  f(mds_co)			      \
   f(osd)			      \
+  f(osdmap)			      \
   f(osdmap_mapping)		      \
   f(unittest_1)			      \
   f(unittest_2)
@@ -168,9 +170,11 @@ extern void set_debug_mode(bool d);
 class pool_t;
 
 // we shard pool stats across many shard_t's to reduce the amount
-// of cacheline ping pong.
+// of cacheline ping pong.  a pool uses as many of them as there are
+// cpus (rounded up to a power of two), so summing them stays cheap on
+// small machines.
 enum {
-  num_shard_bits = 5
+  num_shard_bits = 6
 };
 enum {
   num_shards = 1 << num_shard_bits
@@ -211,13 +215,16 @@ struct type_info_hash {
 
 class pool_t {
   shard_t shard[num_shards];
+  size_t shard_mask;  // active shards - 1
 
   mutable std::mutex lock;  // only used for types list
   std::unordered_map<const char *, type_t> type_map;
 
 public:
+  pool_t();
+
   //
-  // How much this pool consumes. O(<num_shards>)
+  // How much this pool consumes. O(<active shards>)
   //
   size_t allocated_bytes() const;
   size_t allocated_items() const;
@@ -226,7 +233,7 @@ public:
     // Dirt cheap, see:
     //   http://fossies.org/dox/glibc-2.24/pthread__self_8c_source.html
     size_t me = (size_t)pthread_self();
-    size_t i = (me >> 3) & ((1 << num_shard_bits) - 1);
+    size_t i = (me >> 3) & shard_mask;
     return &shard[i];
   }
 
@@ -246,7 +253,8 @@ public:
   void get_stats(stats_t *total,
 		 std::map<std::string, stats_t> *by_type) const;
 
-  void dump(ceph::Formatter *f) const;
+  // dump pool stats, adding our total to *sum if given
+  void dump(ceph::Formatter *f, stats_t *sum = nullptr) const;
 };
 
 // skip unittest_[12] by default
@@ -376,11 +384,11 @@ public:
                                                                         \
     template<typename k,typename v, typename cmp = std::less<k> >	\
     using map = std::map<k, v, cmp,					\
-			 pool_allocator<std::pair<k,v>>>;		\
+			 pool_allocator<std::pair<const k,v>>>;		\
                                                                         \
     template<typename k,typename v, typename cmp = std::less<k> >	\
     using multimap = std::multimap<k,v,cmp,				\
-				   pool_allocator<std::pair<k,v>>>;	\
+				   pool_allocator<std::pair<const k,v>>>; \
                                                                         \
     template<typename k, typename cmp = std::less<k> >			\
     using set = std::set<k,cmp,pool_allocator<k>>;			\
@@ -395,7 +403,14 @@ public:
 	     typename h=std::hash<k>,					\
 	     typename eq = std::equal_to<k>>				\
     using unordered_map =						\
-      std::unordered_map<k,v,h,eq,pool_allocator<std::pair<k,v>>>;	\
+      std::unordered_map<k,v,h,eq,pool_allocator<std::pair<const k,v>>>; \
+                                                                        \
+    template<typename k, typename v,					\
+	     typename h=std::hash<k>,					\
+	     typename eq = std::equal_to<k>>				\
+    using unordered_multimap =						\
+      std::unordered_multimap<k,v,h,eq,					\
+			      pool_allocator<std::pair<const k,v>>>;	\
                                                                         \
     inline size_t allocated_bytes() {					\
       return mempool::get_pool(id).allocated_bytes();			\
@@ -2,6 +2,7 @@
 #define __LIBRADOS_HPP
 
 #include <stdbool.h>
+#include <functional>
 #include <string>
 #include <list>
 #include <map>
@@ -283,6 +284,12 @@ namespace librados
     void set_op_flags(ObjectOperationFlags flags) __attribute__((deprecated));
     //flag mean ObjectOperationFlags
     void set_op_flags2(int flags);
+    /**
+     * Make the operation part of an end-to-end trace the caller started,
+     * as the child of span parent_span_id.  A trace_id of 0 means the
+     * caller decided not to trace it.
+     */
+    void set_trace(uint64_t trace_id, uint64_t parent_span_id);
 
     void cmpxattr(const char *name, uint8_t op, const bufferlist& val);
     void cmpxattr(const char *name, uint8_t op, uint64_t v);
@@ -890,6 +897,29 @@ namespace librados
         ObjectCursor *split_start,
         ObjectCursor *split_finish);
 
+    /**
+     * List the objects between two cursors, enumerating up to @a fanout
+     * slices of the range concurrently
+     *
+     * @a cb is called from the calling thread with each batch of up to
+     * @a result_item_count objects as it arrives, in no particular
+     * order.  If it returns nonzero the listing stops and that value is
+     * returned.  The filter is the same as for object_list(); a
+     * "prefix" filter, encoded as the string "prefix" followed by the
+     * name prefix and optionally an xattr name and value (an empty
+     * value matches any), is applied by the OSDs before any xattr is
+     * read.
+     *
+     * @returns 0 on success, negative error code on failure
+     */
+    int object_list_parallel(
+        const ObjectCursor &start,
+        const ObjectCursor &finish,
+        const size_t fanout,
+        const size_t result_item_count,
+        const bufferlist &filter,
+        std::function<int(std::vector<ObjectItem>&)> cb);
+
     /**
      * List available hit set objects
      *
@@ -1061,6 +1091,32 @@ namespace librados
 		    ObjectReadOperation *op, int flags,
 		    bufferlist *pbl);
 
+    /**
+     * Schedule an async write operation on each of several objects
+     *
+     * This is the same as calling aio_operate() for each object, but
+     * with one completion for all of them, and with the targets of all
+     * of them found at once, which is cheaper for many small operations.
+     *
+     * @param ops the objects and the operations to perform on each
+     * @param c completes once all the operations have completed, with
+     * the first error any of them returned, or 0
+     * @param prvals where to store each operation's return value, if not NULL
+     * @returns 0 on success, negative error code on failure
+     */
+    int aio_operate_batch(
+      const std::vector<std::pair<std::string, ObjectWriteOperation*> >& ops,
+      AioCompletion *c, std::vector<int> *prvals, int flags = 0);
+    /**
+     * Schedule an async read operation on each of several objects
+     *
+     * As for the write version; the results of each operation go where
+     * its ObjectReadOperation says.
+     */
+    int aio_operate_batch(
+      const std::vector<std::pair<std::string, ObjectReadOperation*> >& ops,
+      AioCompletion *c, std::vector<int> *prvals, int flags = 0);
+
     // watch/notify
     int watch2(const std::string& o, uint64_t *handle,
 	       librados::WatchCtx2 *ctx);
@@ -161,6 +161,16 @@ typedef struct {
   int64_t pool;
 } rbd_group_spec_t;
 
+typedef enum {
+  GROUP_SNAP_STATE_INCOMPLETE,
+  GROUP_SNAP_STATE_COMPLETE
+} rbd_group_snap_state_t;
+
+typedef struct {
+  char *name;
+  rbd_group_snap_state_t state;
+} rbd_group_snap_spec_t;
+
 typedef enum {
   RBD_LOCK_MODE_EXCLUSIVE = 0,
   RBD_LOCK_MODE_SHARED = 1,
@@ -368,6 +378,15 @@ CEPH_RBD_API int rbd_copy_with_progress3(rbd_image_t image,
 					 const char *destname,
 					 rbd_image_options_t dest_opts,
 					 librbd_progress_fn_t cb, void *cbdata);
+CEPH_RBD_API int rbd_deep_copy(rbd_image_t src, rados_ioctx_t dest_io_ctx,
+                               const char *destname,
+                               rbd_image_options_t dest_opts);
+CEPH_RBD_API int rbd_deep_copy_with_progress(rbd_image_t image,
+                                             rados_ioctx_t dest_io_ctx,
+                                             const char *destname,
+                                             rbd_image_options_t dest_opts,
+                                             librbd_progress_fn_t cb,
+                                             void *cbdata);
 
 /* snapshots */
 CEPH_RBD_API int rbd_snap_list(rbd_image_t image, rbd_snap_info_t *snaps,
@@ -783,6 +802,37 @@ CEPH_RBD_API void rbd_group_image_status_cleanup(
 CEPH_RBD_API void rbd_group_image_status_list_cleanup(
 					      rbd_group_image_status_t *images,
 					      size_t len);
+
+/**
+ * Create a crash-consistent snapshot of every image in a group.
+ *
+ * Writes to all member images are stopped while the image snapshots are
+ * taken, and resume once every image has been snapshotted.
+ *
+ * @param group_p the pool of the group
+ * @param group_name the group to snapshot
+ * @param snap_name the name of the group snapshot
+ * @returns 0 on success, negative error code on failure
+ */
+CEPH_RBD_API int rbd_group_snap_create(rados_ioctx_t group_p,
+				       const char *group_name,
+				       const char *snap_name);
+CEPH_RBD_API int rbd_group_snap_remove(rados_ioctx_t group_p,
+				       const char *group_name,
+				       const char *snap_name);
+/**
+ * List the snapshots of a group.
+ *
+ * @param snaps the array to fill, released with rbd_group_snap_list_cleanup
+ * @param snaps_size in: the size of the array, out: the number of snapshots
+ * @returns 0 on success, -ERANGE if the array is too small
+ */
+CEPH_RBD_API int rbd_group_snap_list(rados_ioctx_t group_p,
+				     const char *group_name,
+				     rbd_group_snap_spec_t *snaps,
+				     size_t *snaps_size);
+CEPH_RBD_API void rbd_group_snap_list_cleanup(rbd_group_snap_spec_t *snaps,
+					      size_t len);
 #ifdef __cplusplus
 }
 #endif
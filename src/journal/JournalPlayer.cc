@@ -84,6 +84,7 @@ JournalPlayer::~JournalPlayer() {
     Mutex::Locker locker(m_lock);
     assert(m_shut_down);
     assert(m_fetch_object_numbers.empty());
+    assert(m_prefetch_object_numbers.empty());
     assert(!m_watch_scheduled);
   }
   m_replay_handler->put();
@@ -595,17 +596,38 @@ bool JournalPlayer::remove_empty_object_player(const ObjectPlayerPtr &player) {
   return true;
 }
 
-void JournalPlayer::fetch(uint64_t object_num) {
-  assert(m_lock.is_locked());
-
-  ObjectPlayerPtr object_player(new ObjectPlayer(
+ObjectPlayerPtr JournalPlayer::create_object_player(uint64_t object_num) {
+  return ObjectPlayerPtr(new ObjectPlayer(
     m_ioctx, m_object_oid_prefix, object_num, m_journal_metadata->get_timer(),
     m_journal_metadata->get_timer_lock(), m_journal_metadata->get_order(),
     m_journal_metadata->get_settings().max_fetch_bytes));
+}
+
+void JournalPlayer::fetch(uint64_t object_num) {
+  assert(m_lock.is_locked());
 
   uint8_t splay_width = m_journal_metadata->get_splay_width();
+  auto it = m_prefetched_object_players.find(object_num);
+  if (it != m_prefetched_object_players.end()) {
+    // already read ahead (or being read): no need for another round trip
+    ldout(m_cct, 10) << __func__ << ": using prefetched " << object_num
+                     << dendl;
+    m_object_players[object_num % splay_width] = it->second;
+    m_prefetched_object_players.erase(it);
+
+    assert(m_fetch_object_numbers.count(object_num) == 0);
+    m_fetch_object_numbers.insert(object_num);
+    if (m_prefetch_object_numbers.count(object_num) == 0) {
+      m_journal_metadata->queue(new C_Fetch(this, object_num), 0);
+    }
+    prefetch_ahead();
+    return;
+  }
+
+  ObjectPlayerPtr object_player = create_object_player(object_num);
   m_object_players[object_num % splay_width] = object_player;
   fetch(object_player);
+  prefetch_ahead();
 }
 
 void JournalPlayer::fetch(const ObjectPlayerPtr &object_player) {
@@ -642,6 +664,99 @@ void JournalPlayer::handle_fetched(uint64_t object_num, int r) {
   process_state(object_num, r);
 }
 
+void JournalPlayer::prefetch_ahead() {
+  assert(m_lock.is_locked());
+
+  const Settings &settings = m_journal_metadata->get_settings();
+  if (settings.max_prefetch_bytes == 0 || m_shut_down ||
+      m_state == STATE_ERROR) {
+    return;
+  }
+
+  uint8_t splay_width = m_journal_metadata->get_splay_width();
+  uint64_t active_set = m_journal_metadata->get_active_set();
+  uint64_t object_bytes = settings.max_fetch_bytes > 0 ?
+    settings.max_fetch_bytes : 1ULL << m_journal_metadata->get_order();
+  uint64_t max_objects = std::max<uint64_t>(
+    1, settings.max_prefetch_bytes / object_bytes);
+
+  // drop read-ahead that playback already moved past
+  for (auto it = m_prefetched_object_players.begin();
+       it != m_prefetched_object_players.end();) {
+    auto player_it = m_object_players.find(it->first % splay_width);
+    if (player_it != m_object_players.end() &&
+        it->first <= player_it->second->get_object_number()) {
+      it = m_prefetched_object_players.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  // read the next object sets of every splay offset in order; the active
+  // set is skipped since it may still be appended to
+  for (uint64_t ahead = 1;
+       m_prefetched_object_players.size() < max_objects; ++ahead) {
+    bool found = false;
+    for (auto &pair : m_object_players) {
+      uint64_t object_num = pair.second->get_object_number() +
+                            ahead * splay_width;
+      if (object_num / splay_width >= active_set) {
+        continue;
+      }
+      found = true;
+
+      if (m_prefetched_object_players.count(object_num) != 0) {
+        continue;
+      } else if (m_prefetched_object_players.size() >= max_objects) {
+        break;
+      }
+
+      ldout(m_cct, 10) << __func__ << ": "
+                       << utils::get_object_name(m_object_oid_prefix,
+                                                 object_num)
+                       << dendl;
+      ObjectPlayerPtr object_player = create_object_player(object_num);
+      m_prefetched_object_players[object_num] = object_player;
+      m_prefetch_object_numbers.insert(object_num);
+      object_player->fetch(new C_Prefetch(this, object_num));
+    }
+
+    if (!found) {
+      break;
+    }
+  }
+}
+
+void JournalPlayer::handle_prefetched(uint64_t object_num, int r) {
+  ldout(m_cct, 10) << __func__ << ": "
+                   << utils::get_object_name(m_object_oid_prefix, object_num)
+                   << ": r=" << r << dendl;
+
+  Mutex::Locker locker(m_lock);
+  assert(m_prefetch_object_numbers.count(object_num) == 1);
+  m_prefetch_object_numbers.erase(object_num);
+
+  if (m_fetch_object_numbers.count(object_num) != 0) {
+    // playback caught up with the read-ahead and waits for it
+    m_fetch_object_numbers.erase(object_num);
+    if (m_shut_down) {
+      return;
+    }
+
+    if (r == 0) {
+      ObjectPlayerPtr object_player = get_object_player(object_num);
+      remove_empty_object_player(object_player);
+    }
+    process_state(object_num, r);
+    return;
+  }
+
+  if (r < 0) {
+    // leave it to a regular fetch to report the error
+    m_prefetched_object_players.erase(object_num);
+  }
+}
+
 void JournalPlayer::refetch(bool immediate) {
   ldout(m_cct, 10) << __func__ << dendl;
   assert(m_lock.is_locked());
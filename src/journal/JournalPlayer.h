@@ -45,6 +45,7 @@ private:
   typedef std::map<uint8_t, ObjectPlayerPtr> SplayedObjectPlayers;
   typedef std::map<uint8_t, ObjectPosition> SplayedObjectPositions;
   typedef std::set<uint64_t> ObjectNumbers;
+  typedef std::map<uint64_t, ObjectPlayerPtr> PrefetchedObjectPlayers;
 
   enum State {
     STATE_INIT,
@@ -73,6 +74,20 @@ private:
     }
   };
 
+  struct C_Prefetch : public Context {
+    JournalPlayer *player;
+    uint64_t object_num;
+    C_Prefetch(JournalPlayer *p, uint64_t o) : player(p), object_num(o) {
+      player->m_async_op_tracker.start_op();
+    }
+    virtual ~C_Prefetch() {
+      player->m_async_op_tracker.finish_op();
+    }
+    virtual void finish(int r) {
+      player->handle_prefetched(object_num, r);
+    }
+  };
+
   struct C_Watch : public Context {
     JournalPlayer *player;
     uint64_t object_num;
@@ -116,6 +131,11 @@ private:
   PrefetchSplayOffsets m_prefetch_splay_offsets;
   SplayedObjectPlayers m_object_players;
 
+  // objects read ahead of the splay position that will play them, while
+  // the journal is consumed, up to max_prefetch_bytes
+  PrefetchedObjectPlayers m_prefetched_object_players;
+  ObjectNumbers m_prefetch_object_numbers;
+
   bool m_commit_position_valid = false;
   ObjectPosition m_commit_position;
   SplayedObjectPositions m_commit_positions;
@@ -139,11 +159,15 @@ private:
   int process_prefetch(uint64_t object_number);
   int process_playback(uint64_t object_number);
 
+  ObjectPlayerPtr create_object_player(uint64_t object_num);
   void fetch(uint64_t object_num);
   void fetch(const ObjectPlayerPtr &object_player);
   void handle_fetched(uint64_t object_num, int r);
   void refetch(bool immediate);
 
+  void prefetch_ahead();
+  void handle_prefetched(uint64_t object_num, int r);
+
   void schedule_watch(bool immediate);
   void handle_watch(uint64_t object_num, int r);
   void handle_watch_assert_active(int r);
@@ -3,6 +3,7 @@
 
 #include "journal/JournalRecorder.h"
 #include "common/errno.h"
+#include "common/perf_counters.h"
 #include "journal/Entry.h"
 #include "journal/Utils.h"
 
@@ -59,6 +60,23 @@ JournalRecorder::JournalRecorder(librados::IoCtx &ioctx,
   m_ioctx.dup(ioctx);
   m_cct = reinterpret_cast<CephContext*>(m_ioctx.cct());
 
+  std::string name = "journal-recorder-" + m_object_oid_prefix;
+  if (name.back() == '.') {
+    name.pop_back();
+  }
+  PerfCountersBuilder plb(m_cct, name, l_journal_recorder_first,
+                          l_journal_recorder_last);
+  plb.add_u64_counter(l_journal_recorder_append_ops, "append_ops",
+                      "Append ops sent to journal objects");
+  plb.add_u64_avg(l_journal_recorder_append_entries, "append_entries",
+                  "Entries per append op");
+  plb.add_u64_avg(l_journal_recorder_append_bytes, "append_bytes",
+                  "Bytes per append op");
+  plb.add_time_avg(l_journal_recorder_append_latency, "append_latency",
+                   "Latency of append ops");
+  m_perf_counters = plb.create_perf_counters();
+  m_cct->get_perfcounters_collection()->add(m_perf_counters);
+
   uint8_t splay_width = m_journal_metadata->get_splay_width();
   for (uint8_t splay_offset = 0; splay_offset < splay_width; ++splay_offset) {
     m_object_locks.push_back(shared_ptr<Mutex>(
@@ -79,6 +97,9 @@ JournalRecorder::~JournalRecorder() {
   Mutex::Locker locker(m_lock);
   assert(m_in_flight_advance_sets == 0);
   assert(m_in_flight_object_closes == 0);
+
+  m_cct->get_perfcounters_collection()->remove(m_perf_counters);
+  delete m_perf_counters;
 }
 
 Future JournalRecorder::append(uint64_t tag_tid,
@@ -251,7 +272,9 @@ ObjectRecorderPtr JournalRecorder::create_object_recorder(
     object_number, lock, m_journal_metadata->get_work_queue(),
     m_journal_metadata->get_timer(), m_journal_metadata->get_timer_lock(),
     &m_object_handler, m_journal_metadata->get_order(), m_flush_interval,
-    m_flush_bytes, m_flush_age));
+    m_flush_bytes, m_flush_age,
+    m_journal_metadata->get_settings().max_in_flight_appends,
+    m_perf_counters));
   return object_recorder;
 }
 
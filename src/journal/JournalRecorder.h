@@ -16,6 +16,7 @@
 #include <map>
 #include <string>
 
+class PerfCounters;
 class SafeTimer;
 
 namespace journal {
@@ -86,6 +87,8 @@ private:
   Listener m_listener;
   ObjectHandler m_object_handler;
 
+  PerfCounters *m_perf_counters = nullptr;
+
   Mutex m_lock;
 
   uint32_t m_in_flight_advance_sets = 0;
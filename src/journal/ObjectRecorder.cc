@@ -5,6 +5,7 @@
 #include "journal/Future.h"
 #include "journal/Utils.h"
 #include "include/assert.h"
+#include "common/perf_counters.h"
 #include "common/Timer.h"
 #include "cls/journal/cls_journal_client.h"
 
@@ -22,12 +23,17 @@ ObjectRecorder::ObjectRecorder(librados::IoCtx &ioctx, const std::string &oid,
                                ContextWQ *work_queue, SafeTimer &timer,
                                Mutex &timer_lock, Handler *handler,
                                uint8_t order, uint32_t flush_interval,
-                               uint64_t flush_bytes, double flush_age)
+                               uint64_t flush_bytes, double flush_age,
+                               uint32_t max_in_flight_appends,
+                               PerfCounters *perf_counters)
   : RefCountedObject(NULL, 0), m_oid(oid), m_object_number(object_number),
     m_cct(NULL), m_op_work_queue(work_queue), m_timer(timer),
     m_timer_lock(timer_lock), m_handler(handler), m_order(order),
     m_soft_max_size(1 << m_order), m_flush_interval(flush_interval),
-    m_flush_bytes(flush_bytes), m_flush_age(flush_age), m_flush_handler(this),
+    m_flush_bytes(flush_bytes), m_flush_age(flush_age),
+    m_max_in_flight_appends(max_in_flight_appends),
+    m_in_flight_limit(max_in_flight_appends), m_perf_counters(perf_counters),
+    m_flush_handler(this),
     m_append_task(NULL), m_lock(lock), m_append_tid(0), m_pending_bytes(0),
     m_size(0), m_overflowed(false), m_object_closed(false),
     m_in_flight_flushes(false), m_aio_scheduled(false) {
@@ -99,6 +105,8 @@ void ObjectRecorder::flush(Context *on_safe) {
       future = Future(m_append_buffers.rbegin()->first);
 
       flush_appends(true);
+    } else if (!m_pending_buffers.empty()) {
+      future = Future(m_pending_buffers.rbegin()->first);
     } else if (!m_in_flight_appends.empty()) {
       AppendBuffers &append_buffers = m_in_flight_appends.rbegin()->second;
       assert(!append_buffers.empty());
@@ -248,8 +256,17 @@ void ObjectRecorder::handle_append_flushed(uint64_t tid, int r) {
     m_lock->Lock();
     auto tid_iter = m_in_flight_tids.find(tid);
     assert(tid_iter != m_in_flight_tids.end());
+    update_in_flight_limit(ceph_clock_now() - tid_iter->second);
     m_in_flight_tids.erase(tid_iter);
 
+    if (!m_pending_buffers.empty() && !m_aio_scheduled) {
+      // send the appends held back while the limit was reached
+      m_op_work_queue->queue(new FunctionContext([this] (int r) {
+          send_appends_aio();
+      }));
+      m_aio_scheduled = true;
+    }
+
     InFlightAppends::iterator iter = m_in_flight_appends.find(tid);
     if (r == -EOVERFLOW || m_overflowed) {
       if (iter != m_in_flight_appends.end()) {
@@ -346,7 +363,7 @@ void ObjectRecorder::send_appends(AppendBuffers *append_buffers) {
 
   m_pending_buffers.splice(m_pending_buffers.end(), *append_buffers,
                            append_buffers->begin(), append_buffers->end());
-  if (!m_aio_scheduled) {
+  if (!m_aio_scheduled && can_send_appends()) {
     m_op_work_queue->queue(new FunctionContext([this] (int r) {
         send_appends_aio();
     }));
@@ -354,13 +371,19 @@ void ObjectRecorder::send_appends(AppendBuffers *append_buffers) {
   }
 }
 
+bool ObjectRecorder::can_send_appends() const {
+  assert(m_lock->is_locked());
+  return (m_max_in_flight_appends == 0 ||
+          m_in_flight_tids.size() < m_in_flight_limit);
+}
+
 void ObjectRecorder::send_appends_aio() {
   AppendBuffers *append_buffers;
   uint64_t append_tid;
   {
     Mutex::Locker locker(*m_lock);
     append_tid = m_append_tid++;
-    m_in_flight_tids.insert(append_tid);
+    m_in_flight_tids[append_tid] = ceph_clock_now();
 
     // safe to hold pointer outside lock until op is submitted
     append_buffers = &m_in_flight_appends[append_tid];
@@ -372,16 +395,27 @@ void ObjectRecorder::send_appends_aio() {
   C_AppendFlush *append_flush = new C_AppendFlush(this, append_tid);
   C_Gather *gather_ctx = new C_Gather(m_cct, append_flush);
 
-  librados::ObjectWriteOperation op;
-  client::guard_append(&op, m_soft_max_size);
+  // coalesce the entries into a single append
+  bufferlist append_bl;
   for (AppendBuffers::iterator it = append_buffers->begin();
        it != append_buffers->end(); ++it) {
     ldout(m_cct, 20) << __func__ << ": flushing " << *it->first
                      << dendl;
-    op.append(it->second);
-    op.set_op_flags2(CEPH_OSD_OP_FLAG_FADVISE_DONTNEED);
+    append_bl.append(it->second);
+  }
+  if (m_perf_counters != nullptr) {
+    m_perf_counters->inc(l_journal_recorder_append_ops);
+    m_perf_counters->inc(l_journal_recorder_append_entries,
+                         append_buffers->size());
+    m_perf_counters->inc(l_journal_recorder_append_bytes,
+                         append_bl.length());
   }
 
+  librados::ObjectWriteOperation op;
+  client::guard_append(&op, m_soft_max_size);
+  op.append(append_bl);
+  op.set_op_flags2(CEPH_OSD_OP_FLAG_FADVISE_DONTNEED);
+
   librados::AioCompletion *rados_completion =
     librados::Rados::aio_create_completion(gather_ctx->new_sub(), nullptr,
                                            utils::rados_ctx_callback);
@@ -399,6 +433,10 @@ void ObjectRecorder::send_appends_aio() {
       } else {
         m_lock->Unlock();
       }
+    } else if (!can_send_appends()) {
+      // sent along with any later appends once an append op completes
+      m_aio_scheduled = false;
+      m_lock->Unlock();
     } else {
       // additional pending items -- reschedule
       m_op_work_queue->queue(new FunctionContext([this] (int r) {
@@ -412,6 +450,35 @@ void ObjectRecorder::send_appends_aio() {
   gather_ctx->activate();
 }
 
+void ObjectRecorder::update_in_flight_limit(const utime_t &latency) {
+  assert(m_lock->is_locked());
+  if (m_perf_counters != nullptr) {
+    m_perf_counters->tinc(l_journal_recorder_append_latency, latency);
+  }
+  if (m_max_in_flight_appends == 0) {
+    return;
+  }
+
+  double lat = latency;
+  m_avg_latency = (m_avg_latency == 0 ? lat :
+                                        0.875 * m_avg_latency + 0.125 * lat);
+  if (m_min_latency == 0 || m_avg_latency < m_min_latency) {
+    m_min_latency = m_avg_latency;
+  }
+
+  uint32_t in_flight_limit = m_in_flight_limit;
+  if (m_avg_latency > 2 * m_min_latency) {
+    m_in_flight_limit = MAX(1, m_in_flight_limit - 1);
+  } else if (m_avg_latency < 1.5 * m_min_latency) {
+    m_in_flight_limit = MIN(m_max_in_flight_appends, m_in_flight_limit + 1);
+  }
+  if (m_in_flight_limit != in_flight_limit) {
+    ldout(m_cct, 20) << __func__ << ": " << m_oid << " latency "
+                     << m_avg_latency << " (min " << m_min_latency << "), "
+                     << "in-flight limit " << m_in_flight_limit << dendl;
+  }
+}
+
 void ObjectRecorder::notify_handler_unlock() {
   assert(m_lock->is_locked());
   if (m_object_closed) {
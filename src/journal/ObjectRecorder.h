@@ -5,6 +5,7 @@
 #define CEPH_JOURNAL_OBJECT_RECORDER_H
 
 #include "include/Context.h"
+#include "include/utime.h"
 #include "include/rados/librados.hpp"
 #include "common/Cond.h"
 #include "common/Mutex.h"
@@ -18,8 +19,18 @@
 #include <boost/noncopyable.hpp>
 #include "include/assert.h"
 
+class PerfCounters;
 class SafeTimer;
 
+enum {
+  l_journal_recorder_first = 27500,
+  l_journal_recorder_append_ops,
+  l_journal_recorder_append_entries,
+  l_journal_recorder_append_bytes,
+  l_journal_recorder_append_latency,
+  l_journal_recorder_last,
+};
+
 namespace journal {
 
 class ObjectRecorder;
@@ -41,7 +52,9 @@ public:
                  uint64_t object_number, std::shared_ptr<Mutex> lock,
                  ContextWQ *work_queue, SafeTimer &timer, Mutex &timer_lock,
                  Handler *handler, uint8_t order, uint32_t flush_interval,
-                 uint64_t flush_bytes, double flush_age);
+                 uint64_t flush_bytes, double flush_age,
+                 uint32_t max_in_flight_appends = 0,
+                 PerfCounters *perf_counters = nullptr);
   ~ObjectRecorder();
 
   inline uint64_t get_object_number() const {
@@ -73,7 +86,7 @@ public:
   }
 
 private:
-  typedef std::set<uint64_t> InFlightTids;
+  typedef std::map<uint64_t, utime_t> InFlightTids;
   typedef std::map<uint64_t, AppendBuffers> InFlightAppends;
 
   struct FlushHandler : public FutureImpl::FlushHandler {
@@ -130,6 +143,15 @@ private:
   uint64_t m_flush_bytes;
   double m_flush_age;
 
+  // while the limit of in-flight append ops is reached, appends are held
+  // and then sent together; the limit drops as the OSD slows down
+  uint32_t m_max_in_flight_appends;
+  uint32_t m_in_flight_limit;
+  double m_avg_latency = 0;
+  double m_min_latency = 0;
+
+  PerfCounters *m_perf_counters;
+
   FlushHandler m_flush_handler;
 
   C_AppendTask *m_append_task;
@@ -162,7 +184,9 @@ private:
   void handle_append_flushed(uint64_t tid, int r);
   void append_overflowed();
   void send_appends(AppendBuffers *append_buffers);
+  bool can_send_appends() const;
   void send_appends_aio();
+  void update_in_flight_limit(const utime_t &latency);
 
   void notify_handler_unlock();
 };
@@ -11,8 +11,11 @@ namespace journal {
 struct Settings {
   double commit_interval = 5;         ///< commit position throttle (in secs)
   uint64_t max_fetch_bytes = 0;       ///< 0 implies no limit
+  uint64_t max_prefetch_bytes = 0;    ///< read-ahead of later objects,
+                                      ///< 0 implies no read-ahead
   uint64_t max_payload_bytes = 0;     ///< 0 implies object size limit
   int max_concurrent_object_sets = 0; ///< 0 implies no limit
+  uint32_t max_in_flight_appends = 0; ///< per object, 0 implies no limit
   std::set<std::string> whitelisted_laggy_clients;
                                       ///< clients that mustn't be disconnected
 };
@@ -8,6 +8,7 @@
 #include <set>
 #include <map>
 #include <string>
+#include <vector>
 #include "include/memory.h"
 #include <boost/scoped_ptr.hpp>
 #include "include/encoding.h"
@@ -117,6 +118,15 @@ public:
       const std::string &prefix ///< [in] Prefix by which to remove keys
       ) = 0;
 
+    /// Remove keys in [start, end) with a single range tombstone.
+    /// Returns false, removing nothing, if the store can't; the caller
+    /// then has to remove the keys one by one.
+    virtual bool rm_range_keys(
+      const std::string &prefix,  ///< [in] Prefix of the keys
+      const std::string &start,   ///< [in] First key to remove
+      const std::string &end      ///< [in] First key to keep
+      ) { return false; }
+
     /// Merge value into key
     virtual void merge(
       const std::string &prefix,   ///< [in] Prefix ==> MUST match some established merge operator
@@ -138,6 +148,32 @@ public:
   virtual int init(string option_str="") = 0;
   virtual int open(std::ostream &out) = 0;
   virtual int create_and_open(std::ostream &out) = 0;
+
+  /**
+   * A separately tuned keyspace holding all keys of one prefix.
+   *
+   * Backends that support it keep such a prefix apart (own memtables,
+   * compaction and filters); the key/value interface is unchanged.
+   */
+  struct ColumnFamily {
+    std::string name;     ///< the prefix stored in this column family
+    std::string options;  ///< backend specific tuning
+    ColumnFamily(const std::string& n, const std::string& o)
+      : name(n), options(o) {}
+  };
+  /// open, applying options to the column families the db was created with
+  virtual int open(std::ostream &out, const std::vector<ColumnFamily>& cfs) {
+    if (!cfs.empty())
+      return -EOPNOTSUPP;
+    return open(out);
+  }
+  /// create (with the given column families) and open
+  virtual int create_and_open(std::ostream &out,
+			      const std::vector<ColumnFamily>& cfs) {
+    if (!cfs.empty())
+      return -EOPNOTSUPP;
+    return create_and_open(out);
+  }
   virtual void close() { }
 
   virtual Transaction get_transaction() = 0;
@@ -290,7 +326,16 @@ public:
   }
 
   Iterator get_iterator(const std::string &prefix) {
-    return std::make_shared<IteratorImpl>(prefix, get_iterator());
+    return std::make_shared<IteratorImpl>(prefix,
+					  _get_prefix_iterator(prefix));
+  }
+
+  /// an iterator over the keys of prefix that sort below upper_bound
+  Iterator get_iterator(const std::string &prefix,
+			const std::string &upper_bound) {
+    return std::make_shared<IteratorImpl>(prefix,
+					  _get_prefix_iterator(prefix,
+							       upper_bound));
   }
 
   virtual uint64_t get_estimated_size(std::map<std::string,uint64_t> &extra) = 0;
@@ -340,12 +385,43 @@ public:
   virtual void get_statistics(Formatter *f) {
     return;
   }
+
+  /// bytes currently held by the backend's in-memory (block) cache
+  virtual int64_t get_cache_usage() const {
+    return -EOPNOTSUPP;
+  }
+  /// resize the backend's in-memory (block) cache
+  virtual int set_cache_size(uint64_t s) {
+    return -EOPNOTSUPP;
+  }
+  /// cumulative hit/miss counts for the backend's in-memory (block) cache
+  virtual int get_cache_hits(uint64_t *hits, uint64_t *misses) {
+    return -EOPNOTSUPP;
+  }
+  /// an integer-valued backend property, e.g. "rocksdb.is-write-stopped"
+  virtual int get_int_property(const std::string &property, uint64_t *out) {
+    return -EOPNOTSUPP;
+  }
 protected:
   /// List of matching prefixes and merge operators
   std::vector<std::pair<std::string,
 			std::shared_ptr<MergeOperator> > > merge_ops;
 
   virtual WholeSpaceIterator _get_iterator() = 0;
+  /// an iterator that need only be valid for keys of the given prefix
+  virtual WholeSpaceIterator _get_prefix_iterator(const std::string &prefix) {
+    return _get_iterator();
+  }
+  /**
+   * Like the above, but keys at or past upper_bound need not be seen
+   * either.  Backends can use the bound to stop early instead of
+   * walking whatever (e.g. tombstones) lies beyond the range; callers
+   * must still do their own end-of-range check.
+   */
+  virtual WholeSpaceIterator _get_prefix_iterator(
+    const std::string &prefix, const std::string &upper_bound) {
+    return _get_prefix_iterator(prefix);
+  }
 };
 
 #endif
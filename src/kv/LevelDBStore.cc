@@ -248,14 +248,18 @@ int LevelDBStore::get(
     std::map<string, bufferlist> *out)
 {
   utime_t start = ceph_clock_now();
+  // leveldb has no MultiGet; read the whole batch from one snapshot
+  leveldb::ReadOptions options;
+  options.snapshot = db->GetSnapshot();
   for (std::set<string>::const_iterator i = keys.begin();
        i != keys.end(); ++i) {
     std::string value;
     std::string bound = combine_strings(prefix, *i);
-    auto status = db->Get(leveldb::ReadOptions(), leveldb::Slice(bound), &value);
+    auto status = db->Get(options, leveldb::Slice(bound), &value);
     if (status.ok())
       (*out)[*i].append(value);
   }
+  db->ReleaseSnapshot(options.snapshot);
   utime_t lat = ceph_clock_now() - start;
   logger->inc(l_leveldb_gets);
   logger->tinc(l_leveldb_get_latency, lat);
@@ -10,6 +10,7 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <limits>
 #include <errno.h>
 #include <unistd.h>
 #include <sys/types.h>
@@ -51,10 +52,10 @@ static string make_key(const string &prefix, const string &value)
   return out;
 }
 
-void MemDB::_encode(mdb_iter_t iter, bufferlist &bl)
+void MemDB::_encode(const string& key, const bufferptr& data, bufferlist &bl)
 {
-  ::encode(iter->first, bl);
-  ::encode(iter->second, bl);
+  ::encode(key, bl);
+  ::encode(data, bl);
 }
 
 std::string MemDB::_get_data_fn()
@@ -65,7 +66,7 @@ std::string MemDB::_get_data_fn()
 
 void MemDB::_save()
 {
-  std::lock_guard<std::mutex> l(m_lock);
+  RWLock::RLocker l(m_lock);
   dout(10) << __func__ << " Saving MemDB to file: "<< _get_data_fn().c_str() << dendl;
   int mode = 0644;
   int fd = TEMP_FAILURE_RETRY(::open(_get_data_fn().c_str(),
@@ -77,11 +78,12 @@ void MemDB::_save()
     return;
   }
   bufferlist bl;
-  mdb_iter_t iter = m_map.begin();
-  while (iter != m_map.end()) {
-    dout(10) << __func__ << " Key:"<< iter->first << dendl;
-    _encode(iter, bl);
-    ++iter;
+  for (auto& p : m_map) {
+    mdb_version_t *v = _visible(p.second, m_seq);
+    if (!v)
+      continue;
+    dout(10) << __func__ << " Key:"<< p.first << dendl;
+    _encode(p.first, v->data, bl);
   }
   bl.write_fd(fd);
 
@@ -90,7 +92,7 @@ void MemDB::_save()
 
 int MemDB::_load()
 {
-  std::lock_guard<std::mutex> l(m_lock);
+  RWLock::WLocker l(m_lock);
   dout(10) << __func__ << " Reading MemDB from file: "<< _get_data_fn().c_str() << dendl;
   /*
    * Open file and read it in single shot.
@@ -123,7 +125,7 @@ int MemDB::_load()
     bytes_done += ::decode_file(fd, datap);
 
     dout(10) << __func__ << " Key:"<< key << dendl;
-    m_map[key] = datap;
+    m_map[key].push_back(mdb_version_t(0, false, datap));
     m_total_bytes += datap.length();
   }
   VOID_TEMP_FAILURE_RETRY(::close(fd));
@@ -186,19 +188,25 @@ int MemDB::submit_transaction(KeyValueDB::Transaction t)
   MDBTransactionImpl* mt =  static_cast<MDBTransactionImpl*>(t.get());
 
   dtrace << __func__ << " " << mt->get_ops().size() << dendl;
+  RWLock::WLocker l(m_lock);
+  uint64_t seq = m_seq + 1;
+  uint64_t oldest = std::min(_oldest_snapshot(), seq);
   for(auto& op : mt->get_ops()) {
     if(op.first == MDBTransactionImpl::WRITE) {
       ms_op_t set_op = op.second;
-      _setkey(set_op);
+      _setkey(set_op, seq, oldest);
     } else if (op.first == MDBTransactionImpl::MERGE) {
       ms_op_t merge_op = op.second;
-      _merge(merge_op);
+      _merge(merge_op, seq, oldest);
     } else {
       ms_op_t rm_op = op.second;
       assert(op.first == MDBTransactionImpl::DELETE);
-      _rmkey(rm_op);
+      _rmkey(rm_op, seq, oldest);
     }
   }
+  _trim_stale(oldest);
+  // publish the whole transaction at once
+  m_seq = seq;
 
   return 0;
 }
@@ -251,44 +259,140 @@ void MemDB::MDBTransactionImpl::merge(
   return;
 }
 
-int MemDB::_setkey(ms_op_t &op)
+uint64_t MemDB::_get_snapshot()
+{
+  // m_seq only moves under the write lock
+  RWLock::RLocker l(m_lock);
+  std::lock_guard<std::mutex> sl(m_snap_lock);
+  m_snapshots.insert(m_seq);
+  return m_seq;
+}
+
+void MemDB::_put_snapshot(uint64_t seq)
+{
+  std::lock_guard<std::mutex> sl(m_snap_lock);
+  auto p = m_snapshots.find(seq);
+  assert(p != m_snapshots.end());
+  m_snapshots.erase(p);
+}
+
+uint64_t MemDB::_oldest_snapshot()
+{
+  std::lock_guard<std::mutex> sl(m_snap_lock);
+  if (m_snapshots.empty())
+    return std::numeric_limits<uint64_t>::max();
+  return *m_snapshots.begin();
+}
+
+/*
+ * Newest version at or below seq, or NULL if the key did not exist
+ * as of seq.
+ */
+MemDB::mdb_version_t *MemDB::_visible(mdb_versions_t& v, uint64_t seq)
+{
+  for (auto p = v.rbegin(); p != v.rend(); ++p) {
+    if (p->seq <= seq)
+      return p->deleted ? nullptr : &*p;
+  }
+  return nullptr;
+}
+
+/*
+ * Drop versions no snapshot at or after oldest can see.  A key whose
+ * only remaining version is a deletion nobody can see past goes away;
+ * no iterator can be parked on it since none sees it.  Caller holds
+ * the write lock.
+ */
+void MemDB::_trim(mdb_iter_t p, uint64_t oldest)
+{
+  mdb_versions_t& v = p->second;
+  unsigned keep = 0;
+  for (unsigned i = 0; i < v.size(); ++i) {
+    if (v[i].seq <= oldest)
+      keep = i;
+  }
+  if (keep)
+    v.erase(v.begin(), v.begin() + keep);
+  if (v.size() == 1 && v[0].deleted && v[0].seq <= oldest) {
+    m_stale.erase(p->first);
+    m_map.erase(p);
+  } else if (v.size() == 1 && !v[0].deleted) {
+    m_stale.erase(p->first);
+  } else {
+    m_stale.insert(p->first);
+  }
+}
+
+void MemDB::_trim_stale(uint64_t oldest)
+{
+  if (oldest == m_stale_trimmed)
+    return;  // writes already trimmed the keys they touched
+  m_stale_trimmed = oldest;
+  for (auto k = m_stale.begin(); k != m_stale.end(); ) {
+    string key = *k++;
+    auto p = m_map.find(key);
+    if (p == m_map.end()) {
+      m_stale.erase(key);
+      continue;
+    }
+    if (p->second.front().seq > oldest)
+      continue;
+    _trim(p, oldest);
+  }
+}
+
+void MemDB::_add_version(const string &key, uint64_t seq, bool deleted,
+			 const bufferptr &data, uint64_t oldest)
+{
+  auto p = m_map.find(key);
+  if (p == m_map.end()) {
+    if (deleted)
+      return;
+    p = m_map.insert(make_pair(key, mdb_versions_t())).first;
+  }
+  mdb_versions_t& v = p->second;
+  if (!v.empty() && v.back().seq == seq) {
+    // an earlier op of this transaction
+    v.back().deleted = deleted;
+    v.back().data = data;
+  } else {
+    v.push_back(mdb_version_t(seq, deleted, data));
+  }
+  _trim(p, oldest);
+}
+
+int MemDB::_setkey(ms_op_t &op, uint64_t seq, uint64_t oldest)
 {
-  std::lock_guard<std::mutex> l(m_lock);
   std::string key = make_key(op.first.first, op.first.second);
   bufferlist bl = op.second;
 
   m_total_bytes += bl.length();
 
-  bufferlist bl_old;
-  if (_get(op.first.first, op.first.second, &bl_old)) {
-    /*
-     * delete and free existing key.
-     */
-    assert(m_total_bytes >= bl_old.length());
-    m_total_bytes -= bl_old.length();
-    m_map.erase(key);
+  auto p = m_map.find(key);
+  if (p != m_map.end() && !p->second.back().deleted) {
+    unsigned old_len = p->second.back().data.length();
+    assert(m_total_bytes >= old_len);
+    m_total_bytes -= old_len;
   }
 
-  m_map[key] = bufferptr((char *) bl.c_str(), bl.length());
-  iterator_seq_no++;
+  _add_version(key, seq, false, bufferptr((char *) bl.c_str(), bl.length()),
+	       oldest);
   return 0;
 }
 
-int MemDB::_rmkey(ms_op_t &op)
+int MemDB::_rmkey(ms_op_t &op, uint64_t seq, uint64_t oldest)
 {
-  std::lock_guard<std::mutex> l(m_lock);
   std::string key = make_key(op.first.first, op.first.second);
 
-  bufferlist bl_old;
-  if (_get(op.first.first, op.first.second, &bl_old)) {
-    assert(m_total_bytes >= bl_old.length());
-    m_total_bytes -= bl_old.length();
+  auto p = m_map.find(key);
+  if (p == m_map.end() || p->second.back().deleted) {
+    return 0;
   }
-  iterator_seq_no++;
-  /*
-   * Erase will call the destructor for bufferptr.
-   */
-  return m_map.erase(key);
+  unsigned old_len = p->second.back().data.length();
+  assert(m_total_bytes >= old_len);
+  m_total_bytes -= old_len;
+  _add_version(key, seq, true, bufferptr(), oldest);
+  return 1;
 }
 
 std::shared_ptr<KeyValueDB::MergeOperator> MemDB::_find_merge_op(std::string prefix)
@@ -304,9 +408,8 @@ std::shared_ptr<KeyValueDB::MergeOperator> MemDB::_find_merge_op(std::string pre
 }
 
 
-int MemDB::_merge(ms_op_t &op)
+int MemDB::_merge(ms_op_t &op, uint64_t seq, uint64_t oldest)
 {
-  std::lock_guard<std::mutex> l(m_lock);
   std::string prefix = op.first.first;
   std::string key = make_key(op.first.first, op.first.second);
   bufferlist bl = op.second;
@@ -328,26 +431,28 @@ int MemDB::_merge(ms_op_t &op)
      * Merge non existent.
      */
     mop->merge_nonexistent(bl.c_str(), bl.length(), &new_val);
-    m_map[key] = bufferptr(new_val.c_str(), new_val.length());
+    _add_version(key, seq, false, bufferptr(new_val.c_str(), new_val.length()),
+		 oldest);
   } else {
     /*
      * Merge existing.
      */
     std::string new_val;
     mop->merge(bl_old.c_str(), bl_old.length(), bl.c_str(), bl.length(), &new_val);
-    m_map[key] = bufferptr(new_val.c_str(), new_val.length());
+    _add_version(key, seq, false, bufferptr(new_val.c_str(), new_val.length()),
+		 oldest);
     bytes_adjusted -= bl_old.length();
     bl_old.clear();
   }
 
   assert((int64_t)m_total_bytes + bytes_adjusted >= 0);
   m_total_bytes += bytes_adjusted;
-  iterator_seq_no++;
   return 0;
 }
 
 /*
- * Caller take btree lock.
+ * Latest version, including the ops of a transaction being applied.
+ * Caller takes m_lock.
  */
 bool MemDB::_get(const string &prefix, const string &k, bufferlist *out)
 {
@@ -357,14 +462,18 @@ bool MemDB::_get(const string &prefix, const string &k, bufferlist *out)
   if (iter == m_map.end()) {
     return false;
   }
+  mdb_version_t& v = iter->second.back();
+  if (v.deleted) {
+    return false;
+  }
 
-  out->push_back((m_map[key].clone()));
+  out->push_back(v.data.clone());
   return true;
 }
 
 bool MemDB::_get_locked(const string &prefix, const string &k, bufferlist *out)
 {
-  std::lock_guard<std::mutex> l(m_lock);
+  RWLock::RLocker l(m_lock);
   return _get(prefix, k, out);
 }
 
@@ -381,10 +490,11 @@ int MemDB::get(const string &prefix, const std::string& key,
 int MemDB::get(const string &prefix, const std::set<string> &keys,
     std::map<string, bufferlist> *out)
 {
+  RWLock::RLocker l(m_lock);
   for (const auto& i : keys) {
     bufferlist bl;
-    if (_get_locked(prefix, i, &bl))
-      out->insert(make_pair(i, bl));
+    if (_get(prefix, i, &bl))
+      out->insert(out->end(), make_pair(i, bl));
   }
 
   return 0;
@@ -393,50 +503,41 @@ int MemDB::get(const string &prefix, const std::set<string> &keys,
 void MemDB::MDBWholeSpaceIteratorImpl::fill_current()
 {
   bufferlist bl;
-  bl.append(m_iter->second.clone());
+  bl.append(_visible(m_iter->second, m_seq)->data.clone());
   m_key_value = std::make_pair(m_iter->first, bl);
 }
 
-bool MemDB::MDBWholeSpaceIteratorImpl::valid()
+/*
+ * Move m_iter onto the first key at or after it that this snapshot
+ * sees, and load it.  Caller holds the read lock.
+ */
+void MemDB::MDBWholeSpaceIteratorImpl::_skip_forward()
 {
-  if (m_key_value.first.empty()) {
-    return false;
-  }
-  return true;
+  free_last();
+  while (m_iter != m_db->m_map.end() && !_visible(m_iter->second, m_seq))
+    ++m_iter;
+  if (m_iter != m_db->m_map.end())
+    fill_current();
 }
 
-bool MemDB::MDBWholeSpaceIteratorImpl::iterator_validate() {
-
-  if (this_seq_no != *global_seq_no) {
-    auto key = m_key_value.first;
-    assert(!key.empty());
-
-    bool restart_iter = false;
-    if (!m_using_btree) {
-      /*
-       * Map is modified and marker key does not exists, 
-       * restart the iterator from next key.
-       */
-      if (m_map_p->find(key) == m_map_p->end()) {
-        restart_iter = true;
-      }
-    } else {
-      restart_iter = true;
-    }
-
-    if (restart_iter) {
-      m_iter = m_map_p->lower_bound(key);
-      if (m_iter == m_map_p->end()) {
-        return false;
-      }
+void MemDB::MDBWholeSpaceIteratorImpl::_skip_backward()
+{
+  free_last();
+  while (!_visible(m_iter->second, m_seq)) {
+    if (m_iter == m_db->m_map.begin()) {
+      m_iter = m_db->m_map.end();
+      return;
     }
-
-    /*
-     * This iter is valid now.
-     */
-    this_seq_no = *global_seq_no;
+    --m_iter;
   }
+  fill_current();
+}
 
+bool MemDB::MDBWholeSpaceIteratorImpl::valid()
+{
+  if (m_key_value.first.empty()) {
+    return false;
+  }
   return true;
 }
 
@@ -478,36 +579,30 @@ bufferlist MemDB::MDBWholeSpaceIteratorImpl::value()
 
 int MemDB::MDBWholeSpaceIteratorImpl::next()
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-  if (!iterator_validate()) {
-    free_last();
+  RWLock::RLocker l(m_db->m_lock);
+  if (!valid()) {
     return -1;
   }
-  free_last();
+  // our key is visible to us, so it cannot have been trimmed
   ++m_iter;
-  if (m_iter != m_map_p->end()) {
-    fill_current();
-    return 0;
-  } else {
-    return -1;
-  }
+  _skip_forward();
+  return valid() ? 0 : -1;
 }
 
 int MemDB::MDBWholeSpaceIteratorImpl:: prev()
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-  if (!iterator_validate()) {
-    free_last();
+  RWLock::RLocker l(m_db->m_lock);
+  if (!valid()) {
     return -1;
   }
-  free_last();
-  if (m_iter != m_map_p->begin()) {
-    --m_iter;
-    fill_current();
-    return 0;
-  } else {
+  if (m_iter == m_db->m_map.begin()) {
+    free_last();
+    m_iter = m_db->m_map.end();
     return -1;
   }
+  --m_iter;
+  _skip_backward();
+  return valid() ? 0 : -1;
 }
 
 /*
@@ -515,68 +610,63 @@ int MemDB::MDBWholeSpaceIteratorImpl:: prev()
  */
 int MemDB::MDBWholeSpaceIteratorImpl::seek_to_first(const std::string &k)
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-  free_last();
+  RWLock::RLocker l(m_db->m_lock);
   if (k.empty()) {
-    m_iter = m_map_p->begin();
+    m_iter = m_db->m_map.begin();
   } else {
-    m_iter = m_map_p->lower_bound(k);
-  }
-  
-  if (m_iter == m_map_p->end()) {
-    return -1;
+    m_iter = m_db->m_map.lower_bound(k);
   }
-  fill_current();
-  return 0;
+  _skip_forward();
+  return valid() ? 0 : -1;
 }
 
+/*
+ * Last key of the given prefix, if prefix is null then last key in btree.
+ */
 int MemDB::MDBWholeSpaceIteratorImpl::seek_to_last(const std::string &k)
 {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
-  free_last();
+  RWLock::RLocker l(m_db->m_lock);
   if (k.empty()) {
-    m_iter = m_map_p->end();
-    --m_iter;
+    m_iter = m_db->m_map.end();
   } else {
-    m_iter = m_map_p->lower_bound(k);
+    string limit = k;
+    limit.push_back(KEY_DELIM + 1);
+    m_iter = m_db->m_map.lower_bound(limit);
   }
-
-  if (m_iter == m_map_p->end()) {
+  if (m_iter == m_db->m_map.begin()) {
+    free_last();
+    m_iter = m_db->m_map.end();
     return -1;
   }
-  fill_current();
-  return 0;
+  --m_iter;
+  _skip_backward();
+  return valid() ? 0 : -1;
 }
 
 MemDB::MDBWholeSpaceIteratorImpl::~MDBWholeSpaceIteratorImpl()
 {
   free_last();
+  m_db->_put_snapshot(m_seq);
 }
 
 int MemDB::MDBWholeSpaceIteratorImpl::upper_bound(const std::string &prefix,
     const std::string &after) {
 
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
+  RWLock::RLocker l(m_db->m_lock);
 
   dtrace << "upper_bound " << prefix.c_str() << after.c_str() << dendl;
   string k = make_key(prefix, after);
-  m_iter = m_map_p->upper_bound(k);
-  if (m_iter != m_map_p->end()) {
-    fill_current();
-    return 0;
-  }
-  return -1;
+  m_iter = m_db->m_map.upper_bound(k);
+  _skip_forward();
+  return valid() ? 0 : -1;
 }
 
 int MemDB::MDBWholeSpaceIteratorImpl::lower_bound(const std::string &prefix,
     const std::string &to) {
-  std::lock_guard<std::mutex> l(*m_map_lock_p);
+  RWLock::RLocker l(m_db->m_lock);
   dtrace << "lower_bound " << prefix.c_str() << to.c_str() << dendl;
   string k = make_key(prefix, to);
-  m_iter = m_map_p->lower_bound(k);
-  if (m_iter != m_map_p->end()) {
-    fill_current();
-    return 0;
-  }
-  return -1;
+  m_iter = m_db->m_map.lower_bound(k);
+  _skip_forward();
+  return valid() ? 0 : -1;
 }
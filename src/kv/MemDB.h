@@ -20,6 +20,7 @@
 #include "include/cpp-btree/btree.h"
 #include "include/cpp-btree/btree_map.h"
 #include "include/encoding_btree.h"
+#include "common/RWLock.h"
 #include "KeyValueDB.h"
 #include "osd/osd_types.h"
 
@@ -29,15 +30,35 @@ using std::string;
 class MemDB : public KeyValueDB
 {
   typedef std::pair<std::pair<std::string, std::string>, bufferlist> ms_op_t;
-  std::mutex m_lock;
-  uint64_t m_total_bytes;
-  uint64_t m_allocated_bytes;
 
-  typedef std::map<std::string, bufferptr> mdb_map_t;
+  /*
+   * Each key keeps the versions still visible to some open iterator,
+   * oldest first.  A transaction commits all of its ops under one seq;
+   * an iterator reads as of the seq current when it was created, so
+   * no iterator ever copies or revalidates against the map.
+   */
+  struct mdb_version_t {
+    uint64_t seq;
+    bool deleted;
+    bufferptr data;
+    mdb_version_t(uint64_t s, bool d, const bufferptr& p)
+      : seq(s), deleted(d), data(p) {}
+  };
+  typedef std::vector<mdb_version_t> mdb_versions_t;
+  typedef std::map<std::string, mdb_versions_t> mdb_map_t;
   typedef mdb_map_t::iterator mdb_iter_t;
-  bool m_using_btree;
+
+  RWLock m_lock;             ///< readers share, transactions exclusive
+  uint64_t m_total_bytes;
+  uint64_t m_allocated_bytes;
 
   mdb_map_t m_map;
+  uint64_t m_seq;            ///< last committed transaction
+
+  std::mutex m_snap_lock;
+  std::multiset<uint64_t> m_snapshots;  ///< seqs of open iterators
+  std::set<std::string> m_stale;  ///< keys holding versions to trim
+  uint64_t m_stale_trimmed;       ///< oldest snapshot at the last sweep
 
   CephContext *m_cct;
   void* m_priv;
@@ -47,17 +68,25 @@ class MemDB : public KeyValueDB
   int transaction_rollback(KeyValueDB::Transaction t);
   int _open(ostream &out);
   void close();
+  static mdb_version_t *_visible(mdb_versions_t& v, uint64_t seq);
   bool _get(const string &prefix, const string &k, bufferlist *out);
   bool _get_locked(const string &prefix, const string &k, bufferlist *out);
   std::string _get_data_fn();
-  void _encode(mdb_iter_t iter, bufferlist &bl);
+  void _encode(const string& key, const bufferptr& data, bufferlist &bl);
   void _save();
   int _load();
-  uint64_t iterator_seq_no;
+
+  uint64_t _get_snapshot();
+  void _put_snapshot(uint64_t seq);
+  uint64_t _oldest_snapshot();
+  void _add_version(const std::string &key, uint64_t seq, bool deleted,
+		    const bufferptr &data, uint64_t oldest);
+  void _trim(mdb_iter_t p, uint64_t oldest);
+  void _trim_stale(uint64_t oldest);
 
 public:
   MemDB(CephContext *c, const string &path, void *p) :
-    m_using_btree(false), m_cct(c), m_priv(p), m_db_path(path), iterator_seq_no(1)
+    m_lock("MemDB::m_lock"), m_seq(0), m_stale_trimmed(0), m_cct(c), m_priv(p), m_db_path(path)
   {
     //Nothing as of now
   }
@@ -107,10 +136,9 @@ private:
   /*
    * Transaction states.
    */
-  int _merge(const std::string &k, bufferptr &bl);
-  int _merge(ms_op_t &op);
-  int _setkey(ms_op_t &op);
-  int _rmkey(ms_op_t &op);
+  int _merge(ms_op_t &op, uint64_t seq, uint64_t oldest);
+  int _setkey(ms_op_t &op, uint64_t seq, uint64_t oldest);
+  int _rmkey(ms_op_t &op, uint64_t seq, uint64_t oldest);
 
 public:
 
@@ -140,27 +168,20 @@ public:
 
       mdb_iter_t m_iter;
       std::pair<string, bufferlist> m_key_value;
-      mdb_map_t *m_map_p;
-      std::mutex *m_map_lock_p;
-      uint64_t *global_seq_no;
-      uint64_t this_seq_no;
-      bool m_using_btree;
+      MemDB *m_db;
+      uint64_t m_seq;        ///< snapshot this iterator reads
+
+      void _skip_forward();
+      void _skip_backward();
+      void fill_current();
+      void free_last();
 
   public:
-    MDBWholeSpaceIteratorImpl(mdb_map_t *btree_p, std::mutex *btree_lock_p,
-                              uint64_t *iterator_seq_no, bool using_btree) {
-      m_map_p = btree_p;
-      m_map_lock_p = btree_lock_p;
-      std::lock_guard<std::mutex> l(*m_map_lock_p);
-      global_seq_no = iterator_seq_no;
-      this_seq_no = *iterator_seq_no;
-      m_using_btree = using_btree;
+    explicit MDBWholeSpaceIteratorImpl(MemDB *db)
+      : m_db(db), m_seq(db->_get_snapshot()) {
+      m_iter = m_db->m_map.end();
     }
 
-    void fill_current();
-    void free_last();
-
-
     int seek_to_first(const std::string &k);
     int seek_to_last(const std::string &k);
 
@@ -170,7 +191,6 @@ public:
     int upper_bound(const std::string &prefix, const std::string &after);
     int lower_bound(const std::string &prefix, const std::string &to);
     bool valid();
-    bool iterator_validate();
 
     int next();
     int prev();
@@ -184,12 +204,12 @@ public:
   };
 
   uint64_t get_estimated_size(std::map<std::string,uint64_t> &extra) {
-      std::lock_guard<std::mutex> l(m_lock);
+      RWLock::RLocker l(m_lock);
       return m_allocated_bytes;
   };
 
   int get_statfs(struct store_statfs_t *buf) {
-    std::lock_guard<std::mutex> l(m_lock);
+    RWLock::RLocker l(m_lock);
     buf->reset();
     buf->total = m_total_bytes;
     buf->allocated = m_allocated_bytes;
@@ -201,7 +221,7 @@ protected:
 
   WholeSpaceIterator _get_iterator() {
     return std::shared_ptr<KeyValueDB::WholeSpaceIteratorImpl>(
-      new MDBWholeSpaceIteratorImpl(&m_map, &m_lock, &iterator_seq_no, m_using_btree));
+      new MDBWholeSpaceIteratorImpl(this));
   }
 };
 
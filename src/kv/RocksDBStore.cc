@@ -16,6 +16,7 @@
 #include "rocksdb/slice.h"
 #include "rocksdb/cache.h"
 #include "rocksdb/filter_policy.h"
+#include "rocksdb/slice_transform.h"
 #include "rocksdb/utilities/convenience.h"
 #include "rocksdb/merge_operator.h"
 using std::string;
@@ -170,6 +171,10 @@ int RocksDBStore::tryInterpret(const string key, const string val, rocksdb::Opti
     int ret = string2bool(val, disableWAL);
     if (ret != 0)
       return ret;
+  } else if (key == "cache_stats") {
+    int ret = string2bool(val, cache_stats);
+    if (ret != 0)
+      return ret;
   } else {
     //unrecognize config options.
     return -EINVAL;
@@ -215,7 +220,8 @@ int RocksDBStore::init(string _options_str)
   return 0;
 }
 
-int RocksDBStore::create_and_open(ostream &out)
+int RocksDBStore::create_and_open(ostream &out,
+				  const std::vector<ColumnFamily>& cfs)
 {
   if (env) {
     unique_ptr<rocksdb::Directory> dir;
@@ -230,10 +236,31 @@ int RocksDBStore::create_and_open(ostream &out)
       return r;
     }
   }
-  return do_open(out, true);
+  return do_open(out, true, cfs);
+}
+
+rocksdb::ColumnFamilyHandle *RocksDBStore::get_cf_handle(const string& prefix)
+{
+  if (!cf_handles.empty()) {
+    auto p = cf_handles.find(prefix);
+    if (p != cf_handles.end())
+      return p->second;
+  }
+  return db->DefaultColumnFamily();
 }
 
-int RocksDBStore::do_open(ostream &out, bool create_if_missing)
+const rocksdb::SliceTransform *RocksDBStore::get_prefix_extractor(
+  const string& prefix)
+{
+  if (!cf_handles.empty() && cf_handles.count(prefix)) {
+    auto p = cf_prefix_extractors.find(prefix);
+    return p == cf_prefix_extractors.end() ? nullptr : p->second.get();
+  }
+  return default_prefix_extractor.get();
+}
+
+int RocksDBStore::do_open(ostream &out, bool create_if_missing,
+			  const std::vector<ColumnFamily>& cfs)
 {
   rocksdb::Options opt;
   rocksdb::Status status;
@@ -245,7 +272,7 @@ int RocksDBStore::do_open(ostream &out, bool create_if_missing)
     }
   }
 
-  if (g_conf->rocksdb_perf)  {
+  if (g_conf->rocksdb_perf || cache_stats)  {
     dbstats = rocksdb::CreateDBStatistics();
     opt.statistics = dbstats;
   }
@@ -289,18 +316,119 @@ int RocksDBStore::do_open(ostream &out, bool create_if_missing)
   auto cache = rocksdb::NewLRUCache(g_conf->rocksdb_cache_size, g_conf->rocksdb_cache_shard_bits);
   bbt_opts.block_size = g_conf->rocksdb_block_size;
   bbt_opts.block_cache = cache;
+  if (g_conf->rocksdb_bloom_bits_per_key > 0) {
+    dout(10) << __func__ << " set bloom filter bits per key to "
+	     << g_conf->rocksdb_bloom_bits_per_key << dendl;
+    bbt_opts.filter_policy.reset(
+      rocksdb::NewBloomFilterPolicy(g_conf->rocksdb_bloom_bits_per_key, false));
+  }
   opt.table_factory.reset(rocksdb::NewBlockBasedTableFactory(bbt_opts));
   dout(10) << __func__ << " set block size to " << g_conf->rocksdb_block_size
            << " cache size to " << g_conf->rocksdb_cache_size
            << " num of cache shards to " << (1 << g_conf->rocksdb_cache_shard_bits) << dendl;
 
   opt.merge_operator.reset(new MergeOperatorRouter(*this));
-  status = rocksdb::DB::Open(opt, path, &db);
-  if (!status.ok()) {
-    derr << status.ToString() << dendl;
-    return -EINVAL;
+
+  // Column families inherit everything set up above (env, table
+  // factory and block cache, merge operator) and layer their own
+  // options on top.
+  map<string,rocksdb::ColumnFamilyOptions> cf_opts;
+  for (auto& cf : cfs) {
+    rocksdb::ColumnFamilyOptions base(opt), cf_opt;
+    status = rocksdb::GetColumnFamilyOptionsFromString(base, cf.options,
+						       &cf_opt);
+    if (!status.ok()) {
+      derr << __func__ << " invalid options '" << cf.options
+	   << "' for column family " << cf.name << ": " << status.ToString()
+	   << dendl;
+      return -EINVAL;
+    }
+    cf_opts[cf.name] = cf_opt;
   }
-  
+
+  std::vector<string> existing;
+  status = rocksdb::DB::ListColumnFamilies(rocksdb::DBOptions(opt), path,
+					   &existing);
+  if (!status.ok() || existing.size() <= 1) {
+    // No column families yet.  They can only be added to a new store;
+    // we do not move the keys of an existing prefix.
+    bool fresh = !status.ok();
+    status = rocksdb::DB::Open(opt, path, &db);
+    if (!status.ok()) {
+      derr << status.ToString() << dendl;
+      return -EINVAL;
+    }
+    for (auto& p : cf_opts) {
+      if (!fresh) {
+	derr << __func__ << " not adding column family " << p.first
+	     << " to an existing store; its keys stay in the default one"
+	     << dendl;
+	continue;
+      }
+      rocksdb::ColumnFamilyHandle *h;
+      status = db->CreateColumnFamily(p.second, p.first, &h);
+      if (!status.ok()) {
+	derr << __func__ << " failed to create column family " << p.first
+	     << ": " << status.ToString() << dendl;
+	return -EINVAL;
+      }
+      dout(1) << __func__ << " created column family " << p.first << dendl;
+      cf_handles[p.first] = h;
+    }
+  } else {
+    std::vector<rocksdb::ColumnFamilyDescriptor> descs;
+    for (auto& name : existing) {
+      if (name == rocksdb::kDefaultColumnFamilyName) {
+	descs.push_back(rocksdb::ColumnFamilyDescriptor(
+			  name, rocksdb::ColumnFamilyOptions(opt)));
+	continue;
+      }
+      auto p = cf_opts.find(name);
+      if (p == cf_opts.end()) {
+	dout(1) << __func__ << " column family " << name
+		<< " not configured, using the default options" << dendl;
+	descs.push_back(rocksdb::ColumnFamilyDescriptor(
+			  name, rocksdb::ColumnFamilyOptions(opt)));
+      } else {
+	descs.push_back(rocksdb::ColumnFamilyDescriptor(name, p->second));
+	cf_opts.erase(p);
+      }
+    }
+    for (auto& p : cf_opts) {
+      derr << __func__ << " column family " << p.first
+	   << " does not exist in this store; its keys stay in the default one"
+	   << dendl;
+    }
+    std::vector<rocksdb::ColumnFamilyHandle*> handles;
+    status = rocksdb::DB::Open(rocksdb::DBOptions(opt), path, descs,
+			       &handles, &db);
+    if (!status.ok()) {
+      derr << status.ToString() << dendl;
+      return -EINVAL;
+    }
+    for (unsigned i = 0; i < descs.size(); ++i) {
+      if (descs[i].name == rocksdb::kDefaultColumnFamilyName) {
+	// we use db->DefaultColumnFamily()
+	delete handles[i];
+      } else {
+	dout(10) << __func__ << " column family " << descs[i].name << dendl;
+	cf_handles[descs[i].name] = handles[i];
+      }
+    }
+  }
+
+  // Iterators over a table with a prefix extractor must ask for total
+  // order seeks unless they stay within one extracted prefix.
+  default_prefix_extractor = db->GetOptions().prefix_extractor;
+  for (auto& p : cf_handles) {
+    auto pe = db->GetOptions(p.second).prefix_extractor;
+    if (pe) {
+      dout(10) << __func__ << " column family " << p.first
+	       << " prefix extractor " << pe->Name() << dendl;
+      cf_prefix_extractors[p.first] = pe;
+    }
+  }
+
   PerfCountersBuilder plb(g_ceph_context, "rocksdb", l_rocksdb_first, l_rocksdb_last);
   plb.add_u64_counter(l_rocksdb_gets, "get", "Gets");
   plb.add_u64_counter(l_rocksdb_txns, "submit_transaction", "Submit transactions");
@@ -317,6 +445,8 @@ int RocksDBStore::do_open(ostream &out, bool create_if_missing)
   plb.add_time_avg(l_rocksdb_write_delay_time, "rocksdb_write_delay_time", "Rocksdb write delay time");
   plb.add_time_avg(l_rocksdb_write_pre_and_post_process_time, 
       "rocksdb_write_pre_and_post_time", "total time spent on writing a record, excluding write process");
+  plb.add_u64_avg(l_rocksdb_iter_deletes_skipped, "iter_deletes_skipped",
+		  "Tombstones skipped per prefix iterator (needs rocksdb_perf)");
   logger = plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 
@@ -344,6 +474,12 @@ RocksDBStore::~RocksDBStore()
   close();
   delete logger;
 
+  // column family handles must go before the db
+  for (auto& p : cf_handles) {
+    delete p.second;
+  }
+  cf_handles.clear();
+
   // Ensure db is destroyed before dependent db_cache and filterpolicy
   delete db;
   db = nullptr;
@@ -431,6 +567,38 @@ void RocksDBStore::get_statistics(Formatter *f)
   }
 }
 
+int64_t RocksDBStore::get_cache_usage() const
+{
+  if (!bbt_opts.block_cache)
+    return -ENOENT;
+  return bbt_opts.block_cache->GetUsage();
+}
+
+int RocksDBStore::set_cache_size(uint64_t s)
+{
+  if (!bbt_opts.block_cache)
+    return -ENOENT;
+  bbt_opts.block_cache->SetCapacity(s);
+  dout(20) << __func__ << " block cache capacity now " << s << dendl;
+  return 0;
+}
+
+int RocksDBStore::get_cache_hits(uint64_t *hits, uint64_t *misses)
+{
+  if (!dbstats)
+    return -EOPNOTSUPP;
+  *hits = dbstats->getTickerCount(rocksdb::BLOCK_CACHE_HIT);
+  *misses = dbstats->getTickerCount(rocksdb::BLOCK_CACHE_MISS);
+  return 0;
+}
+
+int RocksDBStore::get_int_property(const string &property, uint64_t *out)
+{
+  if (!db->GetIntProperty(property, out))
+    return -ENOENT;
+  return 0;
+}
+
 int RocksDBStore::submit_transaction(KeyValueDB::Transaction t)
 {
   utime_t start = ceph_clock_now();
@@ -552,14 +720,16 @@ void RocksDBStore::RocksDBTransactionImpl::set(
 
   // bufferlist::c_str() is non-constant, so we can't call c_str()
   if (to_set_bl.is_contiguous() && to_set_bl.length() > 0) {
-    bat.Put(rocksdb::Slice(key),
-	     rocksdb::Slice(to_set_bl.buffers().front().c_str(),
-			    to_set_bl.length()));
+    bat.Put(db->get_cf_handle(prefix),
+	    rocksdb::Slice(key),
+	    rocksdb::Slice(to_set_bl.buffers().front().c_str(),
+			   to_set_bl.length()));
   } else {
     // make a copy
     bufferlist val = to_set_bl;
-    bat.Put(rocksdb::Slice(key),
-	     rocksdb::Slice(val.c_str(), val.length()));
+    bat.Put(db->get_cf_handle(prefix),
+	    rocksdb::Slice(key),
+	    rocksdb::Slice(val.c_str(), val.length()));
   }
 }
 
@@ -573,21 +743,23 @@ void RocksDBStore::RocksDBTransactionImpl::set(
 
   // bufferlist::c_str() is non-constant, so we can't call c_str()
   if (to_set_bl.is_contiguous() && to_set_bl.length() > 0) {
-    bat.Put(rocksdb::Slice(key),
-	     rocksdb::Slice(to_set_bl.buffers().front().c_str(),
-			    to_set_bl.length()));
+    bat.Put(db->get_cf_handle(prefix),
+	    rocksdb::Slice(key),
+	    rocksdb::Slice(to_set_bl.buffers().front().c_str(),
+			   to_set_bl.length()));
   } else {
     // make a copy
     bufferlist val = to_set_bl;
-    bat.Put(rocksdb::Slice(key),
-	     rocksdb::Slice(val.c_str(), val.length()));
+    bat.Put(db->get_cf_handle(prefix),
+	    rocksdb::Slice(key),
+	    rocksdb::Slice(val.c_str(), val.length()));
   }
 }
 
 void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 					         const string &k)
 {
-  bat.Delete(combine_strings(prefix, k));
+  bat.Delete(db->get_cf_handle(prefix), combine_strings(prefix, k));
 }
 
 void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
@@ -596,25 +768,38 @@ void RocksDBStore::RocksDBTransactionImpl::rmkey(const string &prefix,
 {
   string key;
   combine_strings(prefix, k, keylen, &key);
-  bat.Delete(key);
+  bat.Delete(db->get_cf_handle(prefix), key);
 }
 
 void RocksDBStore::RocksDBTransactionImpl::rm_single_key(const string &prefix,
 					                 const string &k)
 {
-  bat.SingleDelete(combine_strings(prefix, k));
+  bat.SingleDelete(db->get_cf_handle(prefix), combine_strings(prefix, k));
 }
 
 void RocksDBStore::RocksDBTransactionImpl::rmkeys_by_prefix(const string &prefix)
 {
+  auto cf = db->get_cf_handle(prefix);
   KeyValueDB::Iterator it = db->get_iterator(prefix);
   for (it->seek_to_first();
        it->valid();
        it->next()) {
-    bat.Delete(combine_strings(prefix, it->key()));
+    bat.Delete(cf, combine_strings(prefix, it->key()));
   }
 }
 
+bool RocksDBStore::RocksDBTransactionImpl::rm_range_keys(const string &prefix,
+                                                         const string &start,
+                                                         const string &end)
+{
+  if (!db->cct->_conf->rocksdb_enable_rmrange)
+    return false;
+  bat.DeleteRange(db->get_cf_handle(prefix),
+		  combine_strings(prefix, start),
+		  combine_strings(prefix, end));
+  return true;
+}
+
 void RocksDBStore::RocksDBTransactionImpl::merge(
   const string &prefix,
   const string &k,
@@ -624,31 +809,45 @@ void RocksDBStore::RocksDBTransactionImpl::merge(
 
   // bufferlist::c_str() is non-constant, so we can't call c_str()
   if (to_set_bl.is_contiguous() && to_set_bl.length() > 0) {
-    bat.Merge(rocksdb::Slice(key),
-	       rocksdb::Slice(to_set_bl.buffers().front().c_str(),
-			    to_set_bl.length()));
+    bat.Merge(db->get_cf_handle(prefix),
+	      rocksdb::Slice(key),
+	      rocksdb::Slice(to_set_bl.buffers().front().c_str(),
+			     to_set_bl.length()));
   } else {
     // make a copy
     bufferlist val = to_set_bl;
-    bat.Merge(rocksdb::Slice(key),
-	     rocksdb::Slice(val.c_str(), val.length()));
+    bat.Merge(db->get_cf_handle(prefix),
+	      rocksdb::Slice(key),
+	      rocksdb::Slice(val.c_str(), val.length()));
   }
 }
 
-//gets will bypass RocksDB row cache, since it uses iterator
 int RocksDBStore::get(
     const string &prefix,
     const std::set<string> &keys,
     std::map<string, bufferlist> *out)
 {
   utime_t start = ceph_clock_now();
-  for (std::set<string>::const_iterator i = keys.begin();
-       i != keys.end(); ++i) {
-    std::string value;
-    std::string bound = combine_strings(prefix, *i);
-    auto status = db->Get(rocksdb::ReadOptions(), rocksdb::Slice(bound), &value);
-    if (status.ok())
-      (*out)[*i].append(value);
+  // one MultiGet: a single consistent view, and the per-call overhead
+  // (memtable/version refs, locking) is paid once for the batch
+  std::vector<string> bounds;
+  bounds.reserve(keys.size());
+  std::vector<rocksdb::Slice> slices;
+  slices.reserve(keys.size());
+  for (auto& k : keys) {
+    bounds.push_back(combine_strings(prefix, k));
+    slices.push_back(rocksdb::Slice(bounds.back()));
+  }
+  std::vector<rocksdb::ColumnFamilyHandle*> cfs(keys.size(),
+						get_cf_handle(prefix));
+  std::vector<string> values;
+  std::vector<rocksdb::Status> status = db->MultiGet(rocksdb::ReadOptions(),
+						     cfs, slices, &values);
+  unsigned n = 0;
+  for (auto& k : keys) {
+    if (status[n].ok())
+      (*out)[k].append(values[n]);
+    ++n;
   }
   utime_t lat = ceph_clock_now() - start;
   logger->inc(l_rocksdb_gets);
@@ -667,7 +866,8 @@ int RocksDBStore::get(
   string value, k;
   rocksdb::Status s;
   k = combine_strings(prefix, key);
-  s = db->Get(rocksdb::ReadOptions(), rocksdb::Slice(k), &value);
+  s = db->Get(rocksdb::ReadOptions(), get_cf_handle(prefix),
+	      rocksdb::Slice(k), &value);
   if (s.ok()) {
     out->append(value);
   } else {
@@ -691,7 +891,8 @@ int RocksDBStore::get(
   string value, k;
   combine_strings(prefix, key, keylen, &k);
   rocksdb::Status s;
-  s = db->Get(rocksdb::ReadOptions(), rocksdb::Slice(k), &value);
+  s = db->Get(rocksdb::ReadOptions(), get_cf_handle(prefix),
+	      rocksdb::Slice(k), &value);
   if (s.ok()) {
     out->append(value);
   } else {
@@ -728,6 +929,9 @@ void RocksDBStore::compact()
   logger->inc(l_rocksdb_compact);
   rocksdb::CompactRangeOptions options;
   db->CompactRange(options, nullptr, nullptr);
+  for (auto& p : cf_handles) {
+    db->CompactRange(options, p.second, nullptr, nullptr);
+  }
 }
 
 
@@ -805,29 +1009,86 @@ void RocksDBStore::compact_range(const string& start, const string& end)
   rocksdb::Slice cstart(start);
   rocksdb::Slice cend(end);
   db->CompactRange(options, &cstart, &cend);
+  // the range may cover prefixes kept in other column families
+  for (auto& p : cf_handles) {
+    db->CompactRange(options, p.second, &cstart, &cend);
+  }
+}
+namespace {
+// Adds the tombstones rocksdb stepped over during one iterator call to
+// *total; perf_context is per thread, so only the delta is ours.
+struct deletes_skipped_t {
+  uint64_t *total;
+  uint64_t start;
+  explicit deletes_skipped_t(uint64_t *t)
+    : total(t),
+      start(t ? rocksdb::perf_context.internal_delete_skipped_count : 0) {}
+  ~deletes_skipped_t() {
+    if (total)
+      *total += rocksdb::perf_context.internal_delete_skipped_count - start;
+  }
+};
+}
+
+#define COUNT_DELETES_SKIPPED() \
+  deletes_skipped_t _skipped(store ? &deletes_skipped : nullptr)
+
+RocksDBStore::RocksDBWholeSpaceIteratorImpl::RocksDBWholeSpaceIteratorImpl(
+  RocksDBStore *s,
+  rocksdb::ColumnFamilyHandle *cf,
+  const rocksdb::SliceTransform *extractor,
+  const string& u)
+  : dbiter(nullptr),
+    upper(u),
+    upper_slice(upper)
+{
+  rocksdb::ReadOptions options;
+  options.iterate_upper_bound = &upper_slice;
+  if (extractor) {
+    if (extractor->InDomain(upper_slice) &&
+	extractor->Transform(upper_slice).size() < upper.size()) {
+      // the whole range shares the bound's extracted prefix (e.g. one
+      // object's omap), so the prefix bloom filters can skip tables
+      options.prefix_same_as_start = true;
+    } else {
+      options.total_order_seek = true;
+    }
+  }
+  if (g_conf->rocksdb_perf) {
+    rocksdb::SetPerfLevel(rocksdb::PerfLevel::kEnableTimeExceptForMutex);
+    store = s;
+  }
+  dbiter = s->db->NewIterator(options, cf);
 }
 RocksDBStore::RocksDBWholeSpaceIteratorImpl::~RocksDBWholeSpaceIteratorImpl()
 {
   delete dbiter;
+  if (store) {
+    store->logger->inc(l_rocksdb_iter_deletes_skipped, deletes_skipped);
+  }
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_first()
 {
+  COUNT_DELETES_SKIPPED();
   dbiter->SeekToFirst();
   return dbiter->status().ok() ? 0 : -1;
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_first(const string &prefix)
 {
+  COUNT_DELETES_SKIPPED();
   rocksdb::Slice slice_prefix(prefix);
   dbiter->Seek(slice_prefix);
   return dbiter->status().ok() ? 0 : -1;
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_last()
 {
+  COUNT_DELETES_SKIPPED();
   dbiter->SeekToLast();
   return dbiter->status().ok() ? 0 : -1;
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::seek_to_last(const string &prefix)
 {
+  COUNT_DELETES_SKIPPED();
   string limit = past_prefix(prefix);
   rocksdb::Slice slice_limit(limit);
   dbiter->Seek(slice_limit);
@@ -851,6 +1112,7 @@ int RocksDBStore::RocksDBWholeSpaceIteratorImpl::upper_bound(const string &prefi
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::lower_bound(const string &prefix, const string &to)
 {
+  COUNT_DELETES_SKIPPED();
   string bound = combine_strings(prefix, to);
   rocksdb::Slice slice_bound(bound);
   dbiter->Seek(slice_bound);
@@ -862,6 +1124,7 @@ bool RocksDBStore::RocksDBWholeSpaceIteratorImpl::valid()
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::next()
 {
+  COUNT_DELETES_SKIPPED();
   if (valid()) {
     dbiter->Next();
   }
@@ -869,6 +1132,7 @@ int RocksDBStore::RocksDBWholeSpaceIteratorImpl::next()
 }
 int RocksDBStore::RocksDBWholeSpaceIteratorImpl::prev()
 {
+  COUNT_DELETES_SKIPPED();
   if (valid()) {
     dbiter->Prev();
   }
@@ -923,6 +1187,176 @@ int RocksDBStore::RocksDBWholeSpaceIteratorImpl::status()
   return dbiter->status().ok() ? 0 : -1;
 }
 
+// Each prefix lives in exactly one column family, so the child
+// iterators never hold the same key; that keeps direction changes
+// simple.
+RocksDBStore::CFMergingIteratorImpl::~CFMergingIteratorImpl()
+{
+  for (auto i : iters) {
+    delete i;
+  }
+}
+void RocksDBStore::CFMergingIteratorImpl::_pick_forward()
+{
+  cur = nullptr;
+  for (auto i : iters) {
+    if (i->Valid() && (!cur || i->key().compare(cur->key()) < 0))
+      cur = i;
+  }
+  forward = true;
+}
+void RocksDBStore::CFMergingIteratorImpl::_pick_backward()
+{
+  cur = nullptr;
+  for (auto i : iters) {
+    if (i->Valid() && (!cur || i->key().compare(cur->key()) > 0))
+      cur = i;
+  }
+  forward = false;
+}
+void RocksDBStore::CFMergingIteratorImpl::_seek(const string& k)
+{
+  rocksdb::Slice slice(k);
+  for (auto i : iters) {
+    i->Seek(slice);
+  }
+  _pick_forward();
+}
+int RocksDBStore::CFMergingIteratorImpl::seek_to_first()
+{
+  for (auto i : iters) {
+    i->SeekToFirst();
+  }
+  _pick_forward();
+  return status();
+}
+int RocksDBStore::CFMergingIteratorImpl::seek_to_first(const string &prefix)
+{
+  _seek(prefix);
+  return status();
+}
+int RocksDBStore::CFMergingIteratorImpl::seek_to_last()
+{
+  for (auto i : iters) {
+    i->SeekToLast();
+  }
+  _pick_backward();
+  return status();
+}
+int RocksDBStore::CFMergingIteratorImpl::seek_to_last(const string &prefix)
+{
+  _seek(past_prefix(prefix));
+  if (!valid()) {
+    seek_to_last();
+  } else {
+    prev();
+  }
+  return status();
+}
+int RocksDBStore::CFMergingIteratorImpl::upper_bound(const string &prefix,
+						      const string &after)
+{
+  lower_bound(prefix, after);
+  if (valid()) {
+    pair<string,string> key = raw_key();
+    if (key.first == prefix && key.second == after)
+      next();
+  }
+  return status();
+}
+int RocksDBStore::CFMergingIteratorImpl::lower_bound(const string &prefix,
+						      const string &to)
+{
+  _seek(combine_strings(prefix, to));
+  return status();
+}
+bool RocksDBStore::CFMergingIteratorImpl::valid()
+{
+  return cur && cur->Valid();
+}
+int RocksDBStore::CFMergingIteratorImpl::next()
+{
+  if (valid()) {
+    if (!forward) {
+      string k = cur->key().ToString();
+      for (auto i : iters) {
+	if (i != cur)
+	  i->Seek(k);
+      }
+    }
+    cur->Next();
+    _pick_forward();
+  }
+  return status();
+}
+int RocksDBStore::CFMergingIteratorImpl::prev()
+{
+  if (valid()) {
+    if (forward) {
+      string k = cur->key().ToString();
+      for (auto i : iters) {
+	if (i == cur)
+	  continue;
+	i->Seek(k);
+	if (i->Valid())
+	  i->Prev();
+	else
+	  i->SeekToLast();
+      }
+    }
+    cur->Prev();
+    _pick_backward();
+  }
+  return status();
+}
+string RocksDBStore::CFMergingIteratorImpl::key()
+{
+  string out_key;
+  split_key(cur->key(), 0, &out_key);
+  return out_key;
+}
+pair<string,string> RocksDBStore::CFMergingIteratorImpl::raw_key()
+{
+  string prefix, key;
+  split_key(cur->key(), &prefix, &key);
+  return make_pair(prefix, key);
+}
+bool RocksDBStore::CFMergingIteratorImpl::raw_key_is_prefixed(
+  const string &prefix)
+{
+  rocksdb::Slice key = cur->key();
+  if ((key.size() > prefix.length()) && (key[prefix.length()] == '\0')) {
+    return memcmp(key.data(), prefix.c_str(), prefix.length()) == 0;
+  } else {
+    return false;
+  }
+}
+bufferlist RocksDBStore::CFMergingIteratorImpl::value()
+{
+  return to_bufferlist(cur->value());
+}
+bufferptr RocksDBStore::CFMergingIteratorImpl::value_as_ptr()
+{
+  rocksdb::Slice val = cur->value();
+  return bufferptr(val.data(), val.size());
+}
+int RocksDBStore::CFMergingIteratorImpl::status()
+{
+  for (auto i : iters) {
+    if (!i->status().ok())
+      return -1;
+  }
+  return 0;
+}
+size_t RocksDBStore::CFMergingIteratorImpl::key_size()
+{
+  return cur->key().size();
+}
+size_t RocksDBStore::CFMergingIteratorImpl::value_size()
+{
+  return cur->value().size();
+}
+
 string RocksDBStore::past_prefix(const string &prefix)
 {
   string limit = prefix;
@@ -931,8 +1365,33 @@ string RocksDBStore::past_prefix(const string &prefix)
 }
 
 RocksDBStore::WholeSpaceIterator RocksDBStore::_get_iterator()
+{
+  rocksdb::ReadOptions options;
+  options.total_order_seek = true;
+  if (!cf_handles.empty()) {
+    std::vector<rocksdb::Iterator*> iters;
+    iters.push_back(db->NewIterator(options));
+    for (auto& p : cf_handles) {
+      iters.push_back(db->NewIterator(options, p.second));
+    }
+    return std::make_shared<CFMergingIteratorImpl>(std::move(iters));
+  }
+  return std::make_shared<RocksDBWholeSpaceIteratorImpl>(
+        db->NewIterator(options));
+}
+
+RocksDBStore::WholeSpaceIterator RocksDBStore::_get_prefix_iterator(
+  const string &prefix)
 {
   return std::make_shared<RocksDBWholeSpaceIteratorImpl>(
-        db->NewIterator(rocksdb::ReadOptions()));
+    this, get_cf_handle(prefix), get_prefix_extractor(prefix),
+    past_prefix(prefix));
 }
 
+RocksDBStore::WholeSpaceIterator RocksDBStore::_get_prefix_iterator(
+  const string &prefix, const string &upper_bound)
+{
+  return std::make_shared<RocksDBWholeSpaceIteratorImpl>(
+    this, get_cf_handle(prefix), get_prefix_extractor(prefix),
+    combine_strings(prefix, upper_bound));
+}
@@ -10,8 +10,10 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <unordered_map>
 #include <boost/scoped_ptr.hpp>
 #include "rocksdb/write_batch.h"
+#include "rocksdb/slice.h"
 #include "rocksdb/perf_context.h"
 #include "rocksdb/iostats_context.h"
 #include "rocksdb/statistics.h"
@@ -42,6 +44,7 @@ enum {
   l_rocksdb_write_memtable_time,
   l_rocksdb_write_delay_time,
   l_rocksdb_write_pre_and_post_process_time,
+  l_rocksdb_iter_deletes_skipped,
   l_rocksdb_last,
 };
 
@@ -55,6 +58,8 @@ namespace rocksdb{
   class WriteBatch;
   class Iterator;
   class Logger;
+  class ColumnFamilyHandle;
+  class SliceTransform;
   struct Options;
   struct BlockBasedTableOptions;
 }
@@ -75,7 +80,17 @@ class RocksDBStore : public KeyValueDB {
   rocksdb::BlockBasedTableOptions bbt_opts;
   string options_str;
 
-  int do_open(ostream &out, bool create_if_missing);
+  /// prefix -> column family, for prefixes kept out of the default one
+  std::unordered_map<std::string, rocksdb::ColumnFamilyHandle*> cf_handles;
+  /// prefix extractors of the column families that configure one
+  std::unordered_map<std::string,
+		     std::shared_ptr<const rocksdb::SliceTransform>> cf_prefix_extractors;
+  std::shared_ptr<const rocksdb::SliceTransform> default_prefix_extractor;
+
+  int do_open(ostream &out, bool create_if_missing,
+	      const std::vector<ColumnFamily>& cfs);
+  rocksdb::ColumnFamilyHandle *get_cf_handle(const std::string& prefix);
+  const rocksdb::SliceTransform *get_prefix_extractor(const std::string& prefix);
 
   // manage async compactions
   Mutex compact_queue_lock;
@@ -102,6 +117,7 @@ public:
   /// compact the underlying rocksdb store
   bool compact_on_mount;
   bool disableWAL;
+  bool cache_stats;  ///< track block cache hits/misses even without rocksdb_perf
   void compact();
 
   int tryInterpret(const string key, const string val, rocksdb::Options &opt);
@@ -135,24 +151,37 @@ public:
     compact_queue_stop(false),
     compact_thread(this),
     compact_on_mount(false),
-    disableWAL(false)
+    disableWAL(false),
+    cache_stats(false)
   {}
 
   ~RocksDBStore();
 
   static bool check_omap_dir(string &omap_dir);
   /// Opens underlying db
-  int open(ostream &out) {
-    return do_open(out, false);
+  int open(ostream &out) override {
+    return do_open(out, false, {});
+  }
+  int open(ostream &out, const std::vector<ColumnFamily>& cfs) override {
+    return do_open(out, false, cfs);
   }
   /// Creates underlying db if missing and opens it
-  int create_and_open(ostream &out);
+  int create_and_open(ostream &out) override {
+    return create_and_open(out, {});
+  }
+  int create_and_open(ostream &out,
+		      const std::vector<ColumnFamily>& cfs) override;
 
   void close();
 
   void split_stats(const std::string &s, char delim, std::vector<std::string> &elems);
   void get_statistics(Formatter *f);
 
+  int64_t get_cache_usage() const override;
+  int set_cache_size(uint64_t s) override;
+  int get_cache_hits(uint64_t *hits, uint64_t *misses) override;
+  int get_int_property(const string &property, uint64_t *out) override;
+
   struct  RocksWBHandler: public rocksdb::WriteBatch::Handler {
     std::string seen ;
     int num_seen = 0;
@@ -240,6 +269,25 @@ public:
 
       num_seen++;
     }
+    rocksdb::Status PutCF(uint32_t cf, const rocksdb::Slice& key,
+			  const rocksdb::Slice& value) override {
+      Put(key, value);
+      return rocksdb::Status::OK();
+    }
+    rocksdb::Status SingleDeleteCF(uint32_t cf,
+				   const rocksdb::Slice& key) override {
+      SingleDelete(key);
+      return rocksdb::Status::OK();
+    }
+    rocksdb::Status DeleteCF(uint32_t cf, const rocksdb::Slice& key) override {
+      Delete(key);
+      return rocksdb::Status::OK();
+    }
+    rocksdb::Status MergeCF(uint32_t cf, const rocksdb::Slice& key,
+			    const rocksdb::Slice& value) override {
+      Merge(key, value);
+      return rocksdb::Status::OK();
+    }
     virtual bool Continue() override { return num_seen < 50; }
 
   };
@@ -273,6 +321,10 @@ public:
     void rmkeys_by_prefix(
       const string &prefix
       ) override;
+    bool rm_range_keys(
+      const string &prefix,
+      const string &start,
+      const string &end) override;
     void merge(
       const string& prefix,
       const string& k,
@@ -306,9 +358,18 @@ public:
     public KeyValueDB::WholeSpaceIteratorImpl {
   protected:
     rocksdb::Iterator *dbiter;
+    RocksDBStore *store = nullptr;  ///< set when skipped tombstones are counted
+    uint64_t deletes_skipped = 0;
+    string upper;                   ///< backs ReadOptions::iterate_upper_bound
+    rocksdb::Slice upper_slice;
   public:
     explicit RocksDBWholeSpaceIteratorImpl(rocksdb::Iterator *iter) :
       dbiter(iter) { }
+    /// iterate over one column family, stopping short of the upper bound
+    RocksDBWholeSpaceIteratorImpl(RocksDBStore *store,
+				  rocksdb::ColumnFamilyHandle *cf,
+				  const rocksdb::SliceTransform *extractor,
+				  const string& upper);
     //virtual ~RocksDBWholeSpaceIteratorImpl() { }
     ~RocksDBWholeSpaceIteratorImpl();
 
@@ -331,6 +392,38 @@ public:
     size_t value_size() override;
   };
 
+  /// whole-space iteration over several column families at once
+  class CFMergingIteratorImpl : public KeyValueDB::WholeSpaceIteratorImpl {
+    std::vector<rocksdb::Iterator*> iters;
+    rocksdb::Iterator *cur = nullptr;
+    bool forward = true;
+    void _pick_forward();
+    void _pick_backward();
+    void _seek(const string& k);
+  public:
+    explicit CFMergingIteratorImpl(std::vector<rocksdb::Iterator*>&& i)
+      : iters(i) {}
+    ~CFMergingIteratorImpl();
+
+    int seek_to_first() override;
+    int seek_to_first(const string &prefix) override;
+    int seek_to_last() override;
+    int seek_to_last(const string &prefix) override;
+    int upper_bound(const string &prefix, const string &after) override;
+    int lower_bound(const string &prefix, const string &to) override;
+    bool valid() override;
+    int next() override;
+    int prev() override;
+    string key() override;
+    pair<string,string> raw_key() override;
+    bool raw_key_is_prefixed(const string &prefix) override;
+    bufferlist value() override;
+    bufferptr value_as_ptr() override;
+    int status() override;
+    size_t key_size() override;
+    size_t value_size() override;
+  };
+
   /// Utility
   static string combine_strings(const string &prefix, const string &value) {
     string out = prefix;
@@ -432,6 +525,9 @@ err:
 
 protected:
   WholeSpaceIterator _get_iterator();
+  WholeSpaceIterator _get_prefix_iterator(const std::string &prefix) override;
+  WholeSpaceIterator _get_prefix_iterator(const std::string &prefix,
+					  const std::string &upper_bound) override;
 };
 
 
@@ -9,6 +9,7 @@
 #include "compressor/zlib/CompressionPluginZlib.h"
 #include "compressor/zstd/CompressionPluginZstd.h"
 #include "erasure-code/ErasureCodePlugin.h"
+#include "erasure-code/clay/ErasureCodePluginClay.h"
 #if __x86_64__ && defined(HAVE_BETTER_YASM_ELF64)
 #include "erasure-code/isa/ErasureCodePluginIsa.h"
 #endif
@@ -132,6 +133,13 @@ void cephd_preload_embedded_plugins()
     }
     assert(r == 0);
 
+    plugin = new ErasureCodePluginClay();
+    r = reg.add("clay", plugin);
+    if (r == -EEXIST) {
+      delete plugin;
+    }
+    assert(r == 0);
+
     plugin = new ErasureCodePluginShec();
     r = reg.add("shec", plugin);
     if (r == -EEXIST) {
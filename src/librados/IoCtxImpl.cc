@@ -799,6 +799,51 @@ int librados::IoCtxImpl::aio_operate(const object_t& oid,
   return 0;
 }
 
+int librados::IoCtxImpl::aio_operate_batch(
+  const vector<pair<object_t, ::ObjectOperation*> >& ops,
+  AioCompletionImpl *c, bool write, const SnapContext& snap_context,
+  int flags, vector<int> *prvals)
+{
+  FUNCTRACE();
+  auto ut = ceph::real_clock::now();
+  /* can't write to a snapshot */
+  if (write && snap_seq != CEPH_NOSNAP)
+    return -EROFS;
+
+  if (prvals)
+    prvals->assign(ops.size(), 0);
+  C_aio_batch_Complete *batch = new C_aio_batch_Complete(c, ops.size(),
+							 prvals);
+  c->io = this;
+  if (write) {
+    queue_aio_write(c);
+  } else {
+    c->is_read = true;
+  }
+  if (ops.empty()) {
+    batch->onfinish->complete(0);
+    delete batch;
+    return 0;
+  }
+
+  vector<Objecter::Op*> objecter_ops;
+  objecter_ops.reserve(ops.size());
+  for (unsigned i = 0; i < ops.size(); ++i) {
+    Context *onack = new C_aio_batch_op(batch, i);
+    if (write) {
+      objecter_ops.push_back(objecter->prepare_mutate_op(
+	ops[i].first, oloc, *ops[i].second, snap_context, ut, flags,
+	onack, nullptr));
+    } else {
+      objecter_ops.push_back(objecter->prepare_read_op(
+	ops[i].first, oloc, *ops[i].second, snap_seq, nullptr, flags,
+	onack, nullptr));
+    }
+  }
+  objecter->op_submit_batch(objecter_ops);
+  return 0;
+}
+
 int librados::IoCtxImpl::aio_read(const object_t oid, AioCompletionImpl *c,
 				  bufferlist *pbl, size_t len, uint64_t off,
 				  uint64_t snapid)
@@ -1913,6 +1958,29 @@ void librados::IoCtxImpl::C_aio_Complete::finish(int r)
   c->put_unlock();
 }
 
+librados::IoCtxImpl::C_aio_batch_Complete::C_aio_batch_Complete(
+  AioCompletionImpl *c, unsigned n, vector<int> *_prvals)
+  : onfinish(new C_aio_Complete(c)), prvals(_prvals),
+    lock("librados::IoCtxImpl::C_aio_batch_Complete::lock"),
+    pending(n), rval(0)
+{
+}
+
+void librados::IoCtxImpl::C_aio_batch_Complete::op_finish(unsigned i, int r)
+{
+  lock.Lock();
+  if (prvals)
+    (*prvals)[i] = r;
+  if (r < 0 && rval == 0)
+    rval = r;
+  bool last = --pending == 0;
+  lock.Unlock();
+  if (last) {
+    onfinish->complete(rval);
+    delete this;
+  }
+}
+
 void librados::IoCtxImpl::object_list_slice(
   const hobject_t start,
   const hobject_t finish,
@@ -1953,3 +2021,100 @@ void librados::IoCtxImpl::object_list_slice(
       hobject_t::_reverse_bits(rev_finish), poolid, string());
 }
 
+namespace {
+struct ListSlice {
+  hobject_t pos, end, next;
+  std::list<librados::ListObjectImpl> result;
+  int r = 0;
+};
+
+struct C_ListSlice : public Context {
+  Mutex& lock;
+  Cond& cond;
+  std::list<ListSlice*>& done;
+  ListSlice *slice;
+  C_ListSlice(Mutex& lock, Cond& cond, std::list<ListSlice*>& done,
+	      ListSlice *slice)
+    : lock(lock), cond(cond), done(done), slice(slice) {}
+  void finish(int r) override {
+    Mutex::Locker l(lock);
+    slice->r = r;
+    done.push_back(slice);
+    cond.Signal();
+  }
+};
+} // anonymous namespace
+
+int librados::IoCtxImpl::object_list_parallel(
+  const hobject_t& start,
+  const hobject_t& finish,
+  size_t fanout,
+  uint32_t max,
+  const bufferlist& filter,
+  std::function<int(std::list<librados::ListObjectImpl>&)> cb)
+{
+  if (fanout < 1)
+    fanout = 1;
+
+  // each slice keeps one enumerate_objects in flight, and the results
+  // are handed to cb here, one batch at a time, as they arrive
+  std::vector<ListSlice> slices(fanout);
+  Mutex lock("IoCtxImpl::object_list_parallel");
+  Cond cond;
+  std::list<ListSlice*> done;
+  size_t in_flight = 0;
+
+  auto issue = [&](ListSlice *s) {
+    s->result.clear();
+    ++in_flight;
+    objecter->enumerate_objects(poolid, oloc.nspace, s->pos, s->end, max,
+				filter, &s->result, &s->next,
+				new C_ListSlice(lock, cond, done, s));
+  };
+
+  for (size_t i = 0; i < fanout; ++i) {
+    ListSlice& s = slices[i];
+    object_list_slice(start, finish, i, fanout, &s.pos, &s.end);
+    if (s.pos.is_max() || s.pos == s.end)
+      continue;
+    issue(&s);
+  }
+
+  int ret = 0;
+  bool stop = false;
+  while (in_flight > 0) {
+    ListSlice *s;
+    {
+      Mutex::Locker l(lock);
+      while (done.empty())
+	cond.Wait(lock);
+      s = done.front();
+      done.pop_front();
+    }
+    --in_flight;
+
+    // once we are stopping, just wait for the rest to come back
+    if (stop)
+      continue;
+    if (s->r < 0) {
+      ldout(client->cct, 10) << __func__ << " slice at " << s->pos
+			     << " failed: " << s->r << dendl;
+      ret = s->r;
+      stop = true;
+      continue;
+    }
+    if (!s->result.empty()) {
+      int r = cb(s->result);
+      if (r != 0) {
+	ret = r;
+	stop = true;
+	continue;
+      }
+    }
+    s->pos = s->next;
+    if (!s->pos.is_max() && s->pos != s->end)
+      issue(s);
+  }
+  return ret;
+}
+
@@ -117,6 +117,13 @@ struct librados::IoCtxImpl {
     const size_t m,
     hobject_t *split_start,
     hobject_t *split_finish);
+  int object_list_parallel(
+    const hobject_t& start,
+    const hobject_t& finish,
+    size_t fanout,
+    uint32_t max,
+    const bufferlist& filter,
+    std::function<int(std::list<librados::ListObjectImpl>&)> cb);
 
   int create(const object_t& oid, bool exclusive);
   int write(const object_t& oid, bufferlist& bl, size_t len, uint64_t off);
@@ -154,6 +161,10 @@ struct librados::IoCtxImpl {
 		  int flags);
   int aio_operate_read(const object_t& oid, ::ObjectOperation *o,
 		       AioCompletionImpl *c, int flags, bufferlist *pbl);
+  int aio_operate_batch(
+    const vector<pair<object_t, ::ObjectOperation*> >& ops,
+    AioCompletionImpl *c, bool write, const SnapContext& snap_context,
+    int flags, vector<int> *prvals);
 
   struct C_aio_stat_Ack : public Context {
     librados::AioCompletionImpl *c;
@@ -180,6 +191,26 @@ struct librados::IoCtxImpl {
     void finish(int r);
   };
 
+  // the ops of one aio_operate_batch(), completing c once all are done
+  struct C_aio_batch_Complete {
+    C_aio_Complete *onfinish;
+    vector<int> *prvals;
+    Mutex lock;
+    unsigned pending;
+    int rval;
+    C_aio_batch_Complete(AioCompletionImpl *c, unsigned n,
+			 vector<int> *prvals);
+    void op_finish(unsigned i, int r);
+  };
+  struct C_aio_batch_op : public Context {
+    C_aio_batch_Complete *batch;
+    unsigned i;
+    C_aio_batch_op(C_aio_batch_Complete *b, unsigned _i) : batch(b), i(_i) {}
+    void finish(int r) override {
+      batch->op_finish(i, r);
+    }
+  };
+
   int aio_read(const object_t oid, AioCompletionImpl *c,
 	       bufferlist *pbl, size_t len, uint64_t off, uint64_t snapid);
   int aio_read(object_t oid, AioCompletionImpl *c,
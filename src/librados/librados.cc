@@ -140,6 +140,12 @@ void librados::ObjectOperation::set_op_flags2(int flags)
   ::set_op_flags(o, flags);
 }
 
+void librados::ObjectOperation::set_trace(uint64_t trace_id,
+					  uint64_t parent_span_id)
+{
+  impl->o.trace = trace_context_t(trace_id, parent_span_id);
+}
+
 void librados::ObjectOperation::cmpxattr(const char *name, uint8_t op, const bufferlist& v)
 {
   ::ObjectOperation *o = &impl->o;
@@ -1480,6 +1486,29 @@ int librados::IoCtx::aio_operate(const std::string& oid, AioCompletion *c,
 				       translate_flags(flags), pbl);
 }
 
+int librados::IoCtx::aio_operate_batch(
+  const std::vector<std::pair<std::string, ObjectWriteOperation*> >& ops,
+  AioCompletion *c, std::vector<int> *prvals, int flags)
+{
+  vector<pair<object_t, ::ObjectOperation*> > v;
+  v.reserve(ops.size());
+  for (auto& i : ops)
+    v.push_back(make_pair(object_t(i.first), &i.second->impl->o));
+  return io_ctx_impl->aio_operate_batch(v, c->pc, true, io_ctx_impl->snapc,
+					translate_flags(flags), prvals);
+}
+
+int librados::IoCtx::aio_operate_batch(
+  const std::vector<std::pair<std::string, ObjectReadOperation*> >& ops,
+  AioCompletion *c, std::vector<int> *prvals, int flags)
+{
+  vector<pair<object_t, ::ObjectOperation*> > v;
+  v.reserve(ops.size());
+  for (auto& i : ops)
+    v.push_back(make_pair(object_t(i.first), &i.second->impl->o));
+  return io_ctx_impl->aio_operate_batch(v, c->pc, false, io_ctx_impl->snapc,
+					translate_flags(flags), prvals);
+}
 
 void librados::IoCtx::snap_set_read(snap_t seq)
 {
@@ -5950,3 +5979,31 @@ void librados::IoCtx::object_list_slice(
       (hobject_t*)(split_finish->c_cursor));
 }
 
+int librados::IoCtx::object_list_parallel(
+    const ObjectCursor &start,
+    const ObjectCursor &finish,
+    const size_t fanout,
+    const size_t result_item_count,
+    const bufferlist &filter,
+    std::function<int(std::vector<ObjectItem>&)> cb)
+{
+  std::vector<ObjectItem> result;
+  return io_ctx_impl->object_list_parallel(
+      *((hobject_t*)(start.c_cursor)),
+      *((hobject_t*)(finish.c_cursor)),
+      fanout,
+      result_item_count,
+      filter,
+      [&](std::list<librados::ListObjectImpl>& objs) {
+	result.clear();
+	for (auto& i : objs) {
+	  ObjectItem oi;
+	  oi.oid = i.oid;
+	  oi.nspace = i.nspace;
+	  oi.locator = i.locator;
+	  result.push_back(oi);
+	}
+	return cb(result);
+      });
+}
+
@@ -16,36 +16,47 @@
 
 #include "libradosstriper/MultiAioCompletionImpl.h"
 
-void libradosstriper::MultiAioCompletionImpl::complete_request(ssize_t r)
+void libradosstriper::MultiAioCompletionImpl::add_result(ssize_t r,
+							bool count_bytes)
 {
-  lock.Lock();
-  if (rval >= 0) {
+  int cur = rval;
+  while (cur >= 0) {
+    int next;
     if (r < 0 && r != -EEXIST)
-      rval = r;
-    else if (r > 0)
-      rval += r;
+      next = r;
+    else if (r > 0 && count_bytes)
+      next = cur + r;
+    else
+      break;
+    if (rval.compare_exchange_weak(cur, next))
+      break;
   }
-  assert(pending_complete);
-  int count = --pending_complete;
-  if (!count && !building) {
-    complete();
+}
+
+void libradosstriper::MultiAioCompletionImpl::complete_request(ssize_t r)
+{
+  add_result(r, true);
+  assert(pending_complete > 0);
+  if (--pending_complete == 0) {
+    lock.Lock();
+    if (!building)
+      complete();
+    lock.Unlock();
   }
-  put_unlock();
+  put();
 }
 
 void libradosstriper::MultiAioCompletionImpl::safe_request(ssize_t r)
 {
-  lock.Lock();
-  if (rval >= 0) {
-    if (r < 0 && r != -EEXIST)
-      rval = r;
-  }
-  assert(pending_safe);
-  int count = --pending_safe;
-  if (!count && !building) {
-    safe();
+  add_result(r, false);
+  assert(pending_safe > 0);
+  if (--pending_safe == 0) {
+    lock.Lock();
+    if (!building)
+      safe();
+    lock.Unlock();
   }
-  put_unlock();
+  put();
 }
 
 void libradosstriper::MultiAioCompletionImpl::finish_adding_requests()
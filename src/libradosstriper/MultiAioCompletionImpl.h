@@ -15,6 +15,8 @@
 #ifndef CEPH_LIBRADOSSTRIPERSTRIPER_MULTIAIOCOMPLETIONIMPL_H
 #define CEPH_LIBRADOSSTRIPERSTRIPER_MULTIAIOCOMPLETIONIMPL_H
 
+#include <atomic>
+
 #include "common/Cond.h"
 #include "common/Mutex.h"
 
@@ -22,13 +24,18 @@
 
 struct libradosstriper::MultiAioCompletionImpl {
 
+  // The counters and the return value are atomic so that completing a
+  // rados request, which happens once per stripe unit touched, does not
+  // take the lock.  It is only taken when a counter reaches zero, to run
+  // the user's callback and wake up waiters, and when setting callbacks.
   Mutex lock;
   Cond cond;
-  int ref, rval;
-  int pending_complete, pending_safe;
+  std::atomic<int> ref, rval;
+  std::atomic<int> pending_complete, pending_safe;
   rados_callback_t callback_complete, callback_safe;
   void *callback_complete_arg, *callback_safe_arg;
   bool building;       ///< true if we are still building this completion
+  bool completed, safed; ///< whether complete() and safe() were called
   bufferlist bl;       /// only used for read case in C api of rados striper
   std::list<bufferlist*> bllist; /// keep temporary buffer lists used for destriping
 
@@ -37,7 +44,7 @@ struct libradosstriper::MultiAioCompletionImpl {
     pending_complete(0), pending_safe(0),
     callback_complete(0), callback_safe(0),
     callback_complete_arg(0), callback_safe_arg(0),
-    building(true) {};
+    building(true), completed(false), safed(false) {};
 
   ~MultiAioCompletionImpl() {
     // deallocate temporary buffer lists
@@ -78,16 +85,10 @@ struct libradosstriper::MultiAioCompletionImpl {
     return 0;
   }
   bool is_complete() {
-    lock.Lock();
-    int r = pending_complete;
-    lock.Unlock();
-    return 0 == r;
+    return 0 == pending_complete;
   }
   bool is_safe() {
-    lock.Lock();
-    int r = pending_safe;
-    lock.Unlock();
-    return r == 0;
+    return 0 == pending_safe;
   }
   void wait_for_complete_and_cb() {
     lock.Lock();
@@ -114,48 +115,35 @@ struct libradosstriper::MultiAioCompletionImpl {
     return r;
   }
   int get_return_value() {
-    lock.Lock();
-    int r = rval;
-    lock.Unlock();
-    return r;
+    return rval;
   }
   void get() {
-    lock.Lock();
     _get();
-    lock.Unlock();
   }
   void _get() {
-    assert(lock.is_locked());
     assert(ref > 0);
     ++ref;
   }
   void put() {
-    lock.Lock();
-    put_unlock();
-  }
-  void put_unlock() {
     assert(ref > 0);
-    int n = --ref;
-    lock.Unlock();
-    if (!n)
+    if (--ref == 0)
       delete this;
   }
   void add_request() {
-    lock.Lock();
     pending_complete++;
     _get();
     pending_safe++;
     _get();
-    lock.Unlock();
   }
   void add_safe_request() {
-    lock.Lock();
     pending_complete++;
     _get();
-    lock.Unlock();
   }
   void complete() {
     assert(lock.is_locked());
+    if (completed)
+      return;
+    completed = true;
     if (callback_complete) {
       callback_complete(this, callback_complete_arg);
       callback_complete = 0;
@@ -164,6 +152,9 @@ struct libradosstriper::MultiAioCompletionImpl {
   }
   void safe() {
     assert(lock.is_locked());
+    if (safed)
+      return;
+    safed = true;
     if (callback_safe) {
       callback_safe(this, callback_safe_arg);
       callback_safe = 0;
@@ -171,6 +162,7 @@ struct libradosstriper::MultiAioCompletionImpl {
     cond.Signal();
   };
 
+  void add_result(ssize_t r, bool count_bytes);
   void complete_request(ssize_t r);
   void safe_request(ssize_t r);
   void finish_adding_requests();
@@ -237,7 +237,8 @@ libradosstriper::RadosStriperImpl::TruncateCompletionData::~TruncateCompletionDa
 
 libradosstriper::RadosStriperImpl::RadosStriperImpl(librados::IoCtx& ioctx, librados::IoCtxImpl *ioctx_impl) :
   m_refCnt(0),lock("RadosStriper Refcont", false, false), m_radosCluster(ioctx), m_ioCtx(ioctx), m_ioCtxImpl(ioctx_impl),
-  m_layout(default_file_layout) {}
+  m_layout(default_file_layout),
+  m_readaheadLock("RadosStriper Readahead", false, false) {}
 
 ///////////////////////// layout /////////////////////////////
 
@@ -322,6 +323,7 @@ int libradosstriper::RadosStriperImpl::write(const std::string& soid,
 					     size_t len,
 					     uint64_t off) 
 {
+  invalidate_readahead(soid);
   // open the object. This will create it if needed, retrieve its layout
   // and size and take a shared lock on it
   ceph_file_layout layout;
@@ -335,6 +337,7 @@ int libradosstriper::RadosStriperImpl::append(const std::string& soid,
 					      const bufferlist& bl,
 					      size_t len) 
 {
+  invalidate_readahead(soid);
   // open the object. This will create it if needed, retrieve its layout
   // and size and take a shared lock on it
   ceph_file_layout layout;
@@ -358,6 +361,8 @@ int libradosstriper::RadosStriperImpl::read(const std::string& soid,
 					    size_t len,
 					    uint64_t off)
 {
+  if (cct()->_conf->rados_striper_readahead_max_bytes > 0)
+    return read_with_readahead(soid, bl, len, off);
   // create a completion object
   librados::AioCompletionImpl c;
   // call asynchronous method
@@ -372,6 +377,131 @@ int libradosstriper::RadosStriperImpl::read(const std::string& soid,
   return rc;
 }
 
+///////////////////////// readahead /////////////////////////////
+
+void libradosstriper::RadosStriperImpl::ReadaheadState::Window::wait()
+{
+  if (!c)
+    return;
+  c->wait_for_complete_and_cb();
+  int r = c->get_return_value();
+  c->release();
+  c = 0;
+  if (r < 0) {
+    // nothing usable in there
+    bl.clear();
+    len = 0;
+  }
+}
+
+libradosstriper::RadosStriperImpl::ReadaheadState::~ReadaheadState()
+{
+  for (auto& w : windows)
+    w.second.wait();
+}
+
+int libradosstriper::RadosStriperImpl::read_with_readahead(const std::string& soid,
+							   bufferlist* bl,
+							   size_t len,
+							   uint64_t off)
+{
+  const md_config_t *conf = cct()->_conf;
+  std::shared_ptr<ReadaheadState> ra;
+  {
+    Mutex::Locker l(m_readaheadLock);
+    auto p = m_readahead.find(soid);
+    if (p != m_readahead.end()) {
+      ra = p->second;
+    } else {
+      if (m_readahead.size() >= MAX_READAHEAD_OBJECTS)
+	m_readahead.erase(m_readahead.begin());
+      ra = std::make_shared<ReadaheadState>();
+      ra->readahead.set_trigger_requests(
+	conf->rados_striper_readahead_trigger_requests);
+      ra->readahead.set_max_readahead_size(
+	conf->rados_striper_readahead_max_bytes);
+      // whole stripes, so that each window keeps all the objects of a
+      // stripe busy at once
+      uint64_t stripe_width = (uint64_t)m_layout.fl_stripe_unit *
+	m_layout.fl_stripe_count;
+      uint64_t set_size = (uint64_t)m_layout.fl_object_size *
+	m_layout.fl_stripe_count;
+      ra->readahead.set_alignments({set_size, stripe_width});
+      m_readahead[soid] = ra;
+    }
+  }
+
+  Mutex::Locker l(ra->lock);
+
+  // start the next window before waiting for anything
+  Readahead::extent_t e = ra->readahead.update(off, len, ra->size);
+  if (e.second > 0) {
+    ReadaheadState::Window& w = ra->windows[e.first];
+    if (!w.c && w.bl.length() == 0) {
+      w.len = e.second;
+      w.bl.push_back(buffer::create(e.second));
+      w.c = new librados::AioCompletionImpl;
+      int r = aio_read(soid, w.c, &w.bl, e.second, e.first);
+      if (r < 0) {
+	w.c->release();
+	ra->windows.erase(e.first);
+      }
+    }
+  }
+
+  // forget the windows we are past
+  while (!ra->windows.empty()) {
+    auto p = ra->windows.begin();
+    if (p->first + p->second.len > off)
+      break;
+    p->second.wait();
+    ra->windows.erase(p);
+  }
+
+  // serve the read from the window it falls in, if that has it all
+  auto p = ra->windows.upper_bound(off);
+  if (p != ra->windows.begin()) {
+    --p;
+    ReadaheadState::Window& w = p->second;
+    w.wait();
+    uint64_t end = p->first + w.bl.length();
+    bool eof = w.bl.length() < w.len;
+    if (eof)
+      ra->size = end;
+    if (off + len <= end || (eof && off <= end)) {
+      uint64_t n = std::min<uint64_t>(off + len, end) - off;
+      bufferlist data;
+      if (n > 0)
+	data.substr_of(w.bl, off - p->first, n);
+      bl->claim(data);
+      return n;
+    }
+  }
+
+  librados::AioCompletionImpl c;
+  int rc = aio_read(soid, &c, bl, len, off);
+  if (!rc) {
+    c.wait_for_complete_and_cb();
+    rc = c.get_return_value();
+  }
+  return rc;
+}
+
+void libradosstriper::RadosStriperImpl::invalidate_readahead(const std::string& soid)
+{
+  std::shared_ptr<ReadaheadState> ra;
+  {
+    Mutex::Locker l(m_readaheadLock);
+    auto p = m_readahead.find(soid);
+    if (p == m_readahead.end())
+      return;
+    ra = p->second;
+    m_readahead.erase(p);
+  }
+  // in-flight windows, which hold a shared lock on the striped object,
+  // are waited for as ra goes away
+}
+
 ///////////////////////// asynchronous io /////////////////////////////
 
 int libradosstriper::RadosStriperImpl::aio_write(const std::string& soid,
@@ -380,6 +510,7 @@ int libradosstriper::RadosStriperImpl::aio_write(const std::string& soid,
 						 size_t len,
 						 uint64_t off)
 {
+  invalidate_readahead(soid);
   ceph_file_layout layout;
   std::string lockCookie;
   int rc = createAndOpenStripedObject(soid, &layout, len+off, &lockCookie, true);
@@ -392,6 +523,7 @@ int libradosstriper::RadosStriperImpl::aio_append(const std::string& soid,
 						  const bufferlist& bl,
 						  size_t len)
 {
+  invalidate_readahead(soid);
   ceph_file_layout layout;
   uint64_t size = len;
   std::string lockCookie;
@@ -801,6 +933,8 @@ int libradosstriper::RadosStriperImpl::aio_remove(const std::string& soid,
 						  librados::AioCompletionImpl *c,
 						  int flags)
 {
+  // our own readahead would hold the lock we are about to take
+  invalidate_readahead(soid);
   // the RemoveCompletionData object will lock the given soid for the duration
   // of the removal
   std::string lockCookie = getUUID();
@@ -898,6 +1032,7 @@ int libradosstriper::RadosStriperImpl::internal_aio_remove
 
 int libradosstriper::RadosStriperImpl::trunc(const std::string& soid, uint64_t size)
 {
+  invalidate_readahead(soid);
   // lock the object in exclusive mode
   std::string firstObjOid = getObjectId(soid, 0);
   librados::ObjectWriteOperation op;
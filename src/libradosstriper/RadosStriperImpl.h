@@ -15,6 +15,8 @@
 #ifndef CEPH_LIBRADOSSTRIPER_RADOSSTRIPERIMPL_H
 #define CEPH_LIBRADOSSTRIPER_RADOSSTRIPERIMPL_H
 
+#include <map>
+#include <memory>
 #include <string>
 
 #include "include/atomic.h"
@@ -27,6 +29,7 @@
 #include "librados/IoCtxImpl.h"
 #include "librados/AioCompletionImpl.h"
 #include "common/RefCountedObj.h"
+#include "common/Readahead.h"
 
 struct libradosstriper::RadosStriperImpl {
 
@@ -239,6 +242,34 @@ struct libradosstriper::RadosStriperImpl {
     uint64_t m_size;
   };
 
+  /**
+   * readahead state of a striped object read sequentially with read()
+   */
+  struct ReadaheadState {
+    /// a readahead request and, once it is complete, its data
+    struct Window {
+      Window() : len(0), c(0) {}
+      /// wait for the read to complete; the data is then in bl
+      void wait();
+      /// number of bytes asked for; fewer in bl means end of object
+      uint64_t len;
+      /// completion of the read, 0 once waited for
+      librados::AioCompletionImpl *c;
+      /// the data
+      bufferlist bl;
+    };
+    ReadaheadState() : lock("RadosStriperImpl::ReadaheadState::lock"),
+		       size(Readahead::NO_LIMIT) {}
+    /// destructor, waits for the windows still being read
+    ~ReadaheadState();
+    Mutex lock;
+    Readahead readahead;
+    /// size of the striped object, once a window reached its end
+    uint64_t size;
+    /// windows by offset in the striped object
+    std::map<uint64_t, Window> windows;
+  };
+
   /**
    * exception wrapper around an error code
    */
@@ -332,6 +363,18 @@ struct libradosstriper::RadosStriperImpl {
       delete this;
   }
 
+  // readahead
+  /**
+   * reads through the readahead windows of the striped object, first
+   * starting the next window if the reads so far are sequential
+   */
+  int read_with_readahead(const std::string& soid,
+			  bufferlist* bl,
+			  size_t len,
+			  uint64_t off);
+  /// drops the readahead data of a striped object we are changing
+  void invalidate_readahead(const std::string& soid);
+
   // objectid manipulation
   std::string getObjectId(const object_t& soid, long long unsigned objectno);
 
@@ -474,6 +517,13 @@ struct libradosstriper::RadosStriperImpl {
 
   // Default layout
   ceph_file_layout m_layout;
+
+  // Readahead state of the striped objects being read, at most
+  // MAX_READAHEAD_OBJECTS of them.  Declared last so that in-flight
+  // readahead is waited for before anything else is torn down
+  static const size_t MAX_READAHEAD_OBJECTS = 32;
+  Mutex m_readaheadLock;
+  std::map<std::string, std::shared_ptr<ReadaheadState> > m_readahead;
 };
 
 #endif
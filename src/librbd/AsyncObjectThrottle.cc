@@ -7,6 +7,11 @@
 #include "librbd/ImageCtx.h"
 #include "librbd/Utils.h"
 
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::AsyncObjectThrottle: " << this \
+                           << " " << __func__ << ": "
+
 namespace librbd
 {
 
@@ -29,6 +34,9 @@ void AsyncObjectThrottle<T>::start_ops(uint64_t max_concurrent) {
   bool complete;
   {
     Mutex::Locker l(m_lock);
+    m_min_ops = m_max_ops = max_concurrent;
+    m_limit_ops = MAX(max_concurrent,
+                      m_image_ctx.concurrent_management_ops_max);
     for (uint64_t i = 0; i < max_concurrent; ++i) {
       start_next_op();
       if (m_ret < 0 && m_current_ops == 0) {
@@ -45,7 +53,7 @@ void AsyncObjectThrottle<T>::start_ops(uint64_t max_concurrent) {
 }
 
 template <typename T>
-void AsyncObjectThrottle<T>::finish_op(int r) {
+void AsyncObjectThrottle<T>::finish_op(int r, const utime_t &latency) {
   bool complete;
   {
     RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
@@ -55,7 +63,14 @@ void AsyncObjectThrottle<T>::finish_op(int r) {
       m_ret = r;
     }
 
-    start_next_op();
+    update_window(latency);
+    while (m_current_ops < m_max_ops) {
+      uint64_t current_ops = m_current_ops;
+      start_next_op();
+      if (m_current_ops == current_ops) {
+        break;
+      }
+    }
     complete = (m_current_ops == 0);
   }
   if (complete) {
@@ -64,6 +79,38 @@ void AsyncObjectThrottle<T>::finish_op(int r) {
   }
 }
 
+template <typename T>
+void AsyncObjectThrottle<T>::update_window(const utime_t &latency) {
+  assert(m_lock.is_locked());
+  if (m_limit_ops <= m_min_ops) {
+    return;
+  }
+
+  m_window_latency += static_cast<double>(latency);
+  if (++m_window_ops < m_max_ops) {
+    return;
+  }
+
+  double avg_latency = m_window_latency / m_window_ops;
+  m_window_ops = 0;
+  m_window_latency = 0;
+  if (m_min_latency == 0 || avg_latency < m_min_latency) {
+    m_min_latency = avg_latency;
+  }
+
+  uint64_t max_ops = m_max_ops;
+  if (avg_latency < 1.5 * m_min_latency) {
+    m_max_ops = MIN(m_limit_ops, m_max_ops + MAX(1, m_max_ops / 4));
+  } else if (avg_latency > 3 * m_min_latency) {
+    m_max_ops = MAX(m_min_ops, m_max_ops / 2);
+  }
+  if (m_max_ops != max_ops) {
+    ldout(m_image_ctx.cct, 10) << "latency " << avg_latency << " (min "
+                               << m_min_latency << "), window " << max_ops
+                               << " -> " << m_max_ops << dendl;
+  }
+}
+
 template <typename T>
 void AsyncObjectThrottle<T>::start_next_op() {
   bool done = false;
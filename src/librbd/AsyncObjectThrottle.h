@@ -5,6 +5,8 @@
 
 #include "include/int_types.h"
 #include "include/Context.h"
+#include "include/utime.h"
+#include "common/Clock.h"
 
 #include <boost/function.hpp>
 
@@ -17,7 +19,7 @@ struct ImageCtx;
 class AsyncObjectThrottleFinisher {
 public:
   virtual ~AsyncObjectThrottleFinisher() {};
-  virtual void finish_op(int r) = 0;
+  virtual void finish_op(int r, const utime_t &latency) = 0;
 };
 
 template <typename ImageCtxT = ImageCtx>
@@ -25,7 +27,8 @@ class C_AsyncObjectThrottle : public Context {
 public:
   C_AsyncObjectThrottle(AsyncObjectThrottleFinisher &finisher,
                         ImageCtxT &image_ctx)
-    : m_image_ctx(image_ctx), m_finisher(finisher) {
+    : m_image_ctx(image_ctx), m_finisher(finisher),
+      m_start_time(ceph_clock_now()) {
   }
 
   virtual int send() = 0;
@@ -34,13 +37,22 @@ protected:
   ImageCtxT &m_image_ctx;
 
   void finish(int r) override {
-    m_finisher.finish_op(r);
+    m_finisher.finish_op(r, ceph_clock_now() - m_start_time);
   }
 
 private:
   AsyncObjectThrottleFinisher &m_finisher;
+  utime_t m_start_time;
 };
 
+/**
+ * Sends one op per object, keeping a window of them in flight.  The
+ * window starts at the concurrency given to start_ops(); while the
+ * average latency of a window's worth of ops stays close to the lowest
+ * seen it grows, up to rbd_concurrent_management_ops_max, and once the
+ * latency rises well above that it is halved again.
+ */
+
 template <typename ImageCtxT = ImageCtx>
 class AsyncObjectThrottle : public AsyncObjectThrottleFinisher {
 public:
@@ -55,7 +67,7 @@ public:
 		      uint64_t end_object_no);
 
   void start_ops(uint64_t max_concurrent);
-  void finish_op(int r) override;
+  void finish_op(int r, const utime_t &latency) override;
 
 private:
   Mutex m_lock;
@@ -69,7 +81,15 @@ private:
   uint64_t m_current_ops;
   int m_ret;
 
+  uint64_t m_min_ops = 0;
+  uint64_t m_max_ops = 0;           ///< current window
+  uint64_t m_limit_ops = 0;         ///< the window can grow up to this
+  uint64_t m_window_ops = 0;        ///< completed in the current window
+  double m_window_latency = 0;      ///< their summed latency
+  double m_min_latency = 0;         ///< lowest window average seen
+
   void start_next_op();
+  void update_window(const utime_t &latency);
 };
 
 } // namespace librbd
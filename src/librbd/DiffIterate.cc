@@ -44,7 +44,7 @@ struct DiffContext {
     : callback(callback), callback_arg(callback_arg),
       whole_object(_whole_object), from_snap_id(_from_snap_id),
       end_snap_id(_end_snap_id),
-      throttle(image_ctx.concurrent_management_ops, true) {
+      throttle(image_ctx.concurrent_diff_ops, true) {
   }
 };
 
@@ -58,6 +58,15 @@ public:
       m_object_extents(object_extents), m_snap_ret(0) {
   }
 
+  // the object map already tells how the object changed: report that
+  // without listing its snapshots, in order with the objects before it
+  void send_known(ObjectDiffState state) {
+    m_known = true;
+    m_known_state = state;
+    C_OrderedThrottle *ctx = m_diff_context.throttle.start_op(this);
+    ctx->complete(0);
+  }
+
   void send() {
     C_OrderedThrottle *ctx = m_diff_context.throttle.start_op(this);
     librados::AioCompletion *rados_completion =
@@ -82,7 +91,9 @@ protected:
     }
 
     Diffs diffs;
-    if (r == 0) {
+    if (m_known) {
+      compute_known_diffs(&diffs);
+    } else if (r == 0) {
       ldout(cct, 20) << "object " << m_oid << ": list_snaps complete" << dendl;
       compute_diffs(&diffs);
     } else if (r == -ENOENT) {
@@ -118,6 +129,26 @@ private:
   librados::snap_set_t m_snap_set;
   int m_snap_ret;
 
+  bool m_known = false;
+  ObjectDiffState m_known_state = OBJECT_DIFF_STATE_NONE;
+
+  void compute_known_diffs(Diffs *diffs) {
+    ldout(m_image_ctx.cct, 20) << "object " << m_oid << ": diff state "
+                               << m_known_state << " from object map"
+                               << dendl;
+    if (m_known_state == OBJECT_DIFF_STATE_NONE) {
+      compute_parent_overlap(diffs);
+      return;
+    }
+
+    bool exists = (m_known_state == OBJECT_DIFF_STATE_UPDATED);
+    for (vector<ObjectExtent>::iterator q = m_object_extents.begin();
+         q != m_object_extents.end(); ++q) {
+      diffs->push_back(boost::make_tuple(m_offset + q->offset, q->length,
+                                         exists));
+    }
+  }
+
   void compute_diffs(Diffs *diffs) {
     CephContext *cct = m_image_ctx.cct;
 
@@ -240,7 +271,7 @@ int DiffIterate::execute() {
   BitVector<2> object_diff_state;
   {
     RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
-    if (m_whole_object && (m_image_ctx.features & RBD_FEATURE_FAST_DIFF) != 0) {
+    if ((m_image_ctx.features & RBD_FEATURE_FAST_DIFF) != 0) {
       r = diff_object_map(from_snap_id, end_snap_id, &object_diff_state);
       if (r < 0) {
         ldout(cct, 5) << "fast diff disabled" << dendl;
@@ -300,30 +331,34 @@ int DiffIterate::execute() {
          p != object_extents.end(); ++p) {
       ldout(cct, 20) << "object " << p->first << dendl;
 
+      // the object map is trusted whenever it is valid: unchanged objects
+      // are skipped (unless they may show parent data) and only changed
+      // objects are listed, when the exact extents are needed
+      ObjectDiffState state = OBJECT_DIFF_STATE_UPDATED;
       if (fast_diff_enabled) {
         const uint64_t object_no = p->second.front().objectno;
-        if (object_diff_state[object_no] != OBJECT_DIFF_STATE_NONE) {
-          bool updated = (object_diff_state[object_no] ==
-                            OBJECT_DIFF_STATE_UPDATED);
-          for (std::vector<ObjectExtent>::iterator q = p->second.begin();
-               q != p->second.end(); ++q) {
-            r = m_callback(off + q->offset, q->length, updated, m_callback_arg);
-            if (r < 0) {
-              return r;
-            }
-          }
+        state = static_cast<ObjectDiffState>(
+          static_cast<uint8_t>(object_diff_state[object_no]));
+        if (state == OBJECT_DIFF_STATE_NONE &&
+            diff_context.parent_diff.empty()) {
+          continue;
         }
+      }
+
+      C_DiffObject *diff_object = new C_DiffObject(m_image_ctx, head_ctx,
+                                                   diff_context,
+                                                   p->first.name, off,
+                                                   p->second);
+      if (fast_diff_enabled &&
+          (m_whole_object || state == OBJECT_DIFF_STATE_NONE)) {
+        diff_object->send_known(state);
       } else {
-        C_DiffObject *diff_object = new C_DiffObject(m_image_ctx, head_ctx,
-                                                     diff_context,
-                                                     p->first.name, off,
-                                                     p->second);
         diff_object->send();
+      }
 
-        if (diff_context.throttle.pending_error()) {
-          r = diff_context.throttle.wait_for_ret();
-          return r;
-        }
+      if (diff_context.throttle.pending_error()) {
+        r = diff_context.throttle.wait_for_ret();
+        return r;
       }
     }
 
@@ -374,7 +409,7 @@ int DiffIterate::diff_object_map(uint64_t from_snap_id, uint64_t to_snap_id,
     }
 
     uint64_t flags;
-    int r = m_image_ctx.get_flags(from_snap_id, &flags);
+    int r = m_image_ctx.get_flags(current_snap_id, &flags);
     if (r < 0) {
       lderr(cct) << "diff_object_map: failed to retrieve image flags" << dendl;
       return r;
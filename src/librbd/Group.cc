@@ -1,12 +1,17 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 // vim: ts=8 sw=2 smarttab
 
+#include "common/Cond.h"
 #include "common/errno.h"
 
+#include "librbd/ExclusiveLock.h"
 #include "librbd/Group.h"
+#include "librbd/ImageCtx.h"
 #include "librbd/ImageState.h"
+#include "librbd/Operations.h"
 #include "librbd/Utils.h"
 #include "librbd/io/AioCompletion.h"
+#include <iomanip>
 
 #define dout_subsys ceph_subsys_rbd
 #undef dout_prefix
@@ -26,6 +31,223 @@ using librados::Rados;
 
 namespace librbd {
 
+namespace {
+
+const uint64_t MAX_GROUP_SNAPS_READ = 1024;
+
+std::string group_image_snap_name(int64_t group_pool,
+                                  const std::string &group_id,
+                                  snapid_t snap_id)
+{
+  std::ostringstream oss;
+  oss << ".group." << std::hex << group_pool << "_" << group_id << "_"
+      << snap_id;
+  return oss.str();
+}
+
+int list_group_images(IoCtx& group_ioctx, const std::string &group_header_oid,
+                      std::vector<cls::rbd::GroupImageStatus> *images)
+{
+  const int max_read = 1024;
+  cls::rbd::GroupImageSpec start_last;
+  int r;
+  do {
+    std::vector<cls::rbd::GroupImageStatus> images_page;
+    r = cls_client::group_image_list(&group_ioctx, group_header_oid,
+                                     start_last, max_read, &images_page);
+    if (r < 0) {
+      return r;
+    }
+    images->insert(images->end(), images_page.begin(), images_page.end());
+
+    if (!images_page.empty()) {
+      start_last = images_page.rbegin()->spec;
+    }
+    r = images_page.size();
+  } while (r == max_read);
+
+  return 0;
+}
+
+int list_group_snaps(IoCtx& group_ioctx, const std::string &group_header_oid,
+                     std::vector<cls::rbd::GroupSnapshot> *snaps)
+{
+  snapid_t start_after = 0;
+  int r;
+  do {
+    std::vector<cls::rbd::GroupSnapshot> snaps_page;
+    r = cls_client::group_snap_list(&group_ioctx, group_header_oid,
+                                    start_after, MAX_GROUP_SNAPS_READ,
+                                    &snaps_page);
+    if (r < 0) {
+      return r;
+    }
+    snaps->insert(snaps->end(), snaps_page.begin(), snaps_page.end());
+
+    if (!snaps_page.empty()) {
+      start_after = snaps_page.rbegin()->id;
+    }
+    r = snaps_page.size();
+  } while (r == static_cast<int>(MAX_GROUP_SNAPS_READ));
+
+  return 0;
+}
+
+// issues op against every image at once and waits for all of them
+template <typename F>
+int for_each_image(const std::vector<ImageCtx*> &ictxs, F &&op,
+                   std::vector<int> *results = nullptr)
+{
+  std::vector<C_SaferCond> ctxs(ictxs.size());
+  for (size_t i = 0; i < ictxs.size(); ++i) {
+    op(ictxs[i], &ctxs[i]);
+  }
+
+  int ret = 0;
+  for (size_t i = 0; i < ictxs.size(); ++i) {
+    int r = ctxs[i].wait();
+    if (results != nullptr) {
+      results->push_back(r);
+    }
+    if (r < 0 && ret == 0) {
+      ret = r;
+    }
+  }
+  return ret;
+}
+
+void close_images(std::vector<ImageCtx*> *ictxs)
+{
+  for_each_image(*ictxs, [](ImageCtx *ictx, Context *ctx) {
+      ictx->state->close(ctx);
+    });
+  for (auto ictx : *ictxs) {
+    delete ictx;
+  }
+  ictxs->clear();
+}
+
+// images that no longer exist are skipped if skip_missing is set
+int open_images(IoCtx& group_ioctx,
+                const std::vector<cls::rbd::GroupImageSpec> &specs,
+                bool skip_missing, std::vector<ImageCtx*> *ictxs)
+{
+  CephContext *cct = (CephContext *)group_ioctx.cct();
+  librados::Rados rados(group_ioctx);
+
+  std::vector<ImageCtx*> opening;
+  for (auto &spec : specs) {
+    IoCtx image_ioctx;
+    int r = rados.ioctx_create2(spec.pool_id, image_ioctx);
+    if (r < 0) {
+      lderr(cct) << "failed to open pool " << spec.pool_id << ": "
+                 << cpp_strerror(r) << dendl;
+      for (auto ictx : opening) {
+        delete ictx;
+      }
+      return r;
+    }
+    opening.push_back(new ImageCtx("", spec.image_id, nullptr, image_ioctx,
+                                   false));
+  }
+
+  std::vector<int> results;
+  for_each_image(opening, [](ImageCtx *ictx, Context *ctx) {
+      ictx->state->open(false, ctx);
+    }, &results);
+
+  int ret = 0;
+  for (size_t i = 0; i < opening.size(); ++i) {
+    if (results[i] == 0) {
+      ictxs->push_back(opening[i]);
+      continue;
+    }
+
+    delete opening[i];
+    if (results[i] == -ENOENT && skip_missing) {
+      continue;
+    }
+    lderr(cct) << "failed to open image " << specs[i].image_id << ": "
+               << cpp_strerror(results[i]) << dendl;
+    if (ret == 0) {
+      ret = results[i];
+    }
+  }
+
+  if (ret < 0) {
+    close_images(ictxs);
+  }
+  return ret;
+}
+
+int remove_image_snaps(const std::vector<ImageCtx*> &ictxs,
+                       const std::string &image_snap_name)
+{
+  std::vector<int> results;
+  for_each_image(ictxs, [&image_snap_name](ImageCtx *ictx, Context *ctx) {
+      ictx->operations->snap_remove(image_snap_name.c_str(), ctx);
+    }, &results);
+
+  for (auto r : results) {
+    if (r < 0 && r != -ENOENT) {
+      return r;
+    }
+  }
+  return 0;
+}
+
+int group_snap_remove_by_record(IoCtx& group_ioctx, const std::string &group_id,
+                                const cls::rbd::GroupSnapshot &group_snap)
+{
+  CephContext *cct = (CephContext *)group_ioctx.cct();
+  std::string group_header_oid = util::group_header_name(group_id);
+
+  // an incomplete snapshot does not know which images it got to
+  std::vector<cls::rbd::GroupImageSpec> specs;
+  if (group_snap.state == cls::rbd::GROUP_SNAPSHOT_STATE_COMPLETE) {
+    for (auto &snap : group_snap.snaps) {
+      specs.emplace_back(snap.image_id, snap.pool);
+    }
+  } else {
+    std::vector<cls::rbd::GroupImageStatus> images;
+    int r = list_group_images(group_ioctx, group_header_oid, &images);
+    if (r < 0) {
+      lderr(cct) << "error listing group images: " << cpp_strerror(r) << dendl;
+      return r;
+    }
+    for (auto &image : images) {
+      specs.push_back(image.spec);
+    }
+  }
+
+  std::vector<ImageCtx*> ictxs;
+  int r = open_images(group_ioctx, specs, true, &ictxs);
+  if (r < 0) {
+    return r;
+  }
+
+  r = remove_image_snaps(ictxs, group_image_snap_name(group_ioctx.get_id(),
+                                                      group_id,
+                                                      group_snap.id));
+  close_images(&ictxs);
+  if (r < 0) {
+    lderr(cct) << "failed to remove image snapshots: " << cpp_strerror(r)
+               << dendl;
+    return r;
+  }
+
+  r = cls_client::group_snap_remove(&group_ioctx, group_header_oid,
+                                    group_snap.id);
+  if (r < 0 && r != -ENOENT) {
+    lderr(cct) << "failed to remove group snapshot record: "
+               << cpp_strerror(r) << dendl;
+    return r;
+  }
+  return 0;
+}
+
+} // anonymous namespace
+
 // Consistency groups functions
 
 int group_create(librados::IoCtx& io_ctx, const char *group_name)
@@ -76,8 +298,23 @@ int group_remove(librados::IoCtx& io_ctx, const char *group_name)
   CephContext *cct((CephContext *)io_ctx.cct());
   ldout(cct, 20) << "group_remove " << &io_ctx << " " << group_name << dendl;
 
+  std::vector<group_snap_spec_t> snaps;
+  int r = group_snap_list(io_ctx, group_name, &snaps);
+  if (r < 0 && r != -ENOENT) {
+    lderr(cct) << "error listing group snapshots" << dendl;
+    return r;
+  }
+
+  for (auto &snap : snaps) {
+    r = group_snap_remove(io_ctx, group_name, snap.name.c_str());
+    if (r < 0 && r != -ENOENT) {
+      lderr(cct) << "error removing group snapshot" << dendl;
+      return r;
+    }
+  }
+
   std::vector<group_image_status_t> images;
-  int r = group_image_list(io_ctx, group_name, &images);
+  r = group_image_list(io_ctx, group_name, &images);
   if (r < 0 && r != -ENOENT) {
     lderr(cct) << "error listing group images" << dendl;
     return r;
@@ -312,28 +549,12 @@ int group_image_list(librados::IoCtx& group_ioctx,
 		 << group_name << " group id " << group_header_oid << dendl;
 
   std::vector<cls::rbd::GroupImageStatus> image_ids;
-
-  const int max_read = 1024;
-  do {
-    std::vector<cls::rbd::GroupImageStatus> image_ids_page;
-    cls::rbd::GroupImageSpec start_last;
-
-    r = cls_client::group_image_list(&group_ioctx, group_header_oid,
-	start_last, max_read, &image_ids_page);
-
-    if (r < 0) {
-      lderr(cct) << "error reading image list from consistency group: "
-	<< cpp_strerror(-r) << dendl;
-      return r;
-    }
-    image_ids.insert(image_ids.end(),
-		     image_ids_page.begin(), image_ids_page.end());
-
-    if (image_ids_page.size() > 0)
-      start_last = image_ids_page.rbegin()->spec;
-
-    r = image_ids_page.size();
-  } while (r == max_read);
+  r = list_group_images(group_ioctx, group_header_oid, &image_ids);
+  if (r < 0) {
+    lderr(cct) << "error reading image list from consistency group: "
+      << cpp_strerror(-r) << dendl;
+    return r;
+  }
 
   for (auto i : image_ids) {
     librados::Rados rados(group_ioctx);
@@ -382,4 +603,209 @@ int image_get_group(ImageCtx *ictx, group_spec_t *group_spec)
   return 0;
 }
 
+int group_snap_create(librados::IoCtx& group_ioctx, const char *group_name,
+		      const char *snap_name)
+{
+  CephContext *cct = (CephContext *)group_ioctx.cct();
+  ldout(cct, 20) << "group_snap_create " << &group_ioctx
+		 << " group name " << group_name << " snap name "
+		 << snap_name << dendl;
+
+  std::string group_id;
+  int r = cls_client::dir_get_id(&group_ioctx, RBD_GROUP_DIRECTORY,
+				 group_name, &group_id);
+  if (r < 0) {
+    lderr(cct) << "error reading consistency group id object: "
+	       << cpp_strerror(r) << dendl;
+    return r;
+  }
+  std::string group_header_oid = util::group_header_name(group_id);
+
+  std::vector<cls::rbd::GroupImageStatus> images;
+  r = list_group_images(group_ioctx, group_header_oid, &images);
+  if (r < 0) {
+    lderr(cct) << "error listing group images: " << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  std::vector<cls::rbd::GroupImageSpec> specs;
+  for (auto &image : images) {
+    if (image.state != cls::rbd::GROUP_IMAGE_LINK_STATE_ATTACHED) {
+      lderr(cct) << "image " << image.spec.image_id << " is being added to "
+		 << "or removed from the group" << dendl;
+      return -EINVAL;
+    }
+    specs.push_back(image.spec);
+  }
+
+  snapid_t snap_id;
+  r = cls_client::group_snap_add(&group_ioctx, group_header_oid, snap_name,
+				 &snap_id);
+  if (r < 0) {
+    lderr(cct) << "error adding group snapshot: " << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  cls::rbd::GroupSnapshot group_snap(snap_id, snap_name,
+				     cls::rbd::GROUP_SNAPSHOT_STATE_INCOMPLETE);
+  std::string image_snap_name = group_image_snap_name(group_ioctx.get_id(),
+						      group_id, snap_id);
+  cls::rbd::SnapshotNamespace snap_namespace(
+    cls::rbd::GroupSnapshotNamespace(group_ioctx.get_id(), group_id,
+				     snap_id));
+
+  std::vector<ImageCtx*> ictxs;
+  r = open_images(group_ioctx, specs, false, &ictxs);
+  if (r < 0) {
+    cls_client::group_snap_remove(&group_ioctx, group_header_oid, snap_id);
+    return r;
+  }
+
+  // quiesce: take the exclusive lock of every image, which asks the
+  // current owners to flush and release it, and hold on to it until all
+  // the snapshots exist
+  r = for_each_image(ictxs, [](ImageCtx *ictx, Context *ctx) {
+      RWLock::WLocker owner_locker(ictx->owner_lock);
+      if (ictx->exclusive_lock == nullptr) {
+	ctx->complete(0);
+	return;
+      }
+      ictx->exclusive_lock->block_requests(-EBUSY);
+      ictx->exclusive_lock->acquire_lock(ctx);
+    });
+  if (r == 0) {
+    for (auto ictx : ictxs) {
+      RWLock::RLocker owner_locker(ictx->owner_lock);
+      if (ictx->exclusive_lock != nullptr &&
+	  !ictx->exclusive_lock->is_lock_owner()) {
+	r = -EROFS;
+	break;
+      }
+    }
+  }
+  if (r < 0) {
+    lderr(cct) << "failed to quiesce group images: " << cpp_strerror(r)
+	       << dendl;
+  }
+
+  if (r == 0) {
+    r = for_each_image(ictxs,
+      [&image_snap_name, &snap_namespace](ImageCtx *ictx, Context *ctx) {
+	RWLock::RLocker owner_locker(ictx->owner_lock);
+	ictx->operations->execute_snap_create(image_snap_name, snap_namespace,
+					      ctx, 0, false);
+      });
+    if (r < 0) {
+      lderr(cct) << "failed to create image snapshots: " << cpp_strerror(r)
+		 << dendl;
+    }
+  }
+
+  if (r == 0) {
+    for (auto ictx : ictxs) {
+      RWLock::RLocker snap_locker(ictx->snap_lock);
+      group_snap.snaps.emplace_back(ictx->md_ctx.get_id(), ictx->id,
+				    ictx->get_snap_id(image_snap_name));
+    }
+  }
+
+  for (auto ictx : ictxs) {
+    RWLock::RLocker owner_locker(ictx->owner_lock);
+    if (ictx->exclusive_lock != nullptr) {
+      ictx->exclusive_lock->unblock_requests();
+    }
+  }
+
+  if (r == 0) {
+    group_snap.state = cls::rbd::GROUP_SNAPSHOT_STATE_COMPLETE;
+    r = cls_client::group_snap_set(&group_ioctx, group_header_oid, group_snap);
+    if (r < 0) {
+      lderr(cct) << "failed to update group snapshot: " << cpp_strerror(r)
+		 << dendl;
+    }
+  }
+  close_images(&ictxs);
+
+  if (r < 0) {
+    int remove_r = group_snap_remove_by_record(group_ioctx, group_id,
+					       group_snap);
+    if (remove_r < 0) {
+      lderr(cct) << "failed to clean up group snapshot: "
+		 << cpp_strerror(remove_r) << dendl;
+    }
+    return r;
+  }
+
+  return 0;
+}
+
+int group_snap_remove(librados::IoCtx& group_ioctx, const char *group_name,
+		      const char *snap_name)
+{
+  CephContext *cct = (CephContext *)group_ioctx.cct();
+  ldout(cct, 20) << "group_snap_remove " << &group_ioctx
+		 << " group name " << group_name << " snap name "
+		 << snap_name << dendl;
+
+  std::string group_id;
+  int r = cls_client::dir_get_id(&group_ioctx, RBD_GROUP_DIRECTORY,
+				 group_name, &group_id);
+  if (r < 0) {
+    lderr(cct) << "error reading consistency group id object: "
+	       << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  std::vector<cls::rbd::GroupSnapshot> group_snaps;
+  r = list_group_snaps(group_ioctx, util::group_header_name(group_id),
+		       &group_snaps);
+  if (r < 0) {
+    lderr(cct) << "error listing group snapshots: " << cpp_strerror(r)
+	       << dendl;
+    return r;
+  }
+
+  for (auto &group_snap : group_snaps) {
+    if (group_snap.name == snap_name) {
+      return group_snap_remove_by_record(group_ioctx, group_id, group_snap);
+    }
+  }
+  return -ENOENT;
+}
+
+int group_snap_list(librados::IoCtx& group_ioctx, const char *group_name,
+		    std::vector<group_snap_spec_t> *snaps)
+{
+  CephContext *cct = (CephContext *)group_ioctx.cct();
+  ldout(cct, 20) << "group_snap_list " << &group_ioctx
+		 << " group name " << group_name << dendl;
+
+  std::string group_id;
+  int r = cls_client::dir_get_id(&group_ioctx, RBD_GROUP_DIRECTORY,
+				 group_name, &group_id);
+  if (r < 0) {
+    lderr(cct) << "error reading consistency group id object: "
+	       << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  std::vector<cls::rbd::GroupSnapshot> group_snaps;
+  r = list_group_snaps(group_ioctx, util::group_header_name(group_id),
+		       &group_snaps);
+  if (r < 0) {
+    lderr(cct) << "error listing group snapshots: " << cpp_strerror(r)
+	       << dendl;
+    return r;
+  }
+
+  for (auto &group_snap : group_snaps) {
+    snaps->push_back(
+      group_snap_spec_t {
+	group_snap.name,
+	group_snap.state == cls::rbd::GROUP_SNAPSHOT_STATE_COMPLETE ?
+	  GROUP_SNAP_STATE_COMPLETE : GROUP_SNAP_STATE_INCOMPLETE});
+  }
+  return 0;
+}
+
 } // namespace librbd
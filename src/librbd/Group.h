@@ -24,6 +24,12 @@ int group_image_remove(librados::IoCtx& group_ioctx, const char *group_name,
 int group_image_list(librados::IoCtx& group_ioctx, const char *group_name,
 		     std::vector<group_image_status_t> *images);
 int image_get_group(ImageCtx *ictx, group_spec_t *group_spec);
+int group_snap_create(librados::IoCtx& group_ioctx, const char *group_name,
+		      const char *snap_name);
+int group_snap_remove(librados::IoCtx& group_ioctx, const char *group_name,
+		      const char *snap_name);
+int group_snap_list(librados::IoCtx& group_ioctx, const char *group_name,
+		    std::vector<group_snap_spec_t> *snaps);
 
 } // namespace librbd
 
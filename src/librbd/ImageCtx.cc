@@ -24,6 +24,7 @@
 #include "librbd/Operations.h"
 #include "librbd/operation/ResizeRequest.h"
 #include "librbd/Utils.h"
+#include "librbd/cache/ImageCache.h"
 #include "librbd/LibrbdWriteback.h"
 #include "librbd/exclusive_lock/AutomaticPolicy.h"
 #include "librbd/exclusive_lock/StandardPolicy.h"
@@ -52,11 +53,12 @@ namespace librbd {
 
 namespace {
 
+// op_work_queue state machines rely on their contexts running one at a
+// time, so only image IO gets the rbd_op_threads pool
 class ThreadPoolSingleton : public ThreadPool {
 public:
   explicit ThreadPoolSingleton(CephContext *cct)
-    : ThreadPool(cct, "librbd::thread_pool", "tp_librbd", 1,
-                 "rbd_op_threads") {
+    : ThreadPool(cct, "librbd::thread_pool", "tp_librbd", 1) {
     start();
   }
   ~ThreadPoolSingleton() override {
@@ -64,6 +66,30 @@ public:
   }
 };
 
+class IOThreadPoolSingleton : public ThreadPool {
+public:
+  explicit IOThreadPoolSingleton(CephContext *cct)
+    : ThreadPool(cct, "librbd::io_thread_pool", "tp_librbd_io", 1,
+                 "rbd_op_threads") {
+    start();
+  }
+  ~IOThreadPoolSingleton() override {
+    stop();
+  }
+};
+
+class FinisherPoolSingleton : public FinisherPool {
+public:
+  explicit FinisherPoolSingleton(CephContext *cct)
+    : FinisherPool(cct, "librbd", "fn_librbd",
+                   cct->_conf->rbd_op_finisher_threads) {
+    start();
+  }
+  ~FinisherPoolSingleton() {
+    stop();
+  }
+};
+
 class SafeTimerSingleton : public SafeTimer {
 public:
   Mutex lock;
@@ -92,6 +118,18 @@ struct C_FlushCache : public Context {
   }
 };
 
+struct C_FlushImageCache : public Context {
+  ImageCtx *image_ctx;
+  Context *on_safe;
+
+  C_FlushImageCache(ImageCtx *_image_ctx, Context *_on_safe)
+    : image_ctx(_image_ctx), on_safe(_on_safe) {
+  }
+  void finish(int r) override {
+    image_ctx->image_cache->flush(on_safe);
+  }
+};
+
 struct C_ShutDownCache : public Context {
   ImageCtx *image_ctx;
   Context *on_finish;
@@ -199,13 +237,26 @@ struct C_InvalidateCache : public Context {
 
     memset(&header, 0, sizeof(header));
 
-    ThreadPool *thread_pool_singleton = get_thread_pool_instance(cct);
+    IOThreadPoolSingleton *io_thread_pool_singleton;
+    cct->lookup_or_create_singleton_object<IOThreadPoolSingleton>(
+      io_thread_pool_singleton, "librbd::io_thread_pool");
     io_work_queue = new io::ImageRequestWQ(
       this, "librbd::io_work_queue", cct->_conf->rbd_op_thread_timeout,
-      thread_pool_singleton);
-    op_work_queue = new ContextWQ("librbd::op_work_queue",
-                                  cct->_conf->rbd_op_thread_timeout,
-                                  thread_pool_singleton);
+      io_thread_pool_singleton);
+
+    ThreadPool *thread_pool_singleton = get_thread_pool_instance(cct);
+    if (cct->_conf->rbd_op_finisher_threads > 0) {
+      // ordered per image, parallel across images
+      op_work_queue = new ContextWQ("librbd::op_work_queue",
+                                    cct->_conf->rbd_op_thread_timeout,
+                                    thread_pool_singleton,
+                                    get_finisher_pool_instance(cct),
+                                    reinterpret_cast<uintptr_t>(this));
+    } else {
+      op_work_queue = new ContextWQ("librbd::op_work_queue",
+                                    cct->_conf->rbd_op_thread_timeout,
+                                    thread_pool_singleton);
+    }
 
     if (cct->_conf->rbd_auto_exclusive_lock_until_manual_request) {
       exclusive_lock_policy = new exclusive_lock::AutomaticPolicy(this);
@@ -220,6 +271,7 @@ struct C_InvalidateCache : public Context {
     assert(exclusive_lock == NULL);
     assert(object_map == NULL);
     assert(journal == NULL);
+    assert(image_cache == nullptr);
     assert(asok_hook == NULL);
 
     if (perfcounter) {
@@ -382,6 +434,35 @@ struct C_InvalidateCache : public Context {
     plb.add_u64_counter(l_librbd_readahead_bytes, "readahead_bytes", "Data size in read ahead");
     plb.add_u64_counter(l_librbd_invalidate_cache, "invalidate_cache", "Cache invalidates");
 
+    // Latency axis configuration, values are in nanoseconds
+    PerfHistogramCommon::axis_config_d lat_axis_config{
+      "Latency (usec)",
+      PerfHistogramCommon::SCALE_LOG2, ///< Latency in logarithmic scale
+      0,                               ///< Start at 0
+      10000,                           ///< Quantization unit is 10usec
+      32,                              ///< Enough to cover blocked requests
+    };
+    // Request size axis configuration, values are in bytes
+    PerfHistogramCommon::axis_config_d bytes_axis_config{
+      "Request size (bytes)",
+      PerfHistogramCommon::SCALE_LOG2, ///< Size in logarithmic scale
+      0,                               ///< Start at 0
+      512,                             ///< Quantization unit is 512 bytes
+      32,                              ///< Enough to cover any request
+    };
+    plb.add_histogram(l_librbd_rd_lat_bytes_hist, "rd_latency_bytes_histogram",
+                      lat_axis_config, bytes_axis_config,
+                      "Histogram of read latency vs. size");
+    plb.add_histogram(l_librbd_wr_lat_bytes_hist, "wr_latency_bytes_histogram",
+                      lat_axis_config, bytes_axis_config,
+                      "Histogram of write latency vs. size");
+    plb.add_u64_counter(l_librbd_qos_throttled, "qos_throttled",
+                        "IOs held back by QoS limits");
+    plb.add_time_avg(l_librbd_qos_throttle_latency, "qos_throttle_latency",
+                     "Time IOs were held back by QoS limits");
+    plb.add_time_avg(l_librbd_journal_wait_latency, "journal_wait_latency",
+                     "Latency of IO journal events until they are safe");
+
     perfcounter = plb.create_perf_counters();
     cct->get_perfcounters_collection()->add(perfcounter);
   }
@@ -795,6 +876,23 @@ struct C_InvalidateCache : public Context {
   }
 
   void ImageCtx::invalidate_cache(bool purge_on_error, Context *on_finish) {
+    if (image_cache != nullptr) {
+      // write the image cache back first: it may write into the object cache
+      image_cache->invalidate(new FunctionContext(
+        [this, purge_on_error, on_finish](int r) {
+          if (r < 0) {
+            on_finish->complete(r);
+            return;
+          }
+          invalidate_object_cache(purge_on_error, on_finish);
+        }));
+      return;
+    }
+    invalidate_object_cache(purge_on_error, on_finish);
+  }
+
+  void ImageCtx::invalidate_object_cache(bool purge_on_error,
+                                         Context *on_finish) {
     if (object_cacher == NULL) {
       op_work_queue->queue(on_finish, 0);
       return;
@@ -880,6 +978,10 @@ struct C_InvalidateCache : public Context {
       // flush cache after completing all in-flight AIO ops
       on_safe = new C_FlushCache(this, on_safe);
     }
+    if (image_cache != nullptr) {
+      // and write the image cache back, into the object cache, before that
+      on_safe = new C_FlushImageCache(this, on_safe);
+    }
     flush_async_operations(on_safe);
   }
 
@@ -949,7 +1051,21 @@ struct C_InvalidateCache : public Context {
         "rbd_cache_max_dirty_age", false)(
         "rbd_cache_max_dirty_object", false)(
         "rbd_cache_block_writes_upfront", false)(
+        "rbd_persistent_cache", false)(
+        "rbd_persistent_cache_path", false)(
+        "rbd_persistent_cache_size", false)(
+        "rbd_persistent_cache_max_writeback", false)(
+        "rbd_memory_cache", false)(
+        "rbd_memory_cache_size", false)(
+        "rbd_memory_cache_max_dirty", false)(
+        "rbd_memory_cache_target_dirty", false)(
+        "rbd_memory_cache_max_dirty_age", false)(
+        "rbd_memory_cache_shards", false)(
+        "rbd_memory_cache_max_writeback", false)(
+        "rbd_memory_cache_writeback_batch", false)(
         "rbd_concurrent_management_ops", false)(
+        "rbd_concurrent_management_ops_max", false)(
+        "rbd_concurrent_diff_ops", false)(
         "rbd_balance_snap_reads", false)(
         "rbd_localize_snap_reads", false)(
         "rbd_balance_parent_reads", false)(
@@ -958,6 +1074,7 @@ struct C_InvalidateCache : public Context {
         "rbd_readahead_max_bytes", false)(
         "rbd_readahead_disable_after_bytes", false)(
         "rbd_clone_copy_on_read", false)(
+        "rbd_sparse_copyup", false)(
         "rbd_blacklist_on_break_lock", false)(
         "rbd_blacklist_expire_seconds", false)(
         "rbd_request_timed_out_seconds", false)(
@@ -967,12 +1084,22 @@ struct C_InvalidateCache : public Context {
         "rbd_journal_object_flush_interval", false)(
         "rbd_journal_object_flush_bytes", false)(
         "rbd_journal_object_flush_age", false)(
+        "rbd_journal_object_max_in_flight_appends", false)(
         "rbd_journal_pool", false)(
         "rbd_journal_max_payload_bytes", false)(
         "rbd_journal_max_concurrent_object_sets", false)(
+        "rbd_journal_parallel_writes", false)(
+        "rbd_journal_max_prefetch_bytes", false)(
         "rbd_mirroring_resync_after_disconnect", false)(
         "rbd_mirroring_replay_delay", false)(
-        "rbd_skip_partial_discard", false);
+        "rbd_skip_partial_discard", false)(
+        "rbd_qos_iops_limit", false)(
+        "rbd_qos_bps_limit", false)(
+        "rbd_qos_read_iops_limit", false)(
+        "rbd_qos_write_iops_limit", false)(
+        "rbd_qos_read_bps_limit", false)(
+        "rbd_qos_write_bps_limit", false)(
+        "rbd_qos_burst_seconds", false);
 
     md_config_t local_config_t;
     std::map<std::string, bufferlist> res;
@@ -1007,7 +1134,21 @@ struct C_InvalidateCache : public Context {
     ASSIGN_OPTION(cache_max_dirty_age);
     ASSIGN_OPTION(cache_max_dirty_object);
     ASSIGN_OPTION(cache_block_writes_upfront);
+    ASSIGN_OPTION(persistent_cache);
+    ASSIGN_OPTION(persistent_cache_path);
+    ASSIGN_OPTION(persistent_cache_size);
+    ASSIGN_OPTION(persistent_cache_max_writeback);
+    ASSIGN_OPTION(memory_cache);
+    ASSIGN_OPTION(memory_cache_size);
+    ASSIGN_OPTION(memory_cache_max_dirty);
+    ASSIGN_OPTION(memory_cache_target_dirty);
+    ASSIGN_OPTION(memory_cache_max_dirty_age);
+    ASSIGN_OPTION(memory_cache_shards);
+    ASSIGN_OPTION(memory_cache_max_writeback);
+    ASSIGN_OPTION(memory_cache_writeback_batch);
     ASSIGN_OPTION(concurrent_management_ops);
+    ASSIGN_OPTION(concurrent_management_ops_max);
+    ASSIGN_OPTION(concurrent_diff_ops);
     ASSIGN_OPTION(balance_snap_reads);
     ASSIGN_OPTION(localize_snap_reads);
     ASSIGN_OPTION(balance_parent_reads);
@@ -1016,6 +1157,7 @@ struct C_InvalidateCache : public Context {
     ASSIGN_OPTION(readahead_max_bytes);
     ASSIGN_OPTION(readahead_disable_after_bytes);
     ASSIGN_OPTION(clone_copy_on_read);
+    ASSIGN_OPTION(sparse_copyup);
     ASSIGN_OPTION(blacklist_on_break_lock);
     ASSIGN_OPTION(blacklist_expire_seconds);
     ASSIGN_OPTION(request_timed_out_seconds);
@@ -1026,12 +1168,41 @@ struct C_InvalidateCache : public Context {
     ASSIGN_OPTION(journal_object_flush_interval);
     ASSIGN_OPTION(journal_object_flush_bytes);
     ASSIGN_OPTION(journal_object_flush_age);
+    ASSIGN_OPTION(journal_object_max_in_flight_appends);
     ASSIGN_OPTION(journal_pool);
     ASSIGN_OPTION(journal_max_payload_bytes);
     ASSIGN_OPTION(journal_max_concurrent_object_sets);
+    ASSIGN_OPTION(journal_parallel_writes);
+    ASSIGN_OPTION(journal_max_prefetch_bytes);
     ASSIGN_OPTION(mirroring_resync_after_disconnect);
     ASSIGN_OPTION(mirroring_replay_delay);
     ASSIGN_OPTION(skip_partial_discard);
+    ASSIGN_OPTION(qos_iops_limit);
+    ASSIGN_OPTION(qos_bps_limit);
+    ASSIGN_OPTION(qos_read_iops_limit);
+    ASSIGN_OPTION(qos_write_iops_limit);
+    ASSIGN_OPTION(qos_read_bps_limit);
+    ASSIGN_OPTION(qos_write_bps_limit);
+    ASSIGN_OPTION(qos_burst_seconds);
+
+    if (memory_cache && !persistent_cache) {
+      // the memory cache takes the place of the object cacher
+      cache = false;
+    }
+
+    std::pair<uint64_t, uint64_t> qos_limits[] = {
+      {io::RBD_QOS_IOPS_THROTTLE, qos_iops_limit},
+      {io::RBD_QOS_BPS_THROTTLE, qos_bps_limit},
+      {io::RBD_QOS_READ_IOPS_THROTTLE, qos_read_iops_limit},
+      {io::RBD_QOS_WRITE_IOPS_THROTTLE, qos_write_iops_limit},
+      {io::RBD_QOS_READ_BPS_THROTTLE, qos_read_bps_limit},
+      {io::RBD_QOS_WRITE_BPS_THROTTLE, qos_write_bps_limit},
+    };
+    for (auto &limit : qos_limits) {
+      io_work_queue->apply_qos_limit(
+        limit.first, limit.second,
+        limit.second * std::max(qos_burst_seconds, 1.0));
+    }
   }
 
   ExclusiveLock<ImageCtx> *ImageCtx::create_exclusive_lock() {
@@ -1099,6 +1270,13 @@ struct C_InvalidateCache : public Context {
     return thread_pool_singleton;
   }
 
+  FinisherPool *ImageCtx::get_finisher_pool_instance(CephContext *cct) {
+    FinisherPoolSingleton *finisher_pool_singleton;
+    cct->lookup_or_create_singleton_object<FinisherPoolSingleton>(
+      finisher_pool_singleton, "librbd::finisher_pool");
+    return finisher_pool_singleton;
+  }
+
   void ImageCtx::get_timer_instance(CephContext *cct, SafeTimer **timer,
                                     Mutex **timer_lock) {
     SafeTimerSingleton *safe_timer_singleton;
@@ -32,6 +32,7 @@
 class CephContext;
 class ContextWQ;
 class Finisher;
+class FinisherPool;
 class PerfCounters;
 class ThreadPool;
 class SafeTimer;
@@ -169,7 +170,21 @@ namespace librbd {
     double cache_max_dirty_age;
     uint32_t cache_max_dirty_object;
     bool cache_block_writes_upfront;
+    bool persistent_cache;
+    std::string persistent_cache_path;
+    uint64_t persistent_cache_size;
+    uint32_t persistent_cache_max_writeback;
+    bool memory_cache;
+    uint64_t memory_cache_size;
+    uint64_t memory_cache_max_dirty;
+    uint64_t memory_cache_target_dirty;
+    double memory_cache_max_dirty_age;
+    uint32_t memory_cache_shards;
+    uint32_t memory_cache_max_writeback;
+    uint64_t memory_cache_writeback_batch;
     uint32_t concurrent_management_ops;
+    uint32_t concurrent_management_ops_max;
+    uint32_t concurrent_diff_ops;
     bool balance_snap_reads;
     bool localize_snap_reads;
     bool balance_parent_reads;
@@ -178,6 +193,7 @@ namespace librbd {
     uint64_t readahead_max_bytes;
     uint64_t readahead_disable_after_bytes;
     bool clone_copy_on_read;
+    bool sparse_copyup;
     bool blacklist_on_break_lock;
     uint32_t blacklist_expire_seconds;
     uint32_t request_timed_out_seconds;
@@ -188,12 +204,22 @@ namespace librbd {
     int journal_object_flush_interval;
     uint64_t journal_object_flush_bytes;
     double journal_object_flush_age;
+    uint32_t journal_object_max_in_flight_appends;
     std::string journal_pool;
     uint32_t journal_max_payload_bytes;
     int journal_max_concurrent_object_sets;
+    bool journal_parallel_writes;
+    uint32_t journal_max_prefetch_bytes;
     bool mirroring_resync_after_disconnect;
     int mirroring_replay_delay;
     bool skip_partial_discard;
+    uint64_t qos_iops_limit;
+    uint64_t qos_bps_limit;
+    uint64_t qos_read_iops_limit;
+    uint64_t qos_write_iops_limit;
+    uint64_t qos_read_bps_limit;
+    uint64_t qos_write_bps_limit;
+    double qos_burst_seconds;
 
     LibrbdAdminSocketHook *asok_hook;
 
@@ -283,6 +309,7 @@ namespace librbd {
     void shut_down_cache(Context *on_finish);
     int invalidate_cache(bool purge_on_error);
     void invalidate_cache(bool purge_on_error, Context *on_finish);
+    void invalidate_object_cache(bool purge_on_error, Context *on_finish);
     void clear_nonexistence_cache();
     bool is_cache_empty();
     void register_watch(Context *on_finish);
@@ -318,6 +345,7 @@ namespace librbd {
     void set_journal_policy(journal::Policy *policy);
 
     static ThreadPool *get_thread_pool_instance(CephContext *cct);
+    static FinisherPool *get_finisher_pool_instance(CephContext *cct);
     static void get_timer_instance(CephContext *cct, SafeTimer **timer,
                                    Mutex **timer_lock);
   };
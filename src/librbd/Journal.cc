@@ -4,13 +4,17 @@
 #include "librbd/Journal.h"
 #include "librbd/ExclusiveLock.h"
 #include "librbd/ImageCtx.h"
+#include "librbd/internal.h"
+#include "librbd/Utils.h"
 #include "cls/journal/cls_journal_types.h"
+#include "cls/rbd/cls_rbd_client.h"
 #include "journal/Journaler.h"
 #include "journal/Policy.h"
 #include "journal/ReplayEntry.h"
 #include "journal/Settings.h"
 #include "journal/Utils.h"
 #include "common/errno.h"
+#include "common/perf_counters.h"
 #include "common/Timer.h"
 #include "common/WorkQueue.h"
 #include "include/rados/librados.hpp"
@@ -33,6 +37,7 @@ namespace librbd {
 
 using util::create_async_context_callback;
 using util::create_context_callback;
+using util::create_rados_ack_callback;
 using journal::util::C_DecodeTag;
 using journal::util::C_DecodeTags;
 
@@ -590,6 +595,12 @@ bool Journal<I>::is_journal_appending() const {
           !m_image_ctx.get_journal_policy()->append_disabled());
 }
 
+template <typename I>
+bool Journal<I>::is_mirroring() const {
+  Mutex::Locker locker(m_lock);
+  return m_mirroring;
+}
+
 template <typename I>
 void Journal<I>::wait_for_journal_ready(Context *on_ready) {
   on_ready = create_async_context_callback(m_image_ctx, on_ready);
@@ -1182,6 +1193,9 @@ void Journal<I>::create_journaler() {
   settings.max_payload_bytes = m_image_ctx.journal_max_payload_bytes;
   settings.max_concurrent_object_sets =
     m_image_ctx.journal_max_concurrent_object_sets;
+  settings.max_in_flight_appends =
+    m_image_ctx.journal_object_max_in_flight_appends;
+  settings.max_prefetch_bytes = m_image_ctx.journal_max_prefetch_bytes;
   // TODO: a configurable filter to exclude certain peers from being
   // disconnected.
   settings.whitelisted_laggy_clients = {IMAGE_CLIENT_ID};
@@ -1309,6 +1323,82 @@ void Journal<I>::handle_open(int r) {
   transition_state(STATE_REPLAYING, 0);
   m_journal_replay = journal::Replay<I>::create(m_image_ctx);
   m_journaler->start_replay(&m_replay_handler);
+
+  get_mirror_image();
+}
+
+namespace {
+
+struct C_GetMirrorImage : public Context {
+  util::AsyncOpTracker &async_op_tracker;
+  Context *on_finish = nullptr;
+  bufferlist out_bl;
+
+  C_GetMirrorImage(util::AsyncOpTracker &async_op_tracker)
+    : async_op_tracker(async_op_tracker) {
+    async_op_tracker.start_op();
+  }
+  ~C_GetMirrorImage() override {
+     async_op_tracker.finish_op();
+  }
+
+  void finish(int r) override {
+    on_finish->complete(r);
+  }
+};
+
+} // anonymous namespace
+
+template <typename I>
+void Journal<I>::get_mirror_image() {
+  // rbd-mirror only sees what made it into the journal, so writes to a
+  // mirrored image must not reach the image before their event is safe
+  // (see rbd_journal_parallel_writes).  Looked up each time the journal
+  // is opened, i.e. whenever the exclusive lock is acquired; until then
+  // the image is assumed to be mirrored.
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << this << " " << __func__ << dendl;
+
+  C_GetMirrorImage *get_ctx = new C_GetMirrorImage(
+    m_async_journal_op_tracker);
+  get_ctx->on_finish = new FunctionContext(
+    [this, get_ctx](int r) {
+      handle_get_mirror_image(get_ctx->out_bl, r);
+    });
+
+  librados::ObjectReadOperation op;
+  cls_client::mirror_image_get_start(&op, m_image_ctx.id);
+  librados::AioCompletion *comp = create_rados_ack_callback(get_ctx);
+  int r = m_image_ctx.md_ctx.aio_operate(RBD_MIRRORING, comp, &op,
+                                         &get_ctx->out_bl);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+void Journal<I>::handle_get_mirror_image(bufferlist &out_bl, int r) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << this << " " << __func__ << ": r=" << r << dendl;
+
+  cls::rbd::MirrorImage mirror_image;
+  if (r == 0) {
+    bufferlist::iterator it = out_bl.begin();
+    r = cls_client::mirror_image_get_finish(&it, &mirror_image);
+  }
+
+  bool mirroring = true;
+  if (r == -ENOENT) {
+    mirroring = false;
+  } else if (r < 0) {
+    lderr(cct) << this << " " << __func__ << ": "
+               << "failed to retrieve mirror image state: "
+               << cpp_strerror(r) << dendl;
+  } else {
+    mirroring = (mirror_image.state != cls::rbd::MIRROR_IMAGE_STATE_DISABLED);
+  }
+
+  Mutex::Locker locker(m_lock);
+  m_mirroring = mirroring;
 }
 
 template <typename I>
@@ -1557,6 +1647,8 @@ void Journal<I>::handle_io_event_safe(int r, uint64_t tid) {
     Event &event = it->second;
     aio_object_requests.swap(event.aio_object_requests);
     on_safe_contexts.swap(event.on_safe_contexts);
+    m_image_ctx.perfcounter->tinc(l_librbd_journal_wait_latency,
+                                  ceph_clock_now() - event.start_time);
 
     if (r < 0 || event.committed_io) {
       // failed journal write so IO won't be sent -- or IO extent was
@@ -8,6 +8,7 @@
 #include "include/atomic.h"
 #include "include/Context.h"
 #include "include/interval_set.h"
+#include "common/Clock.h"
 #include "common/Cond.h"
 #include "common/Mutex.h"
 #include "common/Cond.h"
@@ -119,6 +120,8 @@ public:
   bool is_journal_ready() const;
   bool is_journal_replaying() const;
   bool is_journal_appending() const;
+  /// true unless the image is known not to be mirrored
+  bool is_mirroring() const;
 
   void wait_for_journal_ready(Context *on_ready);
 
@@ -198,12 +201,14 @@ private:
     bool committed_io = false;
     bool safe = false;
     int ret_val = 0;
+    utime_t start_time;
 
     Event() {
     }
     Event(const Futures &_futures, const IOObjectRequests &_requests,
           uint64_t offset, size_t length)
-      : futures(_futures), aio_object_requests(_requests) {
+      : futures(_futures), aio_object_requests(_requests),
+        start_time(ceph_clock_now()) {
       if (length > 0) {
         pending_extents.insert(offset, length);
       }
@@ -330,6 +335,8 @@ private:
 
   uint64_t m_refresh_sequence = 0;
 
+  bool m_mirroring = true;
+
   bool is_journal_replaying(const Mutex &) const;
   bool is_tag_owner(const Mutex &) const;
 
@@ -340,6 +347,8 @@ private:
   Future wait_event(Mutex &lock, uint64_t tid, Context *on_safe);
 
   void create_journaler();
+  void get_mirror_image();
+  void handle_get_mirror_image(bufferlist &out_bl, int r);
   void destroy_journaler(int r);
   void recreate_journaler(int r);
 
@@ -237,22 +237,67 @@ void ObjectMap<I>::detained_aio_update(UpdateOperation &&op) {
   }
 
   ldout(cct, 20) << "in-flight update cell: " << cell << dendl;
-  Context *on_finish = op.on_finish;
-  Context *ctx = new FunctionContext([this, cell, on_finish](int r) {
-      handle_detained_aio_update(cell, r, on_finish);
+  op.cell = cell;
+  m_queued_updates.push_back(std::move(op));
+
+  // updates that arrive while others are in flight wait for them, so that
+  // they can be sent together
+  if (m_in_flight_updates == 0) {
+    send_queued_updates();
+  }
+}
+
+template <typename I>
+void ObjectMap<I>::send_queued_updates() {
+  assert(m_image_ctx.snap_lock.is_locked());
+  assert(m_image_ctx.object_map_lock.is_wlocked());
+
+  UpdateOperations ops;
+  ops.swap(m_queued_updates);
+  ops.sort([](const UpdateOperation &lhs, const UpdateOperation &rhs) {
+      return lhs.start_object_no < rhs.start_object_no;
     });
-  aio_update(CEPH_NOSNAP, op.start_object_no, op.end_object_no, op.new_state,
-             op.current_state, ctx);
+
+  // the queued updates cannot overlap: coalesce runs of adjacent ones to
+  // the same state into a single ranged update
+  while (!ops.empty()) {
+    UpdateOperations run;
+    run.splice(run.end(), ops, ops.begin());
+    const UpdateOperation &first = run.front();
+    uint64_t end_object_no = first.end_object_no;
+    while (!ops.empty() && ops.front().start_object_no == end_object_no &&
+           ops.front().new_state == first.new_state &&
+           ops.front().current_state == first.current_state) {
+      end_object_no = ops.front().end_object_no;
+      run.splice(run.end(), ops, ops.begin());
+    }
+
+    ldout(m_image_ctx.cct, 20) << "sending " << run.size() << " update(s): "
+                               << "start=" << first.start_object_no << ", "
+                               << "end=" << end_object_no << dendl;
+    uint64_t start_object_no = first.start_object_no;
+    uint8_t new_state = first.new_state;
+    boost::optional<uint8_t> current_state = first.current_state;
+    ++m_in_flight_updates;
+    Context *ctx = new FunctionContext([this, run](int r) {
+        handle_queued_updates(run, r);
+      });
+    aio_update(CEPH_NOSNAP, start_object_no, end_object_no, new_state,
+               current_state, ctx);
+  }
 }
 
 template <typename I>
-void ObjectMap<I>::handle_detained_aio_update(BlockGuardCell *cell, int r,
-                                              Context *on_finish) {
+void ObjectMap<I>::handle_queued_updates(const UpdateOperations &ops, int r) {
   CephContext *cct = m_image_ctx.cct;
-  ldout(cct, 20) << "cell=" << cell << ", r=" << r << dendl;
+  ldout(cct, 20) << "updates=" << ops.size() << ", r=" << r << dendl;
 
   typename UpdateGuard::BlockOperations block_ops;
-  m_update_guard->release(cell, &block_ops);
+  for (auto &op : ops) {
+    typename UpdateGuard::BlockOperations cell_block_ops;
+    m_update_guard->release(op.cell, &cell_block_ops);
+    block_ops.splice(block_ops.end(), cell_block_ops);
+  }
 
   {
     RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
@@ -260,9 +305,16 @@ void ObjectMap<I>::handle_detained_aio_update(BlockGuardCell *cell, int r,
     for (auto &op : block_ops) {
       detained_aio_update(std::move(op));
     }
+
+    assert(m_in_flight_updates > 0);
+    if (--m_in_flight_updates == 0 && !m_queued_updates.empty()) {
+      send_queued_updates();
+    }
   }
 
-  on_finish->complete(r);
+  for (auto &op : ops) {
+    op.on_finish->complete(r);
+  }
 }
 
 template <typename I>
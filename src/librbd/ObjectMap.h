@@ -10,6 +10,7 @@
 #include "common/bit_vector.hpp"
 #include "librbd/Utils.h"
 #include <boost/optional.hpp>
+#include <list>
 
 class Context;
 class RWLock;
@@ -105,6 +106,7 @@ private:
     uint8_t new_state;
     boost::optional<uint8_t> current_state;
     Context *on_finish;
+    BlockGuardCell *cell = nullptr;
 
     UpdateOperation(uint64_t start_object_no, uint64_t end_object_no,
                     uint8_t new_state,
@@ -117,6 +119,7 @@ private:
   };
 
   typedef BlockGuard<UpdateOperation> UpdateGuard;
+  typedef std::list<UpdateOperation> UpdateOperations;
 
   ImageCtxT &m_image_ctx;
   ceph::BitVector<2> m_object_map;
@@ -124,9 +127,14 @@ private:
 
   UpdateGuard *m_update_guard = nullptr;
 
+  /// updates that passed the guard while others were in flight
+  UpdateOperations m_queued_updates;
+  uint32_t m_in_flight_updates = 0;
+
   void detained_aio_update(UpdateOperation &&update_operation);
-  void handle_detained_aio_update(BlockGuardCell *cell, int r,
-                                  Context *on_finish);
+  void send_queued_updates();
+  void handle_queued_updates(const UpdateOperations &update_operations,
+                             int r);
 
   void aio_update(uint64_t snap_id, uint64_t start_object_no,
                   uint64_t end_object_no, uint8_t new_state,
@@ -0,0 +1,949 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "MemoryImageCache.h"
+#include "include/stringify.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/Timer.h"
+#include "common/WorkQueue.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/Utils.h"
+#include <iterator>
+#include <limits>
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::MemoryImageCache: " << this << " " \
+                           <<  __func__ << ": "
+
+namespace librbd {
+namespace cache {
+
+namespace {
+
+const uint64_t NO_SEQ = std::numeric_limits<uint64_t>::max();
+
+uint64_t extents_length(const ImageCache::Extents &image_extents) {
+  uint64_t length = 0;
+  for (auto &e : image_extents) {
+    length += e.second;
+  }
+  return length;
+}
+
+} // anonymous namespace
+
+/**
+ * Assembles a read from what was cached when it was looked up and what
+ * had to be read from the image, and caches the latter if nothing was
+ * written over it in the meantime.
+ */
+template <typename I>
+struct MemoryImageCache<I>::C_ReadRequest : public Context {
+  struct Miss {
+    uint32_t shard;
+    uint64_t generation;
+    uint64_t offset;
+    uint64_t length;
+    uint64_t buffer_offset;
+  };
+
+  MemoryImageCache *cache;
+  uint64_t length = 0;
+  std::map<uint64_t, bufferlist> parts;   ///< buffer offset -> data
+  std::vector<Miss> misses;
+  bufferlist *out_bl;
+  Context *on_finish;
+  bufferlist bl;                          ///< the misses, read from the image
+
+  C_ReadRequest(MemoryImageCache *cache, bufferlist *out_bl,
+                Context *on_finish)
+    : cache(cache), out_bl(out_bl), on_finish(on_finish) {
+  }
+
+  void finish(int r) override {
+    if (r < 0) {
+      on_finish->complete(r);
+      return;
+    }
+
+    uint64_t bl_offset = 0;
+    for (auto &miss : misses) {
+      bufferlist data;
+      if (bl_offset < bl.length()) {
+        data.substr_of(bl, bl_offset,
+                       std::min(miss.length, bl.length() - bl_offset));
+      }
+      if (data.length() < miss.length) {
+        data.append_zero(miss.length - data.length());
+      }
+      bl_offset += miss.length;
+
+      Shard &shard = *cache->m_shards[miss.shard];
+      {
+        Mutex::Locker locker(shard.lock);
+        if (shard.generation == miss.generation) {
+          cache->insert_clean(shard, miss.offset, bufferlist(data));
+        }
+      }
+      parts[miss.buffer_offset] = std::move(data);
+    }
+
+    out_bl->clear();
+    for (auto &part : parts) {
+      out_bl->claim_append(part.second);
+    }
+    assert(out_bl->length() == length);
+    on_finish->complete(length);
+  }
+};
+
+template <typename I>
+MemoryImageCache<I>::MemoryImageCache(I &image_ctx)
+  : m_image_ctx(image_ctx), m_image_writeback(image_ctx),
+    m_object_size(1ULL << image_ctx.order),
+    m_lock(util::unique_lock_name("librbd::cache::MemoryImageCache::m_lock",
+                                  this)) {
+  uint32_t shards = std::max(1U, image_ctx.memory_cache_shards);
+  for (uint32_t i = 0; i < shards; ++i) {
+    m_shards.push_back(new Shard(util::unique_lock_name(
+      "librbd::cache::MemoryImageCache::shard_lock" + stringify(i), this)));
+  }
+  m_shard_size = image_ctx.memory_cache_size / shards;
+
+  ImageCtx::get_timer_instance(image_ctx.cct, &m_timer, &m_timer_lock);
+}
+
+template <typename I>
+MemoryImageCache<I>::~MemoryImageCache() {
+  assert(m_in_flight == 0);
+  assert(m_timer_event == nullptr);
+  for (auto shard : m_shards) {
+    delete shard;
+  }
+}
+
+template <typename I>
+void MemoryImageCache<I>::aio_read(Extents &&image_extents, bufferlist *bl,
+                                   int fadvise_flags, Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "image_extents=" << image_extents << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  C_ReadRequest *req = new C_ReadRequest(this, bl, on_finish);
+  req->length = extents_length(image_extents);
+
+  Pieces pieces;
+  map_extents(image_extents, &pieces);
+
+  Extents miss_extents;
+  for (auto &piece : pieces) {
+    Shard &shard = *m_shards[piece.shard];
+    Mutex::Locker locker(shard.lock);
+
+    uint64_t pos = piece.offset;
+    uint64_t end = piece.offset + piece.length;
+    auto it = shard.extents.upper_bound(pos);
+    if (it != shard.extents.begin()) {
+      auto prev = std::prev(it);
+      if (prev->first + prev->second.length > pos) {
+        it = prev;
+      }
+    }
+
+    while (pos < end) {
+      uint64_t buffer_offset = piece.buffer_offset + pos - piece.offset;
+      if (it != shard.extents.end() && it->first <= pos) {
+        Extent &extent = it->second;
+        uint64_t n = std::min(extent.offset + extent.length, end) - pos;
+        req->parts[buffer_offset].substr_of(extent.bl, pos - extent.offset, n);
+        if (extent.seq == 0) {
+          shard.lru.erase(shard.lru.iterator_to(extent));
+          shard.lru.push_back(extent);
+        }
+        pos += n;
+        ++it;
+      } else {
+        uint64_t next = end;
+        if (it != shard.extents.end()) {
+          next = std::min(end, it->first);
+        }
+        req->misses.push_back({piece.shard, shard.generation, pos, next - pos,
+                               buffer_offset});
+        miss_extents.push_back({pos, next - pos});
+        pos = next;
+      }
+    }
+  }
+
+  if (miss_extents.empty()) {
+    req->complete(0);
+    return;
+  }
+  m_image_writeback.aio_read(std::move(miss_extents), &req->bl, fadvise_flags,
+                             req);
+}
+
+template <typename I>
+void MemoryImageCache<I>::aio_write(Extents &&image_extents,
+                                    bufferlist&& bl,
+                                    int fadvise_flags,
+                                    Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "image_extents=" << image_extents << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  retry_writeback();
+
+  uint64_t length = extents_length(image_extents);
+  if (!m_deferring &&
+      m_dirty_bytes + length <= m_image_ctx.memory_cache_max_dirty) {
+    write_extents(std::move(image_extents), std::move(bl));
+    if (m_dirty_bytes > m_image_ctx.memory_cache_target_dirty) {
+      schedule_writeback();
+    }
+    on_finish->complete(0);
+    return;
+  }
+
+  Completions completions;
+  bool send = false;
+  {
+    Mutex::Locker locker(m_lock);
+    m_deferred.emplace_back(OP_WRITE, std::move(image_extents), on_finish);
+    m_deferred.back().bl = std::move(bl);
+    m_deferred.back().fadvise_flags = fadvise_flags;
+    m_deferring = true;
+    send = dispatch_deferred(&completions);
+  }
+  complete(&completions);
+  if (send) {
+    send_barrier();
+  }
+}
+
+template <typename I>
+void MemoryImageCache<I>::aio_discard(uint64_t offset, uint64_t length,
+                                      bool skip_partial_discard,
+                                      Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "offset=" << offset << ", "
+                 << "length=" << length << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  retry_writeback();
+
+  Completions completions;
+  bool send = false;
+  {
+    Mutex::Locker locker(m_lock);
+    m_deferred.emplace_back(OP_DISCARD, Extents{{offset, length}}, on_finish);
+    m_deferred.back().skip_partial_discard = skip_partial_discard;
+    m_deferring = true;
+    send = dispatch_deferred(&completions);
+  }
+  complete(&completions);
+  if (send) {
+    send_barrier();
+  }
+}
+
+template <typename I>
+void MemoryImageCache<I>::aio_flush(Context *on_finish) {
+  flush(on_finish);
+}
+
+template <typename I>
+void MemoryImageCache<I>::aio_writesame(uint64_t offset, uint64_t length,
+                                        bufferlist&& bl, int fadvise_flags,
+                                        Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "offset=" << offset << ", "
+                 << "length=" << length << ", "
+                 << "data_len=" << bl.length() << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  retry_writeback();
+
+  Completions completions;
+  bool send = false;
+  {
+    Mutex::Locker locker(m_lock);
+    m_deferred.emplace_back(OP_WRITESAME, Extents{{offset, length}},
+                            on_finish);
+    m_deferred.back().bl = std::move(bl);
+    m_deferred.back().fadvise_flags = fadvise_flags;
+    m_deferring = true;
+    send = dispatch_deferred(&completions);
+  }
+  complete(&completions);
+  if (send) {
+    send_barrier();
+  }
+}
+
+template <typename I>
+void MemoryImageCache<I>::init(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 5) << "shards=" << m_shards.size() << ", "
+                << "shard_size=" << m_shard_size << dendl;
+
+  if (m_image_ctx.memory_cache_max_dirty_age > 0) {
+    Mutex::Locker timer_locker(*m_timer_lock);
+    schedule_tick();
+  }
+  on_finish->complete(0);
+}
+
+template <typename I>
+void MemoryImageCache<I>::shut_down(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << dendl;
+
+  {
+    Mutex::Locker timer_locker(*m_timer_lock);
+    m_shutting_down = true;
+    if (m_timer_event != nullptr) {
+      m_timer->cancel_event(m_timer_event);
+      m_timer_event = nullptr;
+    }
+  }
+
+  flush(new FunctionContext([this, on_finish](int r) {
+      {
+        Mutex::Locker locker(m_lock);
+        drop_all(true);
+      }
+
+      // behind any writeback already queued
+      m_image_ctx.op_work_queue->queue(on_finish, r);
+    }));
+}
+
+template <typename I>
+void MemoryImageCache<I>::invalidate(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << dendl;
+
+  flush(new FunctionContext([this, on_finish](int r) {
+      {
+        Mutex::Locker locker(m_lock);
+        drop_all(false);
+      }
+      on_finish->complete(r);
+    }));
+}
+
+template <typename I>
+void MemoryImageCache<I>::flush(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "on_finish=" << on_finish << dendl;
+
+  Context *ctx = new FunctionContext([this, on_finish](int r) {
+      if (r < 0) {
+        on_finish->complete(r);
+        return;
+      }
+      RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+      m_image_writeback.aio_flush(on_finish);
+    });
+
+  m_writeback_failed = false;
+
+  Completions completions;
+  {
+    Mutex::Locker locker(m_lock);
+    if (!m_deferred.empty()) {
+      // every write before it has to be cached first
+      m_deferred.emplace_back(OP_FLUSH, Extents(), ctx);
+    } else {
+      m_flush_waiters.push_back(std::make_pair(m_next_seq - 1, ctx));
+      complete_flush_waiters(&completions);
+      if (!m_flush_waiters.empty()) {
+        schedule_writeback();
+      }
+    }
+  }
+  complete(&completions);
+}
+
+template <typename I>
+void MemoryImageCache<I>::map_extents(const Extents &image_extents,
+                                      Pieces *pieces) const {
+  uint64_t buffer_offset = 0;
+  for (auto &e : image_extents) {
+    uint64_t offset = e.first;
+    uint64_t end = e.first + e.second;
+    while (offset < end) {
+      uint64_t object_no = offset / m_object_size;
+      uint64_t length = std::min(end, (object_no + 1) * m_object_size) -
+                        offset;
+      pieces->push_back({static_cast<uint32_t>(object_no % m_shards.size()),
+                         offset, length, buffer_offset});
+      offset += length;
+      buffer_offset += length;
+    }
+  }
+}
+
+template <typename I>
+typename MemoryImageCache<I>::Extent &MemoryImageCache<I>::add_extent(
+    Shard &shard, uint64_t offset, uint64_t length, bufferlist &&bl,
+    uint64_t seq, bool writing) {
+  assert(shard.lock.is_locked());
+  auto r = shard.extents.emplace(
+    std::piecewise_construct, std::forward_as_tuple(offset),
+    std::forward_as_tuple(offset, length, std::move(bl)));
+  assert(r.second);
+
+  Extent &extent = r.first->second;
+  extent.seq = seq;
+  extent.writing = writing;
+  if (seq == 0) {
+    shard.lru.push_back(extent);
+  }
+  return extent;
+}
+
+template <typename I>
+void MemoryImageCache<I>::remove_range(Shard &shard, uint64_t offset,
+                                       uint64_t length,
+                                       uint64_t *dropped_seq) {
+  assert(shard.lock.is_locked());
+  uint64_t end = offset + length;
+
+  auto it = shard.extents.upper_bound(offset);
+  if (it != shard.extents.begin()) {
+    auto prev = std::prev(it);
+    if (prev->first + prev->second.length > offset) {
+      it = prev;
+    }
+  }
+
+  while (it != shard.extents.end() && it->first < end) {
+    Extent &extent = it->second;
+    uint64_t e_start = extent.offset;
+    uint64_t e_end = extent.offset + extent.length;
+    uint64_t removed = std::min(e_end, end) - std::max(e_start, offset);
+
+    shard.bytes -= removed;
+    if (extent.seq != 0) {
+      shard.dirty_bytes -= removed;
+      m_dirty_bytes -= removed;
+      if (!extent.writing) {
+        // what is being written back is accounted for until it is done
+        auto seq_it = shard.dirty_seqs.find(extent.seq);
+        assert(seq_it != shard.dirty_seqs.end() && seq_it->second >= removed);
+        seq_it->second -= removed;
+        if (seq_it->second == 0) {
+          shard.dirty_seqs.erase(seq_it);
+        }
+        *dropped_seq = std::min(*dropped_seq, extent.seq);
+      }
+    }
+
+    bufferlist bl(std::move(extent.bl));
+    uint64_t seq = extent.seq;
+    bool writing = extent.writing;
+    it = shard.extents.erase(it);
+
+    if (e_start < offset) {
+      bufferlist left;
+      left.substr_of(bl, 0, offset - e_start);
+      add_extent(shard, e_start, offset - e_start, std::move(left), seq,
+                 writing);
+    }
+    if (e_end > end) {
+      bufferlist right;
+      right.substr_of(bl, end - e_start, e_end - end);
+      add_extent(shard, end, e_end - end, std::move(right), seq, writing);
+      break;
+    }
+  }
+}
+
+template <typename I>
+void MemoryImageCache<I>::write_piece(Shard &shard, uint64_t offset,
+                                      uint64_t length, bufferlist &&bl,
+                                      uint64_t seq) {
+  assert(shard.lock.is_locked());
+
+  // data it replaces before it is written back is only durable once this
+  // is, so it counts as being as old as that
+  uint64_t dropped_seq = NO_SEQ;
+  remove_range(shard, offset, length, &dropped_seq);
+  seq = std::min(seq, dropped_seq);
+
+  add_extent(shard, offset, length, std::move(bl), seq, false);
+  shard.bytes += length;
+  shard.dirty_bytes += length;
+  shard.dirty_seqs[seq] += length;
+  m_dirty_bytes += length;
+  ++shard.generation;
+  trim(shard);
+}
+
+template <typename I>
+void MemoryImageCache<I>::insert_clean(Shard &shard, uint64_t offset,
+                                       bufferlist &&bl) {
+  assert(shard.lock.is_locked());
+  uint64_t pos = offset;
+  uint64_t end = offset + bl.length();
+
+  auto it = shard.extents.upper_bound(pos);
+  if (it != shard.extents.begin()) {
+    auto prev = std::prev(it);
+    if (prev->first + prev->second.length > pos) {
+      it = prev;
+    }
+  }
+
+  // only fill the gaps: whatever is cached is at least as recent
+  while (pos < end) {
+    if (it != shard.extents.end() && it->first <= pos) {
+      pos = std::max(pos, it->first + it->second.length);
+      ++it;
+      continue;
+    }
+
+    uint64_t next = end;
+    if (it != shard.extents.end()) {
+      next = std::min(end, it->first);
+    }
+    bufferlist gap;
+    gap.substr_of(bl, pos - offset, next - pos);
+    add_extent(shard, pos, next - pos, std::move(gap), 0, false);
+    shard.bytes += next - pos;
+    pos = next;
+  }
+  trim(shard);
+}
+
+template <typename I>
+void MemoryImageCache<I>::trim(Shard &shard) {
+  assert(shard.lock.is_locked());
+  while (shard.bytes > m_shard_size && !shard.lru.empty()) {
+    Extent &extent = shard.lru.front();
+    shard.bytes -= extent.length;
+    shard.extents.erase(extent.offset);
+  }
+}
+
+template <typename I>
+void MemoryImageCache<I>::write_extents(Extents &&image_extents,
+                                        bufferlist &&bl) {
+  uint64_t seq = m_next_seq++;
+
+  Pieces pieces;
+  map_extents(image_extents, &pieces);
+  for (auto &piece : pieces) {
+    bufferlist data;
+    data.substr_of(bl, piece.buffer_offset, piece.length);
+
+    Shard &shard = *m_shards[piece.shard];
+    Mutex::Locker locker(shard.lock);
+    write_piece(shard, piece.offset, piece.length, std::move(data), seq);
+  }
+}
+
+template <typename I>
+bool MemoryImageCache<I>::dispatch_deferred(Completions *completions) {
+  assert(m_lock.is_locked());
+  CephContext *cct = m_image_ctx.cct;
+
+  bool send = false;
+  while (!m_deferred.empty() && !m_barrier_in_flight) {
+    Op &op = m_deferred.front();
+    if (op.type == OP_WRITE) {
+      uint64_t length = extents_length(op.image_extents);
+      if (m_dirty_bytes > 0 &&
+          m_dirty_bytes + length > m_image_ctx.memory_cache_max_dirty) {
+        schedule_writeback();
+        break;
+      }
+      write_extents(std::move(op.image_extents), std::move(op.bl));
+      completions->push_back(std::make_pair(op.on_finish, 0));
+    } else if (op.type == OP_FLUSH) {
+      m_flush_waiters.push_back(std::make_pair(m_next_seq - 1, op.on_finish));
+      schedule_writeback();
+    } else {
+      // cached data the barrier covers must not be written back after it
+      if (m_in_flight > 0) {
+        break;
+      }
+
+      ldout(cct, 20) << "dropping " << op.image_extents << dendl;
+      uint64_t dropped_seq = NO_SEQ;
+      Pieces pieces;
+      map_extents(op.image_extents, &pieces);
+      for (auto &piece : pieces) {
+        Shard &shard = *m_shards[piece.shard];
+        Mutex::Locker locker(shard.lock);
+        remove_range(shard, piece.offset, piece.length, &dropped_seq);
+        ++shard.generation;
+      }
+
+      // stays in front of later IO until it is done
+      m_barrier_in_flight = true;
+      m_barrier_seq = dropped_seq;
+      send = true;
+      break;
+    }
+    m_deferred.pop_front();
+  }
+
+  m_deferring = !m_deferred.empty();
+  return send;
+}
+
+template <typename I>
+void MemoryImageCache<I>::send_barrier() {
+  m_image_ctx.op_work_queue->queue(new FunctionContext([this](int r) {
+      RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+      Op *op;
+      {
+        Mutex::Locker locker(m_lock);
+        assert(m_barrier_in_flight && !m_deferred.empty());
+        op = &m_deferred.front();
+      }
+
+      CephContext *cct = m_image_ctx.cct;
+      ldout(cct, 20) << "image_extents=" << op->image_extents << dendl;
+
+      Context *ctx = new FunctionContext([this](int r) {
+          handle_barrier(r);
+        });
+      uint64_t offset = op->image_extents[0].first;
+      uint64_t length = op->image_extents[0].second;
+      if (op->type == OP_DISCARD) {
+        m_image_writeback.aio_discard(offset, length,
+                                      op->skip_partial_discard, ctx);
+      } else {
+        m_image_writeback.aio_writesame(offset, length, bufferlist(op->bl),
+                                        op->fadvise_flags, ctx);
+      }
+    }), 0);
+}
+
+template <typename I>
+void MemoryImageCache<I>::handle_barrier(int r) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "r=" << r << dendl;
+
+  Completions completions;
+  bool send;
+  {
+    Mutex::Locker locker(m_lock);
+    assert(m_barrier_in_flight && !m_deferred.empty());
+    completions.push_back(std::make_pair(m_deferred.front().on_finish, r));
+    m_deferred.pop_front();
+    m_barrier_in_flight = false;
+    m_barrier_seq = 0;
+
+    complete_flush_waiters(&completions);
+    send = dispatch_deferred(&completions);
+  }
+  complete(&completions);
+  if (send) {
+    send_barrier();
+  }
+}
+
+template <typename I>
+void MemoryImageCache<I>::drop_all(bool dirty) {
+  assert(m_lock.is_locked());
+  for (auto shard_ptr : m_shards) {
+    Shard &shard = *shard_ptr;
+    Mutex::Locker locker(shard.lock);
+    for (auto it = shard.extents.begin(); it != shard.extents.end(); ) {
+      Extent &extent = it->second;
+      if (extent.seq != 0 && !dirty) {
+        ++it;
+        continue;
+      }
+      if (extent.seq != 0) {
+        shard.dirty_bytes -= extent.length;
+        m_dirty_bytes -= extent.length;
+      }
+      shard.bytes -= extent.length;
+      it = shard.extents.erase(it);
+    }
+    if (dirty) {
+      shard.dirty_seqs.clear();
+    }
+    ++shard.generation;
+  }
+}
+
+template <typename I>
+uint64_t MemoryImageCache<I>::oldest_seq() {
+  assert(m_lock.is_locked());
+  uint64_t seq = NO_SEQ;
+  if (m_barrier_in_flight) {
+    seq = m_barrier_seq;
+  }
+  for (auto shard : m_shards) {
+    Mutex::Locker locker(shard->lock);
+    if (!shard->dirty_seqs.empty()) {
+      seq = std::min(seq, shard->dirty_seqs.begin()->first);
+    }
+  }
+  return seq;
+}
+
+template <typename I>
+void MemoryImageCache<I>::complete_flush_waiters(Completions *completions) {
+  assert(m_lock.is_locked());
+  if (m_flush_waiters.empty()) {
+    return;
+  }
+
+  uint64_t seq = oldest_seq();
+  while (!m_flush_waiters.empty() && m_flush_waiters.front().first < seq) {
+    completions->push_back(std::make_pair(m_flush_waiters.front().second,
+                                          m_writeback_error));
+    m_writeback_error = 0;
+    m_flush_waiters.pop_front();
+  }
+}
+
+template <typename I>
+void MemoryImageCache<I>::schedule_writeback() {
+  if (m_writeback_failed || m_writeback_scheduled.exchange(true)) {
+    return;
+  }
+  m_image_ctx.op_work_queue->queue(new FunctionContext([this](int r) {
+      writeback();
+    }), 0);
+}
+
+template <typename I>
+void MemoryImageCache<I>::retry_writeback() {
+  if (m_writeback_failed.exchange(false) && m_dirty_bytes > 0) {
+    schedule_writeback();
+  }
+}
+
+template <typename I>
+void MemoryImageCache<I>::writeback() {
+  CephContext *cct = m_image_ctx.cct;
+
+  struct Batch {
+    Extents image_extents;
+    bufferlist bl;
+    std::vector<Writing> *writing = new std::vector<Writing>();
+  };
+  std::vector<Batch> batches;
+
+  RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+  {
+    Mutex::Locker locker(m_lock);
+    m_writeback_scheduled = false;
+
+    // a discard or writesame is waiting for writeback to stop
+    if (m_barrier_in_flight ||
+        (!m_deferred.empty() && m_deferred.front().type != OP_WRITE &&
+         m_deferred.front().type != OP_FLUSH)) {
+      return;
+    }
+
+    // under the target, only write back what has aged
+    uint64_t max_seq = m_aged_seq;
+    if (!m_flush_waiters.empty() || !m_deferred.empty() ||
+        m_dirty_bytes > m_image_ctx.memory_cache_target_dirty) {
+      max_seq = NO_SEQ;
+    }
+
+    uint32_t max_in_flight = std::max(1U,
+      m_image_ctx.memory_cache_max_writeback);
+    uint64_t batch_bytes = 0;
+    uint32_t shard_count = m_shards.size();
+    uint32_t scanned = 0;
+    for (; scanned < shard_count && max_seq > 0 &&
+           m_in_flight + batches.size() < max_in_flight; ++scanned) {
+      uint32_t shard_idx = (m_next_shard + scanned) % shard_count;
+      Shard &shard = *m_shards[shard_idx];
+      Mutex::Locker shard_locker(shard.lock);
+      if (shard.dirty_bytes == 0) {
+        continue;
+      }
+
+      for (auto &pair : shard.extents) {
+        Extent &extent = pair.second;
+        if (extent.seq == 0 || extent.writing || extent.seq > max_seq ||
+            shard.writing.intersects(extent.offset, extent.length)) {
+          continue;
+        }
+
+        if (batches.empty() ||
+            batch_bytes >= m_image_ctx.memory_cache_writeback_batch) {
+          if (m_in_flight + batches.size() >= max_in_flight) {
+            break;
+          }
+          batches.emplace_back();
+          batch_bytes = 0;
+        }
+
+        Batch &batch = batches.back();
+        if (!batch.image_extents.empty() &&
+            batch.writing->back().shard == shard_idx &&
+            batch.image_extents.back().first +
+              batch.image_extents.back().second == extent.offset) {
+          batch.image_extents.back().second += extent.length;
+        } else {
+          batch.image_extents.push_back({extent.offset, extent.length});
+        }
+        batch.bl.append(extent.bl);
+        batch.writing->push_back({shard_idx, extent.offset, extent.length,
+                                  extent.seq});
+        batch_bytes += extent.length;
+
+        extent.writing = true;
+        shard.writing.insert(extent.offset, extent.length);
+      }
+    }
+    m_next_shard = (m_next_shard + scanned) % shard_count;
+    m_in_flight += batches.size();
+  }
+
+  for (auto &batch : batches) {
+    ldout(cct, 20) << "image_extents=" << batch.image_extents << dendl;
+    std::vector<Writing> *writing = batch.writing;
+    Context *ctx = new FunctionContext([this, writing](int r) {
+        handle_writeback(writing, r);
+      });
+    m_image_writeback.aio_write(std::move(batch.image_extents),
+                                std::move(batch.bl), 0, ctx);
+  }
+}
+
+template <typename I>
+void MemoryImageCache<I>::handle_writeback(std::vector<Writing> *writing,
+                                           int r) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "extents=" << writing->size() << ", r=" << r << dendl;
+  if (r < 0) {
+    lderr(cct) << "failed to write back: " << cpp_strerror(r) << dendl;
+  }
+
+  for (auto &w : *writing) {
+    Shard &shard = *m_shards[w.shard];
+    Mutex::Locker locker(shard.lock);
+    shard.writing.erase(w.offset, w.length);
+
+    // what is left of it is accounted for again below if it failed
+    auto seq_it = shard.dirty_seqs.find(w.seq);
+    assert(seq_it != shard.dirty_seqs.end() && seq_it->second >= w.length);
+    seq_it->second -= w.length;
+    if (seq_it->second == 0) {
+      shard.dirty_seqs.erase(seq_it);
+    }
+
+    // whatever is still marked as being written back in the range was
+    // written by this batch
+    auto it = shard.extents.lower_bound(w.offset);
+    while (it != shard.extents.end() && it->first < w.offset + w.length) {
+      Extent &extent = it->second;
+      if (!extent.writing) {
+        ++it;
+        continue;
+      }
+
+      extent.writing = false;
+      if (r < 0) {
+        // it was acknowledged: keep it dirty, to be written back again
+        shard.dirty_seqs[extent.seq] += extent.length;
+        ++it;
+        continue;
+      }
+      shard.dirty_bytes -= extent.length;
+      m_dirty_bytes -= extent.length;
+      extent.seq = 0;
+      shard.lru.push_back(extent);
+      ++it;
+    }
+    trim(shard);
+  }
+  delete writing;
+
+  Completions completions;
+  bool send;
+  {
+    Mutex::Locker locker(m_lock);
+    assert(m_in_flight > 0);
+    --m_in_flight;
+    if (r < 0) {
+      if (m_writeback_error == 0) {
+        m_writeback_error = r;
+      }
+      m_writeback_failed = true;
+    }
+
+    complete_flush_waiters(&completions);
+    if (m_writeback_failed && m_in_flight == 0) {
+      // the rest wait for the failed extents
+      for (auto &w : m_flush_waiters) {
+        completions.push_back(std::make_pair(w.second, m_writeback_error));
+      }
+      if (!m_flush_waiters.empty()) {
+        m_flush_waiters.clear();
+        m_writeback_error = 0;
+      }
+    }
+    send = dispatch_deferred(&completions);
+  }
+  if (m_dirty_bytes > 0) {
+    schedule_writeback();
+  }
+  complete(&completions);
+  if (send) {
+    send_barrier();
+  }
+}
+
+template <typename I>
+void MemoryImageCache<I>::schedule_tick() {
+  assert(m_timer_lock->is_locked());
+  if (m_shutting_down) {
+    return;
+  }
+
+  m_timer_event = new FunctionContext([this](int r) {
+      handle_tick();
+    });
+  m_timer->add_event_after(m_image_ctx.memory_cache_max_dirty_age,
+                           m_timer_event);
+}
+
+template <typename I>
+void MemoryImageCache<I>::handle_tick() {
+  assert(m_timer_lock->is_locked());
+  m_timer_event = nullptr;
+
+  {
+    Mutex::Locker locker(m_lock);
+    m_aged_seq = m_tick_seq;
+    m_tick_seq = m_next_seq - 1;
+  }
+  m_writeback_failed = false;
+  if (m_dirty_bytes > 0) {
+    schedule_writeback();
+  }
+  schedule_tick();
+}
+
+template <typename I>
+void MemoryImageCache<I>::complete(Completions *completions) {
+  // the last completion may be the one that lets us be destroyed
+  auto op_work_queue = m_image_ctx.op_work_queue;
+  for (auto &c : *completions) {
+    op_work_queue->queue(c.first, c.second);
+  }
+  completions->clear();
+}
+
+} // namespace cache
+} // namespace librbd
+
+template class librbd::cache::MemoryImageCache<librbd::ImageCtx>;
@@ -0,0 +1,214 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_LIBRBD_CACHE_MEMORY_IMAGE_CACHE
+#define CEPH_LIBRBD_CACHE_MEMORY_IMAGE_CACHE
+
+#include "ImageCache.h"
+#include "ImageWriteback.h"
+#include "include/buffer.h"
+#include "include/interval_set.h"
+#include "common/Mutex.h"
+#include <boost/intrusive/list.hpp>
+#include <atomic>
+#include <list>
+#include <map>
+#include <vector>
+
+class SafeTimer;
+
+namespace librbd {
+
+struct ImageCtx;
+
+namespace cache {
+
+/**
+ * In-memory write-back image cache
+ *
+ * The image is cut into object-sized ranges, each owned by one of a fixed
+ * number of shards with its own lock, so IO to different objects does not
+ * contend.  A shard keeps its cached data as non-overlapping extents
+ * indexed by offset; clean extents are evicted least recently used first.
+ *
+ * Writes are acknowledged once cached.  Dirty extents are written back
+ * in the background, once there are more than the target number of dirty
+ * bytes or they get too old: adjacent extents are coalesced and several
+ * are batched into each request.  Extents being written back are never
+ * written back again concurrently, so the image sees overlapping writes
+ * in order.  Extents that fail to be written back stay dirty: the error
+ * goes to the next flush, and writeback stops until the next write, flush
+ * or tick.  Writes wait for writeback when there are too many dirty
+ * bytes.  Discards and writesames drop the range they cover and are
+ * passed through once no writeback is in flight; later IO waits for them.
+ */
+template <typename ImageCtxT = librbd::ImageCtx>
+class MemoryImageCache : public ImageCache {
+public:
+  MemoryImageCache(ImageCtxT &image_ctx);
+  ~MemoryImageCache() override;
+
+  /// client AIO methods
+  void aio_read(Extents&& image_extents, ceph::bufferlist *bl,
+                int fadvise_flags, Context *on_finish) override;
+  void aio_write(Extents&& image_extents, ceph::bufferlist&& bl,
+                 int fadvise_flags, Context *on_finish) override;
+  void aio_discard(uint64_t offset, uint64_t length,
+                   bool skip_partial_discard, Context *on_finish) override;
+  void aio_flush(Context *on_finish) override;
+  void aio_writesame(uint64_t offset, uint64_t length,
+                     ceph::bufferlist&& bl,
+                     int fadvise_flags, Context *on_finish) override;
+
+  /// internal state methods
+  void init(Context *on_finish) override;
+  void shut_down(Context *on_finish) override;
+
+  void invalidate(Context *on_finish) override;
+  void flush(Context *on_finish) override;
+
+private:
+  typedef boost::intrusive::list_member_hook<
+    boost::intrusive::link_mode<boost::intrusive::auto_unlink> > LRUHook;
+
+  struct Extent {
+    uint64_t offset;
+    uint64_t length;
+    ceph::bufferlist bl;
+    uint64_t seq = 0;       ///< oldest write it holds, 0 once clean
+    bool writing = false;   ///< being written back
+    LRUHook lru_item;       ///< linked while clean
+
+    Extent(uint64_t offset, uint64_t length, ceph::bufferlist &&bl)
+      : offset(offset), length(length), bl(std::move(bl)) {
+    }
+  };
+
+  typedef std::map<uint64_t, Extent> ExtentMap;
+  typedef boost::intrusive::list<
+    Extent,
+    boost::intrusive::member_hook<Extent, LRUHook, &Extent::lru_item>,
+    boost::intrusive::constant_time_size<false> > LRUList;
+
+  struct Shard {
+    Mutex lock;
+    ExtentMap extents;
+    LRUList lru;
+    uint64_t bytes = 0;
+    uint64_t dirty_bytes = 0;
+    uint64_t generation = 0;              ///< bumped by every change of data
+    interval_set<uint64_t> writing;       ///< ranges being written back
+    std::map<uint64_t, uint64_t> dirty_seqs; ///< seq -> bytes not yet written back
+
+    Shard(const std::string &name) : lock(name) {
+    }
+  };
+
+  enum OpType {
+    OP_WRITE,
+    OP_DISCARD,
+    OP_WRITESAME,
+    OP_FLUSH
+  };
+
+  /// IO waiting for room for dirty data, or for a discard or writesame
+  struct Op {
+    OpType type;
+    Extents image_extents;
+    ceph::bufferlist bl;
+    int fadvise_flags = 0;
+    bool skip_partial_discard = false;
+    Context *on_finish;
+
+    Op(OpType type, Extents &&image_extents, Context *on_finish)
+      : type(type), image_extents(std::move(image_extents)),
+        on_finish(on_finish) {
+    }
+  };
+
+  /// a dirty extent in a writeback batch
+  struct Writing {
+    uint32_t shard;
+    uint64_t offset;
+    uint64_t length;
+    uint64_t seq;
+  };
+
+  /// the part of an image extent within one shard's object range
+  struct Piece {
+    uint32_t shard;
+    uint64_t offset;
+    uint64_t length;
+    uint64_t buffer_offset;
+  };
+
+  typedef std::vector<Piece> Pieces;
+  typedef std::list<std::pair<Context *, int> > Completions;
+  typedef std::list<std::pair<uint64_t, Context *> > FlushWaiters;
+
+  struct C_ReadRequest;
+
+  ImageCtxT &m_image_ctx;
+  ImageWriteback<ImageCtxT> m_image_writeback;
+  uint64_t m_object_size;
+  std::vector<Shard*> m_shards;
+  uint64_t m_shard_size;                  ///< cache bytes per shard
+
+  std::atomic<uint64_t> m_next_seq = { 1 };
+  std::atomic<uint64_t> m_dirty_bytes = { 0 };
+  std::atomic<bool> m_deferring = { false };
+  std::atomic<bool> m_writeback_scheduled = { false };
+  std::atomic<bool> m_writeback_failed = { false };
+
+  Mutex m_lock;
+  std::list<Op> m_deferred;
+  bool m_barrier_in_flight = false;
+  uint64_t m_barrier_seq = 0;             ///< oldest write a barrier dropped
+  FlushWaiters m_flush_waiters;
+  unsigned m_in_flight = 0;
+  uint64_t m_aged_seq = 0;                ///< writes older than the last tick
+  uint64_t m_tick_seq = 0;                ///< last write before the last tick
+  uint32_t m_next_shard = 0;
+  int m_writeback_error = 0;
+
+  SafeTimer *m_timer;
+  Mutex *m_timer_lock;
+  Context *m_timer_event = nullptr;       ///< protected by m_timer_lock
+  bool m_shutting_down = false;           ///< protected by m_timer_lock
+
+  void map_extents(const Extents &image_extents, Pieces *pieces) const;
+
+  Extent &add_extent(Shard &shard, uint64_t offset, uint64_t length,
+                     ceph::bufferlist &&bl, uint64_t seq, bool writing);
+  void write_piece(Shard &shard, uint64_t offset, uint64_t length,
+                   ceph::bufferlist &&bl, uint64_t seq);
+  void remove_range(Shard &shard, uint64_t offset, uint64_t length,
+                    uint64_t *dropped_seq);
+  void insert_clean(Shard &shard, uint64_t offset, ceph::bufferlist &&bl);
+  void trim(Shard &shard);
+
+  void write_extents(Extents &&image_extents, ceph::bufferlist &&bl);
+  bool dispatch_deferred(Completions *completions);
+  void send_barrier();
+  void handle_barrier(int r);
+  void drop_all(bool dirty);
+
+  uint64_t oldest_seq();
+  void complete_flush_waiters(Completions *completions);
+
+  void schedule_writeback();
+  void retry_writeback();
+  void writeback();
+  void handle_writeback(std::vector<Writing> *writing, int r);
+  void schedule_tick();
+  void handle_tick();
+
+  void complete(Completions *completions);
+};
+
+} // namespace cache
+} // namespace librbd
+
+extern template class librbd::cache::MemoryImageCache<librbd::ImageCtx>;
+
+#endif // CEPH_LIBRBD_CACHE_MEMORY_IMAGE_CACHE
@@ -0,0 +1,828 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "WriteLogImageCache.h"
+#include "include/stringify.h"
+#include "common/dout.h"
+#include "common/errno.h"
+#include "common/safe_io.h"
+#include "common/WorkQueue.h"
+#include "librbd/ExclusiveLock.h"
+#include "librbd/ImageCtx.h"
+#include "librbd/Utils.h"
+#include <fcntl.h>
+#include <limits>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#define dout_subsys ceph_subsys_rbd
+#undef dout_prefix
+#define dout_prefix *_dout << "librbd::WriteLogImageCache: " << this << " " \
+                           <<  __func__ << ": "
+
+namespace librbd {
+namespace cache {
+
+namespace {
+
+// The log file starts with a superblock naming the first sequence number
+// in use; entries follow from LOG_START, each a header followed by the
+// encoded image extents and the data.  Entries with an earlier sequence
+// number, or that fail their crc, end the log.
+const uint64_t SUPERBLOCK_MAGIC = 0x726264776c6f6731ULL;  // "rbdwlog1"
+const uint64_t ENTRY_MAGIC = 0x726264776c656e74ULL;       // "rbdwlent"
+const uint64_t SUPERBLOCK_LENGTH = 8 + 8 + 4;
+const uint64_t ENTRY_HEADER_LENGTH = 8 + 8 + 4 + 4;
+const uint64_t LOG_START = 4096;
+
+// how far into the pending writes to look for ones to write back
+const unsigned MAX_WRITEBACK_SCAN = 1024;
+
+typedef ImageCache::Extents Extents;
+
+bool overlaps(const Extents &a, const Extents &b) {
+  for (auto &x : a) {
+    for (auto &y : b) {
+      if (x.first < y.first + y.second && y.first < x.first + x.second) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+uint64_t entry_length(const Extents &image_extents, const bufferlist &bl) {
+  return ENTRY_HEADER_LENGTH + 4 + 16 * image_extents.size() + bl.length();
+}
+
+struct C_OverlayRead : public Context {
+  Extents image_extents;
+  std::vector<std::pair<Extents, bufferlist> > overlays;
+  bufferlist *out_bl;
+  Context *on_finish;
+  bufferlist bl;
+
+  C_OverlayRead(const Extents &image_extents, bufferlist *out_bl,
+                Context *on_finish)
+    : image_extents(image_extents), out_bl(out_bl), on_finish(on_finish) {
+  }
+
+  void finish(int r) override {
+    if (r < 0) {
+      on_finish->complete(r);
+      return;
+    }
+
+    uint64_t length = 0;
+    for (auto &e : image_extents) {
+      length += e.second;
+    }
+    bufferptr ptr(length);
+    ptr.zero();
+    bl.copy(0, std::min<uint64_t>(bl.length(), length), ptr.c_str());
+
+    // later writes land on top of earlier ones
+    for (auto &overlay : overlays) {
+      uint64_t data_off = 0;
+      for (auto &w : overlay.first) {
+        uint64_t buf_off = 0;
+        for (auto &e : image_extents) {
+          uint64_t start = std::max(w.first, e.first);
+          uint64_t end = std::min(w.first + w.second, e.first + e.second);
+          if (start < end) {
+            overlay.second.copy(data_off + start - w.first, end - start,
+                                ptr.c_str() + buf_off + start - e.first);
+          }
+          buf_off += e.second;
+        }
+        data_off += w.second;
+      }
+    }
+
+    out_bl->clear();
+    out_bl->push_back(std::move(ptr));
+    on_finish->complete(length);
+  }
+};
+
+} // anonymous namespace
+
+template <typename I>
+WriteLogImageCache<I>::WriteLogImageCache(I &image_ctx)
+  : m_image_ctx(image_ctx), m_image_writeback(image_ctx),
+    m_lock(util::unique_lock_name("librbd::cache::WriteLogImageCache::m_lock",
+                                  this)),
+    m_log_size(std::max(image_ctx.persistent_cache_size, LOG_START)),
+    m_log_offset(LOG_START) {
+}
+
+template <typename I>
+WriteLogImageCache<I>::~WriteLogImageCache() {
+  assert(m_in_flight == 0);
+  if (m_fd >= 0) {
+    VOID_TEMP_FAILURE_RETRY(::close(m_fd));
+  }
+}
+
+template <typename I>
+void WriteLogImageCache<I>::aio_read(Extents &&image_extents, bufferlist *bl,
+                                     int fadvise_flags, Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "image_extents=" << image_extents << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  C_OverlayRead *ctx = nullptr;
+  {
+    Mutex::Locker locker(m_lock);
+    bool dirty = false;
+    for (auto &e : image_extents) {
+      if (e.second > 0 && m_dirty.intersects(e.first, e.second)) {
+        dirty = true;
+        break;
+      }
+    }
+
+    if (dirty) {
+      ctx = new C_OverlayRead(image_extents, bl, on_finish);
+      for (auto &op : m_pending) {
+        if (!overlaps(op.image_extents, image_extents)) {
+          continue;
+        }
+        if (op.passthrough) {
+          // a discard or writesame is changing the data under us: read
+          // once it is done
+          delete ctx;
+          Extents extents(std::move(image_extents));
+          m_read_waiters.push_back(std::make_pair(op.seq, new FunctionContext(
+            [this, extents, bl, fadvise_flags, on_finish](int r) {
+              RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+              aio_read(Extents(extents), bl, fadvise_flags, on_finish);
+            })));
+          return;
+        }
+        ctx->overlays.push_back(std::make_pair(op.image_extents, op.bl));
+      }
+    }
+  }
+
+  if (ctx != nullptr) {
+    on_finish = ctx;
+    bl = &ctx->bl;
+  }
+  m_image_writeback.aio_read(std::move(image_extents), bl, fadvise_flags,
+                             on_finish);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::aio_write(Extents &&image_extents,
+                                      bufferlist&& bl,
+                                      int fadvise_flags,
+                                      Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "image_extents=" << image_extents << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  Completions completions;
+  {
+    Mutex::Locker locker(m_lock);
+    m_deferred.emplace_back(m_next_seq++, OP_WRITE, std::move(image_extents),
+                            on_finish);
+    m_deferred.back().bl = std::move(bl);
+    m_deferred.back().fadvise_flags = fadvise_flags;
+    dispatch_deferred(&completions);
+    retry_writeback();
+  }
+  complete(&completions);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::aio_discard(uint64_t offset, uint64_t length,
+                                        bool skip_partial_discard,
+                                        Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "offset=" << offset << ", "
+                 << "length=" << length << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  Completions completions;
+  {
+    Mutex::Locker locker(m_lock);
+    m_deferred.emplace_back(m_next_seq++, OP_DISCARD,
+                            Extents{{offset, length}}, on_finish);
+    m_deferred.back().skip_partial_discard = skip_partial_discard;
+    dispatch_deferred(&completions);
+    retry_writeback();
+  }
+  complete(&completions);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::aio_flush(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "on_finish=" << on_finish << dendl;
+
+  // everything acknowledged is already durable in the log; only writes
+  // still waiting for room in it need to be waited for
+  Completions completions;
+  {
+    Mutex::Locker locker(m_lock);
+    if (m_deferred.empty()) {
+      completions.push_back(std::make_pair(on_finish, m_writeback_error));
+      m_writeback_error = 0;
+    } else {
+      m_deferred.emplace_back(m_next_seq++, OP_FLUSH, Extents(), on_finish);
+    }
+  }
+  complete(&completions);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::aio_writesame(uint64_t offset, uint64_t length,
+                                          bufferlist&& bl, int fadvise_flags,
+                                          Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "offset=" << offset << ", "
+                 << "length=" << length << ", "
+                 << "data_len=" << bl.length() << ", "
+                 << "on_finish=" << on_finish << dendl;
+
+  Completions completions;
+  {
+    Mutex::Locker locker(m_lock);
+    m_deferred.emplace_back(m_next_seq++, OP_WRITESAME,
+                            Extents{{offset, length}}, on_finish);
+    m_deferred.back().bl = std::move(bl);
+    m_deferred.back().fadvise_flags = fadvise_flags;
+    dispatch_deferred(&completions);
+    retry_writeback();
+  }
+  complete(&completions);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::init(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  m_path = m_image_ctx.persistent_cache_path + "/rbd-" +
+           stringify(m_image_ctx.md_ctx.get_id()) + "." + m_image_ctx.id +
+           ".wlog";
+  ldout(cct, 5) << "path=" << m_path << dendl;
+
+  int r;
+  {
+    Mutex::Locker locker(m_lock);
+    m_fd = ::open(m_path.c_str(), O_RDWR | O_CREAT | O_DSYNC | O_CLOEXEC,
+                  0600);
+    if (m_fd < 0) {
+      r = -errno;
+      lderr(cct) << "failed to open write log " << m_path << ": "
+                 << cpp_strerror(r) << dendl;
+    } else {
+      r = replay();
+      if (r < 0) {
+        VOID_TEMP_FAILURE_RETRY(::close(m_fd));
+        m_fd = -1;
+      } else {
+        // allocate the log up front so appends don't also have to sync
+        // allocation metadata
+        int err = ::posix_fallocate(m_fd, 0, m_log_size);
+        if (err != 0) {
+          ldout(cct, 5) << "failed to preallocate write log: "
+                        << cpp_strerror(err) << dendl;
+        }
+        if (!m_pending.empty()) {
+          schedule_writeback();
+        }
+      }
+    }
+  }
+  on_finish->complete(r);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::shut_down(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << dendl;
+
+  flush(new FunctionContext([this, on_finish](int r) {
+      Mutex::Locker locker(m_lock);
+      if (m_fd >= 0) {
+        VOID_TEMP_FAILURE_RETRY(::close(m_fd));
+        m_fd = -1;
+      }
+      Context *ctx = new FunctionContext([on_finish, r](int) {
+          on_finish->complete(r);
+        });
+      if (m_writeback_scheduled) {
+        // it has to run before we go away
+        m_on_shut_down = ctx;
+      } else {
+        m_image_ctx.op_work_queue->queue(ctx, 0);
+      }
+    }));
+}
+
+template <typename I>
+void WriteLogImageCache<I>::invalidate(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << dendl;
+
+  // nothing is cached but the log, which flush empties
+  flush(on_finish);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::flush(Context *on_finish) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "on_finish=" << on_finish << dendl;
+
+  Context *ctx = new FunctionContext([this, on_finish](int r) {
+      if (r < 0) {
+        on_finish->complete(r);
+        return;
+      }
+      RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+      m_image_writeback.aio_flush(on_finish);
+    });
+
+  Completions completions;
+  {
+    Mutex::Locker locker(m_lock);
+    uint64_t seq = m_next_seq - 1;
+    if (retired_seq() >= seq) {
+      if (m_writeback_error == 0) {
+        trim_log();
+      }
+      completions.push_back(std::make_pair(ctx, m_writeback_error));
+      m_writeback_error = 0;
+    } else {
+      m_flush_waiters.push_back(std::make_pair(seq, ctx));
+      if (m_writeback_failed) {
+        // try the failed writes again: this flush gets how that goes
+        m_writeback_failed = false;
+        m_writeback_error = 0;
+      }
+      schedule_writeback();
+    }
+  }
+  complete(&completions);
+}
+
+template <typename I>
+uint64_t WriteLogImageCache<I>::retired_seq() const {
+  assert(m_lock.is_locked());
+  uint64_t seq = m_next_seq;
+  if (!m_pending.empty()) {
+    seq = m_pending.front().seq;
+  } else if (!m_deferred.empty()) {
+    seq = m_deferred.front().seq;
+  }
+  return seq - 1;
+}
+
+template <typename I>
+void WriteLogImageCache<I>::add_pending(std::list<Op> *ops,
+                                        typename std::list<Op>::iterator it) {
+  assert(m_lock.is_locked());
+  for (auto &e : it->image_extents) {
+    if (e.second > 0) {
+      m_dirty.union_insert(e.first, e.second);
+    }
+  }
+  m_pending.splice(m_pending.end(), *ops, it);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::dispatch_deferred(Completions *completions) {
+  assert(m_lock.is_locked());
+  CephContext *cct = m_image_ctx.cct;
+
+  while (!m_deferred.empty()) {
+    if (!m_pending.empty() && m_pending.front().passthrough) {
+      // everything waits for a passed through op
+      break;
+    }
+
+    Op &op = m_deferred.front();
+    if (op.type == OP_FLUSH) {
+      // every write before it is in the log
+      completions->push_back(std::make_pair(op.on_finish, m_writeback_error));
+      m_writeback_error = 0;
+      m_deferred.pop_front();
+      continue;
+    }
+
+    uint64_t length = 0;
+    if (op.type == OP_WRITE && !m_log_failed) {
+      length = entry_length(op.image_extents, op.bl);
+      if (length > m_log_size - LOG_START ||
+          length - ENTRY_HEADER_LENGTH > std::numeric_limits<uint32_t>::max()) {
+        op.passthrough = true;
+      }
+    } else {
+      op.passthrough = true;
+    }
+
+    int r;
+    if (op.passthrough) {
+      // whatever is logged before it has to be out of the log first, or a
+      // replay would write it back over this op
+      if (!m_pending.empty()) {
+        break;
+      }
+      if (m_log_offset > LOG_START && !m_log_failed) {
+        r = reset_log();
+        if (r < 0) {
+          lderr(cct) << "failed to reset write log: " << cpp_strerror(r)
+                     << dendl;
+          m_log_failed = true;
+        }
+      }
+      add_pending(&m_deferred, m_deferred.begin());
+      schedule_writeback();
+      break;
+    }
+
+    if (m_log_offset + length > m_log_size) {
+      if (!m_pending.empty()) {
+        // wait for the log to drain
+        break;
+      }
+      r = reset_log();
+      if (r < 0) {
+        lderr(cct) << "failed to reset write log: " << cpp_strerror(r)
+                   << dendl;
+        m_log_failed = true;
+        continue;
+      }
+    }
+
+    r = append(op);
+    if (r < 0) {
+      lderr(cct) << "failed to append to write log, writing through from now "
+                 << "on: " << cpp_strerror(r) << dendl;
+      m_log_failed = true;
+      continue;
+    }
+
+    completions->push_back(std::make_pair(op.on_finish, 0));
+    op.on_finish = nullptr;
+    add_pending(&m_deferred, m_deferred.begin());
+    schedule_writeback();
+  }
+}
+
+template <typename I>
+int WriteLogImageCache<I>::append(Op &op) {
+  assert(m_lock.is_locked());
+
+  bufferlist payload;
+  ::encode(op.image_extents, payload);
+  payload.append(op.bl);
+
+  bufferlist bl;
+  ::encode(ENTRY_MAGIC, bl);
+  ::encode(op.seq, bl);
+  ::encode(static_cast<uint32_t>(payload.length()), bl);
+  ::encode(payload.crc32c(0), bl);
+  bl.claim_append(payload);
+  assert(m_log_offset + bl.length() <= m_log_size);
+
+  int r = bl.write_fd(m_fd, m_log_offset);
+  if (r < 0) {
+    return r;
+  }
+  m_log_offset += bl.length();
+  return 0;
+}
+
+template <typename I>
+int WriteLogImageCache<I>::reset_log() {
+  assert(m_lock.is_locked());
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "first_seq=" << m_next_seq << dendl;
+
+  bufferlist bl;
+  ::encode(SUPERBLOCK_MAGIC, bl);
+  ::encode(m_next_seq, bl);
+  ::encode(bl.crc32c(0), bl);
+
+  int r = bl.write_fd(m_fd, 0);
+  if (r < 0) {
+    return r;
+  }
+  m_log_offset = LOG_START;
+  return 0;
+}
+
+template <typename I>
+void WriteLogImageCache<I>::trim_log() {
+  assert(m_lock.is_locked());
+  CephContext *cct = m_image_ctx.cct;
+
+  // everything logged has been written back: start over, so that the
+  // next open doesn't write it back again over whatever came after
+  if (m_fd < 0 || m_log_failed || m_log_offset == LOG_START ||
+      !m_pending.empty() || !m_deferred.empty()) {
+    return;
+  }
+  int r = reset_log();
+  if (r < 0) {
+    lderr(cct) << "failed to reset write log: " << cpp_strerror(r) << dendl;
+    m_log_failed = true;
+  }
+}
+
+template <typename I>
+int WriteLogImageCache<I>::replay() {
+  assert(m_lock.is_locked());
+  CephContext *cct = m_image_ctx.cct;
+
+  bufferptr sb(SUPERBLOCK_LENGTH);
+  int r = safe_pread_exact(m_fd, sb.c_str(), SUPERBLOCK_LENGTH, 0);
+  if (r == -EDOM) {
+    // a new log
+    return reset_log();
+  } else if (r < 0) {
+    lderr(cct) << "failed to read write log: " << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  uint64_t magic;
+  uint64_t first_seq;
+  uint32_t crc;
+  bufferlist bl;
+  bl.push_back(sb);
+  bufferlist::iterator p = bl.begin();
+  ::decode(magic, p);
+  ::decode(first_seq, p);
+  ::decode(crc, p);
+  bufferlist header;
+  header.substr_of(bl, 0, SUPERBLOCK_LENGTH - 4);
+  if (magic != SUPERBLOCK_MAGIC || header.crc32c(0) != crc) {
+    lderr(cct) << m_path << " is not a write log" << dendl;
+    return -EINVAL;
+  }
+
+  // the configured size may have shrunk since the log was written
+  struct stat st;
+  if (::fstat(m_fd, &st) < 0) {
+    r = -errno;
+    lderr(cct) << "failed to stat write log: " << cpp_strerror(r) << dendl;
+    return r;
+  }
+  uint64_t end = std::max<uint64_t>(st.st_size, m_log_size);
+
+  std::list<Op> ops;
+  uint64_t offset = LOG_START;
+  uint64_t last_seq = 0;
+  while (offset + ENTRY_HEADER_LENGTH <= end) {
+    bufferptr hp(ENTRY_HEADER_LENGTH);
+    r = safe_pread_exact(m_fd, hp.c_str(), ENTRY_HEADER_LENGTH, offset);
+    if (r == -EDOM) {
+      break;
+    } else if (r < 0) {
+      lderr(cct) << "failed to read write log: " << cpp_strerror(r) << dendl;
+      return r;
+    }
+
+    uint64_t seq;
+    uint32_t length;
+    bl.clear();
+    bl.push_back(hp);
+    p = bl.begin();
+    ::decode(magic, p);
+    ::decode(seq, p);
+    ::decode(length, p);
+    ::decode(crc, p);
+    if (magic != ENTRY_MAGIC || seq < first_seq || seq <= last_seq ||
+        offset + ENTRY_HEADER_LENGTH + length > end) {
+      break;
+    }
+
+    bufferptr pp(length);
+    r = safe_pread_exact(m_fd, pp.c_str(), length,
+                         offset + ENTRY_HEADER_LENGTH);
+    if (r == -EDOM) {
+      break;
+    } else if (r < 0) {
+      lderr(cct) << "failed to read write log: " << cpp_strerror(r) << dendl;
+      return r;
+    }
+    bufferlist payload;
+    payload.push_back(pp);
+    if (payload.crc32c(0) != crc) {
+      break;
+    }
+
+    Extents image_extents;
+    p = payload.begin();
+    try {
+      ::decode(image_extents, p);
+    } catch (const buffer::error &err) {
+      break;
+    }
+    ops.emplace_back(seq, OP_WRITE, std::move(image_extents), nullptr);
+    p.copy(p.get_remaining(), ops.back().bl);
+    add_pending(&ops, ops.begin());
+
+    last_seq = seq;
+    offset += ENTRY_HEADER_LENGTH + length;
+  }
+
+  m_next_seq = std::max(first_seq, last_seq + 1);
+  m_log_offset = offset;
+  ldout(cct, 1) << "replaying " << m_pending.size() << " writes from "
+                << m_path << dendl;
+  return 0;
+}
+
+template <typename I>
+void WriteLogImageCache<I>::schedule_writeback() {
+  assert(m_lock.is_locked());
+  if (m_writeback_scheduled || m_writeback_failed) {
+    return;
+  }
+  m_writeback_scheduled = true;
+  m_image_ctx.op_work_queue->queue(new FunctionContext([this](int r) {
+      writeback();
+    }), 0);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::retry_writeback() {
+  assert(m_lock.is_locked());
+  if (m_writeback_failed) {
+    m_writeback_failed = false;
+    schedule_writeback();
+  }
+}
+
+template <typename I>
+void WriteLogImageCache<I>::writeback() {
+  CephContext *cct = m_image_ctx.cct;
+
+  RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
+  std::vector<Op*> ops;
+  Completions completions;
+  {
+    Mutex::Locker locker(m_lock);
+    m_writeback_scheduled = false;
+    if (m_on_shut_down != nullptr) {
+      completions.push_back(std::make_pair(m_on_shut_down, 0));
+      m_on_shut_down = nullptr;
+    } else if (m_image_ctx.exclusive_lock != nullptr &&
+               !m_image_ctx.exclusive_lock->is_lock_owner()) {
+      // leave it in the log, to be written back when the lock is ours
+      ldout(cct, 5) << "not lock owner, leaving " << m_pending.size()
+                    << " writes in the log" << dendl;
+      for (auto &w : m_flush_waiters) {
+        completions.push_back(std::make_pair(w.second, 0));
+      }
+      m_flush_waiters.clear();
+    } else {
+      // an op can be written back once no earlier op still pending
+      // overlaps it
+      interval_set<uint64_t> earlier;
+      unsigned scanned = 0;
+      for (auto it = m_pending.begin();
+           it != m_pending.end() &&
+             m_in_flight < m_image_ctx.persistent_cache_max_writeback &&
+             scanned < MAX_WRITEBACK_SCAN;
+           ++it, ++scanned) {
+        if (it->retired) {
+          continue;
+        }
+        bool blocked = false;
+        for (auto &e : it->image_extents) {
+          if (e.second > 0 && earlier.intersects(e.first, e.second)) {
+            blocked = true;
+          }
+        }
+        for (auto &e : it->image_extents) {
+          if (e.second > 0) {
+            earlier.union_insert(e.first, e.second);
+          }
+        }
+        if (blocked || it->issued) {
+          continue;
+        }
+        it->issued = true;
+        ++m_in_flight;
+        ops.push_back(&*it);
+      }
+    }
+  }
+  complete(&completions);
+
+  for (auto op : ops) {
+    ldout(cct, 20) << "seq=" << op->seq << ", "
+                   << "image_extents=" << op->image_extents << dendl;
+    Context *ctx = new FunctionContext([this, op](int r) {
+        handle_writeback(op, r);
+      });
+    switch (op->type) {
+    case OP_WRITE:
+      m_image_writeback.aio_write(Extents(op->image_extents),
+                                  bufferlist(op->bl), op->fadvise_flags, ctx);
+      break;
+    case OP_DISCARD:
+      m_image_writeback.aio_discard(op->image_extents[0].first,
+                                    op->image_extents[0].second,
+                                    op->skip_partial_discard, ctx);
+      break;
+    case OP_WRITESAME:
+      m_image_writeback.aio_writesame(op->image_extents[0].first,
+                                      op->image_extents[0].second,
+                                      bufferlist(op->bl), op->fadvise_flags,
+                                      ctx);
+      break;
+    default:
+      assert(false);
+    }
+  }
+}
+
+template <typename I>
+void WriteLogImageCache<I>::handle_writeback(Op *op, int r) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << "seq=" << op->seq << ", r=" << r << dendl;
+
+  Completions completions;
+  {
+    Mutex::Locker locker(m_lock);
+    assert(m_in_flight > 0);
+    --m_in_flight;
+
+    if (op->passthrough) {
+      completions.push_back(std::make_pair(op->on_finish, r));
+      op->retired = true;
+    } else if (r < 0) {
+      // it was acknowledged: keep it, in the log and here, and stop
+      // writing back until it is asked for again
+      lderr(cct) << "failed to write back seq " << op->seq << ": "
+                 << cpp_strerror(r) << dendl;
+      if (m_writeback_error == 0) {
+        m_writeback_error = r;
+      }
+      op->issued = false;
+      m_writeback_failed = true;
+    } else {
+      op->retired = true;
+    }
+    while (!m_pending.empty() && m_pending.front().retired) {
+      m_pending.pop_front();
+    }
+    if (m_pending.empty()) {
+      m_dirty.clear();
+    }
+
+    uint64_t seq = retired_seq();
+    while (!m_flush_waiters.empty() && m_flush_waiters.front().first <= seq) {
+      if (m_writeback_error == 0) {
+        trim_log();
+      }
+      completions.push_back(std::make_pair(m_flush_waiters.front().second,
+                                           m_writeback_error));
+      m_writeback_error = 0;
+      m_flush_waiters.pop_front();
+    }
+    if (m_writeback_failed && m_in_flight == 0) {
+      // the rest wait for the failed writes
+      for (auto &w : m_flush_waiters) {
+        completions.push_back(std::make_pair(w.second, m_writeback_error));
+      }
+      if (!m_flush_waiters.empty()) {
+        m_flush_waiters.clear();
+        m_writeback_error = 0;
+      }
+    }
+    for (auto it = m_read_waiters.begin(); it != m_read_waiters.end(); ) {
+      if (it->first <= seq) {
+        completions.push_back(std::make_pair(it->second, 0));
+        it = m_read_waiters.erase(it);
+      } else {
+        ++it;
+      }
+    }
+
+    dispatch_deferred(&completions);
+    if (m_pending.size() > m_in_flight) {
+      schedule_writeback();
+    }
+  }
+  complete(&completions);
+}
+
+template <typename I>
+void WriteLogImageCache<I>::complete(Completions *completions) {
+  for (auto &c : *completions) {
+    m_image_ctx.op_work_queue->queue(c.first, c.second);
+  }
+  completions->clear();
+}
+
+} // namespace cache
+} // namespace librbd
+
+template class librbd::cache::WriteLogImageCache<librbd::ImageCtx>;
@@ -0,0 +1,147 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_LIBRBD_CACHE_WRITE_LOG_IMAGE_CACHE
+#define CEPH_LIBRBD_CACHE_WRITE_LOG_IMAGE_CACHE
+
+#include "ImageCache.h"
+#include "ImageWriteback.h"
+#include "include/buffer.h"
+#include "include/interval_set.h"
+#include "common/Mutex.h"
+#include <list>
+#include <string>
+
+namespace librbd {
+
+struct ImageCtx;
+
+namespace cache {
+
+/**
+ * Persistent write-back image cache
+ *
+ * Writes are appended to a log file on a local device (opened O_DSYNC)
+ * and acknowledged as soon as they are durable there; they are then
+ * written back to the image in the background, in order, through
+ * ImageWriteback.  Writes that overlap are never written back
+ * concurrently, so the image always sees them in the order they were
+ * logged.  Reads are passed through and overlaid with the logged writes
+ * not yet written back.
+ *
+ * On open the log is replayed: every intact entry not known to have
+ * been written back is written back again, so a crash loses nothing that
+ * was acknowledged.  A flush that finds everything written back starts
+ * the log over, so a clean shut down or lock release replays nothing.
+ * A write that fails to write back stays in the log: the flushes waiting
+ * for it fail, and it is tried again on the next write or flush.
+ *
+ * Discards and writesames are not logged; they wait for the log to drain
+ * and are passed through, and later writes wait for them.
+ *
+ * The log belongs to the client that wrote it: it is only written back
+ * while the client owns the exclusive lock, and left in place otherwise.
+ */
+template <typename ImageCtxT = librbd::ImageCtx>
+class WriteLogImageCache : public ImageCache {
+public:
+  WriteLogImageCache(ImageCtxT &image_ctx);
+  ~WriteLogImageCache() override;
+
+  /// client AIO methods
+  void aio_read(Extents&& image_extents, ceph::bufferlist *bl,
+                int fadvise_flags, Context *on_finish) override;
+  void aio_write(Extents&& image_extents, ceph::bufferlist&& bl,
+                 int fadvise_flags, Context *on_finish) override;
+  void aio_discard(uint64_t offset, uint64_t length,
+                   bool skip_partial_discard, Context *on_finish) override;
+  void aio_flush(Context *on_finish) override;
+  void aio_writesame(uint64_t offset, uint64_t length,
+                     ceph::bufferlist&& bl,
+                     int fadvise_flags, Context *on_finish) override;
+
+  /// internal state methods
+  void init(Context *on_finish) override;
+  void shut_down(Context *on_finish) override;
+
+  void invalidate(Context *on_finish) override;
+  void flush(Context *on_finish) override;
+
+private:
+  enum OpType {
+    OP_WRITE,
+    OP_DISCARD,
+    OP_WRITESAME,
+    OP_FLUSH
+  };
+
+  struct Op {
+    uint64_t seq;
+    OpType type;
+    Extents image_extents;
+    ceph::bufferlist bl;
+    int fadvise_flags = 0;
+    bool skip_partial_discard = false;
+    Context *on_finish;
+
+    // passed straight through instead of logged; acknowledged once
+    // written back
+    bool passthrough = false;
+    bool issued = false;
+    bool retired = false;
+
+    Op(uint64_t seq, OpType type, Extents &&image_extents, Context *on_finish)
+      : seq(seq), type(type), image_extents(std::move(image_extents)),
+        on_finish(on_finish) {
+    }
+  };
+
+  typedef std::list<std::pair<Context *, int> > Completions;
+  typedef std::list<std::pair<uint64_t, Context *> > Waiters;
+
+  ImageCtxT &m_image_ctx;
+  ImageWriteback<ImageCtxT> m_image_writeback;
+
+  Mutex m_lock;
+  std::string m_path;
+  int m_fd = -1;
+  bool m_log_failed = false;
+  uint64_t m_log_size;
+  uint64_t m_log_offset;      ///< where the next entry is appended
+  uint64_t m_next_seq = 1;
+
+  std::list<Op> m_deferred;   ///< waiting to be logged or passed through
+  std::list<Op> m_pending;    ///< logged or passed through, not yet written back
+  interval_set<uint64_t> m_dirty; ///< covers m_pending until it drains
+  unsigned m_in_flight = 0;
+  bool m_writeback_scheduled = false;
+  bool m_writeback_failed = false; ///< stopped until the next write or flush
+  int m_writeback_error = 0;
+
+  Waiters m_flush_waiters;    ///< waiting for everything up to seq to retire
+  Waiters m_read_waiters;     ///< reads waiting for a passed through op
+  Context *m_on_shut_down = nullptr;
+
+  uint64_t retired_seq() const;
+  void add_pending(std::list<Op> *ops, typename std::list<Op>::iterator it);
+
+  void dispatch_deferred(Completions *completions);
+  int append(Op &op);
+  int reset_log();
+  void trim_log();
+  int replay();
+
+  void schedule_writeback();
+  void retry_writeback();
+  void writeback();
+  void handle_writeback(Op *op, int r);
+
+  void complete(Completions *completions);
+};
+
+} // namespace cache
+} // namespace librbd
+
+extern template class librbd::cache::WriteLogImageCache<librbd::ImageCtx>;
+
+#endif // CEPH_LIBRBD_CACHE_WRITE_LOG_IMAGE_CACHE
@@ -7,6 +7,8 @@
 #include "cls/rbd/cls_rbd_client.h"
 #include "librbd/ImageCtx.h"
 #include "librbd/Utils.h"
+#include "librbd/cache/MemoryImageCache.h"
+#include "librbd/cache/WriteLogImageCache.h"
 #include "librbd/image/CloseRequest.h"
 #include "librbd/image/RefreshRequest.h"
 #include "librbd/image/SetSnapRequest.h"
@@ -154,7 +156,7 @@ Context *OpenRequest<I>::handle_v2_get_id(int *result) {
                << dendl;
     send_close_image(*result);
   } else {
-    send_v2_get_immutable_metadata();
+    send_v2_get_initial_metadata();
   }
   return nullptr;
 }
@@ -189,20 +191,76 @@ Context *OpenRequest<I>::handle_v2_get_name(int *result) {
                << cpp_strerror(*result) << dendl;
     send_close_image(*result);
   } else {
-    send_v2_get_immutable_metadata();
+    send_v2_get_initial_metadata();
   }
 
   return nullptr;
 }
 
 template <typename I>
-void OpenRequest<I>::send_v2_get_immutable_metadata() {
+void OpenRequest<I>::send_v2_get_initial_metadata() {
   CephContext *cct = m_image_ctx->cct;
   ldout(cct, 10) << this << " " << __func__ << dendl;
 
   m_image_ctx->old_format = false;
   m_image_ctx->header_oid = util::header_name(m_image_ctx->id);
 
+  // striping metadata is not batched since it fails unless the image
+  // uses fancy striping
+  librados::ObjectReadOperation op;
+  cls_client::get_immutable_metadata_start(&op);
+  cls_client::get_data_pool_start(&op);
+  cls_client::metadata_list_start(&op, m_last_metadata_key, MAX_METADATA_ITEMS);
+
+  using klass = OpenRequest<I>;
+  librados::AioCompletion *comp = create_rados_ack_callback<
+    klass, &klass::handle_v2_get_initial_metadata>(this);
+  m_out_bl.clear();
+  m_image_ctx->md_ctx.aio_operate(m_image_ctx->header_oid, comp, &op,
+                                  &m_out_bl);
+  comp->release();
+}
+
+template <typename I>
+Context *OpenRequest<I>::handle_v2_get_initial_metadata(int *result) {
+  CephContext *cct = m_image_ctx->cct;
+  ldout(cct, 10) << __func__ << ": r=" << *result << dendl;
+
+  std::map<std::string, bufferlist> metadata;
+  if (*result == 0) {
+    bufferlist::iterator it = m_out_bl.begin();
+    *result = cls_client::get_immutable_metadata_finish(
+      &it, &m_image_ctx->object_prefix, &m_image_ctx->order);
+    if (*result == 0) {
+      *result = cls_client::get_data_pool_finish(&it, &m_data_pool_id);
+    }
+    if (*result == 0) {
+      *result = cls_client::metadata_list_finish(&it, &metadata);
+    }
+  }
+
+  if (*result == -EOPNOTSUPP || *result == -EIO) {
+    ldout(cct, 10) << "batched metadata not supported by OSD" << dendl;
+    m_legacy_header = true;
+    send_v2_get_immutable_metadata();
+    return nullptr;
+  } else if (*result < 0) {
+    lderr(cct) << "failed to retreive initial metadata: "
+               << cpp_strerror(*result) << dendl;
+    send_close_image(*result);
+    return nullptr;
+  }
+
+  m_more_metadata = add_metadata(std::move(metadata));
+  send_v2_get_stripe_unit_count();
+  return nullptr;
+}
+
+template <typename I>
+void OpenRequest<I>::send_v2_get_immutable_metadata() {
+  CephContext *cct = m_image_ctx->cct;
+  ldout(cct, 10) << this << " " << __func__ << dendl;
+
   librados::ObjectReadOperation op;
   cls_client::get_immutable_metadata_start(&op);
 
@@ -275,7 +333,24 @@ Context *OpenRequest<I>::handle_v2_get_stripe_unit_count(int *result) {
     return nullptr;
   }
 
-  send_v2_get_data_pool();
+  if (m_legacy_header) {
+    send_v2_get_data_pool();
+    return nullptr;
+  }
+
+  *result = init_data_pool();
+  if (*result < 0) {
+    send_close_image(*result);
+    return nullptr;
+  }
+
+  if (m_more_metadata) {
+    send_v2_apply_metadata();
+    return nullptr;
+  }
+
+  m_image_ctx->apply_metadata(m_metadata);
+  send_register_watch();
   return nullptr;
 }
 
@@ -301,10 +376,9 @@ Context *OpenRequest<I>::handle_v2_get_data_pool(int *result) {
   CephContext *cct = m_image_ctx->cct;
   ldout(cct, 10) << this << " " << __func__ << ": r=" << *result << dendl;
 
-  int64_t data_pool_id = -1;
   if (*result == 0) {
     bufferlist::iterator it = m_out_bl.begin();
-    *result = cls_client::get_data_pool_finish(&it, &data_pool_id);
+    *result = cls_client::get_data_pool_finish(&it, &m_data_pool_id);
   } else if (*result == -EOPNOTSUPP) {
     *result = 0;
   }
@@ -316,18 +390,12 @@ Context *OpenRequest<I>::handle_v2_get_data_pool(int *result) {
     return nullptr;
   }
 
-  if (data_pool_id != -1) {
-    librados::Rados rados(m_image_ctx->md_ctx);
-    *result = rados.ioctx_create2(data_pool_id, m_image_ctx->data_ctx);
-    if (*result < 0) {
-      lderr(cct) << "failed to initialize data pool IO context: "
-                 << cpp_strerror(*result) << dendl;
-      send_close_image(*result);
-      return nullptr;
-    }
+  *result = init_data_pool();
+  if (*result < 0) {
+    send_close_image(*result);
+    return nullptr;
   }
 
-  m_image_ctx->init_layout();
   send_v2_apply_metadata();
   return nullptr;
 }
@@ -370,14 +438,9 @@ Context *OpenRequest<I>::handle_v2_apply_metadata(int *result) {
     return nullptr;
   }
 
-  if (!metadata.empty()) {
-    m_metadata.insert(metadata.begin(), metadata.end());
-    m_last_metadata_key = metadata.rbegin()->first;
-    if (boost::starts_with(m_last_metadata_key,
-                           ImageCtx::METADATA_CONF_PREFIX)) {
-      send_v2_apply_metadata();
-      return nullptr;
-    }
+  if (add_metadata(std::move(metadata))) {
+    send_v2_apply_metadata();
+    return nullptr;
   }
 
   m_image_ctx->apply_metadata(m_metadata);
@@ -386,6 +449,36 @@ Context *OpenRequest<I>::handle_v2_apply_metadata(int *result) {
   return nullptr;
 }
 
+template <typename I>
+int OpenRequest<I>::init_data_pool() {
+  if (m_data_pool_id != -1) {
+    librados::Rados rados(m_image_ctx->md_ctx);
+    int r = rados.ioctx_create2(m_data_pool_id, m_image_ctx->data_ctx);
+    if (r < 0) {
+      lderr(m_image_ctx->cct) << "failed to initialize data pool IO context: "
+                              << cpp_strerror(r) << dendl;
+      return r;
+    }
+  }
+
+  m_image_ctx->init_layout();
+  return 0;
+}
+
+template <typename I>
+bool OpenRequest<I>::add_metadata(std::map<std::string, bufferlist> &&metadata) {
+  if (metadata.empty()) {
+    return false;
+  }
+
+  m_metadata.insert(metadata.begin(), metadata.end());
+  m_last_metadata_key = metadata.rbegin()->first;
+
+  // more config keys may follow
+  return boost::starts_with(m_last_metadata_key,
+                            ImageCtx::METADATA_CONF_PREFIX);
+}
+
 template <typename I>
 void OpenRequest<I>::send_register_watch() {
   m_image_ctx->init();
@@ -442,8 +535,47 @@ Context *OpenRequest<I>::handle_refresh(int *result) {
     send_close_image(*result);
     return nullptr;
   } else {
+    return send_init_image_cache(result);
+  }
+}
+
+template <typename I>
+Context *OpenRequest<I>::send_init_image_cache(int *result) {
+  // the image caches hold writes to the image head only
+  if ((!m_image_ctx->persistent_cache && !m_image_ctx->memory_cache) ||
+      m_image_ctx->read_only || !m_image_ctx->snap_name.empty()) {
     return send_set_snap(result);
   }
+
+  CephContext *cct = m_image_ctx->cct;
+  ldout(cct, 10) << this << " " << __func__ << dendl;
+
+  using klass = OpenRequest<I>;
+  if (m_image_ctx->persistent_cache) {
+    m_image_ctx->image_cache = new cache::WriteLogImageCache<I>(*m_image_ctx);
+  } else {
+    m_image_ctx->image_cache = new cache::MemoryImageCache<I>(*m_image_ctx);
+  }
+  m_image_ctx->image_cache->init(
+    create_context_callback<klass, &klass::handle_init_image_cache>(this));
+  return nullptr;
+}
+
+template <typename I>
+Context *OpenRequest<I>::handle_init_image_cache(int *result) {
+  CephContext *cct = m_image_ctx->cct;
+  ldout(cct, 10) << __func__ << ": r=" << *result << dendl;
+
+  if (*result < 0) {
+    lderr(cct) << "failed to initialize image cache: "
+               << cpp_strerror(*result) << dendl;
+    delete m_image_ctx->image_cache;
+    m_image_ctx->image_cache = nullptr;
+    send_close_image(*result);
+    return nullptr;
+  }
+
+  return send_set_snap(result);
 }
 
 template <typename I>
@@ -43,21 +43,27 @@ private:
    *            V2_GET_ID|NAME                      |
    *                |                               |
    *                v                               |
-   *            V2_GET_IMMUTABLE_METADATA           |
+   *            V2_GET_INITIAL_METADATA             |
    *                |                               |
-   *                v                               |
+   *                | (older OSD)                   |
+   *                |-----> V2_GET_IMMUTABLE_METADATA
+   *                |           |                   |
+   *                v           v                   |
    *            V2_GET_STRIPE_UNIT_COUNT            |
-   *                |                               |
-   *                v                               |
-   *            V2_GET_DATA_POOL                    |
-   *                |                               |
-   *                v                               |
+   *                |           |                   |
+   *                |           v                   |
+   *                |       V2_GET_DATA_POOL        |
+   *                |           |                   |
+   *                v           v                   |
    *      /---> V2_APPLY_METADATA -------------> REGISTER_WATCH (skip if
    *      |         |                               |            read-only)
    *      \---------/                               v
    *                                             REFRESH
    *                                                |
    *                                                v
+   *                                             INIT_IMAGE_CACHE (skip if
+   *                                                |              disabled)
+   *                                                v
    *                                             SET_SNAP (skip if no snap)
    *                                                |
    *                                                v
@@ -78,8 +84,12 @@ private:
   bufferlist m_out_bl;
   int m_error_result;
 
+  bool m_legacy_header = false;
+  int64_t m_data_pool_id = -1;
+
   std::string m_last_metadata_key;
   std::map<std::string, bufferlist> m_metadata;
+  bool m_more_metadata = false;
 
   void send_v1_detect_header();
   Context *handle_v1_detect_header(int *result);
@@ -93,6 +103,9 @@ private:
   void send_v2_get_name();
   Context *handle_v2_get_name(int *result);
 
+  void send_v2_get_initial_metadata();
+  Context *handle_v2_get_initial_metadata(int *result);
+
   void send_v2_get_immutable_metadata();
   Context *handle_v2_get_immutable_metadata(int *result);
 
@@ -105,12 +118,18 @@ private:
   void send_v2_apply_metadata();
   Context *handle_v2_apply_metadata(int *result);
 
+  int init_data_pool();
+  bool add_metadata(std::map<std::string, bufferlist> &&metadata);
+
   void send_register_watch();
   Context *handle_register_watch(int *result);
 
   void send_refresh();
   Context *handle_refresh(int *result);
 
+  Context *send_init_image_cache(int *result);
+  Context *handle_init_image_cache(int *result);
+
   Context *send_set_snap(int *result);
   Context *handle_set_snap(int *result);
 
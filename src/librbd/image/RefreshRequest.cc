@@ -285,7 +285,91 @@ Context *RefreshRequest<I>::handle_v2_get_mutable_metadata(int *result) {
     m_incomplete_update = true;
   }
 
-  send_v2_get_flags();
+  if (m_legacy_metadata) {
+    send_v2_get_flags();
+  } else {
+    send_v2_get_metadata();
+  }
+  return nullptr;
+}
+
+template <typename I>
+void RefreshRequest<I>::send_v2_get_metadata() {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << this << " " << __func__ << dendl;
+
+  // everything that depends on the snap context in one round trip
+  librados::ObjectReadOperation op;
+  cls_client::get_flags_start(&op, m_snapc.snaps);
+  cls_client::image_get_group_start(&op);
+  if (!m_snapc.snaps.empty()) {
+    cls_client::snapshot_list_start(&op, m_snapc.snaps);
+    cls_client::snapshot_timestamp_list_start(&op, m_snapc.snaps);
+    cls_client::snapshot_namespace_list_start(&op, m_snapc.snaps);
+  }
+
+  using klass = RefreshRequest<I>;
+  librados::AioCompletion *comp = create_rados_ack_callback<
+    klass, &klass::handle_v2_get_metadata>(this);
+  m_out_bl.clear();
+  int r = m_image_ctx.md_ctx.aio_operate(m_image_ctx.header_oid, comp, &op,
+                                         &m_out_bl);
+  assert(r == 0);
+  comp->release();
+}
+
+template <typename I>
+Context *RefreshRequest<I>::handle_v2_get_metadata(int *result) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 10) << this << " " << __func__ << ": "
+                 << "r=" << *result << dendl;
+
+  if (*result == 0) {
+    bufferlist::iterator it = m_out_bl.begin();
+    *result = cls_client::get_flags_finish(&it, &m_flags, m_snapc.snaps,
+                                           &m_snap_flags);
+    if (*result == 0) {
+      *result = cls_client::image_get_group_finish(&it, &m_group_spec);
+    }
+    if (*result == 0 && !m_snapc.snaps.empty()) {
+      *result = cls_client::snapshot_list_finish(&it, m_snapc.snaps,
+                                                 &m_snap_names,
+                                                 &m_snap_sizes,
+                                                 &m_snap_parents,
+                                                 &m_snap_protection);
+      if (*result == 0) {
+        *result = cls_client::snapshot_timestamp_list_finish(
+          &it, m_snapc.snaps, &m_snap_timestamps);
+      }
+      if (*result == 0) {
+        *result = cls_client::snapshot_namespace_list_finish(
+          &it, m_snapc.snaps, &m_snap_namespaces);
+      }
+    }
+  }
+
+  if (*result == -EOPNOTSUPP) {
+    // an older OSD fails the whole batch for any method it lacks
+    ldout(cct, 10) << "batched metadata not supported by OSD" << dendl;
+    m_legacy_metadata = true;
+    send_v2_get_flags();
+    return nullptr;
+  } else if (*result == -ENOENT) {
+    ldout(cct, 10) << "out-of-sync snapshot state detected" << dendl;
+    send_v2_get_mutable_metadata();
+    return nullptr;
+  } else if (*result < 0) {
+    lderr(cct) << "failed to retrieve metadata: " << cpp_strerror(*result)
+               << dendl;
+    return m_on_finish;
+  }
+
+  if (m_snapc.snaps.empty()) {
+    // clears the snapshot state and moves on to the parent
+    send_v2_get_snapshots();
+  } else {
+    send_v2_refresh_parent();
+  }
   return nullptr;
 }
 
@@ -52,21 +52,24 @@ private:
    *    \-----> V2_GET_MUTABLE_METADATA                    <apply>
    *                |                                         |
    *                v                                         |
-   *            V2_GET_FLAGS                                  |
+   *            V2_GET_METADATA                               |
    *                |                                         |
-   *                v                                         |
-   *            V2_GET_GROUP                                  |
-   *                |                                         |
-   *                v                                         |
-   *            V2_GET_SNAPSHOTS (skip if no snaps)           |
-   *                |                                         |
-   *                v                                         |
-   *            V2_GET_SNAP_TIMESTAMPS                        |
-   *                |                                         |
-   *                v                                         |
-   *            V2_GET_SNAP_NAMESPACES                        |
-   *                |                                         |
-   *                v                                         |
+   *                | (older OSD)                             |
+   *                |-----> V2_GET_FLAGS                      |
+   *                |           |                             |
+   *                |           v                             |
+   *                |       V2_GET_GROUP                      |
+   *                |           |                             |
+   *                |           v                             |
+   *                |       V2_GET_SNAPSHOTS (skip if no      |
+   *                |           |             snaps)          |
+   *                |           v                             |
+   *                |       V2_GET_SNAP_TIMESTAMPS            |
+   *                |           |                             |
+   *                |           v                             |
+   *                |       V2_GET_SNAP_NAMESPACES            |
+   *                |           |                             |
+   *                v           v                             |
    *            V2_REFRESH_PARENT (skip if no parent or       |
    *                |              refresh not needed)        |
    *                v                                         |
@@ -146,6 +149,7 @@ private:
   bool m_exclusive_locked;
 
   bool m_blocked_writes = false;
+  bool m_legacy_metadata = false;
   bool m_incomplete_update = false;
 
   void send_v1_read_header();
@@ -163,6 +167,9 @@ private:
   void send_v2_get_mutable_metadata();
   Context *handle_v2_get_mutable_metadata(int *result);
 
+  void send_v2_get_metadata();
+  Context *handle_v2_get_metadata(int *result);
+
   void send_v2_get_flags();
   Context *handle_v2_get_flags(int *result);
 
@@ -1760,14 +1760,13 @@ int mirror_image_disable_internal(ImageCtx *ictx, bool force,
     ProgressContext &prog_ctx;
   };
 
-  int copy(ImageCtx *src, IoCtx& dest_md_ctx, const char *destname,
-	   ImageOptions& opts, ProgressContext &prog_ctx)
+  // create and open an image with the layout of src, unless overridden
+  // by opts
+  static int create_copy_dest(ImageCtx *src, IoCtx& dest_md_ctx,
+			      const char *destname, ImageOptions& opts,
+			      ImageCtx **dest_ictx)
   {
     CephContext *cct = (CephContext *)dest_md_ctx.cct();
-    ldout(cct, 20) << "copy " << src->name
-		   << (src->snap_name.length() ? "@" + src->snap_name : "")
-		   << " -> " << destname << " opts = " << opts << dendl;
-
     src->snap_lock.get_read();
     uint64_t features = src->features;
     uint64_t src_size = src->get_image_size(src->snap_id);
@@ -1811,6 +1810,23 @@ int mirror_image_disable_internal(ImageCtx *ictx, bool force,
       lderr(cct) << "failed to read newly created header" << dendl;
       return r;
     }
+    *dest_ictx = dest;
+    return 0;
+  }
+
+  int copy(ImageCtx *src, IoCtx& dest_md_ctx, const char *destname,
+	   ImageOptions& opts, ProgressContext &prog_ctx)
+  {
+    CephContext *cct = (CephContext *)dest_md_ctx.cct();
+    ldout(cct, 20) << "copy " << src->name
+		   << (src->snap_name.length() ? "@" + src->snap_name : "")
+		   << " -> " << destname << " opts = " << opts << dendl;
+
+    ImageCtx *dest;
+    int r = create_copy_dest(src, dest_md_ctx, destname, opts, &dest);
+    if (r < 0) {
+      return r;
+    }
 
     r = copy(src, dest, prog_ctx);
     int close_r = dest->state->close();
@@ -1836,8 +1852,9 @@ int mirror_image_disable_internal(ImageCtx *ictx, bool force,
   class C_CopyRead : public Context {
   public:
     C_CopyRead(SimpleThrottle *throttle, ImageCtx *dest, uint64_t offset,
-	       bufferlist *bl)
-      : m_throttle(throttle), m_dest(dest), m_offset(offset), m_bl(bl) {
+	       bufferlist *bl, bool discard_zeroes = false)
+      : m_throttle(throttle), m_dest(dest), m_offset(offset), m_bl(bl),
+	m_discard_zeroes(discard_zeroes) {
       m_throttle->start_op();
     }
     void finish(int r) override {
@@ -1851,8 +1868,17 @@ int mirror_image_disable_internal(ImageCtx *ictx, bool force,
       assert(m_bl->length() == (size_t)r);
 
       if (m_bl->is_zero()) {
+	uint64_t length = m_bl->length();
 	delete m_bl;
-	m_throttle->end_op(r);
+	if (!m_discard_zeroes || length == 0) {
+	  m_throttle->end_op(r);
+	  return;
+	}
+
+	// the destination may hold older data here
+	Context *ctx = new C_CopyWrite(m_throttle, nullptr);
+	auto comp = io::AioCompletion::create(ctx);
+	m_dest->io_work_queue->aio_discard(comp, m_offset, length, false);
 	return;
       }
 
@@ -1870,8 +1896,47 @@ int mirror_image_disable_internal(ImageCtx *ictx, bool force,
     ImageCtx *m_dest;
     uint64_t m_offset;
     bufferlist *m_bl;
+    bool m_discard_zeroes;
   };
 
+  static int copy_metadata(ImageCtx *src, ImageCtx *dest)
+  {
+    CephContext *cct = src->cct;
+    map<string, bufferlist> pairs;
+    int r = cls_client::metadata_list(&src->md_ctx, src->header_oid, "", 0,
+				      &pairs);
+    if (r < 0 && r != -EOPNOTSUPP && r != -EIO) {
+      lderr(cct) << "couldn't list metadata: " << cpp_strerror(r) << dendl;
+      return r;
+    } else if (r == 0 && !pairs.empty()) {
+      r = cls_client::metadata_set(&dest->md_ctx, dest->header_oid, pairs);
+      if (r < 0) {
+        lderr(cct) << "couldn't set metadata: " << cpp_strerror(r) << dendl;
+        return r;
+      }
+    }
+    return 0;
+  }
+
+  // false if the object map shows that none of the objects backing the
+  // stripe period at offset exist
+  static bool period_may_exist(ImageCtx *ictx, uint64_t offset)
+  {
+    RWLock::RLocker snap_locker(ictx->snap_lock);
+    if (ictx->object_map == nullptr) {
+      return true;
+    }
+
+    uint64_t object_no = (offset / ictx->get_stripe_period()) *
+			 ictx->stripe_count;
+    for (uint64_t i = 0; i < ictx->stripe_count; ++i) {
+      if (ictx->object_map->object_may_exist(object_no + i)) {
+	return true;
+      }
+    }
+    return false;
+  }
+
   int copy(ImageCtx *src, ImageCtx *dest, ProgressContext &prog_ctx)
   {
     src->snap_lock.get_read();
@@ -1888,19 +1953,18 @@ int mirror_image_disable_internal(ImageCtx *ictx, bool force,
 		 << dest_size << dendl;
       return -EINVAL;
     }
-    int r;
-    map<string, bufferlist> pairs;
-
-    r = cls_client::metadata_list(&src->md_ctx, src->header_oid, "", 0, &pairs);
-    if (r < 0 && r != -EOPNOTSUPP && r != -EIO) {
-      lderr(cct) << "couldn't list metadata: " << cpp_strerror(r) << dendl;
+    int r = copy_metadata(src, dest);
+    if (r < 0) {
       return r;
-    } else if (r == 0 && !pairs.empty()) {
-      r = cls_client::metadata_set(&dest->md_ctx, dest->header_oid, pairs);
-      if (r < 0) {
-        lderr(cct) << "couldn't set metadata: " << cpp_strerror(r) << dendl;
-        return r;
-      }
+    }
+
+    // data under the parent overlap may come from the parent even where
+    // the object map says the object does not exist
+    uint64_t overlap = 0;
+    {
+      RWLock::RLocker snap_locker(src->snap_lock);
+      RWLock::RLocker parent_locker(src->parent_lock);
+      src->get_parent_overlap(src->snap_id, &overlap);
     }
 
     RWLock::RLocker owner_lock(src->owner_lock);
@@ -1911,6 +1975,9 @@ int mirror_image_disable_internal(ImageCtx *ictx, bool force,
       if (throttle.pending_error()) {
         return throttle.wait_for_ret();
       }
+      if (offset >= overlap && !period_may_exist(src, offset)) {
+	continue;
+      }
 
       uint64_t len = min(period, src_size - offset);
       bufferlist *bl = new bufferlist();
@@ -1928,6 +1995,179 @@ int mirror_image_disable_internal(ImageCtx *ictx, bool force,
     return r;
   }
 
+  struct DeepCopyDiff {
+    interval_set<uint64_t> updated;
+    interval_set<uint64_t> removed;
+  };
+
+  static int deep_copy_diff_cb(uint64_t offset, size_t length, int exists,
+			       void *arg)
+  {
+    DeepCopyDiff *diff = reinterpret_cast<DeepCopyDiff *>(arg);
+    if (exists) {
+      diff->updated.union_insert(offset, length);
+    } else {
+      diff->removed.union_insert(offset, length);
+    }
+    return 0;
+  }
+
+  // bring dest, which holds src as of from_snap_name (or nothing), up to
+  // date with src by copying the objects that changed since
+  static int deep_copy_diff(ImageCtx *src, const char *from_snap_name,
+			    ImageCtx *dest)
+  {
+    CephContext *cct = src->cct;
+    src->snap_lock.get_read();
+    uint64_t src_size = src->get_image_size(src->snap_id);
+    src->snap_lock.put_read();
+
+    dest->snap_lock.get_read();
+    uint64_t dest_size = dest->get_image_size(dest->snap_id);
+    dest->snap_lock.put_read();
+
+    int r;
+    if (dest_size != src_size) {
+      NoOpProgressContext no_op;
+      r = dest->operations->resize(src_size, true, no_op);
+      if (r < 0) {
+	lderr(cct) << "failed to resize destination image: "
+		   << cpp_strerror(r) << dendl;
+	return r;
+      }
+    }
+
+    // with fast-diff this only reads the object maps; whole objects are
+    // copied either way
+    DeepCopyDiff diff;
+    r = diff_iterate(src, from_snap_name, 0, src_size, true, true,
+		     &deep_copy_diff_cb, &diff);
+    if (r < 0) {
+      lderr(cct) << "failed to diff source image: " << cpp_strerror(r)
+		 << dendl;
+      return r;
+    }
+    ldout(cct, 10) << "copying " << diff.updated.size() << " bytes, "
+		   << "discarding " << diff.removed.size() << " bytes" << dendl;
+
+    bool discard_zeroes = (from_snap_name != nullptr);
+    uint64_t object_size = src->get_object_size();
+    unsigned fadvise_flags = LIBRADOS_OP_FLAG_FADVISE_SEQUENTIAL |
+			     LIBRADOS_OP_FLAG_FADVISE_NOCACHE;
+
+    RWLock::RLocker owner_lock(src->owner_lock);
+    SimpleThrottle throttle(src->concurrent_management_ops, false);
+    for (auto it = diff.updated.begin(); it != diff.updated.end(); ++it) {
+      uint64_t end = it.get_start() + it.get_len();
+      for (uint64_t offset = it.get_start(); offset < end; ) {
+	if (throttle.pending_error()) {
+	  return throttle.wait_for_ret();
+	}
+
+	uint64_t len = min(object_size - offset % object_size, end - offset);
+	bufferlist *bl = new bufferlist();
+	Context *ctx = new C_CopyRead(&throttle, dest, offset, bl,
+				      discard_zeroes);
+	auto comp = io::AioCompletion::create_and_start(ctx, src,
+							io::AIO_TYPE_READ);
+	io::ImageRequest<>::aio_read(src, comp, {{offset, len}},
+				     io::ReadResult{bl}, fadvise_flags);
+	offset += len;
+      }
+    }
+
+    for (auto it = diff.removed.begin(); it != diff.removed.end(); ++it) {
+      if (throttle.pending_error()) {
+	return throttle.wait_for_ret();
+      }
+
+      throttle.start_op();
+      Context *ctx = new C_CopyWrite(&throttle, nullptr);
+      auto comp = io::AioCompletion::create(ctx);
+      dest->io_work_queue->aio_discard(comp, it.get_start(), it.get_len(),
+				       false);
+    }
+    return throttle.wait_for_ret();
+  }
+
+  int deep_copy(ImageCtx *src, IoCtx& dest_md_ctx, const char *destname,
+		ImageOptions& opts, ProgressContext &prog_ctx)
+  {
+    CephContext *cct = (CephContext *)dest_md_ctx.cct();
+    ldout(cct, 20) << "deep_copy " << src->name
+		   << (src->snap_name.length() ? "@" + src->snap_name : "")
+		   << " -> " << destname << " opts = " << opts << dendl;
+
+    // the user snapshots up to the one src is opened at, oldest first
+    std::vector<std::string> snap_names;
+    {
+      RWLock::RLocker snap_locker(src->snap_lock);
+      for (auto &it : src->snap_info) {
+	if (src->snap_id != CEPH_NOSNAP && it.first >= src->snap_id) {
+	  break;
+	}
+	if (boost::get<cls::rbd::UserSnapshotNamespace>(
+	      &it.second.snap_namespace) != nullptr) {
+	  snap_names.push_back(it.second.name);
+	}
+      }
+    }
+
+    ImageCtx *dest;
+    int r = create_copy_dest(src, dest_md_ctx, destname, opts, &dest);
+    if (r < 0) {
+      return r;
+    }
+
+    r = copy_metadata(src, dest);
+
+    // each snapshot only costs the objects that changed since the one
+    // before it
+    const char *from_snap_name = nullptr;
+    size_t steps = snap_names.size() + 1;
+    for (size_t i = 0; r == 0 && i < snap_names.size(); ++i) {
+      ImageCtx *snap_ictx = new ImageCtx(src->name, src->id,
+					 snap_names[i].c_str(), src->md_ctx,
+					 true);
+      r = snap_ictx->state->open(false);
+      if (r < 0) {
+	delete snap_ictx;
+	lderr(cct) << "failed to open snapshot " << snap_names[i] << ": "
+		   << cpp_strerror(r) << dendl;
+	break;
+      }
+
+      r = deep_copy_diff(snap_ictx, from_snap_name, dest);
+      snap_ictx->state->close();
+      if (r < 0) {
+	break;
+      }
+
+      r = dest->operations->snap_create(snap_names[i].c_str(),
+					cls::rbd::UserSnapshotNamespace());
+      if (r < 0) {
+	lderr(cct) << "failed to create snapshot " << snap_names[i] << ": "
+		   << cpp_strerror(r) << dendl;
+	break;
+      }
+      from_snap_name = snap_names[i].c_str();
+      prog_ctx.update_progress(i + 1, steps);
+    }
+
+    if (r == 0) {
+      r = deep_copy_diff(src, from_snap_name, dest);
+    }
+
+    int close_r = dest->state->close();
+    if (r == 0 && close_r < 0) {
+      r = close_r;
+    }
+    if (r == 0) {
+      prog_ctx.update_progress(steps, steps);
+    }
+    return r;
+  }
+
   int snap_set(ImageCtx *ictx, const char *snap_name)
   {
     ldout(ictx->cct, 20) << "snap_set " << ictx << " snap = "
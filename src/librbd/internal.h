@@ -50,6 +50,14 @@ enum {
 
   l_librbd_invalidate_cache,
 
+  l_librbd_rd_lat_bytes_hist,
+  l_librbd_wr_lat_bytes_hist,
+
+  l_librbd_qos_throttled,
+  l_librbd_qos_throttle_latency,
+
+  l_librbd_journal_wait_latency,
+
   l_librbd_last,
 };
 
@@ -157,6 +165,8 @@ namespace librbd {
   int copy(ImageCtx *ictx, IoCtx& dest_md_ctx, const char *destname,
 	   ImageOptions& opts, ProgressContext &prog_ctx);
   int copy(ImageCtx *src, ImageCtx *dest, ProgressContext &prog_ctx);
+  int deep_copy(ImageCtx *ictx, IoCtx& dest_md_ctx, const char *destname,
+		ImageOptions& opts, ProgressContext &prog_ctx);
 
   /* cooperative locking */
   int list_lockers(ImageCtx *ictx,
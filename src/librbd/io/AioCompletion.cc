@@ -63,9 +63,15 @@ void AioCompletion::complete() {
   case AIO_TYPE_CLOSE:
     break;
   case AIO_TYPE_READ:
-    ictx->perfcounter->tinc(l_librbd_rd_latency, elapsed); break;
+    ictx->perfcounter->tinc(l_librbd_rd_latency, elapsed);
+    ictx->perfcounter->hinc(l_librbd_rd_lat_bytes_hist, elapsed.to_nsec(),
+                            io_bytes);
+    break;
   case AIO_TYPE_WRITE:
-    ictx->perfcounter->tinc(l_librbd_wr_latency, elapsed); break;
+    ictx->perfcounter->tinc(l_librbd_wr_latency, elapsed);
+    ictx->perfcounter->hinc(l_librbd_wr_lat_bytes_hist, elapsed.to_nsec(),
+                            io_bytes);
+    break;
   case AIO_TYPE_DISCARD:
     ictx->perfcounter->tinc(l_librbd_discard_latency, elapsed); break;
   case AIO_TYPE_FLUSH:
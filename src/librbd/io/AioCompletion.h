@@ -54,6 +54,7 @@ struct AioCompletion {
   ImageCtx *ictx;
   utime_t start_time;
   aio_type_t aio_type;
+  uint64_t io_bytes;        ///< request size, for the latency histograms
 
   ReadResult read_result;
 
@@ -101,7 +102,7 @@ struct AioCompletion {
                     complete_arg(NULL), rbd_comp(NULL),
                     pending_count(0), blockers(1),
                     ref(1), released(false), ictx(NULL),
-                    aio_type(AIO_TYPE_NONE),
+                    aio_type(AIO_TYPE_NONE), io_bytes(0),
                     journal_tid(0), m_xlist_item(this), event_notify(false) {
   }
 
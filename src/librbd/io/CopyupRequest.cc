@@ -6,6 +6,7 @@
 #include "common/dout.h"
 #include "common/errno.h"
 #include "common/Mutex.h"
+#include "cls/rbd/cls_rbd_client.h"
 
 #include "librbd/AsyncObjectThrottle.h"
 #include "librbd/ExclusiveLock.h"
@@ -137,7 +138,7 @@ bool CopyupRequest::send_copyup() {
     add_copyup_op = false;
 
     librados::ObjectWriteOperation copyup_op;
-    copyup_op.exec("rbd", "copyup", m_copyup_data);
+    add_copyup_data_op(&copyup_op);
 
     // send only the copyup request with a blank snapshot context so that
     // all snapshots are detected from the parent for this object.  If
@@ -162,7 +163,7 @@ bool CopyupRequest::send_copyup() {
     librados::ObjectWriteOperation write_op;
     if (add_copyup_op) {
       // CoW did not need to handle existing snapshots
-      write_op.exec("rbd", "copyup", m_copyup_data);
+      add_copyup_data_op(&write_op);
     }
 
     // merge all pending write ops into this single RADOS op
@@ -183,6 +184,39 @@ bool CopyupRequest::send_copyup() {
   return false;
 }
 
+void CopyupRequest::add_copyup_data_op(librados::ObjectWriteOperation *op) {
+  if (!m_ictx->sparse_copyup) {
+    op->exec("rbd", "copyup", m_copyup_data);
+    return;
+  }
+
+  // leave the zeroed ranges of the parent object out of the payload
+  std::map<uint64_t, uint64_t> extent_map;
+  bufferlist data;
+  uint64_t length = m_copyup_data.length();
+  for (uint64_t offset = 0; offset < length; offset += CEPH_PAGE_SIZE) {
+    uint64_t len = MIN(CEPH_PAGE_SIZE, length - offset);
+    bufferlist bl;
+    bl.substr_of(m_copyup_data, offset, len);
+    if (bl.is_zero()) {
+      continue;
+    }
+
+    auto it = extent_map.rbegin();
+    if (it != extent_map.rend() && it->first + it->second == offset) {
+      it->second += len;
+    } else {
+      extent_map[offset] = len;
+    }
+    data.claim_append(bl);
+  }
+
+  ldout(m_ictx->cct, 20) << __func__ << " " << this << ": sending "
+                         << data.length() << "/" << length << " bytes in "
+                         << extent_map.size() << " extents" << dendl;
+  cls_client::sparse_copyup(op, extent_map, data);
+}
+
 bool CopyupRequest::is_copyup_required() {
   bool noop = true;
   for (const ObjectRequest<> *req : m_pending_requests) {
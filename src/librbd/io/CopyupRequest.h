@@ -95,6 +95,7 @@ private:
   bool send_object_map_head();
   bool send_object_map();
   bool send_copyup();
+  void add_copyup_data_op(librados::ObjectWriteOperation *op);
   bool is_copyup_required();
 };
 
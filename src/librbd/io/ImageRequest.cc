@@ -163,22 +163,27 @@ void ImageRequest<I>::send() {
                  << "completion=" << aio_comp <<  dendl;
 
   aio_comp->get();
-  int r = clip_request();
-  if (r < 0) {
-    m_aio_comp->fail(r);
+  if (m_bypass_image_cache || m_image_ctx.image_cache == nullptr) {
+    // clipped under the same snap_lock hold that maps the extents
+    send_request();
     return;
   }
 
-  if (m_bypass_image_cache || m_image_ctx.image_cache == nullptr) {
-    send_request();
-  } else {
-    send_image_cache_request();
+  int r;
+  {
+    RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
+    r = clip_request();
+  }
+  if (r < 0) {
+    m_aio_comp->fail(r);
+    return;
   }
+  send_image_cache_request();
 }
 
 template <typename I>
 int ImageRequest<I>::clip_request() {
-  RWLock::RLocker snap_locker(m_image_ctx.snap_lock);
+  assert(m_image_ctx.snap_lock.is_locked());
   for (auto &image_extent : m_image_extents) {
     size_t clip_len = image_extent.second;
     int r = clip_io(get_image_ctx(&m_image_ctx), image_extent.first, &clip_len);
@@ -191,6 +196,31 @@ int ImageRequest<I>::clip_request() {
   return 0;
 }
 
+template <typename I>
+bool ImageRequest<I>::tokens_requested(uint64_t flag, uint64_t *tokens) const {
+  aio_type_t aio_type = get_aio_type();
+  bool read_op = (aio_type == AIO_TYPE_READ);
+  if (((flag & RBD_QOS_READ_MASK) != 0 && !read_op) ||
+      ((flag & RBD_QOS_WRITE_MASK) != 0 && read_op)) {
+    return false;
+  }
+
+  if (aio_type == AIO_TYPE_FLUSH) {
+    // nothing to pay, but it has to queue behind the writes already waiting
+    *tokens = 0;
+  } else if ((flag & RBD_QOS_BPS_MASK) != 0) {
+    *tokens = 0;
+    if (aio_type != AIO_TYPE_DISCARD) {
+      for (auto &extent : m_image_extents) {
+        *tokens += extent.second;
+      }
+    }
+  } else {
+    *tokens = 1;
+  }
+  return true;
+}
+
 template <typename I>
 void ImageRequest<I>::start_op() {
   m_aio_comp->start_op();
@@ -219,11 +249,6 @@ void ImageReadRequest<I>::send_request() {
   CephContext *cct = image_ctx.cct;
 
   auto &image_extents = this->m_image_extents;
-  if (image_ctx.object_cacher && image_ctx.readahead_max_bytes > 0 &&
-      !(m_op_flags & LIBRADOS_OP_FLAG_FADVISE_RANDOM)) {
-    readahead(get_image_ctx(&image_ctx), image_extents);
-  }
-
   AioCompletion *aio_comp = this->m_aio_comp;
   librados::snap_t snap_id;
   map<object_t,vector<ObjectExtent> > object_extents;
@@ -232,6 +257,11 @@ void ImageReadRequest<I>::send_request() {
     // prevent image size from changing between computing clip and recording
     // pending async operation
     RWLock::RLocker snap_locker(image_ctx.snap_lock);
+    int r = this->clip_request();
+    if (r < 0) {
+      aio_comp->fail(r);
+      return;
+    }
     snap_id = image_ctx.snap_id;
 
     // map image extents to object extents
@@ -247,6 +277,12 @@ void ImageReadRequest<I>::send_request() {
     }
   }
   aio_comp->read_result.set_clip_length(buffer_ofs);
+  aio_comp->io_bytes = buffer_ofs;
+
+  if (image_ctx.object_cacher && image_ctx.readahead_max_bytes > 0 &&
+      !(m_op_flags & LIBRADOS_OP_FLAG_FADVISE_RANDOM)) {
+    readahead(get_image_ctx(&image_ctx), image_extents);
+  }
 
   // pre-calculate the expected number of read requests
   uint32_t request_count = 0;
@@ -320,6 +356,11 @@ void AbstractImageWriteRequest<I>::send_request() {
     // prevent image size from changing between computing clip and recording
     // pending async operation
     RWLock::RLocker snap_locker(image_ctx.snap_lock);
+    int r = this->clip_request();
+    if (r < 0) {
+      aio_comp->fail(r);
+      return;
+    }
     if (image_ctx.snap_id != CEPH_NOSNAP || image_ctx.read_only) {
       aio_comp->fail(-EROFS);
       return;
@@ -342,17 +383,34 @@ void AbstractImageWriteRequest<I>::send_request() {
   }
 
   prune_object_extents(object_extents);
+  aio_comp->io_bytes = clip_len;
 
   if (!object_extents.empty()) {
     uint64_t journal_tid = 0;
+    // rbd-mirror would never see data that reached the image ahead of
+    // a journal event that was then lost
+    bool parallel = (journaling && image_ctx.journal_parallel_writes &&
+                     image_ctx.object_cacher == NULL &&
+                     !image_ctx.journal->is_mirroring());
     aio_comp->set_request_count(
-      object_extents.size() + get_object_cache_request_count(journaling));
+      object_extents.size() + get_object_cache_request_count(journaling) +
+      (parallel ? 1 : 0));
 
     ObjectRequests requests;
     send_object_requests(object_extents, snapc,
                          (journaling ? &requests : nullptr));
 
-    if (journaling) {
+    if (parallel) {
+      // write the data while the event is appended: the request completes
+      // only once the event is safe as well, so every acknowledged write
+      // can still be replayed
+      assert(image_ctx.journal != NULL);
+      journal_tid = append_journal_event(ObjectRequests(), m_synchronous);
+      image_ctx.journal->wait_event(journal_tid, new C_AioRequest(aio_comp));
+      for (auto request : requests) {
+        request->send();
+      }
+    } else if (journaling) {
       // in-flight ops are flushed prior to closing the journal
       assert(image_ctx.journal != NULL);
       journal_tid = append_journal_event(requests, m_synchronous);
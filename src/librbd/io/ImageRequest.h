@@ -6,6 +6,7 @@
 
 #include "include/int_types.h"
 #include "include/buffer_fwd.h"
+#include "include/utime.h"
 #include "common/snap_types.h"
 #include "osd/osd_types.h"
 #include "librbd/io/Types.h"
@@ -15,6 +16,7 @@
 
 namespace librbd {
 class ImageCtx;
+struct BlockGuardCell;
 
 namespace io {
 
@@ -53,6 +55,38 @@ public:
     m_bypass_image_cache = true;
   }
 
+  /// QoS throttles (RBD_QOS_*) the request has been let through
+  bool was_throttled(uint64_t flag) const {
+    return (m_throttled_flag & flag) != 0;
+  }
+  void set_throttled(uint64_t flag) {
+    m_throttled_flag |= flag;
+  }
+  bool were_all_throttled() const {
+    return (m_throttled_flag & RBD_QOS_MASK) == RBD_QOS_MASK;
+  }
+  /// whether the throttle applies to the request, and what it costs
+  bool tokens_requested(uint64_t flag, uint64_t *tokens) const;
+
+  void set_throttle_start(const utime_t &start) {
+    m_throttle_start = start;
+  }
+  const utime_t &get_throttle_start() const {
+    return m_throttle_start;
+  }
+
+  const Extents &get_image_extents() const {
+    return m_image_extents;
+  }
+
+  /// ImageRequestWQ dispatch guard cell held while the request is sent
+  void set_dispatch_cell(BlockGuardCell *cell) {
+    m_dispatch_cell = cell;
+  }
+  BlockGuardCell *get_dispatch_cell() const {
+    return m_dispatch_cell;
+  }
+
 protected:
   typedef std::list<ObjectRequestHandle *> ObjectRequests;
 
@@ -60,6 +94,9 @@ protected:
   AioCompletion *m_aio_comp;
   Extents m_image_extents;
   bool m_bypass_image_cache = false;
+  uint64_t m_throttled_flag = 0;
+  utime_t m_throttle_start;
+  BlockGuardCell *m_dispatch_cell = nullptr;
 
   ImageRequest(ImageCtxT &image_ctx, AioCompletion *aio_comp,
                Extents &&image_extents)
@@ -67,6 +104,7 @@ protected:
       m_image_extents(image_extents) {
   }
 
+  /// requires snap_lock
   virtual int clip_request();
   virtual void send_request() = 0;
   virtual void send_image_cache_request() = 0;
@@ -3,6 +3,8 @@
 
 #include "librbd/io/ImageRequestWQ.h"
 #include "common/errno.h"
+#include "common/Throttle.h"
+#include "librbd/BlockGuard.h"
 #include "librbd/ExclusiveLock.h"
 #include "librbd/ImageCtx.h"
 #include "librbd/ImageState.h"
@@ -11,6 +13,7 @@
 #include "librbd/exclusive_lock/Policy.h"
 #include "librbd/io/AioCompletion.h"
 #include "librbd/io/ImageRequest.h"
+#include <limits>
 
 #define dout_subsys ceph_subsys_rbd
 #undef dout_prefix
@@ -26,12 +29,31 @@ ImageRequestWQ::ImageRequestWQ(ImageCtx *image_ctx, const string &name,
     m_lock(util::unique_lock_name("ImageRequestWQ::m_lock", this)),
     m_write_blockers(0), m_in_progress_writes(0), m_queued_reads(0),
     m_queued_writes(0), m_in_flight_ops(0), m_refresh_in_progress(false),
-    m_shutdown(false), m_on_shutdown(nullptr) {
+    m_shutdown(false), m_on_shutdown(nullptr),
+    m_dispatch_guard(new DispatchGuard(image_ctx->cct)) {
   CephContext *cct = m_image_ctx.cct;
   ldout(cct, 5) << this << " " << ": ictx=" << image_ctx << dendl;
+
+  SafeTimer *timer;
+  Mutex *timer_lock;
+  ImageCtx::get_timer_instance(cct, &timer, &timer_lock);
+  for (auto flag : {RBD_QOS_IOPS_THROTTLE, RBD_QOS_BPS_THROTTLE,
+                    RBD_QOS_READ_IOPS_THROTTLE, RBD_QOS_WRITE_IOPS_THROTTLE,
+                    RBD_QOS_READ_BPS_THROTTLE, RBD_QOS_WRITE_BPS_THROTTLE}) {
+    m_throttles.push_back(std::make_pair(flag, new TokenBucketThrottle(
+      cct, cct->_conf->rbd_qos_schedule_tick_min, timer, timer_lock)));
+  }
+
   tp->add_work_queue(this);
 }
 
+ImageRequestWQ::~ImageRequestWQ() {
+  for (auto &t : m_throttles) {
+    delete t.second;
+  }
+  delete m_dispatch_guard;
+}
+
 ssize_t ImageRequestWQ::read(uint64_t off, uint64_t len,
                              ReadResult &&read_result, int op_flags) {
   CephContext *cct = m_image_ctx.cct;
@@ -146,7 +168,7 @@ void ImageRequestWQ::aio_read(AioCompletion *c, uint64_t off, uint64_t len,
   }
 
   if (m_image_ctx.non_blocking_aio || writes_blocked() || !writes_empty() ||
-      lock_required) {
+      lock_required || m_qos_enabled_flag != 0) {
     queue(new ImageReadRequest<>(m_image_ctx, c, {{off, len}},
                                  std::move(read_result), op_flags));
   } else {
@@ -175,7 +197,8 @@ void ImageRequestWQ::aio_write(AioCompletion *c, uint64_t off, uint64_t len,
   }
 
   RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
-  if (m_image_ctx.non_blocking_aio || writes_blocked()) {
+  if (m_image_ctx.non_blocking_aio || writes_blocked() ||
+      m_qos_enabled_flag != 0) {
     queue(new ImageWriteRequest<>(m_image_ctx, c, {{off, len}},
                                   std::move(bl), op_flags));
   } else {
@@ -204,7 +227,8 @@ void ImageRequestWQ::aio_discard(AioCompletion *c, uint64_t off,
   }
 
   RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
-  if (m_image_ctx.non_blocking_aio || writes_blocked()) {
+  if (m_image_ctx.non_blocking_aio || writes_blocked() ||
+      m_qos_enabled_flag != 0) {
     queue(new ImageDiscardRequest<>(m_image_ctx, c, off, len, skip_partial_discard));
   } else {
     c->start_op();
@@ -255,7 +279,8 @@ void ImageRequestWQ::aio_writesame(AioCompletion *c, uint64_t off, uint64_t len,
   }
 
   RWLock::RLocker owner_locker(m_image_ctx.owner_lock);
-  if (m_image_ctx.non_blocking_aio || writes_blocked()) {
+  if (m_image_ctx.non_blocking_aio || writes_blocked() ||
+      m_qos_enabled_flag != 0) {
     queue(new ImageWriteSameRequest<>(m_image_ctx, c, off, len, std::move(bl),
                                       op_flags));
   } else {
@@ -363,11 +388,23 @@ void ImageRequestWQ::clear_require_lock_on_read() {
 }
 
 void *ImageRequestWQ::_void_dequeue() {
-  ImageRequest<> *peek_item = front();
+  ImageRequest<> *peek_item;
+  while (true) {
+    peek_item = front();
 
-  // no IO ops available or refresh in-progress (IO stalled)
-  if (peek_item == nullptr || m_refresh_in_progress) {
-    return nullptr;
+    // no IO ops available or refresh in-progress (IO stalled)
+    if (peek_item == nullptr || m_refresh_in_progress) {
+      return nullptr;
+    }
+
+    if (!needs_throttle(peek_item)) {
+      break;
+    }
+
+    // the throttles hold on to it until it may go
+    ldout(m_image_ctx.cct, 15) << "throttling IO " << peek_item << dendl;
+    ThreadPool::PointerWQ<ImageRequest<> >::_void_dequeue();
+    _void_process_finish(nullptr);
   }
 
   bool refresh_required = m_image_ctx.state->is_refresh_required();
@@ -377,13 +414,18 @@ void *ImageRequestWQ::_void_dequeue() {
       if (m_write_blockers > 0) {
         return nullptr;
       }
+    } else if (m_require_lock_on_read) {
+      return nullptr;
+    }
 
-      // refresh will requeue the op -- don't count it as in-progress
-      if (!refresh_required) {
+    // refresh will requeue the op -- don't count it as in-progress
+    if (!refresh_required) {
+      if (!start_dispatch(peek_item)) {
+        return nullptr;
+      }
+      if (peek_item->is_write_op()) {
         m_in_progress_writes.inc();
       }
-    } else if (m_require_lock_on_read) {
-      return nullptr;
     }
   }
 
@@ -414,6 +456,7 @@ void ImageRequestWQ::process(ImageRequest<> *req) {
                  << "req=" << req << dendl;
 
   req->send();
+  finish_dispatch(req);
 
   finish_queued_op(req);
   if (req->is_write_op()) {
@@ -524,6 +567,54 @@ void ImageRequestWQ::queue(ImageRequest<> *req) {
   }
 }
 
+bool ImageRequestWQ::start_dispatch(ImageRequest<> *req) {
+  assert(get_pool_lock().is_locked());
+
+  // a flush has to follow everything sent before it
+  BlockExtent block_extent(0, std::numeric_limits<uint64_t>::max());
+  auto &image_extents = req->get_image_extents();
+  if (!image_extents.empty()) {
+    block_extent.block_start = std::numeric_limits<uint64_t>::max();
+    block_extent.block_end = 0;
+    for (auto &extent : image_extents) {
+      block_extent.block_start = std::min(block_extent.block_start,
+                                          extent.first);
+      block_extent.block_end = std::max(block_extent.block_end,
+                                        extent.first + extent.second);
+    }
+    if (block_extent.block_end == block_extent.block_start) {
+      ++block_extent.block_end;
+    }
+  }
+
+  // set before trying so that a racing finish_dispatch() signals us: it
+  // needs the pool lock, which we hold until the stall is visible
+  m_dispatch_stalled = true;
+  BlockGuardCell *cell = nullptr;
+  m_dispatch_guard->detain(block_extent, nullptr, &cell);
+  if (cell == nullptr) {
+    ldout(m_image_ctx.cct, 20) << "delaying overlapping IO " << req << dendl;
+    return false;
+  }
+
+  m_dispatch_stalled = false;
+  req->set_dispatch_cell(cell);
+  return true;
+}
+
+void ImageRequestWQ::finish_dispatch(ImageRequest<> *req) {
+  BlockGuardCell *cell = req->get_dispatch_cell();
+  assert(cell != nullptr);
+
+  DispatchGuard::BlockOperations block_operations;
+  m_dispatch_guard->release(cell, &block_operations);
+  req->set_dispatch_cell(nullptr);
+
+  if (m_dispatch_stalled.exchange(false)) {
+    signal();
+  }
+}
+
 void ImageRequestWQ::handle_refreshed(int r, ImageRequest<> *req) {
   CephContext *cct = m_image_ctx.cct;
   ldout(cct, 15) << "resuming IO after image refresh: r=" << r << ", "
@@ -551,6 +642,78 @@ void ImageRequestWQ::handle_refreshed(int r, ImageRequest<> *req) {
   }
 }
 
+void ImageRequestWQ::apply_qos_limit(uint64_t flag, uint64_t limit,
+                                     uint64_t burst) {
+  CephContext *cct = m_image_ctx.cct;
+  TokenBucketThrottle *throttle = nullptr;
+  for (auto &t : m_throttles) {
+    if (t.first == flag) {
+      throttle = t.second;
+      break;
+    }
+  }
+  assert(throttle != nullptr);
+
+  ldout(cct, 10) << __func__ << ": flag=" << flag << ", limit=" << limit
+                 << ", burst=" << burst << dendl;
+  throttle->set_limit(limit, burst);
+  if (limit != 0) {
+    m_qos_enabled_flag |= flag;
+  } else {
+    m_qos_enabled_flag &= ~flag;
+  }
+}
+
+bool ImageRequestWQ::needs_throttle(ImageRequest<> *req) {
+  assert(get_pool_lock().is_locked());
+  uint64_t enabled = m_qos_enabled_flag;
+  if (enabled == 0) {
+    return false;
+  }
+
+  bool blocked = false;
+  for (auto &t : m_throttles) {
+    uint64_t flag = t.first;
+    if (req->was_throttled(flag)) {
+      continue;
+    }
+
+    uint64_t tokens;
+    if ((enabled & flag) != 0 && req->tokens_requested(flag, &tokens) &&
+        t.second->get<ImageRequestWQ, ImageRequest<>,
+                      &ImageRequestWQ::handle_throttle_ready>(
+          tokens, this, req, flag)) {
+      blocked = true;
+    } else {
+      req->set_throttled(flag);
+    }
+  }
+
+  if (blocked) {
+    req->set_throttle_start(ceph_clock_now());
+    m_image_ctx.perfcounter->inc(l_librbd_qos_throttled);
+  }
+  return blocked;
+}
+
+void ImageRequestWQ::handle_throttle_ready(int r, ImageRequest<> *req,
+                                           uint64_t flag) {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 15) << "req=" << req << ", flag=" << flag << dendl;
+
+  {
+    Mutex::Locker pool_locker(get_pool_lock());
+    req->set_throttled(flag);
+    if (!req->were_all_throttled()) {
+      return;
+    }
+  }
+
+  m_image_ctx.perfcounter->tinc(l_librbd_qos_throttle_latency,
+                                ceph_clock_now() - req->get_throttle_start());
+  ThreadPool::PointerWQ<ImageRequest<> >::queue(req);
+}
+
 void ImageRequestWQ::handle_blocked_writes(int r) {
   Contexts contexts;
   {
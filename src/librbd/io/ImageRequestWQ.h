@@ -8,11 +8,16 @@
 #include "include/atomic.h"
 #include "common/RWLock.h"
 #include "common/WorkQueue.h"
+#include <atomic>
 #include <list>
 
+class TokenBucketThrottle;
+
 namespace librbd {
 
 class ImageCtx;
+template <typename> class BlockGuard;
+struct BlockGuardCell;
 
 namespace io {
 
@@ -24,6 +29,7 @@ class ImageRequestWQ : protected ThreadPool::PointerWQ<ImageRequest<ImageCtx> >
 public:
   ImageRequestWQ(ImageCtx *image_ctx, const string &name, time_t ti,
                  ThreadPool *tp);
+  ~ImageRequestWQ() override;
 
   ssize_t read(uint64_t off, uint64_t len, ReadResult &&read_result,
                int op_flags);
@@ -62,6 +68,9 @@ public:
   void set_require_lock_on_read();
   void clear_require_lock_on_read();
 
+  /// limit one RBD_QOS_* throttle to @p limit per second; 0 lifts it
+  void apply_qos_limit(uint64_t flag, uint64_t limit, uint64_t burst);
+
 protected:
   void *_void_dequeue() override;
   void process(ImageRequest<ImageCtx> *req) override;
@@ -108,6 +117,16 @@ private:
   bool m_shutdown;
   Context *m_on_shutdown;
 
+  std::list<std::pair<uint64_t, TokenBucketThrottle*> > m_throttles;
+  std::atomic<uint64_t> m_qos_enabled_flag = { 0 };
+
+  // with more than one rbd_op_threads, requests are sent concurrently:
+  // the one at the head of the queue is only dequeued once no request it
+  // overlaps is still being sent, so overlapping requests keep their order
+  typedef BlockGuard<ImageRequest<ImageCtx> *> DispatchGuard;
+  DispatchGuard *m_dispatch_guard;
+  std::atomic<bool> m_dispatch_stalled = { false };
+
   inline bool writes_empty() const {
     RWLock::RLocker locker(m_lock);
     return (m_queued_writes.read() == 0);
@@ -121,8 +140,15 @@ private:
 
   void queue(ImageRequest<ImageCtx> *req);
 
+  bool start_dispatch(ImageRequest<ImageCtx> *req);
+  void finish_dispatch(ImageRequest<ImageCtx> *req);
+
   void handle_refreshed(int r, ImageRequest<ImageCtx> *req);
   void handle_blocked_writes(int r);
+
+  bool needs_throttle(ImageRequest<ImageCtx> *req);
+  void handle_throttle_ready(int r, ImageRequest<ImageCtx> *req,
+                             uint64_t flag);
 };
 
 } // namespace io
@@ -95,6 +95,7 @@ ObjectRequest<I>::ObjectRequest(ImageCtx *ictx, const std::string &oid,
 
   Striper::extent_to_file(m_ictx->cct, &m_ictx->layout, m_object_no,
                           0, m_ictx->layout.object_size, m_parent_extents);
+  m_trace.start(m_ictx->cct, trace_sample(m_ictx->cct), "librbd object io");
 
   RWLock::RLocker snap_locker(m_ictx->snap_lock);
   RWLock::RLocker parent_locker(m_ictx->parent_lock);
@@ -290,6 +291,7 @@ void ObjectReadRequest<I>::send() {
     op.read(this->m_object_off, this->m_object_len, &m_read_data, nullptr);
   }
   op.set_op_flags2(m_op_flags);
+  this->set_trace(&op);
 
   librados::AioCompletion *rados_completion =
     util::create_rados_ack_callback(this);
@@ -554,6 +556,7 @@ void AbstractObjectWriteRequest::send_write_op()
 
   add_write_ops(&m_write);
   assert(m_write.size() != 0);
+  set_trace(&m_write);
 
   librados::AioCompletion *rados_completion =
     util::create_rados_safe_callback(this);
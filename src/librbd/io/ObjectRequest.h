@@ -9,6 +9,7 @@
 #include <map>
 
 #include "common/snap_types.h"
+#include "common/Tracer.h"
 #include "include/buffer.h"
 #include "include/rados/librados.hpp"
 #include "librbd/ObjectMap.h"
@@ -111,6 +112,12 @@ protected:
   Context *m_completion;
   Extents m_parent_extents;
   bool m_hide_enoent;
+  TraceSpan m_trace;
+
+  void set_trace(librados::ObjectOperation *op) {
+    trace_context_t t = m_trace.context();
+    op->set_trace(t.trace_id, t.span_id);
+  }
 
 private:
   bool m_has_parent = false;
@@ -22,6 +22,25 @@ typedef enum {
   AIO_TYPE_WRITESAME,
 } aio_type_t;
 
+static const uint64_t RBD_QOS_IOPS_THROTTLE       = 1 << 0;
+static const uint64_t RBD_QOS_BPS_THROTTLE        = 1 << 1;
+static const uint64_t RBD_QOS_READ_IOPS_THROTTLE  = 1 << 2;
+static const uint64_t RBD_QOS_WRITE_IOPS_THROTTLE = 1 << 3;
+static const uint64_t RBD_QOS_READ_BPS_THROTTLE   = 1 << 4;
+static const uint64_t RBD_QOS_WRITE_BPS_THROTTLE  = 1 << 5;
+
+static const uint64_t RBD_QOS_BPS_MASK = (RBD_QOS_BPS_THROTTLE |
+                                          RBD_QOS_READ_BPS_THROTTLE |
+                                          RBD_QOS_WRITE_BPS_THROTTLE);
+static const uint64_t RBD_QOS_READ_MASK = (RBD_QOS_READ_IOPS_THROTTLE |
+                                           RBD_QOS_READ_BPS_THROTTLE);
+static const uint64_t RBD_QOS_WRITE_MASK = (RBD_QOS_WRITE_IOPS_THROTTLE |
+                                            RBD_QOS_WRITE_BPS_THROTTLE);
+static const uint64_t RBD_QOS_MASK = (RBD_QOS_IOPS_THROTTLE |
+                                      RBD_QOS_BPS_THROTTLE |
+                                      RBD_QOS_READ_MASK |
+                                      RBD_QOS_WRITE_MASK);
+
 typedef std::vector<std::pair<uint64_t, uint64_t> > Extents;
 typedef std::map<uint64_t, uint64_t> ExtentMap;
 
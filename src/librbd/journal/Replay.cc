@@ -27,6 +27,32 @@ static const uint64_t IN_FLIGHT_IO_HIGH_WATER_MARK(64);
 
 static NoOpProgressContext no_op_progress_callback;
 
+bool get_aio_modify_extent(const EventEntry &event_entry, uint64_t *offset,
+                           uint64_t *length) {
+  switch (event_entry.get_event_type()) {
+  case EVENT_TYPE_AIO_DISCARD: {
+      auto &event = boost::get<AioDiscardEvent>(event_entry.event);
+      *offset = event.offset;
+      *length = event.length;
+      return true;
+    }
+  case EVENT_TYPE_AIO_WRITE: {
+      auto &event = boost::get<AioWriteEvent>(event_entry.event);
+      *offset = event.offset;
+      *length = event.length;
+      return true;
+    }
+  case EVENT_TYPE_AIO_WRITESAME: {
+      auto &event = boost::get<AioWriteSameEvent>(event_entry.event);
+      *offset = event.offset;
+      *length = event.length;
+      return true;
+    }
+  default:
+    return false;
+  }
+}
+
 template <typename I, typename E>
 struct ExecuteOp : public Context {
   I &image_ctx;
@@ -160,7 +186,9 @@ struct C_RefreshIfRequired : public Context {
 
 template <typename I>
 Replay<I>::Replay(I &image_ctx)
-  : m_image_ctx(image_ctx), m_lock("Replay<I>::m_lock") {
+  : m_image_ctx(image_ctx), m_lock("Replay<I>::m_lock"),
+    m_max_parallel_aio_modify(
+      image_ctx.cct->_conf->rbd_journal_replay_max_parallel_writes) {
 }
 
 template <typename I>
@@ -171,6 +199,8 @@ Replay<I>::~Replay() {
   assert(m_aio_modify_safe_contexts.empty());
   assert(m_op_events.empty());
   assert(m_in_flight_op_events == 0);
+  assert(m_parallel_aio_modify == 0);
+  assert(m_deferred_event == nullptr);
 }
 
 template <typename I>
@@ -192,9 +222,19 @@ void Replay<I>::process(const EventEntry &event_entry,
 
   on_ready = util::create_async_context_callback(m_image_ctx, on_ready);
 
-  RWLock::RLocker owner_lock(m_image_ctx.owner_lock);
-  boost::apply_visitor(EventVisitor(this, on_ready, on_safe),
-                       event_entry.event);
+  {
+    Mutex::Locker locker(m_lock);
+    if (is_event_blocked(event_entry)) {
+      // the replayer waits for on_ready, so at most one event is deferred
+      ldout(cct, 20) << ": waiting for parallel AIO: deferring event" << dendl;
+      assert(m_deferred_event == nullptr && !m_deferred_event_queued);
+      m_deferred_event.reset(new DeferredEvent(event_entry, on_ready,
+                                               on_safe));
+      return;
+    }
+  }
+
+  process_event(event_entry, on_ready, on_safe);
 }
 
 template <typename I>
@@ -209,6 +249,17 @@ void Replay<I>::shut_down(bool cancel_ops, Context *on_finish) {
   {
     Mutex::Locker locker(m_lock);
 
+    if (m_deferred_event != nullptr || m_deferred_event_queued) {
+      // restart once the deferred event has been dispatched
+      ldout(cct, 20) << ": waiting for deferred event" << dendl;
+      assert(m_on_deferred_shut_down == nullptr);
+      m_on_deferred_shut_down = new FunctionContext(
+        [this, cancel_ops, on_finish](int r) {
+          shut_down(cancel_ops, on_finish);
+        });
+      return;
+    }
+
     // safely commit any remaining AIO modify operations
     if ((m_in_flight_aio_flush + m_in_flight_aio_modify) != 0) {
       flush_comp = create_aio_flush_completion(nullptr);
@@ -304,6 +355,60 @@ void Replay<I>::replay_op_ready(uint64_t op_tid, Context *on_resume) {
   }
 }
 
+template <typename I>
+bool Replay<I>::is_event_blocked(const EventEntry &event_entry) const {
+  assert(m_lock.is_locked());
+  if (m_parallel_aio_modify == 0) {
+    return false;
+  }
+
+  uint64_t offset;
+  uint64_t length;
+  if (get_aio_modify_extent(event_entry, &offset, &length)) {
+    // overlapping AIO must be applied in journal order
+    return (length > 0 &&
+            m_parallel_aio_modify_extents.intersects(offset, length));
+  }
+
+  // flushes already wait for all prior AIO, while ops (snapshots,
+  // resizes, etc) expect all prior AIO to have been applied
+  return (event_entry.get_event_type() != EVENT_TYPE_AIO_FLUSH);
+}
+
+template <typename I>
+void Replay<I>::process_event(const EventEntry &event_entry,
+                              Context *on_ready, Context *on_safe) {
+  RWLock::RLocker owner_lock(m_image_ctx.owner_lock);
+  boost::apply_visitor(EventVisitor(this, on_ready, on_safe),
+                       event_entry.event);
+}
+
+template <typename I>
+void Replay<I>::handle_deferred_event() {
+  CephContext *cct = m_image_ctx.cct;
+  ldout(cct, 20) << dendl;
+
+  std::unique_ptr<DeferredEvent> deferred_event;
+  {
+    Mutex::Locker locker(m_lock);
+    assert(m_deferred_event != nullptr && m_deferred_event_queued);
+    std::swap(deferred_event, m_deferred_event);
+  }
+
+  process_event(deferred_event->event_entry, deferred_event->on_ready,
+                deferred_event->on_safe);
+
+  Context *on_shut_down = nullptr;
+  {
+    Mutex::Locker locker(m_lock);
+    m_deferred_event_queued = false;
+    std::swap(on_shut_down, m_on_deferred_shut_down);
+  }
+  if (on_shut_down != nullptr) {
+    on_shut_down->complete(0);
+  }
+}
+
 template <typename I>
 void Replay<I>::handle_event(const journal::AioDiscardEvent &event,
                              Context *on_ready, Context *on_safe) {
@@ -311,8 +416,9 @@ void Replay<I>::handle_event(const journal::AioDiscardEvent &event,
   ldout(cct, 20) << ": AIO discard event" << dendl;
 
   bool flush_required;
-  auto aio_comp = create_aio_modify_completion(on_ready, on_safe,
+  auto aio_comp = create_aio_modify_completion(&on_ready, on_safe,
                                                io::AIO_TYPE_DISCARD,
+                                               event.offset, event.length,
                                                &flush_required);
   io::ImageRequest<I>::aio_discard(&m_image_ctx, aio_comp, event.offset,
                                    event.length, event.skip_partial_discard);
@@ -323,6 +429,11 @@ void Replay<I>::handle_event(const journal::AioDiscardEvent &event,
 
     io::ImageRequest<I>::aio_flush(&m_image_ctx, flush_comp);
   }
+
+  if (on_ready != nullptr) {
+    // replayed in parallel -- ready without waiting for the ACK
+    on_ready->complete(0);
+  }
 }
 
 template <typename I>
@@ -333,8 +444,9 @@ void Replay<I>::handle_event(const journal::AioWriteEvent &event,
 
   bufferlist data = event.data;
   bool flush_required;
-  auto aio_comp = create_aio_modify_completion(on_ready, on_safe,
+  auto aio_comp = create_aio_modify_completion(&on_ready, on_safe,
                                                io::AIO_TYPE_WRITE,
+                                               event.offset, event.length,
                                                &flush_required);
   io::ImageRequest<I>::aio_write(&m_image_ctx, aio_comp,
                                  {{event.offset, event.length}},
@@ -346,6 +458,11 @@ void Replay<I>::handle_event(const journal::AioWriteEvent &event,
 
     io::ImageRequest<I>::aio_flush(&m_image_ctx, flush_comp);
   }
+
+  if (on_ready != nullptr) {
+    // replayed in parallel -- ready without waiting for the ACK
+    on_ready->complete(0);
+  }
 }
 
 template <typename I>
@@ -372,8 +489,9 @@ void Replay<I>::handle_event(const journal::AioWriteSameEvent &event,
 
   bufferlist data = event.data;
   bool flush_required;
-  auto aio_comp = create_aio_modify_completion(on_ready, on_safe,
+  auto aio_comp = create_aio_modify_completion(&on_ready, on_safe,
                                                io::AIO_TYPE_WRITESAME,
+                                               event.offset, event.length,
                                                &flush_required);
   io::ImageRequest<I>::aio_writesame(&m_image_ctx, aio_comp, event.offset,
                                      event.length, std::move(data), 0);
@@ -384,6 +502,11 @@ void Replay<I>::handle_event(const journal::AioWriteSameEvent &event,
 
     io::ImageRequest<I>::aio_flush(&m_image_ctx, flush_comp);
   }
+
+  if (on_ready != nullptr) {
+    // replayed in parallel -- ready without waiting for the ACK
+    on_ready->complete(0);
+  }
 }
 
 template <typename I>
@@ -777,12 +900,28 @@ void Replay<I>::handle_event(const journal::UnknownEvent &event,
 
 template <typename I>
 void Replay<I>::handle_aio_modify_complete(Context *on_ready, Context *on_safe,
-                                           int r) {
+                                           bool parallel, uint64_t offset,
+                                           uint64_t length, int r) {
   Mutex::Locker locker(m_lock);
   CephContext *cct = m_image_ctx.cct;
   ldout(cct, 20) << ": on_ready=" << on_ready << ", "
                  << "on_safe=" << on_safe << ", r=" << r << dendl;
 
+  if (parallel) {
+    assert(m_parallel_aio_modify > 0);
+    --m_parallel_aio_modify;
+    m_parallel_aio_modify_extents.erase(offset, length);
+
+    if (m_deferred_event != nullptr && !m_deferred_event_queued &&
+        !is_event_blocked(m_deferred_event->event_entry)) {
+      ldout(cct, 20) << ": resuming deferred event" << dendl;
+      m_deferred_event_queued = true;
+      m_image_ctx.op_work_queue->queue(new FunctionContext([this](int r) {
+          handle_deferred_event();
+        }), 0);
+    }
+  }
+
   if (on_ready != nullptr) {
     on_ready->complete(0);
   }
@@ -946,8 +1085,9 @@ void Replay<I>::handle_op_complete(uint64_t op_tid, int r) {
 
 template <typename I>
 io::AioCompletion *
-Replay<I>::create_aio_modify_completion(Context *on_ready, Context *on_safe,
+Replay<I>::create_aio_modify_completion(Context **on_ready, Context *on_safe,
                                         io::aio_type_t aio_type,
+                                        uint64_t offset, uint64_t length,
                                         bool *flush_required) {
   Mutex::Locker locker(m_lock);
   CephContext *cct = m_image_ctx.cct;
@@ -972,18 +1112,31 @@ Replay<I>::create_aio_modify_completion(Context *on_ready, Context *on_safe,
   // * in-flight ops are at a consistent point (snap create has IO flushed,
   //   shrink has adjusted clip boundary, etc) -- should have already been
   //   flagged not-ready
+  bool parallel = false;
   if (m_in_flight_aio_modify == IN_FLIGHT_IO_HIGH_WATER_MARK) {
     ldout(cct, 10) << ": hit AIO replay high-water mark: pausing replay"
                    << dendl;
     assert(m_on_aio_ready == nullptr);
-    std::swap(m_on_aio_ready, on_ready);
+    std::swap(m_on_aio_ready, *on_ready);
+  } else if (length > 0 &&
+             m_parallel_aio_modify < m_max_parallel_aio_modify) {
+    // doesn't overlap other parallel AIO (see is_event_blocked), so the
+    // next event can be processed as soon as this one is dispatched
+    parallel = true;
+    ++m_parallel_aio_modify;
+    m_parallel_aio_modify_extents.insert(offset, length);
   }
 
   // when the modification is ACKed by librbd, we can process the next
   // event. when flushed, the completion of the next flush will fire the
   // on_safe callback
+  Context *on_ack_ready = nullptr;
+  if (!parallel) {
+    std::swap(on_ack_ready, *on_ready);
+  }
   auto aio_comp = io::AioCompletion::create_and_start<Context>(
-    new C_AioModifyComplete(this, on_ready, on_safe),
+    new C_AioModifyComplete(this, on_ack_ready, on_safe, parallel, offset,
+                            length),
     util::get_image_ctx(&m_image_ctx), aio_type);
   return aio_comp;
 }
@@ -7,11 +7,13 @@
 #include "include/int_types.h"
 #include "include/buffer_fwd.h"
 #include "include/Context.h"
+#include "include/interval_set.h"
 #include "common/Mutex.h"
 #include "librbd/io/Types.h"
 #include "librbd/journal/Types.h"
 #include <boost/variant.hpp>
 #include <list>
+#include <memory>
 #include <unordered_set>
 #include <unordered_map>
 
@@ -62,6 +64,18 @@ private:
   typedef std::unordered_set<Context *> ContextSet;
   typedef std::unordered_map<uint64_t, OpEvent> OpEvents;
 
+  /// event waiting for overlapping (or, for an op, all) parallel AIO
+  struct DeferredEvent {
+    EventEntry event_entry;
+    Context *on_ready;
+    Context *on_safe;
+
+    DeferredEvent(const EventEntry &event_entry, Context *on_ready,
+                  Context *on_safe)
+      : event_entry(event_entry), on_ready(on_ready), on_safe(on_safe) {
+    }
+  };
+
   struct C_OpOnComplete : public Context {
     Replay *replay;
     uint64_t op_tid;
@@ -77,11 +91,17 @@ private:
     Replay *replay;
     Context *on_ready;
     Context *on_safe;
-    C_AioModifyComplete(Replay *replay, Context *on_ready, Context *on_safe)
-      : replay(replay), on_ready(on_ready), on_safe(on_safe) {
+    bool parallel;
+    uint64_t offset;
+    uint64_t length;
+    C_AioModifyComplete(Replay *replay, Context *on_ready, Context *on_safe,
+                        bool parallel, uint64_t offset, uint64_t length)
+      : replay(replay), on_ready(on_ready), on_safe(on_safe),
+        parallel(parallel), offset(offset), length(length) {
     }
     void finish(int r) override {
-      replay->handle_aio_modify_complete(on_ready, on_safe, r);
+      replay->handle_aio_modify_complete(on_ready, on_safe, parallel, offset,
+                                         length, r);
     }
   };
 
@@ -129,6 +149,20 @@ private:
   Context *m_flush_ctx = nullptr;
   Context *m_on_aio_ready = nullptr;
 
+  // AIO modify events readied before they are ACKed
+  uint64_t m_max_parallel_aio_modify;
+  uint64_t m_parallel_aio_modify = 0;
+  interval_set<uint64_t> m_parallel_aio_modify_extents;
+
+  std::unique_ptr<DeferredEvent> m_deferred_event;
+  bool m_deferred_event_queued = false;
+  Context *m_on_deferred_shut_down = nullptr;
+
+  bool is_event_blocked(const EventEntry &event_entry) const;
+  void process_event(const EventEntry &event_entry, Context *on_ready,
+                     Context *on_safe);
+  void handle_deferred_event();
+
   void handle_event(const AioDiscardEvent &event, Context *on_ready,
                     Context *on_safe);
   void handle_event(const AioWriteEvent &event, Context *on_ready,
@@ -170,7 +204,9 @@ private:
   void handle_event(const UnknownEvent &event, Context *on_ready,
                     Context *on_safe);
 
-  void handle_aio_modify_complete(Context *on_ready, Context *on_safe, int r);
+  void handle_aio_modify_complete(Context *on_ready, Context *on_safe,
+                                  bool parallel, uint64_t offset,
+                                  uint64_t length, int r);
   void handle_aio_flush_complete(Context *on_flush_safe, Contexts &on_safe_ctxs,
                                  int r);
 
@@ -178,9 +214,11 @@ private:
                                       Context *on_safe, OpEvent **op_event);
   void handle_op_complete(uint64_t op_tid, int r);
 
-  io::AioCompletion *create_aio_modify_completion(Context *on_ready,
+  io::AioCompletion *create_aio_modify_completion(Context **on_ready,
                                                   Context *on_safe,
                                                   io::aio_type_t aio_type,
+                                                  uint64_t offset,
+                                                  uint64_t length,
                                                   bool *flush_required);
   io::AioCompletion *create_aio_flush_completion(Context *on_safe);
   void handle_aio_completion(io::AioCompletion *aio_comp);
@@ -542,6 +542,42 @@ namespace librbd {
     return r;
   }
 
+  int RBD::group_snap_create(IoCtx& group_ioctx, const char *group_name,
+                             const char *snap_name)
+  {
+    TracepointProvider::initialize<tracepoint_traits>(get_cct(group_ioctx));
+    tracepoint(librbd, group_snap_create_enter,
+               group_ioctx.get_pool_name().c_str(), group_ioctx.get_id(),
+               group_name, snap_name);
+    int r = librbd::group_snap_create(group_ioctx, group_name, snap_name);
+    tracepoint(librbd, group_snap_create_exit, r);
+    return r;
+  }
+
+  int RBD::group_snap_remove(IoCtx& group_ioctx, const char *group_name,
+                             const char *snap_name)
+  {
+    TracepointProvider::initialize<tracepoint_traits>(get_cct(group_ioctx));
+    tracepoint(librbd, group_snap_remove_enter,
+               group_ioctx.get_pool_name().c_str(), group_ioctx.get_id(),
+               group_name, snap_name);
+    int r = librbd::group_snap_remove(group_ioctx, group_name, snap_name);
+    tracepoint(librbd, group_snap_remove_exit, r);
+    return r;
+  }
+
+  int RBD::group_snap_list(IoCtx& group_ioctx, const char *group_name,
+                           std::vector<group_snap_spec_t> *snaps)
+  {
+    TracepointProvider::initialize<tracepoint_traits>(get_cct(group_ioctx));
+    tracepoint(librbd, group_snap_list_enter,
+               group_ioctx.get_pool_name().c_str(), group_ioctx.get_id(),
+               group_name);
+    int r = librbd::group_snap_list(group_ioctx, group_name, snaps);
+    tracepoint(librbd, group_snap_list_exit, r);
+    return r;
+  }
+
 
   RBD::AioCompletion::AioCompletion(void *cb_arg, callback_t complete_cb)
   {
@@ -966,6 +1002,28 @@ namespace librbd {
     return r;
   }
 
+  int Image::deep_copy(IoCtx& dest_io_ctx, const char *destname,
+		       ImageOptions& opts)
+  {
+    ImageCtx *ictx = (ImageCtx *)ctx;
+    tracepoint(librbd, deep_copy_enter, ictx, ictx->name.c_str(), ictx->snap_name.c_str(), ictx->read_only, dest_io_ctx.get_pool_name().c_str(), dest_io_ctx.get_id(), destname, opts.opts);
+    librbd::NoOpProgressContext prog_ctx;
+    int r = librbd::deep_copy(ictx, dest_io_ctx, destname, opts, prog_ctx);
+    tracepoint(librbd, deep_copy_exit, r);
+    return r;
+  }
+
+  int Image::deep_copy_with_progress(IoCtx& dest_io_ctx, const char *destname,
+				     ImageOptions& opts,
+				     librbd::ProgressContext &pctx)
+  {
+    ImageCtx *ictx = (ImageCtx *)ctx;
+    tracepoint(librbd, deep_copy_enter, ictx, ictx->name.c_str(), ictx->snap_name.c_str(), ictx->read_only, dest_io_ctx.get_pool_name().c_str(), dest_io_ctx.get_id(), destname, opts.opts);
+    int r = librbd::deep_copy(ictx, dest_io_ctx, destname, opts, pctx);
+    tracepoint(librbd, deep_copy_exit, r);
+    return r;
+  }
+
   int Image::flatten()
   {
     ImageCtx *ictx = (ImageCtx *)ctx;
@@ -2072,6 +2130,37 @@ extern "C" int rbd_copy_with_progress3(rbd_image_t image, rados_ioctx_t dest_p,
   return ret;
 }
 
+extern "C" int rbd_deep_copy(rbd_image_t image, rados_ioctx_t dest_p,
+			     const char *destname, rbd_image_options_t c_opts)
+{
+  librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
+  librados::IoCtx dest_io_ctx;
+  librados::IoCtx::from_rados_ioctx_t(dest_p, dest_io_ctx);
+  tracepoint(librbd, deep_copy_enter, ictx, ictx->name.c_str(), ictx->snap_name.c_str(), ictx->read_only, dest_io_ctx.get_pool_name().c_str(), dest_io_ctx.get_id(), destname, c_opts);
+  librbd::ImageOptions opts(c_opts);
+  librbd::NoOpProgressContext prog_ctx;
+  int r = librbd::deep_copy(ictx, dest_io_ctx, destname, opts, prog_ctx);
+  tracepoint(librbd, deep_copy_exit, r);
+  return r;
+}
+
+extern "C" int rbd_deep_copy_with_progress(rbd_image_t image,
+					   rados_ioctx_t dest_p,
+					   const char *destname,
+					   rbd_image_options_t dest_opts,
+					   librbd_progress_fn_t fn, void *data)
+{
+  librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
+  librados::IoCtx dest_io_ctx;
+  librados::IoCtx::from_rados_ioctx_t(dest_p, dest_io_ctx);
+  tracepoint(librbd, deep_copy_enter, ictx, ictx->name.c_str(), ictx->snap_name.c_str(), ictx->read_only, dest_io_ctx.get_pool_name().c_str(), dest_io_ctx.get_id(), destname, dest_opts);
+  librbd::ImageOptions opts(dest_opts);
+  librbd::CProgressContext prog_ctx(fn, data);
+  int ret = librbd::deep_copy(ictx, dest_io_ctx, destname, opts, prog_ctx);
+  tracepoint(librbd, deep_copy_exit, ret);
+  return ret;
+}
+
 extern "C" int rbd_flatten(rbd_image_t image)
 {
   librbd::ImageCtx *ictx = (librbd::ImageCtx *)image;
@@ -3580,3 +3669,78 @@ extern "C" void rbd_group_image_status_list_cleanup(
     rbd_group_image_status_cleanup(&images[i]);
   }
 }
+
+extern "C" int rbd_group_snap_create(rados_ioctx_t group_p,
+				     const char *group_name,
+				     const char *snap_name)
+{
+  librados::IoCtx group_ioctx;
+  librados::IoCtx::from_rados_ioctx_t(group_p, group_ioctx);
+
+  TracepointProvider::initialize<tracepoint_traits>(get_cct(group_ioctx));
+  tracepoint(librbd, group_snap_create_enter,
+             group_ioctx.get_pool_name().c_str(), group_ioctx.get_id(),
+             group_name, snap_name);
+  int r = librbd::group_snap_create(group_ioctx, group_name, snap_name);
+  tracepoint(librbd, group_snap_create_exit, r);
+  return r;
+}
+
+extern "C" int rbd_group_snap_remove(rados_ioctx_t group_p,
+				     const char *group_name,
+				     const char *snap_name)
+{
+  librados::IoCtx group_ioctx;
+  librados::IoCtx::from_rados_ioctx_t(group_p, group_ioctx);
+
+  TracepointProvider::initialize<tracepoint_traits>(get_cct(group_ioctx));
+  tracepoint(librbd, group_snap_remove_enter,
+             group_ioctx.get_pool_name().c_str(), group_ioctx.get_id(),
+             group_name, snap_name);
+  int r = librbd::group_snap_remove(group_ioctx, group_name, snap_name);
+  tracepoint(librbd, group_snap_remove_exit, r);
+  return r;
+}
+
+extern "C" int rbd_group_snap_list(rados_ioctx_t group_p,
+				   const char *group_name,
+				   rbd_group_snap_spec_t *snaps,
+				   size_t *snaps_size)
+{
+  librados::IoCtx group_ioctx;
+  librados::IoCtx::from_rados_ioctx_t(group_p, group_ioctx);
+
+  TracepointProvider::initialize<tracepoint_traits>(get_cct(group_ioctx));
+  tracepoint(librbd, group_snap_list_enter,
+             group_ioctx.get_pool_name().c_str(), group_ioctx.get_id(),
+             group_name);
+
+  std::vector<librbd::group_snap_spec_t> cpp_snaps;
+  int r = librbd::group_snap_list(group_ioctx, group_name, &cpp_snaps);
+  if (r < 0) {
+    tracepoint(librbd, group_snap_list_exit, r);
+    return r;
+  }
+
+  if (*snaps_size < cpp_snaps.size()) {
+    *snaps_size = cpp_snaps.size();
+    tracepoint(librbd, group_snap_list_exit, -ERANGE);
+    return -ERANGE;
+  }
+
+  for (size_t i = 0; i < cpp_snaps.size(); ++i) {
+    snaps[i].name = strdup(cpp_snaps[i].name.c_str());
+    snaps[i].state = cpp_snaps[i].state;
+  }
+  *snaps_size = cpp_snaps.size();
+
+  tracepoint(librbd, group_snap_list_exit, 0);
+  return 0;
+}
+
+extern "C" void rbd_group_snap_list_cleanup(rbd_group_snap_spec_t *snaps,
+					    size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    free(snaps[i].name);
+  }
+}
@@ -5,6 +5,7 @@
 #include "librbd/AsyncObjectThrottle.h"
 #include "librbd/ExclusiveLock.h"
 #include "librbd/ImageCtx.h"
+#include "librbd/ObjectMap.h"
 #include "librbd/io/ObjectRequest.h"
 #include "common/dout.h"
 #include "common/errno.h"
@@ -39,6 +40,22 @@ public:
       return -ERESTART;
     }
 
+    {
+      // an object already written in the clone holds all of its data
+      RWLock::RLocker snap_locker(image_ctx.snap_lock);
+      if (image_ctx.object_map != nullptr &&
+          !image_ctx.test_flags(RBD_FLAG_OBJECT_MAP_INVALID,
+                                image_ctx.snap_lock)) {
+        RWLock::RLocker object_map_locker(image_ctx.object_map_lock);
+        if (m_object_no < image_ctx.object_map->size()) {
+          uint8_t state = (*image_ctx.object_map)[m_object_no];
+          if (state == OBJECT_EXISTS || state == OBJECT_EXISTS_CLEAN) {
+            return 1;
+          }
+        }
+      }
+    }
+
     bufferlist bl;
     string oid = image_ctx.get_object_name(m_object_no);
     auto req = new io::ObjectWriteRequest(&image_ctx, oid, m_object_no, 0,
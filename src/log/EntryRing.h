@@ -0,0 +1,70 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef __CEPH_LOG_ENTRYRING_H
+#define __CEPH_LOG_ENTRYRING_H
+
+#include <atomic>
+
+#include "Entry.h"
+
+namespace ceph {
+namespace logging {
+
+/**
+ * Bounded single-producer, single-consumer ring of entries.
+ *
+ * The producer is the one thread the ring belongs to; the consumer is
+ * whoever holds the Log's flush mutex.  Neither side takes a lock.
+ */
+struct EntryRing {
+  static const size_t SIZE = 1024;  ///< power of two
+
+  std::atomic<size_t> m_head;  ///< next slot to consume
+  char m_pad0[64 - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> m_tail;  ///< next slot to fill
+  char m_pad1[64 - sizeof(std::atomic<size_t>)];
+  std::atomic<bool> m_dead;    ///< the producer thread has exited
+  Entry *m_entries[SIZE];
+
+  /// producer: false if the ring is full
+  bool push(Entry *e) {
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == SIZE)
+      return false;
+    m_entries[tail & (SIZE - 1)] = e;
+    // seq_cst, so that it is ordered against the producer's subsequent
+    // check of whether the flusher is asleep
+    m_tail.store(tail + 1, std::memory_order_seq_cst);
+    return true;
+  }
+
+  /// consumer: NULL if the ring is empty
+  Entry *pop() {
+    size_t head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire))
+      return NULL;
+    Entry *e = m_entries[head & (SIZE - 1)];
+    m_head.store(head + 1, std::memory_order_release);
+    return e;
+  }
+
+  bool empty() const {
+    return m_head.load(std::memory_order_seq_cst) ==
+      m_tail.load(std::memory_order_seq_cst);
+  }
+
+  EntryRing()
+    : m_head(0), m_tail(0), m_dead(false)
+  {}
+  ~EntryRing() {
+    Entry *e;
+    while ((e = pop()) != NULL)
+      delete e;
+  }
+};
+
+}
+}
+
+#endif
@@ -6,6 +6,8 @@
 #include <errno.h>
 #include <syslog.h>
 
+#include <algorithm>
+
 #include "common/errno.h"
 #include "common/safe_io.h"
 #include "common/Clock.h"
@@ -30,6 +32,28 @@ namespace logging {
 
 static OnExitManager exit_callbacks;
 
+static std::atomic<uint64_t> next_log_id(1);
+
+namespace {
+/// the calling thread's ring, and the Log it feeds
+struct ThreadRing {
+  uint64_t log_id = 0;
+  EntryRing *ring = nullptr;
+  std::weak_ptr<EntryRing> ref;
+  bool exited = false;  ///< logging from later thread_local destructors
+
+  ~ThreadRing() {
+    auto r = ref.lock();
+    if (r)
+      r->m_dead = true;
+    log_id = 0;
+    ring = nullptr;
+    exited = true;
+  }
+};
+thread_local ThreadRing thread_ring;
+}
+
 static void log_on_exit(void *p)
 {
   Log *l = *(Log **)p;
@@ -44,6 +68,8 @@ Log::Log(SubsystemMap *s)
     m_queue_mutex_holder(0),
     m_flush_mutex_holder(0),
     m_new(), m_recent(),
+    m_id(next_log_id++),
+    m_flusher_waiting(false),
     m_fd(-1),
     m_uid(0),
     m_gid(0),
@@ -203,14 +229,79 @@ void Log::stop_graylog()
   pthread_mutex_unlock(&m_flush_mutex);
 }
 
-void Log::submit_entry(Entry *e)
+EntryRing *Log::_get_thread_ring()
 {
+  if (thread_ring.log_id == m_id)
+    return thread_ring.ring;
+  if (thread_ring.exited || !thread_ring.ref.expired())
+    return NULL;  // this thread feeds another log; use the queue for this one
+
+  auto r = std::make_shared<EntryRing>();
   pthread_mutex_lock(&m_queue_mutex);
-  m_queue_mutex_holder = pthread_self();
+  m_rings.push_back(r);
+  pthread_mutex_unlock(&m_queue_mutex);
+  thread_ring.log_id = m_id;
+  thread_ring.ring = r.get();
+  thread_ring.ref = r;
+  return r.get();
+}
 
+bool Log::_rings_empty()
+{
+  for (auto& r : m_rings) {
+    if (!r->empty())
+      return false;
+  }
+  return true;
+}
+
+void Log::_drain_rings(EntryQueue *q)
+{
+  // caller holds m_flush_mutex and m_queue_mutex
+  vector<Entry*> v;
+  for (auto p = m_rings.begin(); p != m_rings.end(); ) {
+    bool dead = (*p)->m_dead;
+    Entry *e;
+    while ((e = (*p)->pop()) != NULL)
+      v.push_back(e);
+    if (dead)
+      p = m_rings.erase(p);
+    else
+      ++p;
+  }
+  if (v.empty())
+    return;
+
+  // interleave with entries that took the locked path
+  Entry *e;
+  while ((e = q->dequeue()) != NULL)
+    v.push_back(e);
+  std::stable_sort(v.begin(), v.end(),
+		   [](const Entry *a, const Entry *b) {
+		     return a->m_stamp < b->m_stamp;
+		   });
+  for (auto i : v)
+    q->enqueue(i);
+}
+
+void Log::submit_entry(Entry *e)
+{
   if (m_inject_segv)
     *(volatile int *)(0) = 0xdead;
 
+  EntryRing *r = _get_thread_ring();
+  if (r && r->push(e)) {
+    if (m_flusher_waiting) {
+      pthread_mutex_lock(&m_queue_mutex);
+      pthread_cond_signal(&m_cond_flusher);
+      pthread_mutex_unlock(&m_queue_mutex);
+    }
+    return;
+  }
+
+  pthread_mutex_lock(&m_queue_mutex);
+  m_queue_mutex_holder = pthread_self();
+
   // wait for flush to catch up
   while (m_new.m_len > m_max_new)
     pthread_cond_wait(&m_cond_loggers, &m_queue_mutex);
@@ -268,6 +359,7 @@ void Log::flush()
   m_queue_mutex_holder = pthread_self();
   EntryQueue t;
   t.swap(m_new);
+  _drain_rings(&t);
   pthread_cond_broadcast(&m_cond_loggers);
   m_queue_mutex_holder = 0;
   pthread_mutex_unlock(&m_queue_mutex);
@@ -382,6 +474,7 @@ void Log::dump_recent()
 
   EntryQueue t;
   t.swap(m_new);
+  _drain_rings(&t);
 
   m_queue_mutex_holder = 0;
   pthread_mutex_unlock(&m_queue_mutex);
@@ -442,7 +535,7 @@ void *Log::entry()
   pthread_mutex_lock(&m_queue_mutex);
   m_queue_mutex_holder = pthread_self();
   while (!m_stop) {
-    if (!m_new.empty()) {
+    if (!m_new.empty() || !_rings_empty()) {
       m_queue_mutex_holder = 0;
       pthread_mutex_unlock(&m_queue_mutex);
       flush();
@@ -451,7 +544,12 @@ void *Log::entry()
       continue;
     }
 
-    pthread_cond_wait(&m_cond_flusher, &m_queue_mutex);
+    // submitters only wake us while this is set; recheck the rings
+    // after setting it so that a push racing with it is not missed
+    m_flusher_waiting = true;
+    if (_rings_empty())
+      pthread_cond_wait(&m_cond_flusher, &m_queue_mutex);
+    m_flusher_waiting = false;
   }
   m_queue_mutex_holder = 0;
   pthread_mutex_unlock(&m_queue_mutex);
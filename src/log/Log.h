@@ -4,9 +4,14 @@
 #ifndef __CEPH_LOG_LOG_H
 #define __CEPH_LOG_LOG_H
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
 #include "common/Thread.h"
 
 #include "EntryQueue.h"
+#include "EntryRing.h"
 
 namespace ceph {
 namespace logging {
@@ -32,6 +37,13 @@ class Log : private Thread
   EntryQueue m_new;    ///< new entries
   EntryQueue m_recent; ///< recent (less new) entries we've already written at low detail
 
+  /// per-thread rings of new entries; submitters fall back to m_new
+  /// when theirs is full.  The list is protected by m_queue_mutex, the
+  /// ring contents by m_flush_mutex on the consumer side.
+  std::vector<std::shared_ptr<EntryRing>> m_rings;
+  const uint64_t m_id;  ///< tells this Log's rings from a previous one's
+  std::atomic<bool> m_flusher_waiting;
+
   std::string m_log_file;
   int m_fd;
   uid_t m_uid;
@@ -53,6 +65,9 @@ class Log : private Thread
 
   void *entry();
 
+  EntryRing *_get_thread_ring();
+  bool _rings_empty();
+  void _drain_rings(EntryQueue *q);
   void _flush(EntryQueue *q, EntryQueue *requeue, bool crash);
 
   void _log_message(const char *s, bool crash);
@@ -1,5 +1,9 @@
 #include <gtest/gtest.h>
 
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+
 #include "log/Log.h"
 #include "common/Clock.h"
 #include "common/PrebufferedStreambuf.h"
@@ -190,6 +194,44 @@ TEST(Log, ManyGather)
   log.stop();
 }
 
+TEST(Log, ManyThreads)
+{
+  SubsystemMap subs;
+  subs.add(1, "foo", 20, 10);
+  Log log(&subs);
+  log.start();
+  const char *fn = "/tmp/log_many_threads";
+  ::unlink(fn);
+  log.set_log_file(fn);
+  log.reopen_log_file();
+
+  // more entries per thread than fit in its ring, so that some take the
+  // locked path as well
+  const int threads = 8;
+  const int per_thread = EntryRing::SIZE * 3;
+  std::vector<std::thread> ts;
+  for (int t = 0; t < threads; t++) {
+    ts.emplace_back([&log, per_thread] {
+	for (int i = 0; i < per_thread; i++) {
+	  log.submit_entry(new Entry(ceph_clock_now(), pthread_self(), 10, 1,
+				     "hello from a thread"));
+	}
+      });
+  }
+  for (auto& t : ts)
+    t.join();
+  log.flush();
+  log.stop();
+
+  std::ifstream in(fn);
+  std::string line;
+  int lines = 0;
+  while (std::getline(in, line))
+    lines++;
+  ASSERT_EQ(threads * per_thread, lines);
+  ::unlink(fn);
+}
+
 void do_segv()
 {
   SubsystemMap subs;
@@ -483,11 +483,15 @@ void Beacon::notify_health(MDSRank const *mds)
   }
 
   // Report if we have significantly exceeded our cache size limit
-  if (mds->mdcache->get_num_inodes() >
-        g_conf->mds_cache_size * g_conf->mds_health_cache_threshold) {
+  if (mds->mdcache->cache_overfull()) {
     std::ostringstream oss;
-    oss << "Too many inodes in cache (" << mds->mdcache->get_num_inodes()
-        << "/" << g_conf->mds_cache_size << "), "
+    oss << "MDS cache is too large (" << prettybyte_t(mds->mdcache->cache_size())
+        << "/" << prettybyte_t(MDCache::cache_limit_memory()) << ", "
+        << mds->mdcache->get_num_inodes() << " inodes";
+    if (MDCache::cache_limit_inodes()) {
+      oss << "/" << MDCache::cache_limit_inodes();
+    }
+    oss << "), "
         << mds->mdcache->num_inodes_with_caps << " inodes in use by clients, "
         << mds->mdcache->get_num_strays() << " stray files";
 
@@ -74,7 +74,7 @@ public:
 // PINS
 //int cdir_pins[CDIR_NUM_PINS] = { 0,0,0,0,0,0,0,0,0,0,0,0,0,0 };
 
-boost::pool<> CDir::pool(sizeof(CDir));
+MEMPOOL_DEFINE_OBJECT_FACTORY(CDir, co_dir, mds_co);
 
 
 ostream& operator<<(ostream& out, const CDir& dir)
@@ -1490,22 +1490,79 @@ public:
   bufferlist hdrbl;
   map<string, bufferlist> omap;
   bufferlist btbl;
+  bool more;
   int ret1, ret2, ret3;
 
   C_IO_Dir_OMAP_Fetched(CDir *d, MDSInternalContextBase *f) :
-    CDirIOContext(d), fin(f), ret1(0), ret2(0), ret3(0) { }
+    CDirIOContext(d), fin(f), more(false), ret1(0), ret2(0), ret3(0) { }
   void finish(int r) override {
     // check the correctness of backtrace
     if (r >= 0 && ret3 != -ECANCELED)
       dir->inode->verify_diri_backtrace(btbl, ret3);
     if (r >= 0) r = ret1;
     if (r >= 0) r = ret2;
+    if (r >= 0 && more) {
+      dir->_omap_fetch_more(hdrbl, omap, fin);
+      return;
+    }
     dir->_omap_fetched(hdrbl, omap, !fin, r);
     if (fin)
       fin->complete(r);
   }
 };
 
+/*
+ * A big dirfrag is read in ops of mds_dir_keys_per_op keys each, so that
+ * no single op holds the OSD (or hits its per-op omap limit) for the
+ * whole object.  They are read one after another, each continuing after
+ * the last key of the previous one.
+ */
+class C_IO_Dir_OMAP_FetchedMore : public CDirIOContext {
+  MDSInternalContextBase *fin;
+public:
+  bufferlist hdrbl;
+  bool more;
+  map<string, bufferlist> omap;      ///< read so far
+  map<string, bufferlist> omap_more; ///< read by this op
+  int ret;
+
+  C_IO_Dir_OMAP_FetchedMore(CDir *d, MDSInternalContextBase *f) :
+    CDirIOContext(d), fin(f), more(false), ret(0) { }
+  void finish(int r) override {
+    if (r >= 0) r = ret;
+    if (r >= 0) {
+      omap.insert(omap_more.begin(), omap_more.end());
+      if (more) {
+	dir->_omap_fetch_more(hdrbl, omap, fin);
+	return;
+      }
+    }
+    dir->_omap_fetched(hdrbl, omap, !fin, r);
+    if (fin)
+      fin->complete(r);
+  }
+};
+
+void CDir::_omap_fetch_more(bufferlist& hdrbl, map<string, bufferlist>& omap,
+			    MDSInternalContextBase *c)
+{
+  assert(!omap.empty());
+  dout(10) << "_omap_fetch_more after " << omap.size() << " keys on "
+	   << *this << dendl;
+
+  C_IO_Dir_OMAP_FetchedMore *fin = new C_IO_Dir_OMAP_FetchedMore(this, c);
+  fin->hdrbl.claim(hdrbl);
+  fin->omap.swap(omap);
+
+  object_t oid = get_ondisk_object();
+  object_locator_t oloc(cache->mds->mdsmap->get_metadata_pool());
+  ObjectOperation rd;
+  rd.omap_get_vals(fin->omap.rbegin()->first, "", g_conf->mds_dir_keys_per_op,
+		   &fin->omap_more, &fin->more, &fin->ret);
+  cache->mds->objecter->read(oid, oloc, rd, CEPH_NOSNAP, NULL, 0,
+			     new C_OnFinisher(fin, cache->mds->finisher));
+}
+
 void CDir::_omap_fetch(MDSInternalContextBase *c, const std::set<dentry_key_t>& keys)
 {
   C_IO_Dir_OMAP_Fetched *fin = new C_IO_Dir_OMAP_Fetched(this, c);
@@ -1515,8 +1572,8 @@ void CDir::_omap_fetch(MDSInternalContextBase *c, const std::set<dentry_key_t>&
   rd.omap_get_header(&fin->hdrbl, &fin->ret1);
   if (keys.empty()) {
     assert(!c);
-#warning use the pmore arg
-    rd.omap_get_vals("", "", (uint64_t)-1, &fin->omap, nullptr, &fin->ret2);
+    rd.omap_get_vals("", "", g_conf->mds_dir_keys_per_op,
+		     &fin->omap, &fin->more, &fin->ret2);
   } else {
     assert(c);
     std::set<std::string> str_keys;
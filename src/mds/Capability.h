@@ -134,15 +134,7 @@ public:
   }
 
 
-  static void *operator new(size_t num_bytes) {
-    void *n = pool.malloc();
-    if (!n)
-      throw std::bad_alloc();
-    return n;
-  }
-  void operator delete(void *p) {
-    pool.free(p);
-  }
+  MEMPOOL_CLASS_HELPERS();
   const Capability& operator=(const Capability& other);  // no copying
 
   int pending() { return _pending; }
@@ -341,7 +333,6 @@ public:
   xlist<Capability*>::item item_client_revoking_caps;
 
 private:
-  static boost::pool<> pool;
   CInode *inode;
   client_t client;
 
@@ -129,6 +129,11 @@ double mds_load_t::mds_load()
   case 2:
     return cpu_load_avg;
 
+  case 3:
+    // what a rank runs out of first: it gets about one core, however
+    // many the host has
+    return proc_cpu;
+
   }
   ceph_abort();
   return 0;
@@ -154,6 +159,10 @@ mds_load_t MDBalancer::get_load(utime_t now)
   load.req_rate = mds->get_req_rate();
   load.queue_len = messenger->get_dispatch_queue_len();
 
+  sample_process_load(now);
+  load.proc_cpu = last_proc_cpu;
+  load.req_latency = last_req_latency;
+
   ifstream cpu("/proc/loadavg");
   if (cpu.is_open())
     cpu >> load.cpu_load_avg;
@@ -164,6 +173,49 @@ mds_load_t MDBalancer::get_load(utime_t now)
   return load;
 }
 
+/*
+ * How much cpu time this process used and how long replies took since
+ * the last sample.  Samples less than a second apart would mostly be
+ * noise, so then the last values stand.
+ */
+void MDBalancer::sample_process_load(utime_t now)
+{
+  if (last_load_stamp != utime_t() && now - last_load_stamp < 1.0)
+    return;
+
+  uint64_t ticks = 0;
+  ifstream stat("/proc/self/stat");
+  string line;
+  if (stat.is_open() && getline(stat, line)) {
+    // fields after the command name; utime and stime are the 14th and
+    // 15th of the whole line
+    std::istringstream iss(line.substr(line.rfind(')') + 2));
+    vector<string> fields;
+    string f;
+    while (fields.size() < 13 && iss >> f)
+      fields.push_back(f);
+    if (fields.size() == 13)
+      ticks = strtoull(fields[11].c_str(), NULL, 10) +
+	      strtoull(fields[12].c_str(), NULL, 10);
+  }
+  pair<uint64_t, uint64_t> lat = mds->logger->get_tavg_ms(l_mds_reply_latency);
+
+  if (last_load_stamp != utime_t()) {
+    double elapsed = now - last_load_stamp;
+    if (ticks >= last_cpu_ticks)
+      last_proc_cpu = 100.0 * (ticks - last_cpu_ticks) /
+		      sysconf(_SC_CLK_TCK) / elapsed;
+    if (lat.first > last_reply_lat.first)
+      last_req_latency = (double)(lat.second - last_reply_lat.second) /
+			 (lat.first - last_reply_lat.first) / 1000.0;
+    else
+      last_req_latency = 0.0;
+  }
+  last_load_stamp = now;
+  last_cpu_ticks = ticks;
+  last_reply_lat = lat;
+}
+
 /*
  * Read synchronously from RADOS using a timeout. We cannot do daemon-local
  * fallbacks (i.e. kick off async read when we are processing the map and
@@ -413,7 +465,7 @@ void MDBalancer::queue_split(const CDir *dir, bool fast)
 
   bool is_new = false;
   if (split_pending.count(frag) == 0) {
-    split_pending.insert(frag);
+    split_pending[frag] = make_pair(ceph_clock_now(), dir->get_frag_size());
     is_new = true;
   }
 
@@ -575,11 +627,21 @@ void MDBalancer::prep_rebalance(int beat)
     last_epoch_over = beat_epoch;
 
     // am i over long enough?
-    if (last_epoch_under && beat_epoch - last_epoch_under < 2) {
+    if (last_epoch_under &&
+	beat_epoch - last_epoch_under < g_conf->mds_bal_overload_epochs) {
       dout(5) << "  i am overloaded, but only for " << (beat_epoch - last_epoch_under) << " epochs" << dendl;
       return;
     }
 
+    // moving subtrees costs the clients a pause and both ranks work: not
+    // worth it as long as we still answer fast
+    if (m != mds_load.end() &&
+	m->second.req_latency < g_conf->mds_bal_min_latency) {
+      dout(5) << "  i am overloaded, but replies take only "
+	      << m->second.req_latency << "s" << dendl;
+      return;
+    }
+
     dout(5) << "  i am sufficiently overloaded" << dendl;
 
 
@@ -703,7 +765,9 @@ int MDBalancer::mantle_prep_rebalance()
                   {"all.meta_load", load.all.meta_load()},
                   {"req_rate", load.req_rate},
                   {"queue_len", load.queue_len},
-                  {"cpu_load_avg", load.cpu_load_avg}};
+                  {"cpu_load_avg", load.cpu_load_avg},
+                  {"proc_cpu", load.proc_cpu},
+                  {"req_latency", load.req_latency}};
   }
 
   /* execute the balancer */
@@ -723,6 +787,23 @@ int MDBalancer::mantle_prep_rebalance()
 
 
 
+/*
+ * Whether dir is in a subtree we imported within mds_bal_import_cooldown.
+ * Passing it on (or back) right away is how subtrees end up bouncing
+ * between ranks whose loads are close: the move itself shifts the loads
+ * the next round is based on.
+ */
+bool MDBalancer::is_recent_import(CDir *dir)
+{
+  CDir *root = mds->mdcache->get_subtree_root(dir);
+  auto p = recent_imports.find(root->dirfrag());
+  if (p == recent_imports.end())
+    return false;
+  dout(15) << "  imported " << *root << " at " << p->second
+	   << ", not moving it yet" << dendl;
+  return true;
+}
+
 void MDBalancer::try_rebalance()
 {
   if (!check_targets())
@@ -734,6 +815,13 @@ void MDBalancer::try_rebalance()
     return;
   }
 
+  for (auto p = recent_imports.begin(); p != recent_imports.end(); ) {
+    if (rebalance_time - p->second >= (double)g_conf->mds_bal_import_cooldown)
+      recent_imports.erase(p++);
+    else
+      ++p;
+  }
+
   // make a sorted list of my imports
   map<double,CDir*>    import_pop_map;
   multimap<mds_rank_t,CDir*>  import_from_map;
@@ -745,6 +833,7 @@ void MDBalancer::try_rebalance()
        ++it) {
     CDir *im = *it;
     if (im->get_inode()->is_stray()) continue;
+    if (is_recent_import(im)) continue;
 
     double pop = im->pop_auth_subtree.meta_load(rebalance_time, mds->mdcache->decayrate);
     if (g_conf->mds_bal_idle_threshold > 0 &&
@@ -858,6 +947,7 @@ void MDBalancer::try_rebalance()
 	 pot != candidates.end();
 	 ++pot) {
       if ((*pot)->get_inode()->is_stray()) continue;
+      if (is_recent_import(*pot)) continue;
       find_exports(*pot, amount, exports, have, already_exporting);
       if (have > amount-MIN_OFFLOAD)
 	break;
@@ -1066,6 +1156,34 @@ void MDBalancer::hit_inode(utime_t now, CInode *in, int type, int who)
     hit_dir(now, in->get_parent_dn()->get_dir(), type, who);
 }
 
+/*
+ * Whether a frag waiting to be split grows so fast that it will be past
+ * the fast split size by the time the split is due.  Then it's a burst
+ * of creates that isn't going to settle, and the sooner the split, the
+ * smaller the frags the creates land in.
+ */
+bool MDBalancer::split_growing_fast(const CDir *dir)
+{
+  auto p = split_pending.find(dir->dirfrag());
+  assert(p != split_pending.end());
+
+  double elapsed = ceph_clock_now() - p->second.first;
+  int grown = dir->get_frag_size() - p->second.second;
+  if (elapsed < .01 || grown <= 0)
+    return false;
+
+  double left = std::max(g_conf->mds_bal_fragment_interval - elapsed, 0.0);
+  double projected = dir->get_frag_size() + grown / elapsed * left;
+  double fast_limit = g_conf->mds_bal_split_size *
+		      g_conf->mds_bal_fragment_fast_factor;
+  if (projected <= fast_limit)
+    return false;
+
+  dout(10) << __func__ << " " << *dir << " grew by " << grown << " in "
+	   << elapsed << "s, will reach " << projected << dendl;
+  return true;
+}
+
 void MDBalancer::maybe_fragment(CDir *dir, bool hot)
 {
   // split/merge
@@ -1081,7 +1199,7 @@ void MDBalancer::maybe_fragment(CDir *dir, bool hot)
       if (split_pending.count(dir->dirfrag()) == 0) {
         queue_split(dir, false);
       } else {
-        if (dir->should_split_fast()) {
+        if (dir->should_split_fast() || split_growing_fast(dir)) {
           queue_split(dir, true);
         } else {
           dout(10) << __func__ << ": fragment already enqueued to split: "
@@ -1220,6 +1338,9 @@ void MDBalancer::add_import(CDir *dir, utime_t now)
 {
   dirfrag_load_vec_t subload = dir->pop_auth_subtree;
 
+  if (g_conf->mds_bal_import_cooldown > 0)
+    recent_imports[dir->dirfrag()] = now;
+
   while (true) {
     dir = dir->inode->get_parent_dir();
     if (!dir) break;
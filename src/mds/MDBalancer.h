@@ -50,13 +50,27 @@ class MDBalancer {
 
   utime_t last_heartbeat;
   utime_t last_sample;    
+
+  // process cpu time and reply latency at the last load sample
+  utime_t last_load_stamp;
+  uint64_t last_cpu_ticks;
+  pair<uint64_t, uint64_t> last_reply_lat;  ///< count, total ms
+  double last_proc_cpu, last_req_latency;
+  void sample_process_load(utime_t now);
+
+  // subtrees we imported lately, which we don't pass on just yet
+  map<dirfrag_t, utime_t> recent_imports;
+  bool is_recent_import(CDir *dir);
   utime_t rebalance_time; //ensure a consistent view of load for rebalance
 
   // Dirfrags which are marked to be passed on to MDCache::[split|merge]_dir
   // just as soon as a delayed context comes back and triggers it.
   // These sets just prevent us from spawning extra timer contexts for
-  // dirfrags that already have one in flight.
-  set<dirfrag_t>   split_pending, merge_pending;
+  // dirfrags that already have one in flight.  Splits remember when they
+  // were queued and the frag size then, to tell how fast it grows.
+  map<dirfrag_t, pair<utime_t, int> > split_pending;
+  set<dirfrag_t>   merge_pending;
+  bool split_growing_fast(const CDir *dir);
 
   // per-epoch scatter/gathered info
   map<mds_rank_t, mds_load_t>  mds_load;
@@ -87,7 +101,9 @@ public:
     messenger(msgr),
     mon_client(monc),
     beat_epoch(0),
-    last_epoch_under(0), last_epoch_over(0), my_load(0.0), target_load(0.0) { }
+    last_epoch_under(0), last_epoch_over(0),
+    last_cpu_ticks(0), last_proc_cpu(0.0), last_req_latency(0.0),
+    my_load(0.0), target_load(0.0) { }
   
   mds_load_t get_load(utime_t);
 
@@ -181,6 +181,8 @@ MDCache::MDCache(MDSRank *m) :
   mds(m),
   filer(m->objecter, m->finisher),
   exceeded_size_limit(false),
+  open_ino_num_fetching(0),
+  open_ino_fetched_lock("MDCache::open_ino_fetched_lock"),
   recovery_queue(m),
   stray_manager(m)
 {
@@ -216,7 +218,7 @@ MDCache::MDCache(MDSRank *m) :
   cap_imports_num_opening = 0;
 
   opening_root = open = false;
-  lru.lru_set_max(g_conf->mds_cache_size);
+  lru.lru_set_max(cache_limit_inodes());
   lru.lru_set_midpoint(g_conf->mds_cache_mid);
 
   decayrate.set_halflife(g_conf->mds_decay_halflife);
@@ -233,9 +235,46 @@ MDCache::~MDCache()
 
 
 
+uint64_t MDCache::cache_limit_inodes()
+{
+  return g_conf->mds_cache_size > 0 ? g_conf->mds_cache_size : 0;
+}
+
+uint64_t MDCache::cache_limit_memory()
+{
+  return g_conf->mds_cache_memory_limit;
+}
+
+double MDCache::cache_toofull_ratio() const
+{
+  double reserve = 1.0 - g_conf->mds_cache_reservation;
+  double ratio = 0.0;
+
+  uint64_t inode_limit = cache_limit_inodes();
+  if (inode_limit) {
+    double target = inode_limit * reserve;
+    ratio = (inode_map.size() - target) / target;
+  }
+  uint64_t memory_limit = cache_limit_memory();
+  if (memory_limit) {
+    double target = memory_limit * reserve;
+    ratio = std::max(ratio, (cache_size() - target) / target);
+  }
+  return std::max(ratio, 0.0);
+}
+
+bool MDCache::cache_overfull() const
+{
+  double threshold = g_conf->mds_health_cache_threshold;
+  uint64_t inode_limit = cache_limit_inodes();
+  uint64_t memory_limit = cache_limit_memory();
+  return (inode_limit && inode_map.size() > inode_limit * threshold) ||
+    (memory_limit && cache_size() > memory_limit * threshold);
+}
+
 void MDCache::log_stat()
 {
-  mds->logger->set(l_mds_inode_max, g_conf->mds_cache_size);
+  mds->logger->set(l_mds_inode_max, cache_limit_inodes());
   mds->logger->set(l_mds_inodes, lru.lru_get_size());
   mds->logger->set(l_mds_inodes_pinned, lru.lru_get_num_pinned());
   mds->logger->set(l_mds_inodes_top, lru.lru_get_top());
@@ -283,8 +322,7 @@ void MDCache::add_inode(CInode *in)
       base_inodes.insert(in);
   }
 
-  if (get_num_inodes() >
-        g_conf->mds_cache_size * g_conf->mds_health_cache_threshold) {
+  if (cache_overfull()) {
     exceeded_size_limit = true;
   }
 }
@@ -1546,7 +1584,7 @@ CInode *MDCache::cow_inode(CInode *in, snapid_t last)
   }
 
   // clone caps?
-  for (map<client_t,Capability*>::iterator p = in->client_caps.begin();
+  for (mempool_cap_map::iterator p = in->client_caps.begin();
       p != in->client_caps.end();
       ++p) {
     client_t client = p->first;
@@ -1994,7 +2032,7 @@ void MDCache::broadcast_quota_to_client(CInode *in)
   if (!i->quota.is_enable())
     return;
 
-  for (map<client_t,Capability*>::iterator it = in->client_caps.begin();
+  for (mempool_cap_map::iterator it = in->client_caps.begin();
        it != in->client_caps.end();
        ++it) {
     Session *session = mds->get_session(it->first);
@@ -6394,16 +6432,26 @@ void MDCache::start_recovered_truncates()
 bool MDCache::trim(int max, int count)
 {
   // trim LRU
+  bool to_limits = false;
   if (count > 0) {
     max = lru.lru_get_size() - count;
     if (max <= 0)
       max = 1;
   } else if (max < 0) {
-    max = g_conf->mds_cache_size;
-    if (max <= 0)
-      return false;
+    // trim to the inode limit, if any, and until the memory fits
+    to_limits = true;
+    uint64_t inode_limit = cache_limit_inodes();
+    if (inode_limit) {
+      max = inode_limit * (1.0 - g_conf->mds_cache_reservation);
+    } else {
+      max = lru.lru_get_size();
+      // keep the midpoint relative to what we hold
+      lru.lru_set_max(max);
+    }
   }
-  dout(7) << "trim max=" << max << "  cur=" << lru.lru_get_size() << dendl;
+  dout(7) << "trim max=" << max << "  cur=" << lru.lru_get_size()
+	  << " cache_size=" << cache_size() << "/" << cache_limit_memory()
+	  << dendl;
 
   // process delayed eval_stray()
   stray_manager.advance_delayed();
@@ -6417,14 +6465,17 @@ bool MDCache::trim(int max, int count)
   // unless we see null dentries at the bottom of the LRU,
   // in which case trim all those.
   bool trimming_nulls = true;
-  while (trimming_nulls || lru.lru_get_size() + unexpirable > (unsigned)max) {
+  while (trimming_nulls ||
+	 lru.lru_get_size() + unexpirable > (unsigned)max ||
+	 (to_limits && cache_toofull())) {
     CDentry *dn = static_cast<CDentry*>(lru.lru_expire());
     if (!dn) {
       break;
     }
     if (!dn->get_linkage()->is_null()) {
       trimming_nulls = false;
-      if (lru.lru_get_size() + unexpirable < (unsigned)max) {
+      if (lru.lru_get_size() + unexpirable < (unsigned)max &&
+	  !(to_limits && cache_toofull())) {
 	unexpirables.push_back(dn);
 	break;
       }
@@ -7386,27 +7437,26 @@ void MDCache::check_memory_usage()
   mds->mlogger->set(l_mdm_heap, last.get_heap());
   mds->mlogger->set(l_mdm_malloc, last.malloc);
 
-  if (num_inodes_with_caps > g_conf->mds_cache_size) {
-    float ratio = (float)g_conf->mds_cache_size * .9 / (float)num_inodes_with_caps;
-    if (ratio < 1.0) {
-      last_recall_state = ceph_clock_now();
-      mds->server->recall_client_state(ratio);
-    }
+  // what trim() can't get rid of is pinned, mostly by client caps: ask
+  // the clients to give up enough of theirs to get below the target
+  double toofull = cache_toofull_ratio();
+  if (toofull > 0.0) {
+    float ratio = .9 / (1.0 + toofull);
+    dout(2) << "check_memory_usage: cache " << cache_size() << "/"
+	    << cache_limit_memory() << " bytes, " << inode_map.size() << "/"
+	    << cache_limit_inodes() << " inodes, recalling caps to " << ratio
+	    << dendl;
+    last_recall_state = ceph_clock_now();
+    mds->server->recall_client_state(ratio);
   }
 
-  // If the cache size had exceeded its limit, but we're back in bounds
-  // now, free any unused pool memory so that our memory usage isn't
-  // permanently bloated.
-  if (exceeded_size_limit
-      && get_num_inodes() <=
-        g_conf->mds_cache_size * g_conf->mds_health_cache_threshold) {
-    // Only do this once we are back in bounds: otherwise the releases would
-    // slow down whatever process caused us to exceed bounds to begin with
-    dout(2) << "check_memory_usage: releasing unused space from pool allocators"
+  // The cache objects live in the mds_co mempool, which hands freed
+  // memory straight back to the allocator, so once we are back in
+  // bounds there is nothing left to release.
+  if (exceeded_size_limit && !cache_overfull()) {
+    dout(2) << "check_memory_usage: cache back within its limit, "
+            << cache_size() << " bytes in cache objects"
             << dendl;
-    CInode::pool.release_memory();
-    CDir::pool.release_memory();
-    CDentry::pool.release_memory();
     exceeded_size_limit = false;
   }
 }
@@ -8280,17 +8330,75 @@ void MDCache::make_trace(vector<CDentry*>& trace, CInode *in)
 // -------------------------------------------------------------------------------
 // Open inode by inode number
 
-class C_IO_MDC_OpenInoBacktraceFetched : public MDCacheIOContext {
+// completes in the objecter, without mds_lock
+class C_MDC_OpenInoBacktraceReply : public Context {
+  MDCache *mdcache;
   inodeno_t ino;
   public:
   bufferlist bl;
-  C_IO_MDC_OpenInoBacktraceFetched(MDCache *c, inodeno_t i) :
-    MDCacheIOContext(c), ino(i) {}
+  C_MDC_OpenInoBacktraceReply(MDCache *c, inodeno_t i) :
+    mdcache(c), ino(i) {}
   void finish(int r) override {
-    mdcache->_open_ino_backtrace_fetched(ino, bl, r);
+    mdcache->_open_ino_backtrace_reply(ino, bl, r);
   }
 };
 
+class C_IO_MDC_OpenInoProcessFetched : public MDCacheIOContext {
+  public:
+  explicit C_IO_MDC_OpenInoProcessFetched(MDCache *c) : MDCacheIOContext(c) {}
+  void finish(int r) override {
+    mdcache->_open_ino_process_fetched();
+  }
+};
+
+void MDCache::_open_ino_fetch_backtrace(inodeno_t ino, open_ino_info_t& info)
+{
+  if (open_ino_num_fetching >= g_conf->mds_open_ino_max_fetching) {
+    dout(10) << "_open_ino_fetch_backtrace ino " << ino << " queued" << dendl;
+    open_ino_fetch_queue.push_back(ino);
+    return;
+  }
+  open_ino_num_fetching++;
+  C_MDC_OpenInoBacktraceReply *fin = new C_MDC_OpenInoBacktraceReply(this, ino);
+  fetch_backtrace(ino, info.pool, fin->bl, fin);
+}
+
+void MDCache::_open_ino_backtrace_reply(inodeno_t ino, bufferlist& bl, int err)
+{
+  Mutex::Locker l(open_ino_fetched_lock);
+  bool first = open_ino_fetched.empty();
+  open_ino_fetched.push_back(open_ino_fetched_t());
+  open_ino_fetched_t& f = open_ino_fetched.back();
+  f.ino = ino;
+  f.bl.claim(bl);
+  f.err = err;
+  if (first)
+    mds->finisher->queue(new C_IO_MDC_OpenInoProcessFetched(this));
+}
+
+void MDCache::_open_ino_process_fetched()
+{
+  list<open_ino_fetched_t> fetched;
+  {
+    Mutex::Locker l(open_ino_fetched_lock);
+    fetched.swap(open_ino_fetched);
+  }
+  dout(10) << "_open_ino_process_fetched " << fetched.size() << " backtraces" << dendl;
+
+  for (auto& f : fetched) {
+    open_ino_num_fetching--;
+    _open_ino_backtrace_fetched(f.ino, f.bl, f.err);
+  }
+
+  while (!open_ino_fetch_queue.empty() &&
+	 open_ino_num_fetching < g_conf->mds_open_ino_max_fetching) {
+    inodeno_t ino = open_ino_fetch_queue.front();
+    open_ino_fetch_queue.pop_front();
+    assert(opening_inodes.count(ino));
+    _open_ino_fetch_backtrace(ino, opening_inodes[ino]);
+  }
+}
+
 struct C_MDC_OpenInoTraverseDir : public MDCacheContext {
   inodeno_t ino;
   MMDSOpenIno *msg;
@@ -8347,10 +8455,7 @@ void MDCache::_open_ino_backtrace_fetched(inodeno_t ino, bufferlist& bl, int err
       dout(10) << " old object in pool " << info.pool
 	       << ", retrying pool " << backtrace.pool << dendl;
       info.pool = backtrace.pool;
-      C_IO_MDC_OpenInoBacktraceFetched *fin =
-	new C_IO_MDC_OpenInoBacktraceFetched(this, ino);
-      fetch_backtrace(ino, info.pool, fin->bl,
-		      new C_OnFinisher(fin, mds->finisher));
+      _open_ino_fetch_backtrace(ino, info);
       return;
     }
   } else if (err == -ENOENT) {
@@ -8359,10 +8464,7 @@ void MDCache::_open_ino_backtrace_fetched(inodeno_t ino, bufferlist& bl, int err
       dout(10) << " no object in pool " << info.pool
 	       << ", retrying pool " << meta_pool << dendl;
       info.pool = meta_pool;
-      C_IO_MDC_OpenInoBacktraceFetched *fin =
-	new C_IO_MDC_OpenInoBacktraceFetched(this, ino);
-      fetch_backtrace(ino, info.pool, fin->bl,
-		      new C_OnFinisher(fin, mds->finisher));
+      _open_ino_fetch_backtrace(ino, info);
       return;
     }
     err = 0; // backtrace.ancestors.empty() is checked below
@@ -8586,10 +8688,7 @@ void MDCache::do_open_ino(inodeno_t ino, open_ino_info_t& info, int err)
     info.checking = mds->get_nodeid();
     info.checked.clear();
     info.checked.insert(mds->get_nodeid());
-    C_IO_MDC_OpenInoBacktraceFetched *fin =
-      new C_IO_MDC_OpenInoBacktraceFetched(this, ino);
-    fetch_backtrace(ino, info.pool, fin->bl,
-		    new C_OnFinisher(fin, mds->finisher));
+    _open_ino_fetch_backtrace(ino, info);
   } else {
     assert(!info.ancestors.empty());
     info.checking = mds->get_nodeid();
@@ -9164,6 +9263,10 @@ void MDCache::request_cleanup(MDRequestRef& mdr)
 {
   dout(15) << "request_cleanup " << *mdr << dendl;
 
+  // never replied: a batch it heads retries without it
+  if (mdr->batch_object)
+    mds->server->finish_batch(mdr, -EAGAIN);
+
   if (mdr->has_more()) {
     if (mdr->more()->is_ambiguous_auth)
       mdr->clear_ambiguous_auth();
@@ -12322,6 +12425,8 @@ void MDCache::register_perfcounters()
     pcb.add_u64(l_mdc_num_strays_purging, "num_strays_purging", "Stray dentries purging");
     pcb.add_u64(l_mdc_num_strays_delayed, "num_strays_delayed", "Stray dentries delayed");
     pcb.add_u64(l_mdc_num_purge_ops, "num_purge_ops", "Purge operations");
+    pcb.add_u64(l_mdc_num_strays_queued, "num_strays_queued",
+        "Stray dentries waiting to be purged", "strq");
     pcb.add_u64_counter(l_mdc_strays_created, "strays_created", "Stray dentries created");
     pcb.add_u64_counter(l_mdc_strays_purged, "strays_purged",
         "Stray dentries purged", "purg");
@@ -12337,10 +12442,17 @@ void MDCache::register_perfcounters()
     pcb.add_u64_counter(l_mdc_recovery_completed, "recovery_completed",
         "File recoveries completed", "recd");
 
+    /* Scrub statistics */
+    pcb.add_u64(l_mdc_num_scrubs_in_progress, "num_scrubs_in_progress", "Scrubs in progress");
+    pcb.add_u64_counter(l_mdc_inodes_scrubbed, "inodes_scrubbed",
+        "Inodes scrubbed", "scrb");
+    pcb.add_u64_counter(l_mdc_scrub_errors, "scrub_errors", "Inodes that failed scrub");
+
     logger.reset(pcb.create_perf_counters());
     g_ceph_context->get_perfcounters_collection()->add(logger.get());
     recovery_queue.set_logger(logger.get());
     stray_manager.set_logger(logger.get());
+    mds->scrubstack->set_logger(logger.get());
 }
 
 /**
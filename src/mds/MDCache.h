@@ -79,6 +79,8 @@ enum {
   l_mdc_num_strays_delayed,
   // How many purge RADOS ops might currently be in flight?
   l_mdc_num_purge_ops,
+  // How many stray dentries are waiting for purge throttles
+  l_mdc_num_strays_queued,
   // How many dentries have ever been added to stray dir
   l_mdc_strays_created,
   // How many dentries have ever finished purging from stray dir
@@ -99,6 +101,13 @@ enum {
   // How many inodes ever completed size recovery
   l_mdc_recovery_completed,
 
+  // How many inodes are currently being scrubbed
+  l_mdc_num_scrubs_in_progress,
+  // How many inodes have ever been scrubbed
+  l_mdc_inodes_scrubbed,
+  // How many inodes ever failed scrub validation
+  l_mdc_scrub_errors,
+
   l_mdc_last,
 };
 
@@ -675,6 +684,23 @@ public:
   void set_cache_size(size_t max) { lru.lru_set_max(max); }
   size_t get_cache_size() { return lru.lru_get_size(); }
 
+  /*
+   * The cache is limited by the memory of its objects, and optionally by
+   * the number of inodes.  It is trimmed, and clients are asked to release
+   * caps, once it grows beyond mds_cache_reservation below either limit.
+   */
+  static uint64_t cache_limit_inodes();
+  static uint64_t cache_limit_memory();
+  /// bytes of CInode, CDentry, CDir, Capability and their containers
+  uint64_t cache_size() const {
+    return mempool::mds_co::allocated_bytes();
+  }
+  /// how far the cache is above its trim target, as a fraction of it
+  double cache_toofull_ratio() const;
+  bool cache_toofull() const { return cache_toofull_ratio() > 0.0; }
+  /// whether the cache is so far beyond its limits that it is unhealthy
+  bool cache_overfull() const;
+
   // trimming
   bool trim(int max=-1, int count=-1);   // trim cache
   bool trim_dentry(CDentry *dn, map<mds_rank_t, MCacheExpire*>& expiremap);
@@ -941,6 +967,22 @@ protected:
   ceph_tid_t open_ino_last_tid;
   map<inodeno_t,open_ino_info_t> opening_inodes;
 
+  // Backtraces are fetched at most mds_open_ino_max_fetching at a time,
+  // and the replies are handled a batch at a time, so that opening many
+  // inodes (as in rejoin) doesn't take mds_lock once per inode.
+  struct open_ino_fetched_t {
+    inodeno_t ino;
+    bufferlist bl;
+    int err;
+  };
+  list<inodeno_t> open_ino_fetch_queue;
+  int open_ino_num_fetching;
+  Mutex open_ino_fetched_lock;
+  list<open_ino_fetched_t> open_ino_fetched;  // replies not handled yet
+
+  void _open_ino_fetch_backtrace(inodeno_t ino, open_ino_info_t& info);
+  void _open_ino_backtrace_reply(inodeno_t ino, bufferlist& bl, int err);
+  void _open_ino_process_fetched();
   void _open_ino_backtrace_fetched(inodeno_t ino, bufferlist& bl, int err);
   void _open_ino_parent_opened(inodeno_t ino, int ret);
   void _open_ino_traverse_dir(inodeno_t ino, open_ino_info_t& info, int err);
@@ -953,7 +995,8 @@ protected:
   void do_open_ino_peer(inodeno_t ino, open_ino_info_t& info);
   void handle_open_ino(MMDSOpenIno *m, int err=0);
   void handle_open_ino_reply(MMDSOpenInoReply *m);
-  friend class C_IO_MDC_OpenInoBacktraceFetched;
+  friend class C_MDC_OpenInoBacktraceReply;
+  friend class C_IO_MDC_OpenInoProcessFetched;
   friend struct C_MDC_OpenInoTraverseDir;
   friend struct C_MDC_OpenInoParentOpened;
 
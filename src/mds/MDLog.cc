@@ -355,6 +355,20 @@ public:
   }
 };
 
+/**
+ * Completes the group commit flush of the submit thread
+ */
+class C_MDL_GroupFlushed : public Context {
+  MDLog *mdlog;
+public:
+  explicit C_MDL_GroupFlushed(MDLog *m) : mdlog(m) {}
+  void finish(int r) override {
+    Mutex::Locker l(mdlog->submit_mutex);
+    mdlog->group_flushing = false;
+    mdlog->submit_cond.Signal();
+  }
+};
+
 void MDLog::_submit_thread()
 {
   dout(10) << "_submit_thread start" << dendl;
@@ -367,6 +381,21 @@ void MDLog::_submit_thread()
       continue;
     }
 
+    // group commit: keep one flush in flight, covering everything that
+    // was appended while the previous one was.  how much goes into a
+    // write follows the journal latency and the submit rate.
+    if (group_unflushed > 0 && !group_flushing &&
+	g_conf->mds_log_group_commit) {
+      dout(20) << "_submit_thread group flush of " << group_unflushed
+	       << " events" << dendl;
+      group_flushing = true;
+      group_unflushed = 0;
+      submit_mutex.Unlock();
+      journaler->flush(new C_MDL_GroupFlushed(this));
+      submit_mutex.Lock();
+      continue;
+    }
+
     map<uint64_t,list<PendingEvent> >::iterator it = pending_events.begin();
     if (it == pending_events.end()) {
       submit_cond.Wait(submit_mutex);
@@ -436,10 +465,13 @@ void MDLog::_submit_thread()
     }
 
     submit_mutex.Lock();
-    if (data.flush)
+    if (data.flush) {
       unflushed = 0;
-    else if (data.le)
+      group_unflushed = 0;
+    } else if (data.le) {
       unflushed++;
+      group_unflushed++;
+    }
   }
 
   submit_mutex.Unlock();
@@ -554,6 +586,17 @@ void MDLog::_start_new_segment()
   _journal_segment_subtree_map(NULL);
 }
 
+class C_MDL_Trim : public MDSInternalContext {
+  MDLog *mdlog;
+public:
+  explicit C_MDL_Trim(MDLog *m) : MDSInternalContext(m->mds), mdlog(m) {}
+  void finish(int r) override {
+    mdlog->trim_queued = false;
+    if (mdlog->mds->is_active() || mdlog->mds->is_stopping())
+      mdlog->trim();
+  }
+};
+
 void MDLog::_prepare_new_segment()
 {
   assert(submit_mutex.is_locked_by_me());
@@ -566,6 +609,15 @@ void MDLog::_prepare_new_segment()
   logger->inc(l_mdl_segadd);
   logger->set(l_mdl_seg, segments.size());
 
+  // under heavy load the journal can run far ahead between two ticks,
+  // and whatever it holds beyond the limit is expired in one go.  start
+  // expiring as soon as it goes beyond, so that trimming keeps up.
+  if (!trim_queued && !mds->is_any_replay() &&
+      segments.size() > g_conf->mds_log_max_segments) {
+    trim_queued = true;
+    mds->queue_waiter(new C_MDL_Trim(this));
+  }
+
   // Adjust to next stray dir
   dout(10) << "Advancing to next stray directory on mds " << mds->get_nodeid() 
 	   << dendl;
@@ -1261,9 +1313,25 @@ void MDLog::_replay_thread()
 {
   dout(10) << "_replay_thread start" << dendl;
 
+  for (int i = 0; i < g_conf->mds_log_replay_decode_threads; i++) {
+    ReplayDecodeThread *t = new ReplayDecodeThread(this);
+    t->create("md_log_decode");
+    replay_decoders.push_back(t);
+  }
+
   // loop
   int r = 0;
+  vector<ReplayEntry> decoding;
   while (1) {
+    if (!journaler->is_readable() || journaler->get_error()) {
+      // we may wait, or stop: catch up first
+      _replay_decode_wait();
+      if (!_replay_batch(decoding)) {
+	_replay_decode_shutdown();
+	return;
+      }
+    }
+
     // wait for read?
     while (!journaler->is_readable() &&
 	   journaler->get_read_pos() < journaler->get_write_pos() &&
@@ -1336,76 +1404,40 @@ void MDLog::_replay_thread()
     
     assert(journaler->is_readable() || mds->is_daemon_stopping());
     
-    // read it
-    uint64_t pos = journaler->get_read_pos();
-    bufferlist bl;
-    bool r = journaler->try_read_entry(bl);
-    if (!r && journaler->get_error())
-      continue;
-    assert(r);
-    
-    // unpack event
-    LogEvent *le = LogEvent::decode(bl);
-    if (!le) {
-      dout(0) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos() 
-	      << " -- unable to decode event" << dendl;
-      dout(0) << "dump of unknown or corrupt event:\n";
-      bl.hexdump(*_dout);
-      *_dout << dendl;
-
-      mds->clog->error() << "corrupt journal event at " << pos << "~"
-                         << bl.length() << " / "
-                         << journaler->get_write_pos();
-      if (g_conf->mds_log_skip_corrupt_events) {
-        continue;
-      } else {
-        mds->damaged_unlocked();
-        ceph_abort();  // Should be unreachable because damaged() calls
-                    // respawn()
-      }
-
+    // read what we can without waiting
+    vector<ReplayEntry> batch;
+    while (journaler->is_readable() &&
+	   batch.size() < g_conf->mds_log_replay_batch) {
+      ReplayEntry e;
+      e.pos = journaler->get_read_pos();
+      if (!journaler->try_read_entry(e.bl))
+	break;
+      e.end = journaler->get_read_pos();
+      batch.push_back(std::move(e));
     }
-    le->set_start_off(pos);
-
-    // new segment?
-    if (le->get_type() == EVENT_SUBTREEMAP ||
-	le->get_type() == EVENT_RESETJOURNAL) {
-      ESubtreeMap *sle = dynamic_cast<ESubtreeMap*>(le);
-      if (sle && sle->event_seq > 0)
-	event_seq = sle->event_seq;
-      else
-	event_seq = pos;
-      segments[event_seq] = new LogSegment(event_seq, pos);
-      logger->set(l_mdl_seg, segments.size());
-    } else {
-      event_seq++;
+    if (batch.empty()) {
+      assert(journaler->get_error());
+      continue;
     }
 
-    // have we seen an import map yet?
-    if (segments.empty()) {
-      dout(10) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos() 
-	       << " " << le->get_stamp() << " -- waiting for subtree_map.  (skipping " << *le << ")" << dendl;
-    } else {
-      dout(10) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos() 
-	       << " " << le->get_stamp() << ": " << *le << dendl;
-      le->_segment = get_current_segment();    // replay may need this
-      le->_segment->num_events++;
-      le->_segment->end = journaler->get_read_pos();
-      num_events++;
-
-      {
-        Mutex::Locker l(mds->mds_lock);
-        if (mds->is_daemon_stopping()) {
-          return;
-        }
-        logger->inc(l_mdl_replayed);
-        le->replay(mds);
-      }
+    // replay the previous batch while this one decodes
+    _replay_decode_wait();
+    vector<ReplayEntry> replaying;
+    replaying.swap(decoding);
+    decoding.swap(batch);
+    _replay_decode_start(decoding);
+    if (!_replay_batch(replaying)) {
+      _replay_decode_shutdown();
+      return;
     }
-    delete le;
+  }
 
-    logger->set(l_mdl_rdpos, pos);
+  _replay_decode_wait();
+  if (!_replay_batch(decoding)) {
+    _replay_decode_shutdown();
+    return;
   }
+  _replay_decode_shutdown();
 
   // done!
   if (r == 0) {
@@ -1430,6 +1462,147 @@ void MDLog::_replay_thread()
   dout(10) << "_replay_thread finish" << dendl;
 }
 
+void MDLog::_replay_decode_thread()
+{
+  Mutex::Locker l(replay_decode_lock);
+  while (!replay_decode_stop) {
+    if (!replay_decoding || replay_decode_next == replay_decoding->size()) {
+      replay_decode_cond.Wait(replay_decode_lock);
+      continue;
+    }
+    ReplayEntry& e = (*replay_decoding)[replay_decode_next++];
+    replay_decode_lock.Unlock();
+    e.le = LogEvent::decode(e.bl);
+    replay_decode_lock.Lock();
+    if (--replay_decode_left == 0)
+      replay_decode_cond.SignalAll();
+  }
+}
+
+void MDLog::_replay_decode_start(vector<ReplayEntry>& batch)
+{
+  if (replay_decoders.empty()) {
+    for (auto& e : batch)
+      e.le = LogEvent::decode(e.bl);
+    return;
+  }
+  Mutex::Locker l(replay_decode_lock);
+  assert(!replay_decoding);
+  replay_decoding = &batch;
+  replay_decode_next = 0;
+  replay_decode_left = batch.size();
+  replay_decode_cond.SignalAll();
+}
+
+void MDLog::_replay_decode_wait()
+{
+  Mutex::Locker l(replay_decode_lock);
+  if (!replay_decoding)
+    return;
+  while (replay_decode_left > 0)
+    replay_decode_cond.Wait(replay_decode_lock);
+  replay_decoding = NULL;
+}
+
+void MDLog::_replay_decode_shutdown()
+{
+  _replay_decode_wait();
+  replay_decode_lock.Lock();
+  replay_decode_stop = true;
+  replay_decode_cond.SignalAll();
+  replay_decode_lock.Unlock();
+  for (auto t : replay_decoders) {
+    t->join();
+    delete t;
+  }
+  replay_decoders.clear();
+  replay_decode_stop = false;
+}
+
+/**
+ * Replay decoded entries, in order, and clear the batch.
+ *
+ * @returns false if the daemon is stopping
+ */
+bool MDLog::_replay_batch(vector<ReplayEntry>& batch)
+{
+  bool ok = true;
+  for (auto& e : batch) {
+    if (ok)
+      ok = _replay_entry(e);
+    delete e.le;
+  }
+  batch.clear();
+  return ok;
+}
+
+bool MDLog::_replay_entry(ReplayEntry& e)
+{
+  uint64_t pos = e.pos;
+  bufferlist& bl = e.bl;
+  LogEvent *le = e.le;
+
+  // unpack event
+  if (!le) {
+    dout(0) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos() 
+	    << " -- unable to decode event" << dendl;
+    dout(0) << "dump of unknown or corrupt event:\n";
+    bl.hexdump(*_dout);
+    *_dout << dendl;
+
+    mds->clog->error() << "corrupt journal event at " << pos << "~"
+		       << bl.length() << " / "
+		       << journaler->get_write_pos();
+    if (g_conf->mds_log_skip_corrupt_events) {
+      return true;
+    } else {
+      mds->damaged_unlocked();
+      ceph_abort();  // Should be unreachable because damaged() calls
+		  // respawn()
+    }
+  }
+  le->set_start_off(pos);
+
+  // new segment?
+  if (le->get_type() == EVENT_SUBTREEMAP ||
+      le->get_type() == EVENT_RESETJOURNAL) {
+    ESubtreeMap *sle = dynamic_cast<ESubtreeMap*>(le);
+    if (sle && sle->event_seq > 0)
+      event_seq = sle->event_seq;
+    else
+      event_seq = pos;
+    segments[event_seq] = new LogSegment(event_seq, pos);
+    logger->set(l_mdl_seg, segments.size());
+  } else {
+    event_seq++;
+  }
+
+  // have we seen an import map yet?
+  if (segments.empty()) {
+    dout(10) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos() 
+	     << " " << le->get_stamp() << " -- waiting for subtree_map.  (skipping " << *le << ")" << dendl;
+  } else {
+    dout(10) << "_replay " << pos << "~" << bl.length() << " / " << journaler->get_write_pos() 
+	     << " " << le->get_stamp() << ": " << *le << dendl;
+    le->_segment = get_current_segment();    // replay may need this
+    le->_segment->num_events++;
+    le->_segment->end = e.end;
+    num_events++;
+
+    {
+      Mutex::Locker l(mds->mds_lock);
+      if (mds->is_daemon_stopping()) {
+	return false;
+      }
+      logger->inc(l_mdl_replayed);
+      le->replay(mds);
+    }
+  }
+
+  logger->set(l_mdl_rdpos, pos);
+  return true;
+}
+
 void MDLog::standby_trim_segments()
 {
   dout(10) << "standby_trim_segments" << dendl;
@@ -71,6 +71,13 @@ protected:
 
   int unflushed;
 
+  // group commit: events appended by the submit thread since its last
+  // flush, and whether that flush is still in flight
+  int group_unflushed;
+  bool group_flushing;
+
+  bool trim_queued;  ///< a trim() is queued for the journal running ahead
+
   bool capped;
 
   // Log position which is persistent *and* for which
@@ -104,6 +111,40 @@ protected:
   void _replay();         // old way
   void _replay_thread();  // new way
 
+  // Replay reads the journal a batch of entries at a time.  The entries
+  // are decoded by the replay decode threads while the replay thread
+  // replays the previous batch under mds_lock.
+  struct ReplayEntry {
+    uint64_t pos;
+    uint64_t end;     // read pos past the entry
+    bufferlist bl;
+    LogEvent *le;
+    ReplayEntry() : pos(0), end(0), le(NULL) {}
+  };
+  class ReplayDecodeThread : public Thread {
+    MDLog *log;
+  public:
+    explicit ReplayDecodeThread(MDLog *l) : log(l) {}
+    void* entry() {
+      log->_replay_decode_thread();
+      return 0;
+    }
+  };
+  vector<ReplayDecodeThread*> replay_decoders;
+  Mutex replay_decode_lock;
+  Cond replay_decode_cond;
+  vector<ReplayEntry> *replay_decoding;  // batch being decoded
+  size_t replay_decode_next;             // next entry of it to decode
+  size_t replay_decode_left;             // entries of it not decoded yet
+  bool replay_decode_stop;
+
+  void _replay_decode_thread();
+  void _replay_decode_start(vector<ReplayEntry>& batch);
+  void _replay_decode_wait();
+  void _replay_decode_shutdown();
+  bool _replay_batch(vector<ReplayEntry>& batch);
+  bool _replay_entry(ReplayEntry& e);
+
   // Journal recovery/rewrite logic
   class RecoveryThread : public Thread {
     MDLog *log;
@@ -195,12 +236,20 @@ public:
   explicit MDLog(MDSRank *m) : mds(m),
                       num_events(0), 
                       unflushed(0),
+                      group_unflushed(0),
+                      group_flushing(false),
+                      trim_queued(false),
                       capped(false),
                       safe_pos(0),
                       journaler(0),
                       logger(0),
                       replay_thread(this),
                       already_replayed(false),
+                      replay_decode_lock("MDLog::replay_decode_lock"),
+                      replay_decoding(NULL),
+                      replay_decode_next(0),
+                      replay_decode_left(0),
+                      replay_decode_stop(false),
                       recovery_thread(this),
                       event_seq(0), expiring_events(0), expired_events(0),
 		      mdsmap_up_features(0),
@@ -306,6 +355,8 @@ private:
 
   friend class C_MaybeExpiredSegment;
   friend class C_MDL_Flushed;
+  friend class C_MDL_GroupFlushed;
+  friend class C_MDL_Trim;
 
 public:
   void trim_expired_segments();
@@ -688,7 +688,7 @@ void Migrator::maybe_do_queued_export()
     return;
   running = true;
   while (!export_queue.empty() &&
-	 export_state.size() <= 4) {
+	 (int)export_state.size() < g_conf->mds_bal_max_exports_in_flight) {
     dirfrag_t df = export_queue.front().first;
     mds_rank_t dest = export_queue.front().second;
     export_queue.pop_front();
@@ -1124,7 +1124,7 @@ void Migrator::get_export_client_set(CDir *dir, set<client_t>& client_set)
 	  }
 	}
       }
-      for (map<client_t, Capability*>::iterator q = in->client_caps.begin();
+      for (mempool_cap_map::iterator q = in->client_caps.begin();
 	   q != in->client_caps.end();
 	   ++q)
 	client_set.insert(q->first);
@@ -1134,7 +1134,7 @@ void Migrator::get_export_client_set(CDir *dir, set<client_t>& client_set)
 
 void Migrator::get_export_client_set(CInode *in, set<client_t>& client_set)
 {
-  for (map<client_t, Capability*>::iterator q = in->client_caps.begin();
+  for (mempool_cap_map::iterator q = in->client_caps.begin();
       q != in->client_caps.end();
       ++q)
     client_set.insert(q->first);
@@ -1334,7 +1334,7 @@ void Migrator::encode_export_inode_caps(CInode *in, bool auth_cap, bufferlist& b
   }
 
   // make note of clients named by exported capabilities
-  for (map<client_t, Capability*>::iterator it = in->client_caps.begin();
+  for (mempool_cap_map::iterator it = in->client_caps.begin();
        it != in->client_caps.end();
        ++it) 
     exported_client_map[it->first] = mds->sessionmap.get_inst(entity_name_t::CLIENT(it->first.v));
@@ -1349,7 +1349,7 @@ void Migrator::finish_export_inode_caps(CInode *in, mds_rank_t peer,
   in->put(CInode::PIN_EXPORTINGCAPS);
 
   // tell (all) clients about migrating caps.. 
-  for (map<client_t, Capability*>::iterator it = in->client_caps.begin();
+  for (mempool_cap_map::iterator it = in->client_caps.begin();
        it != in->client_caps.end();
        ++it) {
     Capability *cap = it->second;
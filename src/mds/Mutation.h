@@ -194,6 +194,8 @@ struct MDRequestImpl : public MutationImpl {
 
   int snap_caps;
   int getattr_caps;       ///< caps requested by getattr
+  MDSCacheObject *batch_object; ///< getattr/lookup batched on this object
+  bool batch_head;        ///< ... and we take the locks for the batch
   bool did_early_reply;
   bool o_trunc;           ///< request is an O_TRUNC mutation
   bool has_completed;     ///< request has already completed
@@ -299,7 +301,7 @@ struct MDRequestImpl : public MutationImpl {
     session(NULL), item_session_request(this),
     client_request(params.client_req), straydn(NULL), snapid(CEPH_NOSNAP),
     tracei(NULL), tracedn(NULL), alloc_ino(0), used_prealloc_ino(0),
-    snap_caps(0), getattr_caps(0),
+    snap_caps(0), getattr_caps(0), batch_object(NULL), batch_head(false),
     did_early_reply(false), o_trunc(false), has_completed(false),
     slave_request(NULL), internal_op(params.internal_op), internal_op_finish(NULL),
     internal_op_private(NULL),
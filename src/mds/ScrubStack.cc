@@ -16,6 +16,7 @@
 
 #include "ScrubStack.h"
 #include "common/Finisher.h"
+#include "common/perf_counters.h"
 #include "mds/MDSRank.h"
 #include "mds/MDCache.h"
 #include "mds/MDSContinuation.h"
@@ -121,6 +122,7 @@ void ScrubStack::kick_off_scrubs()
       can_continue = progress || terminal || completed;
     }
   }
+  logger->set(l_mdc_num_scrubs_in_progress, scrubs_in_progress);
 }
 
 void ScrubStack::scrub_dir_inode(CInode *in,
@@ -385,8 +387,11 @@ void ScrubStack::_validate_inode_done(CInode *in, int r,
     }
   }
 
+  logger->inc(l_mdc_inodes_scrubbed);
+
   // Inform the cluster log if we found an error
   if (!result.passed_validation) {
+    logger->inc(l_mdc_scrub_errors);
     std::string path;
     in->make_path_string(path, true);
     clog->warn() << "Scrub error on inode " << *in
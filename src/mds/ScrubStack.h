@@ -25,6 +25,7 @@
 
 class MDCache;
 class Finisher;
+class PerfCounters;
 
 class ScrubStack {
 protected:
@@ -37,6 +38,7 @@ protected:
   int scrubs_in_progress;
   ScrubStack *scrubstack; // hack for dout
   int stack_size;
+  PerfCounters *logger;
 
   class C_KickOffScrubs : public MDSInternalContext {
     ScrubStack *stack;
@@ -59,12 +61,14 @@ public:
     scrubs_in_progress(0),
     scrubstack(this),
     stack_size(0),
+    logger(NULL),
     scrub_kick(mdc, this),
     mdcache(mdc) {}
   ~ScrubStack() {
     assert(inode_stack.empty());
     assert(!scrubs_in_progress);
   }
+  void set_logger(PerfCounters *l) { logger = l; }
   /**
    * Put a inode on the top of the scrub stack, so it is the highest priority.
    * If there are other scrubs in progress, they will not continue scrubbing new
@@ -119,6 +119,8 @@ void Server::create_logger()
       "Client session messages", "hcs");
   plb.add_u64_counter(l_mdss_dispatch_client_request, "dispatch_client_request", "Client requests dispatched");
   plb.add_u64_counter(l_mdss_dispatch_slave_request, "dispatch_server_request", "Server requests dispatched");
+  plb.add_u64_counter(l_mdss_batched_client_request, "batched_client_request",
+      "Client requests answered along with a concurrent one");
   logger = plb.create_perf_counters();
   g_ceph_context->get_perfcounters_collection()->add(logger);
 }
@@ -427,6 +429,7 @@ void Server::_session_logged(Session *session, uint64_t state_seq, bool open, ve
     assert(session->is_closing() || session->is_killing() ||
 	   session->is_opening()); // re-open closing session
     session->info.prealloc_inos.subtract(inos);
+    session->delegated_inos.clear();
     mds->inotable->apply_release_ids(inos);
     assert(mds->inotable->get_version() == piv);
   }
@@ -931,7 +934,8 @@ void Server::recover_filelocks(CInode *in, bufferlist locks, int64_t client)
  */
 void Server::recall_client_state(float ratio)
 {
-  int max_caps_per_client = (int)(g_conf->mds_cache_size * .8);
+  int max_caps_per_client = MDCache::cache_limit_inodes() ?
+    (int)(MDCache::cache_limit_inodes() * .8) : INT_MAX;
   int min_caps_per_client = 100;
 
   dout(10) << "recall_client_state " << ratio
@@ -1033,6 +1037,8 @@ void Server::submit_mdlog_entry(LogEvent *le, MDSLogContextBase *fin, MDRequestR
 void Server::respond_to_request(MDRequestRef& mdr, int r)
 {
   if (mdr->client_request) {
+    if (mdr->batch_head)
+      finish_batch(mdr, r);
     reply_client_request(mdr, new MClientReply(mdr->client_request, r));
   } else if (mdr->internal_op > -1) {
     dout(10) << "respond_to_request on internal request " << mdr << dendl;
@@ -1043,6 +1049,83 @@ void Server::respond_to_request(MDRequestRef& mdr, int r)
   }
 }
 
+/*
+ * Concurrent getattrs (lookups) of the same inode (dentry) for the same
+ * caps need the same locks and see the same state.  Only the first one
+ * goes through the locking; the others wait for it and just build their
+ * reply under its locks, so a hot inode doesn't cost a lock round trip,
+ * with its waits and retries, per request.
+ *
+ * @returns true if mdr waits for another request
+ */
+bool Server::batch_request(MDRequestRef& mdr, MDSCacheObject *obj)
+{
+  if (mdr->batch_head) {
+    if (mdr->batch_object == obj)
+      return false;  // retried
+    // the path now leads elsewhere; let the others look again too
+    finish_batch(mdr, -EAGAIN);
+  }
+
+  int mask = mdr->client_request->head.args.getattr.mask;
+  list<MDRequestRef>& reqs = batched_requests[make_pair(obj, mask)];
+  mdr->batch_object = obj;
+  if (reqs.empty())
+    mdr->batch_head = true;
+  reqs.push_back(mdr);
+  if (mdr->batch_head)
+    return false;
+
+  dout(10) << "batch_request " << *mdr << " waits for " << *reqs.front() << dendl;
+  mdr->mark_event("batched");
+  if (logger) logger->inc(l_mdss_batched_client_request);
+  return true;
+}
+
+/*
+ * Take mdr out of its batch.  If it is the head and succeeded, answer the
+ * others with its result while it still holds the locks; if it failed,
+ * the error may be its own (e.g. permissions), so the others retry.
+ */
+void Server::finish_batch(MDRequestRef& mdr, int r)
+{
+  int mask = mdr->client_request->head.args.getattr.mask;
+  auto p = batched_requests.find(make_pair(mdr->batch_object, mask));
+  assert(p != batched_requests.end());
+  bool head = mdr->batch_head;
+  mdr->batch_object = NULL;
+  mdr->batch_head = false;
+  if (!head) {
+    p->second.remove(mdr);
+    if (p->second.empty())
+      batched_requests.erase(p);
+    return;
+  }
+
+  list<MDRequestRef> reqs;
+  reqs.swap(p->second);
+  batched_requests.erase(p);
+  assert(reqs.front() == mdr);
+  reqs.pop_front();
+
+  for (auto& m : reqs) {
+    m->batch_object = NULL;
+    if (r < 0) {
+      mds->queue_waiter(new C_MDS_RetryRequest(mdcache, m));
+      continue;
+    }
+    if (!check_access(m, mdr->tracei, MAY_READ))
+      continue;
+    m->getattr_caps = mdr->getattr_caps;
+    mds->balancer->hit_inode(ceph_clock_now(), mdr->tracei, META_POP_IRD,
+			     m->client_request->get_source().num());
+    dout(10) << "reply to batched stat on " << *m->client_request << dendl;
+    m->tracei = mdr->tracei;
+    m->tracedn = mdr->tracedn;
+    respond_to_request(m, 0);
+  }
+}
+
 void Server::early_reply(MDRequestRef& mdr, CInode *tracei, CDentry *tracedn)
 {
   if (!g_conf->mds_early_reply)
@@ -2707,6 +2790,27 @@ CDentry* Server::rdlock_path_xlock_dentry(MDRequestRef& mdr, int n,
  * @param mdr request
  * @returns the pointer, or NULL if it had to be delayed (but mdr is taken care of)
  */
+/*
+ * Start fetching a dirfrag we are auth for, without waiting for it.  A
+ * client reading through a big directory asks for the next frag next, and
+ * gets it from the cache rather than wait for a whole omap read.
+ */
+void Server::prefetch_dirfrag(CInode *diri, frag_t fg)
+{
+  CDir *dir = diri->get_dirfrag(fg);
+  if (!dir) {
+    if (!diri->is_auth() || diri->is_frozen())
+      return;
+    dir = diri->get_or_open_dirfrag(mdcache, fg);
+  }
+  if (!dir->is_auth() || dir->is_complete() ||
+      dir->state_test(CDir::STATE_FETCHING) || !dir->can_auth_pin())
+    return;
+
+  dout(10) << "prefetch_dirfrag " << *dir << dendl;
+  dir->fetch(NULL, false);
+}
+
 CDir* Server::try_open_auth_dirfrag(CInode *diri, frag_t fg, MDRequestRef& mdr)
 {
   CDir *dir = diri->get_dirfrag(fg);
@@ -2783,6 +2887,14 @@ void Server::handle_client_getattr(MDRequestRef& mdr, bool is_lookup)
   if ((mask & CEPH_CAP_FILE_SHARED) && (issued & CEPH_CAP_FILE_EXCL) == 0) rdlocks.insert(&ref->filelock);
   if ((mask & CEPH_CAP_XATTR_SHARED) && (issued & CEPH_CAP_XATTR_EXCL) == 0) rdlocks.insert(&ref->xattrlock);
 
+  // others can only share our answer if we read it under the locks,
+  // not from the caps of our client
+  const int excl = CEPH_CAP_LINK_EXCL | CEPH_CAP_AUTH_EXCL |
+		   CEPH_CAP_FILE_EXCL | CEPH_CAP_XATTR_EXCL;
+  if (mdr->snapid == CEPH_NOSNAP && (issued & excl) == 0 &&
+      batch_request(mdr, is_lookup ? (MDSCacheObject*)mdr->dn[0].back() : ref))
+    return;
+
   if (!mds->locker->acquire_locks(mdr, rdlocks, wrlocks, xlocks))
     return;
 
@@ -3321,6 +3433,14 @@ void Server::handle_client_openc(MDRequestRef& mdr)
     dout(10) << "adding ino to reply to indicate inode was created" << dendl;
     // add the file created flag onto the reply if create_flags features is supported
     ::encode(in->inode.ino, mdr->reply_extra_bl);
+
+    if (req->get_flags() & CEPH_MDS_FLAG_DELEG_INOS) {
+      // inos the client may use to create files without waiting for us
+      interval_set<inodeno_t> inos;
+      mdr->session->delegate_inos(g_conf->mds_client_delegate_inos, inos);
+      dout(10) << "delegating " << inos << " to " << client << dendl;
+      ::encode(inos, mdr->reply_extra_bl);
+    }
   }
 
   journal_and_reply(mdr, in, dn, le, fin);
@@ -3563,6 +3683,9 @@ void Server::handle_client_readdir(MDRequestRef& mdr)
 
   // bump popularity.  NOTE: this doesn't quite capture it.
   mds->balancer->hit_dir(now, dir, META_POP_IRD, -1, numfiles);
+
+  if (g_conf->mds_readdir_prefetch && !fg.is_rightmost())
+    prefetch_dirfrag(diri, diri->dirfragtree[fg.next().value()]);
   
   // reply
   mdr->tracei = diri;
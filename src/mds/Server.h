@@ -36,6 +36,7 @@ enum {
   l_mdss_handle_client_session,
   l_mdss_dispatch_client_request,
   l_mdss_dispatch_slave_request,
+  l_mdss_batched_client_request,
   l_mdss_last,
 };
 
@@ -49,6 +50,10 @@ private:
   // OSDMap full status, used to generate ENOSPC on some operations
   bool is_full;
 
+  // getattr/lookup requests by object and mask; the first one takes the
+  // locks, the others are answered along with it
+  map<pair<MDSCacheObject*, int>, list<MDRequestRef> > batched_requests;
+
   // State for while in reconnect
   MDSInternalContext *reconnect_done;
   int failed_reconnects;
@@ -115,6 +120,8 @@ public:
   void dispatch_client_request(MDRequestRef& mdr);
   void early_reply(MDRequestRef& mdr, CInode *tracei, CDentry *tracedn);
   void respond_to_request(MDRequestRef& mdr, int r = 0);
+  bool batch_request(MDRequestRef& mdr, MDSCacheObject *obj);
+  void finish_batch(MDRequestRef& mdr, int r);
   void set_trace_dist(Session *session, MClientReply *reply, CInode *in, CDentry *dn,
 		      snapid_t snapid,
 		      int num_dentries_wanted,
@@ -154,6 +161,7 @@ public:
 				    bool mustexist, bool alwaysxlock,
 				    file_layout_t **layout=NULL);
 
+  void prefetch_dirfrag(CInode *diri, frag_t fg);
   CDir* try_open_auth_dirfrag(CInode *diri, frag_t fg, MDRequestRef& mdr);
 
 
@@ -146,6 +146,7 @@ public:
   size_t get_request_count();
 
   interval_set<inodeno_t> pending_prealloc_inos; // journaling prealloc, will be added to prealloc_inos
+  interval_set<inodeno_t> delegated_inos; // part of prealloc_inos the client creates with on its own
 
   void notify_cap_release(size_t n_caps);
   void notify_recall_sent(int const new_limit);
@@ -166,12 +167,47 @@ public:
 	ino = 0;
     }
     if (!ino) {
-      ino = info.prealloc_inos.range_start();
+      // skip the ones the client may be using for its own creates
+      for (auto p = info.prealloc_inos.begin();
+	   p != info.prealloc_inos.end() && !ino; ++p) {
+	for (uint64_t i = p.get_start(); i < p.get_start() + p.get_len(); ++i) {
+	  if (!delegated_inos.contains(i)) {
+	    ino = i;
+	    break;
+	  }
+	}
+      }
+      if (!ino)
+	ino = info.prealloc_inos.range_start();
       info.prealloc_inos.erase(ino);
     }
+    if (delegated_inos.contains(ino))
+      delegated_inos.erase(ino);
     info.used_inos.insert(ino, 1);
     return ino;
   }
+  /**
+   * Hand up to @a want of the preallocated inos to the client, which
+   * may then name them in creates it answers itself.  At least half of
+   * the preallocated inos stay with the mds.
+   *
+   * @param inos [out] the newly delegated inos
+   */
+  void delegate_inos(int want, interval_set<inodeno_t>& inos) {
+    int avail = std::min<int>(info.prealloc_inos.size() / 2,
+			      want) - delegated_inos.size();
+    for (auto p = info.prealloc_inos.begin();
+	 p != info.prealloc_inos.end() && avail > 0; ++p) {
+      for (uint64_t i = p.get_start();
+	   i < p.get_start() + p.get_len() && avail > 0; ++i) {
+	if (!delegated_inos.contains(i)) {
+	  inos.insert(i);
+	  --avail;
+	}
+      }
+    }
+    delegated_inos.insert(inos);
+  }
   int get_num_projected_prealloc_inos() const {
     return info.prealloc_inos.size() + pending_prealloc_inos.size();
   }
@@ -339,6 +375,7 @@ public:
 
   void clear() {
     pending_prealloc_inos.clear();
+    delegated_inos.clear();
     info.clear_meta();
 
     cap_push_seq = 0;
@@ -363,6 +363,7 @@ void StrayManager::enqueue(CDentry *dn, bool trunc)
       dn->state_set(CDentry::STATE_PURGINGPINNED);
     }
     ready_for_purge.push_back(QueuedStray(dn, trunc, ops_required));
+    logger->set(l_mdc_num_strays_queued, ready_for_purge.size());
   }
 }
 
@@ -409,6 +410,9 @@ void StrayManager::_advance()
     ready_for_purge.erase(q);
   }
 
+  logger->set(l_mdc_num_strays_queued,
+	      ready_for_purge.size() + fetching_strays.size());
+
   MDSGatherBuilder gather(g_ceph_context);
   for (auto p = to_fetch.begin(); p != to_fetch.end(); ++p)
     p->first->fetch(gather.new_sub(), p->second);
@@ -528,21 +532,35 @@ uint32_t StrayManager::_calculate_ops_required(CInode *in, bool trunc)
     }
     // One for the root, plus any leaves
     ops_required = 1 + ls.size();
-  } else {
-    // File, work out concurrent Filer::purge deletes
+  } else if (trunc) {
+    // Filer::purge deletes of all but the first object, which is zeroed
+    // to keep the backtrace
     const uint64_t to = MAX(in->inode.max_size_ever,
             MAX(in->inode.size, in->inode.get_max_size()));
-
     const uint64_t num = (to > 0) ? Striper::get_num_objects(in->inode.layout, to) : 1;
-    ops_required = MIN(num, g_conf->filer_max_purge_ops);
+    ops_required = MIN(num - 1, g_conf->filer_max_purge_ops) + 1;
+  } else {
+    // File, work out concurrent Filer::purge deletes.  This must match
+    // what purge() issues: overcounting a small file's ops halves how
+    // many of them we purge at once.
+    const uint64_t to = in->is_file() ? MAX(in->inode.max_size_ever,
+            MAX(in->inode.size, in->inode.get_max_size())) : 0;
+    const inode_t *pi = in->get_projected_inode();
 
-    // Account for removing (or zeroing) backtrace
-    ops_required += 1;
+    if (to > 0) {
+      const uint64_t num = Striper::get_num_objects(in->inode.layout, to);
+      ops_required = MIN(num, g_conf->filer_max_purge_ops);
+      // the backtrace is removed with the first object, unless it lives
+      // in another namespace
+      if (!pi->layout.pool_ns.empty())
+	ops_required += 1;
+    } else {
+      // just the backtrace
+      ops_required = 1;
+    }
 
     // Account for deletions for old pools
-    if (!trunc) {
-      ops_required += in->get_projected_inode()->old_pools.size();
-    }
+    ops_required += pi->old_pools.size();
   }
 
   return ops_required;
@@ -894,6 +912,7 @@ void StrayManager::abort_queue()
 
   trimmed_strays.clear();
   fetching_strays.clear();
+  logger->set(l_mdc_num_strays_queued, 0);
 
   aborted = true;
 }
@@ -911,7 +930,7 @@ void StrayManager::truncate(CDentry *dn, uint32_t op_allowance)
 
   C_GatherBuilder gather(
     g_ceph_context,
-    new C_OnFinisher(new C_IO_PurgeStrayPurged(this, dn, true, 0),
+    new C_OnFinisher(new C_IO_PurgeStrayPurged(this, dn, true, op_allowance),
 		     mds->finisher));
 
   SnapRealm *realm = in->find_snaprealm();
@@ -26,7 +26,7 @@
 #include "inode_backtrace.h"
 
 #include <boost/spirit/include/qi.hpp>
-#include <boost/pool/pool.hpp>
+#include "include/mempool.h"
 #include "include/assert.h"
 #include <boost/serialization/strong_typedef.hpp>
 
@@ -1183,15 +1183,18 @@ struct mds_load_t {
   double queue_len;
 
   double cpu_load_avg;
+  double proc_cpu;     ///< % of a cpu used by this mds, lately
+  double req_latency;  ///< mean reply latency in seconds, lately
 
   explicit mds_load_t(const utime_t &t) : 
     auth(t), all(t), req_rate(0), cache_hit_rate(0),
-    queue_len(0), cpu_load_avg(0)
+    queue_len(0), cpu_load_avg(0), proc_cpu(0), req_latency(0)
   {}
   // mostly for the dencoder infrastructure
   mds_load_t() :
     auth(), all(),
-    req_rate(0), cache_hit_rate(0), queue_len(0), cpu_load_avg(0)
+    req_rate(0), cache_hit_rate(0), queue_len(0), cpu_load_avg(0),
+    proc_cpu(0), req_latency(0)
   {}
   
   double mds_load();  // defiend in MDBalancer.cc
@@ -1219,6 +1222,8 @@ inline std::ostream& operator<<( std::ostream& out, mds_load_t& load )
              << ", hr " << load.cache_hit_rate
              << ", qlen " << load.queue_len
 	     << ", cpu " << load.cpu_load_avg
+	     << ", proc cpu " << load.proc_cpu
+	     << ", lat " << load.req_latency
              << ">";
 }
 
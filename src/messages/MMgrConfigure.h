@@ -23,25 +23,44 @@
  */
 class MMgrConfigure : public Message
 {
-  static const int HEAD_VERSION = 1;
+  static const int HEAD_VERSION = 2;
   static const int COMPAT_VERSION = 1;
 
 public:
   uint32_t stats_period;
 
+  // The mgr understands values sent as differences from the last
+  // report (MMgrReport::packed v2)
+  bool compact_reports = false;
+
+  // Only declare counters whose path starts with one of these; all of
+  // them if empty
+  std::vector<std::string> stats_filter;
+
   void decode_payload()
   {
     bufferlist::iterator p = payload.begin();
     ::decode(stats_period, p);
+    if (header.version >= 2) {
+      ::decode(compact_reports, p);
+      ::decode(stats_filter, p);
+    }
   }
 
   void encode_payload(uint64_t features) {
     ::encode(stats_period, payload);
+    ::encode(compact_reports, payload);
+    ::encode(stats_filter, payload);
   }
 
   const char *get_type_name() const { return "mgrconfigure"; }
   void print(ostream& out) const {
-    out << get_type_name() << "()";
+    out << get_type_name() << "(period=" << stats_period
+        << (compact_reports ? " compact" : "");
+    if (!stats_filter.empty()) {
+      out << " filter=" << stats_filter;
+    }
+    out << ")";
   }
 
   MMgrConfigure()
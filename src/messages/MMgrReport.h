@@ -19,6 +19,49 @@
 
 #include "common/perf_counters.h"
 
+/**
+ * The layout of one axis of a histogram counter, as configured by
+ * PerfHistogramCommon::axis_config_d in the daemon.
+ */
+class PerfHistogramAxisType
+{
+public:
+  std::string name;
+  uint8_t scale_type = 0;
+  int64_t min = 0;
+  int64_t quant_size = 0;
+  int32_t buckets = 0;
+
+  PerfHistogramAxisType() {}
+  PerfHistogramAxisType(const PerfHistogramCommon::axis_config_d &ac)
+    : name(ac.m_name ? ac.m_name : ""), scale_type(ac.m_scale_type),
+      min(ac.m_min), quant_size(ac.m_quant_size), buckets(ac.m_buckets)
+  {}
+
+  void encode(bufferlist &bl) const
+  {
+    ENCODE_START(1, 1, bl);
+    ::encode(name, bl);
+    ::encode(scale_type, bl);
+    ::encode(min, bl);
+    ::encode(quant_size, bl);
+    ::encode(buckets, bl);
+    ENCODE_FINISH(bl);
+  }
+
+  void decode(bufferlist::iterator &p)
+  {
+    DECODE_START(1, p);
+    ::decode(name, p);
+    ::decode(scale_type, p);
+    ::decode(min, p);
+    ::decode(quant_size, p);
+    ::decode(buckets, p);
+    DECODE_FINISH(p);
+  }
+};
+WRITE_CLASS_ENCODER(PerfHistogramAxisType)
+
 class PerfCounterType
 {
 public:
@@ -26,28 +69,33 @@ public:
   std::string description;
   std::string nick;
   enum perfcounter_type_d type;
+  std::vector<PerfHistogramAxisType> axes;  ///< histogram counters only
 
   void encode(bufferlist &bl) const
   {
     // TODO: decide whether to drop the per-type
     // encoding here, we could rely on the MgrReport
     // verisoning instead.
-    ENCODE_START(1, 1, bl);
+    ENCODE_START(2, 1, bl);
     ::encode(path, bl);
     ::encode(description, bl);
     ::encode(nick, bl);
     static_assert(sizeof(type) == 1, "perfcounter_type_d must be one byte");
     ::encode((uint8_t)type, bl);
+    ::encode(axes, bl);
     ENCODE_FINISH(bl);
   }
   
   void decode(bufferlist::iterator &p)
   {
-    DECODE_START(1, p);
+    DECODE_START(2, p);
     ::decode(path, p);
     ::decode(description, p);
     ::decode(nick, p);
     ::decode((uint8_t&)type, p);
+    if (struct_v >= 2) {
+      ::decode(axes, p);
+    }
     DECODE_FINISH(p);
   }
 };
@@ -55,7 +103,7 @@ WRITE_CLASS_ENCODER(PerfCounterType)
 
 class MMgrReport : public Message
 {
-  static const int HEAD_VERSION = 1;
+  static const int HEAD_VERSION = 2;
   static const int COMPAT_VERSION = 1;
 
 public:
@@ -72,8 +120,19 @@ public:
   // Decode: iterate over the types we know about, sorted by idx,
   // and use the current type's type to decide how to decode
   // the next bytes from the bufferlist.
+  //
+  // v1 has each value as a fixed 64 bit integer (and long running
+  // averages as sum, count, count).  v2, sent when the mgr's
+  // MMgrConfigure says it understands it, has one blob of signed
+  // varints: each value (and average count) as the difference from the
+  // one in the previous report of the session.
   bufferlist packed;
 
+  // Histogram counters, in the same order, each as the list of its
+  // non-zero buckets: (index into the raw data, value).  Empty if the
+  // daemon does not report histograms.
+  bufferlist packed_histograms;
+
   std::string daemon_name;
 
   void decode_payload()
@@ -82,18 +141,22 @@ public:
     ::decode(daemon_name, p);
     ::decode(declare_types, p);
     ::decode(packed, p);
+    if (header.version >= 2) {
+      ::decode(packed_histograms, p);
+    }
   }
 
   void encode_payload(uint64_t features) {
     ::encode(daemon_name, payload);
     ::encode(declare_types, payload);
     ::encode(packed, payload);
+    ::encode(packed_histograms, payload);
   }
 
   const char *get_type_name() const { return "mgrreport"; }
   void print(ostream& out) const {
     out << get_type_name() << "(" << declare_types.size() << " "
-        << packed.length() << ")"; 
+        << packed.length() << " " << packed_histograms.length() << ")";
   }
 
   MMgrReport()
@@ -0,0 +1,56 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef CEPH_MMONMGRREPORT_H
+#define CEPH_MMONMGRREPORT_H
+
+#include "messages/PaxosServiceMessage.h"
+#include "mon/PGMap.h"
+
+/**
+ * The pg stat aggregates the active mgr sends the mon when
+ * mon_pg_stats_via_mgr is set, in place of the mon keeping a PGMap.
+ */
+class MMonMgrReport : public PaxosServiceMessage {
+
+  static const int HEAD_VERSION = 1;
+  static const int COMPAT_VERSION = 1;
+
+public:
+  PGMapDigest digest;
+
+  MMonMgrReport()
+    : PaxosServiceMessage(MSG_MON_MGR_REPORT, 0, HEAD_VERSION, COMPAT_VERSION)
+  {}
+
+private:
+  ~MMonMgrReport() {}
+
+public:
+  const char *get_type_name() const { return "monmgrreport"; }
+
+  void print(ostream& out) const {
+    out << get_type_name() << "(pgmap v" << digest.version << ", "
+        << digest.num_pg << " pgs)";
+  }
+
+  void encode_payload(uint64_t features) {
+    paxos_encode();
+    ::encode(digest, payload, features);
+  }
+  void decode_payload() {
+    bufferlist::iterator p = payload.begin();
+    paxos_decode(p);
+    ::decode(digest, p);
+  }
+};
+
+#endif
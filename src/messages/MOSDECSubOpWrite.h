@@ -55,7 +55,12 @@ public:
   virtual void encode_payload(uint64_t features) {
     ::encode(pgid, payload);
     ::encode(map_epoch, payload);
-    ::encode(op, payload);
+    uint32_t t_off = 0;
+    op.encode(payload, &t_off);
+    // the shard data travels in the front; hint the receiver how to
+    // align it so the largest write reaches the store page aligned
+    if (op.t.get_data_length())
+      header.data_off = (0 - (t_off + op.t.get_data_offset())) & ~CEPH_PAGE_MASK;
   }
 
   const char *get_type_name() const { return "MOSDECSubOpWrite"; }
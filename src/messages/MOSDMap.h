@@ -19,10 +19,12 @@
 #include "msg/Message.h"
 #include "osd/OSDMap.h"
 #include "include/ceph_features.h"
+#include "compressor/Compressor.h"
 
 class MOSDMap : public Message {
 
-  static const int HEAD_VERSION = 3;
+  static const int HEAD_VERSION = 4;
+  static const int COMPAT_VERSION = 3;
 
  public:
   uuid_d fsid;
@@ -30,6 +32,11 @@ class MOSDMap : public Message {
   map<epoch_t, bufferlist> incremental_maps;
   epoch_t oldest_map, newest_map;
 
+  /// if set, maps that encode to at least compress_min_size bytes are
+  /// sent compressed to peers with CEPH_FEATURE_MOSDMAP_COMPACT
+  CompressorRef compressor;
+  uint32_t compress_min_size = 0;
+
   epoch_t get_first() const {
     epoch_t e = 0;
     map<epoch_t, bufferlist>::const_iterator i = maps.begin();
@@ -78,6 +85,22 @@ public:
       oldest_map = 0;
       newest_map = 0;
     }
+    if (header.version >= 4) {
+      __u8 alg;
+      ::decode(alg, p);
+      if (alg != Compressor::COMP_ALG_NONE) {
+	bufferlist compressed, bl;
+	::decode(compressed, p);
+	CompressorRef c;
+	if (get_cct())
+	  c = Compressor::create(get_cct(), alg);
+	if (!c || c->decompress(compressed, bl) < 0)
+	  throw buffer::malformed_input("unable to decompress osdmaps");
+	bufferlist::iterator q = bl.begin();
+	::decode(incremental_maps, q);
+	::decode(maps, q);
+      }
+    }
   }
   void encode_payload(uint64_t features) {
     header.version = HEAD_VERSION;
@@ -123,12 +146,39 @@ public:
 	m.encode(p->second, features | CEPH_FEATURE_RESERVED);
       }
     }
-    ::encode(incremental_maps, payload);
-    ::encode(maps, payload);
+    if (header.version == HEAD_VERSION)
+      header.compat_version = COMPAT_VERSION;
+    bufferlist compressed;
+    if (compressor && (features & CEPH_FEATURE_MOSDMAP_COMPACT)) {
+      bufferlist bl;
+      ::encode(incremental_maps, bl);
+      ::encode(maps, bl);
+      if (bl.length() < compress_min_size ||
+	  compressor->compress(bl, compressed) < 0 ||
+	  compressed.length() >= bl.length())
+	compressed.clear();
+    }
+    if (compressed.length()) {
+      ::encode(map<epoch_t, bufferlist>(), payload);
+      ::encode(map<epoch_t, bufferlist>(), payload);
+    } else {
+      ::encode(incremental_maps, payload);
+      ::encode(maps, payload);
+    }
     if (header.version >= 2) {
       ::encode(oldest_map, payload);
       ::encode(newest_map, payload);
     }
+    if (header.version >= 4) {
+      // older decoders stop before this; the maps are only ever
+      // compressed for peers that know to look here
+      if (compressed.length()) {
+	::encode((__u8)compressor->get_type(), payload);
+	::encode(compressed, payload);
+      } else {
+	::encode((__u8)Compressor::COMP_ALG_NONE, payload);
+      }
+    }
   }
 
   const char *get_type_name() const { return "omap"; }
@@ -377,6 +377,7 @@ struct ceph_osd_request_head {
 
       ::encode(retry_attempt, payload);
       ::encode(features, payload);
+      encode_trace(payload);
     }
   }
 
@@ -542,6 +543,8 @@ struct ceph_osd_request_head {
     ::decode(retry_attempt, p);
 
     ::decode(features, p);
+    if (header.version == HEAD_VERSION)
+      decode_trace(p);
 
     hobj.pool = pgid.pgid.pool();
     hobj.set_key(oloc.key);
@@ -100,6 +100,7 @@ public:
     ::decode(from, p);
     ::decode(updated_hit_set_history, p);
     ::decode(pg_roll_forward_to, p);
+    decode_trace(p);
     final_decode_needed = false;
   }
 
@@ -119,6 +120,7 @@ public:
     ::encode(from, payload);
     ::encode(updated_hit_set_history, payload);
     ::encode(pg_roll_forward_to, payload);
+    encode_trace(payload);
   }
 
   MOSDRepOp()
@@ -0,0 +1,86 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2004-2006 Sage Weil <sage@newdream.net>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_MOSDREPOPBATCH_H
+#define CEPH_MOSDREPOPBATCH_H
+
+#include "msg/Message.h"
+
+/*
+ * several MOSDRepOps for (possibly) different pgs bound for the same
+ * peer, in the order they were queued
+ */
+
+class MOSDRepOpBatch : public Message {
+
+  static const int HEAD_VERSION = 1;
+  static const int COMPAT_VERSION = 1;
+
+public:
+  epoch_t map_epoch;
+  list<Message*> ops;
+
+  MOSDRepOpBatch()
+    : Message(MSG_OSD_REPOP_BATCH, HEAD_VERSION, COMPAT_VERSION),
+      map_epoch(0) {}
+  explicit MOSDRepOpBatch(epoch_t e)
+    : Message(MSG_OSD_REPOP_BATCH, HEAD_VERSION, COMPAT_VERSION),
+      map_epoch(e) {}
+
+private:
+  ~MOSDRepOpBatch() override {
+    for (auto m : ops)
+      m->put();
+  }
+
+public:
+  /// take the contained ops, with our source and connection
+  void claim_ops(list<Message*> *out) {
+    for (auto m : ops) {
+      m->get_header().src = get_header().src;
+      m->set_connection(get_connection());
+      m->set_recv_stamp(get_recv_stamp());
+      m->set_throttle_stamp(get_throttle_stamp());
+      m->set_recv_complete_stamp(get_recv_complete_stamp());
+    }
+    out->splice(out->end(), ops);
+  }
+
+  const char *get_type_name() const override { return "osd_repop_batch"; }
+  void print(ostream& out) const override {
+    out << "osd_repop_batch(" << ops.size() << " ops e" << map_epoch << ")";
+  }
+
+  void encode_payload(uint64_t features) override {
+    ::encode(map_epoch, payload);
+    __u32 n = ops.size();
+    ::encode(n, payload);
+    for (auto m : ops)
+      encode_message(m, features, payload);
+  }
+  void decode_payload() override {
+    bufferlist::iterator p = payload.begin();
+    ::decode(map_epoch, p);
+    __u32 n;
+    ::decode(n, p);
+    while (n--) {
+      Message *m = decode_message(NULL, 0, p);
+      if (!m)
+	throw buffer::malformed_input("bad op in osd_repop_batch");
+      ops.push_back(m);
+    }
+  }
+};
+
+#endif
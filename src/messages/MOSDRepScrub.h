@@ -24,7 +24,7 @@
 
 struct MOSDRepScrub : public MOSDFastDispatchOp {
 
-  static const int HEAD_VERSION = 6;
+  static const int HEAD_VERSION = 7;
   static const int COMPAT_VERSION = 2;
 
   spg_t pgid;             // PG to scrub
@@ -36,6 +36,7 @@ struct MOSDRepScrub : public MOSDFastDispatchOp {
   hobject_t end;         // upper bound of scrub, exclusive
   bool deep;             // true if scrub should be deep
   uint32_t seed;         // seed value for digest calculation
+  eversion_t skip_unchanged_to; // deep scrub need not hash objects at or before
 
   epoch_t get_map_epoch() const override {
     return map_epoch;
@@ -75,6 +76,7 @@ public:
         << ",chunky:" << chunky
         << ",deep:" << deep
 	<< ",seed:" << seed
+	<< ",skip_unchanged_to:" << skip_unchanged_to
         << ",version:" << header.version;
     out << ")";
   }
@@ -90,6 +92,7 @@ public:
     ::encode(deep, payload);
     ::encode(pgid.shard, payload);
     ::encode(seed, payload);
+    ::encode(skip_unchanged_to, payload);
   }
   void decode_payload() {
     bufferlist::iterator p = payload.begin();
@@ -122,6 +125,9 @@ public:
     } else {
       seed = 0;
     }
+    if (header.version >= 7) {
+      ::decode(skip_unchanged_to, p);
+    }
   }
 };
 
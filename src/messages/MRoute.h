@@ -62,9 +62,9 @@ public:
       bool m;
       ::decode(m, p);
       if (m)
-	msg = decode_message(NULL, 0, p);
+	msg = decode_message(get_cct(), 0, p);
     } else {
-      msg = decode_message(NULL, 0, p);
+      msg = decode_message(get_cct(), 0, p);
     }
     if (header.version >= 3) {
       ::decode(send_osdmap_first, p);
@@ -50,6 +50,17 @@ void ClusterState::ingest_pgstats(MPGStats *stats)
   Mutex::Locker l(lock);
   PGMap::Incremental pending_inc;
   pending_inc.version = pg_map.version + 1; // to make apply_incremental happy
+  pending_inc.stamp = ceph_clock_now();
+
+  // the mon's pg_map gets these once, from its config at creation; follow
+  // the config here so that the full sets we report to the mon match
+  float full_ratio = g_conf->mon_osd_full_ratio;
+  if (full_ratio > 1.0)
+    full_ratio /= 100.0;
+  float nearfull_ratio = g_conf->mon_osd_nearfull_ratio;
+  if (nearfull_ratio > 1.0)
+    nearfull_ratio /= 100.0;
+  pg_map.set_full_ratios(full_ratio, nearfull_ratio);
 
   const int from = stats->get_orig_source().num();
   bool is_in = false;
@@ -93,6 +104,14 @@ void ClusterState::ingest_pgstats(MPGStats *stats)
   pg_map.apply_incremental(g_ceph_context, pending_inc);
 }
 
+void ClusterState::get_pg_digest(PGMapDigest *d)
+{
+  Mutex::Locker l(lock);
+  utime_t cutoff = ceph_clock_now();
+  cutoff -= g_conf->mon_pg_stuck_threshold;
+  pg_map.get_digest(d, cutoff);
+}
+
 void ClusterState::notify_osdmap(const OSDMap &osd_map)
 {
   Mutex::Locker l(lock);
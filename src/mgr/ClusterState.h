@@ -60,6 +60,8 @@ public:
 
   void load_digest(MMgrDigest *m);
   void ingest_pgstats(MPGStats *stats);
+  /// the aggregates the mon needs when it leaves the pg stats to us
+  void get_pg_digest(PGMapDigest *d);
 
   const bufferlist &get_health() const {return health_json;}
   const bufferlist &get_mon_status() const {return mon_status_json;}
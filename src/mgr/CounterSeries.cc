@@ -0,0 +1,192 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "CounterSeries.h"
+
+#include "common/config.h"
+#include "global/global_context.h"
+
+static void put_varint(std::string *s, int64_t v)
+{
+  uint64_t z = (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63);
+  while (z >= 0x80) {
+    s->push_back(static_cast<char>(0x80 | (z & 0x7f)));
+    z >>= 7;
+  }
+  s->push_back(static_cast<char>(z));
+}
+
+static int64_t get_varint(const char **p)
+{
+  uint64_t z = 0;
+  unsigned shift = 0;
+  uint8_t b;
+  do {
+    b = static_cast<uint8_t>(*(*p)++);
+    z |= static_cast<uint64_t>(b & 0x7f) << shift;
+    shift += 7;
+  } while (b & 0x80);
+  return static_cast<int64_t>(z >> 1) ^ -static_cast<int64_t>(z & 1);
+}
+
+static int64_t to_ms(utime_t t)
+{
+  return static_cast<int64_t>(t.sec()) * 1000 + t.usec() / 1000;
+}
+
+static utime_t from_ms(int64_t ms)
+{
+  return utime_t(ms / 1000, (ms % 1000) * 1000000);  // ns
+}
+
+void CounterSeries::Chunk::append(utime_t t, uint64_t v)
+{
+  const int64_t ms = to_ms(t);
+  if (count == 0) {
+    first = t;
+    put_varint(&data, ms);
+    put_varint(&data, static_cast<int64_t>(v));
+    prev_dt = 0;
+  } else {
+    const int64_t dt = ms - prev_t;
+    put_varint(&data, dt - prev_dt);
+    put_varint(&data, static_cast<int64_t>(v - prev_v));
+    prev_dt = dt;
+  }
+  prev_t = ms;
+  prev_v = v;
+  last = t;
+  ++count;
+}
+
+void CounterSeries::Chunk::decode(utime_t from, utime_t to,
+                                  std::vector<Sample> *out) const
+{
+  if (last < from || first > to) {
+    return;
+  }
+  const char *p = data.data();
+  int64_t ms = 0, dt = 0;
+  uint64_t v = 0;
+  for (unsigned i = 0; i < count; ++i) {
+    if (i == 0) {
+      ms = get_varint(&p);
+      v = static_cast<uint64_t>(get_varint(&p));
+    } else {
+      dt += get_varint(&p);
+      ms += dt;
+      v += static_cast<uint64_t>(get_varint(&p));
+    }
+    const utime_t t = from_ms(ms);
+    if (t > to) {
+      break;
+    }
+    if (t >= from) {
+      out->push_back({t, v});
+    }
+  }
+}
+
+void CounterSeries::Tier::append(utime_t t, uint64_t v)
+{
+  if (chunks.empty() || chunks.back().count >= Chunk::MAX_SAMPLES) {
+    chunks.emplace_back();
+  }
+  chunks.back().append(t, v);
+
+  utime_t cutoff = t;
+  cutoff -= retention;
+  while (chunks.size() > 1 && chunks.front().last < cutoff) {
+    chunks.pop_front();
+  }
+}
+
+CounterSeries::CounterSeries()
+{
+  if (g_conf->mgr_counter_history_raw > 0) {
+    tiers.emplace_back(0, g_conf->mgr_counter_history_raw);
+  }
+  if (g_conf->mgr_counter_history_minutes > 0) {
+    tiers.emplace_back(60, g_conf->mgr_counter_history_minutes);
+  }
+  if (g_conf->mgr_counter_history_hours > 0) {
+    tiers.emplace_back(3600, g_conf->mgr_counter_history_hours);
+  }
+}
+
+void CounterSeries::push(utime_t t, uint64_t v)
+{
+  for (auto &tier : tiers) {
+    if (tier.period == 0) {
+      tier.append(t, v);
+      continue;
+    }
+    const uint64_t period = t.sec() / tier.period;
+    if (tier.have_pending && period != tier.pending_period) {
+      tier.append(utime_t(tier.pending_period * tier.period, 0),
+                  tier.pending_v);
+    }
+    tier.have_pending = true;
+    tier.pending_period = period;
+    tier.pending_v = v;
+  }
+}
+
+void CounterSeries::get(utime_t from, utime_t to, uint32_t period,
+                        std::vector<Sample> *out) const
+{
+  const Tier *best = nullptr;
+  utime_t best_first;
+  for (const auto &tier : tiers) {
+    if (tier.period < period) {
+      continue;
+    }
+    utime_t first;
+    if (!tier.chunks.empty()) {
+      first = tier.chunks.front().first;
+    } else if (tier.have_pending) {
+      first = utime_t(tier.pending_period * tier.period, 0);
+    } else {
+      continue;
+    }
+    if (best == nullptr || first < best_first) {
+      best = &tier;
+      best_first = first;
+    }
+    if (first <= from) {
+      break;
+    }
+  }
+  if (best == nullptr) {
+    return;
+  }
+
+  for (const auto &c : best->chunks) {
+    c.decode(from, to, out);
+  }
+  if (best->have_pending) {
+    const utime_t t(best->pending_period * best->period, 0);
+    if (t >= from && t <= to) {
+      out->push_back({t, best->pending_v});
+    }
+  }
+}
+
+size_t CounterSeries::get_bytes() const
+{
+  size_t r = 0;
+  for (const auto &tier : tiers) {
+    for (const auto &c : tier.chunks) {
+      r += c.data.size();
+    }
+  }
+  return r;
+}
@@ -0,0 +1,94 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef COUNTER_SERIES_H_
+#define COUNTER_SERIES_H_
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "include/utime.h"
+
+/**
+ * The history of one perf counter's values, kept at several
+ * resolutions: as reported, one sample a minute and one an hour, each
+ * for as long as the mgr_counter_history_* options say.
+ *
+ * Each coarser resolution keeps the last value reported in each of its
+ * periods, which is exact for the cumulative counters that make up most
+ * of the perf counters (rates come out of differences the same way they
+ * do at full resolution) and a point sample for gauges.
+ *
+ * Samples are stored compressed in chunks, Gorilla-style but byte
+ * aligned: the timestamp as the difference from the previous
+ * difference, the value as the difference from the previous value,
+ * both as zigzag varints.  A counter sampled at a regular interval that
+ * moves by less than 64 per sample costs two bytes a sample.
+ */
+class CounterSeries
+{
+  public:
+  struct Sample {
+    utime_t t;
+    uint64_t v;
+  };
+
+  CounterSeries();
+
+  void push(utime_t t, uint64_t v);
+
+  /**
+   * Append the samples between @p from and @p to (inclusive) to @p out,
+   * in time order, from the finest resolution of at least @p period
+   * seconds that goes back to @p from (or else the one going back
+   * furthest).
+   */
+  void get(utime_t from, utime_t to, uint32_t period,
+           std::vector<Sample> *out) const;
+
+  /// bytes used by the compressed samples
+  size_t get_bytes() const;
+
+  private:
+  struct Chunk {
+    static const unsigned MAX_SAMPLES = 120;
+
+    utime_t first;
+    utime_t last;
+    unsigned count = 0;
+    std::string data;
+    // the state the next sample is encoded against
+    int64_t prev_t = 0;   ///< ms
+    int64_t prev_dt = 0;
+    uint64_t prev_v = 0;
+
+    void append(utime_t t, uint64_t v);
+    void decode(utime_t from, utime_t to, std::vector<Sample> *out) const;
+  };
+
+  struct Tier {
+    uint32_t period;      ///< seconds, 0 for every reported value
+    uint32_t retention;   ///< seconds
+    std::deque<Chunk> chunks;
+
+    // the last value reported in the current period, not yet in chunks
+    bool have_pending = false;
+    uint64_t pending_period = 0;
+    uint64_t pending_v = 0;
+
+    Tier(uint32_t p, uint32_t r) : period(p), retention(r) {}
+    void append(utime_t t, uint64_t v);
+  };
+  std::vector<Tier> tiers;
+};
+
+#endif
@@ -14,12 +14,14 @@
 #include "DaemonServer.h"
 
 #include "auth/RotatingKeyRing.h"
+#include "include/str_list.h"
 
 #include "messages/MMgrOpen.h"
 #include "messages/MMgrConfigure.h"
 #include "messages/MCommand.h"
 #include "messages/MCommandReply.h"
 #include "messages/MPGStats.h"
+#include "messages/MMonMgrReport.h"
 
 #define dout_context g_ceph_context
 #define dout_subsys ceph_subsys_mgr
@@ -151,6 +153,18 @@ bool DaemonServer::ms_dispatch(Message *m)
   };
 }
 
+/**
+ * With mon_pg_stats_via_mgr, tell the mon the cluster-wide pg stats
+ * it would otherwise have aggregated itself.
+ */
+void DaemonServer::send_report()
+{
+  auto m = new MMonMgrReport();
+  cluster_state.get_pg_digest(&m->digest);
+  dout(10) << *m << dendl;
+  monc->send_mon_message(m);
+}
+
 void DaemonServer::shutdown()
 {
   msgr->shutdown();
@@ -170,6 +184,8 @@ bool DaemonServer::handle_open(MMgrOpen *m)
 
   auto configure = new MMgrConfigure();
   configure->stats_period = g_conf->mgr_stats_period;
+  configure->compact_reports = true;
+  get_str_vec(g_conf->mgr_stats_filter, configure->stats_filter);
   m->get_connection()->send_message(configure);
 
   if (daemon_state.exists(key)) {
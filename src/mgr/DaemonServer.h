@@ -80,6 +80,8 @@ public:
   bool handle_open(MMgrOpen *m);
   bool handle_report(MMgrReport *m);
   bool handle_command(MCommand *m);
+
+  void send_report();
 };
 
 #endif
@@ -118,26 +118,89 @@ void DaemonPerfCounters::update(MMgrReport *report)
     declared_types.insert(t.path);
   }
 
+  if (!report->declare_types.empty()) {
+    // both are sorted by path, so the values received so far carry over
+    // in one pass
+    std::vector<DeclaredCounter> old;
+    old.swap(declared);
+    declared.reserve(declared_types.size());
+    auto o = old.begin();
+    for (const auto &t_path : declared_types) {
+      DeclaredCounter c;
+      if (o != old.end() && o->type->path == t_path) {
+        c = *o++;
+      } else {
+        c.type = &types.at(t_path);
+        c.instance = &instances[t_path];
+      }
+      declared.push_back(c);
+    }
+  }
+
   const auto now = ceph_clock_now();
 
   // Parse packed data according to declared set of types
   bufferlist::iterator p = report->packed.begin();
-  DECODE_START(1, p);
-  for (const auto &t_path : declared_types) {
-    const auto &t = types.at(t_path);
-    uint64_t val = 0;
-    uint64_t avgcount = 0;
-    uint64_t avgcount2 = 0;
-
-    ::decode(val, p);
-    if (t.type & PERFCOUNTER_LONGRUNAVG) {
-      ::decode(avgcount, p);
-      ::decode(avgcount2, p);
+  DECODE_START(2, p);
+  if (struct_v >= 2) {
+    bufferlist deltas;
+    ::decode(deltas, p);
+    if (!declared.empty()) {
+      deltas.c_str();  // contiguous, for the varint decoders
+      auto dp = deltas.buffers().front().begin();
+      for (auto &c : declared) {
+        int64_t d;
+        denc_signed_varint(d, dp);
+        c.value += d;
+        if (c.type->type & PERFCOUNTER_LONGRUNAVG) {
+          denc_signed_varint(d, dp);
+          c.avgcount += d;
+        }
+        // TODO: interface for insertion of avgs
+        c.instance->push(now, c.value);
+      }
+    }
+  } else {
+    for (auto &c : declared) {
+      uint64_t avgcount2 = 0;
+      ::decode(c.value, p);
+      if (c.type->type & PERFCOUNTER_LONGRUNAVG) {
+        ::decode(c.avgcount, p);
+        ::decode(avgcount2, p);
+      }
+      // TODO: interface for insertion of avgs
+      c.instance->push(now, c.value);
     }
-    // TODO: interface for insertion of avgs
-    instances[t_path].push(now, val);
   }
   DECODE_FINISH(p);
+
+  // Histograms, if the daemon sent any
+  if (report->packed_histograms.length()) {
+    bufferlist::iterator hp = report->packed_histograms.begin();
+    DECODE_START(1, hp);
+    for (const auto &c : declared) {
+      const auto &t = *c.type;
+      const auto &t_path = t.path;
+      if (!(t.type & PERFCOUNTER_HISTOGRAM)) {
+        continue;
+      }
+      std::vector<std::pair<uint32_t, uint64_t>> buckets;
+      ::decode(buckets, hp);
+
+      size_t size = 1;
+      for (const auto &axis : t.axes) {
+        size *= axis.buckets;
+      }
+      auto &h = histograms[t_path];
+      h.assign(size, 0);
+      for (const auto &b : buckets) {
+        if (b.first < size) {
+          h[b.first] = b.second;
+        }
+      }
+    }
+    DECODE_FINISH(hp);
+  }
 }
 
 uint64_t PerfCounterInstance::get_current() const
@@ -148,5 +211,6 @@ uint64_t PerfCounterInstance::get_current() const
 void PerfCounterInstance::push(utime_t t, uint64_t const &v)
 {
   buffer.push_back({t, v});
+  history.push(t, v);
 }
 
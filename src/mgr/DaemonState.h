@@ -24,6 +24,8 @@
 
 #include "msg/msg_types.h"
 
+#include "CounterSeries.h"
+
 // For PerfCounterType
 #include "messages/MMgrReport.h"
 
@@ -48,11 +50,18 @@ class PerfCounterInstance
   boost::circular_buffer<DataPoint> buffer;
   uint64_t get_current() const;
 
+  // longer history, downsampled
+  CounterSeries history;
+
   public:
   const boost::circular_buffer<DataPoint> & get_data() const
   {
     return buffer;
   }
+  const CounterSeries &get_history() const
+  {
+    return history;
+  }
   void push(utime_t t, uint64_t const &v);
   PerfCounterInstance()
     : buffer(20) {}
@@ -74,18 +83,35 @@ class DaemonPerfCounters
 
   std::map<std::string, PerfCounterInstance> instances;
 
+  // Latest values of histogram counters, in the layout of
+  // PerfHistogram's raw data (first axis most significant)
+  std::map<std::string, std::vector<uint64_t>> histograms;
+
   // FIXME: this state is really local to DaemonServer, it's part
   // of the protocol rather than being part of what other classes
   // mgiht want to read.  Maybe have a separate session object
   // inside DaemonServer instead of stashing session-ish state here?
   std::set<std::string> declared_types;
 
+  // declared_types in the order their values arrive, resolved once per
+  // declaration instead of looked up by path on every report, with the
+  // values last received (compact reports send differences)
+  struct DeclaredCounter {
+    const PerfCounterType *type;
+    PerfCounterInstance *instance;
+    uint64_t value = 0;
+    uint64_t avgcount = 0;
+  };
+  std::vector<DeclaredCounter> declared;
+
   void update(MMgrReport *report);
 
   void clear()
   {
     instances.clear();
+    histograms.clear();
     declared_types.clear();
+    declared.clear();
   }
 };
 
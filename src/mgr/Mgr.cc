@@ -205,11 +205,27 @@ void Mgr::init()
   py_modules.init();
   py_modules.start();
 
+  timer.init();
+  tick();
+
   dout(4) << "Complete." << dendl;
   initializing = false;
   initialized = true;
 }
 
+void Mgr::tick()
+{
+  assert(lock.is_locked_by_me());
+  if (g_conf->mon_pg_stats_via_mgr) {
+    server.send_report();
+  }
+  timer.add_event_after(g_conf->mgr_mon_report_interval, new FunctionContext(
+        [this](int r){
+          tick();
+        }
+  ));
+}
+
 void Mgr::load_all_metadata()
 {
   assert(lock.is_locked_by_me());
@@ -338,6 +354,8 @@ void Mgr::shutdown()
   // give up the lock for us.
   Mutex::Locker l(lock);
 
+  timer.shutdown();
+
   // First stop the server so that we're not taking any more incoming requests
   server.shutdown();
 
@@ -64,6 +64,7 @@ protected:
   void load_config();
   void load_all_metadata();
   void init();
+  void tick();
 
   bool initialized;
   bool initializing;
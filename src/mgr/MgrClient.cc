@@ -12,6 +12,8 @@
  */
 
 
+#include <algorithm>
+
 #include "MgrClient.h"
 
 #include "mgr/MgrContext.h"
@@ -189,6 +191,14 @@ void MgrClient::send_report()
         auto data = *(i.second);
         
         if (session->declared.count(path) == 0) {
+          if (!session->stats_filter.empty() &&
+              std::none_of(session->stats_filter.begin(),
+                           session->stats_filter.end(),
+                           [&path](const std::string &prefix) {
+                             return path.compare(0, prefix.size(), prefix) == 0;
+                           })) {
+            continue;
+          }
           PerfCounterType type;
           type.path = path;
           if (data.description) {
@@ -198,8 +208,13 @@ void MgrClient::send_report()
             type.nick = data.nick;
           }
           type.type = data.type;
+          if (data.histogram) {
+            for (const auto &ac : data.histogram->get_axes_config()) {
+              type.axes.push_back(PerfHistogramAxisType(ac));
+            }
+          }
           report->declare_types.push_back(std::move(type));
-          session->declared.insert(path);
+          session->declared[path] = std::make_pair(0, 0);
         }
       }
     }
@@ -207,22 +222,75 @@ void MgrClient::send_report()
     ldout(cct, 20) << by_path.size() << " counters, of which "
              << report->declare_types.size() << " new" << dendl;
 
-    ENCODE_START(1, 1, report->packed);
-    for (const auto &path : session->declared) {
-      auto data = by_path.at(path);
-      ::encode(static_cast<uint64_t>(data->u64.read()),
-          report->packed);
-      if (data->type & PERFCOUNTER_LONGRUNAVG) {
-        ::encode(static_cast<uint64_t>(data->avgcount.read()),
-            report->packed);
-        ::encode(static_cast<uint64_t>(data->avgcount2.read()),
-            report->packed);
+    if (session->compact_reports) {
+      // most counters barely move between reports, so the differences
+      // fit in a byte or two
+      bufferlist deltas;
+      {
+        auto app = deltas.get_contiguous_appender(
+          session->declared.size() * 2 * (sizeof(uint64_t) + 2));
+        for (auto &i : session->declared) {
+          auto data = by_path.at(i.first);
+          auto &last = i.second;
+          if (data->type & PERFCOUNTER_LONGRUNAVG) {
+            pair<uint64_t,uint64_t> a = data->read_avg();
+            denc_signed_varint((int64_t)(a.first - last.first), app);
+            denc_signed_varint((int64_t)(a.second - last.second), app);
+            last = a;
+          } else {
+            uint64_t v = data->read_u64();
+            denc_signed_varint((int64_t)(v - last.first), app);
+            last.first = v;
+          }
+        }
+      }
+      ENCODE_START(2, 2, report->packed);
+      ::encode(deltas, report->packed);
+      ENCODE_FINISH(report->packed);
+    } else {
+      ENCODE_START(1, 1, report->packed);
+      for (auto &i : session->declared) {
+        auto data = by_path.at(i.first);
+        if (data->type & PERFCOUNTER_LONGRUNAVG) {
+          pair<uint64_t,uint64_t> a = data->read_avg();
+          ::encode(a.first, report->packed);
+          ::encode(a.second, report->packed);
+          ::encode(a.second, report->packed);
+          i.second = a;
+        } else {
+          uint64_t v = data->read_u64();
+          ::encode(v, report->packed);
+          i.second.first = v;
+        }
+      }
+      ENCODE_FINISH(report->packed);
+    }
+
+    if (cct->_conf->mgr_stats_histograms) {
+      // only the non-zero buckets; most of a latency x size histogram
+      // is never hit
+      ENCODE_START(1, 1, report->packed_histograms);
+      for (const auto &i : session->declared) {
+        auto data = by_path.at(i.first);
+        if (!data->histogram) {
+          continue;
+        }
+        std::vector<std::pair<uint32_t, uint64_t>> buckets;
+        for (int64_t i = 0; i < data->histogram->get_raw_size(); ++i) {
+          uint64_t v = data->histogram->read_raw(i);
+          if (v) {
+            buckets.push_back(std::make_pair((uint32_t)i, v));
+          }
+        }
+        ::encode(buckets, report->packed_histograms);
       }
+      ENCODE_FINISH(report->packed_histograms);
     }
-    ENCODE_FINISH(report->packed);
   });
 
-  ldout(cct, 20) << "encoded " << report->packed.length() << " bytes" << dendl;
+  ldout(cct, 20) << "encoded " << report->packed.length() << " bytes, "
+                 << report->packed_histograms.length() << " bytes of histograms"
+                 << dendl;
 
   report->daemon_name = g_conf->name.get_id();
 
@@ -255,6 +323,8 @@ bool MgrClient::handle_mgr_configure(MMgrConfigure *m)
 
   bool starting = (stats_period == 0) && (m->stats_period != 0);
   stats_period = m->stats_period;
+  session->compact_reports = m->compact_reports;
+  session->stats_filter = m->stats_filter;
   if (starting) {
     send_report();
   }
@@ -32,8 +32,13 @@ class MPGStats;
 class MgrSessionState
 {
   public:
-  // Which performance counters have we already transmitted schema for?
-  std::set<std::string> declared;
+  // Which performance counters have we already transmitted schema for,
+  // and the values (and average counts) last sent for them?
+  std::map<std::string, std::pair<uint64_t, uint64_t>> declared;
+
+  // From the mgr's MMgrConfigure
+  bool compact_reports = false;
+  std::vector<std::string> stats_filter;
 
   // Our connection to the mgr
   ConnectionRef con;
@@ -111,27 +111,58 @@ PyObject *PyModules::get_metadata_python(std::string const &handle,
 }
 
 
-PyObject *PyModules::get_python(const std::string &what)
+bool PyModules::dump(const std::string &what, std::string *out)
 {
-  PyThreadState *tstate = PyEval_SaveThread();
-  Mutex::Locker l(lock);
-  PyEval_RestoreThread(tstate);
+  assert(lock.is_locked_by_me());
 
+  // The versions of the maps the result is rendered from, if it is only
+  // rendered from maps
+  std::string version;
   if (what == "fs_map") {
-    PyFormatter f;
-    cluster_state.with_fsmap([&f](const FSMap &fsmap) {
-      fsmap.dump(&f);
+    cluster_state.with_fsmap([&version](const FSMap &fsmap) {
+      version = stringify(fsmap.get_epoch());
+    });
+  } else if (what == "mon_map") {
+    cluster_state.with_monmap([&version](const MonMap &monmap) {
+      version = stringify(monmap.get_epoch());
+    });
+  } else if (what.substr(0, 7) == "osd_map" ||
+             what == "osdmap_crush_map_text" || what == "df") {
+    cluster_state.with_osdmap([&version](const OSDMap &osd_map) {
+      version = stringify(osd_map.get_epoch());
     });
-    return f.get();
-  } else if (what == "osdmap_crush_map_text") {
+  }
+  if (what == "df" || what == "pg_summary" || what == "osd_stats" ||
+      what == "pg_stats") {
+    cluster_state.with_pgmap([&version](const PGMap &pg_map) {
+      version += "/" + stringify(pg_map.version);
+    });
+  }
+  if (!version.empty()) {
+    auto i = dump_cache.find(what);
+    if (i != dump_cache.end() && i->second.first == version) {
+      *out = i->second.second;
+      return true;
+    }
+  }
+
+  if (what == "osdmap_crush_map_text") {
     bufferlist rdata;
     cluster_state.with_osdmap([&rdata](const OSDMap &osd_map){
-	osd_map.crush->encode(rdata, CEPH_FEATURES_SUPPORTED_DEFAULT);
+      osd_map.crush->encode(rdata, CEPH_FEATURES_SUPPORTED_DEFAULT);
+    });
+    *out = rdata.to_str();
+    dump_cache[what] = std::make_pair(version, *out);
+    return true;
+  }
+
+  JSONFormatter f;
+  f.open_object_section(what.c_str());
+  if (what == "fs_map") {
+    cluster_state.with_fsmap([&f](const FSMap &fsmap) {
+      fsmap.dump(&f);
     });
-    std::string crush_text = rdata.to_str();
-    return PyString_FromString(crush_text.c_str());
   } else if (what.substr(0, 7) == "osd_map") {
-    PyFormatter f;
     cluster_state.with_osdmap([&f, &what](const OSDMap &osd_map){
       if (what == "osd_map") {
         osd_map.dump(&f);
@@ -141,21 +172,15 @@ PyObject *PyModules::get_python(const std::string &what)
         osd_map.crush->dump(&f);
       }
     });
-    return f.get();
   } else if (what == "config") {
-    PyFormatter f;
     g_conf->show_config(&f);
-    return f.get();
   } else if (what == "mon_map") {
-    PyFormatter f;
     cluster_state.with_monmap(
       [&f](const MonMap &monmap) {
         monmap.dump(&f);
       }
     );
-    return f.get();
   } else if (what == "osd_metadata") {
-    PyFormatter f;
     auto dmc = daemon_state.get_by_type(CEPH_ENTITY_TYPE_OSD);
     for (const auto &i : dmc) {
       f.open_object_section(i.first.second.c_str());
@@ -165,9 +190,7 @@ PyObject *PyModules::get_python(const std::string &what)
       }
       f.close_section();
     }
-    return f.get();
   } else if (what == "pg_summary") {
-    PyFormatter f;
     cluster_state.with_pgmap(
         [&f](const PGMap &pg_map) {
           std::map<std::string, std::map<std::string, uint32_t> > osds;
@@ -208,11 +231,7 @@ PyObject *PyModules::get_python(const std::string &what)
           f.close_section();
         }
     );
-    return f.get();
-
   } else if (what == "df") {
-    PyFormatter f;
-
     cluster_state.with_osdmap([this, &f](const OSDMap &osd_map){
       cluster_state.with_pgmap(
           [&osd_map, &f](const PGMap &pg_map) {
@@ -220,16 +239,44 @@ PyObject *PyModules::get_python(const std::string &what)
         pg_map.dump_pool_stats(osd_map, nullptr, &f, true);
       });
     });
-    return f.get();
+  } else if (what == "pg_stats") {
+    // the brief form of pg dump: enough to see where data is and
+    // how much of it moves
+    cluster_state.with_pgmap(
+        [&f](const PGMap &pg_map) {
+      f.open_array_section("pg_stats");
+      for (const auto &i : pg_map.pg_stat) {
+        f.open_object_section("pg_stat");
+        f.dump_stream("pgid") << i.first;
+        f.dump_string("state", pg_state_string(i.second.state));
+        f.dump_int("num_bytes", i.second.stats.sum.num_bytes);
+        f.dump_int("num_objects", i.second.stats.sum.num_objects);
+        f.dump_int("num_object_copies",
+                   i.second.stats.sum.num_object_copies);
+        f.dump_int("num_objects_misplaced",
+                   i.second.stats.sum.num_objects_misplaced);
+        f.dump_int("num_objects_degraded",
+                   i.second.stats.sum.num_objects_degraded);
+        f.open_array_section("up");
+        for (auto osd : i.second.up) {
+          f.dump_int("osd", osd);
+        }
+        f.close_section();
+        f.open_array_section("acting");
+        for (auto osd : i.second.acting) {
+          f.dump_int("osd", osd);
+        }
+        f.close_section();
+        f.close_section();
+      }
+      f.close_section();
+    });
   } else if (what == "osd_stats") {
-    PyFormatter f;
     cluster_state.with_pgmap(
         [&f](const PGMap &pg_map) {
       pg_map.dump_osd_stats(&f);
     });
-    return f.get();
   } else if (what == "health" || what == "mon_status") {
-    PyFormatter f;
     bufferlist json;
     if (what == "health") {
       json = cluster_state.get_health();
@@ -239,11 +286,53 @@ PyObject *PyModules::get_python(const std::string &what)
       assert(false);
     }
     f.dump_string("json", json.to_str());
-    return f.get();
   } else {
+    return false;
+  }
+  f.close_section();
+
+  std::stringstream ss;
+  f.flush(ss);
+  *out = ss.str();
+  if (!version.empty()) {
+    dump_cache[what] = std::make_pair(version, *out);
+  }
+  return true;
+}
+
+PyObject *PyModules::get_python(const std::string &what)
+{
+  // Render in C++ without the GIL, so other modules keep running, and
+  // without holding any cluster state lock while python objects are
+  // built from the result.
+  std::string data;
+  bool found;
+  PyThreadState *tstate = PyEval_SaveThread();
+  {
+    Mutex::Locker l(lock);
+    found = dump(what, &data);
+  }
+  PyEval_RestoreThread(tstate);
+
+  if (!found) {
     derr << "Python module requested unknown data '" << what << "'" << dendl;
     Py_RETURN_NONE;
   }
+  if (what == "osdmap_crush_map_text") {
+    return PyString_FromString(data.c_str());
+  }
+
+  // every caller gets its own objects, so a module modifying what it
+  // got doesn't affect the others
+  PyObject *json = PyImport_ImportModule("json");
+  if (json == nullptr) {
+    return nullptr;
+  }
+  PyObject *r = PyObject_CallMethod(json, const_cast<char*>("loads"),
+                                    const_cast<char*>("s#"),
+                                    data.data(), (int)data.size());
+  Py_DECREF(json);
+  return r;
 }
 
 //XXX courtesy of http://stackoverflow.com/questions/1418015/how-to-get-python-exception-text
@@ -564,43 +653,192 @@ PyObject* PyModules::get_counter_python(
     const std::string &svc_id,
     const std::string &path)
 {
+  // copy the datapoints out without the GIL, and build the python
+  // objects from the copy without our lock
+  std::vector<std::pair<uint64_t, uint64_t>> points;
   PyThreadState *tstate = PyEval_SaveThread();
-  Mutex::Locker l(lock);
+  {
+    Mutex::Locker l(lock);
+
+    auto metadata = daemon_state.get(DaemonKey(svc_type, svc_id));
+
+    // FIXME: this is unsafe, I need to either be inside DaemonStateIndex's
+    // lock or put a lock on individual DaemonStates
+    if (metadata) {
+      auto i = metadata->perf_counters.instances.find(path);
+      if (i != metadata->perf_counters.instances.end()) {
+        const auto &data = i->second.get_data();
+        points.reserve(data.size());
+        for (const auto &datapoint : data) {
+          points.emplace_back(datapoint.t.sec(), datapoint.v);
+        }
+      } else {
+        dout(4) << "Missing counter: '" << path << "' ("
+                << ceph_entity_type_name(svc_type) << "."
+                << svc_id << ")" << dendl;
+        dout(20) << "Paths are:" << dendl;
+        for (const auto &i : metadata->perf_counters.instances) {
+          dout(20) << i.first << dendl;
+        }
+      }
+    } else {
+      dout(4) << "No daemon state for "
+                << ceph_entity_type_name(svc_type) << "."
+                << svc_id << ")" << dendl;
+    }
+  }
+  PyEval_RestoreThread(tstate);
+
+  PyFormatter f;
+  f.open_array_section(path.c_str());
+  for (const auto &p : points) {
+    f.open_array_section("datapoint");
+    f.dump_unsigned("t", p.first);
+    f.dump_unsigned("v", p.second);
+    f.close_section();
+  }
+  f.close_section();
+  return f.get();
+}
+
+PyObject* PyModules::get_counter_range_python(
+    const std::string &handle,
+    entity_type_t svc_type,
+    const std::string &svc_id,
+    const std::string &path,
+    utime_t from,
+    utime_t to,
+    uint32_t period)
+{
+  std::vector<CounterSeries::Sample> samples;
+  PyThreadState *tstate = PyEval_SaveThread();
+  {
+    Mutex::Locker l(lock);
+
+    // FIXME: same locking caveat as get_counter_python
+    if (daemon_state.exists(DaemonKey(svc_type, svc_id))) {
+      auto metadata = daemon_state.get(DaemonKey(svc_type, svc_id));
+      auto i = metadata->perf_counters.instances.find(path);
+      if (i != metadata->perf_counters.instances.end()) {
+        i->second.get_history().get(from, to, period, &samples);
+      } else {
+        dout(4) << "Missing counter: '" << path << "' ("
+                << ceph_entity_type_name(svc_type) << "."
+                << svc_id << ")" << dendl;
+      }
+    }
+  }
   PyEval_RestoreThread(tstate);
 
   PyFormatter f;
   f.open_array_section(path.c_str());
+  for (const auto &s : samples) {
+    f.open_array_section("datapoint");
+    f.dump_float("t", (double)s.t);
+    f.dump_unsigned("v", s.v);
+    f.close_section();
+  }
+  f.close_section();
+  return f.get();
+}
 
-  auto metadata = daemon_state.get(DaemonKey(svc_type, svc_id));
+PyObject* PyModules::export_counters_python(
+    const std::string &handle,
+    const std::string &prefix,
+    utime_t from,
+    uint32_t period)
+{
+  // daemon name -> path -> samples
+  std::map<std::string,
+           std::map<std::string, std::vector<CounterSeries::Sample>>> r;
+  const utime_t now = ceph_clock_now();
+  PyThreadState *tstate = PyEval_SaveThread();
+  {
+    Mutex::Locker l(lock);
 
-  // FIXME: this is unsafe, I need to either be inside DaemonStateIndex's
-  // lock or put a lock on individual DaemonStates
-  if (metadata) {
-    if (metadata->perf_counters.instances.count(path)) {
-      auto counter_instance = metadata->perf_counters.instances.at(path);
-      const auto &data = counter_instance.get_data();
-      for (const auto &datapoint : data) {
+    // FIXME: same locking caveat as get_counter_python
+    const auto all = daemon_state.get_all();
+    for (const auto &i : all) {
+      auto &daemon = r[std::string(ceph_entity_type_name(i.first.first)) +
+                       "." + i.first.second];
+      for (const auto &j : i.second->perf_counters.instances) {
+        if (j.first.compare(0, prefix.size(), prefix) != 0) {
+          continue;
+        }
+        j.second.get_history().get(from, now, period, &daemon[j.first]);
+      }
+    }
+  }
+  PyEval_RestoreThread(tstate);
+
+  PyFormatter f;
+  for (const auto &i : r) {
+    f.open_object_section(i.first.c_str());
+    for (const auto &j : i.second) {
+      f.open_array_section(j.first.c_str());
+      for (const auto &s : j.second) {
         f.open_array_section("datapoint");
-        f.dump_unsigned("t", datapoint.t.sec());
-        f.dump_unsigned("v", datapoint.v);
+        f.dump_float("t", (double)s.t);
+        f.dump_unsigned("v", s.v);
         f.close_section();
-
       }
-    } else {
-      dout(4) << "Missing counter: '" << path << "' ("
-              << ceph_entity_type_name(svc_type) << "."
-              << svc_id << ")" << dendl;
-      dout(20) << "Paths are:" << dendl;
-      for (const auto &i : metadata->perf_counters.instances) {
-        dout(20) << i.first << dendl;
+      f.close_section();
+    }
+    f.close_section();
+  }
+  return f.get();
+}
+
+PyObject* PyModules::get_histogram_python(
+    const std::string &handle,
+    entity_type_t svc_type,
+    const std::string &svc_id,
+    const std::string &path)
+{
+  PyThreadState *tstate = PyEval_SaveThread();
+  Mutex::Locker l(lock);
+  PyEval_RestoreThread(tstate);
+
+  PyFormatter f;
+
+  auto metadata = daemon_state.get(DaemonKey(svc_type, svc_id));
+
+  // FIXME: same locking caveat as get_counter_python
+  if (metadata && metadata->perf_counters.histograms.count(path)) {
+    const auto &t = metadata->perf_counters.types.at(path);
+    const auto &values = metadata->perf_counters.histograms.at(path);
+
+    f.open_array_section("axes");
+    for (const auto &axis : t.axes) {
+      f.open_object_section("axis");
+      f.dump_string("name", axis.name);
+      f.dump_unsigned("scale_type", axis.scale_type);
+      f.dump_int("min", axis.min);
+      f.dump_int("quant_size", axis.quant_size);
+      f.dump_int("buckets", axis.buckets);
+      f.close_section();
+    }
+    f.close_section();
+
+    // one row per bucket of the first axis
+    size_t row = values.size();
+    if (!t.axes.empty() && t.axes.front().buckets > 0) {
+      row = values.size() / t.axes.front().buckets;
+    }
+    f.open_array_section("values");
+    for (size_t i = 0; i < values.size(); i += row) {
+      f.open_array_section("row");
+      for (size_t j = i; j < i + row && j < values.size(); ++j) {
+        f.dump_unsigned("value", values[j]);
       }
+      f.close_section();
     }
+    f.close_section();
   } else {
-    dout(4) << "No daemon state for "
-              << ceph_entity_type_name(svc_type) << "."
-              << svc_id << ")" << dendl;
+    dout(4) << "Missing histogram: '" << path << "' ("
+            << ceph_entity_type_name(svc_type) << "."
+            << svc_id << ")" << dendl;
   }
-  f.close_section();
   return f.get();
 }
 
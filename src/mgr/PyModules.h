@@ -38,8 +38,15 @@ class PyModules
 
   mutable Mutex lock;
 
+  // get_python() results rendered from cluster maps, as json (or text),
+  // and the map versions they were rendered from
+  std::map<std::string, std::pair<std::string, std::string>> dump_cache;
+
   std::string get_site_packages();
 
+  // render get_python()'s @p what; false if it isn't known
+  bool dump(const std::string &what, std::string *out);
+
 public:
   static constexpr auto config_prefix = "mgr.";
 
@@ -61,6 +68,14 @@ public:
   PyObject *get_counter_python(std::string const &handle,
       entity_type_t svc_type, const std::string &svc_id,
       const std::string &path);
+  PyObject *get_histogram_python(std::string const &handle,
+      entity_type_t svc_type, const std::string &svc_id,
+      const std::string &path);
+  PyObject *get_counter_range_python(std::string const &handle,
+      entity_type_t svc_type, const std::string &svc_id,
+      const std::string &path, utime_t from, utime_t to, uint32_t period);
+  PyObject *export_counters_python(std::string const &handle,
+      const std::string &prefix, utime_t from, uint32_t period);
 
   std::map<std::string, std::string> config_cache;
 
@@ -245,6 +245,75 @@ get_counter(PyObject *self, PyObject *args)
       handle, svc_type, svc_id, counter_path);
 }
 
+static PyObject*
+get_histogram(PyObject *self, PyObject *args)
+{
+  char *handle = nullptr;
+  char *type_str = nullptr;
+  char *svc_id = nullptr;
+  char *counter_path = nullptr;
+  if (!PyArg_ParseTuple(args, "ssss:get_histogram", &handle, &type_str,
+                                                    &svc_id, &counter_path)) {
+    return nullptr;
+  }
+
+  entity_type_t svc_type = svc_type_from_str(type_str);
+  if (svc_type == CEPH_ENTITY_TYPE_ANY) {
+    // FIXME: form a proper exception
+    return nullptr;
+  }
+
+  return global_handle->get_histogram_python(
+      handle, svc_type, svc_id, counter_path);
+}
+
+static PyObject*
+get_counter_range(PyObject *self, PyObject *args)
+{
+  char *handle = nullptr;
+  char *type_str = nullptr;
+  char *svc_id = nullptr;
+  char *counter_path = nullptr;
+  double from = 0;
+  double to = 0;
+  unsigned int period = 0;
+  if (!PyArg_ParseTuple(args, "ssssddI:get_counter_range", &handle,
+                        &type_str, &svc_id, &counter_path, &from, &to,
+                        &period)) {
+    return nullptr;
+  }
+
+  entity_type_t svc_type = svc_type_from_str(type_str);
+  if (svc_type == CEPH_ENTITY_TYPE_ANY) {
+    // FIXME: form a proper exception
+    return nullptr;
+  }
+
+  utime_t from_t, to_t;
+  from_t.set_from_double(from);
+  to_t.set_from_double(to);
+  return global_handle->get_counter_range_python(
+      handle, svc_type, svc_id, counter_path, from_t, to_t, period);
+}
+
+static PyObject*
+export_counters(PyObject *self, PyObject *args)
+{
+  char *handle = nullptr;
+  char *prefix = nullptr;
+  double from = 0;
+  unsigned int period = 0;
+  if (!PyArg_ParseTuple(args, "ssdI:export_counters", &handle, &prefix,
+                        &from, &period)) {
+    return nullptr;
+  }
+
+  utime_t from_t;
+  from_t.set_from_double(from);
+  return global_handle->export_counters_python(
+      handle, prefix, from_t, period);
+}
+
 PyMethodDef CephStateMethods[] = {
     {"get", ceph_state_get, METH_VARARGS,
      "Get a cluster object"},
@@ -260,6 +329,12 @@ PyMethodDef CephStateMethods[] = {
      "Set a configuration value"},
     {"get_counter", get_counter, METH_VARARGS,
       "Get a performance counter"},
+    {"get_histogram", get_histogram, METH_VARARGS,
+      "Get a histogram performance counter"},
+    {"get_counter_range", get_counter_range, METH_VARARGS,
+      "Get the history of a performance counter"},
+    {"export_counters", export_counters, METH_VARARGS,
+      "Get the history of all performance counters"},
     {"log", ceph_log, METH_VARARGS,
      "Emit a (local) log message"},
     {NULL, NULL, 0, NULL}
@@ -141,6 +141,18 @@ int DataHealthService::update_store_stats(DataStats &ours)
   ours.store_stats.bytes_misc = extra["misc"];
   ours.last_update = ceph_clock_now();
 
+  mon->logger->set(l_mon_store_bytes, store_size);
+  mon->logger->set(l_mon_store_sst_bytes, extra["sst"]);
+  mon->logger->set(l_mon_store_log_bytes, extra["log"]);
+  uint64_t v;
+  if (mon->store->get_int_property("rocksdb.is-write-stopped", &v) == 0)
+    mon->logger->set(l_mon_store_write_stopped, v);
+  if (mon->store->get_int_property("rocksdb.actual-delayed-write-rate", &v) == 0)
+    mon->logger->set(l_mon_store_delayed_write_rate, v);
+  if (mon->store->get_int_property("rocksdb.estimate-pending-compaction-bytes",
+				   &v) == 0)
+    mon->logger->set(l_mon_store_pending_compaction_bytes, v);
+
   return 0;
 }
 
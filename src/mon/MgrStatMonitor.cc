@@ -0,0 +1,149 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#include "messages/MMonMgrReport.h"
+
+#include "Monitor.h"
+#include "MgrMonitor.h"
+#include "PGMonitor.h"
+
+#include "MgrStatMonitor.h"
+
+#define dout_subsys ceph_subsys_mon
+#undef dout_prefix
+#define dout_prefix *_dout << "MgrStatMonitor " << __func__ << " "
+
+void MgrStatMonitor::create_initial()
+{
+}
+
+void MgrStatMonitor::update_from_paxos(bool *need_bootstrap)
+{
+  version_t version = get_last_committed();
+  if (version == loaded_version)
+    return;
+
+  bufferlist bl;
+  int err = get_version(version, bl);
+  assert(err == 0);
+  bufferlist::iterator p = bl.begin();
+  ::decode(digest, p);
+  loaded_version = version;
+  last_update = ceph_clock_now();
+  dout(10) << "v" << version << " from pgmap v" << digest.version
+	   << ", " << digest.num_pg << " pgs" << dendl;
+
+  if (g_conf->mon_pg_stats_via_mgr)
+    mon->pgmon()->update_logger();
+}
+
+void MgrStatMonitor::create_pending()
+{
+  pending_digest = digest;
+}
+
+void MgrStatMonitor::encode_pending(MonitorDBStore::TransactionRef t)
+{
+  version_t version = get_last_committed() + 1;
+  bufferlist bl;
+  ::encode(pending_digest, bl, mon->get_quorum_con_features());
+  put_version(t, version, bl);
+  put_last_committed(t, version);
+}
+
+version_t MgrStatMonitor::get_trim_to()
+{
+  // each version stands alone; keep a few for peons catching up
+  unsigned max = g_conf->mon_max_pgmap_epochs;
+  version_t version = get_last_committed();
+  if (mon->is_leader() && version > max)
+    return version - max;
+  return 0;
+}
+
+bool MgrStatMonitor::preprocess_query(MonOpRequestRef op)
+{
+  PaxosServiceMessage *m = static_cast<PaxosServiceMessage*>(op->get_req());
+  switch (m->get_type()) {
+  case MSG_MON_MGR_REPORT:
+    return preprocess_report(op);
+  default:
+    mon->no_reply(op);
+    derr << "Unhandled message type " << m->get_type() << dendl;
+    return true;
+  }
+}
+
+bool MgrStatMonitor::prepare_update(MonOpRequestRef op)
+{
+  PaxosServiceMessage *m = static_cast<PaxosServiceMessage*>(op->get_req());
+  switch (m->get_type()) {
+  case MSG_MON_MGR_REPORT:
+    return prepare_report(op);
+  default:
+    mon->no_reply(op);
+    derr << "Unhandled message type " << m->get_type() << dendl;
+    return true;
+  }
+}
+
+bool MgrStatMonitor::preprocess_report(MonOpRequestRef op)
+{
+  MMonMgrReport *m = static_cast<MMonMgrReport*>(op->get_req());
+  MonSession *session = m->get_session();
+  if (!session || !session->is_capable("pg", MON_CAP_R)) {
+    dout(1) << "report from entity with insufficient caps" << dendl;
+    return true;
+  }
+  if (!g_conf->mon_pg_stats_via_mgr) {
+    dout(10) << "ignoring " << *m << ", mon_pg_stats_via_mgr is off" << dendl;
+    return true;
+  }
+  if (!m->get_source().is_mgr() ||
+      session->global_id != mon->mgrmon()->get_map().active_gid) {
+    dout(10) << "ignoring " << *m << " from non-active mgr "
+	     << m->get_source() << dendl;
+    return true;
+  }
+  return false;
+}
+
+bool MgrStatMonitor::prepare_report(MonOpRequestRef op)
+{
+  MMonMgrReport *m = static_cast<MMonMgrReport*>(op->get_req());
+  dout(10) << *m << dendl;
+  // a newer report replaces an older one still pending; the mgr sends
+  // them no faster than mgr_mon_report_interval
+  pending_digest = m->digest;
+  return true;
+}
+
+void MgrStatMonitor::get_health(list<pair<health_status_t,string> >& summary,
+				list<pair<health_status_t,string> > *detail,
+				CephContext *cct) const
+{
+  if (!g_conf->mon_pg_stats_via_mgr)
+    return;
+
+  // the pg health itself comes from PGMonitor, which reads our digest
+  utime_t age = ceph_clock_now() - last_update;
+  if (get_last_committed() == 0 ||
+      age > utime_t(g_conf->mon_mgr_report_grace, 0)) {
+    ostringstream ss;
+    if (get_last_committed() == 0)
+      ss << "no pg stats reported by ceph-mgr yet";
+    else
+      ss << "pg stats from ceph-mgr are " << (int)age << " seconds old";
+    summary.push_back(make_pair(HEALTH_WARN, ss.str()));
+    if (detail)
+      detail->push_back(make_pair(HEALTH_WARN, ss.str()));
+  }
+}
@@ -0,0 +1,59 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ */
+
+#ifndef CEPH_MGRSTATMONITOR_H
+#define CEPH_MGRSTATMONITOR_H
+
+#include "PGMap.h"
+#include "PaxosService.h"
+
+/**
+ * Keeps the pg stat digest the active mgr reports when
+ * mon_pg_stats_via_mgr is set.
+ *
+ * Each version is a whole PGMapDigest, replaced rather than patched, so
+ * the mon commits at most one small update per report interval no matter
+ * how many osds are sending pg stats (to the mgr).
+ */
+class MgrStatMonitor : public PaxosService {
+  PGMapDigest digest;
+  PGMapDigest pending_digest;
+  version_t loaded_version = 0;
+
+  /// local time we last committed a digest, for noticing a silent mgr
+  utime_t last_update;
+
+public:
+  MgrStatMonitor(Monitor *mn, Paxos *p, const string& service_name)
+    : PaxosService(mn, p, service_name)
+  {}
+
+  const PGMapDigest& get_digest() const { return digest; }
+
+  void create_initial() override;
+  void update_from_paxos(bool *need_bootstrap) override;
+  void create_pending() override;
+  void encode_pending(MonitorDBStore::TransactionRef t) override;
+  void encode_full(MonitorDBStore::TransactionRef t) override { }
+  version_t get_trim_to() override;
+
+  bool preprocess_query(MonOpRequestRef op) override;
+  bool prepare_update(MonOpRequestRef op) override;
+
+  bool preprocess_report(MonOpRequestRef op);
+  bool prepare_report(MonOpRequestRef op);
+
+  void get_health(list<pair<health_status_t,string> >& summary,
+		  list<pair<health_status_t,string> > *detail,
+		  CephContext *cct) const override;
+};
+
+#endif
@@ -75,6 +75,7 @@
 #include "LogMonitor.h"
 #include "AuthMonitor.h"
 #include "MgrMonitor.h"
+#include "MgrStatMonitor.h"
 #include "mon/QuorumService.h"
 #include "mon/HealthMonitor.h"
 #include "mon/ConfigKeyService.h"
@@ -204,6 +205,7 @@ Monitor::Monitor(CephContext* cct_, string nm, MonitorDBStore *s,
   paxos_service[PAXOS_LOG] = new LogMonitor(this, paxos, "logm");
   paxos_service[PAXOS_AUTH] = new AuthMonitor(this, paxos, "auth");
   paxos_service[PAXOS_MGR] = new MgrMonitor(this, paxos, "mgr");
+  paxos_service[PAXOS_MGRSTAT] = new MgrStatMonitor(this, paxos, "mgrstat");
 
   health_monitor = new HealthMonitor(this);
   config_key_service = new ConfigKeyService(this, paxos);
@@ -240,6 +242,8 @@ PaxosService *Monitor::get_paxos_service_by_name(const string& name)
     return paxos_service[PAXOS_AUTH];
   if (name == "mgr")
     return paxos_service[PAXOS_MGR];
+  if (name == "mgrstat")
+    return paxos_service[PAXOS_MGRSTAT];
 
   assert(0 == "given name does not match known paxos service");
   return NULL;
@@ -700,6 +704,15 @@ int Monitor::preinit()
     pcb.add_u64_counter(l_mon_election_call, "election_call", "Elections started");
     pcb.add_u64_counter(l_mon_election_win, "election_win", "Elections won");
     pcb.add_u64_counter(l_mon_election_lose, "election_lose", "Elections lost");
+    pcb.add_u64(l_mon_store_bytes, "store_bytes", "Estimated size of the mon store");
+    pcb.add_u64(l_mon_store_sst_bytes, "store_sst_bytes", "Bytes in the mon store's sst files");
+    pcb.add_u64(l_mon_store_log_bytes, "store_log_bytes", "Bytes in the mon store's logs");
+    pcb.add_u64(l_mon_store_write_stopped, "store_write_stopped",
+		"Writes to the mon store are stopped for compaction");
+    pcb.add_u64(l_mon_store_delayed_write_rate, "store_delayed_write_rate",
+		"Write rate the mon store is throttled to while compaction catches up (0 if not)");
+    pcb.add_u64(l_mon_store_pending_compaction_bytes, "store_pending_compaction_bytes",
+		"Estimated bytes the mon store has left to compact");
     logger = pcb.create_perf_counters();
     cct->get_perfcounters_collection()->add(logger);
   }
@@ -1135,9 +1148,9 @@ void Monitor::bootstrap()
 
   // sync store
   if (g_conf->mon_compact_on_bootstrap) {
-    dout(10) << "bootstrap -- triggering compaction" << dendl;
-    store->compact();
-    dout(10) << "bootstrap -- finished compaction" << dendl;
+    // in the background; waiting for it here would hold up the election
+    dout(10) << "bootstrap -- queueing compaction" << dendl;
+    store->compact_async(get_sync_targets_names());
   }
 
   // singleton monitor?
@@ -2691,7 +2704,7 @@ void Monitor::get_cluster_status(stringstream &ss, Formatter *f)
     osdmon()->osdmap.print_summary(f, cout);
     f->close_section();
     f->open_object_section("pgmap");
-    pgmon()->pg_map.print_summary(f, NULL);
+    pgmon()->get_digest().print_summary(f, NULL);
     f->close_section();
     f->open_object_section("fsmap");
     mdsmon()->get_fsmap().print_summary(f, NULL);
@@ -2718,7 +2731,7 @@ void Monitor::get_cluster_status(stringstream &ss, Formatter *f)
     }
 
     osdmon()->osdmap.print_summary(NULL, ss);
-    pgmon()->pg_map.print_summary(NULL, &ss);
+    pgmon()->get_digest().print_summary(NULL, &ss);
   }
 }
 
@@ -3095,9 +3108,23 @@ void Monitor::handle_command(MonOpRequestRef op)
   } else if (prefix == "status" ||
 	     prefix == "health" ||
 	     prefix == "df") {
+    // a peon answers these itself, so only from state its lease covers
+    if (is_peon() && !paxos->is_readable()) {
+      dout(10) << __func__ << " waiting for paxos -> readable" << dendl;
+      paxos->wait_for_readable(op, new C_RetryMessage(this, op));
+      return;
+    }
+
     string detail;
     cmd_getval(g_ceph_context, cmdmap, "detail", detail);
 
+    string cache_key = prefix + " " + detail + " " + format;
+    if (get_cached_command_reply(cache_key, &rdata)) {
+      rs = "";
+      r = 0;
+      goto out;
+    }
+
     if (prefix == "status") {
       // get_cluster_status handles f == NULL
       get_cluster_status(ds, f.get());
@@ -3133,7 +3160,7 @@ void Monitor::handle_command(MonOpRequestRef op)
       if (f)
         f->open_object_section("stats");
 
-      pgmon()->pg_map.dump_fs_stats(&ds, f.get(), verbose);
+      pgmon()->get_digest().dump_fs_stats(&ds, f.get(), verbose);
       if (!f)
         ds << '\n';
       pgmon()->pg_map.dump_pool_stats(osdmon()->osdmap, &ds, f.get(), verbose);
@@ -3148,6 +3175,7 @@ void Monitor::handle_command(MonOpRequestRef op)
       return;
     }
     rdata.append(ds);
+    cache_command_reply(cache_key, rdata);
     rs = "";
     r = 0;
   } else if (prefix == "report") {
@@ -3336,6 +3364,35 @@ void Monitor::handle_command(MonOpRequestRef op)
     reply_command(op, r, rs, rdata, 0);
 }
 
+bool Monitor::get_cached_command_reply(const string& key, bufferlist *rdata)
+{
+  if (g_conf->mon_command_reply_cache_ttl <= 0)
+    return false;
+  auto p = command_reply_cache.find(key);
+  if (p == command_reply_cache.end())
+    return false;
+  if (p->second.epoch != get_epoch() ||
+      p->second.paxos_version != paxos->get_version() ||
+      ceph_clock_now() - p->second.stamp > g_conf->mon_command_reply_cache_ttl) {
+    command_reply_cache.erase(p);
+    return false;
+  }
+  dout(20) << __func__ << " '" << key << "' from " << p->second.stamp << dendl;
+  rdata->append(p->second.rdata);
+  return true;
+}
+
+void Monitor::cache_command_reply(const string& key, const bufferlist& rdata)
+{
+  if (g_conf->mon_command_reply_cache_ttl <= 0)
+    return;
+  cached_command_reply_t& c = command_reply_cache[key];
+  c.epoch = get_epoch();
+  c.paxos_version = paxos->get_version();
+  c.stamp = ceph_clock_now();
+  c.rdata = rdata;
+}
+
 void Monitor::reply_command(MonOpRequestRef op, int rc, const string &rs, version_t version)
 {
   bufferlist rdata;
@@ -3872,6 +3929,11 @@ void Monitor::dispatch_op(MonOpRequestRef op)
       paxos_service[PAXOS_MGR]->dispatch(op);
       break;
 
+    // MgrStat
+    case MSG_MON_MGR_REPORT:
+      paxos_service[PAXOS_MGRSTAT]->dispatch(op);
+      break;
+
     // pg
     case CEPH_MSG_STATFS:
     case MSG_PGSTATS:
@@ -88,6 +88,12 @@ enum {
   l_mon_election_call,
   l_mon_election_win,
   l_mon_election_lose,
+  l_mon_store_bytes,
+  l_mon_store_sst_bytes,
+  l_mon_store_log_bytes,
+  l_mon_store_write_stopped,
+  l_mon_store_delayed_write_rate,
+  l_mon_store_pending_compaction_bytes,
   l_mon_last,
 };
 
@@ -642,6 +648,10 @@ public:
     return (class MgrMonitor*) paxos_service[PAXOS_MGR];
   }
 
+  class MgrStatMonitor *mgrstatmon() {
+    return (class MgrStatMonitor*) paxos_service[PAXOS_MGRSTAT];
+  }
+
   friend class Paxos;
   friend class OSDMonitor;
   friend class MDSMonitor;
@@ -677,6 +687,22 @@ public:
   void handle_command(MonOpRequestRef op);
   void handle_route(MonOpRequestRef op);
 
+  /**
+   * Formatted replies to the read-only commands clients poll the most
+   * (status, health, df), keyed by the command and its output options.
+   * A reply is reused until paxos commits, an election happens, or
+   * mon_command_reply_cache_ttl passes.
+   */
+  struct cached_command_reply_t {
+    epoch_t epoch = 0;
+    version_t paxos_version = 0;
+    utime_t stamp;
+    bufferlist rdata;
+  };
+  map<string, cached_command_reply_t> command_reply_cache;
+  bool get_cached_command_reply(const string& key, bufferlist *rdata);
+  void cache_command_reply(const string& key, const bufferlist& rdata);
+
   void handle_mon_metadata(MonOpRequestRef op);
   int get_mon_metadata(int mon, Formatter *f, ostream& err);
   int print_nodes(Formatter *f, ostream& err);
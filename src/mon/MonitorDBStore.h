@@ -676,6 +676,16 @@ class MonitorDBStore
     db->compact_prefix(prefix);
   }
 
+  /// queue compaction of @p prefixes and return without waiting for it
+  void compact_async(const set<string>& prefixes) {
+    for (auto& p : prefixes)
+      db->compact_prefix_async(p);
+  }
+
+  int get_int_property(const string& property, uint64_t *out) {
+    return db->get_int_property(property, out);
+  }
+
   uint64_t get_estimated_size(map<string, uint64_t> &extras) {
     return db->get_estimated_size(extras);
   }
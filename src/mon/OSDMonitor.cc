@@ -382,11 +382,16 @@ void OSDMonitor::on_active()
   }
   if (g_conf->mon_osd_prime_pg_temp) {
     C_PrintTime *fin = new C_PrintTime(osdmap.get_epoch());
-    mapping.reset(new OSDMapMapping);
+    // keep the previous mappings, so that only the pgs this epoch may
+    // have moved are recalculated
+    if (!mapping)
+      mapping.reset(new OSDMapMapping);
     mapping_job = mapping->start_update(osdmap, mapper,
 					g_conf->mon_osd_mapping_pgs_per_chunk);
     dout(10) << __func__ << " started mapping job " << mapping_job.get()
-	     << " at " << fin->start << dendl;
+	     << " at " << fin->start << " for "
+	     << mapping->get_num_remapped_pgs() << "/"
+	     << mapping->get_num_pgs() << " pgs" << dendl;
     mapping_job->set_finish_event(fin);
   }
 }
@@ -977,6 +982,9 @@ void OSDMonitor::create_pending()
   // clean up pg_temp, primary_temp
   OSDMap::clean_temps(g_ceph_context, osdmap, &pending_inc);
   dout(10) << "create_pending  did clean_temps" << dendl;
+
+  // and pg_upmap entries left behind by removed pools or osds
+  OSDMap::clean_pg_upmaps(g_ceph_context, osdmap, &pending_inc);
 }
 
 void OSDMonitor::maybe_prime_pg_temp()
@@ -1316,7 +1324,7 @@ version_t OSDMonitor::get_trim_to()
 {
   if (mon->pgmon()->is_readable() &&
       mon->pgmon()->pg_map.creating_pgs.empty()) {
-    epoch_t floor = mon->pgmon()->pg_map.get_min_last_epoch_clean();
+    epoch_t floor = mon->pgmon()->get_digest().get_min_last_epoch_clean();
     dout(10) << " min_last_epoch_clean " << floor << dendl;
     if (g_conf->mon_osd_force_trim_to > 0 &&
 	g_conf->mon_osd_force_trim_to < (int)get_last_committed()) {
@@ -2254,6 +2262,10 @@ bool OSDMonitor::prepare_boot(MonOpRequestRef op)
       xi.features = m->osd_features;
     else
       xi.features = m->get_connection()->get_features();
+    {
+      auto p = m->metadata.find("osd_store_csum");
+      xi.store_csum = p != m->metadata.end() && p->second == "1";
+    }
 
     // mark in?
     if ((g_conf->mon_osd_auto_mark_auto_out_in &&
@@ -2636,6 +2648,23 @@ MOSDMap *OSDMonitor::build_incremental(epoch_t from, epoch_t to)
   return m;
 }
 
+void OSDMonitor::set_map_compressor(MOSDMap *m, MonSession *session)
+{
+  // a routed reply is encoded for the proxying mon, so go by what the
+  // session's own client supports
+  if (!session->con->has_feature(CEPH_FEATURE_MOSDMAP_COMPACT))
+    return;
+  const string& type = g_conf->mon_osd_map_compression;
+  if (type != map_compressor_type) {
+    map_compressor_type = type;
+    map_compressor.reset();
+    if (type.length() && type != "none")
+      map_compressor = Compressor::create(g_ceph_context, type);
+  }
+  m->compressor = map_compressor;
+  m->compress_min_size = g_conf->mon_osd_map_compression_min_size;
+}
+
 void OSDMonitor::send_full(MonOpRequestRef op)
 {
   op->mark_osdmon_event(__func__);
@@ -2693,6 +2722,7 @@ void OSDMonitor::send_incremental(epoch_t first,
     m->oldest_map = get_first_committed();
     m->newest_map = osdmap.get_epoch();
     m->maps[first] = bl;
+    set_map_compressor(m, session);
 
     if (req) {
       mon->send_reply(req, m);
@@ -2705,10 +2735,42 @@ void OSDMonitor::send_incremental(epoch_t first,
     first++;
   }
 
+  // only osds need every epoch; a client far enough behind gets just the
+  // current full map, which is smaller than all the incrementals leading
+  // up to it
+  if (g_conf->mon_osd_client_full_map_epochs > 0 &&
+      !session->inst.name.is_osd() &&
+      session->con->has_feature(CEPH_FEATURE_MOSDMAP_COMPACT) &&
+      first + g_conf->mon_osd_client_full_map_epochs <= osdmap.get_epoch()) {
+    epoch_t last = osdmap.get_epoch();
+    bufferlist bl;
+    int err = get_version_full(last, bl);
+    assert(err == 0);
+    assert(bl.length());
+
+    dout(20) << __func__ << " skipping " << first << ".." << (last - 1)
+	     << ", sending full " << last << " " << bl.length() << " bytes"
+	     << dendl;
+
+    MOSDMap *m = new MOSDMap(osdmap.get_fsid());
+    m->oldest_map = get_first_committed();
+    m->newest_map = last;
+    m->maps[last] = bl;
+    set_map_compressor(m, session);
+
+    if (req)
+      mon->send_reply(req, m);
+    else
+      session->con->send_message(m);
+    session->osd_epoch = last;
+    return;
+  }
+
   while (first <= osdmap.get_epoch()) {
     epoch_t last = MIN(first + g_conf->osd_map_message_max - 1,
 		       osdmap.get_epoch());
     MOSDMap *m = build_incremental(first, last);
+    set_map_compressor(m, session);
 
     if (req) {
       // send some maps.  it may not be all of them, but it will get them
@@ -2896,7 +2958,8 @@ void OSDMonitor::tick()
 
   //if map full setting has changed, get that info out there!
   if (mon->pgmon()->is_readable()) {
-    if (!mon->pgmon()->pg_map.full_osds.empty()) {
+    const PGMapDigest& pgd = mon->pgmon()->get_digest();
+    if (!pgd.full_osds.empty()) {
       dout(5) << "There are full osds, setting full flag" << dendl;
       add_flag(CEPH_OSDMAP_FULL);
     } else if (osdmap.test_flag(CEPH_OSDMAP_FULL)){
@@ -2904,7 +2967,7 @@ void OSDMonitor::tick()
       remove_flag(CEPH_OSDMAP_FULL);
     }
 
-    if (!mon->pgmon()->pg_map.nearfull_osds.empty()) {
+    if (!pgd.nearfull_osds.empty()) {
       dout(5) << "There are near full osds, setting nearfull flag" << dendl;
       add_flag(CEPH_OSDMAP_NEARFULL);
     } else if (osdmap.test_flag(CEPH_OSDMAP_NEARFULL)){
@@ -3192,7 +3255,8 @@ namespace {
     RECOVERY_PRIORITY, RECOVERY_OP_PRIORITY, SCRUB_PRIORITY,
     COMPRESSION_MODE, COMPRESSION_ALGORITHM, COMPRESSION_REQUIRED_RATIO,
     COMPRESSION_MAX_BLOB_SIZE, COMPRESSION_MIN_BLOB_SIZE,
-    CSUM_TYPE, CSUM_MAX_BLOCK, CSUM_MIN_BLOCK };
+    CSUM_TYPE, CSUM_MAX_BLOCK, CSUM_MIN_BLOCK,
+    MCLOCK_RES, MCLOCK_WGT, MCLOCK_LIM, COMPRESSION_DICTIONARIES };
 
   std::set<osd_pool_get_choices>
     subtract_second_from_first(const std::set<osd_pool_get_choices>& first,
@@ -3699,6 +3763,10 @@ bool OSDMonitor::preprocess_command(MonOpRequestRef op)
       {"csum_type", CSUM_TYPE},
       {"csum_max_block", CSUM_MAX_BLOCK},
       {"csum_min_block", CSUM_MIN_BLOCK},
+      {"mclock_res", MCLOCK_RES},
+      {"mclock_wgt", MCLOCK_WGT},
+      {"mclock_lim", MCLOCK_LIM},
+      {"compression_dictionaries", COMPRESSION_DICTIONARIES},
     };
 
     typedef std::set<osd_pool_get_choices> choices_set_t;
@@ -3903,6 +3971,10 @@ bool OSDMonitor::preprocess_command(MonOpRequestRef op)
 	  case CSUM_TYPE:
 	  case CSUM_MAX_BLOCK:
 	  case CSUM_MIN_BLOCK:
+	  case MCLOCK_RES:
+	  case MCLOCK_WGT:
+	  case MCLOCK_LIM:
+	  case COMPRESSION_DICTIONARIES:
 	    for (i = ALL_CHOICES.begin(); i != ALL_CHOICES.end(); ++i) {
 	      if (i->second == *it)
 		break;
@@ -4060,6 +4132,10 @@ bool OSDMonitor::preprocess_command(MonOpRequestRef op)
 	  case CSUM_TYPE:
 	  case CSUM_MAX_BLOCK:
 	  case CSUM_MIN_BLOCK:
+	  case MCLOCK_RES:
+	  case MCLOCK_WGT:
+	  case MCLOCK_LIM:
+	  case COMPRESSION_DICTIONARIES:
 	    for (i = ALL_CHOICES.begin(); i != ALL_CHOICES.end(); ++i) {
 	      if (i->second == *it)
 		break;
@@ -4377,10 +4453,11 @@ bool OSDMonitor::update_pools_status()
   for (map<int64_t,pg_pool_t>::const_iterator it = pools.begin();
        it != pools.end();
        ++it) {
-    if (!mon->pgmon()->pg_map.pg_pool_sum.count(it->first))
+    const auto& pg_pool_sum = mon->pgmon()->get_digest().pg_pool_sum;
+    auto stats = pg_pool_sum.find(it->first);
+    if (stats == pg_pool_sum.end())
       continue;
-    pool_stat_t& stats = mon->pgmon()->pg_map.pg_pool_sum[it->first];
-    object_stat_sum_t& sum = stats.stats.sum;
+    const object_stat_sum_t& sum = stats->second.stats.sum;
     const pg_pool_t &pool = it->second;
     const string& pool_name = osdmap.get_pool_name(it->first);
 
@@ -4427,10 +4504,11 @@ void OSDMonitor::get_pools_health(
   const map<int64_t,pg_pool_t>& pools = osdmap.get_pools();
   for (map<int64_t,pg_pool_t>::const_iterator it = pools.begin();
        it != pools.end(); ++it) {
-    if (!mon->pgmon()->pg_map.pg_pool_sum.count(it->first))
+    const auto& pg_pool_sum = mon->pgmon()->get_digest().pg_pool_sum;
+    auto stats = pg_pool_sum.find(it->first);
+    if (stats == pg_pool_sum.end())
       continue;
-    pool_stat_t& stats = mon->pgmon()->pg_map.pg_pool_sum[it->first];
-    object_stat_sum_t& sum = stats.stats.sum;
+    const object_stat_sum_t& sum = stats->second.stats.sum;
     const pg_pool_t &pool = it->second;
     const string& pool_name = osdmap.get_pool_name(it->first);
 
@@ -5379,7 +5457,13 @@ int OSDMonitor::prepare_command_pool_set(map<string,cmd_vartype> &cmdmap,
 	p.hit_set_params = HitSet::Params(new ExplicitHashHitSet::Params);
       else if (val == "explicit_object")
 	p.hit_set_params = HitSet::Params(new ExplicitObjectHitSet::Params);
-      else {
+      else if (val == "decaying_count") {
+	if (!osdmap.test_flag(CEPH_OSDMAP_REQUIRE_LUMINOUS)) {
+	  ss << "hit_set_type decaying_count requires require_luminous_osds";
+	  return -EPERM;
+	}
+	p.hit_set_params = HitSet::Params(new DecayingCountHitSet::Params);
+      } else {
 	ss << "unrecognized hit_set type '" << val << "'";
 	return -EINVAL;
       }
@@ -5558,6 +5642,47 @@ int OSDMonitor::prepare_command_pool_set(map<string,cmd_vartype> &cmdmap,
         ss << "compression_required_ratio is out of range (0-1): '" << val << "'";
 	return EINVAL;
       }
+    } else if (var == "compression_dictionaries") {
+      map<uint32_t, bufferlist> dicts, old_dicts;
+      if (!val.empty() &&
+	  Compressor::decode_dictionaries(val, &dicts) < 0) {
+	ss << "error decoding compression_dictionaries";
+	return -EINVAL;
+      }
+      if (val.length() > g_conf->mon_max_pool_compression_dictionaries_bytes) {
+	ss << "compression_dictionaries is larger than "
+	   << "mon_max_pool_compression_dictionaries_bytes ("
+	   << g_conf->mon_max_pool_compression_dictionaries_bytes << ")";
+	return -EINVAL;
+      }
+      // data compressed with a dictionary can't be read without it
+      string old;
+      if (p.opts.get(pool_opts_t::COMPRESSION_DICTIONARIES, &old)) {
+	Compressor::decode_dictionaries(old, &old_dicts);
+      }
+      for (auto& d : old_dicts) {
+	auto q = dicts.find(d.first);
+	if (q == dicts.end() || !q->second.contents_equal(d.second)) {
+	  ss << "compression dictionary " << d.first << " may be in use and"
+	     << " cannot be removed or changed";
+	  return -EBUSY;
+	}
+      }
+      if (dicts.count(0)) {
+	ss << "compression dictionary id 0 is reserved";
+	return -EINVAL;
+      }
+    } else if (var == "mclock_res" ||
+	       var == "mclock_wgt" ||
+	       var == "mclock_lim") {
+      if (floaterr.length()) {
+        ss << "error parsing float value '" << val << "': " << floaterr;
+        return -EINVAL;
+      }
+      if (f < 0) {
+        ss << var << " must not be negative: '" << val << "'";
+	return -EINVAL;
+      }
     } else if (var == "csum_type") {
       auto t = val != "unset" ? Checksummer::get_csum_string_type(val) : 0;
       if (t < 0 ) {
@@ -6845,6 +6970,120 @@ bool OSDMonitor::prepare_command_impl(MonOpRequestRef op,
     pending_inc.new_primary_temp[pgid] = osd;
     ss << "set " << pgid << " primary_temp mapping to " << osd;
     goto update;
+  } else if (prefix == "osd pg-upmap" ||
+	     prefix == "osd rm-pg-upmap" ||
+	     prefix == "osd pg-upmap-items" ||
+	     prefix == "osd rm-pg-upmap-items") {
+    if (!osdmap.test_flag(CEPH_OSDMAP_REQUIRE_LUMINOUS)) {
+      ss << "you must set the require_luminous_osds flag before using "
+	 << "pg_upmap; clients older than luminous will also be refused";
+      err = -EPERM;
+      goto reply;
+    }
+    string pgidstr;
+    if (!cmd_getval(g_ceph_context, cmdmap, "pgid", pgidstr)) {
+      ss << "unable to parse 'pgid' value '"
+         << cmd_vartype_stringify(cmdmap["pgid"]) << "'";
+      err = -EINVAL;
+      goto reply;
+    }
+    pg_t pgid;
+    if (!pgid.parse(pgidstr.c_str())) {
+      ss << "invalid pgid '" << pgidstr << "'";
+      err = -EINVAL;
+      goto reply;
+    }
+    if (!osdmap.pg_exists(pgid)) {
+      ss << "pg " << pgid << " does not exist";
+      err = -ENOENT;
+      goto reply;
+    }
+    if (pending_inc.new_pg_upmap.count(pgid) ||
+	pending_inc.old_pg_upmap.count(pgid) ||
+	pending_inc.new_pg_upmap_items.count(pgid) ||
+	pending_inc.old_pg_upmap_items.count(pgid)) {
+      dout(10) << __func__ << " waiting for pending update on " << pgid << dendl;
+      wait_for_finished_proposal(op, new C_RetryMessage(this, op));
+      return true;
+    }
+
+    if (prefix == "osd rm-pg-upmap") {
+      if (!osdmap.pg_upmap.count(pgid)) {
+	ss << "no pg_upmap mapping for " << pgid;
+	err = 0;
+	goto reply;
+      }
+      pending_inc.old_pg_upmap.insert(pgid);
+      ss << "clear " << pgid << " pg_upmap mapping";
+      goto update;
+    }
+    if (prefix == "osd rm-pg-upmap-items") {
+      if (!osdmap.pg_upmap_items.count(pgid)) {
+	ss << "no pg_upmap_items mapping for " << pgid;
+	err = 0;
+	goto reply;
+      }
+      pending_inc.old_pg_upmap_items.insert(pgid);
+      ss << "clear " << pgid << " pg_upmap_items mapping";
+      goto update;
+    }
+
+    vector<int64_t> id_vec;
+    if (!cmd_getval(g_ceph_context, cmdmap, "id", id_vec)) {
+      ss << "unable to parse 'id' value(s) '"
+         << cmd_vartype_stringify(cmdmap["id"]) << "'";
+      err = -EINVAL;
+      goto reply;
+    }
+    for (auto osd : id_vec) {
+      if (osd != CRUSH_ITEM_NONE && !osdmap.exists(osd)) {
+        ss << "osd." << osd << " does not exist";
+        err = -ENOENT;
+        goto reply;
+      }
+    }
+
+    if (prefix == "osd pg-upmap") {
+      const pg_pool_t *pool = osdmap.get_pg_pool(pgid.pool());
+      if (id_vec.size() != pool->get_size()) {
+	ss << "pool " << pgid.pool() << " has size " << pool->get_size()
+	   << ", but " << id_vec.size() << " osds were given";
+	err = -EINVAL;
+	goto reply;
+      }
+      vector<int32_t> new_pg_upmap;
+      for (auto osd : id_vec) {
+	if (osd != CRUSH_ITEM_NONE &&
+	    std::find(new_pg_upmap.begin(), new_pg_upmap.end(), osd) !=
+	    new_pg_upmap.end()) {
+	  ss << "osd." << osd << " appears more than once";
+	  err = -EINVAL;
+	  goto reply;
+	}
+	new_pg_upmap.push_back(osd);
+      }
+      pending_inc.new_pg_upmap[pgid] = new_pg_upmap;
+      ss << "set " << pgid << " pg_upmap mapping to " << new_pg_upmap;
+    } else {
+      if (id_vec.empty() || id_vec.size() % 2) {
+	ss << "you must specify pairs of <from> <to> osds";
+	err = -EINVAL;
+	goto reply;
+      }
+      vector<pair<int32_t,int32_t> > new_pg_upmap_items;
+      for (auto p = id_vec.begin(); p != id_vec.end(); p += 2) {
+	if (*p == *(p + 1)) {
+	  ss << "osd." << *p << " is mapped to itself";
+	  err = -EINVAL;
+	  goto reply;
+	}
+	new_pg_upmap_items.push_back(make_pair(*p, *(p + 1)));
+      }
+      pending_inc.new_pg_upmap_items[pgid] = new_pg_upmap_items;
+      ss << "set " << pgid << " pg_upmap_items mapping to "
+	 << new_pg_upmap_items;
+    }
+    goto update;
   } else if (prefix == "osd primary-affinity") {
     int64_t id;
     if (!cmd_getval(g_ceph_context, cmdmap, "id", id)) {
@@ -8448,7 +8687,7 @@ int OSDMonitor::_prepare_remove_pool(int64_t pool, ostream *ss)
   pending_inc.old_pools.insert(pool);
 
   // remove any pg_temp mappings for this pool too
-  for (map<pg_t,vector<int32_t> >::iterator p = osdmap.pg_temp->begin();
+  for (OSDMap::pg_temp_map_t::iterator p = osdmap.pg_temp->begin();
        p != osdmap.pg_temp->end();
        ++p) {
     if (p->first.pool() == (uint64_t)pool) {
@@ -8457,7 +8696,7 @@ int OSDMonitor::_prepare_remove_pool(int64_t pool, ostream *ss)
       pending_inc.new_pg_temp[p->first].clear();
     }
   }
-  for (map<pg_t,int32_t>::iterator p = osdmap.primary_temp->begin();
+  for (OSDMap::primary_temp_map_t::iterator p = osdmap.primary_temp->begin();
       p != osdmap.primary_temp->end();
       ++p) {
     if (p->first.pool() == (uint64_t)pool) {
@@ -40,6 +40,7 @@ class MonSession;
 class MOSDMap;
 
 #include "erasure-code/ErasureCodeInterface.h"
+#include "compressor/Compressor.h"
 #include "mon/MonOpRequest.h"
 
 #define OSD_METADATA_PREFIX "osd_metadata"
@@ -132,6 +133,10 @@ public:
   SimpleLRU<version_t, bufferlist> inc_osd_cache;
   SimpleLRU<version_t, bufferlist> full_osd_cache;
 
+  // for mon_osd_map_compression; recreated when the option changes
+  string map_compressor_type;
+  CompressorRef map_compressor;
+
   bool check_failures(utime_t now);
   bool check_failure(utime_t now, int target_osd, failure_info_t& fi);
   void force_failure(utime_t now, int target_osd);
@@ -227,6 +232,7 @@ private:
   // ...
   MOSDMap *build_latest_full();
   MOSDMap *build_incremental(epoch_t first, epoch_t last);
+  void set_map_compressor(MOSDMap *m, MonSession *session);
   void send_full(MonOpRequestRef op);
   void send_incremental(MonOpRequestRef op, epoch_t first);
 public:
@@ -16,6 +16,105 @@
 
 // --
 
+void PGMapDigest::encode(bufferlist& bl, uint64_t features) const
+{
+  ENCODE_START(1, 1, bl);
+  ::encode(version, bl);
+  ::encode(stamp, bl);
+  ::encode(num_pg_by_state, bl);
+  ::encode(num_pg, bl);
+  ::encode(num_osd, bl);
+  ::encode(pg_pool_sum, bl, features);
+  ::encode(pg_sum, bl, features);
+  ::encode(osd_sum, bl);
+  ::encode(full_osds, bl);
+  ::encode(nearfull_osds, bl);
+  ::encode(min_last_epoch_clean, bl);
+  ::encode(pg_sum_delta, bl, features);
+  ::encode(stamp_delta, bl);
+  ::encode(num_pg_stuck, bl);
+  ENCODE_FINISH(bl);
+}
+
+void PGMapDigest::decode(bufferlist::iterator& p)
+{
+  DECODE_START(1, p);
+  ::decode(version, p);
+  ::decode(stamp, p);
+  ::decode(num_pg_by_state, p);
+  ::decode(num_pg, p);
+  ::decode(num_osd, p);
+  ::decode(pg_pool_sum, p);
+  ::decode(pg_sum, p);
+  ::decode(osd_sum, p);
+  ::decode(full_osds, p);
+  ::decode(nearfull_osds, p);
+  ::decode(min_last_epoch_clean, p);
+  ::decode(pg_sum_delta, p);
+  ::decode(stamp_delta, p);
+  ::decode(num_pg_stuck, p);
+  DECODE_FINISH(p);
+}
+
+void PGMapDigest::dump(Formatter *f) const
+{
+  f->dump_unsigned("version", version);
+  f->dump_stream("stamp") << stamp;
+  f->dump_unsigned("num_pgs", num_pg);
+  f->dump_unsigned("num_osds", num_osd);
+  f->dump_unsigned("min_last_epoch_clean", min_last_epoch_clean);
+  f->open_array_section("num_pg_by_state");
+  for (auto& p : num_pg_by_state) {
+    f->open_object_section("state");
+    f->dump_string("name", pg_state_string(p.first));
+    f->dump_unsigned("num", p.second);
+    f->close_section();
+  }
+  f->close_section();
+  f->open_object_section("num_pg_stuck");
+  for (auto& p : num_pg_stuck)
+    f->dump_int(p.first.c_str(), p.second);
+  f->close_section();
+  f->open_object_section("pg_stats_sum");
+  pg_sum.dump(f);
+  f->close_section();
+  f->open_object_section("osd_stats_sum");
+  osd_sum.dump(f);
+  f->close_section();
+  f->open_array_section("pool_stats");
+  for (auto& p : pg_pool_sum) {
+    f->open_object_section("pool_stat");
+    f->dump_int("poolid", p.first);
+    p.second.dump(f);
+    f->close_section();
+  }
+  f->close_section();
+  f->open_array_section("full_osds");
+  for (auto osd : full_osds)
+    f->dump_int("osd", osd);
+  f->close_section();
+  f->open_array_section("nearfull_osds");
+  for (auto osd : nearfull_osds)
+    f->dump_int("osd", osd);
+  f->close_section();
+}
+
+void PGMapDigest::generate_test_instances(list<PGMapDigest*>& ls)
+{
+  ls.push_back(new PGMapDigest);
+  ls.push_back(new PGMapDigest);
+  ls.back()->version = 12;
+  ls.back()->stamp = utime_t(123,345);
+  ls.back()->num_pg = 3;
+  ls.back()->num_osd = 2;
+  ls.back()->num_pg_by_state[PG_STATE_ACTIVE|PG_STATE_CLEAN] = 2;
+  ls.back()->num_pg_by_state[PG_STATE_PEERING] = 1;
+  ls.back()->pg_pool_sum[1] = pool_stat_t();
+  ls.back()->nearfull_osds.insert(1);
+  ls.back()->min_last_epoch_clean = 7;
+  ls.back()->num_pg_stuck["stuck inactive"] = 1;
+}
+
 void PGMap::Incremental::encode(bufferlist &bl, uint64_t features) const
 {
   if ((features & CEPH_FEATURE_MONENC) == 0) {
@@ -1174,7 +1273,7 @@ void PGMap::print_osd_blocked_by_stats(std::ostream *ss) const
   (*ss) << tab;
 }
 
-void PGMap::recovery_summary(Formatter *f, list<string> *psl,
+void PGMapDigest::recovery_summary(Formatter *f, list<string> *psl,
                              const pool_stat_t& delta_sum) const
 {
   if (delta_sum.stats.sum.num_objects_degraded && delta_sum.stats.sum.num_object_copies > 0) {
@@ -1227,7 +1326,7 @@ void PGMap::recovery_summary(Formatter *f, list<string> *psl,
   }
 }
 
-void PGMap::recovery_rate_summary(Formatter *f, ostream *out,
+void PGMapDigest::recovery_rate_summary(Formatter *f, ostream *out,
                                   const pool_stat_t& delta_sum,
                                   utime_t delta_stamp) const
 {
@@ -1258,12 +1357,12 @@ void PGMap::recovery_rate_summary(Formatter *f, ostream *out,
   }
 }
 
-void PGMap::overall_recovery_rate_summary(Formatter *f, ostream *out) const
+void PGMapDigest::overall_recovery_rate_summary(Formatter *f, ostream *out) const
 {
   recovery_rate_summary(f, out, pg_sum_delta, stamp_delta);
 }
 
-void PGMap::overall_recovery_summary(Formatter *f, list<string> *psl) const
+void PGMapDigest::overall_recovery_summary(Formatter *f, list<string> *psl) const
 {
   recovery_summary(f, psl, pg_sum);
 }
@@ -1293,7 +1392,7 @@ void PGMap::pool_recovery_summary(Formatter *f, list<string> *psl,
   recovery_summary(f, psl, p->second.first);
 }
 
-void PGMap::client_io_rate_summary(Formatter *f, ostream *out,
+void PGMapDigest::client_io_rate_summary(Formatter *f, ostream *out,
                                    const pool_stat_t& delta_sum,
                                    utime_t delta_stamp) const
 {
@@ -1328,7 +1427,7 @@ void PGMap::client_io_rate_summary(Formatter *f, ostream *out,
   }
 }
 
-void PGMap::overall_client_io_rate_summary(Formatter *f, ostream *out) const
+void PGMapDigest::overall_client_io_rate_summary(Formatter *f, ostream *out) const
 {
   client_io_rate_summary(f, out, pg_sum_delta, stamp_delta);
 }
@@ -1347,7 +1446,7 @@ void PGMap::pool_client_io_rate_summary(Formatter *f, ostream *out,
   client_io_rate_summary(f, out, p->second.first, ts->second);
 }
 
-void PGMap::cache_io_rate_summary(Formatter *f, ostream *out,
+void PGMapDigest::cache_io_rate_summary(Formatter *f, ostream *out,
                                   const pool_stat_t& delta_sum,
                                   utime_t delta_stamp) const
 {
@@ -1428,7 +1527,7 @@ void PGMap::cache_io_rate_summary(Formatter *f, ostream *out,
   }
 }
 
-void PGMap::overall_cache_io_rate_summary(Formatter *f, ostream *out) const
+void PGMapDigest::overall_cache_io_rate_summary(Formatter *f, ostream *out) const
 {
   cache_io_rate_summary(f, out, pg_sum_delta, stamp_delta);
 }
@@ -1562,7 +1661,7 @@ void PGMap::clear_delta()
   stamp_delta = utime_t();
 }
 
-void PGMap::print_summary(Formatter *f, ostream *out) const
+void PGMapDigest::print_summary(Formatter *f, ostream *out) const
 {
   std::stringstream ss;
   if (f)
@@ -1595,7 +1694,7 @@ void PGMap::print_summary(Formatter *f, ostream *out) const
 
   if (f) {
     f->dump_unsigned("version", version);
-    f->dump_unsigned("num_pgs", pg_stat.size());
+    f->dump_unsigned("num_pgs", num_pg);
     f->dump_unsigned("num_pools", pg_pool_sum.size());
     f->dump_unsigned("num_objects", pg_sum.stats.sum.num_objects);
     f->dump_unsigned("data_bytes", pg_sum.stats.sum.num_bytes);
@@ -1604,7 +1703,7 @@ void PGMap::print_summary(Formatter *f, ostream *out) const
     f->dump_unsigned("bytes_total", osd_sum.kb * 1024ull);
   } else {
     *out << "      pgmap v" << version << ": "
-         << pg_stat.size() << " pgs, " << pg_pool_sum.size() << " pools, "
+         << num_pg << " pgs, " << pg_pool_sum.size() << " pools, "
          << prettybyte_t(pg_sum.stats.sum.num_bytes) << " data, "
          << pretty_si_t(pg_sum.stats.sum.num_objects) << "objects\n";
     *out << "            "
@@ -1742,6 +1841,14 @@ void PGMap::generate_test_instances(list<PGMap*>& o)
   }
 }
 
+void PGMap::get_digest(PGMapDigest *d, utime_t cutoff) const
+{
+  get_min_last_epoch_clean();
+  *d = *this;
+  d->num_pg_stuck.clear();
+  get_stuck_counts(cutoff, d->num_pg_stuck);
+}
+
 void PGMap::get_filtered_pg_stats(uint32_t state, int64_t poolid, int64_t osdid,
                                   bool primary, set<pg_t>& pgs)
 {
@@ -1993,7 +2100,7 @@ void PGMap::dump_pool_stats(const OSDMap &osd_map, stringstream *ss,
   }
 }
 
-void PGMap::dump_fs_stats(
+void PGMapDigest::dump_fs_stats(
     stringstream *ss, Formatter *f, bool verbose) const
 {
   if (f) {
@@ -32,16 +32,106 @@
 
 namespace ceph { class Formatter; }
 
-class PGMap {
+/**
+ * The cluster-wide aggregates of a PGMap, without the per-pg and per-osd
+ * stats they are summed from.
+ *
+ * This is what the mon needs for status, health, quotas and full flags.
+ * When ceph-mgr aggregates the pg stats (mon_pg_stats_via_mgr) it sends
+ * one of these to the mon instead of the mon keeping the PGMap itself.
+ */
+class PGMapDigest {
 public:
-  // the map
+  virtual ~PGMapDigest() {}
+
   version_t version;
+  utime_t stamp;
+
+  ceph::unordered_map<int,int> num_pg_by_state;
+  int64_t num_pg, num_osd;
+  ceph::unordered_map<int,pool_stat_t> pg_pool_sum;
+  pool_stat_t pg_sum;
+  osd_stat_t osd_sum;
+  set<int32_t> full_osds;
+  set<int32_t> nearfull_osds;
+  mutable epoch_t min_last_epoch_clean;
+
+  // overall delta over the last few updates
+  pool_stat_t pg_sum_delta;
+  utime_t stamp_delta;
+
+  /// counts of stuck pgs by kind, only filled in by PGMap::get_digest()
+  map<string,int> num_pg_stuck;
+
+  PGMapDigest()
+    : version(0),
+      num_pg(0),
+      num_osd(0),
+      min_last_epoch_clean(0)
+  {}
+
+  pool_stat_t get_pg_pool_sum_stat(int64_t pool) const {
+    ceph::unordered_map<int,pool_stat_t>::const_iterator p =
+      pg_pool_sum.find(pool);
+    if (p != pg_pool_sum.end())
+      return p->second;
+    return pool_stat_t();
+  }
+
+  virtual epoch_t get_min_last_epoch_clean() const {
+    return min_last_epoch_clean;
+  }
+
+  void dump_fs_stats(stringstream *ss, Formatter *f, bool verbose) const;
+
+  void recovery_summary(Formatter *f, list<string> *psl,
+                        const pool_stat_t& delta_sum) const;
+  void overall_recovery_summary(Formatter *f, list<string> *psl) const;
+  void recovery_rate_summary(Formatter *f, ostream *out,
+                             const pool_stat_t& delta_sum,
+                             utime_t delta_stamp) const;
+  void overall_recovery_rate_summary(Formatter *f, ostream *out) const;
+  /**
+   * Obtain a formatted/plain output for client I/O, source from stats for a
+   * given @p delta_sum pool over a given @p delta_stamp period of time.
+   */
+  void client_io_rate_summary(Formatter *f, ostream *out,
+                              const pool_stat_t& delta_sum,
+                              utime_t delta_stamp) const;
+  /**
+   * Obtain a formatted/plain output for the overall client I/O, which is
+   * calculated resorting to @p pg_sum_delta and @p stamp_delta.
+   */
+  void overall_client_io_rate_summary(Formatter *f, ostream *out) const;
+  /**
+   * Obtain a formatted/plain output for cache tier IO, source from stats for a
+   * given @p delta_sum pool over a given @p delta_stamp period of time.
+   */
+  void cache_io_rate_summary(Formatter *f, ostream *out,
+                             const pool_stat_t& delta_sum,
+                             utime_t delta_stamp) const;
+  /**
+   * Obtain a formatted/plain output for the overall cache tier IO, which is
+   * calculated resorting to @p pg_sum_delta and @p stamp_delta.
+   */
+  void overall_cache_io_rate_summary(Formatter *f, ostream *out) const;
+
+  void print_summary(Formatter *f, ostream *out) const;
+
+  void encode(bufferlist& bl, uint64_t features) const;
+  void decode(bufferlist::iterator& p);
+  void dump(Formatter *f) const;
+  static void generate_test_instances(list<PGMapDigest*>& ls);
+};
+WRITE_CLASS_ENCODER_FEATURES(PGMapDigest)
+
+class PGMap : public PGMapDigest {
+public:
+  // the map
   epoch_t last_osdmap_epoch;   // last osdmap epoch i applied to the pgmap
   epoch_t last_pg_scan;  // osdmap epoch
   ceph::unordered_map<pg_t,pg_stat_t> pg_stat;
   ceph::unordered_map<int32_t,osd_stat_t> osd_stat;
-  set<int32_t> full_osds;
-  set<int32_t> nearfull_osds;
   float full_ratio;
   float nearfull_ratio;
 
@@ -115,18 +205,11 @@ public:
   };
 
 
-  // aggregate stats (soft state), generated by calc_stats()
-  ceph::unordered_map<int,int> num_pg_by_state;
-  int64_t num_pg, num_osd;
-  ceph::unordered_map<int,pool_stat_t> pg_pool_sum;
-  pool_stat_t pg_sum;
-  osd_stat_t osd_sum;
-  mutable epoch_t min_last_epoch_clean;
+  // aggregate stats (soft state), generated by calc_stats(); the
+  // cluster-wide sums live in PGMapDigest
   ceph::unordered_map<int,int> blocked_by_sum;
   ceph::unordered_map<int,set<pg_t> > pg_by_osd;
 
-  utime_t stamp;
-
   // recent deltas, and summation
   /**
    * keep track of last deltas for each pool, calculated using
@@ -147,8 +230,6 @@ public:
   ceph::unordered_map<uint64_t, pair<pool_stat_t,utime_t> > per_pool_sum_delta;
 
   list< pair<pool_stat_t, utime_t> > pg_sum_deltas;
-  pool_stat_t pg_sum_delta;
-  utime_t stamp_delta;
 
   void update_global_delta(CephContext *cct,
                            const utime_t ts, const pool_stat_t& pg_sum_old);
@@ -196,12 +277,8 @@ public:
   static const int STUCK_STALE = (1<<4);
   
   PGMap()
-    : version(0),
-      last_osdmap_epoch(0), last_pg_scan(0),
-      full_ratio(0), nearfull_ratio(0),
-      num_pg(0),
-      num_osd(0),
-      min_last_epoch_clean(0)
+    : last_osdmap_epoch(0), last_pg_scan(0),
+      full_ratio(0), nearfull_ratio(0)
   {}
 
   void set_full_ratios(float full, float nearfull) {
@@ -245,14 +322,6 @@ public:
       return p->second.size();
   }
 
-  pool_stat_t get_pg_pool_sum_stat(int64_t pool) const {
-    ceph::unordered_map<int,pool_stat_t>::const_iterator p =
-      pg_pool_sum.find(pool);
-    if (p != pg_pool_sum.end())
-      return p->second;
-    return pool_stat_t();
-  }
-
   void update_pg(pg_t pgid, bufferlist& bl);
   void remove_pg(pg_t pgid);
   void update_osd(int osd, bufferlist& bl);
@@ -278,7 +347,6 @@ public:
   void dump(Formatter *f) const; 
   void dump_pool_stats(const OSDMap &osd_map, stringstream *ss, Formatter *f,
       bool verbose) const;
-  void dump_fs_stats(stringstream *ss, Formatter *f, bool verbose) const;
   static void dump_object_stat_sum(TextTable &tbl, Formatter *f,
 			    const object_stat_sum_t &sum,
 			    uint64_t avail,
@@ -317,29 +385,10 @@ public:
 
   void get_filtered_pg_stats(uint32_t state, int64_t poolid, int64_t osdid,
                              bool primary, set<pg_t>& pgs);
-  void recovery_summary(Formatter *f, list<string> *psl,
-                        const pool_stat_t& delta_sum) const;
-  void overall_recovery_summary(Formatter *f, list<string> *psl) const;
   void pool_recovery_summary(Formatter *f, list<string> *psl,
                              uint64_t poolid) const;
-  void recovery_rate_summary(Formatter *f, ostream *out,
-                             const pool_stat_t& delta_sum,
-                             utime_t delta_stamp) const;
-  void overall_recovery_rate_summary(Formatter *f, ostream *out) const;
   void pool_recovery_rate_summary(Formatter *f, ostream *out,
                                   uint64_t poolid) const;
-  /**
-   * Obtain a formatted/plain output for client I/O, source from stats for a
-   * given @p delta_sum pool over a given @p delta_stamp period of time.
-   */
-  void client_io_rate_summary(Formatter *f, ostream *out,
-                              const pool_stat_t& delta_sum,
-                              utime_t delta_stamp) const;
-  /**
-   * Obtain a formatted/plain output for the overall client I/O, which is
-   * calculated resorting to @p pg_sum_delta and @p stamp_delta.
-   */
-  void overall_client_io_rate_summary(Formatter *f, ostream *out) const;
   /**
    * Obtain a formatted/plain output for client I/O over a given pool
    * with id @p pool_id.  We will then obtain pool-specific data
@@ -347,18 +396,6 @@ public:
    */
   void pool_client_io_rate_summary(Formatter *f, ostream *out,
                                    uint64_t poolid) const;
-  /**
-   * Obtain a formatted/plain output for cache tier IO, source from stats for a
-   * given @p delta_sum pool over a given @p delta_stamp period of time.
-   */
-  void cache_io_rate_summary(Formatter *f, ostream *out,
-                             const pool_stat_t& delta_sum,
-                             utime_t delta_stamp) const;
-  /**
-   * Obtain a formatted/plain output for the overall cache tier IO, which is
-   * calculated resorting to @p pg_sum_delta and @p stamp_delta.
-   */
-  void overall_cache_io_rate_summary(Formatter *f, ostream *out) const;
   /**
    * Obtain a formatted/plain output for cache tier IO over a given pool
    * with id @p pool_id.  We will then obtain pool-specific data
@@ -367,15 +404,17 @@ public:
   void pool_cache_io_rate_summary(Formatter *f, ostream *out,
                                   uint64_t poolid) const;
 
-  void print_summary(Formatter *f, ostream *out) const;
   void print_oneline_summary(Formatter *f, ostream *out) const;
 
-  epoch_t get_min_last_epoch_clean() const {
+  epoch_t get_min_last_epoch_clean() const override {
     if (!min_last_epoch_clean)
       min_last_epoch_clean = calc_min_last_epoch_clean();
     return min_last_epoch_clean;
   }
 
+  /// the aggregates, plus the stuck pg counts as of @p cutoff
+  void get_digest(PGMapDigest *d, utime_t cutoff) const;
+
   static void generate_test_instances(list<PGMap*>& o);
 };
 WRITE_CLASS_ENCODER_FEATURES(PGMap::Incremental)
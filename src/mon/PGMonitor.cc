@@ -18,6 +18,7 @@
 #include "PGMonitor.h"
 #include "Monitor.h"
 #include "OSDMonitor.h"
+#include "MgrStatMonitor.h"
 #include "MonitorDBStore.h"
 
 #include "messages/MPGStats.h"
@@ -80,19 +81,20 @@ void PGMonitor::on_active()
 void PGMonitor::update_logger()
 {
   dout(10) << "update_logger" << dendl;
+  const PGMapDigest& d = get_digest();
 
-  mon->cluster_logger->set(l_cluster_osd_bytes, pg_map.osd_sum.kb * 1024ull);
+  mon->cluster_logger->set(l_cluster_osd_bytes, d.osd_sum.kb * 1024ull);
   mon->cluster_logger->set(l_cluster_osd_bytes_used,
-                           pg_map.osd_sum.kb_used * 1024ull);
+                           d.osd_sum.kb_used * 1024ull);
   mon->cluster_logger->set(l_cluster_osd_bytes_avail,
-                           pg_map.osd_sum.kb_avail * 1024ull);
+                           d.osd_sum.kb_avail * 1024ull);
 
-  mon->cluster_logger->set(l_cluster_num_pool, pg_map.pg_pool_sum.size());
-  mon->cluster_logger->set(l_cluster_num_pg, pg_map.pg_stat.size());
+  mon->cluster_logger->set(l_cluster_num_pool, d.pg_pool_sum.size());
+  mon->cluster_logger->set(l_cluster_num_pg, d.num_pg);
 
   unsigned active = 0, active_clean = 0, peering = 0;
-  for (ceph::unordered_map<int,int>::iterator p = pg_map.num_pg_by_state.begin();
-       p != pg_map.num_pg_by_state.end();
+  for (ceph::unordered_map<int,int>::const_iterator p = d.num_pg_by_state.begin();
+       p != d.num_pg_by_state.end();
        ++p) {
     if (p->first & PG_STATE_ACTIVE) {
       active += p->second;
@@ -106,11 +108,18 @@ void PGMonitor::update_logger()
   mon->cluster_logger->set(l_cluster_num_pg_active, active);
   mon->cluster_logger->set(l_cluster_num_pg_peering, peering);
 
-  mon->cluster_logger->set(l_cluster_num_object, pg_map.pg_sum.stats.sum.num_objects);
-  mon->cluster_logger->set(l_cluster_num_object_degraded, pg_map.pg_sum.stats.sum.num_objects_degraded);
-  mon->cluster_logger->set(l_cluster_num_object_misplaced, pg_map.pg_sum.stats.sum.num_objects_misplaced);
-  mon->cluster_logger->set(l_cluster_num_object_unfound, pg_map.pg_sum.stats.sum.num_objects_unfound);
-  mon->cluster_logger->set(l_cluster_num_bytes, pg_map.pg_sum.stats.sum.num_bytes);
+  mon->cluster_logger->set(l_cluster_num_object, d.pg_sum.stats.sum.num_objects);
+  mon->cluster_logger->set(l_cluster_num_object_degraded, d.pg_sum.stats.sum.num_objects_degraded);
+  mon->cluster_logger->set(l_cluster_num_object_misplaced, d.pg_sum.stats.sum.num_objects_misplaced);
+  mon->cluster_logger->set(l_cluster_num_object_unfound, d.pg_sum.stats.sum.num_objects_unfound);
+  mon->cluster_logger->set(l_cluster_num_bytes, d.pg_sum.stats.sum.num_bytes);
+}
+
+const PGMapDigest& PGMonitor::get_digest() const
+{
+  if (g_conf->mon_pg_stats_via_mgr)
+    return mon->mgrstatmon()->get_digest();
+  return pg_map;
 }
 
 void PGMonitor::tick()
@@ -590,10 +599,11 @@ void PGMonitor::handle_statfs(MonOpRequestRef op)
     get_last_committed());
 
   // these are in KB.
-  reply->h.st.kb = pg_map.osd_sum.kb;
-  reply->h.st.kb_used = pg_map.osd_sum.kb_used;
-  reply->h.st.kb_avail = pg_map.osd_sum.kb_avail;
-  reply->h.st.num_objects = pg_map.pg_sum.stats.sum.num_objects;
+  const PGMapDigest& d = get_digest();
+  reply->h.st.kb = d.osd_sum.kb;
+  reply->h.st.kb_used = d.osd_sum.kb_used;
+  reply->h.st.kb_avail = d.osd_sum.kb_avail;
+  reply->h.st.num_objects = d.pg_sum.stats.sum.num_objects;
 
   // reply
   mon->send_reply(op, reply);
@@ -627,9 +637,11 @@ bool PGMonitor::preprocess_getpoolstats(MonOpRequestRef op)
     int64_t poolid = mon->osdmon()->osdmap.lookup_pg_pool_name(p->c_str());
     if (poolid < 0)
       continue;
-    if (pg_map.pg_pool_sum.count(poolid) == 0)
+    const PGMapDigest& d = get_digest();
+    auto q = d.pg_pool_sum.find(poolid);
+    if (q == d.pg_pool_sum.end())
       continue;
-    reply->pool_stats[*p] = pg_map.pg_pool_sum[poolid];
+    reply->pool_stats[*p] = q->second;
   }
 
   mon->send_reply(op, reply);
@@ -742,6 +754,9 @@ bool PGMonitor::prepare_pg_stats(MonOpRequestRef op)
       
   last_osd_report[from] = ceph_clock_now();
 
+  if (g_conf->mon_pg_stats_via_mgr)
+    return prepare_pg_stats_via_mgr(op);
+
   if (!pg_stats_have_changed(from, stats)) {
     dout(10) << " message contains no new osd|pg stats" << dendl;
     MPGStatsAck *ack = new MPGStatsAck;
@@ -811,6 +826,41 @@ bool PGMonitor::prepare_pg_stats(MonOpRequestRef op)
   return true;
 }
 
+/*
+ * With ceph-mgr aggregating pg stats, an MPGStats is only a liveness
+ * report, plus whatever it tells us about the pgs we are still creating.
+ * Nothing else goes into pg_map, so most reports are acked without a
+ * proposal.
+ */
+bool PGMonitor::prepare_pg_stats_via_mgr(MonOpRequestRef op)
+{
+  op->mark_pgmon_event(__func__);
+  MPGStats *stats = static_cast<MPGStats*>(op->get_req());
+
+  MPGStatsAck *ack = new MPGStatsAck;
+  ack->set_tid(stats->get_tid());
+  bool created = false;
+  for (auto& p : stats->pg_stat) {
+    ack->pg_stat[p.first] = make_pair(p.second.reported_seq,
+				      p.second.reported_epoch);
+    if (!pg_map.creating_pgs.count(p.first) ||
+	(p.second.state & PG_STATE_CREATING))
+      continue;
+    dout(15) << " got " << p.first << " created, now "
+	     << pg_state_string(p.second.state) << dendl;
+    pending_inc.pg_stat_updates[p.first] = p.second;
+    created = true;
+  }
+
+  if (!created) {
+    mon->send_reply(op, ack);
+    return false;
+  }
+  MonOpRequestRef ack_op = mon->op_tracker.create_request<MonOpRequest>(ack);
+  wait_for_finished_proposal(op, new C_Stats(this, op, ack_op));
+  return true;
+}
+
 void PGMonitor::_updated_stats(MonOpRequestRef op, MonOpRequestRef ack_op)
 {
   op->mark_pgmon_event(__func__);
@@ -1529,6 +1579,11 @@ void PGMonitor::get_health(list<pair<health_status_t,string> >& summary,
 			   list<pair<health_status_t,string> > *detail,
 			   CephContext *cct) const
 {
+  if (g_conf->mon_pg_stats_via_mgr) {
+    get_digest_health(get_digest(), summary, detail);
+    return;
+  }
+
   map<string,int> note;
   ceph::unordered_map<int,int>::const_iterator p = pg_map.num_pg_by_state.begin();
   ceph::unordered_map<int,int>::const_iterator p_end = pg_map.num_pg_by_state.end();
@@ -1851,6 +1906,116 @@ void PGMonitor::check_full_osd_health(list<pair<health_status_t,string> >& summa
   }
 }
 
+/*
+ * The part of get_health() that can be told from the aggregates alone,
+ * for when ceph-mgr has the per-pg stats.
+ */
+void PGMonitor::get_digest_health(const PGMapDigest& d,
+				  list<pair<health_status_t,string> >& summary,
+				  list<pair<health_status_t,string> > *detail) const
+{
+  map<string,int> note;
+  for (auto& p : d.num_pg_by_state) {
+    if (p.first & PG_STATE_STALE)
+      note["stale"] += p.second;
+    if (p.first & PG_STATE_DOWN)
+      note["down"] += p.second;
+    if (p.first & PG_STATE_UNDERSIZED)
+      note["undersized"] += p.second;
+    if (p.first & PG_STATE_DEGRADED)
+      note["degraded"] += p.second;
+    if (p.first & PG_STATE_INCONSISTENT)
+      note["inconsistent"] += p.second;
+    if (p.first & PG_STATE_PEERING)
+      note["peering"] += p.second;
+    if (p.first & PG_STATE_REPAIR)
+      note["repair"] += p.second;
+    if (p.first & PG_STATE_RECOVERING)
+      note["recovering"] += p.second;
+    if (p.first & PG_STATE_RECOVERY_WAIT)
+      note["recovery_wait"] += p.second;
+    if (p.first & PG_STATE_INCOMPLETE)
+      note["incomplete"] += p.second;
+    if (p.first & PG_STATE_BACKFILL_WAIT)
+      note["backfill_wait"] += p.second;
+    if (p.first & PG_STATE_BACKFILL)
+      note["backfilling"] += p.second;
+    if (p.first & PG_STATE_BACKFILL_TOOFULL)
+      note["backfill_toofull"] += p.second;
+  }
+  for (auto& p : d.num_pg_stuck)
+    note[p.first] = p.second;
+
+  uint64_t num_inactive_pgs = 0;
+  auto p = d.num_pg_stuck.find("stuck inactive");
+  if (p != d.num_pg_stuck.end())
+    num_inactive_pgs += p->second;
+  p = d.num_pg_stuck.find("stuck stale");
+  if (p != d.num_pg_stuck.end())
+    num_inactive_pgs += p->second;
+  if (g_conf->mon_pg_min_inactive > 0 &&
+      num_inactive_pgs >= g_conf->mon_pg_min_inactive) {
+    ostringstream ss;
+    ss << num_inactive_pgs << " pgs are stuck inactive for more than "
+       << g_conf->mon_pg_stuck_threshold << " seconds";
+    summary.push_back(make_pair(HEALTH_ERR, ss.str()));
+  }
+  for (auto& p : note) {
+    ostringstream ss;
+    ss << p.second << " pgs " << p.first;
+    summary.push_back(make_pair(HEALTH_WARN, ss.str()));
+  }
+
+  // slow requests
+  if (g_conf->mon_osd_max_op_age > 0 &&
+      d.osd_sum.op_queue_age_hist.upper_bound() > g_conf->mon_osd_max_op_age) {
+    unsigned sum = _warn_slow_request_histogram(d.osd_sum.op_queue_age_hist,
+						"", summary, NULL);
+    if (sum > 0) {
+      ostringstream ss;
+      ss << sum << " requests are blocked > " << g_conf->mon_osd_max_op_age
+	 << " sec";
+      summary.push_back(make_pair(HEALTH_WARN, ss.str()));
+    }
+  }
+
+  // recovery
+  list<string> sl;
+  d.overall_recovery_summary(NULL, &sl);
+  for (auto& p : sl) {
+    summary.push_back(make_pair(HEALTH_WARN, "recovery " + p));
+    if (detail)
+      detail->push_back(make_pair(HEALTH_WARN, "recovery " + p));
+  }
+
+  // full/nearfull, without the per-osd utilization we no longer have
+  for (auto& p : { make_pair(&d.full_osds, HEALTH_ERR),
+		   make_pair(&d.nearfull_osds, HEALTH_WARN) }) {
+    if (p.first->empty())
+      continue;
+    const char *desc = p.second == HEALTH_ERR ? "full" : "near full";
+    ostringstream ss;
+    ss << p.first->size() << " " << desc << " osd(s)";
+    summary.push_back(make_pair(p.second, ss.str()));
+    if (detail) {
+      for (auto osd : *p.first) {
+	ostringstream ss;
+	ss << "osd." << osd << " is " << desc;
+	detail->push_back(make_pair(p.second, ss.str()));
+      }
+    }
+  }
+
+  // scrub
+  if (d.pg_sum.stats.sum.num_scrub_errors) {
+    ostringstream ss;
+    ss << d.pg_sum.stats.sum.num_scrub_errors << " scrub errors";
+    summary.push_back(make_pair(HEALTH_ERR, ss.str()));
+    if (detail)
+      detail->push_back(make_pair(HEALTH_ERR, ss.str()));
+  }
+}
+
 int PGMonitor::dump_stuck_pg_stats(stringstream &ds,
                                    Formatter *f,
                                    int threshold,
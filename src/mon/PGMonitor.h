@@ -61,7 +61,6 @@ private:
   void create_pending();  // prepare a new pending
   // propose pending update to peers
   version_t get_trim_to();
-  void update_logger();
 
   void encode_pending(MonitorDBStore::TransactionRef t);
   void read_pgmap_meta();
@@ -74,6 +73,7 @@ private:
   bool preprocess_pg_stats(MonOpRequestRef op);
   bool pg_stats_have_changed(int from, const MPGStats *stats) const;
   bool prepare_pg_stats(MonOpRequestRef op);
+  bool prepare_pg_stats_via_mgr(MonOpRequestRef op);
   void _updated_stats(MonOpRequestRef op, MonOpRequestRef ack_op);
 
   struct C_Stats;
@@ -139,6 +139,15 @@ public:
 
   void dump_info(Formatter *f) const;
 
+  /**
+   * The cluster-wide pg stats: our own pg_map's, or the ceph-mgr's
+   * digest when mon_pg_stats_via_mgr is set, in which case pg_map only
+   * tracks pg creation.
+   */
+  const PGMapDigest& get_digest() const;
+
+  void update_logger();
+
   int _warn_slow_request_histogram(const pow2_hist_t& h, string suffix,
 				   list<pair<health_status_t,string> >& summary,
 				   list<pair<health_status_t,string> > *detail) const;
@@ -149,6 +158,9 @@ public:
   void check_full_osd_health(list<pair<health_status_t,string> >& summary,
 			     list<pair<health_status_t,string> > *detail,
 			     const set<int>& s, const char *desc, health_status_t sev) const;
+  void get_digest_health(const PGMapDigest& d,
+			 list<pair<health_status_t,string> >& summary,
+			 list<pair<health_status_t,string> > *detail) const;
 
   void check_subs();
   void check_sub(Subscription *sub);
@@ -177,7 +177,25 @@ bool PaxosService::should_propose(double& delay)
 
 void PaxosService::propose_pending()
 {
-  dout(10) << "propose_pending" << dendl;
+  queue_pending();
+
+  if (g_conf->paxos_batch_proposals) {
+    // services still gathering updates behind their proposal timer ride
+    // along in the same transaction instead of costing a round each
+    for (auto svc : mon->paxos_service) {
+      if (svc == this || !svc->proposal_timer || !svc->is_write_ready())
+	continue;
+      dout(10) << __func__ << " batching " << svc->get_service_name() << dendl;
+      svc->queue_pending();
+    }
+  }
+
+  paxos->trigger_propose();
+}
+
+void PaxosService::queue_pending()
+{
+  dout(10) << __func__ << dendl;
   assert(have_pending);
   assert(!proposing);
   assert(mon->is_leader());
@@ -237,7 +255,6 @@ void PaxosService::propose_pending()
     }
   };
   paxos->queue_pending_finisher(new C_Committed(this));
-  paxos->trigger_propose();
 }
 
 bool PaxosService::should_stash_full()
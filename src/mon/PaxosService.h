@@ -194,6 +194,16 @@ private:
    */
   void _active();
 
+  /**
+   * Encode our pending value into the pending Paxos transaction, without
+   * triggering a proposal.
+   *
+   * @pre have_pending is true
+   * @post Cancel the proposal timer, if any
+   * @post have_pending is false
+   */
+  void queue_pending();
+
 public:
   /**
    * Propose a new value through Paxos.
@@ -207,7 +217,9 @@ public:
    * @pre Paxos is active
    * @post Cancel the proposal timer, if any
    * @post have_pending is false
-   * @post propose pending value through Paxos
+   * @post propose pending value through Paxos, along with the pending
+   *	   values of any other services waiting on their proposal timer if
+   *	   paxos_batch_proposals is set
    *
    * @note This function depends on the implementation of encode_pending on
    *	   the class that is implementing PaxosService
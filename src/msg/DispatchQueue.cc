@@ -29,11 +29,22 @@
 #define dout_prefix *_dout << "-- " << msgr->get_myaddr() << " "
 
 double DispatchQueue::get_max_age(utime_t now) const {
-  Mutex::Locker l(lock);
-  if (marrival.empty())
-    return 0;
-  else
-    return (now - marrival.begin()->first);
+  double max_age = 0;
+  for (auto shard : shards) {
+    Mutex::Locker l(shard->lock);
+    if (!shard->marrival.empty())
+      max_age = MAX(max_age, now - shard->marrival.begin()->first);
+  }
+  return max_age;
+}
+
+int DispatchQueue::get_queue_len() const {
+  int len = 0;
+  for (auto shard : shards) {
+    Mutex::Locker l(shard->lock);
+    len += shard->mqueue.length();
+  }
+  return len;
 }
 
 uint64_t DispatchQueue::pre_dispatch(Message *m)
@@ -79,18 +90,18 @@ void DispatchQueue::fast_preprocess(Message *m)
 
 void DispatchQueue::enqueue(Message *m, int priority, uint64_t id)
 {
-
-  Mutex::Locker l(lock);
+  Shard *shard = get_shard(m->get_connection().get());
+  Mutex::Locker l(shard->lock);
   ldout(cct,20) << "queue " << m << " prio " << priority << dendl;
-  add_arrival(m);
+  shard->add_arrival(m);
   if (priority >= CEPH_MSG_PRIO_LOW) {
-    mqueue.enqueue_strict(
+    shard->mqueue.enqueue_strict(
         id, priority, QueueItem(m));
   } else {
-    mqueue.enqueue(
+    shard->mqueue.enqueue(
         id, priority, m->get_cost(), QueueItem(m));
   }
-  cond.Signal();
+  shard->cond.Signal();
 }
 
 void DispatchQueue::local_delivery(Message *m, int priority)
@@ -147,15 +158,17 @@ void DispatchQueue::dispatch_throttle_release(uint64_t msize)
  * has remaining messages at that priority level, it is re-placed on to the
  * end of the queue. If the queue is empty; it's removed.
  * The message is then delivered and the process starts again.
+ * Each shard runs this loop in its own thread.
  */
-void DispatchQueue::entry()
+void DispatchQueue::entry(Shard *shard)
 {
+  Mutex &lock = shard->lock;
   lock.Lock();
   while (true) {
-    while (!mqueue.empty()) {
-      QueueItem qitem = mqueue.dequeue();
+    while (!shard->mqueue.empty()) {
+      QueueItem qitem = shard->mqueue.dequeue();
       if (!qitem.is_code())
-	remove_arrival(qitem.get_message());
+	shard->remove_arrival(qitem.get_message());
       lock.Unlock();
 
       if (qitem.is_code()) {
@@ -205,38 +218,42 @@ void DispatchQueue::entry()
       break;
 
     // wait for something to be put on queue
-    cond.Wait(lock);
+    shard->cond.Wait(lock);
   }
   lock.Unlock();
 }
 
 void DispatchQueue::discard_queue(uint64_t id) {
-  Mutex::Locker l(lock);
-  list<QueueItem> removed;
-  mqueue.remove_by_class(id, &removed);
-  for (list<QueueItem>::iterator i = removed.begin();
-       i != removed.end();
-       ++i) {
-    assert(!(i->is_code())); // We don't discard id 0, ever!
-    Message *m = i->get_message();
-    remove_arrival(m);
-    dispatch_throttle_release(m->get_dispatch_throttle_size());
-    m->put();
+  for (auto shard : shards) {
+    Mutex::Locker l(shard->lock);
+    list<QueueItem> removed;
+    shard->mqueue.remove_by_class(id, &removed);
+    for (list<QueueItem>::iterator i = removed.begin();
+	 i != removed.end();
+	 ++i) {
+      assert(!(i->is_code())); // We don't discard id 0, ever!
+      Message *m = i->get_message();
+      shard->remove_arrival(m);
+      dispatch_throttle_release(m->get_dispatch_throttle_size());
+      m->put();
+    }
   }
 }
 
 void DispatchQueue::start()
 {
   assert(!stop);
-  assert(!dispatch_thread.is_started());
-  dispatch_thread.create("ms_dispatch");
+  assert(!is_started());
+  for (auto shard : shards)
+    shard->dispatch_thread.create(shard->thread_name.c_str());
   local_delivery_thread.create("ms_local");
 }
 
 void DispatchQueue::wait()
 {
   local_delivery_thread.join();
-  dispatch_thread.join();
+  for (auto shard : shards)
+    shard->dispatch_thread.join();
 }
 
 void DispatchQueue::discard_local()
@@ -258,9 +275,11 @@ void DispatchQueue::shutdown()
   local_delivery_cond.Signal();
   local_delivery_lock.Unlock();
 
-  // stop my dispatch thread
-  lock.Lock();
+  // stop my dispatch threads
   stop = true;
-  cond.Signal();
-  lock.Unlock();
+  for (auto shard : shards) {
+    shard->lock.Lock();
+    shard->cond.Signal();
+    shard->lock.Unlock();
+  }
 }
@@ -21,6 +21,7 @@
 #include "include/assert.h"
 #include "include/xlist.h"
 #include "include/atomic.h"
+#include "include/stringify.h"
 #include "common/Mutex.h"
 #include "common/Cond.h"
 #include "common/Thread.h"
@@ -64,46 +65,86 @@ class DispatchQueue {
     
   CephContext *cct;
   Messenger *msgr;
-  mutable Mutex lock;
-  Cond cond;
-
-  PrioritizedQueue<QueueItem, uint64_t> mqueue;
-
-  set<pair<double, Message*> > marrival;
-  map<Message *, set<pair<double, Message*> >::iterator> marrival_map;
-  void add_arrival(Message *m) {
-    marrival_map.insert(
-      make_pair(
-	m,
-	marrival.insert(make_pair(m->get_recv_stamp(), m)).first
-	)
-      );
+
+  /**
+   * A Shard queues the messages and events of the connections mapped to
+   * it and delivers them from its own thread. A connection always maps
+   * to the same shard, so its messages keep their order, while those of
+   * other connections may be dispatched in parallel. There is a single
+   * shard unless ms_dispatch_threads asks for more.
+   */
+  struct Shard {
+    DispatchQueue *dq;
+    mutable Mutex lock;
+    Cond cond;
+
+    PrioritizedQueue<QueueItem, uint64_t> mqueue;
+
+    set<pair<double, Message*> > marrival;
+    map<Message *, set<pair<double, Message*> >::iterator> marrival_map;
+    void add_arrival(Message *m) {
+      marrival_map.insert(
+	make_pair(
+	  m,
+	  marrival.insert(make_pair(m->get_recv_stamp(), m)).first
+	  )
+	);
+    }
+    void remove_arrival(Message *m) {
+      map<Message *, set<pair<double, Message*> >::iterator>::iterator i =
+	marrival_map.find(m);
+      assert(i != marrival_map.end());
+      marrival.erase(i->second);
+      marrival_map.erase(i);
+    }
+
+    /**
+     * The DispatchThread runs dispatch_entry to empty out the shard.
+     */
+    class DispatchThread : public Thread {
+      Shard *shard;
+    public:
+      explicit DispatchThread(Shard *s) : shard(s) {}
+      void *entry() {
+	shard->dq->entry(shard);
+	return 0;
+      }
+    } dispatch_thread;
+    string thread_name;  // Thread keeps the pointer
+
+    Shard(DispatchQueue *dq, const string &name, unsigned i)
+      : dq(dq),
+	lock("Messenger::DispatchQueue::lock" + name),
+	mqueue(dq->cct->_conf->ms_pq_max_tokens_per_priority,
+	       dq->cct->_conf->ms_pq_min_cost),
+	dispatch_thread(this),
+	thread_name(i ? "ms_dispatch_" + stringify(i) : "ms_dispatch") {}
+  };
+  vector<Shard*> shards;
+
+  Shard *get_shard(const Connection *con) const {
+    if (shards.size() == 1)
+      return shards[0];
+    // connections are heap allocated, so mix the pointer before using it
+    uint64_t h = (uint64_t)(uintptr_t)con * 0x9E3779B97F4A7C15ull;
+    return shards[(h >> 32) % shards.size()];
   }
-  void remove_arrival(Message *m) {
-    map<Message *, set<pair<double, Message*> >::iterator>::iterator i =
-      marrival_map.find(m);
-    assert(i != marrival_map.end());
-    marrival.erase(i->second);
-    marrival_map.erase(i);
+  void queue_code(int code, Connection *con) {
+    Shard *shard = get_shard(con);
+    Mutex::Locker l(shard->lock);
+    if (stop)
+      return;
+    shard->mqueue.enqueue_strict(
+      0,
+      CEPH_MSG_PRIO_HIGHEST,
+      QueueItem(code, con));
+    shard->cond.Signal();
   }
 
   std::atomic<uint64_t> next_id;
     
   enum { D_CONNECT = 1, D_ACCEPT, D_BAD_REMOTE_RESET, D_BAD_RESET, D_CONN_REFUSED, D_NUM_CODES };
 
-  /**
-   * The DispatchThread runs dispatch_entry to empty out the dispatch_queue.
-   */
-  class DispatchThread : public Thread {
-    DispatchQueue *dq;
-  public:
-    explicit DispatchThread(DispatchQueue *dq) : dq(dq) {}
-    void *entry() {
-      dq->entry();
-      return 0;
-    }
-  } dispatch_thread;
-
   Mutex local_delivery_lock;
   Cond local_delivery_cond;
   bool stop_local_delivery;
@@ -126,16 +167,13 @@ class DispatchQueue {
   /// Throttle preventing us from building up a big backlog waiting for dispatch
   Throttle dispatch_throttler;
 
-  bool stop;
+  std::atomic<bool> stop;  // read without a shard lock by dispatch threads and Pipes
   void local_delivery(Message *m, int priority);
   void run_local_delivery();
 
   double get_max_age(utime_t now) const;
 
-  int get_queue_len() const {
-    Mutex::Locker l(lock);
-    return mqueue.length();
-  }
+  int get_queue_len() const;
 
   /**
    * Release memory accounting back to the dispatch throttler.
@@ -145,54 +183,19 @@ class DispatchQueue {
   void dispatch_throttle_release(uint64_t msize);
 
   void queue_connect(Connection *con) {
-    Mutex::Locker l(lock);
-    if (stop)
-      return;
-    mqueue.enqueue_strict(
-      0,
-      CEPH_MSG_PRIO_HIGHEST,
-      QueueItem(D_CONNECT, con));
-    cond.Signal();
+    queue_code(D_CONNECT, con);
   }
   void queue_accept(Connection *con) {
-    Mutex::Locker l(lock);
-    if (stop)
-      return;
-    mqueue.enqueue_strict(
-      0,
-      CEPH_MSG_PRIO_HIGHEST,
-      QueueItem(D_ACCEPT, con));
-    cond.Signal();
+    queue_code(D_ACCEPT, con);
   }
   void queue_remote_reset(Connection *con) {
-    Mutex::Locker l(lock);
-    if (stop)
-      return;
-    mqueue.enqueue_strict(
-      0,
-      CEPH_MSG_PRIO_HIGHEST,
-      QueueItem(D_BAD_REMOTE_RESET, con));
-    cond.Signal();
+    queue_code(D_BAD_REMOTE_RESET, con);
   }
   void queue_reset(Connection *con) {
-    Mutex::Locker l(lock);
-    if (stop)
-      return;
-    mqueue.enqueue_strict(
-      0,
-      CEPH_MSG_PRIO_HIGHEST,
-      QueueItem(D_BAD_RESET, con));
-    cond.Signal();
+    queue_code(D_BAD_RESET, con);
   }
   void queue_refused(Connection *con) {
-    Mutex::Locker l(lock);
-    if (stop)
-      return;
-    mqueue.enqueue_strict(
-      0,
-      CEPH_MSG_PRIO_HIGHEST,
-      QueueItem(D_CONN_REFUSED, con));
-    cond.Signal();
+    queue_code(D_CONN_REFUSED, con);
   }
 
   bool can_fast_dispatch(Message *m) const;
@@ -205,28 +208,31 @@ class DispatchQueue {
     return next_id++;
   }
   void start();
-  void entry();
+  void entry(Shard *shard);
   void wait();
   void shutdown();
-  bool is_started() const {return dispatch_thread.is_started();}
+  bool is_started() const {return shards[0]->dispatch_thread.is_started();}
 
   DispatchQueue(CephContext *cct, Messenger *msgr, string &name)
     : cct(cct), msgr(msgr),
-      lock("Messenger::DispatchQueue::lock" + name),
-      mqueue(cct->_conf->ms_pq_max_tokens_per_priority,
-	     cct->_conf->ms_pq_min_cost),
       next_id(1),
-      dispatch_thread(this),
       local_delivery_lock("Messenger::DispatchQueue::local_delivery_lock" + name),
       stop_local_delivery(false),
       local_delivery_thread(this),
       dispatch_throttler(cct, string("msgr_dispatch_throttler-") + name,
                          cct->_conf->ms_dispatch_throttle_bytes),
       stop(false)
-    {}
+  {
+    unsigned n = MAX(cct->_conf->ms_dispatch_threads, 1u);
+    for (unsigned i = 0; i < n; ++i)
+      shards.push_back(new Shard(this, i ? name + "-" + stringify(i) : name, i));
+  }
   ~DispatchQueue() {
-    assert(mqueue.empty());
-    assert(marrival.empty());
+    for (auto shard : shards) {
+      assert(shard->mqueue.empty());
+      assert(shard->marrival.empty());
+      delete shard;
+    }
     assert(local_messages.empty());
   }
 };
@@ -159,6 +159,7 @@ using namespace std;
 #include "messages/MMgrBeacon.h"
 #include "messages/MMgrMap.h"
 #include "messages/MMgrDigest.h"
+#include "messages/MMonMgrReport.h"
 #include "messages/MMgrReport.h"
 #include "messages/MMgrOpen.h"
 #include "messages/MMgrConfigure.h"
@@ -181,6 +182,7 @@ using namespace std;
 
 #include "messages/MOSDPGUpdateLogMissing.h"
 #include "messages/MOSDPGUpdateLogMissingReply.h"
+#include "messages/MOSDRepOpBatch.h"
 
 #define DEBUGLVL  10    // debug level of output
 
@@ -460,6 +462,9 @@ Message *decode_message(CephContext *cct, int crcflags,
   case MSG_OSD_PG_UPDATE_LOG_MISSING_REPLY:
     m = new MOSDPGUpdateLogMissingReply();
     break;
+  case MSG_OSD_REPOP_BATCH:
+    m = new MOSDRepOpBatch();
+    break;
   case CEPH_MSG_OSD_BACKOFF:
     m = new MOSDBackoff;
     break;
@@ -730,6 +735,10 @@ Message *decode_message(CephContext *cct, int crcflags,
     m = new MMgrDigest();
     break;
 
+  case MSG_MON_MGR_REPORT:
+    m = new MMonMgrReport();
+    break;
+
   case MSG_MGR_OPEN:
     m = new MMgrOpen();
     break;
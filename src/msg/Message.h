@@ -33,6 +33,7 @@
 
 #include "common/debug.h"
 #include "common/config.h"
+#include "common/Tracer.h"
 
 // monitor internal
 #define MSG_MON_SCRUB              64
@@ -110,6 +111,7 @@
 #define MSG_OSD_REPOPREPLY    113
 #define MSG_OSD_PG_UPDATE_LOG_MISSING  114
 #define MSG_OSD_PG_UPDATE_LOG_MISSING_REPLY  115
+#define MSG_OSD_REPOP_BATCH   116
 
 
 // *** MDS ***
@@ -190,6 +192,9 @@
 // *** ceph-mon(MgrMonitor) -> ceph-mgr
 #define MSG_MGR_DIGEST               0x705
 
+// *** ceph-mgr -> ceph-mon(MgrStatMonitor)
+#define MSG_MON_MGR_REPORT        0x706
+
 // ======================================================
 
 // abstract Message class
@@ -248,6 +253,23 @@ public:
 				     bi::list_member_hook<>,
 				     &Message::dispatch_q > > Queue;
 
+  /// the end-to-end trace this request is part of, for the messages that
+  /// carry one
+  trace_context_t trace;
+
+  /*
+   * The trace goes after everything else in the payload: older peers
+   * don't look at what's left over, and a message from one of them
+   * simply isn't traced.
+   */
+  void encode_trace(bufferlist& bl) const {
+    ::encode(trace, bl);
+  }
+  void decode_trace(bufferlist::iterator& p) {
+    if (!p.end())
+      ::decode(trace, p);
+  }
+
 protected:
   CompletionHook* completion_hook = nullptr; // owned by Messenger
 
@@ -265,6 +287,11 @@ protected:
   // currently throttled.
   uint64_t dispatch_throttle_size = 0;
 
+  // bytes held against the memory budget of the messenger worker that
+  // received us, released when we are destroyed.
+  Throttle *recv_throttler = nullptr;
+  uint64_t recv_throttle_size = 0;
+
   friend class Messenger;
 
 public:
@@ -291,6 +318,8 @@ protected:
     if (byte_throttler)
       byte_throttler->put(payload.length() + middle.length() + data.length());
     release_message_throttle();
+    if (recv_throttler)
+      recv_throttler->put(recv_throttle_size);
     /* call completion hooks (if any) */
     if (completion_hook)
       completion_hook->complete(0);
@@ -310,6 +339,11 @@ public:
   void set_dispatch_throttle_size(uint64_t s) { dispatch_throttle_size = s; }
   uint64_t get_dispatch_throttle_size() const { return dispatch_throttle_size; }
 
+  void set_recv_throttler(Throttle *t, uint64_t s) {
+    recv_throttler = t;
+    recv_throttle_size = s;
+  }
+
   const ceph_msg_header &get_header() const { return header; }
   ceph_msg_header &get_header() { return header; }
   void set_header(const ceph_msg_header &e) { header = e; }
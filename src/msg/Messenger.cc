@@ -4,6 +4,8 @@
 #include <random>
 #include "include/Spinlock.h"
 #include "include/types.h"
+#include "include/ipaddr.h"
+#include "include/str_list.h"
 #include "Messenger.h"
 
 #include "msg/simple/SimpleMessenger.h"
@@ -62,3 +64,43 @@ int Messenger::get_default_crc_flags(md_config_t * conf)
     r |= MSG_CRC_HEADER;
   return r;
 }
+
+/*
+ * Data crc is redundant on a trusted network when the store checksums
+ * the data anyway. A sender that skips it marks the footer NOCRC, so the
+ * receiver skips the check as well and no handshake change is needed.
+ */
+int Messenger::get_peer_crc_flags(int peer_type, const entity_addr_t& peer_addr) const
+{
+  const md_config_t *conf = cct->_conf;
+  if (!(crcflags & MSG_CRC_DATA) || conf->ms_crc_data_trusted_peers.empty())
+    return crcflags;
+
+  list<string> types;
+  get_str_list(conf->ms_crc_data_trusted_peers, types);
+  if (std::find(types.begin(), types.end(),
+		ceph_entity_type_name(peer_type)) == types.end())
+    return crcflags;
+
+  if (!conf->ms_crc_data_trusted_networks.empty()) {
+    list<string> networks;
+    get_str_list(conf->ms_crc_data_trusted_networks, networks);
+    bool trusted = false;
+    for (auto& n : networks) {
+      struct sockaddr_storage net;
+      unsigned int prefix_len;
+      if (!parse_network(n.c_str(), (struct sockaddr*)&net, &prefix_len)) {
+	lderr(cct) << __func__ << " unable to parse network " << n << dendl;
+	continue;
+      }
+      if (network_contains((struct sockaddr*)&net, prefix_len,
+			   peer_addr.get_sockaddr())) {
+	trusted = true;
+	break;
+      }
+    }
+    if (!trusted)
+      return crcflags;
+  }
+  return crcflags & ~MSG_CRC_DATA;
+}
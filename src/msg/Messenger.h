@@ -259,6 +259,13 @@ public:
    */
   static int get_default_crc_flags(md_config_t *);
 
+  /**
+   * Get the crc flags to use with a given peer: the default flags,
+   * without MSG_CRC_DATA if the peer is covered by
+   * ms_crc_data_trusted_peers and ms_crc_data_trusted_networks.
+   */
+  int get_peer_crc_flags(int peer_type, const entity_addr_t& peer_addr) const;
+
   /**
    * @} // Accessors
    */
@@ -97,6 +97,16 @@ class C_tick_wakeup : public EventCallback {
   }
 };
 
+class C_ack_wakeup : public EventCallback {
+  AsyncConnectionRef conn;
+
+ public:
+  explicit C_ack_wakeup(AsyncConnectionRef c): conn(c) {}
+  void do_request(int fd_or_id) override {
+    conn->delayed_ack(fd_or_id);
+  }
+};
+
 static void alloc_aligned_buffer(bufferlist& data, unsigned len, unsigned off)
 {
   // create a buffer to read into that matches the data alignment
@@ -131,12 +141,14 @@ AsyncConnection::AsyncConnection(CephContext *cct, AsyncMessenger *m, DispatchQu
     inactive_timeout_us(cct->_conf->ms_tcp_read_timeout*1000*1000),
     got_bad_auth(false), authorizer(NULL), replacing(false),
     is_reset_from_peer(false), once_ready(false), state_buffer(NULL), state_offset(0),
-    worker(w), center(&w->center)
+    worker(w), center(&w->center), crcflags(m->crcflags), load_bytes(0),
+    last_rebalance(ceph::coarse_mono_clock::now())
 {
   read_handler = new C_handle_read(this);
   write_handler = new C_handle_write(this);
   wakeup_handler = new C_time_wakeup(this);
   tick_handler = new C_tick_wakeup(this);
+  ack_handler = new C_ack_wakeup(this);
   memset(msgvec, 0, sizeof(msgvec));
   // double recv_max_prefetch see "read_until"
   recv_buf = new char[2*recv_max_prefetch];
@@ -194,8 +206,8 @@ ssize_t AsyncConnection::read_bulk(char *buf, unsigned len)
 // else return < 0 means error
 ssize_t AsyncConnection::_try_send(bool more)
 {
-  if (async_msgr->cct->_conf->ms_inject_socket_failures && cs) {
-    if (rand() % async_msgr->cct->_conf->ms_inject_socket_failures == 0) {
+  if (async_msgr->msgr_conf->ms_inject_socket_failures && cs) {
+    if (rand() % async_msgr->msgr_conf->ms_inject_socket_failures == 0) {
       ldout(async_msgr->cct, 0) << __func__ << " injecting socket failure" << dendl;
       cs.shutdown();
     }
@@ -247,8 +259,8 @@ ssize_t AsyncConnection::read_until(unsigned len, char *p)
   ldout(async_msgr->cct, 25) << __func__ << " len is " << len << " state_offset is "
                              << state_offset << dendl;
 
-  if (async_msgr->cct->_conf->ms_inject_socket_failures && cs) {
-    if (rand() % async_msgr->cct->_conf->ms_inject_socket_failures == 0) {
+  if (async_msgr->msgr_conf->ms_inject_socket_failures && cs) {
+    if (rand() % async_msgr->msgr_conf->ms_inject_socket_failures == 0) {
       ldout(async_msgr->cct, 0) << __func__ << " injecting socket failure" << dendl;
       cs.shutdown();
     }
@@ -315,11 +327,11 @@ ssize_t AsyncConnection::read_until(unsigned len, char *p)
 }
 
 void AsyncConnection::inject_delay() {
-  if (async_msgr->cct->_conf->ms_inject_internal_delays) {
+  if (async_msgr->msgr_conf->ms_inject_internal_delays) {
     ldout(async_msgr->cct, 10) << __func__ << " sleep for " << 
-      async_msgr->cct->_conf->ms_inject_internal_delays << dendl;
+      async_msgr->msgr_conf->ms_inject_internal_delays << dendl;
     utime_t t;
-    t.set_from_double(async_msgr->cct->_conf->ms_inject_internal_delays);
+    t.set_from_double(async_msgr->msgr_conf->ms_inject_internal_delays);
     t.sleep();
   }
 }
@@ -333,6 +345,11 @@ void AsyncConnection::process()
 #endif
   bool need_dispatch_writer = false;
   std::lock_guard<std::mutex> l(lock);
+  if (!center->in_thread()) {
+    // queued on the worker we were moved away from
+    center->dispatch_event_external(read_handler);
+    return;
+  }
   last_active = ceph::coarse_mono_clock::now();
   do {
     ldout(async_msgr->cct, 20) << __func__ << " prev state is " << get_state_name(prev_state) << dendl;
@@ -457,7 +474,7 @@ void AsyncConnection::process()
 
           if (has_feature(CEPH_FEATURE_NOSRCADDR)) {
             header = *((ceph_msg_header*)state_buffer);
-            if (msgr->crcflags & MSG_CRC_HEADER)
+            if (crcflags & MSG_CRC_HEADER)
               header_crc = ceph_crc32c(0, (unsigned char *)&header,
                                        sizeof(header) - sizeof(header.crc));
           } else {
@@ -466,7 +483,7 @@ void AsyncConnection::process()
             memcpy(&header, &oldheader, sizeof(header));
             header.src = oldheader.src.name;
             header.reserved = oldheader.reserved;
-            if (msgr->crcflags & MSG_CRC_HEADER) {
+            if (crcflags & MSG_CRC_HEADER) {
               header.crc = oldheader.crc;
               header_crc = ceph_crc32c(0, (unsigned char *)&oldheader, sizeof(oldheader) - sizeof(oldheader.crc));
             }
@@ -479,7 +496,7 @@ void AsyncConnection::process()
                               << " off " << header.data_off << dendl;
 
           // verify header crc
-          if (msgr->crcflags & MSG_CRC_HEADER && header_crc != header.crc) {
+          if (crcflags & MSG_CRC_HEADER && header_crc != header.crc) {
             ldout(async_msgr->cct,0) << __func__ << " got bad header crc "
                                      << header_crc << " != " << header.crc << dendl;
             goto fail;
@@ -558,6 +575,26 @@ void AsyncConnection::process()
             }
           }
 
+          state = STATE_OPEN_MESSAGE_THROTTLE_WORKER;
+          break;
+        }
+
+      case STATE_OPEN_MESSAGE_THROTTLE_WORKER:
+        {
+          // stop reading while the messages this worker already received
+          // hold more memory than it is allowed
+          recv_throttler = &worker->recv_throttle;
+          if (cur_msg_size) {
+            if (!recv_throttler->get_or_fail(cur_msg_size)) {
+              ldout(async_msgr->cct, 10) << __func__ << " wants " << cur_msg_size << " bytes from worker throttle "
+                                         << recv_throttler->get_current() << "/"
+                                         << recv_throttler->get_max() << " failed, just wait." << dendl;
+              if (register_time_events.empty())
+                register_time_events.insert(center->create_time_event(1000, wakeup_handler));
+              break;
+            }
+          }
+
           throttle_stamp = ceph_clock_now();
           state = STATE_OPEN_MESSAGE_READ_FRONT;
           break;
@@ -568,8 +605,19 @@ void AsyncConnection::process()
           // read front
           unsigned front_len = current_header.front_len;
           if (front_len) {
-            if (!front.length())
-              front.push_back(buffer::create(front_len));
+            if (!front.length()) {
+              // a message without a data segment may still carry bulk data
+              // in its front (e.g. ec sub writes); data_off then tells us
+              // how to place the front so that data ends up page aligned
+              unsigned front_off = le32_to_cpu(current_header.data_off);
+              if (!current_header.data_len && front_off &&
+                  front_off < CEPH_PAGE_SIZE && front_len >= CEPH_PAGE_SIZE) {
+                bufferptr bp = buffer::create_page_aligned(front_off + front_len);
+                front.push_back(bufferptr(bp, front_off, front_len));
+              } else {
+                front.push_back(buffer::create(front_len));
+              }
+            }
 
             r = read_until(front_len, front.c_str());
             if (r < 0) {
@@ -696,7 +744,11 @@ void AsyncConnection::process()
 
           ldout(async_msgr->cct, 20) << __func__ << " got " << front.length() << " + " << middle.length()
                               << " + " << data.length() << " byte message" << dendl;
-          Message *message = decode_message(async_msgr->cct, async_msgr->crcflags, current_header, footer, front, middle, data);
+          logger->inc(l_msgr_crc_bytes,
+                      (crcflags & MSG_CRC_HEADER ? front.length() + middle.length() : 0) +
+                      (crcflags & MSG_CRC_DATA && !(footer.flags & CEPH_MSG_FOOTER_NOCRC) ?
+                       data.length() : 0));
+          Message *message = decode_message(async_msgr->cct, crcflags, current_header, footer, front, middle, data);
           if (!message) {
             ldout(async_msgr->cct, 1) << __func__ << " decode message failed " << dendl;
             goto fail;
@@ -721,6 +773,7 @@ void AsyncConnection::process()
           // store reservation size in message, so we don't get confused
           // by messages entering the dispatch queue through other paths.
           message->set_dispatch_throttle_size(cur_msg_size);
+          message->set_recv_throttler(recv_throttler, cur_msg_size);
 
           message->set_recv_stamp(recv_stamp);
           message->set_throttle_stamp(throttle_stamp);
@@ -737,14 +790,14 @@ void AsyncConnection::process()
                     << message->get_seq() << " <= " << cur_seq << " " << message << " " << *message
                     << ", discarding" << dendl;
             message->put();
-            if (has_feature(CEPH_FEATURE_RECONNECT_SEQ) && async_msgr->cct->_conf->ms_die_on_old_message)
+            if (has_feature(CEPH_FEATURE_RECONNECT_SEQ) && async_msgr->msgr_conf->ms_die_on_old_message)
               assert(0 == "old msgs despite reconnect_seq feature");
             break;
           }
           if (message->get_seq() > cur_seq + 1) {
             ldout(async_msgr->cct, 0) << __func__ << " missed message?  skipped from seq "
                                       << cur_seq << " to " << message->get_seq() << dendl;
-            if (async_msgr->cct->_conf->ms_die_on_skipped_message)
+            if (async_msgr->msgr_conf->ms_die_on_skipped_message)
               assert(0 == "skipped incoming seq");
           }
 
@@ -774,13 +827,17 @@ void AsyncConnection::process()
 
           logger->inc(l_msgr_recv_messages);
           logger->inc(l_msgr_recv_bytes, cur_msg_size + sizeof(ceph_msg_header) + sizeof(ceph_msg_footer));
+          logger->hinc(l_msgr_recv_lat_bytes_hist,
+                       (message->get_recv_complete_stamp() - recv_stamp).to_nsec(),
+                       cur_msg_size);
+          load_bytes += cur_msg_size + sizeof(ceph_msg_header) + sizeof(ceph_msg_footer);
 
           async_msgr->ms_fast_preprocess(message);
           if (delay_state) {
             utime_t release = message->get_recv_stamp();
             double delay_period = 0;
-            if (rand() % 10000 < async_msgr->cct->_conf->ms_inject_delay_probability * 10000.0) {
-              delay_period = async_msgr->cct->_conf->ms_inject_delay_max * (double)(rand() % 10000) / 10000.0;
+            if (rand() % 10000 < async_msgr->msgr_conf->ms_inject_delay_probability * 10000.0) {
+              delay_period = async_msgr->msgr_conf->ms_inject_delay_max * (double)(rand() % 10000) / 10000.0;
               release += delay_period;
               ldout(async_msgr->cct, 1) << "queue_received will delay until " << release << " on "
                                         << message << " " << *message << dendl;
@@ -838,6 +895,9 @@ void AsyncConnection::process()
     }
   } while (prev_state != state);
 
+  if (state == STATE_OPEN)
+    maybe_migrate();
+
   if (need_dispatch_writer && is_connected())
     center->dispatch_event_external(write_handler);
   return;
@@ -980,12 +1040,12 @@ ssize_t AsyncConnection::_process_connection()
         ldout(async_msgr->cct, 20) << __func__ << " connect peer addr for me is " << peer_addr_for_me << dendl;
         lock.unlock();
         async_msgr->learned_addr(peer_addr_for_me);
-        if (async_msgr->cct->_conf->ms_inject_internal_delays) {
-          if (rand() % async_msgr->cct->_conf->ms_inject_socket_failures == 0) {
+        if (async_msgr->msgr_conf->ms_inject_internal_delays) {
+          if (rand() % async_msgr->msgr_conf->ms_inject_socket_failures == 0) {
             ldout(msgr->cct, 10) << __func__ << " sleep for "
-                                 << async_msgr->cct->_conf->ms_inject_internal_delays << dendl;
+                                 << async_msgr->msgr_conf->ms_inject_internal_delays << dendl;
             utime_t t;
-            t.set_from_double(async_msgr->cct->_conf->ms_inject_internal_delays);
+            t.set_from_double(async_msgr->msgr_conf->ms_inject_internal_delays);
             t.sleep();
           }
         }
@@ -1311,6 +1371,7 @@ ssize_t AsyncConnection::_process_connection()
                              << connect_msg.global_seq << dendl;
         set_peer_type(connect_msg.host_type);
         policy = async_msgr->get_policy(connect_msg.host_type);
+        crcflags = async_msgr->get_peer_crc_flags(peer_type, peer_addr);
         ldout(async_msgr->cct, 10) << __func__ << " accept of host_type " << connect_msg.host_type
                                    << ", policy.lossy=" << policy.lossy << " policy.server="
                                    << policy.server << " policy.standby=" << policy.standby
@@ -1925,7 +1986,7 @@ int AsyncConnection::send_message(Message *m)
     ldout(async_msgr->cct, 5) << __func__ << " clear encoded buffer previous "
                               << f << " != " << get_features() << dendl;
   }
-  if (!is_queued() && can_write == WriteStatus::CANWRITE && async_msgr->cct->_conf->ms_async_send_inline) {
+  if (!is_queued() && can_write == WriteStatus::CANWRITE && async_msgr->msgr_conf->ms_async_send_inline) {
     if (!bl.length())
       prepare_send_message(get_features(), m, bl);
     logger->inc(l_msgr_send_messages_inline);
@@ -2164,7 +2225,10 @@ void AsyncConnection::prepare_send_message(uint64_t features, Message *m, buffer
                                << features << " " << m << " " << *m << dendl;
 
   // encode and copy out of *m
-  m->encode(features, msgr->crcflags);
+  m->encode(features, crcflags);
+  logger->inc(l_msgr_crc_bytes,
+              (crcflags & MSG_CRC_HEADER ? m->get_payload().length() + m->get_middle().length() : 0) +
+              (crcflags & MSG_CRC_DATA ? m->get_data().length() : 0));
 
   bl.append(m->get_payload());
   bl.append(m->get_middle());
@@ -2175,6 +2239,7 @@ ssize_t AsyncConnection::write_message(Message *m, bufferlist& bl, bool more)
 {
   FUNCTRACE();
   assert(can_write == WriteStatus::CANWRITE);
+  utime_t start = ceph_clock_now();
   m->set_seq(out_seq.inc());
 
   if (!policy.lossy) {
@@ -2183,7 +2248,7 @@ ssize_t AsyncConnection::write_message(Message *m, bufferlist& bl, bool more)
     m->get();
   }
 
-  if (msgr->crcflags & MSG_CRC_HEADER)
+  if (crcflags & MSG_CRC_HEADER)
     m->calc_header_crc();
 
   ceph_msg_header& header = m->get_header();
@@ -2245,22 +2310,29 @@ ssize_t AsyncConnection::write_message(Message *m, bufferlist& bl, bool more)
   if (has_feature(CEPH_FEATURE_MSG_AUTH)) {
     outcoming_bl.append((char*)&footer, sizeof(footer));
   } else {
-    if (msgr->crcflags & MSG_CRC_HEADER) {
+    if (crcflags & MSG_CRC_HEADER) {
       old_footer.front_crc = footer.front_crc;
       old_footer.middle_crc = footer.middle_crc;
       old_footer.data_crc = footer.data_crc;
     } else {
        old_footer.front_crc = old_footer.middle_crc = 0;
     }
-    old_footer.data_crc = msgr->crcflags & MSG_CRC_DATA ? footer.data_crc : 0;
+    old_footer.data_crc = crcflags & MSG_CRC_DATA ? footer.data_crc : 0;
     old_footer.flags = footer.flags;
     outcoming_bl.append((char*)&old_footer, sizeof(old_footer));
   }
 
-  logger->inc(l_msgr_send_bytes, outcoming_bl.length() - original_bl_len);
+  uint64_t msg_bytes = outcoming_bl.length() - original_bl_len;
+  logger->inc(l_msgr_send_bytes, msg_bytes);
+  load_bytes += msg_bytes;
   ldout(async_msgr->cct, 20) << __func__ << " sending " << m->get_seq()
                              << " " << m << dendl;
-  ssize_t rc = _try_send(more);
+  // when more messages follow, leave this one for the send that carries
+  // them; handle_write flushes whatever is left after its loop
+  ssize_t rc = 0;
+  if (!more ||
+      outcoming_bl.length() >= async_msgr->msgr_conf->ms_async_send_batch_bytes)
+    rc = _try_send(more);
   if (rc < 0) {
     ldout(async_msgr->cct, 1) << __func__ << " error sending " << m << ", "
                               << cpp_strerror(rc) << dendl;
@@ -2274,6 +2346,8 @@ ssize_t AsyncConnection::write_message(Message *m, bufferlist& bl, bool more)
   else if (m->get_type() == CEPH_MSG_OSD_OPREPLY)
     OID_EVENT_TRACE_WITH_MSG(m, "SEND_MSG_OSD_OPREPLY_END", false);
   m->put();
+  logger->hinc(l_msgr_send_lat_bytes_hist,
+               (ceph_clock_now() - start).to_nsec(), msg_bytes);
 
   return rc;
 }
@@ -2315,6 +2389,14 @@ void AsyncConnection::reset_recv_state()
                                << dispatch_queue->dispatch_throttler.get_max() << dendl;
     dispatch_queue->dispatch_throttle_release(cur_msg_size);
   }
+  if (state > STATE_OPEN_MESSAGE_THROTTLE_WORKER &&
+      state <= STATE_OPEN_MESSAGE_READ_FOOTER_AND_DISPATCH) {
+    ldout(async_msgr->cct, 10) << __func__ << " releasing " << cur_msg_size
+                               << " bytes to worker throttler "
+                               << recv_throttler->get_current() << "/"
+                               << recv_throttler->get_max() << dendl;
+    recv_throttler->put(cur_msg_size);
+  }
 }
 
 void AsyncConnection::handle_ack(uint64_t seq)
@@ -2424,6 +2506,12 @@ void AsyncConnection::handle_write()
   ssize_t r = 0;
 
   write_lock.lock();
+  if (!center->in_thread()) {
+    // queued on the worker we were moved away from
+    center->dispatch_event_external(write_handler);
+    write_lock.unlock();
+    return;
+  }
   if (can_write == WriteStatus::CANWRITE) {
     if (keepalive) {
       _append_keepalive_or_ack();
@@ -2451,6 +2539,8 @@ void AsyncConnection::handle_write()
     }
 
     uint64_t left = ack_left.read();
+    if (left && _defer_ack(left))
+      left = 0;
     if (left) {
       ceph_le64 s;
       s = in_seq.read();
@@ -2498,6 +2588,117 @@ void AsyncConnection::handle_write()
   lock.unlock();
 }
 
+/*
+ * Moves a busy connection to a less loaded worker, between two
+ * messages. Called in the thread of the current worker, with lock
+ * held. Its events are deleted here and created again in the thread
+ * of the new worker; events already queued here are passed on by
+ * process() and handle_write().
+ */
+void AsyncConnection::maybe_migrate()
+{
+  double interval = async_msgr->cct->_conf->ms_async_rebalance_interval;
+  if (interval <= 0)
+    return;
+  auto now = ceph::coarse_mono_clock::now();
+  uint64_t elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(
+    now - last_rebalance).count();
+  if (elapsed_us < interval * 1000000)
+    return;
+  last_rebalance = now;
+  uint64_t rate = load_bytes.exchange(0) * 1000000 / MAX(elapsed_us, 1);
+
+  if (!register_time_events.empty() ||
+      (delay_state && !delay_state->ready()))
+    return;
+  Worker *target = async_msgr->get_stack()->get_rebalance_target(worker, rate);
+  if (!target)
+    return;
+
+  ldout(async_msgr->cct, 5) << __func__ << " moving from worker " << worker->id
+                            << " to " << target->id << " at " << rate
+                            << " bytes/s" << dendl;
+  std::lock_guard<std::mutex> l(write_lock);
+  center->delete_file_event(cs.fd(), EVENT_READABLE|EVENT_WRITABLE);
+  open_write = false;
+  if (last_tick_id) {
+    center->delete_time_event(last_tick_id);
+    last_tick_id = 0;
+  }
+  // handle_write on the new worker sets it up again
+  if (ack_timer_id) {
+    center->delete_time_event(ack_timer_id);
+    ack_timer_id = 0;
+  }
+  logger->dec(l_msgr_active_connections);
+  worker->release_worker();
+  target->references++;
+  logger = target->get_perf_counter();
+  logger->inc(l_msgr_active_connections);
+  logger->inc(l_msgr_migrated_connections);
+  worker = target;
+  center = &target->center;
+  if (delay_state)
+    delay_state->set_center(center);
+
+  AsyncConnectionRef conn(this);
+  center->submit_to(center->get_id(), [conn]() mutable {
+    std::lock_guard<std::mutex> l(conn->lock);
+    if (conn->state != STATE_OPEN)
+      return ;
+    conn->center->create_file_event(conn->cs.fd(), EVENT_READABLE, conn->read_handler);
+    conn->last_tick_id = conn->center->create_time_event(
+      conn->inactive_timeout_us, conn->tick_handler);
+    // pick up whatever was prefetched or queued while moving
+    conn->center->dispatch_event_external(conn->read_handler);
+    conn->center->dispatch_event_external(conn->write_handler);
+  }, true);
+}
+
+/*
+ * Whether the ack for the last received messages can wait. Nothing is
+ * kept around for acks on lossy connections. Otherwise an ack that would
+ * go out on its own is held back for ms_async_ack_delay_us, in the hope
+ * that it can ride along with the next message; acks are cumulative, so
+ * one ack then covers everything received meanwhile. Called with
+ * write_lock held.
+ */
+bool AsyncConnection::_defer_ack(uint64_t left)
+{
+  if (policy.lossy) {
+    ack_left.sub(left);
+    return true;
+  }
+  const uint64_t ACK_DELAY_MAX_MESSAGES = 64;
+  uint64_t delay_us = async_msgr->msgr_conf->ms_async_ack_delay_us;
+  if (delay_us && !outcoming_bl.length() && left < ACK_DELAY_MAX_MESSAGES) {
+    if (ack_timer_id)
+      return true;
+    if (!ack_timer_fired) {
+      ack_timer_id = center->create_time_event(delay_us, ack_handler);
+      return true;
+    }
+  }
+  if (ack_timer_id) {
+    center->delete_time_event(ack_timer_id);
+    ack_timer_id = 0;
+  }
+  ack_timer_fired = false;
+  return false;
+}
+
+void AsyncConnection::delayed_ack(uint64_t id)
+{
+  {
+    std::lock_guard<std::mutex> l(write_lock);
+    if (id != ack_timer_id)
+      return;
+    ack_timer_id = 0;
+    ack_timer_fired = true;
+  }
+  handle_write();
+}
+
 void AsyncConnection::wakeup_from(uint64_t id)
 {
   lock.lock();
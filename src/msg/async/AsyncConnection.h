@@ -74,6 +74,7 @@ class AsyncConnection : public Connection {
   int randomize_out_seq();
   void handle_ack(uint64_t seq);
   void _append_keepalive_or_ack(bool ack=false, utime_t *t=NULL);
+  bool _defer_ack(uint64_t left);
   ssize_t write_message(Message *m, bufferlist& bl, bool more);
   void inject_delay();
   ssize_t _reply_accept(char tag, ceph_msg_connect &connect, ceph_msg_connect_reply &reply,
@@ -106,6 +107,10 @@ class AsyncConnection : public Connection {
       center->delete_time_event(last_tick_id);
       last_tick_id = 0;
     }
+    if (ack_timer_id) {
+      center->delete_time_event(ack_timer_id);
+      ack_timer_id = 0;
+    }
     if (cs) {
       center->delete_file_event(cs.fd(), EVENT_READABLE|EVENT_WRITABLE);
       cs.shutdown();
@@ -201,6 +206,7 @@ class AsyncConnection : public Connection {
     set_peer_type(type);
     set_peer_addr(addr);
     policy = msgr->get_policy(type);
+    crcflags = msgr->get_peer_crc_flags(type, addr);
     _connect();
   }
   // Only call when AsyncConnection first construct
@@ -225,6 +231,7 @@ class AsyncConnection : public Connection {
     STATE_OPEN_MESSAGE_THROTTLE_MESSAGE,
     STATE_OPEN_MESSAGE_THROTTLE_BYTES,
     STATE_OPEN_MESSAGE_THROTTLE_DISPATCH_QUEUE,
+    STATE_OPEN_MESSAGE_THROTTLE_WORKER,
     STATE_OPEN_MESSAGE_READ_FRONT,
     STATE_OPEN_MESSAGE_READ_MIDDLE,
     STATE_OPEN_MESSAGE_READ_DATA_PREPARE,
@@ -262,6 +269,7 @@ class AsyncConnection : public Connection {
                                         "STATE_OPEN_MESSAGE_THROTTLE_MESSAGE",
                                         "STATE_OPEN_MESSAGE_THROTTLE_BYTES",
                                         "STATE_OPEN_MESSAGE_THROTTLE_DISPATCH_QUEUE",
+                                        "STATE_OPEN_MESSAGE_THROTTLE_WORKER",
                                         "STATE_OPEN_MESSAGE_READ_FRONT",
                                         "STATE_OPEN_MESSAGE_READ_MIDDLE",
                                         "STATE_OPEN_MESSAGE_READ_DATA_PREPARE",
@@ -324,6 +332,7 @@ class AsyncConnection : public Connection {
   EventCallbackRef write_handler;
   EventCallbackRef wakeup_handler;
   EventCallbackRef tick_handler;
+  EventCallbackRef ack_handler;
   struct iovec msgvec[ASYNC_IOV_MAX];
   char *recv_buf;
   uint32_t recv_max_prefetch;
@@ -333,6 +342,9 @@ class AsyncConnection : public Connection {
   ceph::coarse_mono_clock::time_point last_active;
   uint64_t last_tick_id = 0;
   const uint64_t inactive_timeout_us;
+  // pending delayed ack, both protected by write_lock
+  uint64_t ack_timer_id = 0;
+  bool ack_timer_fired = false;
 
   // Tis section are temp variables used by state transition
 
@@ -341,6 +353,7 @@ class AsyncConnection : public Connection {
   utime_t throttle_stamp;
   unsigned msg_left;
   uint64_t cur_msg_size;
+  Throttle *recv_throttler = nullptr;  // worker budget cur_msg_size was taken from
   ceph_msg_header current_header;
   bufferlist data_buf;
   bufferlist::iterator data_blp;
@@ -371,12 +384,20 @@ class AsyncConnection : public Connection {
   EventCenter *center;
   ceph::shared_ptr<AuthSessionHandler> session_security;
 
+  // msgr crcflags, maybe without data crc for this peer
+  int crcflags;
+  // bytes sent and received since the last rebalance check
+  std::atomic<uint64_t> load_bytes;
+  ceph::coarse_mono_clock::time_point last_rebalance;
+  void maybe_migrate();
+
  public:
   // used by eventcallback
   void handle_write();
   void process();
   void wakeup_from(uint64_t id);
   void tick(uint64_t id);
+  void delayed_ack(uint64_t id);
   void local_deliver();
   void stop(bool queue_reset) {
     lock.lock();
@@ -392,6 +413,7 @@ class AsyncConnection : public Connection {
     delete write_handler;
     delete wakeup_handler;
     delete tick_handler;
+    delete ack_handler;
     if (delay_state) {
       delete delay_state;
       delay_state = NULL;
@@ -242,9 +242,35 @@ class C_handle_reap : public EventCallback {
  * AsyncMessenger
  */
 
+const char *AsyncMessengerConf::tracked_keys[] = {
+  "ms_inject_socket_failures",
+  "ms_inject_internal_delays",
+  "ms_inject_delay_probability",
+  "ms_inject_delay_max",
+  "ms_die_on_old_message",
+  "ms_die_on_skipped_message",
+  "ms_async_send_inline",
+  "ms_async_send_batch_bytes",
+  "ms_async_ack_delay_us",
+  NULL
+};
+
+AsyncMessengerConf::AsyncMessengerConf(const md_config_t *conf)
+  : ms_inject_socket_failures(conf->ms_inject_socket_failures),
+    ms_inject_internal_delays(conf->ms_inject_internal_delays),
+    ms_inject_delay_probability(conf->ms_inject_delay_probability),
+    ms_inject_delay_max(conf->ms_inject_delay_max),
+    ms_die_on_old_message(conf->ms_die_on_old_message),
+    ms_die_on_skipped_message(conf->ms_die_on_skipped_message),
+    ms_async_send_inline(conf->ms_async_send_inline),
+    ms_async_send_batch_bytes(conf->ms_async_send_batch_bytes),
+    ms_async_ack_delay_us(conf->ms_async_ack_delay_us)
+{}
+
 AsyncMessenger::AsyncMessenger(CephContext *cct, entity_name_t name,
                                const std::string &type, string mname, uint64_t _nonce)
   : SimplePolicyMessenger(cct, name,mname, _nonce),
+    msgr_conf(cct->_conf),
     dispatch_queue(cct, this, mname),
     lock("AsyncMessenger::lock"),
     nonce(_nonce), need_addr(true), did_bind(false),
@@ -29,6 +29,7 @@ using namespace std;
 #include "include/atomic.h"
 #include "common/Cond.h"
 #include "common/Thread.h"
+#include "common/config_snapshot.h"
 
 #include "msg/SimplePolicyMessenger.h"
 #include "msg/DispatchQueue.h"
@@ -71,6 +72,22 @@ class Processor {
  *
  */
 
+/// options read for every message, see AsyncMessenger::msgr_conf
+struct AsyncMessengerConf {
+  uint64_t ms_inject_socket_failures;
+  double ms_inject_internal_delays;
+  double ms_inject_delay_probability;
+  double ms_inject_delay_max;
+  bool ms_die_on_old_message;
+  bool ms_die_on_skipped_message;
+  bool ms_async_send_inline;
+  uint64_t ms_async_send_batch_bytes;
+  uint32_t ms_async_ack_delay_us;
+
+  explicit AsyncMessengerConf(const md_config_t *conf);
+  static const char *tracked_keys[];
+};
+
 class AsyncMessenger : public SimplePolicyMessenger {
   // First we have the public Messenger interface implementation...
 public:
@@ -213,6 +230,10 @@ private:
   void _finish_bind(const entity_addr_t& bind_addr,
 		    const entity_addr_t& listen_addr);
 
+ public:
+  /// per-message options, read without the config lock
+  ConfigSnapshot<AsyncMessengerConf> msgr_conf;
+
  private:
   static const uint64_t ReapDeadConnectionThreshold = 5;
 
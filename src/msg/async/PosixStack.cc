@@ -19,8 +19,13 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#ifdef __linux__
+#include <linux/errqueue.h>
+#endif
 
 #include <algorithm>
+#include <deque>
+#include <map>
 
 #include "PosixStack.h"
 
@@ -28,6 +33,7 @@
 #include "include/str_list.h"
 #include "include/sock_compat.h"
 #include "common/errno.h"
+#include "common/numa.h"
 #include "common/strtol.h"
 #include "common/dout.h"
 #include "include/assert.h"
@@ -37,6 +43,24 @@
 #undef dout_prefix
 #define dout_prefix *_dout << "PosixStack "
 
+#ifdef __linux__
+// MSG_ZEROCOPY is new in linux 4.14; older headers lack the constants, and
+// older kernels refuse SO_ZEROCOPY, in which case we keep copying.
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+#define HAVE_MSG_ZEROCOPY 1
+#endif
+
 class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   NetHandler &handler;
   int _fd;
@@ -48,9 +72,35 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   bool sigpipe_unblock;
 #endif
 
+  // sendmsg calls of at least this many bytes go out with MSG_ZEROCOPY,
+  // 0 if zero copy is off for this socket
+  uint64_t zerocopy_min;
+  bool zerocopy_enabled = false;
+  // the kernel numbers every successful MSG_ZEROCOPY sendmsg call and
+  // reports finished ranges of those numbers on the error queue. until
+  // then the pages are still referenced by the skbs, so we keep the
+  // buffers alive.
+  struct zerocopy_pinned_t {
+    uint32_t last_seq;
+    std::list<bufferptr> ptrs;
+  };
+  std::deque<zerocopy_pinned_t> zerocopy_pinned;
+  std::map<uint32_t, uint32_t> zerocopy_done;  // out of order lo -> hi
+  uint32_t zerocopy_next_seq = 0;
+  uint32_t zerocopy_acked = 0;  // every seq before this one has completed
+
  public:
-  explicit PosixConnectedSocketImpl(NetHandler &h, const entity_addr_t &sa, int f, bool connected)
-      : handler(h), _fd(f), sa(sa), connected(connected) {}
+  explicit PosixConnectedSocketImpl(NetHandler &h, const entity_addr_t &sa, int f, bool connected,
+                                    uint64_t zerocopy_min_bytes = 0)
+      : handler(h), _fd(f), sa(sa), connected(connected),
+        zerocopy_min(zerocopy_min_bytes) {
+#ifdef HAVE_MSG_ZEROCOPY
+    if (zerocopy_min) {
+      int on = 1;
+      zerocopy_enabled = ::setsockopt(_fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0;
+    }
+#endif
+  }
 
   int is_connected() override {
     if (connected)
@@ -72,6 +122,9 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   }
 
   ssize_t read(char *buf, size_t len) override {
+    // the error queue raises EPOLLERR, which the event loop reports as
+    // readable, so this is where completions of an idle sender land
+    reap_zerocopy();
     ssize_t r = ::read(_fd, buf, len);
     if (r < 0)
       r = -errno;
@@ -140,9 +193,58 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   #endif  /* !defined(MSG_NOSIGNAL) && !defined(SO_NOSIGPIPE) */
   }
 
+  static bool seq_before(uint32_t a, uint32_t b) {
+    return (int32_t)(a - b) < 0;
+  }
+
+  void zerocopy_complete(uint32_t lo, uint32_t hi) {
+    zerocopy_done[lo] = hi;
+    for (auto p = zerocopy_done.find(zerocopy_acked);
+         p != zerocopy_done.end();
+         p = zerocopy_done.find(zerocopy_acked)) {
+      zerocopy_acked = p->second + 1;
+      zerocopy_done.erase(p);
+    }
+    while (!zerocopy_pinned.empty() &&
+           seq_before(zerocopy_pinned.front().last_seq, zerocopy_acked))
+      zerocopy_pinned.pop_front();
+  }
+
+  // drain zero copy completions from the socket error queue and release
+  // the buffers the kernel no longer references
+  void reap_zerocopy() {
+#ifdef HAVE_MSG_ZEROCOPY
+    if (zerocopy_pinned.empty())
+      return;
+    while (true) {
+      char control[CMSG_SPACE(sizeof(struct sock_extended_err)) + 64];
+      struct msghdr msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof(control);
+      if (::recvmsg(_fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        return;
+      for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+              (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+          continue;
+        struct sock_extended_err *serr = (struct sock_extended_err*)CMSG_DATA(cm);
+        if (serr->ee_errno != 0 || serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+          continue;
+        // the kernel had to copy anyway (e.g. loopback or a nic without
+        // scatter-gather), so we only pay for the notifications
+        if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+          zerocopy_enabled = false;
+        zerocopy_complete(serr->ee_info, serr->ee_data);
+      }
+    }
+#endif
+  }
+
   // return the sent length
   // < 0 means error occured
-  static ssize_t do_sendmsg(int fd, struct msghdr &msg, unsigned len, bool more)
+  static ssize_t do_sendmsg(int fd, struct msghdr &msg, unsigned len, bool more,
+                            int extra_flags = 0, unsigned *calls = nullptr)
   {
     suppress_sigpipe();
 
@@ -150,9 +252,9 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
     while (1) {
       ssize_t r;
   #if defined(MSG_NOSIGNAL)
-      r = ::sendmsg(fd, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+      r = ::sendmsg(fd, &msg, MSG_NOSIGNAL | (more ? MSG_MORE : 0) | extra_flags);
   #else
-      r = ::sendmsg(fd, &msg, (more ? MSG_MORE : 0));
+      r = ::sendmsg(fd, &msg, (more ? MSG_MORE : 0) | extra_flags);
   #endif /* defined(MSG_NOSIGNAL) */
 
       if (r < 0) {
@@ -164,6 +266,8 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
         return -errno;
       }
 
+      if (calls)
+        ++*calls;
       sent += r;
       if (len == sent) break;
 
@@ -185,6 +289,7 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   }
 
   ssize_t send(bufferlist &bl, bool more) override {
+    reap_zerocopy();
     size_t sent_bytes = 0;
     std::list<bufferptr>::const_iterator pb = bl.buffers().begin();
     uint64_t left_pbrs = bl.buffers().size();
@@ -197,6 +302,7 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
       msg.msg_iovlen = 0;
       msg.msg_iov = msgvec;
       unsigned msglen = 0;
+      std::list<bufferptr>::const_iterator first = pb;
       while (size > 0) {
         msgvec[msg.msg_iovlen].iov_base = (void*)(pb->c_str());
         msgvec[msg.msg_iovlen].iov_len = pb->length();
@@ -206,7 +312,17 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
         size--;
       }
 
-      ssize_t r = do_sendmsg(_fd, msg, msglen, left_pbrs || more);
+      bool zerocopy = zerocopy_enabled && msglen >= zerocopy_min;
+      unsigned calls = 0;
+      ssize_t r = do_sendmsg(_fd, msg, msglen, left_pbrs || more,
+                             zerocopy ? MSG_ZEROCOPY : 0, &calls);
+      if (zerocopy && calls) {
+        // pinning the whole batch is simpler than tracking how much of it
+        // each call took, and only costs a reference per ptr
+        zerocopy_next_seq += calls;
+        zerocopy_pinned.push_back(
+          zerocopy_pinned_t{zerocopy_next_seq - 1, std::list<bufferptr>(first, pb)});
+      }
       if (r < 0)
         return r;
 
@@ -234,6 +350,9 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   }
   void close() override {
     ::close(_fd);
+    // nothing on the wire matters any more once the socket is gone
+    zerocopy_pinned.clear();
+    zerocopy_done.clear();
   }
   int fd() const override {
     return _fd;
@@ -242,6 +361,18 @@ class PosixConnectedSocketImpl final : public ConnectedSocketImpl {
   friend class PosixNetworkStack;
 };
 
+static void set_busy_poll(CephContext *cct, int sd)
+{
+#ifdef SO_BUSY_POLL
+  int us = cct->_conf->ms_async_busy_poll_us;
+  if (us && ::setsockopt(sd, SOL_SOCKET, SO_BUSY_POLL, &us, sizeof(us)) < 0) {
+    int r = -errno;
+    ldout(cct, 1) << __func__ << " failed to set SO_BUSY_POLL: "
+                  << cpp_strerror(r) << dendl;
+  }
+#endif
+}
+
 class PosixServerSocketImpl : public ServerSocketImpl {
   NetHandler &handler;
   int _fd;
@@ -279,8 +410,12 @@ int PosixServerSocketImpl::accept(ConnectedSocket *sock, const SocketOptions &op
     return -errno;
   }
   handler.set_priority(sd, opt.priority, out->get_family());
+  if (w->busy_poll)
+    set_busy_poll(w->cct, sd);
 
-  std::unique_ptr<PosixConnectedSocketImpl> csi(new PosixConnectedSocketImpl(handler, *out, sd, true));
+  std::unique_ptr<PosixConnectedSocketImpl> csi(
+    new PosixConnectedSocketImpl(handler, *out, sd, true,
+                                 w->cct->_conf->ms_async_zerocopy_min_bytes));
   *sock = ConnectedSocket(std::move(csi));
   if (out)
     out->set_sockaddr((sockaddr*)&ss);
@@ -349,11 +484,30 @@ int PosixWorker::connect(const entity_addr_t &addr, const SocketOptions &opts, C
   }
 
   net.set_priority(sd, opts.priority, addr.get_family());
+  if (busy_poll)
+    set_busy_poll(cct, sd);
   *socket = ConnectedSocket(
-      std::unique_ptr<PosixConnectedSocketImpl>(new PosixConnectedSocketImpl(net, addr, sd, !opts.nonblock)));
+      std::unique_ptr<PosixConnectedSocketImpl>(
+        new PosixConnectedSocketImpl(net, addr, sd, !opts.nonblock,
+                                     cct->_conf->ms_async_zerocopy_min_bytes)));
   return 0;
 }
 
+void PosixNetworkStack::spawn_worker(unsigned i, std::function<void ()> &&func)
+{
+  threads.resize(i+1);
+  std::set<int> cpus = get_cpus(i);
+  threads[i] = std::thread([this, cpus, func]() {
+      int r = set_cpu_affinity(cpus);
+      if (r < 0) {
+        lderr(cct) << __func__ << " failed to bind worker to cpus "
+                   << cpu_set_to_str_list(cpus) << ": " << cpp_strerror(r)
+                   << dendl;
+      }
+      func();
+    });
+}
+
 PosixNetworkStack::PosixNetworkStack(CephContext *c, const string &t)
     : NetworkStack(c, t)
 {
@@ -367,4 +521,6 @@ PosixNetworkStack::PosixNetworkStack(CephContext *c, const string &t)
     else
       lderr(cct) << __func__ << " failed to parse " << corestr << " in " << cct->_conf->ms_async_affinity_cores << dendl;
   }
+  if (coreids.empty())
+    get_numa_affinity(cct, &numa_cpus);
 }
@@ -37,20 +37,25 @@ class PosixWorker : public Worker {
 
 class PosixNetworkStack : public NetworkStack {
   vector<int> coreids;
+  std::set<int> numa_cpus;  ///< for workers without a core of their own
   vector<std::thread> threads;
 
  public:
   explicit PosixNetworkStack(CephContext *c, const string &t);
 
+  virtual bool support_connection_migration() const override { return true; }
+
   int get_cpuid(int id) const {
     if (coreids.empty())
       return -1;
     return coreids[id % coreids.size()];
   }
-  virtual void spawn_worker(unsigned i, std::function<void ()> &&func) override {
-    threads.resize(i+1);
-    threads[i] = std::thread(func);
+  std::set<int> get_cpus(int id) const {
+    if (coreids.empty())
+      return numa_cpus;
+    return std::set<int>{get_cpuid(id)};
   }
+  virtual void spawn_worker(unsigned i, std::function<void ()> &&func) override;
   virtual void join_worker(unsigned i) override {
     assert(threads.size() > i && threads[i].joinable());
     threads[i].join();
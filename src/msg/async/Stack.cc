@@ -16,6 +16,7 @@
 
 #include "common/Cond.h"
 #include "common/errno.h"
+#include "include/str_list.h"
 #include "PosixStack.h"
 #ifdef HAVE_RDMA
 #include "rdma/RDMAStack.h"
@@ -31,6 +32,17 @@
 #undef dout_prefix
 #define dout_prefix *_dout << "stack "
 
+// having any poller keeps the event center from blocking in event_wait,
+// so an idle one is all a busy polling worker needs
+class C_busy_poll : public EventCenter::Poller {
+ public:
+  explicit C_busy_poll(EventCenter *c)
+    : EventCenter::Poller(c, "busy_poll") {}
+  int poll() override {
+    return 0;
+  }
+};
+
 std::function<void ()> NetworkStack::add_thread(unsigned i)
 {
   Worker *w = workers[i];
@@ -39,7 +51,11 @@ std::function<void ()> NetworkStack::add_thread(unsigned i)
     w->center.set_owner();
       ldout(cct, 10) << __func__ << " starting" << dendl;
       w->initialize();
+      std::unique_ptr<C_busy_poll> busy_poller;
+      if (w->busy_poll)
+        busy_poller.reset(new C_busy_poll(&w->center));
       w->init_done();
+      w->update_load(ceph::coarse_mono_clock::now());
       while (!w->done) {
         ldout(cct, 30) << __func__ << " calling event process" << dendl;
 
@@ -48,13 +64,46 @@ std::function<void ()> NetworkStack::add_thread(unsigned i)
           ldout(cct, 20) << __func__ << " process events failed: "
                          << cpp_strerror(errno) << dendl;
           // TODO do something?
+        } else if (r > 0) {
+          w->perf_logger->inc(l_msgr_worker_events, r);
+        } else {
+          w->perf_logger->inc(l_msgr_worker_empty_polls);
         }
+        w->update_load(ceph::coarse_mono_clock::now());
       }
+      busy_poller.reset();
       w->reset();
       w->destroy();
   };
 }
 
+void Worker::update_load(ceph::coarse_mono_clock::time_point now)
+{
+  const auto LoadWindow = std::chrono::seconds(1);
+  if (now - load_window_start < LoadWindow)
+    return;
+
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  uint64_t cpu_ns = ts.tv_sec * 1000000000ull + ts.tv_nsec;
+  uint64_t bytes = perf_logger->get(l_msgr_recv_bytes) +
+    perf_logger->get(l_msgr_send_bytes);
+  if (load_window_cpu_ns) {
+    uint64_t wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      now - load_window_start).count();
+    uint64_t busy_ns = cpu_ns - load_window_cpu_ns;
+    wall_ns = std::max<uint64_t>(wall_ns, 1);
+    load = std::min<uint64_t>(busy_ns * 1000 / wall_ns, 1000);
+    bytes_rate = (bytes - load_window_bytes) * 1000000000ull / wall_ns;
+    perf_logger->tinc(l_msgr_worker_busy, ceph::timespan(busy_ns));
+    perf_logger->set(l_msgr_worker_load, load);
+  }
+  load_window_start = now;
+  load_window_cpu_ns = cpu_ns;
+  load_window_bytes = bytes;
+  migrated_out = false;
+}
+
 std::shared_ptr<NetworkStack> NetworkStack::create(CephContext *c, const string &t)
 {
   if (t == "posix")
@@ -105,9 +154,13 @@ NetworkStack::NetworkStack(CephContext *c, const string &t): type(t), started(fa
     num_workers = EventCenter::MAX_EVENTCENTER;
   }
 
+  vector<string> busy_poll_ids;
+  get_str_vec(cct->_conf->ms_async_busy_poll_workers, busy_poll_ids);
   for (unsigned i = 0; i < num_workers; ++i) {
     Worker *w = create_worker(cct, type, i);
     w->center.init(InitEventNumber, i, type);
+    w->busy_poll = std::find(busy_poll_ids.begin(), busy_poll_ids.end(),
+                             std::to_string(i)) != busy_poll_ids.end();
     workers.push_back(w);
   }
   cct->register_fork_watcher(this);
@@ -160,6 +213,46 @@ Worker* NetworkStack::get_worker()
   return current_best;
 }
 
+Worker* NetworkStack::get_rebalance_target(Worker *from, uint64_t rate)
+{
+  if (!support_connection_migration() || num_workers < 2)
+    return nullptr;
+  unsigned from_load = from->load;
+  uint64_t from_rate = from->bytes_rate;
+  // a busy polling worker always looks fully loaded
+  if (from->busy_poll ||
+      from_load < cct->_conf->ms_async_rebalance_min_load ||
+      rate >= from_rate)
+    return nullptr;
+
+  // the part of the load of from this connection accounts for
+  unsigned moved = from_load * rate / from_rate;
+  Worker *best = nullptr;
+  unsigned min_load = from_load;
+  for (unsigned i = 0; i < num_workers; ++i) {
+    unsigned load = workers[i]->load;
+    if (workers[i] != from && !workers[i]->busy_poll && load < min_load) {
+      best = workers[i];
+      min_load = load;
+    }
+  }
+  // moving it must not just make best the busiest worker instead
+  if (!best || min_load + moved >= from_load - moved)
+    return nullptr;
+
+  // one connection leaves a worker per window, so that the loads it
+  // measures next reflect the move
+  bool expected = false;
+  if (!from->migrated_out.compare_exchange_strong(expected, true))
+    return nullptr;
+  from->load -= moved;
+  best->load += moved;
+  ldout(cct, 10) << __func__ << " worker " << from->id << " (load "
+                 << from_load << ") to " << best->id << " (load " << min_load
+                 << "), moving " << moved << dendl;
+  return best;
+}
+
 void NetworkStack::stop()
 {
   Spinlock::Locker l(pool_spin);
@@ -20,6 +20,7 @@
 #include "include/Spinlock.h"
 #include "common/perf_counters.h"
 #include "common/simple_spin.h"
+#include "common/Throttle.h"
 #include "msg/msg_types.h"
 #include "msg/async/Event.h"
 
@@ -194,6 +195,14 @@ enum {
   l_msgr_send_bytes,
   l_msgr_created_connections,
   l_msgr_active_connections,
+  l_msgr_worker_events,
+  l_msgr_worker_empty_polls,
+  l_msgr_worker_busy,
+  l_msgr_worker_load,
+  l_msgr_migrated_connections,
+  l_msgr_crc_bytes,
+  l_msgr_recv_lat_bytes_hist,
+  l_msgr_send_lat_bytes_hist,
   l_msgr_last,
 };
 
@@ -202,6 +211,12 @@ class Worker {
   std::condition_variable init_cond;
   bool init = false;
 
+  // start of the current load window, and the thread cpu time and
+  // connection bytes at that point
+  ceph::coarse_mono_clock::time_point load_window_start;
+  uint64_t load_window_cpu_ns = 0;
+  uint64_t load_window_bytes = 0;
+
  public:
   bool done = false;
 
@@ -211,12 +226,27 @@ class Worker {
 
   std::atomic_uint references;
   EventCenter center;
+  /// bytes of received messages not yet released, capped by
+  /// ms_async_worker_max_bytes
+  Throttle recv_throttle;
+  /// spin on the event loop instead of sleeping in it
+  bool busy_poll;
+
+  /// share of the last load window this worker spent on cpu, in permille
+  std::atomic_uint load;
+  /// bytes its connections sent and received per second in that window
+  std::atomic<uint64_t> bytes_rate;
+  /// true once a connection moved away from this worker in that window
+  std::atomic_bool migrated_out;
 
   Worker(const Worker&) = delete;
   Worker& operator=(const Worker&) = delete;
 
   Worker(CephContext *c, unsigned i)
-    : cct(c), perf_logger(NULL), id(i), references(0), center(c) {
+    : cct(c), perf_logger(NULL), id(i), references(0), center(c),
+      recv_throttle(c, "msgr_worker_" + std::to_string(i) + "_recv",
+                    c->_conf->ms_async_worker_max_bytes),
+      busy_poll(false), load(0), bytes_rate(0), migrated_out(false) {
     char name[128];
     sprintf(name, "AsyncMessenger::Worker-%u", id);
     // initialize perf_logger
@@ -229,6 +259,35 @@ class Worker {
     plb.add_u64_counter(l_msgr_send_bytes, "msgr_send_bytes", "Network received bytes");
     plb.add_u64_counter(l_msgr_active_connections, "msgr_active_connections", "Active connection number");
     plb.add_u64_counter(l_msgr_created_connections, "msgr_created_connections", "Created connection number");
+    plb.add_u64_counter(l_msgr_worker_events, "msgr_worker_events", "Events processed by the worker");
+    plb.add_u64_counter(l_msgr_worker_empty_polls, "msgr_worker_empty_polls", "Event loop passes that found nothing to do");
+    plb.add_time(l_msgr_worker_busy, "msgr_worker_busy", "Cpu time of the worker thread");
+    plb.add_u64(l_msgr_worker_load, "msgr_worker_load", "Cpu share of the worker in the last second, in permille");
+    plb.add_u64_counter(l_msgr_migrated_connections, "msgr_migrated_connections", "Connections moved to this worker");
+    plb.add_u64_counter(l_msgr_crc_bytes, "msgr_crc_bytes", "Message bytes checksummed when sending or receiving");
+
+    // Latency axis configuration, values are in nanoseconds
+    PerfHistogramCommon::axis_config_d lat_axis_config{
+      "Latency (usec)",
+      PerfHistogramCommon::SCALE_LOG2, ///< Latency in logarithmic scale
+      0,                               ///< Start at 0
+      1000,                            ///< Quantization unit is 1usec
+      32,                              ///< Enough to cover stalled peers
+    };
+    // Message size axis configuration, values are in bytes
+    PerfHistogramCommon::axis_config_d bytes_axis_config{
+      "Message size (bytes)",
+      PerfHistogramCommon::SCALE_LOG2, ///< Size in logarithmic scale
+      0,                               ///< Start at 0
+      128,                             ///< Quantization unit is 128 bytes
+      32,                              ///< Enough to cover any message
+    };
+    plb.add_histogram(l_msgr_recv_lat_bytes_hist, "msgr_recv_lat_bytes_histogram",
+                      lat_axis_config, bytes_axis_config,
+                      "Time from first header byte to message read vs. size");
+    plb.add_histogram(l_msgr_send_lat_bytes_hist, "msgr_send_lat_bytes_histogram",
+                      lat_axis_config, bytes_axis_config,
+                      "Time to encode and hand a message to the socket vs. size");
 
     perf_logger = plb.create_perf_counters();
     cct->get_perfcounters_collection()->add(perf_logger);
@@ -267,6 +326,8 @@ class Worker {
     while (!init)
       init_cond.wait(l);
   }
+  /// update load and bytes_rate, from the worker thread
+  void update_load(ceph::coarse_mono_clock::time_point now);
   void reset() {
     init_lock.lock();
     init = false;
@@ -313,6 +374,9 @@ class NetworkStack : public CephContext::ForkWatcher {
   // need to let each thread do binding port.
   virtual bool support_local_listen_table() const { return false; }
   virtual bool nonblock_connect_need_writable_event() const { return true; }
+  // backend need to override this method if a connected socket can be
+  // polled by any worker, so that busy connections may be moved
+  virtual bool support_connection_migration() const { return false; }
 
   void start();
   void stop();
@@ -320,6 +384,9 @@ class NetworkStack : public CephContext::ForkWatcher {
   Worker *get_worker(unsigned i) {
     return workers[i];
   }
+  /// a less loaded worker to move a connection of from to, given the
+  /// bytes per second the connection moves, or nullptr to stay
+  Worker *get_rebalance_target(Worker *from, uint64_t rate);
   void drain();
   unsigned get_num_worker() const {
     return num_workers;
@@ -23,7 +23,6 @@
 #define dout_prefix *_dout << "Infiniband "
 
 static const uint32_t MAX_SHARED_RX_SGE_COUNT = 1;
-static const uint32_t MAX_INLINE_DATA = 0;
 static const uint32_t TCP_MSG_LEN = sizeof("0000:00000000:00000000:00000000:00000000000000000000000000000000");
 static const uint32_t CQ_DEPTH = 30000;
 
@@ -162,6 +161,7 @@ Infiniband::QueuePair::QueuePair(
   initial_psn(0),
   max_send_wr(max_send_wr),
   max_recv_wr(max_recv_wr),
+  max_inline_data(0),
   q_key(q_key),
   dead(false)
 {
@@ -183,7 +183,7 @@ int Infiniband::QueuePair::init()
   qpia.srq = srq;                      // use the same shared receive queue
   qpia.cap.max_send_wr  = max_send_wr; // max outstanding send requests
   qpia.cap.max_send_sge = 1;           // max send scatter-gather elements
-  qpia.cap.max_inline_data = MAX_INLINE_DATA;          // max bytes of immediate data on send q
+  qpia.cap.max_inline_data = cct->_conf->ms_async_rdma_max_inline_data; // max bytes of immediate data on send q
   qpia.qp_type = type;                 // RC, UC, UD, or XRC
   qpia.sq_sig_all = 0;                 // only generate CQEs on requested WQEs
 
@@ -198,8 +198,11 @@ int Infiniband::QueuePair::init()
     return -1;
   }
 
+  // the provider may round the inline size up
+  max_inline_data = qpia.cap.max_inline_data;
+
   ldout(cct, 20) << __func__ << " successfully create queue pair: "
-                 << "qp=" << qp << dendl;
+                 << "qp=" << qp << " max_inline_data=" << max_inline_data << dendl;
 
   // move from RESET to INIT state
   ibv_qp_attr qpa;
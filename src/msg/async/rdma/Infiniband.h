@@ -322,6 +322,8 @@ class Infiniband {
      */
     bool is_error() const;
     ibv_qp* get_qp() const { return qp; }
+    /// largest send that may be posted with IBV_SEND_INLINE
+    uint32_t get_max_inline_data() const { return max_inline_data; }
     Infiniband::CompletionQueue* get_tx_cq() const { return txcq; }
     Infiniband::CompletionQueue* get_rx_cq() const { return rxcq; }
     int to_dead();
@@ -341,6 +343,7 @@ class Infiniband {
     uint32_t     initial_psn;    // initial packet sequence number
     uint32_t     max_send_wr;
     uint32_t     max_recv_wr;
+    uint32_t     max_inline_data;
     uint32_t     q_key;
     bool dead;
   };
@@ -60,6 +60,7 @@ RDMADispatcher::RDMADispatcher(CephContext* c, Infiniband* i, RDMAStack* s)
   PerfCountersBuilder plb(cct, "AsyncMessenger::RDMADispatcher", l_msgr_rdma_dispatcher_first, l_msgr_rdma_dispatcher_last);
 
   plb.add_u64_counter(l_msgr_rdma_polling, "polling", "Whether dispatcher thread is polling");
+  plb.add_u64(l_msgr_rdma_polling_window, "polling_window", "Microseconds the dispatcher busy polls before sleeping");
   plb.add_u64_counter(l_msgr_rdma_inflight_tx_chunks, "inflight_tx_chunks", "The number of inflight tx chunks");
 
   plb.add_u64_counter(l_msgr_rdma_rx_total_wc, "rx_total_wc", "The number of total rx work completion");
@@ -131,6 +132,11 @@ void RDMADispatcher::polling()
   utime_t last_inactive = ceph_clock_now();
   bool rearmed = false;
   int ret = 0;
+  const bool adaptive = cct->_conf->ms_async_rdma_adaptive_polling;
+  const uint64_t max_window = cct->_conf->ms_async_rdma_polling_us;
+  const uint64_t min_window = std::max<uint64_t>(max_window / 64, 1);
+  uint64_t window = max_window;
+  perf_logger->set(l_msgr_rdma_polling_window, window);
 
   while (true) {
     int n = rx_cq->poll_cq(MAX_COMPLETIONS, wc);
@@ -152,7 +158,7 @@ void RDMADispatcher::polling()
       if (done)
         break;
 
-      if ((ceph_clock_now() - last_inactive).to_nsec() / 1000 > cct->_conf->ms_async_rdma_polling_us) {
+      if ((ceph_clock_now() - last_inactive).to_nsec() / 1000 > window) {
         handle_async_event();
         if (!rearmed) {
           // Clean up cq events after rearm notify ensure no new incoming event
@@ -168,6 +174,7 @@ void RDMADispatcher::polling()
         channel_poll.revents = 0;
         int r = 0;
         perf_logger->set(l_msgr_rdma_polling, 0);
+        utime_t sleep_start = ceph_clock_now();
         while (!done && r == 0) {
           r = poll(&channel_poll, 1, 1);
           if (r < 0) {
@@ -179,6 +186,17 @@ void RDMADispatcher::polling()
         if (r > 0 && rx_cc->get_cq_event())
           ldout(cct, 20) << __func__ << " got cq event." << dendl;
         last_inactive = ceph_clock_now();
+        if (adaptive) {
+          // woken up right after giving up: polling a bit longer would have
+          // caught it without the interrupt. a long sleep means the busy
+          // window was wasted cpu.
+          uint64_t slept = (last_inactive - sleep_start).to_nsec() / 1000;
+          if (slept < window)
+            window = std::min(window * 2, max_window);
+          else if (slept > window * 4)
+            window = std::max(window / 2, min_window);
+          perf_logger->set(l_msgr_rdma_polling_window, window);
+        }
         perf_logger->set(l_msgr_rdma_polling, 1);
         rearmed = false;
       }
@@ -355,6 +373,7 @@ RDMAWorker::RDMAWorker(CephContext *c, unsigned i)
   plb.add_u64_counter(l_msgr_rdma_rx_no_registered_mem, "rx_no_registered_mem", "The count of no registered buffer when receiving");
 
   plb.add_u64_counter(l_msgr_rdma_tx_chunks, "tx_chunks", "The number of tx chunks transmitted");
+  plb.add_u64_counter(l_msgr_rdma_tx_inline_chunks, "tx_inline_chunks", "The number of tx chunks sent inline");
   plb.add_u64_counter(l_msgr_rdma_tx_bytes, "tx_bytes", "The bytes of tx chunks transmitted");
   plb.add_u64_counter(l_msgr_rdma_rx_chunks, "rx_chunks", "The number of rx chunks transmitted");
   plb.add_u64_counter(l_msgr_rdma_rx_bytes, "rx_bytes", "The bytes of rx chunks transmitted");
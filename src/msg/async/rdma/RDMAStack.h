@@ -38,6 +38,7 @@ enum {
   l_msgr_rdma_dispatcher_first = 94000,
 
   l_msgr_rdma_polling,
+  l_msgr_rdma_polling_window,
   l_msgr_rdma_inflight_tx_chunks,
 
   l_msgr_rdma_rx_total_wc,
@@ -143,6 +144,7 @@ enum {
   l_msgr_rdma_rx_no_registered_mem,
 
   l_msgr_rdma_tx_chunks,
+  l_msgr_rdma_tx_inline_chunks,
   l_msgr_rdma_tx_bytes,
   l_msgr_rdma_rx_chunks,
   l_msgr_rdma_rx_bytes,
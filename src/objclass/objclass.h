@@ -144,6 +144,12 @@ public:
    * will be rejected without calling ::filter
    */
   virtual bool reject_empty_xattr() { return true; }
+
+  /**
+   * Called with each object before its xattr is fetched.  Returning
+   * false rejects the object without reading anything from the store.
+   */
+  virtual bool filter_name(const hobject_t &obj) { return true; }
 };
 
 // Classes expose a filter constructor that returns a subclass of PGLSFilter
@@ -783,7 +783,7 @@ public:
     /** Inquires about the Transaction as a whole. */
 
     /// How big is the encoded Transaction buffer?
-    uint64_t get_encoded_bytes() {
+    uint64_t get_encoded_bytes() const {
       //layout: data_bl + op_bl + coll_index + object_index + data
 
       // coll_index size, object_index size and sizeof(transaction_data)
@@ -983,15 +983,29 @@ private:
       if (op_ptr.length() == 0 || op_ptr.offset() >= op_ptr.length()) {
         op_ptr = bufferptr(sizeof(Op) * OPS_PER_PTR);
       }
-      bufferptr ptr(op_ptr, 0, sizeof(Op));
-      op_bl.append(ptr);
+      // extends the tail of op_bl when it is the previous op, so the ops
+      // stay in one ptr and iterator needn't rebuild op_bl to walk them
+      char* p = op_ptr.c_str();
+      op_bl.append(op_ptr, 0, sizeof(Op));
 
       op_ptr.set_offset(op_ptr.offset() + sizeof(Op));
 
-      char* p = ptr.c_str();
       memset(p, 0, sizeof(Op));
       return reinterpret_cast<Op*>(p);
     }
+    /// the indexes are encoded in key order, so each key goes at the end
+    template<typename T>
+    static void _decode_index(map<T, __le32>& m, bufferlist::iterator& p) {
+      __u32 n;
+      ::decode(n, p);
+      m.clear();
+      while (n--) {
+	T k;
+	::decode(k, p);
+	auto i = m.emplace_hint(m.end(), std::move(k), __le32());
+	::decode(i->second, p);
+      }
+    }
     __le32 _get_coll_id(const coll_t& coll) {
       map<coll_t, __le32>::iterator c = coll_index.find(coll);
       if (c != coll_index.end())
@@ -1403,6 +1417,10 @@ public:
 
     void encode(bufferlist& bl) const {
       //layout: data_bl + op_bl + coll_index + object_index + data
+      // data_bl and op_bl are appended by reference; make room for the
+      // rest, plus struct header and their lengths, in a single buffer
+      bl.reserve(get_encoded_bytes() - data_bl.length() - op_bl.length() +
+		 sizeof(__u8) * 2 + sizeof(__u32) * 3);
       ENCODE_START(9, 9, bl);
       ::encode(data_bl, bl);
       ::encode(op_bl, bl);
@@ -1418,8 +1436,8 @@ public:
 
       ::decode(data_bl, bl);
       ::decode(op_bl, bl);
-      ::decode(coll_index, bl);
-      ::decode(object_index, bl);
+      _decode_index(coll_index, bl);
+      _decode_index(object_index, bl);
       data.decode(bl);
       coll_id = coll_index.size();
       object_id = object_index.size();
@@ -1541,7 +1559,16 @@ public:
     return false;   // assume a backend cannot, unless it says otherwise
   }
 
+  /// true if the backend checksums what it writes and verifies it on read
+  virtual bool has_builtin_csum() const {
+    return false;
+  }
+
   virtual int statfs(struct store_statfs_t *buf) = 0;
+  /// space used by a single pool; -EOPNOTSUPP if not tracked by the backend
+  virtual int pool_statfs(uint64_t pool_id, struct store_statfs_t *buf) {
+    return -EOPNOTSUPP;
+  }
 
   virtual void collect_metadata(map<string,string> *pm) { }
 
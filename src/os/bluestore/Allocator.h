@@ -12,6 +12,7 @@
 #ifndef CEPH_OS_BLUESTORE_ALLOCATOR_H
 #define CEPH_OS_BLUESTORE_ALLOCATOR_H
 
+#include <functional>
 #include <ostream>
 #include "include/assert.h"
 #include "os/bluestore/bluestore_types.h"
@@ -53,6 +54,22 @@ public:
 
   virtual uint64_t get_free() = 0;
 
+  /*
+   * How fragmented the free space is, from 0 (one contiguous run) to 1
+   * (every free alloc_unit isolated).  Negative if the allocator can't
+   * tell.
+   */
+  virtual double get_fragmentation(uint64_t alloc_unit) {
+    return -1.0;
+  }
+
+  /// call notify for every free extent, in offset order; -EOPNOTSUPP
+  /// if the allocator can't enumerate its free space
+  virtual int foreach_free(
+    std::function<void(uint64_t offset, uint64_t length)> notify) {
+    return -EOPNOTSUPP;
+  }
+
   virtual void shutdown() = 0;
   static Allocator *create(CephContext* cct, string type, int64_t size,
 			   int64_t block_size);
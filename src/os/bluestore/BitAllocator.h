@@ -516,6 +516,7 @@ public:
   ~BitAllocator();
   void shutdown();
   using BitMapAreaIN::alloc_blocks_dis; //Wait version
+  using BitMapAreaIN::is_allocated;
 
   void free_blocks(int64_t start_block, int64_t num_blocks);
   void set_blocks_used(int64_t start_block, int64_t num_blocks);
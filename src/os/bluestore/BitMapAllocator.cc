@@ -163,6 +163,40 @@ uint64_t BitMapAllocator::get_free()
     m_block_size);
 }
 
+int BitMapAllocator::foreach_free(
+  std::function<void(uint64_t offset, uint64_t length)> notify)
+{
+  std::lock_guard<std::mutex> l(m_lock);
+  int64_t total = m_bit_alloc->total_blocks();
+  int64_t chunk = BmapEntry::size();
+  int64_t run_start = -1;
+  for (int64_t b = 0; b < total; ) {
+    if (b % chunk == 0 && b + chunk <= total &&
+	m_bit_alloc->is_allocated(b, chunk)) {
+      // whole word in use
+      if (run_start >= 0) {
+	notify(run_start * m_block_size, (b - run_start) * m_block_size);
+	run_start = -1;
+      }
+      b += chunk;
+      continue;
+    }
+    if (m_bit_alloc->is_allocated(b, 1)) {
+      if (run_start >= 0) {
+	notify(run_start * m_block_size, (b - run_start) * m_block_size);
+	run_start = -1;
+      }
+    } else if (run_start < 0) {
+      run_start = b;
+    }
+    ++b;
+  }
+  if (run_start >= 0) {
+    notify(run_start * m_block_size, (total - run_start) * m_block_size);
+  }
+  return 0;
+}
+
 void BitMapAllocator::dump()
 {
   std::lock_guard<std::mutex> l(m_lock);
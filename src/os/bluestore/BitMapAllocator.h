@@ -40,6 +40,8 @@ public:
     uint64_t offset, uint64_t length) override;
 
   uint64_t get_free() override;
+  int foreach_free(
+    std::function<void(uint64_t offset, uint64_t length)> notify) override;
 
   void dump() override;
 
@@ -23,7 +23,9 @@
 #endif
 
 #include "common/debug.h"
+#include "common/errno.h"
 #include "common/EventTrace.h"
+#include "common/numa.h"
 
 #define dout_context cct
 #define dout_subsys ceph_subsys_bdev
@@ -73,6 +75,22 @@ BlockDevice *BlockDevice::create(CephContext* cct, const string& path,
   return NULL;
 }
 
+std::set<int> BlockDevice::get_affinity_cpus() const
+{
+  std::set<int> cpus;
+  if (!cct->_conf->bdev_numa_affinity || numa_node < 0)
+    return cpus;
+  int r = get_numa_node_cpu_set(numa_node, &cpus);
+  if (r < 0) {
+    derr << __func__ << " unable to get cpus of numa node " << numa_node
+	 << ": " << cpp_strerror(r) << dendl;
+    return cpus;
+  }
+  dout(1) << __func__ << " numa node " << numa_node << " cpus "
+	  << cpu_set_to_str_list(cpus) << dendl;
+  return cpus;
+}
+
 void BlockDevice::queue_reap_ioc(IOContext *ioc)
 {
   std::lock_guard<std::mutex> l(ioc_reap_lock);
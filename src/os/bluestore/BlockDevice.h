@@ -20,6 +20,7 @@
 #include <atomic>
 #include <condition_variable>
 #include <mutex>
+#include <set>
 
 #include "acconfig.h"
 #include "os/fs/FS.h"
@@ -78,6 +79,7 @@ private:
 
 protected:
   bool rotational = true;
+  int numa_node = -1;  ///< of the device's controller, -1 if unknown
 
 public:
   BlockDevice(CephContext* cct) : cct(cct) {}
@@ -88,6 +90,9 @@ public:
     CephContext* cct, const string& path, aio_callback_t cb, void *cbpriv);
   virtual bool supported_bdev_label() { return true; }
   virtual bool is_rotational() { return rotational; }
+  int get_numa_node() const { return numa_node; }
+  /// cpus local to the device, if bdev_numa_affinity is set
+  std::set<int> get_affinity_cpus() const;
 
   virtual void aio_submit(IOContext *ioc) = 0;
 
@@ -30,7 +30,8 @@ BlueFS::BlueFS(CephContext* cct)
     bdev(MAX_BDEV),
     ioc(MAX_BDEV),
     block_all(MAX_BDEV),
-    block_total(MAX_BDEV, 0)
+    block_total(MAX_BDEV, 0),
+    spillover_thread(this)
 {
 }
 
@@ -77,6 +78,8 @@ void BlueFS::_init_logger()
 		    "Compactions of the metadata log");
   b.add_u64_counter(l_bluefs_logged_bytes, "logged_bytes",
 		    "Bytes written to the metadata log");
+  b.add_u64_counter(l_bluefs_log_flush_grouped, "log_flush_grouped",
+		    "Log syncs satisfied by a concurrent log flush");
   b.add_u64_counter(l_bluefs_files_written_wal, "files_written_wal",
 		    "Files written to WAL");
   b.add_u64_counter(l_bluefs_files_written_sst, "files_written_sst",
@@ -85,6 +88,37 @@ void BlueFS::_init_logger()
 		    "Bytes written to WAL");
   b.add_u64_counter(l_bluefs_bytes_written_sst, "bytes_written_sst",
 		    "Bytes written to SSTs");
+  b.add_u64(l_bluefs_spillover_bytes, "spillover_bytes",
+	    "Bytes on a slower device than their file prefers");
+  b.add_u64_counter(l_bluefs_migrated_files, "migrated_files",
+		    "Spilled files moved back to their preferred device");
+  b.add_u64_counter(l_bluefs_migrated_bytes, "migrated_bytes",
+		    "Bytes moved back to their preferred device");
+
+  // Latency axis configuration for io histograms, values are in nanoseconds
+  PerfHistogramCommon::axis_config_d io_hist_x_axis_config{
+    "Latency (usec)",
+    PerfHistogramCommon::SCALE_LOG2, ///< Latency in logarithmic scale
+    0,                               ///< Start at 0
+    10000,                           ///< Quantization unit is 10usec
+    32,                              ///< Enough to cover stalled devices
+  };
+
+  // IO size axis configuration for io histograms, values are in bytes
+  PerfHistogramCommon::axis_config_d io_hist_y_axis_config{
+    "IO size (bytes)",
+    PerfHistogramCommon::SCALE_LOG2, ///< IO size in logarithmic scale
+    0,                               ///< Start at 0
+    512,                             ///< Quantization unit is 512 bytes
+    32,                              ///< Enough to cover any sst read
+  };
+
+  b.add_histogram(l_bluefs_read_lat_bytes_hist, "read_lat_bytes_histogram",
+		  io_hist_x_axis_config, io_hist_y_axis_config,
+		  "Histogram of file read latency vs. size");
+  b.add_histogram(l_bluefs_fsync_lat_bytes_hist, "fsync_lat_bytes_histogram",
+		  io_hist_x_axis_config, io_hist_y_axis_config,
+		  "Histogram of file fsync latency vs. bytes flushed");
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -406,6 +440,10 @@ int BlueFS::mount()
            << dendl;
 
   _init_logger();
+  if (cct->_conf->bluefs_spillover_check_interval > 0) {
+    spillover_stop = false;
+    spillover_thread.create("bluefs_spill");
+  }
   return 0;
 
  out:
@@ -417,6 +455,15 @@ void BlueFS::umount()
 {
   dout(1) << __func__ << dendl;
 
+  if (spillover_thread.is_started()) {
+    {
+      std::lock_guard<std::mutex> l(spillover_lock);
+      spillover_stop = true;
+      spillover_cond.notify_all();
+    }
+    spillover_thread.join();
+  }
+
   sync_metadata();
 
   _close_writer(log_writer);
@@ -440,25 +487,36 @@ int BlueFS::fsck()
 
 int BlueFS::_write_super()
 {
-  // build superblock
   bufferlist bl;
+  _encode_super(bl);
+  _write_super_bl(bl);
+  return 0;
+}
+
+void BlueFS::_encode_super(bufferlist& bl)
+{
+  // build superblock
   ::encode(super, bl);
   uint32_t crc = bl.crc32c(-1);
   ::encode(crc, bl);
   dout(10) << __func__ << " super block length(encoded): " << bl.length() << dendl;
   dout(10) << __func__ << " superblock " << super.version << dendl;
   dout(10) << __func__ << " log_fnode " << super.log_fnode << dendl;
+  dout(20) << __func__ << " v " << super.version
+           << " crc 0x" << std::hex << crc << std::dec << dendl;
   assert(bl.length() <= get_super_length());
   bl.append_zero(get_super_length() - bl.length());
+}
 
-  bdev[BDEV_DB]->aio_write(get_super_offset(), bl, ioc[BDEV_DB], false);
-  bdev[BDEV_DB]->aio_submit(ioc[BDEV_DB]);
-  ioc[BDEV_DB]->aio_wait();
-  dout(20) << __func__ << " v " << super.version
-           << " crc 0x" << std::hex << crc
-           << " offset 0x" << get_super_offset() << std::dec
-           << dendl;
-  return 0;
+// NOTE: safe to call without the lock; uses its own IOContext
+void BlueFS::_write_super_bl(bufferlist& bl)
+{
+  IOContext sioc(cct, NULL);
+  bdev[BDEV_DB]->aio_write(get_super_offset(), bl, &sioc, false);
+  bdev[BDEV_DB]->aio_submit(&sioc);
+  sioc.aio_wait();
+  dout(20) << __func__ << " offset 0x" << std::hex << get_super_offset()
+	   << std::dec << dendl;
 }
 
 int BlueFS::_open_super()
@@ -857,6 +915,7 @@ int BlueFS::_read_random(
            << " 0x" << std::hex << off << "~" << len << std::dec
 	   << " from " << h->file->fnode << dendl;
 
+  utime_t start = ceph_clock_now();
   ++h->file->num_reading;
 
   if (!h->ignore_eof &&
@@ -888,6 +947,10 @@ int BlueFS::_read_random(
 
   dout(20) << __func__ << " got " << ret << dendl;
   --h->file->num_reading;
+  if (logger) {  // not yet during mount's log replay
+    logger->hinc(l_bluefs_read_lat_bytes_hist,
+		 (ceph_clock_now() - start).to_nsec(), ret);
+  }
   return ret;
 }
 
@@ -903,6 +966,7 @@ int BlueFS::_read(
            << " 0x" << std::hex << off << "~" << len << std::dec
 	   << " from " << h->file->fnode << dendl;
 
+  utime_t start = ceph_clock_now();
   ++h->file->num_reading;
 
   if (!h->ignore_eof &&
@@ -973,6 +1037,10 @@ int BlueFS::_read(
   dout(20) << __func__ << " got " << ret << dendl;
   assert(!outbl || (int)outbl->length() == ret);
   --h->file->num_reading;
+  if (logger) {  // not yet during mount's log replay
+    logger->hinc(l_bluefs_read_lat_bytes_hist,
+		 (ceph_clock_now() - start).to_nsec(), ret);
+  }
   return ret;
 }
 
@@ -1013,6 +1081,9 @@ uint64_t BlueFS::_estimate_log_size()
 void BlueFS::compact_log()
 {
   std::unique_lock<std::mutex> l(lock);
+  while (log_flushing || new_log_writer) {
+    log_cond.wait(l);
+  }
   if (cct->_conf->bluefs_compact_log_sync) {
      _compact_log_sync();
   } else {
@@ -1029,8 +1100,9 @@ bool BlueFS::_should_compact_log()
 	   << " expected " << expected << std::dec
 	   << " ratio " << ratio
 	   << (new_log ? " (async compaction in progress)" : "")
+	   << (log_flushing ? " (log flush in progress)" : "")
 	   << dendl;
-  if (new_log ||
+  if (new_log || log_flushing ||
       current < cct->_conf->bluefs_log_compact_min_size ||
       ratio < cct->_conf->bluefs_log_compact_min_ratio) {
     return false;
@@ -1143,7 +1215,7 @@ void BlueFS::_compact_log_sync()
  *
  * 6. Update the log_fnode to splice in the new beginning.
  *
- * 7. Write the new superblock.
+ * 7. Drop lock and write the new superblock.
  *
  * 8. Release the old log space.  Clean up.
  */
@@ -1248,13 +1320,17 @@ void BlueFS::_compact_log_async(std::unique_lock<std::mutex>& l)
   log_writer->pos = log_writer->file->fnode.size =
     log_writer->pos - old_log_jump_to + new_log_jump_to;
 
-  // 7. write the super block to reflect the changes
+  // 7. write the super block to reflect the changes.  new_log_writer is
+  // still set, so nobody can grow the log (and change log_fnode) while we
+  // are unlocked.
   dout(10) << __func__ << " writing super" << dendl;
   super.log_fnode = log_file->fnode;
   ++super.version;
-  _write_super();
+  bufferlist sbl;
+  _encode_super(sbl);
 
   lock.unlock();
+  _write_super_bl(sbl);
   flush_bdev();
   lock.lock();
 
@@ -1307,6 +1383,7 @@ int BlueFS::_flush_and_sync_log(std::unique_lock<std::mutex>& l,
   if (want_seq && want_seq <= log_seq_stable) {
     dout(10) << __func__ << " want_seq " << want_seq << " <= log_seq_stable "
 	     << log_seq_stable << ", done" << dendl;
+    logger->inc(l_bluefs_log_flush_grouped);
     return 0;
   }
   if (log_t.empty() && dirty_files.empty()) {
@@ -1362,7 +1439,14 @@ int BlueFS::_flush_and_sync_log(std::unique_lock<std::mutex>& l,
   log_t.seq = 0;  // just so debug output is less confusing
   log_flushing = true;
 
+  // make sure file data hits the disk before the log records that point
+  // at it.  log_flushing keeps other log writers out, so we need not hold
+  // the lock for this; everyone else (including other fsyncs, which will
+  // all queue up behind this flush and then go out in the next one) can
+  // keep going.
+  l.unlock();
   flush_bdev();
+  l.lock();
   int r = _flush(log_writer, true);
   assert(r == 0);
 
@@ -1420,7 +1504,8 @@ int BlueFS::_flush_and_sync_log(std::unique_lock<std::mutex>& l,
   return 0;
 }
 
-int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
+int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length,
+			 std::unique_lock<std::mutex> *l)
 {
   dout(10) << __func__ << " " << h << " pos 0x" << std::hex << h->pos
 	   << " 0x" << offset << "~" << length << std::dec
@@ -1529,12 +1614,6 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
     x_off -= partial;
     offset -= partial;
     length += partial;
-    dout(20) << __func__ << " waiting for previous aio to complete" << dendl;
-    for (auto p : h->iocv) {
-      if (p) {
-	p->aio_wait();
-      }
-    }
   }
   if (length == partial + h->buffer.length()) {
     bl.claim_append(h->buffer);
@@ -1565,6 +1644,14 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
   h->pos = offset + length;
   h->tail_block.clear();
 
+  // Carve up the data under the lock; the fnode extents may change
+  // once we drop it.
+  struct pending_write_t {
+    unsigned bdev;
+    uint64_t offset;
+    bufferlist bl;
+  };
+  vector<pending_write_t> writes;
   uint64_t bloff = 0;
   while (length > 0) {
     uint64_t x_len = MIN(p->length - x_off, length);
@@ -1595,12 +1682,34 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
 	t.append_zero(zlen);
       }
     }
-    bdev[p->bdev]->aio_write(p->offset + x_off, t, h->iocv[p->bdev], buffered);
+    writes.push_back(pending_write_t{p->bdev, p->offset + x_off, bufferlist()});
+    writes.back().bl.claim(t);
     bloff += x_len;
     length -= x_len;
     ++p;
     x_off = 0;
   }
+
+  // The data IO only touches h, which the caller serializes via
+  // h->lock, so regular files need not hold the global lock across
+  // it.  The log files stay under the lock; their writers are not
+  // handed out.
+  bool unlocked = false;
+  if (l && h->file->fnode.ino > 1) {
+    l->unlock();
+    unlocked = true;
+  }
+  if (partial) {
+    dout(20) << __func__ << " waiting for previous aio to complete" << dendl;
+    for (auto p : h->iocv) {
+      if (p) {
+	p->aio_wait();
+      }
+    }
+  }
+  for (auto& w : writes) {
+    bdev[w.bdev]->aio_write(w.offset, w.bl, h->iocv[w.bdev], buffered);
+  }
   for (unsigned i = 0; i < MAX_BDEV; ++i) {
     if (bdev[i]) {
       assert(h->iocv[i]);
@@ -1609,6 +1718,9 @@ int BlueFS::_flush_range(FileWriter *h, uint64_t offset, uint64_t length)
       }
     }
   }
+  if (unlocked) {
+    l->lock();
+  }
   dout(20) << __func__ << " h " << h << " pos now 0x"
            << std::hex << h->pos << std::dec << dendl;
   return 0;
@@ -1642,7 +1754,8 @@ void BlueFS::wait_for_aio(FileWriter *h)
   dout(10) << __func__ << " " << h << " done in " << dur << dendl;
 }
 
-int BlueFS::_flush(FileWriter *h, bool force)
+int BlueFS::_flush(FileWriter *h, bool force,
+		   std::unique_lock<std::mutex> *l)
 {
   h->buffer_appender.flush();
   uint64_t length = h->buffer.length();
@@ -1663,7 +1776,7 @@ int BlueFS::_flush(FileWriter *h, bool force)
            << std::hex << offset << "~" << length << std::dec
 	   << " to " << h->file->fnode << dendl;
   assert(h->pos <= h->file->fnode.size);
-  return _flush_range(h, offset, length);
+  return _flush_range(h, offset, length, l);
 }
 
 int BlueFS::_truncate(FileWriter *h, uint64_t offset)
@@ -1710,7 +1823,9 @@ int BlueFS::_truncate(FileWriter *h, uint64_t offset)
 int BlueFS::_fsync(FileWriter *h, std::unique_lock<std::mutex>& l)
 {
   dout(10) << __func__ << " " << h << " " << h->file->fnode << dendl;
-  int r = _flush(h, true);
+  utime_t start = ceph_clock_now();
+  uint64_t bytes = h->buffer.length();
+  int r = _flush(h, true, &l);
   if (r < 0)
      return r;
   uint64_t old_dirty_seq = h->file->dirty_seq;
@@ -1728,6 +1843,8 @@ int BlueFS::_fsync(FileWriter *h, std::unique_lock<std::mutex>& l)
     assert(h->file->dirty_seq == 0 ||  // cleaned
 	   h->file->dirty_seq > s);    // or redirtied by someone else
   }
+  logger->hinc(l_bluefs_fsync_lat_bytes_hist,
+	       (ceph_clock_now() - start).to_nsec(), bytes);
   return 0;
 }
 
@@ -1741,8 +1858,176 @@ void BlueFS::flush_bdev()
   }
 }
 
+void BlueFS::_spillover_thread()
+{
+  dout(10) << __func__ << " start" << dendl;
+  std::unique_lock<std::mutex> l(spillover_lock);
+  while (!spillover_stop) {
+    auto interval = ceph::make_timespan(
+      cct->_conf->bluefs_spillover_check_interval);
+    spillover_cond.wait_for(l, interval);
+    if (spillover_stop)
+      break;
+    l.unlock();
+    check_spillover(cct->_conf->bluefs_spillover_migrate,
+		    cct->_conf->bluefs_spillover_migrate_max_bytes);
+    l.lock();
+  }
+  dout(10) << __func__ << " finish" << dendl;
+}
+
+uint64_t BlueFS::check_spillover(bool migrate, uint64_t max_bytes)
+{
+  std::unique_lock<std::mutex> l(lock);
+  uint64_t spilled = 0;
+  vector<pair<utime_t,FileRef>> candidates;
+  for (auto& p : file_map) {
+    FileRef f = p.second;
+    if (f->fnode.ino <= 1)
+      continue;
+    uint64_t file_spilled = 0;
+    for (auto& e : f->fnode.extents) {
+      if (e.bdev > f->fnode.prefer_bdev)
+	file_spilled += e.length;
+    }
+    if (!file_spilled)
+      continue;
+    spilled += file_spilled;
+    // wal files are short-lived; leave them alone
+    if (f->fnode.prefer_bdev != BDEV_WAL && bdev[f->fnode.prefer_bdev])
+      candidates.push_back(make_pair(f->fnode.mtime, f));
+  }
+  logger->set(l_bluefs_spillover_bytes, spilled);
+  dout(10) << __func__ << " 0x" << std::hex << spilled << std::dec
+	   << " bytes spilled over in " << candidates.size()
+	   << " movable files" << dendl;
+  if (!migrate || candidates.empty())
+    return spilled;
+
+  // newer files are in the lower, hotter levels; move them first
+  std::sort(candidates.begin(), candidates.end(),
+	    [](const pair<utime_t,FileRef>& a, const pair<utime_t,FileRef>& b) {
+	      return a.first > b.first;
+	    });
+  uint64_t moved = 0;
+  for (auto& p : candidates) {
+    if (moved >= max_bytes)
+      break;
+    FileRef f = p.second;
+    uint64_t size = f->fnode.size;
+    int r = _migrate_file(l, f);
+    if (r == -ENOSPC)
+      break;
+    if (r == 0) {
+      moved += size;
+      spilled -= std::min(spilled, size);
+    }
+  }
+  logger->set(l_bluefs_spillover_bytes, spilled);
+  return spilled;
+}
+
+int BlueFS::_migrate_file(std::unique_lock<std::mutex>& l, FileRef f)
+{
+  if (f->deleted || f->num_readers.load() || f->num_writers.load() ||
+      f->locked) {
+    dout(20) << __func__ << " " << f->fnode << " busy" << dendl;
+    return -EBUSY;
+  }
+  uint8_t target = f->fnode.prefer_bdev;
+  uint64_t min_alloc_size = cct->_conf->bluefs_alloc_size;
+  uint64_t need = ROUND_UP_TO(MAX(f->fnode.size, 1), min_alloc_size);
+  uint64_t reserve = block_total[target] *
+    cct->_conf->bluefs_spillover_migrate_min_free_ratio;
+  if (alloc[target]->get_free() < need + reserve) {
+    dout(10) << __func__ << " not enough room on bdev " << (int)target
+	     << " for " << f->fnode << dendl;
+    return -ENOSPC;
+  }
+  mempool::bluefs::vector<bluefs_extent_t> extents;
+  int r = _allocate(target, need, &extents, false);
+  if (r < 0)
+    return r;
+  bluefs_fnode_t old = f->fnode;
+  dout(10) << __func__ << " " << old << " to " << extents << dendl;
+
+  // Copy without the lock.  The old extents stay valid until we swap
+  // them out below; anybody opening the file meanwhile makes us back
+  // off.
+  l.unlock();
+  uint64_t len = ROUND_UP_TO(old.size, super.block_size);
+  bufferlist bl;
+  {
+    IOContext rioc(cct, NULL);
+    uint64_t left = len;
+    for (auto& e : old.extents) {
+      if (!left)
+	break;
+      uint64_t x_len = MIN(left, e.length);
+      bufferlist t;
+      r = bdev[e.bdev]->read(e.offset, x_len, &t, &rioc, false);
+      assert(r == 0);
+      bl.claim_append(t);
+      left -= x_len;
+    }
+  }
+  {
+    IOContext wioc(cct, NULL);
+    uint64_t off = 0;
+    for (auto& e : extents) {
+      if (off >= len)
+	break;
+      uint64_t x_len = MIN(len - off, e.length);
+      bufferlist t;
+      t.substr_of(bl, off, x_len);
+      bdev[target]->aio_write(e.offset, t, &wioc, false);
+      off += x_len;
+    }
+    if (wioc.has_pending_aios()) {
+      bdev[target]->aio_submit(&wioc);
+      wioc.aio_wait();
+    }
+    bdev[target]->flush();
+  }
+  l.lock();
+
+  auto same_extents = [](const mempool::bluefs::vector<bluefs_extent_t>& a,
+			 const mempool::bluefs::vector<bluefs_extent_t>& b) {
+    if (a.size() != b.size())
+      return false;
+    for (unsigned i = 0; i < a.size(); ++i) {
+      if (a[i].bdev != b[i].bdev || a[i].offset != b[i].offset ||
+	  a[i].length != b[i].length)
+	return false;
+    }
+    return true;
+  };
+  if (f->deleted || f->num_readers.load() || f->num_writers.load() ||
+      f->locked || f->fnode.size != old.size ||
+      !same_extents(f->fnode.extents, old.extents)) {
+    dout(10) << __func__ << " " << f->fnode << " changed under us, backing off"
+	     << dendl;
+    for (auto& e : extents) {
+      alloc[target]->release(e.offset, e.length);
+    }
+    return -EBUSY;
+  }
+  // the old extents are released once the update is stable
+  for (auto& e : f->fnode.extents) {
+    pending_release[e.bdev].insert(e.offset, e.length);
+  }
+  f->fnode.extents.swap(extents);
+  log_t.op_file_update(f->fnode);
+  _flush_and_sync_log(l);
+  logger->inc(l_bluefs_migrated_files);
+  logger->inc(l_bluefs_migrated_bytes, old.size);
+  dout(10) << __func__ << " now " << f->fnode << dendl;
+  return 0;
+}
+
 int BlueFS::_allocate(uint8_t id, uint64_t len,
-		      mempool::bluefs::vector<bluefs_extent_t> *ev)
+		      mempool::bluefs::vector<bluefs_extent_t> *ev,
+		      bool fallback)
 {
   dout(10) << __func__ << " len 0x" << std::hex << len << std::dec
            << " from " << (int)id << dendl;
@@ -1755,6 +2040,10 @@ int BlueFS::_allocate(uint8_t id, uint64_t len,
     r = alloc[id]->reserve(left);
   }
   if (r < 0) {
+    if (!fallback) {
+      dout(10) << __func__ << " no room on bdev " << (int)id << dendl;
+      return r;
+    }
     if (id != BDEV_SLOW) {
       if (bdev[id]) {
 	dout(1) << __func__ << " failed to allocate 0x" << std::hex << left
@@ -1919,7 +2208,7 @@ int BlueFS::open_for_write(
     // match up with bluestore.  the slow device is always the second
     // one (when a dedicated block.db device is present and used at
     // bdev 0).  the wal device is always last.
-    if (boost::algorithm::ends_with(filename, ".slow")) {
+    if (boost::algorithm::ends_with(dirname, ".slow")) {
       file->fnode.prefer_bdev = BlueFS::BDEV_SLOW;
     } else if (boost::algorithm::ends_with(dirname, ".wal")) {
       file->fnode.prefer_bdev = BlueFS::BDEV_WAL;
@@ -4,10 +4,12 @@
 #define CEPH_OS_BLUESTORE_BLUEFS_H
 
 #include <atomic>
+#include <condition_variable>
 #include <mutex>
 
 #include "bluefs_types.h"
 #include "common/RefCountedObj.h"
+#include "common/Thread.h"
 #include "BlockDevice.h"
 
 #include "boost/intrusive/list.hpp"
@@ -31,10 +33,16 @@ enum {
   l_bluefs_log_bytes,
   l_bluefs_log_compactions,
   l_bluefs_logged_bytes,
+  l_bluefs_log_flush_grouped,
   l_bluefs_files_written_wal,
   l_bluefs_files_written_sst,
   l_bluefs_bytes_written_wal,
   l_bluefs_bytes_written_sst,
+  l_bluefs_spillover_bytes,
+  l_bluefs_migrated_files,
+  l_bluefs_migrated_bytes,
+  l_bluefs_read_lat_bytes_hist,
+  l_bluefs_fsync_lat_bytes_hist,
   l_bluefs_last,
 };
 
@@ -124,7 +132,7 @@ public:
     bufferlist::page_aligned_appender buffer_appender;  //< for const char* only
     int writer_type = 0;    ///< WRITER_*
 
-    std::mutex lock;
+    std::mutex lock;        ///< serializes flush/fsync/truncate on this writer
     std::array<IOContext*,MAX_BDEV> iocv; ///< for each bdev
 
     FileWriter(FileRef f)
@@ -255,6 +263,23 @@ private:
   vector<Allocator*> alloc;                   ///< allocators for bdevs
   vector<interval_set<uint64_t>> pending_release; ///< extents to release
 
+  /// periodically accounts (and optionally undoes) spillover to slower
+  /// devices
+  struct SpilloverThread : public Thread {
+    BlueFS *fs;
+    explicit SpilloverThread(BlueFS *f) : fs(f) {}
+    void *entry() override {
+      fs->_spillover_thread();
+      return NULL;
+    }
+  } spillover_thread;
+  std::mutex spillover_lock;
+  std::condition_variable spillover_cond;
+  bool spillover_stop = false;
+
+  void _spillover_thread();
+  int _migrate_file(std::unique_lock<std::mutex>& l, FileRef f);
+
   void _init_logger();
   void _shutdown_logger();
   void _update_logger_stats();
@@ -268,9 +293,13 @@ private:
   void _drop_link(FileRef f);
 
   int _allocate(uint8_t bdev, uint64_t len,
-		mempool::bluefs::vector<bluefs_extent_t> *ev);
-  int _flush_range(FileWriter *h, uint64_t offset, uint64_t length);
-  int _flush(FileWriter *h, bool force);
+		mempool::bluefs::vector<bluefs_extent_t> *ev,
+		bool fallback = true);
+  /// if l is given, it may be dropped around the data IO of regular files
+  int _flush_range(FileWriter *h, uint64_t offset, uint64_t length,
+		   std::unique_lock<std::mutex> *l = nullptr);
+  int _flush(FileWriter *h, bool force,
+	     std::unique_lock<std::mutex> *l = nullptr);
   int _fsync(FileWriter *h, std::unique_lock<std::mutex>& l);
 
   void _claim_completed_aios(FileWriter *h, list<FS::aio_t> *ls);
@@ -309,6 +338,8 @@ private:
 
   int _open_super();
   int _write_super();
+  void _encode_super(bufferlist& bl);
+  void _write_super_bl(bufferlist& bl);
   int _replay(bool noop); ///< replay journal
 
   FileWriter *_create_writer(FileRef f);
@@ -379,6 +410,15 @@ public:
   void flush_log();
   void compact_log();
 
+  /**
+   * Account files that live (partly) on a slower device than the one
+   * they prefer and, if migrate, copy up to max_bytes of them back.
+   * Only files nobody has open are moved.
+   *
+   * @returns bytes still spilled over
+   */
+  uint64_t check_spillover(bool migrate, uint64_t max_bytes);
+
   /// sync any uncommitted state to disk
   void sync_metadata();
 
@@ -393,15 +433,21 @@ public:
   int reclaim_blocks(unsigned bdev, uint64_t want,
 		     AllocExtentVector *extents);
 
+  // Writers are serialized on h->lock, taken before the global lock.
+  // The global lock only protects metadata (fnodes, dirs, the log and
+  // allocators); data IO for regular files runs without it.
   void flush(FileWriter *h) {
-    std::lock_guard<std::mutex> l(lock);
-    _flush(h, false);
+    std::lock_guard<std::mutex> hl(h->lock);
+    std::unique_lock<std::mutex> l(lock);
+    _flush(h, false, &l);
   }
   void flush_range(FileWriter *h, uint64_t offset, uint64_t length) {
-    std::lock_guard<std::mutex> l(lock);
-    _flush_range(h, offset, length);
+    std::lock_guard<std::mutex> hl(h->lock);
+    std::unique_lock<std::mutex> l(lock);
+    _flush_range(h, offset, length, &l);
   }
   int fsync(FileWriter *h) {
+    std::lock_guard<std::mutex> hl(h->lock);
     std::unique_lock<std::mutex> l(lock);
     return _fsync(h, l);
   }
@@ -428,6 +474,7 @@ public:
     return _preallocate(f, offset, len);
   }
   int truncate(FileWriter *h, uint64_t offset) {
+    std::lock_guard<std::mutex> hl(h->lock);
     std::lock_guard<std::mutex> l(lock);
     return _truncate(h, offset);
   }
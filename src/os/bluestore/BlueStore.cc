@@ -22,6 +22,8 @@
 #include "include/compat.h"
 #include "include/intarith.h"
 #include "include/stringify.h"
+#include "include/str_list.h"
+#include "include/small_encoding.h"
 #include "common/errno.h"
 #include "common/safe_io.h"
 #include "Allocator.h"
@@ -30,6 +32,8 @@
 #include "BlueRocksEnv.h"
 #include "auth/Crypto.h"
 #include "common/EventTrace.h"
+#include "common/MemoryModel.h"
+#include "common/admin_socket.h"
 
 #define dout_context cct
 #define dout_subsys ceph_subsys_bluestore
@@ -265,6 +269,14 @@ static void get_coll_key_range(const coll_t& cid, int bits,
   }
 }
 
+// per-pool statfs records live in PREFIX_STAT next to "bluestore_statfs";
+// the binary key can never collide with that one.
+static void get_pool_stat_key(int64_t pool, string *key)
+{
+  key->clear();
+  _key_encode_u64(pool + 0x8000000000000000ull, key);
+}
+
 static void get_shared_blob_key(uint64_t sbid, string *key)
 {
   key->clear();
@@ -527,8 +539,10 @@ ostream& operator<<(ostream& out, const BlueStore::Buffer& b)
   out << "buffer(" << &b << " space " << b.space << " 0x" << std::hex
       << b.offset << "~" << b.length << std::dec
       << " " << BlueStore::Buffer::get_state_name(b.state);
-  if (b.flags)
-    out << " " << BlueStore::Buffer::get_flag_name(b.flags);
+  for (unsigned f = 1; f <= b.flags; f <<= 1) {
+    if (b.flags & f)
+      out << " " << BlueStore::Buffer::get_flag_name(f);
+  }
   return out << ")";
 }
 
@@ -1296,6 +1310,10 @@ void BlueStore::BufferSpace::read(
     Buffer *b = i->second.get();
     assert(b->end() > offset);
     if (b->is_writing() || b->is_clean()) {
+      if (b->flags & Buffer::FLAG_READAHEAD) {
+	b->flags &= ~Buffer::FLAG_READAHEAD;
+	cache->logger->inc(l_bluestore_readahead_hit_bytes, b->length);
+      }
       if (b->offset < offset) {
 	uint32_t skip = offset - b->offset;
 	uint32_t l = MIN(length, b->length - skip);
@@ -1378,6 +1396,7 @@ void BlueStore::BufferSpace::split(Cache* cache, size_t pos, BlueStore::BufferSp
   if (buffer_map.empty())
     return;
 
+  ++write_gen;
   auto p = --buffer_map.end();
   while (true) {
     if (p->second->end() <= pos)
@@ -1390,10 +1409,12 @@ void BlueStore::BufferSpace::split(Cache* cache, size_t pos, BlueStore::BufferSp
       if (p->second->data.length()) {
 	bufferlist bl;
 	bl.substr_of(p->second->data, left, right);
-	r._add_buffer(cache, new Buffer(&r, p->second->state, p->second->seq, 0, bl),
+	r._add_buffer(cache, new Buffer(&r, p->second->state, p->second->seq, 0, bl,
+					p->second->flags),
 		      0, p->second.get());
       } else {
-	r._add_buffer(cache, new Buffer(&r, p->second->state, p->second->seq, 0, right),
+	r._add_buffer(cache, new Buffer(&r, p->second->state, p->second->seq, 0, right,
+					p->second->flags),
 		      0, p->second.get());
       }
       cache->_adjust_buffer_size(p->second.get(), -right);
@@ -1405,13 +1426,16 @@ void BlueStore::BufferSpace::split(Cache* cache, size_t pos, BlueStore::BufferSp
     ldout(cache->cct, 30) << __func__ << " move " << *p->second << dendl;
     if (p->second->data.length()) {
       r._add_buffer(cache, new Buffer(&r, p->second->state, p->second->seq,
-                               p->second->offset - pos, p->second->data),
+                               p->second->offset - pos, p->second->data,
+			       p->second->flags),
                     0, p->second.get());
     } else {
       r._add_buffer(cache, new Buffer(&r, p->second->state, p->second->seq,
-                               p->second->offset - pos, p->second->length),
+                               p->second->offset - pos, p->second->length,
+			       p->second->flags),
                     0, p->second.get());
     }
+    p->second->flags &= ~Buffer::FLAG_READAHEAD;  // moved, not wasted
     if (p == buffer_map.begin()) {
       _rm_buffer(cache, p);
       break;
@@ -1537,6 +1561,7 @@ void BlueStore::OnodeSpace::rename(
   cache->_touch_onode(o);
   o->oid = new_oid;
   o->key = new_okey;
+  o->last_encoded.clear();
 }
 
 bool BlueStore::OnodeSpace::map_any(std::function<bool(OnodeRef)> f)
@@ -2997,6 +3022,45 @@ void BlueStore::Collection::make_blob_shared(uint64_t sbid, BlobRef b)
   ldout(store->cct, 20) << __func__ << " now " << *b << dendl;
 }
 
+void BlueStore::Collection::set_pool_opts(const pool_opts_t& opts)
+{
+  pool_opts = opts;
+
+  map<uint32_t, bufferlist> dicts;
+  string s;
+  if (opts.get(pool_opts_t::COMPRESSION_DICTIONARIES, &s) &&
+      Compressor::decode_dictionaries(s, &dicts) < 0) {
+    lderr(store->cct) << __func__ << " " << cid
+		      << " failed to decode compression dictionaries" << dendl;
+  }
+  std::lock_guard<std::mutex> l(compression_dict_lock);
+  // dictionaries are only ever added, so what we prepared stays valid
+  compression_dicts.swap(dicts);
+}
+
+Compressor::DictionaryRef BlueStore::Collection::get_compression_dict(
+  CompressorRef& c, uint32_t id)
+{
+  std::lock_guard<std::mutex> l(compression_dict_lock);
+  if (compression_dicts.empty()) {
+    return Compressor::DictionaryRef();
+  }
+  auto p = id ? compression_dicts.find(id) : --compression_dicts.end();
+  if (p == compression_dicts.end()) {
+    return Compressor::DictionaryRef();
+  }
+  auto key = make_pair((int)c->get_type(), p->first);
+  auto q = compression_dict_cache.find(key);
+  if (q == compression_dict_cache.end()) {
+    q = compression_dict_cache.emplace(
+      key, c->create_dictionary(p->first, p->second)).first;
+    ldout(store->cct, 10) << __func__ << " " << cid << " prepared "
+			  << c->get_type_name() << " dictionary " << p->first
+			  << (q->second ? "" : " (unsupported)") << dendl;
+  }
+  return q->second;
+}
+
 BlueStore::OnodeRef BlueStore::Collection::get_onode(
   const ghobject_t& oid,
   bool create)
@@ -3025,78 +3089,123 @@ BlueStore::OnodeRef BlueStore::Collection::get_onode(
   bufferlist v;
   int r = store->db->get(PREFIX_OBJ, key.c_str(), key.size(), &v);
   ldout(store->cct, 20) << " r " << r << " v.len " << v.length() << dendl;
-  Onode *on;
   if (v.length() == 0) {
     assert(r == -ENOENT);
     if (!store->cct->_conf->bluestore_debug_misc &&
 	!create)
       return OnodeRef();
-
-    // new object, new onode
-    on = new Onode(this, oid, key);
   } else {
-    // loaded
     assert(r >= 0);
-    on = new Onode(this, oid, key);
-    on->exists = true;
-    bufferptr::iterator p = v.front().begin();
-    on->onode.decode(p);
-
-    // initialize extent_map
-    on->extent_map.decode_spanning_blobs(p);
-    if (on->onode.extent_map_shards.empty()) {
-      denc(on->extent_map.inline_bl, p);
-      on->extent_map.decode_some(on->extent_map.inline_bl);
-    } else {
-      on->extent_map.init_shards(false, false);
-    }
   }
-  o.reset(on);
+  o.reset(_decode_onode(oid, key, v));
   return onode_map.add(oid, o);
 }
 
-void BlueStore::Collection::trim_cache()
+BlueStore::Onode *BlueStore::Collection::_decode_onode(
+  const ghobject_t& oid,
+  const mempool::bluestore_meta_other::string& key,
+  bufferlist& v)
 {
-  // see if mempool stats have updated
-  uint64_t total_bytes;
-  uint64_t total_onodes;
-  size_t seq;
-  store->get_mempool_stats(&seq, &total_bytes, &total_onodes);
-  if (seq == cache->last_trim_seq) {
-    ldout(store->cct, 30) << __func__ << " no new mempool stats; nothing to do"
-			  << dendl;
-    return;
+  Onode *on = new Onode(this, oid, key);
+  if (v.length() == 0) {
+    // new object, new onode
+    return on;
+  }
+  // loaded
+  on->exists = true;
+  bufferptr::iterator p = v.front().begin();
+  on->onode.decode(p);
+
+  // initialize extent_map
+  on->extent_map.decode_spanning_blobs(p);
+  if (on->onode.extent_map_shards.empty()) {
+    denc(on->extent_map.inline_bl, p);
+    on->extent_map.decode_some(on->extent_map.inline_bl);
+  } else {
+    on->extent_map.init_shards(false, false);
   }
-  cache->last_trim_seq = seq;
+  return on;
+}
 
-  // trim
-  if (total_onodes < 2) {
-    total_onodes = 2;
+void BlueStore::Collection::prefetch_onodes(const vector<ghobject_t>& oids)
+{
+  assert(lock.is_wlocked());
+  map<string,const ghobject_t*> want;
+  for (auto& oid : oids) {
+    if (onode_map.lookup(oid))
+      continue;
+    string key;
+    get_object_key(store->cct, oid, &key);
+    want[key] = &oid;
+  }
+  if (want.size() < 2)
+    return;  // get_onode() does just as well
+
+  set<string> keys;
+  for (auto& p : want)
+    keys.insert(keys.end(), p.first);
+  map<string,bufferlist> got;
+  store->db->get(PREFIX_OBJ, keys, &got);
+  ldout(store->cct, 20) << __func__ << " found " << got.size() << " of "
+			<< want.size() << " onodes" << dendl;
+  for (auto& p : want) {
+    mempool::bluestore_meta_other::string key(p.first.c_str(),
+					      p.first.size());
+    bufferlist empty;
+    auto q = got.find(p.first);
+    // a miss is cached as a non-existent onode, just as get_onode()
+    // does when asked to create one
+    OnodeRef o(_decode_onode(*p.second, key,
+			     q == got.end() ? empty : q->second));
+    onode_map.add(*p.second, o);
   }
-  float bytes_per_onode = (float)total_bytes / (float)total_onodes;
-  size_t num_shards = store->cache_shards.size();
-  uint64_t shard_target = store->cct->_conf->bluestore_cache_size / num_shards;
-  ldout(store->cct, 30) << __func__
-			<< " total meta bytes " << total_bytes
-			<< ", total onodes " << total_onodes
-			<< ", bytes_per_onode " << bytes_per_onode
-	   << dendl;
-  cache->trim(shard_target, store->cct->_conf->bluestore_cache_meta_ratio,
-	      bytes_per_onode);
+}
 
-  store->_update_cache_logger();
+void BlueStore::Collection::trim_cache()
+{
+  store->_trim_cache_shard(cache);
 }
 
 // =======================================================
 
+#undef dout_prefix
+#define dout_prefix *_dout << "bluestore.MempoolThread(" << this << ") "
+
 void *BlueStore::MempoolThread::entry()
 {
   Mutex::Locker l(lock);
+  bool autotune = store->cct->_conf->bluestore_cache_autotune;
+  if (autotune) {
+    _autotune_init();
+  }
   while (!stop) {
     store->mempool_bytes = mempool::bluestore_meta_other::allocated_bytes() +
       mempool::bluestore_meta_onode::allocated_bytes();
     store->mempool_onodes = mempool::bluestore_meta_onode::allocated_items();
     ++store->mempool_seq;
+
+    // shards are normally trimmed by the op threads using them; catch up
+    // on any that have been idle for a full interval so they give back
+    // their share.
+    for (auto c : store->cache_shards) {
+      if (c->last_trim_seq + 1 < store->mempool_seq) {
+	store->_trim_cache_shard(c);
+      }
+    }
+    store->_update_cache_logger();
+
+    if (ceph_clock_now() >= next_fragmentation) {
+      store->_update_fragmentation();
+      next_fragmentation = ceph_clock_now();
+      next_fragmentation +=
+	store->cct->_conf->bluestore_fragmentation_check_period;
+    }
+
+    if (autotune && ceph_clock_now() >= next_autotune) {
+      _autotune();
+      next_autotune = ceph_clock_now();
+      next_autotune += store->cct->_conf->bluestore_cache_autotune_interval;
+    }
     utime_t wait;
     wait += store->cct->_conf->bluestore_cache_trim_interval;
     cond.WaitInterval(lock, wait);
@@ -3105,6 +3214,140 @@ void *BlueStore::MempoolThread::entry()
   return NULL;
 }
 
+void BlueStore::MempoolThread::_sample_cache_hits(uint64_t *hits,
+						  uint64_t *misses)
+{
+  // onode hits are counted in lookups, buffer hits in bytes; we only ever
+  // compare ratios, so the units don't need to agree.
+  hits[CACHE_META] = store->logger->get(l_bluestore_onode_hits);
+  misses[CACHE_META] = store->logger->get(l_bluestore_onode_misses);
+  hits[CACHE_DATA] = store->logger->get(l_bluestore_buffer_hit_bytes);
+  misses[CACHE_DATA] = store->logger->get(l_bluestore_buffer_miss_bytes);
+  hits[CACHE_KV] = misses[CACHE_KV] = 0;
+  if (kv_cache) {
+    store->db->get_cache_hits(&hits[CACHE_KV], &misses[CACHE_KV]);
+  }
+}
+
+void BlueStore::MempoolThread::_apply_cache_targets()
+{
+  CephContext *cct = store->cct;
+  store->cache_meta_target = cache_bytes[CACHE_META];
+  store->cache_data_target = cache_bytes[CACHE_DATA];
+  if (kv_cache) {
+    store->db->set_cache_size(cache_bytes[CACHE_KV]);
+  }
+  store->logger->set(l_bluestore_cache_autotune_meta_bytes,
+		     cache_bytes[CACHE_META]);
+  store->logger->set(l_bluestore_cache_autotune_data_bytes,
+		     cache_bytes[CACHE_DATA]);
+  store->logger->set(l_bluestore_cache_autotune_kv_bytes,
+		     cache_bytes[CACHE_KV]);
+  ldout(cct, 10) << __func__ << " total " << pretty_si_t(cache_total)
+		 << " meta " << pretty_si_t(cache_bytes[CACHE_META])
+		 << " data " << pretty_si_t(cache_bytes[CACHE_DATA])
+		 << " kv " << pretty_si_t(cache_bytes[CACHE_KV]) << dendl;
+}
+
+void BlueStore::MempoolThread::_autotune_init()
+{
+  CephContext *cct = store->cct;
+  cache_total = cct->_conf->bluestore_cache_size;
+
+  // only give part of the budget to the kv cache if we can resize it
+  kv_cache = store->db && store->db->get_cache_usage() >= 0;
+  uint64_t kv = 0;
+  if (kv_cache) {
+    kv = MIN((uint64_t)cct->_conf->rocksdb_cache_size, cache_total / 2);
+  }
+  uint64_t rest = cache_total - kv;
+  uint64_t meta = rest * cct->_conf->bluestore_cache_meta_ratio;
+  meta = MIN(meta, rest);
+  cache_bytes[CACHE_META] = meta;
+  cache_bytes[CACHE_DATA] = rest - meta;
+  cache_bytes[CACHE_KV] = kv;
+
+  _sample_cache_hits(last_hits, last_misses);
+  _apply_cache_targets();
+  next_autotune = ceph_clock_now();
+  next_autotune += cct->_conf->bluestore_cache_autotune_interval;
+}
+
+void BlueStore::MempoolThread::_autotune()
+{
+  CephContext *cct = store->cct;
+  uint64_t max_total = cct->_conf->bluestore_cache_size;
+  uint64_t chunk = cct->_conf->bluestore_cache_autotune_chunk_size;
+  int num = kv_cache ? CACHE_MAX : CACHE_KV;
+
+  // first, size the overall budget against the rss target
+  uint64_t total = max_total;
+  uint64_t rss_target = cct->_conf->bluestore_cache_autotune_rss_target;
+  if (rss_target) {
+    MemoryModel mm(cct);
+    MemoryModel::snap snap;
+    mm.sample(&snap);
+    uint64_t rss = (uint64_t)snap.get_rss() << 10;  // kB
+    total = cache_total;
+    if (rss > rss_target) {
+      // freed memory may not show up in rss right away; don't overshoot
+      uint64_t shrink = MIN(rss - rss_target, total / 4);
+      total -= shrink;
+    } else if (rss + chunk < rss_target) {
+      total += chunk;
+    }
+    ldout(cct, 20) << __func__ << " rss " << pretty_si_t(rss)
+		   << " target " << pretty_si_t(rss_target)
+		   << " cache budget " << pretty_si_t(cache_total)
+		   << " -> " << pretty_si_t(total) << dendl;
+  }
+  uint64_t min_total = MIN(chunk * num, max_total);
+  total = MAX(MIN(total, max_total), min_total);
+
+  // keep the current split when the budget changes
+  if (total != cache_total) {
+    uint64_t sum = 0;
+    for (int i = 0; i < num; ++i) {
+      cache_bytes[i] = (double)cache_bytes[i] * total / cache_total;
+      sum += cache_bytes[i];
+    }
+    cache_bytes[CACHE_DATA] += total - sum;
+    cache_total = total;
+  }
+
+  // then move a chunk from the cache that misses least to the one that
+  // misses most.  a cache that saw no lookups at all is a natural donor.
+  uint64_t hits[CACHE_MAX], misses[CACHE_MAX];
+  double miss_ratio[CACHE_MAX];
+  _sample_cache_hits(hits, misses);
+  for (int i = 0; i < num; ++i) {
+    uint64_t h = hits[i] >= last_hits[i] ? hits[i] - last_hits[i] : 0;
+    uint64_t m = misses[i] >= last_misses[i] ? misses[i] - last_misses[i] : 0;
+    miss_ratio[i] = h + m ? (double)m / (double)(h + m) : 0;
+    last_hits[i] = hits[i];
+    last_misses[i] = misses[i];
+  }
+  int donor = 0, taker = 0;
+  for (int i = 1; i < num; ++i) {
+    if (miss_ratio[i] < miss_ratio[donor])
+      donor = i;
+    if (miss_ratio[i] > miss_ratio[taker])
+      taker = i;
+  }
+  uint64_t min_bytes = total * cct->_conf->bluestore_cache_autotune_min_ratio;
+  ldout(cct, 20) << __func__ << " miss ratio meta " << miss_ratio[CACHE_META]
+		 << " data " << miss_ratio[CACHE_DATA]
+		 << " kv " << (kv_cache ? miss_ratio[CACHE_KV] : 0)
+		 << dendl;
+  if (miss_ratio[taker] - miss_ratio[donor] > .01 &&
+      cache_bytes[donor] > min_bytes) {
+    uint64_t delta = MIN(chunk, cache_bytes[donor] - min_bytes);
+    cache_bytes[donor] -= delta;
+    cache_bytes[taker] += delta;
+  }
+  _apply_cache_targets();
+}
+
 // =======================================================
 
 #undef dout_prefix
@@ -3117,6 +3360,41 @@ static void aio_cb(void *priv, void *priv2)
   store->_txc_aio_finish(priv2);
 }
 
+const char *BlueStoreConf::tracked_keys[] = {
+  "bluestore_sync_submit_transaction",
+  "bluestore_debug_randomize_serial_transaction",
+  "bluestore_inject_wal_apply_delay",
+  "bluestore_wal_batch_max_ops",
+  "bluestore_wal_batch_max_bytes",
+  "bluestore_default_buffered_write",
+  "bluestore_max_blob_size",
+  "bluestore_clone_cow",
+  "bluestore_compression_required_ratio",
+  "bluestore_compression_max_queue",
+  "bluestore_gc_fragmented_blob_extents",
+  "bluestore_gc_fragmented_max_bytes",
+  NULL
+};
+
+BlueStoreConf::BlueStoreConf(const md_config_t *conf)
+  : bluestore_sync_submit_transaction(
+      conf->bluestore_sync_submit_transaction),
+    bluestore_debug_randomize_serial_transaction(
+      conf->bluestore_debug_randomize_serial_transaction),
+    bluestore_inject_wal_apply_delay(conf->bluestore_inject_wal_apply_delay),
+    bluestore_wal_batch_max_ops(conf->bluestore_wal_batch_max_ops),
+    bluestore_wal_batch_max_bytes(conf->bluestore_wal_batch_max_bytes),
+    bluestore_default_buffered_write(conf->bluestore_default_buffered_write),
+    bluestore_max_blob_size(conf->bluestore_max_blob_size),
+    bluestore_clone_cow(conf->bluestore_clone_cow),
+    bluestore_compression_required_ratio(
+      conf->bluestore_compression_required_ratio),
+    bluestore_compression_max_queue(conf->bluestore_compression_max_queue),
+    bluestore_gc_fragmented_blob_extents(
+      conf->bluestore_gc_fragmented_blob_extents),
+    bluestore_gc_fragmented_max_bytes(conf->bluestore_gc_fragmented_max_bytes)
+{}
+
 BlueStore::BlueStore(CephContext *cct, const string& path)
   : ObjectStore(cct, path),
     bluefs(NULL),
@@ -3146,10 +3424,24 @@ BlueStore::BlueStore(CephContext *cct, const string& path)
 	     cct->_conf->bluestore_wal_thread_timeout,
 	     cct->_conf->bluestore_wal_thread_suicide_timeout,
 	     &wal_tp),
-    m_finisher_num(1),
+    compress_tp(cct,
+		"BlueStore::compress_tp",
+		"tp_bstore_cmp",
+		cct->_conf->bluestore_compression_threads,
+		"bluestore_compression_threads"),
+    compress_wq(this,
+		cct->_conf->bluestore_compression_thread_timeout,
+		cct->_conf->bluestore_compression_thread_suicide_timeout,
+		&compress_tp),
+    finishers(cct, "bluestore", "finisher",
+	      cct->_conf->bluestore_shard_finishers ?
+	      cct->_conf->osd_op_num_shards : 1),
+    kv_flush_thread(this),
     kv_sync_thread(this),
+    kv_finalize_thread(this),
     kv_stop(false),
     logger(NULL),
+    store_conf(cct->_conf),
     debug_read_error_lock("BlueStore::debug_read_error_lock"),
     csum_type(Checksummer::CSUM_CRC32C),
     sync_wal_apply(cct->_conf->bluestore_sync_wal_apply),
@@ -3158,17 +3450,6 @@ BlueStore::BlueStore(CephContext *cct, const string& path)
   _init_logger();
   cct->_conf->add_observer(this);
   set_cache_shards(1);
-
-  if (cct->_conf->bluestore_shard_finishers) {
-    m_finisher_num = cct->_conf->osd_op_num_shards;
-  }
-
-  for (int i = 0; i < m_finisher_num; ++i) {
-    ostringstream oss;
-    oss << "finisher-" << i;
-    Finisher *f = new Finisher(cct, oss.str(), "finisher");
-    finishers.push_back(f);
-  }
 }
 
 BlueStore::BlueStore(CephContext *cct,
@@ -3202,10 +3483,24 @@ BlueStore::BlueStore(CephContext *cct,
 	     cct->_conf->bluestore_wal_thread_timeout,
 	     cct->_conf->bluestore_wal_thread_suicide_timeout,
 	     &wal_tp),
-    m_finisher_num(1),
+    compress_tp(cct,
+		"BlueStore::compress_tp",
+		"tp_bstore_cmp",
+		cct->_conf->bluestore_compression_threads,
+		"bluestore_compression_threads"),
+    compress_wq(this,
+		cct->_conf->bluestore_compression_thread_timeout,
+		cct->_conf->bluestore_compression_thread_suicide_timeout,
+		&compress_tp),
+    finishers(cct, "bluestore", "finisher",
+	      cct->_conf->bluestore_shard_finishers ?
+	      cct->_conf->osd_op_num_shards : 1),
+    kv_flush_thread(this),
     kv_sync_thread(this),
+    kv_finalize_thread(this),
     kv_stop(false),
     logger(NULL),
+    store_conf(cct->_conf),
     debug_read_error_lock("BlueStore::debug_read_error_lock"),
     csum_type(Checksummer::CSUM_CRC32C),
     min_alloc_size(_min_alloc_size),
@@ -3216,26 +3511,10 @@ BlueStore::BlueStore(CephContext *cct,
   _init_logger();
   cct->_conf->add_observer(this);
   set_cache_shards(1);
-
-  if (cct->_conf->bluestore_shard_finishers) {
-    m_finisher_num = cct->_conf->osd_op_num_shards;
-  }
-
-  for (int i = 0; i < m_finisher_num; ++i) {
-    ostringstream oss;
-    oss << "finisher-" << i;
-    Finisher *f = new Finisher(cct, oss.str(), "finisher");
-    finishers.push_back(f);
-  }
 }
 
 BlueStore::~BlueStore()
 {
-  for (auto f : finishers) {
-    delete f;
-  }
-  finishers.clear();
-
   cct->_conf->remove_observer(this);
   _shutdown_logger();
   assert(!mounted);
@@ -3352,6 +3631,12 @@ void BlueStore::_init_logger()
     "Average submit latency");
   b.add_time_avg(l_bluestore_commit_lat, "commit_lat",
     "Average commit latency");
+  b.add_time_avg(l_bluestore_kv_flush_lat, "kv_flush_lat",
+    "Average kv_flush_thread block device flush latency");
+  b.add_time_avg(l_bluestore_kv_commit_lat, "kv_commit_lat",
+    "Average kv_sync_thread submit and sync latency");
+  b.add_time_avg(l_bluestore_kv_finalize_lat, "kv_finalize_lat",
+    "Average kv_finalize_thread completion latency");
   b.add_time_avg(l_bluestore_read_lat, "read_lat",
     "Average read latency");
   b.add_time_avg(l_bluestore_read_onode_meta_lat, "read_onode_meta_lat",
@@ -3370,12 +3655,18 @@ void BlueStore::_init_logger()
     "Sum for beneficial compress ops");
   b.add_u64(l_bluestore_compress_rejected_count, "compress_rejected_count",
     "Sum for compress ops rejected due to low net gain of space");
+  b.add_u64(l_bluestore_compress_offloaded, "compress_offloaded",
+    "Sum for compress ops run on the compression thread pool");
+  b.add_u64(l_bluestore_compress_backlog_skipped, "compress_backlog_skipped",
+    "Sum for blobs written uncompressed due to compression backlog");
   b.add_u64(l_bluestore_write_pad_bytes, "write_pad_bytes",
     "Sum for write-op padded bytes");
   b.add_u64(l_bluestore_wal_write_ops, "wal_write_ops",
     "Sum for wal write op");
   b.add_u64(l_bluestore_wal_write_bytes, "wal_write_bytes",
     "Sum for wal write bytes");
+  b.add_u64(l_bluestore_wal_batch_writes, "wal_batch_writes",
+    "Sum for device writes issued for batched wal ops");
   b.add_u64(l_bluestore_write_penalty_read_ops, "write_penalty_read_ops",
     "Sum for write penalty read ops");
   b.add_u64(l_bluestore_allocated, "bluestore_allocated",
@@ -3411,6 +3702,22 @@ void BlueStore::_init_logger()
     "Sum for bytes of read hit in the cache");
   b.add_u64(l_bluestore_buffer_miss_bytes, "bluestore_buffer_miss_bytes",
     "Sum for bytes of read missed in the cache");
+  b.add_u64(l_bluestore_readahead_bytes, "bluestore_readahead_bytes",
+    "Sum for bytes read ahead into the cache");
+  b.add_u64(l_bluestore_readahead_hit_bytes, "bluestore_readahead_hit_bytes",
+    "Sum for bytes of read-ahead data later read");
+  b.add_u64(l_bluestore_readahead_wasted_bytes,
+	    "bluestore_readahead_wasted_bytes",
+    "Sum for bytes of read-ahead data dropped or evicted unread");
+  b.add_u64(l_bluestore_cache_autotune_meta_bytes,
+	    "bluestore_cache_autotune_meta_bytes",
+	    "Autotuned onode cache budget");
+  b.add_u64(l_bluestore_cache_autotune_data_bytes,
+	    "bluestore_cache_autotune_data_bytes",
+	    "Autotuned buffer cache budget");
+  b.add_u64(l_bluestore_cache_autotune_kv_bytes,
+	    "bluestore_cache_autotune_kv_bytes",
+	    "Autotuned kv block cache budget");
 
   b.add_u64(l_bluestore_write_big, "bluestore_write_big",
 	    "Large min_alloc_size-aligned writes into fresh blobs");
@@ -3444,12 +3751,61 @@ void BlueStore::_init_logger()
   b.add_u64(l_bluestore_txc, "bluestore_txc", "Transactions committed");
   b.add_u64(l_bluestore_onode_reshard, "bluestore_onode_reshard",
 	    "Onode extent map reshard events");
+  b.add_u64(l_bluestore_onode_unchanged, "bluestore_onode_unchanged",
+	    "Onode key writes skipped because only extent map shards changed");
   b.add_u64(l_bluestore_blob_split, "bluestore_blob_split",
             "Sum for blob splitting due to resharding");
   b.add_u64(l_bluestore_extent_compress, "bluestore_extent_compress",
             "Sum for extents that have been removed due to compression");
   b.add_u64(l_bluestore_gc_merged, "bluestore_gc_merged",
             "Sum for extents that have been merged due to garbage collection");
+  b.add_u64(l_bluestore_gc_relocated, "bluestore_gc_relocated",
+            "Sum for bytes rewritten to defragment blobs");
+  b.add_u64(l_bluestore_fragmentation, "bluestore_fragmentation_micros",
+            "Free space fragmentation score (0..1e6)");
+
+  // Latency axis configuration for txc histograms, values are in nanoseconds
+  PerfHistogramCommon::axis_config_d txc_hist_lat_axis_config{
+    "Latency (usec)",
+    PerfHistogramCommon::SCALE_LOG2, ///< Latency in logarithmic scale
+    0,                               ///< Start at 0
+    10000,                           ///< Quantization unit is 10usec
+    32,                              ///< Enough to cover stalled devices
+  };
+
+  // One bucket per txc state, l_bluestore_state_prepare_lat first
+  PerfHistogramCommon::axis_config_d txc_hist_state_axis_config{
+    "State",
+    PerfHistogramCommon::SCALE_LINEAR, ///< State index
+    0,                                 ///< Start at prepare
+    1,                                 ///< One state per bucket
+    l_bluestore_state_done_lat - l_bluestore_state_prepare_lat + 1 + 2,
+                                       ///< Plus the under/overflow buckets
+  };
+
+  // Txc size axis configuration, values are in bytes
+  PerfHistogramCommon::axis_config_d txc_hist_bytes_axis_config{
+    "Transaction size (bytes)",
+    PerfHistogramCommon::SCALE_LOG2, ///< Size in logarithmic scale
+    0,                               ///< Start at 0
+    512,                             ///< Quantization unit is 512 bytes
+    32,                              ///< Enough to cover any transaction
+  };
+
+  b.add_histogram(l_bluestore_state_lat_hist, "state_lat_histogram",
+    txc_hist_lat_axis_config, txc_hist_state_axis_config,
+    "Histogram of txc state latencies, by state");
+  b.add_histogram(l_bluestore_commit_lat_bytes_hist,
+    "commit_lat_bytes_histogram",
+    txc_hist_lat_axis_config, txc_hist_bytes_axis_config,
+    "Histogram of commit latency vs. transaction size");
+  // every txc passes through each state from several threads
+  for (int i = l_bluestore_state_prepare_lat;
+       i <= l_bluestore_state_done_lat; ++i) {
+    b.set_sharded(i);
+  }
+  b.set_sharded(l_bluestore_submit_lat);
+  b.set_sharded(l_bluestore_commit_lat);
   logger = b.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -3752,7 +4108,7 @@ void BlueStore::_close_fm()
   fm = NULL;
 }
 
-int BlueStore::_open_alloc()
+int BlueStore::_open_alloc(bool use_snapshot)
 {
   assert(alloc == NULL);
   assert(bdev->get_size());
@@ -3761,6 +4117,20 @@ int BlueStore::_open_alloc()
                             min_alloc_size);
   uint64_t num = 0, bytes = 0;
 
+  interval_set<uint64_t> snap;
+  if (use_snapshot && cct->_conf->bluestore_alloc_snapshot &&
+      _load_alloc_snapshot(&snap) == 0) {
+    // the snapshot is the allocator's view: bluefs space is already out
+    for (auto e = snap.begin(); e != snap.end(); ++e) {
+      alloc->init_add_free(e.get_start(), e.get_len());
+      ++num;
+      bytes += e.get_len();
+    }
+    dout(10) << __func__ << " loaded " << pretty_si_t(bytes)
+	     << " in " << num << " extents from snapshot" << dendl;
+    return 0;
+  }
+
   // initialize from freelist
   fm->enumerate_reset();
   uint64_t offset, length;
@@ -3783,6 +4153,137 @@ int BlueStore::_open_alloc()
   return 0;
 }
 
+// The allocator snapshot is only valid for the exact on-disk state it
+// was taken from, so it is written by a clean umount and removed again
+// (synchronously) as soon as it has been loaded.  If we crash while
+// mounted there is no snapshot and the next mount rebuilds from the
+// freelist as usual.
+void BlueStore::_save_alloc_snapshot()
+{
+  bufferlist payload;
+  uint64_t num = 0, last_end = 0;
+  int r = alloc->foreach_free([&](uint64_t offset, uint64_t length) {
+      small_encode_varint_lowz(offset - last_end, payload);
+      small_encode_varint_lowz(length, payload);
+      last_end = offset + length;
+      ++num;
+    });
+  if (r < 0) {
+    dout(10) << __func__ << " allocator can't enumerate free space" << dendl;
+    return;
+  }
+  uint32_t raw_len = payload.length();
+  string cname = cct->_conf->bluestore_alloc_snapshot_compression;
+  if (!cname.empty()) {
+    CompressorRef c = Compressor::create(cct, cname);
+    bufferlist out;
+    if (c && c->compress(payload, out) == 0 && out.length() < raw_len) {
+      payload.swap(out);
+    } else {
+      cname.clear();
+    }
+  }
+
+  bufferlist bl;
+  ENCODE_START(1, 1, bl);
+  ::encode(bdev->get_size(), bl);
+  ::encode(min_alloc_size, bl);
+  ::encode(num, bl);
+  ::encode(cname, bl);
+  ::encode(raw_len, bl);
+  ::encode(payload, bl);
+  ENCODE_FINISH(bl);
+
+  KeyValueDB::Transaction t = db->get_transaction();
+  t->set(PREFIX_SUPER, "alloc_snapshot", bl);
+  r = db->submit_transaction_sync(t);
+  assert(r == 0);
+  dout(10) << __func__ << " " << num << " extents, 0x" << std::hex << raw_len
+	   << " -> 0x" << bl.length() << std::dec << " bytes" << dendl;
+}
+
+int BlueStore::_load_alloc_snapshot(interval_set<uint64_t> *free)
+{
+  bufferlist bl;
+  int r = db->get(PREFIX_SUPER, "alloc_snapshot", &bl);
+  if (r < 0) {
+    dout(10) << __func__ << " no snapshot" << dendl;
+    return r;
+  }
+
+  // invalidate it before anything can be allocated
+  KeyValueDB::Transaction t = db->get_transaction();
+  t->rmkey(PREFIX_SUPER, "alloc_snapshot");
+  r = db->submit_transaction_sync(t);
+  assert(r == 0);
+
+  try {
+    auto p = bl.begin();
+    uint64_t size, au, num;
+    string cname;
+    uint32_t raw_len;
+    bufferlist payload;
+    DECODE_START(1, p);
+    ::decode(size, p);
+    ::decode(au, p);
+    ::decode(num, p);
+    ::decode(cname, p);
+    ::decode(raw_len, p);
+    ::decode(payload, p);
+    DECODE_FINISH(p);
+    if (size != bdev->get_size() || au != min_alloc_size) {
+      derr << __func__ << " snapshot is for a different geometry, ignoring"
+	   << dendl;
+      return -EINVAL;
+    }
+    if (!cname.empty()) {
+      CompressorRef c = Compressor::create(cct, cname);
+      bufferlist out;
+      if (!c || c->decompress(payload, out) < 0 || out.length() != raw_len) {
+	derr << __func__ << " failed to decompress snapshot" << dendl;
+	return -EIO;
+      }
+      payload.swap(out);
+    }
+    auto q = payload.begin();
+    uint64_t last_end = 0;
+    for (uint64_t i = 0; i < num; ++i) {
+      uint64_t gap, length;
+      small_decode_varint_lowz(gap, q);
+      small_decode_varint_lowz(length, q);
+      free->insert(last_end + gap, length);
+      last_end += gap + length;
+    }
+  } catch (buffer::error& e) {
+    derr << __func__ << " failed to decode snapshot" << dendl;
+    free->clear();
+    return -EIO;
+  }
+
+  if (cct->_conf->bluestore_alloc_snapshot_verify) {
+    interval_set<uint64_t> expected;
+    fm->enumerate_reset();
+    uint64_t offset, length;
+    while (fm->enumerate_next(&offset, &length)) {
+      expected.insert(offset, length);
+    }
+    for (auto e = bluefs_extents.begin(); e != bluefs_extents.end(); ++e) {
+      interval_set<uint64_t> i;
+      i.insert(e.get_start(), e.get_len());
+      i.intersection_of(expected);
+      expected.subtract(i);
+    }
+    if (!(expected == *free)) {
+      derr << __func__ << " snapshot does not match freelist, ignoring it"
+	   << dendl;
+      free->clear();
+      return -EIO;
+    }
+    dout(10) << __func__ << " snapshot matches freelist" << dendl;
+  }
+  return 0;
+}
+
 void BlueStore::_close_alloc()
 {
   assert(alloc);
@@ -3791,6 +4292,15 @@ void BlueStore::_close_alloc()
   alloc = NULL;
 }
 
+void BlueStore::_update_fragmentation()
+{
+  double score = alloc->get_fragmentation(min_alloc_size);
+  if (score < 0)
+    return;
+  dout(10) << __func__ << " " << score << dendl;
+  logger->set(l_bluestore_fragmentation, score * 1000000);
+}
+
 int BlueStore::_open_fsid(bool create)
 {
   assert(fsid_fd < 0);
@@ -3899,6 +4409,7 @@ int BlueStore::_open_db(bool create)
   assert(!db);
   string fn = path + "/db";
   string options;
+  vector<KeyValueDB::ColumnFamily> cfs;
   stringstream err;
   ceph::shared_ptr<Int64ArrayMergeOperator> merge_op(new Int64ArrayMergeOperator);
 
@@ -4128,13 +4639,32 @@ int BlueStore::_open_db(bool create)
   FreelistManager::setup_merge_operators(db);
   db->set_merge_operator(PREFIX_STAT, merge_op);
 
-  if (kv_backend == "rocksdb")
+  if (kv_backend == "rocksdb") {
     options = cct->_conf->bluestore_rocksdb_options;
+    if (cct->_conf->bluestore_cache_autotune) {
+      // the cache balancer needs block cache hit rates
+      if (!options.empty())
+	options += ",";
+      options += "cache_stats=true";
+    }
+  }
   db->init(options);
+  if (kv_backend == "rocksdb") {
+    list<string> items;
+    get_str_list(cct->_conf->bluestore_rocksdb_cfs, " \t", items);
+    for (auto& i : items) {
+      size_t pos = i.find('=');
+      if (pos == string::npos)
+	cfs.push_back(KeyValueDB::ColumnFamily(i, ""));
+      else
+	cfs.push_back(KeyValueDB::ColumnFamily(i.substr(0, pos),
+					       i.substr(pos + 1)));
+    }
+  }
   if (create)
-    r = db->create_and_open(err);
+    r = db->create_and_open(err, cfs);
   else
-    r = db->open(err);
+    r = db->open(err, cfs);
   if (r) {
     derr << __func__ << " erroring opening db: " << err.str() << dendl;
     if (bluefs) {
@@ -4608,6 +5138,13 @@ int BlueStore::mkfs()
       t->set(PREFIX_SUPER, "min_alloc_size", bl);
     }
 
+    {
+      // fresh store: every byte is charged to a pool from the start
+      bufferlist bl;
+      t->set(PREFIX_SUPER, "per_pool_stats", bl);
+      per_pool_stats = true;
+    }
+
     ondisk_format = latest_ondisk_format;
     _prepare_ondisk_format_super(t);
     db->submit_transaction_sync(t);
@@ -4679,6 +5216,42 @@ void BlueStore::set_cache_shards(unsigned num)
   }
 }
 
+class BlueStore::SocketHook : public AdminSocketHook {
+  BlueStore *store;
+public:
+  explicit SocketHook(BlueStore *s) : store(s) {}
+  bool call(std::string command, cmdmap_t& cmdmap, std::string format,
+	    bufferlist& out) override {
+    Formatter *f = Formatter::create(format, "json-pretty", "json-pretty");
+    if (command == "bluestore allocator score") {
+      f->open_object_section("fragmentation");
+      double score = store->alloc->get_fragmentation(store->min_alloc_size);
+      if (score >= 0)
+	f->dump_float("fragmentation_rating", score);
+      else
+	f->dump_string("fragmentation_rating", "unsupported");
+      f->close_section();
+      f->flush(out);
+      delete f;
+      return true;
+    }
+    f->open_object_section("fsck");
+    fsck_progress_t& p = store->fsck_progress;
+    bool running = p.running;
+    f->dump_bool("running", running);
+    if (running) {
+      f->dump_string("phase", p.phase.load());
+      f->dump_unsigned("objects_checked", p.objects);
+      f->dump_int("errors", p.errors);
+      f->dump_stream("elapsed") << (ceph_clock_now() - p.start);
+    }
+    f->close_section();
+    f->flush(out);
+    delete f;
+    return true;
+  }
+};
+
 int BlueStore::mount()
 {
   dout(1) << __func__ << " path " << path << dendl;
@@ -4739,7 +5312,7 @@ int BlueStore::mount()
   if (r < 0)
     goto out_db;
 
-  r = _open_alloc();
+  r = _open_alloc(true);
   if (r < 0)
     goto out_fm;
 
@@ -4757,12 +5330,12 @@ int BlueStore::mount()
       goto out_coll;
   }
 
-  for (auto f : finishers) {
-    f->start();
-  }
+  finishers.start();
   wal_tp.start();
-  kv_sync_thread.create("bstore_kv_sync");
+  compress_tp.start();
+  _kv_start();
 
+  wal_batching = cct->_conf->bluestore_wal_batch;
   r = _wal_replay();
   if (r < 0)
     goto out_stop;
@@ -4772,6 +5345,15 @@ int BlueStore::mount()
   _set_csum();
   _set_compression();
 
+  mount_asok_hook = new SocketHook(this);
+  if (cct->get_admin_socket()->register_command(
+	"bluestore allocator score", "bluestore allocator score",
+	mount_asok_hook,
+	"show free space fragmentation of the bluestore allocator") < 0) {
+    delete mount_asok_hook;
+    mount_asok_hook = nullptr;
+  }
+
   mounted = true;
   return 0;
 
@@ -4779,10 +5361,10 @@ int BlueStore::mount()
   _kv_stop();
   wal_wq.drain();
   wal_tp.stop();
-  for (auto f : finishers) {
-    f->wait_for_empty();
-    f->stop();
-  }
+  compress_wq.drain();
+  compress_tp.stop();
+  finishers.wait_for_empty();
+  finishers.stop();
  out_coll:
   coll_map.clear();
  out_alloc:
@@ -4806,6 +5388,13 @@ int BlueStore::umount()
   dout(1) << __func__ << dendl;
 
   _sync();
+  _wait_readahead();
+
+  if (mount_asok_hook) {
+    cct->get_admin_socket()->unregister_command("bluestore allocator score");
+    delete mount_asok_hook;
+    mount_asok_hook = nullptr;
+  }
 
   mempool_thread.shutdown();
 
@@ -4815,17 +5404,21 @@ int BlueStore::umount()
   wal_wq.drain();
   dout(20) << __func__ << " stopping wal_tp" << dendl;
   wal_tp.stop();
-  for (auto f : finishers) {
-    dout(20) << __func__ << " draining finisher" << dendl;
-    f->wait_for_empty();
-    dout(20) << __func__ << " stopping finisher" << dendl;
-    f->stop();
-  }
+  dout(20) << __func__ << " stopping compress_tp" << dendl;
+  compress_wq.drain();
+  compress_tp.stop();
+  dout(20) << __func__ << " draining finishers" << dendl;
+  finishers.wait_for_empty();
+  dout(20) << __func__ << " stopping finishers" << dendl;
+  finishers.stop();
   _reap_collections();
   coll_map.clear();
   dout(20) << __func__ << " closing" << dendl;
 
   mounted = false;
+  if (cct->_conf->bluestore_alloc_snapshot) {
+    _save_alloc_snapshot();
+  }
   _close_alloc();
   _close_fm();
   _close_db();
@@ -4898,37 +5491,195 @@ int BlueStore::_fsck_check_extents(
   return errors;
 }
 
+int BlueStore::_fsck_check_object(
+  fsck_state_t *st,
+  Collection *c,
+  OnodeRef o)
+{
+  const ghobject_t& oid = o->oid;
+  int errors = 0;
+  uint64_t num_extents = 0;
+  store_statfs_t statfs;
+  vector<Blob*> shared, unshared;
+
+  RWLock::RLocker l(c->lock);
+  o->extent_map.fault_range(db, 0, OBJECT_MAX_SIZE);
+  _dump_onode(o, 30);
+
+  // lextents
+  uint64_t pos = 0;
+  map<BlobRef, bluestore_blob_use_tracker_t> ref_map;
+  for (auto& l : o->extent_map.extent_map) {
+    dout(20) << __func__ << "    " << l << dendl;
+    if (l.logical_offset < pos) {
+      derr << __func__ << " " << oid << " lextent at 0x"
+	   << std::hex << l.logical_offset
+	   << " overlaps with the previous, which ends at 0x" << pos
+	   << std::dec << dendl;
+      ++errors;
+    }
+    if (o->extent_map.spans_shard(l.logical_offset, l.length)) {
+      derr << __func__ << " " << oid << " lextent at 0x"
+	   << std::hex << l.logical_offset << "~" << l.length
+	   << " spans a shard boundary"
+	   << std::dec << dendl;
+      ++errors;
+    }
+    pos = l.logical_offset + l.length;
+    statfs.stored += l.length;
+    assert(l.blob);
+    const bluestore_blob_t& blob = l.blob->get_blob();
+
+    auto& ref = ref_map[l.blob];
+    if (ref.is_empty()) {
+      uint32_t min_release_size = blob.get_release_size(min_alloc_size);
+      uint32_t l = blob.get_logical_length();
+      ref.init(l, min_release_size);
+    }
+    ref.get(
+      l.blob_offset,
+      l.length);
+    ++num_extents;
+  }
+  for (auto &i : ref_map) {
+    const bluestore_blob_t& blob = i.first->get_blob();
+    bool equal = i.first->get_blob_use_tracker().equal(i.second);
+    if (!equal) {
+      derr << __func__ << " " << oid << " blob " << *i.first
+	   << " doesn't match expected ref_map " << i.second << dendl;
+      ++errors;
+    }
+    if (blob.is_compressed()) {
+      statfs.compressed += blob.compressed_length;
+      statfs.compressed_original += i.first->get_referenced_bytes();
+    }
+    if (blob.is_shared()) {
+      if (i.first->shared_blob->get_sbid() > blobid_max) {
+	derr << __func__ << " " << oid << " blob " << blob
+	     << " sbid " << i.first->shared_blob->get_sbid() << " > blobid_max "
+	     << blobid_max << dendl;
+	++errors;
+      } else if (i.first->shared_blob->get_sbid() == 0) {
+	derr << __func__ << " " << oid << " blob " << blob
+	     << " marked as shared but has uninitialized sbid"
+	     << dendl;
+	++errors;
+      }
+      shared.push_back(i.first.get());
+    } else {
+      unshared.push_back(i.first.get());
+    }
+  }
+  if (st->deep) {
+    bufferlist bl;
+    int r = _do_read(c, o, 0, o->onode.size, bl, 0);
+    if (r < 0) {
+      ++errors;
+      derr << __func__ << " " << oid << " error during read: "
+	   << cpp_strerror(r) << dendl;
+    }
+  }
+
+  // merge into the global picture
+  {
+    std::lock_guard<std::mutex> l(st->lock);
+    for (auto b : shared) {
+      const bluestore_blob_t& blob = b->get_blob();
+      fsck_sb_info_t& sbi = st->sb_info[b->shared_blob->get_sbid()];
+      sbi.sb = b->shared_blob;
+      sbi.oids.push_back(oid);
+      sbi.compressed = blob.is_compressed();
+      for (auto e : blob.extents) {
+	if (e.is_valid()) {
+	  sbi.ref_map.get(e.offset, e.length);
+	}
+      }
+    }
+    for (auto b : unshared) {
+      const bluestore_blob_t& blob = b->get_blob();
+      errors += _fsck_check_extents(oid, blob.extents,
+				    blob.is_compressed(),
+				    st->used_blocks,
+				    st->expected_statfs);
+    }
+    st->expected_statfs.stored += statfs.stored;
+    st->expected_statfs.compressed += statfs.compressed;
+    st->expected_statfs.compressed_original += statfs.compressed_original;
+    st->num_extents += num_extents;
+    st->num_blobs += ref_map.size();
+  }
+  ++fsck_progress.objects;
+  fsck_progress.errors += errors;
+  return errors;
+}
+
+void BlueStore::_fsck_thread(fsck_state_t *st)
+{
+  std::unique_lock<std::mutex> l(st->lock);
+  while (true) {
+    if (st->q.empty()) {
+      if (st->q_stop) {
+	break;
+      }
+      st->cond.wait(l);
+      continue;
+    }
+    auto p = std::move(st->q.front());
+    st->q.pop_front();
+    st->cond.notify_all();  // there is room in the queue
+    l.unlock();
+    int r = _fsck_check_object(st, p.first.get(), p.second);
+    l.lock();
+    st->errors += r;
+  }
+}
+
+void BlueStore::_fsck_set_phase(const char *phase)
+{
+  fsck_progress.phase = phase;
+}
+
 int BlueStore::fsck(bool deep)
 {
   dout(1) << __func__ << (deep ? " (deep)" : " (shallow)") << " start" << dendl;
   int errors = 0;
   set<uint64_t> used_nids;
   set<uint64_t> used_omap_head;
-  boost::dynamic_bitset<> used_blocks;
   set<uint64_t> used_sbids;
   KeyValueDB::Iterator it;
-  store_statfs_t expected_statfs, actual_statfs;
-  struct sb_info_t {
-    list<ghobject_t> oids;
-    SharedBlobRef sb;
-    bluestore_extent_ref_map_t ref_map;
-    bool compressed;
-  };
-  map<uint64_t,sb_info_t> sb_info;
+  fsck_state_t st;
+  st.deep = deep;
+  boost::dynamic_bitset<>& used_blocks = st.used_blocks;
+  store_statfs_t& expected_statfs = st.expected_statfs;
+  store_statfs_t actual_statfs;
+  map<uint64_t,fsck_sb_info_t>& sb_info = st.sb_info;
+  vector<FsckThread*> threads;
+  unsigned max_queue = 0;
 
   uint64_t num_objects = 0;
-  uint64_t num_extents = 0;
-  uint64_t num_blobs = 0;
   uint64_t num_spanning_blobs = 0;
   uint64_t num_shared_blobs = 0;
   uint64_t num_sharded_objects = 0;
   uint64_t num_object_shards = 0;
 
   utime_t start = ceph_clock_now();
+  fsck_progress.start = start;
+  fsck_progress.objects = 0;
+  fsck_progress.errors = 0;
+  _fsck_set_phase("opening");
+  fsck_progress.running = true;
+  asok_hook = new SocketHook(this);
+  if (cct->get_admin_socket()->register_command(
+	"bluestore fsck status", "bluestore fsck status", asok_hook,
+	"show progress of a running bluestore fsck") < 0) {
+    // another store in this process got there first
+    delete asok_hook;
+    asok_hook = nullptr;
+  }
 
   int r = _open_path();
   if (r < 0)
-    return r;
+    goto out_progress;
   r = _open_fsid(false);
   if (r < 0)
     goto out_path;
@@ -4997,8 +5748,18 @@ int BlueStore::fsck(bool deep)
   expected_statfs.total = actual_statfs.total;
   expected_statfs.available = actual_statfs.available;
 
-  // walk PREFIX_OBJ
+  // walk PREFIX_OBJ.  we decode onodes and check keys, nids and omap
+  // heads here; extents, blobs and (if deep) data are checked by the
+  // fsck threads.
   dout(1) << __func__ << " walking object keyspace" << dendl;
+  _fsck_set_phase("objects");
+  if (cct->_conf->bluestore_fsck_threads > 1) {
+    for (int i = 0; i < cct->_conf->bluestore_fsck_threads; ++i) {
+      threads.push_back(new FsckThread(this, &st));
+      threads.back()->create("bstore_fsck");
+    }
+    max_queue = threads.size() * 16;
+  }
   it = db->get_iterator(PREFIX_OBJ);
   if (it) {
     CollectionRef c;
@@ -5089,8 +5850,11 @@ int BlueStore::fsck(bool deep)
       }
 
       dout(10) << __func__ << "  " << oid << dendl;
-      RWLock::RLocker l(c->lock);
-      OnodeRef o = c->get_onode(oid, false);
+      OnodeRef o;
+      {
+	RWLock::RLocker l(c->lock);
+	o = c->get_onode(oid, false);
+      }
       if (o->onode.nid) {
 	if (o->onode.nid > nid_max) {
 	  derr << __func__ << " " << oid << " nid " << o->onode.nid
@@ -5107,8 +5871,6 @@ int BlueStore::fsck(bool deep)
       }
       ++num_objects;
       num_spanning_blobs += o->extent_map.spanning_blob_map.size();
-      o->extent_map.fault_range(db, 0, OBJECT_MAX_SIZE);
-      _dump_onode(o, 30);
       // shards
       if (!o->extent_map.shards.empty()) {
 	++num_sharded_objects;
@@ -5126,92 +5888,6 @@ int BlueStore::fsck(bool deep)
 	  ++errors;
 	}
       }
-      // lextents
-      uint64_t pos = 0;
-      map<BlobRef, bluestore_blob_use_tracker_t> ref_map;
-      for (auto& l : o->extent_map.extent_map) {
-	dout(20) << __func__ << "    " << l << dendl;
-	if (l.logical_offset < pos) {
-	  derr << __func__ << " " << oid << " lextent at 0x"
-	       << std::hex << l.logical_offset
-	       << " overlaps with the previous, which ends at 0x" << pos
-	       << std::dec << dendl;
-	  ++errors;
-	}
-	if (o->extent_map.spans_shard(l.logical_offset, l.length)) {
-	  derr << __func__ << " " << oid << " lextent at 0x"
-	       << std::hex << l.logical_offset << "~" << l.length
-	       << " spans a shard boundary"
-	       << std::dec << dendl;
-	  ++errors;
-	}
-	pos = l.logical_offset + l.length;
-	expected_statfs.stored += l.length;
-	assert(l.blob);
-	const bluestore_blob_t& blob = l.blob->get_blob();
-
-        auto& ref = ref_map[l.blob];
-        if (ref.is_empty()) {
-          uint32_t min_release_size = blob.get_release_size(min_alloc_size);
-          uint32_t l = blob.get_logical_length();
-          ref.init(l, min_release_size);
-        }
-	ref.get(
-	  l.blob_offset, 
-	  l.length);
-	++num_extents;
-      }
-      for (auto &i : ref_map) {
-	++num_blobs;
-	const bluestore_blob_t& blob = i.first->get_blob();
-	bool equal = i.first->get_blob_use_tracker().equal(i.second);
-	if (!equal) {
-	  derr << __func__ << " " << oid << " blob " << *i.first
-	       << " doesn't match expected ref_map " << i.second << dendl;
-	  ++errors;
-	}
-	if (blob.is_compressed()) {
-	  expected_statfs.compressed += blob.compressed_length;
-	  expected_statfs.compressed_original += 
-	    i.first->get_referenced_bytes();
-	}
-	if (blob.is_shared()) {
-	  if (i.first->shared_blob->get_sbid() > blobid_max) {
-	    derr << __func__ << " " << oid << " blob " << blob
-		 << " sbid " << i.first->shared_blob->get_sbid() << " > blobid_max "
-		 << blobid_max << dendl;
-	    ++errors;
-	  } else if (i.first->shared_blob->get_sbid() == 0) {
-            derr << __func__ << " " << oid << " blob " << blob
-                 << " marked as shared but has uninitialized sbid"
-                 << dendl;
-            ++errors;
-          }
-	  sb_info_t& sbi = sb_info[i.first->shared_blob->get_sbid()];
-	  sbi.sb = i.first->shared_blob;
-	  sbi.oids.push_back(oid);
-	  sbi.compressed = blob.is_compressed();
-	  for (auto e : blob.extents) {
-	    if (e.is_valid()) {
-	      sbi.ref_map.get(e.offset, e.length);
-	    }
-	  }
-	} else {
-	  errors += _fsck_check_extents(oid, blob.extents,
-					blob.is_compressed(),
-					used_blocks,
-					expected_statfs);
-        }
-      }
-      if (deep) {
-	bufferlist bl;
-	int r = _do_read(c.get(), o, 0, o->onode.size, bl, 0);
-	if (r < 0) {
-	  ++errors;
-	  derr << __func__ << " " << oid << " error during read: "
-	       << cpp_strerror(r) << dendl;
-	}
-      }
       // omap
       if (o->onode.has_omap()) {
 	if (used_omap_head.count(o->onode.nid)) {
@@ -5222,9 +5898,34 @@ int BlueStore::fsck(bool deep)
 	  used_omap_head.insert(o->onode.nid);
 	}
       }
+      if (threads.empty()) {
+	errors += _fsck_check_object(&st, c.get(), o);
+      } else {
+	std::unique_lock<std::mutex> l(st.lock);
+	while (st.q.size() >= max_queue) {
+	  st.cond.wait(l);
+	}
+	st.q.push_back(make_pair(c, o));
+	st.cond.notify_all();
+      }
+    }
+  }
+  if (!threads.empty()) {
+    {
+      std::lock_guard<std::mutex> l(st.lock);
+      st.q_stop = true;
+      st.cond.notify_all();
     }
+    for (auto t : threads) {
+      t->join();
+      delete t;
+    }
+    threads.clear();
   }
+  errors += st.errors;
+
   dout(1) << __func__ << " checking shared_blobs" << dendl;
+  _fsck_set_phase("shared blobs");
   it = db->get_iterator(PREFIX_SHARED_BLOB);
   if (it) {
     for (it->lower_bound(string()); it->valid(); it->next()) {
@@ -5243,7 +5944,7 @@ int BlueStore::fsck(bool deep)
 	++errors;
       } else {
 	++num_shared_blobs;
-	sb_info_t& sbi = p->second;
+	fsck_sb_info_t& sbi = p->second;
 	bluestore_shared_blob_t shared_blob(sbid);
 	bufferlist bl = it->value();
 	bufferlist::iterator blp = bl.begin();
@@ -5279,6 +5980,7 @@ int BlueStore::fsck(bool deep)
   }
 
   dout(1) << __func__ << " checking for stray omap data" << dendl;
+  _fsck_set_phase("omap");
   it = db->get_iterator(PREFIX_OMAP);
   if (it) {
     for (it->lower_bound(string()); it->valid(); it->next()) {
@@ -5293,6 +5995,7 @@ int BlueStore::fsck(bool deep)
   }
 
   dout(1) << __func__ << " checking wal events" << dendl;
+  _fsck_set_phase("wal");
   it = db->get_iterator(PREFIX_WAL);
   if (it) {
     for (it->lower_bound(string()); it->valid(); it->next()) {
@@ -5322,6 +6025,7 @@ int BlueStore::fsck(bool deep)
   }
 
   dout(1) << __func__ << " checking freelist vs allocated" << dendl;
+  _fsck_set_phase("freelist");
   {
     // remove bluefs_extents from used set since the freelist doesn't
     // know they are allocated.
@@ -5379,11 +6083,21 @@ int BlueStore::fsck(bool deep)
   _close_fsid();
  out_path:
   _close_path();
+ out_progress:
+  if (asok_hook) {
+    cct->get_admin_socket()->unregister_command("bluestore fsck status");
+    delete asok_hook;
+    asok_hook = nullptr;
+  }
+  fsck_progress.running = false;
+  _fsck_set_phase("");
 
   // fatal errors take precedence
   if (r < 0)
     return r;
 
+  uint64_t num_extents = st.num_extents;
+  uint64_t num_blobs = st.num_blobs;
   dout(2) << __func__ << " " << num_objects << " objects, "
 	  << num_sharded_objects << " of them sharded.  "
 	  << dendl;
@@ -5407,7 +6121,7 @@ void BlueStore::_sync()
   bdev->flush();
 
   std::unique_lock<std::mutex> l(kv_lock);
-  while (!kv_committing.empty() ||
+  while (kv_batches ||
 	 !kv_queue.empty()) {
     dout(20) << " waiting for kv to commit" << dendl;
     kv_sync_cond.wait(l);
@@ -5457,12 +6171,41 @@ int BlueStore::statfs(struct store_statfs_t *buf)
   return 0;
 }
 
-// ---------------
-// cache
-
-BlueStore::CollectionRef BlueStore::_get_collection(const coll_t& cid)
+int BlueStore::pool_statfs(uint64_t pool_id, struct store_statfs_t *buf)
 {
-  RWLock::RLocker l(coll_lock);
+  if (!per_pool_stats)
+    return -EOPNOTSUPP;
+
+  buf->reset();
+  string key;
+  get_pool_stat_key(pool_id, &key);
+  bufferlist bl;
+  int r = db->get(PREFIX_STAT, key, &bl);
+  if (r >= 0) {
+    TransContext::volatile_statfs vstatfs;
+    if (size_t(bl.length()) >= sizeof(vstatfs.values)) {
+      auto it = bl.begin();
+      vstatfs.decode(it);
+      buf->allocated = vstatfs.allocated();
+      buf->stored = vstatfs.stored();
+      buf->compressed = vstatfs.compressed();
+      buf->compressed_original = vstatfs.compressed_original();
+      buf->compressed_allocated = vstatfs.compressed_allocated();
+    } else {
+      dout(10) << __func__ << " pool " << pool_id
+	       << " statfs is corrupt, using empty" << dendl;
+    }
+  }
+  dout(20) << __func__ << " pool " << pool_id << " " << *buf << dendl;
+  return 0;
+}
+
+// ---------------
+// cache
+
+BlueStore::CollectionRef BlueStore::_get_collection(const coll_t& cid)
+{
+  RWLock::RLocker l(coll_lock);
   ceph::unordered_map<coll_t,CollectionRef>::iterator cp = coll_map.find(cid);
   if (cp == coll_map.end())
     return CollectionRef();
@@ -5512,6 +6255,43 @@ void BlueStore::_reap_collections()
   }
 }
 
+void BlueStore::_trim_cache_shard(Cache *cache)
+{
+  // see if mempool stats have updated
+  uint64_t total_bytes;
+  uint64_t total_onodes;
+  size_t seq;
+  get_mempool_stats(&seq, &total_bytes, &total_onodes);
+  if (cache->last_trim_seq.exchange(seq) == seq) {
+    dout(30) << __func__ << " no new mempool stats; nothing to do" << dendl;
+    return;
+  }
+
+  // trim
+  if (total_onodes < 2) {
+    total_onodes = 2;
+  }
+  float bytes_per_onode = (float)total_bytes / (float)total_onodes;
+  size_t num_shards = cache_shards.size();
+  uint64_t target = cct->_conf->bluestore_cache_size;
+  float meta_ratio = cct->_conf->bluestore_cache_meta_ratio;
+  if (cct->_conf->bluestore_cache_autotune) {
+    uint64_t meta = cache_meta_target;
+    uint64_t data = cache_data_target;
+    if (meta + data > 0) {
+      target = meta + data;
+      meta_ratio = (double)meta / (double)target;
+    }
+  }
+  uint64_t shard_target = target / num_shards;
+  dout(30) << __func__ << " shard " << cache
+	   << " total meta bytes " << total_bytes
+	   << ", total onodes " << total_onodes
+	   << ", bytes_per_onode " << bytes_per_onode
+	   << dendl;
+  cache->trim(shard_target, meta_ratio, bytes_per_onode);
+}
+
 void BlueStore::_update_cache_logger()
 {
   uint64_t num_onodes = 0;
@@ -5620,7 +6400,7 @@ int BlueStore::set_collection_opts(
   if (!c->exists)
     return -ENOENT;
   RWLock::WLocker l(c->lock);
-  c->pool_opts = opts;
+  c->set_pool_opts(opts);
   return 0;
 }
 
@@ -5673,6 +6453,9 @@ int BlueStore::read(
       length = o->onode.size;
 
     r = _do_read(c, o, offset, length, bl, op_flags);
+    if (r > 0 && cct->_conf->bluestore_readahead) {
+      _do_readahead(c, o, offset, r, op_flags);
+    }
   }
 
  out:
@@ -5925,7 +6708,7 @@ int BlueStore::_do_read(
 	return -EIO;
       }
       bufferlist raw_bl;
-      r = _decompress(compressed_bl, &raw_bl);
+      r = _decompress(c, compressed_bl, &raw_bl);
       if (r < 0)
 	return r;
       if (buffered) {
@@ -5987,6 +6770,164 @@ int BlueStore::_do_read(
   return r;
 }
 
+void BlueStore::_do_readahead(
+  Collection *c,
+  OnodeRef o,
+  uint64_t offset,
+  size_t length,
+  uint32_t op_flags)
+{
+  if (op_flags & (CEPH_OSD_OP_FLAG_FADVISE_RANDOM |
+		  CEPH_OSD_OP_FLAG_FADVISE_DONTNEED |
+		  CEPH_OSD_OP_FLAG_FADVISE_NOCACHE)) {
+    return;
+  }
+  if (!o->readahead) {
+    std::lock_guard<std::mutex> l(o->flush_lock);
+    if (!o->readahead) {
+      Readahead *ra = new Readahead;
+      ra->set_trigger_requests(cct->_conf->bluestore_readahead_trigger_requests);
+      ra->set_min_readahead_size(cct->_conf->bluestore_readahead_min_bytes);
+      ra->set_max_readahead_size(cct->_conf->bluestore_readahead_max_bytes);
+      o->readahead.reset(ra);
+    }
+  }
+  Readahead::extent_t ra = o->readahead->update(offset, length,
+						o->onode.size);
+  if (ra.second == 0) {
+    return;
+  }
+  dout(20) << __func__ << " " << o->oid << " 0x" << std::hex << ra.first
+	   << "~" << ra.second << std::dec << dendl;
+
+  // we hold the collection lock (read) and o->flush() was done by the
+  // read that got us here, so what is on disk matches the extent map.
+  o->extent_map.fault_range(db, ra.first, ra.second);
+  ReadaheadContext *rctx = new ReadaheadContext(cct, c, o);
+  uint64_t bytes = 0;
+  uint64_t end = ra.first + ra.second;
+  auto lp = o->extent_map.seek_lextent(ra.first);
+  for (; lp != o->extent_map.extent_map.end() && lp->logical_offset < end;
+       ++lp) {
+    BlobRef bptr = lp->blob;
+    const bluestore_blob_t& blob = bptr->get_blob();
+    if (blob.is_compressed()) {
+      // would need a full blob read and a decompress in the aio thread
+      continue;
+    }
+    uint64_t l_off = lp->logical_offset < ra.first ?
+      ra.first - lp->logical_offset : 0;
+    uint64_t b_off = lp->blob_offset + l_off;
+    uint64_t b_len = std::min<uint64_t>(lp->length - l_off,
+					end - lp->logical_offset - l_off);
+    ready_regions_t cache_res;
+    interval_set<uint32_t> cache_interval;
+    uint64_t gen;
+    {
+      std::lock_guard<std::recursive_mutex> l(
+	bptr->shared_blob->get_cache()->lock);
+      gen = bptr->shared_blob->bc.write_gen;
+      bptr->shared_blob->bc.read(
+	bptr->shared_blob->get_cache(), b_off, b_len, cache_res,
+	cache_interval);
+    }
+    if (cache_interval.size() == b_len) {
+      continue;
+    }
+    // only read what isn't cached; a cached buffer may be newer than the
+    // disk (e.g. a deferred write not applied yet)
+    interval_set<uint32_t> gaps;
+    gaps.insert(b_off, b_len);
+    gaps.subtract(cache_interval);
+    uint64_t chunk_size = blob.get_chunk_size(block_size);
+    interval_set<uint32_t> to_read;
+    for (auto g = gaps.begin(); g != gaps.end(); ++g) {
+      uint32_t r_off = P2ALIGN(g.get_start(), chunk_size);
+      to_read.union_insert(
+	r_off, P2ROUNDUP(g.get_start() + g.get_len(), chunk_size) - r_off);
+    }
+    int r = 0;
+    for (auto g = to_read.begin(); g != to_read.end(); ++g) {
+      uint64_t r_off = g.get_start();
+      uint64_t r_len = g.get_len();
+      rctx->regions.emplace_back(bptr, gen, r_off);
+      ReadaheadContext::region_t& reg = rctx->regions.back();
+      // csum_data is updated in place by writes; take a private copy
+      reg.csum = blob;
+      if (blob.csum_data.length()) {
+	reg.csum.csum_data = buffer::ptr(blob.csum_data.c_str(),
+					 blob.csum_data.length());
+      }
+      r = blob.map(
+	r_off, r_len,
+	[&](uint64_t offset, uint64_t length) {
+	  return bdev->aio_read(offset, length, &reg.bl, &rctx->ioc);
+	});
+      if (r < 0) {
+	derr << __func__ << " aio_read failed: " << cpp_strerror(r) << dendl;
+	rctx->regions.pop_back();
+	break;
+      }
+      bytes += r_len;
+    }
+    if (r < 0) {
+      break;
+    }
+  }
+  if (!rctx->ioc.has_pending_aios()) {
+    delete rctx;
+    return;
+  }
+  logger->inc(l_bluestore_readahead_bytes, bytes);
+  o->readahead->inc_pending();
+  {
+    std::lock_guard<std::mutex> l(readahead_lock);
+    ++readahead_inflight;
+  }
+  bdev->aio_submit(&rctx->ioc);
+}
+
+void BlueStore::_readahead_finish(ReadaheadContext *rctx)
+{
+  OnodeRef o = rctx->o;
+  for (auto& reg : rctx->regions) {
+    int bad;
+    uint64_t bad_csum;
+    if (reg.csum.verify_csum(reg.r_off, reg.bl, &bad, &bad_csum) < 0 ||
+	bad >= 0) {
+      // stale (the object changed under us) or bad; let a demand read
+      // find and report it if it is the latter.
+      dout(20) << __func__ << " " << o->oid << " drop unverified 0x"
+	       << std::hex << reg.r_off << "~" << reg.bl.length() << std::dec
+	       << dendl;
+      logger->inc(l_bluestore_readahead_wasted_bytes, reg.bl.length());
+      continue;
+    }
+    if (!reg.blob->shared_blob->bc.did_readahead(
+	  reg.blob->shared_blob->get_cache(), reg.gen, reg.r_off, reg.bl)) {
+      dout(20) << __func__ << " " << o->oid << " drop stale 0x"
+	       << std::hex << reg.r_off << "~" << reg.bl.length() << std::dec
+	       << dendl;
+      logger->inc(l_bluestore_readahead_wasted_bytes, reg.bl.length());
+    }
+  }
+  o->readahead->dec_pending();
+  delete rctx;
+  std::lock_guard<std::mutex> l(readahead_lock);
+  if (--readahead_inflight == 0) {
+    readahead_cond.notify_all();
+  }
+}
+
+void BlueStore::_wait_readahead()
+{
+  std::unique_lock<std::mutex> l(readahead_lock);
+  while (readahead_inflight) {
+    dout(20) << __func__ << " " << readahead_inflight << " in flight" << dendl;
+    readahead_cond.wait(l);
+  }
+}
+
 int BlueStore::_verify_csum(OnodeRef& o,
 			    const bluestore_blob_t* blob, uint64_t blob_xoffset,
 			    const bufferlist& bl,
@@ -6026,7 +6967,8 @@ int BlueStore::_verify_csum(OnodeRef& o,
   return r;
 }
 
-int BlueStore::_decompress(bufferlist& source, bufferlist* result)
+int BlueStore::_decompress(Collection *c, bufferlist& source,
+			   bufferlist* result)
 {
   int r = 0;
   utime_t start = ceph_clock_now();
@@ -6044,6 +6986,20 @@ int BlueStore::_decompress(bufferlist& source, bufferlist* result)
     // decompressed data?
     derr << __func__ << " can't load decompressor " << alg << dendl;
     r = -EIO;
+  } else if (chdr.dict_id) {
+    Compressor::DictionaryRef dict = c->get_compression_dict(cp, chdr.dict_id);
+    if (!dict) {
+      derr << __func__ << " missing compression dictionary " << chdr.dict_id
+	   << dendl;
+      r = -EIO;
+    } else {
+      r = cp->decompress(i, chdr.length, *result, *dict);
+      if (r < 0) {
+	derr << __func__ << " decompression failed with exit code " << r
+	     << dendl;
+	r = -EIO;
+      }
+    }
   } else {
     r = cp->decompress(i, chdr.length, *result);
     if (r < 0) {
@@ -6547,10 +7503,10 @@ int BlueStore::omap_get(
     goto out;
   o->flush();
   {
-    KeyValueDB::Iterator it = db->get_iterator(PREFIX_OMAP);
     string head, tail;
     get_omap_header(o->onode.nid, &head);
     get_omap_tail(o->onode.nid, &tail);
+    KeyValueDB::Iterator it = db->get_iterator(PREFIX_OMAP, tail);
     it->lower_bound(head);
     while (it->valid()) {
       if (it->key() == head) {
@@ -6657,10 +7613,10 @@ int BlueStore::omap_get_keys(
     goto out;
   o->flush();
   {
-    KeyValueDB::Iterator it = db->get_iterator(PREFIX_OMAP);
     string head, tail;
     get_omap_key(o->onode.nid, string(), &head);
     get_omap_tail(o->onode.nid, &tail);
+    KeyValueDB::Iterator it = db->get_iterator(PREFIX_OMAP, tail);
     it->lower_bound(head);
     while (it->valid()) {
       if (it->key() >= tail) {
@@ -6718,14 +7674,20 @@ int BlueStore::omap_get_values(
   o->flush();
   _key_encode_u64(o->onode.nid, &final_key);
   final_key.push_back('.');
-  for (set<string>::const_iterator p = keys.begin(); p != keys.end(); ++p) {
-    final_key.resize(9); // keep prefix
-    final_key += *p;
-    bufferlist val;
-    if (db->get(PREFIX_OMAP, final_key, &val) >= 0) {
-      dout(30) << __func__ << "  got " << pretty_binary_string(final_key)
-	       << " -> " << *p << dendl;
-      out->insert(make_pair(*p, val));
+  {
+    // look them all up in one batch
+    set<string> final_keys;
+    for (auto& k : keys) {
+      final_key.resize(9); // keep prefix
+      final_key += k;
+      final_keys.insert(final_keys.end(), final_key);
+    }
+    map<string,bufferlist> got;
+    db->get(PREFIX_OMAP, final_keys, &got);
+    for (auto& p : got) {
+      dout(30) << __func__ << "  got " << pretty_binary_string(p.first)
+	       << dendl;
+      out->insert(out->end(), make_pair(p.first.substr(9), p.second));
     }
   }
  out:
@@ -6771,17 +7733,19 @@ int BlueStore::omap_check_keys(
   o->flush();
   _key_encode_u64(o->onode.nid, &final_key);
   final_key.push_back('.');
-  for (set<string>::const_iterator p = keys.begin(); p != keys.end(); ++p) {
-    final_key.resize(9); // keep prefix
-    final_key += *p;
-    bufferlist val;
-    if (db->get(PREFIX_OMAP, final_key, &val) >= 0) {
-      dout(30) << __func__ << "  have " << pretty_binary_string(final_key)
-	       << " -> " << *p << dendl;
-      out->insert(*p);
-    } else {
-      dout(30) << __func__ << "  miss " << pretty_binary_string(final_key)
-	       << " -> " << *p << dendl;
+  {
+    set<string> final_keys;
+    for (auto& k : keys) {
+      final_key.resize(9); // keep prefix
+      final_key += k;
+      final_keys.insert(final_keys.end(), final_key);
+    }
+    map<string,bufferlist> got;
+    db->get(PREFIX_OMAP, final_keys, &got);
+    for (auto& p : got) {
+      dout(30) << __func__ << "  have " << pretty_binary_string(p.first)
+	       << dendl;
+      out->insert(out->end(), p.first.substr(9));
     }
   }
  out:
@@ -6821,7 +7785,14 @@ ObjectMap::ObjectMapIterator BlueStore::get_omap_iterator(
   }
   o->flush();
   dout(10) << __func__ << " has_omap = " << (int)o->onode.has_omap() <<dendl;
-  KeyValueDB::Iterator it = db->get_iterator(PREFIX_OMAP);
+  KeyValueDB::Iterator it;
+  if (o->onode.has_omap()) {
+    string tail;
+    get_omap_tail(o->onode.nid, &tail);
+    it = db->get_iterator(PREFIX_OMAP, tail);
+  } else {
+    it = db->get_iterator(PREFIX_OMAP);
+  }
   return ObjectMap::ObjectMapIterator(new OmapIteratorImpl(c, o, it));
 }
 
@@ -6981,6 +7952,12 @@ int BlueStore::_open_super_meta()
   }
   _set_alloc_sizes();
 
+  {
+    bufferlist bl;
+    per_pool_stats = db->get(PREFIX_SUPER, "per_pool_stats", &bl) >= 0;
+    dout(10) << __func__ << " per_pool_stats " << per_pool_stats << dendl;
+  }
+
   return 0;
 }
 
@@ -7060,6 +8037,21 @@ BlueStore::TransContext *BlueStore::_txc_create(OpSequencer *osr)
 
 void BlueStore::_txc_update_store_statfs(TransContext *txc)
 {
+  if (per_pool_stats) {
+    _txc_charge_pool_statfs(txc, CollectionRef());
+    for (auto& p : txc->pool_statfs_delta) {
+      if (p.second.is_empty())
+	continue;
+      string key;
+      get_pool_stat_key(p.first, &key);
+      bufferlist bl;
+      p.second.encode(bl);
+      txc->t->merge(PREFIX_STAT, key, bl);
+    }
+    txc->pool_statfs_delta.clear();
+    txc->statfs_pool_base.reset();
+  }
+
   if (txc->statfs_delta.is_empty())
     return;
 
@@ -7076,6 +8068,25 @@ void BlueStore::_txc_update_store_statfs(TransContext *txc)
   txc->statfs_delta.reset();
 }
 
+void BlueStore::_txc_charge_pool_statfs(TransContext *txc,
+					const CollectionRef& c)
+{
+  // hand what statfs_delta gained since the last call to the pool of the
+  // previous op, then start accruing for c's pool
+  TransContext::volatile_statfs d = txc->statfs_delta;
+  d -= txc->statfs_pool_base;
+  if (!d.is_empty()) {
+    txc->pool_statfs_delta[txc->statfs_pool] += d;
+    txc->statfs_pool_base = txc->statfs_delta;
+  }
+  spg_t pgid;
+  if (c && c->cid.is_pg(&pgid)) {
+    txc->statfs_pool = pgid.pool();
+  } else {
+    txc->statfs_pool = -1;
+  }
+}
+
 void BlueStore::_txc_state_proc(TransContext *txc)
 {
   while (true) {
@@ -7108,7 +8119,7 @@ void BlueStore::_txc_state_proc(TransContext *txc)
 	sb->bc.finish_write(sb->get_cache(), txc->seq);
       }
       txc->shared_blobs_written.clear();
-      if (cct->_conf->bluestore_sync_submit_transaction &&
+      if (store_conf->bluestore_sync_submit_transaction &&
 	  fm->supports_parallel_transactions()) {
 	if (txc->last_nid >= nid_max ||
 	    txc->last_blobid >= blobid_max) {
@@ -7125,8 +8136,8 @@ void BlueStore::_txc_state_proc(TransContext *txc)
 	} else if (txc->osr->txc_with_unstable_io) {
 	  dout(20) << __func__ << " prior txc(s) with unstable ios "
 		   << txc->osr->txc_with_unstable_io.load() << dendl;
-	} else if (cct->_conf->bluestore_debug_randomize_serial_transaction &&
-		   rand() % cct->_conf->bluestore_debug_randomize_serial_transaction
+	} else if (store_conf->bluestore_debug_randomize_serial_transaction &&
+		   rand() % store_conf->bluestore_debug_randomize_serial_transaction
 		   == 0) {
 	  dout(20) << __func__ << " DEBUG randomly forcing submit via kv thread"
 		   << dendl;
@@ -7157,7 +8168,9 @@ void BlueStore::_txc_state_proc(TransContext *txc)
       txc->log_state_latency(logger, l_bluestore_state_kv_done_lat);
       if (txc->wal_txn) {
 	txc->state = TransContext::STATE_WAL_QUEUED;
-	if (sync_wal_apply) {
+	if (wal_batching) {
+	  _wal_queue_batch(txc);
+	} else if (sync_wal_apply) {
 	  _wal_apply(txc);
 	} else {
 	  wal_wq.queue(txc);
@@ -7282,7 +8295,19 @@ void BlueStore::_txc_write_nodes(TransContext *txc, KeyValueDB::Transaction t)
 	     << blob_part << " bytes spanning blobs + "
 	     << extent_part << " bytes inline extents)"
 	     << dendl;
-    t->set(PREFIX_OBJ, o->key.c_str(), o->key.size(), bl);
+    if (o->onode.extent_map_shards.empty()) {
+      // inline extents changed (or we wouldn't be here)
+      o->last_encoded.clear();
+      t->set(PREFIX_OBJ, o->key.c_str(), o->key.size(), bl);
+    } else if (o->last_encoded.contents_equal(bl)) {
+      // a small overwrite typically dirties just one shard and leaves
+      // the onode, shard_info and spanning blobs byte-for-byte the same
+      dout(20) << "  onode " << o->oid << " unchanged" << dendl;
+      logger->inc(l_bluestore_onode_unchanged);
+    } else {
+      t->set(PREFIX_OBJ, o->key.c_str(), o->key.size(), bl);
+      o->last_encoded.claim(bl);
+    }
 
     std::lock_guard<std::mutex> l(o->flush_lock);
     o->flush_txns.insert(txc);
@@ -7331,19 +8356,22 @@ void BlueStore::_txc_finish_kv(TransContext *txc)
     txc->onreadable_sync->complete(0);
     txc->onreadable_sync = NULL;
   }
-  unsigned n = txc->osr->parent->shard_hint.hash_to_shard(m_finisher_num);
+  uint64_t key = (uintptr_t)txc->osr.get();
   if (txc->oncommit) {
-    logger->tinc(l_bluestore_commit_lat, ceph_clock_now() - txc->start);
-    finishers[n]->queue(txc->oncommit);
+    utime_t lat = ceph_clock_now() - txc->start;
+    logger->tinc(l_bluestore_commit_lat, lat);
+    logger->hinc(l_bluestore_commit_lat_bytes_hist, lat.to_nsec(),
+		 txc->bytes);
+    finishers.queue(key, txc->oncommit);
     txc->oncommit = NULL;
   }
   if (txc->onreadable) {
-    finishers[n]->queue(txc->onreadable);
+    finishers.queue(key, txc->onreadable);
     txc->onreadable = NULL;
   }
 
   if (!txc->oncommits.empty()) {
-    finishers[n]->queue(txc->oncommits);
+    finishers.queue(key, txc->oncommits);
   }
   _op_queue_release_throttle(txc);
 }
@@ -7491,38 +8519,82 @@ void BlueStore::_txc_release_alloc(TransContext *txc)
   txc->released.clear();
 }
 
-void BlueStore::_kv_sync_thread()
+void BlueStore::_kv_flush_thread()
 {
   dout(10) << __func__ << " start" << dendl;
   std::unique_lock<std::mutex> l(kv_lock);
   while (true) {
-    assert(kv_committing.empty());
     if (kv_queue.empty() && wal_cleanup_queue.empty()) {
-      if (kv_stop)
-	break;
+      // finalizing a batch (or completing batched wal writes) may queue
+      // more wal cleanup, so only stop once nothing else is in flight.
+      if (kv_stop && kv_batches == 0) {
+	std::lock_guard<std::mutex> wl(wal_lock);
+	if (!wal_batch_pending && !wal_batch_running)
+	  break;
+      }
       dout(20) << __func__ << " sleep" << dendl;
-      kv_sync_cond.notify_all();
       kv_cond.wait(l);
       dout(20) << __func__ << " wake" << dendl;
     } else {
-      deque<TransContext*> kv_submitting;
-      deque<TransContext*> wal_cleaning;
+      KVBatch b;
       dout(20) << __func__ << " committing " << kv_queue.size()
 	       << " submitting " << kv_queue_unsubmitted.size()
 	       << " cleaning " << wal_cleanup_queue.size() << dendl;
-      kv_committing.swap(kv_queue);
-      kv_submitting.swap(kv_queue_unsubmitted);
-      wal_cleaning.swap(wal_cleanup_queue);
-      utime_t start = ceph_clock_now();
+      b.committing.swap(kv_queue);
+      b.submitting.swap(kv_queue_unsubmitted);
+      b.wal_cleaning.swap(wal_cleanup_queue);
+      b.start = ceph_clock_now();
+      ++kv_batches;
       l.unlock();
 
+      // flush/barrier on block device
+      bdev->flush();
+      logger->tinc(l_bluestore_kv_flush_lat, ceph_clock_now() - b.start);
+
+      l.lock();
+      kv_flushed.push_back(std::move(b));
+      kv_flushed_cond.notify_one();
+    }
+  }
+  dout(10) << __func__ << " finish" << dendl;
+}
+
+void BlueStore::_kv_sync_thread()
+{
+  dout(10) << __func__ << " start" << dendl;
+  std::unique_lock<std::mutex> l(kv_lock);
+  while (true) {
+    if (kv_flushed.empty()) {
+      if (kv_sync_stop)
+	break;
+      dout(20) << __func__ << " sleep" << dendl;
+      kv_flushed_cond.wait(l);
+      dout(20) << __func__ << " wake" << dendl;
+    } else {
+      // merge everything that has been flushed so far into a single sync
+      KVBatch b;
+      b.start = kv_flushed.front().start;
+      unsigned num_batches = kv_flushed.size();
+      for (auto& fb : kv_flushed) {
+	b.committing.insert(b.committing.end(),
+			    fb.committing.begin(), fb.committing.end());
+	b.submitting.insert(b.submitting.end(),
+			    fb.submitting.begin(), fb.submitting.end());
+	b.wal_cleaning.insert(b.wal_cleaning.end(),
+			      fb.wal_cleaning.begin(), fb.wal_cleaning.end());
+      }
+      kv_flushed.clear();
+      l.unlock();
+
+      deque<TransContext*>& kv_committing = b.committing;
+      deque<TransContext*>& kv_submitting = b.submitting;
+      deque<TransContext*>& wal_cleaning = b.wal_cleaning;
+      utime_t start = ceph_clock_now();
+
       dout(30) << __func__ << " committing txc " << kv_committing << dendl;
       dout(30) << __func__ << " submitting txc " << kv_submitting << dendl;
       dout(30) << __func__ << " wal_cleaning txc " << wal_cleaning << dendl;
 
-      // flush/barrier on block device
-      bdev->flush();
-
       // we will use one final transaction to force a sync
       KeyValueDB::Transaction synct = db->get_transaction();
 
@@ -7607,27 +8679,19 @@ void BlueStore::_kv_sync_thread()
       }
 
       utime_t finish = ceph_clock_now();
-      utime_t dur = finish - start;
+      logger->tinc(l_bluestore_kv_commit_lat, finish - start);
       dout(20) << __func__ << " committed " << kv_committing.size()
 	       << " cleaned " << wal_cleaning.size()
-	       << " in " << dur << dendl;
-      while (!kv_committing.empty()) {
-	TransContext *txc = kv_committing.front();
+	       << " in " << (finish - b.start)
+	       << " (" << num_batches << " batches)" << dendl;
+      for (auto txc : kv_committing) {
 	assert(txc->state == TransContext::STATE_KV_SUBMITTED);
 	_txc_release_alloc(txc);
-	_txc_state_proc(txc);
-	kv_committing.pop_front();
       }
-      while (!wal_cleaning.empty()) {
-	TransContext *txc = wal_cleaning.front();
+      for (auto txc : wal_cleaning) {
 	_txc_release_alloc(txc);
-	_txc_state_proc(txc);
-	wal_cleaning.pop_front();
       }
 
-      // this is as good a place as any ...
-      _reap_collections();
-
       if (bluefs) {
 	if (!bluefs_gift_extents.empty()) {
 	  _commit_bluefs_freespace(bluefs_gift_extents);
@@ -7644,6 +8708,60 @@ void BlueStore::_kv_sync_thread()
       }
 
       l.lock();
+      // the merged batch finalizes as one; account for the ones we absorbed
+      kv_batches -= num_batches - 1;
+      kv_committed.push_back(std::move(b));
+      kv_finalize_cond.notify_one();
+    }
+  }
+  dout(10) << __func__ << " finish" << dendl;
+}
+
+void BlueStore::_kv_finalize_thread()
+{
+  dout(10) << __func__ << " start" << dendl;
+  std::unique_lock<std::mutex> l(kv_lock);
+  while (true) {
+    if (kv_committed.empty()) {
+      if (kv_finalize_stop)
+	break;
+      dout(20) << __func__ << " sleep" << dendl;
+      kv_finalize_cond.wait(l);
+      dout(20) << __func__ << " wake" << dendl;
+    } else {
+      deque<KVBatch> batches;
+      batches.swap(kv_committed);
+      l.unlock();
+
+      utime_t start = ceph_clock_now();
+      for (auto& b : batches) {
+	dout(20) << __func__ << " finalizing " << b.committing.size()
+		 << " cleaned " << b.wal_cleaning.size() << dendl;
+	for (auto txc : b.committing) {
+	  _txc_state_proc(txc);
+	}
+	for (auto txc : b.wal_cleaning) {
+	  _txc_state_proc(txc);
+	}
+      }
+
+      // everything that committed together gets its wal writes applied
+      // together
+      if (wal_batching) {
+	_wal_submit_batch();
+      }
+
+      // this is as good a place as any ...
+      _reap_collections();
+
+      logger->tinc(l_bluestore_kv_finalize_lat, ceph_clock_now() - start);
+
+      l.lock();
+      kv_batches -= batches.size();
+      if (kv_batches == 0) {
+	kv_sync_cond.notify_all();
+	kv_cond.notify_all();  // flush thread may be waiting to stop
+      }
     }
   }
   dout(10) << __func__ << " finish" << dendl;
@@ -7665,12 +8783,12 @@ int BlueStore::_wal_apply(TransContext *txc)
   txc->log_state_latency(logger, l_bluestore_state_wal_queued_lat);
   txc->state = TransContext::STATE_WAL_APPLYING;
 
-  if (cct->_conf->bluestore_inject_wal_apply_delay) {
+  if (store_conf->bluestore_inject_wal_apply_delay) {
     dout(20) << __func__ << " bluestore_inject_wal_apply_delay "
-	     << cct->_conf->bluestore_inject_wal_apply_delay
+	     << store_conf->bluestore_inject_wal_apply_delay
 	     << dendl;
     utime_t t;
-    t.set_from_double(cct->_conf->bluestore_inject_wal_apply_delay);
+    t.set_from_double(store_conf->bluestore_inject_wal_apply_delay);
     t.sleep();
     dout(20) << __func__ << " finished sleep" << dendl;
   }
@@ -7705,6 +8823,150 @@ int BlueStore::_wal_finish(TransContext *txc)
   return 0;
 }
 
+void BlueStore::WALBatch::prepare_write(uint64_t offset, bufferlist& bl)
+{
+  uint64_t end = offset + bl.length();
+  auto p = extents.lower_bound(offset);
+  if (p != extents.begin()) {
+    --p;
+    if (p->first + p->second.length() <= offset) {
+      ++p;
+    }
+  }
+  // trim or drop anything we overlap; we always win
+  while (p != extents.end() && p->first < end) {
+    uint64_t pend = p->first + p->second.length();
+    if (p->first < offset) {
+      if (pend > end) {
+	bufferlist tail;
+	tail.substr_of(p->second, end - p->first, pend - end);
+	extents[end].swap(tail);
+      }
+      bufferlist head;
+      head.substr_of(p->second, 0, offset - p->first);
+      p->second.swap(head);
+      ++p;
+    } else if (pend > end) {
+      bufferlist tail;
+      tail.substr_of(p->second, end - p->first, pend - end);
+      extents.erase(p);
+      extents[end].swap(tail);
+      break;
+    } else {
+      extents.erase(p++);
+    }
+  }
+  extents[offset] = bl;
+  bytes += bl.length();
+}
+
+void BlueStore::_wal_queue_batch(TransContext *txc)
+{
+  bluestore_wal_transaction_t& wt = *txc->wal_txn;
+  dout(20) << __func__ << " txc " << txc << " seq " << wt.seq << dendl;
+  txc->log_state_latency(logger, l_bluestore_state_wal_queued_lat);
+
+  std::unique_lock<std::mutex> l(wal_lock);
+  if (!wal_batch_pending) {
+    wal_batch_pending = new WALBatch(cct);
+  }
+  WALBatch *b = wal_batch_pending;
+  b->txcs.push_back(txc);
+  for (auto& wo : wt.ops) {
+    assert(wo.op == bluestore_wal_op_t::OP_WRITE);
+    logger->inc(l_bluestore_wal_write_ops);
+    logger->inc(l_bluestore_wal_write_bytes, wo.data.length());
+    bufferlist::iterator p = wo.data.begin();
+    for (auto& e : wo.extents) {
+      bufferlist bl;
+      p.copy(e.length, bl);
+      b->prepare_write(e.offset, bl);
+    }
+    ++b->num_ops;
+  }
+  bool full =
+    b->num_ops >= store_conf->bluestore_wal_batch_max_ops ||
+    b->bytes >= store_conf->bluestore_wal_batch_max_bytes;
+  l.unlock();
+  if (full) {
+    _wal_submit_batch();
+  }
+}
+
+void BlueStore::_wal_submit_batch()
+{
+  std::unique_lock<std::mutex> l(wal_lock);
+  if (!wal_batch_pending || wal_batch_running) {
+    // one batch in flight at a time keeps overlapping writes ordered;
+    // the pending batch goes out when the running one completes.
+    return;
+  }
+  WALBatch *b = wal_batch_running = wal_batch_pending;
+  wal_batch_pending = nullptr;
+  l.unlock();
+
+  if (store_conf->bluestore_inject_wal_apply_delay) {
+    dout(20) << __func__ << " bluestore_inject_wal_apply_delay "
+	     << store_conf->bluestore_inject_wal_apply_delay
+	     << dendl;
+    utime_t t;
+    t.set_from_double(store_conf->bluestore_inject_wal_apply_delay);
+    t.sleep();
+    dout(20) << __func__ << " finished sleep" << dendl;
+  }
+
+  for (auto txc : b->txcs) {
+    txc->state = TransContext::STATE_WAL_APPLYING;
+  }
+
+  // coalesce LBA-adjacent extents into as few writes as we can
+  unsigned num_writes = 0;
+  auto p = b->extents.begin();
+  while (p != b->extents.end()) {
+    uint64_t offset = p->first;
+    bufferlist bl;
+    bl.claim(p->second);
+    for (++p;
+	 p != b->extents.end() && p->first == offset + bl.length();
+	 ++p) {
+      bl.claim_append(p->second);
+    }
+    ++num_writes;
+    if (!g_conf->bluestore_debug_omit_block_device_write) {
+      int r = bdev->aio_write(offset, bl, &b->ioc, false);
+      assert(r == 0);
+    }
+  }
+  dout(10) << __func__ << " batch " << b << " txcs " << b->txcs.size()
+	   << " ops " << b->num_ops << " bytes " << b->bytes
+	   << " in " << num_writes << " writes" << dendl;
+  logger->inc(l_bluestore_wal_batch_writes, num_writes);
+
+  if (b->ioc.has_pending_aios()) {
+    bdev->aio_submit(&b->ioc);
+  } else {
+    _wal_batch_finish(b);
+  }
+}
+
+void BlueStore::_wal_batch_finish(WALBatch *b)
+{
+  dout(20) << __func__ << " batch " << b << dendl;
+  for (auto txc : b->txcs) {
+    txc->log_state_latency(logger, l_bluestore_state_wal_applying_lat);
+    txc->state = TransContext::STATE_WAL_AIO_WAIT;
+    txc->log_state_latency(logger, l_bluestore_state_wal_aio_wait_lat);
+    _wal_finish(txc);
+  }
+  {
+    std::lock_guard<std::mutex> l(wal_lock);
+    assert(wal_batch_running == b);
+    wal_batch_running = nullptr;
+  }
+  delete b;
+  _wal_submit_batch();
+}
+
 int BlueStore::_do_wal_op(TransContext *txc, bluestore_wal_op_t& wo)
 {
   switch (wo.op) {
@@ -7757,6 +9019,9 @@ int BlueStore::_wal_replay()
     txc->state = TransContext::STATE_KV_DONE;
     _txc_state_proc(txc);
   }
+  if (wal_batching) {
+    _wal_submit_batch();
+  }
   dout(20) << __func__ << " flushing osr" << dendl;
   osr->flush();
   dout(10) << __func__ << " completed " << count << " events" << dendl;
@@ -7806,6 +9071,8 @@ int BlueStore::queue_transactions(
   txc->onreadable = onreadable;
   txc->onreadable_sync = onreadable_sync;
   txc->oncommit = ondisk;
+  if (op)
+    txc->trace.start(cct, op->get_trace_context(), "bluestore txc");
 
   for (vector<Transaction>::iterator p = tls.begin(); p != tls.end(); ++p) {
     (*p).set_osr(osr);
@@ -7908,6 +9175,42 @@ void BlueStore::_txc_add_transaction(TransContext *txc, Transaction *t)
   }
   vector<OnodeRef> ovec(i.objects.size());
 
+  if (i.objects.size() > 1) {
+    // Pull in the onodes this transaction touches with one batched
+    // lookup per collection instead of one lookup per object.
+    map<Collection*,vector<ghobject_t>> prefetch;
+    set<pair<uint32_t,uint32_t>> seen;
+    Transaction::iterator pi = t->begin();
+    while (pi.have_op()) {
+      Transaction::Op *op = pi.decode_op();
+      switch (op->op) {
+      case Transaction::OP_NOP:
+      case Transaction::OP_MKCOLL:
+      case Transaction::OP_RMCOLL:
+      case Transaction::OP_COLL_SETATTR:
+      case Transaction::OP_COLL_RMATTR:
+      case Transaction::OP_COLL_SETATTRS:
+      case Transaction::OP_COLL_RENAME:
+      case Transaction::OP_STARTSYNC:
+      case Transaction::OP_SPLIT_COLLECTION:
+      case Transaction::OP_SPLIT_COLLECTION2:
+      case Transaction::OP_COLL_HINT:
+	continue;
+      }
+      uint32_t cid = op->cid, oid = op->oid;
+      if (cid >= cvec.size() || !cvec[cid] || oid >= i.objects.size() ||
+	  !seen.insert(make_pair(cid, oid)).second)
+	continue;
+      prefetch[cvec[cid].get()].push_back(i.get_oid(oid));
+    }
+    for (auto& p : prefetch) {
+      if (p.second.size() < 2)
+	continue;
+      RWLock::WLocker l(p.first->lock);
+      p.first->prefetch_onodes(p.second);
+    }
+  }
+
   for (int pos = 0; i.have_op(); ++pos) {
     Transaction::Op *op = i.decode_op();
     int r = 0;
@@ -7918,6 +9221,8 @@ void BlueStore::_txc_add_transaction(TransContext *txc, Transaction *t)
 
     // collection operations
     CollectionRef &c = cvec[op->cid];
+    if (per_pool_stats)
+      _txc_charge_pool_statfs(txc, c);
     switch (op->op) {
     case Transaction::OP_RMCOLL:
       {
@@ -8623,6 +9928,17 @@ void BlueStore::_do_write_big(
   }
 }
 
+void BlueStore::_compress_job(CompressJob *j)
+{
+  if (j->dict) {
+    j->r = j->c->compress(*j->in, j->out, *j->dict);
+  } else {
+    j->r = j->c->compress(*j->in, j->out);
+  }
+  --compress_queued;
+  j->batch->finish_one();
+}
+
 int BlueStore::_do_alloc_write(
   TransContext *txc,
   CollectionRef coll,
@@ -8645,6 +9961,7 @@ int BlueStore::_do_alloc_write(
 
   uint64_t hint = 0;
   CompressorRef c;
+  Compressor::DictionaryRef cdict;
   double crr = 0;
   if (wctx->compress) {
     c = select_option(
@@ -8665,7 +9982,7 @@ int BlueStore::_do_alloc_write(
 
     crr = select_option(
       "compression_required_ratio",
-      cct->_conf->bluestore_compression_required_ratio,
+      store_conf->bluestore_compression_required_ratio,
       [&]() {
         double val;
         if(coll->pool_opts.get(pool_opts_t::COMPRESSION_REQUIRED_RATIO, &val)) {
@@ -8674,6 +9991,10 @@ int BlueStore::_do_alloc_write(
         return boost::optional<double>();
       }
     );
+
+    if (c) {
+      cdict = coll->get_compression_dict(c, 0);
+    }
   }
 
   // checksum
@@ -8690,6 +10011,43 @@ int BlueStore::_do_alloc_write(
     }
   );
 
+  // with more than one compressible blob, compress them in parallel on
+  // compress_tp.  if the pool is already backed up, write the rest
+  // uncompressed rather than stall this op behind other writers.
+  vector<CompressJob> cjobs;
+  vector<bool> cskip;
+  CompressBatch cbatch;
+  if (c && compress_tp.get_num_threads() > 0 && wctx->writes.size() > 1) {
+    unsigned max_queue = store_conf->bluestore_compression_max_queue;
+    cjobs.resize(wctx->writes.size());
+    cskip.resize(wctx->writes.size(), false);
+    unsigned i = 0;
+    for (auto& wi : wctx->writes) {
+      if (wi.blob_length > min_alloc_size) {
+	if (compress_queued >= max_queue) {
+	  cskip[i] = true;
+	  logger->inc(l_bluestore_compress_backlog_skipped);
+	} else {
+	  CompressJob& j = cjobs[i];
+	  j.batch = &cbatch;
+	  j.c = c;
+	  j.dict = cdict;
+	  j.in = &wi.bl;
+	  {
+	    std::lock_guard<std::mutex> l(cbatch.lock);
+	    ++cbatch.pending;
+	  }
+	  ++compress_queued;
+	  compress_wq.queue(&j);
+	  logger->inc(l_bluestore_compress_offloaded);
+	}
+      }
+      ++i;
+    }
+    cbatch.wait();
+  }
+
+  unsigned wi_idx = 0;
   for (auto& wi : wctx->writes) {
     BlobRef b = wi.b;
     bluestore_blob_t& dblob = b->dirty_blob();
@@ -8700,7 +10058,10 @@ int BlueStore::_do_alloc_write(
     unsigned csum_order = block_size_order;
     bufferlist compressed_bl;
     bool compressed = false;
-    if(c && wi.blob_length > min_alloc_size) {
+    bool skip = !cskip.empty() && cskip[wi_idx];
+    CompressJob *cjob = cjobs.empty() ? nullptr : &cjobs[wi_idx];
+    ++wi_idx;
+    if(c && wi.blob_length > min_alloc_size && !skip) {
 
       utime_t start = ceph_clock_now();
 
@@ -8709,10 +10070,18 @@ int BlueStore::_do_alloc_write(
       assert(wi.blob_length == l->length());
       bluestore_compression_header_t chdr;
       chdr.type = c->get_type();
+      chdr.dict_id = cdict ? cdict->id : 0;
       // FIXME: memory alignment here is bad
       bufferlist t;
 
-      r = c->compress(*l, t);
+      if (cjob && cjob->r != -EAGAIN) {
+	r = cjob->r;
+	t.claim(cjob->out);
+      } else if (cdict) {
+	r = c->compress(*l, t, *cdict);
+      } else {
+	r = c->compress(*l, t);
+      }
       assert(r == 0);
 
       chdr.length = t.length();
@@ -8914,6 +10283,53 @@ void BlueStore::_do_garbage_collection(
       logger->inc(l_bluestore_gc_merged, it->length);
     }
   }
+
+  // while we are here, move what is left of badly fragmented blobs we
+  // just overwrote part of into fresh (hopefully contiguous) space
+  unsigned frag_extents = store_conf->bluestore_gc_fragmented_blob_extents;
+  if (!frag_extents)
+    return;
+  uint64_t budget = store_conf->bluestore_gc_fragmented_max_bytes;
+  set<Blob*> seen;
+  vector<AllocExtent> to_move;
+  for (auto& oe : wctx->old_extents) {
+    Blob *b = oe.blob.get();
+    const bluestore_blob_t& blob = b->get_blob();
+    if (blob.is_compressed() || blob.is_shared() ||
+	!seen.insert(b).second) {
+      continue;
+    }
+    unsigned n = 0;
+    for (auto& p : blob.extents) {
+      if (p.is_valid())
+	++n;
+    }
+    if (n < frag_extents)
+      continue;
+    uint64_t b_start = oe.blob_start();
+    uint64_t b_end = oe.blob_end();
+    o->extent_map.fault_range(db, b_start, b_end - b_start);
+    for (auto ep = o->extent_map.seek_lextent(b_start);
+	 ep != o->extent_map.extent_map.end() &&
+	   ep->logical_offset < b_end;
+	 ++ep) {
+      if (ep->blob.get() != b)
+	continue;
+      if (ep->length > budget)
+	break;
+      to_move.emplace_back(ep->logical_offset, ep->length);
+      budget -= ep->length;
+    }
+    dout(20) << __func__ << " relocating fragmented " << *b << dendl;
+  }
+  for (auto& e : to_move) {
+    bufferlist bl;
+    int r = _do_read(c.get(), o, e.offset, e.length, bl, 0);
+    assert(r == (int)e.length);
+    o->extent_map.fault_range(db, e.offset, e.length);
+    _do_write_data(txc, c, o, e.offset, e.length, bl, wctx);
+    logger->inc(l_bluestore_gc_relocated, e.length);
+  }
 }
 
 void BlueStore::_do_write_data(
@@ -8991,7 +10407,7 @@ int BlueStore::_do_write(
   if (fadvise_flags & CEPH_OSD_OP_FLAG_FADVISE_WILLNEED) {
     dout(20) << __func__ << " will do buffered write" << dendl;
     wctx.buffered = true;
-  } else if (cct->_conf->bluestore_default_buffered_write &&
+  } else if (store_conf->bluestore_default_buffered_write &&
 	     (fadvise_flags & (CEPH_OSD_OP_FLAG_FADVISE_DONTNEED |
 			       CEPH_OSD_OP_FLAG_FADVISE_NOCACHE)) == 0) {
     dout(20) << __func__ << " defaulting to buffered write" << dendl;
@@ -9065,8 +10481,8 @@ int BlueStore::_do_write(
     }
   }
   if (wctx.target_blob_size == 0 ||
-      wctx.target_blob_size > cct->_conf->bluestore_max_blob_size) {
-    wctx.target_blob_size = cct->_conf->bluestore_max_blob_size;
+      wctx.target_blob_size > store_conf->bluestore_max_blob_size) {
+    wctx.target_blob_size = store_conf->bluestore_max_blob_size;
   }
   // set the min blob size floor at 2x the min_alloc_size, or else we
   // won't be able to allocate a smaller extent for the compressed
@@ -9265,6 +10681,7 @@ int BlueStore::_do_remove(
   txc->removed(o);
   o->extent_map.clear();
   o->onode = bluestore_onode_t();
+  o->last_encoded.clear();
   _debug_obj_on_delete(o->oid);
   return 0;
 }
@@ -9366,10 +10783,10 @@ int BlueStore::_rmattrs(TransContext *txc,
 
 void BlueStore::_do_omap_clear(TransContext *txc, uint64_t id)
 {
-  KeyValueDB::Iterator it = db->get_iterator(PREFIX_OMAP);
   string prefix, tail;
   get_omap_header(id, &prefix);
   get_omap_tail(id, &tail);
+  KeyValueDB::Iterator it = db->get_iterator(PREFIX_OMAP, tail);
   it->lower_bound(prefix);
   while (it->valid()) {
     if (it->key() >= tail) {
@@ -9500,10 +10917,16 @@ int BlueStore::_omap_rmkey_range(TransContext *txc,
   if (!o->onode.has_omap()) {
     goto out;
   }
-  o->flush();
-  it = db->get_iterator(PREFIX_OMAP);
   get_omap_key(o->onode.nid, first, &key_first);
   get_omap_key(o->onode.nid, last, &key_last);
+  if (txc->t->rm_range_keys(PREFIX_OMAP, key_first, key_last)) {
+    dout(20) << __func__ << "  rm range " << pretty_binary_string(key_first)
+	     << " to " << pretty_binary_string(key_last) << dendl;
+    txc->note_modified_object(o);
+    goto out;
+  }
+  o->flush();
+  it = db->get_iterator(PREFIX_OMAP, key_last);
   it->lower_bound(key_first);
   while (it->valid()) {
     if (it->key() >= key_last) {
@@ -9570,7 +10993,7 @@ int BlueStore::_clone(TransContext *txc,
   r = _do_truncate(txc, c, newo, 0);
   if (r < 0)
     goto out;
-  if (cct->_conf->bluestore_clone_cow) {
+  if (store_conf->bluestore_clone_cow) {
     _do_clone_range(txc, c, oldo, newo, 0, oldo->onode.size, 0);
   } else {
     bufferlist bl;
@@ -9596,10 +11019,10 @@ int BlueStore::_clone(TransContext *txc,
     if (!newo->onode.has_omap()) {
       newo->onode.set_omap_flag();
     }
-    KeyValueDB::Iterator it = db->get_iterator(PREFIX_OMAP);
     string head, tail;
     get_omap_header(oldo->onode.nid, &head);
     get_omap_tail(oldo->onode.nid, &tail);
+    KeyValueDB::Iterator it = db->get_iterator(PREFIX_OMAP, tail);
     it->lower_bound(head);
     while (it->valid()) {
       if (it->key() >= tail) {
@@ -9753,7 +11176,7 @@ int BlueStore::_clone_range(TransContext *txc,
   _assign_nid(txc, newo);
 
   if (length > 0) {
-    if (cct->_conf->bluestore_clone_cow) {
+    if (store_conf->bluestore_clone_cow) {
       _do_zero(txc, c, newo, dstoff, length);
       _do_clone_range(txc, c, oldo, newo, srcoff, length, dstoff);
     } else {
@@ -34,6 +34,8 @@
 #include "include/memory.h"
 #include "include/mempool.h"
 #include "common/Finisher.h"
+#include "common/config_snapshot.h"
+#include "common/Readahead.h"
 #include "common/perf_counters.h"
 #include "compressor/Compressor.h"
 #include "os/ObjectStore.h"
@@ -64,6 +66,9 @@ enum {
   l_bluestore_state_done_lat,
   l_bluestore_submit_lat,
   l_bluestore_commit_lat,
+  l_bluestore_kv_flush_lat,
+  l_bluestore_kv_commit_lat,
+  l_bluestore_kv_finalize_lat,
   l_bluestore_read_lat,
   l_bluestore_read_onode_meta_lat,
   l_bluestore_read_wait_flush_lat,
@@ -73,9 +78,12 @@ enum {
   l_bluestore_csum_lat,
   l_bluestore_compress_success_count,
   l_bluestore_compress_rejected_count,
+  l_bluestore_compress_backlog_skipped,
+  l_bluestore_compress_offloaded,
   l_bluestore_write_pad_bytes,
   l_bluestore_wal_write_ops,
   l_bluestore_wal_write_bytes,
+  l_bluestore_wal_batch_writes,
   l_bluestore_write_penalty_read_ops,
   l_bluestore_allocated,
   l_bluestore_stored,
@@ -93,6 +101,12 @@ enum {
   l_bluestore_buffer_bytes,
   l_bluestore_buffer_hit_bytes,
   l_bluestore_buffer_miss_bytes,
+  l_bluestore_readahead_bytes,
+  l_bluestore_readahead_hit_bytes,
+  l_bluestore_readahead_wasted_bytes,
+  l_bluestore_cache_autotune_meta_bytes,
+  l_bluestore_cache_autotune_data_bytes,
+  l_bluestore_cache_autotune_kv_bytes,
   l_bluestore_write_big,
   l_bluestore_write_big_bytes,
   l_bluestore_write_big_blobs,
@@ -110,12 +124,36 @@ enum {
 
   l_bluestore_txc,
   l_bluestore_onode_reshard,
+  l_bluestore_onode_unchanged,
   l_bluestore_blob_split,
   l_bluestore_extent_compress,
   l_bluestore_gc_merged,
+  l_bluestore_gc_relocated,
+  l_bluestore_fragmentation,
+  l_bluestore_state_lat_hist,
+  l_bluestore_commit_lat_bytes_hist,
   l_bluestore_last
 };
 
+/// options read per write or per transaction; see ConfigSnapshot
+struct BlueStoreConf {
+  bool bluestore_sync_submit_transaction;
+  int bluestore_debug_randomize_serial_transaction;
+  float bluestore_inject_wal_apply_delay;
+  uint64_t bluestore_wal_batch_max_ops;
+  uint64_t bluestore_wal_batch_max_bytes;
+  bool bluestore_default_buffered_write;
+  uint32_t bluestore_max_blob_size;
+  bool bluestore_clone_cow;
+  double bluestore_compression_required_ratio;
+  int bluestore_compression_max_queue;
+  int bluestore_gc_fragmented_blob_extents;
+  uint64_t bluestore_gc_fragmented_max_bytes;
+
+  explicit BlueStoreConf(const md_config_t *conf);
+  static const char *tracked_keys[];
+};
+
 class BlueStore : public ObjectStore,
 		  public md_config_obs_t {
   // -----------------------------------------------------
@@ -155,11 +193,12 @@ public:
     }
     enum {
       FLAG_NOCACHE = 1,  ///< trim when done WRITING (do not become CLEAN)
-      // NOTE: fix operator<< when you define a second flag
+      FLAG_READAHEAD = 2, ///< read ahead of demand, and not yet read since
     };
     static const char *get_flag_name(int s) {
       switch (s) {
       case FLAG_NOCACHE: return "nocache";
+      case FLAG_READAHEAD: return "readahead";
       default: return "???";
       }
     }
@@ -235,6 +274,8 @@ public:
     // few IOs in flight to the same Blob at the same time).
     state_list_t writing;   ///< writing buffers, sorted by seq, ascending
 
+    uint64_t write_gen = 0; ///< bumped on write/split; see did_readahead()
+
     ~BufferSpace() {
       assert(buffer_map.empty());
       assert(writing.empty());
@@ -256,6 +297,10 @@ public:
     void _rm_buffer(Cache* cache, map<uint32_t, std::unique_ptr<Buffer>>::iterator p) {
       assert(p != buffer_map.end());
       cache->_audit("_rm_buffer start");
+      if (p->second->flags & Buffer::FLAG_READAHEAD) {
+	cache->logger->inc(l_bluestore_readahead_wasted_bytes,
+			   p->second->length);
+      }
       if (p->second->is_writing()) {
         writing.erase(writing.iterator_to(*p->second));
       } else {
@@ -288,6 +333,7 @@ public:
 
     void write(Cache* cache, uint64_t seq, uint32_t offset, bufferlist& bl, unsigned flags) {
       std::lock_guard<std::recursive_mutex> l(cache->lock);
+      ++write_gen;
       Buffer *b = new Buffer(this, Buffer::STATE_WRITING, seq, offset, bl,
 			     flags);
       b->cache_private = _discard(cache, offset, bl.length());
@@ -300,6 +346,36 @@ public:
       b->cache_private = _discard(cache, offset, bl.length());
       _add_buffer(cache, b, 1, nullptr);
     }
+    /// install read-ahead data, unless the space was written since gen.
+    /// Only fills holes: an existing buffer may be newer than the disk.
+    bool did_readahead(Cache* cache, uint64_t gen, uint32_t offset,
+		       bufferlist& bl) {
+      std::lock_guard<std::recursive_mutex> l(cache->lock);
+      if (gen != write_gen) {
+	return false;
+      }
+      uint32_t end = offset + bl.length();
+      uint32_t pos = offset;
+      auto i = _data_lower_bound(offset);
+      while (pos < end) {
+	uint32_t hole_end = end;
+	if (i != buffer_map.end() && i->first < end) {
+	  if (i->first <= pos) {
+	    pos = std::min(end, i->first + i->second->length);
+	    ++i;
+	    continue;
+	  }
+	  hole_end = i->first;
+	}
+	bufferlist hole;
+	hole.substr_of(bl, pos - offset, hole_end - pos);
+	Buffer *b = new Buffer(this, Buffer::STATE_CLEAN, 0, pos, hole,
+			       Buffer::FLAG_READAHEAD);
+	_add_buffer(cache, b, 1, nullptr);
+	pos = hole_end;
+      }
+      return true;
+    }
 
     void read(Cache* cache, uint32_t offset, uint32_t length,
 	      BlueStore::ready_regions_t& res,
@@ -947,6 +1023,13 @@ public:
 
     ExtentMap extent_map;
 
+    /// sequential read detection; created on first read (under flush_lock)
+    std::unique_ptr<Readahead> readahead;
+
+    /// last value written under key, if sharded (so that a write that
+    /// only touched extent map shards need not rewrite the onode key)
+    bufferlist last_encoded;
+
     std::atomic<int> flushing_count = {0};
     std::mutex flush_lock;  ///< protect flush_txns
     std::condition_variable flush_cond;   ///< wait here for unapplied txns
@@ -983,7 +1066,7 @@ public:
     std::atomic<uint64_t> num_extents = {0};
     std::atomic<uint64_t> num_blobs = {0};
 
-    size_t last_trim_seq = 0;
+    std::atomic<size_t> last_trim_seq = {0};  ///< mempool_seq of last trim
 
     static Cache *create(CephContext* cct, string type, PerfCounters *logger);
 
@@ -1261,7 +1344,23 @@ public:
     //pool options
     pool_opts_t pool_opts;
 
+    // the pool's compression dictionaries, prepared for a compressor as
+    // they are first used
+    std::mutex compression_dict_lock;
+    map<uint32_t, bufferlist> compression_dicts;
+    map<pair<int, uint32_t>, Compressor::DictionaryRef> compression_dict_cache;
+
+    void set_pool_opts(const pool_opts_t& opts);
+    /// dictionary id for c, or the newest one if id is 0; null if none
+    Compressor::DictionaryRef get_compression_dict(CompressorRef& c,
+						   uint32_t id);
+
     OnodeRef get_onode(const ghobject_t& oid, bool create);
+    /// load the uncached onodes among oids with one batched kv lookup
+    void prefetch_onodes(const vector<ghobject_t>& oids);
+    Onode *_decode_onode(const ghobject_t& oid,
+			 const mempool::bluestore_meta_other::string& key,
+			 bufferlist& v);
 
     // the terminology is confusing here, sorry!
     //
@@ -1327,7 +1426,13 @@ public:
   class OpSequencer;
   typedef boost::intrusive_ptr<OpSequencer> OpSequencerRef;
 
-  struct TransContext {
+  /// something that can own an IOContext and be called back on aio completion
+  struct AioContext {
+    virtual void aio_finish(BlueStore *store) = 0;
+    virtual ~AioContext() {}
+  };
+
+  struct TransContext : public AioContext {
     typedef enum {
       STATE_PREPARE,
       STATE_AIO_WAIT,
@@ -1365,7 +1470,6 @@ public:
       return "???";
     }
 
-#if defined(WITH_LTTNG) && defined(WITH_EVENTTRACE)
     const char *get_state_latency_name(int state) {
       switch (state) {
       case l_bluestore_state_prepare_lat: return "prepare";
@@ -1383,21 +1487,25 @@ public:
       }
       return "???";
     }
-#endif
 
     void log_state_latency(PerfCounters *logger, int state) {
       utime_t lat, now = ceph_clock_now();
       lat = now - last_stamp;
       logger->tinc(state, lat);
+      logger->hinc(l_bluestore_state_lat_hist, lat.to_nsec(),
+		   state - l_bluestore_state_prepare_lat);
 #if defined(WITH_LTTNG) && defined(WITH_EVENTTRACE)
       if (state >= l_bluestore_state_prepare_lat && state <= l_bluestore_state_done_lat) {
         double usecs = (now.to_nsec()-last_stamp.to_nsec())/1000;
         OID_ELAPSED("", usecs, get_state_latency_name(state));
       }
 #endif
+      trace.event(get_state_latency_name(state), now);
       last_stamp = now;
     }
 
+    TraceSpan trace;  ///< finished with us
+
     OpSequencerRef osr;
     boost::intrusive::list_member_hook<> sequencer_item;
 
@@ -1468,8 +1576,26 @@ public:
           ::encode(values[i], bl);
         }
       }
+      volatile_statfs& operator+=(const volatile_statfs& o) {
+        for (size_t i = 0; i < STATFS_LAST; i++) {
+          values[i] += o.values[i];
+        }
+        return *this;
+      }
+      volatile_statfs& operator-=(const volatile_statfs& o) {
+        for (size_t i = 0; i < STATFS_LAST; i++) {
+          values[i] -= o.values[i];
+        }
+        return *this;
+      }
     } statfs_delta;
 
+    /// statfs_delta split by pool; the part of statfs_delta accrued since
+    /// statfs_pool_base is charged to statfs_pool on the next op/commit
+    map<int64_t,volatile_statfs> pool_statfs_delta;
+    volatile_statfs statfs_pool_base;
+    int64_t statfs_pool = -1;
+
 
     IOContext ioc;
     bool had_ios = false;  ///< true if we submitted IOs before our kv txn
@@ -1492,7 +1618,7 @@ public:
 	onreadable(NULL),
 	onreadable_sync(NULL),
 	wal_txn(NULL),
-	ioc(cct, this),
+	ioc(cct, static_cast<AioContext*>(this)),
 	start(ceph_clock_now()) {
         last_stamp = start;
     }
@@ -1500,6 +1626,10 @@ public:
       delete wal_txn;
     }
 
+    void aio_finish(BlueStore *store) override {
+      store->_txc_state_proc(this);
+    }
+
     void write_onode(OnodeRef &o) {
       onodes.insert(o);
     }
@@ -1517,6 +1647,49 @@ public:
     }
   };
 
+  /// wal writes from many txcs, merged by device offset and applied together
+  struct WALBatch : public AioContext {
+    deque<TransContext*> txcs;          ///< txcs whose wal ops we carry
+    map<uint64_t,bufferlist> extents;   ///< non-overlapping writes by offset
+    uint64_t num_ops = 0;               ///< wal ops folded into this batch
+    uint64_t bytes = 0;                 ///< bytes queued (before merging)
+    IOContext ioc;
+
+    explicit WALBatch(CephContext *cct)
+      : ioc(cct, static_cast<AioContext*>(this)) {}
+
+    /// add a write; it supersedes any previously queued overlapping data
+    void prepare_write(uint64_t offset, bufferlist& bl);
+
+    void aio_finish(BlueStore *store) override {
+      store->_wal_batch_finish(this);
+    }
+  };
+
+  /// an async read-ahead into the buffer cache
+  struct ReadaheadContext : public AioContext {
+    struct region_t {
+      BlobRef blob;
+      bluestore_blob_t csum;  ///< copy of blob csum state at issue time
+      uint64_t gen;           ///< BufferSpace::write_gen at issue time
+      uint64_t r_off;         ///< blob offset
+      bufferlist bl;
+      region_t(BlobRef b, uint64_t g, uint64_t o)
+	: blob(b), gen(g), r_off(o) {}
+    };
+    CollectionRef c;
+    OnodeRef o;
+    vector<region_t> regions;
+    IOContext ioc;
+
+    ReadaheadContext(CephContext *cct, CollectionRef c, OnodeRef o)
+      : c(c), o(o), ioc(cct, static_cast<AioContext*>(this)) {}
+
+    void aio_finish(BlueStore *store) override {
+      store->_readahead_finish(this);
+    }
+  };
+
   class OpSequencer : public Sequencer_impl {
   public:
     std::mutex qlock;
@@ -1673,6 +1846,81 @@ public:
     }
   };
 
+  /// blobs of a single _do_alloc_write being compressed on compress_tp
+  struct CompressBatch {
+    std::mutex lock;
+    std::condition_variable cond;
+    unsigned pending = 0;
+
+    void finish_one() {
+      std::lock_guard<std::mutex> l(lock);
+      assert(pending > 0);
+      if (--pending == 0)
+	cond.notify_all();
+    }
+    void wait() {
+      std::unique_lock<std::mutex> l(lock);
+      while (pending)
+	cond.wait(l);
+    }
+  };
+
+  struct CompressJob {
+    CompressBatch *batch = nullptr;
+    CompressorRef c;
+    Compressor::DictionaryRef dict;
+    bufferlist *in = nullptr;    ///< raw blob data (owned by the WriteContext)
+    bufferlist out;              ///< compressed payload (no header)
+    int r = -EAGAIN;             ///< -EAGAIN: not offloaded, do it inline
+  };
+
+  class CompressWQ : public ThreadPool::WorkQueue<CompressJob> {
+    BlueStore *store;
+    std::deque<CompressJob*> q;
+
+  public:
+    CompressWQ(BlueStore *s, time_t ti, time_t sti, ThreadPool *tp)
+      : ThreadPool::WorkQueue<CompressJob>("BlueStore::CompressWQ", ti, sti,
+					   tp),
+	store(s) {
+    }
+    bool _empty() {
+      return q.empty();
+    }
+    bool _enqueue(CompressJob *j) {
+      q.push_back(j);
+      return true;
+    }
+    void _dequeue(CompressJob *j) {
+      assert(0 == "not needed, not implemented");
+    }
+    CompressJob *_dequeue() {
+      if (q.empty())
+	return NULL;
+      CompressJob *j = q.front();
+      q.pop_front();
+      return j;
+    }
+    void _process(CompressJob *j, ThreadPool::TPHandle &) override {
+      store->_compress_job(j);
+    }
+    void _clear() {
+      assert(q.empty());
+    }
+  };
+
+  // the kv commit pipeline: kv_flush_thread gathers txcs and flushes the
+  // block device, kv_sync_thread submits and syncs the kv transactions,
+  // and kv_finalize_thread runs the post-commit state machine.  each stage
+  // works on the next batch while the following stage finishes the last.
+  struct KVFlushThread : public Thread {
+    BlueStore *store;
+    explicit KVFlushThread(BlueStore *s) : store(s) {}
+    void *entry() {
+      store->_kv_flush_thread();
+      return NULL;
+    }
+  };
   struct KVSyncThread : public Thread {
     BlueStore *store;
     explicit KVSyncThread(BlueStore *s) : store(s) {}
@@ -1681,6 +1929,71 @@ public:
       return NULL;
     }
   };
+  struct KVFinalizeThread : public Thread {
+    BlueStore *store;
+    explicit KVFinalizeThread(BlueStore *s) : store(s) {}
+    void *entry() {
+      store->_kv_finalize_thread();
+      return NULL;
+    }
+  };
+
+  // -- fsck --
+  struct fsck_sb_info_t {
+    list<ghobject_t> oids;
+    SharedBlobRef sb;
+    bluestore_extent_ref_map_t ref_map;
+    bool compressed;
+  };
+
+  /// what the fsck object walk accumulates (shared by fsck workers)
+  struct fsck_state_t {
+    bool deep = false;
+
+    std::mutex lock;  ///< protects everything below
+    boost::dynamic_bitset<> used_blocks;
+    map<uint64_t,fsck_sb_info_t> sb_info;
+    store_statfs_t expected_statfs;
+    uint64_t num_extents = 0;
+    uint64_t num_blobs = 0;
+    int errors = 0;
+
+    // work queue
+    std::condition_variable cond;
+    deque<pair<CollectionRef,OnodeRef>> q;
+    bool q_stop = false;
+  };
+
+  struct FsckThread : public Thread {
+    BlueStore *store;
+    fsck_state_t *st;
+    FsckThread(BlueStore *s, fsck_state_t *st) : store(s), st(st) {}
+    void *entry() {
+      store->_fsck_thread(st);
+      return NULL;
+    }
+  };
+
+  /// fsck progress, for the admin socket
+  struct fsck_progress_t {
+    std::atomic<bool> running = {false};
+    std::atomic<const char*> phase = {""};
+    std::atomic<uint64_t> objects = {0};  ///< objects checked
+    std::atomic<int> errors = {0};        ///< errors found so far
+    utime_t start;
+  } fsck_progress;
+
+  class SocketHook;
+  SocketHook *asok_hook = nullptr;
+  SocketHook *mount_asok_hook = nullptr;  ///< commands while mounted
+
+  /// a group of txcs moving through the kv commit pipeline together
+  struct KVBatch {
+    deque<TransContext*> committing;   ///< txcs committed by this batch
+    deque<TransContext*> submitting;   ///< subset the kv thread must submit
+    deque<TransContext*> wal_cleaning; ///< wal done, keys to remove
+    utime_t start;                     ///< when the batch was gathered
+  };
 
   struct DBHistogram {
     struct value_dist {
@@ -1736,24 +2049,43 @@ private:
   interval_set<uint64_t> bluefs_extents;  ///< block extents owned by bluefs
   interval_set<uint64_t> bluefs_extents_reclaiming; ///< currently reclaiming
 
-  std::mutex wal_lock;
+  std::mutex wal_lock;                       ///< protects wal_batch_*
   std::atomic<uint64_t> wal_seq = {0};
+  bool wal_batching = false;  ///< see config option bluestore_wal_batch
+  WALBatch *wal_batch_pending = nullptr;    ///< accumulating wal writes
+  WALBatch *wal_batch_running = nullptr;    ///< wal writes in flight
   ThreadPool wal_tp;
   WALWQ wal_wq;
 
-  int m_finisher_num;
-  vector<Finisher*> finishers;
+  ThreadPool compress_tp;
+  CompressWQ compress_wq;
+  std::atomic<unsigned> compress_queued = {0};  ///< jobs on compress_wq
+
+  std::mutex readahead_lock;                 ///< protects readahead_inflight
+  std::condition_variable readahead_cond;
+  unsigned readahead_inflight = 0;           ///< ReadaheadContexts in flight
 
+  FinisherPool finishers;  ///< completions, ordered per sequencer
+
+  KVFlushThread kv_flush_thread;
   KVSyncThread kv_sync_thread;
-  std::mutex kv_lock;
+  KVFinalizeThread kv_finalize_thread;
+  std::mutex kv_lock;                        ///< protects all kv queues below
   std::condition_variable kv_cond, kv_sync_cond;
+  std::condition_variable kv_flushed_cond;   ///< wakes kv_sync_thread
+  std::condition_variable kv_finalize_cond;  ///< wakes kv_finalize_thread
   bool kv_stop;
+  bool kv_sync_stop = false;
+  bool kv_finalize_stop = false;
+  unsigned kv_batches = 0;                   ///< batches in the pipeline
   deque<TransContext*> kv_queue;             ///< ready, already submitted
   deque<TransContext*> kv_queue_unsubmitted; ///< ready, need submit by kv thread
-  deque<TransContext*> kv_committing;        ///< currently syncing
   deque<TransContext*> wal_cleanup_queue;    ///< wal done, ready for cleanup
+  deque<KVBatch> kv_flushed;                 ///< bdev flushed, need kv commit
+  deque<KVBatch> kv_committed;               ///< kv committed, need finalize
 
   PerfCounters *logger;
+  ConfigSnapshot<BlueStoreConf> store_conf;
 
   std::mutex reap_lock;
   list<CollectionRef> removed_collections;
@@ -1774,6 +2106,7 @@ private:
   uint64_t max_alloc_size = 0; ///< maximum allocation unit (power of 2)
 
   bool sync_wal_apply;	  ///< see config option bluestore_sync_wal_apply
+  bool per_pool_stats = false;  ///< store maintains per-pool statfs records
 
   std::atomic<Compressor::CompressionMode> comp_mode = {Compressor::COMP_NONE}; ///< compression mode
   CompressorRef compressor;
@@ -1795,11 +2128,36 @@ private:
     *onodes = mempool_onodes;
   }
 
+  // cache budgets for the store as a whole (not per shard), maintained by
+  // MempoolThread when bluestore_cache_autotune is enabled.
+  std::atomic<uint64_t> cache_meta_target = {0};
+  std::atomic<uint64_t> cache_data_target = {0};
+
   struct MempoolThread : public Thread {
     BlueStore *store;
     Cond cond;
     Mutex lock;
     bool stop = false;
+
+    // cache autotuning state
+    enum {
+      CACHE_META = 0,
+      CACHE_DATA,
+      CACHE_KV,
+      CACHE_MAX
+    };
+    uint64_t last_hits[CACHE_MAX] = {0};
+    uint64_t last_misses[CACHE_MAX] = {0};
+    uint64_t cache_bytes[CACHE_MAX] = {0};
+    uint64_t cache_total = 0;   ///< current budget (<= bluestore_cache_size)
+    bool kv_cache = false;      ///< kv backend lets us resize its cache
+    utime_t next_autotune;
+    utime_t next_fragmentation;
+
+    void _autotune_init();
+    void _autotune();
+    void _sample_cache_hits(uint64_t *hits, uint64_t *misses);
+    void _apply_cache_targets();
   public:
     explicit MempoolThread(BlueStore *s)
       : store(s),
@@ -1839,8 +2197,11 @@ private:
   void _close_db();
   int _open_fm(bool create);
   void _close_fm();
-  int _open_alloc();
+  int _open_alloc(bool use_snapshot = false);
   void _close_alloc();
+  void _update_fragmentation();
+  void _save_alloc_snapshot();
+  int _load_alloc_snapshot(interval_set<uint64_t> *free);
   int _open_collections(int *errors=0);
   void _close_collections();
 
@@ -1862,6 +2223,7 @@ private:
   CollectionRef _get_collection(const coll_t& cid);
   void _queue_reap_collection(CollectionRef& c);
   void _reap_collections();
+  void _trim_cache_shard(Cache *cache);
   void _update_cache_logger();
 
   void _assign_nid(TransContext *txc, OnodeRef o);
@@ -1873,13 +2235,14 @@ private:
 
   TransContext *_txc_create(OpSequencer *osr);
   void _txc_update_store_statfs(TransContext *txc);
+  void _txc_charge_pool_statfs(TransContext *txc, const CollectionRef& c);
   void _txc_add_transaction(TransContext *txc, Transaction *t);
   void _txc_write_nodes(TransContext *txc, KeyValueDB::Transaction t);
   void _txc_state_proc(TransContext *txc);
   void _txc_aio_submit(TransContext *txc);
 public:
   void _txc_aio_finish(void *p) {
-    _txc_state_proc(static_cast<TransContext*>(p));
+    static_cast<AioContext*>(p)->aio_finish(this);
   }
 private:
   void _txc_finish_io(TransContext *txc);
@@ -1891,22 +2254,55 @@ private:
   void _osr_reap_done(OpSequencer *osr);
 
   void _kv_sync_thread();
+  void _kv_flush_thread();
+  void _kv_finalize_thread();
+  void _kv_start() {
+    // the kv threads mostly wait on the main device
+    std::set<int> cpus = bdev->get_affinity_cpus();
+    kv_flush_thread.set_affinity(cpus);
+    kv_sync_thread.set_affinity(cpus);
+    kv_finalize_thread.set_affinity(cpus);
+    kv_flush_thread.create("bstore_kv_flush");
+    kv_sync_thread.create("bstore_kv_sync");
+    kv_finalize_thread.create("bstore_kv_final");
+  }
   void _kv_stop() {
+    // the flush thread only exits once the whole pipeline is idle, so the
+    // later stages have nothing left to do when we stop them.
     {
       std::lock_guard<std::mutex> l(kv_lock);
       kv_stop = true;
       kv_cond.notify_all();
     }
+    kv_flush_thread.join();
+    {
+      std::lock_guard<std::mutex> l(kv_lock);
+      kv_sync_stop = true;
+      kv_flushed_cond.notify_all();
+    }
     kv_sync_thread.join();
+    {
+      std::lock_guard<std::mutex> l(kv_lock);
+      kv_finalize_stop = true;
+      kv_finalize_cond.notify_all();
+    }
+    kv_finalize_thread.join();
     {
       std::lock_guard<std::mutex> l(kv_lock);
       kv_stop = false;
+      kv_sync_stop = false;
+      kv_finalize_stop = false;
     }
   }
 
   bluestore_wal_op_t *_get_wal_op(TransContext *txc, OnodeRef o);
   int _wal_apply(TransContext *txc);
+
+  void _compress_job(CompressJob *j);
   int _wal_finish(TransContext *txc);
+  void _wal_queue_batch(TransContext *txc);
+  void _wal_submit_batch();
+  void _wal_batch_finish(WALBatch *b);
   int _do_wal_op(TransContext *txc, bluestore_wal_op_t& wo);
   int _wal_replay();
 
@@ -1916,6 +2312,9 @@ private:
     bool compressed,
     boost::dynamic_bitset<> &used_blocks,
     store_statfs_t& expected_statfs);
+  int _fsck_check_object(fsck_state_t *st, Collection *c, OnodeRef o);
+  void _fsck_thread(fsck_state_t *st);
+  void _fsck_set_phase(const char *phase);
 
   void _buffer_cache_write(
     TransContext *txc,
@@ -1967,6 +2366,10 @@ public:
   bool wants_journal() override { return false; };
   bool allows_journal() override { return false; };
 
+  bool has_builtin_csum() const override {
+    return csum_type != Checksummer::CSUM_NONE;
+  }
+
   static int get_block_device_fsid(CephContext* cct, const string& path,
 				   uuid_d *fsid);
 
@@ -2003,6 +2406,7 @@ public:
 
 public:
   int statfs(struct store_statfs_t *buf) override;
+  int pool_statfs(uint64_t pool_id, struct store_statfs_t *buf) override;
 
   bool exists(const coll_t& cid, const ghobject_t& oid) override;
   bool exists(CollectionHandle &c, const ghobject_t& oid) override;
@@ -2042,6 +2446,14 @@ public:
     size_t len,
     bufferlist& bl,
     uint32_t op_flags = 0);
+  void _do_readahead(
+    Collection *c,
+    OnodeRef o,
+    uint64_t offset,
+    size_t len,
+    uint32_t op_flags);
+  void _readahead_finish(ReadaheadContext *rctx);
+  void _wait_readahead();
 
   int fiemap(const coll_t& cid, const ghobject_t& oid,
 	     uint64_t offset, size_t len, bufferlist& bl) override;
@@ -2234,7 +2646,7 @@ private:
     uint64_t blob_xoffset,
     const bufferlist& bl,
     uint64_t logical_offset) const;
-  int _decompress(bufferlist& source, bufferlist* result);
+  int _decompress(Collection *c, bufferlist& source, bufferlist* result);
 
 
   // --------------------------------------------------------
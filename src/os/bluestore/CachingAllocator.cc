@@ -0,0 +1,268 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "CachingAllocator.h"
+#include "bluestore_types.h"
+#include "common/debug.h"
+
+#include <algorithm>
+#include <sched.h>
+#include <thread>
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_bluestore
+#undef dout_prefix
+#define dout_prefix *_dout << "cachingalloc "
+
+static unsigned num_shards(CephContext *cct)
+{
+  int n = cct->_conf->bluestore_allocator_cache_shards;
+  if (n <= 0)
+    n = std::thread::hardware_concurrency();
+  return std::max(n, 1);
+}
+
+CachingAllocator::CachingAllocator(CephContext* cct, Allocator *backend,
+				   int64_t block_size)
+  : cct(cct),
+    backend(backend),
+    block_size(block_size),
+    refill_bytes(P2ROUNDUP(cct->_conf->bluestore_allocator_cache_refill_bytes,
+			   (uint64_t)block_size)),
+    release_batch_bytes(cct->_conf->bluestore_allocator_cache_release_bytes),
+    shards(num_shards(cct))
+{
+  dout(10) << __func__ << " " << shards.size() << " shards, refill 0x"
+	   << std::hex << refill_bytes << " release batch 0x"
+	   << release_batch_bytes << std::dec << dendl;
+}
+
+CachingAllocator::~CachingAllocator()
+{
+}
+
+CachingAllocator::Shard& CachingAllocator::_get_shard()
+{
+#if defined(__linux__)
+  int cpu = sched_getcpu();
+  if (cpu >= 0)
+    return shards[cpu % shards.size()];
+#endif
+  return shards[std::hash<std::thread::id>()(std::this_thread::get_id()) %
+		shards.size()];
+}
+
+int CachingAllocator::reserve(uint64_t need)
+{
+  int64_t r = num_reserved.load();
+  do {
+    if ((int64_t)need > num_free.load() - r) {
+      dout(10) << __func__ << " need 0x" << std::hex << need
+	       << " num_free 0x" << num_free.load()
+	       << " num_reserved 0x" << r << std::dec << " -ENOSPC" << dendl;
+      return -ENOSPC;
+    }
+  } while (!num_reserved.compare_exchange_weak(r, r + need));
+  return 0;
+}
+
+void CachingAllocator::unreserve(uint64_t unused)
+{
+  int64_t r = num_reserved.fetch_sub(unused);
+  assert(r >= (int64_t)unused);
+}
+
+void CachingAllocator::_refill(Shard& s, uint64_t need)
+{
+  uint64_t want = std::max(refill_bytes, P2ROUNDUP(need, block_size));
+  if (backend->reserve(want) < 0) {
+    want = P2ROUNDUP(need, block_size);
+    if (backend->reserve(want) < 0)
+      return;
+  }
+  AllocExtentVector extents;
+  int64_t got = backend->allocate(want, block_size, want, 0, &extents);
+  if (got < (int64_t)want) {
+    backend->unreserve(want - std::max<int64_t>(got, 0));
+  }
+  for (auto& e : extents) {
+    s.free.push_back(e);
+    s.free_bytes += e.length;
+  }
+  dout(20) << __func__ << " got 0x" << std::hex << got << " now 0x"
+	   << s.free_bytes << std::dec << " in " << s.free.size()
+	   << " extents" << dendl;
+}
+
+void CachingAllocator::_flush_all()
+{
+  uint64_t stashed = 0, released = 0;
+  for (auto& s : shards) {
+    std::deque<AllocExtent> f;
+    std::vector<AllocExtent> r;
+    {
+      std::lock_guard<std::mutex> l(s.lock);
+      f.swap(s.free);
+      r.swap(s.released);
+      stashed += s.free_bytes;
+      released += s.released_bytes;
+      s.free_bytes = 0;
+      s.released_bytes = 0;
+    }
+    for (auto& e : f)
+      backend->release(e.offset, e.length);
+    for (auto& e : r)
+      backend->release(e.offset, e.length);
+  }
+  dout(10) << __func__ << " returned 0x" << std::hex << stashed
+	   << " stashed and 0x" << released << " released" << std::dec
+	   << dendl;
+}
+
+int64_t CachingAllocator::_backend_allocate(
+  uint64_t want_size, uint64_t alloc_unit, uint64_t max_alloc_size,
+  int64_t hint, AllocExtentVector *extents)
+{
+  if (backend->reserve(want_size) < 0) {
+    // the space may be parked in our shards
+    _flush_all();
+    if (backend->reserve(want_size) < 0)
+      return -ENOSPC;
+  }
+  int64_t got = backend->allocate(want_size, alloc_unit, max_alloc_size,
+				  hint, extents);
+  if (got < (int64_t)want_size) {
+    backend->unreserve(want_size - std::max<int64_t>(got, 0));
+  }
+  return got;
+}
+
+int64_t CachingAllocator::allocate(
+  uint64_t want_size,
+  uint64_t alloc_unit,
+  uint64_t max_alloc_size,
+  int64_t hint,
+  AllocExtentVector *extents)
+{
+  if (max_alloc_size == 0) {
+    max_alloc_size = want_size;
+  }
+  uint64_t got = 0;
+
+  if (alloc_unit == block_size && want_size % block_size == 0 &&
+      max_alloc_size >= block_size) {
+    uint64_t max = P2ALIGN(max_alloc_size, block_size);
+    ExtentList block_list(extents, 1, max);
+    Shard& s = _get_shard();
+    std::lock_guard<std::mutex> l(s.lock);
+    if (s.free_bytes < want_size) {
+      _refill(s, want_size - s.free_bytes);
+    }
+    while (got < want_size && !s.free.empty()) {
+      AllocExtent& e = s.free.front();
+      uint64_t len = std::min<uint64_t>({e.length, want_size - got, max});
+      block_list.add_extents(e.offset, len);
+      e.offset += len;
+      e.length -= len;
+      if (e.length == 0)
+	s.free.pop_front();
+      s.free_bytes -= len;
+      got += len;
+    }
+  }
+
+  if (got < want_size) {
+    AllocExtentVector more;
+    int64_t r = _backend_allocate(want_size - got, alloc_unit, max_alloc_size,
+				  hint, &more);
+    if (r > 0) {
+      extents->insert(extents->end(), more.begin(), more.end());
+      got += r;
+    }
+  }
+
+  dout(20) << __func__ << " want 0x" << std::hex << want_size
+	   << " got 0x" << got << std::dec << " in " << extents->size()
+	   << " extents" << dendl;
+  if (got == 0) {
+    return -ENOSPC;
+  }
+  num_free -= got;
+  num_reserved -= got;
+  return got;
+}
+
+int CachingAllocator::release(
+  uint64_t offset, uint64_t length)
+{
+  dout(10) << __func__ << " 0x" << std::hex << offset << "~" << length
+	   << std::dec << dendl;
+  std::vector<AllocExtent> batch;
+  {
+    Shard& s = _get_shard();
+    std::lock_guard<std::mutex> l(s.lock);
+    s.released.emplace_back(offset, length);
+    s.released_bytes += length;
+    if (s.released_bytes >= release_batch_bytes) {
+      batch.swap(s.released);
+      s.released_bytes = 0;
+    }
+  }
+  num_free += length;
+  for (auto& e : batch)
+    backend->release(e.offset, e.length);
+  return 0;
+}
+
+uint64_t CachingAllocator::get_free()
+{
+  return num_free;
+}
+
+int CachingAllocator::foreach_free(
+  std::function<void(uint64_t offset, uint64_t length)> notify)
+{
+  _flush_all();
+  return backend->foreach_free(notify);
+}
+
+double CachingAllocator::get_fragmentation(uint64_t alloc_unit)
+{
+  // stashed extents are contiguous runs by construction; only the
+  // backend's view is interesting
+  return backend->get_fragmentation(alloc_unit);
+}
+
+void CachingAllocator::dump()
+{
+  dout(0) << __func__ << " num_free 0x" << std::hex << num_free.load()
+	  << " num_reserved 0x" << num_reserved.load() << std::dec << dendl;
+  for (unsigned i = 0; i < shards.size(); ++i) {
+    Shard& s = shards[i];
+    std::lock_guard<std::mutex> l(s.lock);
+    dout(0) << __func__ << " shard " << i << " stashed 0x" << std::hex
+	    << s.free_bytes << " released 0x" << s.released_bytes << std::dec
+	    << dendl;
+  }
+  backend->dump();
+}
+
+void CachingAllocator::init_add_free(uint64_t offset, uint64_t length)
+{
+  backend->init_add_free(offset, length);
+  num_free += length;
+}
+
+void CachingAllocator::init_rm_free(uint64_t offset, uint64_t length)
+{
+  // the range may be sitting in a shard; give everything back first
+  _flush_all();
+  backend->init_rm_free(offset, length);
+  num_free -= length;
+}
+
+void CachingAllocator::shutdown()
+{
+  _flush_all();
+  backend->shutdown();
+}
@@ -0,0 +1,82 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_OS_BLUESTORE_CACHINGALLOCATOR_H
+#define CEPH_OS_BLUESTORE_CACHINGALLOCATOR_H
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include "Allocator.h"
+#include "os/bluestore/bluestore_types.h"
+
+/**
+ * Per-cpu front end for another Allocator.
+ *
+ * Each shard keeps a small stash of extents pre-allocated (in bulk) from
+ * the backing allocator and carves allocations out of it, so that the
+ * common case only touches a shard lock that is rarely contended.  Freed
+ * space is batched per shard and handed back to the backing allocator
+ * once enough has accumulated, or whenever the backing allocator runs
+ * dry.
+ *
+ * Only requests in units of the block_size given at create time are
+ * served from the stash; anything else goes straight to the backend.
+ * Allocation hints are ignored on the cached path.
+ */
+class CachingAllocator : public Allocator {
+  CephContext* cct;
+  std::unique_ptr<Allocator> backend;
+  uint64_t block_size;
+  uint64_t refill_bytes;         ///< bytes pulled from backend per refill
+  uint64_t release_batch_bytes;  ///< freed bytes buffered per shard
+
+  std::atomic<int64_t> num_free = {0};     ///< incl. stashed/batched space
+  std::atomic<int64_t> num_reserved = {0};
+
+  struct Shard {
+    std::mutex lock;
+    std::deque<AllocExtent> free;     ///< allocated from backend, unused
+    uint64_t free_bytes = 0;
+    std::vector<AllocExtent> released; ///< pending release to backend
+    uint64_t released_bytes = 0;
+  };
+  std::vector<Shard> shards;
+
+  Shard& _get_shard();
+  void _refill(Shard& s, uint64_t need);
+  void _flush_all();
+  int64_t _backend_allocate(uint64_t want_size, uint64_t alloc_unit,
+			    uint64_t max_alloc_size, int64_t hint,
+			    AllocExtentVector *extents);
+
+public:
+  CachingAllocator(CephContext* cct, Allocator *backend, int64_t block_size);
+  ~CachingAllocator();
+
+  int reserve(uint64_t need) override;
+  void unreserve(uint64_t unused) override;
+
+  int64_t allocate(
+    uint64_t want_size, uint64_t alloc_unit, uint64_t max_alloc_size,
+    int64_t hint, AllocExtentVector *extents) override;
+
+  int release(
+    uint64_t offset, uint64_t length) override;
+
+  uint64_t get_free() override;
+  int foreach_free(
+    std::function<void(uint64_t offset, uint64_t length)> notify) override;
+  double get_fragmentation(uint64_t alloc_unit) override;
+
+  void dump() override;
+
+  void init_add_free(uint64_t offset, uint64_t length) override;
+  void init_rm_free(uint64_t offset, uint64_t length) override;
+
+  void shutdown() override;
+};
+
+#endif
@@ -40,6 +40,11 @@ KernelDevice::KernelDevice(CephContext* cct, aio_callback_t cb, void *cbpriv)
     debug_lock("KernelDevice::debug_lock"),
     flush_lock("KernelDevice::flush_lock"),
     aio_queue(cct->_conf->bdev_aio_max_queue_depth),
+#if defined(HAVE_LIBURING)
+    ioring_queue(cct->_conf->bdev_aio_max_queue_depth,
+		 cct->_conf->bdev_ioring_hipri,
+		 cct->_conf->bdev_ioring_sqthread_poll),
+#endif
     aio_callback(cb),
     aio_callback_priv(cbpriv),
     aio_stop(false),
@@ -116,6 +121,8 @@ int KernelDevice::open(const string& p)
 
     rotational = block_device_is_rotational(path.c_str());
     size = s;
+    if (get_block_device_numa_node(path.c_str(), &numa_node) < 0)
+      numa_node = -1;
   } else {
     size = st.st_size;
     //regular file is rotational device
@@ -214,8 +221,29 @@ int KernelDevice::flush()
 
 int KernelDevice::_aio_start()
 {
+  aio_thread.set_affinity(get_affinity_cpus());
   if (aio) {
     dout(10) << __func__ << dendl;
+#if defined(HAVE_LIBURING)
+    if (cct->_conf->bdev_ioring) {
+      int r = -EOPNOTSUPP;
+      if (FS::ioring_queue_t::supported()) {
+	std::vector<int> fds = { fd_direct };
+	r = ioring_queue.init(fds);
+      }
+      if (r == 0) {
+	dout(1) << __func__ << " using io_uring"
+		<< (cct->_conf->bdev_ioring_hipri ? " (hipri)" : "")
+		<< (cct->_conf->bdev_ioring_sqthread_poll ? " (sqthread)" : "")
+		<< dendl;
+	ioring = true;
+	aio_thread.create("bstore_aio");
+	return 0;
+      }
+      derr << __func__ << " io_uring setup failed: " << cpp_strerror(r)
+	   << ", falling back to libaio" << dendl;
+    }
+#endif
     int r = aio_queue.init();
     if (r < 0) {
       derr << __func__ << " failed: " << cpp_strerror(r) << dendl;
@@ -233,6 +261,13 @@ void KernelDevice::_aio_stop()
     aio_stop = true;
     aio_thread.join();
     aio_stop = false;
+#if defined(HAVE_LIBURING)
+    if (ioring) {
+      ioring_queue.shutdown();
+      ioring = false;
+      return;
+    }
+#endif
     aio_queue.shutdown();
   }
 }
@@ -245,8 +280,15 @@ void KernelDevice::_aio_thread()
     dout(40) << __func__ << " polling" << dendl;
     int max = 16;
     FS::aio_t *aio[max];
-    int r = aio_queue.get_next_completed(cct->_conf->bdev_aio_poll_ms,
-					 aio, max);
+    int r;
+#if defined(HAVE_LIBURING)
+    if (ioring) {
+      r = ioring_queue.get_next_completed(cct->_conf->bdev_aio_poll_ms,
+					  aio, max);
+    } else
+#endif
+    r = aio_queue.get_next_completed(cct->_conf->bdev_aio_poll_ms,
+				     aio, max);
     if (r < 0) {
       derr << __func__ << " got " << cpp_strerror(r) << dendl;
     }
@@ -392,6 +434,29 @@ void KernelDevice::aio_submit(IOContext *ioc)
   ioc->num_pending -= pending;
   assert(ioc->num_pending.load() == 0);  // we should be only thread doing this
 
+#if defined(HAVE_LIBURING)
+  if (ioring) {
+    if (cct->_conf->bdev_debug_aio) {
+      std::lock_guard<std::mutex> l(debug_queue_lock);
+      for (list<FS::aio_t>::iterator q = p; q != e; ++q) {
+	debug_aio_link(*q);
+      }
+    }
+    // the whole batch goes to the kernel in a single io_uring_enter (or
+    // none at all, with sqthread polling); do not touch ioc afterwards.
+    int retries = 0;
+    int r = ioring_queue.submit_batch(p, e, static_cast<void*>(ioc),
+				      &retries);
+    if (retries)
+      derr << __func__ << " retries " << retries << dendl;
+    if (r < 0) {
+      derr << " io_uring submit got " << cpp_strerror(r) << dendl;
+      assert(r >= 0);
+    }
+    return;
+  }
+#endif
+
   bool done = false;
   while (!done) {
     FS::aio_t& aio = *p;
@@ -37,6 +37,10 @@ class KernelDevice : public BlockDevice {
   atomic_t io_since_flush;
 
   FS::aio_queue_t aio_queue;
+#if defined(HAVE_LIBURING)
+  FS::ioring_queue_t ioring_queue;
+  bool ioring = false;  ///< submit/reap through ioring_queue, not aio_queue
+#endif
   aio_callback_t aio_callback;
   void *aio_callback_priv;
   bool aio_stop;
@@ -25,6 +25,7 @@
 #include <chrono>
 #include <functional>
 #include <map>
+#include <memory>
 #include <thread>
 #include <xmmintrin.h>
 
@@ -75,6 +76,37 @@ enum {
 
 static void io_complete(void *t, const struct spdk_nvme_cpl *completion);
 
+static bool use_per_thread_qpair(const string& sn)
+{
+  if (!g_conf->bdev_nvme_per_thread_qpair)
+    return false;
+  if (!g_ceph_context->check_experimental_feature_enabled(
+        "bdev_nvme_per_thread_qpair")) {
+    derr << __func__ << " bdev_nvme_per_thread_qpair is experimental and"
+         << " not enabled; using the driver thread" << dendl;
+    return false;
+  }
+  return true;
+}
+
+static PerfCounters *create_logger(const string& name)
+{
+  PerfCountersBuilder b(g_ceph_context, name,
+                        l_bluestore_nvmedevice_first, l_bluestore_nvmedevice_last);
+  b.add_time_avg(l_bluestore_nvmedevice_aio_write_lat, "aio_write_lat", "Average write completing latency");
+  b.add_time_avg(l_bluestore_nvmedevice_read_lat, "read_lat", "Average read completing latency");
+  b.add_time_avg(l_bluestore_nvmedevice_flush_lat, "flush_lat", "Average flush completing latency");
+  b.add_u64(l_bluestore_nvmedevice_queue_ops, "queue_ops", "Operations in nvme queue");
+  b.add_time_avg(l_bluestore_nvmedevice_polling_lat, "polling_lat", "Average polling latency");
+  b.add_time_avg(l_bluestore_nvmedevice_aio_write_queue_lat, "aio_write_queue_lat", "Average queue write request latency");
+  b.add_time_avg(l_bluestore_nvmedevice_read_queue_lat, "read_queue_lat", "Average queue read request latency");
+  b.add_time_avg(l_bluestore_nvmedevice_flush_queue_lat, "flush_queue_lat", "Average queue flush request latency");
+  b.add_u64_counter(l_bluestore_nvmedevice_buffer_alloc_failed, "buffer_alloc_failed", "Alloc data buffer failed count");
+  PerfCounters *logger = b.create_perf_counters();
+  g_ceph_context->get_perfcounters_collection()->add(logger);
+  return logger;
+}
+
 int dpdk_thread_adaptor(void *f)
 {
   (*static_cast<std::function<void ()>*>(f))();
@@ -94,8 +126,12 @@ struct IORequest {
   void **extra_segs = nullptr;
 };
 
+class SharedDriverQueueData;
+
 struct Task {
   NVMEDevice *device;
+  SharedDriverQueueData *queue = nullptr;  // per thread qpair issued on, if any
+  std::vector<void*> *buf_pool = &data_buf_mempool;
   IOContext *ctx = nullptr;
   IOCommand command;
   uint64_t offset;
@@ -116,11 +152,11 @@ struct Task {
   void release_segs() {
     if (io_request.extra_segs) {
       for (uint16_t i = 0; i < io_request.nseg; i++)
-        data_buf_mempool.push_back(io_request.extra_segs[i]);
+        buf_pool->push_back(io_request.extra_segs[i]);
       delete io_request.extra_segs;
     } else if (io_request.nseg) {
       for (uint16_t i = 0; i < io_request.nseg; i++)
-        data_buf_mempool.push_back(io_request.inline_segs[i]);
+        buf_pool->push_back(io_request.inline_segs[i]);
     }
     io_request.nseg = 0;
   }
@@ -184,6 +220,7 @@ class SharedDriverData {
  public:
   std::atomic_ulong completed_op_seq, queue_op_seq;
   PerfCounters *logger = nullptr;
+  const bool per_thread_qpair;
 
   SharedDriverData(unsigned i, const std::string &sn_tag,
                    spdk_nvme_ctrlr *c, spdk_nvme_ns *ns)
@@ -196,38 +233,38 @@ class SharedDriverData {
         queue_lock("NVMEDevice::queue_lock"),
         flush_lock("NVMEDevice::flush_lock"),
         flush_waiters(0),
-        completed_op_seq(0), queue_op_seq(0) {
+        completed_op_seq(0), queue_op_seq(0),
+        per_thread_qpair(use_per_thread_qpair(sn_tag)) {
 
     sector_size = spdk_nvme_ns_get_sector_size(ns);
     block_size = std::max(CEPH_PAGE_SIZE, sector_size);
     size = ((uint64_t)sector_size) * spdk_nvme_ns_get_num_sectors(ns);
-    qpair = spdk_nvme_ctrlr_alloc_io_qpair(c, SPDK_NVME_QPRIO_URGENT);
 
-    PerfCountersBuilder b(g_ceph_context, string("NVMEDevice-AIOThread-"+stringify(this)),
-                          l_bluestore_nvmedevice_first, l_bluestore_nvmedevice_last);
-    b.add_time_avg(l_bluestore_nvmedevice_aio_write_lat, "aio_write_lat", "Average write completing latency");
-    b.add_time_avg(l_bluestore_nvmedevice_read_lat, "read_lat", "Average read completing latency");
-    b.add_time_avg(l_bluestore_nvmedevice_flush_lat, "flush_lat", "Average flush completing latency");
-    b.add_u64(l_bluestore_nvmedevice_queue_ops, "queue_ops", "Operations in nvme queue");
-    b.add_time_avg(l_bluestore_nvmedevice_polling_lat, "polling_lat", "Average polling latency");
-    b.add_time_avg(l_bluestore_nvmedevice_aio_write_queue_lat, "aio_write_queue_lat", "Average queue write request latency");
-    b.add_time_avg(l_bluestore_nvmedevice_read_queue_lat, "read_queue_lat", "Average queue read request latency");
-    b.add_time_avg(l_bluestore_nvmedevice_flush_queue_lat, "flush_queue_lat", "Average queue flush request latency");
-    b.add_u64_counter(l_bluestore_nvmedevice_buffer_alloc_failed, "buffer_alloc_failed", "Alloc data buffer failed count");
-    logger = b.create_perf_counters();
-    g_ceph_context->get_perfcounters_collection()->add(logger);
+    if (per_thread_qpair) {
+      // every submitting thread brings its own qpair and polls it
+      qpair = nullptr;
+      return;
+    }
+    qpair = spdk_nvme_ctrlr_alloc_io_qpair(c, SPDK_NVME_QPRIO_URGENT);
+    logger = create_logger("NVMEDevice-AIOThread-"+stringify(this));
     _aio_start();
   }
   ~SharedDriverData() {
-    g_ceph_context->get_perfcounters_collection()->remove(logger);
-    if (!qpair) {
+    if (logger) {
+      g_ceph_context->get_perfcounters_collection()->remove(logger);
+      delete logger;
+    }
+    if (qpair) {
       spdk_nvme_ctrlr_free_io_qpair(qpair); 
     }
-    delete logger;
   }
 
   bool is_equal(const string &tag) const { return sn == tag; }
   void register_device(NVMEDevice *device) {
+    if (per_thread_qpair) {
+      registered_devices.push_back(device);
+      return;
+    }
     // in case of registered_devices, we stop thread now.
     // Because release is really a rare case, we could bear this
     _aio_stop();
@@ -235,16 +272,30 @@ class SharedDriverData {
     _aio_start();
   }
   void remove_device(NVMEDevice *device) {
-    _aio_stop();
+    if (!per_thread_qpair)
+      _aio_stop();
     std::vector<NVMEDevice*> new_devices;
     for (auto &&it : registered_devices) {
       if (it != device)
         new_devices.push_back(it);
     }
     registered_devices.swap(new_devices);
-    _aio_start();
+    if (!per_thread_qpair)
+      _aio_start();
   }
 
+  const std::string &get_sn() const {
+    return sn;
+  }
+  spdk_nvme_ctrlr *get_ctrlr() {
+    return ctrlr;
+  }
+  spdk_nvme_ns *get_ns() {
+    return ns;
+  }
+  uint32_t get_sector_size() {
+    return sector_size;
+  }
   uint64_t get_block_size() {
     return block_size;
   }
@@ -340,7 +391,8 @@ static int alloc_buf_from_pool(Task *t, bool write)
   if (t->len % data_buffer_size)
     ++count;
   void **segs;
-  if (count > data_buf_mempool.size())
+  std::vector<void*> &pool = *t->buf_pool;
+  if (count > pool.size())
     return -ENOMEM;
   if (count <= inline_segment_num) {
     segs = t->io_request.inline_segs;
@@ -349,8 +401,8 @@ static int alloc_buf_from_pool(Task *t, bool write)
     segs = t->io_request.extra_segs;
   }
   for (uint16_t i = 0; i < count; i++) {
-    segs[i] = data_buf_mempool.back();
-    data_buf_mempool.pop_back();
+    segs[i] = pool.back();
+    pool.pop_back();
   }
   t->io_request.nseg = count;
   if (write) {
@@ -367,25 +419,121 @@ static int alloc_buf_from_pool(Task *t, bool write)
   return 0;
 }
 
-void SharedDriverData::_aio_thread()
+#undef dout_prefix
+#define dout_prefix *_dout << "bdev "
+
+/**
+ * Issue a task's command on qpair.
+ *
+ * @returns 0 if the command is in flight, -EAGAIN if there are no free
+ * data buffers for it yet; any other error was completed here
+ */
+static int issue_task(Task *t, spdk_nvme_ns *ns, spdk_nvme_qpair *qpair,
+                      uint32_t sector_size, PerfCounters *logger,
+                      ceph::coarse_real_clock::time_point start)
 {
-  dout(1) << __func__ << " start" << dendl;
+  int r = 0;
+  uint64_t lba_off = t->offset / sector_size;
+  uint64_t lba_count = t->len / sector_size;
+  ceph::coarse_real_clock::time_point cur;
+  switch (t->command) {
+    case IOCommand::WRITE_COMMAND:
+    {
+      dout(20) << __func__ << " write command issued " << lba_off << "~" << lba_count << dendl;
+      r = alloc_buf_from_pool(t, true);
+      if (r < 0) {
+        logger->inc(l_bluestore_nvmedevice_buffer_alloc_failed);
+        return -EAGAIN;
+      }
 
-  if (data_buf_mempool.empty()) {
-    for (uint16_t i = 0; i < data_buffer_default_num; i++) {
-      void *b = spdk_zmalloc(data_buffer_size, CEPH_PAGE_SIZE, NULL);
-      if (!b) {
-        derr << __func__ << " failed to create memory pool for nvme data buffer" << dendl;
-        assert(b);
+      r = spdk_nvme_ns_cmd_writev(
+          ns, qpair, lba_off, lba_count, io_complete, t, 0,
+          data_buf_reset_sgl, data_buf_next_sge);
+      if (r < 0) {
+        t->ctx->nvme_task_first = t->ctx->nvme_task_last = nullptr;
+        t->release_segs();
+        delete t;
+        derr << __func__ << " failed to do write command" << dendl;
+        ceph_abort();
       }
-      data_buf_mempool.push_back(b);
+      cur = ceph::coarse_real_clock::now();
+      auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(cur - start);
+      logger->tinc(l_bluestore_nvmedevice_aio_write_queue_lat, dur);
+      break;
     }
+    case IOCommand::READ_COMMAND:
+    {
+      dout(20) << __func__ << " read command issueed " << lba_off << "~" << lba_count << dendl;
+      r = alloc_buf_from_pool(t, false);
+      if (r < 0) {
+        logger->inc(l_bluestore_nvmedevice_buffer_alloc_failed);
+        return -EAGAIN;
+      }
+
+      r = spdk_nvme_ns_cmd_readv(
+          ns, qpair, lba_off, lba_count, io_complete, t, 0,
+          data_buf_reset_sgl, data_buf_next_sge);
+      if (r < 0) {
+        derr << __func__ << " failed to read" << dendl;
+        --t->ctx->num_reading;
+        t->return_code = r;
+        t->release_segs();
+        std::unique_lock<std::mutex> l(t->ctx->lock);
+        t->ctx->cond.notify_all();
+      } else {
+        cur = ceph::coarse_real_clock::now();
+        auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(cur - start);
+        logger->tinc(l_bluestore_nvmedevice_read_queue_lat, dur);
+      }
+      break;
+    }
+    case IOCommand::FLUSH_COMMAND:
+    {
+      dout(20) << __func__ << " flush command issueed " << dendl;
+      r = spdk_nvme_ns_cmd_flush(ns, qpair, io_complete, t);
+      if (r < 0) {
+        derr << __func__ << " failed to flush" << dendl;
+        t->return_code = r;
+        t->release_segs();
+        std::unique_lock<std::mutex> l(t->ctx->lock);
+        t->ctx->cond.notify_all();
+      } else {
+        cur = ceph::coarse_real_clock::now();
+        auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(cur - start);
+        logger->tinc(l_bluestore_nvmedevice_flush_queue_lat, dur);
+      }
+      break;
+    }
+  }
+  return r;
+}
+
+static void fill_data_buf_mempool(std::vector<void*> &pool,
+                                  size_t num = data_buffer_default_num)
+{
+  for (size_t i = 0; i < num; i++) {
+    void *b = spdk_zmalloc(data_buffer_size, CEPH_PAGE_SIZE, NULL);
+    if (!b) {
+      derr << __func__ << " failed to create memory pool for nvme data buffer" << dendl;
+      assert(b);
+    }
+    pool.push_back(b);
   }
+}
+
+#undef dout_prefix
+#define dout_prefix *_dout << "bdev(" << sn << ") "
+
+void SharedDriverData::_aio_thread()
+{
+  dout(1) << __func__ << " start" << dendl;
+
+  if (data_buf_mempool.empty())
+    fill_data_buf_mempool(data_buf_mempool);
 
   Task *t = nullptr;
   int r = 0;
   const int max = 4;
-  uint64_t lba_off, lba_count;
   ceph::coarse_real_clock::time_point cur, start
     = ceph::coarse_real_clock::now();
   while (true) {
@@ -399,78 +547,12 @@ void SharedDriverData::_aio_thread()
       }
     }
 
-    for (; t; t = t->next) {
-      lba_off = t->offset / sector_size;
-      lba_count = t->len / sector_size;
-      switch (t->command) {
-        case IOCommand::WRITE_COMMAND:
-        {
-          dout(20) << __func__ << " write command issued " << lba_off << "~" << lba_count << dendl;
-          r = alloc_buf_from_pool(t, true);
-          if (r < 0) {
-            logger->inc(l_bluestore_nvmedevice_buffer_alloc_failed);
-            goto again;
-          }
-
-          r = spdk_nvme_ns_cmd_writev(
-              ns, qpair, lba_off, lba_count, io_complete, t, 0,
-              data_buf_reset_sgl, data_buf_next_sge);
-          if (r < 0) {
-            t->ctx->nvme_task_first = t->ctx->nvme_task_last = nullptr;
-            t->release_segs();
-            delete t;
-            derr << __func__ << " failed to do write command" << dendl;
-            ceph_abort();
-          }
-          cur = ceph::coarse_real_clock::now();
-          auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(cur - start);
-          logger->tinc(l_bluestore_nvmedevice_aio_write_queue_lat, dur);
-          break;
-        }
-        case IOCommand::READ_COMMAND:
-        {
-          dout(20) << __func__ << " read command issueed " << lba_off << "~" << lba_count << dendl;
-          r = alloc_buf_from_pool(t, false);
-          if (r < 0) {
-            logger->inc(l_bluestore_nvmedevice_buffer_alloc_failed);
-            goto again;
-          }
-
-          r = spdk_nvme_ns_cmd_readv(
-              ns, qpair, lba_off, lba_count, io_complete, t, 0,
-              data_buf_reset_sgl, data_buf_next_sge);
-          if (r < 0) {
-            derr << __func__ << " failed to read" << dendl;
-            --t->ctx->num_reading;
-            t->return_code = r;
-            t->release_segs();
-            std::unique_lock<std::mutex> l(t->ctx->lock);
-            t->ctx->cond.notify_all();
-          } else {
-            cur = ceph::coarse_real_clock::now();
-            auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(cur - start);
-            logger->tinc(l_bluestore_nvmedevice_read_queue_lat, dur);
-          }
-          break;
-        }
-        case IOCommand::FLUSH_COMMAND:
-        {
-          dout(20) << __func__ << " flush command issueed " << dendl;
-          r = spdk_nvme_ns_cmd_flush(ns, qpair, io_complete, t);
-          if (r < 0) {
-            derr << __func__ << " failed to flush" << dendl;
-            t->return_code = r;
-            t->release_segs();
-            std::unique_lock<std::mutex> l(t->ctx->lock);
-            t->ctx->cond.notify_all();
-          } else {
-            cur = ceph::coarse_real_clock::now();
-            auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(cur - start);
-            logger->tinc(l_bluestore_nvmedevice_flush_queue_lat, dur);
-          }
-          break;
-        }
-      }
+    while (t) {
+      Task *next = t->next;
+      r = issue_task(t, ns, qpair, sector_size, logger, start);
+      if (r == -EAGAIN)
+        goto again;
+      t = next;
     }
 
     if (!queue_empty.load()) {
@@ -511,6 +593,110 @@ void SharedDriverData::_aio_thread()
   dout(1) << __func__ << " end" << dendl;
 }
 
+/*
+ * With bdev_nvme_per_thread_qpair, each thread that submits IO gets a
+ * qpair and data buffers of its own for each device it uses, issues its
+ * commands directly and polls for their completions before returning
+ * (run to completion).
+ * Nothing crosses threads or takes a lock on the way to the device, and
+ * completions are delivered through aio_callback from the submitting
+ * thread.
+ */
+class SharedDriverQueueData {
+  std::string sn;
+  spdk_nvme_ns *ns;
+  uint32_t sector_size;
+  struct spdk_nvme_qpair *qpair;
+  std::vector<void*> data_buf_mempool;
+
+ public:
+  uint32_t queue_depth = 0;  ///< commands in flight
+  PerfCounters *logger;
+
+  explicit SharedDriverQueueData(SharedDriverData *d)
+    : sn(d->get_sn()),
+      ns(d->get_ns()),
+      sector_size(d->get_sector_size()) {
+    qpair = spdk_nvme_ctrlr_alloc_io_qpair(d->get_ctrlr(), SPDK_NVME_QPRIO_URGENT);
+    if (!qpair) {
+      derr << __func__ << " failed to allocate io qpair" << dendl;
+      ceph_abort();
+    }
+    fill_data_buf_mempool(data_buf_mempool);
+    logger = create_logger("NVMEDevice-Queue-"+stringify(this));
+  }
+  ~SharedDriverQueueData() {
+    assert(!queue_depth);
+    g_ceph_context->get_perfcounters_collection()->remove(logger);
+    delete logger;
+    spdk_nvme_ctrlr_free_io_qpair(qpair);
+    for (auto b : data_buf_mempool)
+      spdk_free(b);
+  }
+
+  /// issue the tasks t->next..., and wait for all of them to complete
+  void aio_handle(NVMEDevice *bdev, Task *t);
+};
+
+// one per device a thread submits to; drivers live as long as the process
+static thread_local std::map<SharedDriverData*,
+                             std::unique_ptr<SharedDriverQueueData>> queue_t;
+
+static SharedDriverQueueData *get_queue(SharedDriverData *driver)
+{
+  auto &queue = queue_t[driver];
+  if (!queue)
+    queue.reset(new SharedDriverQueueData(driver));
+  return queue.get();
+}
+
+void SharedDriverQueueData::aio_handle(NVMEDevice *bdev, Task *t)
+{
+  dout(20) << __func__ << " start" << dendl;
+
+  ceph::coarse_real_clock::time_point start = ceph::coarse_real_clock::now();
+  while (t || queue_depth) {
+    if (queue_depth) {
+      int r = spdk_nvme_qpair_process_completions(qpair, 0);
+      if (r < 0) {
+        derr << __func__ << " failed to process completions: "
+             << cpp_strerror(r) << dendl;
+        ceph_abort();
+      } else if (r == 0) {
+        _mm_pause();
+      }
+    }
+
+    while (t) {
+      Task *next = t->next;
+      t->queue = this;
+      t->buf_pool = &data_buf_mempool;
+      int r = issue_task(t, ns, qpair, sector_size, logger, start);
+      if (r == -EAGAIN) {
+        if (queue_depth)
+          break;  // completions will free some buffers
+        // every buffer is back, and still not enough for this one
+        size_t need = (t->len + data_buffer_size - 1) / data_buffer_size;
+        assert(need > data_buf_mempool.size());
+        dout(1) << __func__ << " growing data buffer pool from "
+                << data_buf_mempool.size() << " to " << need << dendl;
+        fill_data_buf_mempool(data_buf_mempool, need - data_buf_mempool.size());
+        continue;
+      }
+      if (r == 0)
+        ++queue_depth;
+      t = next;
+    }
+    logger->set(l_bluestore_nvmedevice_queue_ops, queue_depth);
+  }
+
+  auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      ceph::coarse_real_clock::now() - start);
+  logger->tinc(l_bluestore_nvmedevice_polling_lat, dur);
+  bdev->reap_ioc();
+  dout(20) << __func__ << " end" << dendl;
+}
+
 #define dout_subsys ceph_subsys_bdev
 #undef dout_prefix
 #define dout_prefix *_dout << "bdev "
@@ -707,15 +893,21 @@ void io_complete(void *t, const struct spdk_nvme_cpl *completion)
 {
   Task *task = static_cast<Task*>(t);
   IOContext *ctx = task->ctx;
-  SharedDriverData *driver = task->device->get_driver();
-  ++driver->completed_op_seq;
+  PerfCounters *logger;
+  if (task->queue) {
+    --task->queue->queue_depth;
+    logger = task->queue->logger;
+  } else {
+    SharedDriverData *driver = task->device->get_driver();
+    ++driver->completed_op_seq;
+    logger = driver->logger;
+  }
   auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(
       ceph::coarse_real_clock::now() - task->start);
   if (task->command == IOCommand::WRITE_COMMAND) {
-    driver->logger->tinc(l_bluestore_nvmedevice_aio_write_lat, dur);
+    logger->tinc(l_bluestore_nvmedevice_aio_write_lat, dur);
     assert(!spdk_nvme_cpl_is_error(completion));
-    dout(20) << __func__ << " write/zero op successfully, left "
-             << driver->queue_op_seq - driver->completed_op_seq << dendl;
+    dout(20) << __func__ << " write/zero op successfully" << dendl;
     // check waiting count before doing callback (which may
     // destroy this ioc).
     if (ctx && !--ctx->num_running) {
@@ -727,7 +919,7 @@ void io_complete(void *t, const struct spdk_nvme_cpl *completion)
     task->release_segs();
     delete task;
   } else if (task->command == IOCommand::READ_COMMAND) {
-    driver->logger->tinc(l_bluestore_nvmedevice_read_lat, dur);
+    logger->tinc(l_bluestore_nvmedevice_read_lat, dur);
     --ctx->num_reading;
     assert(!spdk_nvme_cpl_is_error(completion));
     dout(20) << __func__ << " read op successfully" << dendl;
@@ -743,7 +935,7 @@ void io_complete(void *t, const struct spdk_nvme_cpl *completion)
     }
   } else {
     assert(task->command == IOCommand::FLUSH_COMMAND);
-    driver->logger->tinc(l_bluestore_nvmedevice_flush_lat, dur);
+    logger->tinc(l_bluestore_nvmedevice_flush_lat, dur);
     dout(20) << __func__ << " flush op successfully" << dendl;
     if (spdk_nvme_cpl_is_error(completion))
       task->return_code = -1; // FIXME
@@ -838,9 +1030,21 @@ void NVMEDevice::close()
   dout(1) << __func__ << " end" << dendl;
 }
 
+void NVMEDevice::_submit_task(Task *t, uint64_t ops)
+{
+  if (driver->per_thread_qpair)
+    get_queue(driver)->aio_handle(this, t);
+  else
+    driver->queue_task(t, ops);
+}
+
 int NVMEDevice::flush()
 {
   dout(10) << __func__ << " start" << dendl;
+  if (driver->per_thread_qpair) {
+    // writes completed before aio_submit() returned
+    return 0;
+  }
   auto start = ceph::coarse_real_clock::now();
   driver->flush_wait();
   auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(
@@ -860,9 +1064,10 @@ void NVMEDevice::aio_submit(IOContext *ioc)
     ioc->num_running += pending;
     ioc->num_pending -= pending;
     assert(ioc->num_pending.load() == 0);  // we should be only thread doing this
-    // Only need to push the first entry
-    driver->queue_task(t, pending);
+    // the ioc may be gone once the tasks complete
     ioc->nvme_task_first = ioc->nvme_task_last = nullptr;
+    // Only need to push the first entry
+    _submit_task(t, pending);
   }
 }
 
@@ -889,7 +1094,7 @@ int NVMEDevice::aio_write(
 
   if (buffered) {
     // Only need to push the first entry
-    driver->queue_task(t);
+    _submit_task(t);
   } else {
     t->ctx = ioc;
     Task *first = static_cast<Task*>(ioc->nvme_task_first);
@@ -927,7 +1132,7 @@ int NVMEDevice::read(uint64_t off, uint64_t len, bufferlist *pbl,
     t->copy_to_buf(buf, 0, t->len);
   };
   ++ioc->num_reading;
-  driver->queue_task(t);
+  _submit_task(t);
 
   {
     std::unique_lock<std::mutex> l(ioc->lock);
@@ -996,7 +1201,7 @@ int NVMEDevice::read_random(uint64_t off, uint64_t len, char *buf, bool buffered
     t->copy_to_buf(buf, off-t->offset, len);
   };
   ++ioc.num_reading;
-  driver->queue_task(t);
+  _submit_task(t);
 
   {
     std::unique_lock<std::mutex> l(ioc.lock);
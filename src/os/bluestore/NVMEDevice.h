@@ -198,6 +198,7 @@ class NVMEDevice : public BlockDevice {
   Task *buffered_task_head = nullptr;
 
   static void init();
+  void _submit_task(Task *t, uint64_t ops = 1);
  public:
   SharedDriverData *get_driver() { return driver; }
 
@@ -126,28 +126,43 @@ int64_t StupidAllocator::allocate_int(
     }
   }
 
-  // search down (hint)
-  if (hint) {
-    for (bin = orig_bin; bin >= 0; --bin) {
-      p = free[bin].lower_bound(hint);
-      while (p != free[bin].end()) {
-	if (aligned_len(p, alloc_unit) >= alloc_unit) {
-	  goto found;
+  {
+    // no single run fits; settle for pieces.  with
+    // bluestore_allocator_prefer_contiguous set, first look only for
+    // pieces of at least that many alloc units, then for anything.
+    uint64_t min_lens[2] = { alloc_unit, alloc_unit };
+    int64_t prefer = cct->_conf->bluestore_allocator_prefer_contiguous;
+    if (prefer > 1) {
+      min_lens[0] = MAX(alloc_unit, MIN(want_size, alloc_unit * prefer));
+    }
+    for (unsigned pass = (min_lens[0] > alloc_unit ? 0 : 1); pass < 2;
+	 ++pass) {
+      uint64_t min_len = min_lens[pass];
+
+      // search down (hint)
+      if (hint) {
+	for (bin = orig_bin; bin >= 0; --bin) {
+	  p = free[bin].lower_bound(hint);
+	  while (p != free[bin].end()) {
+	    if (aligned_len(p, alloc_unit) >= min_len) {
+	      goto found;
+	    }
+	    ++p;
+	  }
 	}
-	++p;
       }
-    }
-  }
 
-  // search down (from origin, and skip searched extents by hint)
-  for (bin = orig_bin; bin >= 0; --bin) {
-    p = free[bin].begin();
-    auto end = hint ? free[bin].lower_bound(hint) : free[bin].end();
-    while (p != end) {
-      if (aligned_len(p, alloc_unit) >= alloc_unit) {
-	goto found;
+      // search down (from origin, and skip searched extents by hint)
+      for (bin = orig_bin; bin >= 0; --bin) {
+	p = free[bin].begin();
+	auto end = hint ? free[bin].lower_bound(hint) : free[bin].end();
+	while (p != end) {
+	  if (aligned_len(p, alloc_unit) >= min_len) {
+	    goto found;
+	  }
+	  ++p;
+	}
       }
-      ++p;
     }
   }
 
@@ -256,6 +271,40 @@ uint64_t StupidAllocator::get_free()
   return num_free;
 }
 
+int StupidAllocator::foreach_free(
+  std::function<void(uint64_t offset, uint64_t length)> notify)
+{
+  std::lock_guard<std::mutex> l(lock);
+  // each bin is sorted, but together they aren't
+  btree_interval_set<uint64_t> all;
+  for (auto& f : free) {
+    for (auto p = f.begin(); p != f.end(); ++p) {
+      all.insert(p.get_start(), p.get_len());
+    }
+  }
+  for (auto p = all.begin(); p != all.end(); ++p) {
+    notify(p.get_start(), p.get_len());
+  }
+  return 0;
+}
+
+double StupidAllocator::get_fragmentation(uint64_t alloc_unit)
+{
+  std::lock_guard<std::mutex> l(lock);
+  uint64_t intervals = 0;
+  for (auto& f : free) {
+    intervals += f.num_intervals();
+  }
+  // best case all free space is one interval, worst case every
+  // alloc_unit is its own
+  uint64_t max_intervals = P2ROUNDUP((uint64_t)num_free, alloc_unit) /
+    alloc_unit;
+  if (intervals <= 1 || max_intervals <= 1)
+    return 0.0;
+  double res = (double)(intervals - 1) / (max_intervals - 1);
+  return MIN(res, 1.0);
+}
+
 void StupidAllocator::dump()
 {
   std::lock_guard<std::mutex> l(lock);
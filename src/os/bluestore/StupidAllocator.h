@@ -43,6 +43,9 @@ public:
     uint64_t offset, uint64_t length) override;
 
   uint64_t get_free() override;
+  int foreach_free(
+    std::function<void(uint64_t offset, uint64_t length)> notify) override;
+  double get_fragmentation(uint64_t alloc_unit) override;
 
   void dump() override;
 
@@ -64,13 +64,11 @@ public:
    */
   Mutex header_lock;
   Cond header_cond;
-  Cond map_header_cond;
 
   /**
    * Set of headers currently in use
    */
   set<uint64_t> in_use;
-  set<ghobject_t> map_header_in_use;
 
   /**
    * Takes the map_header_in_use entry in constructor, releases in
@@ -85,10 +83,11 @@ public:
   public:
     explicit MapHeaderLock(DBObjectMap *db) : db(db) {}
     MapHeaderLock(DBObjectMap *db, const ghobject_t &oid) : db(db), locked(oid) {
-      Mutex::Locker l(db->header_lock);
-      while (db->map_header_in_use.count(*locked))
-	db->map_header_cond.Wait(db->header_lock);
-      db->map_header_in_use.insert(*locked);
+      HeaderShard &s = db->get_header_shard(oid);
+      Mutex::Locker l(s.lock);
+      while (s.map_header_in_use.count(*locked))
+	s.cond.Wait(s.lock);
+      s.map_header_in_use.insert(*locked);
     }
 
     const ghobject_t &get_locked() const {
@@ -107,19 +106,29 @@ public:
 
     ~MapHeaderLock() {
       if (locked) {
-	Mutex::Locker l(db->header_lock);
-	assert(db->map_header_in_use.count(*locked));
-	db->map_header_cond.Signal();
-	db->map_header_in_use.erase(*locked);
+	HeaderShard &s = db->get_header_shard(*locked);
+	Mutex::Locker l(s.lock);
+	assert(s.map_header_in_use.count(*locked));
+	s.map_header_in_use.erase(*locked);
+	// the waiters may be after other objects of the shard
+	s.cond.SignalAll();
       }
     }
   };
 
   DBObjectMap(CephContext* cct, KeyValueDB *db)
-    : ObjectMap(cct), db(db), header_lock("DBOBjectMap"),
-      cache_lock("DBObjectMap::CacheLock"),
-      caches(cct->_conf->filestore_omap_header_cache_size)
-    {}
+    : ObjectMap(cct), db(db), header_lock("DBOBjectMap")
+  {
+    int num_shards = MAX(cct->_conf->filestore_omap_header_cache_shards, 1);
+    size_t cache_size = MAX(cct->_conf->filestore_omap_header_cache_size /
+			    num_shards, 1);
+    for (int i = 0; i < num_shards; ++i)
+      header_shards.push_back(new HeaderShard(cache_size));
+  }
+  ~DBObjectMap() override {
+    for (auto s : header_shards)
+      delete s;
+  }
 
   int set_keys(
     const ghobject_t &oid,
@@ -330,8 +339,26 @@ public:
 private:
   /// Implicit lock on Header->seq
   typedef ceph::shared_ptr<_Header> Header;
-  Mutex cache_lock;
-  SimpleLRU<ghobject_t, _Header> caches;
+
+  /**
+   * The objects whose map header is locked (@see MapHeaderLock), and
+   * the cached map headers, sharded by object so that omap ops on
+   * different objects don't wait on each other.
+   */
+  struct HeaderShard {
+    Mutex lock;
+    Cond cond;
+    set<ghobject_t> map_header_in_use;
+    SimpleLRU<ghobject_t, _Header> cache;
+
+    explicit HeaderShard(size_t cache_size)
+      : lock("DBObjectMap::HeaderShard::lock"), cache(cache_size) {}
+  };
+  vector<HeaderShard*> header_shards;
+
+  HeaderShard &get_header_shard(const ghobject_t &oid) {
+    return *header_shards[oid.hobj.get_hash() % header_shards.size()];
+  }
 
   string map_header_key(const ghobject_t &oid);
   string header_key(uint64_t seq);
@@ -461,16 +488,15 @@ private:
     return _generate_new_header(oid, parent);
   }
 
-  /// Lookup leaf header for c oid
-  Header _lookup_map_header(
+  /**
+   * Lookup leaf header for c oid
+   *
+   * The map header lock keeps it from changing, so it is read without
+   * header_lock.
+   */
+  Header lookup_map_header(
     const MapHeaderLock &l,
     const ghobject_t &oid);
-  Header lookup_map_header(
-    const MapHeaderLock &l2,
-    const ghobject_t &oid) {
-    Mutex::Locker l(header_lock);
-    return _lookup_map_header(l2, oid);
-  }
 
   /// Lookup header node for input
   Header lookup_parent(Header input);
@@ -524,7 +550,7 @@ private:
       Mutex::Locker l(db->header_lock);
       assert(db->in_use.count(header->seq));
       db->in_use.erase(header->seq);
-      db->header_cond.Signal();
+      db->header_cond.SignalAll();
       delete header;
     }
   };
@@ -1217,9 +1217,11 @@ void FileJournal::write_thread_entry()
       // wake when more data is queued.  this is not strictly correct,
       // but should be fine given that we will have plenty of aios in
       // flight if we hit this limit to ensure we keep the device
-      // saturated.
-      while (aio_num > 0) {
-	int exp = MIN(aio_num * 2, 24);
+      // saturated.  the first journal_aio_min_inflight aios go out as
+      // soon as there is anything to write.
+      int min_inflight = cct->_conf->journal_aio_min_inflight;
+      while (aio_num > 0 && aio_num >= min_inflight) {
+	int exp = MIN((aio_num - MAX(min_inflight - 1, 0)) * 2, 24);
 	long unsigned min_new = 1ull << exp;
 	uint64_t cur = aio_write_queue_bytes;
 	dout(20) << "write_thread_entry aio throttle: aio num " << aio_num << " bytes " << aio_bytes
@@ -231,4 +231,193 @@ int FS::aio_queue_t::get_next_completed(int timeout_ms, aio_t **paio, int max)
   }
   return r;
 }
+
+#if defined(HAVE_LIBURING)
+bool FS::ioring_queue_t::supported()
+{
+  struct io_uring ring;
+  int r = io_uring_queue_init(16, &ring, 0);
+  if (r < 0) {
+    return false;
+  }
+  io_uring_queue_exit(&ring);
+  return true;
+}
+
+int FS::ioring_queue_t::init(const std::vector<int>& _fds)
+{
+  assert(!ring_active);
+  unsigned flags = 0;
+  if (hipri) {
+    flags |= IORING_SETUP_IOPOLL;
+  }
+  if (sq_thread) {
+    flags |= IORING_SETUP_SQPOLL;
+  }
+  int r = io_uring_queue_init(max_iodepth, &ring, flags);
+  if (r < 0) {
+    return r;
+  }
+  fds = _fds;
+  r = io_uring_register_files(&ring, &fds[0], fds.size());
+  if (r < 0) {
+    io_uring_queue_exit(&ring);
+    fds.clear();
+    return r;
+  }
+  ring_active = true;
+  return 0;
+}
+
+void FS::ioring_queue_t::shutdown()
+{
+  if (ring_active) {
+    io_uring_unregister_files(&ring);
+    io_uring_queue_exit(&ring);
+    fds.clear();
+    ring_active = false;
+    inflight = 0;
+  }
+}
+
+int FS::ioring_queue_t::_fixed_fd(int fd) const
+{
+  for (unsigned i = 0; i < fds.size(); ++i) {
+    if (fds[i] == fd) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void FS::ioring_queue_t::_prep_sqe(struct io_uring_sqe *sqe, aio_t &aio)
+{
+  int fd = _fixed_fd(aio.fd);
+  if (aio.iocb.aio_lio_opcode == IO_CMD_PWRITEV) {
+    io_uring_prep_writev(sqe, fd >= 0 ? fd : aio.fd,
+			 &aio.iov[0], aio.iov.size(), aio.offset);
+  } else {
+    assert(aio.iocb.aio_lio_opcode == IO_CMD_PREAD);
+    io_uring_prep_read(sqe, fd >= 0 ? fd : aio.fd,
+		       aio.iocb.u.c.buf, aio.length, aio.offset);
+  }
+  if (fd >= 0) {
+    sqe->flags |= IOSQE_FIXED_FILE;
+  }
+  io_uring_sqe_set_data(sqe, &aio);
+}
+
+int FS::ioring_queue_t::submit_batch(std::list<aio_t>::iterator p,
+				     std::list<aio_t>::iterator end,
+				     void *priv,
+				     int *retries)
+{
+  // 2^16 * 125us = ~8 seconds, so max sleep is ~16 seconds
+  int attempts = 16;
+  int delay = 125;
+  int queued = 0;
+  std::lock_guard<std::mutex> l(sq_mutex);
+  while (p != end) {
+    // the cq is sized from max_iodepth, so do not let more than that be
+    // outstanding; hold the rest of the batch until the reaper catches up.
+    unsigned slots;
+    {
+      std::unique_lock<std::mutex> il(inflight_lock);
+      inflight_cond.wait(il, [this] { return inflight < max_iodepth; });
+      slots = max_iodepth - inflight;
+    }
+    // fill as much of the sq as we can, then kick it in one go.  note
+    // that nothing in [p, end) may be touched once the last sqe for
+    // this batch is submitted; it may complete (and be freed) at once.
+    unsigned prepped = 0;
+    while (p != end && prepped < slots) {
+      struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+      if (!sqe) {
+	break;
+      }
+      p->priv = priv;
+      _prep_sqe(sqe, *p);
+      ++p;
+      ++prepped;
+    }
+    if (prepped == 0) {
+      // sq full of entries the kernel has not consumed yet
+      int r = io_uring_submit(&ring);
+      if (r < 0) {
+	return r;
+      }
+      if (r == 0) {
+	if (attempts-- <= 0) {
+	  return -EAGAIN;
+	}
+	usleep(delay);
+	delay *= 2;
+	(*retries)++;
+      }
+      continue;
+    }
+    {
+      // account before the kernel sees them; they may be reaped at once
+      std::lock_guard<std::mutex> il(inflight_lock);
+      inflight += prepped;
+    }
+    while (true) {
+      int r = io_uring_submit(&ring);
+      if (r == -EAGAIN || r == -EBUSY) {
+	// completion ring overflow; give the reaper a moment
+	if (attempts-- > 0) {
+	  usleep(delay);
+	  delay *= 2;
+	  (*retries)++;
+	  continue;
+	}
+      }
+      if (r < 0) {
+	return r;
+      }
+      break;
+    }
+    queued += prepped;
+  }
+  return queued;
+}
+
+int FS::ioring_queue_t::get_next_completed(int timeout_ms, aio_t **paio,
+					   int max)
+{
+  struct io_uring_cqe *cqe = nullptr;
+  struct __kernel_timespec t = {
+    timeout_ms / 1000,
+    (timeout_ms % 1000) * 1000 * 1000
+  };
+
+  int r = 0;
+  do {
+    r = io_uring_wait_cqe_timeout(&ring, &cqe, &t);
+  } while (r == -EINTR);
+  if (r == -ETIME) {
+    return 0;
+  }
+  if (r < 0) {
+    return r;
+  }
+
+  // reap whatever else is already sitting on the cq without another
+  // trip into the kernel
+  struct io_uring_cqe *cqes[max];
+  unsigned n = io_uring_peek_batch_cqe(&ring, cqes, max);
+  for (unsigned i = 0; i < n; ++i) {
+    paio[i] = (aio_t *)io_uring_cqe_get_data(cqes[i]);
+    paio[i]->rval = cqes[i]->res;
+  }
+  io_uring_cq_advance(&ring, n);
+  if (n) {
+    std::lock_guard<std::mutex> il(inflight_lock);
+    assert(inflight >= n);
+    inflight -= n;
+    inflight_cond.notify_all();
+  }
+  return n;
+}
+#endif
 #endif
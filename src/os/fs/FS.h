@@ -22,8 +22,15 @@
 #ifdef HAVE_LIBAIO
 # include <libaio.h>
 #endif
+#ifdef HAVE_LIBURING
+# include <liburing.h>
+#endif
 
+#include <condition_variable>
+#include <list>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "include/types.h"
 #include "common/Mutex.h"
@@ -121,6 +128,67 @@ public:
     int submit(aio_t &aio, int *retries);
     int get_next_completed(int timeout_ms, aio_t **paio, int max);
   };
+
+#if defined(HAVE_LIBURING)
+  /**
+   * io_uring based queue
+   *
+   * Consumes the same aio_t's as aio_queue_t (the iocb is only used to
+   * remember the opcode and buffer), but a whole list of them is pushed
+   * onto the submission ring and handed to the kernel with a single
+   * io_uring_enter, and completions are reaped in batches straight off
+   * the completion ring.  The target fds are registered with the ring
+   * up front so the kernel need not take a file reference per io.
+   */
+  struct ioring_queue_t {
+    unsigned max_iodepth;
+    bool hipri;       ///< IORING_SETUP_IOPOLL; O_DIRECT only, busy polls
+    bool sq_thread;   ///< IORING_SETUP_SQPOLL; kernel thread drains the sq
+    struct io_uring ring;
+    bool ring_active;
+    std::vector<int> fds; ///< registered files; index is the fixed fd
+    std::mutex sq_mutex;  ///< serializes producers on the submission ring
+
+    /// ios handed to the kernel and not reaped yet; kept <= max_iodepth
+    std::mutex inflight_lock;
+    std::condition_variable inflight_cond;
+    unsigned inflight;
+
+    ioring_queue_t(unsigned max_iodepth, bool hipri, bool sq_thread)
+      : max_iodepth(max_iodepth),
+	hipri(hipri),
+	sq_thread(sq_thread),
+	ring_active(false),
+	inflight(0) {
+      memset(&ring, 0, sizeof(ring));
+    }
+    ~ioring_queue_t() {
+      assert(!ring_active);
+    }
+
+    /// probe whether the running kernel can give us a ring at all
+    static bool supported();
+
+    int init(const std::vector<int>& fds);
+    void shutdown();
+
+    /**
+     * submit [begin, end); returns number of aios queued or error
+     *
+     * At most max_iodepth aios are outstanding at once; the rest of the
+     * batch waits here for completions to be reaped.
+     */
+    int submit_batch(std::list<aio_t>::iterator begin,
+		     std::list<aio_t>::iterator end,
+		     void *priv,
+		     int *retries);
+    int get_next_completed(int timeout_ms, aio_t **paio, int max);
+
+  private:
+    int _fixed_fd(int fd) const;
+    void _prep_sqe(struct io_uring_sqe *sqe, aio_t &aio);
+  };
+#endif
 #endif
 };
 
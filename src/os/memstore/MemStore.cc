@@ -507,7 +507,8 @@ int MemStore::omap_get(
     return -ENOENT;
   std::lock_guard<std::mutex> lock(o->omap_mutex);
   *header = o->omap_header;
-  *out = o->omap;
+  for (auto& p : o->omap)
+    (*out)[p.first].append(p.second);
   return 0;
 }
 
@@ -546,10 +547,10 @@ int MemStore::omap_get_keys(
   if (!o)
     return -ENOENT;
   std::lock_guard<std::mutex> lock(o->omap_mutex);
-  for (map<string,bufferlist>::iterator p = o->omap.begin();
+  for (map<string,bufferptr>::iterator p = o->omap.begin();
        p != o->omap.end();
        ++p)
-    keys->insert(p->first);
+    keys->insert(keys->end(), p->first);
   return 0;
 }
 
@@ -572,9 +573,9 @@ int MemStore::omap_get_values(
   for (set<string>::const_iterator p = keys.begin();
        p != keys.end();
        ++p) {
-    map<string,bufferlist>::iterator q = o->omap.find(*p);
+    map<string,bufferptr>::iterator q = o->omap.find(*p);
     if (q != o->omap.end())
-      out->insert(*q);
+      (*out)[q->first].append(q->second);
   }
   return 0;
 }
@@ -598,7 +599,7 @@ int MemStore::omap_check_keys(
   for (set<string>::const_iterator p = keys.begin();
        p != keys.end();
        ++p) {
-    map<string,bufferlist>::iterator q = o->omap.find(*p);
+    map<string,bufferptr>::iterator q = o->omap.find(*p);
     if (q != o->omap.end())
       out->insert(*p);
   }
@@ -608,42 +609,44 @@ int MemStore::omap_check_keys(
 class MemStore::OmapIteratorImpl : public ObjectMap::ObjectMapIteratorImpl {
   CollectionRef c;
   ObjectRef o;
-  map<string,bufferlist>::iterator it;
+  map<string,bufferptr>::iterator it;
 public:
   OmapIteratorImpl(CollectionRef c, ObjectRef o)
     : c(c), o(o), it(o->omap.begin()) {}
 
   int seek_to_first() override {
-    std::lock_guard<std::mutex>(o->omap_mutex);
+    std::lock_guard<std::mutex> lock(o->omap_mutex);
     it = o->omap.begin();
     return 0;
   }
   int upper_bound(const string &after) override {
-    std::lock_guard<std::mutex>(o->omap_mutex);
+    std::lock_guard<std::mutex> lock(o->omap_mutex);
     it = o->omap.upper_bound(after);
     return 0;
   }
   int lower_bound(const string &to) override {
-    std::lock_guard<std::mutex>(o->omap_mutex);
+    std::lock_guard<std::mutex> lock(o->omap_mutex);
     it = o->omap.lower_bound(to);
     return 0;
   }
   bool valid() override {
-    std::lock_guard<std::mutex>(o->omap_mutex);
+    std::lock_guard<std::mutex> lock(o->omap_mutex);
     return it != o->omap.end();
   }
   int next(bool validate=true) override {
-    std::lock_guard<std::mutex>(o->omap_mutex);
+    std::lock_guard<std::mutex> lock(o->omap_mutex);
     ++it;
     return 0;
   }
   string key() override {
-    std::lock_guard<std::mutex>(o->omap_mutex);
+    std::lock_guard<std::mutex> lock(o->omap_mutex);
     return it->first;
   }
   bufferlist value() override {
-    std::lock_guard<std::mutex>(o->omap_mutex);
-    return it->second;
+    std::lock_guard<std::mutex> lock(o->omap_mutex);
+    bufferlist bl;
+    bl.append(it->second);
+    return bl;
   }
   int status() override {
     return 0;
@@ -1130,12 +1133,12 @@ int MemStore::_remove(const coll_t& cid, const ghobject_t& oid)
     return -ENOENT;
   RWLock::WLocker l(c->lock);
 
-  auto i = c->object_hash.find(oid);
-  if (i == c->object_hash.end())
+  auto i = c->object_map.find(oid);
+  if (i == c->object_map.end())
     return -ENOENT;
   used_bytes -= i->second->get_size();
-  c->object_hash.erase(i);
-  c->object_map.erase(oid);
+  c->_unindex_object(oid);
+  c->object_map.erase(i);
 
   return 0;
 }
@@ -1281,8 +1284,12 @@ int MemStore::_omap_setkeys(const coll_t& cid, const ghobject_t &oid,
   ::decode(num, p);
   while (num--) {
     string key;
+    __u32 len;
     ::decode(key, p);
-    ::decode(o->omap[key], p);
+    ::decode(len, p);
+    bufferptr& v = o->omap[key];
+    v = bufferptr();
+    p.copy_deep(len, v);
   }
   return 0;
 }
@@ -1323,8 +1330,8 @@ int MemStore::_omap_rmkeyrange(const coll_t& cid, const ghobject_t &oid,
   if (!o)
     return -ENOENT;
   std::lock_guard<std::mutex> lock(o->omap_mutex);
-  map<string,bufferlist>::iterator p = o->omap.lower_bound(first);
-  map<string,bufferlist>::iterator e = o->omap.lower_bound(last);
+  map<string,bufferptr>::iterator p = o->omap.lower_bound(first);
+  map<string,bufferptr>::iterator e = o->omap.lower_bound(last);
   o->omap.erase(p, e);
   return 0;
 }
@@ -1386,13 +1393,14 @@ int MemStore::_collection_add(const coll_t& cid, const coll_t& ocid, const ghobj
   RWLock::WLocker l1(MIN(&(*c), &(*oc))->lock);
   RWLock::WLocker l2(MAX(&(*c), &(*oc))->lock);
 
-  if (c->object_hash.count(oid))
+  if (c->object_map.count(oid))
     return -EEXIST;
-  if (oc->object_hash.count(oid) == 0)
+  auto p = oc->object_map.find(oid);
+  if (p == oc->object_map.end())
     return -ENOENT;
-  ObjectRef o = oc->object_hash[oid];
+  ObjectRef o = p->second;
   c->object_map[oid] = o;
-  c->object_hash[oid] = o;
+  c->_index_object(oid, o);
   return 0;
 }
 
@@ -1413,17 +1421,17 @@ int MemStore::_collection_move_rename(const coll_t& oldcid, const ghobject_t& ol
   c->lock.get_write();
 
   int r = -EEXIST;
-  if (c->object_hash.count(oid))
+  if (c->object_map.count(oid))
     goto out;
   r = -ENOENT;
-  if (oc->object_hash.count(oldoid) == 0)
+  if (oc->object_map.count(oldoid) == 0)
     goto out;
   {
-    ObjectRef o = oc->object_hash[oldoid];
+    ObjectRef o = oc->object_map[oldoid];
     c->object_map[oid] = o;
-    c->object_hash[oid] = o;
+    c->_index_object(oid, o);
     oc->object_map.erase(oldoid);
-    oc->object_hash.erase(oldoid);
+    oc->_unindex_object(oldoid);
   }
   r = 0;
  out:
@@ -1450,8 +1458,8 @@ int MemStore::_split_collection(const coll_t& cid, uint32_t bits, uint32_t match
     if (p->first.match(bits, match)) {
       dout(20) << " moving " << p->first << dendl;
       dc->object_map.insert(make_pair(p->first, p->second));
-      dc->object_hash.insert(make_pair(p->first, p->second));
-      sc->object_hash.erase(p->first);
+      dc->_index_object(p->first, p->second);
+      sc->_unindex_object(p->first);
       sc->object_map.erase(p++);
     } else {
       ++p;
@@ -1608,21 +1616,19 @@ thread_local PageSet::page_vector MemStore::PageSetObject::tls_pages;
 
 int MemStore::PageSetObject::read(uint64_t offset, uint64_t len, bufferlist& bl)
 {
-  const auto start = offset;
   const auto end = offset + len;
   auto remaining = len;
 
   DEFINE_PAGE_VECTOR(tls_pages);
   data.get_range(offset, len, tls_pages);
 
-  // allocate a buffer for the data
-  buffer::ptr buf(len);
-
+  // hand out the pages' data instead of copying it; a page is copied by
+  // the next write to it while we still hold it, see PageSet::alloc_range()
   auto p = tls_pages.begin();
   while (remaining) {
     // no more pages in range
     if (p == tls_pages.end() || (*p)->offset >= end) {
-      buf.zero(offset - start, remaining);
+      bl.append_zero(remaining);
       break;
     }
     auto page = *p;
@@ -1630,7 +1636,7 @@ int MemStore::PageSetObject::read(uint64_t offset, uint64_t len, bufferlist& bl)
     // fill any holes between pages with zeroes
     if (page->offset > offset) {
       const auto count = std::min(remaining, page->offset - offset);
-      buf.zero(offset - start, count);
+      bl.append_zero(count);
       remaining -= count;
       offset = page->offset;
       if (!remaining)
@@ -1641,7 +1647,7 @@ int MemStore::PageSetObject::read(uint64_t offset, uint64_t len, bufferlist& bl)
     const auto page_offset = offset - page->offset;
     const auto count = min(remaining, data.get_page_size() - page_offset);
 
-    buf.copy_in(offset - start, count, page->data + page_offset);
+    bl.append(page->buf, page_offset, count);
 
     remaining -= count;
     offset += count;
@@ -1650,8 +1656,6 @@ int MemStore::PageSetObject::read(uint64_t offset, uint64_t len, bufferlist& bl)
   }
 
   tls_pages.clear(); // drop page refs
-
-  bl.append(std::move(buf));
   return len;
 }
 
@@ -1787,6 +1791,9 @@ int MemStore::PageSetObject::truncate(uint64_t size)
   data.get_range(page_offset, page_size, tls_pages);
   if (tls_pages.empty())
     return 0;
+  tls_pages.clear();
+  // get it again to write, so it is copied if a reader holds it
+  data.alloc_range(size, page_offset + page_size - size, tls_pages);
 
   auto page = tls_pages.begin();
   auto data = (*page)->data;
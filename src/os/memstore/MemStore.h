@@ -16,6 +16,7 @@
 #ifndef CEPH_MEMSTORE_H
 #define CEPH_MEMSTORE_H
 
+#include <atomic>
 #include <mutex>
 #include <boost/intrusive_ptr.hpp>
 
@@ -36,7 +37,9 @@ public:
     std::mutex omap_mutex;
     map<string,bufferptr> xattr;
     bufferlist omap_header;
-    map<string,bufferlist> omap;
+    /// values are copied into a buffer of their own, so they don't pin
+    /// the message they came with, and never modified in place
+    map<string,bufferptr> omap;
 
     typedef boost::intrusive_ptr<Object> Ref;
     friend void intrusive_ptr_add_ref(Object *o) { o->get(); }
@@ -80,7 +83,7 @@ public:
       f->close_section();
 
       f->open_array_section("omap");
-      for (map<string,bufferlist>::const_iterator p = omap.begin();
+      for (map<string,bufferptr>::const_iterator p = omap.begin();
 	   p != omap.end();
 	   ++p) {
 	f->open_object_section("pair");
@@ -98,10 +101,19 @@ public:
     coll_t cid;
     CephContext *cct;
     bool use_page_set;
-    ceph::unordered_map<ghobject_t, ObjectRef> object_hash;  ///< for lookup
+
+    /// the lookup index, sharded by the high bits of the object hash (the
+    /// low bits are those of the pg) so lookups only take a spinlock on
+    /// their shard
+    static const unsigned OBJECT_SHARDS = 16;
+    struct ObjectShard {
+      Spinlock lock;
+      ceph::unordered_map<ghobject_t, ObjectRef> objects;
+    } object_shards[OBJECT_SHARDS];
+
     map<ghobject_t, ObjectRef> object_map;        ///< for iteration
     map<string,bufferptr> xattr;
-    RWLock lock;   ///< for object_{map,hash}
+    RWLock lock;   ///< for object_map, taken before a shard's lock
     bool exists;
 
     typedef boost::intrusive_ptr<Collection> Ref;
@@ -119,22 +131,44 @@ public:
     // reads and writes, so we will never see them concurrently at this
     // level.
 
-    ObjectRef get_object(ghobject_t oid) {
-      RWLock::RLocker l(lock);
-      auto o = object_hash.find(oid);
-      if (o == object_hash.end())
+    ObjectShard& get_shard(const ghobject_t& oid) {
+      return object_shards[oid.hobj.get_hash() >> 28];
+    }
+
+    ObjectRef get_object(const ghobject_t& oid) {
+      ObjectShard& shard = get_shard(oid);
+      std::lock_guard<Spinlock> l(shard.lock);
+      auto o = shard.objects.find(oid);
+      if (o == shard.objects.end())
 	return ObjectRef();
       return o->second;
     }
 
-    ObjectRef get_or_create_object(ghobject_t oid) {
+    ObjectRef get_or_create_object(const ghobject_t& oid) {
+      ObjectRef o = get_object(oid);
+      if (o)
+	return o;
       RWLock::WLocker l(lock);
-      auto result = object_hash.emplace(oid, ObjectRef());
-      if (result.second)
-        object_map[oid] = result.first->second = create_object();
+      auto result = object_map.emplace(oid, ObjectRef());
+      if (result.second) {
+	result.first->second = create_object();
+	_index_object(oid, result.first->second);
+      }
       return result.first->second;
     }
 
+    /// add to / remove from the lookup index, with lock held for write
+    void _index_object(const ghobject_t& oid, const ObjectRef& o) {
+      ObjectShard& shard = get_shard(oid);
+      std::lock_guard<Spinlock> l(shard.lock);
+      shard.objects[oid] = o;
+    }
+    void _unindex_object(const ghobject_t& oid) {
+      ObjectShard& shard = get_shard(oid);
+      std::lock_guard<Spinlock> l(shard.lock);
+      shard.objects.erase(oid);
+    }
+
     void encode(bufferlist& bl) const {
       ENCODE_START(1, 1, bl);
       ::encode(xattr, bl);
@@ -161,7 +195,7 @@ public:
 	auto o = create_object();
 	o->decode(p);
 	object_map.insert(make_pair(k, o));
-	object_hash.insert(make_pair(k, o));
+	_index_object(k, o);
       }
       DECODE_FINISH(p);
     }
@@ -197,7 +231,7 @@ private:
 
   Finisher finisher;
 
-  uint64_t used_bytes;
+  std::atomic<uint64_t> used_bytes;
 
   void _do_transaction(Transaction& t);
 
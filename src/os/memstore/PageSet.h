@@ -28,6 +28,9 @@
 
 
 struct Page {
+  // the data is handed out to readers as is, and copied before it is
+  // modified while one of them still holds it, see shared()
+  buffer::ptr buf;
   char *const data;
   boost::intrusive::avl_set_member_hook<> hook;
   uint64_t offset;
@@ -54,7 +57,7 @@ struct Page {
     }
   };
   void encode(bufferlist &bl, size_t page_size) const {
-    bl.append(buffer::copy(data, page_size));
+    bl.append(buf);
     ::encode(offset, bl);
   }
   void decode(bufferlist::iterator &p, size_t page_size) {
@@ -62,14 +65,13 @@ struct Page {
     ::decode(offset, p);
   }
 
+  /// whether anyone but us still references the data
+  bool shared() const {
+    return buf.raw_nref() > 1;
+  }
+
   static Ref create(size_t page_size, uint64_t offset = 0) {
-    // ensure proper alignment of the Page
-    const auto align = alignof(Page);
-    page_size = (page_size + align - 1) & ~(align - 1);
-    // allocate the Page and its data in a single buffer
-    auto buffer = new char[page_size + sizeof(Page)];
-    // place the Page structure at the end of the buffer
-    return new (buffer + page_size) Page(buffer, offset);
+    return new Page(buffer::create(page_size), offset);
   }
 
   // copy disabled
@@ -77,11 +79,8 @@ struct Page {
   const Page& operator=(const Page&) = delete;
 
  private: // private constructor, use create() instead
-  Page(char *data, uint64_t offset) : data(data), offset(offset), nrefs(1) {}
-
-  static void operator delete(void *p) {
-    delete[] reinterpret_cast<Page*>(p)->data;
-  }
+  Page(buffer::ptr&& buf, uint64_t offset)
+    : buf(std::move(buf)), data(this->buf.c_str()), offset(offset), nrefs(1) {}
 };
 
 class PageSet {
@@ -174,6 +173,14 @@ class PageSet {
         // zero front of page between page_offset and offset
         if (offset > page->offset)
           std::fill(page->data, page->data + offset - page->offset, 0);
+      } else if (insert.first->shared()) {
+        // a reader still holds the data, write to a copy of the page
+        Page *old = &*insert.first;
+        auto page = Page::create(page_size, page_offset);
+        std::copy(old->data, old->data + page_size, page->data);
+        pages.replace_node(insert.first, *page);
+        old->put();
+        cur = pages.iterator_to(*page);
       } else { // exists
         cur = insert.first;
       }
@@ -0,0 +1,130 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2004-2006 Sage Weil <sage@newdream.net>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <algorithm>
+
+#include "ClientThrottle.h"
+
+ClientThrottle::ClientThrottle(const std::string& n)
+  : lock("ClientThrottle::lock"),
+    op_tokens(-1),
+    byte_tokens(-1),
+    admitted_ops(0),
+    admitted_bytes(0),
+    delayed_ops(0),
+    name(n)
+{
+}
+
+void ClientThrottle::_refill(double op_rate, double byte_rate, double burst,
+			     utime_t now)
+{
+  double max_ops = std::max(1.0, op_rate * burst);
+  double max_bytes = byte_rate * burst;
+  if (last == utime_t()) {
+    // a new client starts with a full bucket
+    op_tokens = max_ops;
+    byte_tokens = max_bytes;
+  } else if (now > last) {
+    double dt = now - last;
+    op_tokens = std::min(max_ops, op_tokens + dt * op_rate);
+    byte_tokens = std::min(max_bytes, byte_tokens + dt * byte_rate);
+  }
+  last = now;
+}
+
+bool ClientThrottle::admit(double op_rate, double byte_rate, double burst,
+			   utime_t now, uint64_t len, utime_t *retry,
+			   utime_t *waited)
+{
+  Mutex::Locker l(lock);
+  _refill(op_rate, byte_rate, burst, now);
+
+  double wait = 0;
+  if (op_rate > 0 && op_tokens < 1)
+    wait = (1 - op_tokens) / op_rate;
+  if (byte_rate > 0 && byte_tokens <= 0)
+    wait = std::max(wait, (1 - byte_tokens) / byte_rate);
+  if (wait > 0) {
+    if (blocked_since == utime_t()) {
+      blocked_since = now;
+      ++delayed_ops;
+    }
+    *retry = now;
+    *retry += wait;
+    return false;
+  }
+
+  if (op_rate > 0)
+    op_tokens -= 1;
+  if (byte_rate > 0)
+    byte_tokens -= len;
+  ++admitted_ops;
+  admitted_bytes += len;
+  if (blocked_since != utime_t()) {
+    *waited = now - blocked_since;
+    blocked_since = utime_t();
+  }
+  return true;
+}
+
+void ClientThrottle::dump(Formatter *f)
+{
+  Mutex::Locker l(lock);
+  f->dump_string("client", name);
+  f->dump_float("op_tokens", op_tokens);
+  f->dump_float("byte_tokens", byte_tokens);
+  f->dump_unsigned("admitted_ops", admitted_ops);
+  f->dump_unsigned("admitted_bytes", admitted_bytes);
+  f->dump_unsigned("delayed_ops", delayed_ops);
+  f->dump_bool("blocked", blocked_since != utime_t());
+  if (blocked_since != utime_t())
+    f->dump_stream("blocked_since") << blocked_since;
+}
+
+ClientThrottleRef ClientThrottleMap::get(const std::string& key)
+{
+  Mutex::Locker l(lock);
+  auto p = throttles.find(key);
+  if (p != throttles.end()) {
+    ClientThrottleRef t = p->second.lock();
+    if (t)
+      return t;
+  }
+  // drop anything else nobody uses any more while we are here
+  for (auto q = throttles.begin(); q != throttles.end(); ) {
+    if (q->second.expired())
+      throttles.erase(q++);
+    else
+      ++q;
+  }
+  ClientThrottleRef t(new ClientThrottle(key));
+  throttles[key] = t;
+  return t;
+}
+
+void ClientThrottleMap::dump(Formatter *f)
+{
+  Mutex::Locker l(lock);
+  f->open_array_section("client_throttles");
+  for (auto& p : throttles) {
+    ClientThrottleRef t = p.second.lock();
+    if (!t)
+      continue;
+    f->open_object_section("throttle");
+    t->dump(f);
+    f->close_section();
+  }
+  f->close_section();
+}
@@ -0,0 +1,77 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2004-2006 Sage Weil <sage@newdream.net>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSD_CLIENTTHROTTLE_H
+#define CEPH_OSD_CLIENTTHROTTLE_H
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include "common/Formatter.h"
+#include "common/Mutex.h"
+#include "include/utime.h"
+
+/**
+ * Op and byte token buckets for one client: a session, or every
+ * session of an entity, depending on osd_client_throttle_policy.
+ *
+ * Buckets refill at the configured rates and hold at most burst
+ * seconds' worth.  An op needs one op token and a positive byte
+ * balance; its bytes are charged in full, so a large op can drive the
+ * balance negative and the client waits that debt off before its next
+ * op.  A rate of 0 leaves that dimension unthrottled.
+ */
+class ClientThrottle {
+  Mutex lock;
+  utime_t last;           ///< last refill
+  double op_tokens;
+  double byte_tokens;
+  utime_t blocked_since;  ///< when the op at the head started waiting
+  uint64_t admitted_ops, admitted_bytes, delayed_ops;
+
+  void _refill(double op_rate, double byte_rate, double burst, utime_t now);
+
+public:
+  const std::string name;
+
+  explicit ClientThrottle(const std::string& n);
+
+  /**
+   * charge an op of len bytes
+   *
+   * @param retry [out] when to try again, if it has to wait
+   * @param waited [out] how long it waited, once it is admitted
+   * @return true if it may go now
+   */
+  bool admit(double op_rate, double byte_rate, double burst,
+	     utime_t now, uint64_t len, utime_t *retry, utime_t *waited);
+
+  void dump(Formatter *f);
+};
+typedef std::shared_ptr<ClientThrottle> ClientThrottleRef;
+
+/// the live ClientThrottles, by key
+class ClientThrottleMap {
+  Mutex lock;
+  std::map<std::string, std::weak_ptr<ClientThrottle> > throttles;
+
+public:
+  ClientThrottleMap() : lock("ClientThrottleMap::lock") {}
+
+  ClientThrottleRef get(const std::string& key);
+  void dump(Formatter *f);
+};
+
+#endif
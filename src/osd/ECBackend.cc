@@ -23,6 +23,7 @@
 #include "messages/MOSDECSubOpRead.h"
 #include "messages/MOSDECSubOpReadReply.h"
 #include "ECMsgTypes.h"
+#include "common/Checksummer.h"
 
 #include "PrimaryLogPG.h"
 
@@ -90,6 +91,7 @@ ostream &operator<<(ostream &lhs, const ECBackend::read_request_t &rhs)
   return lhs << "read_request_t(to_read=[" << rhs.to_read << "]"
 	     << ", need=" << rhs.need
 	     << ", want_attrs=" << rhs.want_attrs
+	     << ", want_to_read=" << rhs.want_to_read
 	     << ")";
 }
 
@@ -154,8 +156,10 @@ ostream &operator<<(ostream &lhs, const ECBackend::Op &rhs)
       << " pending_apply=" << rhs.pending_apply
       << " pending_commit=" << rhs.pending_commit
       << " plan.to_read=" << rhs.plan.to_read
-      << " plan.will_write=" << rhs.plan.will_write
-      << ")";
+      << " plan.will_write=" << rhs.plan.will_write;
+  if (rhs.using_delta())
+    lhs << " delta_shards=" << rhs.plan.delta_shards;
+  lhs << ")";
   return lhs;
 }
 
@@ -172,6 +176,7 @@ ostream &operator<<(ostream &lhs, const ECBackend::RecoveryOp &rhs)
 	     << " state=" << ECBackend::RecoveryOp::tostr(rhs.state)
 	     << " waiting_on_pushes=" << rhs.waiting_on_pushes
 	     << " extent_requested=" << rhs.extent_requested
+	     << " read_in_flight=" << rhs.read_in_flight
 	     << ")";
 }
 
@@ -186,6 +191,7 @@ void ECBackend::RecoveryOp::dump(Formatter *f) const
   f->dump_stream("state") << tostr(state);
   f->dump_stream("waiting_on_pushes") << waiting_on_pushes;
   f->dump_stream("extent_requested") << extent_requested;
+  f->dump_bool("read_in_flight", read_in_flight);
 }
 
 ECBackend::ECBackend(
@@ -197,6 +203,7 @@ ECBackend::ECBackend(
   ErasureCodeInterfaceRef ec_impl,
   uint64_t stripe_width)
   : PGBackend(cct, pg, store, coll, ch),
+    osd_is_remote_epoch(0),
     ec_impl(ec_impl),
     sinfo(ec_impl->get_data_chunk_count(), stripe_width) {
   assert((ec_impl->get_data_chunk_count() *
@@ -244,6 +251,7 @@ struct OnRecoveryReadComplete :
       hoid,
       res.returned.back(),
       res.attrs,
+      res.subchunks,
       in.first);
   }
 };
@@ -254,21 +262,26 @@ struct RecoveryMessages {
   void read(
     ECBackend *ec,
     const hobject_t &hoid, uint64_t off, uint64_t len,
-    const set<pg_shard_t> &need,
+    const map<pg_shard_t, vector<pair<int, int> > > &need,
     bool attrs) {
     list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
     to_read.push_back(boost::make_tuple(off, len, 0));
     assert(!reads.count(hoid));
+    set<pg_shard_t> shards;
+    for (auto &&i : need)
+      shards.insert(i.first);
     reads.insert(
       make_pair(
 	hoid,
 	ECBackend::read_request_t(
 	  to_read,
-	  need,
+	  shards,
 	  attrs,
 	  new OnRecoveryReadComplete(
 	    ec,
-	    hoid))));
+	    hoid),
+	  set<int>(),
+	  need)));
   }
 
   map<pg_shard_t, vector<PushOp> > pushes;
@@ -377,6 +390,7 @@ void ECBackend::handle_recovery_read_complete(
   const hobject_t &hoid,
   boost::tuple<uint64_t, uint64_t, map<pg_shard_t, bufferlist> > &to_read,
   boost::optional<map<string, bufferlist> > attrs,
+  const map<int, vector<pair<int, int> > > &subchunks,
   RecoveryMessages *m)
 {
   dout(10) << __func__ << ": returned " << hoid << " "
@@ -388,6 +402,7 @@ void ECBackend::handle_recovery_read_complete(
   assert(recovery_ops.count(hoid));
   RecoveryOp &op = recovery_ops[hoid];
   assert(op.returned_data.empty());
+  op.read_in_flight = false;
   map<int, bufferlist*> target;
   for (set<shard_id_t>::iterator i = op.missing_on_shards.begin();
        i != op.missing_on_shards.end();
@@ -401,7 +416,7 @@ void ECBackend::handle_recovery_read_complete(
     from[i->first.shard].claim(i->second);
   }
   dout(10) << __func__ << ": " << from << dendl;
-  int r = ECUtil::decode(sinfo, ec_impl, from, target);
+  int r = ECUtil::decode(sinfo, ec_impl, from, target, subchunks);
   assert(r == 0);
   if (attrs) {
     op.xattrs.swap(*attrs);
@@ -517,6 +532,41 @@ void ECBackend::dispatch_recovery_messages(RecoveryMessages &m, int priority)
     false, true);
 }
 
+int ECBackend::start_recovery_read(
+  RecoveryOp &op,
+  RecoveryMessages *m)
+{
+  set<int> want(op.missing_on_shards.begin(), op.missing_on_shards.end());
+  uint64_t from = op.recovery_progress.data_recovered_to;
+  uint64_t amount = get_recovery_chunk_size();
+
+  map<pg_shard_t, vector<pair<int, int> > > to_read;
+  int r;
+  if (ec_impl->get_sub_chunk_count() > 1) {
+    r = get_min_avail_to_read_sub_chunks(op.hoid, want, &to_read);
+  } else {
+    set<pg_shard_t> shards;
+    r = get_min_avail_to_read_shards(
+      op.hoid, want, true, false, &shards);
+    vector<pair<int, int> > all(1, make_pair(0, 1));
+    for (auto &&i : shards)
+      to_read[i] = all;
+  }
+  if (r != 0)
+    return r;
+  m->read(
+    this,
+    op.hoid,
+    from,
+    amount,
+    to_read,
+    op.recovery_progress.first && !op.obc);
+  op.extent_requested = make_pair(
+    from,
+    amount);
+  return 0;
+}
+
 void ECBackend::continue_recovery_op(
   RecoveryOp &op,
   RecoveryMessages *m)
@@ -528,9 +578,6 @@ void ECBackend::continue_recovery_op(
       // start read
       op.state = RecoveryOp::READING;
       assert(!op.recovery_progress.data_complete);
-      set<int> want(op.missing_on_shards.begin(), op.missing_on_shards.end());
-      uint64_t from = op.recovery_progress.data_recovered_to;
-      uint64_t amount = get_recovery_chunk_size();
 
       if (op.recovery_progress.first && op.obc) {
 	/* We've got the attrs and the hinfo, might as well use them */
@@ -540,10 +587,7 @@ void ECBackend::continue_recovery_op(
 	::encode(*(op.hinfo), op.xattrs[ECUtil::get_hinfo_key()]);
       }
 
-      set<pg_shard_t> to_read;
-      int r = get_min_avail_to_read_shards(
-	op.hoid, want, true, false, &to_read);
-      if (r != 0) {
+      if (start_recovery_read(op, m) != 0) {
 	// we must have lost a recovery source
 	assert(!op.recovery_progress.first);
 	dout(10) << __func__ << ": canceling recovery op for obj " << op.hoid
@@ -552,16 +596,6 @@ void ECBackend::continue_recovery_op(
 	recovery_ops.erase(op.hoid);
 	return;
       }
-      m->read(
-	this,
-	op.hoid,
-	op.recovery_progress.data_recovered_to,
-	amount,
-	to_read,
-	op.recovery_progress.first && !op.obc);
-      op.extent_requested = make_pair(
-	from,
-	amount);
       dout(10) << __func__ << ": IDLE return " << op << dendl;
       return;
     }
@@ -618,6 +652,13 @@ void ECBackend::continue_recovery_op(
       op.returned_data.clear();
       op.waiting_on_pushes = op.missing_on;
       op.recovery_progress = after_progress;
+      if (!op.recovery_progress.data_complete &&
+	  cct->_conf->osd_ec_recovery_read_ahead) {
+	// overlap the next read with these pushes; if a source is gone,
+	// IDLE will notice once they are acked
+	if (start_recovery_read(op, m) == 0)
+	  op.read_in_flight = true;
+      }
       dout(10) << __func__ << ": READING return " << op << dendl;
       return;
     }
@@ -645,6 +686,17 @@ void ECBackend::continue_recovery_op(
 	  dout(10) << __func__ << ": WRITING return " << op << dendl;
 	  recovery_ops.erase(op.hoid);
 	  return;
+	} else if (op.read_in_flight) {
+	  op.state = RecoveryOp::READING;
+	  dout(10) << __func__ << ": WRITING return, reading ahead " << op
+		   << dendl;
+	  return;
+	} else if (!op.returned_data.empty()) {
+	  // the read ahead finished before the pushes
+	  op.state = RecoveryOp::READING;
+	  dout(10) << __func__ << ": WRITING continue, read ahead " << op
+		   << dendl;
+	  continue;
 	} else {
 	  op.state = RecoveryOp::IDLE;
 	  dout(10) << __func__ << ": WRITING continue " << op << dendl;
@@ -949,6 +1001,7 @@ void ECBackend::handle_sub_read(
       ++i) {
     int r = 0;
     ECUtil::HashInfoRef hinfo;
+    auto subchunks = op.subchunks.find(i->first);
     if (!get_parent()->get_pool().is_hacky_ecoverwrites()) {
       hinfo = get_hash_info(i->first);
       if (!hinfo) {
@@ -960,13 +1013,36 @@ void ECBackend::handle_sub_read(
     }
     for (auto j = i->second.begin(); j != i->second.end(); ++j) {
       bufferlist bl;
-      r = store->read(
-	ch,
-	ghobject_t(i->first, ghobject_t::NO_GEN, shard),
-	j->get<0>(),
-	j->get<1>(),
-	bl, j->get<2>(),
-	true); // Allow EIO return
+      if (subchunks == op.subchunks.end()) {
+	r = store->read(
+	  ch,
+	  ghobject_t(i->first, ghobject_t::NO_GEN, shard),
+	  j->get<0>(),
+	  j->get<1>(),
+	  bl, j->get<2>(),
+	  true); // Allow EIO return
+      } else {
+	// only the asked for sub-chunks of each chunk
+	uint64_t chunk_size = sinfo.get_chunk_size();
+	uint64_t sc_size = chunk_size / ec_impl->get_sub_chunk_count();
+	for (uint64_t off = j->get<0>();
+	     r >= 0 && off < j->get<0>() + j->get<1>();
+	     off += chunk_size) {
+	  for (auto &&k : subchunks->second) {
+	    bufferlist sub;
+	    r = store->read(
+	      ch,
+	      ghobject_t(i->first, ghobject_t::NO_GEN, shard),
+	      off + k.first * sc_size,
+	      k.second * sc_size,
+	      sub, j->get<2>(),
+	      true); // Allow EIO return
+	    if (r < 0)
+	      break;
+	    bl.claim_append(sub);
+	  }
+	}
+      }
       if (r < 0) {
 	get_parent()->clog_error() << __func__
 				   << ": Error " << r
@@ -989,8 +1065,10 @@ void ECBackend::handle_sub_read(
 	// are read in sections, so the digest check here won't be done here.
 	// Do NOT check osd_read_eio_on_bad_digest here.  We need to report
 	// the state of our chunk in case other chunks could substitute.
-	assert(hinfo->has_chunk_hash());
-	if ((bl.length() == hinfo->get_total_chunk_size()) &&
+	// Without shard hashes (osd_ec_rely_on_store_csum) the store has
+	// already verified what it returned.
+	if (hinfo->has_chunk_hash() &&
+	    (bl.length() == hinfo->get_total_chunk_size()) &&
 	    (j->get<0>() == 0)) {
 	  dout(20) << __func__ << ": Checking hash of " << i->first << dendl;
 	  bufferhash h(-1);
@@ -1133,6 +1211,14 @@ void ECBackend::handle_sub_read_reply(
   assert(siter->second.count(op.tid));
   siter->second.erase(op.tid);
 
+  map<pg_shard_t, utime_t>::iterator sent = rop.sent.find(from);
+  if (sent != rop.sent.end()) {
+    uint64_t lat = (ceph_clock_now() - sent->second).to_nsec() / 1000;
+    uint64_t &avg = osd_read_latency[from.osd];
+    avg = avg ? (avg * 7 + lat) / 8 : lat;
+    rop.sent.erase(sent);
+  }
+
   assert(rop.in_progress.count(from));
   rop.in_progress.erase(from);
   unsigned is_complete = 0;
@@ -1153,7 +1239,11 @@ void ECBackend::handle_sub_read_reply(
         dout(20) << __func__ << " have shard=" << j->first.shard << dendl;
       }
       set<int> want_to_read, dummy_minimum;
-      get_want_to_read_shards(&want_to_read);
+      auto req = rop.to_read.find(iter->first);
+      if (req != rop.to_read.end() && !req->second.want_to_read.empty())
+	want_to_read = req->second.want_to_read;
+      else
+	get_want_to_read_shards(&want_to_read);
       int err;
       if ((err = ec_impl->minimum_to_decode(want_to_read, have, &dummy_minimum)) < 0) {
 	dout(20) << __func__ << " minimum_to_decode failed" << dendl;
@@ -1214,6 +1304,8 @@ void ECBackend::complete_read_op(ReadOp &rop, RecoveryMessages *m)
   assert(rop.to_read.size() == rop.complete.size());
   for (; reqiter != rop.to_read.end(); ++reqiter, ++resiter) {
     if (reqiter->second.cb) {
+      for (auto &&i : reqiter->second.subchunks)
+	resiter->second.subchunks[i.first.shard] = i.second;
       pair<RecoveryMessages *, read_result_t &> arg(
 	m, resiter->second);
       reqiter->second.cb->complete(arg);
@@ -1329,6 +1421,8 @@ void ECBackend::on_change()
   completed_to = eversion_t();
   committed_to = eversion_t();
   pipeline_state.clear();
+  delta_objects.clear();
+  num_discarding = 0;
   waiting_reads.clear();
   waiting_state.clear();
   waiting_commit.clear();
@@ -1336,6 +1430,7 @@ void ECBackend::on_change()
     cache.release_write_pin(op.second.pin);
   }
   tid_to_op_map.clear();
+  cache.drop_retained();
 
   for (map<ceph_tid_t, ReadOp>::iterator i = tid_to_read_map.begin();
        i != tid_to_read_map.end();
@@ -1435,18 +1530,14 @@ void ECBackend::call_write_ordered(std::function<void(void)> &&cb) {
   }
 }
 
-int ECBackend::get_min_avail_to_read_shards(
+void ECBackend::get_all_avail_shards(
   const hobject_t &hoid,
-  const set<int> &want,
   bool for_recovery,
-  bool do_redundant_reads,
-  set<pg_shard_t> *to_read)
+  set<int> *_have,
+  map<shard_id_t, pg_shard_t> *_shards)
 {
-  // Make sure we don't do redundant reads for recovery
-  assert(!for_recovery || !do_redundant_reads);
-
-  set<int> have;
-  map<shard_id_t, pg_shard_t> shards;
+  set<int> &have = *_have;
+  map<shard_id_t, pg_shard_t> &shards = *_shards;
 
   for (set<pg_shard_t>::const_iterator i =
 	 get_parent()->get_acting_shards().begin();
@@ -1498,12 +1589,115 @@ int ECBackend::get_min_avail_to_read_shards(
       }
     }
   }
+}
+
+bool ECBackend::is_remote_osd(int osd)
+{
+  OSDMapRef osdmap = get_osdmap();
+  if (osd_is_remote_epoch != osdmap->get_epoch()) {
+    osd_is_remote.clear();
+    osd_is_remote_epoch = osdmap->get_epoch();
+  }
+  map<int, bool>::iterator p = osd_is_remote.find(osd);
+  if (p != osd_is_remote.end())
+    return p->second;
+
+  bool remote = false;
+  const map<string,string> &profile = osdmap->get_erasure_code_profile(
+    get_parent()->get_pool().erasure_code_profile);
+  map<string,string>::const_iterator locality =
+    profile.find("ruleset-locality");
+  if (locality != profile.end() && osd != get_parent()->whoami()) {
+    map<string,string> mine =
+      osdmap->crush->get_full_location(get_parent()->whoami());
+    map<string,string> theirs = osdmap->crush->get_full_location(osd);
+    map<string,string>::iterator m = mine.find(locality->second);
+    map<string,string>::iterator t = theirs.find(locality->second);
+    remote = m == mine.end() || t == theirs.end() || m->second != t->second;
+  }
+  osd_is_remote[osd] = remote;
+  return remote;
+}
+
+void ECBackend::get_shard_read_costs(
+  const set<int> &have,
+  map<shard_id_t, pg_shard_t> &shards,
+  map<int, int> *costs)
+{
+  // in usec: the measured read latency of the osd, plus a fixed
+  // penalty for crossing into another ruleset-locality bucket
+  for (set<int>::const_iterator i = have.begin(); i != have.end(); ++i) {
+    int osd = shards[shard_id_t(*i)].osd;
+    map<int, uint64_t>::iterator lat = osd_read_latency.find(osd);
+    uint64_t cost = lat == osd_read_latency.end() ? 0 : lat->second;
+    if (is_remote_osd(osd))
+      cost += cct->_conf->osd_ec_remote_locality_cost;
+    (*costs)[*i] = MIN(cost, (uint64_t)INT_MAX);
+  }
+  dout(20) << __func__ << " " << *costs << dendl;
+}
+
+int ECBackend::get_min_avail_to_read_shards(
+  const hobject_t &hoid,
+  const set<int> &want,
+  bool for_recovery,
+  bool do_redundant_reads,
+  set<pg_shard_t> *to_read)
+{
+  // Make sure we don't do redundant reads for recovery
+  assert(!for_recovery || !do_redundant_reads);
 
+  set<int> have;
+  map<shard_id_t, pg_shard_t> shards;
+  get_all_avail_shards(hoid, for_recovery, &have, &shards);
+
+  bool locality_aware = cct->_conf->osd_ec_locality_aware_reads &&
+    !do_redundant_reads;
   set<int> need;
-  int r = ec_impl->minimum_to_decode(want, have, &need);
+  int r;
+  if (locality_aware) {
+    map<int, int> costs;
+    get_shard_read_costs(have, shards, &costs);
+    r = ec_impl->minimum_to_decode_with_cost(want, costs, &need);
+  } else {
+    r = ec_impl->minimum_to_decode(want, have, &need);
+  }
   if (r < 0)
     return r;
 
+  if (for_recovery && cct->_conf->osd_ec_recovery_balance_reads &&
+      need.size() >= ec_impl->get_data_chunk_count()) {
+    // minimum_to_decode() favours the lowest shards; instead take the
+    // sources with the fewest reads outstanding, ties rotated by the
+    // object hash so that a batch of objects spreads over all of them.
+    // Sources in our ruleset-locality bucket go first.
+    unsigned n = ec_impl->get_chunk_count();
+    unsigned rot = hoid.get_hash() % n;
+    vector<pair<pair<pair<bool, size_t>, unsigned>, int> > by_load;
+    for (set<int>::iterator i = have.begin(); i != have.end(); ++i) {
+      pg_shard_t from = shards[shard_id_t(*i)];
+      map<pg_shard_t, set<ceph_tid_t> >::iterator p =
+	shard_to_read_map.find(from);
+      size_t load = p == shard_to_read_map.end() ? 0 : p->second.size();
+      bool remote = locality_aware && is_remote_osd(from.osd);
+      by_load.push_back(
+	make_pair(make_pair(make_pair(remote, load), (*i + n - rot) % n), *i));
+    }
+    sort(by_load.begin(), by_load.end());
+    set<int> cheapest;
+    for (unsigned i = 0; i < by_load.size(); ++i) {
+      cheapest.insert(by_load[i].second);
+      if (cheapest.size() < need.size())
+	continue;
+      set<int> balanced;
+      if (ec_impl->minimum_to_decode(want, cheapest, &balanced) == 0) {
+	if (balanced.size() <= need.size())
+	  need.swap(balanced);
+	break;
+      }
+    }
+  }
+
   if (do_redundant_reads) {
       need.swap(have);
   } 
@@ -1520,6 +1714,29 @@ int ECBackend::get_min_avail_to_read_shards(
   return 0;
 }
 
+int ECBackend::get_min_avail_to_read_sub_chunks(
+  const hobject_t &hoid,
+  const set<int> &want,
+  map<pg_shard_t, vector<pair<int, int> > > *to_read)
+{
+  set<int> have;
+  map<shard_id_t, pg_shard_t> shards;
+  get_all_avail_shards(hoid, true, &have, &shards);
+
+  map<int, vector<pair<int, int> > > need;
+  int r = ec_impl->minimum_to_decode_sub_chunks(want, have, &need);
+  if (r < 0)
+    return r;
+
+  for (map<int, vector<pair<int, int> > >::iterator i = need.begin();
+       i != need.end();
+       ++i) {
+    assert(shards.count(shard_id_t(i->first)));
+    (*to_read)[shards[shard_id_t(i->first)]] = i->second;
+  }
+  return 0;
+}
+
 int ECBackend::get_remaining_shards(
   const hobject_t &hoid,
   const set<int> &avail,
@@ -1586,6 +1803,7 @@ void ECBackend::do_read_op(ReadOp &op)
   dout(10) << __func__ << ": starting read " << op << dendl;
 
   map<pg_shard_t, ECSubRead> messages;
+  int sub_chunk_count = ec_impl->get_sub_chunk_count();
   for (map<hobject_t, read_request_t>::iterator i = op.to_read.begin();
        i != op.to_read.end();
        ++i) {
@@ -1597,6 +1815,11 @@ void ECBackend::do_read_op(ReadOp &op)
 	messages[*j].attrs_to_read.insert(i->first);
 	need_attrs = false;
       }
+      auto sub = i->second.subchunks.find(*j);
+      if (sub != i->second.subchunks.end() &&
+	  !(sub->second.size() == 1 &&
+	    sub->second.front().second == sub_chunk_count))
+	messages[*j].subchunks[i->first] = sub->second;
       op.obj_to_source[i->first].insert(*j);
       op.source_to_obj[*j].insert(i->first);
     }
@@ -1619,10 +1842,12 @@ void ECBackend::do_read_op(ReadOp &op)
     }
   }
 
+  utime_t now = ceph_clock_now();
   for (map<pg_shard_t, ECSubRead>::iterator i = messages.begin();
        i != messages.end();
        ++i) {
     op.in_progress.insert(i->first);
+    op.sent[i->first] = now;
     shard_to_read_map[i->first].insert(op.tid);
     i->second.tid = tid;
     MOSDECSubOpRead *msg = new MOSDECSubOpRead;
@@ -1694,6 +1919,24 @@ ECUtil::HashInfoRef ECBackend::get_hash_info(
   return ref;
 }
 
+bool ECBackend::rely_on_store_csum() const
+{
+  if (!cct->_conf->osd_ec_rely_on_store_csum)
+    return false;
+  // the pool can turn the store's checksums off
+  int csum_type = 0;
+  if (get_parent()->get_pool().opts.get(pool_opts_t::CSUM_TYPE, &csum_type) &&
+      csum_type == Checksummer::CSUM_NONE)
+    return false;
+  // every shard, not just ours, has to be on a store that checksums it
+  OSDMapRef osdmap = get_osdmap();
+  for (auto &&i : get_parent()->get_actingbackfill_shards()) {
+    if (!osdmap->get_xinfo(i.osd).store_csum)
+      return false;
+  }
+  return true;
+}
+
 void ECBackend::start_rmw(Op *op, PGTransactionUPtr &&t)
 {
   assert(op);
@@ -1735,6 +1978,20 @@ bool ECBackend::try_state_to_reads()
     return false;
   }
 
+  if (op->requires_rmw()) {
+    for (auto &&hpair: op->plan.will_write) {
+      if (delta_objects.count(hpair.first)) {
+	dout(20) << __func__ << ": blocking " << *op
+		 << " because it requires an rmw and a delta write of "
+		 << hpair.first << " is in flight"
+		 << dendl;
+	return false;
+      }
+    }
+    if (try_delta_rmw(op))
+      return true;
+  }
+
   if (op->invalidates_cache()) {
     dout(20) << __func__ << ": invalidating cache after this op"
 	     << dendl;
@@ -1743,6 +2000,11 @@ bool ECBackend::try_state_to_reads()
   } else {
     op->using_cache = pipeline_state.caching_enabled();
   }
+  if (op->plan.discards_cached) {
+    dout(20) << __func__ << ": dropping retained extents" << dendl;
+    cache.drop_retained();
+    ++num_discarding;
+  }
 
   waiting_state.pop_front();
   waiting_reads.push_back(*op);
@@ -1766,6 +2028,10 @@ bool ECBackend::try_state_to_reads()
 
       extent_set pending_read = to_read_plan;
       pending_read.subtract(remote_read);
+      get_parent()->get_logger()->inc(
+	l_osd_ec_cache_hit, pending_read.size());
+      get_parent()->get_logger()->inc(
+	l_osd_ec_cache_miss, remote_read.size());
 
       if (!remote_read.empty()) {
 	op->remote_read[hpair.first] = std::move(remote_read);
@@ -1782,19 +2048,151 @@ bool ECBackend::try_state_to_reads()
 
   if (!op->remote_read.empty()) {
     assert(get_parent()->get_pool().is_hacky_ecoverwrites());
-    objects_read_async_no_cache(
-      op->remote_read,
-      [this, op](map<hobject_t,pair<int, extent_map> > &&results) {
-	for (auto &&i: results) {
-	  op->remote_read_result.emplace(i.first, i.second.second);
-	}
-	check_ops();
-      });
+    start_remote_read(op);
   }
 
   return true;
 }
 
+void ECBackend::start_remote_read(Op *op)
+{
+  objects_read_async_no_cache(
+    op->remote_read,
+    [this, op](map<hobject_t,pair<int, extent_map> > &&results) {
+      for (auto &&i: results) {
+	op->remote_read_result.emplace(i.first, i.second.second);
+      }
+      check_ops();
+    });
+}
+
+bool ECBackend::get_delta_read_shards(
+  const hobject_t &hoid,
+  const set<int> &data_shards,
+  set<pg_shard_t> *to_read)
+{
+  set<int> want = data_shards;
+  for (unsigned i = ec_impl->get_data_chunk_count();
+       i < ec_impl->get_chunk_count();
+       ++i) {
+    want.insert(i);
+  }
+  for (auto &&i: get_parent()->get_acting_shards()) {
+    if (!want.count(i.shard))
+      continue;
+    if (get_parent()->get_shard_missing(i).is_missing(hoid))
+      return false;
+    to_read->insert(i);
+    want.erase(i.shard);
+  }
+  return want.empty();
+}
+
+struct OnDeltaReadComplete :
+  public GenContext<pair<RecoveryMessages*, ECBackend::read_result_t& > &> {
+  ECBackend *ec;
+  ceph_tid_t tid;
+  OnDeltaReadComplete(ECBackend *ec, ceph_tid_t tid) : ec(ec), tid(tid) {}
+  void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in)
+    override {
+    ec->handle_delta_read(tid, in.second);
+  }
+};
+
+/**
+ * try_delta_rmw
+ *
+ * Start op, the head of waiting_state, as a parity-delta write if it
+ * is one and nothing in flight writes its object; otherwise leave it
+ * for the regular rmw.
+ */
+bool ECBackend::try_delta_rmw(Op *op)
+{
+  if (!cct->_conf->osd_ec_parity_delta_writes ||
+      op->invalidates_cache() ||
+      !pipeline_state.caching_enabled())
+    return false;
+
+  set<int> shards = ECTransaction::get_delta_shards(sinfo, ec_impl, op->plan);
+  if (shards.empty())
+    return false;
+  const hobject_t &hoid = op->plan.to_read.begin()->first;
+  if (cache.contains_object(hoid))
+    return false;
+  set<pg_shard_t> need;
+  if (!get_delta_read_shards(hoid, shards, &need))
+    return false;
+
+  op->plan.delta_shards.swap(shards);
+  op->delta_write = true;
+  op->using_cache = false;
+  op->remote_read = op->plan.to_read;
+  delta_objects.insert(hoid);
+
+  waiting_state.pop_front();
+  waiting_reads.push_back(*op);
+  dout(10) << __func__ << ": data shards " << op->plan.delta_shards
+	   << " reading " << need << " for " << *op << dendl;
+
+  list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
+  const extent_set &extents = op->remote_read.begin()->second;
+  for (auto &&extent: extents) {
+    to_read.emplace_back(extent.first, extent.second, 0);
+  }
+  map<hobject_t, read_request_t> for_read_op;
+  for_read_op.insert(
+    make_pair(
+      hoid,
+      read_request_t(
+	to_read,
+	need,
+	false,
+	new OnDeltaReadComplete(this, op->tid))));
+  // for_recovery: we want exactly these shards, not enough to decode
+  start_read_op(
+    CEPH_MSG_PRIO_DEFAULT,
+    for_read_op,
+    OpRequestRef(),
+    false, true);
+  return true;
+}
+
+void ECBackend::handle_delta_read(ceph_tid_t tid, read_result_t &res)
+{
+  auto iter = tid_to_op_map.find(tid);
+  assert(iter != tid_to_op_map.end());
+  Op *op = &(iter->second);
+  assert(op->using_delta());
+
+  const unsigned num_shards =
+    op->plan.delta_shards.size() + ec_impl->get_coding_chunk_count();
+  bool ok = res.r == 0 && res.errors.empty();
+  ECTransaction::delta_read_t result;
+  for (auto &&extent: res.returned) {
+    uint64_t chunk_len = sinfo.aligned_logical_offset_to_chunk_offset(
+      extent.get<1>());
+    auto &chunks = result[extent.get<0>()];
+    for (auto &&i: extent.get<2>()) {
+      if (i.second.length() != chunk_len)
+	ok = false;
+      chunks[i.first.shard].claim(i.second);
+    }
+    if (chunks.size() != num_shards)
+      ok = false;
+  }
+
+  if (!ok) {
+    dout(5) << __func__ << ": delta read failed (r=" << res.r
+	    << " errors=" << res.errors << "), reading whole stripes for "
+	    << *op << dendl;
+    op->plan.delta_shards.clear();
+    start_remote_read(op);
+    return;
+  }
+  op->delta_read.swap(result);
+  check_ops();
+}
+
 bool ECBackend::try_reads_to_commit()
 {
   if (waiting_reads.empty())
@@ -1840,8 +2238,10 @@ bool ECBackend::try_reads_to_commit()
       ec_impl,
       get_parent()->get_info().pgid.pgid,
       !get_osdmap()->test_flag(CEPH_OSDMAP_REQUIRE_KRAKEN),
+      rely_on_store_csum(),
       sinfo,
       op->remote_read_result,
+      op->delta_read,
       op->log_entries,
       &written,
       &trans,
@@ -1869,7 +2269,8 @@ bool ECBackend::try_reads_to_commit()
     written_set[i.first] = i.second.get_interval_set();
   }
   dout(20) << __func__ << ": written_set: " << written_set << dendl;
-  assert(written_set == op->plan.will_write);
+  // a delta write has no whole stripes to hand the cache
+  assert(op->using_delta() || written_set == op->plan.will_write);
 
   if (op->using_cache) {
     for (auto &&hpair: written) {
@@ -1879,6 +2280,7 @@ bool ECBackend::try_reads_to_commit()
   }
   op->remote_read.clear();
   op->remote_read_result.clear();
+  op->delta_read.clear();
 
   dout(10) << "onreadable_sync: " << op->on_local_applied_sync << dendl;
   ObjectStore::Transaction empty;
@@ -1976,8 +2378,15 @@ bool ECBackend::try_finish_rmw()
     }
   }
 
+  if (op->plan.discards_cached) {
+    assert(num_discarding > 0);
+    --num_discarding;
+  }
   if (op->using_cache) {
-    cache.release_write_pin(op->pin);
+    cache.release_write_pin(op->pin, get_cache_retain());
+  }
+  if (op->delta_write) {
+    delta_objects.erase(op->plan.will_write.begin()->first);
   }
   tid_to_op_map.erase(op->tid);
 
@@ -1991,6 +2400,13 @@ bool ECBackend::try_finish_rmw()
   return true;
 }
 
+uint64_t ECBackend::get_cache_retain() const
+{
+  if (!pipeline_state.caching_enabled() || num_discarding)
+    return 0;
+  return cct->_conf->osd_ec_extent_cache_max_bytes;
+}
+
 void ECBackend::check_ops()
 {
   while (try_state_to_reads() ||
@@ -2125,18 +2541,55 @@ void ECBackend::objects_read_async(
 	   on_complete)));
 }
 
+/**
+ * copy [off, off + len) out of the data chunks read for the stripes
+ * starting at base, which must hold every chunk the range touches
+ */
+static void read_from_chunks(
+  const ECUtil::stripe_info_t &sinfo,
+  const vector<int> &chunk_mapping,
+  map<int, bufferlist> &chunks,
+  uint64_t base,
+  uint64_t off,
+  uint64_t len,
+  bufferlist *out)
+{
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const uint64_t end = off + len;
+  while (off < end) {
+    uint64_t rel = off - base;
+    uint64_t stripe = rel / sinfo.get_stripe_width();
+    unsigned i = (rel % sinfo.get_stripe_width()) / chunk_size;
+    int shard = chunk_mapping.size() > i ? chunk_mapping[i] : (int)i;
+    uint64_t chunk_off = stripe * chunk_size + rel % chunk_size;
+    uint64_t n = MIN(chunk_size - rel % chunk_size, end - off);
+    map<int, bufferlist>::iterator c = chunks.find(shard);
+    assert(c != chunks.end());
+    if (chunk_off >= c->second.length())
+      break;  // short read past the end of the object
+    n = MIN(n, c->second.length() - chunk_off);
+    bufferlist bl;
+    bl.substr_of(c->second, chunk_off, n);
+    out->claim_append(bl);
+    off += n;
+  }
+}
+
 struct CallClientContexts :
   public GenContext<pair<RecoveryMessages*, ECBackend::read_result_t& > &> {
   hobject_t hoid;
   ECBackend *ec;
   ECBackend::ClientAsyncReadStatus *status;
   list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
+  set<int> want_to_read; ///< empty when reading whole stripes
   CallClientContexts(
     hobject_t hoid,
     ECBackend *ec,
     ECBackend::ClientAsyncReadStatus *status,
-    const list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read)
-    : hoid(hoid), ec(ec), status(status), to_read(to_read) {}
+    const list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read,
+    const set<int> &want_to_read)
+    : hoid(hoid), ec(ec), status(status), to_read(to_read),
+      want_to_read(want_to_read) {}
   void finish(pair<RecoveryMessages *, ECBackend::read_result_t &> &in) override {
     ECBackend::read_result_t &res = in.second;
     extent_map result;
@@ -2159,6 +2612,42 @@ struct CallClientContexts :
 	   ++j) {
 	to_decode[j->first.shard].claim(j->second);
       }
+      if (!want_to_read.empty()) {
+	// only the shards holding the range were read; decode just the
+	// ones we had to read around
+	map<int, bufferlist> decoded;
+	map<int, bufferlist*> missing;
+	for (auto &&i: want_to_read) {
+	  if (!to_decode.count(i))
+	    missing[i] = &decoded[i];
+	}
+	if (!missing.empty()) {
+	  int r = ECUtil::decode(
+	    ec->sinfo,
+	    ec->ec_impl,
+	    to_decode,
+	    missing);
+	  if (r < 0) {
+	    res.r = r;
+	    goto out;
+	  }
+	  for (auto &&i: decoded)
+	    to_decode[i.first].claim(i.second);
+	}
+	bufferlist direct;
+	read_from_chunks(
+	  ec->sinfo,
+	  ec->ec_impl->get_chunk_mapping(),
+	  to_decode,
+	  adjusted.first,
+	  read.get<0>(),
+	  read.get<1>(),
+	  &direct);
+	result.insert(
+	  read.get<0>(), direct.length(), std::move(direct));
+	res.returned.pop_front();
+	continue;
+      }
       int r = ECUtil::decode(
 	ec->sinfo,
 	ec->ec_impl,
@@ -2203,10 +2692,20 @@ void ECBackend::objects_read_and_reconstruct(
     
   map<hobject_t, read_request_t> for_read_op;
   for (auto &&to_read: reads) {
+    // a range within fewer than k chunks is read straight from the
+    // shards holding it; minimum_to_decode() widens that to a decodable
+    // set if one of them is missing
+    set<int> want;
+    if (cct->_conf->osd_ec_direct_small_reads && !fast_read) {
+      get_want_to_read_shards(to_read.second, &want);
+      if (want.size() == want_to_read.size())
+	want.clear();
+    }
+
     set<pg_shard_t> shards;
     int r = get_min_avail_to_read_shards(
       to_read.first,
-      want_to_read,
+      want.empty() ? want_to_read : want,
       false,
       fast_read,
       &shards);
@@ -2216,7 +2715,8 @@ void ECBackend::objects_read_and_reconstruct(
       to_read.first,
       this,
       &(in_progress_client_reads.back()),
-      to_read.second);
+      to_read.second,
+      want);
     for_read_op.insert(
       make_pair(
 	to_read.first,
@@ -2224,7 +2724,8 @@ void ECBackend::objects_read_and_reconstruct(
 	  to_read.second,
 	  shards,
 	  false,
-	  c)));
+	  c,
+	  want)));
   }
 
   start_read_op(
@@ -2241,7 +2742,7 @@ int ECBackend::send_all_remaining_reads(
   ReadOp &rop)
 {
   set<int> already_read;
-  const set<pg_shard_t>& ots = rop.obj_to_source[hoid];
+  const set<pg_shard_t> ots = rop.obj_to_source[hoid];
   for (set<pg_shard_t>::iterator i = ots.begin(); i != ots.end(); ++i)
     already_read.insert(i->shard);
   dout(10) << __func__ << " have/error shards=" << already_read << dendl;
@@ -2252,13 +2753,36 @@ int ECBackend::send_all_remaining_reads(
   if (shards.empty())
     return -EIO;
 
-  dout(10) << __func__ << " Read remaining shards " << shards << dendl;
+  // Sub-chunks only decode together with the ones the plugin picked
+  // for them, so if any were read partially fall back to whole chunks:
+  // drop what came back and read every shard that has not failed again.
+  const read_request_t &req = rop.to_read.find(hoid)->second;
+  int sub_chunk_count = ec_impl->get_sub_chunk_count();
+  bool partial = false;
+  for (auto &&i : req.subchunks) {
+    if (!(i.second.size() == 1 &&
+	  i.second.front().second == sub_chunk_count))
+      partial = true;
+  }
+  if (partial) {
+    read_result_t &res = rop.complete[hoid];
+    for (auto &&i : ots) {
+      if (!res.errors.count(i))
+	shards.insert(i);
+    }
+    for (auto &&i : res.returned)
+      i.get<2>().clear();
+  }
+
+  dout(10) << __func__ << " Read remaining shards " << shards
+	   << (partial ? " as whole chunks" : "") << dendl;
 
   // TODOSAM: this doesn't seem right
   list<boost::tuple<uint64_t, uint64_t, uint32_t> > offsets =
     rop.to_read.find(hoid)->second.to_read;
   GenContext<pair<RecoveryMessages *, read_result_t& > &> *c =
     rop.to_read.find(hoid)->second.cb;
+  set<int> want_to_read = rop.to_read.find(hoid)->second.want_to_read;
 
   map<hobject_t, read_request_t> for_read_op;
   for_read_op.insert(
@@ -2268,7 +2792,8 @@ int ECBackend::send_all_remaining_reads(
 	offsets,
 	shards,
 	false,
-	c)));
+	c,
+	want_to_read)));
 
   rop.to_read.swap(for_read_op);
   do_read_op(rop);
@@ -2360,8 +2885,20 @@ void ECBackend::be_deep_scrub(
     o.digest_present = false;
     return;
   } else {
-    if (!get_parent()->get_pool().is_hacky_ecoverwrites()) {
-      assert(hinfo->has_chunk_hash());
+    if (!get_parent()->get_pool().is_hacky_ecoverwrites() &&
+	!hinfo->has_chunk_hash()) {
+      /* Written with osd_ec_rely_on_store_csum: the store checked its
+       * checksums on the reads above, which report -EIO on a mismatch,
+       * so only the size is left to compare.
+       */
+      if (hinfo->get_total_chunk_size() != pos) {
+	dout(0) << "_scan_list  " << poid << " got incorrect size on read" << dendl;
+	o.ec_size_mismatch = true;
+	return;
+      }
+      o.digest = 0;
+      o.digest_present = true;
+    } else if (!get_parent()->get_pool().is_hacky_ecoverwrites()) {
       if (hinfo->get_total_chunk_size() != pos) {
 	dout(0) << "_scan_list  " << poid << " got incorrect size on read" << dendl;
 	o.ec_size_mismatch = true;
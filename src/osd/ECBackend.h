@@ -216,6 +216,29 @@ private:
     }
   }
 
+  /// the data shards holding any byte of extents
+  void get_want_to_read_shards(
+    const list<boost::tuple<uint64_t, uint64_t, uint32_t> > &extents,
+    set<int> *want_to_read) const {
+    const vector<int> &chunk_mapping = ec_impl->get_chunk_mapping();
+    const uint64_t k = ec_impl->get_data_chunk_count();
+    for (auto &&i: extents) {
+      if (i.get<1>() == 0)
+	continue;
+      uint64_t first = i.get<0>() / sinfo.get_chunk_size();
+      uint64_t last = (i.get<0>() + i.get<1>() - 1) / sinfo.get_chunk_size();
+      if (last - first + 1 >= k) {
+	get_want_to_read_shards(want_to_read);
+	return;
+      }
+      for (uint64_t c = first; c <= last; ++c) {
+	uint64_t chunk = c % k;
+	want_to_read->insert(
+	  chunk_mapping.size() > chunk ? chunk_mapping[chunk] : (int)chunk);
+      }
+    }
+  }
+
   /**
    * Recovery
    *
@@ -231,6 +254,10 @@ private:
    *            decode the buffers and proceed to WRITING
    * - WRITING: We are awaiting a completed push.  Once complete, we will
    *            either transition to COMPLETE or to IDLE to continue.
+   *            With osd_ec_recovery_read_ahead, the read of the next
+   *            extent is started on entering WRITING; once the pushes
+   *            complete we go back to READING to wait for it, or to
+   *            push what it already returned.
    * - COMPLETE: complete
    *
    * We use the existing Push and PushReply messages and structures to
@@ -284,12 +311,16 @@ private:
     ObjectContextRef obc;
     set<pg_shard_t> waiting_on_pushes;
 
-    // valid in state READING
+    // valid in state READING, or in state WRITING if read_in_flight
     pair<uint64_t, uint64_t> extent_requested;
 
+    // the read of the next extent was issued before the pushes of the
+    // previous one were acked; see osd_ec_recovery_read_ahead
+    bool read_in_flight;
+
     void dump(Formatter *f) const;
 
-    RecoveryOp() : state(IDLE) {}
+    RecoveryOp() : state(IDLE), read_in_flight(false) {}
   };
   friend ostream &operator<<(ostream &lhs, const RecoveryOp &rhs);
   map<hobject_t, RecoveryOp> recovery_ops;
@@ -297,12 +328,16 @@ private:
   void continue_recovery_op(
     RecoveryOp &op,
     RecoveryMessages *m);
+  int start_recovery_read(
+    RecoveryOp &op,
+    RecoveryMessages *m);
   void dispatch_recovery_messages(RecoveryMessages &m, int priority);
   friend struct OnRecoveryReadComplete;
   void handle_recovery_read_complete(
     const hobject_t &hoid,
     boost::tuple<uint64_t, uint64_t, map<pg_shard_t, bufferlist> > &to_read,
     boost::optional<map<string, bufferlist> > attrs,
+    const map<int, vector<pair<int, int> > > &subchunks,
     RecoveryMessages *m);
   void handle_recovery_push(
     const PushOp &op,
@@ -341,20 +376,29 @@ public:
     list<
       boost::tuple<
 	uint64_t, uint64_t, map<pg_shard_t, bufferlist> > > returned;
+    /// sub-chunks read from each shard; shards not listed were read whole
+    map<int, vector<pair<int, int> > > subchunks;
     read_result_t() : r(0) {}
   };
   struct read_request_t {
     const list<boost::tuple<uint64_t, uint64_t, uint32_t> > to_read;
     const set<pg_shard_t> need;
     const bool want_attrs;
+    /// shards the reader needs; empty for all the data shards
+    const set<int> want_to_read;
+    /// sub-chunks to read from each of need; empty to read them whole
+    const map<pg_shard_t, vector<pair<int, int> > > subchunks;
     GenContext<pair<RecoveryMessages *, read_result_t& > &> *cb;
     read_request_t(
       const list<boost::tuple<uint64_t, uint64_t, uint32_t> > &to_read,
       const set<pg_shard_t> &need,
       bool want_attrs,
-      GenContext<pair<RecoveryMessages *, read_result_t& > &> *cb)
+      GenContext<pair<RecoveryMessages *, read_result_t& > &> *cb,
+      const set<int> &want_to_read = set<int>(),
+      const map<pg_shard_t, vector<pair<int, int> > > &subchunks =
+        map<pg_shard_t, vector<pair<int, int> > >())
       : to_read(to_read), need(need), want_attrs(want_attrs),
-	cb(cb) {}
+	want_to_read(want_to_read), subchunks(subchunks), cb(cb) {}
   };
   friend ostream &operator<<(ostream &lhs, const read_request_t &rhs);
 
@@ -379,6 +423,7 @@ public:
     void dump(Formatter *f) const;
 
     set<pg_shard_t> in_progress;
+    map<pg_shard_t, utime_t> sent; ///< when each sub read was sent
 
     ReadOp(
       int priority,
@@ -412,6 +457,11 @@ public:
   friend ostream &operator<<(ostream &lhs, const ReadOp &rhs);
   map<ceph_tid_t, ReadOp> tid_to_read_map;
   map<pg_shard_t, set<ceph_tid_t> > shard_to_read_map;
+  /// decaying average of the sub read latency of each osd, in usec
+  map<int, uint64_t> osd_read_latency;
+  /// osds known to be in, or out of, our ruleset-locality bucket
+  map<int, bool> osd_is_remote;
+  epoch_t osd_is_remote_epoch;
   void start_read_op(
     int priority,
     map<hobject_t, read_request_t> &to_read,
@@ -471,7 +521,15 @@ public:
     map<hobject_t,extent_set> pending_read; // subset already being read
     map<hobject_t,extent_set> remote_read;  // subset we must read
     map<hobject_t,extent_map> remote_read_result;
+
+    /// parity-delta write, see try_delta_rmw
+    bool using_delta() const { return !plan.delta_shards.empty(); }
+    bool delta_write = false;  // started as one, even if it fell back
+    ECTransaction::delta_read_t delta_read;
+
     bool read_in_progress() const {
+      if (using_delta())
+	return delta_read.empty();
       return !remote_read.empty() && remote_read_result.empty();
     }
 
@@ -549,8 +607,41 @@ public:
   op_list waiting_state;        /// writes waiting on pipe_state
   op_list waiting_reads;        /// writes waiting on partial stripe reads
   op_list waiting_commit;       /// writes waiting on initial commit
+
+  /**
+   * Retained stripes
+   *
+   * Finished writes leave what they wrote in the cache, up to
+   * osd_ec_extent_cache_max_bytes per pg, for the next rmw of the same
+   * stripes.  A delete or truncate may leave those stale past the new
+   * size, where a later extending write would read them back, so one
+   * drops them all and nothing is retained until it finishes.
+   */
+  unsigned num_discarding = 0;  /// discards_cached ops past waiting_state
+  uint64_t get_cache_retain() const;
   eversion_t completed_to;
   eversion_t committed_to;
+
+  /**
+   * Parity-delta writes
+   *
+   * A small overwrite of an object nothing else in the pipeline is
+   * writing may read only the data shards it changes and the coding
+   * shards, and update the coding chunks from the change (see
+   * ECTransaction::get_delta_shards).  It bypasses the cache, which
+   * holds whole stripes, so until it finishes later rmws on the same
+   * object wait in waiting_state rather than read stale stripes.
+   */
+  set<hobject_t> delta_objects;  /// objects with a delta write in flight
+  bool get_delta_read_shards(
+    const hobject_t &hoid,
+    const set<int> &data_shards,
+    set<pg_shard_t> *to_read);
+  bool try_delta_rmw(Op *op);
+  friend struct OnDeltaReadComplete;
+  void handle_delta_read(ceph_tid_t tid, read_result_t &res);
+  void start_remote_read(Op *op);
+
   void start_rmw(Op *op, PGTransactionUPtr &&t);
   bool try_state_to_reads();
   bool try_reads_to_commit();
@@ -615,6 +706,8 @@ public:
   SharedPtrRegistry<hobject_t, ECUtil::HashInfo> unstable_hashinfo_registry;
   ECUtil::HashInfoRef get_hash_info(const hobject_t &hoid, bool checks = true,
 				    const map<string,bufferptr> *attr = NULL);
+  /// true if writes should not maintain the cumulative shard hashes
+  bool rely_on_store_csum() const;
 
 public:
   ECBackend(
@@ -635,6 +728,33 @@ public:
     set<pg_shard_t> *to_read   ///< [out] shards to read
     ); ///< @return error code, 0 on success
 
+  /**
+   * Returns the replicas and their sub-chunks sufficient to recover
+   * want, for codes with more than one sub-chunk per chunk (see
+   * ErasureCodeInterface::minimum_to_decode_sub_chunks)
+   */
+  int get_min_avail_to_read_sub_chunks(
+    const hobject_t &hoid,     ///< [in] object
+    const set<int> &want,      ///< [in] desired shards
+    map<pg_shard_t, vector<pair<int, int> > > *to_read ///< [out] shards to read
+    ); ///< @return error code, 0 on success
+
+  /// true if osd is outside the ruleset-locality bucket of this osd
+  bool is_remote_osd(int osd);
+
+  /// cost of reading each shard of have, for minimum_to_decode_with_cost
+  void get_shard_read_costs(
+    const set<int> &have,
+    map<shard_id_t, pg_shard_t> &shards,
+    map<int, int> *costs);
+
+  /// shards that hold hoid, and where they are
+  void get_all_avail_shards(
+    const hobject_t &hoid,
+    bool for_recovery,
+    set<int> *have,
+    map<shard_id_t, pg_shard_t> *shards);
+
   int get_remaining_shards(
     const hobject_t &hoid,
     const set<int> &avail,
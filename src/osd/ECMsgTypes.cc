@@ -15,6 +15,11 @@
 #include "ECMsgTypes.h"
 
 void ECSubWrite::encode(bufferlist &bl) const
+{
+  encode(bl, nullptr);
+}
+
+void ECSubWrite::encode(bufferlist &bl, uint32_t *t_off) const
 {
   ENCODE_START(4, 1, bl);
   ::encode(from, bl);
@@ -22,6 +27,8 @@ void ECSubWrite::encode(bufferlist &bl) const
   ::encode(reqid, bl);
   ::encode(soid, bl);
   ::encode(stats, bl);
+  if (t_off)
+    *t_off = bl.length();
   ::encode(t, bl);
   ::encode(at_version, bl);
   ::encode(trim_to, bl);
@@ -185,17 +192,18 @@ void ECSubRead::encode(bufferlist &bl, uint64_t features) const
     return;
   }
 
-  ENCODE_START(2, 2, bl);
+  ENCODE_START(3, 2, bl);
   ::encode(from, bl);
   ::encode(tid, bl);
   ::encode(to_read, bl);
   ::encode(attrs_to_read, bl);
+  ::encode(subchunks, bl);
   ENCODE_FINISH(bl);
 }
 
 void ECSubRead::decode(bufferlist::iterator &bl)
 {
-  DECODE_START(2, bl);
+  DECODE_START(3, bl);
   ::decode(from, bl);
   ::decode(tid, bl);
   if (struct_v == 1) {
@@ -214,6 +222,8 @@ void ECSubRead::decode(bufferlist::iterator &bl)
     ::decode(to_read, bl);
   }
   ::decode(attrs_to_read, bl);
+  if (struct_v >= 3)
+    ::decode(subchunks, bl);
   DECODE_FINISH(bl);
 }
 
@@ -223,6 +233,7 @@ std::ostream &operator<<(
   return lhs
     << "ECSubRead(tid=" << rhs.tid
     << ", to_read=" << rhs.to_read
+    << ", subchunks=" << rhs.subchunks
     << ", attrs_to_read=" << rhs.attrs_to_read << ")";
 }
 
@@ -262,6 +273,27 @@ void ECSubRead::dump(Formatter *f) const
     f->close_section();
   }
   f->close_section();
+
+  f->open_array_section("subchunks");
+  for (map<hobject_t, vector<pair<int, int> > >::const_iterator i =
+	 subchunks.begin();
+       i != subchunks.end();
+       ++i) {
+    f->open_object_section("object");
+    f->dump_stream("oid") << i->first;
+    f->open_array_section("ranges");
+    for (vector<pair<int, int> >::const_iterator j = i->second.begin();
+	 j != i->second.end();
+	 ++j) {
+      f->open_object_section("range");
+      f->dump_int("first", j->first);
+      f->dump_int("count", j->second);
+      f->close_section();
+    }
+    f->close_section();
+    f->close_section();
+  }
+  f->close_section();
 }
 
 void ECSubRead::generate_test_instances(list<ECSubRead*>& o)
@@ -282,6 +314,8 @@ void ECSubRead::generate_test_instances(list<ECSubRead*>& o)
   o.back()->to_read[hoid2].push_back(boost::make_tuple(400, 600, 0));
   o.back()->to_read[hoid2].push_back(boost::make_tuple(2000, 600, 0));
   o.back()->attrs_to_read.insert(hoid2);
+  o.back()->subchunks[hoid2].push_back(make_pair(1, 3));
+  o.back()->subchunks[hoid2].push_back(make_pair(7, 3));
 }
 
 void ECSubReadReply::encode(bufferlist &bl) const
@@ -78,6 +78,8 @@ struct ECSubWrite {
     backfill = other.backfill;
   }
   void encode(bufferlist &bl) const;
+  /// also report where in bl the transaction encoding starts
+  void encode(bufferlist &bl, uint32_t *t_off) const;
   void decode(bufferlist::iterator &bl);
   void dump(Formatter *f) const;
   static void generate_test_instances(list<ECSubWrite*>& o);
@@ -107,6 +109,9 @@ struct ECSubRead {
   ceph_tid_t tid;
   map<hobject_t, list<boost::tuple<uint64_t, uint64_t, uint32_t> >> to_read;
   set<hobject_t> attrs_to_read;
+  /// (first, count) sub-chunk ranges to read of each chunk-sized unit
+  /// of to_read; objects not listed are read whole
+  map<hobject_t, vector<pair<int, int> > > subchunks;
   void encode(bufferlist &bl, uint64_t features) const;
   void decode(bufferlist::iterator &bl);
   void dump(Formatter *f) const;
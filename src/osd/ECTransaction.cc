@@ -19,6 +19,7 @@
 
 #include "ECTransaction.h"
 #include "ECUtil.h"
+#include "erasure-code/ErasureCode.h"
 #include "os/ObjectStore.h"
 #include "common/inline_variant.h"
 
@@ -82,6 +83,123 @@ void encode_and_write(
   }
 }
 
+void delta_and_write(
+  pg_t pgid,
+  const hobject_t &oid,
+  const ECUtil::stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ecimpl,
+  const set<int> &shards,
+  uint64_t offset,
+  uint64_t len,
+  const extent_map &updates,
+  const map<int, bufferlist> &old_chunks,
+  uint32_t flags,
+  map<shard_id_t, ObjectStore::Transaction> *transactions,
+  DoutPrefixProvider *dpp) {
+  assert(sinfo.logical_offset_is_stripe_aligned(offset));
+  assert(sinfo.logical_offset_is_stripe_aligned(len));
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const uint64_t stripe_width = sinfo.get_stripe_width();
+  const uint64_t chunk_off = sinfo.aligned_logical_offset_to_chunk_offset(
+    offset);
+  const uint64_t chunk_len = sinfo.aligned_logical_offset_to_chunk_offset(
+    len);
+
+  map<int, bufferlist> old_data, new_data, coding;
+  for (auto &&i: old_chunks) {
+    assert(i.second.length() == chunk_len);
+    if (shards.count(i.first))
+      old_data[i.first] = i.second;
+    else
+      coding[i.first] = i.second;
+  }
+
+  // each written chunk is its old content overlaid with the updates
+  // falling in that chunk's part of every stripe
+  for (int shard: shards) {
+    assert(old_data.count(shard));
+    bufferptr bp(buffer::create_aligned(chunk_len, ErasureCode::SIMD_ALIGN));
+    old_data[shard].copy(0, chunk_len, bp.c_str());
+    for (uint64_t stripe = 0; stripe * stripe_width < len; ++stripe) {
+      uint64_t start = offset + stripe * stripe_width + shard * chunk_size;
+      for (auto &&u: updates.intersect(start, chunk_size)) {
+	u.get_val().copy(
+	  0, u.get_len(),
+	  bp.c_str() + stripe * chunk_size + (u.get_off() - start));
+      }
+    }
+    new_data[shard].push_back(std::move(bp));
+  }
+
+  int r = ecimpl->encode_delta(old_data, new_data, &coding);
+  assert(r == 0);
+
+  ldpp_dout(dpp, 20) << __func__ << ": " << oid
+		     << " " << offset << "~" << len
+		     << " data shards " << shards
+		     << dendl;
+
+  for (auto *m: {&new_data, &coding}) {
+    for (auto &&i: *m) {
+      auto t = transactions->find(shard_id_t(i.first));
+      assert(t != transactions->end());
+      t->second.write(
+	coll_t(spg_t(pgid, t->first)),
+	ghobject_t(oid, ghobject_t::NO_GEN, t->first),
+	chunk_off,
+	chunk_len,
+	i.second,
+	flags);
+    }
+  }
+}
+
+set<int> ECTransaction::get_delta_shards(
+  const ECUtil::stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ecimpl,
+  const WritePlan &plan)
+{
+  set<int> shards;
+  if (!(ecimpl->get_supported_optimizations() &
+	ErasureCodeInterface::FLAG_EC_PLUGIN_PARITY_DELTA) ||
+      !ecimpl->get_chunk_mapping().empty())
+    return shards;
+
+  // one object, every written stripe partially overwritten in place
+  if (!plan.t ||
+      plan.t->op_map.size() != 1 ||
+      plan.to_read.size() != 1)
+    return shards;
+  const hobject_t &oid = plan.t->op_map.begin()->first;
+  const PGTransaction::ObjectOperation &op = plan.t->op_map.begin()->second;
+  if (!op.is_none() || op.truncate || op.buffer_updates.empty())
+    return shards;
+  auto to_read = plan.to_read.find(oid);
+  auto will_write = plan.will_write.find(oid);
+  if (to_read == plan.to_read.end() ||
+      will_write == plan.will_write.end() ||
+      !(to_read->second == will_write->second))
+    return shards;
+
+  const uint64_t chunk_size = sinfo.get_chunk_size();
+  const uint64_t k = ecimpl->get_data_chunk_count();
+  const uint64_t m = ecimpl->get_coding_chunk_count();
+  for (auto &&extent: op.buffer_updates) {
+    uint64_t first = extent.get_off() / chunk_size;
+    uint64_t last = (extent.get_off() + extent.get_len() - 1) / chunk_size;
+    if (last - first + 1 >= k)
+      return set<int>();
+    for (uint64_t c = first; c <= last; ++c)
+      shards.insert(c % k);
+  }
+
+  // a delta write reads and writes the touched and the coding shards; a
+  // full-stripe one reads k shards and writes k + m
+  if (2 * (shards.size() + m) >= 2 * k + m)
+    return set<int>();
+  return shards;
+}
+
 bool ECTransaction::requires_overwrite(
   uint64_t prev_size,
   const PGTransaction::ObjectOperation &op) {
@@ -100,8 +218,10 @@ void ECTransaction::generate_transactions(
   ErasureCodeInterfaceRef &ecimpl,
   pg_t pgid,
   bool legacy_log_entries,
+  bool drop_chunk_hashes,
   const ECUtil::stripe_info_t &sinfo,
   const map<hobject_t,extent_map> &partial_extents,
+  const delta_read_t &delta_read,
   vector<pg_log_entry_t> &entries,
   map<hobject_t,extent_map> *written_map,
   map<shard_id_t, ObjectStore::Transaction> *transactions,
@@ -195,6 +315,8 @@ void ECTransaction::generate_transactions(
       bufferlist old_hinfo;
       ::encode(*hinfo, old_hinfo);
       xattr_rollback[ECUtil::get_hinfo_key()] = old_hinfo;
+      if (drop_chunk_hashes && hinfo->has_chunk_hash())
+	hinfo->set_total_chunk_size_clear_hash(hinfo->get_total_chunk_size());
       
       if (op.is_none() && op.truncate && op.truncate->first == 0) {
 	assert(op.truncate->first == 0);
@@ -537,6 +659,61 @@ void ECTransaction::generate_transactions(
 			   << dendl;
       }
 
+      auto stash_extent = [&](uint64_t off, uint64_t len) {
+	uint64_t restore_from = sinfo.aligned_logical_offset_to_chunk_offset(
+	  off);
+	uint64_t restore_len = sinfo.aligned_logical_offset_to_chunk_offset(
+	  len);
+	ldpp_dout(dpp, 20) << __func__ << ": overwriting "
+			   << restore_from << "~" << restore_len
+			   << dendl;
+	if (rollback_extents.empty()) {
+	  for (auto &&st : *transactions) {
+	    st.second.touch(
+	      coll_t(spg_t(pgid, st.first)),
+	      ghobject_t(oid, entry->version.version, st.first));
+	  }
+	}
+	rollback_extents.emplace_back(make_pair(restore_from, restore_len));
+	for (auto &&st : *transactions) {
+	  st.second.clone_range(
+	    coll_t(spg_t(pgid, st.first)),
+	    ghobject_t(oid, ghobject_t::NO_GEN, st.first),
+	    ghobject_t(oid, entry->version.version, st.first),
+	    restore_from,
+	    restore_len,
+	    restore_from);
+	}
+      };
+
+      if (!plan.delta_shards.empty()) {
+	// parity-delta write, see get_delta_shards: to_write only holds
+	// the updates, the old chunks of the shards written are in
+	// delta_read
+	assert(new_size == orig_size);
+	const extent_set &extents = plan.to_read.at(oid);
+	for (auto extent: extents) {
+	  auto old_chunks = delta_read.find(extent.first);
+	  assert(old_chunks != delta_read.end());
+	  if (entry)
+	    stash_extent(extent.first, extent.second);
+	  delta_and_write(
+	    pgid,
+	    oid,
+	    sinfo,
+	    ecimpl,
+	    plan.delta_shards,
+	    extent.first,
+	    extent.second,
+	    to_write,
+	    old_chunks->second,
+	    fadvise_flags,
+	    transactions,
+	    dpp);
+	}
+	to_write.clear();
+      }
+
       set<int> want;
       for (unsigned i = 0; i < ecimpl->get_chunk_count(); ++i) {
 	want.insert(i);
@@ -549,32 +726,8 @@ void ECTransaction::generate_transactions(
 	assert(extent.get_off() + extent.get_len() <= append_after);
 	assert(sinfo.logical_offset_is_stripe_aligned(extent.get_off()));
 	assert(sinfo.logical_offset_is_stripe_aligned(extent.get_len()));
-	if (entry) {
-	  uint64_t restore_from = sinfo.aligned_logical_offset_to_chunk_offset(
-	    extent.get_off());
-	  uint64_t restore_len = sinfo.aligned_logical_offset_to_chunk_offset(
-	    extent.get_len());
-	  ldpp_dout(dpp, 20) << __func__ << ": overwriting "
-			     << restore_from << "~" << restore_len
-			     << dendl;
-	  if (rollback_extents.empty()) {
-	    for (auto &&st : *transactions) {
-	      st.second.touch(
-		coll_t(spg_t(pgid, st.first)),
-		ghobject_t(oid, entry->version.version, st.first));
-	    }
-	  }
-	  rollback_extents.emplace_back(make_pair(restore_from, restore_len));
-	  for (auto &&st : *transactions) {
-	    st.second.clone_range(
-	      coll_t(spg_t(pgid, st.first)),
-	      ghobject_t(oid, ghobject_t::NO_GEN, st.first),
-	      ghobject_t(oid, entry->version.version, st.first),
-	      restore_from,
-	      restore_len,
-	      restore_from);
-	  }
-	}
+	if (entry)
+	  stash_extent(extent.get_off(), extent.get_len());
 	encode_and_write(
 	  pgid,
 	  oid,
@@ -643,9 +796,13 @@ void ECTransaction::generate_transactions(
 	entry->mod_desc.append(append_after);
       }
 
-      if (!op.is_delete()) {
-	bufferlist hbuf;
-	::encode(*hinfo, hbuf);
+      bufferlist hbuf;
+      ::encode(*hinfo, hbuf);
+      if (op.is_none() && hbuf.contents_equal(old_hinfo)) {
+	// an overwrite within the object, once it has no shard hashes
+	ldpp_dout(dpp, 20) << __func__ << ": " << oid
+			   << " hinfo unchanged" << dendl;
+      } else if (!op.is_delete()) {
 	for (auto &&i : *transactions) {
 	  i.second.setattr(
 	    coll_t(spg_t(pgid, i.first)),
@@ -26,12 +26,22 @@ namespace ECTransaction {
   struct WritePlan {
     PGTransactionUPtr t;
     bool invalidates_cache = false; // Yes, both are possible
+    bool discards_cached = false; // deletes or truncates, see ECBackend
     map<hobject_t,extent_set> to_read;
     map<hobject_t,extent_set> will_write; // superset of to_read
 
     map<hobject_t,ECUtil::HashInfoRef> hash_infos;
+
+    /// data shards of a parity-delta write, empty for a full-stripe one
+    set<int> delta_shards;
   };
 
+  /**
+   * old chunks a parity-delta write needs: for each extent of to_read
+   * (by logical offset), the written data shards and the coding shards
+   */
+  typedef map<uint64_t, map<int, bufferlist> > delta_read_t;
+
   bool requires_overwrite(
     uint64_t prev_size,
     const PGTransaction::ObjectOperation &op);
@@ -59,6 +69,10 @@ namespace ECTransaction {
 	  ldpp_dout(dpp, 20) << __func__ << ": delete, setting projected size"
 			     << " to 0" << dendl;
 	  projected_size = 0;
+	  plan.discards_cached = true;
+	}
+	if (i.second.truncate) {
+	  plan.discards_cached = true;
 	}
 
 	hobject_t source;
@@ -176,13 +190,29 @@ namespace ECTransaction {
     return plan;
   }
 
+  /**
+   * Data shards plan would touch as a parity-delta write
+   *
+   * A partial overwrite of a single object by a linear code can read
+   * and rewrite just the data shards it changes plus the coding shards,
+   * updating the latter from the difference of the former, instead of
+   * reading whole stripes and rewriting every shard.  Returns an empty
+   * set if plan isn't such a write, or if it would not save IO.
+   */
+  set<int> get_delta_shards(
+    const ECUtil::stripe_info_t &sinfo,
+    ErasureCodeInterfaceRef &ecimpl,
+    const WritePlan &plan);
+
   void generate_transactions(
     WritePlan &plan,
     ErasureCodeInterfaceRef &ecimpl,
     pg_t pgid,
     bool legacy_log_entries,
+    bool drop_chunk_hashes,
     const ECUtil::stripe_info_t &sinfo,
     const map<hobject_t,extent_map> &partial_extents,
+    const delta_read_t &delta_read,
     vector<pg_log_entry_t> &entries,
     map<hobject_t,extent_map> *written,
     map<shard_id_t, ObjectStore::Transaction> *transactions,
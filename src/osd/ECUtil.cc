@@ -26,19 +26,28 @@ int ECUtil::decode(
   if (total_data_size == 0)
     return 0;
 
+  // the data chunks, in order
+  const vector<int> &mapping = ec_impl->get_chunk_mapping();
+  vector<int> data;
+  set<int> need;
+  for (unsigned i = 0; i < ec_impl->get_data_chunk_count(); i++) {
+    data.push_back(mapping.size() > i ? mapping[i] : i);
+    need.insert(data.back());
+  }
+  map<int, bufferlist> decoded;
+  int r = ec_impl->decode_stripes(
+    need, to_decode, total_data_size / sinfo.get_chunk_size(), &decoded);
+  assert(r == 0);
   for (uint64_t i = 0; i < total_data_size; i += sinfo.get_chunk_size()) {
-    map<int, bufferlist> chunks;
-    for (map<int, bufferlist>::iterator j = to_decode.begin();
-	 j != to_decode.end();
-	 ++j) {
-      chunks[j->first].substr_of(j->second, i, sinfo.get_chunk_size());
+    for (vector<int>::iterator j = data.begin(); j != data.end(); ++j) {
+      assert(decoded[*j].length() == total_data_size);
+      bufferlist bl;
+      bl.substr_of(decoded[*j], i, sinfo.get_chunk_size());
+      out->claim_append(bl);
     }
-    bufferlist bl;
-    int r = ec_impl->decode_concat(chunks, &bl);
-    assert(bl.length() == sinfo.get_stripe_width());
-    assert(r == 0);
-    out->claim_append(bl);
   }
+  assert(out->length() == sinfo.aligned_chunk_offset_to_logical_offset(
+	   total_data_size));
   return 0;
 }
 
@@ -70,29 +79,91 @@ int ECUtil::decode(
     need.insert(i->first);
   }
 
-  for (uint64_t i = 0; i < total_data_size; i += sinfo.get_chunk_size()) {
+  map<int, bufferlist> out_bls;
+  int r = ec_impl->decode_stripes(
+    need, to_decode, total_data_size / sinfo.get_chunk_size(), &out_bls);
+  assert(r == 0);
+  for (map<int, bufferlist*>::iterator j = out.begin();
+       j != out.end();
+       ++j) {
+    assert(out_bls.count(j->first));
+    j->second->claim_append(out_bls[j->first]);
+  }
+  for (map<int, bufferlist*>::iterator i = out.begin();
+       i != out.end();
+       ++i) {
+    assert(i->second->length() == total_data_size);
+  }
+  return 0;
+}
+
+int ECUtil::decode(
+  const stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ec_impl,
+  map<int, bufferlist> &to_decode,
+  map<int, bufferlist*> &out,
+  const map<int, vector<pair<int, int> > > &subchunks) {
+  assert(to_decode.size());
+
+  uint64_t chunk_size = sinfo.get_chunk_size();
+  uint64_t sub_chunk_size = chunk_size / ec_impl->get_sub_chunk_count();
+  // bytes read from each shard per stripe
+  map<int, uint64_t> read_size;
+  uint64_t num_stripes = 0;
+  for (map<int, bufferlist>::iterator i = to_decode.begin();
+       i != to_decode.end();
+       ++i) {
+    map<int, vector<pair<int, int> > >::const_iterator j =
+      subchunks.find(i->first);
+    uint64_t size = 0;
+    if (j == subchunks.end()) {
+      // read whole
+      size = chunk_size;
+    } else {
+      for (vector<pair<int, int> >::const_iterator k = j->second.begin();
+	   k != j->second.end();
+	   ++k)
+	size += k->second * sub_chunk_size;
+    }
+    assert(size > 0);
+    assert(i->second.length() % size == 0);
+    if (i == to_decode.begin())
+      num_stripes = i->second.length() / size;
+    assert(i->second.length() / size == num_stripes);
+    read_size[i->first] = size;
+  }
+
+  if (num_stripes == 0)
+    return 0;
+
+  set<int> need;
+  for (map<int, bufferlist*>::iterator i = out.begin();
+       i != out.end();
+       ++i) {
+    assert(i->second);
+    assert(i->second->length() == 0);
+    need.insert(i->first);
+  }
+
+  for (uint64_t s = 0; s < num_stripes; ++s) {
     map<int, bufferlist> chunks;
     for (map<int, bufferlist>::iterator j = to_decode.begin();
 	 j != to_decode.end();
 	 ++j) {
-      chunks[j->first].substr_of(j->second, i, sinfo.get_chunk_size());
+      uint64_t size = read_size[j->first];
+      chunks[j->first].substr_of(j->second, s * size, size);
     }
     map<int, bufferlist> out_bls;
-    int r = ec_impl->decode(need, chunks, &out_bls);
+    int r = ec_impl->decode_sub_chunks(need, chunks, &out_bls, chunk_size);
     assert(r == 0);
     for (map<int, bufferlist*>::iterator j = out.begin();
 	 j != out.end();
 	 ++j) {
       assert(out_bls.count(j->first));
-      assert(out_bls[j->first].length() == sinfo.get_chunk_size());
+      assert(out_bls[j->first].length() == chunk_size);
       j->second->claim_append(out_bls[j->first]);
     }
   }
-  for (map<int, bufferlist*>::iterator i = out.begin();
-       i != out.end();
-       ++i) {
-    assert(i->second->length() == total_data_size);
-  }
   return 0;
 }
 
@@ -112,19 +183,9 @@ int ECUtil::encode(
   if (logical_size == 0)
     return 0;
 
-  for (uint64_t i = 0; i < logical_size; i += sinfo.get_stripe_width()) {
-    map<int, bufferlist> encoded;
-    bufferlist buf;
-    buf.substr_of(in, i, sinfo.get_stripe_width());
-    int r = ec_impl->encode(want, buf, &encoded);
-    assert(r == 0);
-    for (map<int, bufferlist>::iterator i = encoded.begin();
-	 i != encoded.end();
-	 ++i) {
-      assert(i->second.length() == sinfo.get_chunk_size());
-      (*out)[i->first].claim_append(i->second);
-    }
-  }
+  int r = ec_impl->encode_stripes(
+    want, in, logical_size / sinfo.get_stripe_width(), out);
+  assert(r == 0);
 
   for (map<int, bufferlist>::iterator i = out->begin();
        i != out->end();
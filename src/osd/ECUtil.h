@@ -99,6 +99,16 @@ int decode(
   map<int, bufferlist> &to_decode,
   map<int, bufferlist*> &out);
 
+/// decode out from the (first, count) sub-chunks of each chunk read
+/// from every shard of to_decode; shards missing from subchunks were
+/// read whole
+int decode(
+  const stripe_info_t &sinfo,
+  ErasureCodeInterfaceRef &ec_impl,
+  map<int, bufferlist> &to_decode,
+  map<int, bufferlist*> &out,
+  const map<int, vector<pair<int, int> > > &subchunks);
+
 int encode(
   const stripe_info_t &sinfo,
   ErasureCodeInterfaceRef &ec_impl,
@@ -14,12 +14,15 @@
 
 #include "ExtentCache.h"
 
+MEMPOOL_DEFINE_OBJECT_FACTORY(ExtentCache::extent, ec_extent, osd);
+
 void ExtentCache::extent::_link_pin_state(pin_state &pin_state)
 {
   assert(parent_extent_set);
   assert(!parent_pin_state);
   parent_pin_state = &pin_state;
   pin_state.pin_list.push_back(*this);
+  pin_state.bytes += length;
 }
 
 void ExtentCache::extent::_unlink_pin_state()
@@ -28,6 +31,7 @@ void ExtentCache::extent::_unlink_pin_state()
   assert(parent_pin_state);
   auto liter = pin_state::list::s_iterator_to(*this);
   parent_pin_state->pin_list.erase(liter);
+  parent_pin_state->bytes -= length;
   parent_pin_state = nullptr;
 }
 
@@ -216,6 +220,32 @@ void ExtentCache::present_rmw_update(
   }
 }
 
+void ExtentCache::release_write_pin(
+  write_pin &pin,
+  uint64_t retain)
+{
+  if (retain) {
+    for (auto iter = pin.pin_list.begin(); iter != pin.pin_list.end(); ) {
+      extent &ext = *iter;
+      ++iter; // move will invalidate
+      if (ext.bl)
+	ext.move(retained);
+    }
+  }
+  release_pin(pin);
+  trim_retained(retain);
+}
+
+void ExtentCache::trim_retained(uint64_t max)
+{
+  while (retained.bytes > max) {
+    unique_ptr<extent> ext(&retained.pin_list.front()); // we now own this
+    auto &eset = *(ext->parent_extent_set);
+    ext->unlink();
+    remove_and_destroy_if_empty(eset);
+  }
+}
+
 ostream &ExtentCache::print(ostream &out) const
 {
   out << "ExtentCache(" << std::endl;
@@ -232,6 +262,7 @@ ostream &ExtentCache::print(ostream &out) const
 	  << ")" << std::endl;
     }
   }
+  out << "  retained " << retained.bytes << std::endl;
   return out << ")" << std::endl;
 }
 
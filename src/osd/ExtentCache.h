@@ -25,6 +25,7 @@
 #include "include/interval_set.h"
 #include "common/interval_map.h"
 #include "include/buffer.h"
+#include "include/mempool.h"
 #include "common/hobject.h"
 
 /**
@@ -92,6 +93,17 @@
    All of the above suggests that there are 3 things users can
    ask of the cache corresponding to the 3 Write pipelines
    states.
+
+   Retained extents:
+
+   A write releasing its pin may hand the extents it wrote to the
+   retained pin rather than drop them, so the next rmw of those
+   stripes finds them without reading.  Retained extents are only
+   ever Write Pinned by a completed write: the next reserve moves them
+   to its own pin like any other, and they return (most recently used
+   last) when that write is released.  The caller bounds the total
+   held and must drop them whenever the object may change under the
+   cache (see ECBackend).
  */
 
 /// If someone wants these types, but not ExtentCache, move to another file
@@ -121,9 +133,11 @@ using extent_map = interval_map<uint64_t, bufferlist, bl_split_merge>;
 class ExtentCache {
   struct object_extent_set;
   struct pin_state;
-private:
-
+public:
+  // public only so the mempool factory can name it
   struct extent {
+    MEMPOOL_CLASS_HELPERS();
+
     object_extent_set *parent_extent_set = nullptr;
     pin_state *parent_pin_state = nullptr;
     boost::intrusive::set_member_hook<> extent_set_member;
@@ -169,6 +183,7 @@ private:
     void link(object_extent_set &parent_extent_set, pin_state &pin_state);
     void move(pin_state &to);
   };
+private:
 
   struct object_extent_set : boost::intrusive::set_base_hook<> {
     hobject_t oid;
@@ -351,9 +366,11 @@ private:
     enum pin_type_t {
       NONE,
       WRITE,
+      RETAINED,
     };
     pin_type_t pin_type = NONE;
-    bool is_write() const { return pin_type == WRITE; }
+    bool is_write() const { return pin_type == WRITE || pin_type == RETAINED; }
+    uint64_t bytes = 0; ///< total length of pin_list
 
     pin_state(const pin_state &other) = delete;
     pin_state &operator=(const pin_state &other) = delete;
@@ -368,6 +385,7 @@ private:
     list pin_list;
     ~pin_state() {
       assert(pin_list.empty());
+      assert(bytes == 0);
       assert(tid == 0);
       assert(pin_type == NONE);
     }
@@ -392,7 +410,19 @@ private:
     p.pin_type = pin_state::NONE;
   }
 
+  /// extents kept by release_write_pin, least recently used first
+  pin_state retained;
+  void trim_retained(uint64_t max);
+
 public:
+  ExtentCache() {
+    retained.pin_type = pin_state::RETAINED;
+  }
+  ~ExtentCache() {
+    trim_retained(0);
+    retained.pin_type = pin_state::NONE;
+  }
+
   class write_pin : private pin_state {
     friend class ExtentCache;
   private:
@@ -474,12 +504,32 @@ public:
     write_pin &pin,
     const extent_map &extents);
 
+  /// true if an in-flight or retained write has extents of oid
+  bool contains_object(const hobject_t &oid) {
+    return get_if_exists(oid) != nullptr;
+  }
+
   /**
    * Release all buffers pinned by pin
+   *
+   * Extents holding data are retained instead, as long as the
+   * retained total stays within retain bytes; the least recently
+   * used ones go first.
+   *
+   * @param pin [in,out] pin to release
+   * @param retain [in] bytes to keep retained, 0 to drop them all
    */
   void release_write_pin(
-    write_pin &pin) {
-    release_pin(pin);
+    write_pin &pin,
+    uint64_t retain = 0);
+
+  /// drop every retained extent
+  void drop_retained() {
+    trim_retained(0);
+  }
+
+  uint64_t get_retained_bytes() const {
+    return retained.bytes;
   }
 
   ostream &print(
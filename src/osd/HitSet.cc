@@ -12,6 +12,8 @@
  *
  */
 
+#include <cmath>
+
 #include "HitSet.h"
 #include "common/Formatter.h"
 
@@ -37,6 +39,10 @@ HitSet::HitSet(const HitSet::Params& params)
     impl.reset(new ExplicitObjectHitSet(static_cast<ExplicitObjectHitSet::Params*>(params.impl.get())));
     break;
 
+  case TYPE_DECAYING_COUNT:
+    impl.reset(new DecayingCountHitSet(static_cast<DecayingCountHitSet::Params*>(params.impl.get())));
+    break;
+
   default:
     assert (0 == "unknown HitSet type");
   }
@@ -71,6 +77,9 @@ void HitSet::decode(bufferlist::iterator &bl)
   case TYPE_BLOOM:
     impl.reset(new BloomHitSet);
     break;
+  case TYPE_DECAYING_COUNT:
+    impl.reset(new DecayingCountHitSet);
+    break;
   case TYPE_NONE:
     impl.reset(NULL);
     break;
@@ -105,6 +114,10 @@ void HitSet::generate_test_instances(list<HitSet*>& o)
   o.back()->insert(hobject_t());
   o.back()->insert(hobject_t("asdf", "", CEPH_NOSNAP, 123, 1, ""));
   o.back()->insert(hobject_t("qwer", "", CEPH_NOSNAP, 456, 1, ""));
+  o.push_back(new HitSet(new DecayingCountHitSet(16, 2, 60, 1)));
+  o.back()->insert(hobject_t());
+  o.back()->insert(hobject_t("asdf", "", CEPH_NOSNAP, 123, 1, ""));
+  o.back()->insert(hobject_t("qwer", "", CEPH_NOSNAP, 456, 1, ""));
 }
 
 HitSet::Params::Params(const Params& o)
@@ -158,6 +171,9 @@ bool HitSet::Params::create_impl(impl_type_t type)
   case TYPE_BLOOM:
     impl.reset(new BloomHitSet::Params);
     break;
+  case TYPE_DECAYING_COUNT:
+    impl.reset(new DecayingCountHitSet::Params);
+    break;
   case TYPE_NONE:
     impl.reset(NULL);
     break;
@@ -203,6 +219,8 @@ void HitSet::Params::generate_test_instances(list<HitSet::Params*>& o)
   loop_hitset_params(ExplicitHashHitSet);
   o.push_back(new Params(new ExplicitObjectHitSet::Params));
   loop_hitset_params(ExplicitObjectHitSet);
+  o.push_back(new Params(new DecayingCountHitSet::Params));
+  loop_hitset_params(DecayingCountHitSet);
 }
 
 ostream& operator<<(ostream& out, const HitSet::Params& p) {
@@ -250,3 +268,66 @@ void BloomHitSet::dump(Formatter *f) const {
   bloom.dump(f);
   f->close_section();
 }
+
+void DecayingCountHitSet::_rescale(utime_t now)
+{
+  double scale = _scale(now);
+  for (auto& c : counters)
+    c /= scale;
+  base = now;
+}
+
+void DecayingCountHitSet::insert_at(const hobject_t& o, utime_t now)
+{
+  ++count;
+  if (counters.empty())
+    return;
+  double scale = _scale(now);
+  if (scale > MAX_SCALE) {
+    _rescale(now);
+    scale = 1;
+  }
+  for (uint32_t row = 0; row < depth; ++row)
+    counters[_slot(o, row)] += scale;
+}
+
+double DecayingCountHitSet::hit_count_at(const hobject_t& o,
+					 utime_t now) const
+{
+  if (counters.empty())
+    return 0;
+  float m = counters[_slot(o, 0)];
+  for (uint32_t row = 1; row < depth; ++row)
+    m = std::min(m, counters[_slot(o, row)]);
+  return m / _scale(now);
+}
+
+unsigned DecayingCountHitSet::approx_unique_insert_count() const
+{
+  // linear counting over the first row
+  if (!width)
+    return 0;
+  unsigned zero = 0;
+  for (uint32_t i = 0; i < width; ++i)
+    if (counters[i] == 0)
+      ++zero;
+  if (!zero)
+    return std::min<uint64_t>(count, width);
+  return std::min<uint64_t>(count, width * std::log((double)width / zero));
+}
+
+void DecayingCountHitSet::Params::dump(Formatter *f) const {
+  f->dump_unsigned("width", width);
+  f->dump_unsigned("depth", depth);
+  f->dump_unsigned("half_life", half_life);
+  f->dump_unsigned("seed", seed);
+}
+
+void DecayingCountHitSet::dump(Formatter *f) const {
+  f->dump_unsigned("width", width);
+  f->dump_unsigned("depth", depth);
+  f->dump_float("half_life", half_life);
+  f->dump_unsigned("seed", seed);
+  f->dump_unsigned("insert_count", count);
+  f->dump_stream("base") << base;
+}
@@ -20,6 +20,7 @@
 #include "include/encoding.h"
 #include "include/unordered_set.h"
 #include "common/bloom_filter.hpp"
+#include "common/Clock.h"
 #include "common/hobject.h"
 
 /**
@@ -36,7 +37,8 @@ public:
     TYPE_NONE = 0,
     TYPE_EXPLICIT_HASH = 1,
     TYPE_EXPLICIT_OBJECT = 2,
-    TYPE_BLOOM = 3
+    TYPE_BLOOM = 3,
+    TYPE_DECAYING_COUNT = 4
   } impl_type_t;
 
   static const char *get_type_name(impl_type_t t) {
@@ -45,6 +47,7 @@ public:
     case TYPE_EXPLICIT_HASH: return "explicit_hash";
     case TYPE_EXPLICIT_OBJECT: return "explicit_object";
     case TYPE_BLOOM: return "bloom";
+    case TYPE_DECAYING_COUNT: return "decaying_count";
     default: return "???";
     }
   }
@@ -61,6 +64,13 @@ public:
     virtual bool is_full() const = 0;
     virtual void insert(const hobject_t& o) = 0;
     virtual bool contains(const hobject_t& o) const = 0;
+    /// roughly how many recent hits o had; sets without counts say 0 or 1
+    virtual double hit_count(const hobject_t& o) const {
+      return contains(o) ? 1 : 0;
+    }
+    /// one set covers all periods, decaying old hits, rather than one set
+    /// per period
+    virtual bool is_decaying() const { return false; }
     virtual unsigned insert_count() const = 0;
     virtual unsigned approx_unique_insert_count() const = 0;
     virtual void encode(bufferlist &bl) const = 0;
@@ -145,6 +155,12 @@ public:
   bool contains(const hobject_t& o) const {
     return impl->contains(o);
   }
+  double hit_count(const hobject_t& o) const {
+    return impl->hit_count(o);
+  }
+  bool is_decaying() const {
+    return impl->is_decaying();
+  }
 
   unsigned insert_count() const {
     return impl->insert_count();
@@ -450,4 +466,171 @@ public:
 };
 WRITE_CLASS_ENCODER(BloomHitSet)
 
+/**
+ * count hits in a count-min sketch whose counts decay exponentially
+ *
+ * Each object bumps one counter in each of depth rows of width
+ * counters.  Its count is the smallest of those counters, so it can be
+ * too high when objects collide but never too low.  Counts halve every
+ * half_life seconds, so one set can stay in use indefinitely and every
+ * query is O(depth) instead of a walk over a list of past sets.
+ *
+ * Decay is applied lazily: a hit at time t adds 2^((t - base) / half_life)
+ * and counts are divided by the same factor when read; the counters are
+ * rescaled before that factor loses precision.
+ */
+class DecayingCountHitSet : public HitSet::Impl {
+public:
+  class Params : public HitSet::Params::Impl {
+  public:
+    HitSet::impl_type_t get_type() const override {
+      return HitSet::TYPE_DECAYING_COUNT;
+    }
+    HitSet::Impl *get_new_impl() const override {
+      return new DecayingCountHitSet(this);
+    }
+
+    uint32_t width;      ///< counters per row
+    uint32_t depth;      ///< rows (hash functions)
+    uint32_t half_life;  ///< seconds for a count to halve; 0 for the pool's hit_set_period
+    uint64_t seed;
+
+    Params()
+      : width(4096), depth(4), half_life(0), seed(0) {}
+    Params(uint32_t w, uint32_t d, uint32_t h, uint64_t s)
+      : width(w), depth(d), half_life(h), seed(s) {}
+
+    void encode(bufferlist& bl) const override {
+      ENCODE_START(1, 1, bl);
+      ::encode(width, bl);
+      ::encode(depth, bl);
+      ::encode(half_life, bl);
+      ::encode(seed, bl);
+      ENCODE_FINISH(bl);
+    }
+    void decode(bufferlist::iterator& bl) override {
+      DECODE_START(1, bl);
+      ::decode(width, bl);
+      ::decode(depth, bl);
+      ::decode(half_life, bl);
+      ::decode(seed, bl);
+      DECODE_FINISH(bl);
+    }
+    void dump(Formatter *f) const override;
+    void dump_stream(ostream& o) const override {
+      o << "width: " << width << ", depth: " << depth
+	<< ", half_life: " << half_life << ", seed: " << seed;
+    }
+    static void generate_test_instances(list<Params*>& o) {
+      o.push_back(new Params);
+      o.push_back(new Params(64, 2, 600, 7));
+    }
+  };
+
+private:
+  uint32_t width, depth;
+  double half_life;
+  uint64_t seed;
+  uint64_t count;            ///< total inserts
+  utime_t base;              ///< when the scale factor was 1
+  vector<float> counters;    ///< depth rows of width counters
+
+  static constexpr double MAX_SCALE = 65536;
+
+  uint32_t _slot(const hobject_t& o, uint32_t row) const {
+    // objects in a pg share their low hash bits; mix before picking
+    uint32_t h = o.get_hash() ^ (uint32_t)(seed + row * 0x9e3779b9u);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    return row * width + h % width;
+  }
+  double _scale(utime_t now) const {
+    if (half_life <= 0 || now <= base)
+      return 1;
+    return exp2((double)(now - base) / half_life);
+  }
+  void _rescale(utime_t now);
+
+public:
+  DecayingCountHitSet()
+    : width(0), depth(0), half_life(0), seed(0), count(0) {}
+  DecayingCountHitSet(uint32_t w, uint32_t d, double h, uint64_t s)
+    : width(w), depth(d), half_life(h), seed(s), count(0),
+      base(ceph_clock_now()), counters((size_t)w * d) {}
+  explicit DecayingCountHitSet(const DecayingCountHitSet::Params *p)
+    : DecayingCountHitSet(p->width, p->depth, p->half_life, p->seed) {}
+
+  HitSet::Impl *clone() const override {
+    return new DecayingCountHitSet(*this);
+  }
+
+  HitSet::impl_type_t get_type() const override {
+    return HitSet::TYPE_DECAYING_COUNT;
+  }
+  bool is_full() const override {
+    return false;
+  }
+  bool is_decaying() const override {
+    return true;
+  }
+
+  void insert_at(const hobject_t& o, utime_t now);
+  double hit_count_at(const hobject_t& o, utime_t now) const;
+
+  void insert(const hobject_t& o) override {
+    insert_at(o, ceph_clock_now());
+  }
+  double hit_count(const hobject_t& o) const override {
+    return hit_count_at(o, ceph_clock_now());
+  }
+  /// hit at least half a time, i.e. once within the last half life
+  bool contains(const hobject_t& o) const override {
+    return hit_count(o) >= .5;
+  }
+  unsigned insert_count() const override {
+    return count;
+  }
+  unsigned approx_unique_insert_count() const override;
+
+  void encode(bufferlist &bl) const override {
+    ENCODE_START(1, 1, bl);
+    ::encode(width, bl);
+    ::encode(depth, bl);
+    ::encode(half_life, bl);
+    ::encode(seed, bl);
+    ::encode(count, bl);
+    ::encode(base, bl);
+    ::encode(counters, bl);
+    ENCODE_FINISH(bl);
+  }
+  void decode(bufferlist::iterator &bl) override {
+    DECODE_START(1, bl);
+    ::decode(width, bl);
+    ::decode(depth, bl);
+    ::decode(half_life, bl);
+    ::decode(seed, bl);
+    ::decode(count, bl);
+    ::decode(base, bl);
+    ::decode(counters, bl);
+    DECODE_FINISH(bl);
+    if (counters.size() != (size_t)width * depth)
+      throw buffer::malformed_input("bad DecayingCountHitSet size");
+  }
+  void dump(Formatter *f) const override;
+  static void generate_test_instances(list<DecayingCountHitSet*>& o) {
+    o.push_back(new DecayingCountHitSet);
+    o.push_back(new DecayingCountHitSet(16, 2, 60, 1));
+    o.back()->base = utime_t(1, 0);
+    o.back()->insert_at(hobject_t(), utime_t(1, 0));
+    o.back()->insert_at(hobject_t("asdf", "", CEPH_NOSNAP, 123, 1, ""),
+			utime_t(2, 0));
+    o.back()->insert_at(hobject_t("qwer", "", CEPH_NOSNAP, 456, 1, ""),
+			utime_t(3, 0));
+  }
+};
+WRITE_CLASS_ENCODER(DecayingCountHitSet)
+
 #endif
@@ -43,6 +43,7 @@
 #include "common/ceph_argparse.h"
 #include "common/version.h"
 #include "common/io_priority.h"
+#include "common/numa.h"
 
 #include "os/ObjectStore.h"
 #ifdef HAVE_LIBFUSE
@@ -68,6 +69,7 @@
 #include "messages/MOSDOpReply.h"
 #include "messages/MOSDBackoff.h"
 #include "messages/MOSDRepOp.h"
+#include "messages/MOSDRepOpBatch.h"
 #include "messages/MOSDRepOpReply.h"
 #include "messages/MOSDSubOp.h"
 #include "messages/MOSDSubOpReply.h"
@@ -179,6 +181,24 @@ void PGQueueable::RunVis::operator()(const PGRecovery &op) {
   return osd->do_recovery(pg.get(), op.epoch_queued, op.reserved_pushes, handle);
 }
 
+PGQueueable::op_type_t PGQueueable::TypeVis::operator()(
+  const OpRequestRef &op) const {
+  switch (op->get_req()->get_type()) {
+  case CEPH_MSG_OSD_OP:
+    return op_type_t::client_op;
+  case MSG_OSD_PG_PUSH:
+  case MSG_OSD_PG_PULL:
+  case MSG_OSD_PG_PUSH_REPLY:
+  case MSG_OSD_PG_SCAN:
+  case MSG_OSD_PG_BACKFILL:
+    return op_type_t::bg_recovery;
+  case MSG_OSD_REP_SCRUB:
+    return op_type_t::bg_scrub;
+  default:
+    return op_type_t::osd_subop;
+  }
+}
+
 //Initial features in new superblock.
 //Features here are also automatically upgraded
 CompatSet OSD::get_osd_initial_compat_set() {
@@ -211,6 +231,33 @@ CompatSet OSD::get_osd_compat_set() {
   return compat;
 }
 
+const char *OSDOpConf::tracked_keys[] = {
+  "osd_max_object_name_len",
+  "osd_max_object_namespace_len",
+  "osd_max_write_size",
+  "osd_backoff_on_degraded",
+  "osd_backoff_on_unfound",
+  "osd_backoff_on_peering",
+  "osd_small_read_fast_path",
+  "osd_small_read_max_len",
+  "osd_debug_op_order",
+  "osd_debug_misdirected_ops",
+  NULL
+};
+
+OSDOpConf::OSDOpConf(const md_config_t *conf)
+  : osd_max_object_name_len(conf->osd_max_object_name_len),
+    osd_max_object_namespace_len(conf->osd_max_object_namespace_len),
+    osd_max_write_size(conf->osd_max_write_size),
+    osd_backoff_on_degraded(conf->osd_backoff_on_degraded),
+    osd_backoff_on_unfound(conf->osd_backoff_on_unfound),
+    osd_backoff_on_peering(conf->osd_backoff_on_peering),
+    osd_small_read_fast_path(conf->osd_small_read_fast_path),
+    osd_small_read_max_len(conf->osd_small_read_max_len),
+    osd_debug_op_order(conf->osd_debug_op_order),
+    osd_debug_misdirected_ops(conf->osd_debug_misdirected_ops)
+{}
+
 OSDService::OSDService(OSD *osd) :
   osd(osd),
   cct(osd->cct),
@@ -222,6 +269,8 @@ OSDService::OSDService(OSD *osd) :
   client_messenger(osd->client_messenger),
   logger(osd->logger),
   recoverystate_perf(osd->recoverystate_perf),
+  repop_batcher(osd->cct, osd->logger),
+  op_conf(osd->cct->_conf),
   monc(osd->monc),
   op_wq(osd->op_shardedwq),
   peering_wq(osd->peering_wq),
@@ -236,6 +285,10 @@ OSDService::OSDService(OSD *osd) :
   peer_map_epoch_lock("OSDService::peer_map_epoch_lock"),
   sched_scrub_lock("OSDService::sched_scrub_lock"), scrubs_pending(0),
   scrubs_active(0),
+  scrub_budget_lock("OSDService::scrub_budget_lock"),
+  scrub_sleep_lock("OSDService::scrub_sleep_lock"),
+  scrub_sleep_timer(
+    osd->client_messenger->cct, scrub_sleep_lock, false /* relax locking */),
   agent_lock("OSDService::agent_lock"),
   agent_valid_iterator(false),
   agent_ops(0),
@@ -260,6 +313,11 @@ OSDService::OSDService(OSD *osd) :
 		 cct->_conf->osd_min_recovery_priority),
   remote_reserver(&reserver_finisher, cct->_conf->osd_max_backfills,
 		  cct->_conf->osd_min_recovery_priority),
+  backfill_sched_lock("OSDService::backfill_sched_lock"),
+  backfill_client_lat(0),
+  backfill_commit_lat(0),
+  backfill_waiting(0),
+  backfill_decision("none"),
   pg_temp_lock("OSDService::pg_temp_lock"),
   snap_sleep_lock("OSDService::snap_sleep_lock"),
   snap_sleep_timer(
@@ -482,6 +540,7 @@ void OSDService::start_shutdown()
 
 void OSDService::shutdown()
 {
+  repop_batcher.stop();
   reserver_finisher.wait_for_empty();
   reserver_finisher.stop();
   {
@@ -503,6 +562,11 @@ void OSDService::shutdown()
     snap_sleep_timer.shutdown();
   }
 
+  {
+    Mutex::Locker l(scrub_sleep_lock);
+    scrub_sleep_timer.shutdown();
+  }
+
   osdmap = OSDMapRef();
   next_osdmap = OSDMapRef();
 }
@@ -515,9 +579,13 @@ void OSDService::init()
   watch_timer.init();
   agent_timer.init();
   snap_sleep_timer.init();
+  scrub_sleep_timer.init();
 
   agent_thread.create("osd_srv_agent");
 
+  if (cct->_conf->osd_repop_batch)
+    repop_batcher.start();
+
   if (cct->_conf->osd_recovery_delay_start)
     defer_recovery(cct->_conf->osd_recovery_delay_start);
 }
@@ -627,6 +695,71 @@ void OSDService::agent_stop()
 
 // -------------------------------------
 
+void OSDService::backfill_recalibrate()
+{
+  Mutex::Locker l(backfill_sched_lock);
+  pair<uint64_t, uint64_t> op_lat = logger->get_tavg_ms(l_osd_op_lat);
+  uint64_t ops = op_lat.first - backfill_last_op_lat.first;
+  backfill_client_lat = ops ?
+    (double)(op_lat.second - backfill_last_op_lat.second) / ops / 1000.0 : 0;
+  backfill_last_op_lat = op_lat;
+  backfill_commit_lat = store->get_cur_stats().os_commit_latency;
+  {
+    Mutex::Locker rl(recovery_lock);
+    backfill_waiting = awaiting_throttle.size();
+  }
+  backfill_waiting += local_reserver.get_num_waiting() +
+    remote_reserver.get_num_waiting();
+
+  if (!cct->_conf->osd_backfill_adaptive) {
+    backfill_decision = "disabled";
+    return;
+  }
+
+  unsigned cur = local_reserver.get_max();
+  unsigned max = MAX(1, cct->_conf->osd_backfill_adaptive_max);
+  unsigned want = cur;
+  double client_target = cct->_conf->osd_backfill_adaptive_client_lat;
+  double commit_target = cct->_conf->osd_backfill_adaptive_commit_lat;
+  if ((client_target > 0 && backfill_client_lat > client_target) ||
+      (commit_target > 0 && backfill_commit_lat > commit_target * 1000)) {
+    want = MAX(1, cur / 2);
+    backfill_decision = "backoff";
+  } else if (backfill_waiting && cur < max) {
+    want = cur + 1;
+    backfill_decision = "grow";
+  } else {
+    backfill_decision = "hold";
+  }
+  want = MIN(want, max);
+  if (want != cur) {
+    dout(10) << __func__ << " client lat " << backfill_client_lat
+	     << "s commit lat " << backfill_commit_lat << "ms waiting "
+	     << backfill_waiting << ": max backfills " << cur << " -> "
+	     << want << dendl;
+    local_reserver.set_max(want);
+    remote_reserver.set_max(want);
+  }
+}
+
+void OSDService::backfill_reset_max()
+{
+  Mutex::Locker l(backfill_sched_lock);
+  local_reserver.set_max(cct->_conf->osd_max_backfills);
+  remote_reserver.set_max(cct->_conf->osd_max_backfills);
+}
+
+void OSDService::dump_backfill_scheduler(Formatter *f)
+{
+  Mutex::Locker l(backfill_sched_lock);
+  f->dump_bool("adaptive", cct->_conf->osd_backfill_adaptive);
+  f->dump_unsigned("max_backfills", local_reserver.get_max());
+  f->dump_float("client_latency", backfill_client_lat);
+  f->dump_unsigned("commit_latency_ms", backfill_commit_lat);
+  f->dump_unsigned("waiting", backfill_waiting);
+  f->dump_string("decision", backfill_decision);
+}
+
 void OSDService::promote_throttle_recalibrate()
 {
   utime_t now = ceph_clock_now();
@@ -820,6 +953,17 @@ void OSDService::send_message_osd_cluster(int peer, Message *m, epoch_t from_epo
   const entity_inst_t& peer_inst = next_map->get_cluster_inst(peer);
   ConnectionRef peer_con = osd->cluster_messenger->get_connection(peer_inst);
   share_map_peer(peer, peer_con.get(), next_map);
+  if (cct->_conf->osd_repop_batch) {
+    // peers can only unpack batches once they all run luminous
+    if (m->get_type() == MSG_OSD_REPOP &&
+	next_map->test_flag(CEPH_OSDMAP_REQUIRE_LUMINOUS)) {
+      repop_batcher.queue(peer_con, static_cast<MOSDRepOp*>(m),
+			  next_map->get_epoch());
+      release_map(next_map);
+      return;
+    }
+    repop_batcher.flush(peer_con.get());
+  }
   peer_con->send_message(m);
   release_map(next_map);
 }
@@ -1126,6 +1270,31 @@ void OSDService::inc_scrubs_active(bool reserved)
   sched_scrub_lock.Unlock();
 }
 
+void OSDService::scrub_charge(uint64_t bytes)
+{
+  double bw = cct->_conf->osd_scrub_bandwidth;
+  if (bw <= 0 || bytes == 0)
+    return;
+  utime_t now = ceph_clock_now();
+  Mutex::Locker l(scrub_budget_lock);
+  if (scrub_budget_next < now)
+    scrub_budget_next = now;
+  utime_t t;
+  t.set_from_double((double)bytes / bw);
+  scrub_budget_next += t;
+}
+
+double OSDService::scrub_budget_delay()
+{
+  if (cct->_conf->osd_scrub_bandwidth <= 0)
+    return 0;
+  utime_t now = ceph_clock_now();
+  Mutex::Locker l(scrub_budget_lock);
+  if (scrub_budget_next <= now)
+    return 0;
+  return (double)(scrub_budget_next - now);
+}
+
 void OSDService::dec_scrubs_active()
 {
   sched_scrub_lock.Lock();
@@ -1691,10 +1860,16 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
   asok_hook(NULL),
   osd_compat(get_osd_compat_set()),
   osd_tp(cct, "OSD::osd_tp", "tp_osd", cct->_conf->osd_op_threads, "osd_op_threads"),
+  osd_peering_tp(cct, "OSD::osd_peering_tp", "tp_osd_peering",
+    cct->_conf->osd_peering_threads, "osd_peering_threads"),
   osd_op_tp(cct, "OSD::osd_op_tp", "tp_osd_tp",
-    cct->_conf->osd_op_num_threads_per_shard * cct->_conf->osd_op_num_shards),
+    (cct->_conf->osd_op_run_to_completion ?
+     1 : cct->_conf->osd_op_num_threads_per_shard) *
+    cct->_conf->osd_op_num_shards),
   disk_tp(cct, "OSD::disk_tp", "tp_osd_disk", cct->_conf->osd_disk_threads, "osd_disk_threads"),
   command_tp(cct, "OSD::command_tp", "tp_osd_cmd",  1),
+  client_throttle_timer_lock("OSD::client_throttle_timer_lock"),
+  client_throttle_timer(cct, client_throttle_timer_lock, false),
   session_waiting_lock("OSD::session_waiting_lock"),
   heartbeat_lock("OSD::heartbeat_lock"),
   heartbeat_stop(false),
@@ -1721,7 +1896,7 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
     this,
     cct->_conf->osd_op_thread_timeout,
     cct->_conf->osd_op_thread_suicide_timeout,
-    &osd_tp),
+    &osd_peering_tp),
   map_lock("OSD::map_lock"),
   pg_map_lock("OSD::pg_map_lock"),
   last_pg_create_epoch(0),
@@ -1751,6 +1926,8 @@ OSD::OSD(CephContext *cct_, ObjectStore *store_,
                                          cct->_conf->osd_op_log_threshold);
   op_tracker.set_history_size_and_duration(cct->_conf->osd_op_history_size,
                                            cct->_conf->osd_op_history_duration);
+  op_tracker.set_sampling(cct->_conf->osd_op_tracker_sample_every,
+			  cct->_conf->osd_op_tracker_escalate_after);
 }
 
 OSD::~OSD()
@@ -1844,6 +2021,14 @@ bool OSD::asok_command(string command, cmdmap_t& cmdmap, string format,
     f->open_object_section("pq");
     op_shardedwq.dump(f);
     f->close_section();
+  } else if (command == "dump_client_throttles") {
+    f->open_object_section("client_throttles");
+    f->dump_float("ops_per_sec", cct->_conf->osd_client_throttle_ops);
+    f->dump_float("bytes_per_sec", cct->_conf->osd_client_throttle_bytes);
+    f->dump_float("burst", cct->_conf->osd_client_throttle_burst);
+    f->dump_string("policy", cct->_conf->osd_client_throttle_policy);
+    client_throttles.dump(f);
+    f->close_section();
   } else if (command == "dump_blacklist") {
     list<pair<entity_addr_t,utime_t> > bl;
     OSDMapRef curmap = service.get_osdmap();
@@ -1912,6 +2097,19 @@ bool OSD::asok_command(string command, cmdmap_t& cmdmap, string format,
     service.remote_reserver.dump(f);
     f->close_section();
     f->close_section();
+  } else if (command == "dump_heartbeat_peers") {
+    Mutex::Locker l(heartbeat_lock);
+    f->open_array_section("heartbeat_peers");
+    for (auto& p : heartbeat_peers) {
+      f->open_object_section("peer");
+      p.second.dump(f);
+      f->close_section();
+    }
+    f->close_section();
+  } else if (command == "dump_backfill_scheduler") {
+    f->open_object_section("backfill_scheduler");
+    service.dump_backfill_scheduler(f);
+    f->close_section();
   } else if (command == "get_latest_osdmap") {
     get_latest_osdmap();
   } else if (command == "set_heap_property") {
@@ -2008,6 +2206,25 @@ class OSD::C_Tick_WithoutOSDLock : public Context {
   }
 };
 
+class OSD::C_ClientThrottleRetry : public Context {
+  OSD *osd;
+  SessionRef session;
+  public:
+  C_ClientThrottleRetry(OSD *o, Session *s) : osd(o), session(s) {}
+  void finish(int r) override {
+    if (osd->service.is_stopping())
+      return;
+    OSDMapRef nextmap = osd->service.get_nextmap_reserved();
+    {
+      Mutex::Locker l(session->session_dispatch_lock);
+      session->throttle_retry_scheduled = false;
+      osd->update_waiting_for_pg(session.get(), nextmap);
+      osd->dispatch_session_waiting(session.get(), nextmap);
+    }
+    osd->service.release_map(nextmap);
+  }
+};
+
 int OSD::enable_disable_fuse(bool stop)
 {
 #ifdef HAVE_LIBFUSE
@@ -2059,6 +2276,7 @@ int OSD::init()
 
   tick_timer.init();
   tick_timer_without_osd_lock.init();
+  client_throttle_timer.init();
   service.backfill_request_timer.init();
 
   // mount.
@@ -2268,6 +2486,13 @@ int OSD::init()
   update_log_config();
 
   osd_tp.start();
+  osd_peering_tp.start();
+  {
+    // op shards next to the nic, with the messenger workers
+    std::set<int> cpus;
+    get_numa_affinity(cct, &cpus);
+    osd_op_tp.set_affinity(cpus);
+  }
   osd_op_tp.start();
   disk_tp.start();
   command_tp.start();
@@ -2275,6 +2500,7 @@ int OSD::init()
   set_disk_tp_priority();
 
   // start the heartbeat
+  heartbeat_thread.set_affinity(cct->_conf->osd_heartbeat_thread_cpu);
   heartbeat_thread.create("osd_srv_heartbt");
 
   // tick
@@ -2390,6 +2616,11 @@ void OSD::final_init()
 				     asok_hook,
 				     "dump op priority queue state");
   assert(r == 0);
+  r = admin_socket->register_command("dump_client_throttles",
+				     "dump_client_throttles",
+				     asok_hook,
+				     "dump per-client op admission state");
+  assert(r == 0);
   r = admin_socket->register_command("dump_blacklist", "dump_blacklist",
 				     asok_hook,
 				     "dump blacklisted clients and times");
@@ -2403,6 +2634,18 @@ void OSD::final_init()
 				     asok_hook,
 				     "show recovery reservations");
   assert(r == 0);
+  r = admin_socket->register_command("dump_heartbeat_peers",
+				     "dump_heartbeat_peers",
+				     asok_hook,
+				     "show heartbeat peers and their ping "
+				     "round trip times");
+  assert(r == 0);
+  r = admin_socket->register_command("dump_backfill_scheduler",
+				     "dump_backfill_scheduler",
+				     asok_hook,
+				     "show the adaptive backfill scheduler's "
+				     "inputs and current limit");
+  assert(r == 0);
   r = admin_socket->register_command("get_latest_osdmap", "get_latest_osdmap",
 				     asok_hook,
 				     "force osd to update the latest map from "
@@ -2578,6 +2821,9 @@ void OSD::create_logger()
       "Client read operations");        // client reads
   osd_plb.add_u64_counter(l_osd_op_r_outb, "op_r_out_bytes",
       "Client data read");   // client read out bytes
+  osd_plb.add_u64_avg(l_osd_op_r_copyb, "op_r_copied_bytes",
+      "Client data read into buffers of the op's own rather than shared "
+      "from the object store");
   osd_plb.add_time_avg(l_osd_op_r_lat,  "op_r_latency",
       "Latency of read operation (including queue time)");    // client read latency
   osd_plb.add_histogram(l_osd_op_r_lat_outb_hist,  "op_r_latency_out_bytes_histogram",
@@ -2635,6 +2881,8 @@ void OSD::create_logger()
   osd_plb.add_u64_counter(l_osd_pull,      "pull", "Pull requests sent");       // pull requests sent
   osd_plb.add_u64_counter(l_osd_push,      "push", "Push messages sent");       // push messages
   osd_plb.add_u64_counter(l_osd_push_outb, "push_out_bytes", "Pushed size");  // pushed bytes
+  osd_plb.add_u64_counter(l_osd_push_partial, "push_partial",
+    "Pushes limited to the extents changed since the peer's version");
 
   osd_plb.add_u64_counter(l_osd_rop, "recovery_ops",
       "Started recovery operations", "recop");       // recovery ops (started)
@@ -2651,6 +2899,7 @@ void OSD::create_logger()
   osd_plb.add_u64(l_osd_pg_replica, "numpg_replica", "Placement groups for which this osd is replica"); // num replica pgs
   osd_plb.add_u64(l_osd_pg_stray, "numpg_stray", "Placement groups ready to be deleted from this osd");   // num stray pgs
   osd_plb.add_u64(l_osd_hb_to, "heartbeat_to_peers", "Heartbeat (ping) peers we send to");     // heartbeat peers we send to
+  osd_plb.add_time_avg(l_osd_hb_rtt, "heartbeat_rtt", "Heartbeat (ping) round trip time");
   osd_plb.add_u64_counter(l_osd_map, "map_messages", "OSD map messages");           // osdmap messages
   osd_plb.add_u64_counter(l_osd_mape, "map_message_epochs", "OSD map epochs");         // osdmap epochs
   osd_plb.add_u64_counter(l_osd_mape_dup, "map_message_epoch_dups", "OSD map duplicates"); // dup osdmap epochs
@@ -2692,6 +2941,25 @@ void OSD::create_logger()
   osd_plb.add_time_avg(l_osd_tier_promote_lat, "osd_tier_promote_lat", "Object promote latency");
   osd_plb.add_time_avg(l_osd_tier_r_lat, "osd_tier_r_lat", "Object proxy read latency");
 
+  osd_plb.add_u64_counter(l_osd_op_small_read_fast, "op_small_read_fast",
+			  "Small reads served by the fast path");
+  osd_plb.add_u64_counter(l_osd_op_small_read_slow, "op_small_read_slow",
+			  "Small reads that fell back to the full op path");
+  osd_plb.add_u64_counter(l_osd_obc_cache_hit, "obc_cache_hit",
+			  "Object context cache hits");
+  osd_plb.add_u64_counter(l_osd_obc_cache_miss, "obc_cache_miss",
+			  "Object context cache misses");
+  osd_plb.add_u64_counter(l_osd_obc_cache_evict, "obc_cache_evict",
+			  "Object contexts evicted from the cache");
+  osd_plb.add_u64_counter(l_osd_repop_batch, "repop_batch",
+			  "Batches of rep ops sent");
+  osd_plb.add_u64_counter(l_osd_repop_batch_ops, "repop_batch_ops",
+			  "Rep ops sent in batches");
+  osd_plb.add_u64_counter(l_osd_client_throttle_delayed,
+			  "client_throttle_delayed",
+			  "Client ops held back by a per-client throttle");
+  osd_plb.add_time_avg(l_osd_client_throttle_lat, "client_throttle_latency",
+		       "Time client ops waited on a per-client throttle");
   osd_plb.add_u64_counter(l_osd_pg_info, "osd_pg_info",
 			  "PG updated its info (using any method)");
   osd_plb.add_u64_counter(l_osd_pg_fastinfo, "osd_pg_fastinfo",
@@ -2699,6 +2967,58 @@ void OSD::create_logger()
   osd_plb.add_u64_counter(l_osd_pg_biginfo, "osd_pg_biginfo",
 			  "PG updated its biginfo attr");
 
+  osd_plb.add_u64(l_osd_snap_trim_queue, "snap_trim_queue",
+		  "Snaps primary pgs on this osd have left to trim");
+  osd_plb.add_u64_counter(l_osd_snap_trim_txns, "snap_trim_txns",
+			  "Snap trim transactions submitted");
+  osd_plb.add_u64_counter(l_osd_snap_trim_objects, "snap_trim_objects",
+			  "Clones trimmed");
+
+  osd_plb.add_u64_counter(l_osd_scrub_chunks, "scrub_chunks",
+			  "Scrub chunks built by this osd");
+  osd_plb.add_u64_counter(l_osd_scrub_objects, "scrub_objects",
+			  "Objects scrubbed by this osd");
+  osd_plb.add_u64_counter(l_osd_scrub_bytes, "scrub_bytes",
+			  "Bytes read by deep scrub on this osd");
+  osd_plb.add_u64_counter(l_osd_scrub_skipped, "scrub_skipped",
+			  "Objects deep scrub didn't hash as they were unchanged");
+  osd_plb.add_time_avg(l_osd_scrub_wait, "scrub_wait",
+		       "Time a scrub chunk waited for osd_scrub_sleep or bandwidth");
+
+  osd_plb.add_u64_counter(l_osd_ec_cache_hit, "ec_cache_hit",
+			  "EC rmw bytes found in the extent cache");
+  osd_plb.add_u64_counter(l_osd_ec_cache_miss, "ec_cache_miss",
+			  "EC rmw bytes read from the shards");
+
+  osd_plb.add_u64(l_osd_mclock_client_len, "mclock_client_queue_len",
+		  "Client ops queued (mclock_opclass)");
+  osd_plb.add_time_avg(l_osd_mclock_client_lat, "mclock_client_queue_lat",
+		       "Client op latency until dequeued (mclock_opclass)");
+  osd_plb.add_u64(l_osd_mclock_subop_len, "mclock_subop_queue_len",
+		  "Sub ops queued (mclock_opclass)");
+  osd_plb.add_time_avg(l_osd_mclock_subop_lat, "mclock_subop_queue_lat",
+		       "Sub op latency until dequeued (mclock_opclass)");
+  osd_plb.add_u64(l_osd_mclock_snaptrim_len, "mclock_snaptrim_queue_len",
+		  "Snap trims queued (mclock_opclass)");
+  osd_plb.add_time_avg(l_osd_mclock_snaptrim_lat, "mclock_snaptrim_queue_lat",
+		       "Snap trim latency until dequeued (mclock_opclass)");
+  osd_plb.add_u64(l_osd_mclock_recovery_len, "mclock_recovery_queue_len",
+		  "Recovery ops queued (mclock_opclass)");
+  osd_plb.add_time_avg(l_osd_mclock_recovery_lat, "mclock_recovery_queue_lat",
+		       "Recovery op latency until dequeued (mclock_opclass)");
+  osd_plb.add_u64(l_osd_mclock_scrub_len, "mclock_scrub_queue_len",
+		  "Scrubs queued (mclock_opclass)");
+  osd_plb.add_time_avg(l_osd_mclock_scrub_lat, "mclock_scrub_queue_lat",
+		       "Scrub latency until dequeued (mclock_opclass)");
+
+  // updated by every op worker thread for every client op
+  osd_plb.set_sharded(l_osd_op);
+  osd_plb.set_sharded(l_osd_op_inb);
+  osd_plb.set_sharded(l_osd_op_outb);
+  osd_plb.set_sharded(l_osd_op_lat);
+  osd_plb.set_sharded(l_osd_op_process_lat);
+  osd_plb.set_sharded(l_osd_op_prepare_lat);
+
   logger = osd_plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(logger);
 }
@@ -2797,9 +3117,12 @@ int OSD::shutdown()
   cct->get_admin_socket()->unregister_command("dump_blocked_ops");
   cct->get_admin_socket()->unregister_command("dump_historic_ops");
   cct->get_admin_socket()->unregister_command("dump_op_pq_state");
+  cct->get_admin_socket()->unregister_command("dump_client_throttles");
   cct->get_admin_socket()->unregister_command("dump_blacklist");
   cct->get_admin_socket()->unregister_command("dump_watchers");
   cct->get_admin_socket()->unregister_command("dump_reservations");
+  cct->get_admin_socket()->unregister_command("dump_heartbeat_peers");
+  cct->get_admin_socket()->unregister_command("dump_backfill_scheduler");
   cct->get_admin_socket()->unregister_command("get_latest_osdmap");
   cct->get_admin_socket()->unregister_command("set_heap_property");
   cct->get_admin_socket()->unregister_command("get_heap_property");
@@ -2829,10 +3152,14 @@ int OSD::shutdown()
   heartbeat_thread.join();
 
   osd_tp.drain();
-  peering_wq.clear();
   osd_tp.stop();
   dout(10) << "osd tp stopped" << dendl;
 
+  osd_peering_tp.drain();
+  peering_wq.clear();
+  osd_peering_tp.stop();
+  dout(10) << "peering tp stopped" << dendl;
+
   osd_op_tp.drain();
   osd_op_tp.stop();
   dout(10) << "op sharded tp stopped" << dendl;
@@ -2858,6 +3185,10 @@ int OSD::shutdown()
     Mutex::Locker l(tick_timer_lock);
     tick_timer_without_osd_lock.shutdown();
   }
+  {
+    Mutex::Locker l(client_throttle_timer_lock);
+    client_throttle_timer.shutdown();
+  }
 
   // note unmount epoch
   dout(10) << "noting clean unmount in epoch " << osdmap->get_epoch() << dendl;
@@ -2883,6 +3214,10 @@ int OSD::shutdown()
 #endif
   {
     RWLock::RLocker l(pg_map_lock);
+    // unpublish the pgs first: clear() returns only after lock-free
+    // readers are done with the old map, so none can pin a pg whose
+    // PGMap ref we drop below
+    pg_lookup.clear();
     for (ceph::unordered_map<spg_t, PG*>::iterator p = pg_map.begin();
         p != pg_map.end();
         ++p) {
@@ -3175,6 +3510,7 @@ PG *OSD::_open_lock_pg(
     RWLock::WLocker l(pg_map_lock);
     pg->lock(no_lockdep_check);
     pg_map[pgid] = pg;
+    pg_lookup.set(pgid, pg);
     pg->get("PGMap");  // because it's in pg_map
     service.pg_add_epoch(pg->info.pgid, createmap->get_epoch());
   }
@@ -3205,6 +3541,7 @@ void OSD::add_newly_split_pg(PG *pg, PG::RecoveryCtx *rctx)
   epoch_t e(service.get_osdmap()->get_epoch());
   pg->get("PGMap");  // For pg_map
   pg_map[pg->info.pgid] = pg;
+  pg_lookup.set(pg->info.pgid, pg);
   service.pg_add_epoch(pg->info.pgid, pg->get_osdmap()->get_epoch());
 
   dout(10) << "Adding newly split pg " << *pg << dendl;
@@ -3327,6 +3664,16 @@ PGRef OSD::get_pg_or_queue_for_pg(const spg_t& pgid, OpRequestRef& op,
   // get_pg_or_queue_for_pg is only called from the fast_dispatch path where
   // the session_dispatch_lock must already be held.
   assert(session->session_dispatch_lock.is_locked());
+
+  // fast path: the pg exists and nothing is queued for it yet
+  if (!session->waiting_for_pg.count(pgid)) {
+    PGRef out;
+    if (pg_lookup.lookup(pgid, [&out](PG *pg) { out = pg; }))
+      return out;
+  }
+
+  // the pg may be created before we get on its waiting list; look again
+  // under pg_map_lock so that wake_pg_waiters() can't run in between
   RWLock::RLocker l(pg_map_lock);
 
   ceph::unordered_map<spg_t, PG*>::iterator i = pg_map.find(pgid);
@@ -3348,13 +3695,19 @@ PGRef OSD::get_pg_or_queue_for_pg(const spg_t& pgid, OpRequestRef& op,
 
 PG *OSD::_lookup_lock_pg(spg_t pgid)
 {
-  RWLock::RLocker l(pg_map_lock);
-
-  auto pg_map_entry = pg_map.find(pgid);
-  if (pg_map_entry == pg_map.end())
+  // pin the pg without pg_map_lock, then make sure it wasn't removed
+  // while we waited for its lock: _remove_pg drops it from pg_lookup
+  // with the pg locked
+  PGRef ref;
+  if (!pg_lookup.lookup(pgid, [&ref](PG *pg) { ref = pg; }))
     return nullptr;
-  PG *pg = pg_map_entry->second;
+  PG *pg = ref.get();
   pg->lock();
+  PG *cur = nullptr;
+  if (!pg_lookup.lookup(pgid, &cur) || cur != pg) {
+    pg->unlock();
+    return nullptr;
+  }
   return pg;
 }
 
@@ -3383,6 +3736,8 @@ void OSD::load_pgs()
 
   bool has_upgraded = false;
 
+  // the pgs are opened first, and their state read after in parallel
+  vector<pair<PG*,bufferlist>> loading;
   for (vector<coll_t>::iterator it = ls.begin();
        it != ls.end();
        ++it) {
@@ -3440,10 +3795,15 @@ void OSD::load_pgs()
     // there can be no waiters here, so we don't call wake_pg_waiters
 
     pg->ch = store->open_collection(pg->coll);
+    loading.push_back(make_pair(pg, std::move(bl)));
+  }
 
-    // read pg state, log
-    pg->read_state(store, bl);
+  // read pg state, log
+  _read_pg_states(loading);
 
+  for (auto& p : loading) {
+    PG *pg = p.first;
+    spg_t pgid = pg->info.pgid;
     if (pg->must_upgrade()) {
       if (!pg->can_upgrade()) {
 	derr << "PG needs upgrade, but on-disk data is too old; upgrade to"
@@ -3511,6 +3871,51 @@ void OSD::load_pgs()
   build_past_intervals_parallel();
 }
 
+/*
+ * reading the info, log and missing set of a pg mostly waits on the
+ * store, and pgs don't share any of it, so on a large or slow disk
+ * it pays off to have several reads in flight.
+ */
+void OSD::_read_pg_states(vector<pair<PG*,bufferlist>>& loading)
+{
+  int num_threads = MIN(cct->_conf->osd_load_pgs_threads, (int)loading.size());
+  if (num_threads <= 1) {
+    for (auto& p : loading)
+      p.first->read_state(store, p.second);
+    return;
+  }
+
+  class Reader : public Thread {
+    ObjectStore *store;
+    vector<pair<PG*,bufferlist>>& loading;
+    std::atomic<size_t>& next;
+  public:
+    Reader(ObjectStore *s, vector<pair<PG*,bufferlist>>& l,
+	   std::atomic<size_t>& n)
+      : store(s), loading(l), next(n) {}
+    void *entry() override {
+      size_t i;
+      while ((i = next++) < loading.size())
+	loading[i].first->read_state(store, loading[i].second);
+      return NULL;
+    }
+  };
+
+  dout(10) << __func__ << " reading " << loading.size() << " pgs with "
+	   << num_threads << " threads" << dendl;
+  std::atomic<size_t> next = {0};
+  vector<Reader*> readers;
+  for (int i = 0; i < num_threads; ++i) {
+    Reader *r = new Reader(store, loading, next);
+    r->create("osd_load_pgs");
+    readers.push_back(r);
+  }
+  for (auto r : readers) {
+    r->join();
+    delete r;
+  }
+}
+
 
 /*
  * build past_intervals efficiently on old, degraded, and buried
@@ -4219,6 +4624,8 @@ void OSD::handle_osd_ping(MOSDPing *m)
 		   << " last_rx_front " << i->second.last_rx_front
 		   << dendl;
 	  i->second.last_rx_back = m->stamp;
+	  heartbeat_note_rtt(m->stamp, &i->second.last_rtt_back,
+			     &i->second.rtt_back);
 	  // if there is no front con, set both stamps.
 	  if (i->second.con_front == NULL)
 	    i->second.last_rx_front = m->stamp;
@@ -4230,6 +4637,8 @@ void OSD::handle_osd_ping(MOSDPing *m)
 		   << " last_rx_front " << i->second.last_rx_front << " -> " << m->stamp
 		   << dendl;
 	  i->second.last_rx_front = m->stamp;
+	  heartbeat_note_rtt(m->stamp, &i->second.last_rtt_front,
+			     &i->second.rtt_front);
 	}
 
         utime_t cutoff = ceph_clock_now();
@@ -4278,8 +4687,40 @@ void OSD::handle_osd_ping(MOSDPing *m)
   m->put();
 }
 
+void OSD::heartbeat_note_rtt(utime_t stamp, utime_t *last, pow2_hist_t *hist)
+{
+  assert(heartbeat_lock.is_locked());
+  utime_t rtt = ceph_clock_now();
+  if (rtt < stamp)
+    return;
+  rtt -= stamp;
+  *last = rtt;
+  logger->tinc(l_osd_hb_rtt, rtt);
+
+  uint64_t usec = rtt.to_nsec() / 1000;
+  hist->add(MIN(usec, (uint64_t)INT32_MAX));
+  int64_t samples = 0;
+  for (auto n : hist->h)
+    samples += n;
+  if (samples >= cct->_conf->osd_heartbeat_rtt_history)
+    hist->decay();
+}
+
 void OSD::heartbeat_entry()
 {
+  int prio = cct->_conf->osd_heartbeat_thread_rt_priority;
+  if (prio > 0) {
+    struct sched_param sp;
+    sp.sched_priority = prio;
+    int r = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+    if (r != 0)
+      derr << __func__ << " unable to set SCHED_FIFO priority " << prio
+	   << ": " << cpp_strerror(r) << dendl;
+    else
+      dout(1) << __func__ << " running SCHED_FIFO at priority " << prio
+	      << dendl;
+  }
+
   Mutex::Locker l(heartbeat_lock);
   if (is_stopping())
     return;
@@ -4552,6 +4993,7 @@ void OSD::tick_without_osd_lock()
       sched_scrub();
     }
     service.promote_throttle_recalibrate();
+    service.backfill_recalibrate();
   }
 
   check_ops_in_flight();
@@ -5190,6 +5632,7 @@ void OSD::_collect_metadata(map<string,string> *pm)
 
   // backend
   (*pm)["osd_objectstore"] = store->get_type();
+  (*pm)["osd_store_csum"] = store->has_builtin_csum() ? "1" : "0";
   store->collect_metadata(pm);
 
   collect_sys_info(pm, cct);
@@ -6073,6 +6516,8 @@ void OSD::dispatch_session_waiting(Session *session, OSDMapRef osdmap)
   auto i = session->waiting_on_map.begin();
   while (i != session->waiting_on_map.end()) {
     OpRequest *op = &(*i);
+    if (!client_throttle_admit(session, op))
+      break;
     session->waiting_on_map.erase(i++);
     if (!dispatch_op_fast(op, osdmap)) {
       session->waiting_on_map.push_front(*op);
@@ -6090,6 +6535,64 @@ void OSD::dispatch_session_waiting(Session *session, OSDMapRef osdmap)
 }
 
 
+/**
+ * charge a client op to its client's throttle
+ *
+ * An op that has to wait stays at the head of waiting_on_map, so the
+ * client's later ops queue behind it in order, and a timer dispatches
+ * the session again once the throttle has refilled.
+ *
+ * @return true if op may be dispatched now
+ */
+bool OSD::client_throttle_admit(Session *session, OpRequest *op)
+{
+  assert(session->session_dispatch_lock.is_locked());
+  const md_config_t *conf = cct->_conf;
+  if (op->client_throttled ||
+      (conf->osd_client_throttle_ops <= 0 &&
+       conf->osd_client_throttle_bytes <= 0))
+    return true;
+  const Message *m = op->get_req();
+  if (m->get_type() != CEPH_MSG_OSD_OP ||
+      !m->get_source().is_client())
+    return true;
+
+  if (!session->throttle) {
+    string key;
+    if (conf->osd_client_throttle_policy == "entity") {
+      key = session->entity_name.to_str();
+    } else {
+      ostringstream ss;
+      ss << m->get_source_inst();
+      key = ss.str();
+    }
+    session->throttle = client_throttles.get(key);
+  }
+
+  utime_t now = ceph_clock_now();
+  utime_t retry, waited;
+  if (!session->throttle->admit(conf->osd_client_throttle_ops,
+				conf->osd_client_throttle_bytes,
+				conf->osd_client_throttle_burst,
+				now, m->get_data_len(), &retry, &waited)) {
+    if (!session->throttle_retry_scheduled) {
+      dout(20) << __func__ << " " << session->throttle->name
+	       << " holding " << *m << " until " << retry << dendl;
+      op->mark_delayed("waiting for client throttle");
+      logger->inc(l_osd_client_throttle_delayed);
+      session->throttle_retry_scheduled = true;
+      Mutex::Locker l(client_throttle_timer_lock);
+      client_throttle_timer.add_event_at(
+	retry, new C_ClientThrottleRetry(this, session));
+    }
+    return false;
+  }
+  op->client_throttled = true;
+  if (waited != utime_t())
+    logger->tinc(l_osd_client_throttle_lat, waited);
+  return true;
+}
+
 void OSD::update_waiting_for_pg(Session *session, OSDMapRef newmap)
 {
   assert(session->session_dispatch_lock.is_locked());
@@ -6178,6 +6681,15 @@ void OSD::ms_fast_dispatch(Message *m)
     m->put();
     return;
   }
+  if (m->get_type() == MSG_OSD_REPOP_BATCH) {
+    MOSDRepOpBatch *batch = static_cast<MOSDRepOpBatch*>(m);
+    list<Message*> ops;
+    batch->claim_ops(&ops);
+    batch->put();
+    for (auto op : ops)
+      ms_fast_dispatch(op);
+    return;
+  }
   OpRequestRef op = op_tracker.create_request<OpRequest, Message*>(m);
   {
 #ifdef WITH_LTTNG
@@ -7020,10 +7532,11 @@ void OSD::handle_osd_map(MOSDMap *m)
 
       OSDMap *o = new OSDMap;
       if (e > 1) {
-	bufferlist obl;
-        bool got = get_map_bl(e - 1, obl);
-        assert(got);
-	o->decode(obl);
+	// build on the previous epoch (usually still in the cache),
+	// sharing whatever this incremental leaves alone
+	OSDMapRef prev = service.try_get_map(e - 1);
+	assert(prev);
+	o->share_from(*prev);
       }
 
       OSDMap::Incremental inc;
@@ -7557,6 +8070,8 @@ void OSD::consume_map()
   service.await_reserved_maps();
   service.publish_map(osdmap);
 
+  op_shardedwq.update_mclock_pool_profiles(*osdmap);
+
   dispatch_sessions_waiting_on_map();
 
   // remove any PGs which we no longer host from the session waiting_for_pg lists
@@ -7583,16 +8098,20 @@ void OSD::consume_map()
   // scan pg's
   {
     RWLock::RLocker l(pg_map_lock);
+    uint64_t snap_trim_queue = 0;
     for (ceph::unordered_map<spg_t,PG*>::iterator it = pg_map.begin();
         it != pg_map.end();
         ++it) {
       PG *pg = it->second;
       pg->lock();
       pg->queue_null(osdmap->get_epoch(), osdmap->get_epoch());
+      if (pg->is_primary())
+	snap_trim_queue += pg->snap_trimq.size();
       pg->unlock();
     }
 
     logger->set(l_osd_pg, pg_map.size());
+    logger->set(l_osd_snap_trim_queue, snap_trim_queue);
   }
   logger->set(l_osd_pg_primary, num_pg_primary);
   logger->set(l_osd_pg_replica, num_pg_replica);
@@ -8552,6 +9071,7 @@ void OSD::_remove_pg(PG *pg)
 
   // remove from map
   pg_map.erase(pg->info.pgid);
+  pg_lookup.erase(pg->info.pgid);
   pg->put("PGMap"); // since we've taken it out of map
 }
 
@@ -8827,7 +9347,7 @@ void OSD::handle_op(OpRequestRef& op, OSDMapRef& osdmap)
   }
 
   // ok, we didn't have the PG.
-  if (!cct->_conf->osd_debug_misdirected_ops) {
+  if (!service.op_conf->osd_debug_misdirected_ops) {
     return;
   }
   // let's see if it's our fault or the client's.  note that this might
@@ -8987,32 +9507,58 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb )
   }
   pair<PGRef, PGQueueable> item = sdata->pqueue->dequeue();
   sdata->pg_for_processing[&*(item.first)].push_back(item.second);
+  // in run-to-completion mode this is the shard's only thread: take a
+  // batch off the queue and run each pg's share of it under one pg lock
+  vector<PGRef> pgs;
+  pgs.push_back(item.first);
+  if (run_to_completion) {
+    for (size_t n = 1;
+	 n < run_to_completion_batch && !sdata->pqueue->empty();
+	 ++n) {
+      pair<PGRef, PGQueueable> next = sdata->pqueue->dequeue();
+      list<PGQueueable>& l = sdata->pg_for_processing[&*(next.first)];
+      if (l.empty())
+	pgs.push_back(next.first);
+      l.push_back(next.second);
+    }
+  }
   sdata->sdata_op_ordering_lock.Unlock();
   ThreadPool::TPHandle tp_handle(osd->cct, hb, timeout_interval,
     suicide_interval);
 
-  (item.first)->lock_suspend_timeout(tp_handle);
-
-  boost::optional<PGQueueable> op;
-  {
-    Mutex::Locker l(sdata->sdata_op_ordering_lock);
-    if (!sdata->pg_for_processing.count(&*(item.first))) {
-      (item.first)->unlock();
-      return;
+  for (auto& pg : pgs) {
+    pg->lock_suspend_timeout(tp_handle);
+    bool first = true;
+    while (first || run_to_completion) {
+      first = false;
+      boost::optional<PGQueueable> op;
+      {
+	Mutex::Locker l(sdata->sdata_op_ordering_lock);
+	auto p = sdata->pg_for_processing.find(&*pg);
+	if (p == sdata->pg_for_processing.end())
+	  break;
+	assert(p->second.size());
+	op = p->second.front();
+	p->second.pop_front();
+	if (p->second.empty())
+	  sdata->pg_for_processing.erase(p);
+      }
+      tp_handle.reset_tp_timeout();
+      _process_op(pg, *op, tp_handle);
     }
-    assert(sdata->pg_for_processing[&*(item.first)].size());
-    op = sdata->pg_for_processing[&*(item.first)].front();
-    sdata->pg_for_processing[&*(item.first)].pop_front();
-    if (!(sdata->pg_for_processing[&*(item.first)].size()))
-      sdata->pg_for_processing.erase(&*(item.first));
+    pg->unlock();
   }
+}
 
+void OSD::ShardedOpWQ::_process_op(PGRef& pg, PGQueueable& op,
+				   ThreadPool::TPHandle& tp_handle)
+{
   // osd:opwq_process marks the point at which an operation has been dequeued
   // and will begin to be handled by a worker thread.
   {
 #ifdef WITH_LTTNG
     osd_reqid_t reqid;
-    if (boost::optional<OpRequestRef> _op = op->maybe_get_op()) {
+    if (boost::optional<OpRequestRef> _op = op.maybe_get_op()) {
       reqid = (*_op)->get_reqid();
     }
 #endif
@@ -9029,20 +9575,18 @@ void OSD::ShardedOpWQ::_process(uint32_t thread_index, heartbeat_handle_d *hb )
   delete f;
   *_dout << dendl;
 
-  op->run(osd, item.first, tp_handle);
+  op.run(osd, pg, tp_handle);
 
   {
 #ifdef WITH_LTTNG
     osd_reqid_t reqid;
-    if (boost::optional<OpRequestRef> _op = op->maybe_get_op()) {
+    if (boost::optional<OpRequestRef> _op = op.maybe_get_op()) {
       reqid = (*_op)->get_reqid();
     }
 #endif
     tracepoint(osd, opwq_process_finish, reqid.name._type,
         reqid.name._num, reqid.tid, reqid.inc);
   }
-
-  (item.first)->unlock();
 }
 
 void OSD::ShardedOpWQ::_enqueue(pair<PGRef, PGQueueable> item) {
@@ -9100,6 +9644,19 @@ void OSD::ShardedOpWQ::_enqueue_front(pair<PGRef, PGQueueable> item) {
 
 }
 
+void OSD::ShardedOpWQ::update_mclock_pool_profiles(const OSDMap& osdmap)
+{
+  if (osd->op_queue != mclock_opclass)
+    return;
+  for (auto sdata : shard_list) {
+    Mutex::Locker l(sdata->sdata_op_ordering_lock);
+    mClockOpClassQueue *q =
+      static_cast<mClockOpClassQueue*>(sdata->pqueue.get());
+    q->set_pool_profiles(
+      mClockOpClassQueue::get_pool_profiles(osdmap, q->get_client_info()));
+  }
+}
+
 
 /*
  * NOTE: dequeue called in worker thread, with pg lock
@@ -9245,10 +9802,12 @@ const char** OSD::get_tracked_conf_keys() const
 {
   static const char* KEYS[] = {
     "osd_max_backfills",
+    "osd_backfill_adaptive",
     "osd_min_recovery_priority",
     "osd_op_complaint_time", "osd_op_log_threshold",
     "osd_op_history_size", "osd_op_history_duration",
     "osd_enable_op_tracker",
+    "osd_op_tracker_sample_every", "osd_op_tracker_escalate_after",
     "osd_map_cache_size",
     "osd_map_max_advance",
     "osd_pg_epoch_persisted_max_stale",
@@ -9276,9 +9835,10 @@ const char** OSD::get_tracked_conf_keys() const
 void OSD::handle_conf_change(const struct md_config_t *conf,
 			     const std::set <std::string> &changed)
 {
-  if (changed.count("osd_max_backfills")) {
-    service.local_reserver.set_max(cct->_conf->osd_max_backfills);
-    service.remote_reserver.set_max(cct->_conf->osd_max_backfills);
+  if (changed.count("osd_max_backfills") ||
+      changed.count("osd_backfill_adaptive")) {
+    // the adaptive scheduler starts over from osd_max_backfills
+    service.backfill_reset_max();
   }
   if (changed.count("osd_min_recovery_priority")) {
     service.local_reserver.set_min_priority(cct->_conf->osd_min_recovery_priority);
@@ -9300,6 +9860,11 @@ void OSD::handle_conf_change(const struct md_config_t *conf,
   if (changed.count("osd_enable_op_tracker")) {
       op_tracker.set_tracking(cct->_conf->osd_enable_op_tracker);
   }
+  if (changed.count("osd_op_tracker_sample_every") ||
+      changed.count("osd_op_tracker_escalate_after")) {
+    op_tracker.set_sampling(cct->_conf->osd_op_tracker_sample_every,
+			    cct->_conf->osd_op_tracker_escalate_after);
+  }
   if (changed.count("osd_disk_thread_ioprio_class") ||
       changed.count("osd_disk_thread_ioprio_priority")) {
     set_disk_tp_priority();
@@ -9607,9 +10172,13 @@ int OSD::init_op_flags(OpRequestRef& op)
 }
 
 void OSD::PeeringWQ::_dequeue(list<PG*> *out) {
+  // split a large backlog evenly over the peering threads instead of
+  // letting the first one to wake up take a whole batch
+  uint64_t threads = MAX(1, osd->cct->_conf->osd_peering_threads);
+  uint64_t batch = MIN(osd->cct->_conf->osd_peering_wq_batch_size,
+		       MAX(1, (peering_queue.size() + threads - 1) / threads));
   for (list<PG*>::iterator i = peering_queue.begin();
-      i != peering_queue.end() &&
-      out->size() < osd->cct->_conf->osd_peering_wq_batch_size;
+      i != peering_queue.end() && out->size() < batch;
       ) {
         if (in_use.count(*i)) {
           ++i;
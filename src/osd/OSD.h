@@ -21,10 +21,12 @@
 
 #include "common/Mutex.h"
 #include "common/RWLock.h"
+#include "common/RCUMap.h"
 #include "common/Timer.h"
 #include "common/WorkQueue.h"
 #include "common/AsyncReserver.h"
 #include "common/ceph_context.h"
+#include "common/config_snapshot.h"
 
 #include "mgr/MgrClient.h"
 
@@ -38,6 +40,8 @@
 
 #include "OpRequest.h"
 #include "Session.h"
+#include "PGQueueable.h"
+#include "RepOpBatcher.h"
 
 #include <atomic>
 #include <map>
@@ -52,6 +56,7 @@ using namespace std;
 #include "common/sharedptr_registry.hpp"
 #include "common/WeightedPriorityQueue.h"
 #include "common/PrioritizedQueue.h"
+#include "mClockOpClassQueue.h"
 #include "messages/MOSDOp.h"
 #include "include/Spinlock.h"
 #include "common/EventTrace.h"
@@ -70,6 +75,7 @@ enum {
   l_osd_op_prepare_lat,
   l_osd_op_r,
   l_osd_op_r_outb,
+  l_osd_op_r_copyb,
   l_osd_op_r_lat,
   l_osd_op_r_lat_outb_hist,
   l_osd_op_r_process_lat,
@@ -89,6 +95,19 @@ enum {
   l_osd_op_rw_process_lat,
   l_osd_op_rw_prepare_lat,
 
+  l_osd_op_small_read_fast,
+  l_osd_op_small_read_slow,
+
+  l_osd_obc_cache_hit,
+  l_osd_obc_cache_miss,
+  l_osd_obc_cache_evict,
+
+  l_osd_repop_batch,
+  l_osd_repop_batch_ops,
+
+  l_osd_client_throttle_delayed,
+  l_osd_client_throttle_lat,
+
   l_osd_sop,
   l_osd_sop_inb,
   l_osd_sop_lat,
@@ -104,6 +123,7 @@ enum {
   l_osd_pull,
   l_osd_push,
   l_osd_push_outb,
+  l_osd_push_partial,
 
   l_osd_rop,
 
@@ -119,6 +139,7 @@ enum {
   l_osd_pg_replica,
   l_osd_pg_stray,
   l_osd_hb_to,
+  l_osd_hb_rtt,
   l_osd_map,
   l_osd_mape,
   l_osd_mape_dup,
@@ -166,6 +187,31 @@ enum {
   l_osd_pg_fastinfo,
   l_osd_pg_biginfo,
 
+  l_osd_snap_trim_queue,
+  l_osd_snap_trim_txns,
+  l_osd_snap_trim_objects,
+
+  l_osd_scrub_chunks,
+  l_osd_scrub_objects,
+  l_osd_scrub_bytes,
+  l_osd_scrub_skipped,
+  l_osd_scrub_wait,
+
+  l_osd_ec_cache_hit,
+  l_osd_ec_cache_miss,
+
+  // mclock_opclass queue depth and latency, in PGQueueable::op_type_t order
+  l_osd_mclock_client_len,
+  l_osd_mclock_client_lat,
+  l_osd_mclock_subop_len,
+  l_osd_mclock_subop_lat,
+  l_osd_mclock_snaptrim_len,
+  l_osd_mclock_snaptrim_lat,
+  l_osd_mclock_recovery_len,
+  l_osd_mclock_recovery_lat,
+  l_osd_mclock_scrub_len,
+  l_osd_mclock_scrub_lat,
+
   l_osd_last,
 };
 
@@ -332,96 +378,21 @@ typedef ceph::shared_ptr<DeletingState> DeletingStateRef;
 
 class OSD;
 
-struct PGScrub {
-  epoch_t epoch_queued;
-  explicit PGScrub(epoch_t e) : epoch_queued(e) {}
-  ostream &operator<<(ostream &rhs) {
-    return rhs << "PGScrub";
-  }
-};
-
-struct PGSnapTrim {
-  epoch_t epoch_queued;
-  explicit PGSnapTrim(epoch_t e) : epoch_queued(e) {}
-  ostream &operator<<(ostream &rhs) {
-    return rhs << "PGSnapTrim";
-  }
-};
-
-struct PGRecovery {
-  epoch_t epoch_queued;
-  uint64_t reserved_pushes;
-  PGRecovery(epoch_t e, uint64_t reserved_pushes)
-    : epoch_queued(e), reserved_pushes(reserved_pushes) {}
-  ostream &operator<<(ostream &rhs) {
-    return rhs << "PGRecovery(epoch=" << epoch_queued
-	       << ", reserved_pushes: " << reserved_pushes << ")";
-  }
-};
-
-
-class PGQueueable {
-  typedef boost::variant<
-    OpRequestRef,
-    PGSnapTrim,
-    PGScrub,
-    PGRecovery
-    > QVariant;
-  QVariant qvariant;
-  int cost; 
-  unsigned priority;
-  utime_t start_time;
-  entity_inst_t owner;
-  struct RunVis : public boost::static_visitor<> {
-    OSD *osd;
-    PGRef &pg;
-    ThreadPool::TPHandle &handle;
-    RunVis(OSD *osd, PGRef &pg, ThreadPool::TPHandle &handle)
-      : osd(osd), pg(pg), handle(handle) {}
-    void operator()(const OpRequestRef &op);
-    void operator()(const PGSnapTrim &op);
-    void operator()(const PGScrub &op);
-    void operator()(const PGRecovery &op);
-  };
-public:
-  // cppcheck-suppress noExplicitConstructor
-  PGQueueable(OpRequestRef op)
-    : qvariant(op), cost(op->get_req()->get_cost()),
-      priority(op->get_req()->get_priority()),
-      start_time(op->get_req()->get_recv_stamp()),
-      owner(op->get_req()->get_source_inst())
-    {}
-  PGQueueable(
-    const PGSnapTrim &op, int cost, unsigned priority, utime_t start_time,
-    const entity_inst_t &owner)
-    : qvariant(op), cost(cost), priority(priority), start_time(start_time),
-      owner(owner) {}
-  PGQueueable(
-    const PGScrub &op, int cost, unsigned priority, utime_t start_time,
-    const entity_inst_t &owner)
-    : qvariant(op), cost(cost), priority(priority), start_time(start_time),
-      owner(owner) {}
-  PGQueueable(
-    const PGRecovery &op, int cost, unsigned priority, utime_t start_time,
-    const entity_inst_t &owner)
-    : qvariant(op), cost(cost), priority(priority), start_time(start_time),
-      owner(owner) {}
-  const boost::optional<OpRequestRef> maybe_get_op() const {
-    const OpRequestRef *op = boost::get<OpRequestRef>(&qvariant);
-    return op ? OpRequestRef(*op) : boost::optional<OpRequestRef>();
-  }
-  uint64_t get_reserved_pushes() const {
-    const PGRecovery *op = boost::get<PGRecovery>(&qvariant);
-    return op ? op->reserved_pushes : 0;
-  }
-  void run(OSD *osd, PGRef &pg, ThreadPool::TPHandle &handle) {
-    RunVis v(osd, pg, handle);
-    boost::apply_visitor(v, qvariant);
-  }
-  unsigned get_priority() const { return priority; }
-  int get_cost() const { return cost; }
-  utime_t get_start_time() const { return start_time; }
-  entity_inst_t get_owner() const { return owner; }
+/// options read on every client op; see ConfigSnapshot
+struct OSDOpConf {
+  uint32_t osd_max_object_name_len;
+  uint32_t osd_max_object_namespace_len;
+  int osd_max_write_size;
+  bool osd_backoff_on_degraded;
+  bool osd_backoff_on_unfound;
+  bool osd_backoff_on_peering;
+  bool osd_small_read_fast_path;
+  uint64_t osd_small_read_max_len;
+  bool osd_debug_op_order;
+  bool osd_debug_misdirected_ops;
+
+  explicit OSDOpConf(const md_config_t *conf);
+  static const char *tracked_keys[];
 };
 
 class OSDService {
@@ -442,6 +413,8 @@ private:
 public:
   PerfCounters *&logger;
   PerfCounters *&recoverystate_perf;
+  RepOpBatcher repop_batcher;
+  ConfigSnapshot<OSDOpConf> op_conf;
   MonClient   *&monc;
   ShardedThreadPool::ShardedWQ < pair <PGRef, PGQueueable> > &op_wq;
   ThreadPool::BatchWorkQueue<PG> &peering_wq;
@@ -612,10 +585,12 @@ public:
   pair<ConnectionRef,ConnectionRef> get_con_osd_hb(int peer, epoch_t from_epoch);  // (back, front)
   void send_message_osd_cluster(int peer, Message *m, epoch_t from_epoch);
   void send_message_osd_cluster(Message *m, Connection *con) {
+    if (cct->_conf->osd_repop_batch)
+      repop_batcher.flush(con);
     con->send_message(m);
   }
   void send_message_osd_cluster(Message *m, const ConnectionRef& con) {
-    con->send_message(m);
+    send_message_osd_cluster(m, con.get());
   }
   void send_message_osd_client(Message *m, Connection *con) {
     con->send_message(m);
@@ -712,6 +687,22 @@ public:
   void dec_scrubs_pending();
   void dec_scrubs_active();
 
+  // -- scrub bandwidth budget --
+  // shared by every pg scrubbing on this osd; a chunk's bytes push
+  // scrub_budget_next out by bytes / osd_scrub_bandwidth, and the next
+  // chunk waits (on scrub_sleep_timer, not in a worker) until then
+private:
+  Mutex scrub_budget_lock;
+  utime_t scrub_budget_next;
+public:
+  /// charge the budget for bytes read by a scrub chunk
+  void scrub_charge(uint64_t bytes);
+  /// seconds until the budget allows another chunk, 0 if it does now
+  double scrub_budget_delay();
+
+  Mutex scrub_sleep_lock;
+  SafeTimer scrub_sleep_timer;
+
   void reply_op_error(OpRequestRef op, int err);
   void reply_op_error(OpRequestRef op, int err, eversion_t v, version_t uv);
   void handle_misdirected_op(PG *pg, OpRequestRef op);
@@ -897,6 +888,22 @@ public:
   AsyncReserver<spg_t> local_reserver;
   AsyncReserver<spg_t> remote_reserver;
 
+  // -- adaptive backfill reservations --
+  // with osd_backfill_adaptive, every tick the local and remote reserver
+  // limit is halved while client ops or the store are slower than their
+  // targets, and grows by one while reservations are waiting otherwise
+private:
+  Mutex backfill_sched_lock;
+  pair<uint64_t, uint64_t> backfill_last_op_lat; ///< l_osd_op_lat (n, ms)
+  double backfill_client_lat;    ///< mean client op latency last tick (s)
+  uint32_t backfill_commit_lat;  ///< store commit latency last tick (ms)
+  unsigned backfill_waiting;     ///< reservations and recoveries waiting
+  const char *backfill_decision;
+public:
+  void backfill_recalibrate();
+  void backfill_reset_max();
+  void dump_backfill_scheduler(Formatter *f);
+
   // -- pg_temp --
 private:
   Mutex pg_temp_lock;
@@ -1395,6 +1402,7 @@ public:
 private:
 
   ThreadPool osd_tp;
+  ThreadPool osd_peering_tp;
   ShardedThreadPool osd_op_tp;
   ThreadPool disk_tp;
   ThreadPool command_tp;
@@ -1453,6 +1461,13 @@ private:
   void session_notify_pg_cleared(Session *session, OSDMapRef osdmap, spg_t pgid);
   void dispatch_session_waiting(Session *session, OSDMapRef osdmap);
 
+  // -- client admission control --
+  ClientThrottleMap client_throttles;
+  Mutex client_throttle_timer_lock;
+  SafeTimer client_throttle_timer;  ///< retries ops held back by a throttle
+  class C_ClientThrottleRetry;
+  bool client_throttle_admit(Session *session, OpRequest *op);
+
   Mutex session_waiting_lock;
   set<Session*> session_waiting_for_map;
   map<spg_t, set<Session*> > session_waiting_for_pg;
@@ -1619,6 +1634,10 @@ private:
     utime_t last_rx_front;  ///< last time we got a ping reply on the front side
     utime_t last_rx_back;   ///< last time we got a ping reply on the back side
     epoch_t epoch;      ///< most recent epoch we wanted this peer
+    utime_t last_rtt_front;  ///< round trip time of the last front ping
+    utime_t last_rtt_back;   ///< round trip time of the last back ping
+    pow2_hist_t rtt_front;   ///< front ping round trip times, in usec
+    pow2_hist_t rtt_back;    ///< back ping round trip times, in usec
 
     bool is_unhealthy(utime_t cutoff) const {
       return
@@ -1633,6 +1652,21 @@ private:
       return last_rx_front > cutoff && last_rx_back > cutoff;
     }
 
+    void dump(Formatter *f) const {
+      f->dump_int("osd", peer);
+      f->dump_stream("first_tx") << first_tx;
+      f->dump_stream("last_tx") << last_tx;
+      f->dump_stream("last_rx_front") << last_rx_front;
+      f->dump_stream("last_rx_back") << last_rx_back;
+      f->dump_float("last_rtt_front", last_rtt_front);
+      f->dump_float("last_rtt_back", last_rtt_back);
+      f->open_object_section("rtt_front_usec");
+      rtt_front.dump(f);
+      f->close_section();
+      f->open_object_section("rtt_back_usec");
+      rtt_back.dump(f);
+      f->close_section();
+    }
   };
   /// state attached to outgoing heartbeat connections
   struct HeartbeatSession : public RefCountedObject {
@@ -1669,6 +1703,7 @@ private:
   }
   void heartbeat();
   void heartbeat_check();
+  void heartbeat_note_rtt(utime_t stamp, utime_t *last, pow2_hist_t *hist);
   void heartbeat_entry();
   void need_heartbeat_peer_update();
 
@@ -1746,7 +1781,8 @@ private:
   // -- op queue --
   enum io_queue {
     prioritized,
-    weightedpriority};
+    weightedpriority,
+    mclock_opclass};
   const io_queue op_queue;
   const unsigned int op_prio_cutoff;
 
@@ -1762,7 +1798,7 @@ private:
       ShardData(
 	string lock_name, string ordering_lock,
 	uint64_t max_tok_per_prio, uint64_t min_cost, CephContext *cct,
-	io_queue opqueue)
+	io_queue opqueue, PerfCounters *&logger)
 	: sdata_lock(lock_name.c_str(), false, true, false, cct),
 	  sdata_op_ordering_lock(ordering_lock.c_str(), false, true, false, cct) {
 	    if (opqueue == weightedpriority) {
@@ -1775,6 +1811,9 @@ private:
 		<PrioritizedQueue< pair<PGRef, PGQueueable>, entity_inst_t>>(
 		  new PrioritizedQueue< pair<PGRef, PGQueueable>, entity_inst_t>(
 		    max_tok_per_prio, min_cost));
+	    } else if (opqueue == mclock_opclass) {
+	      pqueue = std::unique_ptr<mClockOpClassQueue>(
+		new mClockOpClassQueue(cct, logger));
 	    }
 	  }
     };
@@ -1782,11 +1821,19 @@ private:
     vector<ShardData*> shard_list;
     OSD *osd;
     uint32_t num_shards;
+    const bool run_to_completion;
+    const size_t run_to_completion_batch;
+
+    void _process_op(PGRef& pg, PGQueueable& op,
+		     ThreadPool::TPHandle& tp_handle);
 
   public:
     ShardedOpWQ(uint32_t pnum_shards, OSD *o, time_t ti, time_t si, ShardedThreadPool* tp):
       ShardedThreadPool::ShardedWQ < pair <PGRef, PGQueueable> >(ti, si, tp),
-      osd(o), num_shards(pnum_shards) {
+      osd(o), num_shards(pnum_shards),
+      run_to_completion(o->cct->_conf->osd_op_run_to_completion),
+      run_to_completion_batch(
+	std::max(1, (int)o->cct->_conf->osd_op_run_to_completion_batch)) {
       for(uint32_t i = 0; i < num_shards; i++) {
 	char lock_name[32] = {0};
 	snprintf(lock_name, sizeof(lock_name), "%s.%d", "OSD:ShardedOpWQ:", i);
@@ -1797,7 +1844,8 @@ private:
 	ShardData* one_shard = new ShardData(
 	  lock_name, order_lock,
 	  osd->cct->_conf->osd_op_pq_max_tokens_per_priority, 
-	  osd->cct->_conf->osd_op_pq_min_cost, osd->cct, osd->op_queue);
+	  osd->cct->_conf->osd_op_pq_min_cost, osd->cct, osd->op_queue,
+	  osd->logger);
 	shard_list.push_back(one_shard);
       }
     }
@@ -1811,6 +1859,8 @@ private:
 
     void _process(uint32_t thread_index, heartbeat_handle_d *hb);
     void _enqueue(pair <PGRef, PGQueueable> item);
+    /// pick up per-pool mclock client profiles from a new map
+    void update_mclock_pool_profiles(const OSDMap& osdmap);
     void _enqueue_front(pair <PGRef, PGQueueable> item);
       
     void return_waiting_threads() {
@@ -2036,6 +2086,9 @@ protected:
   // -- placement groups --
   RWLock pg_map_lock; // this lock orders *above* individual PG _locks
   ceph::unordered_map<spg_t, PG*> pg_map; // protected by pg_map lock
+  /// lock-free copy of pg_map for the op fast path; updated with pg_map
+  /// under pg_map_lock, before the PGMap ref is dropped
+  RCUMap<spg_t, PG*> pg_lookup;
 
   map<spg_t, list<PG::CephPeeringEvtRef> > peering_wait_for_split;
   PGRecoveryStats pg_recovery_stats;
@@ -2085,6 +2138,7 @@ protected:
     PG::CephPeeringEvtRef evt);
   
   void load_pgs();
+  void _read_pg_states(vector<pair<PG*,bufferlist>>& loading);
   void build_past_intervals_parallel();
 
   /// project pg history from from to now
@@ -2392,6 +2446,7 @@ protected:
     case MSG_OSD_REP_SCRUB:
     case MSG_OSD_PG_UPDATE_LOG_MISSING:
     case MSG_OSD_PG_UPDATE_LOG_MISSING_REPLY:
+    case MSG_OSD_REPOP_BATCH:
       return true;
     default:
       return false;
@@ -2417,6 +2472,8 @@ protected:
       return (rand() % 2 < 1) ? prioritized : weightedpriority;
     } else if (cct->_conf->osd_op_queue == "wpq") {
       return weightedpriority;
+    } else if (cct->_conf->osd_op_queue == "mclock_opclass") {
+      return mclock_opclass;
     } else {
       return prioritized;
     }
@@ -30,6 +30,8 @@
  
 #define dout_subsys ceph_subsys_osd
 
+MEMPOOL_DEFINE_OBJECT_FACTORY(OSDMap, osdmap, osdmap);
+
 // ----------------------------------
 // osd_info_t
 
@@ -100,23 +102,25 @@ void osd_xinfo_t::dump(Formatter *f) const
   f->dump_int("laggy_interval", laggy_interval);
   f->dump_int("features", features);
   f->dump_unsigned("old_weight", old_weight);
+  f->dump_bool("store_csum", store_csum);
 }
 
 void osd_xinfo_t::encode(bufferlist& bl) const
 {
-  ENCODE_START(3, 1, bl);
+  ENCODE_START(4, 1, bl);
   ::encode(down_stamp, bl);
   __u32 lp = laggy_probability * 0xfffffffful;
   ::encode(lp, bl);
   ::encode(laggy_interval, bl);
   ::encode(features, bl);
   ::encode(old_weight, bl);
+  ::encode(store_csum, bl);
   ENCODE_FINISH(bl);
 }
 
 void osd_xinfo_t::decode(bufferlist::iterator& bl)
 {
-  DECODE_START(3, bl);
+  DECODE_START(4, bl);
   ::decode(down_stamp, bl);
   __u32 lp;
   ::decode(lp, bl);
@@ -130,6 +134,10 @@ void osd_xinfo_t::decode(bufferlist::iterator& bl)
     ::decode(old_weight, bl);
   else
     old_weight = 0;
+  if (struct_v >= 4)
+    ::decode(store_csum, bl);
+  else
+    store_csum = false;
   DECODE_FINISH(bl);
 }
 
@@ -141,6 +149,7 @@ void osd_xinfo_t::generate_test_instances(list<osd_xinfo_t*>& o)
   o.back()->laggy_probability = .123;
   o.back()->laggy_interval = 123456;
   o.back()->old_weight = 0x7fff;
+  o.back()->store_csum = true;
 }
 
 ostream& operator<<(ostream& out, const osd_xinfo_t& xi)
@@ -148,7 +157,8 @@ ostream& operator<<(ostream& out, const osd_xinfo_t& xi)
   return out << "down_stamp " << xi.down_stamp
 	     << " laggy_probability " << xi.laggy_probability
 	     << " laggy_interval " << xi.laggy_interval
-	     << " old_weight " << xi.old_weight;
+	     << " old_weight " << xi.old_weight
+	     << " store_csum " << xi.store_csum;
 }
 
 // ----------------------------------
@@ -415,7 +425,11 @@ void OSDMap::Incremental::encode(bufferlist& bl, uint64_t features) const
   ENCODE_START(8, 7, bl);
 
   {
-    ENCODE_START(3, 1, bl); // client-usable data
+    uint8_t v = 4;
+    if (!HAVE_FEATURE(features, SERVER_LUMINOUS)) {
+      v = 3;
+    }
+    ENCODE_START(v, 1, bl); // client-usable data
     ::encode(fsid, bl);
     ::encode(epoch, bl);
     ::encode(modified, bl);
@@ -436,6 +450,12 @@ void OSDMap::Incremental::encode(bufferlist& bl, uint64_t features) const
     ::encode(new_primary_affinity, bl);
     ::encode(new_erasure_code_profiles, bl);
     ::encode(old_erasure_code_profiles, bl);
+    if (v >= 4) {
+      ::encode(new_pg_upmap, bl);
+      ::encode(old_pg_upmap, bl);
+      ::encode(new_pg_upmap_items, bl);
+      ::encode(old_pg_upmap_items, bl);
+    }
     ENCODE_FINISH(bl); // client-usable data
   }
 
@@ -597,7 +617,7 @@ void OSDMap::Incremental::decode(bufferlist::iterator& bl)
     return;
   }
   {
-    DECODE_START(3, bl); // client-usable data
+    DECODE_START(4, bl); // client-usable data
     ::decode(fsid, bl);
     ::decode(epoch, bl);
     ::decode(modified, bl);
@@ -626,6 +646,12 @@ void OSDMap::Incremental::decode(bufferlist::iterator& bl)
       new_erasure_code_profiles.clear();
       old_erasure_code_profiles.clear();
     }
+    if (struct_v >= 4) {
+      ::decode(new_pg_upmap, bl);
+      ::decode(old_pg_upmap, bl);
+      ::decode(new_pg_upmap_items, bl);
+      ::decode(old_pg_upmap_items, bl);
+    }
     DECODE_FINISH(bl); // client-usable data
   }
 
@@ -789,6 +815,45 @@ void OSDMap::Incremental::dump(Formatter *f) const
   }
   f->close_section(); // primary_temp
 
+  f->open_array_section("new_pg_upmap");
+  for (auto& p : new_pg_upmap) {
+    f->open_object_section("mapping");
+    f->dump_stream("pgid") << p.first;
+    f->open_array_section("osds");
+    for (auto q : p.second) {
+      f->dump_int("osd", q);
+    }
+    f->close_section();
+    f->close_section();
+  }
+  f->close_section();
+  f->open_array_section("old_pg_upmap");
+  for (auto& p : old_pg_upmap) {
+    f->dump_stream("pgid") << p;
+  }
+  f->close_section();
+
+  f->open_array_section("new_pg_upmap_items");
+  for (auto& p : new_pg_upmap_items) {
+    f->open_object_section("mapping");
+    f->dump_stream("pgid") << p.first;
+    f->open_array_section("mappings");
+    for (auto& q : p.second) {
+      f->open_object_section("mapping");
+      f->dump_int("from", q.first);
+      f->dump_int("to", q.second);
+      f->close_section();
+    }
+    f->close_section();
+    f->close_section();
+  }
+  f->close_section();
+  f->open_array_section("old_pg_upmap_items");
+  for (auto& p : old_pg_upmap_items) {
+    f->dump_stream("pgid") << p;
+  }
+  f->close_section();
+
   f->open_array_section("new_up_thru");
   for (map<int32_t,uint32_t>::const_iterator p = new_up_thru.begin(); p != new_up_thru.end(); ++p) {
     f->open_object_section("osd");
@@ -920,13 +985,21 @@ void OSDMap::set_max_osd(int m)
   }
   osd_info.resize(m);
   osd_xinfo.resize(m);
-  osd_addrs->client_addr.resize(m);
-  osd_addrs->cluster_addr.resize(m);
-  osd_addrs->hb_back_addr.resize(m);
-  osd_addrs->hb_front_addr.resize(m);
-  osd_uuid->resize(m);
-  if (osd_primary_affinity)
+  if (osd_addrs->client_addr.size() != (size_t)m) {
+    _unshare(osd_addrs);
+    osd_addrs->client_addr.resize(m);
+    osd_addrs->cluster_addr.resize(m);
+    osd_addrs->hb_back_addr.resize(m);
+    osd_addrs->hb_front_addr.resize(m);
+  }
+  if (osd_uuid->size() != (size_t)m) {
+    _unshare(osd_uuid);
+    osd_uuid->resize(m);
+  }
+  if (osd_primary_affinity && osd_primary_affinity->size() != (size_t)m) {
+    _unshare(osd_primary_affinity);
     osd_primary_affinity->resize(m, CEPH_OSD_DEFAULT_PRIMARY_AFFINITY);
+  }
 
   calc_num_osds();
 }
@@ -1041,6 +1114,16 @@ uint64_t OSDMap::get_features(int entity_type, uint64_t *pmask) const
   if (crush->has_nondefault_tunables5())
     features |= CEPH_FEATURE_CRUSH_TUNABLES5;
   mask |= CEPH_FEATURES_CRUSH;
+  if (crush->has_choose_args()) {
+    // shares its bit with SERVER_LUMINOUS, so only claim it when used
+    features |= CEPH_FEATUREMASK_CRUSH_CHOOSE_ARGS;
+    mask |= CEPH_FEATUREMASK_CRUSH_CHOOSE_ARGS;
+  }
+  if (!pg_upmap.empty() || !pg_upmap_items.empty()) {
+    // likewise
+    features |= CEPH_FEATUREMASK_OSDMAP_PG_UPMAP;
+    mask |= CEPH_FEATUREMASK_OSDMAP_PG_UPMAP;
+  }
 
   for (auto p = pools.begin(); p != pools.end(); ++p) {
     if (p->second.has_flag(pg_pool_t::FLAG_HASHPSPOOL)) {
@@ -1143,10 +1226,13 @@ void OSDMap::dedup(const OSDMap *o, OSDMap *n)
 
   int diff = 0;
 
-  // do addrs match?
+  // do addrs match?  (n's may already be shared, with o or with the map
+  // it was built from; it must not be changed then)
   if (o->max_osd != n->max_osd)
     diff++;
-  for (int i = 0; i < o->max_osd && i < n->max_osd; i++) {
+  for (int i = 0;
+       n->osd_addrs.use_count() == 1 && i < o->max_osd && i < n->max_osd;
+       i++) {
     if ( n->osd_addrs->client_addr[i] &&  o->osd_addrs->client_addr[i] &&
 	*n->osd_addrs->client_addr[i] == *o->osd_addrs->client_addr[i])
       n->osd_addrs->client_addr[i] = o->osd_addrs->client_addr[i];
@@ -1168,35 +1254,46 @@ void OSDMap::dedup(const OSDMap *o, OSDMap *n)
     else
       diff++;
   }
-  if (diff == 0) {
+  if (diff == 0 && n->osd_addrs.use_count() == 1) {
     // zoinks, no differences at all!
     n->osd_addrs = o->osd_addrs;
   }
 
   // does crush match?
-  bufferlist oc, nc;
-  ::encode(*o->crush, oc, CEPH_FEATURES_SUPPORTED_DEFAULT);
-  ::encode(*n->crush, nc, CEPH_FEATURES_SUPPORTED_DEFAULT);
-  if (oc.contents_equal(nc)) {
-    n->crush = o->crush;
+  if (o->crush != n->crush) {
+    bufferlist oc, nc;
+    ::encode(*o->crush, oc, CEPH_FEATURES_SUPPORTED_DEFAULT);
+    ::encode(*n->crush, nc, CEPH_FEATURES_SUPPORTED_DEFAULT);
+    if (oc.contents_equal(nc)) {
+      n->crush = o->crush;
+    }
   }
 
   // does pg_temp match?
-  if (o->pg_temp->size() == n->pg_temp->size()) {
+  if (o->pg_temp != n->pg_temp &&
+      o->pg_temp->size() == n->pg_temp->size()) {
     if (*o->pg_temp == *n->pg_temp)
       n->pg_temp = o->pg_temp;
   }
 
   // does primary_temp match?
-  if (o->primary_temp->size() == n->primary_temp->size()) {
+  if (o->primary_temp != n->primary_temp &&
+      o->primary_temp->size() == n->primary_temp->size()) {
     if (*o->primary_temp == *n->primary_temp)
       n->primary_temp = o->primary_temp;
   }
 
   // do uuids match?
-  if (o->osd_uuid->size() == n->osd_uuid->size() &&
+  if (o->osd_uuid != n->osd_uuid &&
+      o->osd_uuid->size() == n->osd_uuid->size() &&
       *o->osd_uuid == *n->osd_uuid)
     n->osd_uuid = o->osd_uuid;
+
+  // do affinities match?
+  if (o->osd_primary_affinity && n->osd_primary_affinity &&
+      o->osd_primary_affinity != n->osd_primary_affinity &&
+      *o->osd_primary_affinity == *n->osd_primary_affinity)
+    n->osd_primary_affinity = o->osd_primary_affinity;
 }
 
 void OSDMap::clean_temps(CephContext *cct,
@@ -1207,7 +1304,7 @@ void OSDMap::clean_temps(CephContext *cct,
   tmpmap.deepish_copy_from(osdmap);
   tmpmap.apply_incremental(*pending_inc);
 
-  for (map<pg_t,vector<int32_t> >::iterator p = tmpmap.pg_temp->begin();
+  for (pg_temp_map_t::iterator p = tmpmap.pg_temp->begin();
        p != tmpmap.pg_temp->end();
        ++p) {
     // if pool does not exist, remove any existing pg_temps associated with
@@ -1246,7 +1343,7 @@ void OSDMap::clean_temps(CephContext *cct,
 	pending_inc->new_pg_temp.erase(p->first);
     }
   }
-  for (map<pg_t,int32_t>::iterator p = tmpmap.primary_temp->begin();
+  for (primary_temp_map_t::iterator p = tmpmap.primary_temp->begin();
        p != tmpmap.primary_temp->end();
        ++p) {
     // primary down?
@@ -1274,6 +1371,53 @@ void OSDMap::clean_temps(CephContext *cct,
   }
 }
 
+void OSDMap::clean_pg_upmaps(CephContext *cct,
+			     const OSDMap& osdmap, Incremental *pending_inc)
+{
+  ldout(cct, 10) << __func__ << dendl;
+  OSDMap tmpmap;
+  tmpmap.deepish_copy_from(osdmap);
+  tmpmap.apply_incremental(*pending_inc);
+
+  // an exception is only worth keeping while its pg exists and all of
+  // its targets do; the osds being out is fine, _apply_upmap skips those
+  auto pg_is_gone = [&](pg_t pg) {
+    return !tmpmap.pg_exists(pg);
+  };
+  auto osd_is_gone = [&](int osd) {
+    return osd != CRUSH_ITEM_NONE && !tmpmap.exists(osd);
+  };
+
+  for (auto& p : tmpmap.pg_upmap) {
+    bool remove = pg_is_gone(p.first);
+    if (!remove) {
+      const pg_pool_t *pool = tmpmap.get_pg_pool(p.first.pool());
+      remove = p.second.size() != pool->get_size() ||
+	std::any_of(p.second.begin(), p.second.end(), osd_is_gone);
+    }
+    if (remove) {
+      ldout(cct, 10) << __func__ << " removing pg_upmap " << p.first
+		     << " " << p.second << dendl;
+      pending_inc->new_pg_upmap.erase(p.first);
+      if (osdmap.pg_upmap.count(p.first))
+	pending_inc->old_pg_upmap.insert(p.first);
+    }
+  }
+  for (auto& p : tmpmap.pg_upmap_items) {
+    bool remove = pg_is_gone(p.first);
+    for (auto i = p.second.begin(); !remove && i != p.second.end(); ++i) {
+      remove = osd_is_gone(i->first) || osd_is_gone(i->second);
+    }
+    if (remove) {
+      ldout(cct, 10) << __func__ << " removing pg_upmap_items " << p.first
+		     << " " << p.second << dendl;
+      pending_inc->new_pg_upmap_items.erase(p.first);
+      if (osdmap.pg_upmap_items.count(p.first))
+	pending_inc->old_pg_upmap_items.insert(p.first);
+    }
+  }
+}
+
 int OSDMap::apply_incremental(const Incremental &inc)
 {
   new_blacklist_entries = false;
@@ -1375,6 +1519,8 @@ int OSDMap::apply_incremental(const Incremental &inc)
     if ((osd_state[i->first] & CEPH_OSD_EXISTS) &&
 	(s & CEPH_OSD_EXISTS)) {
       // osd is destroyed; clear out anything interesting.
+      _unshare(osd_uuid);
+      _unshare(osd_addrs);
       (*osd_uuid)[i->first] = uuid_d();
       osd_info[i->first] = osd_info_t();
       osd_xinfo[i->first] = osd_xinfo_t();
@@ -1389,6 +1535,8 @@ int OSDMap::apply_incremental(const Incremental &inc)
       osd_state[i->first] ^= s;
     }
   }
+  if (!inc.new_up_client.empty() || !inc.new_up_cluster.empty())
+    _unshare(osd_addrs);
   for (map<int32_t,entity_addr_t>::const_iterator i = inc.new_up_client.begin();
        i != inc.new_up_client.end();
        ++i) {
@@ -1431,10 +1579,16 @@ int OSDMap::apply_incremental(const Incremental &inc)
     osd_xinfo[p->first] = p->second;
 
   // uuid
+  if (!inc.new_uuid.empty())
+    _unshare(osd_uuid);
   for (map<int32_t,uuid_d>::const_iterator p = inc.new_uuid.begin(); p != inc.new_uuid.end(); ++p) 
     (*osd_uuid)[p->first] = p->second;
 
   // pg rebuild
+  if (!inc.new_pg_temp.empty())
+    _unshare(pg_temp);
+  if (!inc.new_primary_temp.empty())
+    _unshare(primary_temp);
   for (map<pg_t, vector<int> >::const_iterator p = inc.new_pg_temp.begin(); p != inc.new_pg_temp.end(); ++p) {
     if (p->second.empty())
       pg_temp->erase(p->first);
@@ -1451,6 +1605,19 @@ int OSDMap::apply_incremental(const Incremental &inc)
       (*primary_temp)[p->first] = p->second;
   }
 
+  for (auto& p : inc.new_pg_upmap) {
+    pg_upmap[p.first] = p.second;
+  }
+  for (auto& pg : inc.old_pg_upmap) {
+    pg_upmap.erase(pg);
+  }
+  for (auto& p : inc.new_pg_upmap_items) {
+    pg_upmap_items[p.first] = p.second;
+  }
+  for (auto& pg : inc.old_pg_upmap_items) {
+    pg_upmap_items.erase(pg);
+  }
+
   // blacklist
   if (!inc.new_blacklist.empty()) {
     blacklist.insert(inc.new_blacklist.begin(),inc.new_blacklist.end());
@@ -1565,7 +1732,7 @@ int OSDMap::_pg_to_raw_osds(
   // what crush rule?
   int ruleno = crush->find_rule(pool.get_crush_ruleset(), pool.get_type(), size);
   if (ruleno >= 0)
-    crush->do_rule(ruleno, pps, *osds, size, osd_weight);
+    crush->do_rule(ruleno, pps, *osds, size, osd_weight, pg.pool());
 
   _remove_nonexistent_osds(pool, *osds);
 
@@ -1582,6 +1749,39 @@ int OSDMap::_pg_to_raw_osds(
   return osds->size();
 }
 
+void OSDMap::_apply_upmap(const pg_pool_t& pool, pg_t raw_pg,
+			  vector<int> *raw) const
+{
+  pg_t pg = pool.raw_pg_to_pg(raw_pg);
+  auto p = pg_upmap.find(pg);
+  if (p != pg_upmap.end()) {
+    // ignore the whole mapping if any of its targets is out
+    bool valid = true;
+    for (auto osd : p->second) {
+      if (osd != CRUSH_ITEM_NONE && osd < max_osd && osd_weight[osd] == 0) {
+	valid = false;
+	break;
+      }
+    }
+    if (valid)
+      *raw = vector<int>(p->second.begin(), p->second.end());
+  }
+
+  auto q = pg_upmap_items.find(pg);
+  if (q != pg_upmap_items.end()) {
+    for (auto& r : q->second) {
+      if (r.second != CRUSH_ITEM_NONE && r.second < max_osd &&
+	  osd_weight[r.second] == 0)
+	continue;  // target is out
+      if (std::find(raw->begin(), raw->end(), r.second) != raw->end())
+	continue;  // target is already mapped
+      auto i = std::find(raw->begin(), raw->end(), r.first);
+      if (i != raw->end())
+	*i = r.second;
+    }
+  }
+}
+
 // pg -> (up osd list)
 void OSDMap::_raw_to_up_osds(const pg_pool_t& pool, const vector<int>& raw,
                              vector<int> *up, int *primary) const
@@ -1668,7 +1868,7 @@ void OSDMap::_get_temp_osds(const pg_pool_t& pool, pg_t pg,
                             vector<int> *temp_pg, int *temp_primary) const
 {
   pg = pool.raw_pg_to_pg(pg);
-  map<pg_t,vector<int32_t> >::const_iterator p = pg_temp->find(pg);
+  pg_temp_map_t::const_iterator p = pg_temp->find(pg);
   temp_pg->clear();
   if (p != pg_temp->end()) {
     for (unsigned i=0; i<p->second.size(); i++) {
@@ -1683,7 +1883,7 @@ void OSDMap::_get_temp_osds(const pg_pool_t& pool, pg_t pg,
       }
     }
   }
-  map<pg_t,int32_t>::const_iterator pp = primary_temp->find(pg);
+  primary_temp_map_t::const_iterator pp = primary_temp->find(pg);
   *temp_primary = -1;
   if (pp != primary_temp->end()) {
     *temp_primary = pp->second;
@@ -1721,6 +1921,7 @@ void OSDMap::pg_to_raw_up(pg_t pg, vector<int> *up, int *primary) const
   vector<int> raw;
   ps_t pps;
   _pg_to_raw_osds(*pool, pg, &raw, primary, &pps);
+  _apply_upmap(*pool, pg, &raw);
   _raw_to_up_osds(*pool, raw, up, primary);
   _apply_primary_affinity(pps, *pool, up, primary);
 }
@@ -1728,7 +1929,7 @@ void OSDMap::pg_to_raw_up(pg_t pg, vector<int> *up, int *primary) const
 void OSDMap::_pg_to_up_acting_osds(
   const pg_t& pg, vector<int> *up, int *up_primary,
   vector<int> *acting, int *acting_primary,
-  bool raw_pg_to_pg) const
+  bool raw_pg_to_pg, vector<int> *raw_upmap) const
 {
   const pg_pool_t *pool = get_pg_pool(pg.pool());
   if (!pool ||
@@ -1741,6 +1942,8 @@ void OSDMap::_pg_to_up_acting_osds(
       acting->clear();
     if (acting_primary)
       *acting_primary = -1;
+    if (raw_upmap)
+      raw_upmap->clear();
     return;
   }
   vector<int> raw;
@@ -1750,8 +1953,9 @@ void OSDMap::_pg_to_up_acting_osds(
   int _acting_primary;
   ps_t pps;
   _get_temp_osds(*pool, pg, &_acting, &_acting_primary);
-  if (_acting.empty() || up || up_primary) {
+  if (_acting.empty() || up || up_primary || raw_upmap) {
     _pg_to_raw_osds(*pool, pg, &raw, &_up_primary, &pps);
+    _apply_upmap(*pool, pg, &raw);
     _raw_to_up_osds(*pool, raw, &_up, &_up_primary);
     _apply_primary_affinity(pps, *pool, &_up, &_up_primary);
     if (_acting.empty()) {
@@ -1765,6 +1969,8 @@ void OSDMap::_pg_to_up_acting_osds(
       up->swap(_up);
     if (up_primary)
       *up_primary = _up_primary;
+    if (raw_upmap)
+      raw_upmap->swap(raw);
   }
 
   if (acting)
@@ -1853,7 +2059,7 @@ void OSDMap::encode_client_old(bufferlist& bl) const
   // for ::encode(pg_temp, bl);
   n = pg_temp->size();
   ::encode(n, bl);
-  for (map<pg_t,vector<int32_t> >::const_iterator p = pg_temp->begin();
+  for (pg_temp_map_t::const_iterator p = pg_temp->begin();
        p != pg_temp->end();
        ++p) {
     old_pg_t opg = p->first.get_old_pg();
@@ -1937,7 +2143,11 @@ void OSDMap::encode(bufferlist& bl, uint64_t features) const
   ENCODE_START(8, 7, bl);
 
   {
-    ENCODE_START(3, 1, bl); // client-usable data
+    uint8_t v = 4;
+    if (!HAVE_FEATURE(features, SERVER_LUMINOUS)) {
+      v = 3;
+    }
+    ENCODE_START(v, 1, bl); // client-usable data
     // base
     ::encode(fsid, bl);
     ::encode(epoch, bl);
@@ -1969,6 +2179,10 @@ void OSDMap::encode(bufferlist& bl, uint64_t features) const
     crush->encode(cbl, features);
     ::encode(cbl, bl);
     ::encode(erasure_code_profiles, bl);
+    if (v >= 4) {
+      ::encode(pg_upmap, bl);
+      ::encode(pg_upmap_items, bl);
+    }
     ENCODE_FINISH(bl); // client-usable data
   }
 
@@ -2135,6 +2349,14 @@ void OSDMap::decode_classic(bufferlist::iterator& p)
 
 void OSDMap::decode(bufferlist::iterator& bl)
 {
+  // we may share these with another map (see share_from()); decode
+  // into our own
+  osd_addrs = std::make_shared<addrs_s>();
+  pg_temp = std::make_shared<pg_temp_map_t>();
+  primary_temp = std::make_shared<primary_temp_map_t>();
+  osd_uuid = std::make_shared<mempool::osdmap::vector<uuid_d>>();
+  crush = std::make_shared<CrushWrapper>();
+
   /**
    * Older encodings of the OSDMap had a single struct_v which
    * covered the whole encoding, and was prior to our modern
@@ -2157,7 +2379,7 @@ void OSDMap::decode(bufferlist::iterator& bl)
    * Since we made it past that hurdle, we can use our normal paths.
    */
   {
-    DECODE_START(3, bl); // client-usable data
+    DECODE_START(4, bl); // client-usable data
     // base
     ::decode(fsid, bl);
     ::decode(epoch, bl);
@@ -2196,6 +2418,13 @@ void OSDMap::decode(bufferlist::iterator& bl)
     } else {
       erasure_code_profiles.clear();
     }
+    if (struct_v >= 4) {
+      ::decode(pg_upmap, bl);
+      ::decode(pg_upmap_items, bl);
+    } else {
+      pg_upmap.clear();
+      pg_upmap_items.clear();
+    }
     DECODE_FINISH(bl); // client-usable data
   }
 
@@ -2339,7 +2568,7 @@ void OSDMap::dump(Formatter *f) const
   f->close_section();
 
   f->open_array_section("pg_temp");
-  for (map<pg_t,vector<int32_t> >::const_iterator p = pg_temp->begin();
+  for (pg_temp_map_t::const_iterator p = pg_temp->begin();
        p != pg_temp->end();
        ++p) {
     f->open_object_section("osds");
@@ -2353,7 +2582,7 @@ void OSDMap::dump(Formatter *f) const
   f->close_section();
 
   f->open_array_section("primary_temp");
-  for (map<pg_t, int32_t>::const_iterator p = primary_temp->begin();
+  for (primary_temp_map_t::const_iterator p = primary_temp->begin();
       p != primary_temp->end();
       ++p) {
     f->dump_stream("pgid") << p->first;
@@ -2361,6 +2590,35 @@ void OSDMap::dump(Formatter *f) const
   }
   f->close_section(); // primary_temp
 
+  f->open_array_section("pg_upmap");
+  for (auto& p : pg_upmap) {
+    f->open_object_section("mapping");
+    f->dump_stream("pgid") << p.first;
+    f->open_array_section("osds");
+    for (auto q : p.second) {
+      f->dump_int("osd", q);
+    }
+    f->close_section();
+    f->close_section();
+  }
+  f->close_section(); // pg_upmap
+
+  f->open_array_section("pg_upmap_items");
+  for (auto& p : pg_upmap_items) {
+    f->open_object_section("mapping");
+    f->dump_stream("pgid") << p.first;
+    f->open_array_section("mappings");
+    for (auto& q : p.second) {
+      f->open_object_section("mapping");
+      f->dump_int("from", q.first);
+      f->dump_int("to", q.second);
+      f->close_section();
+    }
+    f->close_section();
+    f->close_section();
+  }
+  f->close_section(); // pg_upmap_items
+
   f->open_object_section("blacklist");
   for (ceph::unordered_map<entity_addr_t,utime_t>::const_iterator p = blacklist.begin();
        p != blacklist.end();
@@ -2503,16 +2761,23 @@ void OSDMap::print(ostream& out) const
   }
   out << std::endl;
 
-  for (map<pg_t,vector<int32_t> >::const_iterator p = pg_temp->begin();
+  for (pg_temp_map_t::const_iterator p = pg_temp->begin();
        p != pg_temp->end();
        ++p)
     out << "pg_temp " << p->first << " " << p->second << "\n";
 
-  for (map<pg_t,int32_t>::const_iterator p = primary_temp->begin();
+  for (primary_temp_map_t::const_iterator p = primary_temp->begin();
       p != primary_temp->end();
       ++p)
     out << "primary_temp " << p->first << " " << p->second << "\n";
 
+  for (auto& p : pg_upmap) {
+    out << "pg_upmap " << p.first << " " << p.second << "\n";
+  }
+  for (auto& p : pg_upmap_items) {
+    out << "pg_upmap_items " << p.first << " " << p.second << "\n";
+  }
+
   for (ceph::unordered_map<entity_addr_t,utime_t>::const_iterator p = blacklist.begin();
        p != blacklist.end();
        ++p)
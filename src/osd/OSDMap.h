@@ -89,9 +89,10 @@ struct osd_xinfo_t {
   __u32 laggy_interval;    ///< average interval between being marked laggy and recovering
   uint64_t features;       ///< features supported by this osd we should know about
   __u32 old_weight;        ///< weight prior to being auto marked out
+  bool store_csum;         ///< store checksums all data (as of last boot)
 
   osd_xinfo_t() : laggy_probability(0), laggy_interval(0),
-                  features(0), old_weight(0) {}
+                  features(0), old_weight(0), store_csum(false) {}
 
   void dump(Formatter *f) const;
   void encode(bufferlist& bl) const;
@@ -106,8 +107,12 @@ ostream& operator<<(ostream& out, const osd_xinfo_t& xi);
 /** OSDMap
  */
 class OSDMap {
-
 public:
+  MEMPOOL_CLASS_HELPERS();
+
+  typedef mempool::osdmap::map<pg_t,vector<int32_t> > pg_temp_map_t;
+  typedef mempool::osdmap::map<pg_t,int32_t> primary_temp_map_t;
+
   class Incremental {
   public:
     /// feature bits we were encoded with.  the subsequent OSDMap
@@ -136,6 +141,10 @@ public:
     map<int32_t,uint32_t> new_weight;
     map<pg_t,vector<int32_t> > new_pg_temp;     // [] to remove
     map<pg_t, int32_t> new_primary_temp;            // [-1] to remove
+    map<pg_t,vector<int32_t> > new_pg_upmap;
+    set<pg_t> old_pg_upmap;
+    map<pg_t,vector<pair<int32_t,int32_t> > > new_pg_upmap_items;
+    set<pg_t> old_pg_upmap_items;
     map<int32_t,uint32_t> new_primary_affinity;
     map<int32_t,epoch_t> new_up_thru;
     map<int32_t,pair<epoch_t,epoch_t> > new_last_clean_interval;
@@ -214,27 +223,38 @@ private:
   int32_t max_osd;
   vector<uint8_t> osd_state;
 
+  /*
+   * The members behind a shared_ptr below are shared between maps of
+   * consecutive epochs (see share_from() and dedup()), so they must
+   * never be modified in place while shared: call _unshare() on one
+   * before changing it.
+   */
   struct addrs_s {
-    vector<ceph::shared_ptr<entity_addr_t> > client_addr;
-    vector<ceph::shared_ptr<entity_addr_t> > cluster_addr;
-    vector<ceph::shared_ptr<entity_addr_t> > hb_back_addr;
-    vector<ceph::shared_ptr<entity_addr_t> > hb_front_addr;
+    mempool::osdmap::vector<ceph::shared_ptr<entity_addr_t> > client_addr;
+    mempool::osdmap::vector<ceph::shared_ptr<entity_addr_t> > cluster_addr;
+    mempool::osdmap::vector<ceph::shared_ptr<entity_addr_t> > hb_back_addr;
+    mempool::osdmap::vector<ceph::shared_ptr<entity_addr_t> > hb_front_addr;
     entity_addr_t blank;
   };
   ceph::shared_ptr<addrs_s> osd_addrs;
 
   vector<__u32>   osd_weight;   // 16.16 fixed point, 0x10000 = "in", 0 = "out"
   vector<osd_info_t> osd_info;
-  ceph::shared_ptr< map<pg_t,vector<int32_t> > > pg_temp;  // temp pg mapping (e.g. while we rebuild)
-  ceph::shared_ptr< map<pg_t,int32_t > > primary_temp;  // temp primary mapping (e.g. while we rebuild)
+  ceph::shared_ptr<pg_temp_map_t> pg_temp;  // temp pg mapping (e.g. while we rebuild)
+  ceph::shared_ptr<primary_temp_map_t> primary_temp;  // temp primary mapping (e.g. while we rebuild)
   ceph::shared_ptr< vector<__u32> > osd_primary_affinity; ///< 16.16 fixed point, 0x10000 = baseline
 
+  /// explicit mappings that replace the crush output of a pg
+  map<pg_t,vector<int32_t> > pg_upmap;
+  /// (from, to) osd substitutions applied to the crush output of a pg
+  map<pg_t,vector<pair<int32_t,int32_t> > > pg_upmap_items;
+
   map<int64_t,pg_pool_t> pools;
   map<int64_t,string> pool_name;
   map<string,map<string,string> > erasure_code_profiles;
   map<string,int64_t> name_pool;
 
-  ceph::shared_ptr< vector<uuid_d> > osd_uuid;
+  ceph::shared_ptr< mempool::osdmap::vector<uuid_d> > osd_uuid;
   vector<osd_xinfo_t> osd_xinfo;
 
   ceph::unordered_map<entity_addr_t,utime_t> blacklist;
@@ -250,6 +270,13 @@ private:
 
   void _calc_up_osd_features();
 
+  /// make *p private to this map, copying it if another map shares it
+  template<typename T>
+  static void _unshare(ceph::shared_ptr<T>& p) {
+    if (p.use_count() > 1)
+      p.reset(new T(*p));
+  }
+
  public:
   bool have_crc() const { return crc_defined; }
   uint32_t get_crc() const { return crc; }
@@ -257,6 +284,7 @@ private:
   ceph::shared_ptr<CrushWrapper> crush;       // hierarchical map
 
   friend class OSDMonitor;
+  friend class OSDMapMapping;
 
  public:
   OSDMap() : epoch(0), 
@@ -265,9 +293,9 @@ private:
 	     num_osd(0), num_up_osd(0), num_in_osd(0),
 	     max_osd(0),
 	     osd_addrs(std::make_shared<addrs_s>()),
-	     pg_temp(std::make_shared<map<pg_t,vector<int32_t>>>()),
-	     primary_temp(std::make_shared<map<pg_t,int32_t>>()),
-	     osd_uuid(std::make_shared<vector<uuid_d>>()),
+	     pg_temp(std::make_shared<pg_temp_map_t>()),
+	     primary_temp(std::make_shared<primary_temp_map_t>()),
+	     osd_uuid(std::make_shared<mempool::osdmap::vector<uuid_d>>()),
 	     cluster_snapshot_epoch(0),
 	     new_blacklist_entries(false),
 	     cached_up_osd_features(0),
@@ -284,9 +312,9 @@ public:
 
   void deepish_copy_from(const OSDMap& o) {
     *this = o;
-    primary_temp.reset(new map<pg_t,int32_t>(*o.primary_temp));
-    pg_temp.reset(new map<pg_t,vector<int32_t> >(*o.pg_temp));
-    osd_uuid.reset(new vector<uuid_d>(*o.osd_uuid));
+    primary_temp.reset(new primary_temp_map_t(*o.primary_temp));
+    pg_temp.reset(new pg_temp_map_t(*o.pg_temp));
+    osd_uuid.reset(new mempool::osdmap::vector<uuid_d>(*o.osd_uuid));
 
     if (o.osd_primary_affinity)
       osd_primary_affinity.reset(new vector<__u32>(*o.osd_primary_affinity));
@@ -298,6 +326,16 @@ public:
     // allocate a new CrushWrapper, though.
   }
 
+  /**
+   * Become a copy of @p o that shares its crush map, addrs, uuids,
+   * affinities and temp mappings.  Applying an incremental to the copy
+   * only copies the parts the incremental changes, so this is much
+   * cheaper than decoding the previous epoch to build the next one.
+   */
+  void share_from(const OSDMap& o) {
+    *this = o;
+  }
+
   // map info
   const uuid_d& get_fsid() const { return fsid; }
   void set_fsid(uuid_d& f) { fsid = f; }
@@ -342,6 +380,12 @@ public:
   unsigned get_num_pg_temp() const {
     return pg_temp->size();
   }
+  const map<pg_t,vector<int32_t> >& get_pg_upmap() const {
+    return pg_upmap;
+  }
+  const map<pg_t,vector<pair<int32_t,int32_t> > >& get_pg_upmap_items() const {
+    return pg_upmap_items;
+  }
 
   int get_flags() const { return flags; }
   bool test_flag(int f) const { return flags & f; }
@@ -384,6 +428,8 @@ public:
     if (!osd_primary_affinity)
       osd_primary_affinity.reset(new vector<__u32>(max_osd,
 						   CEPH_OSD_DEFAULT_PRIMARY_AFFINITY));
+    else
+      _unshare(osd_primary_affinity);
     (*osd_primary_affinity)[o] = w;
   }
   unsigned get_primary_affinity(int o) const {
@@ -576,6 +622,10 @@ public:
   static void clean_temps(CephContext *cct, const OSDMap& osdmap,
 			  Incremental *pending_inc);
 
+  /// drop pg_upmap entries of pending_inc's result that no longer apply
+  static void clean_pg_upmaps(CephContext *cct, const OSDMap& osdmap,
+			      Incremental *pending_inc);
+
   // serialize, unserialize
 private:
   void encode_client_old(bufferlist& bl) const;
@@ -641,6 +691,13 @@ private:
   void _apply_primary_affinity(ps_t seed, const pg_pool_t& pool,
 			       vector<int> *osds, int *primary) const;
 
+  /**
+   * Apply the pg_upmap and then the pg_upmap_items exceptions of @p pg
+   * to its crush output @p raw.  Entries that would map to an osd that
+   * is out, or repeat an osd already in the set, are ignored.
+   */
+  void _apply_upmap(const pg_pool_t& pool, pg_t pg, vector<int> *raw) const;
+
   /// pg -> (up osd list)
   void _raw_to_up_osds(const pg_pool_t& pool, const vector<int>& raw,
                        vector<int> *up, int *primary) const;
@@ -655,11 +712,13 @@ private:
                       vector<int> *temp_pg, int *temp_primary) const;
 
   /**
-   *  map to up and acting. Fills in whatever fields are non-NULL.
+   *  map to up and acting. Fills in whatever fields are non-NULL,
+   *  raw_upmap with the crush output after the pg_upmap exceptions.
    */
   void _pg_to_up_acting_osds(const pg_t& pg, vector<int> *up, int *up_primary,
                              vector<int> *acting, int *acting_primary,
-			     bool raw_pg_to_pg = true) const;
+			     bool raw_pg_to_pg = true,
+			     vector<int> *raw_upmap = NULL) const;
 
 public:
   /***
@@ -679,8 +738,9 @@ public:
     return pg_to_acting_osds(pg, &acting, NULL);
   }
   /**
-   * This does not apply temp overrides and should not be used
-   * by anybody for data mapping purposes. Specify both pointers.
+   * This applies the pg_upmap exceptions but not the temp overrides,
+   * and should not be used by anybody for data mapping purposes.
+   * Specify both pointers.
    */
   void pg_to_raw_up(pg_t pg, vector<int> *up, int *primary) const;
   /**
@@ -698,6 +758,18 @@ public:
     int up_primary, acting_primary;
     pg_to_up_acting_osds(pg, &up, &up_primary, &acting, &acting_primary);
   }
+  /**
+   * pg_to_up_acting_osds(), also returning the crush output after the
+   * pg_upmap exceptions that up was derived from: the osds whose state
+   * the up set depends on.
+   */
+  void pg_to_raw_upmap_up_acting_osds(pg_t pg, vector<int> *raw_upmap,
+				      vector<int> *up, int *up_primary,
+				      vector<int> *acting,
+				      int *acting_primary) const {
+    _pg_to_up_acting_osds(pg, up, up_primary, acting, acting_primary,
+			  true, raw_upmap);
+  }
   bool pg_is_ec(pg_t pg) const {
     map<int64_t, pg_pool_t>::const_iterator i = pools.find(pg.pool());
     assert(i != pools.end());
@@ -860,8 +932,12 @@ public:
   bool crush_ruleset_in_use(int ruleset) const;
 
   void clear_temp() {
-    pg_temp->clear();
-    primary_temp->clear();
+    pg_temp = std::make_shared<pg_temp_map_t>();
+    primary_temp = std::make_shared<primary_temp_map_t>();
+  }
+  void clear_upmap() {
+    pg_upmap.clear();
+    pg_upmap_items.clear();
   }
 
 private:
@@ -41,11 +41,184 @@ void OSDMapMapping::_init_mappings(const OSDMap& osdmap)
   assert(pools.size() == osdmap.get_pools().size());
 }
 
+OSDMapMapping::Inputs::Inputs(const OSDMap& osdmap)
+  : osd_state(osdmap.get_max_osd()),
+    osd_weight(osdmap.osd_weight),
+    osd_primary_affinity(osdmap.get_max_osd()),
+    pools(osdmap.get_pools()),
+    pg_temp(osdmap.pg_temp),
+    primary_temp(osdmap.primary_temp),
+    pg_upmap(osdmap.pg_upmap),
+    pg_upmap_items(osdmap.pg_upmap_items)
+{
+  bufferlist bl;
+  osdmap.crush->encode(bl, CEPH_FEATURES_SUPPORTED_DEFAULT);
+  crush_crc = bl.crc32c(-1);
+  for (int i = 0; i < osdmap.get_max_osd(); ++i) {
+    osd_state[i] = osdmap.get_state(i) & (CEPH_OSD_EXISTS | CEPH_OSD_UP);
+    osd_primary_affinity[i] = osdmap.get_primary_affinity(i);
+  }
+}
+
+// whether two versions of a pool map their pgs the same way
+static bool same_placement(const pg_pool_t& a, const pg_pool_t& b)
+{
+  return a.get_type() == b.get_type() &&
+    a.get_size() == b.get_size() &&
+    a.get_pg_num() == b.get_pg_num() &&
+    a.get_pgp_num() == b.get_pgp_num() &&
+    a.get_crush_ruleset() == b.get_crush_ruleset() &&
+    a.get_flags() == b.get_flags();
+}
+
+// whether the crush rule of a pool can choose osd
+static bool rule_reaches(const OSDMap& osdmap, const pg_pool_t& pool, int osd)
+{
+  const CrushWrapper& crush = *osdmap.crush;
+  int ruleno = crush.find_rule(pool.get_crush_ruleset(), pool.get_type(),
+			       pool.get_size());
+  if (ruleno < 0)
+    return false;
+  for (int step = 0; step < crush.get_rule_len(ruleno); ++step) {
+    if (crush.get_rule_op(ruleno, step) == CRUSH_RULE_TAKE &&
+	crush.subtree_contains(crush.get_rule_arg1(ruleno, step), osd))
+      return true;
+  }
+  return false;
+}
+
+// the keys whose values differ between two maps
+template<class M, class F>
+static void diff_keys(const M& a, const M& b, F f)
+{
+  if (&a == &b)
+    return;
+  auto p = a.begin();
+  auto q = b.begin();
+  while (p != a.end() || q != b.end()) {
+    if (q == b.end() || (p != a.end() && p->first < q->first)) {
+      f(p->first);
+      ++p;
+    } else if (p == a.end() || q->first < p->first) {
+      f(q->first);
+      ++q;
+    } else {
+      if (p->second != q->second)
+	f(p->first);
+      ++p;
+      ++q;
+    }
+  }
+}
+
+void OSDMapMapping::_plan_update(const OSDMap& osdmap)
+{
+  remap_all = true;
+  remap_pools.clear();
+  remap_pgs.clear();
+  num_remapped = 0;
+  for (auto& p : osdmap.get_pools()) {
+    num_remapped += p.second.get_pg_num();
+  }
+
+  const Inputs& next = *next_inputs;
+  if (!inputs ||
+      inputs->crush_crc != next.crush_crc ||
+      inputs->osd_state.size() != next.osd_state.size()) {
+    return;
+  }
+
+  std::set<int64_t> pools;
+  for (auto& p : osdmap.get_pools()) {
+    auto q = inputs->pools.find(p.first);
+    if (q == inputs->pools.end() || !same_placement(q->second, p.second))
+      pools.insert(p.first);
+  }
+
+  // a new weight, or an osd (dis)appearing, can change what crush picks
+  // anywhere under it; an osd going up or down only affects the pgs
+  // whose crush output already includes it
+  std::set<int> moved, changed;
+  for (unsigned i = 0; i < next.osd_state.size(); ++i) {
+    if (inputs->osd_weight[i] != next.osd_weight[i] ||
+	((inputs->osd_state[i] ^ next.osd_state[i]) & CEPH_OSD_EXISTS)) {
+      moved.insert(i);
+      changed.insert(i);
+    } else if (inputs->osd_state[i] != next.osd_state[i] ||
+	       inputs->osd_primary_affinity[i] !=
+	       next.osd_primary_affinity[i]) {
+      changed.insert(i);
+    }
+  }
+  for (auto osd : moved) {
+    for (auto& p : osdmap.get_pools()) {
+      if (!pools.count(p.first) && rule_reaches(osdmap, p.second, osd))
+	pools.insert(p.first);
+    }
+  }
+
+  std::set<pg_t> pgs;
+  auto add = [&](const pg_t& pgid) {
+    if (!pools.count(pgid.pool()) && osdmap.pg_exists(pgid))
+      pgs.insert(pgid);
+  };
+  for (auto osd : changed) {
+    if (osd < (int)raw_rmap.size()) {
+      for (auto pgid : raw_rmap[osd])
+	add(pgid);
+      for (auto pgid : acting_rmap[osd])
+	add(pgid);
+    }
+    // pg_temp members are skipped while they are down
+    for (auto& p : *next.pg_temp) {
+      if (std::find(p.second.begin(), p.second.end(), osd) != p.second.end())
+	add(p.first);
+    }
+  }
+  // upmap targets are skipped while they are out
+  for (auto osd : moved) {
+    for (auto& p : next.pg_upmap) {
+      if (std::find(p.second.begin(), p.second.end(), osd) != p.second.end())
+	add(p.first);
+    }
+    for (auto& p : next.pg_upmap_items) {
+      for (auto& r : p.second) {
+	if (r.second == osd)
+	  add(p.first);
+      }
+    }
+  }
+  diff_keys(*inputs->pg_temp, *next.pg_temp, add);
+  diff_keys(*inputs->primary_temp, *next.primary_temp, add);
+  diff_keys(inputs->pg_upmap, next.pg_upmap, add);
+  diff_keys(inputs->pg_upmap_items, next.pg_upmap_items, add);
+
+  uint64_t n = pgs.size();
+  for (auto pool : pools) {
+    n += osdmap.get_pg_num(pool);
+  }
+  if (n * 2 > num_remapped) {
+    // cheaper to remap everything than to look each pg up
+    return;
+  }
+  remap_all = false;
+  remap_pools.swap(pools);
+  remap_pgs.assign(pgs.begin(), pgs.end());
+  num_remapped = n;
+}
+
 void OSDMapMapping::update(const OSDMap& osdmap)
 {
   _start(osdmap);
   for (auto& p : osdmap.get_pools()) {
-    _update_range(osdmap, p.first, 0, p.second.get_pg_num());
+    if (remap_all || remap_pools.count(p.first)) {
+      _update_range(osdmap, p.first, 0, p.second.get_pg_num());
+    }
+  }
+  if (!remap_all) {
+    for (auto pgid : remap_pgs) {
+      _update_range(osdmap, pgid.pool(), pgid.ps(), pgid.ps() + 1);
+    }
   }
   _finish(osdmap);
   //_dump();  // for debugging
@@ -54,15 +227,21 @@ void OSDMapMapping::update(const OSDMap& osdmap)
 void OSDMapMapping::update(const OSDMap& osdmap, pg_t pgid)
 {
   _update_range(osdmap, pgid.pool(), pgid.ps(), pgid.ps() + 1);
+  // the table no longer reflects a single map
+  inputs.reset();
 }
 
 void OSDMapMapping::_build_rmap(const OSDMap& osdmap)
 {
   acting_rmap.resize(osdmap.get_max_osd());
+  raw_rmap.resize(osdmap.get_max_osd());
   //up_rmap.resize(osdmap.get_max_osd());
   for (auto& v : acting_rmap) {
     v.resize(0);
   }
+  for (auto& v : raw_rmap) {
+    v.resize(0);
+  }
   //for (auto& v : up_rmap) {
   //  v.resize(0);
   //}
@@ -72,13 +251,19 @@ void OSDMapMapping::_build_rmap(const OSDMap& osdmap)
       pgid.set_ps(ps);
       int32_t *row = &p.second.table[p.second.row_size() * ps];
       for (int i = 0; i < row[2]; ++i) {
-	if (row[4 + i] != CRUSH_ITEM_NONE) {
-	  acting_rmap[row[4 + i]].push_back(pgid);
+	if (row[5 + i] != CRUSH_ITEM_NONE) {
+	  acting_rmap[row[5 + i]].push_back(pgid);
 	}
       }
       //for (int i = 0; i < row[3]; ++i) {
-      //up_rmap[row[4 + p.second.size + i]].push_back(pgid);
+      //up_rmap[row[5 + p.second.size + i]].push_back(pgid);
       //}
+      for (int i = 0; i < row[4]; ++i) {
+	int osd = row[5 + 2 * p.second.size + i];
+	if (osd >= 0 && osd < (int)raw_rmap.size()) {
+	  raw_rmap[osd].push_back(pgid);
+	}
+      }
     }
   }
 }
@@ -87,6 +272,8 @@ void OSDMapMapping::_finish(const OSDMap& osdmap)
 {
   _build_rmap(osdmap);
   epoch = osdmap.get_epoch();
+  inputs.swap(next_inputs);
+  next_inputs.reset();
 }
 
 void OSDMapMapping::_dump()
@@ -112,13 +299,13 @@ void OSDMapMapping::_update_range(
   assert(pg_begin <= pg_end);
   assert(pg_end <= i->second.pg_num);
   for (unsigned ps = pg_begin; ps < pg_end; ++ps) {
-    vector<int> up, acting;
+    vector<int> raw, up, acting;
     int up_primary, acting_primary;
-    osdmap.pg_to_up_acting_osds(
+    osdmap.pg_to_raw_upmap_up_acting_osds(
       pg_t(ps, pool),
-      &up, &up_primary, &acting, &acting_primary);
+      &raw, &up, &up_primary, &acting, &acting_primary);
     i->second.set(ps, std::move(up), up_primary,
-		  std::move(acting), acting_primary);
+		  std::move(acting), acting_primary, raw);
   }
 }
 
@@ -148,7 +335,11 @@ void ParallelPGMapper::WQ::_process(Item *i, ThreadPool::TPHandle &h)
 {
   ldout(m->cct, 20) << __func__ << " " << i->job << " " << i->pool
 		    << " [" << i->begin << "," << i->end << ")" << dendl;
-  i->job->process(i->pool, i->begin, i->end);
+  if (!i->pgs.empty()) {
+    i->job->process(i->pgs);
+  } else {
+    i->job->process(i->pool, i->begin, i->end);
+  }
   i->job->finish_one();
   delete i;
 }
@@ -157,13 +348,41 @@ void ParallelPGMapper::queue(
   Job *job,
   unsigned pgs_per_item)
 {
+  std::set<int64_t> pools;
   for (auto& p : job->osdmap->get_pools()) {
-    for (unsigned ps = 0; ps < p.second.get_pg_num(); ps += pgs_per_item) {
-      unsigned ps_end = MIN(ps + pgs_per_item, p.second.get_pg_num());
+    pools.insert(p.first);
+  }
+  queue(job, pgs_per_item, pools, {});
+}
+
+void ParallelPGMapper::queue(
+  Job *job,
+  unsigned pgs_per_item,
+  const std::set<int64_t>& pools,
+  const std::vector<pg_t>& pgs)
+{
+  // hold a shard of our own, so that the job completes even if there
+  // is nothing to queue, and not before everything is
+  job->start_one();
+  for (auto pool : pools) {
+    const pg_pool_t *pi = job->osdmap->get_pg_pool(pool);
+    if (!pi)
+      continue;
+    for (unsigned ps = 0; ps < pi->get_pg_num(); ps += pgs_per_item) {
+      unsigned ps_end = MIN(ps + pgs_per_item, pi->get_pg_num());
       job->start_one();
-      wq.queue(new Item(job, p.first, ps, ps_end));
-      ldout(cct, 20) << __func__ << " " << job << " " << p.first << " [" << ps
+      wq.queue(new Item(job, pool, ps, ps_end));
+      ldout(cct, 20) << __func__ << " " << job << " " << pool << " [" << ps
 		     << "," << ps_end << ")" << dendl;
     }
   }
+  for (auto p = pgs.begin(); p != pgs.end(); ) {
+    auto end = p + MIN((size_t)pgs_per_item, (size_t)(pgs.end() - p));
+    job->start_one();
+    wq.queue(new Item(job, vector<pg_t>(p, end)));
+    ldout(cct, 20) << __func__ << " " << job << " " << (end - p) << " pgs"
+		   << dendl;
+    p = end;
+  }
+  job->finish_one();
 }
@@ -7,6 +7,7 @@
 
 #include <vector>
 #include <map>
+#include <set>
 
 #include "osd/osd_types.h"
 #include "common/WorkQueue.h"
@@ -33,6 +34,11 @@ public:
 
     // child must implement this
     virtual void process(int64_t poolid, unsigned ps_begin, unsigned ps_end) = 0;
+    virtual void process(const std::vector<pg_t>& pgs) {
+      for (auto pgid : pgs) {
+	process(pgid.pool(), pgid.ps(), pgid.ps() + 1);
+      }
+    }
     virtual void complete() = 0;
 
     void set_finish_event(Context *fin) {
@@ -102,12 +108,19 @@ protected:
     Job *job;
     int64_t pool;
     unsigned begin, end;
+    std::vector<pg_t> pgs;  ///< if not empty, map these instead
 
     Item(Job *j, int64_t p, unsigned b, unsigned e)
       : job(j),
 	pool(p),
 	begin(b),
 	end(e) {}
+    Item(Job *j, std::vector<pg_t>&& pgs)
+      : job(j),
+	pool(-1),
+	begin(0),
+	end(0),
+	pgs(std::move(pgs)) {}
   };
   std::deque<Item*> q;
 
@@ -158,6 +171,12 @@ public:
   void queue(
     Job *job,
     unsigned pgs_per_item);
+  /// queue every pg of @p pools, and the individual @p pgs
+  void queue(
+    Job *job,
+    unsigned pgs_per_item,
+    const std::set<int64_t>& pools,
+    const std::vector<pg_t>& pgs);
 
   void drain() {
     wq.drain();
@@ -184,8 +203,10 @@ private:
 	1 + // up_primary
 	1 + // num acting
 	1 + // num up
+	1 + // num raw
 	size + // acting
-	size;  // up
+	size + // up
+	size;  // raw: the crush output after pg_upmap, that up is taken from
     }
 
     PoolMapping(int s, int p)
@@ -209,13 +230,13 @@ private:
       if (acting) {
 	acting->resize(row[2]);
 	for (int i = 0; i < row[2]; ++i) {
-	  (*acting)[i] = row[4 + i];
+	  (*acting)[i] = row[5 + i];
 	}
       }
       if (up) {
 	up->resize(row[3]);
 	for (int i = 0; i < row[3]; ++i) {
-	  (*up)[i] = row[4 + size + i];
+	  (*up)[i] = row[5 + size + i];
 	}
       }
     }
@@ -224,17 +245,24 @@ private:
 	     const std::vector<int>& up,
 	     int up_primary,
 	     const std::vector<int>& acting,
-	     int acting_primary) {
+	     int acting_primary,
+	     const std::vector<int>& raw) {
       int32_t *row = &table[row_size() * ps];
       row[0] = acting_primary;
       row[1] = up_primary;
       row[2] = acting.size();
       row[3] = up.size();
+      // a pg_upmap that does not match the pool size is dropped by the
+      // mon; until it is, only its first size osds are tracked
+      row[4] = std::min<size_t>(raw.size(), size);
       for (int i = 0; i < row[2]; ++i) {
-	row[4 + i] = acting[i];
+	row[5 + i] = acting[i];
       }
       for (int i = 0; i < row[3]; ++i) {
-	row[4 + size + i] = up[i];
+	row[5 + size + i] = up[i];
+      }
+      for (int i = 0; i < row[4]; ++i) {
+	row[5 + 2 * size + i] = raw[i];
       }
     }
   };
@@ -242,11 +270,43 @@ private:
   mempool::osdmap_mapping::map<int64_t,PoolMapping> pools;
   mempool::osdmap_mapping::vector<
     mempool::osdmap_mapping::vector<pg_t>> acting_rmap;  // osd -> pg
+  mempool::osdmap_mapping::vector<
+    mempool::osdmap_mapping::vector<pg_t>> raw_rmap;  // osd -> pg
   //unused: mempool::osdmap_mapping::vector<std::vector<pg_t>> up_rmap;  // osd -> pg
   epoch_t epoch;
   uint64_t num_pgs = 0;
 
+  /**
+   * Everything in an OSDMap that the mappings depend on, as of the
+   * last complete update, so that the next one can tell which pgs a
+   * new map may have moved.
+   */
+  struct Inputs {
+    uint32_t crush_crc = 0;
+    std::vector<uint8_t> osd_state;  ///< EXISTS and UP bits only
+    std::vector<__u32> osd_weight;
+    std::vector<__u32> osd_primary_affinity;
+    std::map<int64_t,pg_pool_t> pools;
+    /// shared with the map; see OSDMap::share_from()
+    std::shared_ptr<const mempool::osdmap::map<pg_t,std::vector<int32_t> > >
+      pg_temp;
+    std::shared_ptr<const mempool::osdmap::map<pg_t,int32_t> > primary_temp;
+    std::map<pg_t,std::vector<int32_t> > pg_upmap;
+    std::map<pg_t,std::vector<std::pair<int32_t,int32_t> > > pg_upmap_items;
+
+    explicit Inputs(const OSDMap& osdmap);
+  };
+  std::unique_ptr<Inputs> inputs;       ///< NULL while a job is in flight
+  std::unique_ptr<Inputs> next_inputs;  ///< of the map being mapped
+
+  // what _start() found needs to be remapped
+  bool remap_all = true;
+  std::set<int64_t> remap_pools;  ///< every pg of these
+  std::vector<pg_t> remap_pgs;    ///< and these
+  uint64_t num_remapped = 0;
+
   void _init_mappings(const OSDMap& osdmap);
+  void _plan_update(const OSDMap& osdmap);
   void _update_range(
     const OSDMap& map,
     int64_t pool,
@@ -255,7 +315,11 @@ private:
   void _build_rmap(const OSDMap& osdmap);
 
   void _start(const OSDMap& osdmap) {
+    next_inputs.reset(new Inputs(osdmap));
+    _plan_update(osdmap);
     _init_mappings(osdmap);
+    // until this update completes the table is a mix of two maps
+    inputs.reset();
   }
   void _finish(const OSDMap& osdmap);
 
@@ -269,10 +333,10 @@ private:
       : Job(osdmap), mapping(m) {
       mapping->_start(*osdmap);
     }
-    void process(int64_t pool, unsigned ps_begin, unsigned ps_end) {
+    void process(int64_t pool, unsigned ps_begin, unsigned ps_end) override {
       mapping->_update_range(*osdmap, pool, ps_begin, ps_end);
     }
-    void complete() {
+    void complete() override {
       mapping->_finish(*osdmap);
     }
   };
@@ -299,6 +363,14 @@ public:
   }
   */
 
+  /**
+   * Bring the mappings up to date with @p map.  Only the pgs that the
+   * differences from the map of the previous complete update may have
+   * moved are recalculated: all those of a pool whose crush rule
+   * reaches an osd with a new weight, those including an osd that went
+   * up or down, and those with new temp or upmap entries.  A new crush
+   * map, or a change touching most pgs anyway, remaps everything.
+   */
   void update(const OSDMap& map);
   void update(const OSDMap& map, pg_t pgid);
 
@@ -307,7 +379,11 @@ public:
     ParallelPGMapper& mapper,
     unsigned pgs_per_item) {
     std::unique_ptr<MappingJob> job(new MappingJob(&map, this));
-    mapper.queue(job.get(), pgs_per_item);
+    if (remap_all) {
+      mapper.queue(job.get(), pgs_per_item);
+    } else {
+      mapper.queue(job.get(), pgs_per_item, remap_pools, remap_pgs);
+    }
     return job;
   }
 
@@ -318,6 +394,11 @@ public:
   uint64_t get_num_pgs() const {
     return num_pgs;
   }
+
+  /// number of pgs the last update recalculated
+  uint64_t get_num_remapped_pgs() const {
+    return num_remapped;
+  }
 };
 
 
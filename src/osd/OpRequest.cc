@@ -28,7 +28,7 @@ OpRequest::OpRequest(Message *req, OpTracker *tracker) :
   rmw_flags(0), request(req),
   hit_flag_points(0), latest_flag_point(0),
   send_map_update(false), sent_epoch(0),
-  hitset_inserted(false) {
+  hitset_inserted(false), client_throttled(false) {
   if (req->get_priority() < tracker->cct->_conf->osd_client_op_priority) {
     // don't warn as quickly for low priority ops
     warn_interval_multiplier = tracker->cct->_conf->osd_recovery_op_warn_multiple;
@@ -75,7 +75,25 @@ void OpRequest::_dump_op_descriptor_unlocked(ostream& stream) const
   get_req()->print(stream);
 }
 
+void OpRequest::start_trace()
+{
+  Mutex::Locker l(lock);
+  if (osd_trace.valid() || !request->trace.valid())
+    return;
+  osd_trace.start(tracker->cct, request->trace,
+		  request->get_type() == MSG_OSD_REPOP ? "osd repop" : "osd op",
+		  request->get_recv_stamp());
+  osd_trace.event("all_read", request->get_recv_complete_stamp());
+  osd_trace.event("dispatched", request->get_dispatch_stamp());
+  if (dequeued_time != utime_t())
+    osd_trace.event("dequeued", dequeued_time);
+}
+
 void OpRequest::_unregistered() {
+  {
+    Mutex::Locker l(lock);
+    osd_trace.finish();
+  }
   request->clear_data();
   request->clear_payload();
   request->release_message_throttle();
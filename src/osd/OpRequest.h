@@ -97,6 +97,10 @@ private:
 
   std::vector<ClassInfo> classes_;
 
+  /// our part of the request's end-to-end trace, if it carries one;
+  /// protected by lock
+  TraceSpan osd_trace;
+
   OpRequest(Message *req, OpTracker *tracker);
 
 protected:
@@ -110,9 +114,29 @@ public:
   bool send_map_update;
   epoch_t sent_epoch;
   bool hitset_inserted;
+  bool client_throttled;  ///< already charged to its client's throttle
   const Message *get_req() const { return request; }
   Message *get_nonconst_req() { return request; }
 
+  /// once the request is decoded, with the trace it carries
+  void start_trace();
+  trace_context_t get_trace_context() const override {
+    Mutex::Locker l(lock);
+    return osd_trace.context();
+  }
+
+  // events of a traced op go into its span, too
+  void mark_event(const char *event, utime_t stamp=ceph_clock_now()) {
+    TrackedOp::mark_event(event, stamp);
+    Mutex::Locker l(lock);
+    osd_trace.event(event, stamp);
+  }
+  void mark_event_string(const string &event, utime_t stamp=ceph_clock_now()) {
+    TrackedOp::mark_event_string(event, stamp);
+    Mutex::Locker l(lock);
+    osd_trace.event(event, stamp);
+  }
+
   const char *state_string() const {
     switch(latest_flag_point) {
     case flag_queued_for_pg: return "queued for pg";
@@ -80,6 +80,8 @@ const string info_key("_info");
 const string biginfo_key("_biginfo");
 const string epoch_key("_epoch");
 const string fastinfo_key("_fastinfo");
+const string scrub_resume_key("_scrub_resume");
+const string deep_verified_key("_deep_verified");
 
 template <class T>
 static ostream& _prefix(std::ostream *_dout, T *t)
@@ -993,7 +995,9 @@ PG::Scrubber::Scrubber()
    num_digest_updates_pending(0),
    state(INACTIVE),
    deep(false),
-   seed(0)
+   seed(0),
+   resumed(false),
+   sleeping(false), slept(false)
 {}
 
 PG::Scrubber::~Scrubber() {}
@@ -3316,6 +3320,7 @@ void PG::read_state(ObjectStore *store, bufferlist &bl)
   assert(r >= 0);
 
   last_written_info = info;
+  read_scrub_progress(store);
 
   ostringstream oss;
   pg_log.read_log_and_missing(
@@ -3370,17 +3375,31 @@ void PG::update_snap_map(
   const vector<pg_log_entry_t> &log_entries,
   ObjectStore::Transaction &t)
 {
+  // deletes (e.g. of a batch of trimmed clones) are removed together,
+  // before anything else touches one of them
+  vector<hobject_t> to_remove;
+  auto remove_pending = [&]() {
+    if (to_remove.empty())
+      return;
+    OSDriver::OSTransaction _t(osdriver.get_transaction(&t));
+    int r = snap_mapper.remove_oids(to_remove, &_t);
+    assert(r == 0);
+    to_remove.clear();
+  };
   for (vector<pg_log_entry_t>::const_iterator i = log_entries.begin();
        i != log_entries.end();
        ++i) {
     OSDriver::OSTransaction _t(osdriver.get_transaction(&t));
     if (i->soid.snap < CEPH_MAXSNAP) {
       if (i->is_delete()) {
-	int r = snap_mapper.remove_oid(
-	  i->soid,
-	  &_t);
-	assert(r == 0);
+	if (std::find(to_remove.begin(), to_remove.end(), i->soid) !=
+	    to_remove.end())
+	  remove_pending();
+	to_remove.push_back(i->soid);
       } else if (i->is_update()) {
+	if (std::find(to_remove.begin(), to_remove.end(), i->soid) !=
+	    to_remove.end())
+	  remove_pending();
 	assert(i->snaps.length() > 0);
 	vector<snapid_t> snaps;
 	bufferlist snapbl = i->snaps;
@@ -3411,6 +3430,7 @@ void PG::update_snap_map(
       }
     }
   }
+  remove_pending();
 }
 
 /**
@@ -3685,7 +3705,7 @@ void PG::sub_op_scrub_map(OpRequestRef op)
 void PG::_request_scrub_map(
   pg_shard_t replica, eversion_t version,
   hobject_t start, hobject_t end,
-  bool deep, uint32_t seed)
+  bool deep, uint32_t seed, eversion_t skip_unchanged_to)
 {
   assert(replica != pg_whoami);
   dout(10) << "scrub  requesting scrubmap from osd." << replica
@@ -3694,6 +3714,7 @@ void PG::_request_scrub_map(
     spg_t(info.pgid.pgid, replica.shard), version,
     get_osdmap()->get_epoch(),
     start, end, deep, seed);
+  repscrubop->skip_unchanged_to = skip_unchanged_to;
   // default priority, we want the rep scrub processed prior to any recovery
   // or client io messages (we are holding a lock!)
   osd->send_message_osd_cluster(
@@ -3953,6 +3974,7 @@ void PG::_scan_snaps(ScrubMap &smap)
 int PG::build_scrub_map_chunk(
   ScrubMap &map,
   hobject_t start, hobject_t end, bool deep, uint32_t seed,
+  eversion_t skip_unchanged_to,
   ThreadPool::TPHandle &handle)
 {
   dout(10) << __func__ << " [" << start << "," << end << ") "
@@ -3975,7 +3997,8 @@ int PG::build_scrub_map_chunk(
   }
 
 
-  get_pgbackend()->be_scan_list(map, ls, deep, seed, handle);
+  get_pgbackend()->be_scan_list(map, ls, deep, seed, skip_unchanged_to,
+				handle);
   _scan_rollback_obs(rollback_obs, handle);
   _scan_snaps(map);
 
@@ -4082,8 +4105,9 @@ void PG::replica_scrub(
     end.pool = info.pgid.pool();
 
   build_scrub_map_chunk(
-    map, start, end, msg->deep, msg->seed,
+    map, start, end, msg->deep, msg->seed, msg->skip_unchanged_to,
     handle);
+  scrub_account_chunk(map, msg->deep, msg->skip_unchanged_to);
 
   vector<OSDOp> scrub(1);
   scrub[0].op.op = CEPH_OSD_OP_SCRUB_MAP;
@@ -4113,19 +4137,6 @@ void PG::replica_scrub(
  */
 void PG::scrub(epoch_t queued, ThreadPool::TPHandle &handle)
 {
-  if (cct->_conf->osd_scrub_sleep > 0 &&
-      (scrubber.state == PG::Scrubber::NEW_CHUNK ||
-       scrubber.state == PG::Scrubber::INACTIVE)) {
-    dout(20) << __func__ << " state is INACTIVE|NEW_CHUNK, sleeping" << dendl;
-    unlock();
-    utime_t t;
-    t.set_from_double(cct->_conf->osd_scrub_sleep);
-    handle.suspend_tp_timeout();
-    t.sleep();
-    handle.reset_tp_timeout();
-    lock();
-    dout(20) << __func__ << " slept for " << t << dendl;
-  }
   if (pg_has_reset_since(queued)) {
     return;
   }
@@ -4149,9 +4160,163 @@ void PG::scrub(epoch_t queued, ThreadPool::TPHandle &handle)
     dout(10) << "starting a new chunky scrub" << dendl;
   }
 
+  if ((scrubber.state == PG::Scrubber::NEW_CHUNK ||
+       scrubber.state == PG::Scrubber::INACTIVE) &&
+      scrub_sleep()) {
+    return;
+  }
+
   chunky_scrub(handle);
 }
 
+/*
+ * Pause before the next chunk for osd_scrub_sleep, or for as long as the
+ * osd's scrub bandwidth budget is overdrawn, whichever is longer.  We wait
+ * on scrub_sleep_timer and get requeued from there, so the op thread is
+ * free for client io in the meantime.
+ *
+ * @return true if a wakeup is pending and the caller should back off
+ */
+bool PG::scrub_sleep()
+{
+  if (scrubber.sleeping) {
+    dout(20) << __func__ << " already waiting" << dendl;
+    return true;
+  }
+  if (scrubber.slept) {
+    scrubber.slept = false;
+    return false;
+  }
+  double delay = MAX((double)cct->_conf->osd_scrub_sleep,
+		     osd->scrub_budget_delay());
+  if (delay <= 0)
+    return false;
+
+  struct OnTimer : Context {
+    PGRef pg;
+    epoch_t epoch;
+    OnTimer(PGRef pg, epoch_t epoch) : pg(pg), epoch(epoch) {}
+    void finish(int) override {
+      pg->lock();
+      if (!pg->pg_has_reset_since(epoch) && pg->scrubber.sleeping) {
+	pg->scrubber.sleeping = false;
+	pg->scrubber.slept = true;
+	pg->osd->logger->tinc(l_osd_scrub_wait,
+			      ceph_clock_now() - pg->scrubber.sleep_start);
+	pg->requeue_scrub();
+      }
+      pg->unlock();
+    }
+  };
+  dout(20) << __func__ << " waiting " << delay << "s before the next chunk"
+	   << dendl;
+  scrubber.sleeping = true;
+  scrubber.sleep_start = ceph_clock_now();
+  Mutex::Locker l(osd->scrub_sleep_lock);
+  osd->scrub_sleep_timer.add_event_after(
+    delay, new OnTimer(this, get_osdmap()->get_epoch()));
+  return true;
+}
+
+void PG::scrub_account_chunk(const ScrubMap &map, bool deep,
+			     eversion_t skip_unchanged_to)
+{
+  osd->logger->inc(l_osd_scrub_chunks);
+  osd->logger->inc(l_osd_scrub_objects, map.objects.size());
+  if (!deep)
+    return;
+  uint64_t bytes = 0;
+  for (auto& p : map.objects) {
+    if (!PGBackend::be_object_unchanged(p.second, skip_unchanged_to))
+      bytes += p.second.size;
+  }
+  osd->logger->inc(l_osd_scrub_bytes, bytes);
+  osd->scrub_charge(bytes);
+}
+
+void PG::read_scrub_progress(ObjectStore *store)
+{
+  set<string> keys;
+  keys.insert(scrub_resume_key);
+  keys.insert(deep_verified_key);
+  map<string,bufferlist> values;
+  int r = store->omap_get_values(coll, pgmeta_oid, keys, &values);
+  if (r < 0)
+    return;
+  if (values.count(scrub_resume_key)) {
+    bufferlist::iterator p = values[scrub_resume_key].begin();
+    ::decode(scrub_resume_from, p);
+    ::decode(scrub_resume_stamp, p);
+    dout(10) << __func__ << " deep scrub started " << scrub_resume_stamp
+	     << " got to " << scrub_resume_from << dendl;
+  }
+  if (values.count(deep_verified_key)) {
+    bufferlist::iterator p = values[deep_verified_key].begin();
+    ::decode(deep_verified_to, p);
+    ::decode(deep_since_full, p);
+    dout(10) << __func__ << " deep verified to " << deep_verified_to
+	     << ", " << deep_since_full << " deep scrubs since a full one"
+	     << dendl;
+  }
+}
+
+void PG::scrub_save_progress()
+{
+  scrub_resume_from = scrubber.start;
+  scrub_resume_stamp = scrubber.deep_stamp;
+  map<string,bufferlist> km;
+  ::encode(scrub_resume_from, km[scrub_resume_key]);
+  ::encode(scrub_resume_stamp, km[scrub_resume_key]);
+  ObjectStore::Transaction t;
+  t.omap_setkeys(coll, pgmeta_oid, km);
+  int tr = osd->store->queue_transaction(osr.get(), std::move(t), NULL);
+  assert(tr == 0);
+}
+
+void PG::scrub_update_verified(ObjectStore::Transaction *t)
+{
+  if (scrubber.shallow_errors || scrubber.deep_errors) {
+    deep_verified_to = eversion_t();
+    deep_since_full = 0;
+  } else {
+    deep_verified_to = scrubber.deep_from;
+    if (scrubber.skip_unchanged_to == eversion_t())
+      deep_since_full = 0;
+    else
+      ++deep_since_full;
+  }
+  dout(20) << __func__ << " " << deep_verified_to << " " << deep_since_full
+	   << dendl;
+  map<string,bufferlist> km;
+  ::encode(deep_verified_to, km[deep_verified_key]);
+  ::encode(deep_since_full, km[deep_verified_key]);
+  t->omap_setkeys(coll, pgmeta_oid, km);
+}
+
+void PG::scrub_clear_verified(ObjectStore::Transaction *t)
+{
+  if (deep_verified_to == eversion_t() && deep_since_full == 0)
+    return;
+  dout(20) << __func__ << " was " << deep_verified_to << dendl;
+  deep_verified_to = eversion_t();
+  deep_since_full = 0;
+  set<string> keys;
+  keys.insert(deep_verified_key);
+  t->omap_rmkeys(coll, pgmeta_oid, keys);
+}
+
+void PG::scrub_clear_progress(ObjectStore::Transaction *t)
+{
+  if (scrub_resume_from == hobject_t())
+    return;
+  dout(20) << __func__ << dendl;
+  scrub_resume_from = hobject_t();
+  scrub_resume_stamp = utime_t();
+  set<string> keys;
+  keys.insert(scrub_resume_key);
+  t->omap_rmkeys(coll, pgmeta_oid, keys);
+}
+
 /*
  * Chunky scrub scrubs objects one chunk at a time with writes blocked for that
  * chunk.
@@ -4262,16 +4427,42 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
 	  scrubber.reserved_peers.clear();
 	}
 
+        // Don't include temporary objects when scrubbing
+        scrubber.start = info.pgid.pgid.get_hobj_start();
+	scrubber.deep_stamp = ceph_clock_now();
+	if (scrubber.deep &&
+	    !state_test(PG_STATE_REPAIR) &&
+	    cct->_conf->osd_scrub_resume &&
+	    scrub_resume_from > scrubber.start &&
+	    scrub_resume_from < info.pgid.pgid.get_hobj_end(pool.info.get_pg_num()) &&
+	    scrub_resume_stamp + cct->_conf->osd_deep_scrub_interval >
+	      scrubber.deep_stamp) {
+	  dout(10) << "resuming deep scrub started " << scrub_resume_stamp
+		   << " at " << scrub_resume_from << dendl;
+	  scrubber.start = scrub_resume_from;
+	  scrubber.deep_stamp = scrub_resume_stamp;
+	  scrubber.resumed = true;
+	}
+	scrubber.deep_from = info.last_update;
+	if (scrubber.deep &&
+	    !state_test(PG_STATE_REPAIR) &&
+	    deep_since_full < (uint32_t)MAX(0, cct->_conf->osd_deep_scrub_skip_unchanged) &&
+	    info.stats.stats.sum.num_scrub_errors == 0) {
+	  scrubber.skip_unchanged_to = deep_verified_to;
+	  dout(10) << "deep scrub not hashing objects unchanged since "
+		   << scrubber.skip_unchanged_to << dendl;
+	}
+
 	{
 	  ObjectStore::Transaction t;
 	  scrubber.cleanup_store(&t);
 	  scrubber.store.reset(Scrub::Store::create(osd->store, &t,
 						    info.pgid, coll));
+	  if (scrubber.deep && !scrubber.resumed)
+	    scrub_clear_progress(&t);
 	  osd->store->queue_transaction(osr.get(), std::move(t), nullptr);
 	}
 
-        // Don't include temporary objects when scrubbing
-        scrubber.start = info.pgid.pgid.get_hobj_start();
         scrubber.state = PG::Scrubber::NEW_CHUNK;
 
 	{
@@ -4279,7 +4470,8 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
 	  bool deep_scrub = state_test(PG_STATE_DEEP_SCRUB);
 	  const char *mode = (repair ? "repair": (deep_scrub ? "deep-scrub" : "scrub"));
 	  stringstream oss;
-	  oss << info.pgid.pgid << " " << mode << " starts" << std::endl;
+	  oss << info.pgid.pgid << " " << mode
+	      << (scrubber.resumed ? " resumes" : " starts") << std::endl;
 	  osd->clog->info(oss);
 	}
 
@@ -4388,7 +4580,7 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
 	  if (*i == pg_whoami) continue;
           _request_scrub_map(*i, scrubber.subset_last_update,
                              scrubber.start, scrubber.end, scrubber.deep,
-			     scrubber.seed);
+			     scrubber.seed, scrubber.skip_unchanged_to);
           scrubber.waiting_on_whom.insert(*i);
           ++scrubber.waiting_on;
         }
@@ -4423,6 +4615,7 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
         ret = build_scrub_map_chunk(scrubber.primary_scrubmap,
                                     scrubber.start, scrubber.end,
                                     scrubber.deep, scrubber.seed,
+				    scrubber.skip_unchanged_to,
 				    handle);
         if (ret < 0) {
           dout(5) << "error building scrub map: " << ret << ", aborting" << dendl;
@@ -4430,6 +4623,8 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
           scrub_unreserve_replicas();
           return;
         }
+	scrub_account_chunk(scrubber.primary_scrubmap, scrubber.deep,
+			    scrubber.skip_unchanged_to);
 
         --scrubber.waiting_on;
         scrubber.waiting_on_whom.erase(pg_whoami);
@@ -4472,6 +4667,10 @@ void PG::chunky_scrub(ThreadPool::TPHandle &handle)
 	}
 
 	if (!(scrubber.end.is_max())) {
+	  if (scrubber.deep &&
+	      !state_test(PG_STATE_REPAIR) &&
+	      cct->_conf->osd_scrub_resume)
+	    scrub_save_progress();
           scrubber.state = PG::Scrubber::NEW_CHUNK;
 	  requeue_scrub();
           done = true;
@@ -4724,7 +4923,9 @@ void PG::scrub_finish()
   info.history.last_scrub_stamp = now;
   if (scrubber.deep) {
     info.history.last_deep_scrub = info.last_update;
-    info.history.last_deep_scrub_stamp = now;
+    // a resumed deep scrub has only covered the whole pg since it started
+    info.history.last_deep_scrub_stamp =
+      scrubber.resumed ? scrubber.deep_stamp : now;
   }
   // Since we don't know which errors were fixed, we can only clear them
   // when every one has been fixed.
@@ -4758,6 +4959,11 @@ void PG::scrub_finish()
     ObjectStore::Transaction t;
     dirty_info = true;
     write_if_dirty(t);
+    if (scrubber.deep) {
+      if (!scrubber.resumed)
+	scrub_update_verified(&t);
+      scrub_clear_progress(&t);
+    }
     int tr = osd->store->queue_transaction(osr.get(), std::move(t), NULL);
     assert(tr == 0);
   }
@@ -5161,6 +5367,10 @@ void PG::start_peering_interval(
     info.history.same_primary_since = osdmap->get_epoch();
   }
 
+  // the last clean deep scrub only vouched for the old acting set's copies
+  if (oldacting != acting)
+    scrub_clear_verified(t);
+
   on_new_interval();
 
   dout(10) << " up " << oldup << " -> " << up 
@@ -6834,7 +7044,11 @@ boost::statechart::result PG::RecoveryState::Active::react(const AdvMap& advmap)
   PG *pg = context< RecoveryMachine >().pg;
   ldout(pg->cct, 10) << "Active advmap" << dendl;
   if (!pg->pool.newly_removed_snaps.empty()) {
+    uint64_t queued = pg->snap_trimq.size();
     pg->snap_trimq.union_of(pg->pool.newly_removed_snaps);
+    if (pg->is_primary())
+      pg->osd->logger->inc(l_osd_snap_trim_queue,
+			   pg->snap_trimq.size() - queued);
     ldout(pg->cct, 10) << *pg << " snap_trimq now " << pg->snap_trimq << dendl;
     pg->dirty_info = true;
     pg->dirty_big_info = true;
@@ -1155,6 +1155,18 @@ public:
     // deep scrub
     bool deep;
     uint32_t seed;
+    /// picked up from scrub_resume_from rather than the start of the pg
+    bool resumed;
+    utime_t deep_stamp;  ///< when this deep scrub (first) started
+    eversion_t deep_from;  ///< last_update when it started
+    /// objects at or before this version are not hashed (see
+    /// deep_verified_to); eversion_t() for a full sweep
+    eversion_t skip_unchanged_to;
+
+    // pause between chunks (osd_scrub_sleep, osd_scrub_bandwidth)
+    bool sleeping;  ///< a scrub_sleep_timer wakeup is pending
+    bool slept;     ///< it fired; go on with the next chunk
+    utime_t sleep_start;
 
     list<Context*> callbacks;
     void add_callback(Context *context) {
@@ -1220,6 +1232,12 @@ public:
       fixed = 0;
       deep = false;
       seed = 0;
+      resumed = false;
+      deep_stamp = utime_t();
+      deep_from = eversion_t();
+      skip_unchanged_to = eversion_t();
+      sleeping = false;
+      slept = false;
       run_callbacks();
       inconsistent.clear();
       missing.clear();
@@ -1234,6 +1252,30 @@ public:
 
   bool scrub_after_recovery;
 
+  // deep scrub progress: the end of the last chunk a deep scrub finished,
+  // kept under scrub_resume_key so one interrupted by a new interval or an
+  // osd restart carries on from there instead of starting over
+  hobject_t scrub_resume_from;
+  utime_t scrub_resume_stamp;  ///< when that deep scrub started
+
+  // every object at or before deep_verified_to was hashed by this primary
+  // in a clean deep scrub and hasn't been written since, so later deep
+  // scrubs may skip it; deep_since_full counts those that did, so every
+  // osd_deep_scrub_skip_unchanged + 1'th one is a full sweep again.  Kept
+  // under deep_verified_key; a new primary starts with a full sweep, and
+  // so does the next deep scrub after the acting set changes or a backfill
+  // completes.
+  eversion_t deep_verified_to;
+  uint32_t deep_since_full = 0;
+  void read_scrub_progress(ObjectStore *store);
+  void scrub_save_progress();
+  void scrub_clear_progress(ObjectStore::Transaction *t);
+  void scrub_update_verified(ObjectStore::Transaction *t);
+  void scrub_clear_verified(ObjectStore::Transaction *t);
+  bool scrub_sleep();
+  void scrub_account_chunk(const ScrubMap &map, bool deep,
+			   eversion_t skip_unchanged_to);
+
   int active_pushes;
 
   void repair_object(
@@ -1255,10 +1297,11 @@ public:
     ThreadPool::TPHandle &handle);
   void _request_scrub_map(pg_shard_t replica, eversion_t version,
                           hobject_t start, hobject_t end, bool deep,
-			  uint32_t seed);
+			  uint32_t seed, eversion_t skip_unchanged_to);
   int build_scrub_map_chunk(
     ScrubMap &map,
     hobject_t start, hobject_t end, bool deep, uint32_t seed,
+    eversion_t skip_unchanged_to,
     ThreadPool::TPHandle &handle);
   /**
    * returns true if [begin, end) is good to scrub at this time
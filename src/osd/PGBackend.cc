@@ -433,6 +433,7 @@ PGBackend *PGBackend::build_pg_backend(
  */
 void PGBackend::be_scan_list(
   ScrubMap &map, const vector<hobject_t> &ls, bool deep, uint32_t seed,
+  eversion_t skip_unchanged_to,
   ThreadPool::TPHandle &handle)
 {
   dout(10) << __func__ << " scanning " << ls.size() << " objects"
@@ -462,7 +463,11 @@ void PGBackend::be_scan_list(
 	o.attrs);
 
       // calculate the CRC32 on deep scrubs
-      if (deep) {
+      if (deep && be_object_unchanged(o, skip_unchanged_to)) {
+	dout(25) << __func__ << "  " << poid << " unchanged since "
+		 << skip_unchanged_to << ", not hashing" << dendl;
+	get_parent()->get_logger()->inc(l_osd_scrub_skipped);
+      } else if (deep) {
 	be_deep_scrub(*p, seed, o, handle);
       }
 
@@ -482,6 +487,31 @@ void PGBackend::be_scan_list(
   }
 }
 
+/*
+ * true if the object's version is at or before skip_unchanged_to, i.e. it
+ * was hashed by an earlier clean deep scrub and hasn't been written since.
+ * An object whose info can't be read is always hashed.
+ */
+bool PGBackend::be_object_unchanged(
+  const ScrubMap::object &o, eversion_t skip_unchanged_to)
+{
+  if (skip_unchanged_to == eversion_t())
+    return false;
+  auto k = o.attrs.find(OI_ATTR);
+  if (k == o.attrs.end())
+    return false;
+  bufferlist bl;
+  bl.push_back(k->second);
+  object_info_t oi;
+  try {
+    bufferlist::iterator bliter = bl.begin();
+    ::decode(oi, bliter);
+  } catch (...) {
+    return false;
+  }
+  return oi.version <= skip_unchanged_to;
+}
+
 bool PGBackend::be_compare_scrub_objects(
   pg_shard_t auth_shard,
   const ScrubMap::object &auth,
@@ -520,7 +520,10 @@ typedef ceph::shared_ptr<const OSDMap> OSDMapRef;
    virtual bool auto_repair_supported() const = 0;
    void be_scan_list(
      ScrubMap &map, const vector<hobject_t> &ls, bool deep, uint32_t seed,
+     eversion_t skip_unchanged_to,
      ThreadPool::TPHandle &handle);
+   static bool be_object_unchanged(
+     const ScrubMap::object &o, eversion_t skip_unchanged_to);
    bool be_compare_scrub_objects(
      pg_shard_t auth_shard,
      const ScrubMap::object &auth,
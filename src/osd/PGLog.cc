@@ -437,6 +437,21 @@ void PGLog::check() {
   }
 }
 
+void PGLog::rm_trimmed_keys(
+  ObjectStore::Transaction& t,
+  const coll_t& coll, const ghobject_t &log_oid,
+  const set<eversion_t> &trimmed)
+{
+  // trimming only ever removes the oldest entries, so the trimmed keys
+  // are contiguous and one range removal replaces a key per entry.
+  // nothing sorts between (e,v) and (e,v+1), the end of the range.
+  eversion_t last = *trimmed.rbegin();
+  t.omap_rmkeyrange(
+    coll, log_oid,
+    trimmed.begin()->get_key_name(),
+    eversion_t(last.epoch, last.version + 1).get_key_name());
+}
+
 void PGLog::write_log_and_missing(
   ObjectStore::Transaction& t,
   map<string,bufferlist> *km,
@@ -519,11 +534,10 @@ void PGLog::_write_log_and_missing_wo_missing(
   )
 {
   set<string> to_remove;
-  for (set<eversion_t>::const_iterator i = trimmed.begin();
-       i != trimmed.end();
-       ++i) {
-    to_remove.insert(i->get_key_name());
-    if (log_keys_debug) {
+  if (log_keys_debug) {
+    for (set<eversion_t>::const_iterator i = trimmed.begin();
+	 i != trimmed.end();
+	 ++i) {
       assert(log_keys_debug->count(i->get_key_name()));
       log_keys_debug->erase(i->get_key_name());
     }
@@ -532,6 +546,8 @@ void PGLog::_write_log_and_missing_wo_missing(
 //dout(10) << "write_log_and_missing, clearing up to " << dirty_to << dendl;
   if (touch_log)
     t.touch(coll, log_oid);
+  if (!trimmed.empty())
+    rm_trimmed_keys(t, coll, log_oid, trimmed);
   if (dirty_to != eversion_t()) {
     t.omap_rmkeyrange(
       coll, log_oid,
@@ -608,11 +624,10 @@ void PGLog::_write_log_and_missing(
   set<string> *log_keys_debug
   ) {
   set<string> to_remove;
-  for (set<eversion_t>::const_iterator i = trimmed.begin();
-       i != trimmed.end();
-       ++i) {
-    to_remove.insert(i->get_key_name());
-    if (log_keys_debug) {
+  if (log_keys_debug) {
+    for (set<eversion_t>::const_iterator i = trimmed.begin();
+	 i != trimmed.end();
+	 ++i) {
       assert(log_keys_debug->count(i->get_key_name()));
       log_keys_debug->erase(i->get_key_name());
     }
@@ -620,6 +635,8 @@ void PGLog::_write_log_and_missing(
 
   if (touch_log)
     t.touch(coll, log_oid);
+  if (!trimmed.empty())
+    rm_trimmed_keys(t, coll, log_oid, trimmed);
   if (dirty_to != eversion_t()) {
     t.omap_rmkeyrange(
       coll, log_oid,
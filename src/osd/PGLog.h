@@ -79,9 +79,11 @@ public:
    * plus some methods to manipulate it all.
    */
   struct IndexedLog : public pg_log_t {
-    mutable ceph::unordered_map<hobject_t,pg_log_entry_t*> objects;  // ptrs into log.  be careful!
-    mutable ceph::unordered_map<osd_reqid_t,pg_log_entry_t*> caller_ops;
-    mutable ceph::unordered_multimap<osd_reqid_t,pg_log_entry_t*> extra_caller_ops;
+    // indexes live in the same mempool as the log so their memory is
+    // accounted along with it
+    mutable mempool::osd::unordered_map<hobject_t,pg_log_entry_t*> objects;  // ptrs into log.  be careful!
+    mutable mempool::osd::unordered_map<osd_reqid_t,pg_log_entry_t*> caller_ops;
+    mutable mempool::osd::unordered_multimap<osd_reqid_t,pg_log_entry_t*> extra_caller_ops;
 
     // recovery pointers
     list<pg_log_entry_t>::iterator complete_to; // not inclusive of referenced item
@@ -115,6 +117,9 @@ public:
 	  break;
 	}
 	f(*rollback_info_trimmed_to_riter);
+	// nothing can roll this entry back any more; don't keep its
+	// rollback info resident for the rest of its life in the log
+	rollback_info_trimmed_to_riter->mark_unrollbackable();
       }
     }
 
@@ -265,7 +270,7 @@ public:
       assert(version);
       assert(user_version);
       assert(return_code);
-      ceph::unordered_map<osd_reqid_t,pg_log_entry_t*>::const_iterator p;
+      mempool::osd::unordered_map<osd_reqid_t,pg_log_entry_t*>::const_iterator p;
       if (!(indexed_data & PGLOG_INDEXED_CALLER_OPS)) {
         index_caller_ops();
       }
@@ -421,7 +426,7 @@ public:
 	       e.extra_reqids.begin();
              j != e.extra_reqids.end();
              ++j) {
-          for (ceph::unordered_multimap<osd_reqid_t,pg_log_entry_t*>::iterator k =
+          for (mempool::osd::unordered_multimap<osd_reqid_t,pg_log_entry_t*>::iterator k =
 		 extra_caller_ops.find(j->first);
                k != extra_caller_ops.end() && k->first == j->first;
                ++k) {
@@ -787,8 +792,7 @@ protected:
 		       << " last_divergent_update: " << last_divergent_update
 		       << dendl;
 
-    ceph::unordered_map<hobject_t, pg_log_entry_t*>::const_iterator objiter =
-      log.objects.find(hoid);
+    auto objiter = log.objects.find(hoid);
     if (objiter != log.objects.end() &&
 	objiter->second->version >= first_divergent_update) {
       /// Case 1)
@@ -1061,6 +1065,11 @@ public:
     const pg_missing_tracker_t &missing,
     bool require_rollback);
 
+  static void rm_trimmed_keys(
+    ObjectStore::Transaction& t,
+    const coll_t& coll, const ghobject_t &log_oid,
+    const set<eversion_t> &trimmed);
+
   static void _write_log_and_missing_wo_missing(
     ObjectStore::Transaction& t,
     map<string,bufferlist>* km,
@@ -1138,22 +1147,24 @@ public:
     list<pg_log_entry_t> entries;
     if (p) {
       for (p->seek_to_first(); p->valid() ; p->next(false)) {
+	// key() builds a new string each time, so take it once
+	const string key = p->key();
 	// non-log pgmeta_oid keys are prefixed with _; skip those
-	if (p->key()[0] == '_')
+	if (key[0] == '_')
 	  continue;
 	bufferlist bl = p->value();//Copy bufferlist before creating iterator
 	bufferlist::iterator bp = bl.begin();
-	if (p->key() == "divergent_priors") {
+	if (key == "divergent_priors") {
 	  ::decode(divergent_priors, bp);
 	  ldpp_dout(dpp, 20) << "read_log_and_missing " << divergent_priors.size()
 			     << " divergent_priors" << dendl;
 	  has_divergent_priors = true;
 	  debug_verify_stored_missing = false;
-	} else if (p->key() == "can_rollback_to") {
+	} else if (key == "can_rollback_to") {
 	  ::decode(on_disk_can_rollback_to, bp);
-	} else if (p->key() == "rollback_info_trimmed_to") {
+	} else if (key == "rollback_info_trimmed_to") {
 	  ::decode(on_disk_rollback_info_trimmed_to, bp);
-	} else if (p->key().substr(0, 7) == string("missing")) {
+	} else if (key.compare(0, 7, "missing") == 0) {
 	  pair<hobject_t, pg_missing_item> p;
 	  ::decode(p, bp);
 	  missing.add(p.first, p.second.need, p.second.have);
@@ -1162,13 +1173,13 @@ public:
 	  e.decode_with_checksum(bp);
 	  ldpp_dout(dpp, 20) << "read_log_and_missing " << e << dendl;
 	  if (!entries.empty()) {
-	    pg_log_entry_t last_e(entries.back());
+	    const pg_log_entry_t &last_e = entries.back();
 	    assert(last_e.version.version < e.version.version);
 	    assert(last_e.version.epoch <= e.version.epoch);
 	  }
-	  entries.push_back(e);
 	  if (log_keys_debug)
 	    log_keys_debug->insert(e.get_key_name());
+	  entries.push_back(std::move(e));
 	}
       }
     }
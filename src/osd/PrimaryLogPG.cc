@@ -75,6 +75,16 @@ static ostream& _prefix(std::ostream *_dout, T *pg) {
 #include <errno.h>
 
 MEMPOOL_DEFINE_OBJECT_FACTORY(PrimaryLogPG, replicatedpg, osd);
+MEMPOOL_DEFINE_OBJECT_FACTORY(ObjectContext, objectcontext, osd);
+
+// approximate memory held by an obc, for byte-sized obc caches
+static size_t obc_cost(const ObjectContext& obc)
+{
+  size_t r = sizeof(ObjectContext);
+  for (auto& p : obc.attr_cache)
+    r += p.first.size() + p.second.length();
+  return r;
+}
 
 PGLSFilter::PGLSFilter() : cct(nullptr)
 {
@@ -528,6 +538,20 @@ bool PrimaryLogPG::is_missing_object(const hobject_t& soid) const
   return pg_log.get_missing().get_items().count(soid);
 }
 
+bool PrimaryLogPG::replica_can_read(const hobject_t& soid) const
+{
+  if (!is_active() || soid > info.last_backfill || is_missing_object(soid))
+    return false;
+  // the primary tells us (as the point we can roll forward to) up to
+  // where every replica has committed; a later write to the object may
+  // not have been acked, and could still be lost in peering
+  const auto& log = pg_log.get_log();
+  if (log.logged_object(soid) &&
+      log.objects.find(soid)->second->version > pg_log.get_can_rollback_to())
+    return false;
+  return true;
+}
+
 void PrimaryLogPG::maybe_kick_recovery(
   const hobject_t &soid)
 {
@@ -694,6 +718,34 @@ public:
                       bufferlist& outdata) override;
 };
 
+// Objects whose name starts with a prefix and, if an xattr name is
+// given, that have that xattr; with a value too, it must match exactly.
+class PGLSPrefixFilter : public PGLSFilter {
+  string prefix;
+  string val;
+public:
+  int init(bufferlist::iterator &params) override
+  {
+    try {
+      ::decode(prefix, params);
+      if (!params.end()) {
+	::decode(xattr, params);
+	::decode(val, params);
+      }
+    } catch (buffer::error &e) {
+      return -EINVAL;
+    }
+
+    return 0;
+  }
+  ~PGLSPrefixFilter() {}
+  bool filter_name(const hobject_t &obj) override {
+    return obj.oid.name.compare(0, prefix.size(), prefix) == 0;
+  }
+  bool filter(const hobject_t &obj, bufferlist& xattr_data,
+                      bufferlist& outdata) override;
+};
+
 class PGLSParentFilter : public PGLSFilter {
   inodeno_t parent_ino;
 public:
@@ -751,17 +803,32 @@ bool PGLSPlainFilter::filter(const hobject_t &obj,
   return true;
 }
 
+bool PGLSPrefixFilter::filter(const hobject_t &obj,
+                              bufferlist& xattr_data, bufferlist& outdata)
+{
+  if (val.empty())
+    return true;
+
+  if (val.size() != xattr_data.length())
+    return false;
+
+  return memcmp(val.c_str(), xattr_data.c_str(), val.size()) == 0;
+}
+
 bool PrimaryLogPG::pgls_filter(PGLSFilter *filter, hobject_t& sobj, bufferlist& outdata)
 {
   bufferlist bl;
 
+  if (!filter->filter_name(sobj))
+    return false;
+
   // If filter has expressed an interest in an xattr, load it.
   if (!filter->get_xattr().empty()) {
     int ret = pgbackend->objects_get_attr(
       sobj,
       filter->get_xattr(),
       &bl);
-    dout(0) << "getattr (sobj=" << sobj << ", attr=" << filter->get_xattr() << ") returned " << ret << dendl;
+    dout(20) << "getattr (sobj=" << sobj << ", attr=" << filter->get_xattr() << ") returned " << ret << dendl;
     if (ret < 0) {
       if (ret != -ENODATA || filter->reject_empty_xattr()) {
         return false;
@@ -788,6 +855,8 @@ int PrimaryLogPG::get_pgls_filter(bufferlist::iterator& iter, PGLSFilter **pfilt
     filter = new PGLSParentFilter(cct);
   } else if (type.compare("plain") == 0) {
     filter = new PGLSPlainFilter();
+  } else if (type.compare("prefix") == 0) {
+    filter = new PGLSPrefixFilter();
   } else {
     std::size_t dot = type.find(".");
     if (dot == std::string::npos || dot == 0 || dot == type.size() - 1) {
@@ -912,6 +981,10 @@ int PrimaryLogPG::do_command(
       agent_state->dump(f.get());
     f->close_section();
 
+    f->open_object_section("object_context_cache");
+    object_contexts.dump_stats(f.get());
+    f->close_section();
+
     f->close_section();
     f->flush(odata);
     return 0;
@@ -1509,7 +1582,11 @@ PrimaryLogPG::PrimaryLogPG(OSDService *o, OSDMapRef curmap,
   pgbackend(
     PGBackend::build_pg_backend(
       _pool.info, curmap, this, coll_t(p), ch, o->store, cct)),
-  object_contexts(o->cct, o->cct->_conf->osd_pg_object_context_cache_count),
+  object_contexts(
+    o->cct,
+    o->cct->_conf->osd_pg_object_context_cache_bytes ?
+    o->cct->_conf->osd_pg_object_context_cache_bytes :
+    o->cct->_conf->osd_pg_object_context_cache_count),
   snapset_contexts_lock("PrimaryLogPG::snapset_contexts_lock"),
   new_backfill(false),
   temp_seq(0),
@@ -1519,6 +1596,14 @@ PrimaryLogPG::PrimaryLogPG(OSDService *o, OSDMapRef curmap,
     pgbackend->get_is_readable_predicate(),
     pgbackend->get_is_recoverable_predicate());
   snap_trimmer_machine.initiate();
+
+  if (cct->_conf->osd_pg_object_context_cache_bytes)
+    object_contexts.set_cost_func(obc_cost);
+  object_contexts.set_probation_ratio(
+    cct->_conf->osd_pg_object_context_cache_probation_ratio);
+  object_contexts.set_perf_counters(
+    osd->logger, l_osd_obc_cache_hit, l_osd_obc_cache_miss,
+    l_osd_obc_cache_evict);
 }
 
 void PrimaryLogPG::get_src_oloc(const object_t& oid, const object_locator_t& oloc, object_locator_t& src_oloc)
@@ -1575,7 +1660,7 @@ void PrimaryLogPG::do_request(
 	is_down() ||
 	is_incomplete() ||
 	(!is_active() && is_peered());
-      if (g_conf->osd_backoff_on_peering && !backoff) {
+      if (osd->op_conf->osd_backoff_on_peering && !backoff) {
 	if (is_peering()) {
 	  backoff = true;
 	}
@@ -1710,6 +1795,7 @@ void PrimaryLogPG::do_op(OpRequestRef& op)
     op->reset_desc();   // for TrackedOp
     m->clear_payload();
   }
+  op->start_trace();
 
   dout(20) << __func__ << ": op " << *m << dendl;
 
@@ -1723,7 +1809,7 @@ void PrimaryLogPG::do_op(OpRequestRef& op)
 	 << std::hex << head.get_hash() << std::dec << dendl;
     osd->clog->warn() << info.pgid.pgid << " does not contain " << head
 		      << " op " << *m << "\n";
-    assert(!cct->_conf->osd_debug_misdirected_ops);
+    assert(!osd->op_conf->osd_debug_misdirected_ops);
     return;
   }
 
@@ -1767,6 +1853,18 @@ void PrimaryLogPG::do_op(OpRequestRef& op)
       osd->handle_misdirected_op(this, op);
       return;
     }
+    // ... as long as it has the object as acked to the client.  Clients
+    // that can't take the -EAGAIN (and go to the primary) get what we
+    // have, as they always did.
+    if (!is_primary() &&
+	m->get_connection()->has_feature(CEPH_FEATURE_REPLICA_READ_EAGAIN) &&
+	(m->get_snapid() != CEPH_NOSNAP ||
+	 !replica_can_read(m->get_hobj()))) {
+      dout(10) << __func__ << " can't serve " << m->get_hobj()
+	       << " as a replica yet" << dendl;
+      osd->reply_op_error(op, -EAGAIN);
+      return;
+    }
   } else {
     // normal case; must be primary
     if (!is_primary()) {
@@ -1785,23 +1883,23 @@ void PrimaryLogPG::do_op(OpRequestRef& op)
   }
 
   // object name too long?
-  if (m->get_oid().name.size() > cct->_conf->osd_max_object_name_len) {
+  if (m->get_oid().name.size() > osd->op_conf->osd_max_object_name_len) {
     dout(4) << "do_op name is longer than "
-	    << cct->_conf->osd_max_object_name_len
+	    << osd->op_conf->osd_max_object_name_len
 	    << " bytes" << dendl;
     osd->reply_op_error(op, -ENAMETOOLONG);
     return;
   }
-  if (m->get_hobj().get_key().size() > cct->_conf->osd_max_object_name_len) {
+  if (m->get_hobj().get_key().size() > osd->op_conf->osd_max_object_name_len) {
     dout(4) << "do_op locator is longer than "
-	    << cct->_conf->osd_max_object_name_len
+	    << osd->op_conf->osd_max_object_name_len
 	    << " bytes" << dendl;
     osd->reply_op_error(op, -ENAMETOOLONG);
     return;
   }
-  if (m->get_hobj().nspace.size() > cct->_conf->osd_max_object_namespace_len) {
+  if (m->get_hobj().nspace.size() > osd->op_conf->osd_max_object_namespace_len) {
     dout(4) << "do_op namespace is longer than "
-	    << cct->_conf->osd_max_object_namespace_len
+	    << osd->op_conf->osd_max_object_namespace_len
 	    << " bytes" << dendl;
     osd->reply_op_error(op, -ENAMETOOLONG);
     return;
@@ -1859,11 +1957,11 @@ void PrimaryLogPG::do_op(OpRequestRef& op)
     }
 
     // too big?
-    if (cct->_conf->osd_max_write_size &&
-        m->get_data_len() > cct->_conf->osd_max_write_size << 20) {
+    if (osd->op_conf->osd_max_write_size &&
+        m->get_data_len() > osd->op_conf->osd_max_write_size << 20) {
       // journal can't hold commit!
       derr << "do_op msg data len " << m->get_data_len()
-           << " > osd_max_write_size " << (cct->_conf->osd_max_write_size << 20)
+           << " > osd_max_write_size " << (osd->op_conf->osd_max_write_size << 20)
            << " on " << *m << dendl;
       osd->reply_op_error(op, -OSD_WRITETOOBIG);
       return;
@@ -1881,8 +1979,8 @@ void PrimaryLogPG::do_op(OpRequestRef& op)
   // missing object?
   if (is_unreadable_object(head)) {
     if (can_backoff &&
-	(g_conf->osd_backoff_on_degraded ||
-	 (g_conf->osd_backoff_on_unfound && missing_loc.is_unfound(head)))) {
+	(osd->op_conf->osd_backoff_on_degraded ||
+	 (osd->op_conf->osd_backoff_on_unfound && missing_loc.is_unfound(head)))) {
       add_backoff(session, head, head);
       maybe_kick_recovery(head);
     } else {
@@ -1893,7 +1991,7 @@ void PrimaryLogPG::do_op(OpRequestRef& op)
 
   // degraded object?
   if (write_ordered && is_degraded_or_backfilling_object(head)) {
-    if (can_backoff && g_conf->osd_backoff_on_degraded) {
+    if (can_backoff && osd->op_conf->osd_backoff_on_degraded) {
       add_backoff(session, head, head);
     } else {
       wait_for_degraded_object(head, op);
@@ -1991,6 +2089,12 @@ void PrimaryLogPG::do_op(OpRequestRef& op)
     return;
   }
 
+  if (osd->op_conf->osd_small_read_fast_path &&
+      !op->may_write() && !op->may_cache() &&
+      do_small_read(op)) {
+    return;
+  }
+
   int r = find_object_context(
     oid, &obc, can_create,
     m->has_flag(CEPH_OSD_FLAG_MAP_SNAP_CLONE),
@@ -2192,6 +2296,97 @@ void PrimaryLogPG::do_op(OpRequestRef& op)
   }
 }
 
+bool PrimaryLogPG::do_small_read(OpRequestRef& op)
+{
+  const MOSDOp *m = static_cast<const MOSDOp*>(op->get_req());
+  if (m->ops.size() != 1 ||
+      m->ops[0].op.op != CEPH_OSD_OP_READ ||
+      m->get_snapid() != CEPH_NOSNAP)
+    return false;
+  const ceph_osd_op& rop = m->ops[0].op;
+  if (rop.extent.length == 0 ||
+      rop.extent.length > osd->op_conf->osd_small_read_max_len)
+    return false;
+
+  // only a head object whose context is cached and which nobody is
+  // writing; anything needing snaps, tiering, hit sets or ec reads goes
+  // the slow way
+  ObjectContextRef obc;
+  if (is_primary() &&
+      !pool.info.require_rollback() &&
+      !pool.info.is_tier() &&
+      pool.info.cache_mode == pg_pool_t::CACHEMODE_NONE &&
+      !hit_set && !agent_state &&
+      !m->has_flag(CEPH_OSD_FLAG_FLUSH) &&
+      !m->has_flag(CEPH_OSD_FLAG_IGNORE_CACHE))
+    obc = object_contexts.lookup(m->get_hobj());
+  if (!obc ||
+      !obc->obs.exists ||
+      obc->obs.oi.is_whiteout() ||
+      obc->obs.oi.is_lost() ||
+      obc->is_blocked() ||
+      !obc->rwstate.waiters.empty() ||
+      (obc->rwstate.state != ObjectContext::RWState::RWNONE &&
+       obc->rwstate.state != ObjectContext::RWState::RWREAD)) {
+    osd->logger->inc(l_osd_op_small_read_slow);
+    return false;
+  }
+
+  const object_info_t& oi = obc->obs.oi;
+  uint64_t size = oi.size;
+  if (oi.truncate_seq < rop.extent.truncate_seq &&
+      rop.extent.offset + rop.extent.length > rop.extent.truncate_size)
+    size = rop.extent.truncate_size;
+  uint64_t off = rop.extent.offset;
+  uint64_t len = off >= size ? 0 : MIN(rop.extent.length, size - off);
+  if (len && off == 0 && len >= oi.size && oi.is_data_digest()) {
+    // whole object; let do_osd_ops verify the digest
+    osd->logger->inc(l_osd_op_small_read_slow);
+    return false;
+  }
+
+  vector<OSDOp> ops(m->ops);
+  OSDOp& osd_op = ops[0];
+  if (len) {
+    obc->ondisk_read_lock();
+    int r = pgbackend->objects_read_sync(
+      oi.soid, off, len, rop.flags, &osd_op.outdata);
+    obc->ondisk_read_unlock();
+    if (r < 0) {
+      dout(10) << __func__ << " read got " << r << " on " << oi.soid
+	       << ", retrying on the slow path" << dendl;
+      osd->logger->inc(l_osd_op_small_read_slow);
+      return false;
+    }
+    len = r;
+  }
+  osd_op.op.extent.length = len;
+  osd_op.rval = 0;
+  dout(10) << __func__ << " " << oi.soid << " " << off << "~" << len
+	   << " ov " << oi.version << dendl;
+
+  op->mark_started();
+  log_read_copies(ops);
+  MOSDOpReply *reply = new MOSDOpReply(m, 0, get_osdmap()->get_epoch(), 0,
+				       false);
+  reply->claim_op_out_data(ops);
+  reply->get_header().data_off = off;
+  reply->set_reply_versions(eversion_t(), oi.user_version);
+  reply->add_flags(CEPH_OSD_FLAG_ACK | CEPH_OSD_FLAG_ONDISK);
+  log_op_stats(op, 0, len);
+
+  // account the read like do_osd_ops does for a read-only ctx; the delta
+  // is folded into info.stats by prepare_write_info
+  object_stat_sum_t delta;
+  delta.num_rd++;
+  delta.num_rd_kb += SHIFT_ROUND_UP(len, 10);
+  unstable_stats.add(delta);
+  publish_stats_to_osd();
+  osd->send_message_osd_client(reply, m->get_connection());
+  osd->logger->inc(l_osd_op_small_read_fast);
+  return true;
+}
+
 void PrimaryLogPG::record_write_error(OpRequestRef op, const hobject_t &soid,
 				      MOSDOpReply *orig_reply, int r)
 {
@@ -2463,6 +2658,14 @@ bool PrimaryLogPG::maybe_promote(ObjectContextRef obc,
   dout(20) << __func__ << " missing_oid " << missing_oid
 	   << "  in_hit_set " << in_hit_set << dendl;
 
+  if (recency && hit_set && hit_set->is_decaying()) {
+    // earlier hits, not counting this op's, decayed and rounded
+    const hobject_t& oid = obc.get() ? obc->obs.oi.soid : missing_oid;
+    if (std::lround(hit_set->hit_count(oid) - 1) < (long)recency)
+      return false;	// not promoting
+    recency = 0;
+  }
+
   switch (recency) {
   case 0:
     break;
@@ -3061,7 +3264,7 @@ void PrimaryLogPG::execute_ctx(OpContext *ctx)
   calc_trim_to();
 
   // verify that we are doing this in order?
-  if (cct->_conf->osd_debug_op_order && m->get_source().is_client() &&
+  if (osd->op_conf->osd_debug_op_order && m->get_source().is_client() &&
       !pool.info.is_tier() && !pool.info.has_tiers()) {
     map<client_t,ceph_tid_t>& cm = debug_op_order[obc->obs.oi.soid];
     ceph_tid_t t = m->get_tid();
@@ -3164,17 +3367,18 @@ void PrimaryLogPG::reply_ctx(OpContext *ctx, int r, eversion_t v, version_t uv)
 
 void PrimaryLogPG::log_op_stats(OpContext *ctx)
 {
-  OpRequestRef op = ctx->op;
+  log_op_stats(ctx->op, ctx->bytes_written, ctx->bytes_read);
+}
+
+void PrimaryLogPG::log_op_stats(OpRequestRef op, uint64_t inb, uint64_t outb)
+{
   const MOSDOp *m = static_cast<const MOSDOp*>(op->get_req());
 
   utime_t now = ceph_clock_now();
   utime_t latency = now;
-  latency -= ctx->op->get_req()->get_recv_stamp();
+  latency -= op->get_req()->get_recv_stamp();
   utime_t process_latency = now;
-  process_latency -= ctx->op->get_dequeued_time();
-
-  uint64_t inb = ctx->bytes_written;
-  uint64_t outb = ctx->bytes_read;
+  process_latency -= op->get_dequeued_time();
 
   osd->logger->inc(l_osd_op);
 
@@ -3395,7 +3599,14 @@ void PrimaryLogPG::do_backfill(OpRequestRef op)
   }
 }
 
-PrimaryLogPG::OpContextUPtr PrimaryLogPG::trim_object(bool first, const hobject_t &coid)
+/*
+ * Trim coid into *pctx, creating it if it is null, so one transaction can
+ * carry the trims of several clones (of different heads).  Returns false,
+ * having added nothing, if coid can't be trimmed now; a ctx this call
+ * created is closed again in that case.
+ */
+bool PrimaryLogPG::trim_object(
+  bool first, const hobject_t &coid, OpContextUPtr *pctx)
 {
   // load clone info
   bufferlist bl;
@@ -3417,7 +3628,7 @@ PrimaryLogPG::OpContextUPtr PrimaryLogPG::trim_object(bool first, const hobject_
   set<snapid_t> old_snaps(coi.snaps.begin(), coi.snaps.end());
   if (old_snaps.empty()) {
     osd->clog->error() << __func__ << " No object info snaps for " << coid << "\n";
-    return NULL;
+    return false;
   }
 
   SnapSet& snapset = obc->ssc->snapset;
@@ -3426,7 +3637,7 @@ PrimaryLogPG::OpContextUPtr PrimaryLogPG::trim_object(bool first, const hobject_
 	   << " old snapset " << snapset << dendl;
   if (snapset.seq == 0) {
     osd->clog->error() << __func__ << " No snapset.seq for " << coid << "\n";
-    return NULL;
+    return false;
   }
 
   set<snapid_t> new_snaps;
@@ -3443,34 +3654,50 @@ PrimaryLogPG::OpContextUPtr PrimaryLogPG::trim_object(bool first, const hobject_
     p = std::find(snapset.clones.begin(), snapset.clones.end(), coid.snap);
     if (p == snapset.clones.end()) {
       osd->clog->error() << __func__ << " Snap " << coid.snap << " not in clones" << "\n";
-      return NULL;
+      return false;
     }
   }
 
-  OpContextUPtr ctx = simple_opc_create(obc);
-  ctx->snapset_obc = snapset_obc;
+  bool created = !*pctx;
+  if (created) {
+    *pctx = simple_opc_create(obc);
+    (*pctx)->snapset_obc = snapset_obc;
+  }
+  OpContextUPtr &ctx = *pctx;
 
+  // the caller keeps a batch to one clone per head, so neither lock can
+  // already be in ctx's lock_manager
   if (!ctx->lock_manager.get_snaptrimmer_write(
 	coid,
 	obc,
 	first)) {
-    close_op_ctx(ctx.release());
+    if (created)
+      close_op_ctx(ctx.release());
     dout(10) << __func__ << ": Unable to get a wlock on " << coid << dendl;
-    return NULL;
+    return false;
   }
 
   if (!ctx->lock_manager.get_snaptrimmer_write(
 	snapoid,
 	snapset_obc,
 	first)) {
-    close_op_ctx(ctx.release());
+    if (created)
+      close_op_ctx(ctx.release());
     dout(10) << __func__ << ": Unable to get a wlock on " << snapoid << dendl;
-    return NULL;
+    return false;
   }
 
-  ctx->at_version = get_next_version();
-
   PGTransaction *t = ctx->op_t.get();
+  if (created) {
+    ctx->at_version = get_next_version();
+  } else {
+    // issue_repop only ondisk-locks and registers ctx->obc and
+    // ctx->snapset_obc; the snaptrimmer write locks keep readers off these
+    // until the repop completes
+    ctx->at_version.version++;
+    t->add_obc(obc);
+    t->add_obc(snapset_obc);
+  }
  
   if (new_snaps.empty()) {
     // remove clone
@@ -3522,7 +3749,7 @@ PrimaryLogPG::OpContextUPtr PrimaryLogPG::trim_object(bool first, const hobject_
 	pg_log_entry_t::DELETE,
 	coid,
 	ctx->at_version,
-	ctx->obs->oi.version,
+	coi.version,
 	0,
 	osd_reqid_t(),
 	ctx->mtime,
@@ -3575,14 +3802,14 @@ PrimaryLogPG::OpContextUPtr PrimaryLogPG::trim_object(bool first, const hobject_
 	pg_log_entry_t::DELETE,
 	snapoid,
 	ctx->at_version,
-	ctx->snapset_obc->obs.oi.version,
+	snapset_obc->obs.oi.version,
 	0,
 	osd_reqid_t(),
 	ctx->mtime,
 	0)
       );
 
-    ctx->snapset_obc->obs.exists = false;
+    snapset_obc->obs.exists = false;
     
     t->remove(snapoid);
   } else {
@@ -3595,16 +3822,16 @@ PrimaryLogPG::OpContextUPtr PrimaryLogPG::trim_object(bool first, const hobject_
 	pg_log_entry_t::MODIFY,
 	snapoid,
 	ctx->at_version,
-	ctx->snapset_obc->obs.oi.version,
+	snapset_obc->obs.oi.version,
 	0,
 	osd_reqid_t(),
 	ctx->mtime,
 	0)
       );
 
-    ctx->snapset_obc->obs.oi.prior_version =
-      ctx->snapset_obc->obs.oi.version;
-    ctx->snapset_obc->obs.oi.version = ctx->at_version;
+    snapset_obc->obs.oi.prior_version =
+      snapset_obc->obs.oi.version;
+    snapset_obc->obs.oi.version = ctx->at_version;
 
     map <string, bufferlist> attrs;
     bl.clear();
@@ -3612,13 +3839,13 @@ PrimaryLogPG::OpContextUPtr PrimaryLogPG::trim_object(bool first, const hobject_
     attrs[SS_ATTR].claim(bl);
 
     bl.clear();
-    ::encode(ctx->snapset_obc->obs.oi, bl,
+    ::encode(snapset_obc->obs.oi, bl,
 	     get_osdmap()->get_features(CEPH_ENTITY_TYPE_OSD, nullptr));
     attrs[OI_ATTR].claim(bl);
     t->setattrs(snapoid, attrs);
   }
 
-  return ctx;
+  return true;
 }
 
 void PrimaryLogPG::kick_snap_trim()
@@ -5049,6 +5276,7 @@ int PrimaryLogPG::do_osd_ops(OpContext *ctx, vector<OSDOp>& ops)
 	    dout(10) << " truncate_seq " << op.extent.truncate_seq << " > current " << seq
 		     << ", truncating to " << op.extent.truncate_size << dendl;
 	    t->truncate(soid, op.extent.truncate_size);
+	    ctx->modified_ranges_exact = false;
 	    oi.truncate_seq = op.extent.truncate_seq;
 	    oi.truncate_size = op.extent.truncate_size;
 	    if (op.extent.truncate_size != oi.size) {
@@ -6085,6 +6313,7 @@ int PrimaryLogPG::_rollback_to(OpContext *ctx, ceph_osd_op& op)
   hobject_t missing_oid;
 
   dout(10) << "_rollback_to " << soid << " snapid " << snapid << dendl;
+  ctx->modified_ranges_exact = false;
 
   ObjectContextRef rollback_to;
   int ret = find_object_context(
@@ -6591,6 +6820,15 @@ int PrimaryLogPG::prepare_transaction(OpContext *ctx)
     }
   }
 
+  // remember what changed for recovery before make_writeable() trims
+  // modified_ranges down to the clone overlap
+  bool log_extents = ctx->modified_ranges_exact &&
+    ctx->obs->exists && ctx->new_obs.exists &&
+    !ctx->obs->oi.is_whiteout() && soid.snap == CEPH_NOSNAP;
+  interval_set<uint64_t> modified_extents;
+  if (log_extents)
+    modified_extents = ctx->modified_ranges;
+
   // clone, if necessary
   if (soid.snap == CEPH_NOSNAP)
     make_writeable(ctx);
@@ -6599,6 +6837,13 @@ int PrimaryLogPG::prepare_transaction(OpContext *ctx)
 	     ctx->new_obs.exists ? pg_log_entry_t::MODIFY :
 	     pg_log_entry_t::DELETE);
 
+  if (log_extents) {
+    pg_log_entry_t& e = ctx->log.back();
+    assert(e.soid == soid && e.is_modify());
+    e.has_modified_extents = true;
+    e.modified_extents.swap(modified_extents);
+  }
+
   return result;
 }
 
@@ -6788,6 +7033,27 @@ void PrimaryLogPG::apply_stats(
   }
 }
 
+/**
+ * account for read data the op does not share with the object store
+ *
+ * From ObjectStore::read() to the messenger, read data is passed along
+ * as shared bufferptrs, so data served from the store's cache still
+ * has the cache's reference when the reply is built.  Data only this
+ * op refers to was copied (decoded, reassembled, zero-filled, or read
+ * by a store that does not cache) somewhere on the way.
+ */
+void PrimaryLogPG::log_read_copies(const vector<OSDOp>& ops)
+{
+  uint64_t copied = 0;
+  for (auto& p : ops) {
+    for (auto& b : p.outdata.buffers()) {
+      if (b.raw_nref() == 1)
+	copied += b.length();
+    }
+  }
+  osd->logger->inc(l_osd_op_r_copyb, copied);
+}
+
 void PrimaryLogPG::complete_read_ctx(int result, OpContext *ctx)
 {
   const MOSDOp *m = static_cast<const MOSDOp*>(ctx->op->get_req());
@@ -6801,6 +7067,8 @@ void PrimaryLogPG::complete_read_ctx(int result, OpContext *ctx)
     }
     ctx->bytes_read += p->outdata.length();
   }
+  if (result >= 0)
+    log_read_copies(ctx->ops);
   ctx->reply->claim_op_out_data(ctx->ops);
   ctx->reply->get_header().data_off = ctx->data_off;
 
@@ -7434,6 +7702,7 @@ void PrimaryLogPG::finish_copyfrom(OpContext *ctx)
   ObjectState& obs = ctx->new_obs;
   CopyFromCallback *cb = static_cast<CopyFromCallback*>(ctx->copy_cb);
 
+  ctx->modified_ranges_exact = false;
   if (obs.exists) {
     dout(20) << __func__ << ": exists, removing" << dendl;
     ctx->op_t->remove(obs.oi.soid);
@@ -10349,6 +10618,15 @@ bool PrimaryLogPG::start_recovery_ops(
   } else { // backfilling
     state_clear(PG_STATE_BACKFILL);
     dout(10) << "recovery done, backfill done" << dendl;
+    {
+      // no deep scrub has hashed the backfilled copies yet
+      ObjectStore::Transaction t;
+      scrub_clear_verified(&t);
+      if (!t.empty()) {
+	int tr = osd->store->queue_transaction(osr.get(), std::move(t), NULL);
+	assert(tr == 0);
+      }
+    }
     queue_peering_event(
       CephPeeringEvtRef(
         std::make_shared<CephPeeringEvt>(
@@ -11360,8 +11638,16 @@ void PrimaryLogPG::hit_set_setup()
     return;
   }
 
-  // FIXME: discard any previous data for now
-  hit_set_create();
+  if (pool.info.hit_set_params.get_type() == HitSet::TYPE_DECAYING_COUNT &&
+      hit_set && hit_set->is_decaying()) {
+    // one set spans every period, and we have been keeping it all along
+    return;
+  }
+
+  // FIXME: discard any previous data for now, unless we can resume from
+  // a checkpoint
+  if (!hit_set_load_checkpoint())
+    hit_set_create();
 
   // include any writes we know about from the pg log.  this doesn't
   // capture reads, but it is better than nothing!
@@ -11444,11 +11730,69 @@ void PrimaryLogPG::hit_set_create()
 
     dout(10) << __func__ << " target_size " << p->target_size
 	     << " fpp " << p->get_fpp() << dendl;
+  } else if (pool.info.hit_set_params.get_type() ==
+	     HitSet::TYPE_DECAYING_COUNT) {
+    DecayingCountHitSet::Params *p =
+      static_cast<DecayingCountHitSet::Params*>(params.impl.get());
+    if (!p->half_life)
+      p->half_life = pool.info.hit_set_period;
+    dout(10) << __func__ << " " << p->width << "x" << p->depth
+	     << " half_life " << p->half_life << dendl;
   }
   hit_set.reset(new HitSet(params));
   hit_set_start_stamp = now;
 }
 
+/**
+ * resume a decaying HitSet from the newest archive
+ *
+ * A decaying set is never replaced, only checkpointed each period, so
+ * the newest archive is where a new primary picks it up.
+ *
+ * @return true if hit_set was loaded
+ */
+bool PrimaryLogPG::hit_set_load_checkpoint()
+{
+  if (pool.info.hit_set_params.get_type() != HitSet::TYPE_DECAYING_COUNT ||
+      info.hit_set.history.empty() ||
+      !pool.info.is_replicated())  // FIXME: EC, as in agent_load_hit_sets
+    return false;
+
+  const pg_hit_set_info_t& p = info.hit_set.history.back();
+  hobject_t oid = get_hit_set_archive_object(p.begin, p.end, p.using_gmt);
+  if (is_unreadable_object(oid)) {
+    dout(10) << __func__ << " unreadable " << oid << dendl;
+    return false;
+  }
+  ObjectContextRef obc = get_object_context(oid, false);
+  if (!obc) {
+    dout(10) << __func__ << " could not load " << oid << dendl;
+    return false;
+  }
+
+  bufferlist bl;
+  obc->ondisk_read_lock();
+  int r = osd->store->read(ch, ghobject_t(oid), 0, 0, bl);
+  obc->ondisk_read_unlock();
+  if (r < 0)
+    return false;
+  HitSetRef hs(new HitSet);
+  try {
+    bufferlist::iterator pbl = bl.begin();
+    ::decode(*hs, pbl);
+  } catch (buffer::error& e) {
+    derr << __func__ << " failed to decode " << oid << dendl;
+    return false;
+  }
+  if (!hs->impl || !hs->is_decaying())
+    return false;
+
+  dout(10) << __func__ << " resuming from " << oid << dendl;
+  hit_set = hs;
+  hit_set_start_stamp = ceph_clock_now();
+  return true;
+}
+
 /**
  * apply log entries to set
  *
@@ -11535,11 +11879,17 @@ void PrimaryLogPG::hit_set_persist()
   if (scrubber.write_blocked_by_scrub(oid))
     return;
 
-  hit_set->seal();
+  // a decaying set is only checkpointed; it carries on as the current
+  // set, covers every older archive, and is never scanned by the agent
+  bool decaying = hit_set->is_decaying();
+  if (decaying)
+    max = 1;
+  else
+    hit_set->seal();
   ::encode(*hit_set, bl);
   dout(20) << __func__ << " archive " << oid << dendl;
 
-  if (agent_state) {
+  if (agent_state && !decaying) {
     agent_state->add_hit_set(new_hset.begin, hit_set);
     uint32_t size = agent_state->hit_set_map.size();
     if (size >= pool.info.hit_set_count) {
@@ -11559,7 +11909,10 @@ void PrimaryLogPG::hit_set_persist()
   new_hset.version = ctx->at_version;
 
   updated_hit_set_hist.history.push_back(new_hset);
-  hit_set_create();
+  if (decaying)
+    hit_set_start_stamp = now;
+  else
+    hit_set_create();
 
   // fabricate an object_info_t and SnapSet
   obc->obs.oi.version = ctx->at_version;
@@ -11869,6 +12222,10 @@ void PrimaryLogPG::agent_load_hit_sets()
   if (agent_state->evict_mode == TierAgentState::EVICT_MODE_IDLE) {
     return;
   }
+  if (hit_set && hit_set->is_decaying()) {
+    // the archives are old checkpoints of hit_set itself
+    return;
+  }
 
   if (agent_state->hit_set_map.size() < info.hit_set.history.size()) {
     dout(10) << __func__ << dendl;
@@ -12341,6 +12698,10 @@ void PrimaryLogPG::agent_estimate_temp(const hobject_t& oid, int *temp)
   assert(hit_set);
   assert(temp);
   *temp = 0;
+  if (hit_set->is_decaying()) {
+    *temp = std::min<double>(hit_set->hit_count(oid) * 1000000, INT_MAX);
+    return;
+  }
   if (hit_set->contains(oid))
     *temp = 1000000;
   unsigned i = 0;
@@ -12868,6 +13229,12 @@ void PrimaryLogPG::_scrub_finish()
   bool deep_scrub = state_test(PG_STATE_DEEP_SCRUB);
   const char *mode = (repair ? "repair": (deep_scrub ? "deep-scrub" : "scrub"));
 
+  if (scrubber.resumed) {
+    // scrub_cstat only covers the chunks scrubbed since we resumed
+    dout(10) << mode << " resumed, not checking stats" << dendl;
+    return;
+  }
+
   if (info.stats.stats_invalid) {
     info.stats.stats = scrub_cstat;
     info.stats.stats_invalid = false;
@@ -13028,8 +13395,11 @@ boost::statechart::result PrimaryLogPG::AwaitAsyncWork::react(const DoSnapWork&)
 
   ldout(pg->cct, 10) << "AwaitAsyncWork: trimming snap " << snap_to_trim << dendl;
 
+  // up to osd_pg_max_concurrent_snap_trims transactions, each trimming up
+  // to osd_snap_trim_batch clones
   vector<hobject_t> to_trim;
-  unsigned max = pg->cct->_conf->osd_pg_max_concurrent_snap_trims;
+  unsigned batch = MAX(1, pg->cct->_conf->osd_snap_trim_batch);
+  unsigned max = pg->cct->_conf->osd_pg_max_concurrent_snap_trims * batch;
   to_trim.reserve(max);
   int r = pg->snap_mapper.get_next_objects_to_trim(
     snap_to_trim,
@@ -13048,6 +13418,9 @@ boost::statechart::result PrimaryLogPG::AwaitAsyncWork::react(const DoSnapWork&)
 		       << dendl;
     pg->info.purged_snaps.insert(snap_to_trim);
     pg->snap_trimq.erase(snap_to_trim);
+    // recounted on every map; don't wrap if this pg wasn't in that count
+    if (pg->osd->logger->get(l_osd_snap_trim_queue))
+      pg->osd->logger->dec(l_osd_snap_trim_queue);
     ldout(pg->cct, 10) << "purged_snaps now "
 		       << pg->info.purged_snaps << ", snap_trimq now "
 		       << pg->snap_trimq << dendl;
@@ -13064,13 +13437,41 @@ boost::statechart::result PrimaryLogPG::AwaitAsyncWork::react(const DoSnapWork&)
   }
   assert(!to_trim.empty());
 
+  auto submit = [pg, &in_flight](OpContextUPtr ctx, vector<hobject_t> objects) {
+    for (auto &o : objects)
+      in_flight.insert(o);
+    pg->osd->logger->inc(l_osd_snap_trim_txns);
+    pg->osd->logger->inc(l_osd_snap_trim_objects, objects.size());
+    ctx->register_on_success(
+      [pg, objects, &in_flight]() {
+	for (auto &o : objects) {
+	  assert(in_flight.find(o) != in_flight.end());
+	  in_flight.erase(o);
+	}
+	if (in_flight.empty())
+	  pg->snap_trimmer_machine.process_event(RepopsComplete());
+      });
+    pg->simple_opc_submit(std::move(ctx));
+  };
+
+  OpContextUPtr ctx;
+  vector<hobject_t> ctx_objects;
+  set<hobject_t> ctx_heads;
   for (auto &&object: to_trim) {
+    if (ctx && (ctx_objects.size() >= batch ||
+		ctx_heads.count(object.get_head()))) {
+      submit(std::move(ctx), std::move(ctx_objects));
+      ctx_objects.clear();
+      ctx_heads.clear();
+    }
+
     // Get next
     ldout(pg->cct, 10) << "AwaitAsyncWork react trimming " << object << dendl;
-    OpContextUPtr ctx = pg->trim_object(in_flight.empty(), object);
-    if (!ctx) {
+    if (!pg->trim_object(in_flight.empty() && !ctx, object, &ctx)) {
       ldout(pg->cct, 10) << "could not get write lock on obj "
 			 << object << dendl;
+      if (ctx)
+	submit(std::move(ctx), std::move(ctx_objects));
       if (in_flight.empty()) {
 	ldout(pg->cct, 10) << "waiting for it to clear"
 			   << dendl;
@@ -13081,18 +13482,11 @@ boost::statechart::result PrimaryLogPG::AwaitAsyncWork::react(const DoSnapWork&)
 	return transit< WaitRepops >();
       }
     }
-
-    in_flight.insert(object);
-    ctx->register_on_success(
-      [pg, object, &in_flight]() {
-	assert(in_flight.find(object) != in_flight.end());
-	in_flight.erase(object);
-	if (in_flight.empty())
-	  pg->snap_trimmer_machine.process_event(RepopsComplete());
-      });
-
-    pg->simple_opc_submit(std::move(ctx));
+    ctx_objects.push_back(object);
+    ctx_heads.insert(object.get_head());
   }
+  if (ctx)
+    submit(std::move(ctx), std::move(ctx_objects));
 
   return transit< WaitRepops >();
 }
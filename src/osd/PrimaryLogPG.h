@@ -514,6 +514,8 @@ public:
     boost::optional<pg_hit_set_history_t> updated_hset_history;
 
     interval_set<uint64_t> modified_ranges;
+    /// false if the data may have changed outside modified_ranges
+    bool modified_ranges_exact = true;
     ObjectContextRef obc;
     ObjectContextRef clone_obc;    // if we created a clone
     ObjectContextRef snapset_obc;  // if we created/deleted a snapdir
@@ -882,6 +884,7 @@ protected:
   void hit_set_clear();     ///< discard any HitSet state
   void hit_set_setup();     ///< initialize HitSet state
   void hit_set_create();    ///< create a new HitSet
+  bool hit_set_load_checkpoint(); ///< resume a decaying HitSet from its archive
   void hit_set_persist();   ///< persist hit info
   bool hit_set_apply_log(); ///< apply log entries to update in-memory HitSet
   void hit_set_trim(OpContextUPtr &ctx, unsigned max); ///< discard old HitSets
@@ -1093,6 +1096,8 @@ protected:
   void reply_ctx(OpContext *ctx, int err, eversion_t v, version_t uv);
   void make_writeable(OpContext *ctx);
   void log_op_stats(OpContext *ctx);
+  void log_op_stats(OpRequestRef op, uint64_t inb, uint64_t outb);
+  void log_read_copies(const vector<OSDOp>& ops);
 
   void write_update_size_and_usage(object_stat_sum_t& stats, object_info_t& oi,
 				   interval_set<uint64_t>& modified, uint64_t offset,
@@ -1349,6 +1354,8 @@ public:
     OpRequestRef& op,
     ThreadPool::TPHandle &handle) override;
   void do_op(OpRequestRef& op) override;
+  /// serve a small read without an OpContext; false to take the slow path
+  bool do_small_read(OpRequestRef& op);
   void record_write_error(OpRequestRef op, const hobject_t &soid,
 			  MOSDOpReply *orig_reply, int r);
   void do_pg_op(OpRequestRef op);
@@ -1361,7 +1368,7 @@ public:
 
   void handle_backoff(OpRequestRef& op);
 
-  OpContextUPtr trim_object(bool first, const hobject_t &coid);
+  bool trim_object(bool first, const hobject_t &coid, OpContextUPtr *pctx);
   void snap_trimmer(epoch_t e) override;
   void kick_snap_trim() override;
   void snap_trimmer_scrub_complete() override;
@@ -1695,6 +1702,8 @@ private:
   int _rollback_to(OpContext *ctx, ceph_osd_op& op);
 public:
   bool is_missing_object(const hobject_t& oid) const;
+  /// whether a replica has oid committed on every replica
+  bool replica_can_read(const hobject_t& oid) const;
   bool is_unreadable_object(const hobject_t &oid) const {
     return is_missing_object(oid) ||
       !missing_loc.readable_with_acting(oid, actingset);
@@ -0,0 +1,134 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2004-2006 Sage Weil <sage@newdream.net>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "RepOpBatcher.h"
+#include "OSD.h"
+#include "common/perf_counters.h"
+#include "messages/MOSDRepOp.h"
+#include "messages/MOSDRepOpBatch.h"
+
+#define dout_context cct
+#define dout_subsys ceph_subsys_osd
+#undef dout_prefix
+#define dout_prefix *_dout << "repop_batcher "
+
+RepOpBatcher::RepOpBatcher(CephContext *cct, PerfCounters *&logger)
+  : cct(cct),
+    logger(logger),
+    lock("RepOpBatcher::lock"),
+    stopping(false),
+    flush_thread(this)
+{
+}
+
+RepOpBatcher::~RepOpBatcher()
+{
+  assert(pending.empty());
+}
+
+void RepOpBatcher::start()
+{
+  flush_thread.create("osd_repop_batch");
+}
+
+void RepOpBatcher::stop()
+{
+  {
+    Mutex::Locker l(lock);
+    stopping = true;
+    cond.Signal();
+  }
+  if (flush_thread.is_started())
+    flush_thread.join();
+  Mutex::Locker l(lock);
+  while (!pending.empty())
+    _send(pending.begin()->first);
+}
+
+void RepOpBatcher::_send(Connection *con)
+{
+  assert(lock.is_locked());
+  auto p = pending.find(con);
+  if (p == pending.end())
+    return;
+  batch_t& b = p->second;
+  dout(20) << __func__ << " " << b.con->get_peer_addr() << " "
+	   << b.m->ops.size() << " ops " << b.bytes << " bytes" << dendl;
+  // sent with the lock held, so batches and anything flushed ahead of
+  // them go out in queue order
+  if (b.m->ops.size() == 1) {
+    Message *m = b.m->ops.front();
+    b.m->ops.clear();
+    b.m->put();
+    b.con->send_message(m);
+  } else {
+    if (logger) {
+      logger->inc(l_osd_repop_batch);
+      logger->inc(l_osd_repop_batch_ops, b.m->ops.size());
+    }
+    b.con->send_message(b.m);
+  }
+  pending.erase(p);
+}
+
+void RepOpBatcher::queue(const ConnectionRef& con, MOSDRepOp *m, epoch_t e)
+{
+  uint64_t bytes = m->get_data().length() + m->logbl.length();
+  Mutex::Locker l(lock);
+  batch_t& b = pending[con.get()];
+  if (!b.m) {
+    b.con = con;
+    b.m = new MOSDRepOpBatch(e);
+    b.m->set_priority(m->get_priority());
+    b.expires = ceph_clock_now();
+    b.expires += cct->_conf->osd_repop_batch_window;
+    cond.Signal();
+  }
+  b.m->ops.push_back(m);
+  b.bytes += bytes;
+  if (stopping || b.bytes >= cct->_conf->osd_repop_batch_max_bytes)
+    _send(con.get());
+}
+
+void RepOpBatcher::flush(Connection *con)
+{
+  Mutex::Locker l(lock);
+  _send(con);
+}
+
+void RepOpBatcher::flush_entry()
+{
+  Mutex::Locker l(lock);
+  while (!stopping) {
+    if (pending.empty()) {
+      cond.Wait(lock);
+      continue;
+    }
+    utime_t now = ceph_clock_now();
+    utime_t next;
+    for (auto p = pending.begin(); p != pending.end(); ) {
+      if (p->second.expires <= now) {
+	Connection *con = p->first;
+	++p;
+	_send(con);
+      } else {
+	if (next == utime_t() || p->second.expires < next)
+	  next = p->second.expires;
+	++p;
+      }
+    }
+    if (next != utime_t())
+      cond.WaitUntil(lock, next);
+  }
+}
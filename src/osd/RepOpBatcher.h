@@ -0,0 +1,79 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2004-2006 Sage Weil <sage@newdream.net>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSD_REPOPBATCHER_H
+#define CEPH_OSD_REPOPBATCHER_H
+
+#include <map>
+
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
+#include "msg/Connection.h"
+
+class MOSDRepOp;
+class MOSDRepOpBatch;
+class PerfCounters;
+
+/**
+ * Coalesces rep ops bound for the same peer into MOSDRepOpBatch
+ * messages.
+ *
+ * A peer's batch goes out once it holds osd_repop_batch_max_bytes of
+ * op data, once osd_repop_batch_window has passed since its first op,
+ * or right before anything else is sent on the same connection, so
+ * that a pg's messages to a replica stay in order.
+ */
+class RepOpBatcher {
+  CephContext *cct;
+  PerfCounters *&logger;
+  Mutex lock;
+  Cond cond;
+  bool stopping;
+
+  struct batch_t {
+    ConnectionRef con;
+    MOSDRepOpBatch *m;
+    uint64_t bytes;
+    utime_t expires;
+    batch_t() : m(nullptr), bytes(0) {}
+  };
+  std::map<Connection*, batch_t> pending;
+
+  void _send(Connection *con);
+
+  struct FlushThread : public Thread {
+    RepOpBatcher *batcher;
+    explicit FlushThread(RepOpBatcher *b) : batcher(b) {}
+    void *entry() override {
+      batcher->flush_entry();
+      return NULL;
+    }
+  } flush_thread;
+  void flush_entry();
+
+public:
+  RepOpBatcher(CephContext *cct, PerfCounters *&logger);
+  ~RepOpBatcher();
+
+  void start();
+  void stop();
+
+  /// queue m for con; takes the message ref
+  void queue(const ConnectionRef& con, MOSDRepOp *m, epoch_t e);
+  /// send whatever is queued for con now
+  void flush(Connection *con);
+};
+
+#endif
@@ -1079,6 +1079,8 @@ void ReplicatedBackend::issue_op(
       op_t,
       peer,
       pinfo);
+    if (op->op)
+      wr->trace = op->op->get_trace_context();
 
     get_parent()->send_message_osd_cluster(
       peer.osd, wr, get_osdmap()->get_epoch());
@@ -1089,6 +1091,7 @@ void ReplicatedBackend::issue_op(
 void ReplicatedBackend::sub_op_modify(OpRequestRef op)
 {
   static_cast<MOSDRepOp*>(op->get_nonconst_req())->finish_decode();
+  op->start_trace();
   const MOSDRepOp *m = static_cast<const MOSDRepOp *>(op->get_req());
   int msg_type = m->get_type();
   assert(MSG_OSD_REPOP == msg_type);
@@ -1581,6 +1584,11 @@ void ReplicatedBackend::prep_push_to_replica(
       lock_manager);
   }
 
+  eversion_t base_version;
+  if (soid.snap == CEPH_NOSNAP)
+    calc_dirty_subsets(oi, soid, peer, data_subset, clone_subsets,
+		       &base_version);
+
   prep_push(
     obc,
     soid,
@@ -1590,7 +1598,57 @@ void ReplicatedBackend::prep_push_to_replica(
     clone_subsets,
     pop,
     cache_dont_need,
-    std::move(lock_manager));
+    std::move(lock_manager),
+    base_version);
+}
+
+/*
+ * if the peer has an older version of head and the log told us which
+ * ranges changed since, only push those; the peer rebuilds the rest
+ * from its own copy.
+ */
+bool ReplicatedBackend::calc_dirty_subsets(
+  const object_info_t& oi, const hobject_t& head, pg_shard_t peer,
+  interval_set<uint64_t>& data_subset,
+  map<hobject_t, interval_set<uint64_t>>& clone_subsets,
+  eversion_t *base_version)
+{
+  if (!cct->_conf->osd_recovery_dirty_extents ||
+      !get_osdmap()->test_flag(CEPH_OSDMAP_REQUIRE_LUMINOUS))
+    return false;
+  const pg_missing_t& missing =
+    get_parent()->get_shard_missing().find(peer)->second;
+  pg_missing_item item;
+  if (!missing.is_missing(head, &item) ||
+      !item.dirty_known ||
+      item.have == eversion_t() ||
+      item.need != oi.version) {
+    dout(20) << __func__ << " " << head << " dirty extents unknown on osd."
+	     << peer << dendl;
+    return false;
+  }
+
+  interval_set<uint64_t> dirty;
+  if (oi.size) {
+    dirty.insert(0, oi.size);
+    dirty.intersection_of(item.dirty);
+  }
+  data_subset.intersection_of(dirty);
+  for (map<hobject_t, interval_set<uint64_t>>::iterator p =
+	 clone_subsets.begin();
+       p != clone_subsets.end(); ) {
+    p->second.intersection_of(dirty);
+    if (p->second.empty())
+      clone_subsets.erase(p++);
+    else
+      ++p;
+  }
+  *base_version = item.have;
+  dout(10) << __func__ << " " << head << " osd." << peer << " has "
+	   << item.have << ", pushing dirty " << data_subset
+	   << " clone_subsets " << clone_subsets << dendl;
+  get_parent()->get_logger()->inc(l_osd_push_partial);
+  return true;
 }
 
 void ReplicatedBackend::prep_push(ObjectContextRef obc,
@@ -1615,7 +1673,8 @@ void ReplicatedBackend::prep_push(
   map<hobject_t, interval_set<uint64_t>>& clone_subsets,
   PushOp *pop,
   bool cache_dont_need,
-  ObcLockManager &&lock_manager)
+  ObcLockManager &&lock_manager,
+  eversion_t base_version)
 {
   get_parent()->begin_peer_recover(peer, soid);
   // take note.
@@ -1627,6 +1686,7 @@ void ReplicatedBackend::prep_push(
   pi.recovery_info.soid = soid;
   pi.recovery_info.oi = obc->obs.oi;
   pi.recovery_info.version = version;
+  pi.recovery_info.base_version = base_version;
   pi.recovery_progress.first = true;
   pi.recovery_progress.data_recovered_to = 0;
   pi.recovery_progress.data_complete = 0;
@@ -1641,6 +1701,39 @@ void ReplicatedBackend::prep_push(
 			&(pi.stat), cache_dont_need);
   assert(r == 0);
   pi.recovery_progress = new_progress;
+  pi.in_flight = 1;
+}
+
+/**
+ * fill_push_window
+ *
+ * Queue further chunks of soid for peer, without waiting for the acks
+ * of the earlier ones, until osd_recovery_push_window chunks are in
+ * flight.  The replica applies them in order: they go out on the same
+ * connection, are queued for the same pg and applied on the same
+ * sequencer.
+ */
+void ReplicatedBackend::fill_push_window(
+  const hobject_t &soid, pg_shard_t peer,
+  vector<PushOp> *pops, bool cache_dont_need)
+{
+  PushInfo &pi = pushing[soid][peer];
+  uint64_t window = MAX(1, cct->_conf->osd_recovery_push_window);
+  while (pi.in_flight < window && !pi.recovery_progress.data_complete) {
+    dout(20) << __func__ << " " << soid << " to osd." << peer
+	     << " from " << pi.recovery_progress.data_recovered_to
+	     << ", " << pi.in_flight << " in flight" << dendl;
+    pops->push_back(PushOp());
+    ObjectRecoveryProgress new_progress;
+    int r = build_push_op(pi.recovery_info,
+			  pi.recovery_progress,
+			  &new_progress,
+			  &pops->back(),
+			  &(pi.stat), cache_dont_need);
+    assert(r == 0);
+    pi.recovery_progress = new_progress;
+    ++pi.in_flight;
+  }
 }
 
 int ReplicatedBackend::send_pull_legacy(int prio, pg_shard_t peer,
@@ -1690,8 +1783,11 @@ void ReplicatedBackend::submit_push_data(
   const map<string, bufferlist> &omap_entries,
   ObjectStore::Transaction *t)
 {
+  // with a base version we build on the copy of soid we already have,
+  // so it must stay in place until the new one is complete
+  bool partial = recovery_info.base_version != eversion_t();
   hobject_t target_oid;
-  if (first && complete) {
+  if (first && complete && !partial) {
     target_oid = recovery_info.soid;
   } else {
     target_oid = get_parent()->get_temp_recovery_object(recovery_info.version,
@@ -1705,8 +1801,25 @@ void ReplicatedBackend::submit_push_data(
 
   if (first) {
     t->remove(coll, ghobject_t(target_oid));
-    t->touch(coll, ghobject_t(target_oid));
+    if (partial) {
+      dout(10) << __func__ << ": rebuilding " << recovery_info.soid
+	       << " from " << recovery_info.base_version
+	       << " with " << recovery_info.copy_subset << dendl;
+      t->clone(coll, ghobject_t(recovery_info.soid), ghobject_t(target_oid));
+      t->omap_clear(coll, ghobject_t(target_oid));
+      t->rmattrs(coll, ghobject_t(target_oid));
+    } else {
+      t->touch(coll, ghobject_t(target_oid));
+    }
     t->truncate(coll, ghobject_t(target_oid), recovery_info.size);
+    if (partial) {
+      // holes in the dirty ranges are not pushed; punch them here
+      for (interval_set<uint64_t>::const_iterator p =
+	     recovery_info.copy_subset.begin();
+	   p != recovery_info.copy_subset.end();
+	   ++p)
+	t->zero(coll, ghobject_t(target_oid), p.get_start(), p.get_len());
+    }
     if (omap_header.length()) 
       t->omap_setheader(coll, ghobject_t(target_oid), omap_header);
 
@@ -1737,7 +1850,7 @@ void ReplicatedBackend::submit_push_data(
     t->setattrs(coll, ghobject_t(target_oid), attrs);
 
   if (complete) {
-    if (!first) {
+    if (target_oid != recovery_info.soid) {
       dout(10) << __func__ << ": Removing oid "
 	       << target_oid << " from the temp collection" << dendl;
       clear_temp_obj(target_oid);
@@ -2203,6 +2316,8 @@ bool ReplicatedBackend::handle_push_reply(
     return false;
   } else {
     PushInfo *pi = &pushing[soid][peer];
+    if (pi->in_flight)
+      --pi->in_flight;
 
     if (!pi->recovery_progress.data_complete) {
       dout(10) << " pushing more from, "
@@ -2215,7 +2330,12 @@ bool ReplicatedBackend::handle_push_reply(
 	&(pi->stat));
       assert(r == 0);
       pi->recovery_progress = new_progress;
+      ++pi->in_flight;
       return true;
+    } else if (pi->in_flight) {
+      dout(10) << " pushed all of " << soid << " to osd." << peer
+	       << ", waiting for " << pi->in_flight << " more acks" << dendl;
+      return false;
     } else {
       // done!
       get_parent()->on_peer_recover(
@@ -2451,6 +2571,7 @@ int ReplicatedBackend::start_pushes(
       h->pushes[peer].push_back(PushOp());
       prep_push_to_replica(obc, soid, peer,
 			   &(h->pushes[peer].back()), h->cache_dont_need);
+      fill_push_window(soid, peer, &(h->pushes[peer]), h->cache_dont_need);
     }
   }
   return pushes;
@@ -168,8 +168,10 @@ private:
     ObjectContextRef obc;
     object_stat_sum_t stat;
     ObcLockManager lock_manager;
+    unsigned in_flight = 0;  ///< chunks sent and not yet acked
 
     void dump(Formatter *f) const {
+      f->dump_unsigned("in_flight", in_flight);
       {
 	f->open_object_section("recovery_progress");
 	recovery_progress.dump(f);
@@ -270,6 +272,8 @@ private:
     int priority,
     map<pg_shard_t, vector<PullOp> > &pulls);
 
+  void fill_push_window(const hobject_t &soid, pg_shard_t peer,
+			vector<PushOp> *pops, bool cache_dont_need = true);
   int build_push_op(const ObjectRecoveryInfo &recovery_info,
 		    const ObjectRecoveryProgress &progress,
 		    ObjectRecoveryProgress *out_progress,
@@ -320,7 +324,13 @@ private:
     map<hobject_t, interval_set<uint64_t>>& clone_subsets,
     PushOp *op,
     bool cache,
-    ObcLockManager &&lock_manager);
+    ObcLockManager &&lock_manager,
+    eversion_t base_version = eversion_t());
+  bool calc_dirty_subsets(
+    const object_info_t& oi, const hobject_t& head, pg_shard_t peer,
+    interval_set<uint64_t>& data_subset,
+    map<hobject_t, interval_set<uint64_t>>& clone_subsets,
+    eversion_t *base_version);
   void calc_head_subsets(
     ObjectContextRef obc, SnapSet& snapset, const hobject_t& head,
     const pg_missing_t& missing,
@@ -21,6 +21,7 @@
 #include "OSDCap.h"
 #include "Watch.h"
 #include "OSDMap.h"
+#include "ClientThrottle.h"
 
 struct Session;
 typedef boost::intrusive_ptr<Session> SessionRef;
@@ -133,6 +134,11 @@ struct Session : public RefCountedObject {
   OSDMapRef osdmap;  /// Map as of which waiting_for_pg is current
   map<spg_t, boost::intrusive::list<OpRequest> > waiting_for_pg;
 
+  /// admission control for this client's ops; set on its first op and,
+  /// like throttle_retry_scheduled, protected by session_dispatch_lock
+  ClientThrottleRef throttle;
+  bool throttle_retry_scheduled = false;
+
   Spinlock sent_epoch_lock;
   epoch_t last_sent_epoch;
   Spinlock received_map_lock;
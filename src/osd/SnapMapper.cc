@@ -293,6 +293,41 @@ int SnapMapper::remove_oid(
   return _remove_oid(oid, t);
 }
 
+int SnapMapper::remove_oids(
+  const vector<hobject_t> &oids,
+  MapCacher::Transaction<std::string, bufferlist> *t)
+{
+  dout(20) << __func__ << " " << oids << dendl;
+  map<string, hobject_t> obj_keys;
+  for (auto &oid : oids) {
+    assert(check(oid));
+    obj_keys[to_object_key(oid)] = oid;
+  }
+  set<string> keys;
+  for (auto &p : obj_keys)
+    keys.insert(p.first);
+  map<string, bufferlist> got;
+  int r = backend.get_keys(keys, &got);
+  if (r < 0)
+    return r;
+  if (got.size() != keys.size())
+    return -ENOENT;
+
+  set<string> to_remove;
+  for (auto &p : got) {
+    object_snaps out;
+    bufferlist::iterator bp = p.second.begin();
+    ::decode(out, bp);
+    assert(!out.snaps.empty());
+    const hobject_t &oid = obj_keys[p.first];
+    to_remove.insert(p.first);
+    for (auto &snap : out.snaps)
+      to_remove.insert(to_raw_key(make_pair(snap, oid)));
+  }
+  backend.remove_keys(to_remove, t);
+  return 0;
+}
+
 int SnapMapper::_remove_oid(
   const hobject_t &oid,
   MapCacher::Transaction<std::string, bufferlist> *t)
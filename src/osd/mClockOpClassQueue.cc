@@ -0,0 +1,189 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2004-2006 Sage Weil <sage@newdream.net>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "OSD.h"
+#include "OSDMap.h"
+#include "mClockOpClassQueue.h"
+#include "common/perf_counters.h"
+
+typedef PGQueueable::op_type_t op_type_t;
+
+std::ostream& operator<<(std::ostream& out, const mclock_op_class_t& c)
+{
+  switch (c.type) {
+  case op_type_t::client_op:
+    out << "client_op";
+    if (c.pool >= 0)
+      out << ".pool" << c.pool;
+    break;
+  case op_type_t::osd_subop: out << "osd_subop"; break;
+  case op_type_t::bg_snaptrim: out << "snaptrim"; break;
+  case op_type_t::bg_recovery: out << "recovery"; break;
+  case op_type_t::bg_scrub: out << "scrub"; break;
+  }
+  return out;
+}
+
+// l_osd_mclock_*_len and _lat, in op_type_t order
+static int len_counter(op_type_t t)
+{
+  return l_osd_mclock_client_len + 2 * static_cast<int>(t);
+}
+
+static int lat_counter(op_type_t t)
+{
+  return len_counter(t) + 1;
+}
+
+mClockOpClassQueue::mClockOpClassQueue(CephContext *cct, PerfCounters *&logger)
+  : cct(cct),
+    logger(logger),
+    queue([this](const Request& r) { return _classify(r); },
+	  [this](const mclock_op_class_t& c) { return _get_info(c); })
+{
+  const md_config_t *conf = cct->_conf;
+  class_info[op_type_t::client_op] = mClockClientInfo(
+    conf->osd_op_queue_mclock_client_op_res,
+    conf->osd_op_queue_mclock_client_op_wgt,
+    conf->osd_op_queue_mclock_client_op_lim);
+  class_info[op_type_t::osd_subop] = mClockClientInfo(
+    conf->osd_op_queue_mclock_osd_subop_res,
+    conf->osd_op_queue_mclock_osd_subop_wgt,
+    conf->osd_op_queue_mclock_osd_subop_lim);
+  class_info[op_type_t::bg_snaptrim] = mClockClientInfo(
+    conf->osd_op_queue_mclock_snap_res,
+    conf->osd_op_queue_mclock_snap_wgt,
+    conf->osd_op_queue_mclock_snap_lim);
+  class_info[op_type_t::bg_recovery] = mClockClientInfo(
+    conf->osd_op_queue_mclock_recov_res,
+    conf->osd_op_queue_mclock_recov_wgt,
+    conf->osd_op_queue_mclock_recov_lim);
+  class_info[op_type_t::bg_scrub] = mClockClientInfo(
+    conf->osd_op_queue_mclock_scrub_res,
+    conf->osd_op_queue_mclock_scrub_wgt,
+    conf->osd_op_queue_mclock_scrub_lim);
+}
+
+std::map<int64_t, mClockClientInfo> mClockOpClassQueue::get_pool_profiles(
+  const OSDMap& osdmap, const mClockClientInfo& defaults)
+{
+  std::map<int64_t, mClockClientInfo> r;
+  for (auto& p : osdmap.get_pools()) {
+    const pool_opts_t& opts = p.second.opts;
+    if (!opts.is_set(pool_opts_t::MCLOCK_RES) &&
+	!opts.is_set(pool_opts_t::MCLOCK_WGT) &&
+	!opts.is_set(pool_opts_t::MCLOCK_LIM))
+      continue;
+    mClockClientInfo info = defaults;
+    opts.get(pool_opts_t::MCLOCK_RES, &info.reservation);
+    opts.get(pool_opts_t::MCLOCK_WGT, &info.weight);
+    opts.get(pool_opts_t::MCLOCK_LIM, &info.limit);
+    r[p.first] = info;
+  }
+  return r;
+}
+
+mclock_op_class_t mClockOpClassQueue::_classify(const Request& r) const
+{
+  op_type_t t = r.second.get_op_type();
+  if (t == op_type_t::client_op && !pool_info.empty()) {
+    int64_t pool = r.first->get_pgid().pool();
+    if (pool_info.count(pool))
+      return mclock_op_class_t(t, pool);
+  }
+  return mclock_op_class_t(t);
+}
+
+mClockClientInfo mClockOpClassQueue::_get_info(
+  const mclock_op_class_t& c) const
+{
+  if (c.pool >= 0) {
+    auto p = pool_info.find(c.pool);
+    if (p != pool_info.end())
+      return p->second;
+  }
+  return class_info.at(c.type);
+}
+
+void mClockOpClassQueue::_queued(const Request& r)
+{
+  if (logger)
+    logger->inc(len_counter(r.second.get_op_type()));
+}
+
+void mClockOpClassQueue::_dequeued(const Request& r, bool dispatched)
+{
+  if (!logger)
+    return;
+  op_type_t t = r.second.get_op_type();
+  logger->dec(len_counter(t));
+  if (dispatched)
+    logger->tinc(lat_counter(t), ceph_clock_now() - r.second.get_start_time());
+}
+
+void mClockOpClassQueue::remove_by_filter(std::function<bool (Request)> f)
+{
+  queue.remove_by_filter([&](Request r) {
+      if (!f(r))
+	return false;
+      _dequeued(r, false);
+      return true;
+    });
+}
+
+void mClockOpClassQueue::remove_by_class(entity_inst_t k,
+					 std::list<Request> *out)
+{
+  std::list<Request> removed;
+  queue.remove_by_class(k, &removed);
+  for (auto& r : removed)
+    _dequeued(r, false);
+  if (out)
+    out->splice(out->begin(), removed);
+}
+
+void mClockOpClassQueue::enqueue_strict(entity_inst_t cl, unsigned priority,
+					Request item)
+{
+  _queued(item);
+  queue.enqueue_strict(cl, priority, item);
+}
+
+void mClockOpClassQueue::enqueue_strict_front(entity_inst_t cl,
+					      unsigned priority, Request item)
+{
+  _queued(item);
+  queue.enqueue_strict_front(cl, priority, item);
+}
+
+void mClockOpClassQueue::enqueue(entity_inst_t cl, unsigned priority,
+				 unsigned cost, Request item)
+{
+  _queued(item);
+  queue.enqueue(cl, priority, cost, item);
+}
+
+void mClockOpClassQueue::enqueue_front(entity_inst_t cl, unsigned priority,
+				       unsigned cost, Request item)
+{
+  _queued(item);
+  queue.enqueue_front(cl, priority, cost, item);
+}
+
+mClockOpClassQueue::Request mClockOpClassQueue::dequeue()
+{
+  Request r = queue.dequeue();
+  _dequeued(r, true);
+  return r;
+}
@@ -0,0 +1,104 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2004-2006 Sage Weil <sage@newdream.net>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#ifndef CEPH_OSD_MCLOCKOPCLASSQUEUE_H
+#define CEPH_OSD_MCLOCKOPCLASSQUEUE_H
+
+#include <map>
+#include <ostream>
+
+#include "common/mClockPriorityQueue.h"
+#include "PGQueueable.h"
+
+class OSDMap;
+class PerfCounters;
+
+/// an op class as the mClock scheduler sees it
+struct mclock_op_class_t {
+  PGQueueable::op_type_t type;
+  int64_t pool;  ///< client ops of a pool with its own profile, else -1
+
+  mclock_op_class_t(PGQueueable::op_type_t t, int64_t p = -1)
+    : type(t), pool(p) {}
+
+  friend bool operator<(const mclock_op_class_t& a,
+			const mclock_op_class_t& b) {
+    if (a.type != b.type)
+      return a.type < b.type;
+    return a.pool < b.pool;
+  }
+};
+std::ostream& operator<<(std::ostream& out, const mclock_op_class_t& c);
+
+/**
+ * OSD op queue scheduling client ops, sub ops, snap trim, recovery and
+ * scrub against each other with mClock, so that each class gets its
+ * reservation and none exceeds its limit while others wait.
+ *
+ * Class profiles come from osd_op_queue_mclock_*; a pool setting any
+ * of the mclock_{res,wgt,lim} pool options gets a client class of its
+ * own.  Accessed under the shard's ordering lock like any OpQueue.
+ */
+class mClockOpClassQueue
+  : public OpQueue<std::pair<PGRef, PGQueueable>, entity_inst_t> {
+  typedef std::pair<PGRef, PGQueueable> Request;
+
+  CephContext *cct;
+  PerfCounters *&logger;
+  std::map<PGQueueable::op_type_t, mClockClientInfo> class_info;
+  std::map<int64_t, mClockClientInfo> pool_info;
+  mClockQueue<Request, entity_inst_t, mclock_op_class_t> queue;
+
+  mclock_op_class_t _classify(const Request& r) const;
+  mClockClientInfo _get_info(const mclock_op_class_t& c) const;
+  void _queued(const Request& r);
+  void _dequeued(const Request& r, bool dispatched);
+
+public:
+  mClockOpClassQueue(CephContext *cct, PerfCounters *&logger);
+
+  /// client class profiles of the pools that have one
+  static std::map<int64_t, mClockClientInfo> get_pool_profiles(
+    const OSDMap& osdmap, const mClockClientInfo& defaults);
+  void set_pool_profiles(std::map<int64_t, mClockClientInfo>&& p) {
+    pool_info.swap(p);
+  }
+  const mClockClientInfo& get_client_info() const {
+    return class_info.at(PGQueueable::op_type_t::client_op);
+  }
+
+  unsigned length() const override final {
+    return queue.length();
+  }
+  void remove_by_filter(std::function<bool (Request)> f) override final;
+  void remove_by_class(entity_inst_t k, std::list<Request> *out)
+    override final;
+  void enqueue_strict(entity_inst_t cl, unsigned priority, Request item)
+    override final;
+  void enqueue_strict_front(entity_inst_t cl, unsigned priority, Request item)
+    override final;
+  void enqueue(entity_inst_t cl, unsigned priority, unsigned cost,
+	       Request item) override final;
+  void enqueue_front(entity_inst_t cl, unsigned priority, unsigned cost,
+		     Request item) override final;
+  bool empty() const override final {
+    return queue.empty();
+  }
+  Request dequeue() override final;
+  void dump(ceph::Formatter *f) const override final {
+    queue.dump(f);
+  }
+};
+
+#endif
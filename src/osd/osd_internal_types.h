@@ -6,6 +6,7 @@
 
 #include "osd_types.h"
 #include "OpRequest.h"
+#include "include/mempool.h"
 
 /*
   * keep tabs on object modifications that are in flight.
@@ -29,6 +30,8 @@ struct ObjectState {
 typedef ceph::shared_ptr<ObjectContext> ObjectContextRef;
 
 struct ObjectContext {
+  MEMPOOL_CLASS_HELPERS();
+
   ObjectState obs;
 
   SnapSetContext *ssc;  // may be null
@@ -975,7 +975,15 @@ static opt_mapping_t opt_mapping = boost::assign::map_list_of
            ("csum_max_block", pool_opts_t::opt_desc_t(
 	     pool_opts_t::CSUM_MAX_BLOCK, pool_opts_t::INT))
            ("csum_min_block", pool_opts_t::opt_desc_t(
-	     pool_opts_t::CSUM_MIN_BLOCK, pool_opts_t::INT));
+	     pool_opts_t::CSUM_MIN_BLOCK, pool_opts_t::INT))
+           ("mclock_res", pool_opts_t::opt_desc_t(
+	     pool_opts_t::MCLOCK_RES, pool_opts_t::DOUBLE))
+           ("mclock_wgt", pool_opts_t::opt_desc_t(
+	     pool_opts_t::MCLOCK_WGT, pool_opts_t::DOUBLE))
+           ("mclock_lim", pool_opts_t::opt_desc_t(
+	     pool_opts_t::MCLOCK_LIM, pool_opts_t::DOUBLE))
+           ("compression_dictionaries", pool_opts_t::opt_desc_t(
+	     pool_opts_t::COMPRESSION_DICTIONARIES, pool_opts_t::STR));
 
 bool pool_opts_t::is_opt_name(const std::string& name) {
     return opt_mapping.find(name) != opt_mapping.end();
@@ -3534,7 +3542,7 @@ void pg_log_entry_t::decode_with_checksum(bufferlist::iterator& p)
 
 void pg_log_entry_t::encode(bufferlist &bl) const
 {
-  ENCODE_START(11, 4, bl);
+  ENCODE_START(12, 4, bl);
   ::encode(op, bl);
   ::encode(soid, bl);
   ::encode(version, bl);
@@ -3561,12 +3569,15 @@ void pg_log_entry_t::encode(bufferlist &bl) const
   ::encode(extra_reqids, bl);
   if (op == ERROR)
     ::encode(return_code, bl);
+  ::encode(has_modified_extents, bl);
+  if (has_modified_extents)
+    ::encode(modified_extents, bl);
   ENCODE_FINISH(bl);
 }
 
 void pg_log_entry_t::decode(bufferlist::iterator &bl)
 {
-  DECODE_START_LEGACY_COMPAT_LEN(11, 4, 4, bl);
+  DECODE_START_LEGACY_COMPAT_LEN(12, 4, 4, bl);
   ::decode(op, bl);
   if (struct_v < 2) {
     sobject_t old_soid;
@@ -3619,6 +3630,11 @@ void pg_log_entry_t::decode(bufferlist::iterator &bl)
     ::decode(extra_reqids, bl);
   if (struct_v >= 11 && op == ERROR)
     ::decode(return_code, bl);
+  if (struct_v >= 12) {
+    ::decode(has_modified_extents, bl);
+    if (has_modified_extents)
+      ::decode(modified_extents, bl);
+  }
   DECODE_FINISH(bl);
 }
 
@@ -3642,6 +3658,8 @@ void pg_log_entry_t::dump(Formatter *f) const
   f->close_section();
   f->dump_stream("mtime") << mtime;
   f->dump_int("return_code", return_code);
+  if (has_modified_extents)
+    f->dump_stream("modified_extents") << modified_extents;
   if (snaps.length() > 0) {
     vector<snapid_t> v;
     bufferlist c = snaps;
@@ -3673,6 +3691,11 @@ void pg_log_entry_t::generate_test_instances(list<pg_log_entry_t*>& o)
   o.push_back(new pg_log_entry_t(ERROR, oid, eversion_t(1,2), eversion_t(3,4),
 				 1, osd_reqid_t(entity_name_t::CLIENT(777), 8, 999),
 				 utime_t(8,9), -ENOENT));
+  o.push_back(new pg_log_entry_t(MODIFY, oid, eversion_t(1,2), eversion_t(3,4),
+				 1, osd_reqid_t(entity_name_t::CLIENT(777), 8, 999),
+				 utime_t(8,9), 0));
+  o.back()->has_modified_extents = true;
+  o.back()->modified_extents.insert(4096, 4096);
 }
 
 ostream& operator<<(ostream& out, const pg_log_entry_t& e)
@@ -4821,7 +4844,7 @@ void ObjectRecoveryProgress::dump(Formatter *f) const
 
 void ObjectRecoveryInfo::encode(bufferlist &bl, uint64_t features) const
 {
-  ENCODE_START(2, 1, bl);
+  ENCODE_START(3, 1, bl);
   ::encode(soid, bl);
   ::encode(version, bl);
   ::encode(size, bl);
@@ -4829,13 +4852,14 @@ void ObjectRecoveryInfo::encode(bufferlist &bl, uint64_t features) const
   ::encode(ss, bl);
   ::encode(copy_subset, bl);
   ::encode(clone_subset, bl);
+  ::encode(base_version, bl);
   ENCODE_FINISH(bl);
 }
 
 void ObjectRecoveryInfo::decode(bufferlist::iterator &bl,
 				int64_t pool)
 {
-  DECODE_START(2, bl);
+  DECODE_START(3, bl);
   ::decode(soid, bl);
   ::decode(version, bl);
   ::decode(size, bl);
@@ -4843,6 +4867,8 @@ void ObjectRecoveryInfo::decode(bufferlist::iterator &bl,
   ::decode(ss, bl);
   ::decode(copy_subset, bl);
   ::decode(clone_subset, bl);
+  if (struct_v >= 3)
+    ::decode(base_version, bl);
   DECODE_FINISH(bl);
 
   if (struct_v < 2) {
@@ -4888,6 +4914,7 @@ void ObjectRecoveryInfo::dump(Formatter *f) const
   }
   f->dump_stream("copy_subset") << copy_subset;
   f->dump_stream("clone_subset") << clone_subset;
+  f->dump_stream("base_version") << base_version;
 }
 
 ostream& operator<<(ostream& out, const ObjectRecoveryInfo &inf)
@@ -4902,6 +4929,7 @@ ostream &ObjectRecoveryInfo::print(ostream &out) const
 	     << ", size: " << size
 	     << ", copy_subset: " << copy_subset
 	     << ", clone_subset: " << clone_subset
+	     << ", base_version: " << base_version
 	     << ")";
 }
 
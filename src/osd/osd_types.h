@@ -1028,6 +1028,10 @@ public:
     CSUM_TYPE,
     CSUM_MAX_BLOCK,
     CSUM_MIN_BLOCK,
+    MCLOCK_RES,
+    MCLOCK_WGT,
+    MCLOCK_LIM,
+    COMPRESSION_DICTIONARIES,
   };
 
   enum type_t {
@@ -2864,12 +2868,16 @@ struct pg_log_entry_t {
   utime_t     mtime;  // this is the _user_ mtime, mind you
   int32_t return_code; // only stored for ERRORs for dup detection
 
+  // data ranges changed by this entry, relative to prior_version
+  interval_set<uint64_t> modified_extents;
+  bool has_modified_extents; // false if unknown (the whole object may differ)
+
   __s32      op;
   bool invalid_hash; // only when decoding sobject_t based entries
   bool invalid_pool; // only when decoding pool-less hobject based entries
 
   pg_log_entry_t()
-   : user_version(0), return_code(0), op(0),
+   : user_version(0), return_code(0), has_modified_extents(false), op(0),
      invalid_hash(false), invalid_pool(false) {}
   pg_log_entry_t(int _op, const hobject_t& _soid,
                 const eversion_t& v, const eversion_t& pv,
@@ -2877,7 +2885,7 @@ struct pg_log_entry_t {
                 const osd_reqid_t& rid, const utime_t& mt,
                 int return_code)
    : soid(_soid), reqid(rid), version(v), prior_version(pv), user_version(uv),
-     mtime(mt), return_code(return_code), op(_op),
+     mtime(mt), return_code(return_code), has_modified_extents(false), op(_op),
      invalid_hash(false), invalid_pool(false)
      {}
       
@@ -3131,10 +3139,23 @@ inline ostream& operator<<(ostream& out, const pg_log_t& log)
  */
 struct pg_missing_item {
   eversion_t need, have;
+  // in memory only: data ranges that differ between have and need, if
+  // every log entry in between recorded them
+  interval_set<uint64_t> dirty;
+  bool dirty_known = false;
   pg_missing_item() {}
   explicit pg_missing_item(eversion_t n) : need(n) {}  // have no old version
   pg_missing_item(eversion_t n, eversion_t h) : need(n), have(h) {}
 
+  void add_dirty(const pg_log_entry_t& e) {
+    if (dirty_known && e.has_modified_extents) {
+      dirty.union_of(e.modified_extents);
+    } else {
+      dirty_known = false;
+      dirty.clear();
+    }
+  }
+
   void encode(bufferlist& bl) const {
     ::encode(need, bl);
     ::encode(have, bl);
@@ -3294,13 +3315,18 @@ public:
 	// already missing (prior).
 	rmissing.erase((missing_it->second).need.version);
 	(missing_it->second).need = e.version;  // leave .have unchanged.
+	(missing_it->second).add_dirty(e);
       } else if (e.is_backlog()) {
 	// May not have prior version
 	assert(0 == "these don't exist anymore");
       } else {
 	// not missing, we must have prior_version (if any)
 	assert(!is_missing_divergent_item);
-	missing[e.soid] = item(e.version, e.prior_version);
+	item& i = missing[e.soid] = item(e.version, e.prior_version);
+	if (e.has_modified_extents) {
+	  i.dirty_known = true;
+	  i.dirty = e.modified_extents;
+	}
       }
       rmissing[e.version.version] = e.soid;
     } else if (e.is_delete()) {
@@ -3314,6 +3340,8 @@ public:
     if (missing.count(oid)) {
       rmissing.erase(missing[oid].need.version);
       missing[oid].need = need;            // no not adjust .have
+      missing[oid].dirty_known = false;
+      missing[oid].dirty.clear();
     } else {
       missing[oid] = item(need, eversion_t());
     }
@@ -3326,6 +3354,8 @@ public:
     if (missing.count(oid)) {
       tracker.changed(oid);
       missing[oid].have = have;
+      missing[oid].dirty_known = false;
+      missing[oid].dirty.clear();
     }
   }
 
@@ -4150,6 +4180,9 @@ struct ObjectRecoveryInfo {
   SnapSet ss;
   interval_set<uint64_t> copy_subset;
   map<hobject_t, interval_set<uint64_t>> clone_subset;
+  /// if set, the target already has soid at this version and copy_subset
+  /// covers every data range changed since
+  eversion_t base_version;
 
   ObjectRecoveryInfo() : size(0) { }
 
@@ -151,6 +151,7 @@ enum {
 
 static const char *config_keys[] = {
   "crush_location",
+  "objecter_read_policy",
   NULL
 };
 
@@ -222,6 +223,9 @@ void Objecter::handle_conf_change(const struct md_config_t *conf,
   if (changed.count("crush_location")) {
     update_crush_location();
   }
+  if (changed.count("objecter_read_policy")) {
+    update_read_policy();
+  }
 }
 
 void Objecter::update_crush_location()
@@ -230,6 +234,24 @@ void Objecter::update_crush_location()
   crush_location = cct->crush_location.get_location();
 }
 
+void Objecter::update_read_policy()
+{
+  const string& p = cct->_conf->objecter_read_policy;
+  int policy = READ_POLICY_PRIMARY;
+  if (p == "random") {
+    policy = READ_POLICY_RANDOM;
+  } else if (p == "localize") {
+    policy = READ_POLICY_LOCALIZE;
+  } else if (p == "latency") {
+    policy = READ_POLICY_LATENCY;
+  } else if (p != "primary") {
+    lderr(cct) << "unknown objecter_read_policy '" << p
+	       << "', reading from primaries" << dendl;
+  }
+  unique_lock wl(rwlock);
+  read_policy = policy;
+}
+
 // messages ------------------------------
 
 /*
@@ -384,6 +406,7 @@ void Objecter::init()
   }
 
   update_crush_location();
+  update_read_policy();
 
   cct->_conf->add_observer(this);
 
@@ -1190,6 +1213,16 @@ void Objecter::handle_osd_map(MOSDMap *m)
 	  osdmap->decode(m->maps[e]);
 	  logger->inc(l_osdc_map_full);
 	}
+	else if (m->maps.count(m->get_last())) {
+	  // the mon sends only the newest full map to clients that are far
+	  // behind
+	  ldout(cct, 3) << "handle_osd_map missing epoch "
+			<< osdmap->get_epoch()+1
+			<< ", jumping to full " << m->get_last() << dendl;
+	  e = m->get_last() - 1;
+	  skipped_map = true;
+	  continue;
+	}
 	else {
 	  if (e >= m->get_oldest()) {
 	    ldout(cct, 3) << "handle_osd_map requesting missing epoch "
@@ -1454,7 +1487,7 @@ int Objecter::pool_snap_list(int64_t poolid, vector<uint64_t> *snaps)
 }
 
 // sl may be unlocked.
-void Objecter::_check_op_pool_dne(Op *op, unique_lock *sl)
+void Objecter::_check_op_pool_dne(Op *op, OSDSession::unique_lock *sl)
 {
   // rwlock is locked unique
 
@@ -2198,6 +2231,15 @@ void Objecter::op_submit(Op *op, ceph_tid_t *ptid, int *ctx_budget)
   _op_submit_with_budget(op, rl, ptid, ctx_budget);
 }
 
+void Objecter::op_submit_batch(const vector<Op*>& ops)
+{
+  shunique_lock rl(rwlock, ceph::acquire_shared);
+  for (auto op : ops) {
+    ceph_tid_t tid = 0;
+    _op_submit_with_budget(op, rl, &tid, nullptr);
+  }
+}
+
 void Objecter::_op_submit_with_budget(Op *op, shunique_lock& sul,
 				      ceph_tid_t *ptid,
 				      int *ctx_budget)
@@ -2310,6 +2352,12 @@ void Objecter::_op_submit(Op *op, shunique_lock& sul, ceph_tid_t *ptid)
 
   ldout(cct, 10) << __func__ << " op " << op << dendl;
 
+  // decided once, the op may come back here to be resent
+  if (!op->parent_trace)
+    op->parent_trace = trace_sample(cct);
+  if (!op->trace.valid())
+    op->trace.start(cct, *op->parent_trace, "objecter op");
+
   // pick target
   assert(op->session == NULL);
   OSDSession *s = NULL;
@@ -2814,15 +2862,23 @@ int Objecter::_calc_target(op_target_t *t, Connection *con, bool any_change)
     } else {
       int osd;
       bool read = is_read && !is_write;
-      if (read && (t->flags & CEPH_OSD_FLAG_BALANCE_READS)) {
+      int policy = READ_POLICY_PRIMARY;
+      if (read && !t->force_primary) {
+	if (t->flags & CEPH_OSD_FLAG_BALANCE_READS)
+	  policy = READ_POLICY_RANDOM;
+	else if (t->flags & CEPH_OSD_FLAG_LOCALIZE_READS)
+	  policy = READ_POLICY_LOCALIZE;
+	else if (pi->is_replicated())
+	  policy = read_policy;
+      }
+      if (policy == READ_POLICY_RANDOM) {
 	int p = rand() % acting.size();
 	if (p)
 	  t->used_replica = true;
 	osd = acting[p];
 	ldout(cct, 10) << " chose random osd." << osd << " of " << acting
 		       << dendl;
-      } else if (read && (t->flags & CEPH_OSD_FLAG_LOCALIZE_READS) &&
-		 acting.size() > 1) {
+      } else if (policy == READ_POLICY_LOCALIZE && acting.size() > 1) {
 	// look for a local replica.  prefer the primary if the
 	// distance is the same.
 	int best = -1;
@@ -2845,6 +2901,23 @@ int Objecter::_calc_target(op_target_t *t, Connection *con, bool any_change)
 	}
 	assert(best >= 0);
 	osd = acting[best];
+      } else if (policy == READ_POLICY_LATENCY && acting.size() > 1) {
+	// osds we have no replies from yet count as the fastest, so that
+	// they get measured
+	osd = acting_primary;
+	uint64_t best_latency = UINT64_MAX;
+	for (auto i : acting) {
+	  auto p = osd_sessions.find(i);
+	  uint64_t latency = p == osd_sessions.end() ? 0 :
+	    p->second->read_latency_us.load(std::memory_order_relaxed);
+	  if (latency < best_latency) {
+	    osd = i;
+	    best_latency = latency;
+	  }
+	}
+	t->used_replica = osd != acting_primary;
+	ldout(cct, 10) << " chose osd." << osd << " of " << acting
+		       << " by read latency" << dendl;
       } else {
 	osd = acting_primary;
       }
@@ -3033,6 +3106,7 @@ void Objecter::_finish_op(Op *op, int r)
 
   inflight_ops.dec();
 
+  op->trace.finish();
   op->put();
 }
 
@@ -3058,6 +3132,10 @@ MOSDOp *Objecter::_prepare_osd_op(Op *op)
 
   int flags = op->target.flags;
   flags |= CEPH_OSD_FLAG_KNOWN_REDIR;
+  if (op->target.used_replica) {
+    // let the replica serve it
+    flags |= CEPH_OSD_FLAG_BALANCE_READS;
+  }
 
   // Nothing checks this any longer, but needed for compatibility with
   // pre-luminous osds
@@ -3091,6 +3169,7 @@ MOSDOp *Objecter::_prepare_osd_op(Op *op)
   if (op->reqid != osd_reqid_t()) {
     m->set_reqid(op->reqid);
   }
+  m->trace = op->trace.context();
 
   logger->inc(l_osdc_op_send);
   logger->inc(l_osdc_op_send_bytes, m->get_data().length());
@@ -3143,6 +3222,7 @@ void Objecter::_send_op(Op *op, MOSDOp *m)
   ldout(cct, 15) << "_send_op " << op->tid << " to "
 		 << op->target.actual_pgid << " on osd." << op->session->osd
 		 << dendl;
+  op->trace.event("send");
 
   ConnectionRef con = op->session->con;
   assert(con);
@@ -3307,6 +3387,7 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
     // just accept this one.  we may do ACK callbacks we shouldn't
     // have, but that is better than doing callbacks out of order.
   }
+  op->trace.event("reply");
 
   Context *onfinish = 0;
 
@@ -3331,6 +3412,32 @@ void Objecter::handle_osd_op_reply(MOSDOpReply *m)
     return;
   }
 
+  if ((op->target.flags & CEPH_OSD_FLAG_READ) &&
+      !(op->target.flags & CEPH_OSD_FLAG_WRITE)) {
+    uint64_t latency = std::chrono::duration_cast<std::chrono::microseconds>(
+      ceph::mono_clock::now() - op->stamp).count();
+    uint64_t avg = s->read_latency_us.load(std::memory_order_relaxed);
+    s->read_latency_us.store(avg ? (avg * 7 + latency) / 8 : latency,
+			     std::memory_order_relaxed);
+  }
+
+  if (rc == -EAGAIN && op->target.used_replica) {
+    // the replica may not have (all of) the object committed yet
+    ldout(cct, 7) << " got -EAGAIN from replica, resubmitting to primary"
+		  << dendl;
+    if (op->onfinish)
+      num_in_flight.dec();
+    _session_op_remove(s, op);
+    sl.unlock();
+    put_session(s);
+
+    op->tid = 0;
+    op->target.force_primary = true;
+    _op_submit(op, sul, NULL);
+    m->put();
+    return;
+  }
+
   if (rc == -EAGAIN) {
     ldout(cct, 7) << " got -EAGAIN, resubmitting" << dendl;
 
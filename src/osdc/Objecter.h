@@ -34,6 +34,7 @@
 #include "common/ceph_time.h"
 #include "common/ceph_timer.h"
 #include "common/Finisher.h"
+#include "common/sharded_shared_mutex.h"
 #include "common/shunique_lock.h"
 
 #include "messages/MOSDOp.h"
@@ -69,6 +70,10 @@ struct ObjectOperation {
   vector<Context*> out_handler;
   vector<int*> out_rval;
 
+  /// set by callers that trace the request themselves; if unset, the
+  /// objecter decides whether to trace it (see trace_sample())
+  boost::optional<trace_context_t> trace;
+
   ObjectOperation() : flags(0), priority(0) {}
   ~ObjectOperation() {
     while (!out_handler.empty()) {
@@ -1133,6 +1138,15 @@ public:
   using Dispatcher::cct;
   std::multimap<string,string> crush_location;
 
+  /// where reads of replicated pools go, unless the op says otherwise
+  enum {
+    READ_POLICY_PRIMARY,
+    READ_POLICY_RANDOM,     ///< as with CEPH_OSD_FLAG_BALANCE_READS
+    READ_POLICY_LOCALIZE,   ///< as with CEPH_OSD_FLAG_LOCALIZE_READS
+    READ_POLICY_LATENCY,    ///< the osd answering reads fastest lately
+  };
+  int read_policy = READ_POLICY_PRIMARY;
+
   atomic_t initialized;
 
 private:
@@ -1154,7 +1168,7 @@ private:
   version_t last_seen_osdmap_version;
   version_t last_seen_pgmap_version;
 
-  mutable boost::shared_mutex rwlock;
+  mutable ceph::sharded_shared_mutex rwlock;
   using lock_guard = std::unique_lock<decltype(rwlock)>;
   using unique_lock = std::unique_lock<decltype(rwlock)>;
   using shared_lock = boost::shared_lock<decltype(rwlock)>;
@@ -1168,6 +1182,7 @@ private:
   void start_tick();
   void tick();
   void update_crush_location();
+  void update_read_policy();
 
   class RequestStateHook;
 
@@ -1209,6 +1224,7 @@ public:
     bool sort_bitwise = false; ///< whether the hobject_t sort order is bitwise
 
     bool used_replica = false;
+    bool force_primary = false; ///< a replica refused, read from the primary
     bool paused = false;
 
     int osd = -1;      ///< the final target osd, or -1
@@ -1296,6 +1312,9 @@ public:
 
     osd_reqid_t reqid; // explicitly setting reqid
 
+    boost::optional<trace_context_t> parent_trace; ///< once decided
+    TraceSpan trace;
+
     Op(const object_t& o, const object_locator_t& ol, vector<OSDOp>& op,
        int f, Context *fin, version_t *ov, int *offset = NULL) :
       session(NULL), incarnation(0),
@@ -1737,6 +1756,8 @@ public:
     ConnectionRef con;
     int num_locks;
     std::unique_ptr<std::mutex[]> completion_locks;
+    /// moving average of the time taken to answer reads, in us
+    std::atomic<uint64_t> read_latency_us = { 0 };
     using unique_completion_lock = std::unique_lock<
       decltype(completion_locks)::element_type>;
 
@@ -1847,7 +1868,7 @@ public:
   }
 
 private:
-  void _check_op_pool_dne(Op *op, unique_lock *sl);
+  void _check_op_pool_dne(Op *op, OSDSession::unique_lock *sl);
   void _send_op_map_check(Op *op);
   void _op_cancel_map_check(Op *op);
   void _check_linger_pool_dne(LingerOp *op, bool *need_unregister);
@@ -2038,6 +2059,8 @@ private:
   // public interface
 public:
   void op_submit(Op *op, ceph_tid_t *ptid = NULL, int *ctx_budget = NULL);
+  /// op_submit() each of @p ops, taking rwlock once for all of them
+  void op_submit_batch(const vector<Op*>& ops);
   bool is_active() {
     shared_lock l(rwlock);
     return !((!inflight_ops.read()) && linger_ops.empty() &&
@@ -2142,6 +2165,7 @@ public:
     o->snapc = snapc;
     o->out_rval.swap(op.out_rval);
     o->reqid = reqid;
+    o->parent_trace = op.trace;
     return o;
   }
   ceph_tid_t mutate(
@@ -2173,6 +2197,7 @@ public:
     o->out_bl.swap(op.out_bl);
     o->out_handler.swap(op.out_handler);
     o->out_rval.swap(op.out_rval);
+    o->parent_trace = op.trace;
     return o;
   }
   ceph_tid_t read(
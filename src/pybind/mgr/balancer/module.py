@@ -0,0 +1,335 @@
+
+"""
+Even out the data on the OSDs by remapping PGs with pg_upmap_items
+"""
+
+import errno
+import json
+import threading
+
+from mgr_module import MgrModule, CommandResult
+
+
+class Module(MgrModule):
+    COMMANDS = [
+        {
+            "cmd": "balancer status",
+            "desc": "Show the balancer settings and how even the OSDs are",
+            "perm": "r"
+        },
+        {
+            "cmd": "balancer on",
+            "desc": "Start moving PGs off overfull OSDs automatically",
+            "perm": "rw"
+        },
+        {
+            "cmd": "balancer off",
+            "desc": "Stop moving PGs automatically",
+            "perm": "rw"
+        },
+        {
+            "cmd": "balancer eval",
+            "desc": "Show how far each OSD is from its share of the data",
+            "perm": "r"
+        },
+        {
+            "cmd": "balancer optimize "
+                   "name=dry_run,type=CephChoices,strings=--dry-run,req=false",
+            "desc": "Run one round of PG moves now, or show what it would be",
+            "perm": "rw"
+        },
+    ]
+
+    # Persistent settings (set with "ceph config-key put mgr/balancer/<key>")
+    # and their defaults
+    DEFAULTS = {
+        # whether to balance in the background
+        'active': 'false',
+        # seconds between rounds
+        'sleep_interval': '60',
+        # don't start a round while more than this fraction of the
+        # object copies are misplaced, and don't move more than that in
+        # one round
+        'max_misplaced': '0.05',
+        # most PG moves in one round
+        'max_moves': '10',
+        # leave OSDs alone that are within this fraction of their share
+        'threshold': '0.05',
+    }
+
+    def __init__(self, *args, **kwargs):
+        super(Module, self).__init__(*args, **kwargs)
+        self.run = True
+        self.event = threading.Event()
+        self.last_round = "none yet"
+
+    def _get(self, key):
+        v = self.get_config(key)
+        if v is None:
+            v = self.DEFAULTS[key]
+        return v
+
+    def _get_float(self, key):
+        return float(self._get(key))
+
+    def _get_int(self, key):
+        return int(self._get(key))
+
+    def handle_command(self, cmd):
+        prefix = cmd['prefix']
+        if prefix == "balancer status":
+            r = dict((k, self._get(k)) for k in self.DEFAULTS)
+            r['last_round'] = self.last_round
+            r['score'] = self.evaluate(self.load())['score']
+            return 0, json.dumps(r, indent=2, sort_keys=True), ""
+        elif prefix == "balancer on":
+            self.set_config('active', 'true')
+            self.event.set()
+            return 0, "", ""
+        elif prefix == "balancer off":
+            self.set_config('active', 'false')
+            return 0, "", ""
+        elif prefix == "balancer eval":
+            e = self.evaluate(self.load())
+            return 0, json.dumps(e, indent=2, sort_keys=True), ""
+        elif prefix == "balancer optimize":
+            dry_run = cmd.get('dry_run') == '--dry-run'
+            r, moves, outs = self.optimize(dry_run)
+            return r, json.dumps(moves, indent=2, sort_keys=True), outs
+        else:
+            return (-errno.EINVAL, "",
+                    "Command not found '{0}'".format(prefix))
+
+    def serve(self):
+        while self.run:
+            if self._get('active') == 'true':
+                r, moves, outs = self.optimize(False)
+                self.last_round = outs
+                self.log.info("balancer: %s" % outs)
+            self.event.wait(self._get_int('sleep_interval'))
+            self.event.clear()
+
+    def shutdown(self):
+        self.run = False
+        self.event.set()
+
+    def load(self):
+        """
+        Gather what a round needs from the cluster maps: the crush
+        weight and failure domain of each OSD, and where each PG is and
+        how big it is.
+        """
+        osd_map = self.get('osd_map')
+        tree = self.get('osd_map_tree')
+        pg_stats = self.get('pg_stats')['pg_stats']
+
+        state = {
+            'epoch': osd_map['epoch'],
+            'pg_upmap_items': dict(
+                (m['pgid'], [(i['from'], i['to']) for i in m['mappings']])
+                for m in osd_map['pg_upmap_items']),
+            'weight': {},   # osd -> effective weight
+            'parent': {},   # crush item -> containing bucket
+            'pgs': {},      # pgid -> (num_bytes, up)
+            'misplaced': 0,
+            'degraded': 0,
+            'copies': 0,
+        }
+
+        for node in tree['nodes']:
+            for child in node.get('children', []):
+                state['parent'][child] = node['id']
+        for node in tree['nodes']:
+            if node['id'] >= 0 and node['status'] == 'up' and \
+                    node['reweight'] > 0:
+                state['weight'][node['id']] = \
+                    node['crush_weight'] * node['reweight']
+
+        for pg in pg_stats:
+            state['pgs'][pg['pgid']] = (pg['num_bytes'], list(pg['up']))
+            state['misplaced'] += pg['num_objects_misplaced']
+            state['degraded'] += pg['num_objects_degraded']
+            state['copies'] += pg['num_object_copies']
+        return state
+
+    def _usage(self, state):
+        usage = dict((osd, 0) for osd in state['weight'])
+        for num_bytes, up in state['pgs'].values():
+            for osd in up:
+                if osd in usage:
+                    usage[osd] += num_bytes
+        return usage
+
+    def _deviations(self, state, usage):
+        """
+        How far each OSD is above (positive) or below its share of the
+        data, as a fraction of that share.
+        """
+        total_weight = sum(state['weight'].values())
+        total_bytes = sum(usage.values())
+        r = {}
+        if total_weight <= 0 or total_bytes <= 0:
+            return r
+        for osd, weight in state['weight'].items():
+            share = total_bytes * weight / total_weight
+            if share > 0:
+                r[osd] = (usage[osd] - share) / share
+        return r
+
+    def evaluate(self, state):
+        usage = self._usage(state)
+        dev = self._deviations(state, usage)
+        score = 0.0
+        if dev:
+            score = (sum(d * d for d in dev.values()) / len(dev)) ** 0.5
+        return {
+            'score': score,
+            'max_deviation': max(dev.values()) if dev else 0.0,
+            'min_deviation': min(dev.values()) if dev else 0.0,
+            'osds': dict(("osd.%d" % osd, {'bytes': usage[osd],
+                                           'deviation': d})
+                         for osd, d in dev.items()),
+        }
+
+    def _ancestors(self, state, item):
+        r = []
+        while item in state['parent']:
+            item = state['parent'][item]
+            r.append(item)
+        return r
+
+    def _can_move(self, state, up, src, dst):
+        """
+        Moving src's copy to dst must keep the copies in different
+        failure domains (the buckets directly above the OSDs) and inside
+        the same crush root.
+        """
+        if dst in up:
+            return False
+        src_ancestors = self._ancestors(state, src)
+        dst_ancestors = self._ancestors(state, dst)
+        if not src_ancestors or not dst_ancestors or \
+                src_ancestors[-1] != dst_ancestors[-1]:
+            return False
+        dst_domain = dst_ancestors[0]
+        for osd in up:
+            if osd != src and \
+                    state['parent'].get(osd) == dst_domain:
+                return False
+        return True
+
+    def plan(self, state):
+        """
+        Pick PG moves from the most overfull OSDs to the most underfull
+        ones, at most max_moves of them and at most max_misplaced of the
+        data.
+
+        :return: dict of pgid to its new list of (from, to) pairs
+        """
+        threshold = self._get_float('threshold')
+        max_moves = self._get_int('max_moves')
+        usage = self._usage(state)
+        total_bytes = sum(usage.values())
+        budget = total_bytes * self._get_float('max_misplaced')
+
+        items = dict(state['pg_upmap_items'])
+        changed = set()
+        moved_bytes = 0
+        while len(changed) < max_moves:
+            dev = self._deviations(state, usage)
+            if not dev:
+                break
+            src = max(dev, key=dev.get)
+            if dev[src] <= threshold:
+                break
+            targets = sorted((osd for osd in dev if dev[osd] < 0),
+                             key=dev.get)
+            move = None
+            # the biggest PG that fits the budget, to fix the most with
+            # the fewest moves
+            candidates = sorted(
+                (pgid for pgid, (b, up) in state['pgs'].items()
+                 if src in up and pgid not in changed and
+                 moved_bytes + b <= budget),
+                key=lambda pgid: -state['pgs'][pgid][0])
+            for pgid in candidates:
+                num_bytes, up = state['pgs'][pgid]
+                for dst in targets:
+                    if self._can_move(state, up, src, dst):
+                        move = (pgid, dst)
+                        break
+                if move:
+                    break
+            if move is None:
+                break
+
+            pgid, dst = move
+            num_bytes, up = state['pgs'][pgid]
+            state['pgs'][pgid] = (num_bytes,
+                                  [dst if o == src else o for o in up])
+            usage[src] -= num_bytes
+            usage[dst] += num_bytes
+            moved_bytes += num_bytes
+
+            # fold the move into the PG's existing exceptions, so a copy
+            # that moves back drops its exception altogether
+            pairs = []
+            folded = False
+            for a, b in items.get(pgid, []):
+                if b == src:
+                    b = dst
+                    folded = True
+                if a != b:
+                    pairs.append((a, b))
+            if not folded:
+                pairs.append((src, dst))
+            items[pgid] = pairs
+            changed.add(pgid)
+
+        return dict((pgid, items[pgid]) for pgid in changed)
+
+    def _mon_command(self, cmd):
+        result = CommandResult('')
+        self.send_command(result, json.dumps(cmd), '')
+        return result.wait()
+
+    def optimize(self, dry_run):
+        state = self.load()
+        if state['degraded'] > 0:
+            return 0, {}, "not balancing while objects are degraded"
+        max_misplaced = self._get_float('max_misplaced')
+        if state['copies'] > 0 and \
+                float(state['misplaced']) / state['copies'] > max_misplaced:
+            return 0, {}, ("not balancing while more than %f of objects "
+                           "are misplaced" % max_misplaced)
+
+        before = self.evaluate(state)['score']
+        moves = self.plan(state)
+        after = self.evaluate(state)['score']
+        summary = "epoch %d: %d pg moves, score %f -> %f" % (
+            state['epoch'], len(moves), before, after)
+        plan = dict((pgid, [[a, b] for a, b in pairs])
+                    for pgid, pairs in moves.items())
+        if dry_run or not moves:
+            return 0, plan, summary
+
+        for pgid, pairs in moves.items():
+            if pairs:
+                cmd = {
+                    'prefix': 'osd pg-upmap-items',
+                    'format': 'json',
+                    'pgid': pgid,
+                    'id': [osd for pair in pairs for osd in pair],
+                }
+            else:
+                cmd = {
+                    'prefix': 'osd rm-pg-upmap-items',
+                    'format': 'json',
+                    'pgid': pgid,
+                }
+            r, outb, outs = self._mon_command(cmd)
+            if r != 0:
+                self.log.warn("balancer: '%s' failed: %s" % (
+                    json.dumps(cmd), outs))
+                return r, plan, outs
+        return 0, plan, summary
@@ -117,6 +117,52 @@ class MgrModule(object):
         """
         return ceph_state.get_counter(self._handle, svc_type, svc_name, path)
 
+    def get_histogram(self, svc_type, svc_name, path):
+        """
+        Called by the plugin to fetch the latest values of a histogram
+        perf counter on a particular service.
+
+        :param svc_type:
+        :param svc_name:
+        :param path:
+        :return: A dict with the "axes" configuration and the bucket
+                 "values", one list per bucket of the first axis
+        """
+        return ceph_state.get_histogram(self._handle, svc_type, svc_name, path)
+
+    def get_counter_range(self, svc_type, svc_name, path, start, end,
+                          period=0):
+        """
+        Called by the plugin to fetch the history of a perf counter on a
+        particular service, downsampled once it is older than
+        mgr_counter_history_raw (and mgr_counter_history_minutes).
+
+        :param svc_type:
+        :param svc_name:
+        :param path:
+        :param start: unix time of the first sample wanted
+        :param end: unix time of the last sample wanted
+        :param period: minimum seconds between samples: 0 for as
+                       reported, 60 or 3600 for the rolled up values
+        :return: A list of two-element lists containing time and value
+        """
+        return ceph_state.get_counter_range(self._handle, svc_type, svc_name,
+                                            path, start, end, period)
+
+    def export_counters(self, since, period=0, prefix=""):
+        """
+        Called by the plugin to fetch the history of every perf counter
+        of every service in one go, e.g. to serve it to an external
+        collector.
+
+        :param since: unix time of the first sample wanted
+        :param period: as for ``get_counter_range``
+        :param prefix: only include counters whose path starts with this
+        :return: A dict of service name ("osd.0") to a dict of counter
+                 path to a list of two-element lists of time and value
+        """
+        return ceph_state.export_counters(self._handle, prefix, since, period)
+
     def list_servers(self):
         """
         Like ``get_server``, but instead of returning information
@@ -27,8 +27,11 @@ void rbd_replay_pending_io_callback(librbd::completion_t cb, void *arg) {
 }
 
 PendingIO::PendingIO(action_id_t id,
-		     ActionCtx &worker)
+		     ActionCtx &worker,
+		     const char *name)
   : m_id(id),
+    m_name(name),
+    m_start_time(ceph_clock_now()),
     m_completion(new librbd::RBD::AioCompletion(this, rbd_replay_pending_io_callback)),
     m_worker(worker) {
     }
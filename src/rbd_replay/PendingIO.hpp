@@ -16,6 +16,7 @@
 #define _INCLUDED_RBD_REPLAY_PENDINGIO_HPP
 
 #include <boost/enable_shared_from_this.hpp>
+#include "common/Clock.h"
 #include "actions.hpp"
 
 /// Do not call outside of rbd_replay::PendingIO.
@@ -31,8 +32,10 @@ class PendingIO : public boost::enable_shared_from_this<PendingIO> {
 public:
   typedef boost::shared_ptr<PendingIO> ptr;
 
+  /// The latency is accounted under @a name unless it is NULL.
   PendingIO(action_id_t id,
-            ActionCtx &worker);
+            ActionCtx &worker,
+            const char *name = NULL);
 
   ~PendingIO();
 
@@ -40,6 +43,14 @@ public:
     return m_id;
   }
 
+  const char *name() const {
+    return m_name;
+  }
+
+  utime_t start_time() const {
+    return m_start_time;
+  }
+
   ceph::bufferlist &bufferlist() {
     return m_bl;
   }
@@ -54,6 +65,8 @@ private:
   friend void ::rbd_replay_pending_io_callback(librbd::completion_t cb, void *arg);
 
   const action_id_t m_id;
+  const char *m_name;
+  const utime_t m_start_time;
   ceph::bufferlist m_bl;
   librbd::RBD::AioCompletion *m_completion;
   ActionCtx &m_worker;
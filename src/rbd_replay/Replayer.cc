@@ -13,6 +13,7 @@
  */
 
 #include "Replayer.hpp"
+#include "common/Clock.h"
 #include "common/errno.h"
 #include "rbd_replay/ActionTypes.h"
 #include "rbd_replay/BufferReader.h"
@@ -89,7 +90,12 @@ void Worker::run() {
     Action::ptr action;
     m_buffer.pop_back(&action);
     m_replayer.wait_for_actions(action->predecessors());
-    action->perform(*this);
+    if (m_replayer.is_local(*action)) {
+      action->perform(*this);
+    } else {
+      // replayed by another client, only its dependents are left to release
+      m_replayer.set_action_complete(action->pending_io_id());
+    }
     m_replayer.set_action_complete(action->id());
   }
   {
@@ -113,8 +119,12 @@ void Worker::run() {
 
 void Worker::remove_pending(PendingIO::ptr io) {
   assert(io);
+  utime_t latency = ceph_clock_now() - io->start_time();
   m_replayer.set_action_complete(io->id());
   boost::mutex::scoped_lock lock(m_pending_ios_mutex);
+  if (io->name() != NULL) {
+    m_latencies[io->name()].add(latency.to_nsec() / 1000);
+  }
   size_t num_erased = m_pending_ios.erase(io->id());
   assertf(num_erased == 1, "id = %d", io->id());
   if (m_pending_ios.empty()) {
@@ -165,6 +175,7 @@ Replayer::Replayer(int num_action_trackers)
   : m_rbd(NULL), m_ioctx(0),  
     m_pool_name("rbd"), m_latency_multiplier(1.0), 
     m_readonly(false), m_dump_perf_counters(false),
+    m_dump_latencies(false), m_client_index(0), m_client_count(1),
     m_num_action_trackers(num_action_trackers),
     m_action_trackers(new action_tracker_d[m_num_action_trackers]) {
   assertf(num_action_trackers > 0, "num_action_trackers = %d", num_action_trackers);
@@ -213,6 +224,13 @@ void Replayer::run(const std::string& replay_file) {
         close(fd);
       } BOOST_SCOPE_EXIT_END;
 
+      if (m_start_time > ceph_clock_now()) {
+        utime_t delay = m_start_time - ceph_clock_now();
+        dout(THREAD_LEVEL) << "Waiting " << delay << " to start" << dendl;
+        boost::this_thread::sleep(boost::posix_time::microseconds(
+          delay.to_nsec() / 1000));
+      }
+
       BufferReader buffer_reader(fd);
       bool versioned = is_versioned_replay(buffer_reader);
       while (true) {
@@ -255,11 +273,18 @@ void Replayer::run(const std::string& replay_file) {
       }
 
       dout(THREAD_LEVEL) << "Waiting for workers to die" << dendl;
+      Latencies latencies;
       pair<thread_id_t, Worker*> w;
       BOOST_FOREACH(w, workers) {
 	w.second->join();
+	for (auto &it : w.second->latencies()) {
+	  latencies[it.first].merge(it.second);
+	}
 	delete w.second;
       }
+      if (m_dump_latencies) {
+	dump_latencies(latencies);
+      }
       clear_images();
       delete m_rbd;
       m_rbd = NULL;
@@ -370,6 +395,28 @@ void Replayer::clear_images() {
   m_images.clear();
 }
 
+void Replayer::dump_latencies(const Latencies &latencies) {
+  static const double percentiles[] = {50, 90, 99, 99.9, 99.99};
+
+  for (auto &it : latencies) {
+    const LatencyHistogram &lat = it.second;
+    cout << it.first << ": " << lat.count() << " ios, latency (usec): min "
+         << lat.min() << " avg " << static_cast<uint64_t>(lat.mean());
+    for (double p : percentiles) {
+      cout << " p" << p << " " << lat.percentile(p);
+    }
+    cout << " max " << lat.max() << std::endl;
+  }
+}
+
+bool Replayer::is_local(const Action &action) const {
+  imagectx_id_t imagectx_id;
+  if (!action.get_imagectx_id(&imagectx_id)) {
+    return true;
+  }
+  return imagectx_id % m_client_count == m_client_index;
+}
+
 void Replayer::set_latency_multiplier(float f) {
   assertf(f >= 0, "f = %f", f);
   m_latency_multiplier = f;
@@ -17,6 +17,8 @@
 
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/shared_mutex.hpp>
+#include "common/LatencyHistogram.h"
+#include "include/utime.h"
 #include "rbd_replay/ActionTypes.h"
 #include "BoundedBuffer.hpp"
 #include "ImageNameMap.hpp"
@@ -26,6 +28,9 @@ namespace rbd_replay {
 
 class Replayer;
 
+/// Latencies of the IOs performed, by action type
+typedef std::map<std::string, LatencyHistogram> Latencies;
+
 /**
    Performs Actions within a single thread.
  */
@@ -62,6 +67,11 @@ public:
 
   rbd_loc map_image_name(std::string image_name, std::string snap_name) const override;
 
+  /// Should only be called once the worker is joined
+  const Latencies &latencies() const {
+    return m_latencies;
+  }
+
 private:
   void run();
 
@@ -71,6 +81,7 @@ private:
   std::map<action_id_t, PendingIO::ptr> m_pending_ios;
   boost::mutex m_pending_ios_mutex;
   boost::condition m_pending_ios_empty;
+  Latencies m_latencies;
   bool m_done;
 };
 
@@ -121,6 +132,29 @@ public:
     m_dump_perf_counters = dump_perf_counters;
   }
 
+  void set_dump_latencies(bool dump_latencies) {
+    m_dump_latencies = dump_latencies;
+  }
+
+  /// Waits until this wall clock time before replaying
+  void set_start_time(utime_t start_time) {
+    m_start_time = start_time;
+  }
+
+  /**
+     Replays only the share of this client when the trace is split across
+     @a client_count clients: the actions on every client_count'th image
+     context, starting with the @a client_index'th.  The actions of the
+     other clients complete right away.
+   */
+  void set_client(unsigned client_index, unsigned client_count) {
+    assertf(client_index < client_count, "client_index = %u", client_index);
+    m_client_index = client_index;
+    m_client_count = client_count;
+  }
+
+  bool is_local(const Action &action) const;
+
   const ImageNameMap &image_name_map() const {
     return m_image_name_map;
   }
@@ -135,6 +169,8 @@ private:
 
   void clear_images();
 
+  void dump_latencies(const Latencies &latencies);
+
   action_tracker_d &tracker_for(action_id_t id);
 
   /// Disallow copying
@@ -149,6 +185,10 @@ private:
   bool m_readonly;
   ImageNameMap m_image_name_map;
   bool m_dump_perf_counters;
+  bool m_dump_latencies;
+  utime_t m_start_time;
+  unsigned m_client_index;
+  unsigned m_client_count;
 
   std::map<imagectx_id_t, librbd::Image*> m_images;
   boost::shared_mutex m_images_mutex;
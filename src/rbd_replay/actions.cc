@@ -111,7 +111,7 @@ void AioReadAction::perform(ActionCtx &worker) {
   dout(ACTION_LEVEL) << "Performing " << *this << dendl;
   librbd::Image *image = worker.get_image(m_action.imagectx_id);
   assert(image);
-  PendingIO::ptr io(new PendingIO(pending_io_id(), worker));
+  PendingIO::ptr io(new PendingIO(pending_io_id(), worker, get_action_name()));
   worker.add_pending(io);
   int r = image->aio_read(m_action.offset, m_action.length, io->bufferlist(), &io->completion());
   assertf(r >= 0, "id = %d, r = %d", id(), r);
@@ -120,7 +120,7 @@ void AioReadAction::perform(ActionCtx &worker) {
 void ReadAction::perform(ActionCtx &worker) {
   dout(ACTION_LEVEL) << "Performing " << *this << dendl;
   librbd::Image *image = worker.get_image(m_action.imagectx_id);
-  PendingIO::ptr io(new PendingIO(pending_io_id(), worker));
+  PendingIO::ptr io(new PendingIO(pending_io_id(), worker, get_action_name()));
   worker.add_pending(io);
   ssize_t r = image->read(m_action.offset, m_action.length, io->bufferlist());
   assertf(r >= 0, "id = %d, r = %d", id(), r);
@@ -131,7 +131,8 @@ void AioWriteAction::perform(ActionCtx &worker) {
   static const std::string fake_data(create_fake_data());
   dout(ACTION_LEVEL) << "Performing " << *this << dendl;
   librbd::Image *image = worker.get_image(m_action.imagectx_id);
-  PendingIO::ptr io(new PendingIO(pending_io_id(), worker));
+  PendingIO::ptr io(new PendingIO(pending_io_id(), worker,
+                                  worker.readonly() ? NULL : get_action_name()));
   uint64_t remaining = m_action.length;
   while (remaining > 0) {
     uint64_t n = std::min(remaining, (uint64_t)fake_data.length());
@@ -150,7 +151,8 @@ void AioWriteAction::perform(ActionCtx &worker) {
 void WriteAction::perform(ActionCtx &worker) {
   dout(ACTION_LEVEL) << "Performing " << *this << dendl;
   librbd::Image *image = worker.get_image(m_action.imagectx_id);
-  PendingIO::ptr io(new PendingIO(pending_io_id(), worker));
+  PendingIO::ptr io(new PendingIO(pending_io_id(), worker,
+                                  worker.readonly() ? NULL : get_action_name()));
   worker.add_pending(io);
   io->bufferlist().append_zero(m_action.length);
   if (!worker.readonly()) {
@@ -163,7 +165,8 @@ void WriteAction::perform(ActionCtx &worker) {
 void AioDiscardAction::perform(ActionCtx &worker) {
   dout(ACTION_LEVEL) << "Performing " << *this << dendl;
   librbd::Image *image = worker.get_image(m_action.imagectx_id);
-  PendingIO::ptr io(new PendingIO(pending_io_id(), worker));
+  PendingIO::ptr io(new PendingIO(pending_io_id(), worker,
+                                  worker.readonly() ? NULL : get_action_name()));
   worker.add_pending(io);
   if (worker.readonly()) {
     worker.remove_pending(io);
@@ -176,7 +179,8 @@ void AioDiscardAction::perform(ActionCtx &worker) {
 void DiscardAction::perform(ActionCtx &worker) {
   dout(ACTION_LEVEL) << "Performing " << *this << dendl;
   librbd::Image *image = worker.get_image(m_action.imagectx_id);
-  PendingIO::ptr io(new PendingIO(pending_io_id(), worker));
+  PendingIO::ptr io(new PendingIO(pending_io_id(), worker,
+                                  worker.readonly() ? NULL : get_action_name()));
   worker.add_pending(io);
   if (!worker.readonly()) {
     ssize_t r = image->discard(m_action.offset, m_action.length);
@@ -187,7 +191,7 @@ void DiscardAction::perform(ActionCtx &worker) {
 
 void OpenImageAction::perform(ActionCtx &worker) {
   dout(ACTION_LEVEL) << "Performing " << *this << dendl;
-  PendingIO::ptr io(new PendingIO(pending_io_id(), worker));
+  PendingIO::ptr io(new PendingIO(pending_io_id(), worker, get_action_name()));
   worker.add_pending(io);
   librbd::Image *image = new librbd::Image();
   librbd::RBD *rbd = worker.rbd();
@@ -219,7 +223,7 @@ void CloseImageAction::perform(ActionCtx &worker) {
 void AioOpenImageAction::perform(ActionCtx &worker) {
   dout(ACTION_LEVEL) << "Performing " << *this << dendl;
   // TODO: Make it async
-  PendingIO::ptr io(new PendingIO(pending_io_id(), worker));
+  PendingIO::ptr io(new PendingIO(pending_io_id(), worker, get_action_name()));
   worker.add_pending(io);
   librbd::Image *image = new librbd::Image();
   librbd::RBD *rbd = worker.rbd();
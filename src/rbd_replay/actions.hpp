@@ -116,11 +116,25 @@ public:
   virtual thread_id_t thread_id() const = 0;
   virtual const action::Dependencies& predecessors() const = 0;
 
+  /// Returns false if the action does not act on an image.
+  virtual bool get_imagectx_id(imagectx_id_t *imagectx_id) const = 0;
+
   virtual std::ostream& dump(std::ostream& o) const = 0;
 
   static ptr construct(const action::ActionEntry &action_entry);
 };
 
+inline bool get_action_imagectx_id(const action::ActionBase &action,
+                                   imagectx_id_t *imagectx_id) {
+  return false;
+}
+
+inline bool get_action_imagectx_id(const action::ImageActionBase &action,
+                                   imagectx_id_t *imagectx_id) {
+  *imagectx_id = action.imagectx_id;
+  return true;
+}
+
 template <typename ActionType>
 class TypedAction : public Action {
 public:
@@ -139,6 +153,10 @@ public:
     return m_action.dependencies;
   }
 
+  bool get_imagectx_id(imagectx_id_t *imagectx_id) const override {
+    return get_action_imagectx_id(m_action, imagectx_id);
+  }
+
   std::ostream& dump(std::ostream& o) const override {
     o << get_action_name() << ": ";
     ceph::JSONFormatter formatter(false);
@@ -38,7 +38,8 @@ static void usage(const char* program) {
   cout << "Usage: " << program << " --conf=<config_file> <replay_file>" << std::endl;
   cout << "Options:" << std::endl;
   cout << "  -p, --pool-name <pool>          Name of the pool to use.  Default: rbd" << std::endl;
-  cout << "  --latency-multiplier <float>    Multiplies inter-request latencies.  Default: 1" << std::endl;
+  cout << "  --latency-multiplier <float>    Multiplies inter-request latencies, 0.5 replays" << std::endl;
+  cout << "                                  at twice the speed.  Default: 1" << std::endl;
   cout << "  --read-only                     Only perform non-destructive operations." << std::endl;
   cout << "  --map-image <rule>              Add a rule to map image names in the trace to" << std::endl;
   cout << "                                  image names in the replay cluster." << std::endl;
@@ -49,6 +50,12 @@ static void usage(const char* program) {
   cout << "                                  the same image is opened and closed multiple times." << std::endl;
   cout << "                                  Performance counters and their meaning may change between" << std::endl;
   cout << "                                  versions." << std::endl;
+  cout << "  --dump-latencies                Print the latency distribution of each type" << std::endl;
+  cout << "                                  of request once the replay completes." << std::endl;
+  cout << "  --start-time <seconds>          Wait until this Unix time before replaying, to" << std::endl;
+  cout << "                                  start several clients together." << std::endl;
+  cout << "  --client-index <index>          Split the trace across --client-count clients" << std::endl;
+  cout << "  --client-count <count>          by image and replay the share of client <index>." << std::endl;
   cout << std::endl;
   cout << "Image mapping rules:" << std::endl;
   cout << "A rule of image1@snap1=image2@snap2 would map snap1 of image1 to snap2 of" << std::endl;
@@ -71,6 +78,10 @@ int main(int argc, const char **argv) {
   std::string val;
   std::ostringstream err;
   bool dump_perf_counters = false;
+  bool dump_latencies = false;
+  long long start_time = 0;
+  int client_index = 0;
+  int client_count = 1;
   for (i = args.begin(); i != args.end(); ) {
     if (ceph_argparse_double_dash(args, i)) {
       break;
@@ -97,6 +108,26 @@ int main(int argc, const char **argv) {
       return 0;
     } else if (ceph_argparse_flag(args, i, "--dump-perf-counters", (char*)NULL)) {
       dump_perf_counters = true;
+    } else if (ceph_argparse_flag(args, i, "--dump-latencies", (char*)NULL)) {
+      dump_latencies = true;
+    } else if (ceph_argparse_witharg(args, i, &start_time, err, "--start-time",
+				     (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << err.str() << std::endl;
+	return 1;
+      }
+    } else if (ceph_argparse_witharg(args, i, &client_index, err, "--client-index",
+				     (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << err.str() << std::endl;
+	return 1;
+      }
+    } else if (ceph_argparse_witharg(args, i, &client_count, err, "--client-count",
+				     (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << err.str() << std::endl;
+	return 1;
+      }
     } else if (get_remainder(*i, "-")) {
       cerr << "Unrecognized argument: " << *i << std::endl;
       return 1;
@@ -117,6 +148,12 @@ int main(int argc, const char **argv) {
     return 1;
   }
 
+  if (client_count < 1 || client_index < 0 || client_index >= client_count) {
+    cerr << "Invalid client index " << client_index << " of " << client_count
+	 << " clients." << std::endl;
+    return 1;
+  }
+
   unsigned int nthreads = boost::thread::hardware_concurrency();
   Replayer replayer(2 * nthreads + 1);
   replayer.set_latency_multiplier(latency_multiplier);
@@ -124,5 +161,8 @@ int main(int argc, const char **argv) {
   replayer.set_readonly(readonly);
   replayer.set_image_name_map(image_name_map);
   replayer.set_dump_perf_counters(dump_perf_counters);
+  replayer.set_dump_latencies(dump_latencies);
+  replayer.set_start_time(utime_t(start_time, 0));
+  replayer.set_client(client_index, client_count);
   replayer.run(replay_file);
 }
@@ -13,10 +13,12 @@
 #define dout_prefix (*_dout << "asio: ")
 
 
-RGWAsioClientIO::RGWAsioClientIO(tcp::socket&& socket,
-                                 request_type&& request)
-  : socket(std::move(socket)),
-    request(std::move(request)),
+RGWAsioClientIO::RGWAsioClientIO(tcp::socket& socket,
+                                 request_type& request,
+                                 boost::asio::yield_context yield)
+  : socket(socket),
+    request(request),
+    yield(yield),
     txbuf(*this) {
 }
 
@@ -84,13 +86,14 @@ size_t RGWAsioClientIO::write_data(const char* const buf,
                                    const size_t len)
 {
   boost::system::error_code ec;
-  auto bytes = boost::asio::write(socket, boost::asio::buffer(buf, len), ec);
+  auto bytes = boost::asio::async_write(socket, boost::asio::buffer(buf, len),
+                                        yield[ec]);
   if (ec) {
     derr << "write_data failed: " << ec.message() << dendl;
     throw rgw::io::Exception(ec.value(), std::system_category());
   } else {
-    /* According to the documentation of boost::asio::write if there is
-     * no error (signalised by ec), then bytes == len. We don't need to
+    /* According to the documentation of boost::asio::async_write if there
+     * is no error (signalised by ec), then bytes == len. We don't need to
      * take care of partial writes in such situation. */
     return bytes;
   }
@@ -4,6 +4,7 @@
 #define RGW_ASIO_CLIENT_H
 
 #include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/spawn.hpp>
 #include <beast/http/body_type.hpp>
 #include <beast/http/concepts.hpp>
 #include <beast/http/message_v1.hpp>
@@ -24,14 +25,17 @@ class RGWBufferlistBody {
                                             Headers>;
 };
 
+// the connection and the request belong to the coroutine serving them;
+// writes suspend it rather than block the thread
 class RGWAsioClientIO : public rgw::io::RestfulClient,
                         public rgw::io::BuffererSink {
   using tcp = boost::asio::ip::tcp;
-  tcp::socket socket;
+  tcp::socket& socket;
 
   using body_type = RGWBufferlistBody;
   using request_type = beast::http::request_v1<body_type>;
-  request_type request;
+  request_type& request;
+  boost::asio::yield_context yield;
 
   bufferlist::const_iterator body_iter;
 
@@ -45,7 +49,8 @@ class RGWAsioClientIO : public rgw::io::RestfulClient,
   size_t read_data(char *buf, size_t max);
 
  public:
-  RGWAsioClientIO(tcp::socket&& socket, request_type&& request);
+  RGWAsioClientIO(tcp::socket& socket, request_type& request,
+                  boost::asio::yield_context yield);
   ~RGWAsioClientIO();
 
   void init_env(CephContext *cct) override;
@@ -7,9 +7,9 @@
 #include <vector>
 
 #include <boost/asio.hpp>
+#include <boost/asio/spawn.hpp>
 #include <boost/optional.hpp>
 
-#include <beast/core/placeholders.hpp>
 #include <beast/core/streambuf.hpp>
 #include <beast/http/empty_body.hpp>
 #include <beast/http/parse_error.hpp>
@@ -75,50 +75,64 @@ class AsioConnection : public std::enable_shared_from_this<AsioConnection> {
   RGWProcessEnv& env;
   boost::asio::io_service::strand strand;
   tcp::socket socket;
-  tcp::endpoint endpoint;
   beast::streambuf buf;
-  beast::http::request_v1<RGWBufferlistBody> request;
 
- public:
-  void on_read(boost::system::error_code ec) {
+  void handle(boost::asio::yield_context yield) {
     auto cct = env.store->ctx();
-    if (ec) {
-      if (ec.category() == beast::http::get_parse_error_category()) {
-        ldout(cct, 1) << "parse failed: " << ec.message() << dendl;
-      } else {
-        ldout(cct, 1) << "read failed: " << ec.message() << dendl;
+    boost::system::error_code ec;
+
+    // serve requests until the client closes the connection or a request
+    // does not want it kept alive.  an idle or slow client only holds the
+    // suspended coroutine, not a thread
+    for (;;) {
+      beast::http::request_v1<RGWBufferlistBody> request;
+      beast::http::async_read(socket, buf, request, yield[ec]);
+      if (ec == boost::asio::error::eof ||
+          ec == boost::asio::error::connection_reset) {
+        return;
+      }
+      if (ec) {
+        if (ec.category() == beast::http::get_parse_error_category()) {
+          ldout(cct, 1) << "parse failed: " << ec.message() << dendl;
+        } else {
+          ldout(cct, 1) << "read failed: " << ec.message() << dendl;
+        }
+        write_bad_request(request.version, yield);
+        return;
+      }
+
+      {
+        RGWRequest req{env.store->get_new_req_id()};
+        RGWAsioClientIO real_client{socket, request, yield};
+        auto real_client_io = rgw::io::add_reordering(
+                                rgw::io::add_buffering(
+                                  rgw::io::add_chunking(
+                                    rgw::io::add_conlen_controlling(
+                                      &real_client))));
+        RGWRestfulIO client(&real_client_io);
+        process_request(env.store, env.rest, &req, env.uri_prefix, &client,
+                        env.olog,
+                        optional_yield_context{socket.get_io_service(), yield});
+      }
+
+      if (!beast::http::is_keep_alive(request) || !socket.is_open()) {
+        return;
       }
-      write_bad_request();
-      return;
     }
-    RGWRequest req{env.store->get_new_req_id()};
-    RGWAsioClientIO real_client{std::move(socket), std::move(request)};
-    auto real_client_io = rgw::io::add_reordering(
-                            rgw::io::add_buffering(
-                              rgw::io::add_chunking(
-                                rgw::io::add_conlen_controlling(
-                                  &real_client))));
-    RGWRestfulIO client(&real_client_io);
-    process_request(env.store, env.rest, &req, env.uri_prefix, &client,
-                    env.olog);
   }
 
-  void write_bad_request() {
+  void write_bad_request(int version, boost::asio::yield_context yield) {
+    auto cct = env.store->ctx();
     beast::http::response_v1<beast::http::empty_body> response;
     response.status = 400;
     response.reason = "Bad Request";
     /* If the request is so terribly malformed that we can't extract even
      * the protocol version, we will use HTTP/1.1 as a fallback. */
-    response.version = request.version ? request.version : 11;
+    response.version = version ? version : 11;
     beast::http::prepare(response);
-    beast::http::async_write(socket, std::move(response),
-                             std::bind(&AsioConnection::on_write,
-                                       shared_from_this(),
-                                       beast::asio::placeholders::error));
-  }
 
-  void on_write(boost::system::error_code ec) {
-    auto cct = env.store->ctx();
+    boost::system::error_code ec;
+    beast::http::async_write(socket, std::move(response), yield[ec]);
     if (ec) {
       ldout(cct, 1) << "write failed: " << ec.message() << dendl;
     }
@@ -129,10 +143,13 @@ class AsioConnection : public std::enable_shared_from_this<AsioConnection> {
     : env(env), strand(socket.get_io_service()), socket(std::move(socket))
   {}
 
-  void read() {
-    beast::http::async_read(socket, buf, request, strand.wrap(
-            std::bind(&AsioConnection::on_read, shared_from_this(),
-                      beast::asio::placeholders::error)));
+  void start() {
+    auto cct = env.store->ctx();
+    boost::coroutines::attributes attrs(cct->_conf->rgw_asio_coroutine_stack_size);
+    boost::asio::spawn(strand,
+                       std::bind(&AsioConnection::handle, shared_from_this(),
+                                 std::placeholders::_1),
+                       attrs);
   }
 };
 
@@ -195,7 +212,7 @@ void AsioFrontend::accept(boost::system::error_code ec)
                           return accept(ec);
                         });
 
-  std::make_shared<AsioConnection>(env, std::move(socket))->read();
+  std::make_shared<AsioConnection>(env, std::move(socket))->start();
 }
 
 int AsioFrontend::run()
@@ -0,0 +1,77 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "common/ceph_context.h"
+#include "common/dout.h"
+
+#include "rgw_auth_cache.h"
+
+#define dout_subsys ceph_subsys_rgw
+
+static ceph::timespan auth_cache_ttl(CephContext *cct)
+{
+  if (cct->_conf->rgw_auth_cache_size <= 0) {
+    return ceph::timespan::zero();
+  }
+  return std::chrono::seconds(cct->_conf->rgw_auth_cache_ttl);
+}
+
+RGWAuthCache::RGWAuthCache(CephContext *cct, const char *name)
+  : entries(std::max(cct->_conf->rgw_auth_cache_size, 1)),
+    ttl(auth_cache_ttl(cct))
+{
+  ldout(cct, 10) << "auth cache " << name << ": size="
+                 << cct->_conf->rgw_auth_cache_size
+                 << " ttl=" << cct->_conf->rgw_auth_cache_ttl << dendl;
+}
+
+bool RGWAuthCache::find(const std::string& key, const std::string& secret,
+                        std::string& value)
+{
+  if (!enabled()) {
+    return false;
+  }
+  Entry e;
+  if (!entries.find(key, e)) {
+    return false;
+  }
+  if (e.expires < ceph::coarse_mono_clock::now()) {
+    entries.erase(key);
+    return false;
+  }
+  if (e.secret != secret) {
+    return false;
+  }
+  value = std::move(e.value);
+  return true;
+}
+
+void RGWAuthCache::add(const std::string& key, const std::string& secret,
+                       const std::string& value)
+{
+  if (!enabled()) {
+    return;
+  }
+  Entry e;
+  e.secret = secret;
+  e.value = value;
+  e.expires = ceph::coarse_mono_clock::now() + ttl;
+  entries.add(key, e);
+}
+
+void RGWAuthCache::invalidate(const std::string& key)
+{
+  entries.erase(key);
+}
+
+RGWAuthCache& rgw_s3_v4_signing_key_cache(CephContext *cct)
+{
+  static RGWAuthCache cache(cct, "s3 v4 signing keys");
+  return cache;
+}
+
+RGWAuthCache& rgw_ldap_auth_cache(CephContext *cct)
+{
+  static RGWAuthCache cache(cct, "ldap");
+  return cache;
+}
@@ -0,0 +1,53 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_RGW_AUTH_CACHE_H
+#define CEPH_RGW_AUTH_CACHE_H
+
+#include <string>
+
+#include "common/ceph_time.h"
+#include "common/lru_map.h"
+
+class CephContext;
+
+/*
+ * A bounded cache of authentication results.
+ *
+ * Each result is stored along with the secret it was derived from (or a
+ * digest of it), and is only returned for that same secret, so a changed
+ * key or password misses rather than being served the old result.  Entries
+ * also expire rgw_auth_cache_ttl seconds after they were added, which bounds
+ * how long a result stays usable once it was revoked elsewhere, e.g. in the
+ * directory server.  At most rgw_auth_cache_size entries are kept, the least
+ * recently used ones are dropped first.
+ */
+class RGWAuthCache {
+  struct Entry {
+    std::string secret;
+    std::string value;
+    ceph::coarse_mono_time expires;
+  };
+
+  lru_map<std::string, Entry> entries;
+  ceph::timespan ttl;
+
+public:
+  RGWAuthCache(CephContext *cct, const char *name);
+
+  bool enabled() const { return ttl != ceph::timespan::zero(); }
+
+  /// find the result cached for key, if derived from the same secret
+  bool find(const std::string& key, const std::string& secret,
+            std::string& value);
+  void add(const std::string& key, const std::string& secret,
+           const std::string& value);
+  void invalidate(const std::string& key);
+};
+
+/// S3 v4 signing keys, by access key and credential scope
+RGWAuthCache& rgw_s3_v4_signing_key_cache(CephContext *cct);
+/// successful LDAP binds, by user
+RGWAuthCache& rgw_ldap_auth_cache(CephContext *cct);
+
+#endif
@@ -4,6 +4,7 @@
 #include "common/armor.h"
 #include "common/utf8.h"
 #include "rgw_common.h"
+#include "rgw_auth_cache.h"
 #include "rgw_client_io.h"
 #include "rgw_rest.h"
 
@@ -340,21 +341,13 @@ void rgw_create_s3_v4_string_to_sign(CephContext *cct, const string& algorithm,
 }
 
 /*
- * calculate the AWS signature version 4
+ * derive the signing key for signature version 4 from the secret key
  */
-int rgw_calculate_s3_v4_aws_signature(struct req_state *s,
-    const string& access_key_id, const string &date, const string& region,
-    const string& service, const string& string_to_sign, string& signature) {
-
-  map<string, RGWAccessKey>::iterator iter = s->user->access_keys.find(access_key_id);
-  if (iter == s->user->access_keys.end()) {
-    ldout(s->cct, 10) << "ERROR: access key not encoded in user info" << dendl;
-    return -EPERM;
-  }
-
-  RGWAccessKey& k = iter->second;
-
-  string secret_key = "AWS4" + k.key;
+static void calc_s3_v4_signing_key(CephContext *cct, const string& key,
+    const string& date, const string& region, const string& service,
+    char *signing_k)
+{
+  string secret_key = "AWS4" + key;
 
   char secret_k[secret_key.size() * MAX_UTF8_SZ];
 
@@ -375,7 +368,7 @@ int rgw_calculate_s3_v4_aws_signature(struct req_state *s,
   char aux[CEPH_CRYPTO_HMACSHA256_DIGESTSIZE * 2 + 1];
   buf_to_hex((unsigned char *) date_k, CEPH_CRYPTO_HMACSHA256_DIGESTSIZE, aux);
 
-  ldout(s->cct, 10) << "date_k        = " << string(aux) << dendl;
+  ldout(cct, 10) << "date_k        = " << string(aux) << dendl;
 
   /* region */
 
@@ -384,7 +377,7 @@ int rgw_calculate_s3_v4_aws_signature(struct req_state *s,
 
   buf_to_hex((unsigned char *) region_k, CEPH_CRYPTO_HMACSHA256_DIGESTSIZE, aux);
 
-  ldout(s->cct, 10) << "region_k      = " << string(aux) << dendl;
+  ldout(cct, 10) << "region_k      = " << string(aux) << dendl;
 
   /* service */
 
@@ -393,14 +386,45 @@ int rgw_calculate_s3_v4_aws_signature(struct req_state *s,
 
   buf_to_hex((unsigned char *) service_k, CEPH_CRYPTO_HMACSHA256_DIGESTSIZE, aux);
 
-  ldout(s->cct, 10) << "service_k     = " << string(aux) << dendl;
+  ldout(cct, 10) << "service_k     = " << string(aux) << dendl;
 
   /* aws4_request */
 
+  calc_hmac_sha256(service_k, CEPH_CRYPTO_HMACSHA256_DIGESTSIZE, "aws4_request", 12, signing_k);
+}
+
+/*
+ * calculate the AWS signature version 4
+ */
+int rgw_calculate_s3_v4_aws_signature(struct req_state *s,
+    const string& access_key_id, const string &date, const string& region,
+    const string& service, const string& string_to_sign, string& signature) {
+
+  map<string, RGWAccessKey>::iterator iter = s->user->access_keys.find(access_key_id);
+  if (iter == s->user->access_keys.end()) {
+    ldout(s->cct, 10) << "ERROR: access key not encoded in user info" << dendl;
+    return -EPERM;
+  }
+
+  RGWAccessKey& k = iter->second;
+
   char *signing_k = s->aws4_auth->signing_k;
 
-  calc_hmac_sha256(service_k, CEPH_CRYPTO_HMACSHA256_DIGESTSIZE, "aws4_request", 12, signing_k);
+  /* the signing key only depends on the secret key and the scope, so it is
+   * the same for all requests of a client over the day */
+  RGWAuthCache& signing_key_cache = rgw_s3_v4_signing_key_cache(s->cct);
+  string cache_key = access_key_id + "/" + date + "/" + region + "/" + service;
+  string cached;
+  if (signing_key_cache.find(cache_key, k.key, cached) &&
+      cached.size() == CEPH_CRYPTO_HMACSHA256_DIGESTSIZE) {
+    memcpy(signing_k, cached.data(), CEPH_CRYPTO_HMACSHA256_DIGESTSIZE);
+  } else {
+    calc_s3_v4_signing_key(s->cct, k.key, date, region, service, signing_k);
+    signing_key_cache.add(cache_key, k.key,
+                          string(signing_k, CEPH_CRYPTO_HMACSHA256_DIGESTSIZE));
+  }
 
+  char aux[CEPH_CRYPTO_HMACSHA256_DIGESTSIZE * 2 + 1];
   buf_to_hex((unsigned char *) signing_k, CEPH_CRYPTO_HMACSHA256_DIGESTSIZE, aux);
 
   ldout(s->cct, 10) << "signing_k     = " << string(aux) << dendl;
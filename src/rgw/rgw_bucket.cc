@@ -1636,6 +1636,41 @@ void RGWDataChangesLog::update_renewed(rgw_bucket_shard& bs, real_time& expirati
   status->cur_expiration = expiration;
 }
 
+int RGWDataChangesLog::commit_entry(int index, cls_log_entry& entry)
+{
+  LogShardCommit& c = commits[index];
+  Mutex::Locker l(c.lock);
+
+  if (!c.queued) {
+    c.queued = std::make_shared<LogShardBatch>();
+  }
+  std::shared_ptr<LogShardBatch> batch = c.queued;
+  batch->entries.push_back(std::move(entry));
+
+  while (c.busy && !batch->done) {
+    c.cond.Wait(c.lock);
+  }
+  if (batch->done) {
+    return batch->ret;
+  }
+
+  /* nobody is writing to the shard, write whatever has queued up */
+  c.busy = true;
+  c.queued.reset();
+  c.lock.Unlock();
+
+  ldout(cct, 20) << "RGWDataChangesLog::commit_entry() writing " << batch->entries.size()
+                 << " entries to " << oids[index] << dendl;
+  int ret = store->time_log_add(oids[index], batch->entries, NULL);
+
+  c.lock.Lock();
+  batch->ret = ret;
+  batch->done = true;
+  c.busy = false;
+  c.cond.SignalAll();
+  return ret;
+}
+
 int RGWDataChangesLog::get_log_shard_id(rgw_bucket& bucket, int shard_id) {
   rgw_bucket_shard bs(bucket, shard_id);
 
@@ -1693,7 +1728,6 @@ int RGWDataChangesLog::add_entry(rgw_bucket& bucket, int shard_id) {
   status->cond = new RefCountedCond;
   status->pending = true;
 
-  string& oid = oids[index];
   real_time expiration;
 
   int ret;
@@ -1713,10 +1747,12 @@ int RGWDataChangesLog::add_entry(rgw_bucket& bucket, int shard_id) {
     change.timestamp = now;
     ::encode(change, bl);
     string section;
+    cls_log_entry entry;
+    store->time_log_prepare_entry(entry, now, section, change.key, bl);
 
     ldout(cct, 20) << "RGWDataChangesLog::add_entry() sending update with now=" << now << " cur_expiration=" << expiration << dendl;
 
-    ret = store->time_log_add(oid, now, section, change.key, bl);
+    ret = commit_entry(index, entry);
 
     now = real_clock::now();
 
@@ -1857,6 +1893,7 @@ RGWDataChangesLog::~RGWDataChangesLog() {
   renew_thread->stop();
   renew_thread->join();
   delete renew_thread;
+  delete[] commits;
   delete[] oids;
 }
 
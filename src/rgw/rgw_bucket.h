@@ -393,6 +393,30 @@ class RGWDataChangesLog {
   int num_shards;
   string *oids;
 
+  /*
+   * Entries that writers add to the same log shard while a write to it is
+   * in flight are queued and go out together in the next write, so a busy
+   * shard sees one append per round trip rather than one per bucket shard.
+   */
+  struct LogShardBatch {
+    list<cls_log_entry> entries;
+    bool done{false};
+    int ret{0};
+  };
+
+  struct LogShardCommit {
+    Mutex lock;
+    Cond cond;
+    bool busy{false};
+    std::shared_ptr<LogShardBatch> queued;
+
+    LogShardCommit() : lock("RGWDataChangesLog::LogShardCommit") {}
+  };
+
+  LogShardCommit *commits;
+
+  int commit_entry(int index, cls_log_entry& entry);
+
   Mutex lock;
   RWLock modified_lock;
   map<int, set<string> > modified_shards;
@@ -447,6 +471,7 @@ public:
     num_shards = cct->_conf->rgw_data_log_num_shards;
 
     oids = new string[num_shards];
+    commits = new LogShardCommit[num_shards];
 
     string prefix = cct->_conf->rgw_data_log_obj_prefix;
 
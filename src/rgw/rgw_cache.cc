@@ -4,21 +4,52 @@
 #include "rgw_cache.h"
 
 #include <errno.h>
+#include <set>
+
+#include "include/ceph_hash.h"
 
 #define dout_subsys ceph_subsys_rgw
 
 using namespace std;
 
-int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask, rgw_cache_entry_info *cache_info)
+void ObjectCache::set_ctx(CephContext *_cct)
+{
+  cct = _cct;
+
+  size_t num_shards = std::max<int64_t>(cct->_conf->rgw_cache_shards, 1);
+  shards.clear();
+  for (size_t i = 0; i < num_shards; i++) {
+    shards.emplace_back(new Shard);
+  }
+  max_entries = std::max<unsigned long>(cct->_conf->rgw_cache_lru_size / num_shards, 1);
+  max_bytes = cct->_conf->rgw_cache_max_bytes / num_shards;
+  lru_window = max_entries / 2;
+  negative_ttl = make_timespan(cct->_conf->rgw_cache_negative_ttl);
+}
+
+ObjectCache::Shard& ObjectCache::get_shard(const string& name)
+{
+  return *shards[ceph_str_hash_linux(name.c_str(), name.size()) % shards.size()];
+}
+
+bool ObjectCache::expired(const ObjectCacheEntry& entry) const
 {
-  RWLock::RLocker l(lock);
+  return entry.info.status < 0 &&
+         entry.expires != ceph::coarse_mono_time() &&
+         entry.expires <= ceph::coarse_mono_clock::now();
+}
 
+int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask, rgw_cache_entry_info *cache_info)
+{
   if (!enabled) {
     return -ENOENT;
   }
 
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end()) {
+  Shard& shard = get_shard(name);
+  RWLock::RLocker l(shard.lock);
+
+  map<string, ObjectCacheEntry>::iterator iter = shard.cache_map.find(name);
+  if (iter == shard.cache_map.end() || expired(iter->second)) {
     ldout(cct, 10) << "cache get: name=" << name << " : miss" << dendl;
     if(perfcounter) perfcounter->inc(l_rgw_cache_miss);
     return -ENOENT;
@@ -26,15 +57,15 @@ int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask, rgw_cac
 
   ObjectCacheEntry *entry = &iter->second;
 
-  if (lru_counter - entry->lru_promotion_ts > lru_window) {
-    ldout(cct, 20) << "cache get: touching lru, lru_counter=" << lru_counter
+  if (shard.lru_counter - entry->lru_promotion_ts > lru_window) {
+    ldout(cct, 20) << "cache get: touching lru, lru_counter=" << shard.lru_counter
                    << " promotion_ts=" << entry->lru_promotion_ts << dendl;
-    lock.unlock();
-    lock.get_write(); /* promote lock to writer */
+    shard.lock.unlock();
+    shard.lock.get_write(); /* promote lock to writer */
 
     /* need to redo this because entry might have dropped off the cache */
-    iter = cache_map.find(name);
-    if (iter == cache_map.end()) {
+    iter = shard.cache_map.find(name);
+    if (iter == shard.cache_map.end()) {
       ldout(cct, 10) << "lost race! cache get: name=" << name << " : miss" << dendl;
       if(perfcounter) perfcounter->inc(l_rgw_cache_miss);
       return -ENOENT;
@@ -42,8 +73,8 @@ int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask, rgw_cac
 
     entry = &iter->second;
     /* check again, we might have lost a race here */
-    if (lru_counter - entry->lru_promotion_ts > lru_window) {
-      touch_lru(name, *entry, iter->second.lru_iter);
+    if (shard.lru_counter - entry->lru_promotion_ts > lru_window) {
+      touch_lru(shard, name, *entry, iter->second.lru_iter);
     }
   }
 
@@ -71,12 +102,24 @@ int ObjectCache::get(string& name, ObjectCacheInfo& info, uint32_t mask, rgw_cac
 
 bool ObjectCache::chain_cache_entry(list<rgw_cache_entry_info *>& cache_info_entries, RGWChainedCache::Entry *chained_entry)
 {
-  RWLock::WLocker l(lock);
-
   if (!enabled) {
     return false;
   }
 
+  /* lock the shards involved in a fixed order */
+  set<Shard *> involved;
+  for (auto cache_info : cache_info_entries) {
+    involved.insert(&get_shard(cache_info->cache_locator));
+  }
+  for (auto shard : involved) {
+    shard->lock.get_write();
+  }
+  auto unlock = [&involved] {
+    for (auto shard : involved) {
+      shard->lock.unlock();
+    }
+  };
+
   list<rgw_cache_entry_info *>::iterator citer;
 
   list<ObjectCacheEntry *> cache_entry_list;
@@ -84,11 +127,13 @@ bool ObjectCache::chain_cache_entry(list<rgw_cache_entry_info *>& cache_info_ent
   /* first verify that all entries are still valid */
   for (citer = cache_info_entries.begin(); citer != cache_info_entries.end(); ++citer) {
     rgw_cache_entry_info *cache_info = *citer;
+    Shard& shard = get_shard(cache_info->cache_locator);
 
     ldout(cct, 10) << "chain_cache_entry: cache_locator=" << cache_info->cache_locator << dendl;
-    map<string, ObjectCacheEntry>::iterator iter = cache_map.find(cache_info->cache_locator);
-    if (iter == cache_map.end()) {
+    map<string, ObjectCacheEntry>::iterator iter = shard.cache_map.find(cache_info->cache_locator);
+    if (iter == shard.cache_map.end()) {
       ldout(cct, 20) << "chain_cache_entry: couldn't find cache locator" << dendl;
+      unlock();
       return false;
     }
 
@@ -96,6 +141,7 @@ bool ObjectCache::chain_cache_entry(list<rgw_cache_entry_info *>& cache_info_ent
 
     if (entry->gen != cache_info->gen) {
       ldout(cct, 20) << "chain_cache_entry: entry.gen (" << entry->gen << ") != cache_info.gen (" << cache_info->gen << ")" << dendl;
+      unlock();
       return false;
     }
 
@@ -113,25 +159,27 @@ bool ObjectCache::chain_cache_entry(list<rgw_cache_entry_info *>& cache_info_ent
     entry->chained_entries.push_back(make_pair(chained_entry->cache, chained_entry->key));
   }
 
+  unlock();
   return true;
 }
 
 void ObjectCache::put(string& name, ObjectCacheInfo& info, rgw_cache_entry_info *cache_info)
 {
-  RWLock::WLocker l(lock);
-
   if (!enabled) {
     return;
   }
 
+  Shard& shard = get_shard(name);
+  RWLock::WLocker l(shard.lock);
+
   ldout(cct, 10) << "cache put: name=" << name << " info.flags=0x"
                  << std::hex << info.flags << std::dec << dendl;
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end()) {
+  map<string, ObjectCacheEntry>::iterator iter = shard.cache_map.find(name);
+  if (iter == shard.cache_map.end()) {
     ObjectCacheEntry entry;
-    entry.lru_iter = lru.end();
-    cache_map.insert(pair<string, ObjectCacheEntry>(name, entry));
-    iter = cache_map.find(name);
+    entry.lru_iter = shard.lru.end();
+    shard.cache_map.insert(pair<string, ObjectCacheEntry>(name, entry));
+    iter = shard.cache_map.find(name);
   }
   ObjectCacheEntry& entry = iter->second;
   ObjectCacheInfo& target = entry.info;
@@ -145,7 +193,7 @@ void ObjectCache::put(string& name, ObjectCacheInfo& info, rgw_cache_entry_info
   entry.chained_entries.clear();
   entry.gen++;
 
-  touch_lru(name, entry, entry.lru_iter);
+  touch_lru(shard, name, entry, entry.lru_iter);
 
   target.status = info.status;
 
@@ -153,6 +201,12 @@ void ObjectCache::put(string& name, ObjectCacheInfo& info, rgw_cache_entry_info
     target.flags = 0;
     target.xattrs.clear();
     target.data.clear();
+    if (negative_ttl != ceph::timespan::zero()) {
+      entry.expires = ceph::coarse_mono_clock::now() + negative_ttl;
+    } else {
+      entry.expires = ceph::coarse_mono_time();
+    }
+    update_size(shard, name, entry);
     return;
   }
 
@@ -191,18 +245,21 @@ void ObjectCache::put(string& name, ObjectCacheInfo& info, rgw_cache_entry_info
 
   if (info.flags & CACHE_FLAG_OBJV)
     target.version = info.version;
+
+  update_size(shard, name, entry);
 }
 
 void ObjectCache::remove(string& name)
 {
-  RWLock::WLocker l(lock);
-
   if (!enabled) {
     return;
   }
 
-  map<string, ObjectCacheEntry>::iterator iter = cache_map.find(name);
-  if (iter == cache_map.end())
+  Shard& shard = get_shard(name);
+  RWLock::WLocker l(shard.lock);
+
+  map<string, ObjectCacheEntry>::iterator iter = shard.cache_map.find(name);
+  if (iter == shard.cache_map.end())
     return;
 
   ldout(cct, 10) << "removing " << name << " from cache" << dendl;
@@ -214,14 +271,30 @@ void ObjectCache::remove(string& name)
     chained_cache->invalidate(iiter->second);
   }
 
-  remove_lru(name, iter->second.lru_iter);
-  cache_map.erase(iter);
+  remove_lru(shard, iter->second.lru_iter);
+  shard.bytes -= entry.size;
+  shard.cache_map.erase(iter);
 }
 
-void ObjectCache::touch_lru(string& name, ObjectCacheEntry& entry, std::list<string>::iterator& lru_iter)
+void ObjectCache::update_size(Shard& shard, const string& name, ObjectCacheEntry& entry)
 {
-  while (lru_size > (size_t)cct->_conf->rgw_cache_lru_size) {
-    list<string>::iterator iter = lru.begin();
+  const ObjectCacheInfo& info = entry.info;
+  size_t size = sizeof(entry) + name.size() * 2 /* map key and lru */ +
+                info.data.length();
+  for (auto& i : info.xattrs) {
+    size += i.first.size() + i.second.length();
+  }
+  shard.bytes += size;
+  shard.bytes -= entry.size;
+  entry.size = size;
+}
+
+void ObjectCache::touch_lru(Shard& shard, const string& name, ObjectCacheEntry& entry,
+                            std::list<string>::iterator& lru_iter)
+{
+  while (shard.lru_size > max_entries ||
+         (max_bytes && shard.bytes > max_bytes && shard.lru_size > 1)) {
+    list<string>::iterator iter = shard.lru.begin();
     if ((*iter).compare(name) == 0) {
       /*
        * if the entry we're touching happens to be at the lru end, don't remove it,
@@ -229,45 +302,49 @@ void ObjectCache::touch_lru(string& name, ObjectCacheEntry& entry, std::list<str
        */
       break;
     }
-    map<string, ObjectCacheEntry>::iterator map_iter = cache_map.find(*iter);
+    map<string, ObjectCacheEntry>::iterator map_iter = shard.cache_map.find(*iter);
     ldout(cct, 10) << "removing entry: name=" << *iter << " from cache LRU" << dendl;
-    if (map_iter != cache_map.end())
-      cache_map.erase(map_iter);
-    lru.pop_front();
-    lru_size--;
+    if (map_iter != shard.cache_map.end()) {
+      for (auto& chained : map_iter->second.chained_entries) {
+        chained.first->invalidate(chained.second);
+      }
+      shard.bytes -= map_iter->second.size;
+      shard.cache_map.erase(map_iter);
+    }
+    shard.lru.pop_front();
+    shard.lru_size--;
+    if (perfcounter) perfcounter->inc(l_rgw_cache_evict);
   }
 
-  if (lru_iter == lru.end()) {
-    lru.push_back(name);
-    lru_size++;
+  if (lru_iter == shard.lru.end()) {
+    shard.lru.push_back(name);
+    shard.lru_size++;
     lru_iter--;
     ldout(cct, 10) << "adding " << name << " to cache LRU end" << dendl;
   } else {
     ldout(cct, 10) << "moving " << name << " to cache LRU end" << dendl;
-    lru.erase(lru_iter);
-    lru.push_back(name);
-    lru_iter = lru.end();
+    shard.lru.erase(lru_iter);
+    shard.lru.push_back(name);
+    lru_iter = shard.lru.end();
     --lru_iter;
   }
 
-  lru_counter++;
-  entry.lru_promotion_ts = lru_counter;
+  shard.lru_counter++;
+  entry.lru_promotion_ts = shard.lru_counter;
 }
 
-void ObjectCache::remove_lru(string& name, std::list<string>::iterator& lru_iter)
+void ObjectCache::remove_lru(Shard& shard, std::list<string>::iterator& lru_iter)
 {
-  if (lru_iter == lru.end())
+  if (lru_iter == shard.lru.end())
     return;
 
-  lru.erase(lru_iter);
-  lru_size--;
-  lru_iter = lru.end();
+  shard.lru.erase(lru_iter);
+  shard.lru_size--;
+  lru_iter = shard.lru.end();
 }
 
 void ObjectCache::set_enabled(bool status)
 {
-  RWLock::WLocker l(lock);
-
   enabled = status;
 
   if (!enabled) {
@@ -277,27 +354,28 @@ void ObjectCache::set_enabled(bool status)
 
 void ObjectCache::invalidate_all()
 {
-  RWLock::WLocker l(lock);
-
   do_invalidate_all();
 }
 
 void ObjectCache::do_invalidate_all()
 {
-  cache_map.clear();
-  lru.clear();
-
-  lru_size = 0;
-  lru_counter = 0;
-  lru_window = 0;
+  for (auto& shard : shards) {
+    RWLock::WLocker l(shard->lock);
+    shard->cache_map.clear();
+    shard->lru.clear();
+
+    shard->lru_size = 0;
+    shard->lru_counter = 0;
+    shard->bytes = 0;
+  }
 
+  RWLock::RLocker l(chained_lock);
   for (list<RGWChainedCache *>::iterator iter = chained_cache.begin(); iter != chained_cache.end(); ++iter) {
     (*iter)->invalidate_all();
   }
 }
 
 void ObjectCache::chain_cache(RGWChainedCache *cache) {
-  RWLock::WLocker l(lock);
+  RWLock::WLocker l(chained_lock);
   chained_cache.push_back(cache);
 }
-
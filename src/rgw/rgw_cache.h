@@ -5,16 +5,24 @@
 #define CEPH_RGWCACHE_H
 
 #include "rgw_rados.h"
+#include <atomic>
+#include <memory>
 #include <string>
 #include <map>
+#include <vector>
 #include "include/types.h"
 #include "include/utime.h"
 #include "include/assert.h"
+#include "common/ceph_time.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
 #include "common/RWLock.h"
 
 enum {
   UPDATE_OBJ,
   REMOVE_OBJ,
+  BATCH_OBJ, /* followed by a list of RGWCacheNotifyInfo */
+  REMOVE_DATA, /* object data, see RGWDataCache */
 };
 
 #define CACHE_FLAG_DATA           0x01
@@ -129,37 +137,57 @@ struct ObjectCacheEntry {
   std::list<string>::iterator lru_iter;
   uint64_t lru_promotion_ts;
   uint64_t gen;
+  size_t size;                       /* bytes charged to the shard */
+  ceph::coarse_mono_time expires;    /* for cached errors only */
   std::list<pair<RGWChainedCache *, string> > chained_entries;
 
-  ObjectCacheEntry() : lru_promotion_ts(0), gen(0) {}
+  ObjectCacheEntry() : lru_promotion_ts(0), gen(0), size(0) {}
 };
 
+/*
+ * The entries are spread by name over rgw_cache_shards shards, each with
+ * its own lock and LRU, so lookups of different objects don't contend.
+ * A shard holds up to its share of rgw_cache_lru_size entries and of
+ * rgw_cache_max_bytes.
+ */
 class ObjectCache {
-  std::map<string, ObjectCacheEntry> cache_map;
-  std::list<string> lru;
-  unsigned long lru_size;
-  unsigned long lru_counter;
+  struct Shard {
+    std::map<string, ObjectCacheEntry> cache_map;
+    std::list<string> lru;
+    unsigned long lru_size;
+    unsigned long lru_counter;
+    uint64_t bytes;
+    RWLock lock;
+
+    Shard() : lru_size(0), lru_counter(0), bytes(0), lock("ObjectCache::Shard") {}
+  };
+
+  std::vector<std::unique_ptr<Shard> > shards;
+  unsigned long max_entries;     /* per shard */
+  uint64_t max_bytes;            /* per shard, 0 for no limit */
   unsigned long lru_window;
-  RWLock lock;
+  ceph::timespan negative_ttl;
   CephContext *cct;
 
+  RWLock chained_lock;
   list<RGWChainedCache *> chained_cache;
 
-  bool enabled;
+  std::atomic<bool> enabled;
 
-  void touch_lru(string& name, ObjectCacheEntry& entry, std::list<string>::iterator& lru_iter);
-  void remove_lru(string& name, std::list<string>::iterator& lru_iter);
+  Shard& get_shard(const string& name);
+  bool expired(const ObjectCacheEntry& entry) const;
+  void touch_lru(Shard& shard, const string& name, ObjectCacheEntry& entry, std::list<string>::iterator& lru_iter);
+  void remove_lru(Shard& shard, std::list<string>::iterator& lru_iter);
+  void update_size(Shard& shard, const string& name, ObjectCacheEntry& entry);
 
   void do_invalidate_all();
 public:
-  ObjectCache() : lru_size(0), lru_counter(0), lru_window(0), lock("ObjectCache"), cct(NULL), enabled(false) { }
+  ObjectCache() : max_entries(0), max_bytes(0), lru_window(0), cct(NULL),
+                  chained_lock("ObjectCache::chained_lock"), enabled(false) { }
   int get(std::string& name, ObjectCacheInfo& bl, uint32_t mask, rgw_cache_entry_info *cache_info);
   void put(std::string& name, ObjectCacheInfo& bl, rgw_cache_entry_info *cache_info);
   void remove(std::string& name);
-  void set_ctx(CephContext *_cct) {
-    cct = _cct;
-    lru_window = cct->_conf->rgw_cache_lru_size / 2;
-  }
+  void set_ctx(CephContext *_cct);
   bool chain_cache_entry(list<rgw_cache_entry_info *>& cache_info_entries, RGWChainedCache::Entry *chained_entry);
 
   void set_enabled(bool status);
@@ -173,6 +201,80 @@ class RGWCache  : public T
 {
   ObjectCache cache;
 
+  /*
+   * Updates of objects that map to the same control object are sent in one
+   * notify while an earlier notify to it is in flight; each caller still
+   * returns only once its update was acknowledged.
+   */
+  struct NotifyBatch {
+    list<RGWCacheNotifyInfo> infos;
+    bool done = false;
+    int r = 0;
+  };
+  struct NotifyQueue {
+    Mutex lock;
+    Cond cond;
+    bool in_flight = false;
+    std::shared_ptr<NotifyBatch> pending;
+
+    NotifyQueue() : lock("RGWCache::NotifyQueue") {}
+  };
+  Mutex notify_queues_lock;
+  map<string, std::unique_ptr<NotifyQueue> > notify_queues;
+
+  NotifyQueue& get_notify_queue(const string& oid) {
+    Mutex::Locker l(notify_queues_lock);
+    auto& q = notify_queues[oid];
+    if (!q) {
+      q.reset(new NotifyQueue);
+    }
+    return *q;
+  }
+
+  enum CacheType {
+    CACHE_TYPE_BUCKET,
+    CACHE_TYPE_USER,
+    CACHE_TYPE_OTHER,
+  };
+  CacheType get_cache_type(const rgw_bucket& bucket) {
+    const RGWZoneParams& params = T::get_zone_params();
+    if (bucket.name == params.domain_root.name) {
+      return CACHE_TYPE_BUCKET;
+    }
+    if (bucket.name == params.user_uid_pool.name ||
+        bucket.name == params.user_keys_pool.name ||
+        bucket.name == params.user_email_pool.name ||
+        bucket.name == params.user_swift_pool.name) {
+      return CACHE_TYPE_USER;
+    }
+    return CACHE_TYPE_OTHER;
+  }
+
+  /* cache.get(), accounting the lookup to the kind of object */
+  int cache_get(rgw_bucket& bucket, string& name, ObjectCacheInfo& info, uint32_t mask,
+                rgw_cache_entry_info *cache_info) {
+    int r = cache.get(name, info, mask, cache_info);
+    if (!perfcounter) {
+      return r;
+    }
+    switch (get_cache_type(bucket)) {
+    case CACHE_TYPE_BUCKET:
+      perfcounter->inc(r == 0 ? l_rgw_cache_bucket_hit : l_rgw_cache_bucket_miss);
+      break;
+    case CACHE_TYPE_USER:
+      perfcounter->inc(r == 0 ? l_rgw_cache_user_hit : l_rgw_cache_user_miss);
+      break;
+    default:
+      break;
+    }
+    if (r == 0 && info.status < 0) {
+      perfcounter->inc(l_rgw_cache_negative_hit);
+    }
+    return r;
+  }
+
+  void handle_notify(RGWCacheNotifyInfo& info);
+
   int list_objects_raw_init(rgw_bucket& bucket, RGWAccessHandle *handle) {
     return T::list_objects_raw_init(bucket, handle);
   }
@@ -214,11 +316,22 @@ class RGWCache  : public T
 	       uint64_t notifier_id,
 	       bufferlist& bl);
 
+  void invalidate_data_cache(const rgw_obj& obj) override {
+    T::invalidate_data_cache(obj);
+
+    rgw_obj o = obj;
+    ObjectCacheInfo info;
+    int r = distribute_cache(T::get_data_cache_key(obj), o, info, REMOVE_DATA);
+    if (r < 0) {
+      mydout(0) << "ERROR: failed to distribute data cache invalidation for " << obj << ": r=" << r << dendl;
+    }
+  }
+
   void set_cache_enabled(bool state) {
     cache.set_enabled(state);
   }
 public:
-  RGWCache() {}
+  RGWCache() : notify_queues_lock("RGWCache::notify_queues_lock") {}
 
   void register_chained_cache(RGWChainedCache *cc) {
     cache.chain_cache(cc);
@@ -242,7 +355,8 @@ public:
                      rgw_cache_entry_info *cache_info);
 
   int raw_obj_stat(rgw_obj& obj, uint64_t *psize, real_time *pmtime, uint64_t *epoch, map<string, bufferlist> *attrs,
-                   bufferlist *first_chunk, RGWObjVersionTracker *objv_tracker);
+                   bufferlist *first_chunk, RGWObjVersionTracker *objv_tracker,
+                   optional_yield_context y = optional_yield_context());
 
   int delete_system_obj(rgw_obj& obj, RGWObjVersionTracker *objv_tracker);
 
@@ -302,7 +416,7 @@ int RGWCache<T>::get_system_obj(RGWObjectCtx& obj_ctx, RGWRados::SystemObject::R
   if (attrs)
     flags |= CACHE_FLAG_XATTRS;
   
-  if (cache.get(name, info, flags, cache_info) == 0) {
+  if (cache_get(bucket, name, info, flags, cache_info) == 0) {
     if (info.status < 0)
       return info.status;
 
@@ -457,7 +571,8 @@ int RGWCache<T>::put_system_obj_data(void *ctx, rgw_obj& obj, bufferlist& data,
 template <class T>
 int RGWCache<T>::raw_obj_stat(rgw_obj& obj, uint64_t *psize, real_time *pmtime,
                           uint64_t *pepoch, map<string, bufferlist> *attrs,
-                          bufferlist *first_chunk, RGWObjVersionTracker *objv_tracker)
+                          bufferlist *first_chunk, RGWObjVersionTracker *objv_tracker,
+                          optional_yield_context y)
 {
   rgw_bucket bucket;
   string oid;
@@ -473,7 +588,7 @@ int RGWCache<T>::raw_obj_stat(rgw_obj& obj, uint64_t *psize, real_time *pmtime,
   uint32_t flags = CACHE_FLAG_META | CACHE_FLAG_XATTRS;
   if (objv_tracker)
     flags |= CACHE_FLAG_OBJV;
-  int r = cache.get(name, info, flags, NULL);
+  int r = cache_get(bucket, name, info, flags, NULL);
   if (r == 0) {
     if (info.status < 0)
       return info.status;
@@ -485,7 +600,7 @@ int RGWCache<T>::raw_obj_stat(rgw_obj& obj, uint64_t *psize, real_time *pmtime,
       objv_tracker->read_version = info.version;
     goto done;
   }
-  r = T::raw_obj_stat(obj, &size, &mtime, &epoch, &info.xattrs, first_chunk, objv_tracker);
+  r = T::raw_obj_stat(obj, &size, &mtime, &epoch, &info.xattrs, first_chunk, objv_tracker, y);
   if (r < 0) {
     if (r == -ENOENT) {
       info.status = r;
@@ -524,9 +639,95 @@ int RGWCache<T>::distribute_cache(const string& normal_name, rgw_obj& obj, Objec
 
   info.obj_info = obj_info;
   info.obj = obj;
+
+  size_t max_batch = std::max(T::cct->_conf->rgw_cache_notify_max_batch, 1);
+  if (max_batch == 1) {
+    bufferlist bl;
+    ::encode(info, bl);
+    if (perfcounter) {
+      perfcounter->inc(l_rgw_cache_notify);
+    }
+    return T::distribute(normal_name, bl);
+  }
+
+  string notify_oid;
+  T::pick_control_oid(normal_name, notify_oid);
+  NotifyQueue& q = get_notify_queue(notify_oid);
+
+  Mutex::Locker l(q.lock);
+  while (q.pending && q.pending->infos.size() >= max_batch) {
+    q.cond.Wait(q.lock);
+  }
+  if (!q.pending) {
+    q.pending = std::make_shared<NotifyBatch>();
+  }
+  std::shared_ptr<NotifyBatch> batch = q.pending;
+  batch->infos.push_back(std::move(info));
+
+  while (q.in_flight && !batch->done) {
+    q.cond.Wait(q.lock);
+  }
+  if (batch->done) {
+    /* sent along with another update */
+    return batch->r;
+  }
+
+  /* nothing in flight: send our batch, the next one fills up meanwhile */
+  q.in_flight = true;
+  q.pending.reset();
+  q.cond.SignalAll();
+  q.lock.Unlock();
+
   bufferlist bl;
-  ::encode(info, bl);
-  return T::distribute(normal_name, bl);
+  if (batch->infos.size() == 1) {
+    ::encode(batch->infos.front(), bl);
+  } else {
+    RGWCacheNotifyInfo header;
+    header.op = BATCH_OBJ;
+    ::encode(header, bl);
+    ::encode(batch->infos, bl);
+  }
+  if (perfcounter) {
+    perfcounter->inc(l_rgw_cache_notify);
+    perfcounter->inc(l_rgw_cache_notify_batched, batch->infos.size() - 1);
+  }
+  mydout(10) << "distributing " << batch->infos.size() << " cache updates to " << notify_oid << dendl;
+  int r = T::distribute(normal_name, bl);
+
+  q.lock.Lock();
+  batch->r = r;
+  batch->done = true;
+  q.in_flight = false;
+  q.cond.SignalAll();
+  return r;
+}
+
+template <class T>
+void RGWCache<T>::handle_notify(RGWCacheNotifyInfo& info)
+{
+  if (info.op == REMOVE_DATA) {
+    if (T::get_data_cache()) {
+      T::invalidate_data_cache(info.obj);
+    }
+    return;
+  }
+
+  rgw_bucket bucket;
+  string oid;
+  normalize_bucket_and_obj(info.obj.bucket, info.obj.get_object(), bucket, oid);
+  string name = normal_name(bucket, oid);
+
+  switch (info.op) {
+  case UPDATE_OBJ:
+    cache.put(name, info.obj_info, NULL);
+    break;
+  case REMOVE_OBJ:
+    cache.remove(name);
+    break;
+  default:
+    mydout(0) << "WARNING: got unknown notification op: " << info.op << dendl;
+    break;
+  }
 }
 
 template <class T>
@@ -536,10 +737,14 @@ int RGWCache<T>::watch_cb(uint64_t notify_id,
 			  bufferlist& bl)
 {
   RGWCacheNotifyInfo info;
+  list<RGWCacheNotifyInfo> batch;
 
   try {
     bufferlist::iterator iter = bl.begin();
     ::decode(info, iter);
+    if (info.op == BATCH_OBJ) {
+      ::decode(batch, iter);
+    }
   } catch (buffer::end_of_buffer& err) {
     mydout(0) << "ERROR: got bad notification" << dendl;
     return -EIO;
@@ -548,21 +753,17 @@ int RGWCache<T>::watch_cb(uint64_t notify_id,
     return -EIO;
   }
 
-  rgw_bucket bucket;
-  string oid;
-  normalize_bucket_and_obj(info.obj.bucket, info.obj.get_object(), bucket, oid);
-  string name = normal_name(bucket, oid);
-  
-  switch (info.op) {
-  case UPDATE_OBJ:
-    cache.put(name, info.obj_info, NULL);
-    break;
-  case REMOVE_OBJ:
-    cache.remove(name);
-    break;
-  default:
-    mydout(0) << "WARNING: got unknown notification op: " << info.op << dendl;
-    return -EINVAL;
+  if (info.op != BATCH_OBJ) {
+    if (info.op != UPDATE_OBJ && info.op != REMOVE_OBJ && info.op != REMOVE_DATA) {
+      mydout(0) << "WARNING: got unknown notification op: " << info.op << dendl;
+      return -EINVAL;
+    }
+    handle_notify(info);
+    return 0;
+  }
+
+  for (auto& i : batch) {
+    handle_notify(i);
   }
 
   return 0;
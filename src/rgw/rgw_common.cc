@@ -58,10 +58,85 @@ int rgw_perf_start(CephContext *cct)
 
   plb.add_u64_counter(l_rgw_cache_hit, "cache_hit", "Cache hits");
   plb.add_u64_counter(l_rgw_cache_miss, "cache_miss", "Cache miss");
+  plb.add_u64_counter(l_rgw_cache_bucket_hit, "cache_bucket_hit", "Cache hits on bucket metadata");
+  plb.add_u64_counter(l_rgw_cache_bucket_miss, "cache_bucket_miss", "Cache misses on bucket metadata");
+  plb.add_u64_counter(l_rgw_cache_user_hit, "cache_user_hit", "Cache hits on user metadata");
+  plb.add_u64_counter(l_rgw_cache_user_miss, "cache_user_miss", "Cache misses on user metadata");
+  plb.add_u64_counter(l_rgw_cache_negative_hit, "cache_negative_hit", "Cache hits on objects known not to exist");
+  plb.add_u64_counter(l_rgw_cache_evict, "cache_evict", "Cache entries evicted");
+  plb.add_u64_counter(l_rgw_cache_notify, "cache_notify", "Cache update notifications sent");
+  plb.add_u64_counter(l_rgw_cache_notify_batched, "cache_notify_batched", "Cache updates sent along with others");
+
+  plb.add_u64_counter(l_rgw_datacache_hit, "datacache_hit", "Object data cache hits");
+  plb.add_u64_counter(l_rgw_datacache_miss, "datacache_miss", "Object data cache misses");
+  plb.add_u64_counter(l_rgw_datacache_evict, "datacache_evict", "Objects evicted from the data cache");
+
+  plb.add_u64_counter(l_rgw_gc_retire_obj, "gc_retire_object", "Tail objects released by the GC");
+  plb.add_u64_counter(l_rgw_gc_retire_fail, "gc_retire_fail", "Tail objects the GC failed to release");
+  plb.add_u64_counter(l_rgw_gc_retire_tag, "gc_retire_chain", "GC entries completed");
+  plb.add_u64_counter(l_rgw_gc_shard_busy, "gc_shard_busy", "GC shards skipped as another processor held them");
+  plb.add_u64(l_rgw_gc_shards_behind, "gc_shards_behind", "GC shards left with expired entries after their last pass");
+
+  plb.add_u64_counter(l_rgw_lc_expire_current, "lc_expire_current", "Current object versions expired by lifecycle");
+  plb.add_u64_counter(l_rgw_lc_expire_noncurrent, "lc_expire_noncurrent", "Noncurrent object versions expired by lifecycle");
+  plb.add_u64_counter(l_rgw_lc_expire_dm, "lc_expire_dm", "Delete markers removed by lifecycle");
+  plb.add_u64_counter(l_rgw_lc_shards_processed, "lc_bucket_shards", "Bucket index shards processed by lifecycle");
+  plb.add_u64_counter(l_rgw_lc_buckets_processed, "lc_buckets", "Buckets processed by lifecycle");
+
+  plb.add_u64_counter(l_rgw_ops_log_drop, "ops_log_drop", "Ops log entries dropped as the backlog was full");
 
   plb.add_u64_counter(l_rgw_keystone_token_cache_hit, "keystone_token_cache_hit", "Keystone token cache hits");
   plb.add_u64_counter(l_rgw_keystone_token_cache_miss, "keystone_token_cache_miss", "Keystone token cache miss");
 
+  // Latency axis configuration, values are in nanoseconds
+  PerfHistogramCommon::axis_config_d lat_axis_config{
+    "Latency (usec)",
+    PerfHistogramCommon::SCALE_LOG2, ///< Latency in logarithmic scale
+    0,                               ///< Start at 0
+    100000,                          ///< Quantization unit is 100usec
+    32,                              ///< Enough to cover any request
+  };
+  // Object size axis configuration, values are in bytes
+  PerfHistogramCommon::axis_config_d bytes_axis_config{
+    "Request size (bytes)",
+    PerfHistogramCommon::SCALE_LOG2, ///< Size in logarithmic scale
+    0,                               ///< Start at 0
+    512,                             ///< Quantization unit is 512 bytes
+    32,                              ///< Enough to cover objects larger than TB
+  };
+  plb.add_histogram(l_rgw_get_lat_bytes_hist, "get_lat_bytes_histogram",
+                    lat_axis_config, bytes_axis_config,
+                    "Histogram of GET request latency vs. bytes sent");
+  plb.add_histogram(l_rgw_put_lat_bytes_hist, "put_lat_bytes_histogram",
+                    lat_axis_config, bytes_axis_config,
+                    "Histogram of PUT request latency vs. bytes received");
+  // Op type axis configuration, one bucket per RGWOpType
+  PerfHistogramCommon::axis_config_d op_axis_config{
+    "Op type",
+    PerfHistogramCommon::SCALE_LINEAR,
+    0,
+    1,
+    RGW_OP_ADMIN_SET_METADATA + 2,   ///< values below 0 go to the first one
+  };
+  plb.add_histogram(l_rgw_req_lat_op_hist, "req_lat_op_histogram",
+                    lat_axis_config, op_axis_config,
+                    "Histogram of request latency vs. op type");
+  plb.add_histogram(l_rgw_req_auth_lat_op_hist, "req_auth_lat_op_histogram",
+                    lat_axis_config, op_axis_config,
+                    "Histogram of request time spent on authentication vs. op type");
+  plb.add_histogram(l_rgw_req_bucket_info_lat_op_hist, "req_bucket_info_lat_op_histogram",
+                    lat_axis_config, op_axis_config,
+                    "Histogram of request time spent reading bucket info and acls vs. op type");
+  plb.add_histogram(l_rgw_req_index_lat_op_hist, "req_index_lat_op_histogram",
+                    lat_axis_config, op_axis_config,
+                    "Histogram of request time spent on bucket index ops vs. op type");
+  plb.add_histogram(l_rgw_req_data_lat_op_hist, "req_data_lat_op_histogram",
+                    lat_axis_config, op_axis_config,
+                    "Histogram of request time spent on object data vs. op type");
+  plb.add_histogram(l_rgw_req_client_lat_op_hist, "req_client_lat_op_histogram",
+                    lat_axis_config, op_axis_config,
+                    "Histogram of request time spent on client io vs. op type");
+
   perfcounter = plb.create_perf_counters();
   cct->get_perfcounters_collection()->add(perfcounter);
   return 0;
@@ -74,6 +149,19 @@ void rgw_perf_stop(CephContext *cct)
   delete perfcounter;
 }
 
+const char *rgw_req_phase_name(int phase)
+{
+  switch (phase) {
+  case RGW_REQ_PHASE_OTHER: return "other";
+  case RGW_REQ_PHASE_AUTH: return "auth";
+  case RGW_REQ_PHASE_BUCKET_INFO: return "bucket_info";
+  case RGW_REQ_PHASE_INDEX: return "index";
+  case RGW_REQ_PHASE_DATA: return "data";
+  case RGW_REQ_PHASE_CLIENT: return "client";
+  }
+  return "unknown";
+}
+
 using namespace ceph::crypto;
 
 rgw_err::
@@ -182,7 +270,8 @@ void req_info::rebuild_from(req_info& src)
 
 
 req_state::req_state(CephContext* _cct, RGWEnv* e, RGWUserInfo* u)
-  : cct(_cct), cio(NULL), op(OP_UNKNOWN), user(u), has_acl_header(false),
+  : cct(_cct), cio(NULL), op(OP_UNKNOWN), op_type(RGW_OP_UNKNOWN), user(u),
+    has_acl_header(false),
     info(_cct, e)
 {
   enable_ops_log = e->conf.enable_ops_log;
@@ -204,6 +293,7 @@ req_state::req_state(CephContext* _cct, RGWEnv* e, RGWUserInfo* u)
   system_request = false;
 
   time = ceph_clock_now();
+  phase_start = ceph::mono_clock::now();
   perm_mask = 0;
   bucket_instance_shard_id = -1;
   content_length = 0;
@@ -203,6 +203,7 @@ using ceph::crypto::MD5;
 #define ERR_MALFORMED_DOC        2204
 #define ERR_NO_ROLE_FOUND        2205
 #define ERR_DELETE_CONFLICT      2206
+#define ERR_BUSY_RESHARDING      2300
 
 #ifndef UINT32_MAX
 #define UINT32_MAX (0xffffffffu)
@@ -236,10 +237,47 @@ enum {
 
   l_rgw_cache_hit,
   l_rgw_cache_miss,
+  l_rgw_cache_bucket_hit,
+  l_rgw_cache_bucket_miss,
+  l_rgw_cache_user_hit,
+  l_rgw_cache_user_miss,
+  l_rgw_cache_negative_hit,
+  l_rgw_cache_evict,
+  l_rgw_cache_notify,
+  l_rgw_cache_notify_batched,
+
+  l_rgw_datacache_hit,
+  l_rgw_datacache_miss,
+  l_rgw_datacache_evict,
+
+  l_rgw_gc_retire_obj,
+  l_rgw_gc_retire_fail,
+  l_rgw_gc_retire_tag,
+  l_rgw_gc_shard_busy,
+  l_rgw_gc_shards_behind,
+
+  l_rgw_lc_expire_current,
+  l_rgw_lc_expire_noncurrent,
+  l_rgw_lc_expire_dm,
+  l_rgw_lc_shards_processed,
+  l_rgw_lc_buckets_processed,
+
+  l_rgw_ops_log_drop,
 
   l_rgw_keystone_token_cache_hit,
   l_rgw_keystone_token_cache_miss,
 
+  l_rgw_get_lat_bytes_hist,
+  l_rgw_put_lat_bytes_hist,
+
+  l_rgw_req_lat_op_hist,
+  /* one per RGWReqPhase but RGW_REQ_PHASE_OTHER, in the same order */
+  l_rgw_req_auth_lat_op_hist,
+  l_rgw_req_bucket_info_lat_op_hist,
+  l_rgw_req_index_lat_op_hist,
+  l_rgw_req_data_lat_op_hist,
+  l_rgw_req_client_lat_op_hist,
+
   l_rgw_last,
 };
 
@@ -971,9 +1009,12 @@ struct RGWBucketInfo
   bool swift_versioning;
   string swift_ver_location;
 
+  // Set on an instance whose index was resharded into new_bucket_instance_id.
+  cls_rgw_reshard_status reshard_status;
+  string new_bucket_instance_id;
 
   void encode(bufferlist& bl) const {
-     ENCODE_START(17, 4, bl);
+     ENCODE_START(18, 4, bl);
      ::encode(bucket, bl);
      ::encode(owner.id, bl);
      ::encode(flags, bl);
@@ -997,10 +1038,12 @@ struct RGWBucketInfo
        ::encode(swift_ver_location, bl);
      }
      ::encode(creation_time, bl);
+     ::encode((uint8_t)reshard_status, bl);
+     ::encode(new_bucket_instance_id, bl);
      ENCODE_FINISH(bl);
   }
   void decode(bufferlist::iterator& bl) {
-    DECODE_START_LEGACY_COMPAT_LEN_32(17, 4, 4, bl);
+    DECODE_START_LEGACY_COMPAT_LEN_32(18, 4, 4, bl);
      ::decode(bucket, bl);
      if (struct_v >= 2) {
        string s;
@@ -1057,6 +1100,14 @@ struct RGWBucketInfo
      if (struct_v >= 17) {
        ::decode(creation_time, bl);
      }
+     reshard_status = CLS_RGW_RESHARD_NONE;
+     new_bucket_instance_id.clear();
+     if (struct_v >= 18) {
+       uint8_t rs;
+       ::decode(rs, bl);
+       reshard_status = (cls_rgw_reshard_status)rs;
+       ::decode(new_bucket_instance_id, bl);
+     }
      DECODE_FINISH(bl);
   }
   void dump(Formatter *f) const;
@@ -1074,7 +1125,7 @@ struct RGWBucketInfo
   }
 
   RGWBucketInfo() : flags(0), has_instance_obj(false), num_shards(0), bucket_index_shard_hash_type(MOD), requester_pays(false),
-                    has_website(false), swift_versioning(false) {}
+                    has_website(false), swift_versioning(false), reshard_status(CLS_RGW_RESHARD_NONE) {}
 };
 WRITE_CLASS_ENCODER(RGWBucketInfo)
 
@@ -1290,6 +1341,23 @@ class RGWRequest;
 #include "rgw_auth.h"
 
 /** Store all the state necessary to complete and respond to an HTTP request*/
+/*
+ * What a request spends its time on.  Each moment of a request is
+ * accounted to a single phase, the innermost RGWReqPhaseTimer on the
+ * stack, or RGW_REQ_PHASE_OTHER outside of all of them.
+ */
+enum RGWReqPhase {
+  RGW_REQ_PHASE_OTHER = 0,
+  RGW_REQ_PHASE_AUTH,        ///< authentication, including keystone and ldap
+  RGW_REQ_PHASE_BUCKET_INFO, ///< bucket info, bucket owner and acls
+  RGW_REQ_PHASE_INDEX,       ///< bucket index and user bucket list ops
+  RGW_REQ_PHASE_DATA,        ///< object data and head reads and writes
+  RGW_REQ_PHASE_CLIENT,      ///< reading from and writing to the client
+  RGW_REQ_PHASE_MAX,
+};
+
+extern const char *rgw_req_phase_name(int phase);
+
 struct req_state {
   CephContext *cct;
   rgw::io::BasicClient *cio;
@@ -1386,8 +1454,38 @@ struct req_state {
   string req_id;
   string trans_id;
 
+  ceph::timespan phase_time[RGW_REQ_PHASE_MAX] = {};
+  RGWReqPhase cur_phase{RGW_REQ_PHASE_OTHER};
+  ceph::mono_time phase_start;
+
   req_state(CephContext* _cct, RGWEnv* e, RGWUserInfo* u);
   ~req_state();
+
+  /// account the time since the last switch to the current phase
+  void set_phase(RGWReqPhase phase) {
+    auto now = ceph::mono_clock::now();
+    phase_time[cur_phase] += now - phase_start;
+    phase_start = now;
+    cur_phase = phase;
+  }
+};
+
+/// accounts the time of a scope to a phase of the request, if there is one
+class RGWReqPhaseTimer {
+  req_state *s;
+  RGWReqPhase prev;
+public:
+  RGWReqPhaseTimer(req_state *_s, RGWReqPhase phase) : s(_s) {
+    if (s) {
+      prev = s->cur_phase;
+      s->set_phase(phase);
+    }
+  }
+  ~RGWReqPhaseTimer() {
+    if (s) {
+      s->set_phase(prev);
+    }
+  }
 };
 
 /** Store basic data on an object */
@@ -2,12 +2,178 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 // vim: ts=8 sw=2 smarttab
 
+#include <deque>
+
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
+
 #include "rgw_compression.h"
 
 #define dout_subsys ceph_subsys_rgw
 
+//------------RGWCompressThreads---------------
+
+namespace {
+
+struct CompressBatch;
+
+struct CompressJob {
+  CompressBatch *batch;
+  bufferlist in;
+  bufferlist out;
+  int r{0};
+};
+
+struct CompressBatch {
+  CompressorRef compressor;
+  Mutex lock{"CompressBatch"};
+  Cond cond;
+  int pending{0};
+  std::vector<CompressJob> jobs;
+};
+
+} // anonymous namespace
+
+class RGWCompressThreads {
+  CephContext *cct;
+
+  Mutex lock;
+  Cond cond;
+  std::deque<CompressJob *> queue;
+  bool stopping{false};
+
+  class Worker : public Thread {
+    RGWCompressThreads *pool;
+  public:
+    explicit Worker(RGWCompressThreads *_pool) : pool(_pool) {}
+    void *entry() override {
+      pool->run();
+      return NULL;
+    }
+  };
+  std::vector<Worker *> workers;
+
+  void run() {
+    Mutex::Locker l(lock);
+    while (!stopping || !queue.empty()) {
+      if (queue.empty()) {
+        cond.Wait(lock);
+        continue;
+      }
+      CompressJob *job = queue.front();
+      queue.pop_front();
+      lock.Unlock();
+      CompressBatch *batch = job->batch;
+      job->r = batch->compressor->compress(job->in, job->out);
+      batch->lock.Lock();
+      if (--batch->pending == 0) {
+        batch->cond.Signal();
+      }
+      batch->lock.Unlock();
+      lock.Lock();
+    }
+  }
+
+public:
+  const uint64_t block_size;
+
+  RGWCompressThreads(CephContext *_cct, int num_threads)
+    : cct(_cct), lock("RGWCompressThreads"),
+      block_size(cct->_conf->rgw_compression_block_size) {
+    for (int i = 0; i < num_threads; i++) {
+      Worker *w = new Worker(this);
+      w->create("rgw_compress");
+      workers.push_back(w);
+    }
+    ldout(cct, 5) << "started " << num_threads << " compression threads" << dendl;
+  }
+
+  ~RGWCompressThreads() {
+    lock.Lock();
+    stopping = true;
+    cond.SignalAll();
+    lock.Unlock();
+    for (auto w : workers) {
+      w->join();
+      delete w;
+    }
+  }
+
+  /// compress all jobs of the batch and wait for them
+  void compress(CompressBatch& batch) {
+    batch.pending = batch.jobs.size();
+    lock.Lock();
+    for (auto& job : batch.jobs) {
+      queue.push_back(&job);
+    }
+    cond.SignalAll();
+    lock.Unlock();
+
+    Mutex::Locker l(batch.lock);
+    while (batch.pending > 0) {
+      batch.cond.Wait(batch.lock);
+    }
+  }
+};
+
+static RGWCompressThreads *compress_threads = NULL;
+
+void rgw_compression_init(CephContext *cct)
+{
+  int num_threads = cct->_conf->rgw_compression_threads;
+  if (num_threads > 0 && cct->_conf->rgw_compression_block_size > 0) {
+    compress_threads = new RGWCompressThreads(cct, num_threads);
+  }
+}
+
+void rgw_compression_finalize()
+{
+  delete compress_threads;
+  compress_threads = NULL;
+}
+
 //------------RGWPutObj_Compress---------------
 
+int RGWPutObj_Compress::compress(bufferlist& bl,
+                                 std::list<std::pair<off_t, bufferlist> >& parts)
+{
+  if (!compress_threads || bl.length() <= compress_threads->block_size) {
+    bufferlist out;
+    int r = compressor->compress(bl, out);
+    if (r < 0) {
+      return r;
+    }
+    parts.emplace_back(0, std::move(out));
+    return 0;
+  }
+
+  /* the blocks are compressed on their own and stored in order, each one
+   * becomes a compression_block of its own */
+  CompressBatch batch;
+  batch.compressor = compressor;
+  uint64_t block_size = compress_threads->block_size;
+  batch.jobs.resize((bl.length() + block_size - 1) / block_size);
+  off_t block_ofs = 0;
+  for (auto& job : batch.jobs) {
+    uint64_t len = std::min<uint64_t>(block_size, bl.length() - block_ofs);
+    job.batch = &batch;
+    job.in.substr_of(bl, block_ofs, len);
+    block_ofs += len;
+  }
+  compress_threads->compress(batch);
+
+  block_ofs = 0;
+  for (auto& job : batch.jobs) {
+    if (job.r < 0) {
+      return job.r;
+    }
+    parts.emplace_back(block_ofs, std::move(job.out));
+    block_ofs += job.in.length();
+  }
+  return 0;
+}
+
 int RGWPutObj_Compress::handle_data(bufferlist& bl, off_t ofs, void **phandle, rgw_obj *pobj, bool *again)
 {
   bufferlist in_bl;
@@ -19,7 +185,8 @@ int RGWPutObj_Compress::handle_data(bufferlist& bl, off_t ofs, void **phandle, r
     if ((ofs > 0 && compressed) ||                                // if previous part was compressed
         (ofs == 0)) {                                             // or it's the first part
       ldout(cct, 10) << "Compression for rgw is enabled, compress part " << bl.length() << dendl;
-      int cr = compressor->compress(bl, in_bl);
+      std::list<std::pair<off_t, bufferlist> > parts;
+      int cr = compress(bl, parts);
       if (cr < 0) {
         if (ofs > 0) {
           lderr(cct) << "Compression failed with exit code " << cr
@@ -32,13 +199,16 @@ int RGWPutObj_Compress::handle_data(bufferlist& bl, off_t ofs, void **phandle, r
         in_bl.claim(bl);
       } else {
         compressed = true;
-    
-        compression_block newbl;
-        int bs = blocks.size();
-        newbl.old_ofs = ofs;
-        newbl.new_ofs = bs > 0 ? blocks[bs-1].len + blocks[bs-1].new_ofs : 0;
-        newbl.len = in_bl.length();
-        blocks.push_back(newbl);
+
+        for (auto& part : parts) {
+          compression_block newbl;
+          int bs = blocks.size();
+          newbl.old_ofs = ofs + part.first;
+          newbl.new_ofs = bs > 0 ? blocks[bs-1].len + blocks[bs-1].new_ofs : 0;
+          newbl.len = part.second.length();
+          blocks.push_back(newbl);
+          in_bl.claim_append(part.second);
+        }
       }
     } else {
       compressed = false;
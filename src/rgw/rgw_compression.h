@@ -4,6 +4,8 @@
 #ifndef CEPH_RGW_COMPRESSION_H
 #define CEPH_RGW_COMPRESSION_H
 
+#include <list>
+#include <utility>
 #include <vector>
 
 #include "compressor/Compressor.h"
@@ -38,6 +40,9 @@ class RGWPutObj_Compress : public RGWPutObj_Filter
   bool compressed{false};
   CompressorRef compressor;
   std::vector<compression_block> blocks;
+
+  /// compress a chunk into parts, each with its offset in the chunk
+  int compress(bufferlist& bl, std::list<std::pair<off_t, bufferlist> >& parts);
 public:
   RGWPutObj_Compress(CephContext* cct_, CompressorRef compressor,
                      RGWPutObjDataProcessor* next)
@@ -50,4 +55,12 @@ public:
 
 }; /* RGWPutObj_Compress */
 
+/*
+ * Chunks of uploads larger than rgw_compression_block_size are split into
+ * blocks of that size, which rgw_compression_threads threads shared by all
+ * requests compress in parallel.
+ */
+void rgw_compression_init(CephContext *cct);
+void rgw_compression_finalize();
+
 #endif /* CEPH_RGW_COMPRESSION_H */
@@ -2,7 +2,9 @@
 #include "rgw_coroutine.h"
 #include "rgw_boost_asio_yield.h"
 #include "rgw_cr_rados.h"
+#include "rgw_data_sync.h"
 
+#include "common/perf_counters.h"
 #include "cls/lock/cls_lock_client.h"
 
 #define dout_context g_ceph_context
@@ -517,7 +519,8 @@ int RGWAsyncFetchRemoteObj::_send_request()
                        NULL, /* string *petag, */
                        NULL, /* struct rgw_err *err, */
                        NULL, /* void (*progress_cb)(off_t, void *), */
-                       NULL); /* void *progress_data*); */
+                       NULL, /* void *progress_data*); */
+                       &bytes_fetched);
 
   if (r < 0) {
     ldout(store->ctx(), 0) << "store->fetch_remote_obj() returned r=" << r << dendl;
@@ -525,6 +528,15 @@ int RGWAsyncFetchRemoteObj::_send_request()
   return r;
 }
 
+int RGWFetchRemoteObjCR::request_complete()
+{
+  int r = req->get_ret_status();
+  if (r >= 0 && counters) {
+    counters->inc(l_rgw_data_sync_fetch_bytes, req->get_bytes_fetched());
+  }
+  return r;
+}
+
 int RGWAsyncStatRemoteObj::_send_request()
 {
   RGWObjectCtx obj_ctx(store);
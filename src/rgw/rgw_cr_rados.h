@@ -736,9 +736,13 @@ class RGWAsyncFetchRemoteObj : public RGWAsyncRadosRequest {
 
   bool copy_if_newer;
 
+  uint64_t bytes_fetched{0};
+
 protected:
   int _send_request();
 public:
+  uint64_t get_bytes_fetched() const { return bytes_fetched; }
+
   RGWAsyncFetchRemoteObj(RGWCoroutine *caller, RGWAioCompletionNotifier *cn, RGWRados *_store,
                          const string& _source_zone,
                          RGWBucketInfo& _bucket_info,
@@ -767,6 +771,8 @@ class RGWFetchRemoteObjCR : public RGWSimpleCoroutine {
 
   bool copy_if_newer;
 
+  PerfCounters *counters;
+
   RGWAsyncFetchRemoteObj *req;
 
 public:
@@ -775,13 +781,14 @@ public:
                       RGWBucketInfo& _bucket_info,
                       const rgw_obj_key& _key,
                       uint64_t _versioned_epoch,
-                      bool _if_newer) : RGWSimpleCoroutine(_store->ctx()), cct(_store->ctx()),
+                      bool _if_newer,
+                      PerfCounters *_counters = nullptr) : RGWSimpleCoroutine(_store->ctx()), cct(_store->ctx()),
                                        async_rados(_async_rados), store(_store),
                                        source_zone(_source_zone),
                                        bucket_info(_bucket_info),
                                        key(_key),
                                        versioned_epoch(_versioned_epoch),
-                                       copy_if_newer(_if_newer), req(NULL) {}
+                                       copy_if_newer(_if_newer), counters(_counters), req(NULL) {}
 
 
   ~RGWFetchRemoteObjCR() {
@@ -802,9 +809,7 @@ public:
     return 0;
   }
 
-  int request_complete() {
-    return req->get_ret_status();
-  }
+  int request_complete();
 };
 
 class RGWAsyncStatRemoteObj : public RGWAsyncRadosRequest {
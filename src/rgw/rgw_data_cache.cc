@@ -0,0 +1,208 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "common/errno.h"
+#include "include/compat.h"
+#include "include/stringify.h"
+
+#include "rgw_data_cache.h"
+#include "rgw_rados.h"
+
+#define dout_subsys ceph_subsys_rgw
+
+using namespace std;
+
+static const string file_prefix = "obj.";
+
+RGWDataCache::RGWDataCache(CephContext *_cct)
+  : cct(_cct),
+    path(cct->_conf->rgw_datacache_path),
+    max_size(cct->_conf->rgw_datacache_size),
+    max_obj_size(cct->_conf->rgw_datacache_max_obj_size),
+    admit_hits(cct->_conf->rgw_datacache_admit_hits),
+    lock("RGWDataCache"),
+    size(0), next_file(0),
+    candidates(cct->_conf->rgw_datacache_admit_candidates)
+{
+}
+
+int RGWDataCache::init()
+{
+  int r = ::mkdir(path.c_str(), 0700);
+  if (r < 0 && errno != EEXIST) {
+    r = -errno;
+    lderr(cct) << "ERROR: failed to create data cache directory " << path
+               << ": " << cpp_strerror(r) << dendl;
+    return r;
+  }
+
+  /* whatever an earlier run left behind isn't indexed */
+  DIR *dir = ::opendir(path.c_str());
+  if (!dir) {
+    r = -errno;
+    lderr(cct) << "ERROR: failed to open data cache directory " << path
+               << ": " << cpp_strerror(r) << dendl;
+    return r;
+  }
+  struct dirent *de;
+  while ((de = ::readdir(dir)) != NULL) {
+    string name = de->d_name;
+    if (name.compare(0, file_prefix.size(), file_prefix) == 0) {
+      ::unlink((path + "/" + name).c_str());
+    }
+  }
+  ::closedir(dir);
+
+  ldout(cct, 1) << "data cache at " << path << " size=" << max_size << dendl;
+  return 0;
+}
+
+int RGWDataCache::read(const string& key, const string& version,
+                       off_t ofs, off_t end, RGWGetDataCB *cb)
+{
+  int fd;
+  {
+    Mutex::Locker l(lock);
+    auto iter = entries.find(key);
+    if (iter == entries.end() || iter->second.version != version) {
+      if (perfcounter) perfcounter->inc(l_rgw_datacache_miss);
+      return -ENOENT;
+    }
+    Entry& entry = iter->second;
+    /* the file may be evicted once it's open, but not before */
+    fd = ::open(entry.file.c_str(), O_RDONLY);
+    if (fd < 0) {
+      int r = -errno;
+      ldout(cct, 0) << "ERROR: failed to open " << entry.file << ": "
+                    << cpp_strerror(r) << dendl;
+      remove_entry(iter);
+      return -ENOENT;
+    }
+    lru.splice(lru.end(), lru, entry.lru_iter);
+  }
+  if (perfcounter) perfcounter->inc(l_rgw_datacache_hit);
+
+  ldout(cct, 20) << "data cache read: key=" << key << " ofs=" << ofs
+                 << " end=" << end << dendl;
+
+  off_t chunk_size = cct->_conf->rgw_get_obj_max_req_size;
+  int r = 0;
+  while (ofs <= end) {
+    off_t len = min(end - ofs + 1, chunk_size);
+    bufferptr bp(len);
+    ssize_t n = ::pread(fd, bp.c_str(), len, ofs);
+    if (n != len) {
+      r = (n < 0 ? -errno : -EIO);
+      ldout(cct, 0) << "ERROR: data cache read of " << key << " failed: "
+                    << cpp_strerror(r) << dendl;
+      break;
+    }
+    bufferlist bl;
+    bl.append(std::move(bp));
+    r = cb->handle_data(bl, 0, len);
+    if (r < 0) {
+      break;
+    }
+    ofs += len;
+  }
+  VOID_TEMP_FAILURE_RETRY(::close(fd));
+
+  if (r == -EIO) {
+    remove(key);
+  }
+  return r;
+}
+
+bool RGWDataCache::admit(const string& key, uint64_t obj_size)
+{
+  if (obj_size > max_obj_size || obj_size > max_size) {
+    return false;
+  }
+
+  int hits = 0;
+  candidates.find(key, hits);
+  if (++hits >= admit_hits) {
+    candidates.erase(key);
+    return true;
+  }
+  candidates.add(key, hits);
+  return false;
+}
+
+void RGWDataCache::put(const string& key, const string& version, bufferlist& bl)
+{
+  string file;
+  {
+    Mutex::Locker l(lock);
+    auto iter = entries.find(key);
+    if (iter != entries.end() && iter->second.version == version) {
+      return;
+    }
+    file = path + "/" + file_prefix + stringify(next_file++);
+  }
+
+  /* written before it's indexed, so no one reads it half written */
+  int r = bl.write_file(file.c_str(), 0600);
+  if (r < 0) {
+    ldout(cct, 0) << "ERROR: failed to write " << file << ": "
+                  << cpp_strerror(r) << dendl;
+    ::unlink(file.c_str());
+    return;
+  }
+
+  Mutex::Locker l(lock);
+  auto iter = entries.find(key);
+  if (iter != entries.end()) {
+    remove_entry(iter);
+  }
+  trim(bl.length());
+
+  lru.push_back(key);
+  Entry& entry = entries[key];
+  entry.version = version;
+  entry.file = file;
+  entry.size = bl.length();
+  entry.lru_iter = --lru.end();
+  size += entry.size;
+
+  ldout(cct, 10) << "data cache put: key=" << key << " size=" << entry.size
+                 << " total=" << size << dendl;
+}
+
+void RGWDataCache::remove(const string& key)
+{
+  Mutex::Locker l(lock);
+  auto iter = entries.find(key);
+  if (iter != entries.end()) {
+    ldout(cct, 10) << "data cache remove: key=" << key << dendl;
+    remove_entry(iter);
+  }
+}
+
+void RGWDataCache::remove_entry(map<string, Entry>::iterator iter)
+{
+  assert(lock.is_locked());
+  Entry& entry = iter->second;
+  ::unlink(entry.file.c_str());
+  size -= entry.size;
+  lru.erase(entry.lru_iter);
+  entries.erase(iter);
+}
+
+void RGWDataCache::trim(uint64_t needed)
+{
+  assert(lock.is_locked());
+  while (size + needed > max_size && !lru.empty()) {
+    auto iter = entries.find(lru.front());
+    assert(iter != entries.end());
+    ldout(cct, 20) << "data cache evict: key=" << iter->first << dendl;
+    remove_entry(iter);
+    if (perfcounter) perfcounter->inc(l_rgw_datacache_evict);
+  }
+}
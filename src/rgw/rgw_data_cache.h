@@ -0,0 +1,75 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_RGW_DATA_CACHE_H
+#define CEPH_RGW_DATA_CACHE_H
+
+#include <list>
+#include <map>
+#include <string>
+
+#include "include/types.h"
+#include "common/Mutex.h"
+#include "common/lru_map.h"
+
+class CephContext;
+class RGWGetDataCB;
+
+/*
+ * A cache of whole object data in files under rgw_datacache_path, meant for
+ * a local SSD.
+ *
+ * Entries are keyed by the head object and hold the object tag they were
+ * read with; the tag changes whenever the object is written, so a lookup
+ * made with the tag of the current head never returns stale data.
+ * Objects are admitted once they were requested rgw_datacache_admit_hits
+ * times and are no larger than rgw_datacache_max_obj_size; the least
+ * recently used ones are evicted to stay within rgw_datacache_size.
+ * The index lives in memory only, so the directory is emptied on startup.
+ */
+class RGWDataCache {
+  CephContext *cct;
+  std::string path;
+  uint64_t max_size;
+  uint64_t max_obj_size;
+  int admit_hits;
+
+  struct Entry {
+    std::string version;
+    std::string file;
+    uint64_t size;
+    std::list<std::string>::iterator lru_iter;
+  };
+
+  Mutex lock;
+  std::map<std::string, Entry> entries;
+  std::list<std::string> lru;
+  uint64_t size;
+  uint64_t next_file;
+
+  lru_map<std::string, int> candidates; ///< requests of objects not cached
+
+  void remove_entry(std::map<std::string, Entry>::iterator iter);
+  void trim(uint64_t needed);
+
+public:
+  explicit RGWDataCache(CephContext *_cct);
+
+  int init();
+
+  /**
+   * Send bytes [ofs, end] of the cached object to cb.
+   *
+   * @returns -ENOENT if the object is not cached with this version
+   */
+  int read(const std::string& key, const std::string& version,
+           off_t ofs, off_t end, RGWGetDataCB *cb);
+
+  /// whether an object that missed should be cached once read
+  bool admit(const std::string& key, uint64_t obj_size);
+
+  void put(const std::string& key, const std::string& version, bufferlist& bl);
+  void remove(const std::string& key);
+};
+
+#endif
@@ -6,6 +6,7 @@
 #include "common/WorkQueue.h"
 #include "common/Throttle.h"
 #include "common/errno.h"
+#include "common/perf_counters.h"
 
 #include "rgw_common.h"
 #include "rgw_rados.h"
@@ -595,6 +596,7 @@ int RGWRemoteDataLog::read_source_log_shards_next(map<int, string> shard_markers
 int RGWRemoteDataLog::init(const string& _source_zone, RGWRESTConn *_conn, RGWSyncErrorLogger *_error_logger, RGWSyncModuleInstanceRef& _sync_module)
 {
   sync_env.init(store->ctx(), store, _conn, async_rados, &http_manager, _error_logger, _source_zone, _sync_module);
+  sync_env.counters = counters;
 
   if (initialized) {
     return 0;
@@ -606,11 +608,35 @@ int RGWRemoteDataLog::init(const string& _source_zone, RGWRESTConn *_conn, RGWSy
     return ret;
   }
 
+  string zone_name = _source_zone;
+  auto zone_iter = store->zone_by_id.find(_source_zone);
+  if (zone_iter != store->zone_by_id.end()) {
+    zone_name = zone_iter->second.name;
+  }
+  PerfCountersBuilder plb(store->ctx(), "data-sync-from-" + zone_name,
+                          l_rgw_data_sync_first, l_rgw_data_sync_last);
+  plb.add_u64_counter(l_rgw_data_sync_fetch_objs, "fetch_objs", "Objects fetched");
+  plb.add_u64_counter(l_rgw_data_sync_fetch_bytes, "fetch_bytes", "Bytes fetched");
+  plb.add_u64_counter(l_rgw_data_sync_fetch_errs, "fetch_errs", "Object fetches that failed");
+  plb.add_time_avg(l_rgw_data_sync_fetch_lat, "fetch_lat", "Object fetch latency");
+  plb.add_u64(l_rgw_data_sync_lag, "sync_lag", "Age in seconds of the latest bucket index log entry picked up for sync");
+  counters = plb.create_perf_counters();
+  store->ctx()->get_perfcounters_collection()->add(counters);
+  sync_env.counters = counters;
+
   initialized = true;
 
   return 0;
 }
 
+RGWRemoteDataLog::~RGWRemoteDataLog()
+{
+  if (counters) {
+    store->ctx()->get_perfcounters_collection()->remove(counters);
+    delete counters;
+  }
+}
+
 void RGWRemoteDataLog::finish()
 {
   stop();
@@ -995,7 +1021,6 @@ public:
   }
 };
 
-#define BUCKET_SHARD_SYNC_SPAWN_WINDOW 20
 #define DATA_SYNC_MAX_ERR_ENTRIES 10
 
 class RGWDataSyncShardCR : public RGWCoroutine {
@@ -1058,6 +1083,10 @@ class RGWDataSyncShardCR : public RGWCoroutine {
 #define RETRY_BACKOFF_SECS_MAX 600
   uint32_t retry_backoff_secs;
 
+  /* an idle shard polls less and less often, it still hears of changes
+   * through the notifications the source zone sends */
+  int poll_interval;
+
   RGWDataSyncDebugLogger logger;
 public:
   RGWDataSyncShardCR(RGWDataSyncEnv *_sync_env,
@@ -1068,9 +1097,10 @@ public:
 						      shard_id(_shard_id),
 						      sync_marker(_marker),
                                                       marker_tracker(NULL), truncated(false), inc_lock("RGWDataSyncShardCR::inc_lock"),
-                                                      total_entries(0), spawn_window(BUCKET_SHARD_SYNC_SPAWN_WINDOW), reset_backoff(NULL),
+                                                      total_entries(0), spawn_window(std::max(_sync_env->cct->_conf->rgw_data_sync_spawn_window, 1)), reset_backoff(NULL),
                                                       lease_cr(nullptr), lease_stack(nullptr), error_repo(nullptr), max_error_entries(DATA_SYNC_MAX_ERR_ENTRIES),
-                                                      retry_backoff_secs(RETRY_BACKOFF_SECS_DEFAULT) {
+                                                      retry_backoff_secs(RETRY_BACKOFF_SECS_DEFAULT),
+                                                      poll_interval(_sync_env->cct->_conf->rgw_data_sync_poll_interval) {
     set_description() << "data sync shard source_zone=" << sync_env->source_zone << " shard_id=" << shard_id;
     status_oid = RGWDataSyncStatusManager::shard_obj_name(sync_env->source_zone, shard_id);
     error_oid = status_oid + ".retry";
@@ -1229,6 +1259,10 @@ public:
         current_modified.swap(modified_shards);
         inc_lock.Unlock();
 
+        if (!current_modified.empty()) {
+          poll_interval = cct->_conf->rgw_data_sync_poll_interval;
+        }
+
         /* process out of band updates */
         for (modified_iter = current_modified.begin(); modified_iter != current_modified.end(); ++modified_iter) {
           yield {
@@ -1272,6 +1306,7 @@ public:
 #define INCREMENTAL_MAX_ENTRIES 100
 	ldout(sync_env->cct, 20) << __func__ << ":" << __LINE__ << ": shard_id=" << shard_id << " datalog_marker=" << datalog_marker << " sync_marker.marker=" << sync_marker.marker << dendl;
 	if (datalog_marker > sync_marker.marker) {
+          poll_interval = cct->_conf->rgw_data_sync_poll_interval;
           spawned_keys.clear();
           yield call(new RGWReadRemoteDataLogShardCR(sync_env, shard_id, &sync_marker.marker, &log_entries, &truncated));
           if (retcode < 0) {
@@ -1319,8 +1354,10 @@ public:
 	}
 	ldout(sync_env->cct, 20) << __func__ << ":" << __LINE__ << ": shard_id=" << shard_id << " datalog_marker=" << datalog_marker << " sync_marker.marker=" << sync_marker.marker << dendl;
 	if (datalog_marker == sync_marker.marker) {
-#define INCREMENTAL_INTERVAL 20
-	  yield wait(utime_t(INCREMENTAL_INTERVAL, 0));
+	  yield wait(utime_t(poll_interval, 0));
+          poll_interval = std::min(poll_interval * 2,
+                                   std::max(cct->_conf->rgw_data_sync_poll_max_interval,
+                                            cct->_conf->rgw_data_sync_poll_interval));
 	}
       } while (true);
     }
@@ -1525,7 +1562,7 @@ RGWCoroutine *RGWDefaultDataSyncModule::sync_object(RGWDataSyncEnv *sync_env, RG
 {
   return new RGWFetchRemoteObjCR(sync_env->async_rados, sync_env->store, sync_env->source_zone, bucket_info,
                                  key, versioned_epoch,
-                                 true);
+                                 true, sync_env->counters);
 }
 
 RGWCoroutine *RGWDefaultDataSyncModule::remove_object(RGWDataSyncEnv *sync_env, RGWBucketInfo& bucket_info, rgw_obj_key& key,
@@ -2154,6 +2191,8 @@ class RGWBucketSyncSingleEntryCR : public RGWCoroutine {
 
   RGWDataSyncModule *data_sync_module;
 
+  utime_t fetch_start;
+
 public:
   RGWBucketSyncSingleEntryCR(RGWDataSyncEnv *_sync_env,
                              RGWBucketInfo *_bucket_info,
@@ -2215,6 +2254,7 @@ public:
             set_status("syncing obj");
             ldout(sync_env->cct, 5) << "bucket sync: sync obj: " << sync_env->source_zone << "/" << bucket_info->bucket << "/" << key << "[" << versioned_epoch << "]" << dendl;
             logger.log("fetch");
+            fetch_start = ceph_clock_now();
             call(data_sync_module->sync_object(sync_env, *bucket_info, key, versioned_epoch));
           } else if (op == CLS_RGW_OP_DEL || op == CLS_RGW_OP_UNLINK_INSTANCE) {
             set_status("removing obj");
@@ -2231,6 +2271,14 @@ public:
           }
         }
       } while (marker_tracker->need_retry(key));
+      if (sync_env->counters && fetch_start != utime_t()) {
+        if (retcode >= 0) {
+          sync_env->counters->inc(l_rgw_data_sync_fetch_objs);
+          sync_env->counters->tinc(l_rgw_data_sync_fetch_lat, ceph_clock_now() - fetch_start);
+        } else if (retcode != -ENOENT) {
+          sync_env->counters->inc(l_rgw_data_sync_fetch_errs);
+        }
+      }
       {
         stringstream ss;
         if (retcode >= 0) {
@@ -2267,7 +2315,34 @@ done:
   }
 };
 
-#define BUCKET_SYNC_SPAWN_WINDOW 20
+/*
+ * The number of object syncs a bucket shard keeps in flight.  It starts at
+ * rgw_bucket_sync_spawn_window, is halved whenever a sync fails -- most
+ * often because the source zone is overloaded -- and grows back by one for
+ * every window's worth of syncs that succeed.
+ */
+class RGWBucketSyncSpawnWindow {
+  int max_window;
+  int window;
+  int successes{0};
+
+public:
+  explicit RGWBucketSyncSpawnWindow(CephContext *cct)
+    : max_window(std::max(cct->_conf->rgw_bucket_sync_spawn_window, 1)),
+      window(max_window) {}
+
+  size_t get() const { return window; }
+
+  void complete(int r) {
+    if (r < 0) {
+      window = std::max(window / 2, 1);
+      successes = 0;
+    } else if (window < max_window && ++successes >= window) {
+      window++;
+      successes = 0;
+    }
+  }
+};
 
 class RGWBucketShardFullSyncCR : public RGWCoroutine {
   RGWDataSyncEnv *sync_env;
@@ -2282,6 +2357,14 @@ class RGWBucketShardFullSyncCR : public RGWCoroutine {
   bucket_list_entry *entry{nullptr};
   RGWModifyOp op{CLS_RGW_OP_ADD};
 
+  /* the next page is listed while the objects of the current one sync */
+  bucket_list_result next_result;
+  rgw_obj_key next_marker;
+  RGWCoroutinesStack *list_stack{nullptr};
+  int list_retcode{0};
+
+  RGWBucketSyncSpawnWindow window;
+
   int total_entries{0};
 
   int sync_status{0};
@@ -2289,6 +2372,8 @@ class RGWBucketShardFullSyncCR : public RGWCoroutine {
   const string& status_oid;
 
   RGWDataSyncDebugLogger logger;
+
+  void collect_children();
 public:
   RGWBucketShardFullSyncCR(RGWDataSyncEnv *_sync_env, const rgw_bucket_shard& bs,
                            RGWBucketInfo *_bucket_info,
@@ -2298,33 +2383,59 @@ public:
     : RGWCoroutine(_sync_env->cct), sync_env(_sync_env), bs(bs),
       bucket_info(_bucket_info), lease_cr(lease_cr), full_marker(_full_marker),
       marker_tracker(sync_env, status_oid, full_marker),
-      status_oid(status_oid) {
+      window(_sync_env->cct), status_oid(status_oid) {
     logger.init(sync_env, "BucketFull", bs.get_key());
   }
 
   int operate() override;
 };
 
-int RGWBucketShardFullSyncCR::operate()
+void RGWBucketShardFullSyncCR::collect_children()
 {
   int ret;
+  RGWCoroutinesStack *child;
+  while (collect_next(&ret, &child)) {
+    if (child == list_stack) {
+      list_retcode = ret;
+      list_stack = nullptr;
+      continue;
+    }
+    window.complete(ret);
+    if (ret < 0) {
+      ldout(sync_env->cct, 0) << "ERROR: a sync operation returned error" << dendl;
+      sync_status = ret;
+      /* we have reported this error */
+    }
+  }
+}
+
+int RGWBucketShardFullSyncCR::operate()
+{
   reenter(this) {
     list_marker = full_marker.position;
 
     total_entries = full_marker.count;
+    set_status("listing remote bucket");
+    ldout(sync_env->cct, 20) << __func__ << "(): listing bucket for full sync" << dendl;
+    yield call(new RGWListBucketShardCR(sync_env, bs, list_marker,
+                                        &list_result));
+    if (retcode < 0 && retcode != -ENOENT) {
+      set_status("failed bucket listing, going down");
+      return set_cr_error(retcode);
+    }
     do {
       if (!lease_cr->is_locked()) {
         drain_all();
         return set_cr_error(-ECANCELED);
       }
-      set_status("listing remote bucket");
-      ldout(sync_env->cct, 20) << __func__ << "(): listing bucket for full sync" << dendl;
-      yield call(new RGWListBucketShardCR(sync_env, bs, list_marker,
-                                          &list_result));
-      if (retcode < 0 && retcode != -ENOENT) {
-        set_status("failed bucket listing, going down");
-        drain_all();
-        return set_cr_error(retcode);
+      if (list_result.is_truncated && !list_result.entries.empty()) {
+        next_result = bucket_list_result();
+        next_marker = list_result.entries.back().key;
+        ldout(sync_env->cct, 20) << __func__ << "(): listing bucket for full sync from "
+            << next_marker << dendl;
+        list_stack = spawn(new RGWListBucketShardCR(sync_env, bs, next_marker,
+                                                    &next_result),
+                           false);
       }
       entries_iter = list_result.entries.begin();
       for (; entries_iter != list_result.entries.end(); ++entries_iter) {
@@ -2350,33 +2461,34 @@ int RGWBucketShardFullSyncCR::operate()
                                  entry->key, &marker_tracker),
                       false);
         }
-        while (num_spawned() > BUCKET_SYNC_SPAWN_WINDOW) {
+        while (num_spawned() > window.get() + (list_stack ? 1 : 0)) {
+          set_status() << "num_spawned() > spawn_window";
           yield wait_for_child();
-          bool again = true;
-          while (again) {
-            again = collect(&ret, nullptr);
-            if (ret < 0) {
-              ldout(sync_env->cct, 0) << "ERROR: a sync operation returned error" << dendl;
-              sync_status = ret;
-              /* we have reported this error */
-            }
-          }
+          collect_children();
         }
       }
-    } while (list_result.is_truncated && sync_status == 0);
+      if (list_result.is_truncated) {
+        /* wait for the next page */
+        collect_children();
+        while (list_stack) {
+          yield wait_for_child();
+          collect_children();
+        }
+        if (list_retcode < 0 && list_retcode != -ENOENT) {
+          set_status("failed bucket listing, going down");
+          drain_all();
+          return set_cr_error(list_retcode);
+        }
+        std::swap(list_result, next_result);
+      } else {
+        list_result.entries.clear();
+      }
+    } while (!list_result.entries.empty() && sync_status == 0);
     set_status("done iterating over all objects");
     /* wait for all operations to complete */
     while (num_spawned()) {
       yield wait_for_child();
-      bool again = true;
-      while (again) {
-        again = collect(&ret, nullptr);
-        if (ret < 0) {
-          ldout(sync_env->cct, 0) << "ERROR: a sync operation returned error" << dendl;
-          sync_status = ret;
-          /* we have reported this error */
-        }
-      }
+      collect_children();
     }
     if (!lease_cr->is_locked()) {
       return set_cr_error(-ECANCELED);
@@ -2432,8 +2544,11 @@ class RGWBucketShardIncrementalSyncCR : public RGWCoroutine {
 
   RGWDataSyncDebugLogger logger;
 
+  RGWBucketSyncSpawnWindow window;
+
   int sync_status{0};
 
+  void collect_children();
 public:
   RGWBucketShardIncrementalSyncCR(RGWDataSyncEnv *_sync_env,
                                   const rgw_bucket_shard& bs,
@@ -2443,7 +2558,8 @@ public:
                                   rgw_bucket_shard_inc_sync_marker& _inc_marker)
     : RGWCoroutine(_sync_env->cct), sync_env(_sync_env), bs(bs),
       bucket_info(_bucket_info), lease_cr(lease_cr), inc_marker(_inc_marker),
-      marker_tracker(sync_env, status_oid, inc_marker), status_oid(status_oid) {
+      marker_tracker(sync_env, status_oid, inc_marker), status_oid(status_oid),
+      window(_sync_env->cct) {
     set_description() << "bucket shard incremental sync bucket="
         << bucket_shard_str{bs};
     set_status("init");
@@ -2453,9 +2569,21 @@ public:
   int operate() override;
 };
 
-int RGWBucketShardIncrementalSyncCR::operate()
+void RGWBucketShardIncrementalSyncCR::collect_children()
 {
   int ret;
+  while (collect_next(&ret)) {
+    window.complete(ret);
+    if (ret < 0) {
+      ldout(sync_env->cct, 0) << "ERROR: a sync operation returned error (ret=" << ret << ")" << dendl;
+      sync_status = ret;
+      /* we have reported this error */
+    }
+  }
+}
+
+int RGWBucketShardIncrementalSyncCR::operate()
+{
   reenter(this) {
     do {
       if (!lease_cr->is_locked()) {
@@ -2547,15 +2675,7 @@ int RGWBucketShardIncrementalSyncCR::operate()
           }
           ldout(sync_env->cct, 5) << *this << ": [inc sync] can't do op on key=" << key << " need to wait for conflicting operation to complete" << dendl;
           yield wait_for_child();
-          bool again = true;
-          while (again) {
-            again = collect(&ret, nullptr);
-            if (ret < 0) {
-              ldout(sync_env->cct, 0) << "ERROR: a child operation returned error (ret=" << ret << ")" << dendl;
-              sync_status = ret;
-              /* we have reported this error */
-            }
-          }
+          collect_children();
         }
         if (!marker_tracker.index_key_to_marker(key, cur_id)) {
           set_status() << "can't do op, sync already in progress for object";
@@ -2574,6 +2694,11 @@ int RGWBucketShardIncrementalSyncCR::operate()
               versioned_epoch = entry->ver.epoch;
             }
             ldout(sync_env->cct, 20) << __func__ << "(): entry->timestamp=" << entry->timestamp << dendl;
+            if (sync_env->counters) {
+              auto lag = ceph::real_clock::now() - entry->timestamp;
+              sync_env->counters->set(l_rgw_data_sync_lag,
+                                      std::max<int64_t>(std::chrono::duration_cast<std::chrono::seconds>(lag).count(), 0));
+            }
             using SyncCR = RGWBucketSyncSingleEntryCR<string, rgw_obj_key>;
             spawn(new SyncCR(sync_env, bucket_info, bs, key,
                              entry->is_versioned(), versioned_epoch,
@@ -2582,35 +2707,17 @@ int RGWBucketShardIncrementalSyncCR::operate()
                   false);
           }
         // }
-        while (num_spawned() > BUCKET_SYNC_SPAWN_WINDOW) {
+        while (num_spawned() > window.get()) {
           set_status() << "num_spawned() > spawn_window";
           yield wait_for_child();
-          bool again = true;
-          while (again) {
-            again = collect(&ret, nullptr);
-            if (ret < 0) {
-              ldout(sync_env->cct, 0) << "ERROR: a sync operation returned error" << dendl;
-              sync_status = ret;
-              /* we have reported this error */
-            }
-            /* not waiting for child here */
-          }
+          collect_children();
         }
       }
     } while (!list_result.empty() && sync_status == 0);
 
     while (num_spawned()) {
       yield wait_for_child();
-      bool again = true;
-      while (again) {
-        again = collect(&ret, nullptr);
-        if (ret < 0) {
-          ldout(sync_env->cct, 0) << "ERROR: a sync operation returned error" << dendl;
-          sync_status = ret;
-          /* we have reported this error */
-        }
-        /* not waiting for child here */
-      }
+      collect_children();
     }
 
     yield call(marker_tracker.flush());
@@ -2915,25 +3022,34 @@ void take_min_markers(IterIn first, IterIn last, IterOut dest)
   }
 }
 
-// wrapper to update last_trim_marker on success
-class LastTimelogTrimCR : public RGWRadosTimelogTrimCR {
-  CephContext *cct;
+// each trim op removes a limited number of entries and returns -ENODATA once
+// there's nothing left before the marker, so repeat it until then and only
+// update last_trim_marker once the whole range is gone
+class LastTimelogTrimCR : public RGWCoroutine {
+  RGWRados *store;
+  const std::string oid;
+  const std::string to_marker;
   std::string *last_trim_marker;
  public:
   LastTimelogTrimCR(RGWRados *store, const std::string& oid,
                     const std::string& to_marker, std::string *last_trim_marker)
-    : RGWRadosTimelogTrimCR(store, oid, real_time{}, real_time{},
-                            std::string{}, to_marker),
-      cct(store->ctx()), last_trim_marker(last_trim_marker)
+    : RGWCoroutine(store->ctx()), store(store), oid(oid),
+      to_marker(to_marker), last_trim_marker(last_trim_marker)
   {}
-  int request_complete() override {
-    int r = RGWRadosTimelogTrimCR::request_complete();
-    if (r < 0 && r != -ENODATA) {
-      ldout(cct, 1) << "failed to trim datalog: " << cpp_strerror(r) << dendl;
-      return r;
+  int operate() override {
+    reenter(this) {
+      do {
+        yield call(new RGWRadosTimelogTrimCR(store, oid, real_time{}, real_time{},
+                                             std::string{}, to_marker));
+      } while (retcode == 0);
+      if (retcode < 0 && retcode != -ENODATA) {
+        ldout(cct, 1) << "failed to trim datalog: " << cpp_strerror(retcode) << dendl;
+        return set_cr_error(retcode);
+      }
+      ldout(cct, 10) << "datalog trimmed to marker " << to_marker << dendl;
+      *last_trim_marker = to_marker;
+      return set_cr_done();
     }
-    ldout(cct, 10) << "datalog trimmed to marker " << to_marker << dendl;
-    *last_trim_marker = to_marker;
     return 0;
   }
 };
@@ -2946,6 +3062,8 @@ class DataLogTrimCR : public RGWCoroutine {
   std::vector<rgw_data_sync_status> peer_status; //< sync status for each peer
   std::vector<rgw_data_sync_marker> min_shard_markers; //< min marker per shard
   std::vector<std::string>& last_trim; //< last trimmed marker per shard
+  const int spawn_window; //< shards trimmed at a time
+  int shard{0};
   int ret{0};
 
  public:
@@ -2956,7 +3074,8 @@ class DataLogTrimCR : public RGWCoroutine {
       zone_id(store->get_zone().id),
       peer_status(store->zone_conn_map.size()),
       min_shard_markers(num_shards),
-      last_trim(last_trim)
+      last_trim(last_trim),
+      spawn_window(std::max(cct->_conf->rgw_data_log_trim_spawn_window, 1))
   {}
 
   int operate() override;
@@ -3001,26 +3120,31 @@ int DataLogTrimCR::operate()
 
     ldout(cct, 10) << "trimming log shards" << dendl;
     set_status("trimming log shards");
-    yield {
-      // determine the minimum marker for each shard
-      take_min_markers(peer_status.begin(), peer_status.end(),
-                       min_shard_markers.begin());
+    // determine the minimum marker for each shard
+    take_min_markers(peer_status.begin(), peer_status.end(),
+                     min_shard_markers.begin());
 
-      for (int i = 0; i < num_shards; i++) {
-        const auto& m = min_shard_markers[i];
+    for (shard = 0; shard < num_shards; shard++) {
+      {
+        const auto& m = min_shard_markers[shard];
         auto& stable = get_stable_marker(m);
-        if (stable <= last_trim[i]) {
+        if (stable <= last_trim[shard]) {
           continue;
         }
-        ldout(cct, 10) << "trimming log shard " << i
+        ldout(cct, 10) << "trimming log shard " << shard
             << " at marker=" << stable
-            << " last_trim=" << last_trim[i] << dendl;
+            << " last_trim=" << last_trim[shard] << dendl;
         using TrimCR = LastTimelogTrimCR;
-        spawn(new TrimCR(store, store->data_log->get_oid(i),
-                         stable, &last_trim[i]),
-              true);
+        spawn(new TrimCR(store, store->data_log->get_oid(shard),
+                         stable, &last_trim[shard]),
+              false);
+      }
+      while ((int)num_spawned() >= spawn_window) {
+        yield wait_for_child();
+        collect_next(&ret);
       }
     }
+    drain_all();
     return set_cr_done();
   }
   return 0;
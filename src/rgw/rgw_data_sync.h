@@ -10,6 +10,20 @@
 #include "common/RWLock.h"
 #include "common/ceph_json.h"
 
+class PerfCounters;
+
+/* data sync counters, kept for each source zone */
+enum {
+  l_rgw_data_sync_first = 15500,
+
+  l_rgw_data_sync_fetch_objs,
+  l_rgw_data_sync_fetch_bytes,
+  l_rgw_data_sync_fetch_errs,
+  l_rgw_data_sync_fetch_lat,
+  l_rgw_data_sync_lag,
+
+  l_rgw_data_sync_last,
+};
 
 struct rgw_datalog_info {
   uint32_t num_shards;
@@ -208,6 +222,7 @@ struct RGWDataSyncEnv {
   RGWSyncErrorLogger *error_logger;
   string source_zone;
   RGWSyncModuleInstanceRef sync_module;
+  PerfCounters *counters{nullptr};
 
   RGWDataSyncEnv() : cct(NULL), store(NULL), conn(NULL), async_rados(NULL), http_manager(NULL), error_logger(NULL), sync_module(NULL) {}
 
@@ -240,6 +255,7 @@ class RGWRemoteDataLog : public RGWCoroutinesManager {
   RGWDataSyncControlCR *data_sync_cr;
 
   bool initialized;
+  PerfCounters *counters;
 
 public:
   RGWRemoteDataLog(RGWRados *_store, RGWAsyncRadosProcessor *async_rados)
@@ -247,7 +263,8 @@ public:
       store(_store), async_rados(async_rados),
       http_manager(store->ctx(), completion_mgr),
       lock("RGWRemoteDataLog::lock"), data_sync_cr(NULL),
-      initialized(false) {}
+      initialized(false), counters(nullptr) {}
+  ~RGWRemoteDataLog() override;
   int init(const string& _source_zone, RGWRESTConn *_conn, RGWSyncErrorLogger *_error_logger, RGWSyncModuleInstanceRef& module);
   void finish();
 
@@ -48,6 +48,13 @@ namespace rgw {
 				       const char *path, uint32_t flags)
   {
     LookupFHResult fhr{nullptr, 0};
+    struct timespec now;
+    (void) clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+
+    fhr = lookup_cached(parent, path, now);
+    if (get<0>(fhr))
+      return fhr;
+
     std::string bucket_name{path};
     RGWStatBucketRequest req(cct, get_user(), bucket_name);
 
@@ -61,6 +68,7 @@ namespace rgw {
       if (get<0>(fhr)) {
 	RGWFileHandle* rgw_fh = get<0>(fhr);
 	rgw_fh->set_times(req.get_ctime());
+	rgw_fh->set_attrs_cached(now);
 	/* restore attributes */
 	auto ux_key = req.get_attr(RGW_ATTR_UNIX_KEY1);
 	auto ux_attrs = req.get_attr(RGW_ATTR_UNIX1);
@@ -81,6 +89,43 @@ namespace rgw {
     using std::get;
 
     LookupFHResult fhr{nullptr, 0};
+    struct timespec now;
+    (void) clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+
+    fhr = lookup_cached(parent, path, now);
+    if (get<0>(fhr))
+      return fhr;
+
+    /* entries of a recent listing of parent need no round trip; the
+     * listing has no Unix attributes, so new handles get the defaults */
+    RGWFileHandle::dirent de;
+    if (parent->find_dirent(path, now, de)) {
+      bool is_dir = (de.type == RGW_FS_TYPE_DIRECTORY);
+      fhr = lookup_fh(parent, path,
+		      RGWFileHandle::FLAG_CREATE|
+		      (is_dir ?
+		       RGWFileHandle::FLAG_DIRECTORY :
+		       RGWFileHandle::FLAG_NONE));
+      RGWFileHandle* rgw_fh = get<0>(fhr);
+      if (rgw_fh && (rgw_fh->is_dir() == is_dir)) {
+	/* don't clobber the state of a file being written */
+	if (! (rgw_fh->is_open() || rgw_fh->creating())) {
+	  if (is_dir) {
+	    rgw_fh->set_mtime(parent->get_mtime());
+	  } else {
+	    rgw_fh->set_size(de.size);
+	    rgw_fh->set_times(de.mtime);
+	  }
+	  rgw_fh->set_attrs_cached(now);
+	}
+	return fhr;
+      }
+      /* the name changed type since it was listed */
+      if (rgw_fh) {
+	unref(rgw_fh);
+	fhr = LookupFHResult{nullptr, 0};
+      }
+    }
 
     /* XXX the need for two round-trip operations to identify file or
      * directory leaf objects is unecessary--the current proposed
@@ -109,6 +154,7 @@ namespace rgw {
 	    RGWFileHandle* rgw_fh = get<0>(fhr);
 	    rgw_fh->set_size(req.get_size());
 	    rgw_fh->set_times(req.get_mtime());
+	    rgw_fh->set_attrs_cached(now);
 	    /* restore attributes */
 	    auto ux_key = req.get_attr(RGW_ATTR_UNIX_KEY1);
 	    auto ux_attrs = req.get_attr(RGW_ATTR_UNIX1);
@@ -135,6 +181,7 @@ namespace rgw {
 	    RGWFileHandle* rgw_fh = get<0>(fhr);
 	    rgw_fh->set_size(req.get_size());
 	    rgw_fh->set_times(req.get_mtime());
+	    rgw_fh->set_attrs_cached(now);
 	    /* restore attributes */
 	    auto ux_key = req.get_attr(RGW_ATTR_UNIX_KEY1);
 	    auto ux_attrs = req.get_attr(RGW_ATTR_UNIX1);
@@ -269,6 +316,7 @@ namespace rgw {
     rgw_fh->flags |= RGWFileHandle::FLAG_DELETED;
     fh_cache.remove(rgw_fh->fh.fh_hk.object, rgw_fh,
 		    RGWFileHandle::FHCache::FLAG_LOCK);
+    parent->invalidate_dirents();
 
 #if 1 /* XXX verify clear cache */
     fh_key fhk(rgw_fh->fh.fh_hk);
@@ -360,6 +408,7 @@ namespace rgw {
 	  << dendl;
 	/* update dst change id */
 	dst_fh->set_times(t);
+	dst_fh->invalidate_dirents();
       }
       break;
       case 1:
@@ -501,6 +550,7 @@ namespace rgw {
 	rc = rc2;
     } else {
       rgw_fh->mtx.unlock(); /* !LOCKED */
+      parent->invalidate_dirents();
     }
 
     get<1>(mkr) = rc;
@@ -544,6 +594,7 @@ namespace rgw {
 
     if ((rc == 0) &&
 	(rc2 == 0)) {
+      parent->invalidate_dirents();
       /* XXX atomicity */
       LookupFHResult fhr = lookup_fh(parent, name, RGWFileHandle::FLAG_CREATE);
       RGWFileHandle* rgw_fh = get<0>(fhr);
@@ -708,7 +759,7 @@ namespace rgw {
 	  (events.size() < 500) ? max_ev : (events.size() / 4);
 	for (uint32_t ix = 0; (ix < _max_ev) && (events.size() > 0); ++ix) {
 	  event& ev = events.front();
-	  if (ev.ts.tv_sec > (now.tv_sec + expire_s)) {
+	  if ((ev.ts.tv_sec + expire_s) > now.tv_sec) {
 	    stop = true;
 	    break;
 	  }
@@ -849,10 +900,16 @@ namespace rgw {
 	fs->state.push_event(ev);
       }
     } else {
-      rgw_obj_key marker{"", ""};
+      if (replay_dirents(rcb, cb_arg, offset, now, eof)) {
+	lock_guard guard(mtx);
+	state.atime = now;
+	return 0;
+      }
+      uint64_t start_off = *offset;
       RGWReaddirRequest req(cct, fs->get_user(), this, rcb, cb_arg, offset);
       rc = rgwlib.get_fe()->execute_req(&req);
       if (! rc) {
+	cache_dirents(start_off, now, req.ents, req.listed_all());
 	lock_guard guard(mtx);
 	state.atime = now;
 	set_nlink(2 + 1);
@@ -864,6 +921,123 @@ namespace rgw {
     return rc;
   } /* RGWFileHandle::readdir */
 
+  void RGWFileHandle::set_attrs_cached(const struct timespec& now)
+  {
+    attr_expire = now;
+    attr_expire.tv_sec += fs->get_context()->_conf->rgw_nfs_attr_cache_secs;
+  }
+
+  bool RGWFileHandle::attrs_cached(const struct timespec& now)
+  {
+    lock_guard guard(mtx);
+    return (attr_expire.tv_sec > now.tv_sec) && !(creating() || deleted());
+  }
+
+  void RGWFileHandle::cache_dirents(uint64_t off, const struct timespec& now,
+				    std::vector<std::pair<std::string,
+							  dirent>>& ents,
+				    bool eof)
+  {
+    CephContext* cct = fs->get_context();
+    if ((cct->_conf->rgw_nfs_attr_cache_secs <= 0) ||
+	(cct->_conf->rgw_nfs_dirent_cache_size <= 0))
+      return;
+
+    lock_guard guard(mtx);
+    directory* d = get<directory>(&variant_type);
+    if (! d)
+      return;
+    if (! (d->flags & directory::FLAG_CACHED) ||
+	(d->expire.tv_sec <= now.tv_sec)) {
+      d->dirents.clear();
+      d->pages.clear();
+      d->flags = (d->flags & ~directory::FLAG_OVERFLOW) |
+	directory::FLAG_CACHED;
+      d->expire = now;
+      d->expire.tv_sec += cct->_conf->rgw_nfs_attr_cache_secs;
+    }
+    if ((d->flags & directory::FLAG_OVERFLOW) ||
+	(d->dirents.size() + ents.size() >
+	 size_t(cct->_conf->rgw_nfs_dirent_cache_size))) {
+      /* stop growing, but keep what was cached */
+      d->flags |= directory::FLAG_OVERFLOW;
+      return;
+    }
+    directory::page& pg = d->pages[off];
+    pg.names.clear();
+    pg.names.reserve(ents.size());
+    for (auto& ent : ents) {
+      pg.names.push_back(ent.first);
+      d->dirents[ent.first] = ent.second;
+    }
+    pg.eof = eof;
+  }
+
+  bool RGWFileHandle::find_dirent(const std::string& name,
+				  const struct timespec& now,
+				  dirent& de)
+  {
+    lock_guard guard(mtx);
+    directory* d = get<directory>(&variant_type);
+    if (! d ||
+	! (d->flags & directory::FLAG_CACHED) ||
+	(d->expire.tv_sec <= now.tv_sec))
+      return false;
+    const auto& iter = d->dirents.find(name);
+    if (iter == d->dirents.end())
+      return false;
+    de = iter->second;
+    return true;
+  }
+
+  bool RGWFileHandle::replay_dirents(rgw_readdir_cb rcb, void *cb_arg,
+				     uint64_t *offset,
+				     const struct timespec& now, bool *eof)
+  {
+    directory::page pg;
+    {
+      lock_guard guard(mtx);
+      directory* d = get<directory>(&variant_type);
+      if (! d ||
+	  ! (d->flags & directory::FLAG_CACHED) ||
+	  (d->expire.tv_sec <= now.tv_sec))
+	return false;
+      const auto& iter = d->pages.find(*offset);
+      if (iter == d->pages.end())
+	return false;
+      pg = iter->second;
+    }
+
+    lsubdout(fs->get_context(), rgw, 15)
+      << __func__ << " " << object_name() << " offset=" << *offset
+      << " entries=" << pg.names.size()
+      << dendl;
+
+    /* the markers for these offsets were recorded when they were listed */
+    bool stopped = false;
+    for (const auto& name : pg.names) {
+      uint64_t off = XXH64(name.data(), name.length(), fh_key::seed);
+      *offset = off;
+      if (! rcb(name.c_str(), cb_arg, off)) {
+	stopped = true;
+	break;
+      }
+    }
+    *eof = pg.eof && !stopped;
+    return true;
+  }
+
+  void RGWFileHandle::invalidate_dirents()
+  {
+    lock_guard guard(mtx);
+    directory* d = get<directory>(&variant_type);
+    if (d) {
+      d->flags &= ~directory::FLAG_CACHED;
+      d->dirents.clear();
+      d->pages.clear();
+    }
+  }
+
   int RGWFileHandle::write(uint64_t off, size_t len, size_t *bytes_written,
 			   void *buffer)
   {
@@ -992,6 +1166,8 @@ namespace rgw {
       }
       delete f->write_req;
       f->write_req = nullptr;
+      /* size and mtime changed */
+      parent->invalidate_dirents();
     }
 
     return rc;
@@ -1015,6 +1191,9 @@ namespace rgw {
   void RGWFileHandle::directory::clear_state()
   {
     marker_cache.clear();
+    dirents.clear();
+    pages.clear();
+    flags &= ~FLAG_CACHED;
   }
 
   void RGWFileHandle::invalidate() {
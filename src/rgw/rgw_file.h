@@ -195,7 +195,21 @@ namespace rgw {
       uint32_t flags;
       marker_cache_t marker_cache;
 
-      directory() : flags(FLAG_NONE) {}
+      /* listing cache, see RGWFileHandle::readdir() */
+      struct dirent {
+	uint8_t type;
+	uint64_t size;
+	real_time mtime;
+      };
+      struct page {
+	std::vector<std::string> names; /* in listing order */
+	bool eof;
+      };
+      std::map<std::string, dirent> dirents;
+      flat_map<uint64_t, page> pages; /* by the offset they were read at */
+      struct timespec expire;
+
+      directory() : flags(FLAG_NONE), expire{0,0} {}
 
       void clear_state();
     };
@@ -205,9 +219,14 @@ namespace rgw {
     uint16_t depth;
     uint32_t flags;
 
+    /* attributes read from RADOS are trusted until then */
+    struct timespec attr_expire{0,0};
+
   public:
     const static std::string root_name;
 
+    using dirent = directory::dirent;
+
     static constexpr uint16_t MAX_DEPTH = 256;
 
     static constexpr uint32_t FLAG_NONE =    0x0000;
@@ -468,6 +487,18 @@ namespace rgw {
       return nullptr;
     }
     
+    void set_attrs_cached(const struct timespec& now);
+    bool attrs_cached(const struct timespec& now);
+
+    void cache_dirents(uint64_t off, const struct timespec& now,
+		       std::vector<std::pair<std::string, dirent>>& ents,
+		       bool eof);
+    bool find_dirent(const std::string& name, const struct timespec& now,
+		     dirent& de);
+    bool replay_dirents(rgw_readdir_cb rcb, void *cb_arg, uint64_t *offset,
+			const struct timespec& now, bool *eof);
+    void invalidate_dirents();
+
     bool is_open() const { return flags & FLAG_OPEN; }
     bool is_root() const { return flags & FLAG_ROOT; }
     bool is_bucket() const { return flags & FLAG_BUCKET; }
@@ -982,6 +1013,21 @@ namespace rgw {
       return fhr;
     } /*  lookup_fh(RGWFileHandle*, const char *, const uint32_t) */
 
+    /* find an existing RGWFileHandle whose attributes are still trusted */
+    LookupFHResult lookup_cached(RGWFileHandle* parent, const char *name,
+				 const struct timespec& now) {
+      using std::get;
+
+      fh_key fhk = parent->make_fhk(parent->make_key_name(name));
+      LookupFHResult fhr = lookup_fh(fhk);
+      RGWFileHandle* fh = get<0>(fhr);
+      if (fh && !fh->attrs_cached(now)) {
+	unref(fh);
+	get<0>(fhr) = nullptr;
+      }
+      return fhr;
+    }
+
     inline void unref(RGWFileHandle* fh) {
       if (likely(! fh->is_root())) {
 	(void) fh_lru.unref(fh, cohort::lru::FLAG_NONE);
@@ -1215,12 +1261,16 @@ public:
   void* cb_arg;
   rgw_readdir_cb rcb;
   size_t ix;
+  bool stopped; /* rcb wants no more entries */
+
+  /* what was listed, for RGWFileHandle::cache_dirents() */
+  std::vector<std::pair<std::string, RGWFileHandle::dirent>> ents;
 
   RGWReaddirRequest(CephContext* _cct, RGWUserInfo *_user,
 		    RGWFileHandle* _rgw_fh, rgw_readdir_cb _rcb,
 		    void* _cb_arg, uint64_t* _offset)
     : RGWLibRequest(_cct, _user), rgw_fh(_rgw_fh), offset(_offset),
-      cb_arg(_cb_arg), rcb(_rcb), ix(0) {
+      cb_arg(_cb_arg), rcb(_rcb), ix(0), stopped(false) {
     const auto& mk = rgw_fh->find_marker(*offset);
     if (mk) {
       marker = *mk;
@@ -1273,10 +1323,12 @@ public:
 
     /* hash offset of name in parent (short name) for NFS readdir cookie */
     uint64_t off = XXH64(name.data(), name.length(), fh_key::seed);
-    *offset = off;
     /* update traversal cache */
     rgw_fh->add_marker(off, marker, type);
-    rcb(name.data(), cb_arg, off); // XXX has to be legit C-style string
+    if (! stopped) {
+      *offset = off;
+      stopped = ! rcb(name.data(), cb_arg, off); // XXX has to be legit C-style string
+    }
     return 0;
   }
 
@@ -1285,67 +1337,72 @@ public:
     return 0;
   }
 
-  virtual void send_response() {
+  void add_entry(boost::string_ref sref, const rgw_obj_key& marker,
+		 uint8_t type, uint64_t size, const real_time& mtime) {
     struct req_state* s = get_state();
-    for (const auto& iter : objs) {
 
-      boost::string_ref sref {iter.key.name};
+    size_t last_del = sref.find_last_of('/');
+    if (last_del != string::npos)
+      sref.remove_prefix(last_del+1);
 
-      lsubdout(cct, rgw, 15) << "readdir objects prefix: " << prefix
-			     << " obj: " << sref << dendl;
+    /* leaf directory? */
+    if (sref.empty())
+      return;
 
-      size_t last_del = sref.find_last_of('/');
-      if (last_del != string::npos)
-	sref.remove_prefix(last_del+1);
+    lsubdout(cct, rgw, 15) << "RGWReaddirRequest "
+			   << __func__ << " "
+			   << "list uri=" << s->relative_uri << " "
+			   << " prefix=" << prefix << " "
+			   << " obj path=" << marker.name
+			   << " (" << sref << ")" << ""
+			   << dendl;
 
-      /* leaf directory? */
-      if (sref.empty())
-	continue;
+    /* each entry is its own marker, so a readdir may continue after any
+     * entry it was handed */
+    std::string name{sref.data(), sref.length()};
+    this->operator()(name, marker, type);
+    ents.emplace_back(std::move(name),
+		      RGWFileHandle::dirent{type, size, mtime});
+    ++ix;
+  }
 
-      lsubdout(cct, rgw, 15) << "RGWReaddirRequest "
-			     << __func__ << " "
-			     << "list uri=" << s->relative_uri << " "
-			     << " prefix=" << prefix << " "
-			     << " obj path=" << iter.key.name
-			     << " (" << sref << ")" << ""
-			     << dendl;
+  virtual void send_response() {
+    /* objects and common prefixes are each sorted; hand them out merged,
+     * in the order of the listing markers */
+    auto obj_iter = objs.begin();
+    auto cp_iter = common_prefixes.begin();
+    while ((obj_iter != objs.end()) ||
+	   (cp_iter != common_prefixes.end())) {
+      if ((cp_iter == common_prefixes.end()) ||
+	  ((obj_iter != objs.end()) &&
+	   (obj_iter->key.name < cp_iter->first))) {
+	lsubdout(cct, rgw, 15) << "readdir objects prefix: " << prefix
+			       << " obj: " << obj_iter->key.name << dendl;
+	add_entry(obj_iter->key.name, rgw_obj_key{obj_iter->key.name, ""},
+		  RGW_FS_TYPE_FILE, obj_iter->size, obj_iter->mtime);
+	++obj_iter;
+	continue;
+      }
 
-      /* call me maybe */
-      this->operator()(sref, next_marker, RGW_FS_TYPE_FILE);
-      ++ix;
-    }
-    for (auto& iter : common_prefixes) {
+      const std::string& cpref = cp_iter->first;
+      ++cp_iter;
 
       lsubdout(cct, rgw, 15) << "readdir common prefixes prefix: " << prefix
-			     << " iter first: " << iter.first
-			     << " iter second: " << iter.second
+			     << " cpref: " << cpref
 			     << dendl;
 
       /* XXX aieee--I have seen this case! */
-      if (iter.first == "/")
+      if (cpref == "/")
 	continue;
 
-      /* it's safest to modify the element in place--a suffix-modifying
-       * string_ref operation is problematic since ULP rgw_file callers
-       * will ultimately need a c-string */
-      if (iter.first.back() == '/')
-	const_cast<std::string&>(iter.first).pop_back();
+      /* the listing continues past everything under a common prefix
+       * given as marker */
+      boost::string_ref sref{cpref};
+      if (sref.back() == '/')
+	sref.remove_suffix(1);
 
-      boost::string_ref sref{iter.first};
-
-      size_t last_del = sref.find_last_of('/');
-      if (last_del != string::npos)
-	sref.remove_prefix(last_del+1);
-
-      lsubdout(cct, rgw, 15) << "RGWReaddirRequest "
-			     << __func__ << " "
-			     << "list uri=" << s->relative_uri << " "
-			     << " prefix=" << prefix << " "
-			     << " cpref=" << sref
-			     << dendl;
-
-      this->operator()(sref, next_marker, RGW_FS_TYPE_DIRECTORY);
-      ++ix;
+      add_entry(sref, rgw_obj_key{cpref, ""}, RGW_FS_TYPE_DIRECTORY, 0,
+		real_time());
     }
   }
 
@@ -1358,6 +1415,10 @@ public:
 			   << " next marker: " << next_marker
 			   << " is_truncated: " << is_truncated
 			   << dendl;
+    return !(is_truncated || stopped);
+  }
+
+  bool listed_all() const {
     return !is_truncated;
   }
 
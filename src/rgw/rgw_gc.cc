@@ -7,7 +7,10 @@
 #include "cls/refcount/cls_refcount_client.h"
 #include "cls/lock/cls_lock_client.h"
 #include "auth/Crypto.h"
+#include "common/errno.h"
+#include "include/stringify.h"
 
+#include <deque>
 #include <list>
 
 #define dout_context g_ceph_context
@@ -129,11 +132,135 @@ int RGWGC::list(int *index, string& marker, uint32_t max, bool expired_only, std
   return 0;
 }
 
-int RGWGC::process(int index, int max_secs)
+/*
+ * Releases the tail objects of the chains in a gc shard with aio, and
+ * collects the tags of the chains that were released completely.
+ */
+class RGWGCIOManager {
+  CephContext *cct;
+  RGWGC *gc;
+  int index;
+  size_t max_aio;
+  size_t max_trim_chunk;
+
+  struct IO {
+    AioCompletion *c;
+    string tag;
+  };
+  deque<IO> ios;
+
+  struct TagState {
+    int pending = 0;
+    bool scheduled = false;   ///< all of its objects were sent
+    bool failed = false;
+  };
+  map<string, TagState> tags;
+  std::list<string> remove_tags;
+  uint64_t num_retired = 0;
+
+  void retire_tag(const string& tag, TagState& state) {
+    if (state.failed) {
+      return;
+    }
+    num_retired++;
+    if (perfcounter) perfcounter->inc(l_rgw_gc_retire_tag);
+    remove_tags.push_back(tag);
+    if (remove_tags.size() >= max_trim_chunk) {
+      flush_remove_tags();
+    }
+  }
+
+  void handle_next_completion() {
+    IO& io = ios.front();
+    io.c->wait_for_complete();
+    int ret = io.c->get_return_value();
+    io.c->release();
+
+    auto iter = tags.find(io.tag);
+    assert(iter != tags.end());
+    TagState& state = iter->second;
+    if (ret == -ENOENT) {
+      ret = 0;
+    }
+    if (ret < 0) {
+      dout(0) << "WARNING: gc could not release an object of tag " << io.tag
+              << ": " << cpp_strerror(ret) << dendl;
+      state.failed = true;
+      if (perfcounter) perfcounter->inc(l_rgw_gc_retire_fail);
+    } else {
+      if (perfcounter) perfcounter->inc(l_rgw_gc_retire_obj);
+    }
+    if (--state.pending == 0 && state.scheduled) {
+      retire_tag(iter->first, state);
+      tags.erase(iter);
+    }
+    ios.pop_front();
+  }
+
+public:
+  RGWGCIOManager(CephContext *_cct, RGWGC *_gc, int _index)
+    : cct(_cct), gc(_gc), index(_index),
+      max_aio(std::max(cct->_conf->rgw_gc_max_concurrent_io, 1)),
+      max_trim_chunk(std::max(cct->_conf->rgw_gc_max_trim_chunk, 1)) {}
+  ~RGWGCIOManager() {
+    drain();
+  }
+
+  int schedule_io(IoCtx *ioctx, const string& oid, ObjectWriteOperation *op,
+                  const string& tag) {
+    while (ios.size() >= max_aio) {
+      handle_next_completion();
+    }
+    AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+    int ret = ioctx->aio_operate(oid, c, op);
+    if (ret < 0) {
+      c->release();
+      tags[tag].failed = true;
+      return ret;
+    }
+    tags[tag].pending++;
+    ios.push_back(IO{c, tag});
+    return 0;
+  }
+
+  uint64_t get_num_retired() const {
+    return num_retired;
+  }
+
+  /* all of the tag's objects were scheduled */
+  void tag_scheduled(const string& tag) {
+    TagState& state = tags[tag];
+    state.scheduled = true;
+    if (state.pending == 0) {
+      retire_tag(tag, state);
+      tags.erase(tag);
+    }
+  }
+
+  void drain() {
+    while (!ios.empty()) {
+      handle_next_completion();
+    }
+    flush_remove_tags();
+  }
+
+  void flush_remove_tags() {
+    if (remove_tags.empty()) {
+      return;
+    }
+    int ret = gc->remove(index, remove_tags);
+    if (ret < 0) {
+      dout(0) << "WARNING: failed to remove tags on gc shard " << index
+              << ": " << cpp_strerror(ret) << dendl;
+    }
+    remove_tags.clear();
+  }
+};
+
+int RGWGC::process(int index, int max_secs, const string& cookie)
 {
   rados::cls::lock::Lock l(gc_index_lock_name);
   utime_t end = ceph_clock_now();
-  std::list<string> remove_tags;
 
   /* max_secs should be greater than zero. We don't want a zero max_secs
    * to be translated as no timeout, since we'd then need to break the
@@ -145,95 +272,115 @@ int RGWGC::process(int index, int max_secs)
   end += max_secs;
   utime_t time(max_secs, 0);
   l.set_duration(time);
+  l.set_cookie(cookie);
 
   int ret = l.lock_exclusive(&store->gc_pool_ctx, obj_names[index]);
   if (ret == -EBUSY) { /* already locked by another gc processor */
-    dout(0) << "RGWGC::process() failed to acquire lock on " << obj_names[index] << dendl;
+    dout(10) << "RGWGC::process() failed to acquire lock on " << obj_names[index] << dendl;
+    if (perfcounter) perfcounter->inc(l_rgw_gc_shard_busy);
     return 0;
   }
   if (ret < 0)
     return ret;
 
   string marker;
-  bool truncated;
-  IoCtx *ctx = new IoCtx;
+  bool truncated = false;
+  bool cut_short = false;
+  uint64_t retired_before = 0;
+  map<string, IoCtx> ioctxs;
+  RGWGCIOManager io_manager(cct, this, index);
   do {
     int max = 100;
     std::list<cls_rgw_gc_obj_info> entries;
     ret = cls_rgw_gc_list(store->gc_pool_ctx, obj_names[index], marker, max, true, entries, &truncated);
     if (ret == -ENOENT) {
       ret = 0;
+      truncated = false;
       goto done;
     }
     if (ret < 0)
       goto done;
 
-    string last_pool;
     std::list<cls_rgw_gc_obj_info>::iterator iter;
     for (iter = entries.begin(); iter != entries.end(); ++iter) {
-      bool remove_tag;
       cls_rgw_gc_obj_info& info = *iter;
       std::list<cls_rgw_obj>::iterator liter;
       cls_rgw_obj_chain& chain = info.chain;
 
       utime_t now = ceph_clock_now();
-      if (now >= end)
+      if (now >= end) {
+        cut_short = true;
         goto done;
+      }
 
-      remove_tag = true;
       for (liter = chain.objs.begin(); liter != chain.objs.end(); ++liter) {
         cls_rgw_obj& obj = *liter;
 
-        if (obj.pool != last_pool) {
-          delete ctx;
-          ctx = new IoCtx;
-	  ret = store->get_rados_handle()->ioctx_create(obj.pool.c_str(), *ctx);
+        auto ctx_iter = ioctxs.find(obj.pool);
+        if (ctx_iter == ioctxs.end()) {
+          IoCtx ctx;
+	  ret = store->get_rados_handle()->ioctx_create(obj.pool.c_str(), ctx);
 	  if (ret < 0) {
 	    dout(0) << "ERROR: failed to create ioctx pool=" << obj.pool << dendl;
 	    continue;
 	  }
-          last_pool = obj.pool;
+          ctx_iter = ioctxs.insert(make_pair(obj.pool, std::move(ctx))).first;
         }
+        IoCtx *ctx = &ctx_iter->second;
 
         ctx->locator_set_key(obj.loc);
         rgw_obj key_obj;
         key_obj.set_obj(obj.key.name);
         key_obj.set_instance(obj.key.instance);
 
-	dout(0) << "gc::process: removing " << obj.pool << ":" << key_obj.get_object() << dendl;
+	dout(5) << "gc::process: removing " << obj.pool << ":" << key_obj.get_object() << dendl;
 	ObjectWriteOperation op;
 	cls_refcount_put(op, info.tag, true);
-        ret = ctx->operate(key_obj.get_object(), &op);
-	if (ret == -ENOENT)
-	  ret = 0;
+        ret = io_manager.schedule_io(ctx, key_obj.get_object(), &op, info.tag);
         if (ret < 0) {
-          remove_tag = false;
           dout(0) << "failed to remove " << obj.pool << ":" << key_obj.get_object() << "@" << obj.loc << dendl;
         }
 
-        if (going_down()) // leave early, even if tag isn't removed, it's ok
+        if (going_down()) { // leave early, even if tag isn't removed, it's ok
+          cut_short = true;
           goto done;
-      }
-      if (remove_tag) {
-        remove_tags.push_back(info.tag);
-#define MAX_REMOVE_CHUNK 16
-        if (remove_tags.size() > MAX_REMOVE_CHUNK) {
-          RGWGC::remove(index, remove_tags);
-          remove_tags.clear();
         }
       }
+      io_manager.tag_scheduled(info.tag);
+    }
+
+    /* the retired entries are gone once drained, so list from the start
+     * again; if none could be retired, leave them for the next pass */
+    io_manager.drain();
+    if (!entries.empty() && io_manager.get_num_retired() == retired_before) {
+      cut_short = true;
+      break;
     }
+    retired_before = io_manager.get_num_retired();
   } while (truncated);
 
 done:
-  if (!remove_tags.empty())
-    RGWGC::remove(index, remove_tags);
+  io_manager.drain();
+  set_behind(index, cut_short || truncated);
   l.unlock(&store->gc_pool_ctx, obj_names[index]);
-  delete ctx;
   return 0;
 }
 
-int RGWGC::process()
+void RGWGC::set_behind(int index, bool is_behind)
+{
+  Mutex::Locker l(behind_lock);
+  if (behind.empty()) {
+    behind.resize(max_objs, false);
+  }
+  if (behind[index] == is_behind) {
+    return;
+  }
+  behind[index] = is_behind;
+  int n = (is_behind ? ++shards_behind : --shards_behind);
+  if (perfcounter) perfcounter->set(l_rgw_gc_shards_behind, n);
+}
+
+int RGWGC::process(const string& cookie)
 {
   int max_secs = cct->_conf->rgw_gc_processor_max_time;
 
@@ -244,9 +391,11 @@ int RGWGC::process()
 
   for (int i = 0; i < max_objs; i++) {
     int index = (i + start) % max_objs;
-    ret = process(index, max_secs);
+    ret = process(index, max_secs, cookie);
     if (ret < 0)
       return ret;
+    if (going_down())
+      break;
   }
 
   return 0;
@@ -259,26 +408,32 @@ bool RGWGC::going_down()
 
 void RGWGC::start_processor()
 {
-  worker = new GCWorker(cct, this);
-  worker->create("rgw_gc");
+  int num_workers = std::max(cct->_conf->rgw_gc_processor_threads, 1);
+  for (int i = 0; i < num_workers; i++) {
+    GCWorker *worker = new GCWorker(cct, this, stringify(i));
+    worker->create("rgw_gc");
+    workers.push_back(worker);
+  }
 }
 
 void RGWGC::stop_processor()
 {
   down_flag.set(1);
-  if (worker) {
+  for (auto worker : workers) {
     worker->stop();
+  }
+  for (auto worker : workers) {
     worker->join();
+    delete worker;
   }
-  delete worker;
-  worker = NULL;
+  workers.clear();
 }
 
 void *RGWGC::GCWorker::entry() {
   do {
     utime_t start = ceph_clock_now();
     dout(2) << "garbage collection: start" << dendl;
-    int r = gc->process();
+    int r = gc->process(cookie);
     if (r < 0) {
       dout(0) << "ERROR: garbage collection process() returned error r=" << r << dendl;
     }
@@ -5,6 +5,9 @@
 #define CEPH_RGW_GC_H
 
 
+#include <atomic>
+#include <vector>
+
 #include "include/types.h"
 #include "include/atomic.h"
 #include "include/rados/librados.hpp"
@@ -15,6 +18,16 @@
 #include "rgw_rados.h"
 #include "cls/rgw/cls_rgw_types.h"
 
+/*
+ * Garbage collection of object tails.
+ *
+ * Removed tails are queued in rgw_gc_max_objs shards.  Every gateway runs
+ * rgw_gc_processor_threads workers over them; a worker leases a shard by
+ * taking its cls lock for rgw_gc_processor_max_time, so each shard is
+ * worked on by one worker of one gateway at a time and the others move on
+ * to the next shard.  Within a shard the tail objects are released with up
+ * to rgw_gc_max_concurrent_io aio operations in flight.
+ */
 class RGWGC {
   CephContext *cct;
   RGWRados *store;
@@ -22,23 +35,31 @@ class RGWGC {
   string *obj_names;
   atomic_t down_flag;
 
+  std::atomic<int> shards_behind;   ///< shards with expired entries left
+  vector<bool> behind;              ///< per shard, protected by behind_lock
+  Mutex behind_lock;
+
   int tag_index(const string& tag);
+  void set_behind(int index, bool is_behind);
 
   class GCWorker : public Thread {
     CephContext *cct;
     RGWGC *gc;
+    string cookie;
     Mutex lock;
     Cond cond;
 
   public:
-    GCWorker(CephContext *_cct, RGWGC *_gc) : cct(_cct), gc(_gc), lock("GCWorker") {}
+    GCWorker(CephContext *_cct, RGWGC *_gc, const string& _cookie)
+      : cct(_cct), gc(_gc), cookie(_cookie), lock("GCWorker") {}
     void *entry();
     void stop();
   };
 
-  GCWorker *worker;
+  vector<GCWorker *> workers;
 public:
-  RGWGC() : cct(NULL), store(NULL), max_objs(0), obj_names(NULL), worker(NULL) {}
+  RGWGC() : cct(NULL), store(NULL), max_objs(0), obj_names(NULL),
+            shards_behind(0), behind_lock("RGWGC::behind_lock") {}
   ~RGWGC() {
     stop_processor();
     finalize();
@@ -54,8 +75,8 @@ public:
 
   int list(int *index, string& marker, uint32_t max, bool expired_only, std::list<cls_rgw_gc_obj_info>& result, bool *truncated);
   void list_init(int *index) { *index = 0; }
-  int process(int index, int process_max_secs);
-  int process();
+  int process(int index, int process_max_secs, const string& cookie);
+  int process(const string& cookie = "");
 
   bool going_down();
   void start_processor();
@@ -113,6 +113,13 @@ void rgw_log_entry::dump(Formatter *f) const
   f->dump_string("user_agent", user_agent);
   f->dump_string("referrer", referrer);
   f->dump_string("bucket_id", bucket_id);
+  if (!phase_times.empty()) {
+    f->open_object_section("phase_times");
+    for (const auto& iter : phase_times) {
+      f->dump_unsigned(iter.first.c_str(), iter.second);
+    }
+    f->close_section();
+  }
 }
 
 void ACLPermission::dump(Formatter *f) const
@@ -698,6 +705,8 @@ void RGWBucketInfo::dump(Formatter *f) const
   encode_json("swift_versioning", swift_versioning, f);
   encode_json("swift_ver_location", swift_ver_location, f);
   encode_json("index_type", (uint32_t)index_type, f);
+  encode_json("reshard_status", (int)reshard_status, f);
+  encode_json("new_bucket_instance_id", new_bucket_instance_id, f);
 }
 
 void RGWBucketInfo::decode_json(JSONObj *obj) {
@@ -729,6 +738,10 @@ void RGWBucketInfo::decode_json(JSONObj *obj) {
   uint32_t it;
   JSONDecoder::decode_json("index_type", it, obj);
   index_type = (RGWBucketIndexType)it;
+  int rs;
+  JSONDecoder::decode_json("reshard_status", rs, obj);
+  reshard_status = (cls_rgw_reshard_status)rs;
+  JSONDecoder::decode_json("new_bucket_instance_id", new_bucket_instance_id, obj);
 }
 
 void rgw_obj_key::dump(Formatter *f) const
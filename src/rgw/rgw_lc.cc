@@ -11,6 +11,7 @@
 #include "cls/rgw/cls_rgw_client.h"
 #include "cls/refcount/cls_refcount_client.h"
 #include "cls/lock/cls_lock_client.h"
+#include "include/stringify.h"
 #include <common/dout.h>
 #include "rgw_common.h"
 #include "rgw_bucket.h"
@@ -265,48 +266,73 @@ int RGWLC::remove_expired_obj(RGWBucketInfo& bucket_info, rgw_obj_key obj_key, b
   }
 }
 
-int RGWLC::bucket_lc_process(string& shard_id)
-{
-  RGWLifecycleConfiguration  config(cct);
+struct RGWLC::LCBucket {
   RGWBucketInfo bucket_info;
-  map<string, bufferlist> bucket_attrs;
-  string next_marker, no_ns, list_versions;
-  bool is_truncated;
-  vector<RGWObjEnt> objs;
-  RGWObjectCtx obj_ctx(store);
-  vector<std::string> result;
-  result = split(shard_id, ':');
-  string bucket_tenant = result[0];
-  string bucket_name = result[1];
-  string bucket_id = result[2];
-  int ret = store->get_bucket_info(obj_ctx, bucket_tenant, bucket_name, bucket_info, NULL, &bucket_attrs);
-  if (ret < 0) {
-    ldout(cct, 0) << "LC:get_bucket_info failed" << bucket_name <<dendl;
-    return ret;
+  RGWLifecycleConfiguration config;
+  string oid;         ///< progress object, in the lc pool
+  int num_shards;     ///< index shards, or 1 for an unsharded index
+
+  explicit LCBucket(CephContext *cct) : config(cct), num_shards(1) {}
+
+  int get_shard_id(int i) const {
+    return (bucket_info.num_shards > 0 ? i : RGW_NO_SHARD);
   }
+};
 
-  ret = bucket_info.bucket.bucket_id.compare(bucket_id) ;
-  if (ret !=0) {
-    ldout(cct, 0) << "LC:old bucket id find, should be delete" << bucket_name <<dendl;
-    return -ENOENT;
+class RGWLC::LCShardWorker : public Thread {
+  RGWLC *lc;
+  LCBucket& b;
+  int first;
+  string cookie;
+
+public:
+  LCShardWorker(RGWLC *_lc, LCBucket& _b, int _first, const string& _cookie)
+    : lc(_lc), b(_b), first(_first), cookie(_cookie) {}
+
+  void *entry() override {
+    lc->process_bucket_shards(b, first, cookie);
+    return NULL;
   }
+};
+
+static string lc_shard_done_key(int i)
+{
+  return "done." + stringify(i);
+}
+
+int RGWLC::bucket_shard_lc_process(LCBucket& b, int i, rados::cls::lock::Lock& l)
+{
+  RGWBucketInfo& bucket_info = b.bucket_info;
+  const string& bucket_name = bucket_info.bucket.name;
+  bool is_truncated;
+  vector<RGWObjEnt> objs;
+  int ret = 0;
 
   RGWRados::Bucket target(store, bucket_info);
+  target.set_shard_id(b.get_shard_id(i));
   RGWRados::Bucket::List list_op(&target);
 
-  map<string, bufferlist>::iterator aiter = bucket_attrs.find(RGW_ATTR_LC);
-  if (aiter == bucket_attrs.end())
-    return 0;
-
-  bufferlist::iterator iter(&aiter->second);
-  try {
-      config.decode(iter);
-    } catch (const buffer::error& e) {
-      ldout(cct, 0) << __func__ <<  "decode life cycle config failed" << dendl;
-      return -1;
+  /* keep the lease on the index shard while we work through it */
+  int lock_secs = cct->_conf->rgw_lc_lock_max_time;
+  utime_t renewed = ceph_clock_now();
+  auto renew_lock = [&]() {
+    utime_t now = ceph_clock_now();
+    if (now - renewed < utime_t(lock_secs / 2, 0)) {
+      return 0;
     }
+    l.set_renew(true);
+    int r = l.lock_exclusive(&store->lc_pool_ctx, b.oid);
+    l.set_renew(false);
+    if (r < 0) {
+      ldout(cct, 0) << "ERROR: lost lease on " << b.oid << " shard " << i
+                    << ": " << cpp_strerror(r) << dendl;
+      return r;
+    }
+    renewed = now;
+    return 0;
+  };
 
-  map<string, lc_op>& prefix_map = config.get_prefix_map();
+  map<string, lc_op>& prefix_map = b.config.get_prefix_map();
   list_op.params.list_versions = bucket_info.versioned();
   if (!bucket_info.versioned()) {
     for(auto prefix_iter = prefix_map.begin(); prefix_iter != prefix_map.end(); ++prefix_iter) {
@@ -315,6 +341,10 @@ int RGWLC::bucket_lc_process(string& shard_id)
       }
       list_op.params.prefix = prefix_iter->first;
       do {
+        ret = renew_lock();
+        if (ret < 0) {
+          return ret;
+        }
         objs.clear();
         list_op.params.marker = list_op.get_next_marker();
         ret = list_op.list_objects(1000, &objs, NULL, &is_truncated);
@@ -343,6 +373,7 @@ int RGWLC::bucket_lc_process(string& shard_id)
             if (ret < 0) {
               ldout(cct, 0) << "ERROR: remove_expired_obj " << dendl;
             } else {
+              if (perfcounter) perfcounter->inc(l_rgw_lc_expire_current);
               ldout(cct, 10) << "DELETED:" << bucket_name << ":" << obj_iter->key.name << dendl;
             }
           }
@@ -365,6 +396,10 @@ int RGWLC::bucket_lc_process(string& shard_id)
       list_op.params.prefix = prefix_iter->first;
       RGWObjEnt pre_obj;
       do {
+        ret = renew_lock();
+        if (ret < 0) {
+          return ret;
+        }
         if (!objs.empty()) {
           pre_obj = objs.back();
         }
@@ -383,6 +418,7 @@ int RGWLC::bucket_lc_process(string& shard_id)
         ceph::real_time mtime;
         bool remove_indeed = true;
         int expiration;
+        int counter;
         for (auto obj_iter = objs.begin(); obj_iter != objs.end(); ++obj_iter) {
           if (obj_iter->is_current()) {
             if (prefix_iter->second.expiration <= 0) {
@@ -399,8 +435,10 @@ int RGWLC::bucket_lc_process(string& shard_id)
                 continue;
               }
               remove_indeed = true;   //we should remove the delete marker if it's the only version
+              counter = l_rgw_lc_expire_dm;
             } else {
               remove_indeed = false;
+              counter = l_rgw_lc_expire_current;
             }
             mtime = obj_iter->mtime;
             expiration = prefix_iter->second.expiration;
@@ -411,6 +449,7 @@ int RGWLC::bucket_lc_process(string& shard_id)
             remove_indeed = true;
             mtime = (obj_iter == objs.begin())?pre_obj.mtime:(obj_iter - 1)->mtime;
             expiration = prefix_iter->second.noncur_expiration;
+            counter = l_rgw_lc_expire_noncurrent;
           }
           if (obj_has_expired(now - ceph::real_clock::to_time_t(mtime), expiration)) {
             if (obj_iter->is_visible()) {
@@ -429,6 +468,7 @@ int RGWLC::bucket_lc_process(string& shard_id)
             if (ret < 0) {
               ldout(cct, 0) << "ERROR: remove_expired_obj " << dendl;
             } else {
+              if (perfcounter) perfcounter->inc(counter);
               ldout(cct, 10) << "DELETED:" << bucket_name << ":" << obj_iter->key.name << dendl;
             }
           }
@@ -440,6 +480,161 @@ int RGWLC::bucket_lc_process(string& shard_id)
   return ret;
 }
 
+void RGWLC::process_bucket_shards(LCBucket& b, int first, const string& lock_cookie)
+{
+  utime_t lock_duration(cct->_conf->rgw_lc_lock_max_time, 0);
+
+  for (int n = 0; n < b.num_shards && !going_down(); n++) {
+    int i = (first + n) % b.num_shards;
+    set<string> keys;
+    keys.insert(lc_shard_done_key(i));
+    map<string, bufferlist> vals;
+    int ret = store->lc_pool_ctx.omap_get_vals_by_keys(b.oid, keys, &vals);
+    if (ret == -ENOENT) { /* the bucket was finished by another processor */
+      return;
+    }
+    if (ret < 0) {
+      ldout(cct, 0) << "ERROR: failed to read lc progress " << b.oid << ": "
+                    << cpp_strerror(ret) << dendl;
+      return;
+    }
+    if (!vals.empty()) {
+      continue;
+    }
+
+    rados::cls::lock::Lock l("lc_shard." + stringify(i));
+    l.set_cookie(lock_cookie);
+    l.set_duration(lock_duration);
+    librados::ObjectWriteOperation op;
+    op.assert_exists();
+    l.lock_exclusive(&op);
+    ret = store->lc_pool_ctx.operate(b.oid, &op);
+    if (ret == -EBUSY) { /* leased by another lc processor */
+      continue;
+    }
+    if (ret < 0) {
+      if (ret != -ENOENT) {
+        ldout(cct, 0) << "ERROR: failed to lock " << b.oid << " shard " << i
+                      << ": " << cpp_strerror(ret) << dendl;
+      }
+      return;
+    }
+
+    /* it may have been finished just before we took the lease */
+    vals.clear();
+    ret = store->lc_pool_ctx.omap_get_vals_by_keys(b.oid, keys, &vals);
+    if (ret == 0 && vals.empty()) {
+      ldout(cct, 20) << "lc: processing " << b.bucket_info.bucket
+                     << " shard " << i << dendl;
+      int32_t result = bucket_shard_lc_process(b, i, l);
+      if (!going_down()) {
+        map<string, bufferlist> done;
+        ::encode(result, done[lc_shard_done_key(i)]);
+        ret = store->lc_pool_ctx.omap_set(b.oid, done);
+        if (ret < 0) {
+          ldout(cct, 0) << "ERROR: failed to update lc progress " << b.oid
+                        << ": " << cpp_strerror(ret) << dendl;
+        }
+        if (perfcounter) perfcounter->inc(l_rgw_lc_shards_processed);
+      }
+    }
+    l.unlock(&store->lc_pool_ctx, b.oid);
+  }
+}
+
+int RGWLC::bucket_lc_process(string& shard_id, bool start, bool *done)
+{
+  LCBucket b(cct);
+  RGWBucketInfo& bucket_info = b.bucket_info;
+  map<string, bufferlist> bucket_attrs;
+  RGWObjectCtx obj_ctx(store);
+  vector<std::string> result;
+  result = split(shard_id, ':');
+  string bucket_tenant = result[0];
+  string bucket_name = result[1];
+  string bucket_id = result[2];
+
+  *done = true;
+  int ret = store->get_bucket_info(obj_ctx, bucket_tenant, bucket_name, bucket_info, NULL, &bucket_attrs);
+  if (ret < 0) {
+    ldout(cct, 0) << "LC:get_bucket_info failed" << bucket_name <<dendl;
+    return ret;
+  }
+
+  ret = bucket_info.bucket.bucket_id.compare(bucket_id) ;
+  if (ret !=0) {
+    ldout(cct, 0) << "LC:old bucket id find, should be delete" << bucket_name <<dendl;
+    return -ENOENT;
+  }
+
+  map<string, bufferlist>::iterator aiter = bucket_attrs.find(RGW_ATTR_LC);
+  if (aiter == bucket_attrs.end())
+    return 0;
+
+  bufferlist::iterator iter(&aiter->second);
+  try {
+      b.config.decode(iter);
+    } catch (const buffer::error& e) {
+      ldout(cct, 0) << __func__ <<  "decode life cycle config failed" << dendl;
+      return -1;
+    }
+
+  b.oid = lc_bucket_oid_prefix + shard_id;
+  b.num_shards = std::max<int>(bucket_info.num_shards, 1);
+
+  if (start) {
+    librados::ObjectWriteOperation op;
+    op.create(false);
+    op.omap_clear();
+    ret = store->lc_pool_ctx.operate(b.oid, &op);
+    if (ret < 0) {
+      ldout(cct, 0) << "ERROR: failed to reset lc progress " << b.oid << ": "
+                    << cpp_strerror(ret) << dendl;
+      return ret;
+    }
+  }
+
+  int num_threads = std::min(std::max(cct->_conf->rgw_lifecycle_thread, 1),
+                             b.num_shards);
+  vector<LCShardWorker*> workers;
+  for (int t = 0; t < num_threads; t++) {
+    LCShardWorker *worker = new LCShardWorker(this, b, t * b.num_shards / num_threads,
+                                              cookie + "." + stringify(t));
+    worker->create("lc_shard_thr");
+    workers.push_back(worker);
+  }
+  for (auto worker : workers) {
+    worker->join();
+    delete worker;
+  }
+
+  /* whoever sees the last index shard done finishes the bucket */
+  map<string, bufferlist> vals;
+  ret = store->lc_pool_ctx.omap_get_vals(b.oid, "", "done.", b.num_shards, &vals);
+  if (ret < 0 || (int)vals.size() < b.num_shards) {
+    *done = false;
+    return (ret == -ENOENT ? 0 : ret);
+  }
+
+  ret = 0;
+  for (auto& v : vals) {
+    int32_t r;
+    try {
+      bufferlist::iterator p = v.second.begin();
+      ::decode(r, p);
+    } catch (const buffer::error& e) {
+      r = -EIO;
+    }
+    if (r < 0) {
+      ret = r;
+    }
+  }
+  store->lc_pool_ctx.remove(b.oid);
+  if (perfcounter) perfcounter->inc(l_rgw_lc_buckets_processed);
+
+  return ret;
+}
+
 int RGWLC::bucket_lc_post(int index, int max_lock_sec, cls_rgw_lc_obj_head& head,
                                                               pair<string, int >& entry, int& result)
 {
@@ -463,8 +658,8 @@ int RGWLC::bucket_lc_post(int index, int max_lock_sec, cls_rgw_lc_obj_head& head
       ret = cls_rgw_lc_rm_entry(store->lc_pool_ctx, obj_names[index],  entry);
       if (ret < 0) {
         dout(0) << "RGWLC::bucket_lc_post() failed to remove entry " << obj_names[index] << dendl;
-        goto clean;
       }
+      goto clean;
     } else if (result < 0) {
       entry.second = lc_failed;
     } else {
@@ -518,9 +713,33 @@ int RGWLC::process()
   return 0;
 }
 
+int RGWLC::find_processing_entry(int index, const string& marker,
+                                 pair<string, int>& entry)
+{
+  string cur = marker;
+  map<string, int> entries;
+  do {
+    int ret = cls_rgw_lc_list(store->lc_pool_ctx, obj_names[index], cur,
+                              MAX_LC_LIST_ENTRIES, entries);
+    if (ret < 0)
+      return ret;
+    for (auto& e : entries) {
+      if (e.second == lc_processing) {
+        entry = e;
+        return 0;
+      }
+      cur = e.first;
+    }
+  } while (!entries.empty());
+
+  entry.first.clear();
+  return 0;
+}
+
 int RGWLC::process(int index, int max_lock_secs)
 {
   rados::cls::lock::Lock l(lc_index_lock_name);
+  string join_marker;
   do {
     utime_t now = ceph_clock_now();
     pair<string, int > entry;//string = bucket_name:bucket_id ,int = LC_BUCKET_STATUS
@@ -541,6 +760,8 @@ int RGWLC::process(int index, int max_lock_secs)
 
     string marker;
     cls_rgw_lc_obj_head head;
+    bool start = true;
+    bool done = false;
     ret = cls_rgw_lc_get_head(store->lc_pool_ctx, obj_names[index], head);
     if (ret < 0) {
       dout(0) << "RGWLC::process() failed to get obj head " << obj_names[index] << ret << dendl;
@@ -563,26 +784,40 @@ int RGWLC::process(int index, int max_lock_secs)
       goto exit;
     }
 
-    if (entry.first.empty())
-      goto exit;
-
-    entry.second = lc_processing;
-    ret = cls_rgw_lc_set_entry(store->lc_pool_ctx, obj_names[index],  entry);
-    if (ret < 0) {
-      dout(0) << "RGWLC::process() failed to set obj entry " << obj_names[index] << entry.first << entry.second << dendl;
-      goto exit;
-    }
+    if (entry.first.empty()) {
+      /* every bucket is claimed; help with the ones still in progress */
+      ret = find_processing_entry(index, join_marker, entry);
+      if (ret < 0) {
+        dout(0) << "RGWLC::process() failed to list entries " << obj_names[index] << dendl;
+        goto exit;
+      }
+      if (entry.first.empty())
+        goto exit;
+      join_marker = entry.first;
+      start = false;
+    } else {
+      entry.second = lc_processing;
+      ret = cls_rgw_lc_set_entry(store->lc_pool_ctx, obj_names[index],  entry);
+      if (ret < 0) {
+        dout(0) << "RGWLC::process() failed to set obj entry " << obj_names[index] << entry.first << entry.second << dendl;
+        goto exit;
+      }
 
-    head.marker = entry.first;
-    ret = cls_rgw_lc_put_head(store->lc_pool_ctx, obj_names[index],  head);
-    if (ret < 0) {
-      dout(0) << "RGWLC::process() failed to put head " << obj_names[index] << dendl;
-      goto exit;
+      head.marker = entry.first;
+      ret = cls_rgw_lc_put_head(store->lc_pool_ctx, obj_names[index],  head);
+      if (ret < 0) {
+        dout(0) << "RGWLC::process() failed to put head " << obj_names[index] << dendl;
+        goto exit;
+      }
     }
     l.unlock(&store->lc_pool_ctx, obj_names[index]);
-    ret = bucket_lc_process(entry.first);
-    ret = bucket_lc_post(index, max_lock_secs, head, entry, ret);
-    return 0;
+    ret = bucket_lc_process(entry.first, start, &done);
+    if (done) {
+      bucket_lc_post(index, max_lock_secs, head, entry, ret);
+    }
+    if (going_down())
+      return 0;
+    continue;
 exit:
     l.unlock(&store->lc_pool_ctx, obj_names[index]);
     return 0;
@@ -16,6 +16,7 @@
 #include "common/Thread.h"
 #include "rgw_common.h"
 #include "rgw_rados.h"
+#include "cls/lock/cls_lock_client.h"
 #include "cls/rgw/cls_rgw_types.h"
 
 using namespace std;
@@ -23,6 +24,7 @@ using namespace std;
 #define MAX_ID_LEN 255
 static string lc_oid_prefix = "lc";
 static string lc_index_lock_name = "lc_process";
+static string lc_bucket_oid_prefix = "lc.bucket.";
 
 extern const char* LC_STATUS[];
 
@@ -207,6 +209,18 @@ public:
 };
 WRITE_CLASS_ENCODER(RGWLifecycleConfiguration)
 
+/*
+ * Lifecycle processing.
+ *
+ * Buckets with a lifecycle configuration are queued in rgw_lc_max_objs
+ * shard objects.  A processor claims the next bucket of a shard, and the
+ * bucket is then expired index shard by index shard: each index shard is
+ * leased with a cls lock on the bucket's progress object
+ * (lc_bucket_oid_prefix + bucket), and marked done in its omap once
+ * processed.  rgw_lifecycle_thread threads of every gateway work on the
+ * index shards of a bucket at once, and gateways that find no unclaimed
+ * bucket left join the ones still being processed.
+ */
 class RGWLC {
   CephContext *cct;
   RGWRados *store;
@@ -228,7 +242,10 @@ class RGWLC {
     bool should_work(utime_t& now);
     int schedule_next_start_time(utime_t& start, utime_t& now);
   };
-  
+
+  struct LCBucket;
+  class LCShardWorker;
+
   public:
   LCWorker *worker;
   RGWLC() : cct(NULL), store(NULL), worker(NULL) {}
@@ -245,7 +262,7 @@ class RGWLC {
   bool if_already_run_today(time_t& start_date);
   int list_lc_progress(const string& marker, uint32_t max_entries, map<string, int> *progress_map);
   int bucket_lc_prepare(int index);
-  int bucket_lc_process(string& shard_id);
+  int bucket_lc_process(string& shard_id, bool start, bool *done);
   int bucket_lc_post(int index, int max_lock_sec, cls_rgw_lc_obj_head& head, 
                                                               pair<string, int >& entry, int& result);
   bool going_down();
@@ -254,6 +271,9 @@ class RGWLC {
 
   private:
   int remove_expired_obj(RGWBucketInfo& bucket_info, rgw_obj_key obj_key, bool remove_indeed = true);
+  int find_processing_entry(int index, const string& marker, pair<string, int>& entry);
+  void process_bucket_shards(LCBucket& b, int first, const string& lock_cookie);
+  int bucket_shard_lc_process(LCBucket& b, int i, rados::cls::lock::Lock& l);
   bool obj_has_expired(double timediff, int days);
 };
 
@@ -5,12 +5,190 @@
 #include <sstream>
 #include <string.h>
 
+#include "common/Formatter.h"
+#include "common/strtol.h"
+#include "include/str_list.h"
+
 #include "rgw_loadgen.h"
 #include "rgw_auth_s3.h"
 
 
 #define dout_subsys ceph_subsys_rgw
 
+static const char *op_names[] = {
+  "put", "get", "list", "delete", "multipart",
+};
+
+const char *rgw_loadgen_op_name(int op)
+{
+  assert(op >= 0 && op < RGW_LOADGEN_OP_MAX);
+  return op_names[op];
+}
+
+/* "name:weight" or "name", weight 1 */
+static int parse_weighted(const string& entry, string *name,
+                          unsigned *weight, string *err)
+{
+  size_t pos = entry.find(':');
+  *name = entry.substr(0, pos);
+  *weight = 1;
+  if (pos != string::npos) {
+    string s = entry.substr(pos + 1);
+    *weight = strict_strtol(s.c_str(), 10, err);
+    if (!err->empty()) {
+      *err = "bad weight in '" + entry + "': " + *err;
+      return -EINVAL;
+    }
+  }
+  return 0;
+}
+
+int rgw_loadgen_parse_op_mix(const string& spec,
+                             unsigned weights[RGW_LOADGEN_OP_MAX],
+                             string *err)
+{
+  list<string> entries;
+  get_str_list(spec, ",", entries);
+
+  std::fill(weights, weights + RGW_LOADGEN_OP_MAX, 0);
+  unsigned total = 0;
+  for (const auto& entry : entries) {
+    string name;
+    unsigned weight;
+    int r = parse_weighted(entry, &name, &weight, err);
+    if (r < 0) {
+      return r;
+    }
+    int op = 0;
+    while (op < RGW_LOADGEN_OP_MAX && name != op_names[op]) {
+      op++;
+    }
+    if (op == RGW_LOADGEN_OP_MAX) {
+      *err = "unknown op '" + name + "'";
+      return -EINVAL;
+    }
+    weights[op] += weight;
+    total += weight;
+  }
+  if (!total) {
+    *err = "empty op mix '" + spec + "'";
+    return -EINVAL;
+  }
+  return 0;
+}
+
+int RGWLoadGenSizeDist::parse(const string& spec, string *err)
+{
+  list<string> entries;
+  get_str_list(spec, ",", entries);
+
+  ranges.clear();
+  total_weight = 0;
+  for (const auto& entry : entries) {
+    string sizes;
+    Range range;
+    int r = parse_weighted(entry, &sizes, &range.weight, err);
+    if (r < 0) {
+      return r;
+    }
+    size_t pos = sizes.find('-');
+    range.min = strict_sistrtoll(sizes.substr(0, pos).c_str(), err);
+    if (err->empty()) {
+      range.max = (pos == string::npos ? range.min :
+                   strict_sistrtoll(sizes.substr(pos + 1).c_str(), err));
+    }
+    if (!err->empty()) {
+      *err = "bad size in '" + entry + "': " + *err;
+      return -EINVAL;
+    }
+    if (range.max < range.min) {
+      *err = "bad size range '" + sizes + "'";
+      return -EINVAL;
+    }
+    ranges.push_back(range);
+    total_weight += range.weight;
+  }
+  if (!total_weight) {
+    *err = "empty size distribution '" + spec + "'";
+    return -EINVAL;
+  }
+  return 0;
+}
+
+uint64_t RGWLoadGenSizeDist::sample(std::mt19937_64& rng) const
+{
+  unsigned w = std::uniform_int_distribution<unsigned>(0, total_weight - 1)(rng);
+  for (const auto& range : ranges) {
+    if (w < range.weight) {
+      return std::uniform_int_distribution<uint64_t>(range.min, range.max)(rng);
+    }
+    w -= range.weight;
+  }
+  assert(0);
+  return 0;
+}
+
+void RGWLoadGenOpStats::add(uint64_t lat_us, uint64_t len, bool failed)
+{
+  count++;
+  if (failed) {
+    errors++;
+  }
+  bytes += len;
+  lat_sum_us += lat_us;
+  lat_max_us = std::max(lat_max_us, lat_us);
+
+  int b = 0;
+  while (b < num_buckets - 1 && (1ull << b) <= lat_us) {
+    b++;
+  }
+  hist[b]++;
+}
+
+uint64_t RGWLoadGenOpStats::percentile(double p) const
+{
+  uint64_t target = std::max<uint64_t>(1, count * p / 100 + 0.5);
+  uint64_t seen = 0;
+  for (int b = 0; b < num_buckets; b++) {
+    seen += hist[b];
+    if (seen >= target) {
+      return std::min<uint64_t>(1ull << b, lat_max_us);
+    }
+  }
+  return lat_max_us;
+}
+
+void RGWLoadGenOpStats::dump(Formatter *f, double secs) const
+{
+  f->dump_unsigned("count", count);
+  f->dump_unsigned("errors", errors);
+  f->dump_unsigned("bytes", bytes);
+  if (secs > 0) {
+    f->dump_float("ops_per_sec", count / secs);
+    f->dump_float("bytes_per_sec", bytes / secs);
+  }
+  if (!count) {
+    return;
+  }
+  f->dump_unsigned("lat_avg_us", lat_sum_us / count);
+  f->dump_unsigned("lat_p50_us", percentile(50));
+  f->dump_unsigned("lat_p90_us", percentile(90));
+  f->dump_unsigned("lat_p99_us", percentile(99));
+  f->dump_unsigned("lat_p999_us", percentile(99.9));
+  f->dump_unsigned("lat_max_us", lat_max_us);
+  /* bucket b holds latencies in [2^(b-1), 2^b) usec */
+  f->open_array_section("lat_hist_us");
+  for (int b = 0; b < num_buckets; b++) {
+    if (hist[b]) {
+      f->open_object_section("bucket");
+      f->dump_unsigned("le", 1ull << b);
+      f->dump_unsigned("count", hist[b]);
+      f->close_section();
+    }
+  }
+  f->close_section();
+}
+
 void RGWLoadGenRequestEnv::set_date(utime_t& tm)
 {
   stringstream s;
@@ -21,7 +199,6 @@ void RGWLoadGenRequestEnv::set_date(utime_t& tm)
 int RGWLoadGenRequestEnv::sign(RGWAccessKey& access_key)
 {
   map<string, string> meta_map;
-  map<string, string> sub_resources;
 
   string canonical_header;
   string digest;
@@ -49,6 +226,9 @@ int RGWLoadGenRequestEnv::sign(RGWAccessKey& access_key)
 size_t RGWLoadGenIO::write_data(const char* const buf,
                                 const size_t len)
 {
+  if (out) {
+    out->append(buf, len);
+  }
   return len;
 }
 
@@ -56,6 +236,9 @@ size_t RGWLoadGenIO::read_data(char* const buf, const size_t len)
 {
   const size_t read_len = std::min(left_to_read,
                                    static_cast<uint64_t>(len));
+  if (!req->body.empty()) {
+    memcpy(buf, req->body.data() + req->body.size() - left_to_read, read_len);
+  }
   left_to_read -= read_len;
   return read_len;
 }
@@ -99,6 +282,7 @@ void RGWLoadGenIO::init_env(CephContext *cct)
 size_t RGWLoadGenIO::send_status(const int status,
                                  const char* const status_name)
 {
+  this->status = status;
   return 0;
 }
 
@@ -110,6 +294,9 @@ size_t RGWLoadGenIO::send_100_continue()
 size_t RGWLoadGenIO::send_header(const boost::string_ref& name,
                                  const boost::string_ref& value)
 {
+  if (name == "ETag") {
+    etag = value.to_string();
+  }
   return 0;
 }
 
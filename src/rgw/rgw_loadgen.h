@@ -5,10 +5,72 @@
 #define CEPH_RGW_LOADGEN_H
 
 #include <map>
+#include <random>
 #include <string>
+#include <vector>
 
 #include "rgw_client_io.h"
 
+enum RGWLoadGenOp {
+  RGW_LOADGEN_OP_PUT = 0,
+  RGW_LOADGEN_OP_GET,
+  RGW_LOADGEN_OP_LIST,
+  RGW_LOADGEN_OP_DELETE,
+  RGW_LOADGEN_OP_MULTIPART,
+  RGW_LOADGEN_OP_MAX,
+};
+
+const char *rgw_loadgen_op_name(int op);
+
+/**
+ * Parse an op mix like "put:20,get:70,list:5,delete:5" into weights.
+ */
+int rgw_loadgen_parse_op_mix(const std::string& spec,
+                             unsigned weights[RGW_LOADGEN_OP_MAX],
+                             std::string *err);
+
+/**
+ * Object sizes, given as weighted fixed sizes or uniform ranges like
+ * "4K:70,64K-1M:25,64M:5".  An entry without a weight has weight 1.
+ */
+class RGWLoadGenSizeDist {
+  struct Range {
+    uint64_t min;
+    uint64_t max;
+    unsigned weight;
+  };
+  std::vector<Range> ranges;
+  unsigned total_weight{0};
+
+public:
+  int parse(const std::string& spec, std::string *err);
+  uint64_t sample(std::mt19937_64& rng) const;
+};
+
+/**
+ * Latencies and volume of the requests of one op type.  Latencies go into
+ * power of two buckets of microseconds; percentiles are reported as the
+ * upper bound of the bucket they fall in.
+ */
+class RGWLoadGenOpStats {
+  static constexpr int num_buckets = 40;
+
+  uint64_t count{0};
+  uint64_t errors{0};
+  uint64_t bytes{0};
+  uint64_t lat_sum_us{0};
+  uint64_t lat_max_us{0};
+  uint64_t hist[num_buckets] = {0};
+
+  uint64_t percentile(double p) const;
+
+public:
+  void add(uint64_t lat_us, uint64_t len, bool failed);
+  bool empty() const { return count == 0; }
+  /// secs is the wall time of the run, for the rates
+  void dump(Formatter *f, double secs) const;
+};
+
 
 struct RGWLoadGenRequestEnv {
   int port;
@@ -18,8 +80,10 @@ struct RGWLoadGenRequestEnv {
   std::string uri;
   std::string query_string;
   std::string date_str;
+  std::string body; ///< sent as is if set, otherwise content_length bytes
 
   std::map<std::string, std::string> headers;
+  std::map<std::string, std::string> sub_resources; ///< also in query_string
 
   RGWLoadGenRequestEnv()
     : port(0),
@@ -38,6 +102,10 @@ class RGWLoadGenIO : public rgw::io::RestfulClient
   RGWLoadGenRequestEnv* req;
   RGWEnv env;
 
+  int status{0};
+  std::string etag;
+  std::string *out{nullptr}; ///< response body, if wanted
+
   void init_env(CephContext *cct) override;
   size_t read_data(char *buf, size_t len);
   size_t write_data(const char *buf, size_t len);
@@ -70,6 +138,10 @@ public:
   }
 
   size_t complete_request() override;
+
+  void set_out(std::string *_out) { out = _out; }
+  int get_status() const { return status; }
+  const std::string& get_etag() const { return etag; }
 };
 
 #endif
@@ -1,9 +1,15 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 // vim: ts=8 sw=2 smarttab
 
+#include <fstream>
+#include <numeric>
+#include <thread>
+
 #include "common/errno.h"
+#include "common/strtol.h"
 #include "common/Throttle.h"
 #include "common/WorkQueue.h"
+#include "include/stringify.h"
 
 #include "rgw_rados.h"
 #include "rgw_rest.h"
@@ -29,16 +35,56 @@ void RGWLoadGenProcess::run()
   int i;
 
   int num_objs;
-
   conf->get_val("num_objs", 1000, &num_objs);
 
   int num_buckets;
   conf->get_val("num_buckets", 1, &num_buckets);
 
+  /* the mixed workload runs for num_ops ops or duration seconds, whichever
+   * is set; without either, num_objs ops */
+  int num_ops;
+  conf->get_val("num_ops", 0, &num_ops);
+
+  int duration;
+  conf->get_val("duration", 0, &duration);
+
+  /* ops started per second, 0 for as many as num_threads can do */
+  int rate;
+  conf->get_val("rate", 0, &rate);
+
+  /* the same seed gives the same sequence of ops and object sizes */
+  int seed;
+  conf->get_val("seed", 0, &seed);
+  std::mt19937_64 rng(seed);
+
+  string op_mix = conf->get_val("op_mix", "");
+  unsigned weights[RGW_LOADGEN_OP_MAX];
+  RGWLoadGenSizeDist sizes;
+  string err;
+
+  report_path = conf->get_val("report", "");
+
   vector<string> buckets(num_buckets);
 
   atomic_t failed;
 
+  ceph::mono_time start;
+
+  if (sizes.parse(conf->get_val("obj_size", "4096"), &err) < 0) {
+    derr << "ERROR: loadgen obj_size: " << err << dendl;
+    goto done;
+  }
+  part_size = strict_sistrtoll(conf->get_val("part_size", "5M").c_str(), &err);
+  if (!err.empty() || !part_size) {
+    derr << "ERROR: loadgen part_size: " << err << dendl;
+    goto done;
+  }
+  if (!op_mix.empty() &&
+      rgw_loadgen_parse_op_mix(op_mix, weights, &err) < 0) {
+    derr << "ERROR: loadgen op_mix: " << err << dendl;
+    goto done;
+  }
+
   for (i = 0; i < num_buckets; i++) {
     buckets[i] = "/loadgen";
     string& bucket = buckets[i];
@@ -49,42 +95,126 @@ void RGWLoadGenProcess::run()
     checkpoint();
   }
 
-  string *objs = new string[num_objs];
-
   if (failed.read()) {
     derr << "ERROR: bucket creation failed" << dendl;
     goto done;
   }
 
+  start = ceph::mono_clock::now();
   for (i = 0; i < num_objs; i++) {
-    char buf[16 + 1];
-    gen_rand_alphanumeric(NULL, buf, sizeof(buf));
-    buf[16] = '\0';
-    objs[i] = buckets[i % num_buckets] + "/" + buf;
-  }
-
-  for (i = 0; i < num_objs; i++) {
-    gen_request("PUT", objs[i], 4096, &failed);
+    uint64_t size = sizes.sample(rng);
+    gen_request("PUT", buckets[i % num_buckets] + "/obj." + stringify(i),
+		size, &failed, RGW_LOADGEN_OP_PUT, size);
   }
 
   checkpoint();
+  report("prefill", ceph::mono_clock::now() - start);
 
   if (failed.read()) {
-    derr << "ERROR: bucket creation failed" << dendl;
-    goto done;
+    derr << "ERROR: object creation failed" << dendl;
+    goto cleanup;
   }
 
-  for (i = 0; i < num_objs; i++) {
-    gen_request("GET", objs[i], 4096, NULL);
+  start = ceph::mono_clock::now();
+  if (op_mix.empty()) {
+    vector<Obj> targets;
+    {
+      Mutex::Locker l(lock);
+      targets = objs;
+    }
+    for (const auto& obj : targets) {
+      gen_request("GET", obj.resource, 0, NULL, RGW_LOADGEN_OP_GET,
+		  obj.size);
+    }
+  } else {
+    if (!num_ops && !duration) {
+      num_ops = num_objs;
+    }
+    unsigned total_weight = std::accumulate(weights,
+					    weights + RGW_LOADGEN_OP_MAX, 0);
+    ceph::mono_time end = start + std::chrono::seconds(duration);
+    for (i = 0; !num_ops || i < num_ops; i++) {
+      ceph::mono_time when = ceph::mono_clock::now();
+      if (rate > 0) {
+	/* latency counts from when the op was due, so a backlog shows */
+	ceph::mono_time due = start + std::chrono::nanoseconds(
+	  1000000000ull * i / rate);
+	if (due > when) {
+	  std::this_thread::sleep_for(due - when);
+	}
+	when = due;
+      }
+      if (duration && when >= end) {
+	break;
+      }
+
+      unsigned w = std::uniform_int_distribution<unsigned>(
+	0, total_weight - 1)(rng);
+      int op = 0;
+      while (w >= weights[op]) {
+	w -= weights[op++];
+      }
+      uint64_t size = sizes.sample(rng);
+      uint64_t pick = rng();
+      const string& bucket = buckets[pick % num_buckets];
+
+      Obj obj;
+      if (op == RGW_LOADGEN_OP_GET || op == RGW_LOADGEN_OP_DELETE) {
+	Mutex::Locker l(lock);
+	if (objs.empty()) {
+	  op = RGW_LOADGEN_OP_PUT;
+	} else {
+	  /* a delete takes its object out right away, so it isn't picked
+	   * again */
+	  auto iter = objs.begin() + pick % objs.size();
+	  obj = *iter;
+	  if (op == RGW_LOADGEN_OP_DELETE) {
+	    *iter = objs.back();
+	    objs.pop_back();
+	  }
+	}
+      }
+
+      switch (op) {
+      case RGW_LOADGEN_OP_PUT:
+	gen_request("PUT", bucket + "/obj." + stringify(num_objs + i), size,
+		    NULL, op, size, when);
+	break;
+      case RGW_LOADGEN_OP_GET:
+	gen_request("GET", obj.resource, 0, NULL, op, obj.size, when);
+	break;
+      case RGW_LOADGEN_OP_LIST:
+	gen_request("GET", bucket, 0, NULL, op, 0, when);
+	break;
+      case RGW_LOADGEN_OP_DELETE:
+	gen_request("DELETE", obj.resource, 0, NULL, op, 0, when);
+	break;
+      case RGW_LOADGEN_OP_MULTIPART:
+	gen_request("POST", bucket + "/obj." + stringify(num_objs + i), size,
+		    NULL, op, size, when);
+	break;
+      }
+    }
   }
 
   checkpoint();
-
-  for (i = 0; i < num_objs; i++) {
-    gen_request("DELETE", objs[i], 0, NULL);
+  report("workload", ceph::mono_clock::now() - start);
+
+cleanup:
+  start = ceph::mono_clock::now();
+  {
+    vector<Obj> targets;
+    {
+      Mutex::Locker l(lock);
+      targets.swap(objs);
+    }
+    for (const auto& obj : targets) {
+      gen_request("DELETE", obj.resource, 0, NULL, RGW_LOADGEN_OP_DELETE, 0);
+    }
   }
 
   checkpoint();
+  report("cleanup", ceph::mono_clock::now() - start);
 
   for (i = 0; i < num_buckets; i++) {
     gen_request("DELETE", buckets[i], 0, NULL);
@@ -95,51 +225,184 @@ done:
 
   m_tp.stop();
 
-  delete[] objs;
-
   signal_shutdown();
 } /* RGWLoadGenProcess::run() */
 
+void RGWLoadGenProcess::report(const char* phase, ceph::timespan elapsed)
+{
+  double secs = std::chrono::duration<double>(elapsed).count();
+
+  JSONFormatter f(true);
+  f.open_object_section("loadgen");
+  f.dump_string("phase", phase);
+  f.dump_float("secs", secs);
+  f.open_object_section("ops");
+  {
+    Mutex::Locker l(lock);
+    for (int op = 0; op < RGW_LOADGEN_OP_MAX; op++) {
+      if (!stats[op].empty()) {
+	f.open_object_section(rgw_loadgen_op_name(op));
+	stats[op].dump(&f, secs);
+	f.close_section();
+      }
+      stats[op] = RGWLoadGenOpStats();
+    }
+  }
+  f.close_section();
+  f.close_section();
+
+  stringstream ss;
+  f.flush(ss);
+  dout(0) << "loadgen " << phase << " results: " << ss.str() << dendl;
+
+  if (!report_path.empty()) {
+    std::ofstream out(report_path, std::ios::app);
+    out << ss.str() << std::endl;
+    if (!out) {
+      derr << "ERROR: failed to write loadgen report to " << report_path
+	   << dendl;
+    }
+  }
+} /* RGWLoadGenProcess::report */
+
 void RGWLoadGenProcess::gen_request(const string& method,
 				    const string& resource,
-				    int content_length, atomic_t* fail_flag)
+				    uint64_t content_length, atomic_t* fail_flag,
+				    int op, uint64_t size,
+				    ceph::mono_time scheduled)
 {
   RGWLoadGenRequest* req =
     new RGWLoadGenRequest(store->get_new_req_id(), method, resource,
-			  content_length, fail_flag);
+			  content_length, fail_flag, op, size, scheduled);
   dout(10) << "allocated request req=" << hex << req << dec << dendl;
   req_throttle.get(1);
   req_wq.queue(req);
 } /* RGWLoadGenProcess::gen_request */
 
-void RGWLoadGenProcess::handle_request(RGWRequest* r)
+int RGWLoadGenProcess::send_request(RGWRequest* req, const string& method,
+				    const string& resource,
+				    const map<string, string>& sub_resources,
+				    const string& body, uint64_t content_length,
+				    string* out, string* etag)
 {
-  RGWLoadGenRequest* req = static_cast<RGWLoadGenRequest*>(r);
-
   RGWLoadGenRequestEnv env;
 
   utime_t tm = ceph_clock_now();
 
   env.port = 80;
-  env.content_length = req->content_length;
+  env.content_length = (body.empty() ? content_length : body.size());
   env.content_type = "binary/octet-stream";
-  env.request_method = req->method;
-  env.uri = req->resource;
+  env.request_method = method;
+  env.uri = resource;
+  env.body = body;
+  env.sub_resources = sub_resources;
+  for (const auto& sub : sub_resources) {
+    if (!env.query_string.empty()) {
+      env.query_string.append("&");
+    }
+    env.query_string.append(sub.first);
+    if (!sub.second.empty()) {
+      env.query_string.append("=" + sub.second);
+    }
+  }
   env.set_date(tm);
   env.sign(access_key);
 
   RGWLoadGenIO real_client_io(&env);
+  real_client_io.set_out(out);
   RGWRestfulIO client_io(&real_client_io);
 
   int ret = process_request(store, rest, req, uri_prefix, &client_io, olog);
   if (ret < 0) {
     /* we don't really care about return code */
     dout(20) << "process_request() returned " << ret << dendl;
+  } else if (real_client_io.get_status() >= 300) {
+    ret = -EIO;
+  }
+  if (etag) {
+    *etag = rgw_string_unquote(real_client_io.get_etag());
+  }
+  return ret;
+} /* RGWLoadGenProcess::send_request */
 
+int RGWLoadGenProcess::multipart_upload(RGWLoadGenRequest* req)
+{
+  static const string upload_id_tag = "<UploadId>";
+
+  string out;
+  int ret = send_request(req, "POST", req->resource, {{"uploads", ""}}, "", 0,
+			 &out, NULL);
+  if (ret < 0) {
+    return ret;
+  }
+  size_t pos = out.find(upload_id_tag);
+  size_t end = out.find("</UploadId>");
+  if (pos == string::npos || end == string::npos) {
+    dout(0) << "ERROR: no upload id in response: " << out << dendl;
+    return -EIO;
+  }
+  pos += upload_id_tag.size();
+  string upload_id = out.substr(pos, end - pos);
+
+  string complete = "<CompleteMultipartUpload>";
+  uint64_t ofs = 0;
+  int num = 1;
+  do {
+    uint64_t len = std::min(part_size, req->content_length - ofs);
+    string etag;
+    ret = send_request(req, "PUT", req->resource,
+		       {{"partNumber", stringify(num)}, {"uploadId", upload_id}},
+		       "", len, NULL, &etag);
+    if (ret < 0) {
+      break;
+    }
+    complete.append("<Part><PartNumber>" + stringify(num) +
+		    "</PartNumber><ETag>" + etag + "</ETag></Part>");
+    ofs += len;
+    num++;
+  } while (ofs < req->content_length);
+  complete.append("</CompleteMultipartUpload>");
+
+  if (ret >= 0) {
+    ret = send_request(req, "POST", req->resource, {{"uploadId", upload_id}},
+		       complete, 0, NULL, NULL);
+  }
+  if (ret < 0) {
+    send_request(req, "DELETE", req->resource, {{"uploadId", upload_id}},
+		 "", 0, NULL, NULL);
+  }
+  return ret;
+} /* RGWLoadGenProcess::multipart_upload */
+
+void RGWLoadGenProcess::handle_request(RGWRequest* r)
+{
+  RGWLoadGenRequest* req = static_cast<RGWLoadGenRequest*>(r);
+
+  int ret;
+  if (req->op == RGW_LOADGEN_OP_MULTIPART) {
+    ret = multipart_upload(req);
+  } else {
+    ret = send_request(req, req->method, req->resource, {}, "",
+		       req->content_length, NULL, NULL);
+  }
+  if (ret < 0) {
     if (req->fail_flag) {
       req->fail_flag->inc();
     }
   }
 
+  if (req->op >= 0) {
+    auto lat = ceph::mono_clock::now() - req->scheduled;
+    uint64_t lat_us =
+      std::chrono::duration_cast<std::chrono::microseconds>(lat).count();
+
+    Mutex::Locker l(lock);
+    stats[req->op].add(lat_us, req->size, ret < 0);
+    if (ret >= 0 && (req->op == RGW_LOADGEN_OP_PUT ||
+		     req->op == RGW_LOADGEN_OP_MULTIPART)) {
+      objs.push_back(Obj{req->resource, req->size});
+    }
+  }
+
   delete req;
 } /* RGWLoadGenProcess::handle_request */
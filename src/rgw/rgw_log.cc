@@ -1,8 +1,16 @@
 // -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
 // vim: ts=8 sw=2 smarttab
 
+#include <fcntl.h>
+#include <atomic>
+#include <thread>
+
 #include "common/Clock.h"
+#include "common/Cond.h"
+#include "common/Thread.h"
 #include "common/Timer.h"
+#include "common/errno.h"
+#include "include/compat.h"
 #include "common/utf8.h"
 #include "common/OutputDataSocket.h"
 #include "common/Formatter.h"
@@ -13,6 +21,7 @@
 #include "rgw_rados.h"
 #include "rgw_client_io.h"
 #include "rgw_rest.h"
+#include "rgw_slow_requests.h"
 
 #define dout_subsys ceph_subsys_rgw
 
@@ -180,6 +189,188 @@ void rgw_log_usage_finalize()
   usage_logger = NULL;
 }
 
+/*
+ * ops logger
+ *
+ * Requests only encode their entry into a buffer; a flusher thread writes
+ * the buffers out every rgw_ops_log_tick_interval seconds, or sooner once
+ * rgw_ops_log_flush_threshold bytes are pending, with one append per log
+ * object.  The buffers are sharded by thread so that requests don't
+ * contend on a single lock.  Entries that would take the backlog past
+ * rgw_ops_log_max_backlog are dropped rather than hold up the request.
+ */
+#define OPS_LOG_SHARDS 16
+
+class OpsLogger : public Thread {
+  CephContext *cct;
+  RGWRados *store;
+  bool to_rados;
+  std::string file_path;
+  int fd;
+
+  struct Shard {
+    Mutex lock;
+    map<string, bufferlist> objs;     ///< encoded entries by log object
+    list<rgw_log_entry> file_entries;
+
+    Shard() : lock("OpsLogger::Shard") {}
+  };
+  Shard shards[OPS_LOG_SHARDS];
+  std::atomic<uint64_t> pending{0};
+
+  Mutex lock;
+  Cond cond;
+  bool stopping;
+
+  Shard& get_shard() {
+    size_t h = std::hash<std::thread::id>()(std::this_thread::get_id());
+    return shards[h % OPS_LOG_SHARDS];
+  }
+
+  void write_rados(map<string, bufferlist>& objs) {
+    for (auto& o : objs) {
+      rgw_obj obj(store->get_zone_params().log_pool, o.first);
+      int ret = store->append_async(obj, o.second.length(), o.second);
+      if (ret == -ENOENT) {
+        ret = store->create_pool(store->get_zone_params().log_pool);
+        if (ret == 0) {
+          ret = store->append_async(obj, o.second.length(), o.second);
+        }
+      }
+      if (ret < 0) {
+        ldout(cct, 0) << "ERROR: failed to write ops log " << o.first
+                      << ": " << cpp_strerror(ret) << dendl;
+      }
+    }
+  }
+
+  void write_file(list<rgw_log_entry>& entries) {
+    JSONFormatter formatter;
+    stringstream ss;
+    for (auto& entry : entries) {
+      rgw_format_ops_log_entry(entry, &formatter);
+      formatter.flush(ss);
+      ss << "\n";
+    }
+    bufferlist bl;
+    bl.append(ss.str());
+    int ret = bl.write_fd(fd);
+    if (ret < 0) {
+      ldout(cct, 0) << "ERROR: failed to write ops log to " << file_path
+                    << ": " << cpp_strerror(ret) << dendl;
+    }
+  }
+
+public:
+  OpsLogger(CephContext *_cct, RGWRados *_store)
+    : cct(_cct), store(_store),
+      to_rados(cct->_conf->rgw_ops_log_rados),
+      file_path(cct->_conf->rgw_ops_log_file_path), fd(-1),
+      lock("OpsLogger"), stopping(false) {
+    if (!file_path.empty()) {
+      fd = ::open(file_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+      if (fd < 0) {
+        int r = -errno;
+        lderr(cct) << "ERROR: failed to open ops log file " << file_path
+                   << ": " << cpp_strerror(r) << dendl;
+      }
+    }
+    create("rgw_ops_log");
+  }
+
+  ~OpsLogger() override {
+    lock.Lock();
+    stopping = true;
+    cond.Signal();
+    lock.Unlock();
+    join();
+    if (fd >= 0) {
+      VOID_TEMP_FAILURE_RETRY(::close(fd));
+    }
+  }
+
+  bool enabled() const {
+    return to_rados || fd >= 0;
+  }
+
+  void insert(const string& oid, rgw_log_entry& entry) {
+    bufferlist bl;
+    ::encode(entry, bl);
+    uint64_t len = bl.length();
+
+    if (pending + len > (uint64_t)cct->_conf->rgw_ops_log_max_backlog) {
+      if (perfcounter) perfcounter->inc(l_rgw_ops_log_drop);
+      ldout(cct, 5) << "ops log backlog full, dropping entry" << dendl;
+      return;
+    }
+
+    Shard& shard = get_shard();
+    shard.lock.Lock();
+    if (to_rados) {
+      shard.objs[oid].claim_append(bl);
+    }
+    if (fd >= 0) {
+      shard.file_entries.push_back(entry);
+    }
+    shard.lock.Unlock();
+
+    if ((pending += len) > (uint64_t)cct->_conf->rgw_ops_log_flush_threshold) {
+      Mutex::Locker l(lock);
+      cond.Signal();
+    }
+  }
+
+  void flush() {
+    map<string, bufferlist> objs;
+    list<rgw_log_entry> file_entries;
+    for (auto& shard : shards) {
+      Mutex::Locker l(shard.lock);
+      for (auto& o : shard.objs) {
+        objs[o.first].claim_append(o.second);
+      }
+      shard.objs.clear();
+      file_entries.splice(file_entries.end(), shard.file_entries);
+    }
+    pending = 0;
+
+    if (!objs.empty()) {
+      write_rados(objs);
+    }
+    if (!file_entries.empty()) {
+      write_file(file_entries);
+    }
+  }
+
+  void *entry() override {
+    lock.Lock();
+    while (!stopping) {
+      cond.WaitInterval(lock, utime_t(cct->_conf->rgw_ops_log_tick_interval, 0));
+      lock.Unlock();
+      flush();
+      lock.Lock();
+    }
+    lock.Unlock();
+    flush();
+    return NULL;
+  }
+};
+
+static OpsLogger *ops_logger = NULL;
+
+void rgw_log_ops_init(CephContext *cct, RGWRados *store)
+{
+  if (cct->_conf->rgw_enable_ops_log &&
+      (cct->_conf->rgw_ops_log_rados || !cct->_conf->rgw_ops_log_file_path.empty())) {
+    ops_logger = new OpsLogger(cct, store);
+  }
+}
+
+void rgw_log_ops_finalize()
+{
+  delete ops_logger;
+  ops_logger = NULL;
+}
+
 static void log_usage(struct req_state *s, const string& op_name)
 {
   if (s->system_request) /* don't log system user operations */
@@ -251,6 +442,13 @@ void rgw_format_ops_log_entry(struct rgw_log_entry& entry, Formatter *formatter)
   formatter->dump_int("total_time", total_time);
   formatter->dump_string("user_agent",  entry.user_agent);
   formatter->dump_string("referrer",  entry.referrer);
+  if (!entry.phase_times.empty()) {
+    formatter->open_object_section("phase_times");
+    for (const auto& iter : entry.phase_times) {
+      formatter->dump_unsigned(iter.first.c_str(), iter.second);
+    }
+    formatter->close_section();
+  }
   if (entry.x_headers.size() > 0) {
     formatter->open_array_section("http_x_headers");
     for (const auto& iter: entry.x_headers) {
@@ -383,9 +581,12 @@ int rgw_log_op(RGWRados *store, RGWREST* const rest, struct req_state *s,
 
   entry.error_code = s->err.s3_code;
   entry.bucket_id = bucket_id;
-
-  bufferlist bl;
-  ::encode(entry, bl);
+  if (rgw_is_slow_request(s->cct, entry.total_time)) {
+    for (int i = 0; i < RGW_REQ_PHASE_MAX; i++) {
+      entry.phase_times[rgw_req_phase_name(i)] =
+        std::chrono::duration_cast<std::chrono::microseconds>(s->phase_time[i]).count();
+    }
+  }
 
   struct tm bdt;
   time_t t = entry.time.sec();
@@ -396,12 +597,18 @@ int rgw_log_op(RGWRados *store, RGWREST* const rest, struct req_state *s,
 
   int ret = 0;
 
-  if (s->cct->_conf->rgw_ops_log_rados) {
+  if (ops_logger && ops_logger->enabled()) {
+    string oid = render_log_object_name(s->cct->_conf->rgw_log_object_name, &bdt,
+				        s->bucket.bucket_id, entry.bucket);
+    ops_logger->insert(oid, entry);
+  } else if (s->cct->_conf->rgw_ops_log_rados) {
     string oid = render_log_object_name(s->cct->_conf->rgw_log_object_name, &bdt,
 				        s->bucket.bucket_id, entry.bucket);
 
     rgw_obj obj(store->get_zone_params().log_pool, oid);
 
+    bufferlist bl;
+    ::encode(entry, bl);
     ret = store->append_async(obj, bl.length(), bl);
     if (ret == -ENOENT) {
       ret = store->create_pool(store->get_zone_params().log_pool);
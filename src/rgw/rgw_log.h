@@ -35,9 +35,10 @@ struct rgw_log_entry {
   string referrer;
   string bucket_id;
   headers_map x_headers;
+  map<string, uint64_t> phase_times; ///< usec per RGWReqPhase, slow requests only
 
   void encode(bufferlist &bl) const {
-    ENCODE_START(9, 5, bl);
+    ENCODE_START(10, 5, bl);
     ::encode(object_owner.id, bl);
     ::encode(bucket_owner.id, bl);
     ::encode(bucket, bl);
@@ -60,10 +61,11 @@ struct rgw_log_entry {
     ::encode(object_owner, bl);
     ::encode(bucket_owner, bl);
     ::encode(x_headers, bl);
+    ::encode(phase_times, bl);
     ENCODE_FINISH(bl);
   }
   void decode(bufferlist::iterator &p) {
-    DECODE_START_LEGACY_COMPAT_LEN(8, 5, 5, p);
+    DECODE_START_LEGACY_COMPAT_LEN(10, 5, 5, p);
     ::decode(object_owner.id, p);
     if (struct_v > 3)
       ::decode(bucket_owner.id, p);
@@ -109,6 +111,9 @@ struct rgw_log_entry {
     if (struct_v >= 9) {
       ::decode(x_headers, p);
     }
+    if (struct_v >= 10) {
+      ::decode(phase_times, p);
+    }
     DECODE_FINISH(p);
   }
   void dump(Formatter *f) const;
@@ -138,6 +143,8 @@ int rgw_log_op(RGWRados *store, RGWREST* const rest, struct req_state *s,
 	       const string& op_name, OpsLogSocket *olog);
 void rgw_log_usage_init(CephContext *cct, RGWRados *store);
 void rgw_log_usage_finalize();
+void rgw_log_ops_init(CephContext *cct, RGWRados *store);
+void rgw_log_ops_finalize();
 void rgw_format_ops_log_entry(struct rgw_log_entry& entry,
 			      Formatter *formatter);
 
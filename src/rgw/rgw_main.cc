@@ -47,6 +47,9 @@
 #include "rgw_rest_realm.h"
 #include "rgw_swift_auth.h"
 #include "rgw_log.h"
+#include "rgw_stream_hash.h"
+#include "rgw_compression.h"
+#include "rgw_slow_requests.h"
 #include "rgw_tools.h"
 #include "rgw_resolve.h"
 
@@ -338,6 +341,13 @@ int main(int argc, const char **argv)
     derr << "Couldn't init storage provider (RADOS)" << dendl;
     return EIO;
   }
+  if (g_conf->rgw_datacache_enabled) {
+    r = store->init_data_cache();
+    if (r < 0) {
+      derr << "ERROR: failed initializing data cache" << dendl;
+      return -r;
+    }
+  }
   r = rgw_perf_start(g_ceph_context);
   if (r < 0) {
     derr << "ERROR: failed starting rgw perf" << dendl;
@@ -354,6 +364,10 @@ int main(int argc, const char **argv)
   rgw_user_init(store);
   rgw_bucket_init(store->meta_mgr);
   rgw_log_usage_init(g_ceph_context, store);
+  rgw_log_ops_init(g_ceph_context, store);
+  rgw_stream_hash_init(g_ceph_context);
+  rgw_compression_init(g_ceph_context);
+  rgw_slow_requests_init(g_ceph_context);
 
   RGWREST rest;
 
@@ -562,6 +576,10 @@ int main(int argc, const char **argv)
   shutdown_async_signal_handler();
 
   rgw_log_usage_finalize();
+  rgw_log_ops_finalize();
+  rgw_stream_hash_finalize();
+  rgw_compression_finalize();
+  rgw_slow_requests_finalize();
 
   delete olog;
 
@@ -34,6 +34,7 @@
 #include "rgw_client_io.h"
 #include "rgw_compression.h"
 #include "rgw_role.h"
+#include "rgw_stream_hash.h"
 #include "cls/lock/cls_lock_client.h"
 #include "cls/rgw/cls_rgw_client.h"
 
@@ -1368,7 +1369,10 @@ void RGWGetObj::execute()
   read_op.params.obj_size = &s->obj_size;
   read_op.params.perr = &s->err;
 
-  op_ret = read_op.prepare();
+  {
+    RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_DATA);
+    op_ret = read_op.prepare();
+  }
   if (op_ret < 0)
     goto done_err;
 
@@ -1463,7 +1467,10 @@ void RGWGetObj::execute()
   ofs_x = ofs;
   end_x = end;
   filter->fixup_range(ofs_x, end_x);
-  op_ret = read_op.iterate(ofs_x, end_x, filter);
+  {
+    RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_DATA);
+    op_ret = read_op.iterate(ofs_x, end_x, filter);
+  }
 
   if (op_ret >= 0)
     op_ret = filter->flush();
@@ -1556,10 +1563,13 @@ void RGWListBuckets::execute()
       read_count = max_buckets;
     }
 
-    op_ret = rgw_read_user_buckets(store, s->user->user_id, buckets,
-                                   marker, end_marker, read_count,
-                                   should_get_stats(), &is_truncated,
-                                   get_default_max());
+    {
+      RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_INDEX);
+      op_ret = rgw_read_user_buckets(store, s->user->user_id, buckets,
+                                     marker, end_marker, read_count,
+                                     should_get_stats(), &is_truncated,
+                                     get_default_max());
+    }
     if (op_ret < 0) {
       /* hmm.. something wrong here.. the user was authenticated, so it
          should exist */
@@ -1679,8 +1689,11 @@ void RGWStatAccount::execute()
   do {
     RGWUserBuckets buckets;
 
-    op_ret = rgw_read_user_buckets(store, s->user->user_id, buckets, marker,
-				   string(), max_buckets, true, &is_truncated);
+    {
+      RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_INDEX);
+      op_ret = rgw_read_user_buckets(store, s->user->user_id, buckets, marker,
+                                     string(), max_buckets, true, &is_truncated);
+    }
     if (op_ret < 0) {
       /* hmm.. something wrong here.. the user was authenticated, so it
          should exist */
@@ -1948,9 +1961,13 @@ void RGWListBucket::execute()
   list_op.params.marker = marker;
   list_op.params.end_marker = end_marker;
   list_op.params.list_versions = list_versions;
+  list_op.params.allow_unordered = allow_unordered;
 
-  op_ret = list_op.list_objects(max, &objs, &common_prefixes, &is_truncated);
-  if (op_ret >= 0 && !delimiter.empty()) {
+  {
+    RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_INDEX);
+    op_ret = list_op.list_objects(max, &objs, &common_prefixes, &is_truncated);
+  }
+  if (op_ret >= 0 && (!delimiter.empty() || allow_unordered)) {
     next_marker = list_op.get_next_marker();
   }
 }
@@ -2878,6 +2895,8 @@ void RGWPutObj::execute()
   boost::optional<RGWPutObj_Compress> compressor;
 
   bool need_calc_md5 = (dlo_manifest == NULL) && (slo_info == NULL);
+  RGWStreamHash md5_stream(&hash, chunked_upload ||
+                           s->content_length > s->cct->_conf->rgw_max_chunk_size);
 
   perfcounter->inc(l_rgw_put);
   op_ret = -EINVAL;
@@ -2999,7 +3018,7 @@ void RGWPutObj::execute()
     }
 
     if (need_calc_md5) {
-      hash.Update((const byte *)data.c_str(), data.length());
+      md5_stream.update(data);
     }
 
     /* save data for producing torrent data */
@@ -3016,7 +3035,10 @@ void RGWPutObj::execute()
       orig_data = data;
     }
 
-    op_ret = put_data_and_throttle(filter, data, ofs, need_to_wait);
+    {
+      RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_DATA);
+      op_ret = put_data_and_throttle(filter, data, ofs, need_to_wait);
+    }
     if (op_ret < 0) {
       if (!need_to_wait || op_ret != -EEXIST) {
         ldout(s->cct, 20) << "processor->thottle_data() returned ret="
@@ -3053,7 +3075,10 @@ void RGWPutObj::execute()
         filter = &*compressor;
       }
 
-      op_ret = put_data_and_throttle(filter, data, ofs, false);
+      {
+        RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_DATA);
+        op_ret = put_data_and_throttle(filter, data, ofs, false);
+      }
       if (op_ret < 0) {
         goto done;
       }
@@ -3103,6 +3128,15 @@ void RGWPutObj::execute()
     goto done;
   }
 
+  {
+    /* failing to queue the bucket for resharding is no reason to fail the upload */
+    int r = store->check_bucket_shards(s->bucket_info, s->bucket, bucket_quota);
+    if (r < 0) {
+      ldout(s->cct, 0) << "WARNING: check_bucket_shards() returned r=" << r << dendl;
+    }
+  }
+
+  md5_stream.flush();
   hash.Final(m);
 
   if (compressor && compressor->is_compressed()) {
@@ -3171,8 +3205,11 @@ void RGWPutObj::execute()
     emplace_attr(RGW_ATTR_SLO_UINDICATOR, std::move(slo_userindicator_bl));
   }
 
-  op_ret = processor->complete(s->obj_size, etag, &mtime, real_time(), attrs,
-                               delete_at, if_match, if_nomatch);
+  {
+    RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_DATA);
+    op_ret = processor->complete(s->obj_size, etag, &mtime, real_time(), attrs,
+                                 delete_at, if_match, if_nomatch);
+  }
 
   /* produce torrent */
   if (s->cct->_conf->rgw_torrent_flag && (ofs == torrent.get_data_len()))
@@ -3225,6 +3262,7 @@ void RGWPostObj::execute()
   char calc_md5[CEPH_CRYPTO_MD5_DIGESTSIZE * 2 + 1];
   unsigned char m[CEPH_CRYPTO_MD5_DIGESTSIZE];
   MD5 hash;
+  RGWStreamHash md5_stream(&hash, s->content_length > s->cct->_conf->rgw_max_chunk_size);
   buffer::list bl, aclbl;
   int len = 0;
   boost::optional<RGWPutObj_Compress> compressor;
@@ -3293,8 +3331,11 @@ void RGWPostObj::execute()
      if (!len)
        break;
 
-     hash.Update((const byte *)data.c_str(), data.length());
-     op_ret = put_data_and_throttle(filter, data, ofs, false);
+     md5_stream.update(data);
+     {
+       RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_DATA);
+       op_ret = put_data_and_throttle(filter, data, ofs, false);
+     }
 
      ofs += len;
 
@@ -3317,6 +3358,12 @@ void RGWPostObj::execute()
     return;
   }
 
+  int r = store->check_bucket_shards(s->bucket_info, s->bucket, bucket_quota);
+  if (r < 0) {
+    ldout(s->cct, 0) << "WARNING: check_bucket_shards() returned r=" << r << dendl;
+  }
+
+  md5_stream.flush();
   hash.Final(m);
   buf_to_hex(m, CEPH_CRYPTO_MD5_DIGESTSIZE, calc_md5);
 
@@ -3343,7 +3390,10 @@ void RGWPostObj::execute()
     emplace_attr(RGW_ATTR_COMPRESSION, std::move(tmp));
   }
 
-  op_ret = processor.complete(s->obj_size, etag, NULL, real_time(), attrs, delete_at);
+  {
+    RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_DATA);
+    op_ret = processor.complete(s->obj_size, etag, NULL, real_time(), attrs, delete_at);
+  }
 }
 
 
@@ -3742,7 +3792,10 @@ void RGWDeleteObj::execute()
       del_op.params.unmod_since = unmod_since;
       del_op.params.high_precision_time = s->system_request; /* system request uses high precision time */
 
-      op_ret = del_op.delete_obj();
+      {
+        RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_DATA);
+        op_ret = del_op.delete_obj();
+      }
       if (op_ret >= 0) {
         delete_marker = del_op.result.delete_marker;
         version_id = del_op.result.version_id;
@@ -3986,6 +4039,7 @@ void RGWCopyObj::execute()
     return;
   }
 
+  RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_DATA);
   op_ret = store->copy_obj(obj_ctx,
 			   s->user->user_id,
 			   client_id,
@@ -4756,6 +4810,101 @@ static int list_multipart_parts(RGWRados *store, struct req_state *s,
   return 0;
 }
 
+/*
+ * Read the infos of all the parts of an upload being completed.
+ *
+ * With v2 upload ids the part keys sort by part number, so the infos of
+ * each max_parts of the requested parts are read in parallel, each read
+ * starting after the part requested before them.  The last read asks for
+ * one more, as no part may follow the last one requested.  If what's found
+ * doesn't line up with the request, the parts are listed one page after
+ * the other instead, which also tells what doesn't match.
+ */
+static int read_multipart_parts(RGWRados *store, struct req_state *s,
+                                const string& upload_id, string& meta_oid,
+                                const map<int, string>& requested,
+                                map<uint32_t, RGWUploadPartInfo>& obj_parts)
+{
+  const int max_parts = 1000;
+  int ret;
+
+  obj_parts.clear();
+
+  if (is_v2_upload_id(upload_id)) {
+    vector<pair<string, uint64_t> > ranges;
+    int prev = 0;
+    auto iter = requested.begin();
+    while (iter != requested.end()) {
+      char buf[32];
+      snprintf(buf, sizeof(buf), "part.%08d", prev);
+      uint64_t count = 0;
+      for (; iter != requested.end() && count < max_parts; ++iter, ++count) {
+        prev = iter->first;
+      }
+      if (iter == requested.end()) {
+        count++;
+      }
+      ranges.push_back(make_pair(string(buf), count));
+    }
+
+    rgw_obj obj;
+    obj.init_ns(s->bucket, meta_oid, mp_ns);
+    obj.set_in_extra_data(true);
+
+    vector<map<string, bufferlist> > results;
+    ret = store->omap_get_vals_parallel(obj, ranges,
+                                        s->cct->_conf->rgw_multipart_complete_max_aio,
+                                        &results);
+    if (ret < 0) {
+      return ret;
+    }
+
+    bool matches = true;
+    auto riter = requested.begin();
+    for (auto& result : results) {
+      for (auto& entry : result) {
+        RGWUploadPartInfo info;
+        try {
+          bufferlist::iterator bli = entry.second.begin();
+          ::decode(info, bli);
+        } catch (buffer::error& err) {
+          ldout(s->cct, 0) << "ERROR: could not part info, caught buffer::error" << dendl;
+          return -EIO;
+        }
+        if (riter == requested.end() || (int)info.num != riter->first) {
+          matches = false;
+          break;
+        }
+        ++riter;
+        obj_parts[info.num] = std::move(info);
+      }
+      if (!matches) {
+        break;
+      }
+    }
+    if (matches && riter == requested.end()) {
+      return 0;
+    }
+    ldout(s->cct, 10) << "parts of upload " << upload_id
+                      << " don't match the request, listing them" << dendl;
+    obj_parts.clear();
+  }
+
+  int marker = 0;
+  bool truncated;
+  do {
+    map<uint32_t, RGWUploadPartInfo> parts;
+    ret = list_multipart_parts(store, s, upload_id, meta_oid, max_parts,
+                               marker, parts, &marker, &truncated);
+    if (ret < 0) {
+      return ret;
+    }
+    obj_parts.insert(parts.begin(), parts.end());
+  } while (truncated);
+
+  return 0;
+}
+
 int RGWCompleteMultipart::verify_permission()
 {
   if (!verify_bucket_permission(s, RGW_PERM_WRITE))
@@ -4829,11 +4978,7 @@ void RGWCompleteMultipart::execute()
   mp.init(s->object.name, upload_id);
   meta_oid = mp.get_meta();
 
-  int total_parts = 0;
   int handled_parts = 0;
-  int max_parts = 1000;
-  int marker = 0;
-  bool truncated;
   RGWCompressionInfo cs_info;
   bool compressed = false;
   uint64_t accounted_size = 0;
@@ -4844,8 +4989,6 @@ void RGWCompleteMultipart::execute()
 
   bool versioned_object = s->bucket_info.versioning_enabled();
 
-  iter = parts->parts.begin();
-
   meta_obj.init_ns(s->bucket, meta_oid, mp_ns);
   meta_obj.set_in_extra_data(true);
   meta_obj.index_hash_source = s->object.name;
@@ -4857,102 +5000,101 @@ void RGWCompleteMultipart::execute()
     return;
   }
 
-  do {
-    op_ret = list_multipart_parts(store, s, upload_id, meta_oid, max_parts,
-				  marker, obj_parts, &marker, &truncated);
-    if (op_ret == -ENOENT) {
-      op_ret = -ERR_NO_SUCH_UPLOAD;
-    }
-    if (op_ret < 0)
+  op_ret = read_multipart_parts(store, s, upload_id, meta_oid, parts->parts,
+                                obj_parts);
+  if (op_ret == -ENOENT) {
+    op_ret = -ERR_NO_SUCH_UPLOAD;
+  }
+  if (op_ret < 0)
+    return;
+
+  if (obj_parts.size() != parts->parts.size()) {
+    ldout(s->cct, 0) << "NOTICE: total parts mismatch: have: " << obj_parts.size()
+		     << " expected: " << parts->parts.size() << dendl;
+    op_ret = -ERR_INVALID_PART;
+    return;
+  }
+
+  for (iter = parts->parts.begin(), obj_iter = obj_parts.begin();
+       iter != parts->parts.end() && obj_iter != obj_parts.end();
+       ++iter, ++obj_iter, ++handled_parts) {
+    uint64_t part_size = obj_iter->second.accounted_size;
+    if (handled_parts < (int)parts->parts.size() - 1 &&
+        part_size < min_part_size) {
+      op_ret = -ERR_TOO_SMALL;
       return;
+    }
 
-    total_parts += obj_parts.size();
-    if (!truncated && total_parts != (int)parts->parts.size()) {
-      ldout(s->cct, 0) << "NOTICE: total parts mismatch: have: " << total_parts
-		       << " expected: " << parts->parts.size() << dendl;
+    char petag[CEPH_CRYPTO_MD5_DIGESTSIZE];
+    if (iter->first != (int)obj_iter->first) {
+      ldout(s->cct, 0) << "NOTICE: parts num mismatch: next requested: "
+		       << iter->first << " next uploaded: "
+		       << obj_iter->first << dendl;
+      op_ret = -ERR_INVALID_PART;
+      return;
+    }
+    string part_etag = rgw_string_unquote(iter->second);
+    if (part_etag.compare(obj_iter->second.etag) != 0) {
+      ldout(s->cct, 0) << "NOTICE: etag mismatch: part: " << iter->first
+		       << " etag: " << iter->second << dendl;
       op_ret = -ERR_INVALID_PART;
       return;
     }
 
-    for (obj_iter = obj_parts.begin(); iter != parts->parts.end() && obj_iter != obj_parts.end(); ++iter, ++obj_iter, ++handled_parts) {
-      uint64_t part_size = obj_iter->second.accounted_size;
-      if (handled_parts < (int)parts->parts.size() - 1 &&
-          part_size < min_part_size) {
-        op_ret = -ERR_TOO_SMALL;
-        return;
-      }
-
-      char petag[CEPH_CRYPTO_MD5_DIGESTSIZE];
-      if (iter->first != (int)obj_iter->first) {
-        ldout(s->cct, 0) << "NOTICE: parts num mismatch: next requested: "
-			 << iter->first << " next uploaded: "
-			 << obj_iter->first << dendl;
-        op_ret = -ERR_INVALID_PART;
-        return;
-      }
-      string part_etag = rgw_string_unquote(iter->second);
-      if (part_etag.compare(obj_iter->second.etag) != 0) {
-        ldout(s->cct, 0) << "NOTICE: etag mismatch: part: " << iter->first
-			 << " etag: " << iter->second << dendl;
-        op_ret = -ERR_INVALID_PART;
-        return;
-      }
+    hex_to_buf(obj_iter->second.etag.c_str(), petag,
+	      CEPH_CRYPTO_MD5_DIGESTSIZE);
+    hash.Update((const byte *)petag, sizeof(petag));
 
-      hex_to_buf(obj_iter->second.etag.c_str(), petag,
-		CEPH_CRYPTO_MD5_DIGESTSIZE);
-      hash.Update((const byte *)petag, sizeof(petag));
+    RGWUploadPartInfo& obj_part = obj_iter->second;
 
-      RGWUploadPartInfo& obj_part = obj_iter->second;
+    /* update manifest for part */
+    string oid = mp.get_part(obj_iter->second.num);
+    rgw_obj src_obj;
+    src_obj.init_ns(s->bucket, oid, mp_ns);
 
-      /* update manifest for part */
-      string oid = mp.get_part(obj_iter->second.num);
-      rgw_obj src_obj;
-      src_obj.init_ns(s->bucket, oid, mp_ns);
+    if (obj_part.manifest.empty()) {
+      ldout(s->cct, 0) << "ERROR: empty manifest for object part: obj="
+		       << src_obj << dendl;
+      op_ret = -ERR_INVALID_PART;
+      return;
+    } else {
+      manifest.append(obj_part.manifest);
+    }
 
-      if (obj_part.manifest.empty()) {
-        ldout(s->cct, 0) << "ERROR: empty manifest for object part: obj="
-			 << src_obj << dendl;
+    if (obj_part.cs_info.compression_type != "none") {
+      if (compressed && cs_info.compression_type != obj_part.cs_info.compression_type) {
+        ldout(s->cct, 0) << "ERROR: compression type was changed during multipart upload ("
+                         << cs_info.compression_type << ">>" << obj_part.cs_info.compression_type << ")" << dendl;
         op_ret = -ERR_INVALID_PART;
         return;
-      } else {
-        manifest.append(obj_part.manifest);
       }
-
-      if (obj_part.cs_info.compression_type != "none") {
-        if (compressed && cs_info.compression_type != obj_part.cs_info.compression_type) {
-          ldout(s->cct, 0) << "ERROR: compression type was changed during multipart upload ("
-                           << cs_info.compression_type << ">>" << obj_part.cs_info.compression_type << ")" << dendl;
-          op_ret = -ERR_INVALID_PART;
-          return;
-        }
-        int new_ofs; // offset in compression data for new part
-        if (cs_info.blocks.size() > 0)
-          new_ofs = cs_info.blocks.back().new_ofs + cs_info.blocks.back().len;
-        else
-          new_ofs = 0;
-        for (const auto& block : obj_part.cs_info.blocks) {
-          compression_block cb;
-          cb.old_ofs = block.old_ofs + cs_info.orig_size;
-          cb.new_ofs = new_ofs;
-          cb.len = block.len;
-          cs_info.blocks.push_back(cb);
-          new_ofs = cb.new_ofs + cb.len;
-        } 
-        if (!compressed)
-          cs_info.compression_type = obj_part.cs_info.compression_type;
-        cs_info.orig_size += obj_part.cs_info.orig_size;
-        compressed = true;
-      }
-
-      rgw_obj_key remove_key;
-      src_obj.get_index_key(&remove_key);
-
-      remove_objs.push_back(remove_key);
-
-      ofs += obj_part.size;
-      accounted_size += obj_part.accounted_size;
-    }
-  } while (truncated);
+      int new_ofs; // offset in compression data for new part
+      if (cs_info.blocks.size() > 0)
+        new_ofs = cs_info.blocks.back().new_ofs + cs_info.blocks.back().len;
+      else
+        new_ofs = 0;
+      for (const auto& block : obj_part.cs_info.blocks) {
+        compression_block cb;
+        cb.old_ofs = block.old_ofs + cs_info.orig_size;
+        cb.new_ofs = new_ofs;
+        cb.len = block.len;
+        cs_info.blocks.push_back(cb);
+        new_ofs = cb.new_ofs + cb.len;
+      } 
+      if (!compressed)
+        cs_info.compression_type = obj_part.cs_info.compression_type;
+      cs_info.orig_size += obj_part.cs_info.orig_size;
+      compressed = true;
+    }
+
+    rgw_obj_key remove_key;
+    src_obj.get_index_key(&remove_key);
+
+    remove_objs.push_back(remove_key);
+
+    ofs += obj_part.size;
+    accounted_size += obj_part.accounted_size;
+  }
   hash.Final((byte *)final_etag);
 
   buf_to_hex((unsigned char *)final_etag, sizeof(final_etag), final_etag_str);
@@ -4981,6 +5123,11 @@ void RGWCompleteMultipart::execute()
 
   obj_ctx.set_atomic(target_obj);
 
+  /* the upload obj leaves the index along with the parts */
+  rgw_obj_key meta_key;
+  meta_obj.get_index_key(&meta_key);
+  remove_objs.push_back(meta_key);
+
   RGWRados::Object op_target(store, s->bucket_info, *static_cast<RGWObjectCtx *>(s->obj_ctx), target_obj);
   RGWRados::Object::Write obj_op(&op_target);
 
@@ -4995,8 +5142,7 @@ void RGWCompleteMultipart::execute()
     return;
 
   // remove the upload obj
-  int r = store->delete_obj(*static_cast<RGWObjectCtx *>(s->obj_ctx),
-			    s->bucket_info, meta_obj, 0);
+  int r = store->delete_raw_obj_async(meta_obj, s->req_id);
   if (r < 0) {
     ldout(store->ctx(), 0) << "WARNING: failed to remove object " << meta_obj << dendl;
   }
@@ -5184,8 +5330,11 @@ void RGWListBucketMultiparts::execute()
   list_op.params.ns = mp_ns;
   list_op.params.filter = &mp_filter;
 
-  op_ret = list_op.list_objects(max_uploads, &objs, &common_prefixes,
-				&is_truncated);
+  {
+    RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_INDEX);
+    op_ret = list_op.list_objects(max_uploads, &objs, &common_prefixes,
+                                  &is_truncated);
+  }
   if (!objs.empty()) {
     vector<RGWObjEnt>::iterator iter;
     RGWMultipartUploadEntry entry;
@@ -5230,6 +5379,8 @@ void RGWDeleteMultiObj::execute()
   RGWMultiDelXMLParser parser;
   int num_processed = 0;
   RGWObjectCtx *obj_ctx = static_cast<RGWObjectCtx *>(s->obj_ctx);
+  vector<rgw_obj> objs;
+  vector<string> index_tags;
 
   op_ret = get_params();
   if (op_ret < 0) {
@@ -5266,12 +5417,29 @@ void RGWDeleteMultiObj::execute()
   }
 
   for (iter = multi_delete->objects.begin();
-        iter != multi_delete->objects.end() && num_processed < max_to_delete;
-        ++iter, num_processed++) {
+       iter != multi_delete->objects.end() && (int)objs.size() < max_to_delete;
+       ++iter) {
     rgw_obj obj(bucket, iter->name);
     obj.set_instance(iter->instance);
 
     obj_ctx->set_atomic(obj);
+    objs.push_back(obj);
+  }
+
+  /* one index op per shard for all the keys rather than one per key */
+  {
+    RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_INDEX);
+    op_ret = store->prepare_del_index_batch(*obj_ctx, s->bucket_info, objs, &index_tags);
+  }
+  if (op_ret < 0) {
+    ldout(s->cct, 5) << "WARNING: failed to prepare index entries: ret=" << op_ret << dendl;
+    index_tags.assign(objs.size(), string());
+  }
+
+  for (iter = multi_delete->objects.begin();
+        iter != multi_delete->objects.end() && num_processed < max_to_delete;
+        ++iter, num_processed++) {
+    rgw_obj& obj = objs[num_processed];
 
     RGWRados::Object del_target(store, s->bucket_info, *obj_ctx, obj);
     RGWRados::Object::Delete del_op(&del_target);
@@ -5279,8 +5447,12 @@ void RGWDeleteMultiObj::execute()
     del_op.params.bucket_owner = s->bucket_owner.get_id();
     del_op.params.versioning_status = s->bucket_info.versioning_status();
     del_op.params.obj_owner = s->owner;
+    del_op.params.index_tag = index_tags[num_processed];
 
-    op_ret = del_op.delete_obj();
+    {
+      RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_DATA);
+      op_ret = del_op.delete_obj();
+    }
     if (op_ret == -ENOENT) {
       op_ret = 0;
     }
@@ -5324,7 +5496,8 @@ bool RGWBulkDelete::Deleter::verify_permission(RGWBucketInfo& binfo,
   return verify_bucket_permission(s, s->user_acl.get(), &bacl, RGW_PERM_WRITE);
 }
 
-bool RGWBulkDelete::Deleter::delete_single(const acct_path_t& path)
+bool RGWBulkDelete::Deleter::delete_single(const acct_path_t& path,
+                                           const std::string& index_tag)
 {
   auto& obj_ctx = *static_cast<RGWObjectCtx *>(s->obj_ctx);
 
@@ -5354,6 +5527,7 @@ bool RGWBulkDelete::Deleter::delete_single(const acct_path_t& path)
     del_op.params.bucket_owner = binfo.owner;
     del_op.params.versioning_status = binfo.versioning_status();
     del_op.params.obj_owner = bowner;
+    del_op.params.index_tag = index_tag;
 
     ret = del_op.delete_obj();
     if (ret < 0) {
@@ -5436,12 +5610,68 @@ delop_fail:
     return false;
 }
 
+/* prepare the index entries of objects in [first, last), all of one bucket;
+ * the ones that can't be are left to delete_single() */
+void RGWBulkDelete::Deleter::prepare_objs(std::list<acct_path_t>::const_iterator first,
+                                          std::list<acct_path_t>::const_iterator last,
+                                          std::vector<std::string> *index_tags)
+{
+  auto& obj_ctx = *static_cast<RGWObjectCtx *>(s->obj_ctx);
+
+  RGWBucketInfo binfo;
+  map<string, bufferlist> battrs;
+  ACLOwner bowner;
+
+  index_tags->assign(std::distance(first, last), string());
+
+  int ret = store->get_bucket_info(obj_ctx, s->user->user_id.tenant,
+                                   first->bucket_name, binfo, nullptr,
+                                   &battrs);
+  if (ret < 0 || !verify_permission(binfo, battrs, bowner)) {
+    return;
+  }
+
+  vector<rgw_obj> objs;
+  for (auto iter = first; iter != last; ++iter) {
+    rgw_obj obj(binfo.bucket, iter->obj_key);
+    obj_ctx.set_atomic(obj);
+    objs.push_back(obj);
+  }
+
+  ret = store->prepare_del_index_batch(obj_ctx, binfo, objs, index_tags);
+  if (ret < 0) {
+    ldout(store->ctx(), 5) << "WARNING: failed to prepare index entries: ret="
+                           << ret << dendl;
+    index_tags->assign(objs.size(), string());
+  }
+}
+
 bool RGWBulkDelete::Deleter::delete_chunk(const std::list<acct_path_t>& paths)
 {
   ldout(store->ctx(), 20) << "in delete_chunk" << dendl;
-  for (auto path : paths) {
-    ldout(store->ctx(), 20) << "bulk deleting path: " << path << dendl;
-    delete_single(path);
+  auto iter = paths.begin();
+  while (iter != paths.end()) {
+    if (iter->obj_key.empty()) {
+      ldout(store->ctx(), 20) << "bulk deleting path: " << *iter << dendl;
+      delete_single(*iter);
+      ++iter;
+      continue;
+    }
+
+    /* objects of a bucket that come in a row are deleted together */
+    auto last = std::next(iter);
+    while (last != paths.end() && !last->obj_key.empty() &&
+           last->bucket_name == iter->bucket_name) {
+      ++last;
+    }
+
+    std::vector<std::string> index_tags;
+    prepare_objs(iter, last, &index_tags);
+
+    for (size_t i = 0; iter != last; ++iter, ++i) {
+      ldout(store->ctx(), 20) << "bulk deleting path: " << *iter << dendl;
+      delete_single(*iter, index_tags[i]);
+    }
   }
 
   return true;
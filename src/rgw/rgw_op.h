@@ -287,7 +287,11 @@ public:
     bool verify_permission(RGWBucketInfo& binfo,
                            map<string, bufferlist>& battrs,
                            ACLOwner& bucket_owner /* out */);
-    bool delete_single(const acct_path_t& path);
+    bool delete_single(const acct_path_t& path,
+                       const std::string& index_tag = std::string());
+    void prepare_objs(std::list<acct_path_t>::const_iterator first,
+                      std::list<acct_path_t>::const_iterator last,
+                      std::vector<std::string> *index_tags);
     bool delete_chunk(const std::list<acct_path_t>& paths);
   };
   /* End of Deleter subclass */
@@ -428,6 +432,7 @@ protected:
   string delimiter;
   string encoding_type;
   bool list_versions;
+  bool allow_unordered;
   int max;
   vector<RGWObjEnt> objs;
   map<string, bool> common_prefixes;
@@ -440,7 +445,7 @@ protected:
   int parse_max_keys();
 
 public:
-  RGWListBucket() : list_versions(false), max(0),
+  RGWListBucket() : list_versions(false), allow_unordered(false), max(0),
                     default_max(0), is_truncated(false), shard_id(-1) {}
   int verify_permission();
   void pre_exec();
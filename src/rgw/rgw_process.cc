@@ -12,6 +12,7 @@
 #include "rgw_process.h"
 #include "rgw_loadgen.h"
 #include "rgw_client_io.h"
+#include "rgw_slow_requests.h"
 
 #define dout_subsys ceph_subsys_rgw
 
@@ -40,7 +41,11 @@ int rgw_process_authenticated(RGWHandler_REST * const handler,
                               const bool skip_retarget)
 {
   req->log(s, "init permissions");
-  int ret = handler->init_permissions(op);
+  int ret;
+  {
+    RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_BUCKET_INFO);
+    ret = handler->init_permissions(op);
+  }
   if (ret < 0) {
     return ret;
   }
@@ -62,7 +67,10 @@ int rgw_process_authenticated(RGWHandler_REST * const handler,
 
   /* If necessary extract object ACL and put them into req_state. */
   req->log(s, "reading permissions");
-  ret = handler->read_permissions(op);
+  {
+    RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_DATA);
+    ret = handler->read_permissions(op);
+  }
   if (ret < 0) {
     return ret;
   }
@@ -114,7 +122,8 @@ int process_request(RGWRados* const store,
                     RGWRequest* const req,
                     const std::string& frontend_prefix,
                     RGWRestfulIO* const client_io,
-                    OpsLogSocket* const olog)
+                    OpsLogSocket* const olog,
+                    optional_yield_context yield)
 {
   int ret = 0;
 
@@ -134,6 +143,7 @@ int process_request(RGWRados* const store,
   struct req_state *s = &rstate;
 
   RGWObjectCtx rados_ctx(store, s);
+  rados_ctx.yield_ctx = yield;
   s->obj_ctx = &rados_ctx;
 
   s->req_id = store->unique_id(req->id);
@@ -169,7 +179,10 @@ int process_request(RGWRados* const store,
   s->op_type = op->get_type();
 
   req->log(s, "authorizing");
-  ret = handler->authorize();
+  {
+    RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_AUTH);
+    ret = handler->authorize();
+  }
   if (ret < 0) {
     dout(10) << "failed to authorize request" << dendl;
     abort_early(s, NULL, ret, handler);
@@ -203,12 +216,16 @@ int process_request(RGWRados* const store,
   }
 done:
   try {
+    RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_CLIENT);
     client_io->complete_request();
   } catch (rgw::io::Exception& e) {
     dout(0) << "ERROR: client_io->complete_request() returned "
             << e.what() << dendl;
   }
 
+  /* account the time since the last phase switch */
+  s->set_phase(RGW_REQ_PHASE_OTHER);
+
   if (should_log) {
     rgw_log_op(store, rest, s, (op ? op->name() : "unknown"), olog);
   }
@@ -222,6 +239,25 @@ done:
   req->log_format(s, "op status=%d", op_ret);
   req->log_format(s, "http status=%d", http_ret);
 
+  utime_t lat = ceph_clock_now() - s->time;
+  if (s->op == OP_GET) {
+    perfcounter->hinc(l_rgw_get_lat_bytes_hist, lat.to_nsec(),
+                      client_io->get_bytes_sent());
+  } else if (s->op == OP_PUT) {
+    perfcounter->hinc(l_rgw_put_lat_bytes_hist, lat.to_nsec(),
+                      client_io->get_bytes_received());
+  }
+  perfcounter->hinc(l_rgw_req_lat_op_hist, lat.to_nsec(), s->op_type);
+  for (int i = RGW_REQ_PHASE_AUTH; i < RGW_REQ_PHASE_MAX; i++) {
+    perfcounter->hinc(l_rgw_req_auth_lat_op_hist + i - RGW_REQ_PHASE_AUTH,
+                      std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        s->phase_time[i]).count(),
+                      s->op_type);
+  }
+  if (rgw_is_slow_request(s->cct, lat)) {
+    rgw_slow_requests_add(s, (op ? op->name() : "unknown"), lat);
+  }
+
   if (handler)
     handler->put_op(op);
   rest->put_handler(handler);
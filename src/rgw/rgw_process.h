@@ -10,6 +10,7 @@
 #include "rgw_user.h"
 #include "rgw_op.h"
 #include "rgw_rest.h"
+#include "rgw_loadgen.h"
 
 #include "include/assert.h"
 
@@ -166,17 +167,42 @@ public:
   }
 };
 
+struct RGWLoadGenRequest;
+
 class RGWLoadGenProcess : public RGWProcess {
   RGWAccessKey access_key;
+
+  struct Obj {
+    string resource;
+    uint64_t size;
+  };
+
+  uint64_t part_size{0};
+  string report_path;
+
+  Mutex lock; ///< guards objs and stats
+  vector<Obj> objs; ///< written and not deleted
+  RGWLoadGenOpStats stats[RGW_LOADGEN_OP_MAX];
+
+  int send_request(RGWRequest* req, const string& method,
+		   const string& resource,
+		   const map<string, string>& sub_resources,
+		   const string& body, uint64_t content_length,
+		   string* out, string* etag);
+  int multipart_upload(RGWLoadGenRequest* req);
+  void report(const char* phase, ceph::timespan elapsed);
+
 public:
   RGWLoadGenProcess(CephContext* cct, RGWProcessEnv* pe, int num_threads,
 		  RGWFrontendConfig* _conf) :
-  RGWProcess(cct, pe, num_threads, _conf) {}
+  RGWProcess(cct, pe, num_threads, _conf), lock("RGWLoadGenProcess") {}
   void run();
   void checkpoint();
   void handle_request(RGWRequest* req);
   void gen_request(const string& method, const string& resource,
-		  int content_length, atomic_t* fail_flag);
+		   uint64_t content_length, atomic_t* fail_flag,
+		   int op = -1, uint64_t size = 0,
+		   ceph::mono_time scheduled = ceph::mono_clock::now());
 
   void set_access_key(RGWAccessKey& key) { access_key = key; }
 };
@@ -187,7 +213,8 @@ extern int process_request(RGWRados* store,
                            RGWRequest* req,
                            const std::string& frontend_prefix,
                            RGWRestfulIO* client_io,
-                           OpsLogSocket* olog);
+                           OpsLogSocket* olog,
+                           optional_yield_context yield = optional_yield_context());
 
 extern int rgw_process_authenticated(RGWHandler_REST* handler,
                                      RGWOp*& op,
@@ -43,6 +43,19 @@ protected:
   lru_map<T, RGWQuotaCacheStats> stats_map;
   RefCountedWaitObject *async_refcount;
 
+  /* a stats read from storage that other requests for the same key wait
+   * on, rather than each reading every index shard of the bucket */
+  struct PendingFetch {
+    bool done{false};
+    int ret{0};
+    RGWStorageStats stats;
+  };
+  Mutex fetch_lock;
+  Cond fetch_cond;
+  map<T, std::shared_ptr<PendingFetch> > fetches;
+
+  int fetch_stats(const rgw_user& user, rgw_bucket& bucket, RGWStorageStats& stats);
+
   class StatsAsyncTestSet : public lru_map<T, RGWQuotaCacheStats>::UpdateContext {
     int objs_delta;
     uint64_t added_bytes;
@@ -61,6 +74,7 @@ protected:
 
   virtual int fetch_stats_from_storage(const rgw_user& user, rgw_bucket& bucket, RGWStorageStats& stats) = 0;
 
+  virtual T map_key(const rgw_user& user, rgw_bucket& bucket) = 0;
   virtual bool map_find(const rgw_user& user, rgw_bucket& bucket, RGWQuotaCacheStats& qs) = 0;
 
   virtual bool map_find_and_update(const rgw_user& user, rgw_bucket& bucket, typename lru_map<T, RGWQuotaCacheStats>::UpdateContext *ctx) = 0;
@@ -68,7 +82,8 @@ protected:
 
   virtual void data_modified(const rgw_user& user, rgw_bucket& bucket) {}
 public:
-  RGWQuotaCache(RGWRados *_store, int size) : store(_store), stats_map(size) {
+  RGWQuotaCache(RGWRados *_store, int size) : store(_store), stats_map(size),
+                                              fetch_lock("RGWQuotaCache::fetch_lock") {
     async_refcount = new RefCountedWaitObject;
   }
   virtual ~RGWQuotaCache() {
@@ -195,14 +210,17 @@ int RGWQuotaCache<T>::get_stats(const rgw_user& user, rgw_bucket& bucket, RGWSto
       }
     }
 
-    if (can_use_cached_stats(quota, qs.stats) && qs.expiration >
-	ceph_clock_now()) {
+    /* expired stats are still good for a while, the refresh started above
+     * replaces them without holding up the request */
+    utime_t stale_limit = qs.expiration;
+    stale_limit += store->ctx()->_conf->rgw_bucket_quota_stale_ttl;
+    if (can_use_cached_stats(quota, qs.stats) && stale_limit > now) {
       stats = qs.stats;
       return 0;
     }
   }
 
-  int ret = fetch_stats_from_storage(user, bucket, stats);
+  int ret = fetch_stats(user, bucket, stats);
   if (ret < 0 && ret != -ENOENT)
     return ret;
 
@@ -211,6 +229,39 @@ int RGWQuotaCache<T>::get_stats(const rgw_user& user, rgw_bucket& bucket, RGWSto
   return 0;
 }
 
+template<class T>
+int RGWQuotaCache<T>::fetch_stats(const rgw_user& user, rgw_bucket& bucket, RGWStorageStats& stats)
+{
+  const T key = map_key(user, bucket);
+
+  Mutex::Locker l(fetch_lock);
+  auto iter = fetches.find(key);
+  if (iter != fetches.end()) {
+    std::shared_ptr<PendingFetch> fetch = iter->second;
+    ldout(store->ctx(), 20) << "quota: waiting for stats read in progress for bucket=" << bucket << dendl;
+    while (!fetch->done) {
+      fetch_cond.Wait(fetch_lock);
+    }
+    stats = fetch->stats;
+    return fetch->ret;
+  }
+
+  auto fetch = std::make_shared<PendingFetch>();
+  fetches[key] = fetch;
+  fetch_lock.Unlock();
+
+  int ret = fetch_stats_from_storage(user, bucket, fetch->stats);
+
+  fetch_lock.Lock();
+  fetch->ret = ret;
+  fetch->done = true;
+  fetches.erase(key);
+  fetch_cond.SignalAll();
+
+  stats = fetch->stats;
+  return ret;
+}
+
 
 template<class T>
 class RGWQuotaStatsUpdate : public lru_map<T, RGWQuotaCacheStats>::UpdateContext {
@@ -300,6 +351,10 @@ void BucketAsyncRefreshHandler::handle_response(const int r)
 
 class RGWBucketStatsCache : public RGWQuotaCache<rgw_bucket> {
 protected:
+  rgw_bucket map_key(const rgw_user& user, rgw_bucket& bucket) override {
+    return bucket;
+  }
+
   bool map_find(const rgw_user& user, rgw_bucket& bucket, RGWQuotaCacheStats& qs) override {
     return stats_map.find(bucket, qs);
   }
@@ -485,6 +540,10 @@ class RGWUserStatsCache : public RGWQuotaCache<rgw_user> {
   BucketsSyncThread *buckets_sync_thread;
   UserSyncThread *user_sync_thread;
 protected:
+  rgw_user map_key(const rgw_user& user, rgw_bucket& bucket) override {
+    return user;
+  }
+
   bool map_find(const rgw_user& user, rgw_bucket& bucket, RGWQuotaCacheStats& qs) override {
     return stats_map.find(user, qs);
   }
@@ -909,6 +968,28 @@ public:
     bucket_stats_cache.adjust_stats(user, bucket, obj_delta, added_bytes, removed_bytes);
     user_stats_cache.adjust_stats(user, bucket, obj_delta, added_bytes, removed_bytes);
   }
+
+  int check_bucket_shards(uint64_t max_objs_per_shard, uint64_t num_shards,
+                          const rgw_user& user, rgw_bucket& bucket,
+                          RGWQuotaInfo& bucket_quota, uint64_t num_objs,
+                          bool& need_resharding, uint32_t *suggested_num_shards) override
+  {
+    RGWStorageStats bucket_stats;
+    int ret = bucket_stats_cache.get_stats(user, bucket, bucket_stats,
+                                           bucket_quota);
+    if (ret < 0) {
+      return ret;
+    }
+
+    need_resharding = (bucket_stats.num_objects + num_objs >
+                       num_shards * max_objs_per_shard);
+    if (need_resharding && suggested_num_shards) {
+      /* leave room for the bucket to double before it needs resharding again */
+      *suggested_num_shards = (bucket_stats.num_objects + num_objs) * 2 / max_objs_per_shard;
+    }
+
+    return 0;
+  }
 };
 
 
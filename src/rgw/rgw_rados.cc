@@ -20,10 +20,12 @@
 
 #include "rgw_rados.h"
 #include "rgw_cache.h"
+#include "rgw_data_cache.h"
 #include "rgw_acl.h"
 #include "rgw_acl_s3.h" /* for dumping s3policy in debug log */
 #include "rgw_lc.h"
 #include "rgw_lc_s3.h"
+#include "rgw_reshard.h"
 #include "rgw_metadata.h"
 #include "rgw_bucket.h"
 #include "rgw_rest_conn.h"
@@ -2995,6 +2997,135 @@ int RGWDataNotifier::process()
   return 0;
 }
 
+/*
+ * Bucket index completions are sent asynchronously and nobody waits for
+ * them.  The ones a reshard refused are parked here and sent again, to
+ * wherever the bucket index ended up, once the reshard is out of the way.
+ */
+struct complete_op_data {
+  RGWIndexCompletionThread *manager;
+  rgw_bucket bucket;
+  rgw_obj obj;
+  RGWModifyOp op;
+  string tag;
+  rgw_bucket_entry_ver ver;
+  cls_rgw_obj_key key;
+  rgw_bucket_dir_entry_meta dir_meta;
+  list<cls_rgw_obj_key> remove_objs;
+  bool log_op;
+  uint16_t bilog_flags;
+};
+
+class RGWIndexCompletionThread : public RGWRadosThread {
+  Mutex completions_lock;
+  Cond cond;
+  list<complete_op_data *> completions;
+  int in_flight;
+
+  uint64_t interval_msec() override {
+    return 1000;
+  }
+public:
+  RGWIndexCompletionThread(RGWRados *_store)
+    : RGWRadosThread(_store, "index-complete"),
+      completions_lock("RGWIndexCompletionThread::completions_lock"),
+      in_flight(0) {}
+  ~RGWIndexCompletionThread() override;
+
+  complete_op_data *create_completion();
+  void handle_completion(complete_op_data *c, int r);
+  static void obj_complete_cb(librados::completion_t cb, void *arg);
+  void drain();
+
+  int process() override;
+};
+
+RGWIndexCompletionThread::~RGWIndexCompletionThread()
+{
+  for (auto c : completions) {
+    delete c;
+  }
+}
+
+complete_op_data *RGWIndexCompletionThread::create_completion()
+{
+  complete_op_data *c = new complete_op_data;
+  c->manager = this;
+
+  Mutex::Locker l(completions_lock);
+  ++in_flight;
+  return c;
+}
+
+void RGWIndexCompletionThread::handle_completion(complete_op_data *c, int r)
+{
+  Mutex::Locker l(completions_lock);
+  if (r == -ERR_BUSY_RESHARDING && !going_down()) {
+    completions.push_back(c);
+  } else {
+    delete c;
+  }
+  if (--in_flight == 0) {
+    cond.Signal();
+  }
+}
+
+void RGWIndexCompletionThread::obj_complete_cb(librados::completion_t cb, void *arg)
+{
+  complete_op_data *c = static_cast<complete_op_data *>(arg);
+  c->manager->handle_completion(c, rados_aio_get_return_value(cb));
+}
+
+void RGWIndexCompletionThread::drain()
+{
+  Mutex::Locker l(completions_lock);
+  while (in_flight > 0) {
+    cond.Wait(completions_lock);
+  }
+}
+
+int RGWIndexCompletionThread::process()
+{
+  list<complete_op_data *> comps;
+  {
+    Mutex::Locker l(completions_lock);
+    comps.swap(completions);
+  }
+
+  for (auto c : comps) {
+    std::unique_ptr<complete_op_data> up(c);
+    if (going_down()) {
+      continue;
+    }
+
+    ldout(cct, 20) << __func__ << "(): resending completion for " << c->obj << dendl;
+
+    RGWRados::BucketShard bs(store);
+    int r = bs.init(c->bucket, c->obj);
+    if (r < 0) {
+      ldout(cct, 0) << "ERROR: " << __func__ << "(): failed to initialize BucketShard, obj=" << c->obj << " r=" << r << dendl;
+      continue;
+    }
+    r = store->guard_reshard(&bs, c->obj, [&](RGWRados::BucketShard *bs) -> int {
+      librados::ObjectWriteOperation o;
+      cls_rgw_bucket_complete_op(o, c->op, c->tag, c->ver, c->key, c->dir_meta,
+                                 &c->remove_objs, c->log_op, c->bilog_flags);
+      return bs->index_ctx.operate(bs->bucket_obj, &o);
+    });
+    if (r < 0) {
+      ldout(cct, 0) << "ERROR: " << __func__ << "(): bucket index completion failed, obj=" << c->obj << " r=" << r << dendl;
+      /* ignoring error, can't do anything about it */
+      continue;
+    }
+    r = store->data_log->add_entry(bs.bucket, bs.shard_id);
+    if (r < 0) {
+      lderr(cct) << "ERROR: failed writing data log" << dendl;
+    }
+  }
+
+  return 0;
+}
+
 class RGWSyncProcessorThread : public RGWRadosThread {
 public:
   RGWSyncProcessorThread(RGWRados *_store, const string& thread_name = "radosgw") : RGWRadosThread(_store, thread_name) {}
@@ -3275,6 +3406,12 @@ void RGWRados::finalize()
     data_notifier->stop();
     delete data_notifier;
   }
+  if (index_completion_thread) {
+    index_completion_thread->stop();
+    index_completion_thread->drain();
+    delete index_completion_thread;
+    index_completion_thread = NULL;
+  }
   delete data_log;
   if (async_rados) {
     delete async_rados;
@@ -3292,6 +3429,12 @@ void RGWRados::finalize()
   delete lc;
   lc = NULL;
 
+  if (reshard) {
+    reshard->stop_processor();
+  }
+  delete reshard;
+  reshard = NULL;
+
   delete obj_expirer;
   obj_expirer = NULL;
 
@@ -3314,6 +3457,8 @@ void RGWRados::finalize()
   delete meta_mgr;
   delete binfo_cache;
   delete obj_tombstone_cache;
+  delete get_obj_throttle;
+  delete data_cache;
   delete sync_modules_manager;
 }
 
@@ -4006,6 +4151,10 @@ int RGWRados::init_complete()
   if (ret < 0)
     return ret;
 
+  ret = open_reshard_pool_ctx();
+  if (ret < 0)
+    return ret;
+
   pools_initialized = true;
 
   gc = new RGWGC();
@@ -4083,6 +4232,9 @@ int RGWRados::init_complete()
   data_notifier = new RGWDataNotifier(this);
   data_notifier->start();
 
+  index_completion_thread = new RGWIndexCompletionThread(this);
+  index_completion_thread->start();
+
   lc = new RGWLC();
   lc->initialize(cct, this);
   
@@ -4109,6 +4261,17 @@ int RGWRados::init_complete()
     obj_tombstone_cache = new tombstone_cache_t(cct->_conf->rgw_obj_tombstone_cache_size);
   }
 
+  if (cct->_conf->rgw_get_obj_max_memory) {
+    get_obj_throttle = new Throttle(cct, "rgw_get_obj_memory",
+                                    cct->_conf->rgw_get_obj_max_memory);
+  }
+
+  reshard = new RGWReshard(this);
+
+  if (use_gc_thread && cct->_conf->rgw_dynamic_resharding) {
+    reshard->start_processor();
+  }
+
   return ret;
 }
 
@@ -4312,6 +4475,25 @@ int RGWRados::open_objexp_pool_ctx()
   return r;
 }
 
+int RGWRados::open_reshard_pool_ctx()
+{
+  const char * const pool_name = get_zone_params().log_pool.name.c_str();
+  librados::Rados * const rad = get_rados_handle();
+  int r = rad->ioctx_create(pool_name, reshard_pool_ctx);
+  if (r == -ENOENT) {
+    r = rad->pool_create(pool_name);
+    if (r == -EEXIST) {
+      r = 0;
+    } else if (r < 0) {
+      return r;
+    }
+
+    r = rad->ioctx_create(pool_name, reshard_pool_ctx);
+  }
+
+  return r;
+}
+
 int RGWRados::init_watch()
 {
   const char *control_pool = get_zone_params().control_pool.name.c_str();
@@ -5140,10 +5322,26 @@ int rgw_policy_from_attrset(CephContext *cct, map<string, bufferlist>& attrset,
  * result: the objects are put in here.
  * common_prefixes: if delim is filled in, any matching prefixes are placed here.
  * is_truncated: if number of objects in the bucket is bigger than max, then truncated.
+ *
+ * With params.allow_unordered the objects come shard by shard rather than
+ * in lexical order, which saves merging the shards of large buckets.
  */
 int RGWRados::Bucket::List::list_objects(int max, vector<RGWObjEnt> *result,
                                          map<string, bool> *common_prefixes,
                                          bool *is_truncated)
+{
+  if (params.allow_unordered) {
+    if (!params.delim.empty()) {
+      return -EINVAL;
+    }
+    return list_objects_unordered(max, result, is_truncated);
+  }
+  return list_objects_ordered(max, result, common_prefixes, is_truncated);
+}
+
+int RGWRados::Bucket::List::list_objects_ordered(int max, vector<RGWObjEnt> *result,
+                                                 map<string, bool> *common_prefixes,
+                                                 bool *is_truncated)
 {
   RGWRados *store = target->get_store();
   CephContext *cct = store->ctx();
@@ -5305,6 +5503,102 @@ done:
   return 0;
 }
 
+int RGWRados::Bucket::List::list_objects_unordered(int max, vector<RGWObjEnt> *result,
+                                                   bool *is_truncated)
+{
+  RGWRados *store = target->get_store();
+  CephContext *cct = store->ctx();
+  rgw_bucket& bucket = target->get_bucket();
+  int shard_id = target->get_shard_id();
+
+  int count = 0;
+  bool truncated = true;
+  int read_ahead = std::max(cct->_conf->rgw_list_bucket_min_readahead, max);
+
+  result->clear();
+
+  rgw_bucket b;
+  rgw_obj marker_obj(b, params.marker);
+  rgw_obj end_marker_obj(b, params.end_marker);
+  rgw_obj prefix_obj;
+  rgw_obj_key cur_end_marker;
+  if (!params.ns.empty()) {
+    marker_obj.set_ns(params.ns);
+    end_marker_obj.set_ns(params.ns);
+    end_marker_obj.get_index_key(&cur_end_marker);
+  }
+  rgw_obj_key cur_marker;
+  marker_obj.get_index_key(&cur_marker);
+
+  const bool cur_end_marker_valid = !params.end_marker.empty();
+
+  prefix_obj.set_ns(params.ns);
+  prefix_obj.set_obj(params.prefix);
+  string cur_prefix = prefix_obj.get_index_key_name();
+
+  while (truncated && count < max) {
+    vector<RGWObjEnt> ent_list;
+    int r = store->cls_bucket_list_unordered(bucket, shard_id, cur_marker, cur_prefix,
+                                             read_ahead, params.list_versions, ent_list,
+                                             &truncated, &cur_marker);
+    if (r < 0)
+      return r;
+
+    auto eiter = ent_list.begin();
+    for (; eiter != ent_list.end() && count < max; ++eiter) {
+      RGWObjEnt& entry = *eiter;
+      rgw_obj_key obj = entry.key;
+      rgw_obj_key key = obj;
+      string instance;
+      string ns;
+
+      bool valid = rgw_obj::parse_raw_oid(obj.name, &obj.name, &instance, &ns);
+      if (!valid) {
+        ldout(cct, 0) << "ERROR: could not parse object name: " << obj.name << dendl;
+        continue;
+      }
+
+      if (!params.list_versions && !entry.is_visible()) {
+        continue;
+      }
+
+      /* entries from other namespaces are interleaved, skip rather than stop */
+      if (params.enforce_ns && ns != params.ns) {
+        continue;
+      }
+
+      if (cur_end_marker_valid && cur_end_marker <= obj) {
+        continue;
+      }
+
+      if (params.filter && !params.filter->filter(obj.name, key.name))
+        continue;
+
+      if (params.prefix.size() && (obj.name.compare(0, params.prefix.size(), params.prefix) != 0))
+        continue;
+
+      params.marker = key;
+      next_marker = key;
+
+      entry.key = obj;
+      entry.ns = ns;
+      result->emplace_back(std::move(entry));
+      count++;
+    }
+
+    if (eiter != ent_list.end()) {
+      /* resume after the last entry we returned rather than after the page */
+      truncated = true;
+      break;
+    }
+  }
+
+  if (is_truncated)
+    *is_truncated = truncated;
+
+  return 0;
+}
+
 /**
  * create a rados pool, associated meta info
  * returns 0 on success, -ERR# otherwise.
@@ -6456,12 +6750,13 @@ int RGWRados::Object::Write::_do_write_meta(uint64_t size, uint64_t accounted_si
   }
 
   if (!index_op->is_prepared()) {
-    r = index_op->prepare(CLS_RGW_OP_ADD, &state->write_tag);
+    RGWReqPhaseTimer timer(target->get_ctx().get_req_state(), RGW_REQ_PHASE_INDEX);
+    r = index_op->prepare(CLS_RGW_OP_ADD, &state->write_tag, target->get_ctx().yield_ctx);
     if (r < 0)
       return r;
   }
 
-  r = ref.ioctx.operate(ref.oid, &op);
+  r = rgw_rados_operate(ref.ioctx, ref.oid, &op, target->get_ctx().yield_ctx);
   if (r < 0) { /* we can expect to get -ECANCELED if object was replaced under,
                 or -ENOENT if was removed, or -EEXIST if it did not exist
                 before and now it does */
@@ -6480,9 +6775,12 @@ int RGWRados::Object::Write::_do_write_meta(uint64_t size, uint64_t accounted_si
     ldout(store->ctx(), 0) << "ERROR: complete_atomic_modification returned r=" << r << dendl;
   }
 
-  r = index_op->complete(poolid, epoch, size, accounted_size,
-                        meta.set_mtime, etag, content_type, &acl_bl,
-                        meta.category, meta.remove_objs);
+  {
+    RGWReqPhaseTimer timer(target->get_ctx().get_req_state(), RGW_REQ_PHASE_INDEX);
+    r = index_op->complete(poolid, epoch, size, accounted_size,
+                           meta.set_mtime, etag, content_type, &acl_bl,
+                           meta.category, meta.remove_objs);
+  }
   if (r < 0)
     goto done_cancel;
 
@@ -7128,7 +7426,8 @@ int RGWRados::fetch_remote_obj(RGWObjectCtx& obj_ctx,
                ceph::buffer::list *petag,
                struct rgw_err *err,
                void (*progress_cb)(off_t, void *),
-               void *progress_data)
+               void *progress_data,
+               uint64_t *bytes_fetched)
 {
   /* source is in a different zonegroup, copy from there */
 
@@ -7356,6 +7655,9 @@ int RGWRados::fetch_remote_obj(RGWObjectCtx& obj_ctx,
     delete opstate;
   }
 
+  if (bytes_fetched) {
+    *bytes_fetched = cb.get_data_len();
+  }
   return 0;
 set_err_state:
   if (copy_if_newer && ret == -ERR_NOT_MODIFIED) {
@@ -7979,6 +8281,37 @@ int RGWRados::send_chain_to_gc(cls_rgw_obj_chain& chain, const string& tag, bool
   return gc->send_chain(chain, tag, sync);
 }
 
+/*
+ * Remove an object that is no longer in the bucket index, without waiting
+ * for it.  It is chained to the GC first, so it goes away even if the
+ * removal is lost.
+ */
+int RGWRados::delete_raw_obj_async(rgw_obj& obj, const string& tag)
+{
+  rgw_rados_ref ref;
+  rgw_bucket bucket;
+  int r = get_obj_ref(obj, &ref, &bucket);
+  if (r < 0) {
+    return r;
+  }
+
+  cls_rgw_obj_chain chain;
+  string pool = ref.ioctx.get_pool_name();
+  cls_rgw_obj_key key(ref.oid);
+  chain.push_obj(pool, key, ref.key);
+  r = send_chain_to_gc(chain, tag, false);
+  if (r < 0) {
+    return r;
+  }
+
+  ObjectWriteOperation op;
+  op.remove();
+  AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+  r = ref.ioctx.aio_operate(ref.oid, c, &op);
+  c->release();
+  return r;
+}
+
 int RGWRados::open_bucket_index(rgw_bucket& bucket, librados::IoCtx& index_ctx, string& bucket_oid)
 {
   int r = open_bucket_index_ctx(bucket, index_ctx);
@@ -8352,12 +8685,17 @@ int RGWRados::Object::Delete::delete_obj()
   index_op.set_bilog_flags(params.bilog_flags);
 
 
-  r = index_op.prepare(CLS_RGW_OP_DEL, &state->write_tag);
-  if (r < 0)
-    return r;
+  if (!params.index_tag.empty()) {
+    index_op.set_prepared(params.index_tag);
+  } else {
+    RGWReqPhaseTimer timer(target->get_ctx().get_req_state(), RGW_REQ_PHASE_INDEX);
+    r = index_op.prepare(CLS_RGW_OP_DEL, &state->write_tag, target->get_ctx().yield_ctx);
+    if (r < 0)
+      return r;
+  }
 
   store->remove_rgw_head_obj(op);
-  r = ref.ioctx.operate(ref.oid, &op);
+  r = rgw_rados_operate(ref.ioctx, ref.oid, &op, target->get_ctx().yield_ctx);
   bool need_invalidate = false;
   if (r == -ECANCELED) {
     /* raced with another operation, we can regard it as removed */
@@ -8373,6 +8711,7 @@ int RGWRados::Object::Delete::delete_obj()
       tombstone_entry entry{*state};
       obj_tombstone_cache->add(obj, entry);
     }
+    RGWReqPhaseTimer timer(target->get_ctx().get_req_state(), RGW_REQ_PHASE_INDEX);
     r = index_op.complete_del(poolid, ref.ioctx.get_last_version(), state->mtime, params.remove_objs);
   } else {
     int ret = index_op.cancel();
@@ -8386,6 +8725,9 @@ int RGWRados::Object::Delete::delete_obj()
       ldout(store->ctx(), 0) << "ERROR: complete_atomic_modification returned ret=" << ret << dendl;
     }
     /* other than that, no need to propagate error */
+    if (store->get_data_cache()) {
+      store->invalidate_data_cache(obj);
+    }
   }
 
   if (need_invalidate) {
@@ -8419,6 +8761,94 @@ int RGWRados::delete_obj(RGWObjectCtx& obj_ctx,
   return del_op.delete_obj();
 }
 
+int RGWRados::prepare_del_index_batch(RGWObjectCtx& obj_ctx, RGWBucketInfo& bucket_info,
+                                      vector<rgw_obj>& objs, vector<string> *tags)
+{
+  tags->assign(objs.size(), string());
+
+  /* versioned deletes go through the olh ops instead */
+  if (bucket_info.index_type == RGWBIType_Indexless ||
+      (bucket_info.versioning_status() & BUCKET_VERSIONED) ||
+      objs.size() < 2) {
+    return 0;
+  }
+
+  struct ShardBatch {
+    list<rgw_cls_obj_prepare_op> ops;
+    vector<pair<size_t, string> > tags;
+    librados::AioCompletion *c{nullptr};
+  };
+  map<string, ShardBatch> shards;
+  librados::IoCtx index_ctx;
+
+  for (size_t i = 0; i < objs.size(); i++) {
+    rgw_obj& obj = objs[i];
+    if (!obj.get_instance().empty()) {
+      continue;
+    }
+    RGWObjState *state;
+    int r = get_obj_state(&obj_ctx, obj, &state, false);
+    if (r < 0 || !state->exists) {
+      continue;
+    }
+    string bucket_obj;
+    int shard_id;
+    r = open_bucket_index_shard(bucket_info.bucket, index_ctx, obj.get_hash_object(),
+                                &bucket_obj, &shard_id);
+    if (r < 0) {
+      return r;
+    }
+
+    rgw_cls_obj_prepare_op op;
+    op.op = CLS_RGW_OP_DEL;
+    if (state->write_tag.length()) {
+      op.tag = string(state->write_tag.c_str(), state->write_tag.length());
+    } else {
+      append_rand_alpha(cct, op.tag, op.tag, 32);
+    }
+    op.key = cls_rgw_obj_key(obj.get_index_key_name(), obj.get_instance());
+    op.locator = obj.get_loc();
+    op.log_op = get_zone().log_data;
+
+    ShardBatch& b = shards[bucket_obj];
+    b.tags.push_back(make_pair(i, op.tag));
+    b.ops.push_back(std::move(op));
+  }
+
+  for (auto& i : shards) {
+    ShardBatch& b = i.second;
+    ObjectWriteOperation o;
+    cls_rgw_bucket_prepare_ops(o, b.ops);
+    b.c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+    int r = index_ctx.aio_operate(i.first, b.c, &o);
+    if (r < 0) {
+      b.c->release();
+      b.c = nullptr;
+    }
+  }
+
+  for (auto& i : shards) {
+    ShardBatch& b = i.second;
+    if (!b.c) {
+      continue;
+    }
+    b.c->wait_for_safe();
+    int r = b.c->get_return_value();
+    b.c->release();
+    if (r < 0) {
+      /* most likely resharding, the objects get prepared one by one */
+      ldout(cct, 5) << "prepare of " << b.tags.size() << " index entries in "
+                    << i.first << " returned r=" << r << dendl;
+      continue;
+    }
+    for (auto& t : b.tags) {
+      (*tags)[t.first] = std::move(t.second);
+    }
+  }
+
+  return 0;
+}
+
 int RGWRados::delete_system_obj(rgw_obj& obj, RGWObjVersionTracker *objv_tracker)
 {
   rgw_rados_ref ref;
@@ -8539,7 +8969,8 @@ int RGWRados::get_system_obj_state_impl(RGWObjectCtx *rctx, rgw_obj& obj, RGWObj
 
   s->obj = obj;
 
-  int r = raw_obj_stat(obj, &s->size, &s->mtime, &s->epoch, &s->attrset, (s->prefetch_data ? &s->data : NULL), objv_tracker);
+  int r = raw_obj_stat(obj, &s->size, &s->mtime, &s->epoch, &s->attrset, (s->prefetch_data ? &s->data : NULL), objv_tracker,
+                       rctx->yield_ctx);
   if (r == -ENOENT) {
     s->exists = false;
     s->has_attrs = true;
@@ -8592,7 +9023,8 @@ int RGWRados::get_obj_state_impl(RGWObjectCtx *rctx, rgw_obj& obj, RGWObjState *
   int r = -ENOENT;
 
   if (!assume_noent) {
-    r = RGWRados::raw_obj_stat(obj, &s->size, &s->mtime, &s->epoch, &s->attrset, (s->prefetch_data ? &s->data : NULL), NULL);
+    r = RGWRados::raw_obj_stat(obj, &s->size, &s->mtime, &s->epoch, &s->attrset, (s->prefetch_data ? &s->data : NULL), NULL,
+                               rctx->yield_ctx);
   }
   if (r == -ENOENT) {
     s->exists = false;
@@ -9352,7 +9784,8 @@ int RGWRados::SystemObject::Read::stat(RGWObjVersionTracker *objv_tracker)
                                 stat_params.lastmod, stat_params.obj_size, objv_tracker);
 }
 
-int RGWRados::Bucket::UpdateIndex::prepare(RGWModifyOp op, const string *write_tag)
+int RGWRados::Bucket::UpdateIndex::prepare(RGWModifyOp op, const string *write_tag,
+                                           optional_yield_context y)
 {
   if (blind) {
     return 0;
@@ -9373,7 +9806,9 @@ int RGWRados::Bucket::UpdateIndex::prepare(RGWModifyOp op, const string *write_t
     }
   }
 
-  int r = store->cls_obj_prepare_op(*bs, op, optag, obj, bilog_flags);
+  int r = store->guard_reshard(bs, obj, [&](BucketShard *bs) -> int {
+    return store->cls_obj_prepare_op(*bs, op, optag, obj, bilog_flags, y);
+  });
   if (r < 0) {
     return r;
   }
@@ -9417,7 +9852,9 @@ int RGWRados::Bucket::UpdateIndex::complete(int64_t poolid, uint64_t epoch,
   ent.owner_display_name = owner.get_display_name();
   ent.content_type = content_type;
 
-  ret = store->cls_obj_complete_add(*bs, optag, poolid, epoch, ent, category, remove_objs, bilog_flags);
+  ret = store->guard_reshard(bs, obj, [&](BucketShard *bs) -> int {
+    return store->cls_obj_complete_add(*bs, obj, optag, poolid, epoch, ent, category, remove_objs, bilog_flags);
+  });
 
   int r = store->data_log->add_entry(bs->bucket, bs->shard_id);
   if (r < 0) {
@@ -9442,7 +9879,9 @@ int RGWRados::Bucket::UpdateIndex::complete_del(int64_t poolid, uint64_t epoch,
     return ret;
   }
 
-  ret = store->cls_obj_complete_del(*bs, optag, poolid, epoch, obj, removed_mtime, remove_objs, bilog_flags);
+  ret = store->guard_reshard(bs, obj, [&](BucketShard *bs) -> int {
+    return store->cls_obj_complete_del(*bs, optag, poolid, epoch, obj, removed_mtime, remove_objs, bilog_flags);
+  });
 
   int r = store->data_log->add_entry(bs->bucket, bs->shard_id);
   if (r < 0) {
@@ -9466,7 +9905,9 @@ int RGWRados::Bucket::UpdateIndex::cancel()
     return ret;
   }
 
-  ret = store->cls_obj_complete_cancel(*bs, optag, obj, bilog_flags);
+  ret = store->guard_reshard(bs, obj, [&](BucketShard *bs) -> int {
+    return store->cls_obj_complete_cancel(*bs, optag, obj, bilog_flags);
+  });
 
   /*
    * need to update data log anyhow, so that whoever follows needs to update its internal markers
@@ -9675,6 +10116,7 @@ struct get_obj_aio_data {
   struct get_obj_data *op_data;
   off_t ofs;
   off_t len;
+  ceph::mono_time issued;
 };
 
 struct get_obj_io {
@@ -9699,15 +10141,86 @@ struct get_obj_data : public RefCountedObject {
   atomic_t cancelled;
   atomic_t err_code;
   Throttle throttle;
+  Throttle *memory_throttle;
   list<bufferlist> read_list;
 
+  /*
+   * The window is sized to what the client drains while a read is
+   * in flight, so fast clients aren't held up by the OSD latency and
+   * slow ones don't pin memory they can't consume yet.
+   */
+  uint64_t min_window;
+  uint64_t max_window;
+  double osd_latency;   // seconds, moving average
+  double client_rate;   // bytes per second, moving average
+
   explicit get_obj_data(CephContext *_cct)
     : cct(_cct),
       rados(NULL), ctx(NULL),
       total_read(0), lock("get_obj_data"), data_lock("get_obj_data::data_lock"),
       client_cb(NULL),
-      throttle(cct, "get_obj_data", cct->_conf->rgw_get_obj_window_size, false) {}
+      throttle(cct, "get_obj_data", cct->_conf->rgw_get_obj_min_window_size, false),
+      memory_throttle(NULL),
+      min_window(cct->_conf->rgw_get_obj_min_window_size),
+      max_window(std::max(cct->_conf->rgw_get_obj_window_size,
+                          cct->_conf->rgw_get_obj_min_window_size)),
+      osd_latency(0), client_rate(0) {}
   ~get_obj_data() { } 
+
+  /* take len bytes of the gateway-wide read budget */
+  void get_memory(off_t len) {
+    if (!memory_throttle) {
+      return;
+    }
+    bool idle;
+    {
+      Mutex::Locker l(lock);
+      idle = completion_map.empty();
+    }
+    if (idle) {
+      /* nothing of ours that would return budget is in flight, so don't
+       * wait for others; this overshoots by at most a read per request */
+      memory_throttle->take(len);
+    } else {
+      memory_throttle->get(len);
+    }
+  }
+
+  void put_memory(off_t len) {
+    if (memory_throttle) {
+      memory_throttle->put(len);
+    }
+  }
+
+  static double average(double avg, double sample) {
+    return avg ? avg * 0.8 + sample * 0.2 : sample;
+  }
+
+  void update_osd_latency(const ceph::timespan& t) {
+    Mutex::Locker l(lock);
+    osd_latency = average(osd_latency, std::chrono::duration<double>(t).count());
+  }
+
+  void update_client_rate(uint64_t bytes, const ceph::timespan& t) {
+    double secs = std::chrono::duration<double>(t).count();
+    if (!bytes || secs <= 0) {
+      return;
+    }
+    uint64_t window;
+    {
+      Mutex::Locker l(lock);
+      client_rate = average(client_rate, bytes / secs);
+      if (!osd_latency) {
+        return;
+      }
+      window = client_rate * osd_latency * 2;
+    }
+    window = std::min(std::max(window, min_window), max_window);
+    if ((int64_t)window != throttle.get_max()) {
+      ldout(cct, 20) << "get_obj_data: window=" << window << dendl;
+      throttle.reset_max(window);
+    }
+  }
   void set_cancelled(int r) {
     cancelled.set(1);
     err_code.set(r);
@@ -9758,12 +10271,14 @@ struct get_obj_data : public RefCountedObject {
     assert(io_iter.second); // assert new insertion
 
     get_obj_io& io = (io_iter.first)->second;
+    io.len = len;
     *pbl = &io.bl;
 
     struct get_obj_aio_data aio;
     aio.ofs = ofs;
     aio.len = len;
     aio.op_data = this;
+    aio.issued = ceph::mono_clock::now();
 
     aio_data.push_back(aio);
 
@@ -9829,7 +10344,12 @@ struct get_obj_data : public RefCountedObject {
     if (r < 0)
       return r;
 
+    off_t next_ofs = ofs;
     for (; aiter != completion_map.end(); ++aiter) {
+      if (aiter->first != next_ofs) {
+        /* a prefetched read past ranges that were not issued yet */
+        break;
+      }
       completion = aiter->second;
       if (!completion->is_safe()) {
         /* reached a request that is not yet complete, stop */
@@ -9843,6 +10363,7 @@ struct get_obj_data : public RefCountedObject {
       }
 
       total_read += r;
+      next_ofs = liter->first + liter->second.len;
 
       map<off_t, get_obj_io>::iterator old_liter = liter++;
       bl_list.push_back(old_liter->second.bl);
@@ -9882,6 +10403,8 @@ void RGWRados::get_obj_aio_completion_cb(completion_t c, void *arg)
 
   ldout(cct, 20) << "get_obj_aio_completion_cb: io completion ofs=" << ofs << " len=" << len << dendl;
   d->throttle.put(len);
+  d->put_memory(len);
+  d->update_osd_latency(ceph::mono_clock::now() - aio_data->issued);
 
   r = rados_aio_get_return_value(c);
   if (r < 0) {
@@ -9921,6 +10444,8 @@ int RGWRados::flush_read_list(struct get_obj_data *d)
   d->data_lock.Unlock();
 
   int r = 0;
+  uint64_t flushed = 0;
+  ceph::mono_time start = ceph::mono_clock::now();
 
   list<bufferlist>::iterator iter;
   for (iter = l.begin(); iter != l.end(); ++iter) {
@@ -9930,6 +10455,10 @@ int RGWRados::flush_read_list(struct get_obj_data *d)
       dout(0) << "ERROR: flush_read_list(): d->client_cb->handle_data() returned " << r << dendl;
       break;
     }
+    flushed += bl.length();
+  }
+  if (r >= 0) {
+    d->update_client_rate(flushed, ceph::mono_clock::now() - start);
   }
 
   d->data_lock.Lock();
@@ -9988,7 +10517,9 @@ int RGWRados::get_obj_iterate_cb(RGWObjectCtx *ctx, RGWObjState *astate,
   get_obj_bucket_and_oid_loc(obj, bucket, oid, key);
 
   d->throttle.get(len);
+  d->get_memory(len);
   if (d->is_cancelled()) {
+    d->put_memory(len);
     return d->get_err_code();
   }
 
@@ -10020,15 +10551,57 @@ done_err:
   ldout(cct, 20) << "cancelling io r=" << r << " obj_ofs=" << obj_ofs << dendl;
   d->set_cancelled(r);
   d->cancel_io(obj_ofs);
+  d->put_memory(len); /* never issued, so no completion returns it */
 
   return r;
 }
 
+/* passes the data on, and keeps it for the data cache */
+class RGWDataCacheFillCB : public RGWGetDataCB {
+  RGWGetDataCB *cb;
+public:
+  bufferlist bl;
+
+  explicit RGWDataCacheFillCB(RGWGetDataCB *_cb) : cb(_cb) {}
+  int handle_data(bufferlist& data, off_t bl_ofs, off_t bl_len) override {
+    bufferlist t;
+    t.substr_of(data, bl_ofs, bl_len);
+    bl.claim_append(t);
+    return cb->handle_data(data, bl_ofs, bl_len);
+  }
+};
+
 int RGWRados::Object::Read::iterate(int64_t ofs, int64_t end, RGWGetDataCB *cb)
 {
   RGWRados *store = source->get_store();
   CephContext *cct = store->ctx();
 
+  RGWDataCache *data_cache = store->get_data_cache();
+  string cache_key, cache_version;
+  uint64_t obj_size = 0;
+  std::unique_ptr<RGWDataCacheFillCB> fill_cb;
+  if (data_cache) {
+    RGWObjState *astate;
+    int r = source->get_state(&astate, true);
+    if (r < 0) {
+      return r;
+    }
+    if (astate->obj_tag.length() > 0) {
+      cache_key = get_data_cache_key(state.obj);
+      cache_version = astate->obj_tag.to_str();
+      obj_size = astate->size;
+      r = data_cache->read(cache_key, cache_version, ofs, end, cb);
+      if (r != -ENOENT) {
+        return r;
+      }
+      if (obj_size > 0 && ofs == 0 && end + 1 == (int64_t)obj_size &&
+          data_cache->admit(cache_key, obj_size)) {
+        fill_cb.reset(new RGWDataCacheFillCB(cb));
+        cb = fill_cb.get();
+      }
+    }
+  }
+
   struct get_obj_data *data = new get_obj_data(cct);
   bool done = false;
 
@@ -10037,8 +10610,10 @@ int RGWRados::Object::Read::iterate(int64_t ofs, int64_t end, RGWGetDataCB *cb)
   data->rados = store;
   data->io_ctx.dup(state.io_ctx);
   data->client_cb = cb;
+  data->memory_throttle = store->get_get_obj_throttle();
 
-  int r = store->iterate_obj(obj_ctx, state.obj, ofs, end, cct->_conf->rgw_get_obj_max_req_size, _get_obj_iterate_cb, (void *)data);
+  int r = store->iterate_obj(obj_ctx, state.obj, ofs, end, cct->_conf->rgw_get_obj_max_req_size,
+                             _get_obj_iterate_cb, (void *)data, true);
   if (r < 0) {
     data->cancel_all_io();
     goto done;
@@ -10059,6 +10634,10 @@ int RGWRados::Object::Read::iterate(int64_t ofs, int64_t end, RGWGetDataCB *cb)
     }
   }
 
+  if (r >= 0 && fill_cb && fill_cb->bl.length() == obj_size) {
+    data_cache->put(cache_key, cache_version, fill_cb->bl);
+  }
+
 done:
   data->put();
   return r;
@@ -10068,7 +10647,7 @@ int RGWRados::iterate_obj(RGWObjectCtx& obj_ctx, rgw_obj& obj,
                           off_t ofs, off_t end,
 			  uint64_t max_chunk_size,
 			  int (*iterate_obj_cb)(rgw_obj&, off_t, off_t, off_t, bool, RGWObjState *, void *),
-	                  void *arg)
+	                  void *arg, bool prefetch_tail)
 {
   rgw_bucket bucket;
   rgw_obj read_obj = obj;
@@ -10093,13 +10672,38 @@ int RGWRados::iterate_obj(RGWObjectCtx& obj_ctx, rgw_obj& obj,
 
     RGWObjManifest::obj_iterator obj_end = astate->manifest.obj_end();
 
-    for (; iter != obj_end && ofs <= end; ++iter) {
+    /*
+     * When the range ends in a later part than it starts in, its last
+     * chunk is read right after the first one rather than last, so that
+     * the reads at both ends are in flight together.
+     */
+    off_t last = end;
+    off_t tail_ofs = 0;
+    rgw_obj tail_obj;
+    uint64_t tail_read_ofs = 0;
+    bool tail_pending = false;
+    if (prefetch_tail && iter != obj_end) {
+      RGWObjManifest::obj_iterator tail_iter = astate->manifest.obj_find(end);
+      if (tail_iter != obj_end &&
+          tail_iter.get_cur_part_id() != iter.get_cur_part_id()) {
+        off_t tail_stripe_ofs = tail_iter.get_stripe_ofs();
+        tail_ofs = max(tail_stripe_ofs, end + 1 - (off_t)max_chunk_size);
+        if (tail_ofs > ofs) {
+          tail_obj = tail_iter.get_location();
+          tail_read_ofs = tail_iter.location_ofs() + (tail_ofs - tail_stripe_ofs);
+          last = tail_ofs - 1;
+          tail_pending = true;
+        }
+      }
+    }
+
+    for (; iter != obj_end && ofs <= last; ++iter) {
       off_t stripe_ofs = iter.get_stripe_ofs();
       off_t next_stripe_ofs = stripe_ofs + iter.get_stripe_size();
 
-      while (ofs < next_stripe_ofs && ofs <= end) {
+      while (ofs < next_stripe_ofs && ofs <= last) {
         read_obj = iter.get_location();
-        uint64_t read_len = min(len, iter.get_stripe_size() - (ofs - stripe_ofs));
+        uint64_t read_len = min((uint64_t)(last - ofs + 1), iter.get_stripe_size() - (ofs - stripe_ofs));
         read_ofs = iter.location_ofs() + (ofs - stripe_ofs);
 
         if (read_len > max_chunk_size) {
@@ -10112,8 +10716,17 @@ int RGWRados::iterate_obj(RGWObjectCtx& obj_ctx, rgw_obj& obj,
 	  return r;
         }
 
-	len -= read_len;
         ofs += read_len;
+
+        if (tail_pending) {
+          tail_pending = false;
+          ldout(cct, 20) << "prefetching tail ofs=" << tail_ofs << " end=" << end << dendl;
+          r = iterate_obj_cb(tail_obj, tail_ofs, tail_read_ofs, end - tail_ofs + 1,
+                             (tail_obj == obj), astate, arg);
+          if (r < 0) {
+            return r;
+          }
+        }
       }
     }
   } else {
@@ -10291,9 +10904,11 @@ int RGWRados::bucket_index_link_olh(RGWObjState& olh_state, rgw_obj& obj_instanc
   }
 
   cls_rgw_obj_key key(obj_instance.get_index_key_name(), obj_instance.get_instance());
-  ret = cls_rgw_bucket_link_olh(bs.index_ctx, bs.bucket_obj, key, olh_state.olh_tag, delete_marker, op_tag, meta, olh_epoch,
-                                unmod_since, high_precision_time,
-                                get_zone().log_data);
+  ret = guard_reshard(&bs, obj_instance, [&](BucketShard *bs) -> int {
+    return cls_rgw_bucket_link_olh(bs->index_ctx, bs->bucket_obj, key, olh_state.olh_tag, delete_marker, op_tag, meta, olh_epoch,
+                                   unmod_since, high_precision_time,
+                                   get_zone().log_data);
+  });
   if (ret < 0) {
     return ret;
   }
@@ -10324,7 +10939,9 @@ int RGWRados::bucket_index_unlink_instance(rgw_obj& obj_instance, const string&
   }
 
   cls_rgw_obj_key key(obj_instance.get_index_key_name(), obj_instance.get_instance());
-  ret = cls_rgw_bucket_unlink_instance(bs.index_ctx, bs.bucket_obj, key, op_tag, olh_tag, olh_epoch, get_zone().log_data);
+  ret = guard_reshard(&bs, obj_instance, [&](BucketShard *bs) -> int {
+    return cls_rgw_bucket_unlink_instance(bs->index_ctx, bs->bucket_obj, key, op_tag, olh_tag, olh_epoch, get_zone().log_data);
+  });
   if (ret < 0) {
     return ret;
   }
@@ -10383,11 +11000,11 @@ int RGWRados::bucket_index_trim_olh_log(RGWObjState& state, rgw_obj& obj_instanc
 
   cls_rgw_obj_key key(obj_instance.get_index_key_name(), string());
 
-  ObjectWriteOperation op;
-
-  cls_rgw_trim_olh_log(op, key, ver, olh_tag);
-
-  ret = bs.index_ctx.operate(bs.bucket_obj, &op);
+  ret = guard_reshard(&bs, obj_instance, [&](BucketShard *bs) -> int {
+    ObjectWriteOperation op;
+    cls_rgw_trim_olh_log(op, key, ver, olh_tag);
+    return bs->index_ctx.operate(bs->bucket_obj, &op);
+  });
   if (ret < 0)
     return ret;
 
@@ -10414,7 +11031,9 @@ int RGWRados::bucket_index_clear_olh(RGWObjState& state, rgw_obj& obj_instance)
 
   cls_rgw_obj_key key(obj_instance.get_index_key_name(), string());
 
-  ret = cls_rgw_clear_olh(bs.index_ctx, bs.bucket_obj, key, olh_tag);
+  ret = guard_reshard(&bs, obj_instance, [&](BucketShard *bs) -> int {
+    return cls_rgw_clear_olh(bs->index_ctx, bs->bucket_obj, key, olh_tag);
+  });
   if (ret < 0) {
     ldout(cct, 5) << "cls_rgw_clear_olh() returned ret=" << ret << dendl;
     return ret;
@@ -10868,7 +11487,7 @@ int RGWRados::follow_olh(RGWObjectCtx& obj_ctx, RGWObjState *state, rgw_obj& olh
 
 int RGWRados::raw_obj_stat(rgw_obj& obj, uint64_t *psize, real_time *pmtime, uint64_t *epoch,
                            map<string, bufferlist> *attrs, bufferlist *first_chunk,
-                           RGWObjVersionTracker *objv_tracker)
+                           RGWObjVersionTracker *objv_tracker, optional_yield_context y)
 {
   rgw_rados_ref ref;
   rgw_bucket bucket;
@@ -10895,11 +11514,7 @@ int RGWRados::raw_obj_stat(rgw_obj& obj, uint64_t *psize, real_time *pmtime, uin
     op.read(0, cct->_conf->rgw_max_chunk_size, first_chunk, NULL);
   }
   bufferlist outbl;
-  r = ref.ioctx.operate(ref.oid, &op, &outbl);
-
-  if (epoch) {
-    *epoch = ref.ioctx.get_last_version();
-  }
+  r = rgw_rados_operate(ref.ioctx, ref.oid, &op, &outbl, y, epoch);
 
   if (r < 0)
     return r;
@@ -11398,6 +12013,67 @@ int RGWRados::omap_get_vals(rgw_obj& obj, bufferlist& header, const string& mark
  
 }
 
+int RGWRados::omap_get_vals_parallel(rgw_obj& obj, const vector<pair<string, uint64_t> >& ranges,
+                                     int max_aio, vector<map<string, bufferlist> > *results)
+{
+  rgw_rados_ref ref;
+  rgw_bucket bucket;
+  int r = get_obj_ref(obj, &ref, &bucket);
+  if (r < 0) {
+    return r;
+  }
+
+  results->clear();
+  results->resize(ranges.size());
+  vector<int> rvals(ranges.size(), 0);
+  std::unique_ptr<bool[]> more(new bool[ranges.size()]);
+
+  list<pair<AioCompletion *, size_t> > in_flight;
+  auto wait_one = [&]() {
+    AioCompletion *c = in_flight.front().first;
+    size_t i = in_flight.front().second;
+    in_flight.pop_front();
+    c->wait_for_complete();
+    int ret = c->get_return_value();
+    c->release();
+    if (ret >= 0) {
+      ret = rvals[i];
+    }
+    return ret;
+  };
+
+  for (size_t i = 0; i < ranges.size(); i++) {
+    if ((int)in_flight.size() >= max(max_aio, 1)) {
+      int ret = wait_one();
+      if (ret < 0 && r == 0) {
+        r = ret;
+      }
+    }
+    if (r < 0) {
+      break;
+    }
+    ObjectReadOperation op;
+    op.omap_get_vals2(ranges[i].first, ranges[i].second, &(*results)[i], &more[i], &rvals[i]);
+    AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+    int ret = ref.ioctx.aio_operate(ref.oid, c, &op, NULL);
+    if (ret < 0) {
+      c->release();
+      r = ret;
+      break;
+    }
+    in_flight.push_back(make_pair(c, i));
+  }
+
+  while (!in_flight.empty()) {
+    int ret = wait_one();
+    if (ret < 0 && r == 0) {
+      r = ret;
+    }
+  }
+
+  return r;
+}
+
 int RGWRados::omap_get_all(rgw_obj& obj, bufferlist& header,
 			   std::map<string, bufferlist>& m)
 {
@@ -11919,15 +12595,15 @@ int RGWRados::cls_rgw_init_index(librados::IoCtx& index_ctx, librados::ObjectWri
 }
 
 int RGWRados::cls_obj_prepare_op(BucketShard& bs, RGWModifyOp op, string& tag,
-                                 rgw_obj& obj, uint16_t bilog_flags)
+                                 rgw_obj& obj, uint16_t bilog_flags, optional_yield_context y)
 {
   ObjectWriteOperation o;
   cls_rgw_obj_key key(obj.get_index_key_name(), obj.get_instance());
   cls_rgw_bucket_prepare_op(o, op, tag, key, obj.get_loc(), get_zone().log_data, bilog_flags);
-  return bs.index_ctx.operate(bs.bucket_obj, &o);
+  return rgw_rados_operate(bs.index_ctx, bs.bucket_obj, &o, y);
 }
 
-int RGWRados::cls_obj_complete_op(BucketShard& bs, RGWModifyOp op, string& tag,
+int RGWRados::cls_obj_complete_op(BucketShard& bs, rgw_obj& obj, RGWModifyOp op, string& tag,
                                   int64_t pool, uint64_t epoch,
                                   RGWObjEnt& ent, RGWObjCategory category,
 				  list<rgw_obj_key> *remove_objs, uint16_t bilog_flags)
@@ -11962,18 +12638,39 @@ int RGWRados::cls_obj_complete_op(BucketShard& bs, RGWModifyOp op, string& tag,
   cls_rgw_bucket_complete_op(o, op, tag, ver, key, dir_meta, pro,
                              get_zone().log_data, bilog_flags);
 
-  AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+  complete_op_data *arg = nullptr;
+  librados::callback_t cb = nullptr;
+  if (index_completion_thread) {
+    /* keep what it takes to send the completion again if a reshard refuses it */
+    arg = index_completion_thread->create_completion();
+    arg->bucket = bs.bucket;
+    arg->obj = obj;
+    arg->op = op;
+    arg->tag = tag;
+    arg->ver = ver;
+    arg->key = key;
+    arg->dir_meta = dir_meta;
+    arg->remove_objs = ro;
+    arg->log_op = get_zone().log_data;
+    arg->bilog_flags = bilog_flags;
+    cb = RGWIndexCompletionThread::obj_complete_cb;
+  }
+
+  AioCompletion *c = librados::Rados::aio_create_completion(arg, NULL, cb);
   int ret = bs.index_ctx.aio_operate(bs.bucket_obj, c, &o);
+  if (ret < 0 && arg) {
+    index_completion_thread->handle_completion(arg, ret);
+  }
   c->release();
   return ret;
 }
 
-int RGWRados::cls_obj_complete_add(BucketShard& bs, string& tag,
+int RGWRados::cls_obj_complete_add(BucketShard& bs, rgw_obj& obj, string& tag,
                                    int64_t pool, uint64_t epoch,
                                    RGWObjEnt& ent, RGWObjCategory category,
                                    list<rgw_obj_key> *remove_objs, uint16_t bilog_flags)
 {
-  return cls_obj_complete_op(bs, CLS_RGW_OP_ADD, tag, pool, epoch, ent, category, remove_objs, bilog_flags);
+  return cls_obj_complete_op(bs, obj, CLS_RGW_OP_ADD, tag, pool, epoch, ent, category, remove_objs, bilog_flags);
 }
 
 int RGWRados::cls_obj_complete_del(BucketShard& bs, string& tag,
@@ -11986,14 +12683,14 @@ int RGWRados::cls_obj_complete_del(BucketShard& bs, string& tag,
   RGWObjEnt ent;
   ent.mtime = removed_mtime;
   obj.get_index_key(&ent.key);
-  return cls_obj_complete_op(bs, CLS_RGW_OP_DEL, tag, pool, epoch, ent, RGW_OBJ_CATEGORY_NONE, remove_objs, bilog_flags);
+  return cls_obj_complete_op(bs, obj, CLS_RGW_OP_DEL, tag, pool, epoch, ent, RGW_OBJ_CATEGORY_NONE, remove_objs, bilog_flags);
 }
 
 int RGWRados::cls_obj_complete_cancel(BucketShard& bs, string& tag, rgw_obj& obj, uint16_t bilog_flags)
 {
   RGWObjEnt ent;
   obj.get_index_key(&ent.key);
-  return cls_obj_complete_op(bs, CLS_RGW_OP_CANCEL, tag, -1 /* pool id */, 0, ent, RGW_OBJ_CATEGORY_NONE, NULL, bilog_flags);
+  return cls_obj_complete_op(bs, obj, CLS_RGW_OP_CANCEL, tag, -1 /* pool id */, 0, ent, RGW_OBJ_CATEGORY_NONE, NULL, bilog_flags);
 }
 
 int RGWRados::cls_obj_set_bucket_tag_timeout(rgw_bucket& bucket, uint64_t timeout)
@@ -12007,6 +12704,43 @@ int RGWRados::cls_obj_set_bucket_tag_timeout(rgw_bucket& bucket, uint64_t timeou
   return CLSRGWIssueSetTagTimeout(index_ctx, bucket_objs, cct->_conf->rgw_bucket_index_max_aio, timeout)();
 }
 
+static void dirent_to_obj_ent(const rgw_bucket_dir_entry& dirent, RGWObjEnt *e)
+{
+  e->key.set(dirent.key.name, dirent.key.instance);
+  e->size = dirent.meta.size;
+  e->accounted_size = dirent.meta.accounted_size;
+  e->mtime = dirent.meta.mtime;
+  e->etag = dirent.meta.etag;
+  e->owner = dirent.meta.owner;
+  e->owner_display_name = dirent.meta.owner_display_name;
+  e->content_type = dirent.meta.content_type;
+  e->tag = dirent.tag;
+  e->flags = dirent.flags;
+  e->versioned_epoch = dirent.versioned_epoch;
+}
+
+/*
+ * Objects are spread evenly across the index shards by name hash, so a page
+ * of num_entries holds about num_entries / num_shards entries from each
+ * shard.  Ask each shard for a few standard deviations more than that, so
+ * that most pages need a single round; the shards that still run dry are
+ * read again on their own.
+ */
+static uint32_t calc_ordered_bucket_list_per_shard(uint32_t num_entries,
+                                                   uint32_t num_shards)
+{
+  const uint32_t min_read = 8;
+
+  if (num_shards <= 1) {
+    return num_entries;
+  }
+
+  double expected = (double)num_entries / num_shards;
+  uint32_t calc_read = (uint32_t)ceil(expected + 3 * sqrt(expected));
+
+  return std::min(num_entries, std::max(min_read, calc_read));
+}
+
 int RGWRados::cls_bucket_list(rgw_bucket& bucket, int shard_id, rgw_obj_key& start, const string& prefix,
 		              uint32_t num_entries, bool list_versions, map<string, RGWObjEnt>& m,
 			      bool *is_truncated, rgw_obj_key *last_entry,
@@ -12023,32 +12757,30 @@ int RGWRados::cls_bucket_list(rgw_bucket& bucket, int shard_id, rgw_obj_key& sta
   if (r < 0)
     return r;
 
+  uint32_t per_shard = calc_ordered_bucket_list_per_shard(num_entries, oids.size());
+  ldout(cct, 20) << "cls_bucket_list: reading " << per_shard << " entries from each of "
+                 << oids.size() << " shards" << dendl;
+
   cls_rgw_obj_key start_key(start.name, start.instance);
-  r = CLSRGWIssueBucketList(index_ctx, start_key, prefix, num_entries, list_versions,
+  r = CLSRGWIssueBucketList(index_ctx, start_key, prefix, per_shard, list_versions,
                             oids, list_results, cct->_conf->rgw_bucket_index_max_aio)();
   if (r < 0)
     return r;
 
-  // Create a list of iterators that are used to iterate each shard
-  vector<map<string, struct rgw_bucket_dir_entry>::iterator> vcurrents(list_results.size());
-  vector<map<string, struct rgw_bucket_dir_entry>::iterator> vends(list_results.size());
-  vector<string> vnames(list_results.size());
-  map<int, struct rgw_cls_list_ret>::iterator iter = list_results.begin();
-  *is_truncated = false;
-  for (; iter != list_results.end(); ++iter) {
-    vcurrents.push_back(iter->second.dir.m.begin());
-    vends.push_back(iter->second.dir.m.end());
-    vnames.push_back(oids[iter->first]);
-    *is_truncated = (*is_truncated || iter->second.is_truncated);
-  }
+  // The next entry of each shard, and how many entries to ask the shard for
+  // when it runs dry
+  map<int, map<string, struct rgw_bucket_dir_entry>::iterator> vcurrents;
+  map<int, uint32_t> vreads;
 
   // Create a map to track the next candidate entry from each shard, if the entry
   // from a specified shard is selected/erased, the next entry from that shard will
   // be inserted for next round selection
-  map<string, size_t> candidates;
-  for (size_t i = 0; i < vcurrents.size(); ++i) {
-    if (vcurrents[i] != vends[i]) {
-      candidates[vcurrents[i]->first] = i;
+  map<string, int> candidates;
+  for (auto& iter : list_results) {
+    vcurrents[iter.first] = iter.second.dir.m.begin();
+    vreads[iter.first] = per_shard;
+    if (!iter.second.dir.m.empty()) {
+      candidates[iter.second.dir.m.begin()->first] = iter.first;
     }
   }
 
@@ -12063,17 +12795,7 @@ int RGWRados::cls_bucket_list(rgw_bucket& bucket, int shard_id, rgw_obj_key& sta
 
     // fill it in with initial values; we may correct later
     RGWObjEnt e;
-    e.key.set(dirent.key.name, dirent.key.instance);
-    e.size = dirent.meta.size;
-    e.accounted_size = dirent.meta.accounted_size;
-    e.mtime = dirent.meta.mtime;
-    e.etag = dirent.meta.etag;
-    e.owner = dirent.meta.owner;
-    e.owner_display_name = dirent.meta.owner_display_name;
-    e.content_type = dirent.meta.content_type;
-    e.tag = dirent.tag;
-    e.flags = dirent.flags;
-    e.versioned_epoch = dirent.versioned_epoch;
+    dirent_to_obj_ent(dirent, &e);
 
     bool force_check = force_check_filter && force_check_filter(dirent.key.name);
     if ((!dirent.exists && !dirent.is_delete_marker()) || !dirent.pending_map.empty() || force_check) {
@@ -12081,7 +12803,7 @@ int RGWRados::cls_bucket_list(rgw_bucket& bucket, int shard_id, rgw_obj_key& sta
        * and if the tags are old we need to do cleanup as well. */
       librados::IoCtx sub_ctx;
       sub_ctx.dup(index_ctx);
-      r = check_disk_state(sub_ctx, bucket, dirent, e, updates[vnames[pos]]);
+      r = check_disk_state(sub_ctx, bucket, dirent, e, updates[oids[pos]]);
       if (r < 0 && r != -ENOENT) {
           return r;
       }
@@ -12095,7 +12817,34 @@ int RGWRados::cls_bucket_list(rgw_bucket& bucket, int shard_id, rgw_obj_key& sta
     // Refresh the candidates map
     candidates.erase(candidates.begin());
     ++vcurrents[pos];
-    if (vcurrents[pos] != vends[pos]) {
+    if (vcurrents[pos] != list_results[pos].dir.m.end()) {
+      candidates[vcurrents[pos]->first] = pos;
+      continue;
+    }
+
+    /* this shard ran dry; nothing from the other shards can be taken before
+     * we know what it holds next, so read more of it alone, starting after
+     * the last entry it returned */
+    if (!list_results[pos].is_truncated || count >= num_entries) {
+      continue;
+    }
+
+    cls_rgw_obj_key shard_marker = dirent.key;
+    vreads[pos] = std::min(std::max(vreads[pos] * 2, per_shard), num_entries - count);
+    ldout(cct, 20) << "cls_bucket_list: reading " << vreads[pos] << " more entries from shard "
+                   << pos << " after " << shard_marker.name << "[" << shard_marker.instance << "]" << dendl;
+
+    map<int, string> shard_oids;
+    shard_oids[pos] = oids[pos];
+    map<int, struct rgw_cls_list_ret> shard_results;
+    r = CLSRGWIssueBucketList(index_ctx, shard_marker, prefix, vreads[pos], list_versions,
+                              shard_oids, shard_results, 1)();
+    if (r < 0)
+      return r;
+
+    list_results[pos] = std::move(shard_results[pos]);
+    vcurrents[pos] = list_results[pos].dir.m.begin();
+    if (vcurrents[pos] != list_results[pos].dir.m.end()) {
       candidates[vcurrents[pos]->first] = pos;
     }
   }
@@ -12114,9 +12863,11 @@ int RGWRados::cls_bucket_list(rgw_bucket& bucket, int shard_id, rgw_obj_key& sta
   }
 
   // Check if all the returned entries are consumed or not
-  for (size_t i = 0; i < vcurrents.size(); ++i) {
-    if (vcurrents[i] != vends[i])
+  *is_truncated = false;
+  for (auto& iter : list_results) {
+    if (iter.second.is_truncated || vcurrents[iter.first] != iter.second.dir.m.end()) {
       *is_truncated = true;
+    }
   }
   if (!m.empty())
     *last_entry = m.rbegin()->first;
@@ -12124,6 +12875,116 @@ int RGWRados::cls_bucket_list(rgw_bucket& bucket, int shard_id, rgw_obj_key& sta
   return 0;
 }
 
+int RGWRados::cls_bucket_list_unordered(rgw_bucket& bucket, int shard_id, rgw_obj_key& start,
+                                        const string& prefix, uint32_t num_entries, bool list_versions,
+                                        vector<RGWObjEnt>& ent_list, bool *is_truncated,
+                                        rgw_obj_key *last_entry,
+                                        bool (*force_check_filter)(const string&  name))
+{
+  ldout(cct, 10) << "cls_bucket_list_unordered " << bucket << " start " << start.name << "[" << start.instance << "] num_entries " << num_entries << dendl;
+
+  *is_truncated = false;
+
+  librados::IoCtx index_ctx;
+  map<int, string> oids;
+  int r = open_bucket_index(bucket, index_ctx, oids, shard_id);
+  if (r < 0)
+    return r;
+
+  /* the shards are listed one after the other; an object always lives in
+   * the same shard, so the marker tells which shard to resume from */
+  map<int, string>::iterator shard_iter = oids.begin();
+  cls_rgw_obj_key marker(start.name, start.instance);
+  if (!start.name.empty() && oids.size() > 1) {
+    string name, instance, ns;
+    if (!rgw_obj::parse_raw_oid(start.name, &name, &instance, &ns)) {
+      ldout(cct, 0) << "ERROR: could not parse marker: " << start.name << dendl;
+      return -EINVAL;
+    }
+    rgw_obj marker_obj(bucket, name);
+    marker_obj.set_ns(ns);
+
+    string marker_oid;
+    int marker_shard;
+    r = open_bucket_index_shard(bucket, index_ctx, marker_obj.get_hash_object(), &marker_oid, &marker_shard);
+    if (r < 0)
+      return r;
+    shard_iter = oids.find(marker_shard);
+  }
+
+  map<string, bufferlist> updates;
+  uint32_t count = 0;
+  for (; shard_iter != oids.end() && count < num_entries; ++shard_iter) {
+    map<int, string> shard_oids;
+    shard_oids[shard_iter->first] = shard_iter->second;
+
+    bool shard_truncated = true;
+    while (shard_truncated && count < num_entries) {
+      map<int, struct rgw_cls_list_ret> shard_results;
+      r = CLSRGWIssueBucketList(index_ctx, marker, prefix, num_entries - count, list_versions,
+                                shard_oids, shard_results, 1)();
+      if (r < 0)
+        return r;
+
+      struct rgw_cls_list_ret& result = shard_results[shard_iter->first];
+      shard_truncated = result.is_truncated;
+
+      for (auto& iter : result.dir.m) {
+        struct rgw_bucket_dir_entry& dirent = iter.second;
+        marker = dirent.key;
+
+        RGWObjEnt e;
+        dirent_to_obj_ent(dirent, &e);
+
+        r = 0;
+        bool force_check = force_check_filter && force_check_filter(dirent.key.name);
+        if ((!dirent.exists && !dirent.is_delete_marker()) || !dirent.pending_map.empty() || force_check) {
+          librados::IoCtx sub_ctx;
+          sub_ctx.dup(index_ctx);
+          r = check_disk_state(sub_ctx, bucket, dirent, e, updates[shard_iter->second]);
+          if (r < 0 && r != -ENOENT) {
+            return r;
+          }
+        }
+        if (r >= 0) {
+          ldout(cct, 10) << "RGWRados::cls_bucket_list_unordered: got " << e.key.name << "[" << e.key.instance << "]" << dendl;
+          ent_list.emplace_back(std::move(e));
+          ++count;
+        }
+      }
+
+      if (result.dir.m.empty()) {
+        break;
+      }
+    }
+
+    if (count >= num_entries) {
+      // stopped inside this shard, or at its end with more shards to go
+      *is_truncated = shard_truncated || std::next(shard_iter) != oids.end();
+      break;
+    }
+
+    marker = cls_rgw_obj_key();
+  }
+
+  for (auto& iter : updates) {
+    if (iter.second.length()) {
+      ObjectWriteOperation o;
+      cls_rgw_suggest_changes(o, iter.second);
+      // we don't care if we lose suggested updates, send them off blindly
+      AioCompletion *c = librados::Rados::aio_create_completion(NULL, NULL, NULL);
+      index_ctx.aio_operate(iter.first, c, &o);
+      c->release();
+    }
+  }
+
+  if (!ent_list.empty()) {
+    last_entry->set(marker.name, marker.instance);
+  }
+
+  return 0;
+}
+
 int RGWRados::cls_obj_usage_log_add(const string& oid, rgw_usage_log_info& info)
 {
   librados::IoCtx io_ctx;
@@ -12650,6 +13511,125 @@ int RGWRados::get_target_shard_id(const RGWBucketInfo& bucket_info, const string
   return r;
 }
 
+#define NUM_RESHARD_RETRIES 10
+
+int RGWRados::block_while_resharding(BucketShard *bs, string *new_bucket_id)
+{
+  utime_t end = ceph_clock_now();
+  end += cct->_conf->rgw_reshard_wait_time;
+
+  do {
+    rgw_bucket_dir_header header;
+    int ret = cls_rgw_get_dir_header(bs->index_ctx, bs->bucket_obj, &header);
+    if (ret < 0) {
+      ldout(cct, 0) << __func__ << " ERROR: failed to read bucket index header of " << bs->bucket_obj << " ret=" << ret << dendl;
+      return ret;
+    }
+
+    const cls_rgw_bucket_instance_entry& entry = header.new_instance;
+    if (entry.reshard_status == CLS_RGW_RESHARD_DONE) {
+      *new_bucket_id = entry.new_bucket_instance_id;
+      return 0;
+    }
+    if (!entry.writes_refused()) {
+      /* the reshard went past the blocked phase or was cancelled */
+      *new_bucket_id = bs->bucket.bucket_id;
+      return 0;
+    }
+
+    ldout(cct, 20) << __func__ << " bucket " << bs->bucket << " is being resharded, waiting" << dendl;
+    sleep(1);
+  } while (ceph_clock_now() < end);
+
+  ldout(cct, 0) << __func__ << " ERROR: bucket " << bs->bucket << " is still being resharded, giving up" << dendl;
+  return -ERR_BUSY_RESHARDING;
+}
+
+int RGWRados::guard_reshard(BucketShard *bs, rgw_obj& obj_instance,
+                            std::function<int(BucketShard *)> call)
+{
+  int r = 0;
+  for (int i = 0; i < NUM_RESHARD_RETRIES; ++i) {
+    r = call(bs);
+    if (r != -ERR_BUSY_RESHARDING) {
+      break;
+    }
+    ldout(cct, 10) << "NOTICE: resharding operation on bucket index detected, blocking" << dendl;
+    string new_bucket_id;
+    r = block_while_resharding(bs, &new_bucket_id);
+    if (r < 0) {
+      return r;
+    }
+    if (new_bucket_id == bs->bucket.bucket_id) {
+      continue;
+    }
+    ldout(cct, 20) << "reshard completion identified, new_bucket_id=" << new_bucket_id << dendl;
+    rgw_bucket bucket = bs->bucket;
+    bucket.bucket_id = new_bucket_id;
+    bucket.oid.clear();
+    r = bs->init(bucket, obj_instance);
+    if (r < 0) {
+      return r;
+    }
+    r = -ERR_BUSY_RESHARDING;
+  }
+
+  return r;
+}
+
+int RGWRados::check_bucket_shards(const RGWBucketInfo& bucket_info, rgw_bucket& bucket,
+                                  RGWQuotaInfo& bucket_quota)
+{
+  if (!cct->_conf->rgw_dynamic_resharding ||
+      bucket_info.reshard_status != CLS_RGW_RESHARD_NONE) {
+    return 0;
+  }
+
+  bool need_resharding = false;
+  uint32_t num_source_shards = (bucket_info.num_shards > 0 ? bucket_info.num_shards : 1);
+  uint32_t suggested_num_shards = 0;
+
+  int ret = quota_handler->check_bucket_shards((uint64_t)cct->_conf->rgw_max_objs_per_shard,
+                                               num_source_shards, bucket_info.owner, bucket,
+                                               bucket_quota, 1, need_resharding,
+                                               &suggested_num_shards);
+  if (ret < 0) {
+    return ret;
+  }
+
+  if (need_resharding) {
+    ldout(cct, 20) << __func__ << " bucket " << bucket.name << " need resharding "
+                   << " old num shards " << bucket_info.num_shards
+                   << " new num shards " << suggested_num_shards << dendl;
+    return add_bucket_to_reshard(bucket_info, suggested_num_shards);
+  }
+
+  return ret;
+}
+
+int RGWRados::add_bucket_to_reshard(const RGWBucketInfo& bucket_info, uint32_t new_num_shards)
+{
+  uint32_t num_source_shards = (bucket_info.num_shards > 0 ? bucket_info.num_shards : 1);
+
+  new_num_shards = min(new_num_shards, get_max_bucket_shards());
+  if (new_num_shards <= num_source_shards) {
+    ldout(cct, 20) << "not resharding bucket name=" << bucket_info.bucket.name
+                   << ", orig_num=" << num_source_shards << ", new_num_shards="
+                   << new_num_shards << dendl;
+    return 0;
+  }
+
+  rgw_reshard_entry entry;
+  entry.time = real_clock::now();
+  entry.tenant = bucket_info.bucket.tenant;
+  entry.bucket_name = bucket_info.bucket.name;
+  entry.bucket_id = bucket_info.bucket.bucket_id;
+  entry.old_num_shards = num_source_shards;
+  entry.new_num_shards = new_num_shards;
+
+  return reshard->add(entry);
+}
+
 void RGWRados::get_bucket_index_object(const string& bucket_oid_base, uint32_t num_shards,
                                       int shard_id, string *bucket_obj)
 {
@@ -12968,6 +13948,23 @@ uint64_t RGWRados::next_bucket_id()
   return ++max_bucket_id;
 }
 
+int RGWRados::init_data_cache()
+{
+  RGWDataCache *cache = new RGWDataCache(cct);
+  int r = cache->init();
+  if (r < 0) {
+    delete cache;
+    return r;
+  }
+  data_cache = cache;
+  return 0;
+}
+
+void RGWRados::invalidate_data_cache(const rgw_obj& obj)
+{
+  data_cache->remove(get_data_cache_key(obj));
+}
+
 RGWRados *RGWStoreManager::init_storage_provider(CephContext *cct, bool use_gc_thread, bool use_lc_thread, bool quota_threads, bool run_sync_thread)
 {
   int use_cache = cct->_conf->rgw_cache_enabled;
@@ -23,14 +23,19 @@
 #include "rgw_meta_sync_status.h"
 #include "rgw_period_puller.h"
 #include "rgw_sync_module.h"
+#include "rgw_yield_context.h"
 
 class RGWWatcher;
 class SafeTimer;
+class Throttle;
+class RGWDataCache;
 class ACLOwner;
 class RGWGC;
 class RGWMetaNotifier;
 class RGWDataNotifier;
 class RGWLC;
+class RGWReshard;
+class RGWIndexCompletionThread;
 class RGWObjectExpirer;
 class RGWMetaSyncProcessorThread;
 class RGWDataSyncProcessorThread;
@@ -629,6 +634,11 @@ public:
       return stripe_size;
     }
 
+    /* multipart part the current stripe belongs to */
+    int get_cur_part_id() const {
+      return cur_part_id;
+    }
+
     /* offset where data starts within current stripe */
     uint64_t location_ofs() {
       if (manifest->explicit_objs) {
@@ -1853,6 +1863,7 @@ struct RGWObjectCtx {
   map<rgw_obj, RGWObjState> objs_state;
   RWLock lock;
   void *user_ctx;
+  optional_yield_context yield_ctx; /* the request's coroutine, if any */
 
   explicit RGWObjectCtx(RGWRados *_store) : store(_store), lock("RGWObjectCtx"), user_ctx(NULL) { }
   RGWObjectCtx(RGWRados *_store, void *_user_ctx) : store(_store), lock("RGWObjectCtx"), user_ctx(_user_ctx) { }
@@ -1861,6 +1872,9 @@ struct RGWObjectCtx {
   void set_atomic(rgw_obj& obj);
   void set_prefetch_data(rgw_obj& obj);
   void invalidate(rgw_obj& obj);
+
+  /// the request this context was created for, if any
+  req_state *get_req_state() { return static_cast<req_state *>(user_ctx); }
 };
 
 class Finisher;
@@ -1892,6 +1906,9 @@ class RGWRados
   friend class RGWMetaNotifier;
   friend class RGWDataNotifier;
   friend class RGWLC;
+  friend class RGWReshard;
+  friend class RGWBucketReshard;
+  friend class RGWIndexCompletionThread;
   friend class RGWObjectExpirer;
   friend class RGWMetaSyncProcessorThread;
   friend class RGWDataSyncProcessorThread;
@@ -1903,6 +1920,7 @@ class RGWRados
   int open_gc_pool_ctx();
   int open_lc_pool_ctx();
   int open_objexp_pool_ctx();
+  int open_reshard_pool_ctx();
 
   int open_pool_ctx(const string& pool, librados::IoCtx&  io_ctx);
   int open_bucket_index_ctx(rgw_bucket& bucket, librados::IoCtx&  index_ctx);
@@ -1933,6 +1951,8 @@ class RGWRados
 
   RGWGC *gc;
   RGWLC *lc;
+  RGWReshard *reshard;
+  RGWIndexCompletionThread *index_completion_thread;
   RGWObjectExpirer *obj_expirer;
   bool use_gc_thread;
   bool use_lc_thread;
@@ -1997,9 +2017,14 @@ protected:
   using tombstone_cache_t = lru_map<rgw_obj, tombstone_entry>;
   tombstone_cache_t *obj_tombstone_cache;
 
+  Throttle *get_obj_throttle; // bytes read by all get obj requests
+
+  RGWDataCache *data_cache;
+
   librados::IoCtx gc_pool_ctx;        // .rgw.gc
   librados::IoCtx lc_pool_ctx;        // .rgw.lc
   librados::IoCtx objexp_pool_ctx;
+  librados::IoCtx reshard_pool_ctx;   // reshard queue, in the log pool
 
   bool pools_initialized;
 
@@ -2025,7 +2050,7 @@ protected:
   RGWPeriod current_period;
 public:
   RGWRados() : max_req_id(0), lock("rados_timer_lock"), watchers_lock("watchers_lock"), timer(NULL),
-               gc(NULL), lc(NULL), obj_expirer(NULL), use_gc_thread(false), use_lc_thread(false), quota_threads(false),
+               gc(NULL), lc(NULL), reshard(NULL), index_completion_thread(NULL), obj_expirer(NULL), use_gc_thread(false), use_lc_thread(false), quota_threads(false),
                run_sync_thread(false), async_rados(nullptr), meta_notifier(NULL),
                data_notifier(NULL), meta_sync_processor_thread(NULL),
                meta_sync_thread_lock("meta_sync_thread_lock"), data_sync_thread_lock("data_sync_thread_lock"),
@@ -2037,6 +2062,7 @@ public:
                next_rados_handle(0),
                handle_lock("rados_handle_lock"),
                binfo_cache(NULL), obj_tombstone_cache(nullptr),
+               get_obj_throttle(nullptr), data_cache(nullptr),
                pools_initialized(false),
                quota_handler(NULL),
                finisher(NULL),
@@ -2052,6 +2078,9 @@ public:
   librados::IoCtx* get_lc_pool_ctx() {
     return &lc_pool_ctx;
   }
+  librados::IoCtx* get_reshard_pool_ctx() {
+    return &reshard_pool_ctx;
+  }
   void set_context(CephContext *_cct) {
     cct = _cct;
   }
@@ -2170,6 +2199,21 @@ public:
     return obj_tombstone_cache;
   }
 
+  Throttle *get_get_obj_throttle() {
+    return get_obj_throttle;
+  }
+
+  /* only the gateway itself caches object data, not the tools */
+  int init_data_cache();
+  RGWDataCache *get_data_cache() {
+    return data_cache;
+  }
+  static string get_data_cache_key(const rgw_obj& obj) {
+    return obj.bucket.marker + "_" + obj.get_object();
+  }
+  /* drop the object from the data cache of all gateways */
+  virtual void invalidate_data_cache(const rgw_obj& obj);
+
   RGWSyncModulesManager *get_sync_modules_manager() {
     return sync_modules_manager;
   }
@@ -2490,6 +2534,7 @@ public:
         ceph::real_time unmod_since;
         ceph::real_time mtime; /* for setting delete marker mtime */
         bool high_precision_time;
+        string index_tag; /* index entry already prepared, see prepare_del_index_batch() */
 
         DeleteParams() : versioning_status(0), olh_epoch(0), bilog_flags(0), remove_objs(NULL), high_precision_time(false) {}
       } params;
@@ -2589,7 +2634,8 @@ public:
         bilog_flags = flags;
       }
 
-      int prepare(RGWModifyOp, const string *write_tag);
+      int prepare(RGWModifyOp, const string *write_tag,
+                  optional_yield_context y = optional_yield_context());
       int complete(int64_t poolid, uint64_t epoch, uint64_t size,
                    uint64_t accounted_size, ceph::real_time& ut,
                    const string& etag, const string& content_type,
@@ -2600,6 +2646,12 @@ public:
                        list<rgw_obj_key> *remove_objs);
       int cancel();
 
+      /* the entry was prepared with this tag by someone else */
+      void set_prepared(const string& tag) {
+        optag = tag;
+        prepared = true;
+      }
+
       const string *get_optag() { return &optag; }
 
       bool is_prepared() { return prepared; }
@@ -2618,10 +2670,15 @@ public:
         bool enforce_ns;
         RGWAccessListFilter *filter;
         bool list_versions;
+        bool allow_unordered; /* shard by shard; cannot be used with delim */
 
-        Params() : enforce_ns(true), filter(NULL), list_versions(false) {}
+        Params() : enforce_ns(true), filter(NULL), list_versions(false), allow_unordered(false) {}
       } params;
 
+    private:
+      int list_objects_ordered(int max, vector<RGWObjEnt> *result, map<string, bool> *common_prefixes, bool *is_truncated);
+      int list_objects_unordered(int max, vector<RGWObjEnt> *result, bool *is_truncated);
+
     public:
       explicit List(RGWRados::Bucket *_target) : target(_target) {}
 
@@ -2742,7 +2799,8 @@ public:
                        ceph::buffer::list *petag,
                        struct rgw_err *err,
                        void (*progress_cb)(off_t, void *),
-                       void *progress_data);
+                       void *progress_data,
+                       uint64_t *bytes_fetched = nullptr);
   /**
    * Copy an object.
    * dest_obj: the object to copy into
@@ -2836,6 +2894,15 @@ public:
                          uint16_t bilog_flags = 0,
                          const ceph::real_time& expiration_time = ceph::real_time());
 
+  /**
+   * Prepare the index entries of objects about to be deleted with one call
+   * per bucket index shard, rather than one per object.  (*tags)[i] is the
+   * tag objs[i] was prepared with, to go into Delete::params.index_tag, or
+   * empty if delete_obj() is to prepare it as usual.
+   */
+  int prepare_del_index_batch(RGWObjectCtx& obj_ctx, RGWBucketInfo& bucket_info,
+                              vector<rgw_obj>& objs, vector<string> *tags);
+
   /* Delete a system object */
   virtual int delete_system_obj(rgw_obj& src_obj, RGWObjVersionTracker *objv_tracker = NULL);
 
@@ -2900,7 +2967,7 @@ public:
                   off_t ofs, off_t end,
                   uint64_t max_chunk_size,
                   int (*iterate_obj_cb)(rgw_obj&, off_t, off_t, off_t, bool, RGWObjState *, void *),
-                  void *arg);
+                  void *arg, bool prefetch_tail = false);
 
   int flush_read_list(struct get_obj_data *d);
 
@@ -2917,7 +2984,8 @@ public:
 
   virtual int raw_obj_stat(rgw_obj& obj, uint64_t *psize, ceph::real_time *pmtime, uint64_t *epoch,
                        map<string, bufferlist> *attrs, bufferlist *first_chunk,
-                       RGWObjVersionTracker *objv_tracker);
+                       RGWObjVersionTracker *objv_tracker,
+                       optional_yield_context y = optional_yield_context());
 
   int obj_operate(rgw_obj& obj, librados::ObjectWriteOperation *op);
   int obj_operate(rgw_obj& obj, librados::ObjectReadOperation *op);
@@ -2951,6 +3019,9 @@ public:
   void gen_rand_obj_instance_name(rgw_obj *target);
 
   int omap_get_vals(rgw_obj& obj, bufferlist& header, const std::string& marker, uint64_t count, std::map<string, bufferlist>& m);
+  /* omap_get_vals() for each (marker, count), with up to max_aio reads in flight */
+  int omap_get_vals_parallel(rgw_obj& obj, const vector<pair<string, uint64_t> >& ranges,
+                             int max_aio, vector<map<string, bufferlist> > *results);
   virtual int omap_get_all(rgw_obj& obj, bufferlist& header, std::map<string, bufferlist>& m);
   virtual int omap_set(rgw_obj& obj, std::string& key, bufferlist& bl);
   virtual int omap_set(rgw_obj& obj, map<std::string, bufferlist>& m);
@@ -3014,10 +3085,11 @@ public:
                                      map<string, bufferlist> *pattrs, bool create_entry_point);
 
   int cls_rgw_init_index(librados::IoCtx& io_ctx, librados::ObjectWriteOperation& op, string& oid);
-  int cls_obj_prepare_op(BucketShard& bs, RGWModifyOp op, string& tag, rgw_obj& obj, uint16_t bilog_flags);
-  int cls_obj_complete_op(BucketShard& bs, RGWModifyOp op, string& tag, int64_t pool, uint64_t epoch,
+  int cls_obj_prepare_op(BucketShard& bs, RGWModifyOp op, string& tag, rgw_obj& obj, uint16_t bilog_flags,
+                         optional_yield_context y = optional_yield_context());
+  int cls_obj_complete_op(BucketShard& bs, rgw_obj& obj, RGWModifyOp op, string& tag, int64_t pool, uint64_t epoch,
                           RGWObjEnt& ent, RGWObjCategory category, list<rgw_obj_key> *remove_objs, uint16_t bilog_flags);
-  int cls_obj_complete_add(BucketShard& bs, string& tag, int64_t pool, uint64_t epoch, RGWObjEnt& ent,
+  int cls_obj_complete_add(BucketShard& bs, rgw_obj& obj, string& tag, int64_t pool, uint64_t epoch, RGWObjEnt& ent,
                            RGWObjCategory category, list<rgw_obj_key> *remove_objs, uint16_t bilog_flags);
   int cls_obj_complete_del(BucketShard& bs, string& tag, int64_t pool, uint64_t epoch, rgw_obj& obj,
                            ceph::real_time& removed_mtime, list<rgw_obj_key> *remove_objs, uint16_t bilog_flags);
@@ -3027,6 +3099,10 @@ public:
                       uint32_t num_entries, bool list_versions, map<string, RGWObjEnt>& m,
                       bool *is_truncated, rgw_obj_key *last_entry,
                       bool (*force_check_filter)(const string&  name) = NULL);
+  int cls_bucket_list_unordered(rgw_bucket& bucket, int shard_id, rgw_obj_key& start, const string& prefix,
+                                uint32_t num_entries, bool list_versions, vector<RGWObjEnt>& ent_list,
+                                bool *is_truncated, rgw_obj_key *last_entry,
+                                bool (*force_check_filter)(const string&  name) = NULL);
   int cls_bucket_head(rgw_bucket& bucket, int shard_id, map<string, struct rgw_bucket_dir_header>& headers, map<int, string> *bucket_instance_ids = NULL);
   int cls_bucket_head_async(rgw_bucket& bucket, int shard_id, RGWGetDirHeader_CB *ctx, int *num_aio);
   int list_bi_log_entries(rgw_bucket& bucket, int shard_id, string& marker, uint32_t max, std::list<rgw_bi_log_entry>& result, bool *truncated);
@@ -3054,6 +3130,25 @@ public:
   void shard_name(const string& prefix, unsigned max_shards, const string& section, const string& key, string& name);
   void shard_name(const string& prefix, unsigned shard_id, string& name);
   int get_target_shard_id(const RGWBucketInfo& bucket_info, const string& obj_key, int *shard_id);
+
+  /**
+   * Wait for a reshard of the bucket @bs belongs to to get out of the way.
+   * Returns the bucket instance id writes should go to in @new_bucket_id,
+   * which is the new instance once the reshard is done, or
+   * -ERR_BUSY_RESHARDING if it is still blocking writes after
+   * rgw_reshard_wait_time.
+   */
+  int block_while_resharding(BucketShard *bs, string *new_bucket_id);
+  /**
+   * Run @call against the index shard of @obj_instance, following the
+   * bucket to its new instance whenever a reshard refuses the write.
+   * @bs is left pointing at the shard the call succeeded on.
+   */
+  int guard_reshard(BucketShard *bs, rgw_obj& obj_instance,
+                    std::function<int(BucketShard *)> call);
+  int check_bucket_shards(const RGWBucketInfo& bucket_info, rgw_bucket& bucket,
+                          RGWQuotaInfo& bucket_quota);
+  int add_bucket_to_reshard(const RGWBucketInfo& bucket_info, uint32_t new_num_shards);
   void time_log_prepare_entry(cls_log_entry& entry, const ceph::real_time& ut, const string& section, const string& key, bufferlist& bl);
   int time_log_add_init(librados::IoCtx& io_ctx);
   int time_log_add(const string& oid, list<cls_log_entry>& entries,
@@ -3098,6 +3193,7 @@ public:
 
   void update_gc_chain(rgw_obj& head_obj, RGWObjManifest& manifest, cls_rgw_obj_chain *chain);
   int send_chain_to_gc(cls_rgw_obj_chain& chain, const string& tag, bool sync);
+  int delete_raw_obj_async(rgw_obj& obj, const string& tag);
   int gc_operate(string& oid, librados::ObjectWriteOperation *op);
   int gc_aio_operate(string& oid, librados::ObjectWriteOperation *op);
   int gc_operate(string& oid, librados::ObjectReadOperation *op, bufferlist *pbl);
@@ -55,13 +55,17 @@ struct RGWFCGXRequest : public RGWRequest {
 struct RGWLoadGenRequest : public RGWRequest {
 	string method;
 	string resource;
-	int content_length;
+	uint64_t content_length;
 	atomic_t* fail_flag;
+	int op; /* RGW_LOADGEN_OP_*, or -1 if not measured */
+	uint64_t size; /* object bytes moved */
+	ceph::mono_time scheduled;
 
-RGWLoadGenRequest(uint64_t req_id, const string& _m, const  string& _r, int _cl,
-		atomic_t *ff)
+RGWLoadGenRequest(uint64_t req_id, const string& _m, const  string& _r,
+		uint64_t _cl, atomic_t *ff, int _op, uint64_t _size,
+		ceph::mono_time _scheduled)
 	: RGWRequest(req_id), method(_m), resource(_r), content_length(_cl),
-		fail_flag(ff) {}
+		fail_flag(ff), op(_op), size(_size), scheduled(_scheduled) {}
 };
 
 #endif /* RGW_REQUEST_H */
@@ -0,0 +1,1167 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <deque>
+
+#include "rgw_reshard.h"
+#include "rgw_bucket.h"
+#include "cls/rgw/cls_rgw_client.h"
+#include "cls/lock/cls_lock_client.h"
+#include "common/errno.h"
+#include "common/ceph_json.h"
+#include "common/Formatter.h"
+
+#define dout_subsys ceph_subsys_rgw
+
+static const string reshard_oid_prefix = "reshard.";
+static const string reshard_lock_name = "reshard_process";
+
+#define RESHARD_SHARD_WINDOW 64
+#define RESHARD_MAX_AIO 128
+#define RESHARD_SWITCH_RETRIES 5
+#define COOKIE_LEN 16
+
+class BucketReshardShard {
+  RGWRados *store;
+  RGWBucketInfo& bucket_info;
+  int num_shard;
+  RGWRados::BucketShard bs;
+  vector<rgw_cls_bi_entry> entries;
+  map<uint8_t, rgw_bucket_category_stats> stats;
+  deque<librados::AioCompletion *>& aio_completions;
+
+  int wait_next_completion() {
+    librados::AioCompletion *c = aio_completions.front();
+    aio_completions.pop_front();
+
+    c->wait_for_safe();
+
+    int ret = c->get_return_value();
+    c->release();
+
+    if (ret < 0) {
+      lderr(store->ctx()) << "ERROR: reshard rados operation failed: " << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+
+    return 0;
+  }
+
+  int get_completion(librados::AioCompletion **c) {
+    if (aio_completions.size() >= RESHARD_MAX_AIO) {
+      int ret = wait_next_completion();
+      if (ret < 0) {
+        return ret;
+      }
+    }
+
+    *c = librados::Rados::aio_create_completion(nullptr, nullptr, nullptr);
+    aio_completions.push_back(*c);
+
+    return 0;
+  }
+
+public:
+  BucketReshardShard(RGWRados *_store, RGWBucketInfo& _bucket_info,
+                     int _num_shard,
+                     deque<librados::AioCompletion *>& _completions) : store(_store), bucket_info(_bucket_info), bs(store),
+                                                                       aio_completions(_completions) {
+    num_shard = (bucket_info.num_shards > 0 ? _num_shard : -1);
+    bs.init(bucket_info.bucket, num_shard);
+  }
+
+  int get_num_shard() {
+    return num_shard;
+  }
+
+  int add_entry(rgw_cls_bi_entry& entry, bool account, uint8_t category,
+                const rgw_bucket_category_stats& entry_stats) {
+    entries.push_back(entry);
+    if (account) {
+      rgw_bucket_category_stats& target = stats[category];
+      target.num_entries += entry_stats.num_entries;
+      target.total_size += entry_stats.total_size;
+      target.total_size_rounded += entry_stats.total_size_rounded;
+    }
+    if (entries.size() >= RESHARD_SHARD_WINDOW) {
+      int ret = flush();
+      if (ret < 0) {
+        return ret;
+      }
+    }
+    return 0;
+  }
+  int flush() {
+    if (entries.size() == 0) {
+      return 0;
+    }
+
+    librados::ObjectWriteOperation op;
+    for (auto& entry : entries) {
+      store->bi_put(op, bs, entry);
+    }
+    cls_rgw_bucket_update_stats(op, false, stats);
+
+    librados::AioCompletion *c;
+    int ret = get_completion(&c);
+    if (ret < 0) {
+      return ret;
+    }
+    ret = bs.index_ctx.aio_operate(bs.bucket_obj, c, &op);
+    if (ret < 0) {
+      lderr(store->ctx()) << "ERROR: failed to store entries in target bucket shard (bs=" << bs.bucket << "/" << bs.shard_id << ") error=" << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+    entries.clear();
+    stats.clear();
+    return 0;
+  }
+
+  int wait_all_aio() {
+    int ret = 0;
+    while (!aio_completions.empty()) {
+      int r = wait_next_completion();
+      if (r < 0) {
+        ret = r;
+      }
+    }
+    return ret;
+  }
+};
+
+class BucketReshardManager {
+  RGWRados *store;
+  RGWBucketInfo& target_bucket_info;
+  deque<librados::AioCompletion *> completions;
+  int num_target_shards;
+  vector<BucketReshardShard *> target_shards;
+
+public:
+  BucketReshardManager(RGWRados *_store, RGWBucketInfo& _target_bucket_info, int _num_target_shards) : store(_store), target_bucket_info(_target_bucket_info),
+                                                                                                       num_target_shards(_num_target_shards) {
+    target_shards.resize(num_target_shards);
+    for (int i = 0; i < num_target_shards; ++i) {
+      target_shards[i] = new BucketReshardShard(store, target_bucket_info, i, completions);
+    }
+  }
+
+  ~BucketReshardManager() {
+    for (auto& shard : target_shards) {
+      int ret = shard->wait_all_aio();
+      if (ret < 0) {
+        ldout(store->ctx(), 20) << __func__ << ": shard->wait_all_aio() returned ret=" << ret << dendl;
+      }
+      delete shard;
+    }
+  }
+
+  int add_entry(int shard_index,
+                rgw_cls_bi_entry& entry, bool account, uint8_t category,
+                const rgw_bucket_category_stats& entry_stats) {
+    int ret = target_shards[shard_index]->add_entry(entry, account, category, entry_stats);
+    if (ret < 0) {
+      lderr(store->ctx()) << "ERROR: target_shards.add_entry(" << entry.idx << ") returned error: " << cpp_strerror(-ret) << dendl;
+      return ret;
+    }
+    return 0;
+  }
+
+  int finish() {
+    int ret = 0;
+    for (auto& shard : target_shards) {
+      int r = shard->flush();
+      if (r < 0) {
+        lderr(store->ctx()) << "ERROR: target_shards[" << shard->get_num_shard() << "].flush() returned error: " << cpp_strerror(-r) << dendl;
+        ret = r;
+      }
+    }
+    for (auto& shard : target_shards) {
+      int r = shard->wait_all_aio();
+      if (r < 0) {
+        lderr(store->ctx()) << "ERROR: target_shards[" << shard->get_num_shard() << "].wait_all_aio() returned error: " << cpp_strerror(-r) << dendl;
+        ret = r;
+      }
+      delete shard;
+    }
+    target_shards.clear();
+    return ret;
+  }
+};
+
+void rgw_reshard_entry::dump(Formatter *f) const
+{
+  utime_t ut(time);
+  encode_json("time", ut, f);
+  encode_json("tenant", tenant, f);
+  encode_json("bucket_name", bucket_name, f);
+  encode_json("bucket_id", bucket_id, f);
+  encode_json("new_instance_id", new_instance_id, f);
+  encode_json("old_num_shards", old_num_shards, f);
+  encode_json("new_num_shards", new_num_shards, f);
+}
+
+void rgw_reshard_entry::get_key(const string& tenant, const string& bucket_name,
+                                string *key)
+{
+  *key = tenant + ":" + bucket_name;
+}
+
+RGWBucketReshard::RGWBucketReshard(RGWRados *_store, const RGWBucketInfo& _bucket_info,
+                                   const map<string, bufferlist>& _bucket_attrs)
+  : store(_store), bucket_info(_bucket_info), bucket_attrs(_bucket_attrs),
+    reshard_lock(reshard_lock_name)
+{
+}
+
+int RGWBucketReshard::open_index()
+{
+  if (!bucket_objs.empty()) {
+    return 0;
+  }
+  int ret = store->open_bucket_index(bucket_info.bucket, index_ctx, bucket_objs);
+  if (ret < 0) {
+    lderr(store->ctx()) << "ERROR: failed to open bucket index of " << bucket_info.bucket << ": " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+  return 0;
+}
+
+/*
+ * Only one reshard of a bucket may run at a time; it holds a lock on the
+ * first of the bucket's index objects, renewed as the reshard goes on so
+ * that a reshard which died lets go of the bucket.
+ */
+int RGWBucketReshard::lock_bucket()
+{
+  CephContext *cct = store->ctx();
+  char cookie_buf[COOKIE_LEN + 1];
+  gen_rand_alphanumeric(cct, cookie_buf, sizeof(cookie_buf) - 1);
+  cookie_buf[COOKIE_LEN] = '\0';
+
+  reshard_lock.set_cookie(cookie_buf);
+  reshard_lock.set_duration(utime_t(cct->_conf->rgw_reshard_bucket_lock_duration, 0));
+
+  int ret = reshard_lock.lock_exclusive(&index_ctx, bucket_objs.begin()->second);
+  if (ret == -EBUSY) {
+    ldout(cct, 0) << "bucket " << bucket_info.bucket << " is already being resharded" << dendl;
+    return ret;
+  }
+  if (ret < 0) {
+    lderr(cct) << "ERROR: failed to lock bucket " << bucket_info.bucket << " for resharding: " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+  lock_renewed = ceph_clock_now();
+  reshard_lock.set_renew(true);
+  return 0;
+}
+
+int RGWBucketReshard::renew_lock_bucket()
+{
+  CephContext *cct = store->ctx();
+  utime_t now = ceph_clock_now();
+  if (now - lock_renewed < utime_t(cct->_conf->rgw_reshard_bucket_lock_duration / 2, 0)) {
+    return 0;
+  }
+  int ret = reshard_lock.lock_exclusive(&index_ctx, bucket_objs.begin()->second);
+  if (ret < 0) {
+    lderr(cct) << "ERROR: failed to renew reshard lock on bucket " << bucket_info.bucket << ": " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+  lock_renewed = now;
+  return 0;
+}
+
+void RGWBucketReshard::unlock_bucket()
+{
+  int ret = reshard_lock.unlock(&index_ctx, bucket_objs.begin()->second);
+  if (ret < 0) {
+    ldout(store->ctx(), 0) << "WARNING: failed to unlock bucket " << bucket_info.bucket << ": " << cpp_strerror(-ret) << dendl;
+  }
+}
+
+int RGWBucketReshard::set_resharding_status(const cls_rgw_bucket_instance_entry& entry)
+{
+  int ret = CLSRGWIssueSetBucketResharding(index_ctx, bucket_objs, entry,
+                                           store->ctx()->_conf->rgw_bucket_index_max_aio)();
+  if (ret < 0) {
+    lderr(store->ctx()) << "ERROR: failed to set resharding status " << to_string(entry.reshard_status)
+                        << " on bucket " << bucket_info.bucket << ": " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+  return 0;
+}
+
+int RGWBucketReshard::set_info_resharding_status(cls_rgw_reshard_status status,
+                                                 const string& new_instance_id)
+{
+  bucket_info.reshard_status = status;
+  bucket_info.new_bucket_instance_id = new_instance_id;
+  int ret = store->put_bucket_instance_info(bucket_info, false, real_time(), &bucket_attrs);
+  if (ret < 0) {
+    lderr(store->ctx()) << "ERROR: failed to store bucket info of " << bucket_info.bucket << ": " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+  return 0;
+}
+
+/*
+ * Drop whatever an unfinished reshard left behind in the index shards:
+ * take the shards back to normal operation and throw away their change log.
+ */
+int RGWBucketReshard::clear_resharding()
+{
+  list<cls_rgw_bucket_instance_entry> status;
+  int ret = get_status(&status);
+  if (ret < 0) {
+    return ret;
+  }
+
+  bool clean = true;
+  for (auto& entry : status) {
+    if (entry.reshard_status != CLS_RGW_RESHARD_NONE) {
+      clean = false;
+    }
+  }
+  if (clean && bucket_info.reshard_status == CLS_RGW_RESHARD_NONE) {
+    return 0;
+  }
+
+  if (!bucket_info.new_bucket_instance_id.empty()) {
+    string linked_id;
+    ret = get_linked_instance(&linked_id);
+    if (ret < 0) {
+      return ret;
+    }
+    if (linked_id == bucket_info.new_bucket_instance_id) {
+      /* the reshard got as far as linking the new instance: finish it */
+      ldout(store->ctx(), 0) << "finishing interrupted reshard of bucket " << bucket_info.bucket
+                             << " into " << linked_id << dendl;
+      rgw_bucket new_bucket = bucket_info.bucket;
+      new_bucket.bucket_id = linked_id;
+      new_bucket.oid.clear();
+      RGWBucketInfo new_bucket_info;
+      RGWObjectCtx obj_ctx(store);
+      ret = store->get_bucket_instance_info(obj_ctx, new_bucket, new_bucket_info, nullptr, nullptr);
+      if (ret < 0) {
+        lderr(store->ctx()) << "ERROR: failed to read bucket info of new instance " << linked_id << ": " << cpp_strerror(-ret) << dendl;
+        return ret;
+      }
+      ret = switch_instance(new_bucket_info);
+      if (ret < 0) {
+        return ret;
+      }
+      ldout(store->ctx(), 0) << "bucket " << bucket_info.bucket << " was already resharded into "
+                             << linked_id << dendl;
+      return -EINVAL;
+    }
+  }
+
+  ldout(store->ctx(), 0) << "cleaning up unfinished reshard of bucket " << bucket_info.bucket << dendl;
+
+  ret = set_resharding_status(cls_rgw_bucket_instance_entry());
+  if (ret < 0) {
+    return ret;
+  }
+
+  for (auto& iter : bucket_objs) {
+    bool is_truncated;
+    do {
+      list<cls_rgw_reshard_log_entry> entries;
+      ret = cls_rgw_reshard_log_list(index_ctx, iter.second, string(), 0, &entries, &is_truncated);
+      if (ret < 0) {
+        return ret;
+      }
+      if (entries.empty()) {
+        break;
+      }
+      librados::ObjectWriteOperation op;
+      cls_rgw_reshard_log_trim(op, entries);
+      ret = index_ctx.operate(iter.second, &op);
+      if (ret < 0) {
+        return ret;
+      }
+    } while (is_truncated);
+  }
+
+  if (!bucket_info.new_bucket_instance_id.empty()) {
+    /* the index and instance info of the new bucket instance are of no use */
+    rgw_bucket new_bucket = bucket_info.bucket;
+    new_bucket.bucket_id = bucket_info.new_bucket_instance_id;
+    new_bucket.oid.clear();
+
+    librados::IoCtx new_index_ctx;
+    map<int, string> new_bucket_objs;
+    ret = store->open_bucket_index(new_bucket, new_index_ctx, new_bucket_objs);
+    if (ret == 0) {
+      for (auto& iter : new_bucket_objs) {
+        new_index_ctx.remove(iter.second);
+      }
+      RGWObjVersionTracker objv_tracker;
+      string entry = new_bucket.get_key();
+      rgw_bucket_instance_remove_entry(store, entry, &objv_tracker);
+    }
+  }
+
+  if (bucket_info.reshard_status != CLS_RGW_RESHARD_NONE ||
+      !bucket_info.new_bucket_instance_id.empty()) {
+    ret = set_info_resharding_status(CLS_RGW_RESHARD_NONE, string());
+    if (ret < 0) {
+      return ret;
+    }
+  }
+
+  return 0;
+}
+
+int RGWBucketReshard::create_new_bucket_instance(int new_num_shards,
+                                                 RGWBucketInfo& new_bucket_info)
+{
+  new_bucket_info = bucket_info;
+  store->create_bucket_id(&new_bucket_info.bucket.bucket_id);
+  new_bucket_info.bucket.oid.clear();
+
+  new_bucket_info.num_shards = new_num_shards;
+  new_bucket_info.objv_tracker.clear();
+  new_bucket_info.reshard_status = CLS_RGW_RESHARD_NONE;
+  new_bucket_info.new_bucket_instance_id.clear();
+
+  int ret = store->init_bucket_index(new_bucket_info.bucket, new_bucket_info.num_shards);
+  if (ret < 0) {
+    lderr(store->ctx()) << "ERROR: failed to init new bucket indexes: " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+
+  ret = store->put_bucket_instance_info(new_bucket_info, true, real_time(), &bucket_attrs);
+  if (ret < 0) {
+    lderr(store->ctx()) << "ERROR: failed to store new bucket instance info: " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+
+  return 0;
+}
+
+int RGWBucketReshard::copy_index(RGWBucketInfo& new_bucket_info, int max_entries,
+                                 bool verbose, ostream *out, Formatter *formatter)
+{
+  int num_source_shards = (bucket_info.num_shards > 0 ? bucket_info.num_shards : 1);
+  int num_target_shards = (new_bucket_info.num_shards > 0 ? new_bucket_info.num_shards : 1);
+
+  BucketReshardManager target_shards_mgr(store, new_bucket_info, num_target_shards);
+
+  verbose = verbose && formatter;
+  if (verbose) {
+    formatter->open_array_section("entries");
+  }
+
+  uint64_t total_entries = 0;
+
+  if (!verbose && out) {
+    *out << "total entries:";
+  }
+
+  for (int i = 0; i < num_source_shards; ++i) {
+    bool is_truncated = true;
+    string marker;
+    while (is_truncated) {
+      list<rgw_cls_bi_entry> entries;
+      int ret = store->bi_list(bucket_info.bucket, i, string(), marker, max_entries, &entries, &is_truncated);
+      if (ret < 0) {
+        lderr(store->ctx()) << "ERROR: bi_list(): " << cpp_strerror(-ret) << dendl;
+        return ret;
+      }
+
+      for (auto& entry : entries) {
+        if (verbose) {
+          formatter->open_object_section("entry");
+
+          encode_json("shard_id", i, formatter);
+          encode_json("num_entry", total_entries, formatter);
+          encode_json("entry", entry, formatter);
+        }
+        total_entries++;
+
+        marker = entry.idx;
+
+        int target_shard_id;
+        cls_rgw_obj_key cls_key;
+        uint8_t category;
+        rgw_bucket_category_stats stats;
+        bool account = entry.get_info(&cls_key, &category, &stats);
+        rgw_obj_key key(cls_key);
+        rgw_obj obj(new_bucket_info.bucket, key);
+        ret = store->get_target_shard_id(new_bucket_info, obj.get_hash_object(), &target_shard_id);
+        if (ret < 0) {
+          lderr(store->ctx()) << "ERROR: get_target_shard_id() returned ret=" << ret << dendl;
+          return ret;
+        }
+
+        int shard_index = (target_shard_id > 0 ? target_shard_id : 0);
+
+        ret = target_shards_mgr.add_entry(shard_index, entry, account, category, stats);
+        if (ret < 0) {
+          return ret;
+        }
+        if (verbose) {
+          formatter->close_section();
+          formatter->flush(*out);
+        } else if (out && !(total_entries % 1000)) {
+          *out << " " << total_entries;
+        }
+      }
+
+      ret = renew_lock_bucket();
+      if (ret < 0) {
+        return ret;
+      }
+    }
+  }
+  if (verbose) {
+    formatter->close_section();
+    formatter->flush(*out);
+  } else if (out) {
+    *out << " " << total_entries << std::endl;
+  }
+
+  int ret = target_shards_mgr.finish();
+  if (ret < 0) {
+    lderr(store->ctx()) << "ERROR: failed to reshard" << dendl;
+    return -EIO;
+  }
+
+  return 0;
+}
+
+int RGWBucketReshard::list_entries(RGWRados::BucketShard& bs, const string& name,
+                                   int max_entries, list<rgw_cls_bi_entry> *entries)
+{
+  string marker;
+  bool is_truncated;
+  do {
+    list<rgw_cls_bi_entry> result;
+    int ret = store->bi_list(bs, name, marker, max_entries, &result, &is_truncated);
+    if (ret < 0) {
+      return ret;
+    }
+    if (result.empty()) {
+      break;
+    }
+    marker = result.back().idx;
+    entries->splice(entries->end(), result);
+  } while (is_truncated);
+
+  return 0;
+}
+
+/*
+ * Make the new index agree with the old one about the object @name: copy
+ * all of its entries over, and drop the ones the old index no longer has.
+ */
+int RGWBucketReshard::sync_entry(RGWRados::BucketShard& source_bs,
+                                 RGWBucketInfo& new_bucket_info, const string& name,
+                                 int max_entries)
+{
+  rgw_obj_key key(cls_rgw_obj_key(name, string()));
+  rgw_obj obj(new_bucket_info.bucket, key);
+  RGWRados::BucketShard target_bs(store);
+  int ret = target_bs.init(new_bucket_info.bucket, obj);
+  if (ret < 0) {
+    return ret;
+  }
+
+  list<rgw_cls_bi_entry> source_entries;
+  ret = list_entries(source_bs, name, max_entries, &source_entries);
+  if (ret < 0) {
+    return ret;
+  }
+
+  list<rgw_cls_bi_entry> target_entries;
+  ret = list_entries(target_bs, name, max_entries, &target_entries);
+  if (ret < 0) {
+    return ret;
+  }
+
+  /*
+   * Every target entry of the object is either overwritten or removed, so
+   * the header moves by what the source entries account for minus what
+   * the target ones did.  The counters are unsigned: adding the two's
+   * complement of the target entries' share takes it back out.
+   */
+  map<uint8_t, rgw_bucket_category_stats> stats;
+  auto account = [&stats](rgw_cls_bi_entry& entry, bool add) {
+    cls_rgw_obj_key cls_key;
+    uint8_t category;
+    rgw_bucket_category_stats entry_stats;
+    if (!entry.get_info(&cls_key, &category, &entry_stats)) {
+      return;
+    }
+    rgw_bucket_category_stats& target = stats[category];
+    if (add) {
+      target.num_entries += entry_stats.num_entries;
+      target.total_size += entry_stats.total_size;
+      target.total_size_rounded += entry_stats.total_size_rounded;
+    } else {
+      target.num_entries -= entry_stats.num_entries;
+      target.total_size -= entry_stats.total_size;
+      target.total_size_rounded -= entry_stats.total_size_rounded;
+    }
+  };
+
+  librados::ObjectWriteOperation op;
+  set<string> source_keys;
+  for (auto& entry : source_entries) {
+    source_keys.insert(entry.idx);
+    store->bi_put(op, target_bs, entry);
+    account(entry, true);
+  }
+  set<string> stale_keys;
+  for (auto& entry : target_entries) {
+    if (source_keys.find(entry.idx) == source_keys.end()) {
+      stale_keys.insert(entry.idx);
+    }
+    account(entry, false);
+  }
+  if (!stale_keys.empty()) {
+    op.omap_rm_keys(stale_keys);
+  }
+  if (source_keys.empty() && stale_keys.empty()) {
+    return 0;
+  }
+  if (!stats.empty()) {
+    cls_rgw_bucket_update_stats(op, false, stats);
+  }
+
+  return target_bs.index_ctx.operate(target_bs.bucket_obj, &op);
+}
+
+/*
+ * Copy the objects that changed in the old index since they were last
+ * copied, as logged by the old index shards.
+ */
+int RGWBucketReshard::catch_up(RGWBucketInfo& new_bucket_info, int max_entries,
+                               uint64_t *num_changes)
+{
+  *num_changes = 0;
+
+  for (auto& iter : bucket_objs) {
+    RGWRados::BucketShard source_bs(store);
+    int ret = source_bs.init(bucket_info.bucket, (bucket_info.num_shards > 0 ? iter.first : -1));
+    if (ret < 0) {
+      return ret;
+    }
+
+    string marker;
+    bool is_truncated;
+    do {
+      list<cls_rgw_reshard_log_entry> entries;
+      ret = cls_rgw_reshard_log_list(index_ctx, iter.second, marker, max_entries,
+                                     &entries, &is_truncated);
+      if (ret < 0) {
+        lderr(store->ctx()) << "ERROR: failed to list reshard log of " << iter.second << ": " << cpp_strerror(-ret) << dendl;
+        return ret;
+      }
+      if (entries.empty()) {
+        break;
+      }
+
+      for (auto& entry : entries) {
+        ret = sync_entry(source_bs, new_bucket_info, entry.name, max_entries);
+        if (ret < 0) {
+          lderr(store->ctx()) << "ERROR: failed to copy index entries of " << entry.name << ": " << cpp_strerror(-ret) << dendl;
+          return ret;
+        }
+      }
+      *num_changes += entries.size();
+      marker = entries.back().name;
+
+      /* entries that changed again while being copied stay in the log */
+      librados::ObjectWriteOperation op;
+      cls_rgw_reshard_log_trim(op, entries);
+      ret = index_ctx.operate(iter.second, &op);
+      if (ret < 0) {
+        return ret;
+      }
+
+      ret = renew_lock_bucket();
+      if (ret < 0) {
+        return ret;
+      }
+    } while (is_truncated);
+  }
+
+  return 0;
+}
+
+int RGWBucketReshard::get_linked_instance(string *bucket_id)
+{
+  RGWObjectCtx obj_ctx(store);
+  RGWBucketEntryPoint entry_point;
+  int ret = store->get_bucket_entrypoint_info(obj_ctx, bucket_info.bucket.tenant, bucket_info.bucket.name,
+                                              entry_point, nullptr, nullptr, nullptr);
+  if (ret < 0) {
+    lderr(store->ctx()) << "ERROR: failed to read bucket entrypoint of " << bucket_info.bucket << ": " << cpp_strerror(-ret) << dendl;
+    return ret;
+  }
+  *bucket_id = entry_point.bucket.bucket_id;
+  return 0;
+}
+
+/*
+ * Once the bucket is linked to the new instance there is no going back:
+ * the old instance is only marked as resharded, so that writers still
+ * holding its bucket info redirect to the new index, and the new instance
+ * is never touched.  Retried, as the old index refuses writes until this
+ * gets through; if it never does, the next reshard or cancel of the bucket
+ * finishes it.
+ */
+int RGWBucketReshard::switch_instance(RGWBucketInfo& new_bucket_info)
+{
+  cls_rgw_bucket_instance_entry entry;
+  entry.reshard_status = CLS_RGW_RESHARD_DONE;
+  entry.new_bucket_instance_id = new_bucket_info.bucket.bucket_id;
+  entry.num_shards = new_bucket_info.num_shards;
+
+  int ret = 0;
+  bool info_done = false;
+  for (int i = 0; i < RESHARD_SWITCH_RETRIES; ++i) {
+    if (i > 0) {
+      sleep(1);
+    }
+    if (!info_done) {
+      ret = set_info_resharding_status(CLS_RGW_RESHARD_DONE, entry.new_bucket_instance_id);
+      if (ret < 0) {
+        continue;
+      }
+      info_done = true;
+    }
+    ret = set_resharding_status(entry);
+    if (ret == 0) {
+      return 0;
+    }
+  }
+  lderr(store->ctx()) << "ERROR: bucket " << bucket_info.bucket << " is linked to new instance "
+                      << entry.new_bucket_instance_id << " but the old instance could not be marked as resharded: "
+                      << cpp_strerror(-ret) << dendl;
+  return ret;
+}
+
+int RGWBucketReshard::do_reshard(RGWBucketInfo& new_bucket_info, int max_entries,
+                                 bool verbose, ostream *out, Formatter *formatter)
+{
+  CephContext *cct = store->ctx();
+
+  int ret = set_info_resharding_status(CLS_RGW_RESHARD_IN_PROGRESS, new_bucket_info.bucket.bucket_id);
+  if (ret < 0) {
+    return ret;
+  }
+
+  cls_rgw_bucket_instance_entry entry;
+  entry.reshard_status = CLS_RGW_RESHARD_IN_PROGRESS;
+  entry.new_bucket_instance_id = new_bucket_info.bucket.bucket_id;
+  entry.num_shards = new_bucket_info.num_shards;
+  ret = set_resharding_status(entry);
+  if (ret < 0) {
+    return ret;
+  }
+
+  ret = copy_index(new_bucket_info, max_entries, verbose, out, formatter);
+  if (ret < 0) {
+    return ret;
+  }
+
+  uint64_t num_changes;
+  for (int pass = 1; ; ++pass) {
+    ret = catch_up(new_bucket_info, max_entries, &num_changes);
+    if (ret < 0) {
+      return ret;
+    }
+    ldout(cct, 10) << "reshard of bucket " << bucket_info.bucket << ": catch up pass " << pass
+                   << " copied " << num_changes << " changed objects" << dendl;
+    if (num_changes < (uint64_t)cct->_conf->rgw_reshard_block_threshold ||
+        pass >= cct->_conf->rgw_reshard_max_catchup_passes) {
+      break;
+    }
+  }
+
+  /* refuse writes to the old index while the last changes are copied */
+  entry.reshard_status = CLS_RGW_RESHARD_BLOCKED;
+  ret = set_resharding_status(entry);
+  if (ret < 0) {
+    return ret;
+  }
+
+  /* the new index's stats are kept up to date as entries are copied */
+  return catch_up(new_bucket_info, max_entries, &num_changes);
+}
+
+int RGWBucketReshard::execute(int num_shards, int max_op_entries, bool verbose,
+                              ostream *out, Formatter *formatter)
+{
+  if (bucket_info.reshard_status == CLS_RGW_RESHARD_DONE) {
+    ldout(store->ctx(), 0) << "bucket " << bucket_info.bucket << " was already resharded into "
+                           << bucket_info.new_bucket_instance_id << dendl;
+    return -EINVAL;
+  }
+
+  int ret = open_index();
+  if (ret < 0) {
+    return ret;
+  }
+
+  ret = lock_bucket();
+  if (ret < 0) {
+    return ret;
+  }
+
+  ret = clear_resharding();
+  if (ret < 0) {
+    unlock_bucket();
+    return ret;
+  }
+
+  RGWBucketInfo new_bucket_info;
+  ret = create_new_bucket_instance(num_shards, new_bucket_info);
+  if (ret < 0) {
+    unlock_bucket();
+    return ret;
+  }
+
+  if (out) {
+    *out << "old bucket instance id: " << bucket_info.bucket.bucket_id << std::endl;
+    *out << "new bucket instance id: " << new_bucket_info.bucket.bucket_id << std::endl;
+  }
+
+  ret = do_reshard(new_bucket_info, max_op_entries, verbose, out, formatter);
+  if (ret >= 0) {
+    ret = rgw_link_bucket(store, new_bucket_info.owner, new_bucket_info.bucket,
+                          bucket_info.creation_time);
+    if (ret < 0) {
+      lderr(store->ctx()) << "ERROR: failed to link new bucket instance (bucket_id=" << new_bucket_info.bucket.bucket_id << "): " << cpp_strerror(-ret) << dendl;
+    }
+  }
+  if (ret < 0) {
+    /*
+     * Unless the bucket ended up linked to the new instance anyway, nothing
+     * refers to it yet and clear_resharding() throws it away; otherwise it
+     * rolls forward.
+     */
+    bucket_info.new_bucket_instance_id = new_bucket_info.bucket.bucket_id;
+    int r = clear_resharding();
+    if (r == -EINVAL && bucket_info.reshard_status == CLS_RGW_RESHARD_DONE) {
+      ret = 0;
+    } else if (r < 0) {
+      lderr(store->ctx()) << "ERROR: failed to clean up after failed reshard of bucket " << bucket_info.bucket << ": " << cpp_strerror(-r) << dendl;
+    }
+    unlock_bucket();
+    return ret;
+  }
+
+  ret = switch_instance(new_bucket_info);
+
+  unlock_bucket();
+  return ret;
+}
+
+int RGWBucketReshard::get_status(list<cls_rgw_bucket_instance_entry> *status)
+{
+  int ret = open_index();
+  if (ret < 0) {
+    return ret;
+  }
+
+  for (auto& iter : bucket_objs) {
+    rgw_bucket_dir_header header;
+    ret = cls_rgw_get_dir_header(index_ctx, iter.second, &header);
+    if (ret < 0) {
+      return ret;
+    }
+    status->push_back(header.new_instance);
+  }
+
+  return 0;
+}
+
+int RGWBucketReshard::cancel()
+{
+  if (bucket_info.reshard_status == CLS_RGW_RESHARD_DONE) {
+    ldout(store->ctx(), 0) << "bucket " << bucket_info.bucket << " was already resharded into "
+                           << bucket_info.new_bucket_instance_id << dendl;
+    return -EINVAL;
+  }
+
+  int ret = open_index();
+  if (ret < 0) {
+    return ret;
+  }
+
+  /* a reshard still running would have the lock */
+  ret = lock_bucket();
+  if (ret < 0) {
+    return ret;
+  }
+
+  ret = clear_resharding();
+
+  unlock_bucket();
+  return ret;
+}
+
+RGWReshard::RGWReshard(RGWRados *_store)
+  : store(_store), cct(_store->ctx()),
+    num_logshards(_store->ctx()->_conf->rgw_reshard_num_logs),
+    queued_lock("RGWReshard::queued_lock"), worker(nullptr)
+{
+  if (num_logshards <= 0) {
+    num_logshards = 1;
+  }
+}
+
+void RGWReshard::get_logshard_oid(int shard_num, string *oid)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%010u", (unsigned)shard_num);
+  *oid = reshard_oid_prefix + buf;
+}
+
+void RGWReshard::get_bucket_logshard_oid(const string& key, string *oid)
+{
+  uint32_t sid = ceph_str_hash_linux(key.c_str(), key.size());
+  get_logshard_oid(sid % num_logshards, oid);
+}
+
+int RGWReshard::add(rgw_reshard_entry& entry)
+{
+  string key;
+  entry.get_key(&key);
+
+  {
+    Mutex::Locker l(queued_lock);
+    if (!queued.insert(key).second) {
+      return 0;
+    }
+  }
+
+  string logshard_oid;
+  get_bucket_logshard_oid(key, &logshard_oid);
+
+  map<string, bufferlist> vals;
+  ::encode(entry, vals[key]);
+  int ret = store->reshard_pool_ctx.omap_set(logshard_oid, vals);
+  if (ret < 0) {
+    lderr(cct) << "ERROR: failed to add entry to reshard log, oid=" << logshard_oid << " ret=" << ret << dendl;
+    Mutex::Locker l(queued_lock);
+    queued.erase(key);
+    return ret;
+  }
+
+  return 0;
+}
+
+int RGWReshard::get(rgw_reshard_entry& entry)
+{
+  string key;
+  entry.get_key(&key);
+
+  string logshard_oid;
+  get_bucket_logshard_oid(key, &logshard_oid);
+
+  set<string> keys;
+  keys.insert(key);
+  map<string, bufferlist> vals;
+  int ret = store->reshard_pool_ctx.omap_get_vals_by_keys(logshard_oid, keys, &vals);
+  if (ret < 0) {
+    return ret;
+  }
+  auto iter = vals.find(key);
+  if (iter == vals.end()) {
+    return -ENOENT;
+  }
+
+  try {
+    bufferlist::iterator biter = iter->second.begin();
+    ::decode(entry, biter);
+  } catch (buffer::error& err) {
+    lderr(cct) << "ERROR: failed to decode reshard entry " << key << dendl;
+    return -EIO;
+  }
+
+  return 0;
+}
+
+int RGWReshard::remove(rgw_reshard_entry& entry)
+{
+  string key;
+  entry.get_key(&key);
+
+  string logshard_oid;
+  get_bucket_logshard_oid(key, &logshard_oid);
+
+  set<string> keys;
+  keys.insert(key);
+  int ret = store->reshard_pool_ctx.omap_rm_keys(logshard_oid, keys);
+  if (ret == -ENOENT) {
+    ret = 0;
+  }
+  if (ret < 0) {
+    lderr(cct) << "ERROR: failed to remove entry from reshard log, oid=" << logshard_oid << " key=" << key << " ret=" << ret << dendl;
+  }
+  return ret;
+}
+
+int RGWReshard::list(int logshard_num, string& marker, uint32_t max,
+                     std::list<rgw_reshard_entry>& entries, bool *is_truncated)
+{
+  string logshard_oid;
+  get_logshard_oid(logshard_num, &logshard_oid);
+
+  map<string, bufferlist> vals;
+  int ret = store->reshard_pool_ctx.omap_get_vals(logshard_oid, marker, max, &vals);
+  if (ret == -ENOENT) {
+    ret = 0;
+  }
+  if (ret < 0) {
+    lderr(cct) << "ERROR: failed to list reshard log, oid=" << logshard_oid << " ret=" << ret << dendl;
+    return ret;
+  }
+
+  for (auto& iter : vals) {
+    rgw_reshard_entry entry;
+    try {
+      bufferlist::iterator biter = iter.second.begin();
+      ::decode(entry, biter);
+    } catch (buffer::error& err) {
+      lderr(cct) << "ERROR: failed to decode reshard entry " << iter.first << dendl;
+      return -EIO;
+    }
+    entries.push_back(entry);
+    marker = iter.first;
+  }
+  *is_truncated = (vals.size() == max);
+
+  return 0;
+}
+
+int RGWReshard::process_single_logshard(int logshard_num)
+{
+  string marker;
+  bool is_truncated = true;
+
+  while (is_truncated && !going_down()) {
+    std::list<rgw_reshard_entry> entries;
+    int ret = list(logshard_num, marker, 1000, entries, &is_truncated);
+    if (ret < 0) {
+      return ret;
+    }
+
+    for (auto& entry : entries) {
+      if (going_down()) {
+        break;
+      }
+
+      RGWBucketInfo bucket_info;
+      map<string, bufferlist> attrs;
+      RGWObjectCtx obj_ctx(store);
+      ret = store->get_bucket_info(obj_ctx, entry.tenant, entry.bucket_name,
+                                   bucket_info, nullptr, &attrs);
+      if (ret < 0 && ret != -ENOENT) {
+        lderr(cct) << "ERROR: failed to get bucket info of " << entry.bucket_name << ": " << cpp_strerror(-ret) << dendl;
+        continue;
+      }
+      if (ret == -ENOENT || bucket_info.bucket.bucket_id != entry.bucket_id) {
+        /* the bucket was removed or resharded since it was queued */
+        remove(entry);
+        continue;
+      }
+
+      RGWBucketReshard br(store, bucket_info, attrs);
+      ret = br.execute(entry.new_num_shards, 1000);
+      if (ret == -EBUSY) {
+        /* someone else is resharding it */
+        continue;
+      }
+      if (ret < 0) {
+        lderr(cct) << "ERROR: failed to reshard bucket " << entry.bucket_name << ": " << cpp_strerror(-ret) << dendl;
+      }
+
+      remove(entry);
+    }
+  }
+
+  return 0;
+}
+
+int RGWReshard::process_all_logshards()
+{
+  {
+    Mutex::Locker l(queued_lock);
+    queued.clear();
+  }
+
+  int ret = 0;
+  for (int i = 0; i < num_logshards && !going_down(); i++) {
+    int r = process_single_logshard(i);
+    if (r < 0) {
+      ldout(cct, 0) << "ERROR: failed to process reshard log " << i << ": " << cpp_strerror(-r) << dendl;
+      ret = r;
+    }
+  }
+
+  return ret;
+}
+
+bool RGWReshard::going_down()
+{
+  return (down_flag.read() != 0);
+}
+
+void RGWReshard::start_processor()
+{
+  worker = new ReshardWorker(cct, this);
+  worker->create("rgw_reshard");
+}
+
+void RGWReshard::stop_processor()
+{
+  down_flag.set(1);
+  if (worker) {
+    worker->stop();
+    worker->join();
+  }
+  delete worker;
+  worker = nullptr;
+}
+
+void *RGWReshard::ReshardWorker::entry() {
+  do {
+    utime_t start = ceph_clock_now();
+    ldout(cct, 2) << "reshard: start" << dendl;
+    int r = reshard->process_all_logshards();
+    if (r < 0) {
+      ldout(cct, 0) << "ERROR: reshard process returned error r=" << r << dendl;
+    }
+    ldout(cct, 2) << "reshard: stop" << dendl;
+
+    if (reshard->going_down())
+      break;
+
+    utime_t end = ceph_clock_now();
+    end -= start;
+    int secs = cct->_conf->rgw_reshard_thread_interval;
+
+    if (secs <= end.sec())
+      continue; // next round
+
+    secs -= end.sec();
+
+    lock.Lock();
+    cond.WaitInterval(lock, utime_t(secs, 0));
+    lock.Unlock();
+  } while (!reshard->going_down());
+
+  return NULL;
+}
+
+void RGWReshard::ReshardWorker::stop()
+{
+  Mutex::Locker l(lock);
+  cond.Signal();
+}
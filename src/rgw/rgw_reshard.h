@@ -0,0 +1,177 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef RGW_RESHARD_H
+#define RGW_RESHARD_H
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+
+#include "include/types.h"
+#include "include/atomic.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
+#include "cls/lock/cls_lock_client.h"
+#include "cls/rgw/cls_rgw_types.h"
+#include "rgw_rados.h"
+
+/*
+ * A bucket waiting in the reshard queue.
+ */
+struct rgw_reshard_entry {
+  ceph::real_time time;
+  std::string tenant;
+  std::string bucket_name;
+  std::string bucket_id;
+  std::string new_instance_id;
+  uint32_t old_num_shards{0};
+  uint32_t new_num_shards{0};
+
+  void encode(bufferlist& bl) const {
+    ENCODE_START(1, 1, bl);
+    ::encode(time, bl);
+    ::encode(tenant, bl);
+    ::encode(bucket_name, bl);
+    ::encode(bucket_id, bl);
+    ::encode(new_instance_id, bl);
+    ::encode(old_num_shards, bl);
+    ::encode(new_num_shards, bl);
+    ENCODE_FINISH(bl);
+  }
+
+  void decode(bufferlist::iterator& bl) {
+    DECODE_START(1, bl);
+    ::decode(time, bl);
+    ::decode(tenant, bl);
+    ::decode(bucket_name, bl);
+    ::decode(bucket_id, bl);
+    ::decode(new_instance_id, bl);
+    ::decode(old_num_shards, bl);
+    ::decode(new_num_shards, bl);
+    DECODE_FINISH(bl);
+  }
+
+  void dump(Formatter *f) const;
+
+  static void get_key(const std::string& tenant, const std::string& bucket_name,
+                      std::string *key);
+  void get_key(std::string *key) const {
+    get_key(tenant, bucket_name, key);
+  }
+};
+WRITE_CLASS_ENCODER(rgw_reshard_entry)
+
+/*
+ * Reshards the index of a single bucket while it stays writable.
+ *
+ * The entries are copied into the index of a new bucket instance while the
+ * old index shards log the names of the objects that change under it.  The
+ * logged names are then copied again until few enough are left, writes to
+ * the old shards are refused while the last of them are copied, and the
+ * bucket is switched over to the new instance.  Writers that were refused
+ * wait for the switch and follow the bucket to its new index.
+ */
+class RGWBucketReshard {
+  RGWRados *store;
+  RGWBucketInfo bucket_info;
+  std::map<std::string, bufferlist> bucket_attrs;
+
+  librados::IoCtx index_ctx;
+  std::map<int, std::string> bucket_objs;
+
+  rados::cls::lock::Lock reshard_lock;
+  utime_t lock_renewed;
+
+  int open_index();
+  int lock_bucket();
+  int renew_lock_bucket();
+  void unlock_bucket();
+
+  int set_resharding_status(const cls_rgw_bucket_instance_entry& entry);
+  int set_info_resharding_status(cls_rgw_reshard_status status,
+                                 const std::string& new_instance_id);
+  int clear_resharding();
+  int create_new_bucket_instance(int new_num_shards,
+                                 RGWBucketInfo& new_bucket_info);
+  int copy_index(RGWBucketInfo& new_bucket_info, int max_entries,
+                 bool verbose, std::ostream *out, Formatter *formatter);
+  int list_entries(RGWRados::BucketShard& bs, const std::string& name,
+                   int max_entries, std::list<rgw_cls_bi_entry> *entries);
+  int sync_entry(RGWRados::BucketShard& source_bs,
+                 RGWBucketInfo& new_bucket_info, const std::string& name,
+                 int max_entries);
+  int catch_up(RGWBucketInfo& new_bucket_info, int max_entries,
+               uint64_t *num_changes);
+  int do_reshard(RGWBucketInfo& new_bucket_info, int max_entries,
+                 bool verbose, std::ostream *out, Formatter *formatter);
+  int get_linked_instance(std::string *bucket_id);
+  int switch_instance(RGWBucketInfo& new_bucket_info);
+
+public:
+  RGWBucketReshard(RGWRados *_store, const RGWBucketInfo& _bucket_info,
+                   const std::map<std::string, bufferlist>& _bucket_attrs);
+
+  int execute(int num_shards, int max_op_entries, bool verbose = false,
+              std::ostream *out = nullptr, Formatter *formatter = nullptr);
+  int get_status(std::list<cls_rgw_bucket_instance_entry> *status);
+  int cancel();
+};
+
+/*
+ * The reshard queue, and the thread that works through it.  Buckets are
+ * queued in rgw_reshard_num_logs omap objects in the zone log pool.
+ */
+class RGWReshard {
+  RGWRados *store;
+  CephContext *cct;
+  int num_logshards;
+  atomic_t down_flag;
+
+  Mutex queued_lock;
+  std::set<std::string> queued;   ///< added since the last pass
+
+  class ReshardWorker : public Thread {
+    CephContext *cct;
+    RGWReshard *reshard;
+    Mutex lock;
+    Cond cond;
+
+  public:
+    ReshardWorker(CephContext *_cct, RGWReshard *_reshard)
+      : cct(_cct), reshard(_reshard), lock("ReshardWorker") {}
+    void *entry() override;
+    void stop();
+  };
+
+  ReshardWorker *worker;
+
+  void get_logshard_oid(int shard_num, std::string *oid);
+  void get_bucket_logshard_oid(const std::string& key, std::string *oid);
+
+public:
+  explicit RGWReshard(RGWRados *_store);
+  ~RGWReshard() {
+    stop_processor();
+  }
+
+  int add(rgw_reshard_entry& entry);
+  int get(rgw_reshard_entry& entry);
+  int remove(rgw_reshard_entry& entry);
+  int list(int logshard_num, std::string& marker, uint32_t max,
+           std::list<rgw_reshard_entry>& entries, bool *is_truncated);
+  int get_num_logshards() const {
+    return num_logshards;
+  }
+
+  int process_single_logshard(int logshard_num);
+  int process_all_logshards();
+
+  bool going_down();
+  void start_processor();
+  void stop_processor();
+};
+
+#endif
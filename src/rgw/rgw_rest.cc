@@ -850,6 +850,7 @@ int dump_body(struct req_state* const s,
               const char* const buf,
               const size_t len)
 {
+  RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_CLIENT);
   try {
     return RESTFUL_IO(s)->send_body(buf, len);
   } catch (rgw::io::Exception& e) {
@@ -871,6 +872,7 @@ int recv_body(struct req_state* const s,
               char* const buf,
               const size_t max)
 {
+  RGWReqPhaseTimer timer(s, RGW_REQ_PHASE_CLIENT);
   try {
     return AWS_AUTHv4_IO(s)->recv_body(buf, max, s->aws4_auth_needs_complete);
   } catch (rgw::io::Exception& e) {
@@ -17,6 +17,7 @@
 #include "rgw_rest_s3.h"
 #include "rgw_rest_s3website.h"
 #include "rgw_auth_s3.h"
+#include "rgw_auth_cache.h"
 #include "rgw_acl.h"
 #include "rgw_policy_s3.h"
 #include "rgw_user.h"
@@ -474,6 +475,11 @@ int RGWListBucket_ObjStore_S3::get_params()
   }
   delimiter = s->info.args.get("delimiter");
   encoding_type = s->info.args.get("encoding-type");
+  s->info.args.get_bool("allow-unordered", &allow_unordered, false);
+  if (allow_unordered && !delimiter.empty()) {
+    /* common prefixes need the entries in order */
+    return -EINVAL;
+  }
   if (s->system_request) {
     s->info.args.get_bool("objs-container", &objs_container, false);
     const char *shard_id_str = s->info.env->get("HTTP_RGWX_SHARD_ID");
@@ -4513,8 +4519,16 @@ RGWAuthApplier::aplptr_t RGWLDAPAuthEngine::authenticate() const
     }
   }*/
 
-  if (ldh->auth(base64_token.id, base64_token.key) != 0) {
-    return nullptr;
+  /* a bind per request would make the directory server the bottleneck, so
+   * successful ones are remembered for a while */
+  RGWAuthCache& ldap_cache = rgw_ldap_auth_cache(cct);
+  string key_digest, unused;
+  calc_hash_sha256(base64_token.id + ":" + base64_token.key, key_digest);
+  if (!ldap_cache.find(base64_token.id, key_digest, unused)) {
+    if (ldh->auth(base64_token.id, base64_token.key) != 0) {
+      return nullptr;
+    }
+    ldap_cache.add(base64_token.id, key_digest, unused);
   }
 
   return apl_factory->create_apl_remote(cct, get_acl_strategy(), get_creds_info(base64_token));
@@ -0,0 +1,140 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <deque>
+
+#include "common/admin_socket.h"
+#include "common/Formatter.h"
+#include "common/Mutex.h"
+
+#include "rgw_common.h"
+#include "rgw_slow_requests.h"
+
+#define dout_subsys ceph_subsys_rgw
+
+class RGWSlowRequestHistory : public AdminSocketHook {
+  CephContext *cct;
+
+  struct Entry {
+    utime_t time;
+    utime_t duration;
+    std::string trans_id;
+    std::string op_name;
+    std::string method;
+    std::string uri;
+    std::string bucket;
+    std::string object;
+    int http_status;
+    ceph::timespan phase_time[RGW_REQ_PHASE_MAX];
+
+    void dump(Formatter *f) const {
+      f->dump_stream("time") << time;
+      f->dump_float("duration", duration);
+      f->dump_string("trans_id", trans_id);
+      f->dump_string("op", op_name);
+      f->dump_string("method", method);
+      f->dump_string("uri", uri);
+      f->dump_string("bucket", bucket);
+      f->dump_string("object", object);
+      f->dump_int("http_status", http_status);
+      f->open_object_section("phases");
+      for (int i = 0; i < RGW_REQ_PHASE_MAX; i++) {
+        f->dump_float(rgw_req_phase_name(i),
+                      std::chrono::duration<double>(phase_time[i]).count());
+      }
+      f->close_section();
+    }
+  };
+
+  Mutex lock;
+  std::deque<Entry> history;
+
+public:
+  explicit RGWSlowRequestHistory(CephContext *_cct)
+    : cct(_cct), lock("RGWSlowRequestHistory") {
+    int r = cct->get_admin_socket()->register_command(
+      "dump_historic_slow_requests", "dump_historic_slow_requests", this,
+      "show recent requests slower than rgw_op_complaint_time");
+    if (r < 0) {
+      lderr(cct) << "ERROR: failed to register admin socket command (r=" << r
+                 << ")" << dendl;
+    }
+  }
+
+  ~RGWSlowRequestHistory() {
+    cct->get_admin_socket()->unregister_command("dump_historic_slow_requests");
+  }
+
+  void add(req_state *s, const std::string& op_name, const utime_t& duration) {
+    Entry e;
+    e.time = s->time;
+    e.duration = duration;
+    e.trans_id = s->trans_id;
+    e.op_name = op_name;
+    e.method = s->info.method ? s->info.method : "";
+    e.uri = s->info.request_uri;
+    e.bucket = s->bucket_name;
+    e.object = s->object.name;
+    e.http_status = s->err.http_ret;
+    for (int i = 0; i < RGW_REQ_PHASE_MAX; i++) {
+      e.phase_time[i] = s->phase_time[i];
+    }
+
+    Mutex::Locker l(lock);
+    history.push_back(std::move(e));
+    while (history.size() > cct->_conf->rgw_op_history_slow_op_size) {
+      history.pop_front();
+    }
+  }
+
+  bool call(std::string command, cmdmap_t& cmdmap, std::string format,
+            bufferlist& out) override {
+    Formatter *f = Formatter::create(format, "json-pretty", "json-pretty");
+    f->open_object_section("slow_request_history");
+    f->dump_float("complaint_time", cct->_conf->rgw_op_complaint_time);
+    {
+      Mutex::Locker l(lock);
+      f->dump_int("num_requests", history.size());
+      f->open_array_section("requests");
+      for (const auto& e : history) {
+        f->open_object_section("request");
+        e.dump(f);
+        f->close_section();
+      }
+      f->close_section();
+    }
+    f->close_section();
+    stringstream ss;
+    f->flush(ss);
+    out.append(ss);
+    delete f;
+    return true;
+  }
+};
+
+static RGWSlowRequestHistory *slow_requests = NULL;
+
+void rgw_slow_requests_init(CephContext *cct)
+{
+  slow_requests = new RGWSlowRequestHistory(cct);
+}
+
+void rgw_slow_requests_finalize()
+{
+  delete slow_requests;
+  slow_requests = NULL;
+}
+
+bool rgw_is_slow_request(CephContext *cct, const utime_t& duration)
+{
+  double complaint_time = cct->_conf->rgw_op_complaint_time;
+  return complaint_time > 0 && (double)duration >= complaint_time;
+}
+
+void rgw_slow_requests_add(req_state *s, const std::string& op_name,
+                           const utime_t& duration)
+{
+  if (slow_requests) {
+    slow_requests->add(s, op_name, duration);
+  }
+}
@@ -0,0 +1,27 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_RGW_SLOW_REQUESTS_H
+#define CEPH_RGW_SLOW_REQUESTS_H
+
+#include <string>
+
+#include "include/utime.h"
+
+class CephContext;
+struct req_state;
+
+/*
+ * Keeps the last rgw_op_history_slow_op_size requests that took longer than
+ * rgw_op_complaint_time, with the time they spent in each RGWReqPhase, for
+ * the dump_historic_slow_requests admin socket command.
+ */
+void rgw_slow_requests_init(CephContext *cct);
+void rgw_slow_requests_finalize();
+
+/// whether a request that took this long is a slow one
+bool rgw_is_slow_request(CephContext *cct, const utime_t& duration);
+void rgw_slow_requests_add(req_state *s, const std::string& op_name,
+                           const utime_t& duration);
+
+#endif
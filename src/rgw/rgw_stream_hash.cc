@@ -0,0 +1,150 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <deque>
+#include <vector>
+
+#include "common/Thread.h"
+#include "common/ceph_context.h"
+#include "common/dout.h"
+
+#include "rgw_stream_hash.h"
+
+#define dout_subsys ceph_subsys_rgw
+
+class RGWHashThreads {
+  CephContext *cct;
+
+  Mutex lock;
+  Cond cond;
+  std::deque<RGWStreamHash *> queue;
+  bool stopping{false};
+
+  class Worker : public Thread {
+    RGWHashThreads *pool;
+  public:
+    explicit Worker(RGWHashThreads *_pool) : pool(_pool) {}
+    void *entry() override {
+      pool->run();
+      return NULL;
+    }
+  };
+  std::vector<Worker *> workers;
+
+  void run() {
+    Mutex::Locker l(lock);
+    while (!stopping || !queue.empty()) {
+      if (queue.empty()) {
+        cond.Wait(lock);
+        continue;
+      }
+      RGWStreamHash *h = queue.front();
+      queue.pop_front();
+      lock.Unlock();
+      h->process();
+      lock.Lock();
+    }
+  }
+
+public:
+  RGWHashThreads(CephContext *_cct, int num_threads)
+    : cct(_cct), lock("RGWHashThreads") {
+    for (int i = 0; i < num_threads; i++) {
+      Worker *w = new Worker(this);
+      w->create("rgw_hash");
+      workers.push_back(w);
+    }
+    ldout(cct, 5) << "started " << num_threads << " upload hash threads" << dendl;
+  }
+
+  ~RGWHashThreads() {
+    lock.Lock();
+    stopping = true;
+    cond.SignalAll();
+    lock.Unlock();
+    for (auto w : workers) {
+      w->join();
+      delete w;
+    }
+  }
+
+  void queue_hash(RGWStreamHash *h) {
+    Mutex::Locker l(lock);
+    queue.push_back(h);
+    cond.Signal();
+  }
+};
+
+static RGWHashThreads *hash_threads = NULL;
+
+void rgw_stream_hash_init(CephContext *cct)
+{
+  int num_threads = cct->_conf->rgw_put_obj_hash_threads;
+  if (num_threads > 0) {
+    hash_threads = new RGWHashThreads(cct, num_threads);
+  }
+}
+
+void rgw_stream_hash_finalize()
+{
+  delete hash_threads;
+  hash_threads = NULL;
+}
+
+static void hash_buffers(ceph::crypto::MD5 *hash, const bufferlist& bl)
+{
+  /* by buffer, c_str() would copy a fragmented chunk to hash it */
+  for (const auto& p : bl.buffers()) {
+    hash->Update((const byte *)p.c_str(), p.length());
+  }
+}
+
+RGWStreamHash::RGWStreamHash(ceph::crypto::MD5 *_hash, bool _async)
+  : hash(_hash), async(_async && hash_threads), lock("RGWStreamHash")
+{
+}
+
+RGWStreamHash::~RGWStreamHash()
+{
+  /* the request may bail out with data still queued */
+  flush();
+}
+
+void RGWStreamHash::update(const bufferlist& bl)
+{
+  if (!async) {
+    hash_buffers(hash, bl);
+    return;
+  }
+
+  Mutex::Locker l(lock);
+  pending.push_back(bl);
+  if (!queued) {
+    queued = true;
+    hash_threads->queue_hash(this);
+  }
+}
+
+void RGWStreamHash::process()
+{
+  Mutex::Locker l(lock);
+  while (!pending.empty()) {
+    std::list<bufferlist> bls;
+    bls.swap(pending);
+    lock.Unlock();
+    for (const auto& bl : bls) {
+      hash_buffers(hash, bl);
+    }
+    lock.Lock();
+  }
+  queued = false;
+  cond.SignalAll();
+}
+
+void RGWStreamHash::flush()
+{
+  Mutex::Locker l(lock);
+  while (queued) {
+    cond.Wait(lock);
+  }
+}
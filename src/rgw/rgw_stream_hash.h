@@ -0,0 +1,50 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef CEPH_RGW_STREAM_HASH_H
+#define CEPH_RGW_STREAM_HASH_H
+
+#include <list>
+
+#include "include/buffer.h"
+#include "common/ceph_crypto.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+
+class CephContext;
+
+/*
+ * Feeds the data of an upload into a hash as it arrives.
+ *
+ * When async, the data is only referenced here and hashed by one of the
+ * rgw_put_obj_hash_threads threads shared by all requests, while the
+ * request thread goes on reading the next chunk from the client and
+ * sending it to rados.  The data of one upload is hashed by one thread at
+ * a time, in the order it was added.  The hash must not be touched until
+ * flush() returned.
+ */
+class RGWStreamHash {
+  ceph::crypto::MD5 *hash;
+  bool async;
+
+  Mutex lock;
+  Cond cond;
+  std::list<bufferlist> pending;
+  bool queued{false}; ///< waiting for or held by a hash thread
+
+  friend class RGWHashThreads;
+  void process();
+
+public:
+  RGWStreamHash(ceph::crypto::MD5 *_hash, bool _async);
+  ~RGWStreamHash();
+
+  void update(const bufferlist& bl);
+  /// wait until everything added so far went into the hash
+  void flush();
+};
+
+void rgw_stream_hash_init(CephContext *cct);
+void rgw_stream_hash_finalize();
+
+#endif
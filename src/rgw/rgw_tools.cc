@@ -85,6 +85,117 @@ int rgw_delete_system_obj(RGWRados *rgwstore, rgw_bucket& bucket, const string&
   return rgwstore->delete_system_obj(obj, objv_tracker);
 }
 
+#ifdef WITH_RADOSGW_ASIO_FRONTEND
+namespace {
+
+/* resumes the coroutine suspended in yield_operate() */
+struct YieldCompletion {
+  using Signature = void(boost::system::error_code);
+#if BOOST_VERSION >= 106600
+  using Result = boost::asio::async_result<boost::asio::yield_context,
+                                           Signature>;
+  using Handler = Result::completion_handler_type;
+#else
+  using Handler = boost::asio::handler_type<boost::asio::yield_context,
+                                            Signature>::type;
+  using Result = boost::asio::async_result<Handler>;
+#endif
+  Handler handler;
+  boost::asio::io_service& service;
+  boost::asio::io_service::work work; // keeps run() going while in flight
+
+  YieldCompletion(Handler&& handler, boost::asio::io_service& service)
+    : handler(std::move(handler)), service(service), work(service) {}
+
+  static void finish(librados::completion_t cb, void *arg) {
+    auto c = static_cast<YieldCompletion*>(arg);
+    boost::system::error_code ec;
+    int r = rados_aio_get_return_value(cb);
+    if (r < 0) {
+      ec.assign(-r, boost::system::system_category());
+    }
+    // hand the result back to the coroutine's strand instead of resuming
+    // it on the librados finisher thread
+    c->service.post(boost::asio::detail::bind_handler(std::move(c->handler), ec));
+    delete c;
+  }
+};
+
+template <typename Submit>
+int yield_operate(optional_yield_context y, bool wait_for_safe,
+                  uint64_t *pversion, Submit&& submit)
+{
+  boost::system::error_code ec;
+  YieldCompletion::Handler handler(y.get_yield_context()[ec]);
+  YieldCompletion::Result result(handler);
+
+  auto state = new YieldCompletion(std::move(handler), y.get_io_service());
+  librados::AioCompletion *c;
+  if (wait_for_safe) {
+    c = librados::Rados::aio_create_completion(state, nullptr,
+                                               YieldCompletion::finish);
+  } else {
+    c = librados::Rados::aio_create_completion(state, YieldCompletion::finish,
+                                               nullptr);
+  }
+
+  int r = submit(c);
+  if (r < 0) {
+    c->release();
+    delete state;
+    return r;
+  }
+
+  result.get();
+
+  if (pversion) {
+    *pversion = c->get_version64();
+  }
+  c->release();
+  return -ec.value();
+}
+
+} // anonymous namespace
+#endif
+
+int rgw_rados_operate(librados::IoCtx& ioctx, const std::string& oid,
+                      librados::ObjectReadOperation *op, bufferlist *pbl,
+                      optional_yield_context y, uint64_t *pversion)
+{
+#ifdef WITH_RADOSGW_ASIO_FRONTEND
+  if (y) {
+    return yield_operate(y, false, pversion,
+                         [&] (librados::AioCompletion *c) {
+                           return ioctx.aio_operate(oid, c, op, pbl);
+                         });
+  }
+#endif
+  int r = ioctx.operate(oid, op, pbl);
+  if (pversion) {
+    *pversion = ioctx.get_last_version();
+  }
+  return r;
+}
+
+int rgw_rados_operate(librados::IoCtx& ioctx, const std::string& oid,
+                      librados::ObjectWriteOperation *op,
+                      optional_yield_context y, uint64_t *pversion)
+{
+#ifdef WITH_RADOSGW_ASIO_FRONTEND
+  if (y) {
+    return yield_operate(y, true, pversion,
+                         [&] (librados::AioCompletion *c) {
+                           return ioctx.aio_operate(oid, c, op);
+                         });
+  }
+#endif
+  int r = ioctx.operate(oid, op);
+  if (pversion) {
+    *pversion = ioctx.get_last_version();
+  }
+  return r;
+}
+
 void parse_mime_map_line(const char *start, const char *end)
 {
   char line[end - start + 1];
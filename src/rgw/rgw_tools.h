@@ -8,7 +8,9 @@
 
 #include "include/types.h"
 #include "common/ceph_time.h"
+#include "include/rados/librados.hpp"
 #include "rgw_common.h"
+#include "rgw_yield_context.h"
 
 class RGWRados;
 class RGWObjectCtx;
@@ -24,6 +26,18 @@ int rgw_get_system_obj(RGWRados *rgwstore, RGWObjectCtx& obj_ctx, rgw_bucket& bu
 int rgw_delete_system_obj(RGWRados *rgwstore, rgw_bucket& bucket, const string& oid,
                           RGWObjVersionTracker *objv_tracker);
 
+/*
+ * Run a librados operation, suspending the request's coroutine rather than
+ * blocking the thread while it is in flight when there is one.  pversion
+ * gets the object version the operation saw.
+ */
+int rgw_rados_operate(librados::IoCtx& ioctx, const std::string& oid,
+                      librados::ObjectReadOperation *op, bufferlist *pbl,
+                      optional_yield_context y, uint64_t *pversion = nullptr);
+int rgw_rados_operate(librados::IoCtx& ioctx, const std::string& oid,
+                      librados::ObjectWriteOperation *op,
+                      optional_yield_context y, uint64_t *pversion = nullptr);
+
 int rgw_tools_init(CephContext *cct);
 void rgw_tools_cleanup();
 const char *rgw_find_mime_by_ext(string& ext);
@@ -0,0 +1,45 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef RGW_YIELD_CONTEXT_H
+#define RGW_YIELD_CONTEXT_H
+
+#include "acconfig.h"
+
+#ifdef WITH_RADOSGW_ASIO_FRONTEND
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/spawn.hpp>
+#endif
+
+/**
+ * The coroutine a request is processed on, if any.
+ *
+ * Frontends that run each request on a stackful coroutine hand it down with
+ * the request, so that calls into librados can suspend the coroutine rather
+ * than block the thread (see rgw_rados_operate()).  An empty one means the
+ * caller owns its thread and the calls block as usual.
+ */
+#ifdef WITH_RADOSGW_ASIO_FRONTEND
+class optional_yield_context {
+  boost::asio::io_service *service = nullptr;
+  boost::asio::yield_context *yield_ctx = nullptr;
+
+ public:
+  optional_yield_context() = default;
+  optional_yield_context(boost::asio::io_service& service,
+                         boost::asio::yield_context& y)
+    : service(&service), yield_ctx(&y) {}
+
+  explicit operator bool() const { return yield_ctx != nullptr; }
+
+  boost::asio::io_service& get_io_service() const { return *service; }
+  boost::asio::yield_context& get_yield_context() const { return *yield_ctx; }
+};
+#else
+class optional_yield_context {
+ public:
+  explicit operator bool() const { return false; }
+};
+#endif
+
+#endif // RGW_YIELD_CONTEXT_H
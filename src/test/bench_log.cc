@@ -10,12 +10,14 @@
 #include "global/global_init.h"
 
 #define dout_context g_ceph_context
+#define dout_subsys ceph_subsys_
 
 struct T : public Thread {
   int num;
+  int level;
   set<int> myset;
   map<int,string> mymap;
-  explicit T(int n) : num(n) {
+  T(int n, int l) : num(n), level(l) {
     myset.insert(123);
     myset.insert(456);
     mymap[1] = "foo";
@@ -24,23 +26,56 @@ struct T : public Thread {
 
   void *entry() override {
     while (num-- > 0)
-      generic_dout(0) << "this is a typical log line.  set "
-		      << myset << " and map " << mymap << dendl;
+      ldout(g_ceph_context, level) << "this is a typical log line.  set "
+				   << myset << " and map " << mymap << dendl;
     return 0;
   }
 };
 
-int main(int argc, const char **argv)
+void usage(const char *name)
 {
-  int threads = atoi(argv[1]);
-  int num = atoi(argv[2]);
-
-  cout << threads << " threads, " << num << " lines per thread" << std::endl;
+  cout << "usage: " << name << " [threads [lines [level]]] [ceph options]\n"
+       << "  threads  number of logging threads (default 32)\n"
+       << "  lines    lines logged by each thread (default 100000)\n"
+       << "  level    debug level of the lines (default 0); with e.g.\n"
+       << "           --debug-none 0/20 and level > 0 the lines are only\n"
+       << "           gathered into the in-memory recent log\n";
+}
 
+int main(int argc, const char **argv)
+{
   vector<const char*> args;
   argv_to_vec(argc, argv, args);
   env_to_vec(args);
 
+  int threads = 32;
+  int num = 100000;
+  int level = 0;
+  vector<const char*> positional;
+  for (auto i = args.begin(); i != args.end(); ) {
+    if (**i == '-') {
+      if (strcmp(*i, "-h") == 0 || strcmp(*i, "--help") == 0) {
+	usage(argv[0]);
+	return 0;
+      }
+      ++i;
+    } else if (positional.size() < 3 && isdigit(**i)) {
+      positional.push_back(*i);
+      i = args.erase(i);
+    } else {
+      ++i;
+    }
+  }
+  if (positional.size() > 0)
+    threads = atoi(positional[0]);
+  if (positional.size() > 1)
+    num = atoi(positional[1]);
+  if (positional.size() > 2)
+    level = atoi(positional[2]);
+
+  cout << threads << " threads, " << num << " lines per thread at level "
+       << level << std::endl;
+
   auto cct = global_init(NULL, args, CEPH_ENTITY_TYPE_OSD,
 			 CODE_ENVIRONMENT_UTILITY, 0);
 
@@ -48,7 +83,7 @@ int main(int argc, const char **argv)
 
   list<T*> ls;
   for (int i=0; i<threads; i++) {
-    T *t = new T(num);
+    T *t = new T(num, level);
     t->create("t");
     ls.push_back(t);
   }
@@ -69,6 +104,7 @@ int main(int argc, const char **argv)
   utime_t end = ceph_clock_now();
   utime_t dur = end - start;
 
-  cout << dur << std::endl;
+  cout << dur << " (" << (uint64_t)((double)threads * num / (double)dur)
+       << " lines/sec)" << std::endl;
   return 0;
 }
@@ -2254,6 +2254,62 @@ TEST(BufferList, append) {
   }
 }
 
+TEST(BufferList, append_or_copy) {
+  {
+    bufferlist bl;
+    bl.append('A');
+    bufferlist other;
+    other.append('B');
+    other.append(bufferptr("C", 1));
+    bl.append_or_copy(other);
+    EXPECT_EQ((unsigned)1, bl.get_num_buffers());
+    EXPECT_EQ((unsigned)3, bl.length());
+    EXPECT_EQ(0, ::memcmp("ABC", bl.c_str(), 3));
+  }
+  {
+    bufferlist bl;
+    bl.append('A');
+    bufferptr big(1024);
+    big.zero();
+    bufferlist other;
+    other.append(big);
+    bl.append_or_copy(other);
+    EXPECT_EQ((unsigned)2, bl.get_num_buffers());
+    EXPECT_EQ(big.c_str(), bl.buffers().back().c_str());
+  }
+}
+
+void bench_bufferlist_encode(int nested, int num)
+{
+  bufferlist small;
+  small.append(string(nested, 'x'));
+  uint64_t alloc_num = buffer::get_history_alloc_num();
+  unsigned buffers = 0;
+  utime_t start = ceph_clock_now();
+  for (int i=0; i<num; ++i) {
+    bufferlist bl;
+    for (int j=0; j<8; ++j) {
+      ::encode((uint64_t)j, bl);
+      ::encode(small, bl);
+    }
+    buffers += bl.get_num_buffers();
+  }
+  utime_t end = ceph_clock_now();
+  cout << num << " encodes with " << nested << " byte nested lists"
+       << " in " << (end - start)
+       << ", " << (double)buffers / num << " buffers each";
+  if (get_env_bool("CEPH_BUFFER_TRACK"))
+    cout << ", " << (double)(buffer::get_history_alloc_num() - alloc_num) / num
+	 << " raw allocs each";
+  cout << std::endl;
+}
+
+TEST(BufferList, BenchEncode) {
+  bench_bufferlist_encode(16, 100000);
+  bench_bufferlist_encode(128, 100000);
+  bench_bufferlist_encode(1024, 100000);
+}
+
 TEST(BufferList, append_zero) {
   bufferlist bl;
   bl.append('A');
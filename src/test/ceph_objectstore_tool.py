@@ -1002,6 +1002,10 @@ def main(argv):
     cmd = "{path}/ceph-objectstore-tool --type memstore --op list --pgid {pg}".format(dir=OSDDIR, osd=ONEOSD, pg=ONEPG, path=CEPH_BIN)
     ERRORS += test_failure(cmd, "Must provide --data-path")
 
+    # Don't specify a target-data-path for dup
+    cmd = (CFSD_PREFIX + "--op dup").format(osd=ONEOSD)
+    ERRORS += test_failure(cmd, "Must provide --target-data-path")
+
     cmd = (CFSD_PREFIX + "--op remove").format(osd=ONEOSD)
     ERRORS += test_failure(cmd, "Must provide pgid")
 
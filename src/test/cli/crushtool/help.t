@@ -58,6 +58,17 @@
                            reweight a given item (and adjust ancestor
                            weights as needed)
      -i mapfn --reweight   recalculate all bucket weights
+     -i mapfn --optimize-choose-args
+                           adjust the weight sets of --pool-id (or the
+                           default ones) so that --rule r with --num-rep n
+                           maps the test inputs evenly over the devices
+        [--iterations n]   give up after n rounds (default 100)
+        [--max-deviation d]
+                           stop once no device is off by more than
+                           the ratio d of its share (default 0.01)
+     -i mapfn --rm-choose-args
+                           remove the weight sets of --pool-id (or the
+                           default ones)
   
   Options for the display/test stage
   
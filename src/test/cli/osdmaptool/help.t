@@ -8,6 +8,8 @@
      --test-map-pgs-dump-all [--pool <poolid>] map all pgs to osds
      --mark-up-in            mark osds up and in (but do not persist)
      --clear-temp            clear pg_temp and primary_temp
+     --clear-upmap           clear pg_upmap and pg_upmap_items
+     --upmap-cleanup         remove pg_upmap entries that no longer apply
      --test-random           do random placements
      --test-map-pg <pgid>    map a pgid to osds
      --test-map-object <objectname> [--pool <poolid>] map an object to osds
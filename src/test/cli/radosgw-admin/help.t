@@ -98,6 +98,11 @@
     gc process                 manually process garbage
     lc list                    list all bucket lifecycle progress
     lc process                 manually process lifecycle
+    reshard add                schedule a resharding of a bucket
+    reshard list               list all buckets scheduled for resharding
+    reshard status             read the resharding status of a bucket
+    reshard process            process the scheduled reshards now
+    reshard cancel             cancel the resharding of a bucket
     metadata get               get metadata info
     metadata put               put metadata info
     metadata rm                remove metadata info
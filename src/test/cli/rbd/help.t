@@ -10,6 +10,7 @@
       clone                       Clone a snapshot into a COW child image.
       copy (cp)                   Copy src image to dest.
       create                      Create an empty image.
+      deep copy (deep cp)         Deep copy src image to dest.
       diff                        Print extents that differ since a previous
                                   snap, or image creation.
       disk-usage (du)             Show disk usage stats for pool, image or
@@ -104,12 +105,15 @@
   usage: rbd bench [--pool <pool>] [--image <image>] [--io-size <io-size>] 
                    [--io-threads <io-threads>] [--io-total <io-total>] 
                    [--io-pattern <io-pattern>] --io-type <io-type> 
-                   <image-spec> 
+                   [--rw-mix-read <rw-mix-read>] [--rate <rate>] 
+                   [--format <format>] [--pretty-format] 
+                   <image-spec> [<image-spec> ...]
   
   Simple benchmark.
   
   Positional arguments
-    <image-spec>         image specification
+    <image-spec>         image specification, one for each image to run against
+                         in parallel
                          (example: [<pool-name>/]<image-name>)
   
   Optional arguments
@@ -119,7 +123,12 @@
     --io-threads arg     ios in flight
     --io-total arg       total size for IO (in B/K/M/G/T)
     --io-pattern arg     IO pattern (rand or seq)
-    --io-type arg        IO type (read or write)
+    --io-type arg        IO type (read, write, or readwrite(rw))
+    --rw-mix-read arg    read proportion in readwrite (<= 100, default 50)
+    --rate arg           IOs per second to issue to each image, whether or not
+                         earlier IO has completed
+    --format arg         output format [plain, json, or xml]
+    --pretty-format      pretty formatting (json and xml)
   
   rbd help children
   usage: rbd children [--pool <pool>] [--image <image>] [--snap <snap>] 
@@ -276,6 +285,53 @@
     (-) supports disabling-only on existing images
     (+) enabled by default for new images if features not specified
   
+  rbd help deep copy
+  usage: rbd deep copy [--pool <pool>] [--image <image>] [--snap <snap>] 
+                       [--dest-pool <dest-pool>] [--dest <dest>] 
+                       [--order <order>] [--object-size <object-size>] 
+                       [--image-feature <image-feature>] [--image-shared] 
+                       [--stripe-unit <stripe-unit>] 
+                       [--stripe-count <stripe-count>] [--data-pool <data-pool>] 
+                       [--journal-splay-width <journal-splay-width>] 
+                       [--journal-object-size <journal-object-size>] 
+                       [--journal-pool <journal-pool>] [--no-progress] 
+                       <source-image-or-snap-spec> <dest-image-spec> 
+  
+  Deep copy src image to dest.
+  
+  Positional arguments
+    <source-image-or-snap-spec>  source image or snapshot specification
+                                 (example:
+                                 [<pool-name>/]<image-name>[@<snap-name>])
+    <dest-image-spec>            destination image specification
+                                 (example: [<pool-name>/]<image-name>)
+  
+  Optional arguments
+    -p [ --pool ] arg            source pool name
+    --image arg                  source image name
+    --snap arg                   source snapshot name
+    --dest-pool arg              destination pool name
+    --dest arg                   destination image name
+    --order arg                  object order [12 <= order <= 25]
+    --object-size arg            object size in B/K/M [4K <= object size <= 32M]
+    --image-feature arg          image features
+                                 [layering(+), striping, exclusive-lock(+*),
+                                 object-map(+*), fast-diff(+*), deep-flatten(+-),
+                                 journaling(*), data-pool]
+    --image-shared               shared image
+    --stripe-unit arg            stripe unit in B/K/M
+    --stripe-count arg           stripe count
+    --data-pool arg              data pool
+    --journal-splay-width arg    number of active journal objects
+    --journal-object-size arg    size of journal objects
+    --journal-pool arg           pool for journal objects
+    --no-progress                disable progress output
+  
+  Image Features:
+    (*) supports enabling/disabling on existing images
+    (-) supports disabling-only on existing images
+    (+) enabled by default for new images if features not specified
+  
   rbd help diff
   usage: rbd diff [--pool <pool>] [--image <image>] [--snap <snap>] 
                   [--from-snap <from-snap>] [--whole-object] [--format <format>] 
@@ -152,6 +152,56 @@ TEST_F(TestClsRbd, copyup)
   ioctx.close();
 }
 
+TEST_F(TestClsRbd, sparse_copyup)
+{
+  librados::IoCtx ioctx;
+  ASSERT_EQ(0, _rados.ioctx_create(_pool_name.c_str(), ioctx));
+
+  string oid = get_temp_image_name();
+  ioctx.remove(oid);
+
+  // sparse_copyup of no extents should create new 0-len object
+  std::map<uint64_t, uint64_t> m;
+  bufferlist inbl;
+  ASSERT_EQ(0, sparse_copyup(&ioctx, oid, m, inbl));
+  uint64_t size;
+  ASSERT_EQ(0, ioctx.stat(oid, &size, NULL));
+  ASSERT_EQ(0U, size);
+
+  // extents past the data are rejected
+  ASSERT_EQ(0, ioctx.remove(oid));
+  m = {{0, 4096}};
+  ASSERT_EQ(-EINVAL, sparse_copyup(&ioctx, oid, m, inbl));
+
+  // sparse_copyup to nonexistent object should write the extents only
+  size_t l = 4096;
+  char *b = random_buf(l * 2);
+  inbl.append(b, l * 2);
+  delete [] b;
+  m = {{0, l}, {l * 2, l}};
+  ASSERT_EQ(0, sparse_copyup(&ioctx, oid, m, inbl));
+
+  bufferlist outbl;
+  ASSERT_EQ((int)(l * 3), ioctx.read(oid, outbl, l * 3, 0));
+  bufferlist expected;
+  expected.substr_of(inbl, 0, l);
+  expected.append_zero(l);
+  bufferlist tail;
+  tail.substr_of(inbl, l, l);
+  expected.append(tail);
+  ASSERT_TRUE(outbl.contents_equal(expected));
+
+  // a preexisting object is left alone
+  m = {{0, l * 2}};
+  ASSERT_EQ(0, sparse_copyup(&ioctx, oid, m, inbl));
+  outbl.clear();
+  ASSERT_EQ((int)(l * 3), ioctx.read(oid, outbl, l * 3, 0));
+  ASSERT_TRUE(outbl.contents_equal(expected));
+
+  ASSERT_EQ(0, ioctx.remove(oid));
+  ioctx.close();
+}
+
 TEST_F(TestClsRbd, get_and_set_id)
 {
   librados::IoCtx ioctx;
@@ -2222,3 +2272,46 @@ TEST_F(TestClsRbd, image_get_group) {
   ASSERT_EQ(group_id, spec.group_id);
   ASSERT_EQ(pool_id, spec.pool_id);
 }
+
+TEST_F(TestClsRbd, group_snap) {
+  librados::IoCtx ioctx;
+  ASSERT_EQ(0, _rados.ioctx_create(_pool_name.c_str(), ioctx));
+
+  string group_id = "group_id_snap";
+  ASSERT_EQ(0, group_create(&ioctx, group_id));
+
+  snapid_t snap_id1;
+  ASSERT_EQ(0, group_snap_add(&ioctx, group_id, "snap1", &snap_id1));
+  ASSERT_EQ(-EEXIST, group_snap_add(&ioctx, group_id, "snap1", &snap_id1));
+  snapid_t snap_id2;
+  ASSERT_EQ(0, group_snap_add(&ioctx, group_id, "snap2", &snap_id2));
+  ASSERT_LT(snap_id1, snap_id2);
+
+  cls::rbd::GroupSnapshot snap(snap_id1, "snap1",
+                               cls::rbd::GROUP_SNAPSHOT_STATE_COMPLETE);
+  snap.snaps.push_back(cls::rbd::ImageSnapshotSpec(ioctx.get_id(), "image1",
+                                                   12));
+  ASSERT_EQ(0, group_snap_set(&ioctx, group_id, snap));
+
+  cls::rbd::GroupSnapshot missing_snap(snap_id2 + 1, "snap3",
+                                       cls::rbd::GROUP_SNAPSHOT_STATE_COMPLETE);
+  ASSERT_EQ(-ENOENT, group_snap_set(&ioctx, group_id, missing_snap));
+
+  std::vector<cls::rbd::GroupSnapshot> snaps;
+  ASSERT_EQ(0, group_snap_list(&ioctx, group_id, 0, 10, &snaps));
+  ASSERT_EQ(2U, snaps.size());
+  ASSERT_EQ(snap, snaps[0]);
+  ASSERT_EQ("snap2", snaps[1].name);
+  ASSERT_EQ(cls::rbd::GROUP_SNAPSHOT_STATE_INCOMPLETE, snaps[1].state);
+
+  snaps.clear();
+  ASSERT_EQ(0, group_snap_list(&ioctx, group_id, snap_id1, 10, &snaps));
+  ASSERT_EQ(1U, snaps.size());
+  ASSERT_EQ(snap_id2, snaps[0].id);
+
+  ASSERT_EQ(0, group_snap_remove(&ioctx, group_id, snap_id1));
+  snaps.clear();
+  ASSERT_EQ(0, group_snap_list(&ioctx, group_id, 0, 10, &snaps));
+  ASSERT_EQ(1U, snaps.size());
+  ASSERT_EQ("snap2", snaps[0].name);
+}
@@ -138,6 +138,77 @@ TEST(cls_rgw, index_basic)
   test_stats(ioctx, bucket_oid, 0, NUM_OBJS, obj_size * NUM_OBJS);
 }
 
+TEST(cls_rgw, index_prepare_batch)
+{
+  string bucket_oid = str_int("bucket", 10);
+
+  OpMgr mgr;
+
+  ObjectWriteOperation *op = mgr.write_op();
+  cls_rgw_bucket_init(*op);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  uint64_t epoch = 1;
+  uint64_t obj_size = 1024;
+
+  list<rgw_cls_obj_prepare_op> ops;
+  for (int i = 0; i < NUM_OBJS; i++) {
+    rgw_cls_obj_prepare_op p;
+    p.op = CLS_RGW_OP_ADD;
+    p.key = cls_rgw_obj_key(str_int("obj", i), string());
+    p.tag = str_int("tag", i);
+    p.locator = str_int("loc", i);
+    p.log_op = true;
+    ops.push_back(p);
+  }
+  op = mgr.write_op();
+  cls_rgw_bucket_prepare_ops(*op, ops);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  for (int i = 0; i < NUM_OBJS; i++) {
+    string obj = str_int("obj", i);
+    string tag = str_int("tag", i);
+    rgw_bucket_dir_entry_meta meta;
+    meta.category = 0;
+    meta.size = obj_size;
+    index_complete(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, epoch, obj, meta);
+  }
+
+  test_stats(ioctx, bucket_oid, 0, NUM_OBJS, obj_size * NUM_OBJS);
+
+  /* an empty tag fails the whole batch */
+  for (int i = 0; i < NUM_OBJS; i++) {
+    rgw_cls_obj_prepare_op p;
+    p.op = CLS_RGW_OP_DEL;
+    p.key = cls_rgw_obj_key(str_int("obj", i), string());
+    p.tag = (i == NUM_OBJS - 1 ? string() : str_int("deltag", i));
+    ops.push_back(p);
+  }
+  op = mgr.write_op();
+  cls_rgw_bucket_prepare_ops(*op, ops);
+  ASSERT_EQ(-EINVAL, ioctx.operate(bucket_oid, op));
+
+  for (int i = 0; i < NUM_OBJS; i++) {
+    rgw_cls_obj_prepare_op p;
+    p.op = CLS_RGW_OP_DEL;
+    p.key = cls_rgw_obj_key(str_int("obj", i), string());
+    p.tag = str_int("deltag", i);
+    ops.push_back(p);
+  }
+  op = mgr.write_op();
+  cls_rgw_bucket_prepare_ops(*op, ops);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  for (int i = 0; i < NUM_OBJS; i++) {
+    string obj = str_int("obj", i);
+    string tag = str_int("deltag", i);
+    rgw_bucket_dir_entry_meta meta;
+    index_complete(mgr, ioctx, bucket_oid, CLS_RGW_OP_DEL, tag, ++epoch, obj, meta);
+  }
+
+  test_stats(ioctx, bucket_oid, 0, 0, 0);
+}
+
 TEST(cls_rgw, index_multiple_obj_writers)
 {
   string bucket_oid = str_int("bucket", 1);
@@ -374,6 +445,109 @@ TEST(cls_rgw, index_suggest)
 }
 
 /* test garbage collection */
+TEST(cls_rgw, bucket_resharding)
+{
+  string bucket_oid = str_int("bucket", 4);
+
+  OpMgr mgr;
+
+  ObjectWriteOperation *op = mgr.write_op();
+  cls_rgw_bucket_init(*op);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  rgw_bucket_dir_entry_meta meta;
+  meta.category = 0;
+  meta.size = 1024;
+
+  /* not logged before resharding starts */
+  string obj = str_int("obj", 0);
+  string tag = str_int("tag", 0);
+  string loc = str_int("loc", 0);
+  index_prepare(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, obj, loc);
+  index_complete(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, 1, obj, meta);
+
+  list<cls_rgw_reshard_log_entry> entries;
+  bool truncated;
+  ASSERT_EQ(0, cls_rgw_reshard_log_list(ioctx, bucket_oid, string(), 0, &entries, &truncated));
+  ASSERT_EQ(0, (int)entries.size());
+
+  cls_rgw_bucket_instance_entry entry;
+  entry.reshard_status = CLS_RGW_RESHARD_IN_PROGRESS;
+  entry.new_bucket_instance_id = "new_instance";
+  entry.num_shards = 8;
+  op = mgr.write_op();
+  cls_rgw_set_bucket_resharding(*op, entry);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  rgw_bucket_dir_header header;
+  ASSERT_EQ(0, cls_rgw_get_dir_header(ioctx, bucket_oid, &header));
+  ASSERT_EQ(CLS_RGW_RESHARD_IN_PROGRESS, header.new_instance.reshard_status);
+  ASSERT_EQ(entry.new_bucket_instance_id, header.new_instance.new_bucket_instance_id);
+
+  /* writes go through while in progress, and get logged once per object */
+#define NUM_RESHARD_OBJS 5
+  for (int i = 1; i <= NUM_RESHARD_OBJS; i++) {
+    string obj = str_int("obj", i);
+    string tag = str_int("tag", i);
+    string loc = str_int("loc", i);
+    index_prepare(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, obj, loc);
+    index_complete(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, 1, obj, meta);
+  }
+
+  ASSERT_EQ(0, cls_rgw_reshard_log_list(ioctx, bucket_oid, string(), 0, &entries, &truncated));
+  ASSERT_EQ(NUM_RESHARD_OBJS, (int)entries.size());
+  ASSERT_FALSE(truncated);
+
+  /* an entry that changed after it was listed survives the trim */
+  obj = str_int("obj", 1);
+  tag = str_int("tag", 100);
+  index_prepare(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, obj, loc);
+
+  op = mgr.write_op();
+  cls_rgw_reshard_log_trim(*op, entries);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  entries.clear();
+  ASSERT_EQ(0, cls_rgw_reshard_log_list(ioctx, bucket_oid, string(), 0, &entries, &truncated));
+  ASSERT_EQ(1, (int)entries.size());
+  ASSERT_EQ(obj, entries.front().name);
+
+  /* blocked: writes are refused */
+  entry.reshard_status = CLS_RGW_RESHARD_BLOCKED;
+  op = mgr.write_op();
+  cls_rgw_set_bucket_resharding(*op, entry);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  obj = str_int("obj", 10);
+  tag = str_int("tag", 10);
+  op = mgr.write_op();
+  cls_rgw_obj_key key(obj, string());
+  cls_rgw_bucket_prepare_op(*op, CLS_RGW_OP_ADD, tag, key, loc, true, 0);
+  ASSERT_EQ(-CLS_RGW_ERR_BUSY_RESHARDING, ioctx.operate(bucket_oid, op));
+
+  /* done: still refused, and the header says where the bucket went */
+  entry.reshard_status = CLS_RGW_RESHARD_DONE;
+  op = mgr.write_op();
+  cls_rgw_set_bucket_resharding(*op, entry);
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  op = mgr.write_op();
+  cls_rgw_bucket_prepare_op(*op, CLS_RGW_OP_ADD, tag, key, loc, true, 0);
+  ASSERT_EQ(-CLS_RGW_ERR_BUSY_RESHARDING, ioctx.operate(bucket_oid, op));
+
+  ASSERT_EQ(0, cls_rgw_get_dir_header(ioctx, bucket_oid, &header));
+  ASSERT_EQ(CLS_RGW_RESHARD_DONE, header.new_instance.reshard_status);
+  ASSERT_EQ(string("new_instance"), header.new_instance.new_bucket_instance_id);
+
+  /* back to normal */
+  op = mgr.write_op();
+  cls_rgw_set_bucket_resharding(*op, cls_rgw_bucket_instance_entry());
+  ASSERT_EQ(0, ioctx.operate(bucket_oid, op));
+
+  index_prepare(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, obj, loc);
+  index_complete(mgr, ioctx, bucket_oid, CLS_RGW_OP_ADD, tag, 1, obj, meta);
+}
+
 static void create_obj(cls_rgw_obj& obj, int i, int j)
 {
   char buf[32];
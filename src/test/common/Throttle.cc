@@ -25,6 +25,7 @@
 #include "common/Mutex.h"
 #include "common/Thread.h"
 #include "common/Throttle.h"
+#include "common/Timer.h"
 #include "common/ceph_argparse.h"
 
 #include <thread>
@@ -417,6 +418,66 @@ TEST(BackoffThrottle, oversaturated)
   ASSERT_GT(results.second.count(), 0.0005);
 }
 
+struct TokenWaiter {
+  Mutex lock;
+  Cond cond;
+  std::list<int> ready;
+
+  TokenWaiter() : lock("TokenWaiter::lock") {}
+
+  void handle_ready(int r, int *item, uint64_t flag) {
+    Mutex::Locker l(lock);
+    ready.push_back(*item);
+    cond.Signal();
+  }
+};
+
+TEST(TokenBucketThrottle, burst_then_rate)
+{
+  Mutex timer_lock("TokenBucketThrottle::timer_lock");
+  SafeTimer timer(g_ceph_context, timer_lock, true);
+  timer.init();
+
+  {
+    TokenBucketThrottle throttle(g_ceph_context, 10, &timer, &timer_lock);
+    TokenWaiter waiter;
+    int items[] = {0, 1, 2};
+
+    // disabled: nothing waits
+    ASSERT_FALSE((throttle.get<TokenWaiter, int, &TokenWaiter::handle_ready>(
+      1000, &waiter, &items[0], 0)));
+
+    // 100/s with a burst of 2: two go at once, the rest in order
+    throttle.set_limit(100, 2);
+    ASSERT_FALSE((throttle.get<TokenWaiter, int, &TokenWaiter::handle_ready>(
+      1, &waiter, &items[0], 0)));
+    ASSERT_FALSE((throttle.get<TokenWaiter, int, &TokenWaiter::handle_ready>(
+      1, &waiter, &items[0], 0)));
+    ASSERT_TRUE((throttle.get<TokenWaiter, int, &TokenWaiter::handle_ready>(
+      1, &waiter, &items[1], 0)));
+    ASSERT_TRUE((throttle.get<TokenWaiter, int, &TokenWaiter::handle_ready>(
+      1, &waiter, &items[2], 0)));
+
+    {
+      Mutex::Locker l(waiter.lock);
+      while (waiter.ready.size() < 2) {
+        ASSERT_EQ(0, waiter.cond.WaitInterval(waiter.lock, utime_t(5, 0)));
+      }
+      ASSERT_EQ(std::list<int>({1, 2}), waiter.ready);
+    }
+
+    // lifting the limit lets waiters go
+    ASSERT_TRUE((throttle.get<TokenWaiter, int, &TokenWaiter::handle_ready>(
+      1000, &waiter, &items[0], 0)));
+    throttle.set_limit(0, 0);
+    Mutex::Locker l(waiter.lock);
+    ASSERT_EQ(3u, waiter.ready.size());
+  }
+
+  Mutex::Locker l(timer_lock);
+  timer.shutdown();
+}
+
 /*
  * Local Variables:
  * compile-command: "cd ../.. ;
@@ -20,6 +20,7 @@
  *
  */
 #include "common/config.h"
+#include "common/config_snapshot.h"
 #include "common/errno.h"
 #include "gtest/gtest.h"
 
@@ -168,6 +169,46 @@ TEST(md_config_t, set_val)
   }
 }
 
+struct test_snapshot_conf_t {
+  uint64_t osd_max_write_size;
+  bool osd_debug_op_order;
+
+  explicit test_snapshot_conf_t(const md_config_t *conf)
+    : osd_max_write_size(conf->osd_max_write_size),
+      osd_debug_op_order(conf->osd_debug_op_order) {}
+  static const char *tracked_keys[];
+};
+const char *test_snapshot_conf_t::tracked_keys[] = {
+  "osd_max_write_size",
+  "osd_debug_op_order",
+  NULL
+};
+
+TEST(md_config_t, snapshot)
+{
+  md_config_t conf;
+  ConfigSnapshot<test_snapshot_conf_t> snap(&conf);
+  const test_snapshot_conf_t *before = snap.get();
+  EXPECT_EQ((uint64_t)conf.osd_max_write_size, before->osd_max_write_size);
+
+  // not visible until the change is applied
+  EXPECT_EQ(0, conf.set_val("osd_max_write_size", "7"));
+  EXPECT_EQ(before, snap.get());
+  conf.apply_changes(NULL);
+  EXPECT_EQ(7u, snap->osd_max_write_size);
+  EXPECT_EQ(conf.osd_debug_op_order, snap->osd_debug_op_order);
+
+  // readers holding the old version still see the old values
+  EXPECT_NE(before, snap.get());
+  EXPECT_NE(7u, before->osd_max_write_size);
+
+  // untracked options do not publish a new version
+  const test_snapshot_conf_t *after = snap.get();
+  EXPECT_EQ(0, conf.set_val("osd_op_threads", "3"));
+  conf.apply_changes(NULL);
+  EXPECT_EQ(after, snap.get());
+}
+
 /*
  * Local Variables:
  * compile-command: "cd ../.. ;
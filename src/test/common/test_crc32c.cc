@@ -8,6 +8,7 @@
 #include "include/crc32c.h"
 #include "include/utime.h"
 #include "common/Clock.h"
+#include "common/Checksummer.h"
 
 #include "gtest/gtest.h"
 
@@ -93,6 +94,51 @@ TEST(Crc32c, Performance) {
 
 }
 
+template<class Alg>
+static void checksummer_bench(const char *name, const bufferlist& bl,
+			      const bufferlist& fragmented, size_t block_size)
+{
+  size_t blocks = bl.length() / block_size;
+  size_t csum_len = blocks * sizeof(typename Alg::value_t);
+  bufferptr csum(csum_len);
+  {
+    utime_t start = ceph_clock_now();
+    Checksummer::calculate<Alg>(block_size, 0, bl.length(), bl, &csum);
+    utime_t end = ceph_clock_now();
+    float rate = (float)bl.length() / (float)(1024*1024) / (float)(end - start);
+    std::cout << name << " calculate = " << rate << " MB/sec" << std::endl;
+  }
+  {
+    utime_t start = ceph_clock_now();
+    int r = Checksummer::verify<Alg>(block_size, 0, bl.length(), bl, csum);
+    utime_t end = ceph_clock_now();
+    float rate = (float)bl.length() / (float)(1024*1024) / (float)(end - start);
+    std::cout << name << " verify = " << rate << " MB/sec" << std::endl;
+    ASSERT_EQ(-1, r);
+  }
+  // blocks straddling buffers must come out the same
+  bufferptr fcsum(csum_len);
+  Checksummer::calculate<Alg>(block_size, 0, fragmented.length(), fragmented,
+			      &fcsum);
+  ASSERT_EQ(0, memcmp(csum.c_str(), fcsum.c_str(), csum_len));
+}
+
+TEST(Crc32c, ChecksummerPerformance) {
+  int len = 256 * 1024 * 1024;
+  bufferptr bp(len);
+  for (int i=0; i<len; i++)
+    bp[i] = i & 0xff;
+  bufferlist bl;
+  bl.append(bp);
+  bufferlist fragmented;
+  for (int off = 0; off < len; off += 3000)
+    fragmented.append(bp, off, std::min(3000, len - off));
+
+  checksummer_bench<Checksummer::crc32c>("crc32c", bl, fragmented, 4096);
+  checksummer_bench<Checksummer::crc32c_8>("crc32c_8", bl, fragmented, 4096);
+  checksummer_bench<Checksummer::xxhash32>("xxhash32", bl, fragmented, 4096);
+  checksummer_bench<Checksummer::xxhash64>("xxhash64", bl, fragmented, 4096);
+}
 
 static uint32_t crc_check_table[] = {
 0xcfc75c75, 0x7aa1b1a7, 0xd761a4fe, 0xd699eeb6, 0x2a136fff, 0x9782190d, 0xb5017bb0, 0xcffb76a9,
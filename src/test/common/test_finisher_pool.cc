@@ -0,0 +1,143 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "common/Finisher.h"
+#include "global/global_context.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+struct C_Record : public Context {
+  std::mutex *lock;
+  vector<int> *seen;
+  int v;
+  std::atomic<int> *running;
+  C_Record(std::mutex *l, vector<int> *s, int v, std::atomic<int> *r)
+    : lock(l), seen(s), v(v), running(r) {}
+  void finish(int r) override {
+    // no two contexts of the same key may run at once
+    EXPECT_EQ(1, ++*running);
+    {
+      std::lock_guard<std::mutex> l(*lock);
+      seen->push_back(v + r);
+    }
+    --*running;
+  }
+};
+
+struct C_Sleep : public Context {
+  std::chrono::milliseconds d;
+  explicit C_Sleep(std::chrono::milliseconds d) : d(d) {}
+  void finish(int r) override {
+    std::this_thread::sleep_for(d);
+  }
+};
+
+struct C_Count : public Context {
+  std::atomic<int> *n;
+  explicit C_Count(std::atomic<int> *n) : n(n) {}
+  void finish(int r) override {
+    ++*n;
+  }
+};
+
+} // anonymous namespace
+
+TEST(FinisherPool, PerKeyOrder)
+{
+  FinisherPool pool(g_ceph_context, "test_order", "fn_test", 4);
+  pool.start();
+
+  const int keys = 32, per_key = 2000;
+  std::mutex locks[keys];
+  vector<int> seen[keys];
+  std::atomic<int> running[keys];
+  for (int k = 0; k < keys; ++k)
+    running[k] = 0;
+
+  vector<std::thread> producers;
+  for (int t = 0; t < 4; ++t) {
+    producers.emplace_back([&, t]() {
+	for (int k = t; k < keys; k += 4) {
+	  for (int i = 0; i < per_key; ++i) {
+	    // odd values go through the r != 0 path
+	    if (i % 2)
+	      pool.queue(k, new C_Record(&locks[k], &seen[k], i - 1,
+					 &running[k]), 1);
+	    else
+	      pool.queue(k, new C_Record(&locks[k], &seen[k], i,
+					 &running[k]));
+	  }
+	}
+      });
+  }
+  for (auto& t : producers)
+    t.join();
+  pool.wait_for_empty();
+  pool.stop();
+
+  for (int k = 0; k < keys; ++k) {
+    ASSERT_EQ((size_t)per_key, seen[k].size());
+    for (int i = 0; i < per_key; ++i)
+      ASSERT_EQ(i, seen[k][i]);
+  }
+}
+
+TEST(FinisherPool, SlowLaneDoesNotBlockOthers)
+{
+  FinisherPool pool(g_ceph_context, "test_steal", "fn_test", 2, 64);
+  pool.start();
+
+  // about half of the other keys' lanes have the slow key's worker as
+  // their home; they only finish early if the other worker steals them
+  pool.queue(0, new C_Sleep(std::chrono::milliseconds(2000)));
+  std::atomic<int> done(0);
+  for (uint64_t k = 1; k < 64; ++k)
+    pool.queue(k, new C_Count(&done));
+
+  auto deadline = std::chrono::steady_clock::now() +
+    std::chrono::milliseconds(1000);
+  while (done.load() < 48 && std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  ASSERT_GE(done.load(), 48);
+
+  pool.wait_for_empty();
+  ASSERT_EQ(63, done.load());
+  pool.stop();
+}
+
+TEST(FinisherPool, WaitForKey)
+{
+  FinisherPool pool(g_ceph_context, "test_wait_key", "fn_test", 2);
+  pool.start();
+  std::atomic<int> done(0);
+  list<Context*> ls;
+  for (int i = 0; i < 100; ++i)
+    ls.push_back(new C_Count(&done));
+  pool.queue(7, ls);
+  ASSERT_TRUE(ls.empty());
+  pool.wait_for_empty(7);
+  ASSERT_EQ(100, done.load());
+  pool.stop();
+
+  // restartable, and work queued while stopped runs after start
+  pool.queue(7, new C_Count(&done));
+  pool.start();
+  pool.wait_for_empty();
+  ASSERT_EQ(101, done.load());
+  pool.stop();
+}
@@ -0,0 +1,123 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "gtest/gtest.h"
+#include "common/mClockPriorityQueue.h"
+
+#include <map>
+#include <list>
+
+// items are (class, id); the owner passed to the queue is the id % 10
+typedef std::pair<int, int> Item;
+typedef mClockQueue<Item, int, int> Queue;
+
+class mClockQueueTest : public testing::Test
+{
+protected:
+  double now = 100.0;
+  std::map<int, mClockClientInfo> infos;
+
+  Queue make_queue() {
+    return Queue(
+      [](const Item& i) { return i.first; },
+      [this](const int& c) { return infos[c]; },
+      [this]() { return now; });
+  }
+
+  std::map<int, int> drain(Queue& q, unsigned n, double step) {
+    std::map<int, int> served;
+    for (unsigned i = 0; i < n && !q.empty(); ++i) {
+      ++served[q.dequeue().first];
+      now += step;
+    }
+    return served;
+  }
+};
+
+TEST_F(mClockQueueTest, Weight) {
+  infos[1] = mClockClientInfo(0, 1, 0);
+  infos[2] = mClockClientInfo(0, 3, 0);
+  Queue q = make_queue();
+  for (int i = 0; i < 1000; ++i) {
+    q.enqueue(i % 10, 0, 0, Item(1, i));
+    q.enqueue(i % 10, 0, 0, Item(2, i));
+  }
+  ASSERT_EQ(2000u, q.length());
+  auto served = drain(q, 400, 0);
+  ASSERT_NEAR(100, served[1], 2);
+  ASSERT_NEAR(300, served[2], 2);
+}
+
+TEST_F(mClockQueueTest, Reservation) {
+  // class 1 has a tiny weight but is guaranteed 10 ops/s
+  infos[1] = mClockClientInfo(10, 0.01, 0);
+  infos[2] = mClockClientInfo(0, 100, 0);
+  Queue q = make_queue();
+  for (int i = 0; i < 1000; ++i) {
+    q.enqueue(0, 0, 0, Item(1, i));
+    q.enqueue(0, 0, 0, Item(2, i));
+  }
+  // 100 ops/s for 5 seconds
+  auto served = drain(q, 500, 0.01);
+  ASSERT_GE(served[1], 49);
+  ASSERT_LE(served[1], 56);
+}
+
+TEST_F(mClockQueueTest, Limit) {
+  // class 1 would win on weight but is capped at 10 ops/s
+  infos[1] = mClockClientInfo(0, 100, 10);
+  infos[2] = mClockClientInfo(0, 1, 0);
+  Queue q = make_queue();
+  for (int i = 0; i < 1000; ++i) {
+    q.enqueue(0, 0, 0, Item(1, i));
+    q.enqueue(0, 0, 0, Item(2, i));
+  }
+  auto served = drain(q, 500, 0.01);
+  ASSERT_LE(served[1], 52);
+
+  // with nothing else queued the limit does not stall the queue
+  Queue q2 = make_queue();
+  for (int i = 0; i < 10; ++i)
+    q2.enqueue(0, 0, 0, Item(1, i));
+  served = drain(q2, 10, 0);
+  ASSERT_EQ(10, served[1]);
+}
+
+TEST_F(mClockQueueTest, StrictAndFront) {
+  infos[1] = mClockClientInfo(0, 1, 0);
+  Queue q = make_queue();
+  q.enqueue(0, 0, 0, Item(1, 1));
+  q.enqueue(0, 0, 0, Item(1, 2));
+  q.enqueue_front(0, 0, 0, Item(1, 0));
+  q.enqueue_strict(0, 10, Item(9, 1));
+  q.enqueue_strict(0, 20, Item(9, 0));
+  q.enqueue_strict_front(0, 10, Item(9, 2));
+  ASSERT_EQ(Item(9, 0), q.dequeue());
+  ASSERT_EQ(Item(9, 2), q.dequeue());
+  ASSERT_EQ(Item(9, 1), q.dequeue());
+  for (int i = 0; i < 3; ++i)
+    ASSERT_EQ(Item(1, i), q.dequeue());
+  ASSERT_TRUE(q.empty());
+}
+
+TEST_F(mClockQueueTest, Remove) {
+  infos[1] = mClockClientInfo(0, 1, 0);
+  infos[2] = mClockClientInfo(0, 1, 0);
+  Queue q = make_queue();
+  for (int i = 0; i < 100; ++i) {
+    q.enqueue(i % 10, 0, 0, Item(1 + i % 2, i));
+  }
+  q.enqueue_strict(3, 5, Item(1, 1003));
+  std::list<Item> out;
+  q.remove_by_class(3, &out);
+  ASSERT_EQ(11u, out.size());
+  for (auto& i : out)
+    ASSERT_EQ(3, i.second % 10);
+  q.remove_by_filter([](Item i) { return i.first == 2; });
+  ASSERT_EQ(50u, q.length());
+  while (!q.empty()) {
+    Item i = q.dequeue();
+    ASSERT_EQ(1, i.first);
+    ASSERT_NE(3, i.second % 10);
+  }
+}
@@ -0,0 +1,32 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <errno.h>
+
+#include "gtest/gtest.h"
+#include "common/numa.h"
+
+TEST(numa, parse_cpu_set_list)
+{
+  std::set<int> cpus;
+  ASSERT_EQ(0, parse_cpu_set_list("", &cpus));
+  ASSERT_TRUE(cpus.empty());
+
+  ASSERT_EQ(0, parse_cpu_set_list("0-3,8,10-11\n", &cpus));
+  ASSERT_EQ((std::set<int>{0, 1, 2, 3, 8, 10, 11}), cpus);
+  ASSERT_EQ("0-3,8,10-11", cpu_set_to_str_list(cpus));
+
+  ASSERT_EQ(0, parse_cpu_set_list("5", &cpus));
+  ASSERT_EQ((std::set<int>{5}), cpus);
+  ASSERT_EQ("5", cpu_set_to_str_list(cpus));
+
+  ASSERT_EQ(-EINVAL, parse_cpu_set_list("3-1", &cpus));
+  ASSERT_EQ(-EINVAL, parse_cpu_set_list("a", &cpus));
+  ASSERT_EQ(-EINVAL, parse_cpu_set_list("1;2", &cpus));
+}
+
+TEST(numa, cpu_set_to_str_list)
+{
+  ASSERT_EQ("", cpu_set_to_str_list(std::set<int>()));
+  ASSERT_EQ("0,2,4-5", cpu_set_to_str_list(std::set<int>{0, 2, 4, 5}));
+}
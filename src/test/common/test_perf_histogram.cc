@@ -245,3 +245,33 @@ TEST(PerfHistogram, AxisAddressing) {
     }
   }
 }
+
+TEST(PerfHistogram, RawAccess) {
+  PerfHistogramCommon::axis_config_d ac1{"", PerfHistogramCommon::SCALE_LINEAR,
+                                         0, 1, 7};
+  PerfHistogramCommon::axis_config_d ac2{"", PerfHistogramCommon::SCALE_LINEAR,
+                                         0, 1, 9};
+
+  PerfHistogram<2> h{ac1, ac2};
+  ASSERT_EQ(7 * 9, h.get_raw_size());
+  ASSERT_EQ(7, h.get_axes_config()[0].m_buckets);
+  ASSERT_EQ(9, h.get_axes_config()[1].m_buckets);
+
+  h.inc_bucket(2, 5);
+  h.inc_bucket(2, 5);
+  h.inc_bucket(6, 0);
+
+  for (int64_t i = 0; i < h.get_raw_size(); ++i) {
+    switch (i) {
+      case 5 + 9 * 2:
+        ASSERT_EQ(2u, h.read_raw(i));
+        break;
+      case 0 + 9 * 6:
+        ASSERT_EQ(1u, h.read_raw(i));
+        break;
+      default:
+        ASSERT_EQ(0u, h.read_raw(i));
+        break;
+    }
+  }
+}
@@ -391,6 +391,53 @@ TEST(SharedCache_all, lru) {
   ASSERT_TRUE(cache.lookup(0).get());
 }
 
+TEST(SharedCache_all, probation) {
+  const size_t SIZE = 8;
+  SharedLRU<int, int> cache(NULL, SIZE);
+  cache.set_probation_ratio(0.25);
+
+  // a hot set, touched twice
+  for (int i = 0; i < 4; ++i) {
+    cache.add(i, new int(i));
+    ASSERT_TRUE(cache.lookup(i).get());
+  }
+  // a scan touches everything once
+  for (int i = 100; i < 200; ++i)
+    cache.add(i, new int(i));
+  for (int i = 0; i < 4; ++i)
+    ASSERT_TRUE(cache.lookup(i).get());
+  ASSERT_FALSE(cache.lookup(150));
+  ASSERT_TRUE(cache.lookup(199).get());
+
+  JSONFormatter f;
+  f.open_object_section("stats");
+  cache.dump_stats(&f);
+  f.close_section();
+  std::stringstream ss;
+  f.flush(ss);
+  ASSERT_NE(std::string::npos, ss.str().find("\"hits\":9"));
+  ASSERT_NE(std::string::npos, ss.str().find("\"misses\":1"));
+  ASSERT_NE(std::string::npos, ss.str().find("\"evictions\":96"));
+}
+
+TEST(SharedCache_all, cost) {
+  SharedLRU<int, int> cache(NULL, 100);
+  cache.set_cost_func([](const int& v) { return (size_t)v; });
+  cache.add(1, new int(40));
+  cache.add(2, new int(40));
+  ASSERT_TRUE(cache.lookup(1).get());
+  // 40 + 40 + 30 > 100: the least recently used goes
+  cache.add(3, new int(30));
+  ASSERT_TRUE(cache.lookup(1).get());
+  ASSERT_FALSE(cache.lookup(2));
+  ASSERT_TRUE(cache.lookup(3).get());
+
+  // costs are picked up again on touch
+  *cache.lookup(3) = 70;
+  ASSERT_TRUE(cache.lookup(3).get());
+  ASSERT_FALSE(cache.lookup(1));
+}
+
 // Local Variables:
 // compile-command: "cd ../.. ; make unittest_shared_cache && ./unittest_shared_cache # --gtest_filter=*.* --log-to-stderr=true"
 // End:
@@ -0,0 +1,99 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <thread>
+
+#include "common/Tracer.h"
+#include "common/ceph_context.h"
+#include "common/config.h"
+#include "include/stringify.h"
+#include "global/global_context.h"
+#include "gtest/gtest.h"
+
+TEST(Tracer, ContextEncoding)
+{
+  trace_context_t t(0x1234, 0x5678);
+  bufferlist bl;
+  ::encode(t, bl);
+  trace_context_t d;
+  bufferlist::iterator p = bl.begin();
+  ::decode(d, p);
+  ASSERT_EQ(t.trace_id, d.trace_id);
+  ASSERT_EQ(t.span_id, d.span_id);
+  ASSERT_TRUE(d.valid());
+  ASSERT_FALSE(trace_context_t().valid());
+}
+
+TEST(Tracer, NotSampled)
+{
+  g_ceph_context->_conf->set_val("trace_sample_rate", "0");
+  ASSERT_FALSE(trace_sample(g_ceph_context).valid());
+
+  TraceSpan span;
+  span.start(g_ceph_context, trace_sample(g_ceph_context), "test");
+  ASSERT_FALSE(span.valid());
+  ASSERT_FALSE(span.context().valid());
+  span.event("nothing");
+  span.finish();
+}
+
+TEST(Tracer, Export)
+{
+  string path = "test_tracer." + stringify(getpid()) + ".trace";
+  g_ceph_context->_conf->set_val("trace_export_path", path);
+  g_ceph_context->_conf->set_val("trace_export_interval", "0.1");
+  g_ceph_context->_conf->set_val("trace_sample_rate", "1");
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  trace_context_t root = trace_sample(g_ceph_context);
+  ASSERT_TRUE(root.valid());
+  trace_context_t child_ctx;
+  {
+    TraceSpan parent;
+    parent.start(g_ceph_context, root, "parent");
+    ASSERT_TRUE(parent.valid());
+    ASSERT_EQ(root.trace_id, parent.context().trace_id);
+    ASSERT_NE(0u, parent.context().span_id);
+
+    TraceSpan child;
+    child.start(g_ceph_context, parent.context(), "child");
+    child_ctx = child.context();
+    child.event("step");
+  }
+
+  // written in the background
+  string text;
+  for (int i = 0; i < 100; ++i) {
+    std::ifstream in(path);
+    text.assign(std::istreambuf_iterator<char>(in),
+		std::istreambuf_iterator<char>());
+    if (std::count(text.begin(), text.end(), '\n') == 2)
+      break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  ::unlink(path.c_str());
+  g_ceph_context->_conf->set_val("trace_sample_rate", "0");
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  ASSERT_EQ(2, std::count(text.begin(), text.end(), '\n'));
+  char id[17];
+  snprintf(id, sizeof(id), "%016llx", (unsigned long long)root.trace_id);
+  ASSERT_NE(string::npos, text.find(string("\"traceId\":\"") + id));
+  ASSERT_NE(string::npos, text.find("\"name\":\"child\""));
+  ASSERT_NE(string::npos, text.find("\"value\":\"step\""));
+  snprintf(id, sizeof(id), "%016llx", (unsigned long long)child_ctx.span_id);
+  ASSERT_NE(string::npos, text.find(string("\"id\":\"") + id));
+}
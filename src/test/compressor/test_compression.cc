@@ -18,6 +18,8 @@
 #include <signal.h>
 #include <stdlib.h>
 #include "gtest/gtest.h"
+#include "acconfig.h"
+#include "common/ceph_time.h"
 #include "common/config.h"
 #include "compressor/Compressor.h"
 #include "compressor/CompressionPlugin.h"
@@ -325,6 +327,9 @@ INSTANTIATE_TEST_CASE_P(
     "zlib/isal",
     "zlib/noisal",
     "snappy",
+#ifdef HAVE_LZ4
+    "lz4",
+#endif
     "zstd"));
 
 TEST(ZlibCompressor, zlib_isal_compatibility)
@@ -364,6 +369,92 @@ TEST(ZlibCompressor, zlib_isal_compatibility)
   EXPECT_TRUE(exp.contents_equal(after));
 }
 
+// small JSON documents alike in structure, as RGW stores them
+static bufferlist make_json_doc(int i)
+{
+  static const char *owners[] = { "alice", "bob", "carol", "dave" };
+  char buf[512];
+  int n = snprintf(buf, sizeof(buf),
+    "{\"bucket\":\"bucket-%d\",\"key\":\"photos/2017/%06d.jpg\","
+    "\"owner\":{\"id\":\"%s\",\"display_name\":\"%s\"},"
+    "\"size\":%d,\"etag\":\"%08x%08x\",\"storage_class\":\"STANDARD\","
+    "\"mtime\":\"2017-06-%02dT%02d:%02d:%02d.000Z\","
+    "\"content_type\":\"image/jpeg\",\"acl\":{\"grants\":["
+    "{\"grantee\":\"%s\",\"permission\":\"FULL_CONTROL\"}]}}",
+    rand() % 16, i, owners[i % 4], owners[i % 4], rand(), rand(), rand(),
+    1 + rand() % 28, rand() % 24, rand() % 60, rand() % 60, owners[i % 4]);
+  bufferlist bl;
+  bl.append(buf, n);
+  return bl;
+}
+
+TEST(ZstdCompressor, dictionary)
+{
+  CompressorRef zstd = Compressor::create(g_ceph_context, "zstd");
+  ASSERT_TRUE(zstd);
+
+  srand(1);
+  vector<bufferlist> samples, docs;
+  for (int i = 0; i < 1000; ++i)
+    samples.push_back(make_json_doc(i));
+  for (int i = 1000; i < 2000; ++i)
+    docs.push_back(make_json_doc(i));
+
+  bufferlist dict_bl;
+  ASSERT_EQ(0, zstd->train_dictionary(samples, 16384, &dict_bl));
+  ASSERT_GT(dict_bl.length(), 0u);
+  ASSERT_LE(dict_bl.length(), 16384u);
+  Compressor::DictionaryRef dict = zstd->create_dictionary(1, dict_bl);
+  ASSERT_TRUE(dict);
+
+  uint64_t raw = 0, plain = 0, with_dict = 0;
+  auto start = ceph::mono_clock::now();
+  for (auto& d : docs) {
+    bufferlist out;
+    ASSERT_EQ(0, zstd->compress(d, out));
+    raw += d.length();
+    plain += out.length();
+  }
+  auto plain_dur = ceph::mono_clock::now() - start;
+  start = ceph::mono_clock::now();
+  for (auto& d : docs) {
+    bufferlist out, after;
+    ASSERT_EQ(0, zstd->compress(d, out, *dict));
+    with_dict += out.length();
+    bufferlist::iterator p = out.begin();
+    ASSERT_EQ(0, zstd->decompress(p, out.length(), after, *dict));
+    ASSERT_TRUE(d.contents_equal(after));
+  }
+  auto dict_dur = ceph::mono_clock::now() - start;
+  cout << "zstd on " << docs.size() << " docs of " << raw << " bytes: "
+       << "ratio " << (double)plain / raw << " in " << plain_dur
+       << " (compress); with a " << dict_bl.length() << " byte dictionary "
+       << (double)with_dict / raw << " in " << dict_dur
+       << " (compress and decompress)" << std::endl;
+  ASSERT_LT(with_dict, plain);
+
+  // dictionaries only work on what they compressed
+  bufferlist out, after;
+  ASSERT_EQ(0, zstd->compress(docs[0], out, *dict));
+  ASSERT_NE(0, zstd->decompress(out, after));
+}
+
+TEST(Compressor, dictionaries_option)
+{
+  map<uint32_t, bufferlist> dicts, decoded;
+  dicts[1].append("one");
+  dicts[7].append("seven");
+  string s = Compressor::encode_dictionaries(dicts);
+  ASSERT_EQ(0, Compressor::decode_dictionaries(s, &decoded));
+  ASSERT_EQ(2u, decoded.size());
+  ASSERT_TRUE(decoded[7].contents_equal(dicts[7]));
+  ASSERT_EQ(-EINVAL, Compressor::decode_dictionaries("not base64!", &decoded));
+
+  CompressorRef snappy = Compressor::create(g_ceph_context, "snappy");
+  ASSERT_TRUE(snappy);
+  ASSERT_FALSE(snappy->create_dictionary(1, dicts[1]));
+}
+
 TEST(CompressionPlugin, all)
 {
   const char* env = getenv("CEPH_LIB");
@@ -941,6 +941,71 @@ TEST(CrushWrapper, distance) {
   ASSERT_EQ(1, c.get_common_ancestor_distance(g_ceph_context, 3, p));
 }
 
+TEST(CrushWrapper, choose_args) {
+  CrushWrapper c;
+  c.create();
+  c.set_tunables_optimal();
+
+  const int ROOT_TYPE = 1;
+  c.set_type_name(ROOT_TYPE, "root");
+  const int OSD_TYPE = 0;
+  c.set_type_name(OSD_TYPE, "osd");
+
+  int rootno;
+  ASSERT_EQ(0, c.add_bucket(0, CRUSH_BUCKET_STRAW2, CRUSH_HASH_RJENKINS1,
+			    ROOT_TYPE, 0, NULL, NULL, &rootno));
+  c.set_item_name(rootno, "default");
+  for (int item = 0; item < 3; ++item) {
+    map<string,string> loc;
+    loc["root"] = "default";
+    ASSERT_EQ(0, c.insert_item(g_ceph_context, item, 1.0,
+			       "osd." + stringify(item), loc));
+  }
+  int ruleset = c.add_simple_ruleset("rule", "default", "osd",
+				     "firstn", pg_pool_t::TYPE_REPLICATED);
+  ASSERT_EQ(0, ruleset);
+  c.finalize();
+
+  const int64_t pool = 1;
+  vector<__u32> weight(3, 0x10000);
+  ASSERT_FALSE(c.has_choose_args());
+  ASSERT_EQ(-ENOENT, c.choose_args_set_item_weight(pool, rootno, 0, 0, 0));
+
+  // weight sets initialized from the bucket do not change the mappings
+  c.create_choose_args(pool, 2);
+  ASSERT_TRUE(c.have_choose_args(pool));
+  for (int x = 0; x < 100; ++x) {
+    vector<int> plain, with_args;
+    c.do_rule(ruleset, x, plain, 2, weight);
+    c.do_rule(ruleset, x, with_args, 2, weight, pool);
+    ASSERT_EQ(plain, with_args);
+  }
+
+  // osd.0 is never picked first once its first position weight is 0
+  ASSERT_EQ(0x10000, c.choose_args_get_item_weight(pool, rootno, 0, 0));
+  ASSERT_EQ(0, c.choose_args_set_item_weight(pool, rootno, 0, 0, 0));
+  ASSERT_EQ(-ENOENT, c.choose_args_set_item_weight(pool, rootno, 0, 2, 0));
+  for (int x = 0; x < 100; ++x) {
+    vector<int> out;
+    c.do_rule(ruleset, x, out, 2, weight, pool);
+    ASSERT_EQ(2u, out.size());
+    ASSERT_NE(0, out[0]);
+  }
+
+  // and it survives an encode/decode round trip
+  bufferlist bl;
+  c.encode(bl, CEPH_FEATURES_SUPPORTED_DEFAULT);
+  CrushWrapper c2;
+  bufferlist::iterator p = bl.begin();
+  c2.decode(p);
+  ASSERT_TRUE(c2.have_choose_args(pool));
+  ASSERT_EQ(0, c2.choose_args_get_item_weight(pool, rootno, 0, 0));
+  ASSERT_EQ(0x10000, c2.choose_args_get_item_weight(pool, rootno, 0, 1));
+
+  ASSERT_TRUE(c.rm_choose_args(pool));
+  ASSERT_FALSE(c.has_choose_args());
+}
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
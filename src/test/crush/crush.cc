@@ -638,3 +638,56 @@ TEST(CRUSH, straw2_reweight) {
     cout << "     vs " << estddev << std::endl;
   }
 }
+
+TEST(CRUSH, straw2_batch) {
+  // the chunked straw2 draw, the batch hash and crush_do_rule_batch
+  // must all give exactly the scalar results
+  const int n = 75;  // more than two chunks, and a partial one
+  int items[n], weights[n];
+  for (int i = 0; i < n; ++i) {
+    items[i] = i;
+    weights[i] = (i % 11 == 5) ? 0 : 0x1000 + (i * 0x3779) % 0x30000;
+  }
+
+  for (unsigned b = 0; b < 100; ++b) {
+    __u32 ids[n], hashes[n];
+    for (int i = 0; i < n; ++i)
+      ids[i] = i * 7919 + b;
+    crush_hash32_3_multi(CRUSH_HASH_RJENKINS1, b, ids, 3, hashes, n);
+    for (int i = 0; i < n; ++i)
+      ASSERT_EQ(crush_hash32_3(CRUSH_HASH_RJENKINS1, b, ids[i], 3), hashes[i]);
+    crush_hash32_2_multi(CRUSH_HASH_RJENKINS1, ids, b, hashes, n);
+    for (int i = 0; i < n; ++i)
+      ASSERT_EQ(crush_hash32_2(CRUSH_HASH_RJENKINS1, ids[i], b), hashes[i]);
+  }
+
+  std::unique_ptr<CrushWrapper> c(new CrushWrapper);
+  c->set_type_name(1, "root");
+  c->set_type_name(0, "osd");
+  c->set_max_devices(n);
+  int root;
+  crush_bucket *bucket = crush_make_bucket(c->get_crush_map(),
+					   CRUSH_BUCKET_STRAW2,
+					   CRUSH_HASH_RJENKINS1,
+					   1, n, items, weights);
+  EXPECT_EQ(0, crush_add_bucket(c->get_crush_map(), 0, bucket, &root));
+  EXPECT_EQ(0, c->set_item_name(root, "root"));
+  int ruleset = c->add_simple_ruleset("rule", "root", "osd",
+				      "firstn", pg_pool_t::TYPE_REPLICATED);
+  EXPECT_EQ(0, ruleset);
+  c->finalize();
+
+  vector<__u32> reweight(n, 0x10000);
+  reweight[3] = 0x8000;
+  vector<int> xs(10000);
+  for (unsigned x = 0; x < xs.size(); ++x)
+    xs[x] = x;
+  vector<vector<int> > batch;
+  c->do_rule_batch(ruleset, xs, &batch, 3, reweight);
+  ASSERT_EQ(xs.size(), batch.size());
+  for (unsigned x = 0; x < xs.size(); ++x) {
+    vector<int> out;
+    c->do_rule(ruleset, xs[x], out, 3, reweight);
+    ASSERT_EQ(out, batch[x]);
+  }
+}
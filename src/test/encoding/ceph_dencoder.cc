@@ -21,6 +21,7 @@
 #include "common/ceph_argparse.h"
 #include "common/Formatter.h"
 #include "common/errno.h"
+#include "common/ceph_time.h"
 #include "msg/Message.h"
 #include "include/assert.h"
 
@@ -64,6 +65,8 @@ void usage(ostream &out)
   out << "  decode              decode into in-memory object\n";
   out << "  encode              encode in-memory object\n";
   out << "  dump_json           dump in-memory object as json (to stdout)\n";
+  out << "  bench_encode <n>    encode in-memory object n times, print ns per encode\n";
+  out << "  bench_decode <n>    decode encoded data n times, print ns per decode\n";
   out << "  hexdump             print encoded data in hex\n";
   out << "\n";
   out << "  copy                copy object (via operator=)\n";
@@ -384,6 +387,34 @@ int main(int argc, const char **argv)
 	exit(1);
       }
       err = den->decode(encbl, skip);
+    } else if (*i == string("bench_encode") ||
+	       *i == string("bench_decode")) {
+      if (!den) {
+	cerr << "must first select type with 'type <name>'" << std::endl;
+	exit(1);
+      }
+      bool enc = (*i == string("bench_encode"));
+      ++i;
+      if (i == args.end()) {
+	cerr << "expecting iteration count" << std::endl;
+	exit(1);
+      }
+      int n = atoi(*i);
+      if (n <= 0) {
+	cerr << "iteration count must be positive" << std::endl;
+	exit(1);
+      }
+      auto start = ceph::mono_clock::now();
+      for (int j = 0; j < n && err.empty(); ++j) {
+	if (enc)
+	  den->encode(encbl, features | CEPH_FEATURE_RESERVED);
+	else
+	  err = den->decode(encbl, skip);
+      }
+      auto elapsed = ceph::mono_clock::now() - start;
+      cout << std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() / n
+	   << " ns per " << (enc ? "encode" : "decode")
+	   << " (" << encbl.length() << " bytes)" << std::endl;
     } else if (*i == string("copy_ctor")) {
       if (!den) {
 	cerr << "must first select type with 'type <name>'" << std::endl;
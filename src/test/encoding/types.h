@@ -107,6 +107,7 @@ TYPE(ECSubReadReply)
 TYPE_NONDETERMINISTIC(ExplicitHashHitSet)
 TYPE_NONDETERMINISTIC(ExplicitObjectHitSet)
 TYPE(BloomHitSet)
+TYPE(DecayingCountHitSet)
 TYPE_NONDETERMINISTIC(HitSet)   // because some subclasses are
 TYPE(HitSet::Params)
 
@@ -143,6 +144,7 @@ TYPE_FEATUREFUL(AuthMonitor::Incremental)
 #include "mon/PGMap.h"
 TYPE_FEATUREFUL(PGMap::Incremental)
 TYPE_FEATUREFUL_NONDETERMINISTIC(PGMap)
+TYPE_FEATUREFUL_NONDETERMINISTIC(PGMapDigest)
 
 #include "mon/MonitorDBStore.h"
 TYPE(MonitorDBStore::Transaction)
@@ -303,9 +305,12 @@ TYPE(rgw_bucket_dir)
 TYPE(rgw_bucket_entry_ver)
 TYPE(cls_rgw_obj_key)
 TYPE(rgw_bucket_olh_log_entry)
+TYPE(cls_rgw_bucket_instance_entry)
+TYPE(cls_rgw_reshard_log_entry)
 
 #include "cls/rgw/cls_rgw_ops.h"
 TYPE(rgw_cls_obj_prepare_op)
+TYPE(rgw_cls_obj_prepare_ops)
 TYPE(rgw_cls_obj_complete_op)
 TYPE(rgw_cls_list_op)
 TYPE(rgw_cls_list_ret)
@@ -373,6 +378,7 @@ TYPE(cls_rbd_snap)
 #include "cls/rbd/cls_rbd_types.h"
 TYPE(cls::rbd::MirrorPeer)
 TYPE(cls::rbd::MirrorImage)
+TYPE(cls::rbd::GroupSnapshot)
 #endif
 
 #endif
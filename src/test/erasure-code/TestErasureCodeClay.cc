@@ -0,0 +1,247 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph distributed storage system
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 2.1 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "include/stringify.h"
+#include "erasure-code/clay/ErasureCodeClay.h"
+#include "global/global_context.h"
+#include "common/config.h"
+#include "gtest/gtest.h"
+
+static bufferlist random_object(unsigned size)
+{
+  bufferptr ptr(size);
+  for (unsigned i = 0; i < size; i++)
+    ptr[i] = rand() % 256;
+  bufferlist bl;
+  bl.push_back(ptr);
+  return bl;
+}
+
+TEST(ErasureCodeClay, parse)
+{
+  {
+    ErasureCodeClay clay(g_conf->erasure_code_dir);
+    ErasureCodeProfile profile;
+    profile["k"] = "8";
+    profile["m"] = "3";
+    EXPECT_EQ(0, clay.init(profile, &cerr));
+    EXPECT_EQ(10, clay.d);
+    EXPECT_EQ(3, clay.q);
+    EXPECT_EQ(1, clay.nu);
+    EXPECT_EQ(4, clay.t);
+    EXPECT_EQ(81, clay.get_sub_chunk_count());
+    EXPECT_EQ(27, clay.get_repair_sub_chunk_count());
+    EXPECT_EQ(0u, clay.get_chunk_size(1) % 81);
+  }
+  {
+    ErasureCodeClay clay(g_conf->erasure_code_dir);
+    ErasureCodeProfile profile;
+    profile["k"] = "4";
+    profile["m"] = "2";
+    profile["d"] = "6";
+    EXPECT_EQ(-EINVAL, clay.init(profile, &cerr));
+  }
+  {
+    ErasureCodeClay clay(g_conf->erasure_code_dir);
+    ErasureCodeProfile profile;
+    profile["scalar_mds"] = "shec";
+    EXPECT_EQ(-ENOENT, clay.init(profile, &cerr));
+  }
+}
+
+TEST(ErasureCodeClay, encode_decode)
+{
+  const char *params[][3] = {
+    { "4", "2", "5" },
+    { "4", "3", "5" },
+    { "3", "3", "5" },
+  };
+  for (auto &p : params) {
+    ErasureCodeClay clay(g_conf->erasure_code_dir);
+    ErasureCodeProfile profile;
+    profile["k"] = p[0];
+    profile["m"] = p[1];
+    profile["d"] = p[2];
+    ASSERT_EQ(0, clay.init(profile, &cerr));
+    unsigned n = clay.get_chunk_count();
+
+    bufferlist in = random_object(clay.get_chunk_size(1) * clay.k);
+    set<int> want_to_encode;
+    for (unsigned i = 0; i < n; i++)
+      want_to_encode.insert(i);
+    map<int, bufferlist> encoded;
+    ASSERT_EQ(0, clay.encode(want_to_encode, in, &encoded));
+    ASSERT_EQ(n, encoded.size());
+
+    // every pattern of up to m erasures
+    for (unsigned erased = 1; erased < (1u << n); erased++) {
+      if (__builtin_popcount(erased) > clay.m)
+	continue;
+      map<int, bufferlist> chunks;
+      set<int> want_to_read;
+      for (unsigned i = 0; i < n; i++) {
+	if (erased & (1 << i))
+	  want_to_read.insert(i);
+	else
+	  chunks[i] = encoded[i];
+      }
+      map<int, bufferlist> decoded;
+      ASSERT_EQ(0, clay.decode(want_to_read, chunks, &decoded));
+      for (set<int>::iterator i = want_to_read.begin();
+	   i != want_to_read.end();
+	   ++i)
+	EXPECT_TRUE(decoded[*i].contents_equal(encoded[*i]))
+	  << "k=" << p[0] << " m=" << p[1] << " erased " << erased;
+    }
+  }
+}
+
+TEST(ErasureCodeClay, repair)
+{
+  const char *params[][3] = {
+    { "4", "2", "5" },
+    { "4", "3", "5" },
+    { "8", "3", "10" },
+  };
+  for (auto &p : params) {
+    ErasureCodeClay clay(g_conf->erasure_code_dir);
+    ErasureCodeProfile profile;
+    profile["k"] = p[0];
+    profile["m"] = p[1];
+    profile["d"] = p[2];
+    ASSERT_EQ(0, clay.init(profile, &cerr));
+    int n = clay.get_chunk_count();
+    unsigned chunk_size = clay.get_chunk_size(1);
+    unsigned sc_size = chunk_size / clay.get_sub_chunk_count();
+
+    bufferlist in = random_object(chunk_size * clay.k);
+    set<int> want_to_encode;
+    for (int i = 0; i < n; i++)
+      want_to_encode.insert(i);
+    map<int, bufferlist> encoded;
+    ASSERT_EQ(0, clay.encode(want_to_encode, in, &encoded));
+
+    for (int lost = 0; lost < n; lost++) {
+      set<int> want_to_read, available;
+      want_to_read.insert(lost);
+      for (int i = 0; i < n; i++)
+	if (i != lost)
+	  available.insert(i);
+      map<int, vector<pair<int, int> > > minimum;
+      ASSERT_EQ(0, clay.minimum_to_decode_sub_chunks(want_to_read, available,
+						     &minimum));
+      EXPECT_EQ((unsigned)clay.d, minimum.size());
+
+      // each helper sends q^(t-1) of its q^t sub-chunks
+      map<int, bufferlist> helpers;
+      for (auto &&i : minimum) {
+	int count = 0;
+	for (auto &&r : i.second) {
+	  bufferlist bl;
+	  bl.substr_of(encoded[i.first], r.first * sc_size, r.second * sc_size);
+	  helpers[i.first].claim_append(bl);
+	  count += r.second;
+	}
+	EXPECT_EQ(clay.get_repair_sub_chunk_count(), count);
+      }
+      map<int, bufferlist> decoded;
+      ASSERT_EQ(0, clay.decode_sub_chunks(want_to_read, helpers, &decoded,
+					  chunk_size));
+      EXPECT_TRUE(decoded[lost].contents_equal(encoded[lost]))
+	<< "k=" << p[0] << " m=" << p[1] << " lost " << lost;
+    }
+  }
+}
+
+TEST(ErasureCodeClay, minimum_to_decode_sub_chunks)
+{
+  ErasureCodeClay clay(g_conf->erasure_code_dir);
+  ErasureCodeProfile profile;
+  profile["k"] = "4";
+  profile["m"] = "2";
+  ASSERT_EQ(0, clay.init(profile, &cerr));
+
+  // nothing missing: read what is wanted, whole
+  set<int> want_to_read, available;
+  want_to_read.insert(0);
+  for (int i = 0; i < 6; i++)
+    available.insert(i);
+  map<int, vector<pair<int, int> > > minimum;
+  EXPECT_EQ(0, clay.minimum_to_decode_sub_chunks(want_to_read, available,
+						 &minimum));
+  EXPECT_EQ(1u, minimum.size());
+  EXPECT_EQ(make_pair(0, clay.get_sub_chunk_count()), minimum[0].front());
+
+  // two chunks lost: k whole chunks
+  want_to_read.insert(1);
+  available.erase(0);
+  available.erase(1);
+  minimum.clear();
+  EXPECT_EQ(0, clay.minimum_to_decode_sub_chunks(want_to_read, available,
+						 &minimum));
+  EXPECT_EQ(4u, minimum.size());
+  for (auto &&i : minimum) {
+    EXPECT_EQ(1u, i.second.size());
+    EXPECT_EQ(clay.get_sub_chunk_count(), i.second.front().second);
+  }
+}
+
+TEST(ErasureCodeClay, encode_stripes)
+{
+  // sub-chunks do not concatenate: stripes are encoded one at a time
+  ErasureCodeClay clay(g_conf->erasure_code_dir);
+  ErasureCodeProfile profile;
+  profile["k"] = "4";
+  profile["m"] = "2";
+  ASSERT_EQ(0, clay.init(profile, &cerr));
+  EXPECT_FALSE(clay.get_supported_optimizations() &
+	       ErasureCodeInterface::FLAG_EC_PLUGIN_MULTI_STRIPE);
+
+  const unsigned stripe_count = 3;
+  unsigned chunk_size = clay.get_chunk_size(1);
+  bufferlist in = random_object(chunk_size * 4 * stripe_count);
+  set<int> want_to_encode;
+  for (int i = 0; i < 6; i++)
+    want_to_encode.insert(i);
+  map<int, bufferlist> encoded;
+  ASSERT_EQ(0, clay.encode_stripes(want_to_encode, in, stripe_count,
+				   &encoded));
+
+  map<int, bufferlist> chunks = encoded;
+  chunks.erase(3);
+  set<int> want_to_read;
+  want_to_read.insert(3);
+  map<int, bufferlist> decoded;
+  ASSERT_EQ(0, clay.decode_stripes(want_to_read, chunks, stripe_count,
+				   &decoded));
+  EXPECT_TRUE(decoded[3].contents_equal(encoded[3]));
+  for (unsigned s = 0; s < stripe_count; s++) {
+    bufferlist stripe;
+    stripe.substr_of(in, s * chunk_size * 4, chunk_size * 4);
+    map<int, bufferlist> one;
+    ASSERT_EQ(0, clay.encode(want_to_encode, stripe, &one));
+    bufferlist bl;
+    bl.substr_of(encoded[5], s * chunk_size, chunk_size);
+    EXPECT_TRUE(bl.contents_equal(one[5]));
+  }
+}
+
+/*
+ * Local Variables:
+ * compile-command: "cd ../.. ; make -j4 unittest_erasure_code_clay &&
+ *   valgrind --tool=memcheck ./unittest_erasure_code_clay \
+ *      --gtest_filter=*.* --log-to-stderr=true --debug-osd=20"
+ * End:
+ */
@@ -874,6 +874,107 @@ TEST_F(IsaErasureCodeTest, isa_xor_codec)
   EXPECT_EQ(5, cnt_cf);
 }
 
+TEST_F(IsaErasureCodeTest, encode_delta)
+{
+  // m=1 is a plain xor, m=2 goes through ec_encode_data_update
+  for (int m = 1; m <= 2; m++) {
+    ErasureCodeIsaDefault Isa(tcache);
+    ErasureCodeProfile profile;
+    profile["k"] = "4";
+    profile["m"] = stringify(m);
+    Isa.init(profile, &cerr);
+    EXPECT_TRUE(Isa.get_supported_optimizations() &
+                ErasureCodeInterface::FLAG_EC_PLUGIN_PARITY_DELTA);
+
+    int n = 4 + m;
+    unsigned object_size = EC_ISA_ADDRESS_ALIGNMENT * 4 * 3;
+    string payload;
+    for (unsigned i = 0; i < object_size; i++)
+      payload.push_back('a' + i % 26);
+    bufferlist in;
+    in.append(payload);
+    set<int> want_to_encode;
+    for (int i = 0; i < n; i++)
+      want_to_encode.insert(i);
+    map<int, bufferlist> encoded;
+    EXPECT_EQ(0, Isa.encode(want_to_encode, in, &encoded));
+    unsigned chunk_size = encoded[0].length();
+
+    // change chunk 2, update the coding chunks from the delta
+    map<int, bufferlist> old_data, new_data, coding;
+    old_data[2].append(encoded[2].c_str(), chunk_size);
+    new_data[2].append(string(chunk_size, 'Z'));
+    for (int i = 4; i < n; i++)
+      coding[i].append(encoded[i].c_str(), chunk_size);
+    EXPECT_EQ(0, Isa.encode_delta(old_data, new_data, &coding));
+
+    // they must match a full encoding of the new data
+    bufferlist changed;
+    changed.append(encoded[0]);
+    changed.append(encoded[1]);
+    changed.append(new_data[2]);
+    changed.append(encoded[3]);
+    map<int, bufferlist> reencoded;
+    EXPECT_EQ(0, Isa.encode(want_to_encode, changed, &reencoded));
+    for (int i = 4; i < n; i++)
+      EXPECT_TRUE(coding[i].contents_equal(reencoded[i]));
+  }
+}
+
+TEST_F(IsaErasureCodeTest, encode_stripes)
+{
+  ErasureCodeIsaDefault Isa(tcache);
+  ErasureCodeProfile profile;
+  profile["k"] = "4";
+  profile["m"] = "2";
+  Isa.init(profile, &cerr);
+  EXPECT_TRUE(Isa.get_supported_optimizations() &
+              ErasureCodeInterface::FLAG_EC_PLUGIN_MULTI_STRIPE);
+
+  const unsigned stripe_count = 8;
+  unsigned chunk_size = Isa.get_chunk_size(1);
+  unsigned stripe_width = chunk_size * 4;
+  string payload;
+  for (unsigned i = 0; i < stripe_width * stripe_count; i++)
+    payload.push_back('a' + (i * 7 + i / 11) % 26);
+  bufferlist in;
+  in.append(payload);
+  set<int> want_to_encode;
+  for (int i = 0; i < 6; i++)
+    want_to_encode.insert(i);
+
+  map<int, bufferlist> encoded;
+  EXPECT_EQ(0, Isa.encode_stripes(want_to_encode, in, stripe_count, &encoded));
+  for (unsigned s = 0; s < stripe_count; s++) {
+    bufferlist stripe;
+    stripe.substr_of(in, s * stripe_width, stripe_width);
+    map<int, bufferlist> one;
+    EXPECT_EQ(0, Isa.encode(want_to_encode, stripe, &one));
+    for (int i = 0; i < 6; i++) {
+      bufferlist bl;
+      bl.substr_of(encoded[i], s * chunk_size, chunk_size);
+      EXPECT_TRUE(bl.contents_equal(one[i]));
+    }
+  }
+
+  // two data chunks of every stripe, into the buffers of a previous decode
+  map<int, bufferlist> chunks = encoded;
+  chunks.erase(0);
+  chunks.erase(2);
+  set<int> want_to_read;
+  want_to_read.insert(0);
+  want_to_read.insert(2);
+  map<int, bufferlist> decoded;
+  EXPECT_EQ(0, Isa.decode_stripes(want_to_read, chunks, stripe_count,
+                                  &decoded));
+  const char *rebuilt = decoded[2].c_str();
+  EXPECT_EQ(0, Isa.decode_stripes(want_to_read, chunks, stripe_count,
+                                  &decoded));
+  EXPECT_EQ(rebuilt, decoded[2].c_str());
+  EXPECT_TRUE(decoded[0].contents_equal(encoded[0]));
+  EXPECT_TRUE(decoded[2].contents_equal(encoded[2]));
+}
+
 TEST_F(IsaErasureCodeTest, create_ruleset)
 {
   CrushWrapper *c = new CrushWrapper;
@@ -227,6 +227,73 @@ TYPED_TEST(ErasureCodeTest, minimum_to_decode)
   }
 }
 
+TYPED_TEST(ErasureCodeTest, encode_stripes)
+{
+  TypeParam jerasure;
+  ErasureCodeProfile profile;
+  profile["k"] = "4";
+  profile["m"] = "2";
+  profile["packetsize"] = "8";
+  jerasure.init(profile, &cerr);
+  EXPECT_TRUE(jerasure.get_supported_optimizations() &
+	      ErasureCodeInterface::FLAG_EC_PLUGIN_MULTI_STRIPE);
+
+  const unsigned stripe_count = 5;
+  unsigned chunk_size = jerasure.get_chunk_size(1);
+  unsigned stripe_width = chunk_size * 4;
+  string payload;
+  for (unsigned i = 0; i < stripe_width * stripe_count; i++)
+    payload.push_back('a' + (i * 7 + i / 13) % 26);
+  bufferlist in;
+  in.append(payload);
+  set<int> want_to_encode;
+  for (int i = 0; i < 6; i++)
+    want_to_encode.insert(i);
+
+  // the same as encoding one stripe at a time
+  map<int, bufferlist> encoded;
+  EXPECT_EQ(0, jerasure.encode_stripes(want_to_encode, in, stripe_count,
+				       &encoded));
+  EXPECT_EQ(6u, encoded.size());
+  for (unsigned s = 0; s < stripe_count; s++) {
+    bufferlist stripe;
+    stripe.substr_of(in, s * stripe_width, stripe_width);
+    map<int, bufferlist> one;
+    EXPECT_EQ(0, jerasure.encode(want_to_encode, stripe, &one));
+    for (int i = 0; i < 6; i++) {
+      bufferlist bl;
+      bl.substr_of(encoded[i], s * chunk_size, chunk_size);
+      EXPECT_TRUE(bl.contents_equal(one[i])) << "stripe " << s << " chunk " << i;
+    }
+  }
+
+  // the output buffers are reused by the next call
+  const char *coding = encoded[4].c_str();
+  EXPECT_EQ(0, jerasure.encode_stripes(want_to_encode, in, stripe_count,
+				       &encoded));
+  EXPECT_EQ(coding, encoded[4].c_str());
+
+  // rebuild a data and a coding chunk of every stripe at once
+  map<int, bufferlist> chunks = encoded;
+  chunks.erase(1);
+  chunks.erase(4);
+  set<int> want_to_read;
+  want_to_read.insert(1);
+  want_to_read.insert(4);
+  map<int, bufferlist> decoded;
+  EXPECT_EQ(0, jerasure.decode_stripes(want_to_read, chunks, stripe_count,
+				       &decoded));
+  EXPECT_TRUE(decoded[1].contents_equal(encoded[1]));
+  EXPECT_TRUE(decoded[4].contents_equal(encoded[4]));
+
+  // a partial stripe is refused
+  bufferlist partial;
+  partial.substr_of(in, 0, stripe_width * stripe_count - 1);
+  map<int, bufferlist> out;
+  EXPECT_EQ(-EINVAL, jerasure.encode_stripes(want_to_encode, partial,
+					     stripe_count, &out));
+}
+
 TEST(ErasureCodeTest, encode)
 {
   ErasureCodeJerasureReedSolomonVandermonde jerasure;
@@ -277,6 +344,108 @@ TEST(ErasureCodeTest, encode)
   }
 }
 
+TEST(ErasureCodeTest, encode_delta)
+{
+  int ws[] = { 8, 16, 32 };
+  for (int w : ws) {
+    ErasureCodeJerasureReedSolomonVandermonde jerasure;
+    ErasureCodeProfile profile;
+    profile["k"] = "4";
+    profile["m"] = "2";
+    profile["w"] = stringify(w);
+    jerasure.init(profile, &cerr);
+    EXPECT_TRUE(jerasure.get_supported_optimizations() &
+		ErasureCodeInterface::FLAG_EC_PLUGIN_PARITY_DELTA);
+
+    unsigned object_size = jerasure.get_alignment() * 4;
+    string payload;
+    for (unsigned i = 0; i < object_size; ++i)
+      payload.push_back('a' + i % 26);
+    bufferlist in;
+    in.append(payload);
+    set<int> want_to_encode;
+    for (int i = 0; i < 6; ++i)
+      want_to_encode.insert(i);
+    map<int,bufferlist> encoded;
+    EXPECT_EQ(0, jerasure.encode(want_to_encode, in, &encoded));
+    unsigned chunk_size = encoded[0].length();
+
+    // change chunks 1 and 2, update the coding chunks from the deltas
+    map<int,bufferlist> old_data, new_data, coding;
+    for (int i = 1; i <= 2; ++i) {
+      old_data[i].append(encoded[i].c_str(), chunk_size);
+      new_data[i].append(string(chunk_size, 'A' + i));
+    }
+    for (int i = 4; i < 6; ++i)
+      coding[i].append(encoded[i].c_str(), chunk_size);
+    EXPECT_EQ(0, jerasure.encode_delta(old_data, new_data, &coding));
+
+    // they must match a full encoding of the new data
+    bufferlist changed;
+    changed.append(encoded[0]);
+    changed.append(new_data[1]);
+    changed.append(new_data[2]);
+    changed.append(encoded[3]);
+    map<int,bufferlist> reencoded;
+    EXPECT_EQ(0, jerasure.encode(want_to_encode, changed, &reencoded));
+    for (int i = 4; i < 6; ++i)
+      EXPECT_TRUE(coding[i].contents_equal(reencoded[i]));
+  }
+
+  {
+    ErasureCodeJerasureCauchyGood jerasure;
+    ErasureCodeProfile profile;
+    profile["k"] = "2";
+    profile["m"] = "1";
+    jerasure.init(profile, &cerr);
+    EXPECT_FALSE(jerasure.get_supported_optimizations() &
+		 ErasureCodeInterface::FLAG_EC_PLUGIN_PARITY_DELTA);
+    map<int,bufferlist> old_data, new_data, coding;
+    old_data[0].append("x");
+    new_data[0].append("y");
+    coding[2].append("z");
+    EXPECT_EQ(-EOPNOTSUPP,
+	      jerasure.encode_delta(old_data, new_data, &coding));
+  }
+}
+
+TEST(ErasureCodeTest, decode_table_cache)
+{
+  ErasureCodeJerasureReedSolomonVandermonde jerasure;
+  ErasureCodeProfile profile;
+  profile["k"] = "4";
+  profile["m"] = "2";
+  profile["w"] = "8";
+  jerasure.init(profile, &cerr);
+
+  unsigned object_size = jerasure.get_alignment() * 4;
+  string payload;
+  for (unsigned i = 0; i < object_size; ++i)
+    payload.push_back('a' + i % 26);
+  bufferlist in;
+  in.append(payload);
+  set<int> want;
+  for (int i = 0; i < 6; ++i)
+    want.insert(i);
+  map<int,bufferlist> encoded;
+  EXPECT_EQ(0, jerasure.encode(want, in, &encoded));
+
+  // every pattern twice: the second decode uses the cached table
+  for (int round = 0; round < 2; ++round) {
+    for (int a = 0; a < 6; ++a) {
+      for (int b = a; b < 6; ++b) {
+	map<int,bufferlist> chunks = encoded;
+	chunks.erase(a);
+	chunks.erase(b);
+	map<int,bufferlist> decoded;
+	EXPECT_EQ(0, jerasure.decode(want, chunks, &decoded));
+	for (int i = 0; i < 6; ++i)
+	  EXPECT_TRUE(decoded[i].contents_equal(encoded[i]));
+      }
+    }
+  }
+}
+
 TEST(ErasureCodeTest, create_ruleset)
 {
   CrushWrapper *c = new CrushWrapper;
@@ -600,6 +600,72 @@ TEST(ErasureCodeLrc, minimum_to_decode)
   }
 }
 
+TEST(ErasureCodeLrc, minimum_to_decode_with_cost)
+{
+  ErasureCodeLrc lrc(g_conf->erasure_code_dir);
+  ErasureCodeProfile profile;
+  profile["mapping"] =
+    "__DD__DD";
+  const char *description_string =
+    "[ "
+    "  [ \"_cDD_cDD\", \"\" ]," // global layer
+    "  [ \"c_DD____\", \"\" ]," // first local layer
+    "  [ \"____cDDD\", \"\" ]," // second local layer
+    "]";
+  profile["layers"] = description_string;
+  EXPECT_EQ(0, lrc.init(profile, &cerr));
+  // the second local layer is cheap: recover within it
+  {
+    set<int> want_to_read;
+    want_to_read.insert(7);
+    map<int, int> available;
+    for (int i = 0; i < 7; i++)
+      available[i] = i < 4 ? 1000 : 1;
+    set<int> minimum;
+    EXPECT_EQ(0, lrc.minimum_to_decode_with_cost(want_to_read, available, &minimum));
+    set<int> expected;
+    expected.insert(4);
+    expected.insert(5);
+    expected.insert(6);
+    EXPECT_EQ(expected, minimum);
+  }
+  // the second local layer is far away: the global layer reads one
+  // chunk of it instead of three
+  {
+    set<int> want_to_read;
+    want_to_read.insert(7);
+    map<int, int> available;
+    for (int i = 0; i < 7; i++)
+      available[i] = i < 4 ? 1 : 1000;
+    set<int> minimum;
+    EXPECT_EQ(0, lrc.minimum_to_decode_with_cost(want_to_read, available, &minimum));
+    EXPECT_EQ(4U, minimum.size());
+    EXPECT_EQ(1U, minimum.count(5));
+    EXPECT_EQ(0U, minimum.count(4));
+    EXPECT_EQ(0U, minimum.count(6));
+  }
+  // the global layer no longer reads every chunk it has when fewer,
+  // cheaper ones are enough
+  {
+    set<int> want_to_read;
+    want_to_read.insert(2);
+    map<int, int> available;
+    available[1] = 1;
+    available[3] = 1;
+    available[5] = 1;
+    available[6] = 1;
+    available[7] = 1000;
+    set<int> minimum;
+    EXPECT_EQ(0, lrc.minimum_to_decode_with_cost(want_to_read, available, &minimum));
+    set<int> expected;
+    expected.insert(1);
+    expected.insert(3);
+    expected.insert(5);
+    expected.insert(6);
+    EXPECT_EQ(expected, minimum);
+  }
+}
+
 TEST(ErasureCodeLrc, encode_decode)
 {
   ErasureCodeLrc lrc(g_conf->erasure_code_dir);
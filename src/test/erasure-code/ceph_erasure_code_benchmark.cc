@@ -32,6 +32,7 @@
 #include "include/utime.h"
 #include "erasure-code/ErasureCodePlugin.h"
 #include "erasure-code/ErasureCode.h"
+#include "include/stringify.h"
 #include "ceph_erasure_code_benchmark.h"
 
 namespace po = boost::program_options;
@@ -61,6 +62,7 @@ int ErasureCodeBench::setup(int argc, char** argv) {
      " the first chunk, then the second etc.)")
     ("parameter,P", po::value<vector<string> >(),
      "add a parameter to the erasure code profile")
+    ("per-pattern", "when decoding, also report GB/s for each erasure pattern")
     ;
 
   po::variables_map vm;
@@ -133,6 +135,7 @@ int ErasureCodeBench::setup(int argc, char** argv) {
   } 
 
   verbose = vm.count("verbose") > 0 ? true : false;
+  per_pattern = vm.count("per-pattern") > 0;
 
   return 0;
 }
@@ -219,7 +222,7 @@ int ErasureCodeBench::decode_erasures(const map<int,bufferlist> &all_chunks,
 	want_to_read.insert(chunk);
 
     map<int,bufferlist> decoded;
-    code = erasure_code->decode(want_to_read, chunks, &decoded);
+    code = timed_decode(erasure_code, want_to_read, chunks, &decoded);
     if (code)
       return code;
     for (set<int>::iterator chunk = want_to_read.begin();
@@ -251,6 +254,29 @@ int ErasureCodeBench::decode_erasures(const map<int,bufferlist> &all_chunks,
   return 0;
 }
 
+int ErasureCodeBench::timed_decode(ErasureCodeInterfaceRef erasure_code,
+				   const set<int> &want_to_read,
+				   const map<int,bufferlist> &chunks,
+				   map<int,bufferlist> *decoded)
+{
+  utime_t begin_time = ceph_clock_now();
+  int code = erasure_code->decode(want_to_read, chunks, decoded);
+  if (per_pattern) {
+    string pattern;
+    for (unsigned int chunk = 0; chunk < erasure_code->get_chunk_count(); chunk++) {
+      if (chunks.count(chunk) == 0) {
+	if (!pattern.empty())
+	  pattern += ",";
+	pattern += stringify(chunk);
+      }
+    }
+    pair<double, uint64_t> &stats = pattern_stats[pattern];
+    stats.first += (double)(ceph_clock_now() - begin_time);
+    stats.second += in_size;
+  }
+  return code;
+}
+
 int ErasureCodeBench::decode()
 {
   ErasureCodePluginRegistry &instance = ErasureCodePluginRegistry::instance();
@@ -303,7 +329,7 @@ int ErasureCodeBench::decode()
 	return code;
     } else if (erased.size() > 0) {
       map<int,bufferlist> decoded;
-      code = erasure_code->decode(want_to_read, encoded, &decoded);
+      code = timed_decode(erasure_code, want_to_read, encoded, &decoded);
       if (code)
 	return code;
     } else {
@@ -316,13 +342,20 @@ int ErasureCodeBench::decode()
 	chunks.erase(erasure);
       }
       map<int,bufferlist> decoded;
-      code = erasure_code->decode(want_to_read, chunks, &decoded);
+      code = timed_decode(erasure_code, want_to_read, chunks, &decoded);
       if (code)
 	return code;
     }
   }
   utime_t end_time = ceph_clock_now();
   cout << (end_time - begin_time) << "\t" << (max_iterations * (in_size / 1024)) << endl;
+  for (map<string, pair<double, uint64_t> >::iterator i = pattern_stats.begin();
+       i != pattern_stats.end();
+       ++i) {
+    double gbps = i->second.first > 0 ?
+      i->second.second / i->second.first / 1000000000 : 0;
+    cout << "erased " << i->first << "\t" << gbps << " GB/s" << endl;
+  }
   return 0;
 }
 
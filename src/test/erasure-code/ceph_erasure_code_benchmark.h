@@ -35,6 +35,10 @@ class ErasureCodeBench {
   vector<int> erased;
   string workload;
 
+  bool per_pattern;
+  /// seconds spent and bytes decoded, by erased chunks
+  map<string, pair<double, uint64_t> > pattern_stats;
+
   ErasureCodeProfile profile;
 
   bool verbose;
@@ -47,6 +51,10 @@ public:
 		      unsigned i,
 		      unsigned want_erasures,
 		      ErasureCodeInterfaceRef erasure_code);
+  int timed_decode(ErasureCodeInterfaceRef erasure_code,
+		   const set<int> &want_to_read,
+		   const map<int,bufferlist> &chunks,
+		   map<int,bufferlist> *decoded);
   int decode();
   int encode();
 };
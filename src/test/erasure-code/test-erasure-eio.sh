@@ -41,7 +41,9 @@ function run() {
 }
 
 function setup_osds() {
-    for id in $(seq 0 3) ; do
+    local count=${1:-4}
+
+    for id in $(seq 0 $(expr $count - 1)) ; do
         run_osd $dir $id || return 1
     done
     wait_for_clean || return 1
@@ -147,8 +149,8 @@ function inject_eio() {
     shift
     local shard_id=$1
     shift
+    local poolname=${1:-pool-jerasure}
 
-    local poolname=pool-jerasure
     local -a initial_osds=($(get_osds $poolname $objname))
     local osd_id=${initial_osds[$shard_id]}
     set_config osd $osd_id filestore_debug_inject_read_err true || return 1
@@ -330,6 +332,35 @@ function TEST_rados_get_with_subreadall_eio_shard_1() {
     delete_pool $poolname
 }
 
+#
+# Recovering a clay chunk reads only some sub-chunks from d helpers.
+# If one of the helpers returns EIO, the primary must fall back to
+# whole chunks from the remaining shards instead of decoding a mix
+# of both.
+#
+function TEST_rados_recover_clay_subchunk_eio() {
+    local dir=$1
+
+    setup_osds 5 || return 1
+
+    local poolname=pool-clay
+    ceph osd erasure-code-profile set clayprofile \
+        plugin=clay \
+        k=2 m=3 d=3 \
+        ruleset-failure-domain=osd || return 1
+    ceph osd pool create $poolname 1 1 erasure clayprofile \
+        || return 1
+    wait_for_clean || return 1
+
+    local objname=obj-clay-eio-$$
+    # shard 1 is one of the helpers when the last shard is repaired
+    inject_eio $objname $dir 1 $poolname || return 1
+    rados_put_get $dir $poolname $objname recovery || return 1
+
+    ceph osd pool delete $poolname $poolname --yes-i-really-really-mean-it
+    ceph osd erasure-code-profile rm clayprofile
+}
+
 main test-erasure-eio "$@"
 
 # Local Variables:
@@ -8,13 +8,16 @@
  *
  */
 
+#include <fstream>
 #include <memory>
 #include <system_error>
 #include <vector>
 
 #include "os/ObjectStore.h"
 #include "global/global_init.h"
+#include "common/ceph_time.h"
 #include "common/errno.h"
+#include "common/Formatter.h"
 #include "include/intarith.h"
 #include "include/stringify.h"
 
@@ -32,6 +35,13 @@ namespace {
 struct Options {
   thread_data* td;
   char* conf;
+  unsigned int pg_count;
+  unsigned int omap_only;
+  unsigned int omap_keys;
+  unsigned int attr_len;
+  unsigned int pglog;
+  unsigned int pglog_length;
+  char* latency_output;
 };
 
 template <class Func> // void Func(fio_option&)
@@ -53,6 +63,69 @@ static std::vector<fio_option> ceph_options{
     o.help   = "Path to a ceph configuration file";
     o.off1   = offsetof(Options, conf);
   }),
+  make_option([] (fio_option& o) {
+    o.name   = "pg_count";
+    o.lname  = "collections per job";
+    o.type   = FIO_OPT_INT;
+    o.help   = "Number of collections to spread the files of a job over "
+               "(default: osd_pool_default_pg_num, at most nr_files)";
+    o.off1   = offsetof(Options, pg_count);
+    o.def    = "0";
+  }),
+  make_option([] (fio_option& o) {
+    o.name   = "omap_only";
+    o.lname  = "omap workload";
+    o.type   = FIO_OPT_BOOL;
+    o.help   = "Writes set omap keys, reads get them and trims remove them, "
+               "like a bucket index, instead of doing data io";
+    o.off1   = offsetof(Options, omap_only);
+    o.def    = "0";
+  }),
+  make_option([] (fio_option& o) {
+    o.name   = "omap_keys";
+    o.lname  = "omap keys per io";
+    o.type   = FIO_OPT_INT;
+    o.help   = "Number of omap keys each io of omap_only covers, the block "
+               "is split between their values";
+    o.off1   = offsetof(Options, omap_keys);
+    o.def    = "1";
+    o.minval = 1;
+  }),
+  make_option([] (fio_option& o) {
+    o.name   = "attr_len";
+    o.lname  = "xattr length";
+    o.type   = FIO_OPT_INT;
+    o.help   = "Also set an xattr of this many bytes with each write, like "
+               "the object info the osd updates (0 for none)";
+    o.off1   = offsetof(Options, attr_len);
+    o.def    = "0";
+  }),
+  make_option([] (fio_option& o) {
+    o.name   = "pglog";
+    o.lname  = "pg log";
+    o.type   = FIO_OPT_BOOL;
+    o.help   = "Also append a pg log entry to the collection's pgmeta "
+               "object with each write, and trim the oldest";
+    o.off1   = offsetof(Options, pglog);
+    o.def    = "0";
+  }),
+  make_option([] (fio_option& o) {
+    o.name   = "pglog_length";
+    o.lname  = "pg log length";
+    o.type   = FIO_OPT_INT;
+    o.help   = "Number of pg log entries to keep per collection";
+    o.off1   = offsetof(Options, pglog_length);
+    o.def    = "3000";
+    o.minval = 1;
+  }),
+  make_option([] (fio_option& o) {
+    o.name   = "latency_output";
+    o.lname  = "latency output file";
+    o.type   = FIO_OPT_STR_STORE;
+    o.help   = "File to append the per-op latencies of each job to, as "
+               "json (default: the ceph log)";
+    o.off1   = offsetof(Options, latency_output);
+  }),
   {} // fio expects a 'null'-terminated list
 };
 
@@ -145,12 +218,15 @@ struct Collection {
   spg_t pg;
   coll_t cid;
   ObjectStore::Sequencer sequencer;
+  ghobject_t pgmeta_oid; //< holds the pg log, like the osd's
+  uint64_t pglog_head = 0; //< version of the next pg log entry
 
   // use big pool ids to avoid clashing with existing collections
   static constexpr int64_t MIN_POOL_ID = 0x0000ffffffffffff;
 
   Collection(const spg_t& pg)
-    : pg(pg), cid(pg), sequencer(stringify(pg)) {}
+    : pg(pg), cid(pg), sequencer(stringify(pg)),
+      pgmeta_oid(pg.make_pgmeta_oid()) {}
 };
 
 struct Object {
@@ -162,6 +238,45 @@ struct Object {
       coll(coll) {}
 };
 
+/// latencies of one kind of op, with a histogram in power of two usecs
+struct OpLatency {
+  std::mutex lock;
+  uint64_t count = 0;
+  ceph::timespan total = ceph::timespan::zero();
+  ceph::timespan max = ceph::timespan::zero();
+  std::vector<uint64_t> histogram = std::vector<uint64_t>(32);
+
+  void add(ceph::timespan lat) {
+    const uint64_t usec =
+      std::chrono::duration_cast<std::chrono::microseconds>(lat).count();
+    std::lock_guard<std::mutex> l(lock);
+    ++count;
+    total += lat;
+    if (lat > max)
+      max = lat;
+    ++histogram[std::min<size_t>(cbitsll(usec), histogram.size() - 1)];
+  }
+
+  void dump(Formatter* f) {
+    std::lock_guard<std::mutex> l(lock);
+    f->dump_unsigned("count", count);
+    f->dump_float("avg_usec", count ?
+                  std::chrono::duration<double, std::micro>(total).count() / count : 0);
+    f->dump_float("max_usec",
+                  std::chrono::duration<double, std::micro>(max).count());
+    f->open_array_section("histogram");
+    for (size_t i = 0; i < histogram.size(); i++) {
+      if (!histogram[i])
+        continue;
+      f->open_object_section("bucket");
+      f->dump_unsigned("max_usec", (1ull << i) - 1);
+      f->dump_unsigned("count", histogram[i]);
+      f->close_section();
+    }
+    f->close_section();
+  }
+};
+
 /// treat each fio job like a separate pool with its own collections and objects
 struct Job {
   Engine* engine; //< shared ptr to the global Engine
@@ -170,23 +285,51 @@ struct Job {
   std::vector<io_u*> events; //< completions for fio_ceph_os_event()
   const bool unlink; //< unlink objects on destruction
 
+  // transaction composition, see the job options
+  bool omap_only;
+  unsigned omap_keys;
+  unsigned attr_len;
+  bool pglog;
+  unsigned pglog_length;
+
+  const std::string name;
+  std::string latency_output;
+  OpLatency latency[DDIR_RWDIR_CNT]; //< by fio data direction
+
   Job(Engine* engine, const thread_data* td);
   ~Job();
+
+  void dump_latency();
 };
 
 Job::Job(Engine* engine, const thread_data* td)
   : engine(engine),
     events(td->o.iodepth),
-    unlink(td->o.unlink)
+    unlink(td->o.unlink),
+    name(td->o.name ? td->o.name : "")
 {
+  auto o = static_cast<const Options*>(td->eo);
+  omap_only = o->omap_only;
+  omap_keys = std::max(1u, o->omap_keys);
+  attr_len = o->attr_len;
+  pglog = o->pglog;
+  pglog_length = std::max(1u, o->pglog_length);
+  if (o->latency_output)
+    latency_output = o->latency_output;
+
   engine->ref();
   // use the fio thread_number for our unique pool id
   const uint64_t pool = Collection::MIN_POOL_ID + td->thread_number;
 
-  // create a collection for each object, up to osd_pool_default_pg_num
-  uint32_t count = g_conf->osd_pool_default_pg_num;
-  if (count > td->o.nr_files)
-    count = td->o.nr_files;
+  // create pg_count collections, or one for each object up to
+  // osd_pool_default_pg_num. each job queues the transactions of its own
+  // collections only, like an osd shard thread does for its pgs
+  uint32_t count = o->pg_count;
+  if (!count) {
+    count = g_conf->osd_pool_default_pg_num;
+    if (count > td->o.nr_files)
+      count = td->o.nr_files;
+  }
 
   assert(count > 0);
   collections.reserve(count);
@@ -201,6 +344,8 @@ Job::Job(Engine* engine, const thread_data* td)
     auto& cid = collections.back().cid;
     if (!engine->os->collection_exists(cid))
       t.create_collection(cid, split_bits);
+    if (pglog)
+      t.touch(cid, collections.back().pgmeta_oid);
   }
 
   const uint64_t file_size = td->o.size / max(1u, td->o.nr_files);
@@ -232,6 +377,7 @@ Job::Job(Engine* engine, const thread_data* td)
 
 Job::~Job()
 {
+  dump_latency();
   if (unlink) {
     ObjectStore::Transaction t;
     // remove our objects
@@ -240,6 +386,8 @@ Job::~Job()
     }
     // remove our collections
     for (auto& coll : collections) {
+      if (pglog)
+        t.remove(coll.cid, coll.pgmeta_oid);
       t.remove_collection(coll.cid);
     }
     ObjectStore::Sequencer sequencer("job cleanup");
@@ -250,6 +398,40 @@ Job::~Job()
   engine->deref();
 }
 
+void Job::dump_latency()
+{
+  static const char* names[2][DDIR_RWDIR_CNT] = {
+    { "read", "write", "trim" },
+    { "omap_get", "omap_set", "omap_rmkeys" },
+  };
+  JSONFormatter f(true);
+  f.open_object_section("job");
+  f.dump_string("name", name);
+  f.open_object_section("latency");
+  for (int d = 0; d < DDIR_RWDIR_CNT; d++) {
+    if (!latency[d].count)
+      continue;
+    f.open_object_section(names[omap_only][d]);
+    latency[d].dump(&f);
+    f.close_section();
+  }
+  f.close_section();
+  f.close_section();
+
+  ostringstream ostr;
+  f.flush(ostr);
+  if (latency_output.empty()) {
+    dout(0) << "FIO plugin " << ostr.str() << dendl;
+    return;
+  }
+  // jobs finish on their own threads
+  std::lock_guard<std::mutex> l(engine->lock);
+  std::ofstream out(latency_output, std::ios::app);
+  out << ostr.str() << std::endl;
+  if (!out)
+    derr << "failed to write latencies to " << latency_output << dendl;
+}
+
 
 int fio_ceph_os_setup(thread_data* td)
 {
@@ -316,14 +498,49 @@ int fio_ceph_os_getevents(thread_data* td, unsigned int min,
 /// completion context for ObjectStore::queue_transaction()
 class UnitComplete : public Context {
   io_u* u;
+  OpLatency& latency;
+  ceph::mono_time start;
  public:
-  UnitComplete(io_u* u) : u(u) {}
+  UnitComplete(io_u* u, OpLatency& latency)
+    : u(u), latency(latency), start(ceph::mono_clock::now()) {}
   void finish(int r) {
+    latency.add(ceph::mono_clock::now() - start);
     // mark the pointer to indicate completion for fio_ceph_os_getevents()
     u->engine_data = reinterpret_cast<void*>(1ull);
   }
 };
 
+/// the omap keys an io covers, each value gets an equal part of the block
+static std::string omap_key(uint64_t offset, unsigned i)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%016llx.%04x", (unsigned long long)offset, i);
+  return buf;
+}
+
+/// add the parts of a write the osd would put into the same transaction
+static void add_write_metadata(Job* job, Collection& coll, Object& object,
+                               ObjectStore::Transaction& t)
+{
+  if (job->attr_len) {
+    bufferlist bl;
+    bl.append_zero(job->attr_len);
+    t.setattr(coll.cid, object.oid, "_", bl);
+  }
+  if (job->pglog) {
+    // a log entry of about the size of the osd's, trimmed to pglog_length
+    const uint64_t v = ++coll.pglog_head;
+    map<string,bufferlist> entry;
+    entry[omap_key(v, 0)].append_zero(180);
+    t.omap_setkeys(coll.cid, coll.pgmeta_oid, entry);
+    if (v > job->pglog_length) {
+      set<string> trim;
+      trim.insert(omap_key(v - job->pglog_length, 0));
+      t.omap_rmkeys(coll.cid, coll.pgmeta_oid, trim);
+    }
+  }
+}
+
 int fio_ceph_os_queue(thread_data* td, io_u* u)
 {
   fio_ro_check(td, u);
@@ -342,29 +559,74 @@ int fio_ceph_os_queue(thread_data* td, io_u* u)
                                        static_cast<char*>(u->xfer_buf)));
     // enqueue a write transaction on the collection's sequencer
     ObjectStore::Transaction t;
-    t.write(coll.cid, object.oid, u->offset, u->xfer_buflen, bl, flags);
+    if (job->omap_only) {
+      const uint64_t value_len = u->xfer_buflen / job->omap_keys;
+      map<string,bufferlist> keys;
+      for (unsigned i = 0; i < job->omap_keys; i++) {
+        keys[omap_key(u->offset, i)].substr_of(bl, i * value_len, value_len);
+      }
+      t.omap_setkeys(coll.cid, object.oid, keys);
+    } else {
+      t.write(coll.cid, object.oid, u->offset, u->xfer_buflen, bl, flags);
+    }
+    add_write_metadata(job, coll, object, t);
+    os->queue_transaction(&coll.sequencer,
+                          std::move(t),
+                          nullptr,
+                          new UnitComplete(u, job->latency[DDIR_WRITE]));
+    return FIO_Q_QUEUED;
+  }
+
+  if (u->ddir == DDIR_TRIM) {
+    ObjectStore::Transaction t;
+    if (job->omap_only) {
+      set<string> keys;
+      for (unsigned i = 0; i < job->omap_keys; i++) {
+        keys.insert(omap_key(u->offset, i));
+      }
+      t.omap_rmkeys(coll.cid, object.oid, keys);
+    } else {
+      t.zero(coll.cid, object.oid, u->offset, u->xfer_buflen);
+    }
     os->queue_transaction(&coll.sequencer,
                           std::move(t),
                           nullptr,
-                          new UnitComplete(u));
+                          new UnitComplete(u, job->latency[DDIR_TRIM]));
     return FIO_Q_QUEUED;
   }
 
   if (u->ddir == DDIR_READ) {
     // ObjectStore reads are synchronous, so make the call and return COMPLETED
+    const auto start = ceph::mono_clock::now();
     bufferlist bl;
-    int r = os->read(coll.cid, object.oid, u->offset, u->xfer_buflen, bl);
+    int r;
+    if (job->omap_only) {
+      set<string> keys;
+      for (unsigned i = 0; i < job->omap_keys; i++) {
+        keys.insert(omap_key(u->offset, i));
+      }
+      map<string,bufferlist> values;
+      r = os->omap_get_values(coll.cid, object.oid, keys, &values);
+      for (auto& v : values) {
+        bl.claim_append(v.second);
+      }
+      if (r == 0)
+        r = std::min<int>(bl.length(), u->xfer_buflen);
+    } else {
+      r = os->read(coll.cid, object.oid, u->offset, u->xfer_buflen, bl);
+    }
+    job->latency[DDIR_READ].add(ceph::mono_clock::now() - start);
     if (r < 0) {
       u->error = r;
       td_verror(td, u->error, "xfer");
     } else {
-      bl.copy(0, bl.length(), static_cast<char*>(u->xfer_buf));
+      bl.copy(0, r, static_cast<char*>(u->xfer_buf));
       u->resid = u->xfer_buflen - r;
     }
     return FIO_Q_COMPLETED;
   }
 
-  derr << "WARNING: Only DDIR_READ and DDIR_WRITE are supported!" << dendl;
+  derr << "WARNING: Only DDIR_READ, DDIR_WRITE and DDIR_TRIM are supported!" << dendl;
   u->error = -EINVAL;
   td_verror(td, u->error, "xfer");
   return FIO_Q_COMPLETED;
@@ -27,7 +27,8 @@ public:
                                               const std::string &client_id = "client",
                                               double commit_internal = 0.1,
                                               uint64_t max_fetch_bytes = 0,
-                                              int max_concurrent_object_sets = 0);
+                                              int max_concurrent_object_sets = 0,
+                                              uint64_t max_prefetch_bytes = 0);
   int append(const std::string &oid, const bufferlist &bl);
 
   int client_register(const std::string &oid, const std::string &id = "client",
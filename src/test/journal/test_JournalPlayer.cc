@@ -21,6 +21,7 @@ public:
   typedef std::list<journal::JournalPlayer *> JournalPlayers;
 
   static const uint64_t max_fetch_bytes = T::max_fetch_bytes;
+  static const uint64_t max_prefetch_bytes = T::max_prefetch_bytes;
 
   struct ReplayHandler : public journal::ReplayHandler {
     Mutex lock;
@@ -60,7 +61,8 @@ public:
 
   journal::JournalMetadataPtr create_metadata(const std::string &oid) {
     return RadosTestFixture::create_metadata(oid, "client", 0.1,
-                                             max_fetch_bytes);
+                                             max_fetch_bytes, 0,
+                                             max_prefetch_bytes);
   }
 
   int client_commit(const std::string &oid,
@@ -135,14 +137,16 @@ public:
   ReplayHandler m_replay_hander;
 };
 
-template <uint64_t _max_fetch_bytes>
+template <uint64_t _max_fetch_bytes, uint64_t _max_prefetch_bytes = 0>
 class TestJournalPlayerParams {
 public:
   static const uint64_t max_fetch_bytes = _max_fetch_bytes;
+  static const uint64_t max_prefetch_bytes = _max_prefetch_bytes;
 };
 
 typedef ::testing::Types<TestJournalPlayerParams<0>,
-                         TestJournalPlayerParams<16> > TestJournalPlayerTypes;
+                         TestJournalPlayerParams<16>,
+                         TestJournalPlayerParams<16, 64> > TestJournalPlayerTypes;
 TYPED_TEST_CASE(TestJournalPlayer, TestJournalPlayerTypes);
 
 TYPED_TEST(TestJournalPlayer, Prefetch) {
@@ -0,0 +1,254 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "gtest/gtest.h"
+#include "include/cephfs/libcephfs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+/*
+ * Whether a create or unlink actually goes async depends on the caps the
+ * mds hands out, so these check what must hold either way: every op takes
+ * effect with the ino the client reported, or its error shows up through
+ * open, fsync or close.
+ */
+
+static void mount_async(struct ceph_mount_info **cmount)
+{
+  ASSERT_EQ(0, ceph_create(cmount, NULL));
+  ASSERT_EQ(0, ceph_conf_read_file(*cmount, NULL));
+  ASSERT_EQ(0, ceph_conf_parse_env(*cmount, NULL));
+  ASSERT_EQ(0, ceph_conf_set(*cmount, "client_async_dirops", "true"));
+  ASSERT_EQ(0, ceph_mount(*cmount, "/"));
+}
+
+static void mount_sync(struct ceph_mount_info **cmount)
+{
+  ASSERT_EQ(0, ceph_create(cmount, NULL));
+  ASSERT_EQ(0, ceph_conf_read_file(*cmount, NULL));
+  ASSERT_EQ(0, ceph_conf_parse_env(*cmount, NULL));
+  ASSERT_EQ(0, ceph_mount(*cmount, "/"));
+}
+
+/*
+ * Make a dir the client may create in on its own: the first create is
+ * synchronous and gets us delegated inos and the layout to use, and a full
+ * listing leaves the dir complete.
+ */
+static void prepare_dir(struct ceph_mount_info *cmount, const std::string& dir)
+{
+  ASSERT_EQ(0, ceph_mkdir(cmount, dir.c_str(), 0777));
+
+  std::string seed = dir + "/seed";
+  int fd = ceph_open(cmount, seed.c_str(), O_CREAT|O_EXCL|O_RDWR, 0644);
+  ASSERT_LE(0, fd);
+  ASSERT_EQ(0, ceph_close(cmount, fd));
+
+  struct ceph_dir_result *dirp;
+  ASSERT_EQ(0, ceph_opendir(cmount, dir.c_str(), &dirp));
+  while (ceph_readdir(cmount, dirp) != NULL)
+    ;
+  ASSERT_EQ(0, ceph_closedir(cmount, dirp));
+}
+
+static int mds_command(struct ceph_mount_info *cmount, const char *mds_spec,
+		       const std::string& cmd)
+{
+  const char *cmdv[] = { cmd.c_str() };
+  char *outbuf = NULL, *outs = NULL;
+  size_t outbuflen = 0, outslen = 0;
+  int r = ceph_mds_command(cmount, mds_spec, cmdv, 1, "", 0,
+			   &outbuf, &outbuflen, &outs, &outslen);
+  if (outbuf)
+    ceph_buffer_free(outbuf);
+  if (outs)
+    ceph_buffer_free(outs);
+  return r;
+}
+
+static int fsync_dir(struct ceph_mount_info *cmount, const std::string& dir)
+{
+  int fd = ceph_open(cmount, dir.c_str(), O_RDONLY, 0);
+  if (fd < 0)
+    return fd;
+  int r = ceph_fsync(cmount, fd, 0);
+  ceph_close(cmount, fd);
+  return r;
+}
+
+TEST(LibCephFS, AsyncCreateUnlink) {
+  struct ceph_mount_info *ca, *cb;
+  mount_async(&ca);
+  mount_sync(&cb);
+
+  char dir[64];
+  snprintf(dir, sizeof(dir), "async_create_unlink.%d", getpid());
+  prepare_dir(ca, dir);
+
+  const int n = 32;
+  std::vector<uint64_t> inos(n);
+  for (int i = 0; i < n; i++) {
+    std::string path = std::string(dir) + "/f" + std::to_string(i);
+    int fd = ceph_open(ca, path.c_str(), O_CREAT|O_EXCL|O_RDWR, 0644);
+    ASSERT_LE(0, fd);
+
+    // new names show up at once, and the create is exclusive
+    ASSERT_EQ(-EEXIST, ceph_open(ca, path.c_str(), O_CREAT|O_EXCL|O_RDWR,
+				 0644));
+    struct ceph_statx stx;
+    ASSERT_EQ(0, ceph_fstatx(ca, fd, &stx, CEPH_STATX_INO, 0));
+    inos[i] = stx.stx_ino;
+
+    // i/o waits for the caps the create brings
+    ASSERT_EQ(4, ceph_write(ca, fd, "data", 4, 0));
+    ASSERT_EQ(0, ceph_fsync(ca, fd, 0));
+    ASSERT_EQ(0, ceph_close(ca, fd));
+  }
+
+  // unlink half of them, and make one of those again right away
+  for (int i = 0; i < n; i += 2) {
+    std::string path = std::string(dir) + "/f" + std::to_string(i);
+    ASSERT_EQ(0, ceph_unlink(ca, path.c_str()));
+    struct ceph_statx stx;
+    ASSERT_EQ(-ENOENT, ceph_statx(ca, path.c_str(), &stx, CEPH_STATX_INO, 0));
+  }
+  std::string again = std::string(dir) + "/f0";
+  int fd = ceph_open(ca, again.c_str(), O_CREAT|O_EXCL|O_RDWR, 0644);
+  ASSERT_LE(0, fd);
+  struct ceph_statx stx;
+  ASSERT_EQ(0, ceph_fstatx(ca, fd, &stx, CEPH_STATX_INO, 0));
+  ASSERT_NE(inos[0], stx.stx_ino);
+  inos[0] = stx.stx_ino;
+  ASSERT_EQ(0, ceph_close(ca, fd));
+  ASSERT_EQ(0, fsync_dir(ca, dir));
+
+  // the other client sees the same names, with the inos we were told
+  for (int i = 0; i < n; i++) {
+    std::string path = std::string(dir) + "/f" + std::to_string(i);
+    int r = ceph_statx(cb, path.c_str(), &stx, CEPH_STATX_INO|CEPH_STATX_SIZE,
+		       0);
+    if (i > 0 && i % 2 == 0) {
+      ASSERT_EQ(-ENOENT, r);
+    } else {
+      ASSERT_EQ(0, r);
+      ASSERT_EQ(inos[i], stx.stx_ino);
+      ASSERT_EQ(i == 0 ? 0u : 4u, stx.stx_size);
+    }
+  }
+
+  int entries = 0;
+  struct ceph_dir_result *dirp;
+  ASSERT_EQ(0, ceph_opendir(cb, dir, &dirp));
+  struct dirent *de;
+  while ((de = ceph_readdir(cb, dirp)) != NULL) {
+    if (strcmp(de->d_name, ".") && strcmp(de->d_name, ".."))
+      entries++;
+  }
+  ASSERT_EQ(0, ceph_closedir(cb, dirp));
+  ASSERT_EQ(1 + n / 2 + 1, entries);  // seed, the odd ones and f0
+
+  ceph_shutdown(ca);
+  ceph_shutdown(cb);
+}
+
+TEST(LibCephFS, AsyncCreateError) {
+  struct ceph_mount_info *cmount;
+  mount_async(&cmount);
+
+  char dir[64];
+  snprintf(dir, sizeof(dir), "async_create_error.%d", getpid());
+  prepare_dir(cmount, dir);
+
+  // the dir is full as far as the mds is concerned: creates get ENOSPC
+  ASSERT_EQ(0, mds_command(cmount, "0",
+    "{\"prefix\": \"injectargs\", "
+    "\"injected_args\": [\"--mds_bal_fragment_size_max=1\"]}"));
+
+  std::string path = std::string(dir) + "/f";
+  int open_r = ceph_open(cmount, path.c_str(), O_CREAT|O_EXCL|O_RDWR, 0644);
+  int fsync_r = 0, close_r = 0;
+  if (open_r >= 0) {
+    fsync_r = ceph_fsync(cmount, open_r, 0);
+    close_r = ceph_close(cmount, open_r);
+  }
+
+  ASSERT_EQ(0, mds_command(cmount, "0",
+    "{\"prefix\": \"injectargs\", "
+    "\"injected_args\": [\"--mds_bal_fragment_size_max=100000\"]}"));
+
+  if (open_r >= 0) {
+    // we were answered before the mds said no
+    ASSERT_EQ(-ENOSPC, fsync_r);
+    ASSERT_EQ(-ENOSPC, close_r);
+  } else {
+    ASSERT_EQ(-ENOSPC, open_r);
+  }
+
+  // and the name we handed out is gone again
+  struct ceph_statx stx;
+  ASSERT_EQ(-ENOENT, ceph_statx(cmount, path.c_str(), &stx, CEPH_STATX_INO,
+				0));
+
+  ceph_shutdown(cmount);
+}
+
+TEST(LibCephFS, AsyncCreateMDSRestart) {
+  struct ceph_mount_info *cmount;
+  mount_async(&cmount);
+
+  char dir[64];
+  snprintf(dir, sizeof(dir), "async_create_restart.%d", getpid());
+  prepare_dir(cmount, dir);
+
+  // creates both ahead of the restart and racing with it
+  const int n = 64;
+  std::vector<int> fds(n);
+  std::vector<uint64_t> inos(n);
+  for (int i = 0; i < n; i++) {
+    if (i == n / 2)
+      ASSERT_EQ(0, mds_command(cmount, "0", "{\"prefix\": \"respawn\"}"));
+
+    std::string path = std::string(dir) + "/f" + std::to_string(i);
+    fds[i] = ceph_open(cmount, path.c_str(), O_CREAT|O_EXCL|O_RDWR, 0644);
+    ASSERT_LE(0, fds[i]);
+    struct ceph_statx stx;
+    ASSERT_EQ(0, ceph_fstatx(cmount, fds[i], &stx, CEPH_STATX_INO,
+			     AT_NO_ATTR_SYNC));
+    inos[i] = stx.stx_ino;
+  }
+
+  // the mds replays or gets the creates again, and must use our inos
+  for (int i = 0; i < n; i++) {
+    ASSERT_EQ(0, ceph_fsync(cmount, fds[i], 0));
+    ASSERT_EQ(0, ceph_close(cmount, fds[i]));
+  }
+  ASSERT_EQ(0, fsync_dir(cmount, dir));
+
+  struct ceph_mount_info *cb;
+  mount_sync(&cb);
+  for (int i = 0; i < n; i++) {
+    std::string path = std::string(dir) + "/f" + std::to_string(i);
+    struct ceph_statx stx;
+    ASSERT_EQ(0, ceph_statx(cb, path.c_str(), &stx, CEPH_STATX_INO, 0));
+    ASSERT_EQ(inos[i], stx.stx_ino);
+  }
+
+  ceph_shutdown(cb);
+  ceph_shutdown(cmount);
+}
@@ -0,0 +1,123 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include "gtest/gtest.h"
+#include "include/cephfs/libcephfs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+/*
+ * Several threads doing I/O on their own files through a single mount, so
+ * they all contend on the one client.
+ */
+
+static const int num_threads = 8;
+static const int io_size = 1 << 20;
+static const int ios_per_thread = 16;
+
+static void do_io(struct ceph_mount_info *cmount, int id, bool vectored,
+		  std::atomic<int> *failures)
+{
+  char name[64];
+  snprintf(name, sizeof(name), "multithread.%d.%d", getpid(), id);
+  int fd = ceph_open(cmount, name, O_CREAT|O_RDWR, 0644);
+  if (fd < 0) {
+    ++*failures;
+    return;
+  }
+
+  std::vector<char> out(io_size), in(io_size);
+  for (int i = 0; i < ios_per_thread; i++) {
+    memset(out.data(), 'a' + (id + i) % 26, io_size);
+    int64_t off = (int64_t)i * io_size;
+    int r;
+    if (vectored) {
+      struct iovec iov[2];
+      iov[0].iov_base = out.data();
+      iov[0].iov_len = io_size / 2;
+      iov[1].iov_base = out.data() + io_size / 2;
+      iov[1].iov_len = io_size / 2;
+      r = ceph_pwritev(cmount, fd, iov, 2, off);
+    } else {
+      r = ceph_write(cmount, fd, out.data(), io_size, off);
+    }
+    if (r != io_size) {
+      ++*failures;
+      break;
+    }
+    if (vectored) {
+      struct iovec iov[2];
+      iov[0].iov_base = in.data();
+      iov[0].iov_len = io_size / 2;
+      iov[1].iov_base = in.data() + io_size / 2;
+      iov[1].iov_len = io_size / 2;
+      r = ceph_preadv(cmount, fd, iov, 2, off);
+    } else {
+      r = ceph_read(cmount, fd, in.data(), io_size, off);
+    }
+    if (r != io_size || memcmp(out.data(), in.data(), io_size) != 0) {
+      ++*failures;
+      break;
+    }
+  }
+
+  ceph_close(cmount, fd);
+  ceph_unlink(cmount, name);
+}
+
+static void run_threads(bool vectored)
+{
+  struct ceph_mount_info *cmount;
+  ASSERT_EQ(0, ceph_create(&cmount, NULL));
+  ASSERT_EQ(0, ceph_conf_read_file(cmount, NULL));
+  ASSERT_EQ(0, ceph_conf_parse_env(cmount, NULL));
+  ASSERT_EQ(0, ceph_mount(cmount, NULL));
+
+  std::atomic<int> failures(0);
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; i++) {
+    threads.emplace_back(do_io, cmount, i, vectored, &failures);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+  ASSERT_EQ(0, failures.load());
+
+  // written and read back
+  double mb = 2.0 * num_threads * ios_per_thread * io_size / (1 << 20);
+  std::cout << num_threads << " threads moved " << mb << " MB in "
+	    << elapsed.count() << " s (" << mb / elapsed.count() << " MB/s)"
+	    << std::endl;
+
+  ceph_shutdown(cmount);
+}
+
+TEST(LibCephFS, MultithreadReadWrite) {
+  run_threads(false);
+}
+
+TEST(LibCephFS, MultithreadReadvWritev) {
+  run_threads(true);
+}
@@ -1507,6 +1507,54 @@ TEST(LibRadosAio, RoundTripWriteFullPP) {
   delete my_completion3;
 }
 
+TEST(LibRadosAio, OperateBatchPP) {
+  AioTestDataPP test_data;
+  ASSERT_EQ("", test_data.init());
+  const int n = 16;
+  std::vector<ObjectWriteOperation> wops(n);
+  std::vector<std::pair<std::string, ObjectWriteOperation*> > writes;
+  for (int i = 0; i < n; ++i) {
+    bufferlist bl;
+    bl.append(stringify(i));
+    wops[i].write_full(bl);
+    writes.push_back(make_pair("foo" + stringify(i), &wops[i]));
+  }
+  boost::scoped_ptr<AioCompletion> wc(
+    test_data.m_cluster.aio_create_completion(0, 0, 0));
+  std::vector<int> rvals;
+  ASSERT_EQ(0, test_data.m_ioctx.aio_operate_batch(writes, wc.get(),
+						   &rvals));
+  {
+    TestAlarm alarm;
+    ASSERT_EQ(0, wc->wait_for_complete());
+  }
+  ASSERT_EQ(0, wc->get_return_value());
+  ASSERT_EQ(std::vector<int>(n, 0), rvals);
+
+  // one of the objects doesn't exist
+  std::vector<ObjectReadOperation> rops(n + 1);
+  std::vector<bufferlist> bls(n + 1);
+  std::vector<std::pair<std::string, ObjectReadOperation*> > reads;
+  for (int i = 0; i <= n; ++i) {
+    rops[i].read(0, 0, &bls[i], nullptr);
+    reads.push_back(make_pair("foo" + stringify(i), &rops[i]));
+  }
+  boost::scoped_ptr<AioCompletion> rc(
+    test_data.m_cluster.aio_create_completion(0, 0, 0));
+  ASSERT_EQ(0, test_data.m_ioctx.aio_operate_batch(reads, rc.get(),
+						   &rvals));
+  {
+    TestAlarm alarm;
+    ASSERT_EQ(0, rc->wait_for_complete());
+  }
+  ASSERT_EQ(-ENOENT, rc->get_return_value());
+  for (int i = 0; i < n; ++i) {
+    ASSERT_EQ(0, rvals[i]);
+    ASSERT_EQ(stringify(i), bls[i].to_str());
+  }
+  ASSERT_EQ(-ENOENT, rvals[n]);
+}
+
 //using ObjectWriteOperation/ObjectReadOperation with iohint
 TEST(LibRadosAio, RoundTripWriteFullPP2)
 {
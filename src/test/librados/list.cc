@@ -1026,5 +1026,69 @@ TEST_F(LibRadosListPP, EnumerateObjectsFilterPP) {
   ASSERT_TRUE(foundit);
 }
 
+TEST_F(LibRadosListPP, EnumerateObjectsParallelPP) {
+  char buf[128];
+  memset(buf, 0xcc, sizeof(buf));
+  bufferlist bl;
+  bl.append(buf, sizeof(buf));
+
+  const uint32_t n_objects = 32;
+  for (unsigned i=0; i<n_objects; ++i) {
+    ASSERT_EQ(0, ioctx.write("a" + stringify(i), bl, sizeof(buf), 0));
+    ASSERT_EQ(0, ioctx.write("b" + stringify(i), bl, sizeof(buf), 0));
+  }
+  bufferlist val;
+  val.append("yes");
+  ASSERT_EQ(0, ioctx.setxattr("a1", "theattr", val));
+  ASSERT_EQ(0, ioctx.setxattr("b2", "theattr", val));
+
+  ObjectCursor begin = ioctx.object_list_begin();
+  ObjectCursor end = ioctx.object_list_end();
+
+  std::set<std::string> saw_obj;
+  auto collect = [&](std::vector<ObjectItem>& result) {
+    for (const auto& i : result) {
+      if (saw_obj.count(i.oid)) {
+        std::cerr << "duplicate obj " << i.oid << std::endl;
+        return -EEXIST;
+      }
+      saw_obj.insert(i.oid);
+    }
+    return 0;
+  };
+
+  ASSERT_EQ(0, ioctx.object_list_parallel(begin, end, 7, 5, {}, collect));
+  ASSERT_EQ(2 * n_objects, saw_obj.size());
+
+  // only the "a" objects
+  bufferlist filter_bl;
+  ::encode(std::string("prefix"), filter_bl);
+  ::encode(std::string("a"), filter_bl);
+  saw_obj.clear();
+  ASSERT_EQ(0, ioctx.object_list_parallel(begin, end, 4, 5, filter_bl,
+					  collect));
+  ASSERT_EQ(n_objects, saw_obj.size());
+  for (unsigned i=0; i<n_objects; ++i) {
+    ASSERT_TRUE(saw_obj.count("a" + stringify(i)));
+  }
+
+  // only the "a" objects with the xattr
+  filter_bl.clear();
+  ::encode(std::string("prefix"), filter_bl);
+  ::encode(std::string("a"), filter_bl);
+  ::encode(std::string("_theattr"), filter_bl);
+  ::encode(std::string("yes"), filter_bl);
+  saw_obj.clear();
+  ASSERT_EQ(0, ioctx.object_list_parallel(begin, end, 4, 5, filter_bl,
+					  collect));
+  ASSERT_EQ(1u, saw_obj.size());
+  ASSERT_TRUE(saw_obj.count("a1"));
+
+  // the callback can stop the listing
+  ASSERT_EQ(1, ioctx.object_list_parallel(
+	      begin, end, 4, 5, {},
+	      [](std::vector<ObjectItem>& result) { return 1; }));
+}
+
 #pragma GCC diagnostic pop
 #pragma GCC diagnostic warning "-Wpragmas"
@@ -0,0 +1,201 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Measures the bandwidth one client gets from libradosstriper: writes a
+ * striped object with up to --concurrency aio writes in flight, reads it
+ * back the same way, then reads it once more with sequential synchronous
+ * reads, which is where readahead (rados_striper_readahead_max_bytes,
+ * passed like any other ceph option) comes in.
+ */
+
+#include <deque>
+#include <iostream>
+#include <boost/program_options/option.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/parsers.hpp>
+
+#include "common/Clock.h"
+#include "include/rados/librados.hpp"
+#include "include/radosstriper/libradosstriper.hpp"
+
+namespace po = boost::program_options;
+
+static void report(const char *name, uint64_t bytes, utime_t start)
+{
+  double elapsed = ceph_clock_now() - start;
+  std::cout << name << ": " << bytes << " bytes in " << elapsed << " s, "
+	    << bytes / elapsed / 1000000000.0 << " GB/s" << std::endl;
+}
+
+static int wait_one(std::deque<librados::AioCompletion*>& in_flight)
+{
+  librados::AioCompletion *c = in_flight.front();
+  in_flight.pop_front();
+  c->wait_for_complete();
+  int r = c->get_return_value();
+  c->release();
+  return r < 0 ? r : 0;
+}
+
+int main(int argc, char **argv)
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help,h", "produce help message")
+    ("pool", po::value<std::string>()->default_value("rbd"),
+     "pool to use")
+    ("object", po::value<std::string>()->default_value("perf_striper"),
+     "name of the striped object")
+    ("size", po::value<uint64_t>()->default_value(1ull << 30),
+     "bytes to write and read")
+    ("io-size", po::value<uint64_t>()->default_value(4 << 20),
+     "bytes per request")
+    ("concurrency", po::value<unsigned>()->default_value(16),
+     "aio requests in flight")
+    ("stripe-unit", po::value<unsigned>()->default_value(512 << 10),
+     "stripe unit")
+    ("stripe-count", po::value<unsigned>()->default_value(8),
+     "stripe count")
+    ("object-size", po::value<unsigned>()->default_value(4 << 20),
+     "rados object size")
+    ;
+
+  po::variables_map vm;
+  po::parsed_options parsed =
+    po::command_line_parser(argc, argv).options(desc).allow_unregistered().run();
+  po::store(parsed, vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << desc << std::endl;
+    return 1;
+  }
+
+  std::vector<std::string> ceph_option_strings = po::collect_unrecognized(
+    parsed.options, po::include_positional);
+  std::vector<const char*> ceph_options;
+  for (auto& i : ceph_option_strings)
+    ceph_options.push_back(i.c_str());
+
+  librados::Rados cluster;
+  int r = cluster.init(NULL);
+  if (r < 0) {
+    std::cerr << "init failed: " << r << std::endl;
+    return 1;
+  }
+  cluster.conf_read_file(NULL);
+  cluster.conf_parse_env(NULL);
+  cluster.conf_parse_argv(ceph_options.size(), ceph_options.data());
+  r = cluster.connect();
+  if (r < 0) {
+    std::cerr << "connect failed: " << r << std::endl;
+    return 1;
+  }
+  librados::IoCtx ioctx;
+  r = cluster.ioctx_create(vm["pool"].as<std::string>().c_str(), ioctx);
+  if (r < 0) {
+    std::cerr << "cannot open pool: " << r << std::endl;
+    return 1;
+  }
+  libradosstriper::RadosStriper striper;
+  r = libradosstriper::RadosStriper::striper_create(ioctx, &striper);
+  if (r < 0) {
+    std::cerr << "striper_create failed: " << r << std::endl;
+    return 1;
+  }
+  if (striper.set_object_layout_stripe_unit(vm["stripe-unit"].as<unsigned>()) ||
+      striper.set_object_layout_stripe_count(vm["stripe-count"].as<unsigned>()) ||
+      striper.set_object_layout_object_size(vm["object-size"].as<unsigned>())) {
+    std::cerr << "invalid layout" << std::endl;
+    return 1;
+  }
+
+  const std::string soid = vm["object"].as<std::string>();
+  const uint64_t size = vm["size"].as<uint64_t>();
+  const uint64_t io_size = vm["io-size"].as<uint64_t>();
+  const unsigned concurrency = std::max(1u, vm["concurrency"].as<unsigned>());
+
+  bufferlist data;
+  data.append(std::string(io_size, 'x'));
+  striper.remove(soid);
+
+  std::deque<librados::AioCompletion*> in_flight;
+  utime_t start = ceph_clock_now();
+  for (uint64_t off = 0; off < size && r == 0; off += io_size) {
+    if (in_flight.size() >= concurrency)
+      r = wait_one(in_flight);
+    librados::AioCompletion *c = librados::Rados::aio_create_completion();
+    int rr = striper.aio_write(soid, c, data, std::min(io_size, size - off), off);
+    if (rr < 0) {
+      c->release();
+      r = rr;
+      break;
+    }
+    in_flight.push_back(c);
+  }
+  while (!in_flight.empty()) {
+    int rr = wait_one(in_flight);
+    if (r == 0)
+      r = rr;
+  }
+  if (r < 0) {
+    std::cerr << "write failed: " << r << std::endl;
+    return 1;
+  }
+  report("aio write", size, start);
+
+  std::deque<bufferlist> bls;
+  start = ceph_clock_now();
+  for (uint64_t off = 0; off < size && r == 0; off += io_size) {
+    if (in_flight.size() >= concurrency) {
+      r = wait_one(in_flight);
+      bls.pop_front();
+    }
+    librados::AioCompletion *c = librados::Rados::aio_create_completion();
+    bls.emplace_back();
+    int rr = striper.aio_read(soid, c, &bls.back(), io_size, off);
+    if (rr < 0) {
+      c->release();
+      r = rr;
+      break;
+    }
+    in_flight.push_back(c);
+  }
+  while (!in_flight.empty()) {
+    int rr = wait_one(in_flight);
+    if (r == 0)
+      r = rr;
+  }
+  bls.clear();
+  if (r < 0) {
+    std::cerr << "aio read failed: " << r << std::endl;
+    return 1;
+  }
+  report("aio read", size, start);
+
+  start = ceph_clock_now();
+  for (uint64_t off = 0; off < size; off += io_size) {
+    bufferlist bl;
+    r = striper.read(soid, &bl, io_size, off);
+    if (r < 0) {
+      std::cerr << "read failed: " << r << std::endl;
+      return 1;
+    }
+  }
+  report("sequential read", size, start);
+
+  striper.remove(soid);
+  return 0;
+}
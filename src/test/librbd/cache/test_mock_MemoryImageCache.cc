@@ -0,0 +1,250 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "test/librbd/test_mock_fixture.h"
+#include "test/librbd/test_support.h"
+#include "test/librbd/mock/MockImageCtx.h"
+#include "librbd/cache/MemoryImageCache.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace librbd {
+namespace {
+
+struct MockTestImageCtx : public MockImageCtx {
+  MockTestImageCtx(ImageCtx &image_ctx) : MockImageCtx(image_ctx) {
+  }
+};
+
+} // anonymous namespace
+
+namespace cache {
+
+template <>
+struct ImageWriteback<librbd::MockTestImageCtx> {
+  typedef std::vector<std::pair<uint64_t,uint64_t> > Extents;
+
+  static ImageWriteback* s_instance;
+
+  ImageWriteback(librbd::MockTestImageCtx &image_ctx) {
+    s_instance = this;
+  }
+  ~ImageWriteback() {
+    s_instance = nullptr;
+  }
+
+  MOCK_METHOD4(aio_read_mock, void(const Extents &, ceph::bufferlist*, int,
+                                   Context *));
+  void aio_read(Extents&& image_extents, ceph::bufferlist *bl,
+                int fadvise_flags, Context *on_finish) {
+    aio_read_mock(image_extents, bl, fadvise_flags, on_finish);
+  }
+
+  MOCK_METHOD4(aio_write_mock, void(const Extents &, const ceph::bufferlist &,
+                                    int, Context *));
+  void aio_write(Extents&& image_extents, ceph::bufferlist&& bl,
+                 int fadvise_flags, Context *on_finish) {
+    aio_write_mock(image_extents, bl, fadvise_flags, on_finish);
+  }
+
+  MOCK_METHOD4(aio_discard, void(uint64_t, uint64_t, bool, Context *));
+  MOCK_METHOD1(aio_flush, void(Context *));
+  MOCK_METHOD5(aio_writesame_mock, void(uint64_t, uint64_t,
+                                        const ceph::bufferlist &, int,
+                                        Context *));
+  void aio_writesame(uint64_t off, uint64_t len, ceph::bufferlist&& bl,
+                     int fadvise_flags, Context *on_finish) {
+    aio_writesame_mock(off, len, bl, fadvise_flags, on_finish);
+  }
+};
+
+ImageWriteback<librbd::MockTestImageCtx>* ImageWriteback<librbd::MockTestImageCtx>::s_instance = nullptr;
+
+} // namespace cache
+} // namespace librbd
+
+// template definitions
+#include "librbd/cache/MemoryImageCache.cc"
+
+namespace librbd {
+namespace cache {
+
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::WithArg;
+
+class TestMockCacheMemoryImageCache : public TestMockFixture {
+public:
+  typedef MemoryImageCache<librbd::MockTestImageCtx> MockMemoryImageCache;
+  typedef ImageWriteback<librbd::MockTestImageCtx> MockImageWriteback;
+  typedef ImageCache::Extents Extents;
+
+  void init_image_ctx(MockTestImageCtx &mock_image_ctx,
+                      uint64_t target_dirty) {
+    mock_image_ctx.memory_cache_size = 1 << 20;
+    mock_image_ctx.memory_cache_max_dirty = 1 << 20;
+    mock_image_ctx.memory_cache_target_dirty = target_dirty;
+    mock_image_ctx.memory_cache_max_dirty_age = 0;
+    mock_image_ctx.memory_cache_shards = 1;
+    mock_image_ctx.memory_cache_max_writeback = 1;
+    mock_image_ctx.memory_cache_writeback_batch = 1 << 20;
+    expect_op_work_queue(mock_image_ctx);
+  }
+
+  void expect_aio_write(MockTestImageCtx &mock_image_ctx,
+                        MockImageWriteback &mock_image_writeback,
+                        const Extents &image_extents,
+                        const bufferlist &bl, int r) {
+    EXPECT_CALL(mock_image_writeback,
+                aio_write_mock(image_extents, ContentsEqual(bl), _, _))
+      .WillOnce(WithArg<3>(CompleteContext(
+        r, mock_image_ctx.image_ctx->op_work_queue)));
+  }
+
+  void expect_aio_write_held(MockImageWriteback &mock_image_writeback,
+                             const Extents &image_extents,
+                             const bufferlist &bl, Context **ctx,
+                             Context *on_issued) {
+    EXPECT_CALL(mock_image_writeback,
+                aio_write_mock(image_extents, ContentsEqual(bl), _, _))
+      .WillOnce(WithArg<3>(Invoke([ctx, on_issued](Context *on_finish) {
+                  *ctx = on_finish;
+                  on_issued->complete(0);
+                })));
+  }
+
+  void expect_aio_flush(MockTestImageCtx &mock_image_ctx,
+                        MockImageWriteback &mock_image_writeback, int r) {
+    EXPECT_CALL(mock_image_writeback, aio_flush(_))
+      .WillOnce(CompleteContext(r, mock_image_ctx.image_ctx->op_work_queue));
+  }
+
+  int init(MockMemoryImageCache &cache) {
+    C_SaferCond ctx;
+    cache.init(&ctx);
+    return ctx.wait();
+  }
+
+  int write(MockTestImageCtx &mock_image_ctx, MockMemoryImageCache &cache,
+            const Extents &image_extents, const bufferlist &bl) {
+    C_SaferCond ctx;
+    {
+      RWLock::RLocker owner_locker(mock_image_ctx.owner_lock);
+      cache.aio_write(Extents(image_extents), bufferlist(bl), 0, &ctx);
+    }
+    return ctx.wait();
+  }
+
+  int read(MockTestImageCtx &mock_image_ctx, MockMemoryImageCache &cache,
+           const Extents &image_extents, bufferlist *bl) {
+    C_SaferCond ctx;
+    {
+      RWLock::RLocker owner_locker(mock_image_ctx.owner_lock);
+      cache.aio_read(Extents(image_extents), bl, 0, &ctx);
+    }
+    return ctx.wait();
+  }
+
+  int flush(MockTestImageCtx &mock_image_ctx, MockMemoryImageCache &cache) {
+    C_SaferCond ctx;
+    {
+      RWLock::RLocker owner_locker(mock_image_ctx.owner_lock);
+      cache.flush(&ctx);
+    }
+    return ctx.wait();
+  }
+
+  int shut_down(MockTestImageCtx &mock_image_ctx,
+                MockMemoryImageCache &cache) {
+    C_SaferCond ctx;
+    {
+      RWLock::RLocker owner_locker(mock_image_ctx.owner_lock);
+      cache.shut_down(&ctx);
+    }
+    return ctx.wait();
+  }
+
+  bufferlist make_data(char c, size_t len) {
+    bufferlist bl;
+    bl.append(std::string(len, c));
+    return bl;
+  }
+};
+
+TEST_F(TestMockCacheMemoryImageCache, WritebackErrorKeepsDirty) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  init_image_ctx(mock_image_ctx, 1 << 20);
+
+  MockMemoryImageCache cache(mock_image_ctx);
+  MockImageWriteback &mock_image_writeback = *MockImageWriteback::s_instance;
+
+  bufferlist bl = make_data('a', 4096);
+  Context *writeback_ctx = nullptr;
+  C_SaferCond issued_ctx;
+  expect_aio_write_held(mock_image_writeback, {{0, 4096}}, bl,
+                        &writeback_ctx, &issued_ctx);
+
+  ASSERT_EQ(0, init(cache));
+  ASSERT_EQ(0, write(mock_image_ctx, cache, {{0, 4096}}, bl));
+
+  C_SaferCond flush_ctx;
+  {
+    RWLock::RLocker owner_locker(mock_image_ctx.owner_lock);
+    cache.flush(&flush_ctx);
+  }
+  ASSERT_EQ(0, issued_ctx.wait());
+  writeback_ctx->complete(-EIO);
+  ASSERT_EQ(-EIO, flush_ctx.wait());
+
+  // still cached, and still dirty
+  EXPECT_CALL(mock_image_writeback, aio_read_mock(_, _, _, _)).Times(0);
+  bufferlist read_bl;
+  ASSERT_EQ(4096, read(mock_image_ctx, cache, {{0, 4096}}, &read_bl));
+  ASSERT_TRUE(bl.contents_equal(read_bl));
+
+  expect_aio_write(mock_image_ctx, mock_image_writeback, {{0, 4096}}, bl, 0);
+  expect_aio_flush(mock_image_ctx, mock_image_writeback, 0);
+  ASSERT_EQ(0, flush(mock_image_ctx, cache));
+
+  expect_aio_flush(mock_image_ctx, mock_image_writeback, 0);
+  ASSERT_EQ(0, shut_down(mock_image_ctx, cache));
+}
+
+TEST_F(TestMockCacheMemoryImageCache, WritebackErrorReportedOnFlush) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  init_image_ctx(mock_image_ctx, 0);
+
+  MockMemoryImageCache cache(mock_image_ctx);
+  MockImageWriteback &mock_image_writeback = *MockImageWriteback::s_instance;
+
+  // written back in the background, with no flush waiting
+  bufferlist bl = make_data('a', 4096);
+  Context *writeback_ctx = nullptr;
+  C_SaferCond issued_ctx;
+  expect_aio_write_held(mock_image_writeback, {{0, 4096}}, bl,
+                        &writeback_ctx, &issued_ctx);
+
+  ASSERT_EQ(0, init(cache));
+  ASSERT_EQ(0, write(mock_image_ctx, cache, {{0, 4096}}, bl));
+  ASSERT_EQ(0, issued_ctx.wait());
+  writeback_ctx->complete(-EIO);
+
+  // the next flush writes it back again, and gets the error
+  expect_aio_write(mock_image_ctx, mock_image_writeback, {{0, 4096}}, bl, 0);
+  ASSERT_EQ(-EIO, flush(mock_image_ctx, cache));
+
+  expect_aio_flush(mock_image_ctx, mock_image_writeback, 0);
+  ASSERT_EQ(0, flush(mock_image_ctx, cache));
+
+  expect_aio_flush(mock_image_ctx, mock_image_writeback, 0);
+  ASSERT_EQ(0, shut_down(mock_image_ctx, cache));
+}
+
+} // namespace cache
+} // namespace librbd
@@ -0,0 +1,331 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include "test/librbd/test_mock_fixture.h"
+#include "test/librbd/test_support.h"
+#include "test/librbd/mock/MockImageCtx.h"
+#include "include/stringify.h"
+#include "common/safe_io.h"
+#include "librbd/cache/WriteLogImageCache.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+namespace librbd {
+namespace {
+
+struct MockTestImageCtx : public MockImageCtx {
+  MockTestImageCtx(ImageCtx &image_ctx) : MockImageCtx(image_ctx) {
+  }
+};
+
+} // anonymous namespace
+
+namespace cache {
+
+template <>
+struct ImageWriteback<librbd::MockTestImageCtx> {
+  typedef std::vector<std::pair<uint64_t,uint64_t> > Extents;
+
+  static ImageWriteback* s_instance;
+
+  ImageWriteback(librbd::MockTestImageCtx &image_ctx) {
+    s_instance = this;
+  }
+  ~ImageWriteback() {
+    if (s_instance == this) {
+      s_instance = nullptr;
+    }
+  }
+
+  MOCK_METHOD4(aio_read_mock, void(const Extents &, ceph::bufferlist*, int,
+                                   Context *));
+  void aio_read(Extents&& image_extents, ceph::bufferlist *bl,
+                int fadvise_flags, Context *on_finish) {
+    aio_read_mock(image_extents, bl, fadvise_flags, on_finish);
+  }
+
+  MOCK_METHOD4(aio_write_mock, void(const Extents &, const ceph::bufferlist &,
+                                    int, Context *));
+  void aio_write(Extents&& image_extents, ceph::bufferlist&& bl,
+                 int fadvise_flags, Context *on_finish) {
+    aio_write_mock(image_extents, bl, fadvise_flags, on_finish);
+  }
+
+  MOCK_METHOD4(aio_discard, void(uint64_t, uint64_t, bool, Context *));
+  MOCK_METHOD1(aio_flush, void(Context *));
+  MOCK_METHOD5(aio_writesame_mock, void(uint64_t, uint64_t,
+                                        const ceph::bufferlist &, int,
+                                        Context *));
+  void aio_writesame(uint64_t off, uint64_t len, ceph::bufferlist&& bl,
+                     int fadvise_flags, Context *on_finish) {
+    aio_writesame_mock(off, len, bl, fadvise_flags, on_finish);
+  }
+};
+
+ImageWriteback<librbd::MockTestImageCtx>* ImageWriteback<librbd::MockTestImageCtx>::s_instance = nullptr;
+
+} // namespace cache
+} // namespace librbd
+
+// template definitions
+#include "librbd/cache/WriteLogImageCache.cc"
+
+namespace librbd {
+namespace cache {
+
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::WithArg;
+
+class TestMockCacheWriteLogImageCache : public TestMockFixture {
+public:
+  typedef WriteLogImageCache<librbd::MockTestImageCtx> MockWriteLogImageCache;
+  typedef ImageWriteback<librbd::MockTestImageCtx> MockImageWriteback;
+  typedef ImageCache::Extents Extents;
+
+  void SetUp() override {
+    TestMockFixture::SetUp();
+
+    char dir[] = "/tmp/test_librbd_wlog.XXXXXX";
+    ASSERT_TRUE(::mkdtemp(dir) != nullptr);
+    m_dir = dir;
+  }
+
+  void TearDown() override {
+    for (auto &path : m_paths) {
+      ::unlink(path.c_str());
+    }
+    ::rmdir(m_dir.c_str());
+
+    TestMockFixture::TearDown();
+  }
+
+  void init_image_ctx(MockTestImageCtx &mock_image_ctx) {
+    mock_image_ctx.persistent_cache_path = m_dir;
+    mock_image_ctx.persistent_cache_size = 1 << 20;
+    mock_image_ctx.persistent_cache_max_writeback = 8;
+    m_paths.insert(m_dir + "/rbd-" +
+                   stringify(mock_image_ctx.md_ctx.get_id()) + "." +
+                   mock_image_ctx.id + ".wlog");
+    expect_op_work_queue(mock_image_ctx);
+  }
+
+  void expect_aio_write(MockTestImageCtx &mock_image_ctx,
+                        MockImageWriteback &mock_image_writeback,
+                        const Extents &image_extents,
+                        const bufferlist &bl, int r) {
+    EXPECT_CALL(mock_image_writeback,
+                aio_write_mock(image_extents, ContentsEqual(bl), _, _))
+      .WillOnce(WithArg<3>(CompleteContext(
+        r, mock_image_ctx.image_ctx->op_work_queue)));
+  }
+
+  void expect_aio_write_held(MockImageWriteback &mock_image_writeback,
+                             const Extents &image_extents,
+                             const bufferlist &bl, Context **ctx,
+                             Context *on_issued) {
+    EXPECT_CALL(mock_image_writeback,
+                aio_write_mock(image_extents, ContentsEqual(bl), _, _))
+      .WillOnce(WithArg<3>(Invoke([ctx, on_issued](Context *on_finish) {
+                  *ctx = on_finish;
+                  on_issued->complete(0);
+                })));
+  }
+
+  void expect_no_aio_write(MockImageWriteback &mock_image_writeback) {
+    EXPECT_CALL(mock_image_writeback, aio_write_mock(_, _, _, _)).Times(0);
+  }
+
+  void expect_aio_flush(MockTestImageCtx &mock_image_ctx,
+                        MockImageWriteback &mock_image_writeback, int r) {
+    EXPECT_CALL(mock_image_writeback, aio_flush(_))
+      .WillOnce(CompleteContext(r, mock_image_ctx.image_ctx->op_work_queue));
+  }
+
+  int init(MockWriteLogImageCache &cache) {
+    C_SaferCond ctx;
+    cache.init(&ctx);
+    return ctx.wait();
+  }
+
+  int write(MockTestImageCtx &mock_image_ctx, MockWriteLogImageCache &cache,
+            const Extents &image_extents, const bufferlist &bl) {
+    C_SaferCond ctx;
+    {
+      RWLock::RLocker owner_locker(mock_image_ctx.owner_lock);
+      cache.aio_write(Extents(image_extents), bufferlist(bl), 0, &ctx);
+    }
+    return ctx.wait();
+  }
+
+  int flush(MockTestImageCtx &mock_image_ctx, MockWriteLogImageCache &cache) {
+    C_SaferCond ctx;
+    {
+      RWLock::RLocker owner_locker(mock_image_ctx.owner_lock);
+      cache.flush(&ctx);
+    }
+    return ctx.wait();
+  }
+
+  int shut_down(MockTestImageCtx &mock_image_ctx,
+                MockWriteLogImageCache &cache) {
+    C_SaferCond ctx;
+    {
+      RWLock::RLocker owner_locker(mock_image_ctx.owner_lock);
+      cache.shut_down(&ctx);
+    }
+    return ctx.wait();
+  }
+
+  bufferlist make_data(char c, size_t len) {
+    bufferlist bl;
+    bl.append(std::string(len, c));
+    return bl;
+  }
+
+  std::string m_dir;
+  std::set<std::string> m_paths;
+};
+
+TEST_F(TestMockCacheWriteLogImageCache, ReplayAfterCleanShutDown) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  init_image_ctx(mock_image_ctx);
+
+  bufferlist bl = make_data('a', 4096);
+  {
+    MockWriteLogImageCache cache(mock_image_ctx);
+    MockImageWriteback &mock_image_writeback =
+      *MockImageWriteback::s_instance;
+    expect_aio_write(mock_image_ctx, mock_image_writeback, {{0, 4096}}, bl, 0);
+    expect_aio_flush(mock_image_ctx, mock_image_writeback, 0);
+
+    ASSERT_EQ(0, init(cache));
+    ASSERT_EQ(0, write(mock_image_ctx, cache, {{0, 4096}}, bl));
+    ASSERT_EQ(0, shut_down(mock_image_ctx, cache));
+  }
+
+  // everything was written back: nothing to replay
+  MockWriteLogImageCache cache(mock_image_ctx);
+  MockImageWriteback &mock_image_writeback = *MockImageWriteback::s_instance;
+  expect_no_aio_write(mock_image_writeback);
+  expect_aio_flush(mock_image_ctx, mock_image_writeback, 0);
+
+  ASSERT_EQ(0, init(cache));
+  ASSERT_EQ(0, shut_down(mock_image_ctx, cache));
+}
+
+TEST_F(TestMockCacheWriteLogImageCache, ReplayAfterCrash) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  init_image_ctx(mock_image_ctx);
+
+  bufferlist bl1 = make_data('a', 4096);
+  bufferlist bl2 = make_data('b', 4096);
+
+  // the first client crashes with both writes logged and neither
+  // written back, while the second was still being logged
+  MockWriteLogImageCache crashed_cache(mock_image_ctx);
+  MockImageWriteback &crashed_image_writeback =
+    *MockImageWriteback::s_instance;
+  Context *writeback_ctx1 = nullptr;
+  Context *writeback_ctx2 = nullptr;
+  C_SaferCond issued_ctx1;
+  C_SaferCond issued_ctx2;
+  expect_aio_write_held(crashed_image_writeback, {{0, 4096}}, bl1,
+                        &writeback_ctx1, &issued_ctx1);
+  expect_aio_write_held(crashed_image_writeback, {{8192, 4096}}, bl2,
+                        &writeback_ctx2, &issued_ctx2);
+
+  ASSERT_EQ(0, init(crashed_cache));
+  ASSERT_EQ(0, write(mock_image_ctx, crashed_cache, {{0, 4096}}, bl1));
+  ASSERT_EQ(0, write(mock_image_ctx, crashed_cache, {{8192, 4096}}, bl2));
+  ASSERT_EQ(0, issued_ctx1.wait());
+  ASSERT_EQ(0, issued_ctx2.wait());
+
+  // tear the second entry: header (24) and one encoded extent (4 + 16)
+  // follow the first entry, which starts at 4096
+  uint64_t entry_length = 24 + 4 + 16 + 4096;
+  int fd = ::open(m_paths.begin()->c_str(), O_WRONLY);
+  ASSERT_LE(0, fd);
+  char garbage = 'x';
+  ASSERT_EQ(0, safe_pwrite(fd, &garbage, 1,
+                           4096 + entry_length + 24 + 4 + 16 + 100));
+  ::close(fd);
+
+  {
+    // only the intact entry is written back again
+    MockWriteLogImageCache cache(mock_image_ctx);
+    MockImageWriteback &mock_image_writeback =
+      *MockImageWriteback::s_instance;
+    expect_aio_write(mock_image_ctx, mock_image_writeback, {{0, 4096}}, bl1,
+                     0);
+    expect_aio_flush(mock_image_ctx, mock_image_writeback, 0);
+
+    ASSERT_EQ(0, init(cache));
+    ASSERT_EQ(0, shut_down(mock_image_ctx, cache));
+  }
+
+  expect_aio_flush(mock_image_ctx, crashed_image_writeback, 0);
+  writeback_ctx1->complete(0);
+  writeback_ctx2->complete(0);
+  ASSERT_EQ(0, shut_down(mock_image_ctx, crashed_cache));
+}
+
+TEST_F(TestMockCacheWriteLogImageCache, WritebackError) {
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  MockTestImageCtx mock_image_ctx(*ictx);
+  init_image_ctx(mock_image_ctx);
+
+  bufferlist bl = make_data('a', 4096);
+  {
+    MockWriteLogImageCache cache(mock_image_ctx);
+    MockImageWriteback &mock_image_writeback =
+      *MockImageWriteback::s_instance;
+    Context *writeback_ctx = nullptr;
+    C_SaferCond issued_ctx;
+    expect_aio_write_held(mock_image_writeback, {{0, 4096}}, bl,
+                          &writeback_ctx, &issued_ctx);
+
+    ASSERT_EQ(0, init(cache));
+    ASSERT_EQ(0, write(mock_image_ctx, cache, {{0, 4096}}, bl));
+    ASSERT_EQ(0, issued_ctx.wait());
+
+    // the flush waiting for it fails, but the write is kept
+    C_SaferCond flush_ctx;
+    {
+      RWLock::RLocker owner_locker(mock_image_ctx.owner_lock);
+      cache.flush(&flush_ctx);
+    }
+    writeback_ctx->complete(-EIO);
+    ASSERT_EQ(-EIO, flush_ctx.wait());
+
+    // and written back again by the next flush
+    expect_aio_write(mock_image_ctx, mock_image_writeback, {{0, 4096}}, bl, 0);
+    expect_aio_flush(mock_image_ctx, mock_image_writeback, 0);
+    ASSERT_EQ(0, flush(mock_image_ctx, cache));
+
+    expect_aio_flush(mock_image_ctx, mock_image_writeback, 0);
+    ASSERT_EQ(0, shut_down(mock_image_ctx, cache));
+  }
+
+  MockWriteLogImageCache cache(mock_image_ctx);
+  MockImageWriteback &mock_image_writeback = *MockImageWriteback::s_instance;
+  expect_no_aio_write(mock_image_writeback);
+  expect_aio_flush(mock_image_ctx, mock_image_writeback, 0);
+
+  ASSERT_EQ(0, init(cache));
+  ASSERT_EQ(0, shut_down(mock_image_ctx, cache));
+}
+
+} // namespace cache
+} // namespace librbd
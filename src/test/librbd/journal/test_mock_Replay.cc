@@ -543,6 +543,65 @@ TEST_F(TestMockJournalReplay, PauseIO) {
   ASSERT_EQ(0, when_shut_down(mock_journal_replay, false));
 }
 
+TEST_F(TestMockJournalReplay, ParallelIO) {
+  REQUIRE_FEATURE(RBD_FEATURE_JOURNALING);
+
+  librbd::ImageCtx *ictx;
+  ASSERT_EQ(0, open_image(m_image_name, &ictx));
+
+  ASSERT_EQ(0, ictx->cct->_conf->set_val(
+    "rbd_journal_replay_max_parallel_writes", "2"));
+  BOOST_SCOPE_EXIT( (ictx) ) {
+    ictx->cct->_conf->set_val("rbd_journal_replay_max_parallel_writes", "0");
+  } BOOST_SCOPE_EXIT_END;
+
+  MockReplayImageCtx mock_image_ctx(*ictx);
+  MockJournalReplay mock_journal_replay(mock_image_ctx);
+  MockIoImageRequest mock_io_image_request;
+  expect_op_work_queue(mock_image_ctx);
+
+  InSequence seq;
+  io::AioCompletion *aio_comp1;
+  io::AioCompletion *aio_comp2;
+  io::AioCompletion *aio_comp3;
+  C_SaferCond on_ready1;
+  C_SaferCond on_ready2;
+  C_SaferCond on_ready3;
+  C_SaferCond on_safe1;
+  C_SaferCond on_safe2;
+  C_SaferCond on_safe3;
+
+  // non-overlapping writes are ready before they are ACKed
+  expect_aio_write(mock_io_image_request, &aio_comp1, 0, 512, "test");
+  when_process(mock_journal_replay,
+               EventEntry{AioWriteEvent(0, 512, to_bl("test"))},
+               &on_ready1, &on_safe1);
+  ASSERT_EQ(0, on_ready1.wait());
+
+  expect_aio_write(mock_io_image_request, &aio_comp2, 1024, 512, "test");
+  when_process(mock_journal_replay,
+               EventEntry{AioWriteEvent(1024, 512, to_bl("test"))},
+               &on_ready2, &on_safe2);
+  ASSERT_EQ(0, on_ready2.wait());
+
+  // overlapping write waits for the first write
+  expect_aio_write(mock_io_image_request, &aio_comp3, 256, 512, "test");
+  when_process(mock_journal_replay,
+               EventEntry{AioWriteEvent(256, 512, to_bl("test"))},
+               &on_ready3, &on_safe3);
+  when_complete(mock_image_ctx, aio_comp1, 0);
+  ASSERT_EQ(0, on_ready3.wait());
+
+  when_complete(mock_image_ctx, aio_comp2, 0);
+  when_complete(mock_image_ctx, aio_comp3, 0);
+
+  expect_aio_flush(mock_image_ctx, mock_io_image_request, 0);
+  ASSERT_EQ(0, when_shut_down(mock_journal_replay, false));
+  ASSERT_EQ(0, on_safe1.wait());
+  ASSERT_EQ(0, on_safe2.wait());
+  ASSERT_EQ(0, on_safe3.wait());
+}
+
 TEST_F(TestMockJournalReplay, Flush) {
   librbd::ImageCtx *ictx;
   ASSERT_EQ(0, open_image(m_image_name, &ictx));
@@ -81,11 +81,22 @@ struct MockImageCtx {
       io_work_queue(new io::MockImageRequestWQ()),
       op_work_queue(new MockContextWQ()),
       readahead_max_bytes(image_ctx.readahead_max_bytes),
+      persistent_cache_path(image_ctx.persistent_cache_path),
+      persistent_cache_size(image_ctx.persistent_cache_size),
+      persistent_cache_max_writeback(image_ctx.persistent_cache_max_writeback),
+      memory_cache_size(image_ctx.memory_cache_size),
+      memory_cache_max_dirty(image_ctx.memory_cache_max_dirty),
+      memory_cache_target_dirty(image_ctx.memory_cache_target_dirty),
+      memory_cache_max_dirty_age(image_ctx.memory_cache_max_dirty_age),
+      memory_cache_shards(image_ctx.memory_cache_shards),
+      memory_cache_max_writeback(image_ctx.memory_cache_max_writeback),
+      memory_cache_writeback_batch(image_ctx.memory_cache_writeback_batch),
       parent(NULL), operations(new MockOperations()),
       state(new MockImageState()),
       image_watcher(NULL), object_map(NULL),
       exclusive_lock(NULL), journal(NULL),
       concurrent_management_ops(image_ctx.concurrent_management_ops),
+      concurrent_management_ops_max(image_ctx.concurrent_management_ops_max),
       blacklist_on_break_lock(image_ctx.blacklist_on_break_lock),
       blacklist_expire_seconds(image_ctx.blacklist_expire_seconds),
       journal_order(image_ctx.journal_order),
@@ -94,10 +105,14 @@ struct MockImageCtx {
       journal_object_flush_interval(image_ctx.journal_object_flush_interval),
       journal_object_flush_bytes(image_ctx.journal_object_flush_bytes),
       journal_object_flush_age(image_ctx.journal_object_flush_age),
+      journal_object_max_in_flight_appends(
+          image_ctx.journal_object_max_in_flight_appends),
       journal_pool(image_ctx.journal_pool),
       journal_max_payload_bytes(image_ctx.journal_max_payload_bytes),
       journal_max_concurrent_object_sets(
           image_ctx.journal_max_concurrent_object_sets),
+      journal_parallel_writes(image_ctx.journal_parallel_writes),
+      journal_max_prefetch_bytes(image_ctx.journal_max_prefetch_bytes),
       mirroring_resync_after_disconnect(
           image_ctx.mirroring_resync_after_disconnect),
       mirroring_replay_delay(image_ctx.mirroring_replay_delay)
@@ -257,6 +272,18 @@ struct MockImageCtx {
   MockReadahead readahead;
   uint64_t readahead_max_bytes;
 
+  std::string persistent_cache_path;
+  uint64_t persistent_cache_size;
+  uint32_t persistent_cache_max_writeback;
+
+  uint64_t memory_cache_size;
+  uint64_t memory_cache_max_dirty;
+  uint64_t memory_cache_target_dirty;
+  double memory_cache_max_dirty_age;
+  uint32_t memory_cache_shards;
+  uint32_t memory_cache_max_writeback;
+  uint64_t memory_cache_writeback_batch;
+
   MockImageCtx *parent;
   MockOperations *operations;
   MockImageState *state;
@@ -267,6 +294,7 @@ struct MockImageCtx {
   MockJournal *journal;
 
   int concurrent_management_ops;
+  int concurrent_management_ops_max;
   bool blacklist_on_break_lock;
   uint32_t blacklist_expire_seconds;
   uint8_t journal_order;
@@ -275,9 +303,12 @@ struct MockImageCtx {
   int journal_object_flush_interval;
   uint64_t journal_object_flush_bytes;
   double journal_object_flush_age;
+  uint32_t journal_object_max_in_flight_appends;
   std::string journal_pool;
   uint32_t journal_max_payload_bytes;
   int journal_max_concurrent_object_sets;
+  bool journal_parallel_writes;
+  uint32_t journal_max_prefetch_bytes;
   bool mirroring_resync_after_disconnect;
   int mirroring_replay_delay;
 };
@@ -89,3 +89,62 @@ TEST_F(TestLibCG, add_image)
   ASSERT_EQ(0, rbd.group_image_list(ioctx, group_name, &images));
   ASSERT_EQ(0U, images.size());
 }
+
+TEST_F(TestLibCG, snap)
+{
+  REQUIRE_FORMAT_V2();
+
+  librados::IoCtx ioctx;
+  ASSERT_EQ(0, _rados.ioctx_create(_pool_name.c_str(), ioctx));
+
+  const char *group_name = "mycg_snap";
+  librbd::RBD rbd;
+  ASSERT_EQ(0, rbd.group_create(ioctx, group_name));
+
+  std::vector<std::string> image_names;
+  for (int i = 0; i < 3; ++i) {
+    std::string image_name = get_temp_image_name();
+    int order = 14;
+    ASSERT_EQ(0, rbd.create2(ioctx, image_name.c_str(), 65535,
+                             RBD_FEATURE_LAYERING | RBD_FEATURE_EXCLUSIVE_LOCK,
+                             &order));
+    ASSERT_EQ(0, rbd.group_image_add(ioctx, group_name, ioctx,
+                                     image_name.c_str()));
+    image_names.push_back(image_name);
+  }
+
+  // the group snapshot has to take the lock away from a writer
+  librbd::Image image;
+  ASSERT_EQ(0, rbd.open(ioctx, image, image_names[0].c_str(), NULL));
+  bufferlist bl;
+  bl.append(std::string(256, '1'));
+  ASSERT_EQ(256, image.write(0, bl.length(), bl));
+
+  ASSERT_EQ(0, rbd.group_snap_create(ioctx, group_name, "snap1"));
+  ASSERT_EQ(-EEXIST, rbd.group_snap_create(ioctx, group_name, "snap1"));
+
+  std::vector<librbd::group_snap_spec_t> snaps;
+  ASSERT_EQ(0, rbd.group_snap_list(ioctx, group_name, &snaps));
+  ASSERT_EQ(1U, snaps.size());
+  ASSERT_EQ("snap1", snaps[0].name);
+  ASSERT_EQ(GROUP_SNAP_STATE_COMPLETE, snaps[0].state);
+
+  std::vector<librbd::snap_info_t> image_snaps;
+  ASSERT_EQ(0, image.snap_list(image_snaps));
+  ASSERT_EQ(1U, image_snaps.size());
+
+  // writes resume once the snapshot exists
+  ASSERT_EQ(256, image.write(256, bl.length(), bl));
+
+  ASSERT_EQ(0, rbd.group_snap_remove(ioctx, group_name, "snap1"));
+  snaps.clear();
+  ASSERT_EQ(0, rbd.group_snap_list(ioctx, group_name, &snaps));
+  ASSERT_EQ(0U, snaps.size());
+
+  image_snaps.clear();
+  ASSERT_EQ(0, image.snap_list(image_snaps));
+  ASSERT_EQ(0U, image_snaps.size());
+  ASSERT_EQ(0, image.close());
+
+  ASSERT_EQ(0, rbd.group_remove(ioctx, group_name));
+}
@@ -163,9 +163,9 @@ TEST_F(TestMockObjectMap, NonDetainedUpdate) {
   Context *finish_update_1;
   expect_update(mock_image_ctx, mock_update_request, CEPH_NOSNAP,
                 0, 1, 1, {}, &finish_update_1);
-  Context *finish_update_2;
+  Context *finish_update_2 = nullptr;
   expect_update(mock_image_ctx, mock_update_request, CEPH_NOSNAP,
-                1, 2, 1, {}, &finish_update_2);
+                1, 3, 1, {}, &finish_update_2);
 
   MockUnlockRequest mock_unlock_request;
   expect_unlock(mock_image_ctx, mock_unlock_request, 0);
@@ -177,19 +177,25 @@ TEST_F(TestMockObjectMap, NonDetainedUpdate) {
 
   C_SaferCond update_ctx1;
   C_SaferCond update_ctx2;
+  C_SaferCond update_ctx3;
   {
     RWLock::RLocker snap_locker(mock_image_ctx.snap_lock);
     RWLock::WLocker object_map_locker(mock_image_ctx.object_map_lock);
     mock_object_map.aio_update(CEPH_NOSNAP, 0, 1, {}, &update_ctx1);
     mock_object_map.aio_update(CEPH_NOSNAP, 1, 1, {}, &update_ctx2);
+    mock_object_map.aio_update(CEPH_NOSNAP, 2, 1, {}, &update_ctx3);
   }
 
-  finish_update_2->complete(0);
-  ASSERT_EQ(0, update_ctx2.wait());
-
+  // updates 2 and 3 wait for update 1 and are then sent as one
+  ASSERT_EQ(nullptr, finish_update_2);
   finish_update_1->complete(0);
   ASSERT_EQ(0, update_ctx1.wait());
 
+  ASSERT_NE(nullptr, finish_update_2);
+  finish_update_2->complete(0);
+  ASSERT_EQ(0, update_ctx2.wait());
+  ASSERT_EQ(0, update_ctx3.wait());
+
   C_SaferCond close_ctx;
   mock_object_map.close(&close_ctx);
   ASSERT_EQ(0, close_ctx.wait());
@@ -218,10 +224,7 @@ TEST_F(TestMockObjectMap, DetainedUpdate) {
                 1, 3, 1, {}, &finish_update_2);
   Context *finish_update_3 = nullptr;
   expect_update(mock_image_ctx, mock_update_request, CEPH_NOSNAP,
-                2, 3, 1, {}, &finish_update_3);
-  Context *finish_update_4 = nullptr;
-  expect_update(mock_image_ctx, mock_update_request, CEPH_NOSNAP,
-                0, 2, 1, {}, &finish_update_4);
+                0, 3, 1, {}, &finish_update_3);
 
   MockUnlockRequest mock_unlock_request;
   expect_unlock(mock_image_ctx, mock_unlock_request, 0);
@@ -252,14 +255,12 @@ TEST_F(TestMockObjectMap, DetainedUpdate) {
   // updates 3 and 4 are blocked on update 2
   ASSERT_NE(nullptr, finish_update_2);
   ASSERT_EQ(nullptr, finish_update_3);
-  ASSERT_EQ(nullptr, finish_update_4);
   finish_update_2->complete(0);
   ASSERT_EQ(0, update_ctx2.wait());
 
+  // updates 3 and 4 are adjacent and sent as one
   ASSERT_NE(nullptr, finish_update_3);
-  ASSERT_NE(nullptr, finish_update_4);
   finish_update_3->complete(0);
-  finish_update_4->complete(0);
   ASSERT_EQ(0, update_ctx3.wait());
   ASSERT_EQ(0, update_ctx4.wait());
 
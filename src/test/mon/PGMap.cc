@@ -114,6 +114,44 @@ TEST(pgmap, calc_stats)
   }
 }
 
+TEST(pgmap, digest)
+{
+  PGMap pg_map;
+  PGMap::Incremental inc;
+  osd_stat_t os;
+  pg_stat_t ps;
+
+  ps.state = PG_STATE_ACTIVE | PG_STATE_DEGRADED;
+  ps.last_epoch_clean = 999;
+  ps.stats.sum.num_objects = 10;
+  inc.pg_stat_updates[pg_t(9,1)] = ps;
+  inc.pg_stat_updates[pg_t(9,2)] = ps;
+  inc.version = 1;
+  inc.update_stat(0, 123, os);
+  pg_map.apply_incremental(g_ceph_context, inc);
+
+  // ps.last_undegraded is unset, so both are stuck degraded
+  PGMapDigest d;
+  pg_map.get_digest(&d, ceph_clock_now());
+  ASSERT_EQ(1u, d.version);
+  ASSERT_EQ(2, d.num_pg);
+  ASSERT_EQ(2, d.num_pg_by_state[ps.state]);
+  ASSERT_EQ(2u, d.pg_pool_sum.size());
+  ASSERT_EQ(20, d.pg_sum.stats.sum.num_objects);
+  ASSERT_EQ(123u, d.get_min_last_epoch_clean());
+  ASSERT_EQ(2, d.num_pg_stuck["stuck degraded"]);
+
+  bufferlist bl;
+  ::encode(d, bl, CEPH_FEATURES_ALL);
+  PGMapDigest e;
+  bufferlist::iterator p = bl.begin();
+  ::decode(e, p);
+  ASSERT_EQ(d.num_pg, e.num_pg);
+  ASSERT_EQ(d.pg_sum.stats.sum.num_objects, e.pg_sum.stats.sum.num_objects);
+  ASSERT_EQ(123u, e.get_min_last_epoch_clean());
+  ASSERT_EQ(d.num_pg_stuck, e.num_pg_stuck);
+}
+
 namespace {
   class CheckTextTable : public TextTable {
   public:
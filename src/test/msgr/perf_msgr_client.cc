@@ -19,10 +19,13 @@
 #include <string>
 #include <unistd.h>
 #include <iostream>
+#include <algorithm>
+#include <sys/resource.h>
 
 using namespace std;
 
 #include "include/atomic.h"
+#include "include/str_list.h"
 #include "common/ceph_argparse.h"
 #include "common/debug.h"
 #include "common/Cycles.h"
@@ -64,48 +67,72 @@ class MessengerClient {
   };
 
   class ClientThread : public Thread {
-    Messenger *msgr;
     int concurrent;
-    ConnectionRef conn;
+    vector<ConnectionRef> conns;
     atomic_t client_inc;
     object_t oid;
     object_locator_t oloc;
     pg_t pgid;
-    int msg_len;
-    bufferlist data;
+    // messages cycle through these payloads, so a list of sizes
+    // interleaves small and large messages on every connection
+    vector<bufferlist> datas;
     int ops;
-    ClientDispatcher dispatcher;
+    ceph_tid_t last_tid;
+    map<ceph_tid_t, uint64_t> sent;  // tid -> rdtsc at send
 
    public:
+    ClientDispatcher dispatcher;
     Mutex lock;
     Cond cond;
     uint64_t inflight;
+    vector<uint64_t> latencies;  // ns from send to reply
 
-    ClientThread(Messenger *m, int c, ConnectionRef con, int len, int ops, int think_time_us):
-        msgr(m), concurrent(c), conn(con), client_inc(0), oid("object-name"), oloc(1, 1), msg_len(len), ops(ops),
-        dispatcher(think_time_us, this), lock("MessengerBenchmark::ClientThread::lock") {
-      m->add_dispatcher_head(&dispatcher);
-      bufferptr ptr(msg_len);
-      memset(ptr.c_str(), 0, msg_len);
-      data.append(ptr);
+    ClientThread(int c, const vector<int> &lens, int ops, int think_time_us):
+        concurrent(c), client_inc(0), oid("object-name"), oloc(1, 1), ops(ops), last_tid(0),
+        dispatcher(think_time_us, this), lock("MessengerBenchmark::ClientThread::lock"),
+        inflight(0) {
+      for (auto len : lens) {
+        bufferptr ptr(len);
+        memset(ptr.c_str(), 0, len);
+        datas.push_back(bufferlist());
+        datas.back().append(ptr);
+      }
+      latencies.reserve(ops);
+    }
+    void add_connection(ConnectionRef con) {
+      conns.push_back(con);
+    }
+    void complete(ceph_tid_t tid, uint64_t now) {
+      Mutex::Locker l(lock);
+      auto p = sent.find(tid);
+      if (p != sent.end()) {
+        latencies.push_back(Cycles::to_nanoseconds(now - p->second));
+        sent.erase(p);
+      }
+      inflight--;
+      cond.Signal();
     }
     void *entry() override {
       lock.Lock();
       for (int i = 0; i < ops; ++i) {
-        if (inflight > uint64_t(concurrent)) {
+        while (inflight >= uint64_t(concurrent)) {
           cond.Wait(lock);
         }
 	hobject_t hobj(oid, oloc.key, CEPH_NOSNAP, pgid.ps(), pgid.pool(),
 		       oloc.nspace);
 	spg_t spgid(pgid);
         MOSDOp *m = new MOSDOp(client_inc.read(), 0, hobj, spgid, 0, 0, 0);
-        m->write(0, msg_len, data);
+        bufferlist &data = datas[i % datas.size()];
+        m->write(0, data.length(), data);
+        m->set_tid(++last_tid);
+        sent[last_tid] = Cycles::rdtsc();
         inflight++;
-        conn->send_message(m);
+        conns[i % conns.size()]->send_message(m);
         //cerr << __func__ << " send m=" << m << std::endl;
       }
+      while (inflight)
+        cond.Wait(lock);
       lock.Unlock();
-      msgr->shutdown();
       return 0;
     }
   };
@@ -121,54 +148,76 @@ class MessengerClient {
       type(t), serveraddr(addr), think_time_us(delay) {
   }
   ~MessengerClient() {
-    for (uint64_t i = 0; i < clients.size(); ++i)
-      delete clients[i];
     for (uint64_t i = 0; i < msgrs.size(); ++i) {
       msgrs[i]->shutdown();
       msgrs[i]->wait();
+      delete msgrs[i];
     }
+    for (uint64_t i = 0; i < clients.size(); ++i)
+      delete clients[i];
   }
-  void ready(int c, int jobs, int ops, int msg_len) {
+  void ready(int c, int jobs, int conns, int ops, const vector<int> &lens) {
     entity_addr_t addr;
     addr.parse(serveraddr.c_str());
     addr.set_nonce(0);
     for (int i = 0; i < jobs; ++i) {
-      Messenger *msgr = Messenger::create(g_ceph_context, type, entity_name_t::CLIENT(0), "client", getpid()+i, 0);
-      msgr->set_default_policy(Messenger::Policy::lossless_client(0, 0));
-      entity_inst_t inst(entity_name_t::OSD(0), addr);
-      ConnectionRef conn = msgr->get_connection(inst);
-      ClientThread *t = new ClientThread(msgr, c, conn, msg_len, ops, think_time_us);
-      msgrs.push_back(msgr);
+      ClientThread *t = new ClientThread(c, lens, ops, think_time_us);
+      // every connection gets its own messenger, since a messenger keeps
+      // a single connection to a peer
+      for (int j = 0; j < conns; ++j) {
+        Messenger *msgr = Messenger::create(g_ceph_context, type, entity_name_t::CLIENT(0), "client",
+                                            getpid() + i * conns + j, 0);
+        msgr->set_default_policy(Messenger::Policy::lossless_client(0, 0));
+        msgr->add_dispatcher_head(&t->dispatcher);
+        msgr->start();
+        entity_inst_t inst(entity_name_t::OSD(0), addr);
+        t->add_connection(msgr->get_connection(inst));
+        msgrs.push_back(msgr);
+      }
       clients.push_back(t);
-      msgr->start();
     }
     usleep(1000*1000);
   }
   void start() {
     for (uint64_t i = 0; i < clients.size(); ++i)
       clients[i]->create("client");
-    for (uint64_t i = 0; i < msgrs.size(); ++i)
-      msgrs[i]->wait();
+    for (uint64_t i = 0; i < clients.size(); ++i)
+      clients[i]->join();
+  }
+  vector<uint64_t> get_latencies() {
+    vector<uint64_t> all;
+    for (auto t : clients)
+      all.insert(all.end(), t->latencies.begin(), t->latencies.end());
+    std::sort(all.begin(), all.end());
+    return all;
   }
 };
 
 void MessengerClient::ClientDispatcher::ms_fast_dispatch(Message *m) {
+  uint64_t now = Cycles::rdtsc();
   usleep(think_time);
+  ceph_tid_t tid = m->get_tid();
   m->put();
-  Mutex::Locker l(thread->lock);
-  thread->inflight--;
-  thread->cond.Signal();
+  thread->complete(tid, now);
 }
 
 
 void usage(const string &name) {
-  cerr << "Usage: " << name << " [server ip:port] [numjobs] [concurrency] [ios] [thinktime us] [msg length]" << std::endl;
+  cerr << "Usage: " << name << " [server ip:port] [numjobs] [concurrency] [ios] [thinktime us] [msg length] [connections]" << std::endl;
   cerr << "       [server ip:port]: connect to the ip:port pair" << std::endl;
   cerr << "       [numjobs]: how much client threads spawned and do benchmark" << std::endl;
   cerr << "       [concurrency]: the max inflight messages(like iodepth in fio)" << std::endl;
   cerr << "       [ios]: how much messages sent for each client" << std::endl;
   cerr << "       [thinktime]: sleep time when do fast dispatching(match client logic)" << std::endl;
-  cerr << "       [msg length]: message data bytes" << std::endl;
+  cerr << "       [msg length]: message data bytes, a comma separated list is sent in turn, e.g. 4096,4194304" << std::endl;
+  cerr << "       [connections]: connections each client spreads its messages over (default 1)" << std::endl;
+  cerr << "       the stack is picked with --ms_type, e.g. async+posix, async+rdma or async+dpdk," << std::endl;
+  cerr << "       the number of workers with --ms_async_op_threads" << std::endl;
+}
+
+static uint64_t timeval_to_us(const struct timeval &tv)
+{
+  return tv.tv_sec * 1000000ull + tv.tv_usec;
 }
 
 int main(int argc, char **argv)
@@ -190,26 +239,65 @@ int main(int argc, char **argv)
   int concurrent = atoi(args[2]);
   int ios = atoi(args[3]);
   int think_time = atoi(args[4]);
-  int len = atoi(args[5]);
+  vector<int> lens;
+  list<string> len_strs;
+  get_str_list(args[5], ",", len_strs);
+  for (auto &l : len_strs)
+    lens.push_back(atoi(l.c_str()));
+  int conns = args.size() > 6 ? atoi(args[6]) : 1;
+  if (lens.empty() || numjobs <= 0 || concurrent <= 0 || conns <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
 
   std::string public_msgr_type = g_ceph_context->_conf->ms_public_type.empty() ? g_ceph_context->_conf->ms_type : g_ceph_context->_conf->ms_public_type;
 
   cerr << " using ms-public-type " << public_msgr_type << std::endl;
   cerr << "       server ip:port " << args[0] << std::endl;
   cerr << "       numjobs " << numjobs << std::endl;
+  cerr << "       connections per job " << conns << std::endl;
   cerr << "       concurrency " << concurrent << std::endl;
   cerr << "       ios " << ios << std::endl;
   cerr << "       thinktime(us) " << think_time << std::endl;
-  cerr << "       message data bytes " << len << std::endl;
+  cerr << "       message data bytes " << args[5] << std::endl;
 
   MessengerClient client(public_msgr_type, args[0], think_time);
 
-  client.ready(concurrent, numjobs, ios, len);
+  client.ready(concurrent, numjobs, conns, ios, lens);
   Cycles::init();
+  struct rusage ru_start, ru_stop;
+  getrusage(RUSAGE_SELF, &ru_start);
   uint64_t start = Cycles::rdtsc();
   client.start();
   uint64_t stop = Cycles::rdtsc();
-  cerr << " Total op " << ios << " run time " << Cycles::to_microseconds(stop - start) << "us." << std::endl;
+  getrusage(RUSAGE_SELF, &ru_stop);
+
+  uint64_t total = uint64_t(ios) * numjobs;
+  uint64_t run_us = Cycles::to_microseconds(stop - start);
+  cerr << " Total op " << total << " run time " << run_us << "us." << std::endl;
+
+  vector<uint64_t> lat = client.get_latencies();
+  if (lat.empty())
+    return 0;
+  uint64_t sum = 0;
+  for (auto l : lat)
+    sum += l;
+  cerr << " ops/s " << (run_us ? total * 1000000 / run_us : 0) << std::endl;
+  cerr << " latency(us) avg " << sum / lat.size() / 1000.0;
+  for (double p : {50.0, 90.0, 99.0, 99.9}) {
+    size_t i = std::min(lat.size() - 1, size_t(lat.size() * p / 100));
+    cerr << " p" << p << " " << lat[i] / 1000.0;
+  }
+  cerr << " max " << lat.back() / 1000.0 << std::endl;
+
+  // cpu and context switches of the whole client, messenger workers
+  // included; count syscalls with `strace -c -f` or `perf trace -s`
+  uint64_t cpu_us = timeval_to_us(ru_stop.ru_utime) - timeval_to_us(ru_start.ru_utime) +
+                    timeval_to_us(ru_stop.ru_stime) - timeval_to_us(ru_start.ru_stime);
+  uint64_t csw = (ru_stop.ru_nvcsw - ru_start.ru_nvcsw) +
+                 (ru_stop.ru_nivcsw - ru_start.ru_nivcsw);
+  cerr << " cpu(us)/msg " << double(cpu_us) / total
+       << " context switches/msg " << double(csw) / total << std::endl;
 
   return 0;
 }
@@ -5,6 +5,7 @@
  * Author: Ramesh Chander, Ramesh.Chander@sandisk.com
  */
 #include <iostream>
+#include <thread>
 #include <boost/scoped_ptr.hpp>
 #include <gtest/gtest.h>
 
@@ -13,6 +14,7 @@
 #include "common/errno.h"
 #include "include/stringify.h"
 #include "include/Context.h"
+#include "common/Clock.h"
 #include "os/bluestore/Allocator.h"
 #include "os/bluestore/BitAllocator.h"
 
@@ -202,7 +204,8 @@ TEST_P(AllocTest, test_alloc_failure)
 
 TEST_P(AllocTest, test_alloc_hint_bmap)
 {
-  if (GetParam() == std::string("stupid")) {
+  if (GetParam() != std::string("bitmap")) {
+    // stupid and the cached_ front ends don't honor hints this way
     return;
   }
   int64_t blocks = BitMapArea::get_level_factor(g_ceph_context, 2) * 4;
@@ -245,11 +248,119 @@ TEST_P(AllocTest, test_alloc_hint_bmap)
   EXPECT_EQ(extents[0].offset, (uint64_t) 0);
 }
 
+TEST_P(AllocTest, test_alloc_fragmentation)
+{
+  int64_t block_size = 4096;
+  int64_t blocks = BitMapZone::get_total_blocks() * 16;
+  init_alloc(blocks * block_size, block_size);
+  alloc->init_add_free(0, blocks * block_size);
+  if (alloc->get_fragmentation(block_size) < 0) {
+    // not supported by this allocator
+    return;
+  }
+  EXPECT_EQ(0.0, alloc->get_fragmentation(block_size));
+
+  // punch out every other block
+  for (int64_t i = 0; i < blocks; i += 2) {
+    alloc->init_rm_free(i * block_size, block_size);
+  }
+  EXPECT_GT(alloc->get_fragmentation(block_size), 0.9);
+
+  // and give it all back
+  for (int64_t i = 0; i < blocks; i += 2) {
+    alloc->release(i * block_size, block_size);
+  }
+  alloc->shutdown();
+}
+
+TEST_P(AllocTest, test_alloc_prefer_contiguous)
+{
+  if (GetParam() != std::string("stupid")) {
+    return;
+  }
+  int64_t block_size = 4096;
+  init_alloc(block_size * 1024, block_size);
+  // a 4-block hole before the hint, a 1-block hole after it.  normally
+  // the piece after the hint wins.
+  alloc->init_add_free(block_size * 8, block_size * 4);
+  alloc->init_add_free(block_size * 64, block_size);
+
+  g_conf->set_val("bluestore_allocator_prefer_contiguous", "4");
+  EXPECT_EQ(0, alloc->reserve(block_size * 8));
+  AllocExtentVector extents;
+  EXPECT_EQ(block_size * 5,
+	    alloc->allocate(block_size * 8, block_size, 0, block_size * 32,
+			    &extents));
+  ASSERT_EQ(2u, extents.size());
+  // the long run is used first
+  EXPECT_EQ((uint64_t)block_size * 8, extents[0].offset);
+  EXPECT_EQ((uint32_t)block_size * 4, extents[0].length);
+  g_conf->set_val("bluestore_allocator_prefer_contiguous", "0");
+  alloc->unreserve(block_size * 3);
+  alloc->shutdown();
+}
+
+TEST_P(AllocTest, test_alloc_bench_mt)
+{
+  int64_t block_size = 4096;
+  int64_t size = 1ll << 30;
+  int nthreads = 8;
+  int ops = 20000;
+
+  init_alloc(size, block_size);
+  alloc->init_add_free(0, size);
+
+  std::atomic<uint64_t> allocs_total = {0}, extents_total = {0};
+  auto worker = [&](int id) {
+    std::vector<AllocExtentVector> held;
+    unsigned seed = id;
+    for (int i = 0; i < ops; ++i) {
+      if (held.size() > 32 || (!held.empty() && rand_r(&seed) % 3 == 0)) {
+	// free a random earlier allocation to mix up the free space
+	unsigned n = rand_r(&seed) % held.size();
+	for (auto& e : held[n]) {
+	  alloc->release(e.offset, e.length);
+	}
+	held.erase(held.begin() + n);
+	continue;
+      }
+      uint64_t want = block_size * (1 + rand_r(&seed) % 16);
+      ASSERT_EQ(0, alloc->reserve(want));
+      AllocExtentVector extents;
+      ASSERT_EQ((int64_t)want,
+		alloc->allocate(want, block_size, 0, 0, &extents));
+      ++allocs_total;
+      extents_total += extents.size();
+      held.push_back(extents);
+    }
+    for (auto& ev : held) {
+      for (auto& e : ev) {
+	alloc->release(e.offset, e.length);
+      }
+    }
+  };
+
+  utime_t start = ceph_clock_now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < nthreads; ++i) {
+    threads.emplace_back(worker, i);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  utime_t dur = ceph_clock_now() - start;
+  std::cout << GetParam() << ": " << nthreads << " threads x " << ops
+	    << " ops in " << dur << " s, "
+	    << (double)extents_total / allocs_total
+	    << " extents per allocation" << std::endl;
+  EXPECT_EQ((uint64_t)size, alloc->get_free());
+  alloc->shutdown();
+}
 
 INSTANTIATE_TEST_CASE_P(
   Allocator,
   AllocTest,
-  ::testing::Values("stupid", "bitmap"));
+  ::testing::Values("stupid", "bitmap", "cached_stupid", "cached_bitmap"));
 
 #else
 
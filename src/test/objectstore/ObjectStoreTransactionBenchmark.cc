@@ -126,6 +126,10 @@ class Transaction {
     iterate_ticks.add(Cycles::rdtsc() - start_time);
   }
 
+  static void reset_stat() {
+    write_ticks = setattr_ticks = omap_setkeys_ticks = omap_rmkeys_ticks = Tick();
+    encode_ticks = decode_ticks = iterate_ticks = Tick();
+  }
   static void dump_stat() {
     cerr << " write op: " << Cycles::to_microseconds(write_ticks.ticks) << "us count: " << write_ticks.count << std::endl;
     cerr << " setattr op: " << Cycles::to_microseconds(setattr_ticks.ticks) << "us count: " << setattr_ticks.count << std::endl;
@@ -223,6 +227,30 @@ class PerfCase {
     }
     return ticks;
   }
+
+  // many small ops over a handful of objects in one transaction, which is
+  // where op and index encoding dominate over the data itself
+  uint64_t rados_write_4k_batch(int times, int objects, int ops_per_object) {
+    uint64_t ticks = 0;
+    uint64_t len = Kib *4;
+    vector<ghobject_t> oids;
+    for (int i = 0; i < objects; i++)
+      oids.push_back(create_object());
+    for (int i = 0; i < times; i++) {
+      Transaction t;
+      uint64_t start_time = Cycles::rdtsc();
+      for (int j = 0; j < ops_per_object; j++) {
+        for (auto& oid : oids) {
+          t.write(cid, oid, j * len, len, data["4k"]);
+          t.setattr(cid, oid, snapset_attr, data[snapset_attr]);
+        }
+      }
+      t.apply_encode_decode();
+      t.apply_iterate();
+      ticks += Cycles::rdtsc() - start_time;
+    }
+    return ticks;
+  }
 };
 const string PerfCase::info_epoch_attr("11.40_epoch");
 const string PerfCase::info_info_attr("11.40_info");
@@ -264,5 +292,11 @@ int main(int argc, char **argv)
   Transaction::dump_stat();
   cerr << " Total rados op " << times << " run time " << Cycles::to_microseconds(ticks) << "us." << std::endl;
 
+  Transaction::reset_stat();
+  ticks = c.rados_write_4k_batch(times, 16, 8);
+  cerr << "batched:" << std::endl;
+  Transaction::dump_stat();
+  cerr << " Total batched rados op " << times << " run time " << Cycles::to_microseconds(ticks) << "us." << std::endl;
+
   return 0;
 }
@@ -1487,6 +1487,113 @@ TEST_P(StoreTest, BluestoreStatFSTest) {
   g_ceph_context->_conf->apply_changes(NULL);
 }
 
+TEST_P(StoreTest, BluestorePoolStatFSTest) {
+  if(string(GetParam()) != "bluestore")
+    return;
+  ObjectStore::Sequencer osr("test");
+  int r;
+  coll_t cid1(spg_t(pg_t(0, 1), shard_id_t::NO_SHARD));
+  coll_t cid2(spg_t(pg_t(0, 2), shard_id_t::NO_SHARD));
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid1, 0);
+    t.create_collection(cid2, 0);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  {
+    ObjectStore::Transaction t;
+    bufferlist bl;
+    bl.append("abcde");
+    t.write(cid1, hoid, 0, 5, bl);
+    bl.append("fgh");
+    t.write(cid2, hoid, 0, 8, bl);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+
+    struct store_statfs_t statfs, statfs1, statfs2;
+    ASSERT_EQ(0, store->statfs(&statfs));
+    ASSERT_EQ(0, store->pool_statfs(1, &statfs1));
+    ASSERT_EQ(0, store->pool_statfs(2, &statfs2));
+    ASSERT_EQ(5, statfs1.stored);
+    ASSERT_EQ(8, statfs2.stored);
+    ASSERT_EQ(statfs.stored, statfs1.stored + statfs2.stored);
+    ASSERT_EQ(statfs.allocated, statfs1.allocated + statfs2.allocated);
+  }
+  // survives remount
+  EXPECT_EQ(store->umount(), 0);
+  EXPECT_EQ(store->mount(), 0);
+  {
+    struct store_statfs_t statfs1;
+    ASSERT_EQ(0, store->pool_statfs(1, &statfs1));
+    ASSERT_EQ(5, statfs1.stored);
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid1, hoid);
+    t.remove(cid2, hoid);
+    t.remove_collection(cid1);
+    t.remove_collection(cid2);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+
+    struct store_statfs_t statfs1, statfs2;
+    ASSERT_EQ(0, store->pool_statfs(1, &statfs1));
+    ASSERT_EQ(0, store->pool_statfs(2, &statfs2));
+    ASSERT_EQ(0u, statfs1.stored);
+    ASSERT_EQ(0u, statfs1.allocated);
+    ASSERT_EQ(0u, statfs2.stored);
+    ASSERT_EQ(0u, statfs2.allocated);
+  }
+}
+
+TEST_P(StoreTest, BluestoreAllocSnapshotTest) {
+  if(string(GetParam()) != "bluestore")
+    return;
+  g_conf->set_val("bluestore_alloc_snapshot", "true");
+  g_conf->set_val("bluestore_alloc_snapshot_verify", "true");
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  ObjectStore::Sequencer osr("test");
+  int r;
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    bufferlist bl;
+    bl.append(string(0x30000, 'a'));
+    t.write(cid, hoid, 0, bl.length(), bl);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  struct store_statfs_t before, after;
+  ASSERT_EQ(0, store->statfs(&before));
+  // umount saves the snapshot, mount loads (and verifies) it
+  EXPECT_EQ(store->umount(), 0);
+  EXPECT_EQ(store->mount(), 0);
+  ASSERT_EQ(0, store->statfs(&after));
+  ASSERT_EQ(before.available, after.available);
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // and again, now that the space has been released
+  ASSERT_EQ(0, store->statfs(&before));
+  EXPECT_EQ(store->umount(), 0);
+  EXPECT_EQ(store->mount(), 0);
+  ASSERT_EQ(0, store->statfs(&after));
+  ASSERT_EQ(before.available, after.available);
+
+  g_conf->set_val("bluestore_alloc_snapshot", "false");
+  g_conf->set_val("bluestore_alloc_snapshot_verify", "false");
+  g_ceph_context->_conf->apply_changes(NULL);
+}
+
 TEST_P(StoreTest, BluestoreFragmentedBlobTest) {
   if(string(GetParam()) != "bluestore")
     return;
@@ -4233,6 +4340,74 @@ TEST_P(StoreTest, ZipperPatternSharded) {
   g_ceph_context->_conf->apply_changes(NULL);
 }
 
+TEST_P(StoreTest, ShardedOnodeUnchanged) {
+  if(string(GetParam()) != "bluestore")
+    return;
+  g_conf->set_val("bluestore_min_alloc_size", "4096");
+  g_ceph_context->_conf->apply_changes(NULL);
+  int r = store->umount();
+  ASSERT_EQ(r, 0);
+  r = store->mount(); //to force min_alloc_size update
+  ASSERT_EQ(r, 0);
+
+  ObjectStore::Sequencer osr("test");
+  coll_t cid;
+  ghobject_t a(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    cerr << "Creating collection " << cid << std::endl;
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  bufferlist bl;
+  int len = 4096;
+  bufferptr bp(len);
+  bp.zero();
+  bl.append(bp);
+  // enough separate extents that the extent map gets sharded
+  for (int i=0; i<1000; ++i) {
+    ObjectStore::Transaction t;
+    t.write(cid, a, i*2*len, len, bl, 0);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  const PerfCounters* counters = store->get_perf_counters();
+  {
+    // dirties the onode without changing a byte of it, so it must not
+    // be rewritten
+    uint64_t unchanged = counters->get(l_bluestore_onode_unchanged);
+    ObjectStore::Transaction t;
+    t.touch(cid, a);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(unchanged + 1, counters->get(l_bluestore_onode_unchanged));
+  }
+  {
+    // a real change to the onode is written out
+    uint64_t unchanged = counters->get(l_bluestore_onode_unchanged);
+    ObjectStore::Transaction t;
+    t.setattr(cid, a, "foo", bl);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(unchanged, counters->get(l_bluestore_onode_unchanged));
+    bufferptr got;
+    r = store->getattr(cid, a, "foo", got);
+    ASSERT_EQ(r, 0);
+    ASSERT_EQ(len, (int)got.length());
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, a);
+    t.remove_collection(cid);
+    cerr << "Cleaning" << std::endl;
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  g_conf->set_val("bluestore_min_alloc_size", "0");
+  g_ceph_context->_conf->apply_changes(NULL);
+}
+
 TEST_P(StoreTest, SyntheticMatrixCsumAlgorithm) {
   if (string(GetParam()) != "bluestore")
     return;
@@ -5622,6 +5797,99 @@ TEST_P(StoreTest, Many4KWritesNoCSumTest) {
   g_conf->set_val("bluestore_csum_type", "crc32c");
 }
 
+TEST_P(StoreTest, Many4KWritesWALBatchTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  g_conf->set_val("bluestore_wal_batch", "true");
+  g_conf->set_val("bluestore_wal_batch_max_ops", "16");
+  g_ceph_context->_conf->apply_changes(NULL);
+  store->umount();
+  store->mount();
+
+  store_statfs_t res_stat;
+  unsigned max_object = 4*1024*1024;
+  doMany4KWritesTest(store, 1, 1000, max_object, 4*1024, 0, &res_stat);
+
+  ASSERT_LE(res_stat.stored, max_object);
+  ASSERT_EQ(res_stat.allocated, max_object);
+
+  g_conf->set_val("bluestore_wal_batch", "false");
+  g_conf->set_val("bluestore_wal_batch_max_ops", "512");
+  g_ceph_context->_conf->apply_changes(NULL);
+  store->umount();
+  store->mount();
+}
+
+TEST_P(StoreTest, SequentialReadaheadTest) {
+  if (string(GetParam()) != "bluestore")
+    return;
+  g_conf->set_val("bluestore_readahead", "true");
+  g_conf->set_val("bluestore_readahead_trigger_requests", "2");
+  g_conf->set_val("bluestore_default_buffered_read", "false");
+  g_ceph_context->_conf->apply_changes(NULL);
+  int r = store->umount();
+  ASSERT_EQ(r, 0);
+  r = store->mount();
+  ASSERT_EQ(r, 0);
+
+  ObjectStore::Sequencer osr("test");
+  coll_t cid;
+  ghobject_t hoid(hobject_t(sobject_t("Object 1", CEPH_NOSNAP)));
+  const unsigned obj_size = 4*1024*1024;
+  const unsigned chunk = 64*1024;
+  bufferlist orig;
+  for (unsigned i = 0; i < obj_size / sizeof(i); ++i) {
+    orig.append((const char*)&i, sizeof(i));
+  }
+  {
+    ObjectStore::Transaction t;
+    t.create_collection(cid, 0);
+    t.write(cid, hoid, 0, orig.length(), orig);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  // read it back sequentially, twice, racing an overwrite in between
+  for (unsigned pass = 0; pass < 2; ++pass) {
+    for (unsigned off = 0; off < obj_size; off += chunk) {
+      bufferlist in, exp;
+      r = store->read(cid, hoid, off, chunk, in);
+      ASSERT_EQ((int)chunk, r);
+      exp.substr_of(orig, off, chunk);
+      ASSERT_TRUE(bl_eq(exp, in));
+      if (pass == 1 && off == obj_size / 2) {
+	ObjectStore::Transaction t;
+	bufferlist bl;
+	bl.append(string(chunk * 4, 'x'));
+	t.write(cid, hoid, off + chunk, bl.length(), bl);
+	bufferlist head, tail;
+	head.substr_of(orig, 0, off + chunk);
+	tail.substr_of(orig, off + chunk + bl.length(),
+		       obj_size - off - chunk - bl.length());
+	head.append(bl);
+	head.append(tail);
+	orig.swap(head);
+	r = apply_transaction(store, &osr, std::move(t));
+	ASSERT_EQ(r, 0);
+      }
+    }
+  }
+  {
+    ObjectStore::Transaction t;
+    t.remove(cid, hoid);
+    t.remove_collection(cid);
+    r = apply_transaction(store, &osr, std::move(t));
+    ASSERT_EQ(r, 0);
+  }
+  g_conf->set_val("bluestore_readahead", "false");
+  g_conf->set_val("bluestore_readahead_trigger_requests", "4");
+  g_conf->set_val("bluestore_default_buffered_read", "true");
+  g_ceph_context->_conf->apply_changes(NULL);
+  r = store->umount();
+  ASSERT_EQ(r, 0);
+  r = store->mount();
+  ASSERT_EQ(r, 0);
+}
+
 TEST_P(StoreTest, TooManyBlobsTest) {
   if (string(GetParam()) != "bluestore")
     return;
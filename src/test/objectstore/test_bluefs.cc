@@ -568,6 +568,120 @@ TEST(BlueFS, test_replay) {
   rm_temp_bdev(fn);
 }
 
+TEST(BlueFS, test_read_while_writing) {
+  uint64_t size = 1048576 * 128;
+  string fn = get_temp_bdev(size);
+  BlueFS fs(g_ceph_context);
+  ASSERT_EQ(0, fs.add_block_device(BlueFS::BDEV_DB, fn));
+  fs.add_block_extent(BlueFS::BDEV_DB, 1048576, size - 1048576);
+  uuid_d fsid;
+  ASSERT_EQ(0, fs.mkfs(fsid));
+  ASSERT_EQ(0, fs.mount());
+  ASSERT_EQ(0, fs.mkdir("dir"));
+  create_single_file(fs);
+  bufferlist expected;
+  {
+    BlueFS::FileReader *h;
+    ASSERT_EQ(0, fs.open_for_read("dir.test", "testfile", &h));
+    BlueFS::FileReaderBuffer buf(4096);
+    ASSERT_EQ(ALLOC_SIZE, fs.read(h, &buf, 0, ALLOC_SIZE, &expected, NULL));
+    delete h;
+  }
+  {
+    std::atomic<bool> stop = { false };
+    std::thread reader([&] {
+      while (!stop) {
+	BlueFS::FileReader *h;
+	ASSERT_EQ(0, fs.open_for_read("dir.test", "testfile", &h));
+	BlueFS::FileReaderBuffer buf(4096);
+	bufferlist bl;
+	ASSERT_EQ(ALLOC_SIZE, fs.read(h, &buf, 0, ALLOC_SIZE, &bl, NULL));
+	ASSERT_TRUE(bl.contents_equal(expected));
+	delete h;
+      }
+    });
+    BlueFS::FileWriter *h;
+    ASSERT_EQ(0, fs.open_for_write("dir", "wal", &h, false));
+    for (int i = 0; i < 1000; ++i) {
+      char *buf = gen_buffer(ALLOC_SIZE);
+      h->append(buf, ALLOC_SIZE);
+      delete[] buf;
+      ASSERT_EQ(0, fs.fsync(h));
+    }
+    fs.close_writer(h);
+    stop = true;
+    reader.join();
+  }
+  fs.umount();
+  rm_temp_bdev(fn);
+}
+
+TEST(BlueFS, test_spillover_migrate) {
+  uint64_t size = 1048576 * 64;
+  string fn = get_temp_bdev(size);
+  string slow_fn = get_temp_bdev(size);
+  BlueFS fs(g_ceph_context);
+  ASSERT_EQ(0, fs.add_block_device(BlueFS::BDEV_DB, fn));
+  fs.add_block_extent(BlueFS::BDEV_DB, 1048576, size - 1048576);
+  ASSERT_EQ(0, fs.add_block_device(BlueFS::BDEV_SLOW, slow_fn));
+  fs.add_block_extent(BlueFS::BDEV_SLOW, 1048576, size - 1048576);
+  uuid_d fsid;
+  ASSERT_EQ(0, fs.mkfs(fsid));
+  ASSERT_EQ(0, fs.mount());
+  ASSERT_EQ(0, fs.mkdir("db"));
+
+  // fill up the db device
+  uint64_t chunk = g_conf->bluefs_alloc_size;
+  int n = 0;
+  while (fs.get_free(BlueFS::BDEV_DB) > 4 * chunk) {
+    BlueFS::FileWriter *h;
+    ASSERT_EQ(0, fs.open_for_write("db", "filler." + stringify(n++), &h,
+				   false));
+    char *buf = gen_buffer(chunk);
+    h->append(buf, chunk);
+    delete[] buf;
+    ASSERT_EQ(0, fs.fsync(h));
+    fs.close_writer(h);
+  }
+
+  // this one will not fit
+  uint64_t len = 8 * chunk;
+  char *data = gen_buffer(len);
+  {
+    BlueFS::FileWriter *h;
+    ASSERT_EQ(0, fs.open_for_write("db", "spilled", &h, false));
+    h->append(data, len);
+    ASSERT_EQ(0, fs.fsync(h));
+    fs.close_writer(h);
+  }
+  ASSERT_GE(fs.check_spillover(false, 0), len);
+
+  // make room and move it back
+  for (int i = 0; i < n; ++i) {
+    ASSERT_EQ(0, fs.unlink("db", "filler." + stringify(i)));
+  }
+  fs.sync_metadata();
+  ASSERT_EQ(0u, fs.check_spillover(true, len));
+  {
+    BlueFS::FileReader *h;
+    ASSERT_EQ(0, fs.open_for_read("db", "spilled", &h));
+    BlueFS::FileReaderBuffer buf(4096);
+    bufferlist bl;
+    ASSERT_EQ((int)len, fs.read(h, &buf, 0, len, &bl, NULL));
+    ASSERT_EQ(0, memcmp(data, bl.c_str(), len));
+    delete h;
+  }
+  delete[] data;
+  fs.umount();
+
+  // the new placement survives replay
+  ASSERT_EQ(0, fs.mount());
+  ASSERT_EQ(0u, fs.check_spillover(false, 0));
+  fs.umount();
+  rm_temp_bdev(fn);
+  rm_temp_bdev(slow_fn);
+}
+
 int main(int argc, char **argv) {
   vector<const char*> args;
   argv_to_vec(argc, (const char **)argv, args);
@@ -940,6 +940,53 @@ TEST(Blob, split)
   }
 }
 
+TEST(BufferSpace, did_readahead)
+{
+  BlueStore store(g_ceph_context, "", 4096);
+  BlueStore::Cache *cache = BlueStore::Cache::create(
+    g_ceph_context, "lru", NULL);
+  BlueStore::Collection coll(&store, cache, coll_t());
+  BlueStore::SharedBlob *sb = new BlueStore::SharedBlob(&coll);
+  sb->get();  // hack to avoid dtor from running
+  BlueStore::BufferSpace& bc = sb->bc;
+
+  // a cached buffer that is newer than what is on disk
+  bufferlist cached;
+  cached.append(string(0x1000, 'n'));
+  bc.did_read(cache, 0x1000, cached);
+  uint64_t gen;
+  {
+    std::lock_guard<std::recursive_mutex> l(cache->lock);
+    gen = bc.write_gen;
+  }
+
+  // read-ahead of the surrounding range only fills the holes
+  bufferlist disk;
+  disk.append(string(0x3000, 'o'));
+  ASSERT_TRUE(bc.did_readahead(cache, gen, 0, disk));
+  BlueStore::ready_regions_t res;
+  interval_set<uint32_t> res_intervals;
+  bc.read(cache, 0, 0x3000, res, res_intervals);
+  ASSERT_EQ(0x3000u, res_intervals.size());
+  bufferlist got;
+  for (auto& p : res) {
+    got.claim_append(p.second);
+  }
+  bufferlist expected;
+  expected.append(string(0x1000, 'o'));
+  expected.append(string(0x1000, 'n'));
+  expected.append(string(0x1000, 'o'));
+  ASSERT_TRUE(expected.contents_equal(got));
+
+  // anything written since the read was issued makes it stale
+  bufferlist w;
+  w.append(string(0x1000, 'w'));
+  bc.write(cache, 1, 0x4000, w, 0);
+  ASSERT_FALSE(bc.did_readahead(cache, gen, 0x5000, disk));
+
+  bc.discard(cache, 0, 0x10000);
+}
+
 TEST(Blob, legacy_decode)
 {
   BlueStore store(g_ceph_context, "", 4096);
@@ -1214,6 +1261,79 @@ TEST(ExtentMap, compress_extent_map)
   ASSERT_EQ(6u, em.extent_map.size());
 }
 
+namespace {
+// tallies what would have been written to the kv store
+struct CountingTransaction : public KeyValueDB::TransactionImpl {
+  uint64_t keys = 0;
+  uint64_t bytes = 0;
+  void set(const string& prefix, const string& k,
+	   const bufferlist& bl) override {
+    ++keys;
+    bytes += k.size() + bl.length();
+  }
+  void rmkey(const string& prefix, const string& k) override {}
+  void rmkeys_by_prefix(const string& prefix) override {}
+};
+}
+
+TEST(ExtentMap, encode_bench)
+{
+  BlueStore store(g_ceph_context, "", 4096);
+  BlueStore::LRUCache cache(g_ceph_context);
+  BlueStore::Collection coll(&store, &cache, coll_t());
+  BlueStore::Onode onode(&coll, ghobject_t(), "");
+  BlueStore::ExtentMap& em = onode.extent_map;
+  const uint32_t au = 4096;
+  const unsigned num_blocks = 1024;  // 4 MB object
+  uint64_t next_pba = 0;
+
+  auto write_block = [&](uint32_t off, KeyValueDB::Transaction t) {
+    BlueStore::BlobRef b(new BlueStore::Blob);
+    b->shared_blob = new BlueStore::SharedBlob(&coll);
+    b->dirty_blob().extents.emplace_back(next_pba, au);
+    next_pba += au;
+    BlueStore::extent_map_t old_extents;
+    em.set_lextent(off, 0, au, b, &old_extents);
+    old_extents.clear_and_dispose(BlueStore::ExtentMap::DeleteDisposer());
+    em.dirty_range(t, off, au);
+    em.update(t, false);
+    if (em.needs_reshard()) {
+      em.reshard(nullptr, t);
+      em.update(t, true);
+      em.clear_needs_reshard();
+    }
+  };
+
+  {
+    KeyValueDB::Transaction t(new CountingTransaction);
+    for (unsigned i = 0; i < num_blocks; ++i) {
+      write_block(i * au, t);
+    }
+  }
+  ASSERT_FALSE(onode.onode.extent_map_shards.empty());
+  cout << "initial fill: " << em.extent_map.size() << " extents in "
+       << onode.onode.extent_map_shards.size() << " shards" << std::endl;
+
+  int count = 10000;
+  CountingTransaction *ct = new CountingTransaction;
+  KeyValueDB::Transaction t(ct);
+  ceph::mono_clock::time_point start = ceph::mono_clock::now();
+  for (int i = 0; i < count; ++i) {
+    write_block((rand() % num_blocks) * au, t);
+  }
+  ceph::mono_clock::time_point end = ceph::mono_clock::now();
+  auto dur = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start);
+  cout << "random 4K overwrite: " << dur << ", "
+       << (double)ct->keys / count << " keys and "
+       << (double)ct->bytes / count << " extent map bytes per write"
+       << std::endl;
+  // only the shard holding the overwritten block is rewritten
+  ASSERT_LT((double)ct->keys / count, 2.0);
+  ASSERT_LE((double)ct->bytes / count,
+	    (double)g_conf->bluestore_extent_map_shard_max_size * 2);
+  em.clear();
+}
+
 TEST(GarbageCollector, BasicTest)
 {
   BlueStore::LRUCache cache(g_ceph_context);
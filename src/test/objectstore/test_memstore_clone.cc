@@ -175,6 +175,36 @@ TEST_F(MemStoreClone, CloneRangeHoleEnd)
   ASSERT_EQ(expected, result);
 }
 
+// the data of a read is not changed by a later write
+TEST_F(MemStoreClone, ReadThenOverwrite)
+{
+  ASSERT_TRUE(store);
+
+  const auto obj = make_ghobject("obj1");
+
+  bufferlist bl1, bl2, result1, result2, expected1, expected2;
+  bl1.append("111111111111");
+  bl2.append("2222");
+  expected1.append("111111111111");
+  expected2.append("111222211111");
+
+  ObjectStore::Transaction t;
+  t.write(cid, obj, 0, 12, bl1);
+  ASSERT_EQ(0u, store->apply_transaction(nullptr, std::move(t)));
+  ASSERT_EQ(12, store->read(cid, obj, 0, 12, result1));
+
+  ObjectStore::Transaction t2;
+  t2.write(cid, obj, 3, 4, bl2);
+  t2.truncate(cid, obj, 10);
+  t2.truncate(cid, obj, 12);
+  ASSERT_EQ(0u, store->apply_transaction(nullptr, std::move(t2)));
+  ASSERT_EQ(expected1, result1);
+
+  expected2.zero(10, 2);
+  ASSERT_EQ(12, store->read(cid, obj, 0, 12, result2));
+  ASSERT_EQ(expected2, result2);
+}
+
 int main(int argc, char** argv)
 {
   // default to memstore
@@ -0,0 +1,123 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <thread>
+#include "global/global_init.h"
+#include "common/ceph_argparse.h"
+#include "include/stringify.h"
+#include <gtest/gtest.h>
+
+#include "os/bluestore/BlockDevice.h"
+
+/*
+ * These need an NVMe device bound to SPDK: set CEPH_TEST_NVME_SERIAL to its
+ * serial number.  Its contents are overwritten.
+ */
+
+static string nvme_serial()
+{
+  const char *sn = getenv("CEPH_TEST_NVME_SERIAL");
+  return sn ? sn : "";
+}
+
+// a "spdk:<serial>" file and a symlink to it, the way bluestore sets it up
+static string get_spdk_bdev(const string& serial)
+{
+  string dir = "ceph_test_nvmedevice.tmp." + stringify(getpid());
+  ::mkdir(dir.c_str(), 0755);
+  string target = dir + "/spdk:" + serial;
+  int fd = ::open(target.c_str(), O_CREAT|O_RDWR|O_TRUNC, 0644);
+  assert(fd >= 0);
+  int r = ::write(fd, serial.c_str(), serial.size());
+  assert(r == (int)serial.size());
+  ::close(fd);
+  string link = dir + "/block";
+  ::unlink(link.c_str());
+  r = ::symlink(("spdk:" + serial).c_str(), link.c_str());
+  assert(r == 0);
+  return link;
+}
+
+static void rm_spdk_bdev(const string& link, const string& serial)
+{
+  string dir = link.substr(0, link.rfind('/'));
+  ::unlink(link.c_str());
+  ::unlink((dir + "/spdk:" + serial).c_str());
+  ::rmdir(dir.c_str());
+}
+
+static void aio_cb(void *priv, void *priv2)
+{
+}
+
+TEST(NVMEDevice, PerThreadQueueLargerThanBufferPool) {
+  string serial = nvme_serial();
+  if (serial.empty()) {
+    cout << "CEPH_TEST_NVME_SERIAL not set, skipping" << std::endl;
+    return;
+  }
+  ASSERT_TRUE(g_conf->bdev_nvme_per_thread_qpair);
+  ASSERT_TRUE(g_ceph_context->check_experimental_feature_enabled(
+    "bdev_nvme_per_thread_qpair"));
+
+  string path = get_spdk_bdev(serial);
+  BlockDevice *bdev = BlockDevice::create(g_ceph_context, path, aio_cb, NULL);
+  ASSERT_EQ(0, bdev->open(path));
+
+  // more than a thread's data buffers (2048 x 8k) in one command, with
+  // nothing else in flight to give any back
+  uint64_t len = 32 << 20;
+  ASSERT_LE(len, bdev->get_size());
+  bufferlist bl;
+  bufferptr bp(len);
+  for (uint64_t i = 0; i < len; i++)
+    bp[i] = (char)(i * 7 + (i >> 12));
+  bl.append(bp);
+  bufferlist expected = bl;
+
+  IOContext ioc(g_ceph_context, NULL);
+  ASSERT_EQ(0, bdev->aio_write(0, bl, &ioc, false));
+  bdev->aio_submit(&ioc);
+  ioc.aio_wait();
+  ASSERT_EQ(0, bdev->flush());
+
+  bufferlist out;
+  IOContext rioc(g_ceph_context, NULL);
+  ASSERT_EQ(0, bdev->read(0, len, &out, &rioc, false));
+  ASSERT_TRUE(expected.contents_equal(out));
+
+  // and again from another thread, with a queue of its own
+  std::thread t([&]() {
+    bufferlist tout;
+    IOContext tioc(g_ceph_context, NULL);
+    EXPECT_EQ(0, bdev->read(0, len, &tout, &tioc, false));
+    EXPECT_TRUE(expected.contents_equal(tout));
+  });
+  t.join();
+
+  bdev->close();
+  delete bdev;
+  rm_spdk_bdev(path, serial);
+}
+
+int main(int argc, char **argv) {
+  vector<const char*> args;
+  argv_to_vec(argc, (const char **)argv, args);
+  env_to_vec(args);
+
+  vector<const char *> def_args;
+  def_args.push_back("--debug-bdev=1/20");
+  def_args.push_back("--bdev_nvme_per_thread_qpair=true");
+  def_args.push_back("--enable_experimental_unrecoverable_data_corrupting_features=bdev_nvme_per_thread_qpair");
+
+  auto cct = global_init(&def_args, args, CEPH_ENTITY_TYPE_CLIENT,
+			 CODE_ENVIRONMENT_UTILITY,
+			 0);
+  common_init_finish(g_ceph_context);
+
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -426,3 +426,182 @@ TEST_F(OSDMapTest, PrimaryAffinity) {
     osdmap.set_primary_affinity(1, 0x10000);
   }
 }
+
+TEST_F(OSDMapTest, PGUpmap) {
+  set_up_map();
+
+  pg_t pgid = osdmap.raw_pg_to_pg(pg_t(0, 0));
+  vector<int> up_osds;
+  int up_primary;
+  osdmap.pg_to_raw_up(pgid, &up_osds, &up_primary);
+  ASSERT_EQ(3u, up_osds.size());
+  int spare = -1;
+  for (int i = 0; i < (int)get_num_osds(); ++i) {
+    if (std::find(up_osds.begin(), up_osds.end(), i) == up_osds.end()) {
+      spare = i;
+      break;
+    }
+  }
+  ASSERT_LE(0, spare);
+
+  // pg_upmap_items swaps one osd for another, primary included
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_pg_upmap_items[pgid].push_back(make_pair(up_osds[0], spare));
+    osdmap.apply_incremental(inc);
+    vector<int> new_up;
+    int new_primary;
+    osdmap.pg_to_raw_up(pgid, &new_up, &new_primary);
+    vector<int> expected(up_osds);
+    expected[0] = spare;
+    ASSERT_EQ(expected, new_up);
+    ASSERT_EQ(spare, new_primary);
+  }
+
+  // pg_upmap replaces the whole mapping, and is ignored once one of
+  // its targets is out
+  vector<int32_t> explicit_up;
+  for (int i = get_num_osds() - 1; explicit_up.size() < 3; --i)
+    explicit_up.push_back(i);
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.old_pg_upmap_items.insert(pgid);
+    inc.new_pg_upmap[pgid] = explicit_up;
+    osdmap.apply_incremental(inc);
+    vector<int> new_up;
+    int new_primary;
+    osdmap.pg_to_raw_up(pgid, &new_up, &new_primary);
+    ASSERT_EQ(vector<int>(explicit_up.begin(), explicit_up.end()), new_up);
+    ASSERT_EQ(explicit_up[0], new_primary);
+
+    osdmap.set_weight(explicit_up[0], CEPH_OSD_OUT);
+    osdmap.pg_to_raw_up(pgid, &new_up, &new_primary);
+    ASSERT_NE(vector<int>(explicit_up.begin(), explicit_up.end()), new_up);
+    osdmap.set_weight(explicit_up[0], CEPH_OSD_IN);
+  }
+
+  // entries that do not fit the pool any more are cleaned up
+  {
+    OSDMap::Incremental pending_inc(osdmap.get_epoch() + 1);
+    OSDMap::clean_pg_upmaps(g_ceph_context, osdmap, &pending_inc);
+    ASSERT_TRUE(pending_inc.old_pg_upmap.empty());
+
+    explicit_up.pop_back();
+    pending_inc.new_pg_upmap[pgid] = explicit_up;
+    OSDMap::clean_pg_upmaps(g_ceph_context, osdmap, &pending_inc);
+    ASSERT_FALSE(pending_inc.new_pg_upmap.count(pgid));
+    ASSERT_TRUE(pending_inc.old_pg_upmap.count(pgid));
+  }
+}
+
+TEST_F(OSDMapTest, MappingIncremental) {
+  set_up_map();
+
+  auto check = [this]() {
+    OSDMapMapping full;
+    full.update(osdmap);
+    for (auto& p : osdmap.get_pools()) {
+      for (unsigned ps = 0; ps < p.second.get_pg_num(); ++ps) {
+	pg_t pgid(ps, p.first);
+	vector<int> up, acting, full_up, full_acting;
+	int up_primary, acting_primary, full_up_primary, full_acting_primary;
+	mapping.get(pgid, &up, &up_primary, &acting, &acting_primary);
+	full.get(pgid, &full_up, &full_up_primary, &full_acting,
+		 &full_acting_primary);
+	ASSERT_EQ(full_up, up) << pgid;
+	ASSERT_EQ(full_up_primary, up_primary) << pgid;
+	ASSERT_EQ(full_acting, acting) << pgid;
+	ASSERT_EQ(full_acting_primary, acting_primary) << pgid;
+      }
+    }
+  };
+
+  mapping.update(osdmap);
+  ASSERT_EQ(mapping.get_num_pgs(), mapping.get_num_remapped_pgs());
+  mapping.update(osdmap);
+  ASSERT_EQ(0u, mapping.get_num_remapped_pgs());
+
+  pg_t pgid = osdmap.raw_pg_to_pg(pg_t(0, 0));
+  vector<int> up_osds, acting_osds;
+  osdmap.pg_to_up_acting_osds(pgid, up_osds, acting_osds);
+
+  // an osd going down, and coming back
+  for (int i = 0; i < 2; ++i) {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_state[up_osds[0]] = CEPH_OSD_UP;
+    osdmap.apply_incremental(inc);
+    mapping.update(osdmap);
+    check();
+  }
+
+  // a pg_temp only moves its own pg
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_pg_temp[pgid] = vector<int>(up_osds.rbegin(), up_osds.rend());
+    osdmap.apply_incremental(inc);
+    mapping.update(osdmap);
+    ASSERT_EQ(1u, mapping.get_num_remapped_pgs());
+    check();
+  }
+
+  // and so does a pg_upmap_items entry
+  {
+    int spare = 0;
+    while (std::find(up_osds.begin(), up_osds.end(), spare) != up_osds.end())
+      ++spare;
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_pg_upmap_items[pgid].push_back(make_pair(up_osds[0], spare));
+    osdmap.apply_incremental(inc);
+    mapping.update(osdmap);
+    ASSERT_EQ(1u, mapping.get_num_remapped_pgs());
+    check();
+  }
+
+  // a new weight can move any pg that crush could give that osd
+  {
+    OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+    inc.new_weight[up_osds[1]] = CEPH_OSD_OUT;
+    osdmap.apply_incremental(inc);
+    mapping.update(osdmap);
+    check();
+  }
+}
+
+TEST_F(OSDMapTest, ShareFrom) {
+  set_up_map();
+  pg_t rawpg(0, 0, -1);
+  pg_t pgid = osdmap.raw_pg_to_pg(rawpg);
+  vector<int> up, acting;
+  osdmap.pg_to_up_acting_osds(pgid, up, acting);
+
+  // build the next epoch on top of osdmap, as the OSD does
+  OSDMap next;
+  next.share_from(osdmap);
+  OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+  inc.fsid = osdmap.get_fsid();
+  vector<int> temp(acting.rbegin(), acting.rend());
+  inc.new_pg_temp[pgid] = temp;
+  inc.new_up_client[0] = entity_addr_t();
+  inc.new_uuid[1] = uuid_d();
+  next.apply_incremental(inc);
+
+  // the old epoch is untouched
+  vector<int> old_up, old_acting, new_up, new_acting;
+  osdmap.pg_to_up_acting_osds(pgid, old_up, old_acting);
+  next.pg_to_up_acting_osds(pgid, new_up, new_acting);
+  ASSERT_EQ(acting, old_acting);
+  ASSERT_EQ(temp, new_acting);
+  ASSERT_EQ(0u, osdmap.get_num_pg_temp());
+  ASSERT_NE(uuid_d(), osdmap.get_uuid(1));
+
+  // and the result is the same as decoding the old epoch and applying
+  bufferlist bl;
+  osdmap.encode(bl, CEPH_FEATURES_SUPPORTED_DEFAULT | CEPH_FEATURE_RESERVED);
+  OSDMap decoded;
+  decoded.decode(bl);
+  decoded.apply_incremental(inc);
+  bufferlist a, b;
+  next.encode(a, CEPH_FEATURES_SUPPORTED_DEFAULT | CEPH_FEATURE_RESERVED);
+  decoded.encode(b, CEPH_FEATURES_SUPPORTED_DEFAULT | CEPH_FEATURE_RESERVED);
+  ASSERT_TRUE(a.contents_equal(b));
+}
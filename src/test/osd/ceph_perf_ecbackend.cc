@@ -0,0 +1,520 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Drives the write and read planning of ECBackend without a cluster:
+ * ECTransaction::get_write_plan, the ExtentCache, whole-stripe reads
+ * decoded with ECUtil and ECTransaction::generate_transactions, with
+ * the shard transactions applied to one MemStore.  Set
+ * CEPH_BUFFER_TRACK=true in the environment to count allocations.
+ */
+
+#include <random>
+#include <boost/scoped_ptr.hpp>
+#include <boost/program_options/option.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/parsers.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include "global/global_context.h"
+#include "global/global_init.h"
+#include "common/ceph_argparse.h"
+#include "common/config.h"
+#include "common/Clock.h"
+#include "common/errno.h"
+#include "include/stringify.h"
+#include "include/utime.h"
+#include "erasure-code/ErasureCodePlugin.h"
+#include "os/ObjectStore.h"
+#include "osd/ECTransaction.h"
+#include "osd/ECUtil.h"
+#include "osd/ExtentCache.h"
+
+#define dout_context g_ceph_context
+#define dout_subsys ceph_subsys_osd
+
+namespace po = boost::program_options;
+
+class ECBackendBench : public DoutPrefixProvider {
+  string plugin;
+  ErasureCodeProfile profile;
+  ErasureCodeInterfaceRef ec_impl;
+  boost::scoped_ptr<ECUtil::stripe_info_t> sinfo;
+
+  unsigned stripe_width;
+  uint64_t write_size;
+  uint64_t object_size;
+  double overwrite_ratio;
+  double read_ratio;
+  unsigned num_objects;
+  int max_iterations;
+  uint64_t cache_bytes;
+  string data_dir;
+
+  std::mt19937_64 rng;
+
+  pg_t pgid;
+  boost::scoped_ptr<ObjectStore> store;
+  ObjectStore::Sequencer osr;
+  vector<coll_t> colls;
+
+  ExtentCache cache;
+  map<hobject_t, ECUtil::HashInfoRef> hash_infos;
+  map<hobject_t, ObjectContextRef> obcs;
+  version_t version;
+
+  // counted over the timed run
+  uint64_t writes, reads;
+  uint64_t logical_written, shard_written, rmw_read;
+  uint64_t logical_read, shard_read;
+
+  boost::intrusive_ptr<CephContext> cct;
+
+public:
+  ECBackendBench()
+    : osr("ec_bench"), version(0),
+      writes(0), reads(0),
+      logical_written(0), shard_written(0), rmw_read(0),
+      logical_read(0), shard_read(0) {}
+
+  string gen_prefix() const override { return "ec_bench "; }
+  CephContext *get_cct() const override { return g_ceph_context; }
+  unsigned get_subsys() const override { return ceph_subsys_osd; }
+
+  int setup(int argc, char** argv);
+  int run();
+  void teardown();
+
+private:
+  hobject_t get_oid(unsigned i) const {
+    return hobject_t(object_t("obj_" + stringify(i)), "", CEPH_NOSNAP,
+		     i, pgid.pool(), "");
+  }
+  ECUtil::HashInfoRef get_hinfo(const hobject_t &oid);
+  int read_stripes(const hobject_t &oid, uint64_t off, uint64_t len,
+		   bufferlist *out, uint64_t *shard_bytes);
+  int do_write(const hobject_t &oid);
+  int do_read(const hobject_t &oid);
+};
+
+int ECBackendBench::setup(int argc, char** argv) {
+
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help,h", "produce help message")
+    ("iterations,i", po::value<int>()->default_value(10000),
+     "number of operations")
+    ("plugin,p", po::value<string>()->default_value("jerasure"),
+     "erasure code plugin name")
+    ("parameter,P", po::value<vector<string> >(),
+     "add a parameter to the erasure code profile")
+    ("stripe-width", po::value<unsigned>()->default_value(4096),
+     "stripe width, rounded to what the plugin can encode")
+    ("write-size,s", po::value<uint64_t>()->default_value(4096),
+     "bytes per write, and per read")
+    ("object-size", po::value<uint64_t>()->default_value(4 << 20),
+     "objects are appended to until they reach this size")
+    ("overwrite-ratio", po::value<double>()->default_value(0.5),
+     "fraction of writes to existing objects that overwrite, not append")
+    ("read-ratio", po::value<double>()->default_value(0),
+     "fraction of operations that are reads")
+    ("objects", po::value<unsigned>()->default_value(16),
+     "number of objects")
+    ("cache-bytes", po::value<uint64_t>()->default_value(0),
+     "stripes the extent cache keeps after a write completes")
+    ("data-dir", po::value<string>()->default_value("ec_bench_data"),
+     "directory of the MemStore, created and removed by the benchmark")
+    ("seed", po::value<uint64_t>()->default_value(0),
+     "random seed")
+    ;
+
+  po::variables_map vm;
+  po::parsed_options parsed =
+    po::command_line_parser(argc, argv).options(desc).allow_unregistered().run();
+  po::store(
+    parsed,
+    vm);
+  po::notify(vm);
+
+  vector<const char *> ceph_options, def_args;
+  vector<string> ceph_option_strings = po::collect_unrecognized(
+    parsed.options, po::include_positional);
+  ceph_options.reserve(ceph_option_strings.size());
+  for (vector<string>::iterator i = ceph_option_strings.begin();
+       i != ceph_option_strings.end();
+       ++i) {
+    ceph_options.push_back(i->c_str());
+  }
+
+  cct = global_init(
+    &def_args, ceph_options, CEPH_ENTITY_TYPE_CLIENT,
+    CODE_ENVIRONMENT_UTILITY,
+    CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+  g_ceph_context->_conf->apply_changes(NULL);
+
+  if (vm.count("help")) {
+    cout << desc << std::endl;
+    return 1;
+  }
+
+  if (vm.count("parameter")) {
+    const vector<string> &p = vm["parameter"].as< vector<string> >();
+    for (vector<string>::const_iterator i = p.begin();
+	 i != p.end();
+	 ++i) {
+      std::vector<std::string> strs;
+      boost::split(strs, *i, boost::is_any_of("="));
+      if (strs.size() != 2) {
+	cerr << "--parameter " << *i << " ignored because it does not contain exactly one =" << endl;
+      } else {
+	profile[strs[0]] = strs[1];
+      }
+    }
+  }
+
+  max_iterations = vm["iterations"].as<int>();
+  plugin = vm["plugin"].as<string>();
+  stripe_width = vm["stripe-width"].as<unsigned>();
+  write_size = vm["write-size"].as<uint64_t>();
+  object_size = vm["object-size"].as<uint64_t>();
+  overwrite_ratio = vm["overwrite-ratio"].as<double>();
+  read_ratio = vm["read-ratio"].as<double>();
+  num_objects = vm["objects"].as<unsigned>();
+  cache_bytes = vm["cache-bytes"].as<uint64_t>();
+  data_dir = vm["data-dir"].as<string>();
+  rng.seed(vm["seed"].as<uint64_t>());
+
+  if (write_size == 0 || num_objects == 0 || object_size < write_size) {
+    cerr << "write-size and objects must be > 0, and object-size must be"
+	 << " at least write-size" << endl;
+    return -EINVAL;
+  }
+
+  ErasureCodePluginRegistry &instance = ErasureCodePluginRegistry::instance();
+  instance.disable_dlclose = true;
+  stringstream messages;
+  int r = instance.factory(plugin,
+			   g_conf->erasure_code_dir,
+			   profile, &ec_impl, &messages);
+  if (r) {
+    cerr << messages.str() << endl;
+    return r;
+  }
+  unsigned k = ec_impl->get_data_chunk_count();
+  stripe_width = k * ec_impl->get_chunk_size(stripe_width);
+  sinfo.reset(new ECUtil::stripe_info_t(k, stripe_width));
+
+  r = ::mkdir(data_dir.c_str(), 0777);
+  if (r < 0) {
+    r = -errno;
+    cerr << "unable to create " << data_dir << ": " << cpp_strerror(r) << endl;
+    return r;
+  }
+  store.reset(ObjectStore::create(g_ceph_context, "memstore", data_dir, ""));
+  if (!store) {
+    cerr << "unable to create a memstore" << endl;
+    return -EINVAL;
+  }
+  r = store->mkfs();
+  if (r == 0)
+    r = store->mount();
+  if (r < 0) {
+    cerr << "unable to mount the memstore: " << cpp_strerror(r) << endl;
+    return r;
+  }
+
+  pgid = pg_t(0, 1);
+  ObjectStore::Transaction t;
+  for (unsigned i = 0; i < ec_impl->get_chunk_count(); ++i) {
+    colls.push_back(coll_t(spg_t(pgid, shard_id_t(i))));
+    t.create_collection(colls.back(), 0);
+  }
+  r = store->apply_transaction(&osr, std::move(t));
+  if (r < 0) {
+    cerr << "unable to create collections: " << cpp_strerror(r) << endl;
+    return r;
+  }
+  return 0;
+}
+
+void ECBackendBench::teardown()
+{
+  if (!store)
+    return;
+  hash_infos.clear();
+  store->umount();
+  store.reset();
+  string cmd = "rm -r " + data_dir;
+  if (::system(cmd.c_str()) != 0)
+    cerr << "failed to remove " << data_dir << endl;
+}
+
+ECUtil::HashInfoRef ECBackendBench::get_hinfo(const hobject_t &oid)
+{
+  ECUtil::HashInfoRef &ref = hash_infos[oid];
+  if (!ref)
+    ref.reset(new ECUtil::HashInfo(ec_impl->get_chunk_count()));
+  return ref;
+}
+
+/// read whole stripes [off, off + len) from the data shards, as
+/// ECBackend does when no shard is missing
+int ECBackendBench::read_stripes(
+  const hobject_t &oid, uint64_t off, uint64_t len,
+  bufferlist *out, uint64_t *shard_bytes)
+{
+  set<int> want, have, need;
+  const vector<int> &mapping = ec_impl->get_chunk_mapping();
+  for (unsigned i = 0; i < ec_impl->get_data_chunk_count(); ++i)
+    want.insert(mapping.size() > i ? mapping[i] : i);
+  for (unsigned i = 0; i < ec_impl->get_chunk_count(); ++i)
+    have.insert(i);
+  int r = ec_impl->minimum_to_decode(want, have, &need);
+  if (r < 0)
+    return r;
+
+  pair<uint64_t, uint64_t> chunk =
+    sinfo->aligned_offset_len_to_chunk(make_pair(off, len));
+  map<int, bufferlist> chunks;
+  for (set<int>::iterator i = need.begin(); i != need.end(); ++i) {
+    r = store->read(
+      colls[*i],
+      ghobject_t(oid, ghobject_t::NO_GEN, shard_id_t(*i)),
+      chunk.first, chunk.second, chunks[*i]);
+    if (r < 0)
+      return r;
+    *shard_bytes += chunks[*i].length();
+  }
+  return ECUtil::decode(*sinfo, ec_impl, chunks, out);
+}
+
+int ECBackendBench::do_write(const hobject_t &oid)
+{
+  ECUtil::HashInfoRef hinfo = get_hinfo(oid);
+  uint64_t size = hinfo->get_total_logical_size(*sinfo);
+  uint64_t off = size;
+  std::uniform_real_distribution<double> coin(0, 1);
+  if (size >= write_size &&
+      (size + write_size > object_size || coin(rng) < overwrite_ratio)) {
+    std::uniform_int_distribution<uint64_t> at(0, size - write_size);
+    off = at(rng);
+  }
+
+  ObjectContextRef &obc = obcs[oid];
+  PGTransactionUPtr t(new PGTransaction);
+  if (!obc) {
+    obc.reset(new ObjectContext);
+    obc->obs.oi.soid = oid;
+    obc->obs.exists = true;
+    t->create(oid);
+  }
+  t->add_obc(obc);
+  bufferlist bl;
+  bl.append_zero(write_size);
+  t->write(oid, off, write_size, bl);
+
+  ECTransaction::WritePlan plan = ECTransaction::get_write_plan(
+    *sinfo,
+    std::move(t),
+    [&](const hobject_t &i) { return get_hinfo(i); },
+    this);
+
+  // reads, as try_state_to_reads() and start_remote_read() do them
+  ExtentCache::write_pin pin;
+  cache.open_write_pin(pin);
+  map<hobject_t, extent_set> pending_read;
+  map<hobject_t, extent_map> read_result;
+  extent_set empty;
+  for (auto &&hpair: plan.will_write) {
+    auto to_read_iter = plan.to_read.find(hpair.first);
+    const extent_set &to_read =
+      to_read_iter == plan.to_read.end() ? empty : to_read_iter->second;
+    extent_set remote_read = cache.reserve_extents_for_rmw(
+      hpair.first, pin, hpair.second, to_read);
+    extent_set pending = to_read;
+    pending.subtract(remote_read);
+    if (!pending.empty())
+      pending_read[hpair.first] = std::move(pending);
+    for (auto &&extent: remote_read) {
+      bufferlist stripes;
+      int r = read_stripes(
+	hpair.first, extent.first, extent.second, &stripes, &rmw_read);
+      if (r < 0)
+	return r;
+      read_result[hpair.first].insert(extent.first, extent.second, stripes);
+    }
+  }
+  for (auto &&hpair: pending_read) {
+    read_result[hpair.first].insert(
+      cache.get_remaining_extents_for_rmw(hpair.first, pin, hpair.second));
+  }
+
+  // commit, as try_reads_to_commit() does it
+  ++version;
+  vector<pg_log_entry_t> entries;
+  entries.push_back(
+    pg_log_entry_t(
+      pg_log_entry_t::MODIFY, oid,
+      eversion_t(1, version), eversion_t(1, version - 1),
+      version, osd_reqid_t(), utime_t(), 0));
+  map<shard_id_t, ObjectStore::Transaction> trans;
+  for (unsigned i = 0; i < ec_impl->get_chunk_count(); ++i)
+    trans[shard_id_t(i)];
+  map<hobject_t, extent_map> written;
+  set<hobject_t> temp_added, temp_removed;
+  ECTransaction::generate_transactions(
+    plan,
+    ec_impl,
+    pgid,
+    false,
+    false,
+    *sinfo,
+    read_result,
+    ECTransaction::delta_read_t(),
+    entries,
+    &written,
+    &trans,
+    &temp_added,
+    &temp_removed,
+    this);
+  for (auto &&hpair: written)
+    cache.present_rmw_update(hpair.first, pin, hpair.second);
+
+  vector<ObjectStore::Transaction> tls;
+  for (auto &&i: trans) {
+    shard_written += i.second.get_data_length();
+    tls.push_back(std::move(i.second));
+  }
+  int r = store->apply_transactions(&osr, tls);
+  if (r < 0)
+    return r;
+  cache.release_write_pin(pin, cache_bytes);
+
+  // the pg log would trim the rollback objects of overwrites later on
+  ObjectStore::Transaction trim;
+  bool trimmed = false;
+  for (unsigned i = 0; i < ec_impl->get_chunk_count(); ++i) {
+    ghobject_t rollback(oid, version, shard_id_t(i));
+    if (store->exists(colls[i], rollback)) {
+      trim.remove(colls[i], rollback);
+      trimmed = true;
+    }
+  }
+  if (trimmed) {
+    r = store->apply_transaction(&osr, std::move(trim));
+    if (r < 0)
+      return r;
+  }
+
+  ++writes;
+  logical_written += write_size;
+  return 0;
+}
+
+int ECBackendBench::do_read(const hobject_t &oid)
+{
+  uint64_t size = get_hinfo(oid)->get_total_logical_size(*sinfo);
+  if (size < write_size)
+    return do_write(oid);
+  std::uniform_int_distribution<uint64_t> at(0, size - write_size);
+  uint64_t off = at(rng);
+  pair<uint64_t, uint64_t> bounds =
+    sinfo->offset_len_to_stripe_bounds(make_pair(off, write_size));
+  bufferlist stripes;
+  int r = read_stripes(oid, bounds.first, bounds.second, &stripes,
+		       &shard_read);
+  if (r < 0)
+    return r;
+  bufferlist out;
+  out.substr_of(stripes, off - bounds.first, write_size);
+  ++reads;
+  logical_read += out.length();
+  return 0;
+}
+
+int ECBackendBench::run()
+{
+  std::uniform_int_distribution<unsigned> pick(0, num_objects - 1);
+  std::uniform_real_distribution<double> coin(0, 1);
+  uint64_t allocs = buffer::get_history_alloc_num();
+  utime_t begin_time = ceph_clock_now();
+  for (int i = 0; i < max_iterations; ++i) {
+    hobject_t oid = get_oid(pick(rng));
+    int r = coin(rng) < read_ratio ? do_read(oid) : do_write(oid);
+    if (r < 0) {
+      cerr << "operation " << i << " on " << oid << " failed: "
+	   << cpp_strerror(r) << endl;
+      return r;
+    }
+  }
+  utime_t elapsed = ceph_clock_now() - begin_time;
+  allocs = buffer::get_history_alloc_num() - allocs;
+
+  uint64_t ops = writes + reads;
+  cout << "stripe_width\t" << stripe_width << std::endl;
+  cout << "ops\t" << ops << "\t(" << writes << " writes, "
+       << reads << " reads)" << std::endl;
+  cout << "seconds\t" << elapsed << std::endl;
+  cout << "ops/s\t" << (elapsed > utime_t() ? ops / (double)elapsed : 0)
+       << std::endl;
+  if (writes) {
+    cout << "shard bytes written per write\t"
+	 << shard_written / writes << "\t("
+	 << (double)shard_written / logical_written << "x)" << std::endl;
+    cout << "shard bytes read per write\t"
+	 << rmw_read / writes << std::endl;
+  }
+  if (reads) {
+    cout << "shard bytes read per read\t"
+	 << shard_read / reads << "\t("
+	 << (double)shard_read / logical_read << "x)" << std::endl;
+  }
+  if (getenv("CEPH_BUFFER_TRACK"))
+    cout << "allocations per op\t" << (ops ? (double)allocs / ops : 0)
+	 << std::endl;
+  else
+    cout << "allocations per op\tset CEPH_BUFFER_TRACK=true to count"
+	 << std::endl;
+  return 0;
+}
+
+int main(int argc, char** argv) {
+  ECBackendBench bench;
+  int r;
+  try {
+    r = bench.setup(argc, argv);
+    if (r == 0)
+      r = bench.run();
+  } catch(po::error &e) {
+    cerr << e.what() << endl;
+    r = 1;
+  }
+  bench.teardown();
+  return r < 0 ? 1 : r;
+}
+
+/*
+ * Local Variables:
+ * compile-command: "cd ../.. ; make -j4 ceph_perf_ecbackend &&
+ *   ./ceph_perf_ecbackend \
+ *      --plugin jerasure \
+ *      --parameter technique=reed_sol_van \
+ *      --parameter k=4 \
+ *      --parameter m=2 \
+ *      --write-size 4096 \
+ *      --overwrite-ratio 0.8
+ * "
+ * End:
+ */
@@ -0,0 +1,219 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Times OSDMapMapping::update on a simple map after the kinds of
+ * changes a cluster goes through between epochs, against recalculating
+ * every pg from scratch, and checks that both agree.
+ */
+
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <boost/program_options/option.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/parsers.hpp>
+
+#include "global/global_context.h"
+#include "global/global_init.h"
+#include "common/ceph_argparse.h"
+#include "common/config.h"
+#include "common/Clock.h"
+#include "osd/OSDMap.h"
+#include "osd/OSDMapMapping.h"
+
+namespace po = boost::program_options;
+
+static void set_up_map(OSDMap *osdmap, int num_osds, int pg_bits)
+{
+  uuid_d fsid;
+  osdmap->build_simple(g_ceph_context, 0, fsid, num_osds, pg_bits, pg_bits);
+  OSDMap::Incremental inc(osdmap->get_epoch() + 1);
+  inc.fsid = osdmap->get_fsid();
+  entity_addr_t sample_addr;
+  uuid_d sample_uuid;
+  for (int i = 0; i < num_osds; ++i) {
+    sample_uuid.generate_random();
+    sample_addr.nonce = i;
+    inc.new_state[i] = CEPH_OSD_EXISTS | CEPH_OSD_NEW;
+    inc.new_up_client[i] = sample_addr;
+    inc.new_up_cluster[i] = sample_addr;
+    inc.new_hb_back_up[i] = sample_addr;
+    inc.new_hb_front_up[i] = sample_addr;
+    inc.new_weight[i] = CEPH_OSD_IN;
+    inc.new_uuid[i] = sample_uuid;
+  }
+  osdmap->apply_incremental(inc);
+}
+
+static bool same_mappings(const OSDMap& osdmap, const OSDMapMapping& a,
+			  const OSDMapMapping& b)
+{
+  for (auto& p : osdmap.get_pools()) {
+    for (unsigned ps = 0; ps < p.second.get_pg_num(); ++ps) {
+      pg_t pgid(ps, p.first);
+      vector<int> a_up, a_acting, b_up, b_acting;
+      int a_up_primary, a_acting_primary, b_up_primary, b_acting_primary;
+      a.get(pgid, &a_up, &a_up_primary, &a_acting, &a_acting_primary);
+      b.get(pgid, &b_up, &b_up_primary, &b_acting, &b_acting_primary);
+      if (a_up != b_up || a_up_primary != b_up_primary ||
+	  a_acting != b_acting || a_acting_primary != b_acting_primary) {
+	cerr << pgid << " is " << a_up << "/" << a_acting << " but should be "
+	     << b_up << "/" << b_acting << std::endl;
+	return false;
+      }
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help,h", "produce help message")
+    ("osds", po::value<int>()->default_value(1000),
+     "number of osds")
+    ("pg-bits", po::value<int>()->default_value(7),
+     "log2 of the pgs per osd in each pool")
+    ("epochs", po::value<int>()->default_value(20),
+     "changes of each kind to time")
+    ("seed", po::value<uint64_t>()->default_value(0),
+     "random seed")
+    ;
+
+  po::variables_map vm;
+  po::parsed_options parsed =
+    po::command_line_parser(argc, argv).options(desc).allow_unregistered().run();
+  po::store(parsed, vm);
+  po::notify(vm);
+
+  vector<const char *> ceph_options, def_args;
+  vector<string> ceph_option_strings = po::collect_unrecognized(
+    parsed.options, po::include_positional);
+  for (auto& i : ceph_option_strings) {
+    ceph_options.push_back(i.c_str());
+  }
+  auto cct = global_init(
+    &def_args, ceph_options, CEPH_ENTITY_TYPE_CLIENT,
+    CODE_ENVIRONMENT_UTILITY,
+    CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+
+  if (vm.count("help")) {
+    cout << desc << std::endl;
+    return 1;
+  }
+
+  const int num_osds = vm["osds"].as<int>();
+  const int epochs = vm["epochs"].as<int>();
+  std::mt19937 rng(vm["seed"].as<uint64_t>());
+  auto random_osd = [&]() {
+    return std::uniform_int_distribution<int>(0, num_osds - 1)(rng);
+  };
+
+  OSDMap osdmap;
+  set_up_map(&osdmap, num_osds, vm["pg-bits"].as<int>());
+
+  OSDMapMapping mapping;
+  utime_t start = ceph_clock_now();
+  mapping.update(osdmap);
+  double full_time = ceph_clock_now() - start;
+  cout << "full: " << mapping.get_num_pgs() << " pgs in " << full_time
+       << " s" << std::endl;
+
+  struct Change {
+    const char *name;
+    std::function<void(OSDMap::Incremental *)> make;
+  };
+  // each change is undone by the next one of the same kind
+  int down_osd = -1, out_osd = -1;
+  vector<pg_t> temp_pgs;
+  Change changes[] = {
+    { "osd down/up",
+      [&](OSDMap::Incremental *inc) {
+	if (down_osd < 0)
+	  down_osd = random_osd();
+	inc->new_state[down_osd] = CEPH_OSD_UP;
+	if (osdmap.is_down(down_osd))
+	  down_osd = -1;
+      } },
+    { "pg_temp",
+      [&](OSDMap::Incremental *inc) {
+	if (temp_pgs.empty()) {
+	  auto& pgs = mapping.get_osd_acting_pgs(random_osd());
+	  temp_pgs.assign(pgs.begin(), pgs.end());
+	  for (auto pgid : temp_pgs) {
+	    vector<int> up, acting;
+	    osdmap.pg_to_up_acting_osds(pgid, up, acting);
+	    std::reverse(acting.begin(), acting.end());
+	    inc->new_pg_temp[pgid] = acting;
+	  }
+	} else {
+	  for (auto pgid : temp_pgs)
+	    inc->new_pg_temp[pgid].clear();
+	  temp_pgs.clear();
+	}
+      } },
+    { "osd out/in",
+      [&](OSDMap::Incremental *inc) {
+	if (out_osd < 0) {
+	  out_osd = random_osd();
+	  inc->new_weight[out_osd] = CEPH_OSD_OUT;
+	} else {
+	  inc->new_weight[out_osd] = CEPH_OSD_IN;
+	  out_osd = -1;
+	}
+      } },
+  };
+
+  for (auto& c : changes) {
+    double incremental_time = 0, all_time = 0;
+    uint64_t remapped = 0;
+    for (int i = 0; i < epochs; ++i) {
+      OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+      inc.fsid = osdmap.get_fsid();
+      c.make(&inc);
+      osdmap.apply_incremental(inc);
+
+      start = ceph_clock_now();
+      mapping.update(osdmap);
+      incremental_time += ceph_clock_now() - start;
+      remapped += mapping.get_num_remapped_pgs();
+
+      OSDMapMapping full;
+      start = ceph_clock_now();
+      full.update(osdmap);
+      all_time += ceph_clock_now() - start;
+      if (!same_mappings(osdmap, mapping, full)) {
+	cerr << c.name << ": incremental mapping is wrong at epoch "
+	     << osdmap.get_epoch() << std::endl;
+	return 1;
+      }
+    }
+    cout << c.name << ": " << remapped / epochs << "/" << mapping.get_num_pgs()
+	 << " pgs remapped in " << incremental_time / epochs
+	 << " s per epoch, vs " << all_time / epochs << " s for all"
+	 << std::endl;
+  }
+  return 0;
+}
+
+/*
+ * Local Variables:
+ * compile-command: "cd ../.. ; make -j4 ceph_perf_osdmapmapping &&
+ *   ./ceph_perf_osdmapmapping --osds 1000 --pg-bits 7
+ * "
+ * End:
+ */
@@ -195,3 +195,81 @@ TEST_F(ExplicitObjectHitSetTest, RejectsNoMatch) {
   }
   EXPECT_EQ(matches, 0);
 }
+
+class DecayingCountHitSetTest : public testing::Test, public HitSetTestStrap {
+public:
+
+  DecayingCountHitSetTest()
+    : HitSetTestStrap(new HitSet(new DecayingCountHitSet(1024, 4, 60, 1))) {}
+
+  DecayingCountHitSet *get_hitset() { return static_cast<DecayingCountHitSet*>(hitset->impl.get()); }
+};
+
+TEST_F(DecayingCountHitSetTest, Construct) {
+  ASSERT_EQ(hitset->impl->get_type(), HitSet::TYPE_DECAYING_COUNT);
+  ASSERT_TRUE(hitset->is_decaying());
+}
+
+TEST_F(DecayingCountHitSetTest, InsertsMatch) {
+  fill(50);
+  verify_fill(50);
+  EXPECT_TRUE(hitset->approx_unique_insert_count() >= 45 &&
+              hitset->approx_unique_insert_count() <= 55);
+  EXPECT_FALSE(hitset->is_full());
+}
+
+TEST_F(DecayingCountHitSetTest, Counts) {
+  hobject_t hot(object_t("hot"), "", 0, 1, 0, "");
+  hobject_t cold(object_t("cold"), "", 0, 2, 0, "");
+  utime_t now = ceph_clock_now();
+  for (int i = 0; i < 10; ++i)
+    get_hitset()->insert_at(hot, now);
+  get_hitset()->insert_at(cold, now);
+  EXPECT_NEAR(10, get_hitset()->hit_count_at(hot, now), .01);
+  EXPECT_NEAR(1, get_hitset()->hit_count_at(cold, now), .01);
+}
+
+TEST_F(DecayingCountHitSetTest, Decays) {
+  hobject_t obj(object_t("obj"), "", 0, 1, 0, "");
+  utime_t now = ceph_clock_now();
+  for (int i = 0; i < 8; ++i)
+    get_hitset()->insert_at(obj, now);
+  utime_t later = now;
+  later += 60;
+  EXPECT_NEAR(4, get_hitset()->hit_count_at(obj, later), .01);
+  later += 120;
+  EXPECT_NEAR(1, get_hitset()->hit_count_at(obj, later), .01);
+
+  // long enough to rescale; old hits are all but gone
+  later += 60 * 20;
+  get_hitset()->insert_at(obj, later);
+  EXPECT_NEAR(1, get_hitset()->hit_count_at(obj, later), .01);
+}
+
+TEST_F(DecayingCountHitSetTest, RejectsNoMatch) {
+  fill(100);
+  verify_fill(100);
+
+  char buf[50];
+  int matches = 0;
+  for (int i = 100; i < 200; ++i) {
+    sprintf(buf, "hitsettest_%d", i);
+    hobject_t obj(object_t(buf), "", 0, i, 0, "");
+    if (hitset->contains(obj))
+      ++matches;
+  }
+  EXPECT_LT(matches, 2);
+}
+
+TEST_F(DecayingCountHitSetTest, Encode) {
+  fill(20);
+  bufferlist bl;
+  ::encode(*hitset, bl);
+  HitSet copy;
+  bufferlist::iterator p = bl.begin();
+  ::decode(copy, p);
+  ASSERT_EQ(HitSet::TYPE_DECAYING_COUNT, copy.impl->get_type());
+  EXPECT_EQ(20u, copy.insert_count());
+  HitSetTestStrap strap(&copy);
+  strap.verify_fill(20);
+}
@@ -0,0 +1,69 @@
+#!/bin/bash
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU Library Public License as published by
+# the Free Software Foundation; either version 2, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Library Public License for more details.
+#
+# Time how long PGS placement groups take to go active+clean again
+# after an OSD is marked down, for each value of THREADS given to
+# osd_peering_threads.  Not part of make check:
+#
+#   PGS=1024 THREADS="1 5 10" test/osd/osd-peering-bench.sh
+#
+
+source $(dirname $0)/../detect-build-env-vars.sh
+source $CEPH_ROOT/qa/workunits/ceph-helpers.sh
+
+PGS=${PGS:-256}
+THREADS=${THREADS:-"1 5"}
+
+function run() {
+    local dir=$1
+    shift
+
+    export CEPH_MON="127.0.0.1:7127" # git grep '\<7127\>' : there must be only one
+    export CEPH_ARGS
+    CEPH_ARGS+="--fsid=$(uuidgen) --auth-supported=none "
+    CEPH_ARGS+="--mon-host=$CEPH_MON "
+
+    local funcs=${@:-$(set | sed -n -e 's/^\(TEST_[0-9a-z_]*\) .*/\1/p')}
+    for func in $funcs ; do
+        setup $dir || return 1
+        $func $dir || return 1
+        teardown $dir || return 1
+    done
+}
+
+function TEST_peering_time_to_active() {
+    local dir=$1
+
+    run_mon $dir a --osd_pool_default_size=3 || return 1
+    for id in 0 1 2 ; do
+        run_osd $dir $id || return 1
+    done
+    ceph osd pool create bench $PGS $PGS || return 1
+    wait_for_clean || return 1
+
+    for threads in $THREADS ; do
+        ceph tell osd.* injectargs "--osd-peering-threads $threads" || return 1
+        local start=$(date +%s.%N)
+        ceph osd down 0 || return 1
+        wait_for_osd up 0 || return 1
+        wait_for_clean || return 1
+        local end=$(date +%s.%N)
+        echo "osd_peering_threads=$threads pgs=$PGS" \
+            "time_to_active=$(echo "$end - $start" | bc)s"
+    done
+}
+
+main osd-peering-bench "$@"
+
+# Local Variables:
+# compile-command: "cd ../.. ; make -j4 && test/osd/osd-peering-bench.sh"
+# End:
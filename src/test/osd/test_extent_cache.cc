@@ -278,3 +278,49 @@ TEST(extentcache, write_write_overlap2)
 
   c.release_write_pin(pin3);
 }
+
+TEST(extentcache, retain)
+{
+  hobject_t oid;
+
+  ExtentCache c;
+  ExtentCache::write_pin pin;
+  c.open_write_pin(pin);
+
+  auto to_write = iset_from_vector({{0, 10}, {20, 10}});
+  auto must_read = c.reserve_extents_for_rmw(
+    oid, pin, to_write, to_write);
+  ASSERT_EQ(must_read, to_write);
+  c.present_rmw_update(oid, pin, imap_from_iset(to_write));
+  c.release_write_pin(pin, 100);
+  ASSERT_EQ(20u, c.get_retained_bytes());
+  ASSERT_TRUE(c.contains_object(oid));
+
+  // the next rmw finds what the last one wrote
+  ExtentCache::write_pin pin2;
+  c.open_write_pin(pin2);
+  auto to_write2 = iset_from_vector({{5, 20}});
+  auto to_read2 = iset_from_vector({{5, 5}, {20, 5}});
+  auto must_read2 = c.reserve_extents_for_rmw(
+    oid, pin2, to_write2, to_read2);
+  ASSERT_TRUE(must_read2.empty());
+  ASSERT_EQ(10u, c.get_retained_bytes());
+  auto got2 = c.get_remaining_extents_for_rmw(oid, pin2, to_read2);
+  ASSERT_EQ(got2, imap_from_iset(to_read2));
+  c.present_rmw_update(oid, pin2, imap_from_iset(to_write2));
+
+  // back over the limit, the oldest retained extents go first
+  c.release_write_pin(pin2, 20);
+  ASSERT_EQ(20u, c.get_retained_bytes());
+
+  ExtentCache::write_pin pin3;
+  c.open_write_pin(pin3);
+  auto to_read3 = iset_from_vector({{0, 30}});
+  auto must_read3 = c.reserve_extents_for_rmw(
+    oid, pin3, to_read3, to_read3);
+  ASSERT_EQ(must_read3, iset_from_vector({{0, 5}, {25, 5}}));
+  c.release_write_pin(pin3);
+
+  ASSERT_EQ(0u, c.get_retained_bytes());
+  ASSERT_FALSE(c.contains_object(oid));
+}
@@ -0,0 +1,146 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * Copyright (C) 2004-2006 Sage Weil <sage@newdream.net>
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "common/RCUMap.h"
+#include "common/RWLock.h"
+#include "osd/osd_types.h"
+
+// the OSD's pg lookup, with and without pg_map_lock
+
+static const unsigned NUM_PGS = 256;
+static const unsigned NUM_LOOKUPS = 1000000;
+
+struct FakePG {
+  std::atomic<int> ref;
+  FakePG() : ref(1) {}
+};
+
+static spg_t pgid(unsigned i)
+{
+  return spg_t(pg_t(i, 1));
+}
+
+template <typename F>
+static double run_threads(unsigned nthreads, F&& f)
+{
+  std::atomic<bool> go(false);
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < nthreads; ++t) {
+    threads.emplace_back([&, t]() {
+	while (!go) ;
+	f(t);
+      });
+  }
+  auto start = std::chrono::steady_clock::now();
+  go = true;
+  for (auto& t : threads)
+    t.join();
+  std::chrono::duration<double, std::nano> d =
+    std::chrono::steady_clock::now() - start;
+  return d.count() / NUM_LOOKUPS;
+}
+
+TEST(PGLookup, Bench) {
+  std::vector<FakePG> pgs(NUM_PGS);
+  RWLock pg_map_lock("pg_map_lock");
+  ceph::unordered_map<spg_t, FakePG*> pg_map;
+  RCUMap<spg_t, FakePG*> pg_lookup;
+  for (unsigned i = 0; i < NUM_PGS; ++i) {
+    pg_map[pgid(i)] = &pgs[i];
+    pg_lookup.set(pgid(i), &pgs[i]);
+  }
+
+  unsigned nthreads = std::max(2u, std::thread::hardware_concurrency());
+  for (unsigned n = 1; n <= nthreads; n *= 2) {
+    double locked = run_threads(n, [&](unsigned t) {
+	for (unsigned i = t; i < NUM_LOOKUPS; i += n) {
+	  RWLock::RLocker l(pg_map_lock);
+	  auto p = pg_map.find(pgid(i % NUM_PGS));
+	  ASSERT_TRUE(p != pg_map.end());
+	  p->second->ref++;
+	  p->second->ref--;
+	}
+      });
+    double rcu = run_threads(n, [&](unsigned t) {
+	for (unsigned i = t; i < NUM_LOOKUPS; i += n) {
+	  bool found = pg_lookup.lookup(pgid(i % NUM_PGS), [](FakePG *pg) {
+	      pg->ref++;
+	    });
+	  ASSERT_TRUE(found);
+	  pgs[i % NUM_PGS].ref--;
+	}
+      });
+    std::cout << n << " threads: pg_map_lock " << locked
+	      << " ns/lookup, pg_lookup " << rcu << " ns/lookup" << std::endl;
+  }
+}
+
+TEST(PGLookup, ConcurrentRemove) {
+  // readers pin what they find; the writer only drops the map's ref once
+  // erase() returns, so no reader ever sees a dead pg
+  RCUMap<spg_t, FakePG*> pg_lookup;
+  std::vector<FakePG*> pgs(NUM_PGS);
+  for (unsigned i = 0; i < NUM_PGS; ++i) {
+    pgs[i] = new FakePG;
+    pg_lookup.set(pgid(i), pgs[i]);
+  }
+
+  std::atomic<bool> stop(false);
+  std::atomic<unsigned> bad(0);
+  std::vector<std::thread> readers;
+  for (unsigned t = 0; t < 4; ++t) {
+    readers.emplace_back([&, t]() {
+	for (unsigned i = t; !stop; ++i) {
+	  FakePG *pg = nullptr;
+	  pg_lookup.lookup(pgid(i % NUM_PGS), [&](FakePG *p) {
+	      if (p->ref++ <= 0)
+		++bad;
+	      pg = p;
+	    });
+	  if (pg && --pg->ref == 0)
+	    delete pg;
+	}
+      });
+  }
+
+  for (unsigned round = 0; round < 20; ++round) {
+    for (unsigned i = round % 2; i < NUM_PGS; i += 2) {
+      FakePG *old = pgs[i];
+      pgs[i] = new FakePG;
+      pg_lookup.set(pgid(i), pgs[i]);
+      if (--old->ref == 0)
+	delete old;
+    }
+  }
+  stop = true;
+  for (auto& t : readers)
+    t.join();
+  ASSERT_EQ(0u, bad);
+
+  for (unsigned i = 0; i < NUM_PGS; ++i) {
+    pg_lookup.erase(pgid(i));
+    FakePG *pg = nullptr;
+    ASSERT_FALSE(pg_lookup.lookup(pgid(i), &pg));
+    ASSERT_EQ(1, pgs[i]->ref);
+    delete pgs[i];
+  }
+  ASSERT_EQ(0u, pg_lookup.size());
+}
@@ -942,6 +942,64 @@ TEST(pg_missing_t, add_next_event)
   }
 }
 
+TEST(pg_missing_t, add_next_event_dirty)
+{
+  hobject_t oid(object_t("objname"), "key", 123, 456, 0, "");
+  pg_log_entry_t e(pg_log_entry_t::MODIFY, oid, eversion_t(10,5),
+		   eversion_t(3,4), 0,
+		   osd_reqid_t(entity_name_t::CLIENT(777), 8, 999),
+		   utime_t(8,9), 0);
+  e.has_modified_extents = true;
+  e.modified_extents.insert(0, 4096);
+
+  // extents accumulate while every entry has them
+  {
+    pg_missing_t missing;
+    missing.add_next_event(e);
+    EXPECT_TRUE(missing.get_items().at(oid).dirty_known);
+    EXPECT_EQ(e.modified_extents, missing.get_items().at(oid).dirty);
+
+    pg_log_entry_t next = e;
+    next.prior_version = e.version;
+    next.version = eversion_t(10,6);
+    next.modified_extents.clear();
+    next.modified_extents.insert(8192, 4096);
+    missing.add_next_event(next);
+    const pg_missing_item &item = missing.get_items().at(oid);
+    EXPECT_EQ(next.version, item.need);
+    EXPECT_EQ(e.prior_version, item.have);
+    EXPECT_TRUE(item.dirty_known);
+    EXPECT_EQ(8192U, item.dirty.size());
+  }
+  // one entry without extents makes them unknown
+  {
+    pg_missing_t missing;
+    missing.add_next_event(e);
+    pg_log_entry_t next = e;
+    next.prior_version = e.version;
+    next.version = eversion_t(10,6);
+    next.has_modified_extents = false;
+    missing.add_next_event(next);
+    EXPECT_FALSE(missing.get_items().at(oid).dirty_known);
+    EXPECT_TRUE(missing.get_items().at(oid).dirty.empty());
+  }
+  // a new object has nothing to build on
+  {
+    pg_missing_t missing;
+    pg_log_entry_t create = e;
+    create.prior_version = eversion_t();
+    missing.add_next_event(create);
+    EXPECT_FALSE(missing.get_items().at(oid).dirty_known);
+  }
+  // so does a revised have
+  {
+    pg_missing_t missing;
+    missing.add_next_event(e);
+    missing.revise_have(oid, eversion_t(2,2));
+    EXPECT_FALSE(missing.get_items().at(oid).dirty_known);
+  }
+}
+
 TEST(pg_missing_t, revise_need)
 {
   hobject_t oid(object_t("objname"), "key", 123, 456, 0, "");
@@ -0,0 +1,162 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+/*
+ * Ceph - scalable distributed file system
+ *
+ * This is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License version 2.1, as published by the Free Software
+ * Foundation.  See file COPYING.
+ *
+ */
+
+/*
+ * Times the Objecter's op submission locking from many threads: each
+ * op takes the map lock shared and maps an object to its osds, as
+ * _op_submit() does, while another thread takes it exclusive for each
+ * new map.  Compares boost::shared_mutex, which the Objecter used,
+ * against ceph::sharded_shared_mutex, which it uses now.
+ */
+
+#include <atomic>
+#include <thread>
+#include <boost/program_options/option.hpp>
+#include <boost/program_options/options_description.hpp>
+#include <boost/program_options/variables_map.hpp>
+#include <boost/program_options/cmdline.hpp>
+#include <boost/program_options/parsers.hpp>
+
+#include "global/global_context.h"
+#include "global/global_init.h"
+#include "common/ceph_argparse.h"
+#include "common/config.h"
+#include "common/Clock.h"
+#include "common/sharded_shared_mutex.h"
+#include "common/shunique_lock.h"
+#include "include/stringify.h"
+#include "osd/OSDMap.h"
+
+namespace po = boost::program_options;
+
+template <typename Mutex>
+static double run(const char *name, const OSDMap& osdmap, int threads,
+		  int ops, int map_interval_us)
+{
+  Mutex rwlock;
+  std::atomic<bool> done(false);
+  std::atomic<uint64_t> map_updates(0);
+
+  std::thread mapper([&]() {
+    while (!done) {
+      {
+	std::unique_lock<Mutex> wl(rwlock);
+	++map_updates;
+      }
+      std::this_thread::sleep_for(std::chrono::microseconds(map_interval_us));
+    }
+  });
+
+  utime_t start = ceph_clock_now();
+  std::vector<std::thread> submitters;
+  for (int t = 0; t < threads; ++t) {
+    submitters.emplace_back([&, t]() {
+      for (int i = 0; i < ops; ++i) {
+	ceph::shunique_lock<Mutex> sul(rwlock, ceph::acquire_shared);
+	object_t oid("obj" + stringify(t) + "." + stringify(i));
+	object_locator_t oloc(1);
+	pg_t pgid;
+	osdmap.object_locator_to_pg(oid, oloc, pgid);
+	int primary;
+	vector<int> up;
+	osdmap.pg_to_up_acting_osds(osdmap.raw_pg_to_pg(pgid), &up, &primary,
+				    nullptr, nullptr);
+      }
+    });
+  }
+  for (auto& t : submitters)
+    t.join();
+  double elapsed = ceph_clock_now() - start;
+  done = true;
+  mapper.join();
+
+  double rate = threads * ops / elapsed;
+  cout << name << ": " << threads << " threads, " << rate << " ops/s, "
+       << map_updates << " map updates" << std::endl;
+  return rate;
+}
+
+int main(int argc, char **argv)
+{
+  po::options_description desc("Allowed options");
+  desc.add_options()
+    ("help,h", "produce help message")
+    ("threads", po::value<int>()->default_value(16),
+     "submitting threads")
+    ("ops", po::value<int>()->default_value(200000),
+     "ops per thread")
+    ("osds", po::value<int>()->default_value(100),
+     "number of osds")
+    ("map-interval", po::value<int>()->default_value(100000),
+     "microseconds between map updates")
+    ;
+
+  po::variables_map vm;
+  po::parsed_options parsed =
+    po::command_line_parser(argc, argv).options(desc).allow_unregistered().run();
+  po::store(parsed, vm);
+  po::notify(vm);
+
+  vector<const char *> ceph_options, def_args;
+  vector<string> ceph_option_strings = po::collect_unrecognized(
+    parsed.options, po::include_positional);
+  for (auto& i : ceph_option_strings) {
+    ceph_options.push_back(i.c_str());
+  }
+  auto cct = global_init(
+    &def_args, ceph_options, CEPH_ENTITY_TYPE_CLIENT,
+    CODE_ENVIRONMENT_UTILITY,
+    CINIT_FLAG_NO_DEFAULT_CONFIG_FILE);
+  common_init_finish(g_ceph_context);
+
+  if (vm.count("help")) {
+    cout << desc << std::endl;
+    return 1;
+  }
+
+  OSDMap osdmap;
+  uuid_d fsid;
+  const int num_osds = vm["osds"].as<int>();
+  osdmap.build_simple(g_ceph_context, 0, fsid, num_osds, 6, 6);
+  OSDMap::Incremental inc(osdmap.get_epoch() + 1);
+  inc.fsid = osdmap.get_fsid();
+  entity_addr_t sample_addr;
+  for (int i = 0; i < num_osds; ++i) {
+    inc.new_state[i] = CEPH_OSD_EXISTS | CEPH_OSD_NEW;
+    inc.new_up_client[i] = sample_addr;
+    inc.new_up_cluster[i] = sample_addr;
+    inc.new_hb_back_up[i] = sample_addr;
+    inc.new_hb_front_up[i] = sample_addr;
+    inc.new_weight[i] = CEPH_OSD_IN;
+  }
+  osdmap.apply_incremental(inc);
+
+  const int threads = vm["threads"].as<int>();
+  const int ops = vm["ops"].as<int>();
+  const int interval = vm["map-interval"].as<int>();
+  for (int n = 1; n <= threads; n *= 2) {
+    double a = run<boost::shared_mutex>("boost::shared_mutex", osdmap, n,
+					ops, interval);
+    double b = run<ceph::sharded_shared_mutex>("sharded_shared_mutex",
+					       osdmap, n, ops, interval);
+    cout << "  speedup " << b / a << std::endl;
+  }
+  return 0;
+}
+
+/*
+ * Local Variables:
+ * compile-command: "cd ../.. ; make -j4 ceph_perf_objecter_lock &&
+ *   ./ceph_perf_objecter_lock --threads 16
+ * "
+ * End:
+ */
@@ -22,6 +22,7 @@
 #include "common/config.h"
 #include "common/errno.h"
 #include "common/safe_io.h"
+#include "common/Clock.h"
 
 #include "common/code_environment.h"
 #include "global/global_context.h"
@@ -40,8 +41,10 @@
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/un.h>
+#include <thread>
 #include <time.h>
 #include <unistd.h>
+#include <vector>
 
 #include "common/common_init.h"
 
@@ -220,3 +223,85 @@ TEST(PerfCounters, ResetPerfCounters) {
   ASSERT_EQ("", client.do_request("{ \"prefix\": \"perf reset\", \"var\": \"test_perfcounter_1\", \"format\": \"json\" }", &msg));
   ASSERT_EQ(sd("{\"error\":\"Not find: test_perfcounter_1\"}"), msg);
 }
+
+enum {
+  TEST_PERFCOUNTERS3_ELEMENT_FIRST = 600,
+  TEST_PERFCOUNTERS3_ELEMENT_PLAIN,
+  TEST_PERFCOUNTERS3_ELEMENT_SHARDED,
+  TEST_PERFCOUNTERS3_ELEMENT_SHARDED_AVG,
+  TEST_PERFCOUNTERS3_ELEMENT_LAST,
+};
+
+static PerfCounters* setup_test_perfcounters3(CephContext *cct)
+{
+  PerfCountersBuilder bld(cct, "test_perfcounter_3",
+	  TEST_PERFCOUNTERS3_ELEMENT_FIRST, TEST_PERFCOUNTERS3_ELEMENT_LAST);
+  bld.add_u64_counter(TEST_PERFCOUNTERS3_ELEMENT_PLAIN, "plain");
+  bld.add_u64_counter(TEST_PERFCOUNTERS3_ELEMENT_SHARDED, "sharded");
+  bld.add_time_avg(TEST_PERFCOUNTERS3_ELEMENT_SHARDED_AVG, "sharded_avg");
+  bld.set_sharded(TEST_PERFCOUNTERS3_ELEMENT_SHARDED);
+  bld.set_sharded(TEST_PERFCOUNTERS3_ELEMENT_SHARDED_AVG);
+  return bld.create_perf_counters();
+}
+
+TEST(PerfCounters, ShardedPerfCounters) {
+  AdminSocketClient client(get_rand_socket_path());
+  std::string msg;
+  PerfCountersCollection *coll = g_ceph_context->get_perfcounters_collection();
+  coll->clear();
+  PerfCounters* fake_pf = setup_test_perfcounters3(g_ceph_context);
+  coll->add(fake_pf);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([fake_pf] {
+	for (int j = 0; j < 1000; ++j) {
+	  fake_pf->inc(TEST_PERFCOUNTERS3_ELEMENT_SHARDED, 2);
+	  fake_pf->tinc(TEST_PERFCOUNTERS3_ELEMENT_SHARDED_AVG, utime_t(1, 0));
+	}
+      });
+  }
+  for (auto& t : threads)
+    t.join();
+  fake_pf->dec(TEST_PERFCOUNTERS3_ELEMENT_SHARDED, 8);
+  ASSERT_EQ(7992u, fake_pf->get(TEST_PERFCOUNTERS3_ELEMENT_SHARDED));
+  ASSERT_EQ("", client.do_request("{ \"prefix\": \"perf dump\", \"format\": \"json\" }", &msg));
+  ASSERT_EQ(sd("{\"test_perfcounter_3\":{\"plain\":0,\"sharded\":7992,"
+	    "\"sharded_avg\":{\"avgcount\":4000,\"sum\":4000.000000000}}}"), msg);
+
+  fake_pf->set(TEST_PERFCOUNTERS3_ELEMENT_SHARDED, 5);
+  ASSERT_EQ(5u, fake_pf->get(TEST_PERFCOUNTERS3_ELEMENT_SHARDED));
+  fake_pf->reset();
+  ASSERT_EQ("", client.do_request("{ \"prefix\": \"perf dump\", \"format\": \"json\" }", &msg));
+  ASSERT_EQ(sd("{\"test_perfcounter_3\":{\"plain\":0,\"sharded\":0,"
+	    "\"sharded_avg\":{\"avgcount\":0,\"sum\":0.000000000}}}"), msg);
+  coll->clear();
+}
+
+TEST(PerfCounters, ShardedScaling) {
+  PerfCounters* fake_pf = setup_test_perfcounters3(g_ceph_context);
+  const int ops = 200000;
+  for (int idx : { (int)TEST_PERFCOUNTERS3_ELEMENT_PLAIN,
+		   (int)TEST_PERFCOUNTERS3_ELEMENT_SHARDED }) {
+    for (int nthreads = 1; nthreads <= 8; nthreads *= 2) {
+      fake_pf->set(idx, 0);
+      utime_t start = ceph_clock_now();
+      std::vector<std::thread> threads;
+      for (int i = 0; i < nthreads; ++i) {
+	threads.emplace_back([fake_pf, idx] {
+	    for (int j = 0; j < ops; ++j)
+	      fake_pf->inc(idx);
+	  });
+      }
+      for (auto& t : threads)
+	t.join();
+      utime_t elapsed = ceph_clock_now() - start;
+      std::cout << (idx == TEST_PERFCOUNTERS3_ELEMENT_PLAIN ? "plain" : "sharded")
+		<< " threads " << nthreads
+		<< " ns/inc " << elapsed.to_nsec() / ((uint64_t)ops * nthreads)
+		<< std::endl;
+      ASSERT_EQ((uint64_t)ops * nthreads, fake_pf->get(idx));
+    }
+  }
+  delete fake_pf;
+}
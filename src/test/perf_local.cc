@@ -33,6 +33,7 @@
 //   as a guideline, and be sure to generate output in the same form as
 //   other tests.
 // * Create a new entry for the test in the #tests table.
+#include <thread>
 #include <vector>
 #include <sched.h>
 
@@ -51,6 +52,7 @@
 #include "common/Cond.h"
 #include "common/Mutex.h"
 #include "common/Thread.h"
+#include "common/Throttle.h"
 #include "common/Timer.h"
 #include "msg/async/Event.h"
 #include "global/global_init.h"
@@ -792,6 +794,42 @@ double perf_timer()
   return Cycles::to_seconds(stop - start)/count;
 }
 
+// Measure the cost of an uncontended Throttle get/put pair.
+double throttle_get_put()
+{
+  int count = 1000000;
+  Throttle throttle(g_ceph_context, "perf_local", 1 << 30, false);
+  uint64_t start = Cycles::rdtsc();
+  for (int i = 0; i < count; i++) {
+    throttle.get(1);
+    throttle.put(1);
+  }
+  uint64_t stop = Cycles::rdtsc();
+  return Cycles::to_seconds(stop - start)/count;
+}
+
+// Measure the cost of a Throttle get/put pair with 4 threads hammering
+// the same throttle, none of them ever blocking.
+double throttle_get_put_4threads()
+{
+  int count = 1000000;
+  Throttle throttle(g_ceph_context, "perf_local", 1 << 30, false);
+  std::vector<std::thread> threads;
+  uint64_t start = Cycles::rdtsc();
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&throttle, count]() {
+	for (int i = 0; i < count; i++) {
+	  throttle.get(1);
+	  throttle.put(1);
+	}
+      });
+  }
+  for (auto& t : threads)
+    t.join();
+  uint64_t stop = Cycles::rdtsc();
+  return Cycles::to_seconds(stop - start)/count;
+}
+
 // Measure the cost of throwing and catching an int. This uses an integer as
 // the value thrown, which is presumably as fast as possible.
 double throw_int()
@@ -975,6 +1013,10 @@ TestInfo tests[] = {
     "Start and stop a thread"},
   {"perf_timer", perf_timer,
     "Insert and cancel a SafeTimer"},
+  {"throttle_get_put", throttle_get_put,
+    "Throttle get/put, uncontended"},
+  {"throttle_get_put_4threads", throttle_get_put_4threads,
+    "Throttle get/put, 4 threads, no blocking"},
   {"throw_int", throw_int,
     "Throw an int"},
   {"throw_int_call", throw_int_call,
@@ -247,10 +247,6 @@ TEST_F(TestMockImageSyncImageCopyRequest, Throttled) {
   } BOOST_SCOPE_EXIT_END;
 
 
-  std::string max_ops_str;
-  ASSERT_EQ(0, _rados->conf_get("rbd_concurrent_management_ops", max_ops_str));
-  int max_ops = std::stoi(max_ops_str);
-
   uint64_t object_count = 55;
 
   librbd::MockTestImageCtx mock_remote_image_ctx(*m_remote_image_ctx);
@@ -265,22 +261,20 @@ TEST_F(TestMockImageSyncImageCopyRequest, Throttled) {
 
   EXPECT_CALL(mock_object_copy_request, send()).Times(object_count);
 
-  boost::optional<uint64_t> expected_object_number(boost::none);
+  // objects are completed in order, so the sync point only ever moves
+  // forward over objects that have been copied
+  boost::optional<uint64_t> last_object_number(boost::none);
   EXPECT_CALL(mock_journaler, update_client(_, _))
     .WillRepeatedly(
-        Invoke([&expected_object_number, max_ops, object_count, this]
+        Invoke([&last_object_number, object_count, this]
                (bufferlist data, Context *ctx) {
-          ASSERT_EQ(expected_object_number,
-                    m_client_meta.sync_points.front().object_number);
-          if (!expected_object_number) {
-            expected_object_number = (max_ops - 1);
-          } else {
-            expected_object_number = expected_object_number.get() + max_ops;
-          }
-
-          if (expected_object_number.get() > (object_count - 1)) {
-            expected_object_number = (object_count - 1);
+          auto object_number = m_client_meta.sync_points.front().object_number;
+          ASSERT_TRUE(object_number);
+          ASSERT_GT(object_count, object_number.get());
+          if (last_object_number) {
+            ASSERT_LE(last_object_number.get(), object_number.get());
           }
+          last_object_number = object_number;
 
           m_threads->work_queue->queue(ctx, 0);
       }));
@@ -465,6 +459,13 @@ TEST_F(TestMockImageSyncImageCopyRequest, Cancel_Inflight_Sync) {
     ASSERT_EQ(0, _rados->conf_set("rbd_concurrent_management_ops", max_ops_str.c_str()));
   } BOOST_SCOPE_EXIT_END;
 
+  std::string limit_ops_str;
+  ASSERT_EQ(0, _rados->conf_get("rbd_concurrent_management_ops_max", limit_ops_str));
+  ASSERT_EQ(0, _rados->conf_set("rbd_concurrent_management_ops_max", "3"));
+  BOOST_SCOPE_EXIT( (limit_ops_str) ) {
+    ASSERT_EQ(0, _rados->conf_set("rbd_concurrent_management_ops_max", limit_ops_str.c_str()));
+  } BOOST_SCOPE_EXIT_END;
+
   ASSERT_EQ(0, create_snap("snap1"));
   m_client_meta.sync_points = {{"snap1", boost::none}};
 
@@ -509,7 +510,7 @@ TEST_F(TestMockImageSyncImageCopyRequest, Cancel_Inflight_Sync) {
   ASSERT_TRUE(complete_object_copy(mock_object_copy_request, 5, 0));
 
   ASSERT_EQ(-ECANCELED, ctx.wait());
-  ASSERT_EQ(5u, m_client_meta.sync_points.front().object_number.get());
+  ASSERT_EQ(2u, m_client_meta.sync_points.front().object_number.get());
 }
 
 TEST_F(TestMockImageSyncImageCopyRequest, Cancel1) {
@@ -41,6 +41,35 @@ public:
   }
 };
 
+struct TestInstanceListener : public InstanceWatcher<>::Listener {
+  std::map<std::string, std::string> image_ids;
+  std::set<std::string> deleted_image_ids;
+
+  void handle_image_acquire(const std::string &global_image_id,
+                            const std::string &remote_image_id,
+                            Context *on_finish) override {
+    image_ids[global_image_id] = remote_image_id;
+    on_finish->complete(0);
+  }
+
+  void handle_image_release(const std::string &global_image_id,
+                            bool schedule_delete, Context *on_finish) override {
+    image_ids.erase(global_image_id);
+    if (schedule_delete) {
+      deleted_image_ids.insert(global_image_id);
+    }
+    on_finish->complete(0);
+  }
+
+  void handle_get_image_rates(InstanceWatcher<>::ImageRates *image_rates,
+                              Context *on_finish) override {
+    for (auto &it : image_ids) {
+      (*image_rates)[it.first] = 1.5;
+    }
+    on_finish->complete(0);
+  }
+};
+
 TEST_F(TestInstanceWatcher, InitShutdown)
 {
   InstanceWatcher<> instance_watcher(m_local_io_ctx, m_threads->work_queue);
@@ -131,3 +160,54 @@ TEST_F(TestInstanceWatcher, Remove)
                                      instance_id, &on_remove_noent);
   ASSERT_EQ(0, on_remove_noent.wait());
 }
+
+TEST_F(TestInstanceWatcher, Notify)
+{
+  std::string instance_id = "instance_id";
+
+  librados::Rados cluster;
+  librados::IoCtx io_ctx;
+  ASSERT_EQ("", connect_cluster_pp(cluster));
+  ASSERT_EQ(0, cluster.ioctx_create(_local_pool_name.c_str(), io_ctx));
+  TestInstanceListener listener;
+  InstanceWatcher<> instance_watcher(io_ctx, m_threads->work_queue,
+                                     instance_id, &listener);
+  ASSERT_EQ(0, instance_watcher.init());
+
+  InstanceWatcher<> leader_watcher(m_local_io_ctx, m_threads->work_queue);
+  ASSERT_EQ(0, leader_watcher.init());
+
+  C_SaferCond on_acquire1;
+  leader_watcher.notify_image_acquire(instance_id, "global id 1", "id 1",
+                                      &on_acquire1);
+  ASSERT_EQ(0, on_acquire1.wait());
+  C_SaferCond on_acquire2;
+  leader_watcher.notify_image_acquire(instance_id, "global id 2", "id 2",
+                                      &on_acquire2);
+  ASSERT_EQ(0, on_acquire2.wait());
+  ASSERT_EQ("id 1", listener.image_ids["global id 1"]);
+
+  C_SaferCond on_release;
+  leader_watcher.notify_image_release(instance_id, "global id 1", true,
+                                      &on_release);
+  ASSERT_EQ(0, on_release.wait());
+  ASSERT_EQ(1U, listener.deleted_image_ids.count("global id 1"));
+
+  InstanceWatcher<>::ImageRates image_rates;
+  C_SaferCond on_get_rates;
+  leader_watcher.notify_get_image_rates(instance_id, &image_rates,
+                                        &on_get_rates);
+  ASSERT_EQ(0, on_get_rates.wait());
+  ASSERT_EQ(1U, image_rates.size());
+  ASSERT_EQ(1.5, image_rates["global id 2"]);
+
+  instance_watcher.shut_down();
+
+  // the instance is gone
+  C_SaferCond on_get_rates_noent;
+  leader_watcher.notify_get_image_rates(instance_id, &image_rates,
+                                        &on_get_rates_noent);
+  ASSERT_EQ(-ENOENT, on_get_rates_noent.wait());
+
+  leader_watcher.shut_down();
+}
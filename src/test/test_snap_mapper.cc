@@ -568,6 +568,36 @@ public:
     hobject_to_snap.erase(obj);
   }
 
+  void remove_oids() {
+    Mutex::Locker l(lock);
+    set<hobject_t> to_remove;
+    for (int i = rand() % 5 + 1; i > 0 && to_remove.size() < hobject_to_snap.size(); --i)
+      to_remove.insert(rand_choose(hobject_to_snap)->first);
+    if (to_remove.empty())
+      return;
+    for (auto &oid : to_remove) {
+      for (auto &snap : hobject_to_snap[oid]) {
+	map<snapid_t, set<hobject_t> >::iterator j =
+	  snap_to_hobject.find(snap);
+	assert(j->second.count(oid));
+	j->second.erase(oid);
+      }
+      hobject_to_snap.erase(oid);
+    }
+    {
+      PausyAsyncMap::Transaction t;
+      int r = mapper->remove_oids(
+	vector<hobject_t>(to_remove.begin(), to_remove.end()),
+	&t);
+      ASSERT_EQ(0, r);
+      driver->submit(&t);
+    }
+    for (auto &oid : to_remove) {
+      set<snapid_t> snaps;
+      ASSERT_EQ(-ENOENT, mapper->get_snaps(oid, &snaps));
+    }
+  }
+
   void check_oid() {
     Mutex::Locker l(lock);
     if (hobject_to_snap.empty())
@@ -621,7 +651,7 @@ protected:
     for (int i = 0; i < 5000; ++i) {
       if (!(i % 50))
 	std::cout << i << std::endl;
-      switch (rand() % 5) {
+      switch (rand() % 6) {
       case 0:
 	get_tester().create_snap();
 	break;
@@ -637,6 +667,9 @@ protected:
       case 4:
 	get_tester().remove_oid();
 	break;
+      case 5:
+	get_tester().remove_oids();
+	break;
       }
     }
   }
@@ -18,10 +18,15 @@
 #include <boost/optional.hpp>
 
 #include <stdlib.h>
+#include <atomic>
 
 #include "common/Formatter.h"
 #include "common/errno.h"
 #include "common/ceph_argparse.h"
+#include "common/Clock.h"
+#include "common/Cond.h"
+#include "common/Mutex.h"
+#include "common/Thread.h"
 
 #include "global/global_init.h"
 
@@ -2298,10 +2303,414 @@ int apply_layout_settings(ObjectStore *os, const OSDSuperblock &superblock,
   return r;
 }
 
+/*
+ * Copies a whole store into another one, e.g. a filestore into a new
+ * bluestore on the same host, so an OSD can change its backend without
+ * backfilling its data over the network.
+ *
+ * Collections are handed out to dup_threads workers.  Each worker copies
+ * the objects of its collection into transactions of up to batch_bytes
+ * and goes on reading the next batch while the target commits the last
+ * one.  Everything goes through the ObjectStore interface, so the target
+ * lays the data out the way it would for the OSD.
+ */
+class StoreDup {
+  ObjectStore *src, *dst;
+  map<coll_t,int> colls;  ///< to copy, with their split bits
+  uint64_t batch_bytes;
+
+  map<coll_t,int>::iterator next_coll;
+  Mutex lock;  ///< protects next_coll
+  std::atomic<int> error{0};
+
+  std::atomic<uint64_t> colls_done{0}, objects{0}, bytes{0}, keys{0};
+
+  class Worker : public Thread {
+    StoreDup *dup;
+  public:
+    explicit Worker(StoreDup *d) : dup(d) {}
+    void *entry() override {
+      dup->run();
+      return NULL;
+    }
+  };
+
+  /// a batch being filled and how many are in flight, per worker
+  struct Batch {
+    ObjectStore::Sequencer osr;
+    ObjectStore::Transaction t;
+    uint64_t t_bytes = 0;
+    Mutex lock;
+    Cond cond;
+    unsigned in_flight = 0;
+    int r = 0;
+    Batch() : osr("dup"), lock("StoreDup::Batch::lock") {}
+  };
+
+  struct C_Committed : public Context {
+    Batch *b;
+    explicit C_Committed(Batch *b) : b(b) {}
+    void finish(int r) override {
+      Mutex::Locker l(b->lock);
+      --b->in_flight;
+      if (r < 0 && b->r == 0)
+	b->r = r;
+      b->cond.Signal();
+    }
+  };
+
+  void submit(Batch *b) {
+    if (b->t.empty())
+      return;
+    {
+      // read the next batch while this one commits, but not further ahead
+      Mutex::Locker l(b->lock);
+      while (b->in_flight > 1)
+	b->cond.Wait(b->lock);
+      ++b->in_flight;
+    }
+    b->t.register_on_commit(new C_Committed(b));
+    dst->queue_transaction(&b->osr, std::move(b->t), nullptr);
+    b->t = ObjectStore::Transaction();
+    b->t_bytes = 0;
+  }
+
+  void maybe_submit(Batch *b) {
+    if (b->t_bytes >= batch_bytes)
+      submit(b);
+  }
+
+  void wait_for_commits(Batch *b) {
+    Mutex::Locker l(b->lock);
+    while (b->in_flight)
+      b->cond.Wait(b->lock);
+  }
+
+  int copy_object(Batch *b, const coll_t& cid, const ghobject_t& oid) {
+    struct stat st;
+    int r = src->stat(cid, oid, &st);
+    if (r < 0) {
+      cerr << "stat " << cid << "/" << oid << ": " << cpp_strerror(r)
+	   << std::endl;
+      return r;
+    }
+    b->t.touch(cid, oid);
+
+    map<string,bufferptr> attrs;
+    r = src->getattrs(cid, oid, attrs);
+    if (r < 0) {
+      cerr << "getattrs " << cid << "/" << oid << ": " << cpp_strerror(r)
+	   << std::endl;
+      return r;
+    }
+    if (!attrs.empty()) {
+      for (auto& a : attrs)
+	b->t_bytes += a.first.length() + a.second.length();
+      b->t.setattrs(cid, oid, attrs);
+    }
+
+    // only copy what is allocated, so sparse objects stay sparse
+    uint64_t size = st.st_size;
+    if (size) {
+      b->t.truncate(cid, oid, size);
+      map<uint64_t,uint64_t> extents;
+      bufferlist fm;
+      r = src->fiemap(cid, oid, 0, size, fm);
+      if (r >= 0) {
+	bufferlist::iterator p = fm.begin();
+	::decode(extents, p);
+      } else {
+	extents[0] = size;
+      }
+      for (auto& e : extents) {
+	uint64_t off = e.first, end = MIN(e.first + e.second, size);
+	while (off < end) {
+	  uint64_t len = MIN(end - off, batch_bytes);
+	  bufferlist bl;
+	  r = src->read(cid, oid, off, len, bl);
+	  if (r < 0) {
+	    cerr << "read " << cid << "/" << oid << " " << off << "~" << len
+		 << ": " << cpp_strerror(r) << std::endl;
+	    return r;
+	  }
+	  if (bl.length() == 0)
+	    break;
+	  b->t.write(cid, oid, off, bl.length(), bl);
+	  b->t_bytes += bl.length();
+	  bytes += bl.length();
+	  off += bl.length();
+	  maybe_submit(b);
+	}
+      }
+    }
+
+    bufferlist header;
+    r = src->omap_get_header(cid, oid, &header);
+    if (r < 0) {
+      cerr << "omap_get_header " << cid << "/" << oid << ": "
+	   << cpp_strerror(r) << std::endl;
+      return r;
+    }
+    if (header.length()) {
+      b->t.omap_setheader(cid, oid, header);
+      b->t_bytes += header.length();
+    }
+    ObjectMap::ObjectMapIterator iter = src->get_omap_iterator(cid, oid);
+    if (iter) {
+      map<string,bufferlist> kv;
+      uint64_t kv_bytes = 0;
+      for (iter->seek_to_first(); iter->valid(); iter->next()) {
+	bufferlist v = iter->value();
+	kv_bytes += iter->key().length() + v.length();
+	kv[iter->key()].claim(v);
+	if (b->t_bytes + kv_bytes >= batch_bytes) {
+	  keys += kv.size();
+	  b->t.omap_setkeys(cid, oid, kv);
+	  b->t_bytes += kv_bytes;
+	  kv.clear();
+	  kv_bytes = 0;
+	  submit(b);
+	}
+      }
+      if (!kv.empty()) {
+	keys += kv.size();
+	b->t.omap_setkeys(cid, oid, kv);
+	b->t_bytes += kv_bytes;
+      }
+    }
+    ++objects;
+    maybe_submit(b);
+    return 0;
+  }
+
+  static const int DUP_LIST_AT_A_TIME = 1000;
+
+  int copy_collection(Batch *b, const coll_t& cid, int bits) {
+    b->t.create_collection(cid, bits);
+    ghobject_t next;
+    while (!next.is_max()) {
+      vector<ghobject_t> ls;
+      int r = src->collection_list(cid, next, ghobject_t::get_max(),
+				   DUP_LIST_AT_A_TIME, &ls, &next);
+      if (r < 0) {
+	cerr << "collection_list " << cid << ": " << cpp_strerror(r)
+	     << std::endl;
+	return r;
+      }
+      for (auto& oid : ls) {
+	if (error)
+	  return 0;
+	r = copy_object(b, cid, oid);
+	if (r < 0)
+	  return r;
+      }
+    }
+    submit(b);
+    return 0;
+  }
+
+  void run() {
+    Batch b;
+    while (!error) {
+      map<coll_t,int>::iterator c;
+      {
+	Mutex::Locker l(lock);
+	if (next_coll == colls.end())
+	  break;
+	c = next_coll++;
+      }
+      int r = copy_collection(&b, c->first, c->second);
+      if (r < 0) {
+	error = r;
+	break;
+      }
+      ++colls_done;
+    }
+    wait_for_commits(&b);
+    if (b.r < 0) {
+      cerr << "transaction failed: " << cpp_strerror(b.r) << std::endl;
+      error = b.r;
+    }
+  }
+
+public:
+  StoreDup(ObjectStore *src, ObjectStore *dst, const map<coll_t,int>& colls,
+	   uint64_t batch_bytes)
+    : src(src), dst(dst), colls(colls), batch_bytes(batch_bytes),
+      lock("StoreDup::lock") {
+    next_coll = this->colls.begin();
+  }
+
+  int run(unsigned num_threads) {
+    vector<Worker*> workers;
+    for (unsigned i = 0; i < num_threads; ++i) {
+      Worker *w = new Worker(this);
+      w->create("dup");
+      workers.push_back(w);
+    }
+
+    utime_t start = ceph_clock_now(), last = start;
+    uint64_t last_bytes = 0;
+    while (colls_done < colls.size() && !error) {
+      sleep(1);
+      utime_t now = ceph_clock_now();
+      if (now - last < utime_t(5, 0) && colls_done < colls.size())
+	continue;
+      uint64_t b = bytes;
+      cout << colls_done << "/" << colls.size() << " collections, "
+	   << objects << " objects, " << prettybyte_t(b) << ", "
+	   << keys << " omap keys, "
+	   << prettybyte_t((b - last_bytes) / (double)(now - last)) << "/s"
+	   << std::endl;
+      last = now;
+      last_bytes = b;
+    }
+
+    for (auto w : workers) {
+      w->join();
+      delete w;
+    }
+    if (error)
+      return error;
+    double elapsed = ceph_clock_now() - start;
+    cout << "copied " << colls.size() << " collections, " << objects
+	 << " objects, " << prettybyte_t(bytes) << ", " << keys
+	 << " omap keys in " << (int)elapsed << " s ("
+	 << prettybyte_t(bytes / MAX(elapsed, 1.0)) << "/s)" << std::endl;
+    return 0;
+  }
+};
+
+int dup(const string& srcpath, ObjectStore *src,
+	const string& dstpath, ObjectStore *dst,
+	unsigned num_threads, uint64_t batch_bytes)
+{
+  cout << "dup from " << src->get_type() << " " << srcpath
+       << " to " << dst->get_type() << " " << dstpath << std::endl;
+
+  int r = src->mount();
+  if (r < 0) {
+    cerr << "failed to mount " << srcpath << ": " << cpp_strerror(r)
+	 << std::endl;
+    return r;
+  }
+
+  // the new store keeps the osd's fsid, the osd is the same
+  map<coll_t,int> colls;
+  vector<coll_t> ls;
+  OSDSuperblock superblock;
+  map<epoch_t,ceph::shared_ptr<OSDMap>> osdmaps;
+  bufferlist bl;
+  dst->set_fsid(src->get_fsid());
+  r = dst->mkfs();
+  if (r < 0) {
+    cerr << "failed to mkfs " << dstpath << ": " << cpp_strerror(r)
+	 << std::endl;
+    goto out_src;
+  }
+  r = dst->mount();
+  if (r < 0) {
+    cerr << "failed to mount " << dstpath << ": " << cpp_strerror(r)
+	 << std::endl;
+    goto out_src;
+  }
+
+  r = src->read(coll_t::meta(), OSD_SUPERBLOCK_GOBJECT, 0, 0, bl);
+  if (r < 0) {
+    cerr << "Failure to read OSD superblock: " << cpp_strerror(r)
+	 << std::endl;
+    goto out;
+  }
+  {
+    bufferlist::iterator p = bl.begin();
+    ::decode(superblock, p);
+  }
+
+  r = src->list_collections(ls);
+  if (r < 0) {
+    cerr << "Error listing collections: " << cpp_strerror(r) << std::endl;
+    goto out;
+  }
+  // filestore does not keep the split bits of a pg, they follow from
+  // the pg_num as of the map its pg info was written with
+  for (auto& cid : ls) {
+    spg_t pgid;
+    int bits = src->collection_bits(cid);
+    if (bits < 0)
+      bits = 0;
+    if (cid.is_pg(&pgid) || cid.is_temp(&pgid)) {
+      epoch_t map_epoch = 0;
+      bufferlist info_bl;
+      if (PG::peek_map_epoch(src, pgid, &map_epoch, &info_bl) < 0 ||
+	  map_epoch == 0)
+	map_epoch = superblock.current_epoch;
+      auto m = osdmaps.find(map_epoch);
+      if (m == osdmaps.end()) {
+	ceph::shared_ptr<OSDMap> map = std::make_shared<OSDMap>();
+	bufferlist map_bl;
+	if (get_osdmap(src, map_epoch, *map, map_bl) < 0)
+	  map.reset();
+	m = osdmaps.insert(make_pair(map_epoch, map)).first;
+      }
+      if (m->second && m->second->have_pg_pool(pgid.pool()))
+	bits = pgid.get_split_bits(
+	  m->second->get_pg_pool(pgid.pool())->get_pg_num());
+    }
+    colls[cid] = bits;
+  }
+  osdmaps.clear();
+  cout << colls.size() << " collections, " << num_threads << " threads"
+       << std::endl;
+
+  r = StoreDup(src, dst, colls, batch_bytes).run(num_threads);
+  if (r < 0) {
+    cerr << "dup failed: " << cpp_strerror(r) << std::endl;
+    goto out;
+  }
+
+  for (auto k : {"magic", "whoami", "ceph_fsid"}) {
+    string val;
+    r = src->read_meta(k, &val);
+    if (r < 0) {
+      cerr << "failed to read " << k << " of " << srcpath << ": "
+	   << cpp_strerror(r) << std::endl;
+      goto out;
+    }
+    dst->write_meta(k, val);
+  }
+  {
+    bufferlist keyring;
+    string err;
+    string s = srcpath + "/keyring";
+    if (keyring.read_file(s.c_str(), &err) < 0) {
+      cerr << "failed to read " << s << ": " << err << std::endl;
+    } else {
+      s = dstpath + "/keyring";
+      keyring.write_file(s.c_str(), 0600);
+    }
+  }
+  dst->write_meta("ready", "ready");
+  cout << "dup done" << std::endl;
+  r = 0;
+
+out:
+  {
+    int ur = dst->umount();
+    if (ur < 0 && r == 0)
+      r = ur;
+  }
+out_src:
+  src->umount();
+  return r;
+}
+
 int main(int argc, char **argv)
 {
   string dpath, jpath, pgidstr, op, file, mountpoint, mon_store_path, object;
   string objcmd, arg1, arg2, type, format, argnspace, pool;
+  string target_dpath, target_type;
+  unsigned dup_threads;
+  uint64_t dup_batch_bytes;
   boost::optional<std::string> nspace;
   spg_t pgid;
   unsigned epoch = 0;
@@ -2320,13 +2729,21 @@ int main(int argc, char **argv)
      "path to object store, mandatory")
     ("journal-path", po::value<string>(&jpath),
      "path to journal, use if tool can't find it")
+    ("target-data-path", po::value<string>(&target_dpath),
+     "path of the new object store to dup into, mandatory for dup")
+    ("target-type", po::value<string>(&target_type)->default_value("bluestore"),
+     "type of the new object store to dup into")
+    ("threads", po::value<unsigned>(&dup_threads)->default_value(8),
+     "number of collections dup copies in parallel")
+    ("batch-bytes", po::value<uint64_t>(&dup_batch_bytes)->default_value(32 << 20),
+     "bytes dup copies per transaction")
     ("pgid", po::value<string>(&pgidstr),
      "PG id, mandatory for info, log, remove, export, rm-past-intervals, mark-complete, and mandatory for apply-layout-settings if --pool is not specified")
     ("pool", po::value<string>(&pool),
      "Pool name, mandatory for apply-layout-settings if --pgid is not specified")
     ("op", po::value<string>(&op),
      "Arg is one of [info, log, remove, mkfs, fsck, fuse, export, import, list, fix-lost, list-pgs, rm-past-intervals, dump-journal, dump-super, meta-list, "
-     "get-osdmap, set-osdmap, get-inc-osdmap, set-inc-osdmap, mark-complete, apply-layout-settings, update-mon-db]")
+     "get-osdmap, set-osdmap, get-inc-osdmap, set-inc-osdmap, mark-complete, apply-layout-settings, update-mon-db, dup]")
     ("epoch", po::value<unsigned>(&epoch),
      "epoch# for get-osdmap and get-inc-osdmap, the current epoch in use if not specified")
     ("file", po::value<string>(&file),
@@ -2465,6 +2882,15 @@ int main(int argc, char **argv)
     usage(desc);
     return 1;
   }
+  if (op == "dup" && target_dpath.length() == 0) {
+    cerr << "Must provide --target-data-path" << std::endl;
+    usage(desc);
+    return 1;
+  }
+  if (op == "dup" && dry_run) {
+    cerr << "dup can't be used with --dry-run" << std::endl;
+    return 1;
+  }
   if (op == "fuse" && mountpoint.length() == 0) {
     cerr << "Missing fuse mountpoint" << std::endl;
     usage(desc);
@@ -2588,6 +3014,19 @@ int main(int argc, char **argv)
     return 0;
   }
 
+  if (op == "dup") {
+    ObjectStore *target = ObjectStore::create(
+      g_ceph_context, target_type, target_dpath, target_dpath + "/journal", 0);
+    if (target == NULL) {
+      cerr << "Unable to create store of type " << target_type << std::endl;
+      return 1;
+    }
+    int r = dup(dpath, fs, target_dpath, target,
+		MAX(dup_threads, 1u), MAX(dup_batch_bytes, (uint64_t)(1 << 20)));
+    delete target;
+    return r < 0 ? 1 : 0;
+  }
+
   ObjectStore::Sequencer *osr = new ObjectStore::Sequencer(__func__);
   int ret = fs->mount();
   if (ret < 0) {
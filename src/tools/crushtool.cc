@@ -165,6 +165,17 @@ void usage()
   cout << "                         reweight a given item (and adjust ancestor\n"
        << "                         weights as needed)\n";
   cout << "   -i mapfn --reweight   recalculate all bucket weights\n";
+  cout << "   -i mapfn --optimize-choose-args\n";
+  cout << "                         adjust the weight sets of --pool-id (or the\n";
+  cout << "                         default ones) so that --rule r with --num-rep n\n";
+  cout << "                         maps the test inputs evenly over the devices\n";
+  cout << "      [--iterations n]   give up after n rounds (default 100)\n";
+  cout << "      [--max-deviation d]\n";
+  cout << "                         stop once no device is off by more than\n";
+  cout << "                         the ratio d of its share (default 0.01)\n";
+  cout << "   -i mapfn --rm-choose-args\n";
+  cout << "                         remove the weight sets of --pool-id (or the\n";
+  cout << "                         default ones)\n";
   cout << "\n";
   cout << "Options for the display/test stage\n";
   cout << "\n";
@@ -243,6 +254,11 @@ int main(int argc, const char **argv)
   bool unsafe_tunables = false;
 
   bool reweight = false;
+  bool optimize_choose_args = false;
+  bool rm_choose_args = false;
+  int64_t choose_args_pool = CrushWrapper::DEFAULT_CHOOSE_ARGS;
+  int iterations = 100;
+  float max_deviation = 0.01;
   int add_item = -1;
   bool update_item = false;
   float add_weight = 0;
@@ -360,6 +376,20 @@ int main(int argc, const char **argv)
       adjust = true;
     } else if (ceph_argparse_flag(args, i, "--reweight", (char*)NULL)) {
       reweight = true;
+    } else if (ceph_argparse_flag(args, i, "--optimize_choose_args", (char*)NULL)) {
+      optimize_choose_args = true;
+    } else if (ceph_argparse_flag(args, i, "--rm_choose_args", (char*)NULL)) {
+      rm_choose_args = true;
+    } else if (ceph_argparse_witharg(args, i, &iterations, err, "--iterations", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_witharg(args, i, &max_deviation, err, "--max_deviation", (char*)NULL)) {
+      if (!err.str().empty()) {
+	cerr << err.str() << std::endl;
+	return EXIT_FAILURE;
+      }
     } else if (ceph_argparse_witharg(args, i, &add_item, err, "--add_item", (char*)NULL)) {
       if (!err.str().empty()) {
 	cerr << err.str() << std::endl;
@@ -461,6 +491,7 @@ int main(int argc, const char **argv)
 	return EXIT_FAILURE;
       }
       tester.set_pool_id(z);
+      choose_args_pool = z;
     } else if (ceph_argparse_witharg(args, i, &x, err, "--x", (char*)NULL)) {
       if (!err.str().empty()) {
 	cerr << err.str() << std::endl;
@@ -537,6 +568,7 @@ int main(int argc, const char **argv)
     return EXIT_FAILURE;
   }
   if (!check && !compile && !decompile && !build && !test && !reweight && !adjust && !tree &&
+      !optimize_choose_args && !rm_choose_args &&
       add_item < 0 && full_location < 0 &&
       remove_name.empty() && reweight_name.empty()) {
     cerr << "no action specified; -h for help" << std::endl;
@@ -834,6 +866,21 @@ int main(int argc, const char **argv)
     modified = true;
   }
 
+  if (rm_choose_args) {
+    if (!crush.rm_choose_args(choose_args_pool)) {
+      cerr << me << " no choose_args for " << choose_args_pool << std::endl;
+      return EXIT_FAILURE;
+    }
+    modified = true;
+  }
+
+  if (optimize_choose_args) {
+    int r = tester.optimize_choose_args(iterations, max_deviation);
+    if (r < 0)
+      return EXIT_FAILURE;
+    modified = true;
+  }
+
 
   // display ---
   if (full_location >= 0) {
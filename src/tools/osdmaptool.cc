@@ -33,6 +33,8 @@ void usage()
   cout << "   --test-map-pgs-dump-all [--pool <poolid>] map all pgs to osds" << std::endl;
   cout << "   --mark-up-in            mark osds up and in (but do not persist)" << std::endl;
   cout << "   --clear-temp            clear pg_temp and primary_temp" << std::endl;
+  cout << "   --clear-upmap           clear pg_upmap and pg_upmap_items" << std::endl;
+  cout << "   --upmap-cleanup         remove pg_upmap entries that no longer apply" << std::endl;
   cout << "   --test-random           do random placements" << std::endl;
   cout << "   --test-map-pg <pgid>    map a pgid to osds" << std::endl;
   cout << "   --test-map-object <objectname> [--pool <poolid>] map an object to osds"
@@ -72,6 +74,8 @@ int main(int argc, const char **argv)
   int pool = -1;
   bool mark_up_in = false;
   bool clear_temp = false;
+  bool clear_upmap = false;
+  bool upmap_cleanup = false;
   bool test_map_pgs = false;
   bool test_map_pgs_dump = false;
   bool test_random = false;
@@ -109,6 +113,10 @@ int main(int argc, const char **argv)
       mark_up_in = true;
     } else if (ceph_argparse_flag(args, i, "--clear-temp", (char*)NULL)) {
       clear_temp = true;
+    } else if (ceph_argparse_flag(args, i, "--clear-upmap", (char*)NULL)) {
+      clear_upmap = true;
+    } else if (ceph_argparse_flag(args, i, "--upmap-cleanup", (char*)NULL)) {
+      upmap_cleanup = true;
     } else if (ceph_argparse_flag(args, i, "--test-map-pgs", (char*)NULL)) {
       test_map_pgs = true;
     } else if (ceph_argparse_flag(args, i, "--test-map-pgs-dump", (char*)NULL)) {
@@ -248,6 +256,21 @@ int main(int argc, const char **argv)
     cout << "clearing pg/primary temp" << std::endl;
     osdmap.clear_temp();
   }
+  if (clear_upmap) {
+    cout << "clearing pg_upmap and pg_upmap_items" << std::endl;
+    osdmap.clear_upmap();
+  }
+  if (upmap_cleanup) {
+    OSDMap::Incremental inc;
+    inc.fsid = osdmap.get_fsid();
+    inc.epoch = osdmap.get_epoch()+1;
+    OSDMap::clean_pg_upmaps(g_ceph_context, osdmap, &inc);
+    cout << me << ": removing " << inc.old_pg_upmap.size() << " pg_upmap and "
+	 << inc.old_pg_upmap_items.size() << " pg_upmap_items entries"
+	 << std::endl;
+    osdmap.apply_incremental(inc);
+    modified = true;
+  }
 
   if (!import_crush.empty()) {
     bufferlist cbl;
@@ -26,6 +26,7 @@ using namespace libradosstriper;
 #include "common/debug.h"
 #include "common/errno.h"
 #include "common/Formatter.h"
+#include "compressor/Compressor.h"
 #include "common/obj_bencher.h"
 #include "common/TextTable.h"
 #include "include/stringify.h"
@@ -76,6 +77,10 @@ void usage(ostream& out)
 "                                    remove all objects from pool <pool-name> without removing it\n"
 "   df                               show per-pool and total usage\n"
 "   ls                               list objects in pool\n\n"
+"   train-compression-dict [--max-objects N] [--dict-size B]\n"
+"                                    train a zstd dictionary on samples of up\n"
+"                                    to N objects (default 1000) and add it to\n"
+"                                    the pool's compression_dictionaries\n"
 "   chown 123                        change the pool owner to auid 123\n"
 "\n"
 "POOL SNAP COMMANDS\n"
@@ -101,7 +106,7 @@ void usage(ostream& out)
 "   rollback <obj-name> <snap-name>  roll back object to snap <snap-name>\n"
 "\n"
 "   listsnaps <obj-name>             list the snapshots of this object\n"
-"   bench <seconds> write|seq|rand [-t concurrent_operations] [--no-cleanup] [--run-name run_name] [--no-hints]\n"
+"   bench <seconds> write|seq|rand|mixed [-t concurrent_operations] [--no-cleanup] [--run-name run_name] [--no-hints]\n"
 "                                    default is 16 concurrent IOs and 4 MB ops\n"
 "                                    default is to clean up after write benchmark\n"
 "                                    default run-name is 'benchmark_last_metadata'\n"
@@ -172,7 +177,10 @@ void usage(ostream& out)
 "   -o object_size\n"
 "        set the object size for put/get ops and for write benchmarking\n"
 "   --max-objects\n"
-"        set the max number of objects for write benchmarking\n"
+"        set the max number of objects for write benchmarking, or to sample\n"
+"        for train-compression-dict\n"
+"   --dict-size\n"
+"        set the max size of a trained compression dictionary (default 16384)\n"
 "   -s name\n"
 "   --snap name\n"
 "        select given snap name for (read) IO\n"
@@ -211,6 +219,20 @@ void usage(ostream& out)
 "        write contents to the omap\n"
 "   --write-xattr\n"
 "        write contents to the extended attributes\n"
+"   --mix R:W:D\n"
+"        shares of reads, writes and removes for the mixed benchmark\n"
+"        (default 70:30:0)\n"
+"   --min-object-size N\n"
+"        mixed benchmark object sizes are uniformly distributed between\n"
+"        this and the object size (default: all of the object size)\n"
+"   --target-iops N\n"
+"        open loop: start N mixed benchmark ops per second, whatever their\n"
+"        latency, instead of keeping -t ops in flight\n"
+"   --csv file\n"
+"        write a line of per-second results to file\n"
+"   --start-at unixtime\n"
+"        wait until then to start, to run benchmarks from several hosts\n"
+"        together\n"
 "\n"
 "LOAD GEN OPTIONS:\n"
 "   --num-objects                    total number of objects\n"
@@ -1599,6 +1621,106 @@ static int do_get_inconsistent_cmd(const std::vector<const char*> &nargs,
 /**********************************************
 
 **********************************************/
+static int do_train_compression_dict(Rados& rados, IoCtx& io_ctx,
+				     const char *pool_name,
+				     unsigned max_objects, unsigned dict_size)
+{
+  CompressorRef c = Compressor::create(g_ceph_context, "zstd");
+  if (!c) {
+    cerr << "unable to load the zstd compressor" << std::endl;
+    return -ENOENT;
+  }
+
+  // sample the start of objects, in pieces the size of the blobs that
+  // bluestore compresses
+  uint64_t sample_len = g_conf->bluestore_compression_max_blob_size;
+  vector<bufferlist> samples;
+  try {
+    librados::NObjectIterator i = io_ctx.nobjects_begin();
+    librados::NObjectIterator i_end = io_ctx.nobjects_end();
+    for (; i != i_end && samples.size() < max_objects; ++i) {
+      io_ctx.locator_set_key(i->get_locator());
+      bufferlist bl;
+      int r = io_ctx.read(i->get_oid(), bl, sample_len, 0);
+      if (r == -ENOENT) {
+	continue;
+      }
+      if (r < 0) {
+	cerr << "error reading " << pool_name << "/" << i->get_oid() << ": "
+	     << cpp_strerror(r) << std::endl;
+	return r;
+      }
+      if (bl.length()) {
+	samples.push_back(std::move(bl));
+      }
+    }
+  } catch (const std::runtime_error& e) {
+    cerr << e.what() << std::endl;
+    return -EIO;
+  }
+  io_ctx.locator_set_key(string());
+
+  bufferlist dict;
+  int r = c->train_dictionary(samples, dict_size, &dict);
+  if (r < 0) {
+    cerr << "failed to train a dictionary from " << samples.size()
+	 << " samples: " << cpp_strerror(r) << std::endl;
+    return r;
+  }
+
+  // add it to the pool's dictionaries; the older ones still decompress
+  // what was written with them
+  bufferlist inbl, outbl;
+  string outs;
+  JSONFormatter jf;
+  jf.open_object_section("cmd");
+  jf.dump_string("prefix", "osd pool get");
+  jf.dump_string("pool", pool_name);
+  jf.dump_string("var", "compression_dictionaries");
+  jf.close_section();
+  stringstream cmd;
+  jf.flush(cmd);
+  r = rados.mon_command(cmd.str(), inbl, &outbl, &outs);
+  if (r < 0) {
+    cerr << "error getting compression_dictionaries: " << outs << std::endl;
+    return r;
+  }
+  // "compression_dictionaries: <value>", or nothing if unset
+  map<uint32_t, bufferlist> dicts;
+  string out = outbl.to_str();
+  size_t pos = out.find(": ");
+  if (pos != string::npos) {
+    size_t end = out.find_first_of("\n", pos);
+    string val = out.substr(pos + 2, end == string::npos ? end : end - pos - 2);
+    if (Compressor::decode_dictionaries(val, &dicts) < 0) {
+      cerr << "error decoding compression_dictionaries" << std::endl;
+      return -EINVAL;
+    }
+  }
+  uint32_t id = dicts.empty() ? 1 : dicts.rbegin()->first + 1;
+  dicts[id] = dict;
+
+  JSONFormatter sf;
+  sf.open_object_section("cmd");
+  sf.dump_string("prefix", "osd pool set");
+  sf.dump_string("pool", pool_name);
+  sf.dump_string("var", "compression_dictionaries");
+  sf.dump_string("val", Compressor::encode_dictionaries(dicts));
+  sf.close_section();
+  cmd.str("");
+  sf.flush(cmd);
+  outbl.clear();
+  r = rados.mon_command(cmd.str(), inbl, &outbl, &outs);
+  if (r < 0) {
+    cerr << "error setting compression_dictionaries: " << outs << std::endl;
+    return r;
+  }
+  cout << "added dictionary " << id << " (" << dict.length()
+       << " bytes, from " << samples.size() << " samples) to pool "
+       << pool_name << std::endl;
+  return 0;
+}
+
 static int rados_tool_common(const std::map < std::string, std::string > &opts,
                              std::vector<const char*> &nargs)
 {
@@ -1611,6 +1733,7 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
   unsigned op_size = default_op_size;
   unsigned object_size = 0;
   unsigned max_objects = 0;
+  unsigned dict_size = 16384;
   uint64_t obj_offset = 0;
   bool block_size_specified = false;
   int bench_write_dest = 0;
@@ -1714,6 +1837,12 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
       return -EINVAL;
     }
   }
+  i = opts.find("dict-size");
+  if (i != opts.end()) {
+    if (rados_sistrtoll(i, &dict_size)) {
+      return -EINVAL;
+    }
+  }
   i = opts.find("offset");
   if (i != opts.end()) {
     if (rados_sistrtoll(i, &obj_offset)) {
@@ -2118,6 +2247,18 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
     }
   }
 
+  else if (strcmp(nargs[0], "train-compression-dict") == 0) {
+    if (!pool_name) {
+      cerr << "pool name was not specified" << std::endl;
+      ret = -1;
+      goto out;
+    }
+    ret = do_train_compression_dict(rados, io_ctx, pool_name,
+				    max_objects ? max_objects : 1000,
+				    dict_size);
+    if (ret < 0)
+      goto out;
+  }
   else if (strcmp(nargs[0], "ls") == 0) {
     if (!pool_name) {
       cerr << "pool name was not specified" << std::endl;
@@ -2954,9 +3095,11 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
       operation = OP_SEQ_READ;
     else if (strcmp(nargs[2], "rand") == 0)
       operation = OP_RAND_READ;
+    else if (strcmp(nargs[2], "mixed") == 0)
+      operation = OP_MIXED;
     else
       usage_exit();
-    if (operation != OP_WRITE) {
+    if (operation != OP_WRITE && operation != OP_MIXED) {
       if (block_size_specified) {
         cerr << "-b|--block_size option can be used only with `write' bench test"
              << std::endl;
@@ -2985,6 +3128,44 @@ static int rados_tool_common(const std::map < std::string, std::string > &opts,
     bencher.set_show_time(show_time);
     bencher.set_write_destination(static_cast<OpWriteDest>(bench_write_dest));
 
+    i = opts.find("mix");
+    if (i != opts.end()) {
+      unsigned mr, mw, md;
+      if (sscanf(i->second.c_str(), "%u:%u:%u", &mr, &mw, &md) != 3 ||
+	  mw == 0) {
+	cerr << "--mix must be R:W:D with some writes" << std::endl;
+	ret = -EINVAL;
+	goto out;
+      }
+      bencher.set_mix(mr, mw, md);
+    }
+    i = opts.find("min-object-size");
+    if (i != opts.end()) {
+      uint64_t min_object_size;
+      if (rados_sistrtoll(i, &min_object_size)) {
+	ret = -EINVAL;
+	goto out;
+      }
+      bencher.set_min_object_size(min_object_size);
+    }
+    i = opts.find("target-iops");
+    if (i != opts.end())
+      bencher.set_target_iops(atof(i->second.c_str()));
+    i = opts.find("start-at");
+    if (i != opts.end())
+      bencher.set_start_at(utime_t(atof(i->second.c_str()), 0));
+    std::unique_ptr<ofstream> csv;
+    i = opts.find("csv");
+    if (i != opts.end()) {
+      csv.reset(new ofstream(i->second.c_str()));
+      if (!*csv) {
+	cerr << "cannot open " << i->second << std::endl;
+	ret = -EINVAL;
+	goto out;
+      }
+      bencher.set_csv(*csv);
+    }
+
     ostream *outstream = NULL;
     if (formatter) {
       bencher.set_formatter(formatter);
@@ -3578,6 +3759,16 @@ int main(int argc, const char **argv)
       opts["no-verify"] = "true";
     } else if (ceph_argparse_witharg(args, i, &val, "--run-name", (char*)NULL)) {
       opts["run-name"] = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--mix", (char*)NULL)) {
+      opts["mix"] = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--min-object-size", (char*)NULL)) {
+      opts["min-object-size"] = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--target-iops", (char*)NULL)) {
+      opts["target-iops"] = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--csv", (char*)NULL)) {
+      opts["csv"] = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--start-at", (char*)NULL)) {
+      opts["start-at"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "--prefix", (char*)NULL)) {
       opts["prefix"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "-p", "--pool", (char*)NULL)) {
@@ -3602,6 +3793,8 @@ int main(int argc, const char **argv)
       opts["object-size"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "--max-objects", (char*)NULL)) {
       opts["max-objects"] = val;
+    } else if (ceph_argparse_witharg(args, i, &val, "--dict-size", (char*)NULL)) {
+      opts["dict-size"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "--offset", (char*)NULL)) {
       opts["offset"] = val;
     } else if (ceph_argparse_witharg(args, i, &val, "-o", (char*)NULL)) {
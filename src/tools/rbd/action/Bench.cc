@@ -7,7 +7,11 @@
 #include "common/errno.h"
 #include "common/strtol.h"
 #include "common/Cond.h"
+#include "common/Formatter.h"
+#include "common/LatencyHistogram.h"
 #include "common/Mutex.h"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <boost/accumulators/accumulators.hpp>
 #include <boost/accumulators/statistics/stats.hpp>
@@ -26,6 +30,7 @@ namespace {
 enum io_type_t {
   IO_TYPE_READ = 0,
   IO_TYPE_WRITE,
+  IO_TYPE_RW,
 
   IO_TYPE_NUM,
 };
@@ -65,6 +70,8 @@ io_type_t get_io_type(string io_type_string) {
     return IO_TYPE_READ;
   else if (io_type_string == "write")
     return IO_TYPE_WRITE;
+  else if (io_type_string == "readwrite" || io_type_string == "rw")
+    return IO_TYPE_RW;
   else
     return IO_TYPE_NUM;
 }
@@ -80,6 +87,39 @@ void validate(boost::any& v, const std::vector<std::string>& values,
     v = boost::any(io_type);
 }
 
+const char *io_type_name(io_type_t io_type) {
+  switch (io_type) {
+  case IO_TYPE_READ:
+    return "read";
+  case IO_TYPE_WRITE:
+    return "write";
+  case IO_TYPE_RW:
+    return "readwrite";
+  default:
+    return "unknown";
+  }
+}
+
+const double PERCENTILES[] = {50, 90, 99, 99.9, 99.99};
+
+struct OpStats {
+  uint64_t ops = 0;
+  uint64_t bytes = 0;
+  LatencyHistogram latency;
+
+  void merge(const OpStats &other) {
+    ops += other.ops;
+    bytes += other.bytes;
+    latency.merge(other.latency);
+  }
+};
+
+struct ImageSpec {
+  std::string pool_name;
+  std::string image_name;
+  std::string snap_name;
+};
+
 } // anonymous namespace
 
 static void rbd_bencher_completion(void *c, void *pc);
@@ -87,11 +127,14 @@ struct rbd_bencher;
 
 struct bencher_completer {
   rbd_bencher *bencher;
+  io_type_t io_type;
+  utime_t due;
   bufferlist *bl;
 
 public:
-  bencher_completer(rbd_bencher *bencher, bufferlist *bl)
-    : bencher(bencher), bl(bl)
+  bencher_completer(rbd_bencher *bencher, io_type_t io_type, utime_t due,
+                    bufferlist *bl)
+    : bencher(bencher), io_type(io_type), due(due), bl(bl)
   { }
 
   ~bencher_completer()
@@ -101,31 +144,42 @@ public:
   }
 };
 
+// one per image; the lock and cond are shared by all of them
 struct rbd_bencher {
   librbd::Image *image;
-  Mutex lock;
-  Cond cond;
+  std::string name;
+  Mutex &lock;
+  Cond &cond;
   int in_flight;
-  io_type_t io_type;
   uint64_t io_size;
   bufferlist write_bl;
+  OpStats stats[IO_TYPE_RW];       ///< by IO_TYPE_READ/IO_TYPE_WRITE
+
+  // only used by the thread issuing IO
+  uint64_t size = 0;
+  uint64_t issued = 0;
+  uint64_t off = 0;
+  std::vector<uint64_t> thread_offset;
+  size_t next_thread = 0;
 
-  explicit rbd_bencher(librbd::Image *i, io_type_t io_type, uint64_t io_size)
+  rbd_bencher(librbd::Image *i, const std::string &name, Mutex &lock,
+              Cond &cond, io_type_t io_type, uint64_t io_size)
     : image(i),
-      lock("rbd_bencher::lock"),
+      name(name),
+      lock(lock),
+      cond(cond),
       in_flight(0),
-      io_type(io_type),
       io_size(io_size)
   {
-    if (io_type == IO_TYPE_WRITE) {
+    if (io_type != IO_TYPE_READ) {
       bufferptr bp(io_size);
       memset(bp.c_str(), rand() & 0xff, io_size);
       write_bl.push_back(bp);
     }
   }
 
-
-  bool start_io(int max, uint64_t off, uint64_t len, int op_flags)
+  bool start_io(int max, io_type_t io_type, uint64_t off, uint64_t len,
+                int op_flags, utime_t due)
   {
     {
       Mutex::Locker l(lock);
@@ -137,12 +191,14 @@ struct rbd_bencher {
     librbd::RBD::AioCompletion *c;
     if (io_type == IO_TYPE_READ) {
       bufferlist *read_bl = new bufferlist();
-      c = new librbd::RBD::AioCompletion((void *)(new bencher_completer(this, read_bl)),
-					 rbd_bencher_completion);
+      c = new librbd::RBD::AioCompletion(
+        (void *)(new bencher_completer(this, io_type, due, read_bl)),
+        rbd_bencher_completion);
       image->aio_read2(off, len, *read_bl, c, op_flags);
     } else if (io_type == IO_TYPE_WRITE) {
-      c = new librbd::RBD::AioCompletion((void *)(new bencher_completer(this, NULL)),
-					 rbd_bencher_completion);
+      c = new librbd::RBD::AioCompletion(
+        (void *)(new bencher_completer(this, io_type, due, NULL)),
+        rbd_bencher_completion);
       image->aio_write2(off, len, write_bl, c, op_flags);
     } else {
       assert(0 == "Invalid io_type");
@@ -150,16 +206,6 @@ struct rbd_bencher {
     //cout << "start " << c << " at " << off << "~" << len << std::endl;
     return true;
   }
-
-  void wait_for(int max) {
-    Mutex::Locker l(lock);
-    while (in_flight > max) {
-      utime_t dur;
-      dur.set_from_double(.2);
-      cond.WaitInterval(lock, dur);
-    }
-  }
-
 };
 
 void rbd_bencher_completion(void *vc, void *pc)
@@ -169,14 +215,19 @@ void rbd_bencher_completion(void *vc, void *pc)
   rbd_bencher *b = bc->bencher;
   //cout << "complete " << c << std::endl;
   int ret = c->get_return_value();
-  if (b->io_type == IO_TYPE_WRITE && ret != 0) {
+  if (bc->io_type == IO_TYPE_WRITE && ret != 0) {
     cout << "write error: " << cpp_strerror(ret) << std::endl;
     exit(ret < 0 ? -ret : ret);
-  } else if (b->io_type == IO_TYPE_READ && (unsigned int)ret != b->io_size) {
+  } else if (bc->io_type == IO_TYPE_READ && (unsigned int)ret != b->io_size) {
     cout << "read error: " << cpp_strerror(ret) << std::endl;
     exit(ret < 0 ? -ret : ret);
   }
+  utime_t latency = ceph_clock_now() - bc->due;
   b->lock.Lock();
+  OpStats &stats = b->stats[bc->io_type];
+  ++stats.ops;
+  stats.bytes += b->io_size;
+  stats.latency.add(latency.to_nsec() / 1000);
   b->in_flight--;
   b->cond.Signal();
   b->lock.Unlock();
@@ -184,49 +235,99 @@ void rbd_bencher_completion(void *vc, void *pc)
   delete bc;
 }
 
-int do_bench(librbd::Image& image, io_type_t io_type,
-		   uint64_t io_size, uint64_t io_threads,
-		   uint64_t io_bytes, bool random)
-{
-  uint64_t size = 0;
-  image.size(&size);
-  if (io_size > size) {
-    std::cerr << "rbd: io-size " << prettybyte_t(io_size) << " "
-              << "larger than image size " << prettybyte_t(size) << std::endl;
-    return -EINVAL;
+void dump_stats(Formatter *f, const char *name, const OpStats &stats,
+                double elapsed) {
+  const LatencyHistogram &lat = stats.latency;
+  if (f) {
+    f->open_object_section(name);
+    f->dump_unsigned("ops", stats.ops);
+    f->dump_unsigned("bytes", stats.bytes);
+    f->dump_float("ops_per_sec", stats.ops / elapsed);
+    f->dump_float("bytes_per_sec", stats.bytes / elapsed);
+    f->open_object_section("latency_usec");
+    f->dump_unsigned("min", lat.min());
+    f->dump_float("mean", lat.mean());
+    f->dump_unsigned("max", lat.max());
+    for (double p : PERCENTILES) {
+      std::ostringstream oss;
+      oss << "p" << p;
+      f->dump_unsigned(oss.str().c_str(), lat.percentile(p));
+    }
+    f->close_section();
+    f->close_section();
+    return;
+  }
+
+  printf("%-5s  ops: %8lu  ops/sec: %8.2lf  bytes/sec: %8.2lf\n", name,
+         (unsigned long)stats.ops, stats.ops / elapsed,
+         stats.bytes / elapsed);
+  printf("%-5s  latency (usec): min %lu  avg %.0lf", name,
+         (unsigned long)lat.min(), lat.mean());
+  for (double p : PERCENTILES) {
+    printf("  p%g %lu", p, (unsigned long)lat.percentile(p));
   }
+  printf("  max %lu\n", (unsigned long)lat.max());
+}
 
+int do_bench(std::vector<librbd::Image> &images,
+             const std::vector<std::string> &image_names, io_type_t io_type,
+             uint64_t io_size, uint64_t io_threads, uint64_t io_bytes,
+             bool random, uint64_t rw_mix_read, uint64_t rate, Formatter *f)
+{
   if (io_size > std::numeric_limits<uint32_t>::max()) {
     std::cerr << "rbd: io-size should be less than 4G" << std::endl;
     return -EINVAL;
   }
 
-  rbd_bencher b(&image, io_type, io_size);
-
-  std::cout << "bench "
-       << " type " << (io_type == IO_TYPE_READ ? "read" : "write")
-       << " io_size " << io_size
-       << " io_threads " << io_threads
-       << " bytes " << io_bytes
-       << " pattern " << (random ? "random" : "sequential")
-       << std::endl;
-
   srand(time(NULL) % (unsigned long) -1);
 
-  utime_t start = ceph_clock_now();
-  utime_t last;
-  unsigned ios = 0;
+  Mutex lock("rbd_bencher::lock");
+  Cond cond;
+  std::vector<std::unique_ptr<rbd_bencher> > benchers;
+  for (size_t n = 0; n < images.size(); ++n) {
+    uint64_t size = 0;
+    images[n].size(&size);
+    if (io_size > size) {
+      std::cerr << "rbd: io-size " << prettybyte_t(io_size) << " "
+                << "larger than image " << image_names[n] << " size "
+                << prettybyte_t(size) << std::endl;
+      return -EINVAL;
+    }
 
-  vector<uint64_t> thread_offset;
-  uint64_t i;
-  uint64_t start_pos;
+    benchers.emplace_back(new rbd_bencher(&images[n], image_names[n], lock,
+                                          cond, io_type, io_size));
+    rbd_bencher &b = *benchers.back();
+    b.size = size;
 
-  // disturb all thread's offset, used by seq IO
-  for (i = 0; i < io_threads; i++) {
-    start_pos = (rand() % (size / io_size)) * io_size;
-    thread_offset.push_back(start_pos);
+    // disturb all thread's offset, used by seq IO
+    for (uint64_t i = 0; i < io_threads; i++) {
+      b.thread_offset.push_back((rand() % (size / io_size)) * io_size);
+    }
   }
 
+  if (!f) {
+    std::cout << "bench "
+         << " type " << io_type_name(io_type)
+         << " io_size " << io_size
+         << " io_threads " << io_threads
+         << " bytes " << io_bytes
+         << " pattern " << (random ? "random" : "sequential");
+    if (io_type == IO_TYPE_RW) {
+      std::cout << " read:write " << rw_mix_read << ":" << 100 - rw_mix_read;
+    }
+    if (rate > 0) {
+      std::cout << " rate " << rate;
+    }
+    if (benchers.size() > 1) {
+      std::cout << " images " << benchers.size();
+    }
+    std::cout << std::endl;
+  }
+
+  utime_t start = ceph_clock_now();
+  utime_t last;
+  uint64_t ios = 0;
+
   const int WINDOW_SIZE = 5;
   typedef boost::accumulators::accumulator_set<
     double, boost::accumulators::stats<
@@ -248,32 +349,66 @@ int do_bench(librbd::Image& image, io_type_t io_type,
     op_flags = LIBRADOS_OP_FLAG_FADVISE_SEQUENTIAL;
   }
 
-  printf("  SEC       OPS   OPS/SEC   BYTES/SEC\n");
-  uint64_t off;
-  for (off = 0; off < io_bytes; ) {
-    b.wait_for(io_threads - 1);
-    i = 0;
-    while (i < io_threads && off < io_bytes) {
-      if (random) {
-        thread_offset[i] = (rand() % (size / io_size)) * io_size;
-      } else {
-        thread_offset[i] += io_size;
-        if (thread_offset[i] + io_size > size)
-          thread_offset[i] = 0;
+  if (!f) {
+    printf("  SEC       OPS   OPS/SEC   BYTES/SEC\n");
+  }
+  while (true) {
+    // with a target rate, IO is issued when it is due whether or not
+    // earlier IO has completed, and its latency counts from then
+    utime_t now = ceph_clock_now();
+    utime_t next_due;
+    std::vector<bool> waiting_for_rate(benchers.size(), false);
+    bool done = true;
+    for (size_t n = 0; n < benchers.size(); ++n) {
+      rbd_bencher &b = *benchers[n];
+      while (b.off < io_bytes) {
+        utime_t due = now;
+        if (rate > 0) {
+          due = start;
+          due += static_cast<double>(b.issued) / rate;
+          if (due > now) {
+            if (next_due.is_zero() || due < next_due) {
+              next_due = due;
+            }
+            waiting_for_rate[n] = true;
+            break;
+          }
+        }
+
+        uint64_t &offset = b.thread_offset[b.next_thread];
+        if (random) {
+          offset = (rand() % (b.size / io_size)) * io_size;
+        } else {
+          offset += io_size;
+          if (offset + io_size > b.size)
+            offset = 0;
+        }
+
+        io_type_t op_type = io_type;
+        if (io_type == IO_TYPE_RW) {
+          op_type = (static_cast<uint64_t>(rand() % 100) < rw_mix_read ?
+                       IO_TYPE_READ : IO_TYPE_WRITE);
+        }
+
+        if (!b.start_io(io_threads, op_type, offset, io_size, op_flags, due))
+          break;
+
+        b.next_thread = (b.next_thread + 1) % io_threads;
+        ++b.issued;
+        b.off += io_size;
+        ++ios;
+        ++cur_ios;
+        cur_off += io_size;
       }
-
-      if (!b.start_io(io_threads, thread_offset[i], io_size, op_flags))
-        break;
-
-      ++i;
-      ++ios;
-      off += io_size;
-
-      ++cur_ios;
-      cur_off += io_size;
+      if (b.off < io_bytes) {
+        done = false;
+      }
+    }
+    if (done) {
+      break;
     }
 
-    utime_t now = ceph_clock_now();
+    now = ceph_clock_now();
     utime_t elapsed = now - start;
     if (last.is_zero()) {
       last = elapsed;
@@ -285,34 +420,108 @@ int do_bench(librbd::Image& image, io_type_t io_type,
       cur_off = 0;
 
       double time_sum = boost::accumulators::rolling_sum(time_acc);
-      printf("%5d  %8d  %8.2lf  %8.2lf\n",
-             (int)elapsed,
-             (int)(ios - io_threads),
-             boost::accumulators::rolling_sum(ios_acc) / time_sum,
-             boost::accumulators::rolling_sum(off_acc) / time_sum);
+      if (!f) {
+        printf("%5d  %8d  %8.2lf  %8.2lf\n",
+               (int)elapsed,
+               (int)(ios - io_threads * benchers.size()),
+               boost::accumulators::rolling_sum(ios_acc) / time_sum,
+               boost::accumulators::rolling_sum(off_acc) / time_sum);
+      }
       last = elapsed;
     }
+
+    // wait for a completion unless some image can take more IO now
+    Mutex::Locker l(lock);
+    bool ready = false;
+    for (size_t n = 0; n < benchers.size(); ++n) {
+      if (!waiting_for_rate[n] && benchers[n]->off < io_bytes &&
+          benchers[n]->in_flight < static_cast<int>(io_threads)) {
+        ready = true;
+        break;
+      }
+    }
+    if (!ready) {
+      utime_t dur;
+      dur.set_from_double(.2);
+      if (!next_due.is_zero() && next_due - now < dur) {
+        dur = next_due - now;
+      }
+      cond.WaitInterval(lock, dur);
+    }
   }
-  b.wait_for(0);
-  int r = image.flush();
-  if (r < 0) {
-    std::cerr << "Error flushing data at the end: " << cpp_strerror(r)
-              << std::endl;
+
+  {
+    Mutex::Locker l(lock);
+    for (auto &b : benchers) {
+      while (b->in_flight > 0) {
+        cond.Wait(lock);
+      }
+    }
+  }
+  for (auto &b : benchers) {
+    int r = b->image->flush();
+    if (r < 0) {
+      std::cerr << "Error flushing data at the end: " << cpp_strerror(r)
+                << std::endl;
+    }
   }
 
   utime_t now = ceph_clock_now();
   double elapsed = now - start;
 
-  printf("elapsed: %5d  ops: %8d  ops/sec: %8.2lf  bytes/sec: %8.2lf\n",
-         (int)elapsed, ios, (double)ios / elapsed, (double)off / elapsed);
+  OpStats totals[IO_TYPE_RW];
+  for (auto &b : benchers) {
+    for (int t = 0; t < IO_TYPE_RW; ++t) {
+      totals[t].merge(b->stats[t]);
+    }
+  }
+  uint64_t off = io_bytes * benchers.size();
+
+  if (f) {
+    f->open_object_section("bench");
+    f->dump_string("io_type", io_type_name(io_type));
+    f->dump_unsigned("io_size", io_size);
+    f->dump_unsigned("io_threads", io_threads);
+    f->dump_unsigned("io_total", io_bytes);
+    f->dump_string("io_pattern", random ? "rand" : "seq");
+    if (io_type == IO_TYPE_RW) {
+      f->dump_unsigned("rw_mix_read", rw_mix_read);
+    }
+    f->dump_unsigned("rate", rate);
+    f->open_array_section("images");
+    for (auto &b : benchers) {
+      f->open_object_section("image");
+      f->dump_string("name", b->name);
+      f->dump_unsigned("ops", b->stats[IO_TYPE_READ].ops +
+                                b->stats[IO_TYPE_WRITE].ops);
+      f->close_section();
+    }
+    f->close_section();
+    f->dump_float("elapsed", elapsed);
+    f->dump_unsigned("ops", ios);
+    f->dump_float("ops_per_sec", ios / elapsed);
+    f->dump_float("bytes_per_sec", off / elapsed);
+  } else {
+    printf("elapsed: %5d  ops: %8d  ops/sec: %8.2lf  bytes/sec: %8.2lf\n",
+           (int)elapsed, (int)ios, (double)ios / elapsed,
+           (double)off / elapsed);
+  }
+  for (int t = 0; t < IO_TYPE_RW; ++t) {
+    if (totals[t].ops > 0) {
+      dump_stats(f, io_type_name(static_cast<io_type_t>(t)), totals[t],
+                 elapsed);
+    }
+  }
+  if (f) {
+    f->close_section();
+    f->flush(std::cout);
+  }
 
   return 0;
 }
 
 void add_bench_common_options(po::options_description *positional,
 			      po::options_description *options) {
-  at::add_image_spec_options(positional, options, at::ARGUMENT_MODIFIER_NONE);
-
   options->add_options()
     ("io-size", po::value<Size>(), "IO size (in B/K/M/G/T)")
     ("io-threads", po::value<uint32_t>(), "ios in flight")
@@ -322,32 +531,67 @@ void add_bench_common_options(po::options_description *positional,
 
 void get_arguments_for_write(po::options_description *positional,
                              po::options_description *options) {
+  at::add_image_spec_options(positional, options, at::ARGUMENT_MODIFIER_NONE);
   add_bench_common_options(positional, options);
 }
 
 void get_arguments_for_bench(po::options_description *positional,
                              po::options_description *options) {
+  positional->add_options()
+    (at::IMAGE_SPEC.c_str(),
+     po::value<std::vector<std::string> >()->multitoken(),
+     "image specification, one for each image to run against in parallel\n"
+     "(example: [<pool-name>/]<image-name>)");
+  at::add_pool_option(options, at::ARGUMENT_MODIFIER_NONE);
+  at::add_image_option(options, at::ARGUMENT_MODIFIER_NONE);
   add_bench_common_options(positional, options);
 
   options->add_options()
-    ("io-type", po::value<IOType>()->required(), "IO type (read or write)");
+    ("io-type", po::value<IOType>()->required(),
+     "IO type (read, write, or readwrite(rw))")
+    ("rw-mix-read", po::value<uint64_t>(),
+     "read proportion in readwrite (<= 100, default 50)")
+    ("rate", po::value<uint64_t>(),
+     "IOs per second to issue to each image, whether or not earlier IO "
+     "has completed");
+  at::add_format_options(options);
 }
 
 int bench_execute(const po::variables_map &vm, io_type_t bench_io_type) {
   size_t arg_index = 0;
-  std::string pool_name;
-  std::string image_name;
-  std::string snap_name;
   utils::SnapshotPresence snap_presence = utils::SNAPSHOT_PRESENCE_NONE;
   if (bench_io_type == IO_TYPE_READ)
     snap_presence = utils::SNAPSHOT_PRESENCE_PERMITTED;
 
+  std::vector<ImageSpec> specs(1);
   int r = utils::get_pool_image_snapshot_names(
-    vm, at::ARGUMENT_MODIFIER_NONE, &arg_index, &pool_name, &image_name,
-    &snap_name, snap_presence, utils::SPEC_VALIDATION_NONE);
+    vm, at::ARGUMENT_MODIFIER_NONE, &arg_index, &specs[0].pool_name,
+    &specs[0].image_name, &specs[0].snap_name, snap_presence,
+    utils::SPEC_VALIDATION_NONE);
   if (r < 0) {
     return r;
   }
+  for (std::string spec = utils::get_positional_argument(vm, arg_index++);
+       !spec.empty();
+       spec = utils::get_positional_argument(vm, arg_index++)) {
+    ImageSpec image_spec;
+    r = utils::extract_spec(spec, &image_spec.pool_name,
+                            &image_spec.image_name, &image_spec.snap_name,
+                            utils::SPEC_VALIDATION_NONE);
+    if (r < 0) {
+      return r;
+    }
+    if (image_spec.pool_name.empty()) {
+      image_spec.pool_name = (vm.count(at::POOL_NAME) ?
+        vm[at::POOL_NAME].as<std::string>() : at::DEFAULT_POOL_NAME);
+    }
+    r = utils::validate_snapshot_name(at::ARGUMENT_MODIFIER_NONE,
+                                      image_spec.snap_name, snap_presence);
+    if (r < 0) {
+      return r;
+    }
+    specs.push_back(image_spec);
+  }
 
   uint64_t bench_io_size;
   if (vm.count("io-size")) {
@@ -385,17 +629,60 @@ int bench_execute(const po::variables_map &vm, io_type_t bench_io_type) {
     bench_random = false;
   }
 
-  librados::Rados rados;
-  librados::IoCtx io_ctx;
-  librbd::Image image;
-  r = utils::init_and_open_image(pool_name, image_name, "", false, &rados,
-                                 &io_ctx, &image);
+  uint64_t bench_rw_mix_read = 50;
+  if (vm.count("rw-mix-read")) {
+    bench_rw_mix_read = vm["rw-mix-read"].as<uint64_t>();
+  }
+  if (bench_rw_mix_read > 100) {
+    std::cerr << "rbd: --rw-mix-read should not be greater than 100."
+              << std::endl;
+    return -EINVAL;
+  }
+
+  uint64_t bench_rate = 0;
+  if (vm.count("rate")) {
+    bench_rate = vm["rate"].as<uint64_t>();
+  }
+
+  at::Format::Formatter formatter;
+  r = utils::get_formatter(vm, &formatter);
   if (r < 0) {
     return r;
   }
 
-  r = do_bench(image, bench_io_type, bench_io_size, bench_io_threads,
-		     bench_bytes, bench_random);
+  librados::Rados rados;
+  std::vector<librados::IoCtx> io_ctxs(specs.size());
+  std::vector<librbd::Image> images(specs.size());
+  std::vector<std::string> image_names;
+  for (size_t n = 0; n < specs.size(); ++n) {
+    if (n == 0) {
+      r = utils::init(specs[n].pool_name, &rados, &io_ctxs[n]);
+    } else {
+      r = utils::init_io_ctx(rados, specs[n].pool_name, &io_ctxs[n]);
+    }
+    if (r < 0) {
+      return r;
+    }
+
+    r = utils::open_image(io_ctxs[n], specs[n].image_name,
+                          !specs[n].snap_name.empty(), &images[n]);
+    if (r < 0) {
+      return r;
+    }
+    std::string name = specs[n].pool_name + "/" + specs[n].image_name;
+    if (!specs[n].snap_name.empty()) {
+      r = utils::snap_set(images[n], specs[n].snap_name);
+      if (r < 0) {
+        return r;
+      }
+      name += "@" + specs[n].snap_name;
+    }
+    image_names.push_back(name);
+  }
+
+  r = do_bench(images, image_names, bench_io_type, bench_io_size,
+               bench_io_threads, bench_bytes, bench_random, bench_rw_mix_read,
+               bench_rate, formatter.get());
   if (r < 0) {
     std::cerr << "bench failed: " << cpp_strerror(r) << std::endl;
     return r;
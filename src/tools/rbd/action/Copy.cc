@@ -17,10 +17,22 @@ namespace po = boost::program_options;
 
 static int do_copy(librbd::Image &src, librados::IoCtx& dest_pp,
 		   const char *destname, librbd::ImageOptions& opts,
-		   bool no_progress)
+		   bool no_progress, bool deep)
 {
+  int r;
+  if (deep) {
+    utils::ProgressContext pc("Image deep copy", no_progress);
+    r = src.deep_copy_with_progress(dest_pp, destname, opts, pc);
+    if (r < 0) {
+      pc.fail();
+      return r;
+    }
+    pc.finish();
+    return 0;
+  }
+
   utils::ProgressContext pc("Image copy", no_progress);
-  int r = src.copy_with_progress3(dest_pp, destname, opts, pc);
+  r = src.copy_with_progress3(dest_pp, destname, opts, pc);
   if (r < 0){
     pc.fail();
     return r;
@@ -38,7 +50,7 @@ void get_arguments(po::options_description *positional,
   at::add_no_progress_option(options);
 }
 
-int execute(const po::variables_map &vm) {
+static int execute_copy(const po::variables_map &vm, bool deep) {
   size_t arg_index = 0;
   std::string pool_name;
   std::string image_name;
@@ -83,17 +95,29 @@ int execute(const po::variables_map &vm) {
   }
 
   r = do_copy(image, dst_io_ctx, dst_image_name.c_str(), opts,
-              vm[at::NO_PROGRESS].as<bool>());
+              vm[at::NO_PROGRESS].as<bool>(), deep);
   if (r < 0) {
-    std::cerr << "rbd: copy failed: " << cpp_strerror(r) << std::endl;
+    std::cerr << "rbd: " << (deep ? "deep " : "") << "copy failed: "
+              << cpp_strerror(r) << std::endl;
     return r;
   }
   return 0;
 }
 
+int execute(const po::variables_map &vm) {
+  return execute_copy(vm, false);
+}
+
+int execute_deep(const po::variables_map &vm) {
+  return execute_copy(vm, true);
+}
+
 Shell::Action action(
   {"copy"}, {"cp"}, "Copy src image to dest.", at::get_long_features_help(),
   &get_arguments, &execute);
+Shell::Action action_deep(
+  {"deep", "copy"}, {"deep", "cp"}, "Deep copy src image to dest.",
+  at::get_long_features_help(), &get_arguments, &execute_deep);
 
 } // namespace copy
 } // namespace action
@@ -9,6 +9,7 @@
 #include "common/errno.h"
 #include "common/Throttle.h"
 #include "include/encoding.h"
+#include "include/interval_set.h"
 #include <iostream>
 #include <fcntl.h>
 #include <stdlib.h>
@@ -461,16 +462,41 @@ static int do_export_v2(librbd::Image& image, librbd::image_info_t &info, int fd
   return r;
 }
 
+static int allocated_extent_cb(uint64_t offset, size_t length, int exists,
+                               void *arg) {
+  if (exists) {
+    auto allocated = reinterpret_cast<interval_set<uint64_t> *>(arg);
+    allocated->union_insert(offset, length);
+  }
+  return 0;
+}
+
 static int do_export_v1(librbd::Image& image, librbd::image_info_t &info, int fd,
 		        uint64_t period, int max_concurrent_ops, utils::ProgressContext &pc)
 {
   int r = 0;
   size_t file_size = 0;
+
+  // a file is left sparse where the object map shows that no object
+  // exists, so those periods need not be read at all
+  bool sparse = false;
+  interval_set<uint64_t> allocated;
+  uint64_t features;
+  if (fd != 1 && image.features(&features) == 0 &&
+      (features & RBD_FEATURE_FAST_DIFF) != 0) {
+    r = image.diff_iterate2(NULL, 0, info.size, true, true,
+                            allocated_extent_cb, &allocated);
+    sparse = (r == 0);
+  }
+
   SimpleThrottle throttle(max_concurrent_ops, false);
   for (uint64_t offset = 0; offset < info.size; offset += period) {
     if (throttle.pending_error()) {
       break;
     }
+    if (sparse && !allocated.intersects(offset, period)) {
+      continue;
+    }
 
     uint64_t length = min(period, info.size - offset);
     C_Export *ctx = new C_Export(throttle, image, file_size + offset, offset, length, fd);
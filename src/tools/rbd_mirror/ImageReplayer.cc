@@ -408,6 +408,8 @@ void ImageReplayer<I>::start(Context *on_finish, bool manual)
   journal::Settings settings;
   settings.commit_interval = cct->_conf->rbd_mirror_journal_commit_age;
   settings.max_fetch_bytes = cct->_conf->rbd_mirror_journal_max_fetch_bytes;
+  settings.max_prefetch_bytes =
+    cct->_conf->rbd_mirror_journal_max_prefetch_bytes;
 
   m_remote_journaler = new Journaler(m_threads->work_queue,
                                      m_threads->timer,
@@ -1141,6 +1143,7 @@ void ImageReplayer<I>::process_entry() {
 
   Context *on_ready = create_context_callback<
     ImageReplayer, &ImageReplayer<I>::handle_process_entry_ready>(this);
+  m_replayed_bytes.add(m_replay_entry.get_data().length());
   Context *on_commit = new C_ReplayCommitted(this, std::move(m_replay_entry));
 
   m_local_replay->process(m_event_entry, on_ready, on_commit);
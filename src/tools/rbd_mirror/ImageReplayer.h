@@ -111,6 +111,9 @@ public:
     Mutex::Locker locker(m_lock);
     return m_local_image_name;
   }
+  inline uint64_t get_replayed_bytes() const {
+    return m_replayed_bytes.read();
+  }
 
   void start(Context *on_finish = nullptr, bool manual = false);
   void stop(Context *on_finish = nullptr, bool manual = false,
@@ -321,6 +324,7 @@ private:
   librbd::journal::MirrorPeerClientMeta m_client_meta;
 
   ReplayEntry m_replay_entry;
+  atomic64_t m_replayed_bytes;
   bool m_replay_tag_valid = false;
   uint64_t m_replay_tag_tid = 0;
   cls::journal::Tag m_replay_tag;
@@ -8,6 +8,7 @@
 #include "cls/rbd/cls_rbd_client.h"
 #include "librbd/ManagedLock.h"
 #include "librbd/Utils.h"
+#include "librbd/watcher/Notifier.h"
 
 #define dout_context g_ceph_context
 #define dout_subsys ceph_subsys_rbd_mirror
@@ -21,6 +22,9 @@ namespace mirror {
 using librbd::util::create_async_context_callback;
 using librbd::util::create_context_callback;
 using librbd::util::create_rados_ack_callback;
+using librbd::watcher::C_NotifyAck;
+
+using namespace instance_watcher;
 
 namespace {
 
@@ -65,6 +69,50 @@ struct RemoveInstanceRequest : public Context {
   }
 };
 
+struct C_NotifyInstance : public Context {
+  bufferlist *response;
+  Context *on_finish;
+  bufferlist out_bl;
+
+  C_NotifyInstance(bufferlist *response, Context *on_finish)
+    : response(response), on_finish(on_finish) {
+  }
+
+  void finish(int r) override {
+    if (r < 0 && r != -ETIMEDOUT) {
+      on_finish->complete(r);
+      return;
+    }
+
+    typedef std::map<std::pair<uint64_t, uint64_t>, bufferlist> responses_t;
+    typedef std::set<std::pair<uint64_t, uint64_t> > timeouts_t;
+    responses_t responses;
+    timeouts_t timeouts;
+    if (out_bl.length() > 0) {
+      try {
+        bufferlist::iterator iter = out_bl.begin();
+        ::decode(responses, iter);
+        ::decode(timeouts, iter);
+      } catch (const buffer::error &err) {
+        on_finish->complete(-EBADMSG);
+        return;
+      }
+    }
+
+    if (responses.empty()) {
+      // either the instance did not answer in time or nobody is watching
+      // its object any more
+      on_finish->complete(timeouts.empty() ? -ENOENT : -ETIMEDOUT);
+      return;
+    }
+
+    if (response != nullptr) {
+      response->claim(responses.begin()->second);
+    }
+    on_finish->complete(0);
+  }
+};
+
 } // anonymous namespace
 
 template <typename I>
@@ -94,10 +142,12 @@ void InstanceWatcher<I>::remove_instance(librados::IoCtx &io_ctx,
 template <typename I>
 InstanceWatcher<I>::InstanceWatcher(librados::IoCtx &io_ctx,
                                     ContextWQ *work_queue,
-                                    const boost::optional<std::string> &id)
+                                    const boost::optional<std::string> &id,
+                                    Listener *listener)
   : Watcher(io_ctx, work_queue, RBD_MIRROR_INSTANCE_PREFIX +
             (id ? *id : stringify(io_ctx.get_instance_id()))),
     m_instance_id(id ? *id : stringify(io_ctx.get_instance_id())),
+    m_listener(listener),
     m_lock("rbd::mirror::InstanceWatcher " + io_ctx.get_pool_name()),
     m_instance_lock(librbd::ManagedLock<I>::create(
       m_ioctx, m_work_queue, m_oid, this, librbd::managed_lock::EXCLUSIVE, true,
@@ -167,10 +217,145 @@ void InstanceWatcher<I>::remove(Context *on_finish) {
 template <typename I>
 void InstanceWatcher<I>::handle_notify(uint64_t notify_id, uint64_t handle,
                                        uint64_t notifier_id, bufferlist &bl) {
-  dout(20) << dendl;
+  dout(20) << "notify_id=" << notify_id << ", handle=" << handle << ", "
+           << "notifier_id=" << notifier_id << dendl;
+
+  C_NotifyAck *ctx = new C_NotifyAck(this, notify_id, handle);
+
+  NotifyMessage notify_message;
+  try {
+    bufferlist::iterator iter = bl.begin();
+    ::decode(notify_message, iter);
+  } catch (const buffer::error &err) {
+    derr << ": error decoding image notification: " << err.what() << dendl;
+    ctx->complete(0);
+    return;
+  }
+
+  apply_visitor(HandlePayloadVisitor(this, ctx), notify_message.payload);
+}
+
+template <typename I>
+void InstanceWatcher<I>::notify_image_acquire(
+    const std::string &instance_id, const std::string &global_image_id,
+    const std::string &remote_image_id, Context *on_notify_ack) {
+  dout(20) << "instance_id=" << instance_id << ", global_image_id="
+           << global_image_id << dendl;
+
+  notify_instance(instance_id,
+                  ImageAcquirePayload(global_image_id, remote_image_id),
+                  nullptr, on_notify_ack);
+}
+
+template <typename I>
+void InstanceWatcher<I>::notify_image_release(
+    const std::string &instance_id, const std::string &global_image_id,
+    bool schedule_delete, Context *on_notify_ack) {
+  dout(20) << "instance_id=" << instance_id << ", global_image_id="
+           << global_image_id << ", schedule_delete=" << schedule_delete
+           << dendl;
+
+  notify_instance(instance_id,
+                  ImageReleasePayload(global_image_id, schedule_delete),
+                  nullptr, on_notify_ack);
+}
+
+template <typename I>
+void InstanceWatcher<I>::notify_get_image_rates(const std::string &instance_id,
+                                                ImageRates *image_rates,
+                                                Context *on_notify_ack) {
+  dout(20) << "instance_id=" << instance_id << dendl;
+
+  bufferlist *response = new bufferlist();
+  Context *ctx = new FunctionContext(
+    [response, image_rates, on_notify_ack](int r) {
+      if (r == 0) {
+        try {
+          bufferlist::iterator iter = response->begin();
+          ::decode(*image_rates, iter);
+        } catch (const buffer::error &err) {
+          r = -EBADMSG;
+        }
+      }
+      delete response;
+      on_notify_ack->complete(r);
+    });
+  notify_instance(instance_id, GetImageRatesPayload(), response, ctx);
+}
+
+template <typename I>
+void InstanceWatcher<I>::notify_instance(const std::string &instance_id,
+                                         const Payload &payload,
+                                         bufferlist *response,
+                                         Context *on_notify_ack) {
+  bufferlist bl;
+  ::encode(NotifyMessage(payload), bl);
+
+  C_NotifyInstance *ctx = new C_NotifyInstance(
+    response, create_async_context_callback(m_work_queue, on_notify_ack));
+  librados::AioCompletion *aio_comp = create_rados_ack_callback(ctx);
+  int r = m_ioctx.aio_notify(RBD_MIRROR_INSTANCE_PREFIX + instance_id,
+                             aio_comp, bl,
+                             librbd::watcher::Notifier::NOTIFY_TIMEOUT,
+                             &ctx->out_bl);
+  assert(r == 0);
+  aio_comp->release();
+}
+
+template <typename I>
+void InstanceWatcher<I>::handle_payload(const ImageAcquirePayload &payload,
+                                        C_NotifyAck *on_notify_ack) {
+  dout(20) << "image_acquire: global_image_id=" << payload.global_image_id
+           << dendl;
+
+  if (m_listener == nullptr) {
+    on_notify_ack->complete(0);
+    return;
+  }
+  m_listener->handle_image_acquire(payload.global_image_id,
+                                   payload.remote_image_id, on_notify_ack);
+}
+
+template <typename I>
+void InstanceWatcher<I>::handle_payload(const ImageReleasePayload &payload,
+                                        C_NotifyAck *on_notify_ack) {
+  dout(20) << "image_release: global_image_id=" << payload.global_image_id
+           << ", schedule_delete=" << payload.schedule_delete << dendl;
+
+  if (m_listener == nullptr) {
+    on_notify_ack->complete(0);
+    return;
+  }
+  m_listener->handle_image_release(payload.global_image_id,
+                                   payload.schedule_delete, on_notify_ack);
+}
+
+template <typename I>
+void InstanceWatcher<I>::handle_payload(const GetImageRatesPayload &payload,
+                                        C_NotifyAck *on_notify_ack) {
+  dout(20) << "get_image_rates" << dendl;
+
+  if (m_listener == nullptr) {
+    on_notify_ack->complete(0);
+    return;
+  }
+
+  ImageRates *image_rates = new ImageRates();
+  Context *ctx = new FunctionContext(
+    [image_rates, on_notify_ack](int r) {
+      ::encode(*image_rates, on_notify_ack->out);
+      delete image_rates;
+      on_notify_ack->complete(0);
+    });
+  m_listener->handle_get_image_rates(image_rates, ctx);
+}
+
+template <typename I>
+void InstanceWatcher<I>::handle_payload(const UnknownPayload &payload,
+                                        C_NotifyAck *on_notify_ack) {
+  dout(20) << "unknown" << dendl;
 
-  bufferlist out;
-  acknowledge_notify(notify_id, handle, out);
+  on_notify_ack->complete(0);
 }
 
 template <typename I>
@@ -10,6 +10,8 @@
 
 #include "librbd/Watcher.h"
 #include "librbd/managed_lock/Types.h"
+#include "librbd/watcher/Types.h"
+#include "tools/rbd_mirror/instance_watcher/Types.h"
 
 namespace librbd {
   class ImageCtx;
@@ -22,6 +24,25 @@ namespace mirror {
 template <typename ImageCtxT = librbd::ImageCtx>
 class InstanceWatcher : protected librbd::Watcher {
 public:
+  typedef instance_watcher::ImageRates ImageRates;
+
+  /**
+   * Handles the requests the leader sends to this instance
+   */
+  struct Listener {
+    virtual ~Listener() {
+    }
+
+    virtual void handle_image_acquire(const std::string &global_image_id,
+                                      const std::string &remote_image_id,
+                                      Context *on_finish) = 0;
+    virtual void handle_image_release(const std::string &global_image_id,
+                                      bool schedule_delete,
+                                      Context *on_finish) = 0;
+    virtual void handle_get_image_rates(ImageRates *image_rates,
+                                        Context *on_finish) = 0;
+  };
+
   static void get_instances(librados::IoCtx &io_ctx,
                             std::vector<std::string> *instance_ids,
                             Context *on_finish);
@@ -31,17 +52,23 @@ public:
 
   static InstanceWatcher *create(
     librados::IoCtx &io_ctx, ContextWQ *work_queue,
-    const boost::optional<std::string> &id = boost::none) {
-    return new InstanceWatcher(io_ctx, work_queue, id);
+    const boost::optional<std::string> &id = boost::none,
+    Listener *listener = nullptr) {
+    return new InstanceWatcher(io_ctx, work_queue, id, listener);
   }
   void destroy() {
     delete this;
   }
 
   InstanceWatcher(librados::IoCtx &io_ctx, ContextWQ *work_queue,
-                  const boost::optional<std::string> &id = boost::none);
+                  const boost::optional<std::string> &id = boost::none,
+                  Listener *listener = nullptr);
   ~InstanceWatcher() override;
 
+  inline const std::string &get_instance_id() const {
+    return m_instance_id;
+  }
+
   int init();
   void shut_down();
 
@@ -49,6 +76,18 @@ public:
   void shut_down(Context *on_finish);
   void remove(Context *on_finish);
 
+  /// requests to another instance -- fail with -ENOENT if it is gone
+  void notify_image_acquire(const std::string &instance_id,
+                            const std::string &global_image_id,
+                            const std::string &remote_image_id,
+                            Context *on_notify_ack);
+  void notify_image_release(const std::string &instance_id,
+                            const std::string &global_image_id,
+                            bool schedule_delete, Context *on_notify_ack);
+  void notify_get_image_rates(const std::string &instance_id,
+                              ImageRates *image_rates,
+                              Context *on_notify_ack);
+
 protected:
   void handle_notify(uint64_t notify_id, uint64_t handle, uint64_t notifier_id,
                      bufferlist &bl) override;
@@ -83,8 +122,24 @@ private:
    * @endverbatim
    */
 
+  struct HandlePayloadVisitor : public boost::static_visitor<void> {
+    InstanceWatcher *instance_watcher;
+    librbd::watcher::C_NotifyAck *on_notify_ack;
+
+    HandlePayloadVisitor(InstanceWatcher *instance_watcher,
+                         librbd::watcher::C_NotifyAck *on_notify_ack)
+      : instance_watcher(instance_watcher), on_notify_ack(on_notify_ack) {
+    }
+
+    template <typename Payload>
+    inline void operator()(const Payload &payload) const {
+      instance_watcher->handle_payload(payload, on_notify_ack);
+    }
+  };
+
   bool m_owner;
   std::string m_instance_id;
+  Listener *m_listener;
 
   mutable Mutex m_lock;
   librbd::ManagedLock<ImageCtxT> *m_instance_lock;
@@ -122,6 +177,19 @@ private:
 
   void break_instance_lock();
   void handle_break_instance_lock(int r);
+
+  void notify_instance(const std::string &instance_id,
+                       const instance_watcher::Payload &payload,
+                       bufferlist *response, Context *on_notify_ack);
+
+  void handle_payload(const instance_watcher::ImageAcquirePayload &payload,
+                      librbd::watcher::C_NotifyAck *on_notify_ack);
+  void handle_payload(const instance_watcher::ImageReleasePayload &payload,
+                      librbd::watcher::C_NotifyAck *on_notify_ack);
+  void handle_payload(const instance_watcher::GetImageRatesPayload &payload,
+                      librbd::watcher::C_NotifyAck *on_notify_ack);
+  void handle_payload(const instance_watcher::UnknownPayload &payload,
+                      librbd::watcher::C_NotifyAck *on_notify_ack);
 };
 
 } // namespace mirror
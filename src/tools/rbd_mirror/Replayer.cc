@@ -217,7 +217,8 @@ Replayer::Replayer(Threads *threads, std::shared_ptr<ImageDeleter> image_deleter
   m_local_pool_id(local_pool_id),
   m_asok_hook(nullptr),
   m_replayer_thread(this),
-  m_leader_listener(this)
+  m_leader_listener(this),
+  m_instance_listener(this)
 {
 }
 
@@ -296,7 +297,9 @@ int Replayer::init()
   }
 
   m_instance_watcher.reset(InstanceWatcher<>::create(m_local_io_ctx,
-                                                     m_threads->work_queue));
+                                                     m_threads->work_queue,
+                                                     boost::none,
+                                                     &m_instance_listener));
   r = m_instance_watcher->init();
   if (r < 0) {
     derr << "error initializing instance watcher: " << cpp_strerror(r) << dendl;
@@ -453,8 +456,17 @@ void Replayer::run()
     if (m_pool_watcher->is_blacklisted()) {
       m_blacklisted = true;
       m_stopping.set(1);
-    } else if (!m_manual_stop && m_leader_watcher->is_leader()) {
-      set_sources(m_pool_watcher->get_images());
+    } else if (!m_manual_stop) {
+      set_sources(m_assigned_image_ids);
+
+      if (m_leader_watcher->is_leader()) {
+        ImageIds image_ids = m_pool_watcher->get_images();
+        scan_init_images(image_ids);
+
+        m_lock.Unlock();
+        update_image_map(image_ids);
+        m_lock.Lock();
+      }
     }
 
     if (m_blacklisted) {
@@ -587,32 +599,38 @@ void Replayer::release_leader()
   m_leader_watcher->release_leader();
 }
 
-void Replayer::set_sources(const ImageIds &image_ids)
+void Replayer::scan_init_images(const ImageIds &image_ids)
 {
-  dout(20) << "enter" << dendl;
-
   assert(m_lock.is_locked());
 
-  if (!m_init_image_ids.empty() && !m_stopping.read() &&
-      m_leader_watcher->is_leader()) {
-    dout(20) << "scanning initial local image set" << dendl;
-    for (auto &remote_image : image_ids) {
-      auto it = m_init_image_ids.find(ImageId(remote_image.global_id));
-      if (it != m_init_image_ids.end()) {
-        m_init_image_ids.erase(it);
-      }
-    }
+  if (m_init_image_ids.empty() || m_stopping.read()) {
+    return;
+  }
 
-    // the remaining images in m_init_image_ids must be deleted
-    for (auto &image_id : m_init_image_ids) {
-      dout(20) << "scheduling the deletion of init image: "
-               << image_id.global_id << " (" << image_id.id << ")" << dendl;
-      m_image_deleter->schedule_image_delete(m_local_rados, m_local_pool_id,
-                                             image_id.id, image_id.global_id);
+  dout(20) << "scanning initial local image set" << dendl;
+  for (auto &remote_image : image_ids) {
+    auto it = m_init_image_ids.find(ImageId(remote_image.global_id));
+    if (it != m_init_image_ids.end()) {
+      m_init_image_ids.erase(it);
     }
-    m_init_image_ids.clear();
   }
 
+  // the remaining images in m_init_image_ids must be deleted
+  for (auto &image_id : m_init_image_ids) {
+    dout(20) << "scheduling the deletion of init image: "
+             << image_id.global_id << " (" << image_id.id << ")" << dendl;
+    m_image_deleter->schedule_image_delete(m_local_rados, m_local_pool_id,
+                                           image_id.id, image_id.global_id);
+  }
+  m_init_image_ids.clear();
+}
+
+void Replayer::set_sources(const ImageIds &image_ids)
+{
+  dout(20) << "enter" << dendl;
+
+  assert(m_lock.is_locked());
+
   // shut down replayers for non-mirrored images
   for (auto image_it = m_image_replayers.begin();
        image_it != m_image_replayers.end();) {
@@ -721,27 +739,32 @@ bool Replayer::stop_image_replayer(unique_ptr<ImageReplayer<> > &image_replayer)
   dout(20) << "global_image_id=" << image_replayer->get_global_image_id()
            << dendl;
 
+  // images that are still mirrored are only stopped here because they
+  // moved to another instance
+  const std::string &global_image_id = image_replayer->get_global_image_id();
+  bool schedule_delete = m_delete_image_ids.count(global_image_id) != 0;
+
   // TODO: check how long it is stopping and alert if it is too long.
   if (image_replayer->is_stopped()) {
-    m_image_deleter->cancel_waiter(m_local_pool_id,
-                                   image_replayer->get_global_image_id());
+    m_image_deleter->cancel_waiter(m_local_pool_id, global_image_id);
 
-    if (!m_stopping.read() && m_leader_watcher->is_leader()) {
+    if (!m_stopping.read() && schedule_delete) {
       dout(20) << "scheduling delete" << dendl;
       m_image_deleter->schedule_image_delete(
         m_local_rados,
         image_replayer->get_local_pool_id(),
         image_replayer->get_local_image_id(),
-        image_replayer->get_global_image_id());
+        global_image_id);
     }
+    m_delete_image_ids.erase(global_image_id);
     return true;
   } else {
-    if (!m_stopping.read()) {
+    if (!m_stopping.read() && schedule_delete) {
       dout(20) << "scheduling delete after image replayer stopped" << dendl;
     }
     FunctionContext *ctx = new FunctionContext(
-        [&image_replayer, this] (int r) {
-          if (!m_stopping.read() && m_leader_watcher->is_leader() && r >= 0) {
+        [&image_replayer, schedule_delete, this] (int r) {
+          if (!m_stopping.read() && schedule_delete && r >= 0) {
             m_image_deleter->schedule_image_delete(
               m_local_rados,
               image_replayer->get_local_pool_id(),
@@ -770,19 +793,290 @@ void Replayer::handle_post_acquire_leader(Context *on_finish) {
 void Replayer::handle_pre_release_leader(Context *on_finish) {
   dout(20) << dendl;
 
+  // assigned images keep replaying: the next leader learns where they are
+  // from the image rates every instance reports
   {
     Mutex::Locker locker(m_lock);
-    set_sources(ImageIds());
-    if (!m_image_replayers.empty()) {
-      Mutex::Locker timer_locker(m_threads->timer_lock);
-      Context *task = create_async_context_callback(
-        m_threads->work_queue, new FunctionContext(
-          [this, on_finish](int r) {
-            handle_pre_release_leader(on_finish);
-          }));
-      m_threads->timer->add_event_after(1, task);
+    m_instance_ids.clear();
+  }
+
+  on_finish->complete(0);
+}
+
+void Replayer::update_image_map(const ImageIds &image_ids) {
+  dout(20) << dendl;
+
+  std::vector<std::string> instance_ids;
+  C_SaferCond get_ctx;
+  InstanceWatcher<>::get_instances(m_local_io_ctx, &instance_ids, &get_ctx);
+  int r = get_ctx.wait();
+  if (r < 0) {
+    derr << "error retrieving instances: " << cpp_strerror(r) << dendl;
+    return;
+  }
+
+  const std::string &local_instance_id = m_instance_watcher->get_instance_id();
+  if (std::find(instance_ids.begin(), instance_ids.end(),
+                local_instance_id) == instance_ids.end()) {
+    instance_ids.push_back(local_instance_id);
+  }
+
+  // an image weighs its write rate, plus one so idle images spread too
+  std::map<std::string, std::map<std::string, double> > instance_images;
+  std::map<std::string, std::string> image_instances;
+  std::list<std::pair<std::string, std::string> > releases;
+  for (auto &instance_id : instance_ids) {
+    ImageRates image_rates;
+    r = get_image_rates(instance_id, &image_rates);
+    if (r == -ENOENT) {
+      dout(10) << "removing dead instance " << instance_id << dendl;
+      C_SaferCond remove_ctx;
+      InstanceWatcher<>::remove_instance(m_local_io_ctx, m_threads->work_queue,
+                                         instance_id, &remove_ctx);
+      remove_ctx.wait();
+      continue;
+    } else if (r < 0) {
+      derr << "error retrieving image rates from instance " << instance_id
+           << ": " << cpp_strerror(r) << dendl;
       return;
     }
+
+    auto &images = instance_images[instance_id];
+    for (auto &it : image_rates) {
+      if (image_instances.count(it.first) != 0) {
+        // left behind by a previous leader
+        releases.push_back({instance_id, it.first});
+        continue;
+      }
+      image_instances[it.first] = instance_id;
+      images[it.first] = it.second + 1;
+    }
+  }
+
+  std::map<std::string, double> instance_loads;
+  for (auto &it : instance_images) {
+    double &load = instance_loads[it.first];
+    load = 0;
+    for (auto &image : it.second) {
+      load += image.second;
+    }
+  }
+
+  auto least_loaded = [&instance_loads]() {
+    auto min_it = instance_loads.begin();
+    for (auto it = instance_loads.begin(); it != instance_loads.end(); ++it) {
+      if (it->second < min_it->second) {
+        min_it = it;
+      }
+    }
+    return min_it->first;
+  };
+
+  // images no longer mirrored are deleted by the instance replaying them
+  std::list<std::pair<std::string, std::string> > deletes;
+  for (auto &it : image_instances) {
+    if (image_ids.count(ImageId(it.first)) == 0) {
+      deletes.push_back({it.second, it.first});
+      instance_loads[it.second] -= instance_images[it.second][it.first];
+      instance_images[it.second].erase(it.first);
+    }
+  }
+
+  // new images and the ones of dead instances go to the least loaded
+  std::list<std::pair<std::string, ImageId> > acquires;
+  for (auto &image_id : image_ids) {
+    auto it = image_instances.find(image_id.global_id);
+    if (it != image_instances.end() &&
+        instance_images[it->second].count(image_id.global_id) != 0) {
+      continue;
+    }
+    std::string instance_id = least_loaded();
+    acquires.push_back({instance_id, image_id});
+    instance_images[instance_id][image_id.global_id] = 1;
+    instance_loads[instance_id] += 1;
+  }
+
+  // once instances come or go, move the largest images that narrow the gap
+  // between the most and the least loaded instance
+  std::set<std::string> live_instance_ids;
+  for (auto &it : instance_images) {
+    live_instance_ids.insert(it.first);
+  }
+  if (live_instance_ids != m_instance_ids) {
+    for (size_t i = 0; i < image_ids.size(); ++i) {
+      auto max_it = instance_loads.begin();
+      for (auto it = instance_loads.begin(); it != instance_loads.end(); ++it) {
+        if (it->second > max_it->second) {
+          max_it = it;
+        }
+      }
+      std::string to_instance_id = least_loaded();
+      double gap = max_it->second - instance_loads[to_instance_id];
+
+      auto &images = instance_images[max_it->first];
+      auto image_it = images.end();
+      for (auto it = images.begin(); it != images.end(); ++it) {
+        if (it->second < gap &&
+            (image_it == images.end() || it->second > image_it->second)) {
+          image_it = it;
+        }
+      }
+      if (image_it == images.end()) {
+        break;
+      }
+
+      std::string global_image_id = image_it->first;
+      double weight = image_it->second;
+      dout(10) << "moving " << global_image_id << " from instance "
+               << max_it->first << " to " << to_instance_id << dendl;
+      if (image_instances.count(global_image_id) != 0) {
+        releases.push_back({max_it->first, global_image_id});
+      }
+      for (auto it = acquires.begin(); it != acquires.end(); ++it) {
+        if (it->second.global_id == global_image_id) {
+          acquires.erase(it);
+          break;
+        }
+      }
+      acquires.push_back({to_instance_id,
+                          *image_ids.find(ImageId(global_image_id))});
+
+      images.erase(image_it);
+      max_it->second -= weight;
+      instance_images[to_instance_id][global_image_id] = weight;
+      instance_loads[to_instance_id] += weight;
+    }
+    m_instance_ids = live_instance_ids;
+  }
+
+  // release first, so an image is never assigned twice
+  for (auto &it : deletes) {
+    release_image(it.first, it.second, true);
+  }
+  for (auto &it : releases) {
+    release_image(it.first, it.second, false);
+  }
+  for (auto &it : acquires) {
+    acquire_image(it.first, it.second);
+  }
+}
+
+int Replayer::get_image_rates(const std::string &instance_id,
+                              ImageRates *image_rates) {
+  C_SaferCond ctx;
+  if (instance_id == m_instance_watcher->get_instance_id()) {
+    handle_get_image_rates(image_rates, &ctx);
+  } else {
+    m_instance_watcher->notify_get_image_rates(instance_id, image_rates, &ctx);
+  }
+  return ctx.wait();
+}
+
+int Replayer::acquire_image(const std::string &instance_id,
+                            const ImageId &image_id) {
+  dout(20) << "instance_id=" << instance_id << ", global_image_id="
+           << image_id.global_id << dendl;
+
+  C_SaferCond ctx;
+  if (instance_id == m_instance_watcher->get_instance_id()) {
+    handle_image_acquire(image_id.global_id, image_id.id, &ctx);
+  } else {
+    m_instance_watcher->notify_image_acquire(instance_id, image_id.global_id,
+                                             image_id.id, &ctx);
+  }
+  int r = ctx.wait();
+  if (r < 0) {
+    derr << "error assigning image " << image_id.global_id << " to instance "
+         << instance_id << ": " << cpp_strerror(r) << dendl;
+  }
+  return r;
+}
+
+int Replayer::release_image(const std::string &instance_id,
+                            const std::string &global_image_id,
+                            bool schedule_delete) {
+  dout(20) << "instance_id=" << instance_id << ", global_image_id="
+           << global_image_id << ", schedule_delete=" << schedule_delete
+           << dendl;
+
+  C_SaferCond ctx;
+  if (instance_id == m_instance_watcher->get_instance_id()) {
+    handle_image_release(global_image_id, schedule_delete, &ctx);
+  } else {
+    m_instance_watcher->notify_image_release(instance_id, global_image_id,
+                                             schedule_delete, &ctx);
+  }
+  int r = ctx.wait();
+  if (r < 0) {
+    derr << "error releasing image " << global_image_id << " from instance "
+         << instance_id << ": " << cpp_strerror(r) << dendl;
+  }
+  return r;
+}
+
+void Replayer::handle_image_acquire(const std::string &global_image_id,
+                                    const std::string &remote_image_id,
+                                    Context *on_finish) {
+  dout(20) << "global_image_id=" << global_image_id << dendl;
+
+  {
+    Mutex::Locker locker(m_lock);
+    m_assigned_image_ids.erase(ImageId(global_image_id));
+    m_assigned_image_ids.insert(ImageId(global_image_id, remote_image_id));
+    m_delete_image_ids.erase(global_image_id);
+    m_cond.Signal();
+  }
+
+  on_finish->complete(0);
+}
+
+void Replayer::handle_image_release(const std::string &global_image_id,
+                                    bool schedule_delete, Context *on_finish) {
+  dout(20) << "global_image_id=" << global_image_id << ", "
+           << "schedule_delete=" << schedule_delete << dendl;
+
+  // the image replayer is stopped by the next pass of the replayer thread;
+  // until then the local image exclusive lock keeps the instance it was
+  // assigned to from replaying it as well
+  {
+    Mutex::Locker locker(m_lock);
+    m_assigned_image_ids.erase(ImageId(global_image_id));
+    if (schedule_delete) {
+      m_delete_image_ids.insert(global_image_id);
+    }
+    m_cond.Signal();
+  }
+
+  on_finish->complete(0);
+}
+
+void Replayer::handle_get_image_rates(ImageRates *image_rates,
+                                      Context *on_finish) {
+  dout(20) << dendl;
+
+  {
+    Mutex::Locker locker(m_lock);
+    utime_t now = ceph_clock_now();
+    std::map<std::string, std::pair<uint64_t, utime_t> > image_samples;
+    for (auto &image_id : m_assigned_image_ids) {
+      uint64_t bytes = 0;
+      auto it = m_image_replayers.find(image_id.global_id);
+      if (it != m_image_replayers.end()) {
+        bytes = it->second->get_replayed_bytes();
+      }
+
+      double rate = 0;
+      auto sample_it = m_image_samples.find(image_id.global_id);
+      if (sample_it != m_image_samples.end() &&
+          bytes >= sample_it->second.first &&
+          now > sample_it->second.second) {
+        rate = (bytes - sample_it->second.first) /
+               (double)(now - sample_it->second.second);
+      }
+      (*image_rates)[image_id.global_id] = rate;
+      image_samples[image_id.global_id] = {bytes, now};
+    }
+    m_image_samples = std::move(image_samples);
   }
 
   on_finish->complete(0);
@@ -17,6 +17,7 @@
 
 #include "ClusterWatcher.h"
 #include "ImageReplayer.h"
+#include "InstanceWatcher.h"
 #include "LeaderWatcher.h"
 #include "PoolWatcher.h"
 #include "ImageDeleter.h"
@@ -29,7 +30,6 @@ namespace mirror {
 
 struct Threads;
 class ReplayerAdminSocketHook;
-template <typename> class InstanceWatcher;
 
 /**
  * Controls mirroring for a single remote cluster.
@@ -58,9 +58,18 @@ public:
   void release_leader();
 
 private:
+  typedef InstanceWatcher<>::ImageRates ImageRates;
+
   void init_local_mirroring_images();
+  void scan_init_images(const ImageIds &image_ids);
   void set_sources(const ImageIds &image_ids);
 
+  void update_image_map(const ImageIds &image_ids);
+  int get_image_rates(const std::string &instance_id, ImageRates *image_rates);
+  int acquire_image(const std::string &instance_id, const ImageId &image_id);
+  int release_image(const std::string &instance_id,
+                    const std::string &global_image_id, bool schedule_delete);
+
   void start_image_replayer(unique_ptr<ImageReplayer<> > &image_replayer);
   bool stop_image_replayer(unique_ptr<ImageReplayer<> > &image_replayer);
 
@@ -70,6 +79,13 @@ private:
   void handle_post_acquire_leader(Context *on_finish);
   void handle_pre_release_leader(Context *on_finish);
 
+  void handle_image_acquire(const std::string &global_image_id,
+                            const std::string &remote_image_id,
+                            Context *on_finish);
+  void handle_image_release(const std::string &global_image_id,
+                            bool schedule_delete, Context *on_finish);
+  void handle_get_image_rates(ImageRates *image_rates, Context *on_finish);
+
   Threads *m_threads;
   std::shared_ptr<ImageDeleter> m_image_deleter;
   ImageSyncThrottlerRef<> m_image_sync_throttler;
@@ -98,6 +114,17 @@ private:
 
   std::set<ImageId> m_init_image_ids;
 
+  // images the leader assigned to this instance, and the ones it released
+  // because they are no longer mirrored
+  ImageIds m_assigned_image_ids;
+  std::set<std::string> m_delete_image_ids;
+
+  // replayed bytes and when they were sampled, to compute image rates
+  std::map<std::string, std::pair<uint64_t, utime_t> > m_image_samples;
+
+  // instances seen by the last image map update (leader only)
+  std::set<std::string> m_instance_ids;
+
   class ReplayerThread : public Thread {
     Replayer *m_replayer;
   public:
@@ -126,6 +153,34 @@ private:
     Replayer *m_replayer;
   } m_leader_listener;
 
+  class InstanceListener : public InstanceWatcher<>::Listener {
+  public:
+    InstanceListener(Replayer *replayer) : m_replayer(replayer) {
+    }
+
+    void handle_image_acquire(const std::string &global_image_id,
+                              const std::string &remote_image_id,
+                              Context *on_finish) override {
+      m_replayer->handle_image_acquire(global_image_id, remote_image_id,
+                                       on_finish);
+    }
+
+    void handle_image_release(const std::string &global_image_id,
+                              bool schedule_delete,
+                              Context *on_finish) override {
+      m_replayer->handle_image_release(global_image_id, schedule_delete,
+                                       on_finish);
+    }
+
+    void handle_get_image_rates(ImageRates *image_rates,
+                                Context *on_finish) override {
+      m_replayer->handle_get_image_rates(image_rates, on_finish);
+    }
+
+  private:
+    Replayer *m_replayer;
+  } m_instance_listener;
+
   std::unique_ptr<LeaderWatcher<> > m_leader_watcher;
   std::unique_ptr<InstanceWatcher<librbd::ImageCtx> > m_instance_watcher;
 };
@@ -4,6 +4,7 @@
 #include "ImageCopyRequest.h"
 #include "ObjectCopyRequest.h"
 #include "include/stringify.h"
+#include "common/Clock.h"
 #include "common/errno.h"
 #include "common/Timer.h"
 #include "journal/Journaler.h"
@@ -142,9 +143,14 @@ void ImageCopyRequest<I>::send_object_copies() {
   bool complete;
   {
     Mutex::Locker locker(m_lock);
-    for (int i = 0; i < cct->_conf->rbd_concurrent_management_ops; ++i) {
+    m_min_ops = MAX(1, cct->_conf->rbd_concurrent_management_ops);
+    m_limit_ops = MAX(m_min_ops, static_cast<uint64_t>(
+      cct->_conf->rbd_concurrent_management_ops_max));
+    m_max_ops = m_min_ops;
+    while (m_current_ops < m_max_ops) {
+      uint64_t current_ops = m_current_ops;
       send_next_object_copy();
-      if (m_ret_val < 0 && m_current_ops == 0) {
+      if (m_current_ops == current_ops) {
         break;
       }
     }
@@ -188,17 +194,22 @@ void ImageCopyRequest<I>::send_next_object_copy() {
   dout(20) << ": object_num=" << ono << dendl;
 
   ++m_current_ops;
+  m_in_flight_object_nos.insert(ono);
 
-  Context *ctx = create_context_callback<
-    ImageCopyRequest<I>, &ImageCopyRequest<I>::handle_object_copy>(this);
+  utime_t start_time = ceph_clock_now();
+  Context *ctx = new FunctionContext([this, ono, start_time](int r) {
+      handle_object_copy(ono, start_time, r);
+    });
   ObjectCopyRequest<I> *req = ObjectCopyRequest<I>::create(
     m_local_image_ctx, m_remote_image_ctx, &m_snap_map, ono, ctx);
   req->send();
 }
 
 template <typename I>
-void ImageCopyRequest<I>::handle_object_copy(int r) {
-  dout(20) << ": r=" << r << dendl;
+void ImageCopyRequest<I>::handle_object_copy(uint64_t object_no,
+                                             const utime_t &start_time,
+                                             int r) {
+  dout(20) << ": object_num=" << object_no << ", r=" << r << dendl;
 
   int percent;
   bool complete;
@@ -206,6 +217,7 @@ void ImageCopyRequest<I>::handle_object_copy(int r) {
     Mutex::Locker locker(m_lock);
     assert(m_current_ops > 0);
     --m_current_ops;
+    m_in_flight_object_nos.erase(object_no);
 
     percent = 100 * m_object_no / m_end_object_no;
 
@@ -214,9 +226,17 @@ void ImageCopyRequest<I>::handle_object_copy(int r) {
       if (m_ret_val == 0) {
         m_ret_val = r;
       }
+    } else {
+      update_window(ceph_clock_now() - start_time);
     }
 
-    send_next_object_copy();
+    while (m_current_ops < m_max_ops) {
+      uint64_t current_ops = m_current_ops;
+      send_next_object_copy();
+      if (m_current_ops == current_ops) {
+        break;
+      }
+    }
     complete = (m_current_ops == 0);
   }
 
@@ -243,6 +263,39 @@ void ImageCopyRequest<I>::handle_object_copy(int r) {
   }
 }
 
+template <typename I>
+void ImageCopyRequest<I>::update_window(const utime_t &latency) {
+  assert(m_lock.is_locked());
+  if (m_limit_ops <= m_min_ops) {
+    return;
+  }
+
+  m_window_latency += static_cast<double>(latency);
+  if (++m_window_ops < m_max_ops) {
+    return;
+  }
+
+  double avg_latency = m_window_latency / m_window_ops;
+  m_window_ops = 0;
+  m_window_latency = 0;
+  if (m_min_latency == 0 || avg_latency < m_min_latency) {
+    m_min_latency = avg_latency;
+  }
+
+  // widen the window while the copies don't slow down, back off
+  // quickly once they do
+  uint64_t max_ops = m_max_ops;
+  if (avg_latency < 1.5 * m_min_latency) {
+    m_max_ops = MIN(m_limit_ops, m_max_ops + MAX(1, m_max_ops / 4));
+  } else if (avg_latency > 3 * m_min_latency) {
+    m_max_ops = MAX(m_min_ops, m_max_ops / 2);
+  }
+  if (m_max_ops != max_ops) {
+    dout(10) << ": latency " << avg_latency << " (min " << m_min_latency
+             << "), window " << max_ops << " -> " << m_max_ops << dendl;
+  }
+}
+
 template <typename I>
 void ImageCopyRequest<I>::send_update_sync_point() {
   Mutex::Locker l(m_lock);
@@ -253,8 +306,15 @@ void ImageCopyRequest<I>::send_update_sync_point() {
     return;
   }
 
-  if (m_sync_point->object_number &&
-      (m_object_no-1) == m_sync_point->object_number.get()) {
+  // objects are started in order, so every object before the oldest
+  // in-flight one has been copied
+  uint64_t copied_object_no = m_object_no;
+  if (!m_in_flight_object_nos.empty()) {
+    copied_object_no = *m_in_flight_object_nos.begin();
+  }
+  if (copied_object_no == 0 ||
+      (m_sync_point->object_number &&
+       (copied_object_no - 1) == m_sync_point->object_number.get())) {
     // update sync point did not progress since last sync
     return;
   }
@@ -262,7 +322,7 @@ void ImageCopyRequest<I>::send_update_sync_point() {
   m_updating_sync_point = true;
 
   m_client_meta_copy = *m_client_meta;
-  m_sync_point->object_number = m_object_no - 1;
+  m_sync_point->object_number = copied_object_no - 1;
 
   CephContext *cct = m_local_image_ctx->cct;
   ldout(cct, 20) << ": sync_point=" << *m_sync_point << dendl;
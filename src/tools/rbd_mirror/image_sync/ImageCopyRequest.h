@@ -7,10 +7,12 @@
 #include "include/int_types.h"
 #include "include/rados/librados.hpp"
 #include "common/Mutex.h"
+#include "include/utime.h"
 #include "librbd/journal/Types.h"
 #include "librbd/journal/TypeTraits.h"
 #include "tools/rbd_mirror/BaseRequest.h"
 #include <map>
+#include <set>
 #include <vector>
 
 class Context;
@@ -98,8 +100,17 @@ private:
   uint64_t m_object_no = 0;
   uint64_t m_end_object_no;
   uint64_t m_current_ops = 0;
+  std::set<uint64_t> m_in_flight_object_nos;
   int m_ret_val = 0;
 
+  // object copy window, adapted to the latency of the copies
+  uint64_t m_min_ops = 0;
+  uint64_t m_limit_ops = 0;
+  uint64_t m_max_ops = 0;
+  uint64_t m_window_ops = 0;
+  double m_window_latency = 0;
+  double m_min_latency = 0;
+
   bool m_updating_sync_point;
   Context *m_update_sync_ctx;
   double m_update_sync_point_interval;
@@ -111,7 +122,9 @@ private:
 
   void send_object_copies();
   void send_next_object_copy();
-  void handle_object_copy(int r);
+  void handle_object_copy(uint64_t object_no, const utime_t &start_time,
+                          int r);
+  void update_window(const utime_t &latency);
 
   void send_update_sync_point();
   void handle_update_sync_point(int r);
@@ -215,6 +215,10 @@ void ObjectCopyRequest<I>::send_write_object() {
            << "local_snap_seq=" << local_snap_seq << ", "
            << "local_snaps=" << local_snap_ids << dendl;
 
+  // nothing to zero in an object that didn't exist before this snapshot,
+  // only what the sparse read returned needs to be written
+  bool sparse = (m_snap_object_creates.count(remote_snap_seq) != 0);
+
   auto &sync_ops = m_snap_sync_ops.begin()->second;
   assert(!sync_ops.empty());
   uint64_t object_offset;
@@ -226,7 +230,7 @@ void ObjectCopyRequest<I>::send_write_object() {
       object_offset = sync_op.offset;
       buffer_offset = 0;
       for (auto it : sync_op.extent_map) {
-        if (object_offset < it.first) {
+        if (object_offset < it.first && !sparse) {
           dout(20) << ": zero op: " << object_offset << "~"
                    << it.first - object_offset << dendl;
           op.zero(object_offset, it.first - object_offset);
@@ -247,7 +251,7 @@ void ObjectCopyRequest<I>::send_write_object() {
           dout(20) << ": trunc op: " << object_offset << dendl;
           op.truncate(object_offset);
           m_snap_object_sizes[remote_snap_seq] = object_offset;
-        } else {
+        } else if (!sparse) {
           dout(20) << ": zero op: " << object_offset << "~"
                    << sync_op_end - object_offset << dendl;
           op.zero(object_offset, sync_op_end - object_offset);
@@ -359,6 +363,7 @@ void ObjectCopyRequest<I>::compute_diffs() {
   m_snap_sync_ops = {};
   m_snap_object_states = {};
   m_snap_object_sizes = {};
+  m_snap_object_creates = {};
 
   librados::snap_t remote_sync_pont_snap_id = m_snap_map->rbegin()->first;
   uint64_t prev_end_size = 0;
@@ -433,6 +438,9 @@ void ObjectCopyRequest<I>::compute_diffs() {
           SYNC_OP_TYPE_TRUNC, end_size, 0U);
       }
       m_snap_object_sizes[end_remote_snap_id] = end_size;
+      if (!prev_exists) {
+        m_snap_object_creates.insert(end_remote_snap_id);
+      }
     } else {
       if (prev_exists) {
         // object remove
@@ -10,6 +10,7 @@
 #include "librbd/ImageCtx.h"
 #include <list>
 #include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -102,6 +103,7 @@ private:
   typedef std::map<WriteReadSnapIds, SyncOps> SnapSyncOps;
   typedef std::map<librados::snap_t, uint8_t> SnapObjectStates;
   typedef std::map<librados::snap_t, uint64_t> SnapObjectSizes;
+  typedef std::set<librados::snap_t> SnapIdSet;
 
   ImageCtxT *m_local_image_ctx;
   ImageCtxT *m_remote_image_ctx;
@@ -123,6 +125,7 @@ private:
   SnapSyncOps m_snap_sync_ops;
   SnapObjectStates m_snap_object_states;
   SnapObjectSizes m_snap_object_sizes;
+  SnapIdSet m_snap_object_creates; ///< snaps in which the object is created
 
   void send_list_snaps();
   void handle_list_snaps(int r);
@@ -0,0 +1,117 @@
+// -*- mode:C++; tab-width:8; c-basic-offset:2; indent-tabs-mode:t -*-
+// vim: ts=8 sw=2 smarttab
+
+#ifndef RBD_MIRROR_INSTANCE_WATCHER_TYPES_H
+#define RBD_MIRROR_INSTANCE_WATCHER_TYPES_H
+
+#include "include/int_types.h"
+#include "include/buffer_fwd.h"
+#include "include/encoding.h"
+#include <map>
+#include <string>
+#include <boost/variant.hpp>
+
+namespace ceph { class Formatter; }
+
+namespace rbd {
+namespace mirror {
+namespace instance_watcher {
+
+enum NotifyOp {
+  NOTIFY_OP_IMAGE_ACQUIRE   = 0,
+  NOTIFY_OP_IMAGE_RELEASE   = 1,
+  NOTIFY_OP_GET_IMAGE_RATES = 2,
+};
+
+struct ImageAcquirePayload {
+  static const NotifyOp NOTIFY_OP = NOTIFY_OP_IMAGE_ACQUIRE;
+
+  std::string global_image_id;
+  std::string remote_image_id;
+
+  ImageAcquirePayload() {
+  }
+  ImageAcquirePayload(const std::string &global_image_id,
+                      const std::string &remote_image_id)
+    : global_image_id(global_image_id), remote_image_id(remote_image_id) {
+  }
+
+  void encode(bufferlist &bl) const;
+  void decode(__u8 version, bufferlist::iterator &iter);
+  void dump(Formatter *f) const;
+};
+
+struct ImageReleasePayload {
+  static const NotifyOp NOTIFY_OP = NOTIFY_OP_IMAGE_RELEASE;
+
+  std::string global_image_id;
+  bool schedule_delete = false;
+
+  ImageReleasePayload() {
+  }
+  ImageReleasePayload(const std::string &global_image_id,
+                      bool schedule_delete)
+    : global_image_id(global_image_id), schedule_delete(schedule_delete) {
+  }
+
+  void encode(bufferlist &bl) const;
+  void decode(__u8 version, bufferlist::iterator &iter);
+  void dump(Formatter *f) const;
+};
+
+struct GetImageRatesPayload {
+  static const NotifyOp NOTIFY_OP = NOTIFY_OP_GET_IMAGE_RATES;
+
+  GetImageRatesPayload() {
+  }
+
+  void encode(bufferlist &bl) const;
+  void decode(__u8 version, bufferlist::iterator &iter);
+  void dump(Formatter *f) const;
+};
+
+struct UnknownPayload {
+  static const NotifyOp NOTIFY_OP = static_cast<NotifyOp>(-1);
+
+  UnknownPayload() {
+  }
+
+  void encode(bufferlist &bl) const;
+  void decode(__u8 version, bufferlist::iterator &iter);
+  void dump(Formatter *f) const;
+};
+
+typedef boost::variant<ImageAcquirePayload,
+                       ImageReleasePayload,
+                       GetImageRatesPayload,
+                       UnknownPayload> Payload;
+
+struct NotifyMessage {
+  NotifyMessage(const Payload &payload = UnknownPayload()) : payload(payload) {
+  }
+
+  Payload payload;
+
+  void encode(bufferlist& bl) const;
+  void decode(bufferlist::iterator& it);
+  void dump(Formatter *f) const;
+
+  static void generate_test_instances(std::list<NotifyMessage *> &o);
+};
+
+WRITE_CLASS_ENCODER(NotifyMessage);
+
+/// replayed bytes per second of each image an instance is replaying,
+/// keyed by global image id (reply to GetImageRates)
+typedef std::map<std::string, double> ImageRates;
+
+std::ostream &operator<<(std::ostream &out, const NotifyOp &op);
+
+} // namespace instance_watcher
+} // namespace mirror
+} // namespace rbd
+
+using rbd::mirror::instance_watcher::encode;
+using rbd::mirror::instance_watcher::decode;
+
+#endif // RBD_MIRROR_INSTANCE_WATCHER_TYPES_H
@@ -34,6 +34,8 @@
 #include <sys/socket.h>
 
 #include <iostream>
+#include <memory>
+#include <vector>
 #include <boost/regex.hpp>
 
 #include "mon/MonClient.h"
@@ -68,6 +70,9 @@ static void usage()
             << "  --nbds_max <limit>                        Override for module param nbds_max\n"
             << "  --max_part <limit>                        Override for module param max_part\n"
             << "  --exclusive                               Forbid other clients write\n"
+            << "  --connections <count>                     Number of sockets to the nbd device\n"
+            << "                                            (kernel 4.9 and later)\n"
+            << "  --queue-depth <count>                     Max in-flight requests per socket\n"
             << std::endl;
   generic_server_usage();
 }
@@ -77,9 +82,15 @@ static bool readonly = false;
 static int nbds_max = 0;
 static int max_part = 255;
 static bool exclusive = false;
+static int connections = 1;
+static int queue_depth = 128;
 
 #define RBD_NBD_BLKSIZE 512UL
 
+#ifndef NBD_FLAG_CAN_MULTI_CONN
+#define NBD_FLAG_CAN_MULTI_CONN (1 << 8)
+#endif
+
 #ifdef CEPH_BIG_ENDIAN
 #define ntohll(a) (a)
 #elif defined(CEPH_LITTLE_ENDIAN)
@@ -89,16 +100,23 @@ static bool exclusive = false;
 #endif
 #define htonll(a) ntohll(a)
 
+/**
+ * Serves the requests of one nbd socket: a reader thread submits them to
+ * librbd, at most queue_depth at a time, and a writer thread sends the
+ * replies back as they complete.
+ */
 class NBDServer
 {
 private:
   int fd;
   librbd::Image &image;
+  size_t queue_depth;
 
 public:
-  NBDServer(int _fd, librbd::Image& _image)
+  NBDServer(int _fd, librbd::Image& _image, size_t _queue_depth)
     : fd(_fd)
     , image(_image)
+    , queue_depth(_queue_depth)
     , terminated(false)
     , lock("NBDServer::Locker")
     , reader_thread(*this, &NBDServer::reader_entry)
@@ -115,7 +133,7 @@ private:
       ::shutdown(fd, SHUT_RDWR);
 
       Mutex::Locker l(lock);
-      cond.Signal();
+      cond.SignalAll();
     }
   }
 
@@ -143,6 +161,9 @@ private:
   void io_start(IOContext *ctx)
   {
     Mutex::Locker l(lock);
+    while (queue_depth > 0 && io_pending.size() >= queue_depth &&
+           !terminated.read())
+      cond.Wait(lock);
     io_pending.push_back(&ctx->item);
   }
 
@@ -152,7 +173,8 @@ private:
     assert(ctx->item.is_on_list());
     ctx->item.remove_myself();
     io_finished.push_back(&ctx->item);
-    cond.Signal();
+    // wakes both the writer and a reader held back by the queue depth
+    cond.SignalAll();
   }
 
   IOContext *wait_io_finish()
@@ -305,20 +327,20 @@ private:
 
       dout(20) << __func__ << ": got: " << *ctx << dendl;
 
-      int r = safe_write(fd, &ctx->reply, sizeof(struct nbd_reply));
+      // send the header and the read data with a single writev, straight
+      // from the buffers librbd filled
+      bufferlist bl;
+      bl.append(reinterpret_cast<char *>(&ctx->reply),
+                sizeof(struct nbd_reply));
+      if (ctx->command == NBD_CMD_READ && ctx->reply.error == htonl(0)) {
+        bl.claim_append(ctx->data);
+      }
+      int r = bl.write_fd(fd);
       if (r < 0) {
-	derr << *ctx << ": failed to write reply header: " << cpp_strerror(r)
+	derr << *ctx << ": failed to write reply: " << cpp_strerror(r)
 	     << dendl;
         return;
       }
-      if (ctx->command == NBD_CMD_READ && ctx->reply.error == htonl(0)) {
-	r = ctx->data.write_fd(fd);
-        if (r < 0) {
-	  derr << *ctx << ": failed to write replay data: " << cpp_strerror(r)
-	       << dendl;
-          return;
-	}
-      }
       dout(20) << *ctx << ": finish" << dendl;
     }
     dout(20) << __func__ << ": terminated" << dendl;
@@ -507,7 +529,8 @@ static int do_map(int argc, const char *argv[])
   unsigned long size;
 
   int index = 0;
-  int fd[2];
+  // one socket pair per connection: the kernel end, then ours
+  std::vector<std::pair<int, int> > socks;
   int nbd;
 
   librbd::image_info_t info;
@@ -543,9 +566,13 @@ static int do_map(int argc, const char *argv[])
   common_init_finish(g_ceph_context);
   global_init_chdir(g_ceph_context);
 
-  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd) == -1) {
-    r = -errno;
-    goto close_ret;
+  for (int i = 0; i < connections; ++i) {
+    int fd[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd) == -1) {
+      r = -errno;
+      goto close_fd;
+    }
+    socks.push_back(std::make_pair(fd[0], fd[1]));
   }
 
   if (devpath.empty()) {
@@ -560,7 +587,7 @@ static int do_map(int argc, const char *argv[])
         goto close_fd;
       }
 
-      r = ioctl(nbd, NBD_SET_SOCK, fd[0]);
+      r = ioctl(nbd, NBD_SET_SOCK, socks[0].first);
       if (r < 0) {
         close(nbd);
         ++index;
@@ -584,7 +611,7 @@ static int do_map(int argc, const char *argv[])
       goto close_fd;
     }
 
-    r = ioctl(nbd, NBD_SET_SOCK, fd[0]);
+    r = ioctl(nbd, NBD_SET_SOCK, socks[0].first);
     if (r < 0) {
       r = -errno;
       cerr << "rbd-nbd: the device " << devpath << " is busy" << std::endl;
@@ -593,9 +620,27 @@ static int do_map(int argc, const char *argv[])
     }
   }
 
+  for (size_t i = 1; i < socks.size(); ++i) {
+    if (ioctl(nbd, NBD_SET_SOCK, socks[i].first) < 0) {
+      // kernels before 4.9 take a single socket
+      cerr << "rbd-nbd: failed to add connection: " << cpp_strerror(errno)
+           << ", using " << i << " connection(s)" << std::endl;
+      for (size_t j = i; j < socks.size(); ++j) {
+        close(socks[j].first);
+        close(socks[j].second);
+      }
+      socks.resize(i);
+      break;
+    }
+  }
+
   flags = NBD_FLAG_SEND_FLUSH | NBD_FLAG_SEND_TRIM | NBD_FLAG_HAS_FLAGS;
   if (!snapname.empty() || readonly)
     flags |= NBD_FLAG_READ_ONLY;
+  if (socks.size() > 1) {
+    // a flush on any connection flushes the whole image
+    flags |= NBD_FLAG_CAN_MULTI_CONN;
+  }
 
   r = rados.init_with_context(g_ceph_context);
   if (r < 0)
@@ -684,11 +729,15 @@ static int do_map(int argc, const char *argv[])
     }
 
     {
-      NBDServer server(fd[1], image);
-
-      server.start();
+      std::vector<std::unique_ptr<NBDServer> > servers;
+      for (auto &sock : socks) {
+        servers.emplace_back(new NBDServer(sock.second, image, queue_depth));
+        servers.back()->start();
+      }
       ioctl(nbd, NBD_DO_IT);
-      server.stop();
+      for (auto &server : servers) {
+        server->stop();
+      }
     }
 
     r = image.update_unwatch(handle);
@@ -702,9 +751,10 @@ close_nbd:
   }
   close(nbd);
 close_fd:
-  close(fd[0]);
-  close(fd[1]);
-close_ret:
+  for (auto &sock : socks) {
+    close(sock.first);
+    close(sock.second);
+  }
   image.close();
   io_ctx.close();
   rados.shutdown();
@@ -827,6 +877,24 @@ static int rbd_nbd(int argc, const char *argv[])
       readonly = true;
     } else if (ceph_argparse_flag(args, i, "--exclusive", (char *)NULL)) {
       exclusive = true;
+    } else if (ceph_argparse_witharg(args, i, &connections, err, "--connections", (char *)NULL)) {
+      if (!err.str().empty()) {
+        cerr << err.str() << std::endl;
+        return EXIT_FAILURE;
+      }
+      if (connections < 1) {
+        cerr << "rbd-nbd: Invalid argument for connections!" << std::endl;
+        return EXIT_FAILURE;
+      }
+    } else if (ceph_argparse_witharg(args, i, &queue_depth, err, "--queue-depth", (char *)NULL)) {
+      if (!err.str().empty()) {
+        cerr << err.str() << std::endl;
+        return EXIT_FAILURE;
+      }
+      if (queue_depth < 0) {
+        cerr << "rbd-nbd: Invalid argument for queue-depth!" << std::endl;
+        return EXIT_FAILURE;
+      }
     } else {
       ++i;
     }